@@ -18,11 +18,19 @@
 // Updated 8/27/17 by Eqmule - Added Stringsafeness
 
 #include <mq/Plugin.h>
+#include <mq/base/WString.h>
 
+#include <ws2tcpip.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <list>
 #include <mutex>
+#include <string>
+#include <thread>
 
-#pragma comment(lib,"wsock32.lib")
+#pragma comment(lib,"ws2_32.lib")
 
 PreSetup("MQ2Irc");
 
@@ -55,7 +63,6 @@ char UseTimeStamp[MAX_STRING] = {0};
 char strTimeBuffer[MAX_STRING] = {0};
 char szTemp[MAX_STRING] = {0};
 char strDefault[MAX_STRING] = {0};
-std::recursive_mutex s_mutex;
 
 int maxLength;
 TIMESTAMP* pTimestamp = nullptr;
@@ -63,20 +70,16 @@ TIMESTAMP* pCurrentTimestamp = nullptr;
 int irctop = 0, ircbottom = 0, ircleft = 0, ircright = 0;
 WORD sockVersion;
 WSADATA wsaData;
-int nret;
-LPHOSTENT hostEntry;
-SOCKET theSocket;
-char* ireadbuf = new char[512];
 char buff[512];
 std::list<char*> channels;
 std::list<char*>::iterator mychan;
 void* pchan = nullptr;
 int IRCChatColor = USERCOLOR_DEFAULT;
-bool bConnecting = false;
-bool bTriedConnect = false;
-bool bConnected = false;
-SOCKADDR_IN serverInfo;
+std::atomic_bool bConnecting = false;
+std::atomic_bool bTriedConnect = false;
+std::atomic_bool bConnected = false;
 void ircout(char* text);
+void IrcSend(const char* line, bool priority = false);
 
 class CIRCWnd : public CCustomWnd
 {
@@ -106,7 +109,7 @@ public:
 					else
 					{
 						sprintf_s(buff, "PRIVMSG %s :%s\n\0", *mychan, InputBox->InputText.c_str());
-						send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+						IrcSend(buff);
 						sprintf_s(buff, "\ag<\aw%s\ag>\a-w %s\0", IrcNick, InputBox->InputText.c_str());
 						ircout(buff);
 					}
@@ -155,10 +158,11 @@ void ircout(char* text)
 		StripMQChat(text, processed);
 		CheckChatForEvent(processed);
 
-		MQToSTML(text, processed, MAX_STRING);
-		strcat_s(processed, "<br>");
+		std::string stml;
+		MQToSTML(text, stml);
+		stml.append("<br>");
 
-		MyWnd->StmlOut->AppendSTML(processed);
+		MyWnd->StmlOut->AppendSTML(CXStr{ stml });
 		MyWnd->StmlOut->SetVScrollPos(MyWnd->StmlOut->GetVScrollMax());
 	}
 	else
@@ -167,35 +171,352 @@ void ircout(char* text)
 	}
 }
 
-DWORD WINAPI IRCConnectThread(void* lpParam)
+// All of the socket work happens on the network thread, so a slow or unreachable server can't stall
+// the pulse. The game thread queues lines with IrcSend and parses what was received in OnPulse.
+std::mutex s_queueMutex;
+std::deque<std::string> s_sendQueue;
+std::deque<std::string> s_receiveQueue;
+std::deque<std::string> s_statusQueue;
+std::thread s_networkThread;
+std::string s_quitLine;
+std::atomic_bool s_stopNetwork = false;
+std::atomic_bool s_quitting = false;
+
+constexpr size_t MaxSendQueue = 500;          // chat beyond this is dropped rather than sent minutes late
+constexpr size_t MaxCoalescedLength = 400;    // leaves room in the 512 byte limit for the prefix the server adds
+
+// Flood control as in RFC 1459 section 8.10: each line costs two seconds (and another second for
+// every 120 bytes), and the client may only be ten seconds ahead of the clock.
+constexpr std::chrono::seconds LinePenalty{ 2 };
+constexpr std::chrono::seconds MaxPenalty{ 10 };
+
+void IrcSend(const char* line, bool priority)
 {
-	std::scoped_lock lock(s_mutex);
+	std::scoped_lock lock(s_queueMutex);
 
-	bConnecting = true;
-	nret = connect(theSocket, (LPSOCKADDR)& serverInfo, sizeof(struct sockaddr));
-	if (nret == SOCKET_ERROR)
+	if (priority)
+		s_sendQueue.emplace_front(line);
+	else if (s_sendQueue.size() < MaxSendQueue)
+		s_sendQueue.emplace_back(line);
+}
+
+// The QUIT is kept apart from the queue, so the network thread knows when it has been written and
+// can send it without waiting for the flood limit.
+static void IrcQuit(const char* line)
+{
+	std::scoped_lock lock(s_queueMutex);
+	s_quitLine = line;
+	s_quitting = true;
+}
+
+static bool TakeQuitLine(std::string& line)
+{
+	std::scoped_lock lock(s_queueMutex);
+
+	if (s_quitLine.empty())
+		return false;
+
+	line = std::move(s_quitLine);
+	s_quitLine.clear();
+	return true;
+}
+
+static void IrcStatus(std::string text)
+{
+	std::scoped_lock lock(s_queueMutex);
+	s_statusQueue.push_back(std::move(text));
+}
+
+// Takes the next line to send. PRIVMSGs to the same target that are queued behind it are merged into
+// it, so a burst of relayed chat costs one line of flood penalty instead of one per message.
+static bool TakeNextLine(std::string& line)
+{
+	std::scoped_lock lock(s_queueMutex);
+
+	if (s_sendQueue.empty())
+		return false;
+
+	line = std::move(s_sendQueue.front());
+	s_sendQueue.pop_front();
+
+	size_t textStart;
+	if (line.compare(0, 8, "PRIVMSG ") != 0 || (textStart = line.find(" :")) == std::string::npos)
+		return true;
+
+	const std::string prefix = line.substr(0, textStart + 2);
+
+	while (!s_sendQueue.empty() && !line.empty() && line.back() == '\n')
 	{
-		bConnected = false;
+		const std::string& next = s_sendQueue.front();
+		if (next.compare(0, prefix.length(), prefix) != 0
+			|| line.length() + 2 + next.length() - prefix.length() > MaxCoalescedLength)
+		{
+			break;
+		}
+
+		line.pop_back();
+		line.append(" | ").append(next, prefix.length());
+		s_sendQueue.pop_front();
 	}
-	else
+
+	return true;
+}
+
+template <typename Duration>
+static bool WaitForStop(Duration duration)
+{
+	const auto until = std::chrono::steady_clock::now() + duration;
+
+	while (!s_stopNetwork && std::chrono::steady_clock::now() < until)
+		Sleep(100);
+
+	return s_stopNetwork;
+}
+
+// Looks up the server without blocking a shutdown: the lookup is cancelled if the thread is stopped
+// while it is still waiting on DNS.
+static bool ResolveServer(IN_ADDR& address)
+{
+	const std::wstring host = utf8_to_wstring(IrcServer);
+
+	ADDRINFOEXW hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!overlapped.hEvent)
+		return false;
+
+	PADDRINFOEXW result = nullptr;
+	HANDLE cancelHandle = nullptr;
+	int ret = GetAddrInfoExW(host.c_str(), nullptr, NS_DNS, nullptr, &hints, &result, nullptr,
+		&overlapped, nullptr, &cancelHandle);
+
+	if (ret == WSA_IO_PENDING)
+	{
+		while (WaitForSingleObject(overlapped.hEvent, 250) == WAIT_TIMEOUT)
+		{
+			if (s_stopNetwork)
+			{
+				// The result is only ours to free once the cancelled lookup has completed.
+				GetAddrInfoExCancel(&cancelHandle);
+				WaitForSingleObject(overlapped.hEvent, INFINITE);
+				break;
+			}
+		}
+
+		ret = GetAddrInfoExOverlappedResult(&overlapped);
+	}
+
+	CloseHandle(overlapped.hEvent);
+
+	const bool found = ret == NO_ERROR && result && result->ai_addr;
+	if (found)
+		address = reinterpret_cast<const SOCKADDR_IN*>(result->ai_addr)->sin_addr;
+
+	if (result)
+		FreeAddrInfoExW(result);
+
+	return found;
+}
+
+static SOCKET ConnectToServer()
+{
+	IN_ADDR address = {};
+	if (!ResolveServer(address))
+	{
+		if (!s_stopNetwork)
+			IrcStatus("\ar#\ax Host lookup error");
+		return INVALID_SOCKET;
+	}
+
+	SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock == INVALID_SOCKET)
+	{
+		IrcStatus("\ar#\ax Socket error");
+		return INVALID_SOCKET;
+	}
+
+	unsigned long nonblocking = 1;
+	ioctlsocket(sock, FIONBIO, &nonblocking);
+
+	SOCKADDR_IN serverInfo = {};
+	serverInfo.sin_family = AF_INET;
+	serverInfo.sin_addr = address;
+	serverInfo.sin_port = htons(IrcPort);
+
+	if (connect(sock, (LPSOCKADDR)&serverInfo, sizeof(struct sockaddr)) != SOCKET_ERROR
+		|| WSAGetLastError() == WSAEWOULDBLOCK)
+	{
+		// Give up after 30 seconds, checking for a shutdown while waiting.
+		for (int waited = 0; waited < 30000 && !s_stopNetwork; waited += 250)
+		{
+			WSAPOLLFD fd = { sock, POLLWRNORM, 0 };
+			int ret = WSAPoll(&fd, 1, 250);
+			if (ret == SOCKET_ERROR || (ret > 0 && (fd.revents & (POLLERR | POLLHUP))))
+				break;
+
+			if (ret > 0 && (fd.revents & POLLWRNORM))
+				return sock;
+		}
+	}
+
+	closesocket(sock);
+	return INVALID_SOCKET;
+}
+
+// Sends and receives until the connection is lost, the user quits or the thread is stopped.
+static void RunConnection(SOCKET sock)
+{
+	std::string received;
+	std::string pending;
+	std::string line;
+	auto messageTimer = std::chrono::steady_clock::now();
+	bool quitQueued = false;
+	char buffer[4096];
+
+	while (!s_stopNetwork)
 	{
-		unsigned long nonblocking = 1;
-		ioctlsocket(theSocket, FIONBIO, &nonblocking);
-		Sleep((clock_t)2 * CLOCKS_PER_SEC / 2);
+		const auto now = std::chrono::steady_clock::now();
+		if (messageTimer < now)
+			messageTimer = now;
+
+		// The QUIT isn't held back by the flood limit, and nothing is sent after it.
+		if (!quitQueued && TakeQuitLine(line))
+		{
+			pending.append(line);
+			quitQueued = true;
+		}
+
+		// Everything allowed by the flood limit goes out in one write.
+		while (!quitQueued && messageTimer - now < MaxPenalty && TakeNextLine(line))
+		{
+			messageTimer += LinePenalty + std::chrono::seconds(line.length() / 120);
+			pending.append(line);
+		}
 
-		sprintf_s(buff, "NICK %s\n\0", IrcNick);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
-		sprintf_s(buff, "USER %s %s %s :%s\n\0", Username, IrcNick, IrcNick, Realname);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
-		sprintf_s(buff, "JOIN %s\n\0", IrcChan);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
-		bConnected = true;
+		if (!pending.empty())
+		{
+			int ret = send(sock, pending.data(), static_cast<int>(pending.length()), 0);
+			if (ret == SOCKET_ERROR)
+			{
+				if (WSAGetLastError() != WSAEWOULDBLOCK)
+					return;
+			}
+			else
+			{
+				pending.erase(0, ret);
+			}
+		}
+
+		// Once the QUIT itself has been written there is nothing left to do.
+		if (quitQueued && pending.empty())
+			return;
+
+		WSAPOLLFD fd = { sock, static_cast<SHORT>(pending.empty() ? POLLRDNORM : POLLRDNORM | POLLWRNORM), 0 };
+		if (WSAPoll(&fd, 1, 100) == SOCKET_ERROR)
+			return;
+
+		if (fd.revents & (POLLRDNORM | POLLHUP | POLLERR))
+		{
+			int ret = recv(sock, buffer, sizeof(buffer), 0);
+			if (ret == 0 || (ret == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK))
+				return;
+
+			if (ret > 0)
+			{
+				received.append(buffer, ret);
+
+				std::scoped_lock lock(s_queueMutex);
+
+				size_t start = 0;
+				size_t end;
+				while ((end = received.find('\n', start)) != std::string::npos)
+				{
+					s_receiveQueue.emplace_back(received, start, end - start);
+					start = end + 1;
+				}
+
+				received.erase(0, start);
+
+				// Lines are at most 512 bytes, this isn't irc.
+				if (received.length() > 512)
+					received.clear();
+			}
+		}
+	}
+}
+
+static void NetworkThread()
+{
+	bool connectedOnce = false;
+	int attempt = 0;
+
+	while (!s_stopNetwork)
+	{
+		SOCKET sock = ConnectToServer();
+		if (sock != INVALID_SOCKET)
+		{
+			attempt = 0;
+
+			// Registration goes ahead of anything that was queued while offline.
+			char line[512];
+			sprintf_s(line, "JOIN %s\n", IrcChan);
+			IrcSend(line, true);
+			sprintf_s(line, "USER %s %s %s :%s\n", Username, IrcNick, IrcNick, Realname);
+			IrcSend(line, true);
+			sprintf_s(line, "NICK %s\n", IrcNick);
+			IrcSend(line, true);
+
+			bConnected = true;
+			bConnecting = false;
+			if (connectedOnce)
+				IrcStatus("\ar#\ax Reconnected.");
+			else
+				bTriedConnect = true;
+			connectedOnce = true;
+
+			RunConnection(sock);
+
+			closesocket(sock);
+			bConnected = false;
+		}
+		else if (!connectedOnce)
+		{
+			// The first attempt is reported by OnPulse, and isn't retried.
+			bTriedConnect = true;
+			break;
+		}
+
+		if (s_stopNetwork || s_quitting)
+			break;
+
+		// Counts as connecting, so /iconnect doesn't start another one and /i quit stops this one.
+		bConnecting = true;
+
+		const int delay = std::min(5 << std::min(attempt++, 6), 300);
+		IrcStatus("\ar#\ax Connection lost, reconnecting in " + std::to_string(delay) + " seconds.");
+
+		if (WaitForStop(std::chrono::seconds(delay)))
+			break;
 	}
 
-	bTriedConnect = true;
 	bConnecting = false;
+}
 
-	return 0;
+static void StopNetworkThread()
+{
+	s_stopNetwork = true;
+	if (s_networkThread.joinable())
+		s_networkThread.join();
+	s_stopNetwork = false;
+
+	std::scoped_lock lock(s_queueMutex);
+	s_sendQueue.clear();
+	s_receiveQueue.clear();
+	s_quitLine.clear();
 }
 
 void TimeStampCmd(SPAWNINFO* pChar, char* szLine)
@@ -309,30 +630,14 @@ void IrcConnectCmd(SPAWNINFO* pChar, char* szLine)
 		MyWnd->StmlOut->SetWindowText(buff);
 	}
 
-	sockVersion = MAKEWORD(1, 1);
+	sockVersion = MAKEWORD(2, 2);
 	WSAStartup(sockVersion, &wsaData);
-	hostEntry = gethostbyname(IrcServer);
-	if (!hostEntry)
-	{
-		ircout("\ar#\ax gethostbyname error");
-		WSACleanup();
-		return;
-	}
-
-	theSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-	if (theSocket == INVALID_SOCKET)
-	{
-		ircout("\ar#\ax Socket error");
-		WSACleanup();
-		return;
-	}
 
-	serverInfo.sin_family = AF_INET;
-	serverInfo.sin_addr = *((LPIN_ADDR)* hostEntry->h_addr_list);
-	serverInfo.sin_port = htons(IrcPort);
-	DWORD ThreadId;
-	CreateThread(NULL, 0, &IRCConnectThread, 0, 0, &ThreadId);
-	return;
+	// The lookup and connect happen on the network thread.
+	StopNetworkThread();
+	s_quitting = false;
+	bConnecting = true;
+	s_networkThread = std::thread(NetworkThread);
 }
 
 void IrcCmd(SPAWNINFO* pChar, char* szLine)
@@ -340,6 +645,13 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	char szCmd[MAX_STRING] = { 0 };
 	strcpy_s(szCmd, szLine);
 
+	if (!bConnected && bConnecting && !_strnicmp(szLine, "quit", 4))
+	{
+		StopNetworkThread();
+		ircout("\ar#\ax Stopped connecting.");
+		return;
+	}
+
 	if (!bConnected)
 	{
 		ircout("\ar#\ax You are not connected. Please use /iconnect to establish a connection.");
@@ -375,7 +687,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	if (!strcmp(szArg1, "NICK"))
 	{
 		sprintf_s(buff, "NICK %s\n\0", z[1]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		WritePrivateProfileString("Last Connect", "Nick", IrcNick, INIFileName);
 		WritePrivateProfileString(IrcServer, "Nick", IrcNick, INIFileName);
 		return;
@@ -384,7 +696,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	if (!strcmp(szArg1, "JOIN"))
 	{
 		sprintf_s(buff, "JOIN %s\n\0", z[1]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		WritePrivateProfileString("Last Connect", "Chan", IrcChan, INIFileName);
 		WritePrivateProfileString(IrcServer, "Chan", IrcChan, INIFileName);
 		return;
@@ -393,14 +705,14 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	if (!strcmp(szArg1, "PART"))
 	{
 		sprintf_s(buff, "PART %s\n\0", *mychan);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		return;
 	}
 
 	if (!strcmp(szArg1, "WHOIS"))
 	{
 		sprintf_s(buff, "WHOIS %s\n\0", z[1]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		return;
 	}
 
@@ -414,7 +726,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	if (!strcmp(szArg1, "QUIT"))
 	{
 		sprintf_s(buff, "QUIT :%s\n\0", z[1]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcQuit(buff);
 		bConnected = false;
 		ircout("\ar#\ax Connection Closed, you can unload MQ2Irc now.");
 		return;
@@ -423,7 +735,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	if (!strcmp(szArg1, "RAW"))
 	{
 		sprintf_s(buff, "%s\n\0", z[1]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		sprintf_s(buff, "\ab[\a-yraw\ab(\ay%s\ab)]\a-w %s\0", IrcServer, z[1]);
 		ircout(buff);
 		return;
@@ -438,7 +750,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 		}
 
 		sprintf_s(buff, "PRIVMSG %s :%s\n\0", *mychan, z[1]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		sprintf_s(buff, "\ag<\aw%s\ag>\a-w %s\0", IrcNick, z[1]);
 		ircout(buff);
 		return;
@@ -447,7 +759,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 	if (!strcmp(szArg1, "NAMES"))
 	{
 		sprintf_s(buff, "NAMES %s\n\0", IrcChan);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		return;
 	}
 
@@ -482,7 +794,7 @@ void IrcCmd(SPAWNINFO* pChar, char* szLine)
 		}
 		// FIXME:  z[2] is out of bounds (probably wrong above too).
 		sprintf_s(buff, "PRIVMSG %s :%s\n\0", z[1], z[2]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff);
 		sprintf_s(buff, "\ab[\a-rmsg\ab(\ar%s\ab)]\a-w %s\0", z[1], z[2]);
 		ircout(buff);
 		return;
@@ -583,7 +895,7 @@ char* parse(char* rawmsg)
 	if (!strcmp(command, "PING"))
 	{
 		sprintf_s(buff, "PONG %s\n\0", param[0]);
-		send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+		IrcSend(buff, true);
 
 		return nullptr;
 	}
@@ -687,7 +999,7 @@ char* parse(char* rawmsg)
 		if (!strcmp(param[1], "\001VERSION\001"))
 		{
 			sprintf_s(buff, "NOTICE %s :\001VERSION %s\001\n\0", prefix, Version);
-			send(theSocket, buff, static_cast<int>(strlen(buff)), 0);
+			IrcSend(buff);
 			sprintf_s(buff, "\ab[\ao%s\ab(\a-octcp\ab)]\a-w VERSION", prefix);
 			return buff;
 		}
@@ -1023,7 +1335,7 @@ PLUGIN_API void ShutdownPlugin()
 	RemoveCommand("/itimestamp");
 	RemoveMQ2Data("Irc");
 
-	// todo: wait to ensure we aren't trying to connect
+	StopNetworkThread();
 
 	delete pIrcType;
 }
@@ -1043,24 +1355,29 @@ PLUGIN_API void OnPulse()
 		}
 	}
 
-	// Fill the input buffer with new data, if any.
+	std::deque<std::string> status;
+	std::deque<std::string> received;
+	{
+		std::scoped_lock lock(s_queueMutex);
+		status.swap(s_statusQueue);
+		received.swap(s_receiveQueue);
+	}
 
-	for (int i = 0; i < 512; i++)
+	for (std::string& text : status)
 	{
-		int err = recv(theSocket, &ireadbuf[i], 1, 0);
-		if ((ireadbuf[i] == '\n') || (err == 0) || (err == SOCKET_ERROR))
-		{
-			if (ireadbuf[i] == '\n')
-			{
-				ireadbuf[i] = '\0';
-				char* message;
-				if ((message = parse(ireadbuf)) != nullptr)
-				{
-					ircout(message);
-				}
-			}
+		ircout(text.data());
+	}
 
-			break;
+	// Lines that the network thread received.
+	for (const std::string& line : received)
+	{
+		char ireadbuf[512];
+		strncpy_s(ireadbuf, line.c_str(), _TRUNCATE);
+
+		char* message;
+		if ((message = parse(ireadbuf)) != nullptr)
+		{
+			ircout(message);
 		}
 	}
 }
@@ -24,6 +24,8 @@
 #include "TelnetServer.h"
 
 #include <mutex>
+#include <string_view>
+#include <vector>
 
 #pragma comment(lib, "ws2_32")
 
@@ -37,7 +39,7 @@ SOCKET Listener;
 bool bListening;
 bool bKillThread;
 bool bThreading;
-TXTBUFFER* Sends = nullptr;
+std::vector<std::string> Sends;
 TXTBUFFER* Commands = 0;
 bool LocalOnly = true;
 bool ANSI = true;
@@ -46,6 +48,76 @@ char TelnetPasswordPrompt[MAX_STRING] = { 0 };
 char TelnetWelcome[MAX_STRING] = { 0 };
 extern int PortUsed;
 
+// Chat is dropped for a connection that has this much waiting to be sent, so a slow client can only
+// fall behind, it can't hold up the others or grow without bound.
+constexpr size_t MaxPendingOutput = 64 * 1024;
+
+static void QueueOutput(TELNET* Conn, std::string_view text)
+{
+	Conn->Output.append(text);
+}
+
+static void QueueChat(TELNET* Conn, std::string_view line)
+{
+	std::string notice;
+	if (Conn->DroppedLines)
+		notice = "[MQ2Telnet: " + std::to_string(Conn->DroppedLines) + " lines dropped]\r\n";
+
+	if (Conn->Output.length() + notice.length() + line.length() + 2 > MaxPendingOutput)
+	{
+		++Conn->DroppedLines;
+		return;
+	}
+
+	Conn->Output.append(notice);
+	Conn->Output.append(line);
+	Conn->Output.append("\r\n");
+	Conn->DroppedLines = 0;
+}
+
+// Sends as much of the queued output as the socket takes without blocking.
+static void FlushOutput(TELNET* Conn)
+{
+	size_t sent = 0;
+	while (sent < Conn->Output.length())
+	{
+		int ret = send(Conn->connection->m_Socket, Conn->Output.data() + sent,
+			static_cast<int>(std::min<size_t>(Conn->Output.length() - sent, 16 * 1024)), 0);
+		if (ret == SOCKET_ERROR)
+		{
+			if (WSAGetLastError() != WSAEWOULDBLOCK)
+				Conn->Failed = true;
+			break;
+		}
+
+		sent += ret;
+	}
+
+	Conn->Output.erase(0, sent);
+}
+
+// Sleeps until a socket has something to read or room to write queued output, or a short timeout
+// passes so that new chat is picked up.
+static void WaitForSockets()
+{
+	std::vector<WSAPOLLFD> fds;
+
+	if (bListening)
+		fds.push_back({ Listener, POLLRDNORM, 0 });
+
+	{
+		std::scoped_lock lock(s_listMutex);
+		for (TELNET* Conn = Connections; Conn; Conn = Conn->pNext)
+		{
+			fds.push_back({ Conn->connection->m_Socket,
+				static_cast<SHORT>(Conn->Output.empty() ? POLLRDNORM : POLLRDNORM | POLLWRNORM), 0 });
+		}
+	}
+
+	if (fds.empty() || WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), 10) == SOCKET_ERROR)
+		Sleep(10);
+}
+
 DWORD WINAPI ProcessingThread(void* lpParam)
 {
 	std::scoped_lock lock(s_processingMutex);
@@ -61,8 +133,7 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 		// process new connections
 		if (bListening)
 		{
-			incoming = accept(Listener, nullptr, nullptr);
-			if (incoming != INVALID_SOCKET)
+			while ((incoming = accept(Listener, nullptr, nullptr)) != INVALID_SOCKET)
 			{
 				int ret = 0;
 				sockaddr_in addr;
@@ -83,8 +154,7 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 
 				std::scoped_lock lock(s_listMutex);
 
-				TELNET* NewConn = new TELNET;
-				memset(NewConn, 0, sizeof(TELNET));
+				TELNET* NewConn = new TELNET();
 
 				CWinTelnet* telnet = new CWinTelnet;
 				telnet->m_Socket = incoming;
@@ -100,27 +170,18 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 			}
 		}
 
-			// process sends
-		std::unique_lock lock(s_bufferMutex);
-
-		TELNET* Conn = Connections;
-		char szText[MAX_STRING * 25] = { 0 };
-		TXTBUFFER* pBuff = Sends;
-		while (pBuff)
+		// process sends
+		std::vector<std::string> chat;
 		{
-			TXTBUFFER* NextChat = pBuff->pNext;
-			strcat_s(szText, pBuff->szText);
-			strcat_s(szText, "\r\n");
-			free(pBuff);
-			pBuff = NextChat;
+			std::scoped_lock lock(s_bufferMutex);
+			chat.swap(Sends);
 		}
-		Sends = nullptr;
-		lock.unlock();
 
-		std::scoped_lock lock2(s_listMutex);
+		std::unique_lock lock2(s_listMutex);
+		TELNET* Conn = Connections;
 		while (Conn)
 		{
-			if (!Conn->connection->isConnected())
+			if (Conn->Failed || !Conn->connection->isConnected())
 			{
 				// remove connection...
 				TELNET* Next = Conn->pNext;
@@ -146,17 +207,20 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 			switch (Conn->State)
 			{
 			case TS_MAININPUT:
-				Conn->connection->WriteStr(szText);
+				for (const std::string& line : chat)
+					QueueChat(Conn, line);
 				break;
 			case TS_SENDLOGIN:
-				Conn->connection->WriteStr(TelnetLoginPrompt);
+				QueueOutput(Conn, TelnetLoginPrompt);
 				Conn->State = TS_GETLOGIN;
 				break;
 			case TS_SENDPASSWORD:
-				Conn->connection->WriteStr(TelnetPasswordPrompt);
+				QueueOutput(Conn, TelnetPasswordPrompt);
 				Conn->State = TS_GETPASSWORD;
 				break;
 			}
+
+			FlushOutput(Conn);
 			Conn = Conn->pNext;
 		}
 
@@ -244,7 +308,7 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 					}
 					else
 					{
-						Conn->connection->WriteStr("invalid\r\n");
+						QueueOutput(Conn, "invalid\r\n");
 						Conn->State = TS_SENDLOGIN;
 					}
 				}
@@ -253,16 +317,17 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 					// process password
 					if (!strcmp(Conn->Password, Conn->Received->szText))
 					{
-						Conn->connection->WriteStr(TelnetWelcome);
-						Conn->connection->WriteStr("\r\n");
+						QueueOutput(Conn, TelnetWelcome);
+						QueueOutput(Conn, "\r\n");
 						Conn->State = TS_MAININPUT;
 					}
 					else
 					{
-						Conn->connection->WriteStr("invalid\r\n");
+						QueueOutput(Conn, "invalid\r\n");
 						if (++Conn->PasswordTries >= 3)
 						{
-							Conn->connection->WriteStr("3 strikes, you're out. later.\r\n");
+							QueueOutput(Conn, "3 strikes, you're out. later.\r\n");
+							FlushOutput(Conn);
 							Conn->connection->Disconnect();
 						}
 						Conn->State = TS_SENDPASSWORD;
@@ -278,10 +343,12 @@ DWORD WINAPI ProcessingThread(void* lpParam)
 				Conn->Received = Next;
 			}
 
+			FlushOutput(Conn);
 			Conn = Conn->pNext;
 		}
 
-		Sleep(10);
+		lock2.unlock();
+		WaitForSockets();
 	}
 
 	DebugSpew("MQ2Telnet processing thread ending");
@@ -294,7 +361,7 @@ CTelnetServer::CTelnetServer()
 	WSADATA wsa;
 	WSAStartup(MAKEWORD(2, 0), &wsa);
 
-	Sends = nullptr;
+	Sends.clear();
 	Commands = nullptr;
 	Connections = nullptr;
 	bListening = false;
@@ -358,23 +425,9 @@ void CTelnetServer::Broadcast(char* String)
 {
 	std::scoped_lock lock(s_bufferMutex);
 
-	TXTBUFFER* pChat = (TXTBUFFER*)malloc(sizeof(TXTBUFFER));
-
-	if (pChat)
-	{
-		strcpy_s(pChat->szText, String);
-		pChat->pNext = nullptr;
-		if (!Sends)
-		{
-			Sends = pChat;
-		}
-		else
-		{
-			TXTBUFFER* pCurrent;
-			for (pCurrent = Sends; pCurrent->pNext; pCurrent = pCurrent->pNext);
-			pCurrent->pNext = pChat;
-		}
-	}
+	// The thread takes everything on every pass, so this only fills up if it is stuck.
+	if (Sends.size() < 1000)
+		Sends.emplace_back(String);
 }
 
 void CTelnetServer::Shutdown()
@@ -404,11 +457,9 @@ void CTelnetServer::Shutdown()
 	}
 
 	// delete all extra shit
-	while (Sends)
 	{
-		TXTBUFFER* pNext = Sends->pNext;
-		free(Sends);
-		Sends = pNext;
+		std::scoped_lock lock(s_bufferMutex);
+		Sends.clear();
 	}
 
 	while (Commands)
@@ -16,6 +16,8 @@
 
 #include "WinTelnet.h"
 
+#include <string>
+
 #define TS_SENDLOGIN    0
 #define TS_GETLOGIN     1
 #define TS_SENDPASSWORD 2
@@ -44,6 +46,9 @@ struct TELNET
 	int PasswordTries;
 	char Buffer[MAX_STRING];
 	TXTBUFFER* Received;
+	std::string Output;          // queued for sending, flushed as the socket accepts it
+	int DroppedLines;            // chat dropped since the last that fit in Output
+	bool Failed;
 	TELNET* pLast;
 	TELNET* pNext;
 };
@@ -25,6 +25,12 @@ MQLIB_API const eqlib::Achievement* GetAchievementByName(std::string_view name);
 // Look up an achievement by its id.
 MQLIB_API const eqlib::Achievement* GetAchievementById(int id);
 
+// Look up the index of an achievement by name, or -1 if there is none.
+MQLIB_API int GetAchievementIndexByName(std::string_view name);
+
+// Look up the index of an achievement in a category by name, or -1 if the category doesn't have it.
+MQLIB_API int GetAchievementIndexInCategoryByName(const eqlib::AchievementCategory* category, std::string_view name);
+
 // Check if an achievement is completed
 MQLIB_API bool IsAchievementComplete(const eqlib::Achievement* achievement);
 
@@ -14,9 +14,12 @@
 
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace mq {
 
@@ -35,6 +38,8 @@ enum class ResponseStatus : int8_t
 	NoConnection            = -2,                  // no connection established
 	RoutingFailed           = -3,                  // message routing failed
 	AmbiguousRecipient      = -4,                  // RPC message couldn't determine single recipient
+	Timeout                 = -5,                  // RPC message didn't get a reply in time
+	TooManyRequests         = -6,                  // too many RPC messages are waiting for replies
 };
 
 /**
@@ -62,6 +67,9 @@ struct Address
 
 	/** Used to specify if the mailbox is fully qualified (default to false) */
 	bool AbsoluteMailbox = false;
+
+	/** The topic of the message. If this is specified, only the mailboxes that subscribe to it get the message */
+	std::optional<std::string> Topic;
 };
 
 /**
@@ -141,6 +149,22 @@ struct DropboxAPI
 	 */
 	void PostReply(const std::shared_ptr<Message>& message, const std::string& data, uint8_t status = 0) const;
 
+	/**
+	 * Subscribes the mailbox to a topic, so it gets the messages that are sent to the topic
+	 *
+	 * @param topic the topic to subscribe to
+	 * @return true if the mailbox wasn't subscribed already
+	 */
+	bool Subscribe(const std::string& topic) const;
+
+	/**
+	 * Unsubscribes the mailbox from a topic
+	 *
+	 * @param topic the topic to unsubscribe from
+	 * @return true if the mailbox was subscribed
+	 */
+	bool Unsubscribe(const std::string& topic) const;
+
 	/**
 	 * Removes the mailbox with the same name from the post office
 	 */
@@ -188,6 +212,73 @@ void SendToActor(const Address& address, const T& obj, const ResponseCallbackAPI
  */
 void SendToActor(const Address& address, const std::string& data, const ResponseCallbackAPI& callback = nullptr);
 
+/**
+ * A value of a ${} expression evaluated on another client. Expressions that are a single ${} keep
+ * the type they had there, anything else is a string.
+ */
+struct RemoteValue
+{
+	enum class Kind
+	{
+		Null,                         // the expression didn't evaluate to anything
+		String,
+		Integer,
+		Number,
+		Boolean,
+	};
+
+	Kind ValueKind = Kind::Null;
+	std::string String;               // also set for the other kinds, the same as the value parses to
+	int64_t Integer = 0;
+	double Number = 0.0;
+	bool Boolean = false;
+	std::string TypeName;             // the macro data type it came from, "string" for text
+};
+
+/**
+ * An expression of a remote subscription whose value changed.
+ */
+struct RemoteValueChange
+{
+	size_t Index;                     // Index of the expression in the list the subscription was made with
+	RemoteValue Value;
+};
+
+using RemoteQueryCallback = std::function<void(int status, const std::vector<RemoteValue>& values)>;
+using RemoteSubscriptionCallback = std::function<void(const std::vector<RemoteValueChange>& changes)>;
+
+/**
+ * Evaluates ${} expressions on another client and returns the values. The callback is invoked on
+ * the main thread with a status of 0 and a value for each expression, or with one of the
+ * ResponseStatus codes and no values.
+ *
+ * @param address the client to evaluate the expressions on, its mailbox is ignored
+ * @param expressions the expressions, like "${Me.PctHPs}"
+ * @param callback the function to invoke with the values
+ */
+void QueryRemoteData(const Address& address, std::vector<std::string> expressions, RemoteQueryCallback callback);
+
+/**
+ * Watches ${} expressions on another client. The client evaluates them at most every interval,
+ * and sends only the values that changed. The first update has every value.
+ *
+ * @param address the client to evaluate the expressions on, its mailbox is ignored
+ * @param expressions the expressions, like "${Me.PctHPs}"
+ * @param interval how often the client checks the expressions
+ * @param callback the function to invoke on the main thread with the changes
+ * @return an id that can be passed to UnsubscribeRemoteData, or 0 if nothing is being watched
+ */
+int SubscribeRemoteData(const Address& address, std::vector<std::string> expressions,
+	std::chrono::milliseconds interval, RemoteSubscriptionCallback callback);
+
+/**
+ * Stops watching the expressions of a subscription made with SubscribeRemoteData.
+ *
+ * @param subscriptionId the id returned by SubscribeRemoteData
+ * @return true if the subscription was removed
+ */
+bool UnsubscribeRemoteData(int subscriptionId);
+
 } // namespace postoffice
 
 } // namespace mq
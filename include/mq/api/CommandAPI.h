@@ -16,6 +16,7 @@
 
 #include "mq/base/Common.h"
 #include <functional>
+#include <string>
 
 namespace eqlib
 {
@@ -76,6 +77,37 @@ bool IsCommand(std::string_view command);
  */
 void DoCommand(const char* command, bool delayed = true);
 
+struct MQCommand;
+
+/**
+ * A command line that is run many times, such as the command of a key bind. The alias and the
+ * command it runs are looked up the first time it runs, and again only once a command or alias was
+ * added or removed (which includes plugins loading and unloading), or Line was changed. ${}
+ * expressions in the arguments are still parsed every time, through the compiled expression cache.
+ */
+struct MQCompiledCommand
+{
+	MQCompiledCommand() = default;
+	explicit MQCompiledCommand(std::string line) : Line(std::move(line)) {}
+
+	std::string Line;
+
+	// Filled in when the command is resolved.
+	std::string ResolvedLine;                    // Line at the time it was resolved
+	std::string ExpandedLine;                    // Line with its alias expanded
+	size_t ArgumentOffset = 0;
+	MQCommand* ResolvedCommand = nullptr;        // null if the command is run through DoCommand
+	uint32_t ResolvedGeneration = 0;
+	int ResolvedGameState = -1;
+};
+
+/**
+ * Execute a compiled chat command immediately.
+ *
+ * @param command The compiled command to execute. Its resolved state is updated if needed.
+ */
+void DoCommand(MQCompiledCommand& command);
+
 /**
  * Execute a chat command with printf style formatting. Behaves the same as `DoCommand`,
  * with delay set to false. This version is provided as a convenience.
@@ -0,0 +1,133 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace eqlib {
+	class PlayerClient;
+}
+
+namespace mq {
+
+/**
+ * The steps of casting a spell, from the cast beginning to the spell gems being usable again.
+ */
+enum class MQCastPhase
+{
+	Idle,                             // Nothing has been cast since MacroQuest was loaded
+	Begin,                            // A cast began
+	Interrupted,                      // The cast was interrupted, or ended before it finished
+	Fizzled,                          // The spell fizzled
+	Landed,                           // The cast finished
+	Resisted,                         // The target resisted the spell that landed last, or it did not take hold
+	Recovered,                        // The spell gems recovered from the last cast
+};
+
+/**
+ * What changed about the pet, in a PetChanged event.
+ */
+enum MQPetChange : uint32_t
+{
+	MQPetChange_Spawn    = 1 << 0,    // The pet was gained, lost or replaced
+	MQPetChange_Target   = 1 << 1,    // The pet changed targets
+	MQPetChange_HP       = 1 << 2,    // The percent health of the pet changed
+	MQPetChange_Stance   = 1 << 3,    // The pet switched between follow and guard
+	MQPetChange_Commands = 1 << 4,    // Hold, taunt, focus, or another toggle of the pet window changed
+	MQPetChange_Buffs    = 1 << 5,    // A buff landed on the pet, faded, or was refreshed
+};
+
+/**
+ * What changed about the mercenary, in a MercenaryChanged event.
+ */
+enum MQMercenaryChange : uint32_t
+{
+	MQMercenaryChange_Spawn  = 1 << 0,  // The mercenary spawned, despawned or was replaced
+	MQMercenaryChange_State  = 1 << 1,  // The mercenary became active, suspended or died
+	MQMercenaryChange_Stance = 1 << 2,  // The stance of the mercenary changed
+	MQMercenaryChange_HP     = 1 << 3,  // The percent health of the mercenary changed
+};
+
+/**
+ * Changes to the game that MacroQuest checks for once per pulse, before plugins are pulsed.
+ */
+enum class MQGameEvent
+{
+	GameStateChanged,                 // GameState holds the new game state
+	ZoneChanged,                      // ZoneID holds the zone we just finished zoning into
+	TargetChanged,                    // Target holds the new target, or null if it was cleared
+	GroupChanged,                     // The group was joined or left, or its leader or members changed
+	MovingChanged,                    // Moving holds whether we started or stopped moving
+	CastingChanged,                   // SpellID holds the spell we started casting, or -1 if the cast ended
+	BuffsChanged,                     // A buff landed on us, faded, or moved to another slot
+	RaidChanged,                      // The raid was joined or left, or its members changed
+	XTargetChanged,                   // XTargetSlots holds the extended target slots that changed
+	TaskObjectiveProgress,            // TaskID, ObjectiveIndex and ObjectiveCount describe the objective that progressed
+	AdvLootChanged,                   // AdvLootLists holds the advanced loot lists whose items changed
+	SpawnBuffGained,                  // SpawnID, SpellID, BuffSlot and BuffDuration describe a buff in the cached buffs of a spawn
+	SpawnBuffLost,                    // SpawnID, SpellID and BuffSlot describe a buff that was lost or ran out
+	SpawnBuffExpiring,                // SpawnID, SpellID, BuffSlot and BuffDuration describe a buff that is about to run out
+	CastPhaseChanged,                 // CastPhase and SpellID describe the step that the cast went through
+	PetChanged,                       // SpawnID holds the pet, or 0 if it was lost, and PetChanges what changed
+	MercenaryChanged,                 // SpawnID holds the mercenary, or 0 if it isn't spawned, and MercenaryChanges what changed
+};
+
+/**
+ * A change to the game. Only the fields that belong to the event are filled in.
+ */
+struct MQGameEventInfo
+{
+	MQGameEvent Event;
+	int GameState = 0;
+	int ZoneID = 0;
+	eqlib::PlayerClient* Target = nullptr;
+	bool Moving = false;
+	int SpellID = -1;
+	uint32_t XTargetSlots = 0;        // Bit n is set if slot n changed type, status, spawn or aggro
+	int TaskID = 0;
+	int ObjectiveIndex = -1;          // 0 based index of the objective in the task
+	int ObjectiveCount = 0;           // The new count of the objective
+	int ObjectiveRequiredCount = 0;
+	uint32_t AdvLootLists = 0;        // Bit 0 is set if the personal list changed, bit 1 the shared list
+	uint32_t SpawnID = 0;
+	int BuffSlot = -1;
+	uint32_t BuffDuration = 0;        // The remaining duration, in milliseconds
+	MQCastPhase CastPhase = MQCastPhase::Idle;
+	uint32_t PetChanges = 0;          // MQPetChange bits
+	uint32_t MercenaryChanges = 0;    // MQMercenaryChange bits
+};
+
+using MQGameEventCallback = std::function<void(const MQGameEventInfo&)>;
+
+/**
+ * Be notified when the game changes, rather than comparing against last known values every pulse.
+ * The callback is invoked on the main thread, during the pulse that noticed the change.
+ *
+ * @param event The change to be notified of.
+ * @param callback The function to invoke with the change.
+ * @return An id that can be passed to RemoveGameEventObserver, or 0 if the callback is empty.
+ */
+int AddGameEventObserver(MQGameEvent event, MQGameEventCallback callback);
+
+/**
+ * Stop being notified of a change that was added with AddGameEventObserver.
+ *
+ * @param observerId The id returned by AddGameEventObserver.
+ * @return True if the observer was removed.
+ */
+bool RemoveGameEventObserver(int observerId);
+
+} // namespace mq
@@ -20,7 +20,9 @@
 #include "mq/api/MacroDataTypes.h"
 
 #include <functional>
+#include <future>
 #include <string>
+#include <vector>
 
 namespace eqlib {
 	class PlayerClient;
@@ -44,6 +46,7 @@ struct MQTopLevelObject
 	std::string Name;
 	MQTopLevelObjectFunction Function;
 	MQPlugin* Owner;
+	MQDataPurity Purity = MQDataPurity::Volatile;
 };
 using MQDataItem DEPRECATE("Use MQTopLevelObject instead of MQDataItem") = MQTopLevelObject;
 
@@ -52,7 +55,7 @@ using MQDataItem DEPRECATE("Use MQTopLevelObject instead of MQDataItem") = MQTop
  */
 struct MQDataVar
 {
-	char szName[MAX_STRING];
+	std::string Name;
 	MQTypeVar Var;
 
 	MQDataVar* pNext;
@@ -155,9 +158,56 @@ MQLIB_API bool ParseMacroData(char* szOriginal, size_t BufferSize);
 // Same as ParseMacroData, but returns the same char pointer back. Prefer to use ParseMacroData
 MQLIB_API char* ParseMacroParameter(char* szOriginal, size_t BufferSize);
 
+// Parses macro data from any thread. The data is parsed on the main thread during the next pulse,
+// along with every other request made since the last one, and identical requests in a pulse are
+// only parsed once. Don't wait on the result from the main thread, it won't resolve until the
+// next pulse.
+MQLIB_OBJECT std::future<std::string> ParseMacroDataAsync(std::string strOriginal);
+MQLIB_OBJECT std::future<std::vector<std::string>> ParseMacroDataAsync(std::vector<std::string> strings);
+
+/**
+ * A string watched by a macro data observer that changed since the last pulse.
+ */
+struct MQMacroDataChange
+{
+	size_t Index;                     // Index of the string in the list the observer was added with
+	std::string Value;                // Parsed value of the string
+};
+
+using MQMacroDataObserverCallback = std::function<void(const std::vector<MQMacroDataChange>&)>;
+
+/**
+ * Watch a set of strings for changes. Every string is parsed once per pulse, in a single pass over
+ * all observers (strings that are watched more than once are only parsed once), and the callback
+ * is invoked on the main thread with the strings whose value changed. The first pulse reports
+ * every string.
+ *
+ * @param strings The strings to parse, for example "${Me.PctHPs}".
+ * @param callback The function to invoke with the changes.
+ * @return An id that can be passed to RemoveMacroDataObserver, or 0 if nothing is being watched.
+ */
+int AddMacroDataObserver(std::vector<std::string> strings, MQMacroDataObserverCallback callback);
+
+/**
+ * Stop watching the strings of an observer added with AddMacroDataObserver.
+ *
+ * @param observerId The id returned by AddMacroDataObserver.
+ * @return True if the observer was removed.
+ */
+bool RemoveMacroDataObserver(int observerId);
+
 // Returns -1 if member doesn't exist. 0 if it fails, and 1 if it succeeds.
 MQLIB_API int EvaluateMacroDataMember(MQ2Type* Type, MQVarPtr VarPtr, MQTypeVar& Result, const char* Member, char* pIndex);
 
+// Resolves a member or method of a type ahead of time, for repeated evaluation with the overload of
+// EvaluateMacroDataMember below. Returns an empty handle if there is no such member, and for types
+// that have extensions, whose members have to be evaluated by name.
+MQLIB_API MQMemberHandle ResolveMacroDataMember(MQ2Type* Type, const char* Member);
+
+// Returns -1 if the handle is no longer valid for the type (resolve it again). 0 if it fails, and 1
+// if it succeeds.
+MQLIB_API int EvaluateMacroDataMember(MQ2Type* Type, MQVarPtr VarPtr, MQTypeVar& Result, const MQMemberHandle& Member, char* pIndex);
+
 // Returns false if the given name is neither a member nor a method of the given type.
 MQLIB_OBJECT bool FindMacroDataMember(MQ2Type* Type, const std::string& Member);
 
@@ -17,11 +17,13 @@
 #include "mq/base/Common.h"
 #include "mq/base/Deprecation.h"
 #include "mq/base/PluginHandle.h"
+#include "mq/base/String.h"
 
 #include "eqlib/base/Color.h"
 #include "eqlib/CXStr.h"
 #include "eqlib/Items.h"
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -396,11 +398,25 @@ struct MQTypeVar : public MQVarPtr
 	__declspec(property(get = GetVarPtr, put = SetVarPtr)) MQVarPtr VarPtr;
 };
 
+/**
+ * Describes how long the result of a member or top level object stays the same when it is
+ * evaluated again with the same object and index. The macro parser uses this to reuse results
+ * instead of evaluating them again. Anything that is not marked otherwise is volatile.
+ */
+enum class MQDataPurity : uint8_t
+{
+	Volatile = 0,                    // Evaluated every time
+	PerFrame,                        // Unchanged until the next pulse
+	PerZone,                         // Unchanged until the next zone change
+	Constant,                        // Unchanged once the game data is loaded
+};
+
 struct MQTypeMember
 {
 	int          ID;
 	uint32_t     Type;
 	const char* Name;
+	MQDataPurity Purity = MQDataPurity::Volatile;
 
 	MQTypeMember(int ID, const char* Name)
 		: ID(ID), Name(Name), Type(0) {}
@@ -408,6 +424,27 @@ struct MQTypeMember
 		: ID(ID), Name(Name), Type(Type) {}
 };
 
+/**
+ * A member or method of a type that has been resolved by name ahead of time. Passing a handle
+ * to MQ2Type::GetMember skips the lock and the name lookup that a string member access performs.
+ *
+ * A handle stays valid until members or methods are added to or removed from the type it was
+ * resolved against (or the parent type that declares the member). Use MQ2Type::IsValidHandle
+ * to check, and resolve it again with MQ2Type::GetMemberHandle if it has gone stale.
+ */
+struct MQMemberHandle
+{
+	MQ2Type*      Type = nullptr;         // The type that the handle was resolved against
+	MQ2Type*      Owner = nullptr;        // The type that declares the member (Type or a parent)
+	MQTypeMember* Member = nullptr;
+	uint32_t      TypeGeneration = 0;
+	uint32_t      OwnerGeneration = 0;
+
+	bool IsMethod() const { return Member != nullptr && Member->Type != 0; }
+
+	explicit operator bool() const { return Member != nullptr; }
+};
+
 //============================================================================
 
 namespace datatypes {
@@ -432,6 +469,10 @@ public:
 
 	virtual bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) = 0;
 
+	// Evaluate a member that was resolved ahead of time with GetMemberHandle. Returns false if
+	// the member fails to evaluate or the handle is no longer valid for this type.
+	MQLIB_OBJECT bool GetMember(MQVarPtr VarPtr, const MQMemberHandle& handle, char* Index, MQTypeVar& Dest);
+
 	virtual bool ToString(MQVarPtr VarPtr, char* Destination)
 	{
 		strcpy_s(Destination, MAX_STRING, m_typeName.c_str());
@@ -450,6 +491,11 @@ public:
 
 	MQLIB_OBJECT bool CanEvaluateMethodOrMember(const std::string& Name);
 
+	// Resolve a member or method (including inherited members) to a handle. Returns an empty
+	// handle if no member or method by that name exists.
+	MQLIB_OBJECT MQMemberHandle GetMemberHandle(const char* Name);
+	MQLIB_OBJECT bool IsValidHandle(const MQMemberHandle& handle) const;
+
 	inline bool InheritsFrom(MQ2Type* testType)
 	{
 		MQ2Type* parentType = m_parent;
@@ -514,17 +560,25 @@ protected:
 	MQLIB_OBJECT bool AddMethod(int ID, const char* Name);
 	MQLIB_OBJECT bool RemoveMethod(const char* Name);
 
+	// Set the purity of a member, or of every member currently registered on the type. Methods
+	// are always volatile.
+	MQLIB_OBJECT bool SetMemberPurity(const char* Name, MQDataPurity purity);
+	MQLIB_OBJECT void SetMemberPurity(MQDataPurity purity);
+
 	std::string m_typeName;
 	bool m_owned = false;
 	bool m_initialized = false;
 	MQ2Type* m_parent = nullptr;
 	mutable std::mutex m_mutex;
 
+	// Incremented when members or methods are added or removed, invalidating member handles.
+	std::atomic<uint32_t> m_memberGeneration = 1;
+
 private:
 	std::vector<std::unique_ptr<MQTypeMember>> Members;
 	std::vector<std::unique_ptr<MQTypeMember>> Methods;
-	std::unordered_map<std::string, int> MemberMap;
-	std::unordered_map<std::string, int> MethodMap;
+	std::unordered_map<Atom, int> MemberMap;
+	std::unordered_map<Atom, int> MethodMap;
 };
 
 } // namespace datatypes
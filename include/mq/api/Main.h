@@ -16,8 +16,11 @@
 
 #include "mq/api/ActorAPI.h"
 #include "mq/api/CommandAPI.h"
+#include "mq/api/GameEvents.h"
 #include "mq/api/MacroAPI.h"
 #include "mq/api/PluginAPI.h"
+#include "mq/api/SpawnTriggers.h"
+#include "mq/api/WarmUp.h"
 
 namespace mq {
 
@@ -53,6 +56,33 @@ public:
 		postoffice::Dropbox*& dropbox,
 		const MQPluginHandle& pluginHandle) = 0;
 
+	virtual bool SubscribeActor(
+		postoffice::Dropbox* dropbox,
+		const std::string& topic,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool UnsubscribeActor(
+		postoffice::Dropbox* dropbox,
+		const std::string& topic,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual void QueryRemoteData(
+		const postoffice::Address& address,
+		std::vector<std::string> expressions,
+		postoffice::RemoteQueryCallback callback,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual int SubscribeRemoteData(
+		const postoffice::Address& address,
+		std::vector<std::string> expressions,
+		std::chrono::milliseconds interval,
+		postoffice::RemoteSubscriptionCallback callback,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool UnsubscribeRemoteData(
+		int subscriptionId,
+		const MQPluginHandle& pluginHandle) = 0;
+
 	//
 	// Command API
 	//
@@ -83,6 +113,10 @@ public:
 		int msDelay,
 		const MQPluginHandle& pluginHandle) = 0;
 
+	virtual void DoCompiledCommand(
+		MQCompiledCommand& command,
+		const MQPluginHandle& pluginHandle) = 0;
+
 	// Aliases
 	virtual bool AddAlias(
 		const std::string& shortCommand,
@@ -124,6 +158,61 @@ public:
 	virtual MQTopLevelObject* FindTopLevelObject(
 		const char* name) = 0;
 
+	virtual int AddMacroDataObserver(
+		std::vector<std::string> strings,
+		MQMacroDataObserverCallback callback,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool RemoveMacroDataObserver(
+		int observerId,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	//
+	// Game Event API
+	//
+
+	virtual int AddGameEventObserver(
+		MQGameEvent event,
+		MQGameEventCallback callback,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool RemoveGameEventObserver(
+		int observerId,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	//
+	// Warm-up API
+	//
+
+	virtual int AddWarmUpTask(
+		const char* name,
+		MQWarmUpStep step,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool RemoveWarmUpTask(
+		int taskId,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool IsWarmUpTaskReady(
+		int taskId) const = 0;
+
+	virtual bool IsWarmUpComplete() const = 0;
+
+	//
+	// Spawn trigger API
+	//
+
+	virtual int AddSpawnTrigger(
+		const char* name,
+		const MQSpawnSearch& search,
+		float radius,
+		MQSpawnTriggerCallback callback,
+		const MQPluginHandle& pluginHandle) = 0;
+
+	virtual bool RemoveSpawnTrigger(
+		int triggerId,
+		const MQPluginHandle& pluginHandle) = 0;
+
 };
 
 MQLIB_OBJECT MainInterface* GetMainInterface();
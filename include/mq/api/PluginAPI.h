@@ -52,6 +52,25 @@ using fMQUnloadPlugin        = void(*)(const char*);
 using fMQGetPluginInterface  = PluginInterface* (*)();
 using fMQPostUnloadPlugin    = void(*)(const char*);
 
+/**
+ * How often a plugin's OnPulse is called. Set with PLUGIN_PULSE_TIER. Plugins sharing a tier are
+ * spread across frames, so they don't all pulse on the same one.
+ */
+enum class PluginPulseTier : int
+{
+	/** Called every frame. This is the default. */
+	EveryFrame = 0,
+
+	/** Called about ten times a second. */
+	TenPerSecond = 1,
+
+	/** Called about once a second. */
+	OncePerSecond = 2,
+
+	/** Called about once a second, on a frame where no other tiered plugin pulsed. */
+	Idle = 3,
+};
+
 /**
  * Structure representing a loaded plugin.
  */
@@ -85,6 +104,8 @@ struct MQPlugin
 	fMQUnloadPlugin      UnloadPlugin = nullptr;
 	fMQGetPluginInterface GetPluginInterface = nullptr;
 	fMQPostUnloadPlugin  OnPostUnloadPlugin = nullptr;
+	PluginPulseTier      PulseTier = PluginPulseTier::EveryFrame;
+	int                  HeadlessImGuiInterval = 1000;   // milliseconds, set with PLUGIN_HEADLESS_IMGUI_INTERVAL
 
 	MQPlugin*            pLast = nullptr;
 	MQPlugin*            pNext = nullptr;
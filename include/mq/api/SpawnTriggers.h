@@ -0,0 +1,68 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace eqlib {
+	class PlayerClient;
+}
+
+namespace mq {
+
+struct MQSpawnSearch;
+
+/**
+ * A spawn that entered or left the area of a spawn trigger.
+ */
+struct MQSpawnTriggerEvent
+{
+	int TriggerID = 0;
+	eqlib::PlayerClient* Spawn = nullptr;     // Only valid until the callback returns
+	uint32_t SpawnID = 0;
+	bool Entered = false;                     // False if the spawn left, stopped matching, or despawned
+};
+
+using MQSpawnTriggerCallback = std::function<void(const MQSpawnTriggerEvent&)>;
+
+/**
+ * Be notified when spawns that match a search come within a radius, and when they leave it again,
+ * rather than searching the spawns every pulse.
+ *
+ * The area is centered on the controlled player, or on the search's location if it has one. The
+ * radius is a 2d distance, like the radius of a spawn search. Triggers are checked against the spawn
+ * grid on the main thread a few times a second, and a spawn that despawns while inside leaves right
+ * away. Spawns that are inside when we zone are forgotten without leaving.
+ *
+ * @param name A name for the trigger that is used in debug output.
+ * @param search The spawns that can set off the trigger.
+ * @param radius The distance from the center within which a spawn is inside.
+ * @param callback The function to invoke when a spawn enters or leaves.
+ * @return An id that can be passed to RemoveSpawnTrigger, or 0 if the callback is empty or the radius isn't positive.
+ */
+int AddSpawnTrigger(const char* name, const MQSpawnSearch& search, float radius, MQSpawnTriggerCallback callback);
+
+/**
+ * Remove a trigger that was added with AddSpawnTrigger. No leave events are raised for the spawns
+ * that were inside.
+ *
+ * @param triggerId The id returned by AddSpawnTrigger.
+ * @return True if the trigger was removed.
+ */
+bool RemoveSpawnTrigger(int triggerId);
+
+} // namespace mq
@@ -63,5 +63,25 @@ MQLIB_API uint32_t GetRaidMainAssistTargetID(int index);
  */
 MQLIB_API bool IsAssistNPC(PlayerClient* pSpawn);
 
+/**
+ * Returns the spawn with the given spawn ID, or nullptr if there isn't one.
+ * On the main thread this uses the spawn index kept up to date as spawns are added
+ * and removed, otherwise it asks the spawn manager.
+ *
+ * @param spawnID The spawn ID to look up
+ * @return The spawn with the given ID.
+ */
+MQLIB_API PlayerClient* FindSpawnByID(uint32_t spawnID);
+
+/**
+ * Returns the spawn with the given name, or nullptr if there isn't one. The
+ * comparison is case insensitive. On the main thread this uses the spawn index
+ * kept up to date as spawns are added and removed, otherwise it asks the spawn manager.
+ *
+ * @param spawnName The name of the spawn to look up
+ * @return The spawn with the given name. If several spawns share it, the first one.
+ */
+MQLIB_API PlayerClient* FindSpawnByName(const char* spawnName);
+
 
 } // namespace mq
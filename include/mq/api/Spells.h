@@ -15,6 +15,10 @@
 #pragma once
 
 #include "mq/base/Common.h"
+#include "mq/api/GameEvents.h"
+
+#include <memory>
+#include <vector>
 
 namespace mq {
 
@@ -26,4 +30,46 @@ namespace mq {
  */
 MQLIB_API int CalcMinSpellLevel(EQ_Spell* pSpell);
 
+/**
+ * Finds the spells that have an effect with the specified SPA, without scanning every spell.
+ *
+ * @param spa The SPA to look for
+ * @param classID If not 0, only the spells this class can use are returned
+ * @param maxLevel If not 0, only the spells the class can use at this level are returned
+ * @return The ids of the spells, in the order of the spell file. Empty until the spell database
+ *         has been loaded. The list is shared with later calls for the same arguments, and stays
+ *         valid after the spell database is reloaded.
+ */
+MQLIB_OBJECT std::shared_ptr<const std::vector<int>> FindSpellsWithSPA(int spa, int classID = 0, int maxLevel = 0);
+
+/**
+ * What we are casting, and how the last cast went. Updated once per pulse from the casting state of
+ * the player and from the chat messages about casts, before game events are published.
+ */
+struct MQCastState
+{
+	MQCastPhase Phase = MQCastPhase::Idle;       // The step that the cast went through last
+	int SpellID = -1;                            // The spell being cast, or the one that was cast last
+	uint32_t TargetID = 0;                       // The target when the cast began
+	uint32_t CastCount = 0;                      // Goes up every time a cast begins
+	uint64_t PhaseTime = 0;                      // GetTickCount64 of the last step
+	bool Casting = false;
+	bool Recovering = false;                     // The spell gems haven't recovered from the last cast
+};
+
+/**
+ * Returns the state of casting, without evaluating any macro data.
+ *
+ * @return The cast state as of this pulse.
+ */
+MQLIB_OBJECT const MQCastState& GetCastState();
+
+/**
+ * Returns the name of a cast phase, as passed to Event_CastPhase and returned by ${Me.CastPhase}.
+ *
+ * @param phase The phase
+ * @return The lowercase name of the phase, for example "landed".
+ */
+MQLIB_OBJECT const char* GetCastPhaseName(MQCastPhase phase);
+
 } // namespace mq
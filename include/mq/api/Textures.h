@@ -29,13 +29,15 @@ namespace mq {
 class MQTexture
 {
 public:
-	explicit MQTexture(std::string_view name);
+	// A deferred texture isn't loaded until GraphicsResources_OnPulse gets to it.
+	explicit MQTexture(std::string_view name, bool deferred = false);
 	MQLIB_OBJECT ~MQTexture();
 
 	MQTexture(const MQTexture&) = delete;
 	MQTexture& operator=(const MQTexture&) = delete;
 
 	bool IsValid() const { return m_bmi != nullptr; }
+	bool IsPending() const { return m_pending; }
 	const std::string& GetFilename() const { return m_name; }
 
 	MQLIB_OBJECT ImTextureID GetTextureID() const;
@@ -44,9 +46,13 @@ public:
 	void ReleaseTexture();
 	void AcquireTexture();
 
+	// Called when a deferred texture was loaded, or failed to load.
+	void FinishPending();
+
 private:
 	std::string m_name;
 	eqlib::BMI* m_bmi = nullptr;
+	bool m_pending = false;
 };
 
 using MQTexturePtr = std::shared_ptr<MQTexture>;
@@ -55,6 +61,12 @@ using MQTexturePtr = std::shared_ptr<MQTexture>;
 // will return nullptr. The caller is responsible for calling DestroyTexture.
 MQLIB_OBJECT MQTexture* CreateTexture(std::string_view filename);
 
+// Creates a texture that loads over the next frames instead of right away. The file is read on a
+// worker thread and the texture is created on a later pulse, with only a few created per pulse.
+// Until then IsPending is true and IsValid is false. If the texture cannot be created, IsPending
+// becomes false with IsValid still false.
+MQLIB_OBJECT MQTexturePtr CreateTextureAsync(std::string_view filename);
+
 // Destroy a texture that was previously created with CreateTexture
 MQLIB_OBJECT void DestroyTexture(MQTexture* texture);
 
@@ -62,5 +74,11 @@ MQLIB_OBJECT void DestroyTexture(MQTexture* texture);
 // that wraps CreateTexture/DestroyTexture in a shared_ptr.
 MQLIB_OBJECT MQTexturePtr CreateTexturePtr(std::string_view filename);
 
+// Gets the texture of a file that is shared by everyone that asks for the same file, and creates
+// it if nobody holds it anymore. The texture lives as long as someone holds it. An async texture is
+// created like CreateTextureAsync, and is only shared with the other async requests. A file that
+// failed to load isn't tried again for a few seconds, a nullptr is returned instead.
+MQLIB_OBJECT MQTexturePtr GetSharedTexture(std::string_view filename, bool async = false);
+
 } // namespace mq
 
@@ -0,0 +1,62 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <functional>
+
+namespace mq {
+
+/**
+ * One step of a warm-up task. Do a small part of the work and return true once all of it is done.
+ * The step is called again on a later pulse until it returns true.
+ */
+using MQWarmUpStep = std::function<bool()>;
+
+/**
+ * Rebuild an index or cache after zoning, a little at a time, rather than all at once on first use.
+ *
+ * After each zone the steps of every task are called on the main thread, a few each pulse, until
+ * every task has finished. A task that is added while in a zone is started right away.
+ *
+ * @param name A name for the task that is used in debug output.
+ * @param step The step to call until it returns true.
+ * @return An id that can be passed to RemoveWarmUpTask and IsWarmUpTaskReady, or 0 if the step is empty.
+ */
+int AddWarmUpTask(const char* name, MQWarmUpStep step);
+
+/**
+ * Remove a task that was added with AddWarmUpTask.
+ *
+ * @param taskId The id returned by AddWarmUpTask.
+ * @return True if the task was removed.
+ */
+bool RemoveWarmUpTask(int taskId);
+
+/**
+ * Check whether a task has finished since the last zone.
+ *
+ * @param taskId The id returned by AddWarmUpTask.
+ * @return True if the task's step has returned true since we last zoned.
+ */
+bool IsWarmUpTaskReady(int taskId);
+
+/**
+ * Check whether every task has finished since the last zone.
+ *
+ * @return True if we are in a zone and no task is still warming up.
+ */
+bool IsWarmUpComplete();
+
+} // namespace mq
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <mq/base/Color.h>
+#include <mq/base/ConfigCache.h>
 #include <mq/base/String.h>
 
 #include <string>
@@ -36,7 +37,7 @@ inline float GetPrivateProfileFloat(const std::string& Section, const std::strin
 	const std::string strDefaultValue = std::to_string(DefaultValue);
 	const size_t Size = 100;
 	char Return[Size] = { 0 };
-	::GetPrivateProfileStringA(Section.c_str(), Key.c_str(), strDefaultValue.c_str(), Return, Size, iniFileName.c_str());
+	detail::ReadProfileString(Section.c_str(), Key.c_str(), strDefaultValue.c_str(), Return, Size, iniFileName.c_str());
 	return GetFloatFromString(Return, DefaultValue);
 }
 
@@ -44,7 +45,7 @@ inline bool GetPrivateProfileBool(const std::string& Section, const std::string&
 {
 	const size_t Size = 10;
 	char Return[Size] = { 0 };
-	::GetPrivateProfileStringA(Section.c_str(), Key.c_str(), DefaultValue ? "true" : "false", Return, Size, iniFileName.c_str());
+	detail::ReadProfileString(Section.c_str(), Key.c_str(), DefaultValue ? "true" : "false", Return, Size, iniFileName.c_str());
 	return GetBoolFromString(Return, DefaultValue);
 }
 
@@ -52,35 +53,35 @@ inline bool GetPrivateProfileBool(const char* Section, const char* Key, const bo
 {
 	const size_t Size = 10;
 	char Return[Size] = { 0 };
-	::GetPrivateProfileStringA(Section, Key, DefaultValue ? "true" : "false", Return, Size, iniFileName.c_str());
+	detail::ReadProfileString(Section, Key, DefaultValue ? "true" : "false", Return, Size, iniFileName.c_str());
 	return GetBoolFromString(Return, DefaultValue);
 }
 
 inline int GetPrivateProfileInt(const std::string& Section, const std::string& Key, const int DefaultValue, const std::string& iniFileName)
 {
-	return ::GetPrivateProfileIntA(Section.c_str(), Key.c_str(), DefaultValue, iniFileName.c_str());
+	return detail::ReadProfileInt(Section.c_str(), Key.c_str(), DefaultValue, iniFileName.c_str());
 }
 
 inline int GetPrivateProfileInt(const char* Section, const char* Key, const int DefaultValue, const char* iniFileName)
 {
-	return ::GetPrivateProfileIntA(Section, Key, DefaultValue, iniFileName);
+	return detail::ReadProfileInt(Section, Key, DefaultValue, iniFileName);
 }
 
 inline int GetPrivateProfileString(const std::string& Section, const std::string& Key, const std::string& DefaultValue, char* Return, const size_t Size, const std::string& iniFileName)
 {
-	return ::GetPrivateProfileStringA(Section.empty() ? nullptr : Section.c_str(), Key.empty() ? nullptr : Key.c_str(), DefaultValue.c_str(), Return, static_cast<DWORD>(Size), iniFileName.c_str());
+	return detail::ReadProfileString(Section.empty() ? nullptr : Section.c_str(), Key.empty() ? nullptr : Key.c_str(), DefaultValue.c_str(), Return, static_cast<DWORD>(Size), iniFileName.c_str());
 }
 
 inline int GetPrivateProfileString(const char* Section, const char* Key, const char* DefaultValue, char* Return, const size_t Size, const char* iniFileName)
 {
-	return ::GetPrivateProfileStringA(Section, Key, DefaultValue, Return, static_cast<DWORD>(Size), iniFileName);
+	return detail::ReadProfileString(Section, Key, DefaultValue, Return, static_cast<DWORD>(Size), iniFileName);
 }
 
 inline std::string GetPrivateProfileString(const std::string& Section, const std::string& Key, const std::string& DefaultValue, const std::string& iniFileName)
 {
 	char szBuffer[MAX_STRING] = { 0 };
 
-	const DWORD length = ::GetPrivateProfileStringA(Section.empty() ? nullptr : Section.c_str(), Key.empty() ? nullptr : Key.c_str(), DefaultValue.c_str(), szBuffer, MAX_STRING, iniFileName.c_str());
+	const DWORD length = detail::ReadProfileString(Section.empty() ? nullptr : Section.c_str(), Key.empty() ? nullptr : Key.c_str(), DefaultValue.c_str(), szBuffer, MAX_STRING, iniFileName.c_str());
 	return std::string{ szBuffer, length };
 }
 
@@ -88,18 +89,18 @@ inline std::string GetPrivateProfileString(const char* Section, const char* Key,
 {
 	char szBuffer[MAX_STRING] = { 0 };
 
-	const DWORD length = ::GetPrivateProfileStringA(Section, Key, DefaultValue, szBuffer, MAX_STRING, iniFileName);
+	const DWORD length = detail::ReadProfileString(Section, Key, DefaultValue, szBuffer, MAX_STRING, iniFileName);
 	return std::string{ szBuffer, length };
 }
 
 inline mq::MQColor GetPrivateProfileColor(const std::string& Section, const std::string& Key, mq::MQColor color, const std::string& iniFileName)
 {
-	return (uint32_t)::GetPrivateProfileIntA(Section.c_str(), Key.c_str(), (int32_t)color.ToARGB(), iniFileName.c_str());
+	return (uint32_t)detail::ReadProfileInt(Section.c_str(), Key.c_str(), (int32_t)color.ToARGB(), iniFileName.c_str());
 }
 
 inline mq::MQColor GetPrivateProfileColor(const char* Section, const char* Key, mq::MQColor color, const char* iniFileName)
 {
-	return (uint32_t)::GetPrivateProfileIntA(Section, Key, (int32_t)color.ToARGB(), iniFileName);
+	return (uint32_t)detail::ReadProfileInt(Section, Key, (int32_t)color.ToARGB(), iniFileName);
 }
 
 
@@ -122,7 +123,7 @@ std::vector<std::string> GetPrivateProfileKeys(const std::string& section, const
 {
 	char keybuffer[BUFFER_SIZE] = { 0 };
 
-	const int bufferLen = ::GetPrivateProfileStringA(section.c_str(), nullptr, "", keybuffer, BUFFER_SIZE, iniFileName.c_str());
+	const int bufferLen = detail::ReadProfileString(section.c_str(), nullptr, "", keybuffer, BUFFER_SIZE, iniFileName.c_str());
 	char* ptr = keybuffer;
 
 	std::vector<std::string> results;
@@ -143,7 +144,7 @@ std::vector<std::pair<std::string, std::string>> GetPrivateProfileKeyValues(cons
 {
 	char keybuffer[BUFFER_SIZE] = { 0 };
 
-	const int bufferLen = ::GetPrivateProfileSectionA(section.c_str(), keybuffer, BUFFER_SIZE, iniFileName.c_str());
+	const int bufferLen = detail::ReadProfileSection(section.c_str(), keybuffer, BUFFER_SIZE, iniFileName.c_str());
 	char* ptr = keybuffer;
 
 	std::vector<std::pair<std::string, std::string>> results;
@@ -179,7 +180,7 @@ inline std::vector<std::string> GetPrivateProfileSections(const std::string& ini
 {
 	char sectionbuffer[BUFFER_SIZE] = { 0 };
 
-	const int bufferLen = ::GetPrivateProfileSectionNamesA(sectionbuffer, BUFFER_SIZE, iniFileName.c_str());
+	const int bufferLen = detail::ReadProfileString(nullptr, nullptr, "", sectionbuffer, BUFFER_SIZE, iniFileName.c_str());
 	char* ptr = sectionbuffer;
 
 	std::vector<std::string> results;
@@ -203,73 +204,73 @@ inline bool PrivateProfileSectionExists(const std::string& section, const std::s
 
 inline bool WritePrivateProfileSection(const std::string& Section, const std::string& KeysAndValues, const std::string& iniFileName)
 {
-	return ::WritePrivateProfileSectionA(Section.c_str(), KeysAndValues.c_str(), iniFileName.c_str());
+	return detail::WriteProfileSection(Section.c_str(), KeysAndValues.c_str(), iniFileName.c_str());
 }
 
 inline bool WritePrivateProfileSection(const char* Section, const char* KeysAndValues, const char* iniFileName)
 {
-	return ::WritePrivateProfileSectionA(Section, KeysAndValues, iniFileName);
+	return detail::WriteProfileSection(Section, KeysAndValues, iniFileName);
 }
 
 inline bool WritePrivateProfileString(const std::string& Section, const std::string& Key, const std::string& Value, const std::string& iniFileName)
 {
-	return ::WritePrivateProfileStringA(Section.c_str(), Key.c_str(), Value.c_str(), iniFileName.c_str());
+	return detail::WriteProfileString(Section.c_str(), Key.c_str(), Value.c_str(), iniFileName.c_str());
 }
 
 inline bool WritePrivateProfileString(const char* Section, const char* Key, const char* Value, const char* iniFileName)
 {
-	return ::WritePrivateProfileStringA(Section, Key, Value, iniFileName);
+	return detail::WriteProfileString(Section, Key, Value, iniFileName);
 }
 
 inline bool WritePrivateProfileBool(const std::string& Section, const std::string& Key, bool Value, const std::string& iniFileName)
 {
-	return ::WritePrivateProfileStringA(Section.c_str(), Key.c_str(), Value ? "1" : "0", iniFileName.c_str());
+	return detail::WriteProfileString(Section.c_str(), Key.c_str(), Value ? "1" : "0", iniFileName.c_str());
 }
 
 inline bool WritePrivateProfileBool(const char* Section, const char* Key, bool Value, const char* iniFileName)
 {
-	return ::WritePrivateProfileStringA(Section, Key, Value ? "1" : "0", iniFileName);
+	return detail::WriteProfileString(Section, Key, Value ? "1" : "0", iniFileName);
 }
 
 inline bool WritePrivateProfileInt(const std::string& Section, const std::string& Key, int Value, const std::string& iniFileName)
 {
 	std::string ValueString = std::to_string(Value);
-	return ::WritePrivateProfileStringA(Section.c_str(), Key.c_str(), ValueString.c_str(), iniFileName.c_str());
+	return detail::WriteProfileString(Section.c_str(), Key.c_str(), ValueString.c_str(), iniFileName.c_str());
 }
 
 inline bool WritePrivateProfileInt(const char* Section, const char* Key, int Value, const char* iniFileName)
 {
 	std::string ValueString = std::to_string(Value);
-	return ::WritePrivateProfileStringA(Section, Key, ValueString.c_str(), iniFileName);
+	return detail::WriteProfileString(Section, Key, ValueString.c_str(), iniFileName);
 }
 
 inline bool WritePrivateProfileFloat(const std::string& Section, const std::string& Key, float Value, const std::string& iniFileName)
 {
 	std::string ValueString = std::to_string(Value);
-	return ::WritePrivateProfileStringA(Section.c_str(), Key.c_str(), ValueString.c_str(), iniFileName.c_str());
+	return detail::WriteProfileString(Section.c_str(), Key.c_str(), ValueString.c_str(), iniFileName.c_str());
 }
 
 inline bool WritePrivateProfileFloat(const char* Section, const char* Key, float Value, const char* iniFileName)
 {
 	std::string ValueString = std::to_string(Value);
-	return ::WritePrivateProfileStringA(Section, Key, ValueString.c_str(), iniFileName);
+	return detail::WriteProfileString(Section, Key, ValueString.c_str(), iniFileName);
 }
 
 inline bool WritePrivateProfileColor(const std::string& Section, const std::string& Key, mq::MQColor Value, const std::string& iniFileName)
 {
 	std::string ValueString = std::to_string(Value.ToARGB());
-	return ::WritePrivateProfileStringA(Section.c_str(), Key.c_str(), ValueString.c_str(), iniFileName.c_str());
+	return detail::WriteProfileString(Section.c_str(), Key.c_str(), ValueString.c_str(), iniFileName.c_str());
 }
 
 inline bool WritePrivateProfileColor(const char* Section, const char* Key, mq::MQColor Value, const char* iniFileName)
 {
 	std::string ValueString = std::to_string(Value.ToARGB());
-	return ::WritePrivateProfileStringA(Section, Key, ValueString.c_str(), iniFileName);
+	return detail::WriteProfileString(Section, Key, ValueString.c_str(), iniFileName);
 }
 
 inline bool DeletePrivateProfileKey(const std::string& Section, const std::string& Key, const std::string& iniFileName)
 {
-	return ::WritePrivateProfileStringA(Section.c_str(), Key.c_str(), nullptr, iniFileName.c_str());
+	return detail::WriteProfileString(Section.c_str(), Key.c_str(), nullptr, iniFileName.c_str());
 }
 
 // WritePrivateProfileValue provides overloads to allow dispatching by type (selected by the type of default value)
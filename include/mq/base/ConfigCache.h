@@ -0,0 +1,928 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <mq/base/String.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <windows.h>
+
+namespace mq {
+
+// The ini files read and written through the GetPrivateProfile* and WritePrivateProfile* wrappers
+// in Config.h are parsed once and then read from memory. Every access looks at the size and times of
+// the file, and parses it again when anything else (another module, another client, an editor)
+// changed it. The times only tell apart writes that are further apart than their resolution, so a
+// file that was written recently is also compared by the hash of its contents.
+//
+// Writes are applied to the parsed file and kept until they are written back; inside of a
+// ScopedPrivateProfileBatch the writes to a file are only written back once the batch ends. Since
+// the whole file is written back, it is read again right before, and the writes of this module are
+// applied again on top of anything that another writer changed, so those changes aren't lost. This
+// happens under a named mutex for the file, so clients that write the same file take turns.
+//
+// The behavior follows the Win32 functions: sections and keys are matched ignoring case and
+// surrounding whitespace, the first of duplicate sections or keys is the one that is used, and
+// quotes around values are removed. Files that the cache can't handle the same way are passed on to
+// the Win32 functions: relative paths (which the Win32 functions look for in the Windows directory),
+// UTF-16 files, and files that couldn't be read.
+//
+// Every module that includes this has a cache of its own. Since the file is checked on every access,
+// they still see each others writes once they are written back.
+class PrivateProfileCache
+{
+public:
+	enum class LookupResult
+	{
+		NotCached,                                   // use the Win32 function
+		Missing,
+		Found,
+	};
+
+	static PrivateProfileCache& Instance()
+	{
+		static PrivateProfileCache instance;
+		return instance;
+	}
+
+	LookupResult GetString(const char* fileName, std::string_view section, std::string_view key, std::string& value)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		File* file = GetFile(fileName);
+		if (!file)
+			return LookupResult::NotCached;
+
+		const Line* line = file->FindKey(section, key);
+		if (!line)
+			return LookupResult::Missing;
+
+		value = line->value;
+		return LookupResult::Found;
+	}
+
+	// The lines of a section, or the names of the keys in it, as a list of null terminated strings.
+	LookupResult GetSection(const char* fileName, std::string_view section, bool keyNames, std::string& list)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		File* file = GetFile(fileName);
+		if (!file)
+			return LookupResult::NotCached;
+
+		const size_t sectionIndex = file->FindSection(section);
+		if (sectionIndex == File::npos)
+			return LookupResult::Missing;
+
+		list.clear();
+		for (size_t i = sectionIndex + 1; i < file->lines.size() && file->lines[i].kind != Line::Kind::Section; ++i)
+		{
+			const Line& line = file->lines[i];
+			if (line.kind == Line::Kind::Key)
+			{
+				list.append(keyNames ? line.name : trim(line.text));
+				list.push_back('\0');
+			}
+			else if (!keyNames && !trim(line.text).empty())
+			{
+				list.append(trim(line.text));
+				list.push_back('\0');
+			}
+		}
+
+		return LookupResult::Found;
+	}
+
+	LookupResult GetSectionNames(const char* fileName, std::string& list)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		File* file = GetFile(fileName);
+		if (!file)
+			return LookupResult::NotCached;
+
+		list.clear();
+		for (const Line& line : file->lines)
+		{
+			if (line.kind == Line::Kind::Section)
+			{
+				list.append(line.name);
+				list.push_back('\0');
+			}
+		}
+
+		return LookupResult::Found;
+	}
+
+	// A null key removes the section, a null value removes the key. Returns false if the file should
+	// be written with the Win32 function instead.
+	bool WriteString(const char* fileName, const char* section, const char* key, const char* value, bool& result)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		File* file = GetFile(fileName);
+		if (!file || !section)
+			return false;
+
+		file->WriteString(section, key, value);
+		result = Written(fileName, *file);
+		return true;
+	}
+
+	// keysAndValues is a list of null terminated "key=value" strings, ending with an empty one.
+	bool WriteSection(const char* fileName, const char* section, const char* keysAndValues, bool& result)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		File* file = GetFile(fileName);
+		if (!file || !section)
+			return false;
+
+		file->WriteSection(section, keysAndValues);
+		result = Written(fileName, *file);
+		return true;
+	}
+
+	void BeginBatch(const char* fileName)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		if (File* entry = FindEntry(fileName))
+			++entry->batchDepth;
+		else
+			m_files.emplace_back(std::make_unique<File>(NormalizePath(fileName)))->batchDepth = 1;
+	}
+
+	void EndBatch(const char* fileName)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		File* file = FindEntry(fileName);
+		if (file && file->batchDepth > 0 && --file->batchDepth == 0 && file->dirty)
+			Flush(fileName, *file);
+	}
+
+private:
+	// Two seconds in file time, the resolution of the coarsest file systems.
+	static constexpr uint64_t RecentTicks = 2 * 10'000'000ULL;
+
+	static uint64_t HashContents(std::string_view contents)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		for (char ch : contents)
+		{
+			hash ^= static_cast<uint8_t>(ch);
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	enum class ReadResult
+	{
+		Read,
+		Missing,
+		PassThrough,                                 // too big, or UTF-16
+		Failed,
+	};
+
+	struct FileStamp
+	{
+		bool exists = false;
+		FILETIME creationTime = {};
+		FILETIME lastWriteTime = {};
+		DWORD sizeHigh = 0;
+		DWORD sizeLow = 0;
+
+		bool operator==(const FileStamp& other) const
+		{
+			return exists == other.exists
+				&& CompareFileTime(&creationTime, &other.creationTime) == 0
+				&& CompareFileTime(&lastWriteTime, &other.lastWriteTime) == 0
+				&& sizeHigh == other.sizeHigh
+				&& sizeLow == other.sizeLow;
+		}
+		bool operator!=(const FileStamp& other) const { return !(*this == other); }
+
+		// Written so recently that another write in the same tick of the file times wouldn't show.
+		bool IsRecent() const
+		{
+			if (!exists)
+				return false;
+
+			FILETIME now;
+			GetSystemTimeAsFileTime(&now);
+
+			const uint64_t nowTicks = (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+			const uint64_t writeTicks = (static_cast<uint64_t>(lastWriteTime.dwHighDateTime) << 32) | lastWriteTime.dwLowDateTime;
+			return nowTicks < writeTicks + RecentTicks;
+		}
+
+		static FileStamp Get(const char* fileName)
+		{
+			FileStamp stamp;
+
+			WIN32_FILE_ATTRIBUTE_DATA data;
+			if (GetFileAttributesExA(fileName, GetFileExInfoStandard, &data)
+				&& (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+			{
+				stamp.exists = true;
+				stamp.creationTime = data.ftCreationTime;
+				stamp.lastWriteTime = data.ftLastWriteTime;
+				stamp.sizeHigh = data.nFileSizeHigh;
+				stamp.sizeLow = data.nFileSizeLow;
+			}
+
+			return stamp;
+		}
+	};
+
+	struct Line
+	{
+		enum class Kind { Other, Section, Key };
+
+		std::string text;
+		Kind kind = Kind::Other;
+		std::string name;                            // of the section or key
+		std::string value;                           // of a key, without the quotes
+
+		explicit Line(std::string text_) : text(std::move(text_)) { Parse(); }
+
+		void Parse()
+		{
+			kind = Kind::Other;
+			name.clear();
+			value.clear();
+
+			std::string_view line = trim(std::string_view(text));
+			if (!line.empty() && line[0] == '[')
+			{
+				kind = Kind::Section;
+
+				line.remove_prefix(1);
+				if (size_t end = line.find(']'); end != std::string_view::npos)
+					line = line.substr(0, end);
+				name = trim(line);
+				return;
+			}
+
+			const size_t equals = line.find('=');
+			if (equals == std::string_view::npos)
+				return;
+
+			kind = Kind::Key;
+			name = trim(line.substr(0, equals));
+
+			std::string_view val = trim(line.substr(equals + 1));
+			if (val.length() >= 2 && (val.front() == '"' || val.front() == '\'') && val.back() == val.front())
+				val = val.substr(1, val.length() - 2);
+			value = val;
+		}
+	};
+
+	// A write that hasn't been written back yet. A null key or value is kept as missing.
+	struct PendingWrite
+	{
+		bool isSection = false;
+		std::string section;
+		std::optional<std::string> key;
+		std::optional<std::string> value;            // or the keys and values of a section, with their nulls
+	};
+
+	struct File
+	{
+		static constexpr size_t npos = static_cast<size_t>(-1);
+
+		std::string path;
+		FileStamp stamp;
+		uint64_t contentHash = 0;                    // of the contents as they were last read or written
+		bool loaded = false;
+		bool passThrough = false;                    // a file we leave to the Win32 functions
+		bool dirty = false;
+		int batchDepth = 0;
+		std::vector<Line> lines;
+		std::vector<PendingWrite> pending;
+
+		explicit File(std::string path_) : path(std::move(path_)) {}
+
+		size_t FindSection(std::string_view section) const
+		{
+			section = trim(section);
+			for (size_t i = 0; i < lines.size(); ++i)
+			{
+				if (lines[i].kind == Line::Kind::Section && ci_equals(lines[i].name, section))
+					return i;
+			}
+
+			return npos;
+		}
+
+		size_t FindKeyLine(size_t sectionIndex, std::string_view key) const
+		{
+			key = trim(key);
+			for (size_t i = sectionIndex + 1; i < lines.size() && lines[i].kind != Line::Kind::Section; ++i)
+			{
+				if (lines[i].kind == Line::Kind::Key && ci_equals(lines[i].name, key))
+					return i;
+			}
+
+			return npos;
+		}
+
+		const Line* FindKey(std::string_view section, std::string_view key) const
+		{
+			const size_t sectionIndex = FindSection(section);
+			if (sectionIndex == npos)
+				return nullptr;
+
+			const size_t keyIndex = FindKeyLine(sectionIndex, key);
+			return keyIndex != npos ? &lines[keyIndex] : nullptr;
+		}
+
+		// one past the last line of the section that isn't blank
+		size_t GetSectionInsertPoint(size_t sectionIndex) const
+		{
+			size_t insertAt = sectionIndex + 1;
+			for (size_t i = sectionIndex + 1; i < lines.size() && lines[i].kind != Line::Kind::Section; ++i)
+			{
+				if (!trim(lines[i].text).empty())
+					insertAt = i + 1;
+			}
+
+			return insertAt;
+		}
+
+		size_t GetSectionEnd(size_t sectionIndex) const
+		{
+			size_t i = sectionIndex + 1;
+			while (i < lines.size() && lines[i].kind != Line::Kind::Section)
+				++i;
+			return i;
+		}
+
+		void WriteString(std::string_view section, const char* key, const char* value)
+		{
+			PendingWrite& write = pending.emplace_back();
+			write.section = section;
+			if (key)
+				write.key = key;
+			if (value)
+				write.value = value;
+
+			ApplyString(section, key, value);
+		}
+
+		void WriteSection(std::string_view section, const char* keysAndValues)
+		{
+			PendingWrite& write = pending.emplace_back();
+			write.isSection = true;
+			write.section = section;
+
+			// keep the list with its nulls, up to and including the empty string that ends it
+			std::string list;
+			for (const char* entry = keysAndValues; entry && *entry; entry += strlen(entry) + 1)
+				list.append(entry, strlen(entry) + 1);
+			list.push_back('\0');
+			write.value = std::move(list);
+
+			ApplySection(section, keysAndValues);
+		}
+
+		// Applies the writes that haven't been written back to lines that were just read again.
+		void ApplyPending()
+		{
+			for (const PendingWrite& write : pending)
+			{
+				if (write.isSection)
+					ApplySection(write.section, write.value->c_str());
+				else
+					ApplyString(write.section, write.key ? write.key->c_str() : nullptr, write.value ? write.value->c_str() : nullptr);
+			}
+
+			dirty = !pending.empty();
+		}
+
+		void ApplyString(std::string_view section, const char* key, const char* value)
+		{
+			size_t sectionIndex = FindSection(section);
+
+			if (!key)
+			{
+				if (sectionIndex != npos)
+				{
+					lines.erase(lines.begin() + sectionIndex, lines.begin() + GetSectionEnd(sectionIndex));
+					dirty = true;
+				}
+				return;
+			}
+
+			if (sectionIndex == npos)
+			{
+				if (!value)
+					return;
+
+				lines.emplace_back("[" + std::string(trim(section)) + "]");
+				sectionIndex = lines.size() - 1;
+			}
+
+			const size_t keyIndex = FindKeyLine(sectionIndex, key);
+			if (!value)
+			{
+				if (keyIndex != npos)
+				{
+					lines.erase(lines.begin() + keyIndex);
+					dirty = true;
+				}
+				return;
+			}
+
+			if (keyIndex != npos)
+			{
+				Line& line = lines[keyIndex];
+				line.text = line.name + "=" + value;
+				line.Parse();
+			}
+			else
+			{
+				lines.emplace(lines.begin() + GetSectionInsertPoint(sectionIndex), std::string(trim(key)) + "=" + value);
+			}
+
+			dirty = true;
+		}
+
+		void ApplySection(std::string_view section, const char* keysAndValues)
+		{
+			size_t sectionIndex = FindSection(section);
+			if (sectionIndex == npos)
+			{
+				lines.emplace_back("[" + std::string(trim(section)) + "]");
+				sectionIndex = lines.size() - 1;
+			}
+			else
+			{
+				lines.erase(lines.begin() + sectionIndex + 1, lines.begin() + GetSectionEnd(sectionIndex));
+			}
+
+			size_t insertAt = sectionIndex + 1;
+			for (const char* entry = keysAndValues; entry && *entry; entry += strlen(entry) + 1)
+				lines.emplace(lines.begin() + insertAt++, entry);
+
+			dirty = true;
+		}
+
+		// Reads the file again and applies the writes that haven't been written back on top of it.
+		bool Load(const char* fileName)
+		{
+			std::string contents;
+			return Load(ReadContents(fileName, stamp, contents), contents);
+		}
+
+		bool Load(ReadResult result, const std::string& contents)
+		{
+			// keep the writes that are waiting on a batch, and try reading it again on the next access
+			if (result == ReadResult::Failed && loaded && !pending.empty())
+			{
+				stamp = FileStamp{};
+				return false;
+			}
+
+			lines.clear();
+			passThrough = result == ReadResult::PassThrough;
+			loaded = result == ReadResult::Read || result == ReadResult::Missing;
+			contentHash = HashContents(contents);
+
+			if (!loaded || passThrough)
+			{
+				dirty = false;
+				pending.clear();
+				return false;
+			}
+
+			Parse(contents);
+			ApplyPending();
+			return true;
+		}
+
+		void Parse(const std::string& contents)
+		{
+			lines.clear();
+
+			size_t start = 0;
+			while (start < contents.size())
+			{
+				size_t end = contents.find('\n', start);
+				if (end == std::string::npos)
+					end = contents.size();
+
+				size_t lineEnd = end;
+				if (lineEnd > start && contents[lineEnd - 1] == '\r')
+					--lineEnd;
+
+				lines.emplace_back(contents.substr(start, lineEnd - start));
+				start = end + 1;
+			}
+		}
+
+		std::string Serialize() const
+		{
+			std::string contents;
+			for (const Line& line : lines)
+			{
+				contents.append(line.text);
+				contents.append("\r\n");
+			}
+
+			return contents;
+		}
+	};
+
+	static ReadResult ReadContents(const char* fileName, const FileStamp& stamp, std::string& contents)
+	{
+		contents.clear();
+
+		if (!stamp.exists)
+			return ReadResult::Missing;
+
+		// big files are left alone, settings files don't get anywhere close to this
+		if (stamp.sizeHigh != 0 || stamp.sizeLow > 16 * 1024 * 1024)
+			return ReadResult::PassThrough;
+
+		HANDLE hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE)
+			return GetLastError() == ERROR_FILE_NOT_FOUND ? ReadResult::Missing : ReadResult::Failed;
+
+		// the size can have changed since the stamp was taken
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(hFile, &size) || size.HighPart != 0 || size.LowPart > 16 * 1024 * 1024)
+		{
+			CloseHandle(hFile);
+			return ReadResult::PassThrough;
+		}
+
+		contents.resize(size.LowPart);
+		DWORD bytesRead = 0;
+		const BOOL success = ReadFile(hFile, contents.data(), static_cast<DWORD>(contents.size()), &bytesRead, nullptr);
+		CloseHandle(hFile);
+
+		if (!success)
+			return ReadResult::Failed;
+		contents.resize(bytesRead);
+
+		if (contents.size() >= 2 && static_cast<uint8_t>(contents[0]) == 0xff && static_cast<uint8_t>(contents[1]) == 0xfe)
+			return ReadResult::PassThrough;
+
+		return ReadResult::Read;
+	}
+
+	static std::string NormalizePath(const char* fileName)
+	{
+		std::string path = fileName ? fileName : "";
+		for (char& ch : path)
+		{
+			if (ch == '/')
+				ch = '\\';
+		}
+
+		return path;
+	}
+
+	static bool IsAbsolutePath(std::string_view path)
+	{
+		return (path.length() >= 3 && path[1] == ':' && path[2] == '\\')
+			|| (path.length() >= 2 && path[0] == '\\' && path[1] == '\\');
+	}
+
+	File* FindEntry(const char* fileName)
+	{
+		const std::string path = NormalizePath(fileName);
+		for (const auto& file : m_files)
+		{
+			if (ci_equals(file->path, path))
+				return file.get();
+		}
+
+		return nullptr;
+	}
+
+	// The parsed file, up to date with what is on disk. Null if the file isn't cached.
+	File* GetFile(const char* fileName)
+	{
+		if (!fileName || !IsAbsolutePath(NormalizePath(fileName)))
+			return nullptr;
+
+		File* file = FindEntry(fileName);
+		if (!file)
+			file = m_files.emplace_back(std::make_unique<File>(NormalizePath(fileName))).get();
+
+		const FileStamp stamp = FileStamp::Get(fileName);
+		if (!file->loaded || stamp != file->stamp)
+		{
+			// writes that are waiting on a batch are applied again on top of the change made under us
+			file->stamp = stamp;
+			file->Load(fileName);
+		}
+		else if (stamp.IsRecent())
+		{
+			// another write in the same tick keeps the stamp, but not the contents
+			std::string contents;
+			const ReadResult result = ReadContents(fileName, stamp, contents);
+			if (result != ReadResult::Read || HashContents(contents) != file->contentHash)
+				file->Load(result, contents);
+		}
+
+		if (!file->loaded || file->passThrough)
+			return nullptr;
+
+		return file;
+	}
+
+	bool Written(const char* fileName, File& file)
+	{
+		if (file.batchDepth > 0 || !file.dirty)
+			return true;
+
+		return Flush(fileName, file);
+	}
+
+	// Clients that write the same file take turns, so that none of them writes back a file that
+	// another one changed after it was read.
+	static HANDLE AcquireFileMutex(const std::string& path)
+	{
+		std::string name = "Local\\MQIniFile-";
+		std::string lowerPath = path;
+		std::transform(lowerPath.begin(), lowerPath.end(), lowerPath.begin(), [](char ch) { return static_cast<char>(::tolower(static_cast<uint8_t>(ch))); });
+
+		char hash[17];
+		sprintf_s(hash, "%016llx", static_cast<unsigned long long>(HashContents(lowerPath)));
+		name.append(hash);
+
+		HANDLE hMutex = CreateMutexA(nullptr, FALSE, name.c_str());
+		if (hMutex)
+		{
+			// a writer that hangs doesn't keep everyone else from saving
+			const DWORD wait = WaitForSingleObject(hMutex, 2000);
+			if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED)
+			{
+				CloseHandle(hMutex);
+				return nullptr;
+			}
+		}
+
+		return hMutex;
+	}
+
+	static void ReleaseFileMutex(HANDLE hMutex)
+	{
+		if (hMutex)
+		{
+			ReleaseMutex(hMutex);
+			CloseHandle(hMutex);
+		}
+	}
+
+	bool Flush(const char* fileName, File& file)
+	{
+		HANDLE hMutex = AcquireFileMutex(file.path);
+
+		// Whatever was written since we last read the file is kept, and our writes go on top of it.
+		std::string current;
+		const ReadResult readResult = ReadContents(fileName, FileStamp::Get(fileName), current);
+		if ((readResult == ReadResult::Read || readResult == ReadResult::Missing) && HashContents(current) != file.contentHash)
+		{
+			file.Parse(current);
+			file.contentHash = HashContents(current);
+			file.ApplyPending();
+		}
+
+		const std::string contents = file.Serialize();
+
+		// written next to the file and moved over it, so nobody reads a half written file
+		const std::string tempName = file.path + "." + std::to_string(GetCurrentProcessId()) + "." + std::to_string(GetCurrentThreadId()) + ".tmp";
+
+		bool success = false;
+		HANDLE hFile = CreateFileA(tempName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile != INVALID_HANDLE_VALUE)
+		{
+			DWORD written = 0;
+			success = WriteFile(hFile, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr)
+				&& written == contents.size();
+			CloseHandle(hFile);
+
+			success = success && MoveFileExA(tempName.c_str(), fileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+			if (!success)
+				DeleteFileA(tempName.c_str());
+		}
+
+		// the file can't be replaced while someone else has it open without sharing delete, write it in place
+		if (!success)
+		{
+			hFile = CreateFileA(fileName, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (hFile != INVALID_HANDLE_VALUE)
+			{
+				DWORD written = 0;
+				success = WriteFile(hFile, contents.data(), static_cast<DWORD>(contents.size()), &written, nullptr)
+					&& written == contents.size();
+				CloseHandle(hFile);
+			}
+		}
+
+		file.dirty = false;
+		file.pending.clear();
+		file.stamp = FileStamp::Get(fileName);
+		file.contentHash = HashContents(contents);
+
+		ReleaseFileMutex(hMutex);
+
+		// read it again next time rather than trusting what we couldn't write
+		if (!success)
+			file.loaded = false;
+
+		return success;
+	}
+
+	std::mutex m_mutex;
+	std::vector<std::unique_ptr<File>> m_files;
+};
+
+// Collects the writes to an ini file made while it exists, and writes the file once at the end.
+class ScopedPrivateProfileBatch
+{
+public:
+	explicit ScopedPrivateProfileBatch(std::string iniFileName)
+		: m_iniFileName(std::move(iniFileName))
+	{
+		PrivateProfileCache::Instance().BeginBatch(m_iniFileName.c_str());
+	}
+
+	~ScopedPrivateProfileBatch()
+	{
+		PrivateProfileCache::Instance().EndBatch(m_iniFileName.c_str());
+	}
+
+	ScopedPrivateProfileBatch(const ScopedPrivateProfileBatch&) = delete;
+	ScopedPrivateProfileBatch& operator=(const ScopedPrivateProfileBatch&) = delete;
+
+private:
+	std::string m_iniFileName;
+};
+
+namespace detail {
+
+// Copies a value into a buffer the way the Win32 functions do: truncated to fit, and returning the
+// number of characters copied.
+inline DWORD CopyProfileString(std::string_view value, char* buffer, size_t size)
+{
+	if (!buffer || size == 0)
+		return 0;
+
+	const size_t length = std::min(value.length(), size - 1);
+	memcpy(buffer, value.data(), length);
+	buffer[length] = '\0';
+	return static_cast<DWORD>(length);
+}
+
+// Copies a list of null terminated strings, ending it with an extra null.
+inline DWORD CopyProfileList(std::string_view list, char* buffer, size_t size)
+{
+	if (!buffer || size < 2)
+	{
+		if (buffer && size == 1)
+			buffer[0] = '\0';
+		return 0;
+	}
+
+	if (list.length() <= size - 2)
+	{
+		memcpy(buffer, list.data(), list.length());
+		buffer[list.length()] = '\0';
+		buffer[list.length() + 1] = '\0';
+		return static_cast<DWORD>(list.length());
+	}
+
+	memcpy(buffer, list.data(), size - 2);
+	buffer[size - 2] = '\0';
+	buffer[size - 1] = '\0';
+	return static_cast<DWORD>(size - 2);
+}
+
+inline DWORD ReadProfileString(const char* section, const char* key, const char* defaultValue, char* buffer, size_t size, const char* iniFileName)
+{
+	PrivateProfileCache& cache = PrivateProfileCache::Instance();
+	std::string value;
+	PrivateProfileCache::LookupResult result;
+
+	if (!section)
+	{
+		result = cache.GetSectionNames(iniFileName, value);
+		if (result != PrivateProfileCache::LookupResult::NotCached)
+			return CopyProfileList(value, buffer, size);
+	}
+	else if (!key)
+	{
+		result = cache.GetSection(iniFileName, section, true, value);
+		if (result != PrivateProfileCache::LookupResult::NotCached)
+			return CopyProfileList(result == PrivateProfileCache::LookupResult::Found ? value : std::string(), buffer, size);
+	}
+	else
+	{
+		result = cache.GetString(iniFileName, section, key, value);
+		if (result == PrivateProfileCache::LookupResult::Found)
+			return CopyProfileString(value, buffer, size);
+
+		if (result == PrivateProfileCache::LookupResult::Missing)
+		{
+			// like the Win32 function, trailing blanks are removed from the default
+			std::string_view defaultView = defaultValue ? defaultValue : "";
+			while (!defaultView.empty() && defaultView.back() == ' ')
+				defaultView.remove_suffix(1);
+			return CopyProfileString(defaultView, buffer, size);
+		}
+	}
+
+	return ::GetPrivateProfileStringA(section, key, defaultValue, buffer, static_cast<DWORD>(size), iniFileName);
+}
+
+inline DWORD ReadProfileSection(const char* section, char* buffer, size_t size, const char* iniFileName)
+{
+	std::string value;
+	auto result = PrivateProfileCache::Instance().GetSection(iniFileName, section ? section : "", false, value);
+	if (result != PrivateProfileCache::LookupResult::NotCached)
+		return CopyProfileList(result == PrivateProfileCache::LookupResult::Found ? value : std::string(), buffer, size);
+
+	return ::GetPrivateProfileSectionA(section, buffer, static_cast<DWORD>(size), iniFileName);
+}
+
+inline int ReadProfileInt(const char* section, const char* key, int defaultValue, const char* iniFileName)
+{
+	std::string value;
+	auto result = PrivateProfileCache::Instance().GetString(iniFileName, section ? section : "", key ? key : "", value);
+	if (result == PrivateProfileCache::LookupResult::Missing)
+		return defaultValue;
+
+	if (result == PrivateProfileCache::LookupResult::Found)
+	{
+		// decimal, or hex with a 0x prefix. Values that don't fit wrap around like they do for
+		// GetPrivateProfileInt (colors are written as unsigned).
+		const char* str = value.c_str();
+		const bool negative = *str == '-';
+		if (negative)
+			++str;
+
+		int base = 10;
+		if (str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+		{
+			base = 16;
+			str += 2;
+		}
+
+		uint64_t parsed = std::strtoull(str, nullptr, base);
+		if (negative)
+			parsed = 0 - parsed;
+		return static_cast<int>(static_cast<uint32_t>(parsed));
+	}
+
+	return ::GetPrivateProfileIntA(section, key, defaultValue, iniFileName);
+}
+
+inline bool WriteProfileString(const char* section, const char* key, const char* value, const char* iniFileName)
+{
+	bool result = false;
+	if (PrivateProfileCache::Instance().WriteString(iniFileName, section, key, value, result))
+		return result;
+
+	return ::WritePrivateProfileStringA(section, key, value, iniFileName) != FALSE;
+}
+
+inline bool WriteProfileSection(const char* section, const char* keysAndValues, const char* iniFileName)
+{
+	bool result = false;
+	if (PrivateProfileCache::Instance().WriteSection(iniFileName, section, keysAndValues, result))
+		return result;
+
+	return ::WritePrivateProfileSectionA(section, keysAndValues, iniFileName) != FALSE;
+}
+
+} // namespace detail
+
+} // namespace mq
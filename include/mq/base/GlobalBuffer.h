@@ -23,6 +23,10 @@
 namespace mq {
 
 // This allows us to swap out the underlying buffer for DataTypeTemp
+//
+// Every thread has a buffer of its own: the main thread uses the one in here, other threads get one
+// when they first use it. Pushing a buffer only replaces the buffer of the calling thread, so macro
+// data can be evaluated off the main thread without overwriting what the main thread is working on.
 struct SGlobalBuffer
 {
 	static constexpr size_t bufferSize = 2048;
@@ -32,26 +36,36 @@ struct SGlobalBuffer
 	~SGlobalBuffer();
 
 	template <typename Index>
-	char& operator[](Index index) { return ptr[static_cast<size_t>(index)]; }
+	char& operator[](Index index) { return data()[static_cast<size_t>(index)]; }
 
 	template <typename Index>
-	char operator[](Index index) const { return ptr[static_cast<size_t>(index)]; }
+	char operator[](Index index) const { return data()[static_cast<size_t>(index)]; }
 
 	template <typename Index>
-	char* operator& (Index index) const { return &ptr[static_cast<size_t>(index)]; }
+	char* operator& (Index index) const { return &data()[static_cast<size_t>(index)]; }
 
-	operator char* () const { return ptr; }
+	operator char* () const { return data(); }
 
-	operator std::string_view() const { return { ptr }; }
+	operator std::string_view() const { return { data() }; }
 
 	[[nodiscard]] constexpr size_t size() const { return bufferSize; }
-	[[nodiscard]] char* begin() const { return ptr; }
-	[[nodiscard]] char* end() const { return ptr + strlen(ptr); }
+	[[nodiscard]] char* begin() const { return data(); }
+	[[nodiscard]] char* end() const
+	{
+		char* current = data();
+		return current + strlen(current);
+	}
+
+	// The current buffer of the calling thread.
+	[[nodiscard]] MQLIB_OBJECT char* data() const;
 
 	MQLIB_OBJECT void push_buffer(char* new_buffer);
 	MQLIB_OBJECT void pop_buffer();
 
 private:
+	struct ThreadBuffer;
+	ThreadBuffer* GetThreadBuffer() const;
+
 	char* ptr = nullptr;
 	std::stack<char*> m_stack;
 };
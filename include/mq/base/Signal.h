@@ -13,192 +13,388 @@
  */
 
 // Implements a c++11 style signal
+//
+// Slots are kept in a vector and called in the order they were connected. Arguments are passed to
+// every slot by reference, so an emission only copies them for slots that take them by value.
+// Slots connected during an emission are first called by the next one, and slots disconnected
+// during an emission are removed once it finishes. A slot must not destroy the signal calling it.
+// Empty callbacks, such as an empty std::function, are never connected.
 
 #pragma once
 
-#include <functional>
-#include <list>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-namespace mq {
+#include "mq/base/ScopeExit.h"
 
-template <typename... T>
-class SignalConnection;
+namespace mq {
 
-template <typename... T>
-class ScopedSignalConnection;
+template <typename T>
+using SignalArg = std::conditional_t<std::is_reference_v<T>, T, const T&>;
 
+// Move-only callable for signal slots. Callables with up to four pointers of captures are stored
+// inline, so connecting a small lambda doesn't allocate.
 template <typename... T>
-class SignalConnectionItem
+class SignalCallback
 {
+	static constexpr size_t InlineSize = 4 * sizeof(void*);
+
+	struct Operations
+	{
+		void (*invoke)(void* storage, SignalArg<T>... args);
+		void (*move)(void* destination, void* source);
+		void (*destroy)(void* storage);
+	};
+
+	template <typename F>
+	static constexpr bool IsInline = sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t)
+		&& std::is_nothrow_move_constructible_v<F>;
+
+	template <typename F>
+	static const Operations* GetOperations()
+	{
+		if constexpr (IsInline<F>)
+		{
+			static constexpr Operations operations = {
+				[](void* storage, SignalArg<T>... args) { (*static_cast<F*>(storage))(static_cast<SignalArg<T>>(args)...); },
+				[](void* destination, void* source)
+				{
+					new (destination) F(std::move(*static_cast<F*>(source)));
+					static_cast<F*>(source)->~F();
+				},
+				[](void* storage) { static_cast<F*>(storage)->~F(); },
+			};
+			return &operations;
+		}
+		else
+		{
+			static constexpr Operations operations = {
+				[](void* storage, SignalArg<T>... args) { (**static_cast<F**>(storage))(static_cast<SignalArg<T>>(args)...); },
+				[](void* destination, void* source) { *static_cast<F**>(destination) = *static_cast<F**>(source); },
+				[](void* storage) { delete *static_cast<F**>(storage); },
+			};
+			return &operations;
+		}
+	}
+
 public:
-	using Callback = std::function<void(T...)>;
+	SignalCallback() = default;
 
-	SignalConnectionItem(const Callback& cb, bool connected = true)
-		: m_callback(cb)
-		, m_connected(connected)
+	template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SignalCallback>>>
+	SignalCallback(F&& callback)
 	{
+		using Fn = std::decay_t<F>;
+
+		// A null function pointer or an empty std::function makes an empty callback, not one that
+		// fails when it is called.
+		if constexpr (std::is_constructible_v<bool, const Fn&>)
+		{
+			if (!static_cast<bool>(callback))
+				return;
+		}
+
+		if constexpr (IsInline<Fn>)
+			new (&m_storage) Fn(std::forward<F>(callback));
+		else
+			*reinterpret_cast<Fn**>(&m_storage) = new Fn(std::forward<F>(callback));
+
+		m_operations = GetOperations<Fn>();
 	}
 
-	~SignalConnectionItem()
+	SignalCallback(SignalCallback&& other) noexcept
 	{
+		MoveFrom(other);
 	}
 
-	void operator()(T... args)
+	SignalCallback& operator=(SignalCallback&& other) noexcept
 	{
-		if (m_connected && m_callback)
-			m_callback(args...);
+		if (this != &other)
+		{
+			Reset();
+			MoveFrom(other);
+		}
+
+		return *this;
 	}
 
-	bool IsConnected() const
+	SignalCallback(const SignalCallback&) = delete;
+	SignalCallback& operator=(const SignalCallback&) = delete;
+
+	~SignalCallback()
+	{
+		Reset();
+	}
+
+	explicit operator bool() const
 	{
-		return m_connected;
+		return m_operations != nullptr;
 	}
 
-	void Disconnect()
+	void operator()(SignalArg<T>... args)
 	{
-		m_connected = false;
+		m_operations->invoke(&m_storage, static_cast<SignalArg<T>>(args)...);
+	}
+
+	void Reset()
+	{
+		if (m_operations)
+		{
+			m_operations->destroy(&m_storage);
+			m_operations = nullptr;
+		}
 	}
 
 private:
-	Callback m_callback;
-	bool m_connected;
+	void MoveFrom(SignalCallback& other)
+	{
+		if (other.m_operations)
+		{
+			other.m_operations->move(&m_storage, &other.m_storage);
+			m_operations = other.m_operations;
+			other.m_operations = nullptr;
+		}
+	}
+
+	std::aligned_storage_t<InlineSize, alignof(std::max_align_t)> m_storage;
+	const Operations* m_operations = nullptr;
 };
 
 template <typename... T>
-class Signal
-{
-public:
-	using Callback = std::function<void(T...)>;
-	using Connection = SignalConnection<T...>;
-	using ScopedConnection = ScopedSignalConnection<T...>;
+class Signal;
 
-private:
-	using ConnectionItem = SignalConnectionItem<T...>;
-	using ConnectionList = std::list<std::shared_ptr<ConnectionItem>>;
+template <typename... T>
+class SignalConnection;
+
+template <typename... T>
+class ScopedSignalConnection;
 
-	ConnectionList m_list;
-	uint32_t m_recurseCount = 0;
+// The slots of a signal. Connections refer to it weakly, so they can outlive the signal.
+template <typename... T>
+class SignalState
+{
+	using Callback = SignalCallback<T...>;
 
-	void ClearDisconnected()
+	struct Slot
 	{
-		m_list.erase(std::remove_if(m_list.begin(), m_list.end(),
-			[](std::shared_ptr<ConnectionItem>& item)
-		{
-			return !item->IsConnected();
-		}), m_list.end());
+		uint64_t id;
+		bool connected;
+		Callback callback;
+	};
+
+	std::vector<Slot> m_slots;                   // sorted by id
+	std::vector<Slot> m_pending;                 // connected during an emission
+	uint64_t m_nextId = 1;
+	uint32_t m_emitDepth = 0;
+	uint32_t m_disconnected = 0;
+
+	Slot* FindSlot(uint64_t id)
+	{
+		auto iter = std::lower_bound(m_slots.begin(), m_slots.end(), id,
+			[](const Slot& slot, uint64_t value) { return slot.id < value; });
+		if (iter != m_slots.end() && iter->id == id && iter->connected)
+			return &*iter;
+
+		return nullptr;
 	}
-	
-public:
-	Signal() {}
 
-	~Signal()
+	void Compact()
 	{
-		for (auto& item : m_list)
-			item->Disconnect();
+		m_slots.erase(std::remove_if(m_slots.begin(), m_slots.end(),
+			[](const Slot& slot) { return !slot.connected; }), m_slots.end());
+		m_disconnected = 0;
 	}
 
-	void operator()(T... args)
+	void EndEmit()
 	{
-		std::list<std::shared_ptr<ConnectionItem>> list;
-		for (auto& item : m_list)
-		{
-			if (item->IsConnected())
-				list.push_back(item);
-		}
+		if (--m_emitDepth != 0)
+			return;
 
-		++m_recurseCount;
+		// The callbacks of slots disconnected during the emission may have still been running.
+		if (m_disconnected != 0)
+			Compact();
 
-		for (auto& item : list)
+		if (!m_pending.empty())
 		{
-			(*item)(args...);
+			m_slots.insert(m_slots.end(), std::make_move_iterator(m_pending.begin()),
+				std::make_move_iterator(m_pending.end()));
+			m_pending.clear();
 		}
-
-		if (--m_recurseCount == 0)
-			ClearDisconnected();
 	}
 
-	Connection Connect(const Callback& callback)
+public:
+	// Returns 0, and connects nothing, if the callback is empty.
+	uint64_t Connect(Callback&& callback)
 	{
-		auto item = std::make_shared<ConnectionItem>(callback, true);
-		m_list.push_back(item);
+		if (!callback)
+			return 0;
 
-		return Connection(*this, item);
+		const uint64_t id = m_nextId++;
+
+		// Adding to the slots during an emission could move the callback that is running.
+		if (m_emitDepth != 0)
+			m_pending.push_back(Slot{ id, true, std::move(callback) });
+		else
+			m_slots.push_back(Slot{ id, true, std::move(callback) });
+
+		return id;
 	}
 
-	bool Disconnect(const Connection& connection)
+	bool Disconnect(uint64_t id)
 	{
-		bool found = false;
-		for (auto& item : m_list)
+		if (Slot* slot = FindSlot(id))
 		{
-			if (connection.HasItem(*item) && item->IsConnected())
+			slot->connected = false;
+			++m_disconnected;
+
+			if (m_emitDepth == 0)
 			{
-				found = true;
-				item->Disconnect();
+				slot->callback.Reset();
+
+				// Skipping a disconnected slot is cheap, only move the others once there are many.
+				if (m_disconnected * 2 >= m_slots.size())
+					Compact();
 			}
+
+			return true;
 		}
 
-		if (found)
+		auto iter = std::find_if(m_pending.begin(), m_pending.end(),
+			[id](const Slot& slot) { return slot.id == id; });
+		if (iter != m_pending.end())
 		{
-			ClearDisconnected();
+			m_pending.erase(iter);
+			return true;
 		}
 
-		return found;
+		return false;
 	}
 
 	bool DisconnectAll()
 	{
-		for (auto& item : m_list)
-			item->Disconnect();
+		bool found = !m_pending.empty();
+		m_pending.clear();
+
+		for (Slot& slot : m_slots)
+		{
+			if (slot.connected)
+			{
+				slot.connected = false;
+				++m_disconnected;
+				found = true;
+			}
+		}
+
+		if (m_emitDepth == 0)
+			Compact();
 
-		ClearDisconnected();
+		return found;
+	}
+
+	bool IsConnected(uint64_t id)
+	{
+		return FindSlot(id) != nullptr
+			|| std::any_of(m_pending.begin(), m_pending.end(), [id](const Slot& slot) { return slot.id == id; });
 	}
 
-	friend class Connection;
+	void Emit(SignalArg<T>... args)
+	{
+		++m_emitDepth;
+		SCOPE_EXIT(EndEmit());
+
+		// Slots connected by a callback go to m_pending, so the slots can't move while we walk them.
+		const size_t count = m_slots.size();
+		for (size_t i = 0; i < count; ++i)
+		{
+			Slot& slot = m_slots[i];
+			if (slot.connected)
+				slot.callback(static_cast<SignalArg<T>>(args)...);
+		}
+	}
 };
 
 template <typename... T>
-class SignalConnection
+class Signal
 {
-private:
-	using Item = SignalConnectionItem<T...>;
+public:
+	using Callback = SignalCallback<T...>;
+	using Connection = SignalConnection<T...>;
+	using ScopedConnection = ScopedSignalConnection<T...>;
 
-	Signal<T...>* m_signal = nullptr;
-	std::shared_ptr<Item> m_item;
+private:
+	std::shared_ptr<SignalState<T...>> m_state;
 
 public:
-	SignalConnection() {}
+	Signal()
+		: m_state(std::make_shared<SignalState<T...>>())
+	{
+	}
 
-	SignalConnection(Signal<T...>& signal, const std::shared_ptr<Item>& item)
-		: m_signal(&signal)
-		, m_item(item)
-	{}
+	Signal(const Signal&) = delete;
+	Signal& operator=(const Signal&) = delete;
 
-	~SignalConnection()
-	{}
+	void operator()(SignalArg<T>... args)
+	{
+		m_state->Emit(static_cast<SignalArg<T>>(args)...);
+	}
 
-	void operator=(const SignalConnection& other)
+	Connection Connect(Callback callback)
 	{
-		m_signal = other.m_signal;
-		m_item = other.m_item;
+		const uint64_t id = m_state->Connect(std::move(callback));
+		if (id == 0)
+			return Connection();
+
+		return Connection(m_state, id);
+	}
+
+	bool Disconnect(const Connection& connection)
+	{
+		if (connection.m_state.lock() != m_state)
+			return false;
+
+		return m_state->Disconnect(connection.m_id);
 	}
 
-	bool HasItem(const Item& item) const
+	bool DisconnectAll()
 	{
-		return m_item.get() == &item;
+		return m_state->DisconnectAll();
 	}
+};
+
+template <typename... T>
+class SignalConnection
+{
+private:
+	std::weak_ptr<SignalState<T...>> m_state;
+	uint64_t m_id = 0;
+
+	friend class Signal<T...>;
+
+public:
+	SignalConnection() {}
+
+	SignalConnection(const std::shared_ptr<SignalState<T...>>& state, uint64_t id)
+		: m_state(state)
+		, m_id(id)
+	{}
 
 	bool IsConnected() const
 	{
-		return m_item->IsConnected();
+		auto state = m_state.lock();
+		return state && state->IsConnected(m_id);
 	}
 
 	bool Disconnect()
 	{
-		if (m_signal && m_item && m_item->IsConnected())
-			return m_signal->Disconnect(*this);
+		auto state = m_state.lock();
+		m_state.reset();
 
-		return false;
+		return state && state->Disconnect(m_id);
 	}
 };
 
@@ -208,14 +404,13 @@ class ScopedSignalConnection : public SignalConnection<T...>
 public:
 	ScopedSignalConnection() {}
 
-	ScopedSignalConnection(Signal<T...>* signal, void* callback)
-		: SignalConnection<T...>(signal, callback)
-	{}
-
 	ScopedSignalConnection(const SignalConnection<T...>& other)
 		: SignalConnection<T...>(other)
 	{}
 
+	ScopedSignalConnection(const ScopedSignalConnection&) = delete;
+	ScopedSignalConnection& operator=(const ScopedSignalConnection&) = delete;
+
 	~ScopedSignalConnection()
 	{
 		this->Disconnect();
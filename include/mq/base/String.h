@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include "mq/base/Common.h"
+
 #include <algorithm>
 #include <charconv>
 #include <string>
@@ -956,4 +958,63 @@ struct alphanum_less
 	}
 };
 
+//----------------------------------------------------------------------------
+
+// Returns the interned copy of a string, adding it to the table if add is true. Returns nullptr
+// if the string isn't interned and add is false. Interned strings are never freed.
+MQLIB_OBJECT const std::string* InternString(std::string_view str, bool add);
+
+/**
+ * @class Atom
+ *
+ * @brief An interned, case sensitive string
+ *
+ * Every atom with the same text refers to the same entry of a process wide table, so comparing
+ * and hashing atoms only looks at a pointer. Names that are looked up often, like top level
+ * objects, data types and members, are kept in maps keyed on atoms. Look them up with
+ * Atom::Find, which doesn't add to the table: a string that was never interned can't be a key.
+ **/
+class Atom
+{
+public:
+	Atom() = default;
+	explicit Atom(std::string_view str)
+		: m_entry(str.empty() ? nullptr : InternString(str, true))
+	{
+	}
+
+	// Returns the atom for str if one exists, otherwise an empty atom.
+	static Atom Find(std::string_view str)
+	{
+		Atom atom;
+		if (!str.empty())
+			atom.m_entry = InternString(str, false);
+		return atom;
+	}
+
+	bool empty() const { return m_entry == nullptr; }
+	explicit operator bool() const { return m_entry != nullptr; }
+
+	std::string_view view() const { return m_entry ? std::string_view(*m_entry) : std::string_view(); }
+	const char* c_str() const { return m_entry ? m_entry->c_str() : ""; }
+
+	size_t hash() const { return std::hash<const std::string*>()(m_entry); }
+
+	bool operator==(const Atom& other) const { return m_entry == other.m_entry; }
+	bool operator!=(const Atom& other) const { return m_entry != other.m_entry; }
+
+private:
+	const std::string* m_entry = nullptr;
+};
+
 } // namespace mq
+
+namespace std {
+
+template <>
+struct hash<mq::Atom>
+{
+	size_t operator()(const mq::Atom& atom) const noexcept { return atom.hash(); }
+};
+
+} // namespace std
@@ -0,0 +1,181 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "mq/base/Common.h"
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace mq {
+
+/**
+ * Bump allocator for short-lived intermediate data such as scratch buffers used while
+ * evaluating macro data. Memory is never freed individually. Instead, a MQTransientScope
+ * records the current position and rewinds the arena back to it when the scope ends, so nested
+ * evaluations release their allocations in stack order.
+ *
+ * Blocks are kept around after rewinding, so once the arena has warmed up, allocations
+ * do not touch the heap.
+ */
+class MQTransientArena
+{
+public:
+	static constexpr size_t DefaultBlockSize = 64 * 1024;
+
+	// Retained blocks beyond this count are released when the arena is rewound to the start.
+	static constexpr size_t MaxRetainedBlocks = 4;
+
+	struct Marker
+	{
+		size_t block = 0;
+		size_t offset = 0;
+	};
+
+	MQTransientArena() = default;
+	MQTransientArena(const MQTransientArena&) = delete;
+	MQTransientArena& operator=(const MQTransientArena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+	{
+		while (true)
+		{
+			if (m_current < m_blocks.size())
+			{
+				Block& block = m_blocks[m_current];
+				size_t offset = (m_offset + alignment - 1) & ~(alignment - 1);
+
+				if (offset + size <= block.size)
+				{
+					m_offset = offset + size;
+					return block.data.get() + offset;
+				}
+
+				// Blocks past the current one are unused, so one that is too small for this request
+				// can be replaced with a larger one.
+				if (m_current + 1 < m_blocks.size() && m_blocks[m_current + 1].size < size)
+				{
+					m_blocks[m_current + 1] = Block(size);
+				}
+
+				if (m_current + 1 < m_blocks.size() || m_offset != 0)
+				{
+					++m_current;
+					m_offset = 0;
+					continue;
+				}
+
+				// The current block is empty but too small
+				block = Block(size);
+				continue;
+			}
+
+			m_blocks.emplace_back(size > DefaultBlockSize ? size : DefaultBlockSize);
+			m_current = m_blocks.size() - 1;
+			m_offset = 0;
+		}
+	}
+
+	template <typename T>
+	T* AllocateArray(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>, "Transient allocations are never destroyed");
+		return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+	}
+
+	// Allocates a zero-initialized character buffer of the given size
+	char* AllocateString(size_t size)
+	{
+		char* buffer = AllocateArray<char>(size);
+		buffer[0] = 0;
+		return buffer;
+	}
+
+	Marker GetMarker() const { return { m_current, m_offset }; }
+
+	void Rewind(const Marker& marker)
+	{
+		m_current = marker.block;
+		m_offset = marker.offset;
+
+		if (m_current == 0 && m_offset == 0 && m_blocks.size() > MaxRetainedBlocks)
+		{
+			m_blocks.erase(m_blocks.begin() + MaxRetainedBlocks, m_blocks.end());
+		}
+	}
+
+	size_t GetReservedSize() const
+	{
+		size_t total = 0;
+		for (const Block& block : m_blocks)
+			total += block.size;
+		return total;
+	}
+
+private:
+	struct Block
+	{
+		std::unique_ptr<std::byte[]> data;
+		size_t size = 0;
+
+		explicit Block(size_t size_)
+			: data(std::make_unique<std::byte[]>(size_))
+			, size(size_)
+		{
+		}
+	};
+
+	std::vector<Block> m_blocks;
+	size_t m_current = 0;
+	size_t m_offset = 0;
+};
+
+/**
+ * Returns the transient arena for the calling thread.
+ */
+MQLIB_OBJECT MQTransientArena& GetTransientArena();
+
+/**
+ * Releases everything allocated from the thread's transient arena during the lifetime of this
+ * object when it goes out of scope.
+ */
+class [[nodiscard]] MQTransientScope
+{
+public:
+	MQTransientScope()
+		: m_arena(GetTransientArena())
+		, m_marker(m_arena.GetMarker())
+	{
+	}
+
+	~MQTransientScope()
+	{
+		m_arena.Rewind(m_marker);
+	}
+
+	MQTransientScope(const MQTransientScope&) = delete;
+	MQTransientScope& operator=(const MQTransientScope&) = delete;
+
+	MQTransientArena& GetArena() const { return m_arena; }
+
+private:
+	MQTransientArena& m_arena;
+	MQTransientArena::Marker m_marker;
+};
+
+} // namespace mq
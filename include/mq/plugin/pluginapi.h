@@ -20,6 +20,9 @@
 #include "../../src/main/MQ2Main.h"
 #include "mq/api/Main.h"
 
+#include <malloc.h>
+#include <new>
+
 #define PLUGIN_API extern "C" __declspec(dllexport)
 
 // The name of the plugin.
@@ -45,6 +48,37 @@ bool PluginMain(HINSTANCE hModule, DWORD dwReason, void* lpReserved);
 #define PLUGIN_VERSION(Version) \
 	extern __declspec(dllexport) float MQ2Version = static_cast<float>(Version);
 
+// Sets how often OnPulse is called, see mq::PluginPulseTier. For example:
+//   PLUGIN_PULSE_TIER(TenPerSecond);
+#define PLUGIN_PULSE_TIER(Tier) \
+	extern "C" __declspec(dllexport) mq::PluginPulseTier MQPulseTier = mq::PluginPulseTier::Tier;
+
+// Sets how often OnUpdateImGui is called while the frame limiter has ImGui headless, in
+// milliseconds. Nothing is drawn then, so the default of once a second is only to keep the state
+// of the windows current. 0 skips OnUpdateImGui until ImGui is drawn again. For example:
+//   PLUGIN_HEADLESS_IMGUI_INTERVAL(0);
+#define PLUGIN_HEADLESS_IMGUI_INTERVAL(Milliseconds) \
+	extern "C" __declspec(dllexport) int MQHeadlessImGuiInterval = Milliseconds;
+
+// Counts everything the plugin allocates with new and delete under the name of the plugin, see
+// mq/utils/MemoryAccounting.h. Use once, in one source file of the plugin:
+//   PLUGIN_MEMORY_ACCOUNTING();
+#define PLUGIN_MEMORY_ACCOUNTING() \
+	extern "C" __declspec(dllexport) mq::MQMemoryCounters MQPluginMemory{}; \
+	void* operator new(size_t size) \
+	{ \
+		void* ptr = malloc(size ? size : 1); \
+		if (!ptr) throw std::bad_alloc(); \
+		MQPluginMemory.Allocate(_msize(ptr)); \
+		return ptr; \
+	} \
+	void operator delete(void* ptr) noexcept \
+	{ \
+		if (!ptr) return; \
+		MQPluginMemory.Free(_msize(ptr)); \
+		free(ptr); \
+	}
+
 
 #if __has_include("../../../src/private/pluginapi-private.h")
 #include "../../../src/private/pluginapi-private.h"
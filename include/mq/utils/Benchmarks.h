@@ -22,15 +22,24 @@ namespace mq {
 // Benchmarks are used to measure the amount of time spent doing something. When
 // entering a benchmark, the current time is taken, and when leaving, the elapsed
 // time spent in the benchmark is added to the total.
+//
+// Benchmarks can be entered from any thread, and entered again before they are left
+// (recursion), each thread keeps its own stack of entry times. Every sample is also
+// counted in a histogram, which the percentiles are estimated from to within 12.5%.
 
 struct MQBenchmark
 {
 	std::string Name;
-	std::chrono::steady_clock::time_point Entry;
+	std::chrono::steady_clock::time_point Entry;     // No longer used, entry times are kept per thread
 	std::chrono::microseconds LastTime = std::chrono::microseconds::zero();
 	std::chrono::microseconds TotalTime = std::chrono::microseconds::zero();
 	uint64_t Count = 0;
 
+	std::chrono::microseconds MaxTime = std::chrono::microseconds::zero();
+	std::chrono::microseconds P50Time = std::chrono::microseconds::zero();
+	std::chrono::microseconds P95Time = std::chrono::microseconds::zero();
+	std::chrono::microseconds P99Time = std::chrono::microseconds::zero();
+
 	MQBenchmark(const std::string& name) : Name(name) {}
 	MQBenchmark() {}
 };
@@ -44,7 +53,7 @@ MQLIB_API uint32_t AddMQ2Benchmark(const char* Name);
 // Destroy a benchmark by its id.
 MQLIB_API void RemoveMQ2Benchmark(uint32_t BMHandle);
 
-// Returns a reference to a benchmark by looking up its id.
+// Returns a copy of a benchmark by looking up its id.
 MQLIB_API bool GetMQ2Benchmark(uint32_t BMHandle, MQBenchmark& Dest);
 
 // Enter the benchmark and start adding time.
@@ -53,6 +62,17 @@ MQLIB_API void EnterMQ2Benchmark(uint32_t BMHandle);
 // Leave the benchmark.
 MQLIB_API void ExitMQ2Benchmark(uint32_t BMHandle);
 
+// Add a zone to the frame timeline, for work that is timed without a benchmark of its own. Every
+// benchmark sample is added to the timeline as well. "/benchmark capture [frames]" writes the most
+// recent frames of the timeline to a trace that can be opened in chrome://tracing or Perfetto.
+MQLIB_API void AddTimelineZone(const char* Name, const char* Category,
+	std::chrono::steady_clock::time_point Start, std::chrono::steady_clock::time_point End);
+
+// Name the script that is running on the calling thread, so that slow expressions it evaluates
+// are reported with its name instead of a macro line. Pass nullptr once the script stops running.
+// Does nothing unless SlowExpressions=1 is set in the [MacroQuest] section of MacroQuest.ini.
+MQLIB_API void SetSlowExpressionSource(const char* Source);
+
 //----------------------------------------------------------------------------
 // Scoped benchmark object, enters the benchmark at creation and leaves the benchmark at the end
 // of the current scope.
@@ -0,0 +1,81 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <mq/base/Common.h>
+
+#include <atomic>
+#include <string>
+
+namespace mq {
+
+//----------------------------------------------------------------------------
+// Memory accounting keeps counters of how much memory each subsystem and plugin holds, under a
+// name. Whoever allocates updates the counters directly, so counting an allocation costs a few
+// atomic increments and no call into MacroQuest. Allocation rates are sampled from the totals
+// once per second.
+//
+// Counting the allocators that are hot, like those of Lua and ImGui, is enabled by setting
+// MemoryAccounting=1 in the [MacroQuest] section of MacroQuest.ini, and takes effect on restart.
+
+struct MQMemoryCounters
+{
+	std::atomic<int64_t> Current = 0;            // Bytes held right now
+	std::atomic<int64_t> Peak = 0;               // Most bytes held at once
+	std::atomic<uint64_t> TotalAllocated = 0;    // Bytes allocated ever
+	std::atomic<uint64_t> Allocations = 0;
+
+	void Allocate(size_t size)
+	{
+		const int64_t current = Current.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+		TotalAllocated.fetch_add(size, std::memory_order_relaxed);
+		Allocations.fetch_add(1, std::memory_order_relaxed);
+
+		int64_t peak = Peak.load(std::memory_order_relaxed);
+		while (current > peak && !Peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void Free(size_t size)
+	{
+		Current.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+	}
+
+	// For memory that grows and shrinks in place. Growing counts as an allocation.
+	void Resize(size_t oldSize, size_t newSize)
+	{
+		if (newSize > oldSize)
+			Allocate(newSize - oldSize);
+		else
+			Free(oldSize - newSize);
+	}
+};
+
+struct MQMemoryStats
+{
+	std::string Name;
+	int64_t Current = 0;
+	int64_t Peak = 0;
+	uint64_t TotalAllocated = 0;
+	uint64_t Allocations = 0;
+	uint64_t AllocationRate = 0;                 // Bytes allocated over the last second
+};
+
+// Get the counters to account memory under a name. Asking for the same name again returns the
+// same counters, which stay valid until MacroQuest shuts down.
+MQLIB_API MQMemoryCounters* GetMemoryCounters(const char* Name);
+
+} // namespace mq
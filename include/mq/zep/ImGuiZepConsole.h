@@ -29,6 +29,7 @@
 #include "zep/theme.h"
 
 #include <imgui/imgui.h>
+#include <deque>
 #include <memory>
 
 #pragma comment(lib, "zep.lib")
@@ -251,6 +252,17 @@ public:
 	float GetOpacity() const;
 	void SetOpacity(float opacity);
 
+	// Get/Set whether appended text waits for the next render. Waiting text is kept in a ring of at
+	// most the max number of lines, and is only parsed and inserted into the buffer when the console
+	// is rendered. Text that would be pruned before anyone sees it is never formatted, and a console
+	// that isn't shown doesn't pay for what is written to it.
+	bool GetDeferAppend() const { return m_deferAppend; }
+	void SetDeferAppend(bool deferAppend);
+
+	// Insert any text that is waiting for the next render into the buffer. Needed before inserting
+	// at the end of the buffer directly while appends are deferred.
+	void FlushPendingText();
+
 	// Append text to the console, parsing it for hyperlinks and color codes.
 	void AppendText(std::string_view text, MQColor defaultColor = MQColor(0, 0, 0, 0), bool appendNewLine = false);
 
@@ -294,6 +306,9 @@ private:
 	// Parse formatted text
 	void InsertFormattedText(Zep::GlyphIterator position, std::string_view text, ImU32 color);
 
+	// Parse text and color codes and insert it at the end of the buffer
+	void InsertAppendedText(std::string_view text, MQColor defaultColor, bool appendNewLine);
+
 	// Remove lines to keep us within the linecount limit
 	void PruneBuffer();
 
@@ -309,6 +324,19 @@ private:
 	Zep::ZepBuffer* m_buffer = nullptr;
 	int m_maxBufferLines = 10000;
 
+	// Text appended while appends are deferred, with the style it was appended with.
+	struct PendingText
+	{
+		std::string text;
+		ImGuiZepConsoleStyle style;
+		MQColor defaultColor;
+		bool appendNewLine;
+		int lines;
+	};
+	std::deque<PendingText> m_pendingText;
+	int m_pendingLines = 0;
+	bool m_deferAppend = false;
+
 	// Tracking information for autoscroll
 	int m_lastCursorIndex = 0;
 	bool m_lastCursorAtEnd = true;
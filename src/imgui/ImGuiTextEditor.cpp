@@ -2414,6 +2414,18 @@ void TextEditor::Colorize(int fromLine, int lineCount)
 	m_colorRangeMax = std::max(m_colorRangeMax, toLine);
 	m_colorRangeMin = std::max(0, m_colorRangeMin);
 	m_colorRangeMax = std::max(m_colorRangeMin, m_colorRangeMax);
+
+	for (int i = std::max(0, fromLine); i < toLine; ++i)
+		m_lines[i].colorDirty = true;
+
+	if (!m_checkComments)
+	{
+		m_commentRangeMin = std::numeric_limits<int>::max();
+		m_commentRangeMax = 0;
+	}
+
+	m_commentRangeMin = std::max(0, std::min(m_commentRangeMin, fromLine));
+	m_commentRangeMax = std::max(m_commentRangeMax, toLine);
 	m_checkComments = true;
 }
 
@@ -2427,10 +2439,15 @@ void TextEditor::ColorizeRange(int fromLine, int toLine)
 	std::string id;
 
 	int endLine = std::max(0, std::min((int)m_lines.size(), toLine));
-	for (int i = fromLine; i < endLine; ++i)
+	for (int i = std::max(0, fromLine); i < endLine; ++i)
 	{
 		Line& line = m_lines[i];
 
+		if (!line.colorDirty)
+			continue;
+
+		line.colorDirty = false;
+
 		if (line.glyphs.empty())
 			continue;
 
@@ -2543,6 +2560,27 @@ void TextEditor::ColorizeInternal()
 		int currentLine = 0;
 		int currentIndex = 0;
 
+		// Start from the last line before the edits that still knows the state it starts in.
+		currentLine = std::min(m_commentRangeMin, endLine - 1);
+		while (currentLine > 0 && !m_lines[currentLine].scanState.valid)
+			--currentLine;
+
+		if (currentLine > 0)
+		{
+			const LineScanState& state = m_lines[currentLine].scanState;
+
+			if (state.inComment)
+			{
+				commentStartLine = -1;
+				commentStartIndex = 0;
+			}
+			withinString = state.withinString;
+			withinSingleLineComment = state.withinSingleLineComment;
+			withinPreproc = state.withinPreproc;
+			firstChar = state.firstChar;
+			concatenate = true;         // the state already has the line start applied
+		}
+
 		while (currentLine < endLine || currentIndex < endIndex)
 		{
 			Line& line = m_lines[currentLine];
@@ -2554,6 +2592,23 @@ void TextEditor::ColorizeInternal()
 				firstChar = true;
 			}
 
+			if (currentIndex == 0)
+			{
+				LineScanState state;
+				state.valid = true;
+				state.inComment = commentStartLine < currentLine;
+				state.withinString = withinString;
+				state.withinSingleLineComment = withinSingleLineComment;
+				state.withinPreproc = withinPreproc;
+				state.firstChar = firstChar;
+
+				// Past the edits, a line that starts the same as last time ends the same as well.
+				if (currentLine >= m_commentRangeMax && state == line.scanState)
+					break;
+
+				line.scanState = state;
+			}
+
 			concatenate = false;
 
 			if (!line.glyphs.empty())
@@ -2658,10 +2713,25 @@ void TextEditor::ColorizeInternal()
 
 	if (m_colorRangeMin < m_colorRangeMax)
 	{
-		const int increment = (m_languageDefinition.tokenize == nullptr) ? 10 : 10000;
-		const int to = std::min(m_colorRangeMin + increment, m_colorRangeMax);
-		ColorizeRange(m_colorRangeMin, to);
-		m_colorRangeMin = to;
+		// Large files are tokenized over as many frames as it takes. The lines that are on screen go
+		// first, so that what is being looked at and typed in is never waiting on the rest.
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+
+		if (m_charAdvance.y > 0)
+		{
+			const int firstVisible = std::max(0, (int)floor(ImGui::GetScrollY() / m_charAdvance.y));
+			const int lastVisible = firstVisible + (int)ceil(ImGui::GetWindowHeight() / m_charAdvance.y) + 1;
+
+			ColorizeRange(std::max(firstVisible, m_colorRangeMin), std::min(lastVisible, m_colorRangeMax));
+		}
+
+		const int increment = (m_languageDefinition.tokenize == nullptr) ? 10 : 100;
+		do
+		{
+			const int to = std::min(m_colorRangeMin + increment, m_colorRangeMax);
+			ColorizeRange(m_colorRangeMin, to);
+			m_colorRangeMin = to;
+		} while (m_colorRangeMin < m_colorRangeMax && std::chrono::steady_clock::now() < deadline);
 
 		if (m_colorRangeMax == m_colorRangeMin)
 		{
@@ -197,9 +197,35 @@ using Glyphs = std::vector<Glyph>;
 
 //============================================================================
 
+// The state of the comment and string scan at the start of a line. It is kept with the line, so
+// that after an edit the scan only has to go from the changed lines until it reaches a line that
+// starts in the same state as before.
+struct LineScanState
+{
+	bool valid = false;
+	bool inComment = false;                      // within a multi line comment
+	bool withinString = false;
+	bool withinSingleLineComment = false;        // continued from the previous line with a '\'
+	bool withinPreproc = false;
+	bool firstChar = true;
+
+	bool operator==(const LineScanState& other) const
+	{
+		return valid == other.valid
+			&& inComment == other.inComment
+			&& withinString == other.withinString
+			&& withinSingleLineComment == other.withinSingleLineComment
+			&& withinPreproc == other.withinPreproc
+			&& firstChar == other.firstChar;
+	}
+	bool operator!=(const LineScanState& other) const { return !(*this == other); }
+};
+
 struct Line
 {
 	Glyphs glyphs;
+	LineScanState scanState;
+	bool colorDirty = false;                     // needs to be tokenized again
 
 	std::string to_string() const;
 
@@ -450,6 +476,8 @@ private:
 	bool m_cursorPositionChanged = false;
 	int m_colorRangeMin = 0;
 	int m_colorRangeMax = 0;
+	int m_commentRangeMin = 0;
+	int m_commentRangeMax = 0;
 	SelectionMode m_selectionMode = SelectionMode::Normal;
 	bool m_handleKeyboardInputs = true;
 	bool m_handleMouseInputs = true;
@@ -24,6 +24,8 @@
 
 #include "spdlog/spdlog.h"
 
+#include <atomic>
+
  // map of panels in the main GUI window
 static imgui::ImGuiTreePanelWindow* s_mainWindow = nullptr;
 static std::map<const char*, void(*)()> s_pendingPanels;
@@ -37,6 +39,11 @@ static std::vector<std::pair<std::string, std::function<void()>>> s_menus;
 
 // we want the context menu to call OpenPopup exactly once per right click, so we need a state toggle
 static bool s_contextOpen;
+static bool s_contextShown;
+
+// set when something changed that the next frames have to show, even if nothing looks visible. imgui
+// needs a frame or two to create or destroy the platform windows of the viewports.
+static std::atomic_bool s_renderRequested = true;
 
 // storage for filename strings for the backend
 static std::string s_iniFilename;
@@ -312,6 +319,16 @@ void OpenWindow(
 {
 	s_viewports.emplace(label, draw);
 	s_focusViewport = label;
+	RequestRender();
+}
+
+void RequestRender()
+{
+	s_renderRequested = true;
+
+	// wakes the main loop if it's waiting for messages
+	if (hMainWnd != nullptr)
+		PostMessageA(hMainWnd, WM_NULL, 0, 0);
 }
 
 void SelectMainPanel(const std::string& name)
@@ -358,6 +375,29 @@ bool RemoveContextGroup(const std::string& name)
 }
 
 void MaybeShowContextMenu();
+
+// Whether drawing a frame could show anything: a window or the context menu is open, and not every
+// platform window that imgui made for them is minimized.
+static bool HasVisibleUI()
+{
+	if (s_viewports.empty() && !s_contextOpen && !s_contextShown && EQPathErrorMessage.empty())
+		return false;
+
+	// the main viewport is the hidden main window, the others are the ones we draw in
+	const ImGuiPlatformIO& platformIO = ImGui::GetPlatformIO();
+	if (platformIO.Viewports.Size <= 1)
+		return true;
+
+	for (int i = 1; i < platformIO.Viewports.Size; ++i)
+	{
+		const HWND hWnd = static_cast<HWND>(platformIO.Viewports[i]->PlatformHandle);
+		if (hWnd == nullptr || (IsWindowVisible(hWnd) && !IsIconic(hWnd)))
+			return true;
+	}
+
+	return false;
+}
+
 void Run(const std::function<bool()>& mainLoop)
 {
 	s_mainWindow = new imgui::ImGuiTreePanelWindow("MacroQuest", { 640.f, 480.f });
@@ -425,7 +465,10 @@ void Run(const std::function<bool()>& mainLoop)
 
 				ImGui::SetNextWindowClass(&s_viewportClass);
 				if (!it->second())
+				{
 					it = s_viewports.erase(it);
+					s_renderRequested = true;
+				}
 				else
 					++it;
 			}
@@ -456,14 +499,55 @@ void Run(const std::function<bool()>& mainLoop)
 			MaybeShowContextMenu();
 		};
 
-	static std::chrono::time_point<std::chrono::steady_clock> s_nextFrame = std::chrono::steady_clock::now();
+	// Frames are only drawn while something could have changed: for a few frames after each message or
+	// render request, and on an idle tick that keeps timers and status text current. Nothing is drawn
+	// at all while no window is visible.
+	using namespace std::chrono_literals;
+	constexpr auto FrameInterval = 30ms; // 33 1/3 FPS
+	constexpr auto IdleInterval = 250ms;
+	constexpr int WakeFrames = 3;
+
+	int activeFrames = WakeFrames;
+	int forcedFrames = 0;
+	auto nextFrame = std::chrono::steady_clock::now();
+	auto nextIdleFrame = nextFrame;
+
 	while (mainLoop())
 	{
-		LauncherImGui::Backend::DrawFrame(draw_main);
-		std::this_thread::sleep_until(s_nextFrame);
+		if (s_renderRequested.exchange(false))
+		{
+			activeFrames = WakeFrames;
+			forcedFrames = WakeFrames;
+		}
 
-		// 33 1/3 FPS
-		s_nextFrame = s_nextFrame + std::chrono::milliseconds(30);
+		const auto now = std::chrono::steady_clock::now();
+		if ((activeFrames > 0 && now >= nextFrame) || now >= nextIdleFrame)
+		{
+			if (forcedFrames > 0 || HasVisibleUI())
+			{
+				LauncherImGui::Backend::DrawFrame(draw_main);
+
+				// a focused text input has a caret to blink
+				activeFrames = std::max(activeFrames - 1, ImGui::GetIO().WantTextInput ? 1 : 0);
+				forcedFrames = std::max(forcedFrames - 1, 0);
+			}
+			else
+			{
+				activeFrames = 0;
+			}
+
+			nextFrame = now + FrameInterval;
+			nextIdleFrame = now + IdleInterval;
+		}
+
+		// sleep until there is a message to handle or the next frame is due
+		const auto wakeAt = activeFrames > 0 ? std::min(nextFrame, nextIdleFrame) : nextIdleFrame;
+		const auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - std::chrono::steady_clock::now());
+		if (MsgWaitForMultipleObjectsEx(0, nullptr, static_cast<DWORD>(std::max<long long>(timeout.count(), 0)),
+			QS_ALLINPUT, MWMO_INPUTAVAILABLE) == WAIT_OBJECT_0)
+		{
+			activeFrames = WakeFrames;
+		}
 	}
 
 	LauncherImGui::Backend::Cleanup();
@@ -562,7 +646,15 @@ void MaybeShowContextMenu()
 
 	ImGui::SetNextWindowClass(&s_contextClass);
 
-	if (ImGui::BeginPopup("Context Popup", ImGuiWindowFlags_NoMove))
+	const bool contextShown = ImGui::BeginPopup("Context Popup", ImGuiWindowFlags_NoMove);
+	if (contextShown != s_contextShown)
+	{
+		// the popup's viewport has to be created or destroyed
+		s_contextShown = contextShown;
+		s_renderRequested = true;
+	}
+
+	if (contextShown)
 	{
 		// at the top we always want a way to open the GUI
 		if (ImGui::MenuItem("Open UI"))
@@ -40,6 +40,10 @@ void RemoveMainPanel(const char* name);
 bool AddContextGroup(const std::string& name, const std::function<void()>& callback);
 bool RemoveContextGroup(const std::string& name);
 void Run(const std::function<bool()>& mainLoop);
+
+// Wakes the main loop to draw the next frames, for state that changed without a window message.
+// Can be called from any thread.
+void RequestRender();
 void OpenMainWindow();
 void OpenContextMenu();
 void OpenMessageBox(ImGuiViewport* viewport, const std::string& message, const std::string& title, const ImVec2& size = ImVec2(320.0f, 200.0f));
@@ -15,6 +15,7 @@
 #include "loader/LoaderAutoLogin.h"
 #include "loader/MacroQuest.h"
 #include "loader/ImGui.h"
+#include "loader/ProcessMonitor.h"
 #include "imgui/ImGuiFileDialog.h"
 #include "imgui/imgui_internal.h"
 #include "login/Login.h"
@@ -25,16 +26,21 @@
 #include <fmt/os.h>
 #include <spdlog/spdlog.h>
 #include <wil/resource.h>
+#include <algorithm>
+#include <deque>
 #include <filesystem>
+#include <map>
+#include <unordered_map>
 #include <shellapi.h>
+#include <Pdh.h>
+
+#pragma comment(lib, "pdh")
 
 namespace fs = std::filesystem;
 using namespace std::chrono_literals;
 
 // set of loaded instances -- be careful to only read/write this from actors to ensure no race conditions
 static postoffice::Dropbox s_dropbox;
-static std::queue<std::pair<ProfileRecord, bool>> s_pendingLogins;
-static auto s_lastLoginTime = std::chrono::steady_clock::now();
 
 DWORD LaunchProcess(const std::string& process, const std::string& workingDir);
 
@@ -77,6 +83,243 @@ const char* GetClassShortName(const DWORD player_class)
 	return s_classInfo[player_class].UCShortName;
 }
 
+// How loaded the machine is, sampled at most once a second. Launching a client is mostly disk and
+// memory heavy, so all three are checked before starting another one.
+class HostLoad
+{
+	ULARGE_INTEGER m_lastIdle = {};
+	ULARGE_INTEGER m_lastTotal = {};
+	PDH_HQUERY m_query = nullptr;
+	PDH_HCOUNTER m_diskIdle = nullptr;
+	std::chrono::steady_clock::time_point m_lastSample;
+
+	int m_cpu = 0;
+	int m_memory = 0;
+	int m_disk = 0;
+
+public:
+	HostLoad()
+	{
+		if (PdhOpenQueryA(nullptr, 0, &m_query) == ERROR_SUCCESS)
+		{
+			if (PdhAddEnglishCounterA(m_query, R"(\PhysicalDisk(_Total)\% Idle Time)", 0, &m_diskIdle) != ERROR_SUCCESS)
+			{
+				PdhCloseQuery(m_query);
+				m_query = nullptr;
+			}
+			else
+			{
+				PdhCollectQueryData(m_query);
+			}
+		}
+
+		SampleCpu();
+	}
+
+	~HostLoad()
+	{
+		if (m_query)
+			PdhCloseQuery(m_query);
+	}
+
+	HostLoad(const HostLoad&) = delete;
+	HostLoad& operator=(const HostLoad&) = delete;
+
+	void Sample(std::chrono::steady_clock::time_point now)
+	{
+		if (now - m_lastSample < 1s)
+			return;
+
+		m_lastSample = now;
+		m_cpu = SampleCpu();
+
+		MEMORYSTATUSEX memory = { sizeof(MEMORYSTATUSEX) };
+		m_memory = GlobalMemoryStatusEx(&memory) ? static_cast<int>(memory.dwMemoryLoad) : 0;
+
+		m_disk = 0;
+		if (m_query && PdhCollectQueryData(m_query) == ERROR_SUCCESS)
+		{
+			PDH_FMT_COUNTERVALUE value;
+			if (PdhGetFormattedCounterValue(m_diskIdle, PDH_FMT_DOUBLE | PDH_FMT_NOCAP100, nullptr, &value) == ERROR_SUCCESS
+				&& value.CStatus == ERROR_SUCCESS)
+			{
+				m_disk = std::clamp(100 - static_cast<int>(value.doubleValue), 0, 100);
+			}
+		}
+	}
+
+	int Cpu() const { return m_cpu; }
+	int Memory() const { return m_memory; }
+	int Disk() const { return m_disk; }
+
+private:
+	int SampleCpu()
+	{
+		FILETIME fidle, fkernel, fuser;
+		if (!GetSystemTimes(&fidle, &fkernel, &fuser))
+			return 0;
+
+		ULARGE_INTEGER idle, kernel, user, total;
+		memcpy(&idle, &fidle, sizeof(FILETIME));
+		memcpy(&kernel, &fkernel, sizeof(FILETIME));
+		memcpy(&user, &fuser, sizeof(FILETIME));
+
+		// kernel time includes the idle time
+		total.QuadPart = kernel.QuadPart + user.QuadPart;
+
+		const uint64_t totalDelta = total.QuadPart - m_lastTotal.QuadPart;
+		const uint64_t idleDelta = idle.QuadPart - m_lastIdle.QuadPart;
+		m_lastIdle = idle;
+		m_lastTotal = total;
+
+		if (totalDelta == 0)
+			return 0;
+
+		return static_cast<int>(100 * (totalDelta - std::min(idleDelta, totalDelta)) / totalDelta);
+	}
+};
+
+struct PendingLogin
+{
+	ProfileRecord record;
+	bool force;
+};
+
+// a client that was started and hasn't reported that it loaded yet
+struct LaunchingClient
+{
+	std::string group;
+	std::chrono::steady_clock::time_point started;
+};
+
+static std::deque<PendingLogin> s_pendingLogins;
+static std::unordered_map<uint32_t, LaunchingClient> s_launchingClients;
+static std::map<std::string, LaunchProgress> s_launchProgress;
+static std::string s_launchStatus;
+static auto s_nextLaunchTime = std::chrono::steady_clock::now();
+static auto s_loginBackoffTime = std::chrono::steady_clock::now();
+static int s_loginRetries = 0; // since a client last loaded
+
+static LaunchProgress& GetGroupProgress(const std::string& group)
+{
+	return s_launchProgress[group];
+}
+
+// Groups are forgotten once nothing in them is queued or launching.
+static void CheckGroupFinished(const std::string& group)
+{
+	auto iter = s_launchProgress.find(group);
+	if (iter == s_launchProgress.end())
+		return;
+
+	const LaunchProgress& progress = iter->second;
+	if (progress.Queued > 0 || progress.Launching > 0)
+		return;
+
+	SPDLOG_INFO("Finished launching {}: loaded={} failed={} stalled={}",
+		group.empty() ? "characters" : group, progress.Loaded, progress.Failed, progress.Stalled);
+	s_launchProgress.erase(iter);
+}
+
+static void OnClientLoaded(uint32_t pid)
+{
+	s_loginRetries = 0;
+
+	auto iter = s_launchingClients.find(pid);
+	if (iter == s_launchingClients.end())
+		return;
+
+	std::string group = std::move(iter->second.group);
+	s_launchingClients.erase(iter);
+
+	LaunchProgress& progress = GetGroupProgress(group);
+	--progress.Launching;
+	++progress.Loaded;
+	CheckGroupFinished(group);
+}
+
+static void OnClientUnloaded(uint32_t pid)
+{
+	auto iter = s_launchingClients.find(pid);
+	if (iter == s_launchingClients.end())
+		return;
+
+	std::string group = std::move(iter->second.group);
+	s_launchingClients.erase(iter);
+
+	LaunchProgress& progress = GetGroupProgress(group);
+	--progress.Launching;
+	++progress.Failed;
+	CheckGroupFinished(group);
+}
+
+// Every client that is turned away doubles the wait before the next launch, up to a minute.
+static void OnLoginRetry(uint32_t pid, const std::string& message)
+{
+	s_loginRetries = std::min(s_loginRetries + 1, 5);
+
+	const auto backoff = std::min(std::chrono::seconds(60), std::chrono::seconds(2LL << s_loginRetries));
+	s_loginBackoffTime = std::max(s_loginBackoffTime, std::chrono::steady_clock::now() + backoff);
+
+	SPDLOG_DEBUG("Login server turned away pid={}, holding launches for {}s: {}", pid, backoff.count(), message);
+}
+
+// Clients that never report in (no MQ, or stuck somewhere) stop holding a launch slot eventually.
+static void ReleaseStalledLaunches(std::chrono::steady_clock::time_point now)
+{
+	static auto launchTimeout = login::db::CacheSetting<int>("client_launch_timeout", 90, GetIntFromString);
+	const auto timeout = std::chrono::seconds(launchTimeout.Read());
+
+	for (auto iter = s_launchingClients.begin(); iter != s_launchingClients.end();)
+	{
+		if (now - iter->second.started < timeout)
+		{
+			++iter;
+			continue;
+		}
+
+		std::string group = std::move(iter->second.group);
+		SPDLOG_WARN("Client pid={} did not finish loading in {}s", iter->first, timeout.count());
+		iter = s_launchingClients.erase(iter);
+
+		LaunchProgress& progress = GetGroupProgress(group);
+		--progress.Launching;
+		++progress.Stalled;
+		CheckGroupFinished(group);
+	}
+}
+
+// Returns why a launch has to wait, or an empty string if it can go ahead.
+static std::string GetLaunchBlocker(std::chrono::steady_clock::time_point now)
+{
+	static auto concurrency = login::db::CacheSetting<int>("client_launch_concurrency", 4, GetIntFromString);
+	static auto maxLoad = login::db::CacheSetting<int>("client_launch_max_load", 90, GetIntFromString);
+	static HostLoad s_hostLoad;
+
+	if (concurrency.Read() > 0 && static_cast<int>(s_launchingClients.size()) >= concurrency.Read())
+		return fmt::format("Waiting for {} clients to load", s_launchingClients.size());
+
+	if (now < s_loginBackoffTime)
+	{
+		return fmt::format("Login server is busy, waiting {}s",
+			std::chrono::duration_cast<std::chrono::seconds>(s_loginBackoffTime - now).count() + 1);
+	}
+
+	if (maxLoad.Read() > 0)
+	{
+		s_hostLoad.Sample(now);
+
+		if (s_hostLoad.Cpu() >= maxLoad.Read())
+			return fmt::format("Waiting for CPU ({}%)", s_hostLoad.Cpu());
+		if (s_hostLoad.Memory() >= maxLoad.Read())
+			return fmt::format("Waiting for memory ({}%)", s_hostLoad.Memory());
+		if (s_hostLoad.Disk() >= maxLoad.Read())
+			return fmt::format("Waiting for disk ({}%)", s_hostLoad.Disk());
+	}
+
+	return {};
+}
+
 void Post(uint32_t pid, const proto::login::MessageId& messageId, const std::string& data)
 {
 	proto::login::LoginMessage message;
@@ -114,7 +357,8 @@ void AutoLoginRemoveProcess(uint32_t process_id)
 
 void LoadCharacter(const ProfileRecord& profile, bool force)
 {
-	s_pendingLogins.emplace(profile, force);
+	s_pendingLogins.push_back({ profile, force });
+	++GetGroupProgress(profile.profileName).Queued;
 }
 
 void LoadProfileGroup(std::string_view group, bool force)
@@ -137,7 +381,11 @@ void LaunchCleanSession()
 		// create command line arguments
 		std::string parameters = fmt::format(R"("{}" patchme)", eqgame.string());
 
-		if (!LaunchProcess(parameters, GetEQRoot()))
+		if (DWORD processId = LaunchProcess(parameters, GetEQRoot()))
+		{
+			TrackLaunchedProcess(processId);
+		}
+		else
 		{
 			SPDLOG_ERROR("{}",
 				fmt::windows_error(GetLastError(), "Failed to launch eqgame.exe").what());
@@ -145,62 +393,101 @@ void LaunchCleanSession()
 	}
 }
 
+const std::map<std::string, LaunchProgress>& GetLaunchProgress()
+{
+	return s_launchProgress;
+}
+
+const std::string& GetLaunchStatus()
+{
+	return s_launchStatus;
+}
+
 void ProcessPendingLogins()
 {
 	const auto now = std::chrono::steady_clock::now();
-	if (!s_pendingLogins.empty() && now >= s_lastLoginTime)
+	ReleaseStalledLaunches(now);
+
+	if (s_pendingLogins.empty())
 	{
-		auto& [record, force] = s_pendingLogins.front();
-		int applyProfilePID = 0;
+		s_launchStatus.clear();
+		return;
+	}
 
-		if (!force)
-		{
-			// Check for duplicate session
-			const auto& loadedInstances = GetLoadedInstances();
+	if (now < s_nextLaunchTime)
+		return;
 
-			auto iter = loadedInstances.find(LoginInstance::Key(record));
-			if (iter != loadedInstances.end())
-			{
-				const LoginInstance& instance = iter->second;
+	auto& [record, force] = s_pendingLogins.front();
+	const std::string group = record.profileName;
+	LaunchProgress& progress = GetGroupProgress(group);
+	int applyProfilePID = 0;
+	bool alreadyLoaded = false;
 
-				if (!record.profileName.empty() && instance.ProfileGroup != record.profileName)
-				{
-					applyProfilePID = instance.PID;
-				}
-			}
-		}
+	// Check for duplicate session
+	const auto& loadedInstances = GetLoadedInstances();
 
-		int delay = 0;
+	auto iter = loadedInstances.find(LoginInstance::Key(record));
+	if (iter != loadedInstances.end())
+	{
+		const LoginInstance& instance = iter->second;
+		alreadyLoaded = true;
 
-		if (applyProfilePID != 0)
+		if (!force && !record.profileName.empty() && instance.ProfileGroup != record.profileName)
 		{
-			proto::login::ApplyProfileMissive missive;
-			missive.set_do_login(false);
+			applyProfilePID = instance.PID;
+		}
+	}
 
-			if (!record.profileName.empty())
-			{
-				proto::login::ProfileMethod& profile = *missive.mutable_profile();
-				SerializeProfile(record, profile);
-			}
-			else
-			{
-				proto::login::DirectMethod& direct = *missive.mutable_direct();
-				SerializeProfile(record, direct);
-			}
+	if (applyProfilePID != 0)
+	{
+		// Applying a profile to a running client doesn't launch anything, so it isn't held back.
+		proto::login::ApplyProfileMissive missive;
+		missive.set_do_login(false);
 
-			Post(applyProfilePID, mq::proto::login::ApplyProfile, missive);
+		if (!record.profileName.empty())
+		{
+			proto::login::ProfileMethod& profile = *missive.mutable_profile();
+			SerializeProfile(record, profile);
 		}
 		else
 		{
-			StartInstance(record);
+			proto::login::DirectMethod& direct = *missive.mutable_direct();
+			SerializeProfile(record, direct);
+		}
 
-			static auto launchDelay = login::db::CacheSetting<int>("client_launch_delay", 3, GetIntFromString);
-			delay = launchDelay.Read();
+		Post(applyProfilePID, mq::proto::login::ApplyProfile, missive);
+		++progress.Loaded;
+	}
+	else if (alreadyLoaded)
+	{
+		// StartInstance just updates the running client.
+		StartInstance(record);
+		++progress.Loaded;
+	}
+	else
+	{
+		s_launchStatus = GetLaunchBlocker(now);
+		if (!s_launchStatus.empty())
+			return;
+
+		if (const LoginInstance* instance = StartInstance(record))
+		{
+			TrackLaunchedProcess(instance->PID);
+			s_launchingClients[instance->PID] = LaunchingClient{ group, now };
+			++progress.Launching;
+		}
+		else
+		{
+			++progress.Failed;
 		}
 
-		s_lastLoginTime = now + std::chrono::seconds(delay);
-		s_pendingLogins.pop();
+		static auto launchDelay = login::db::CacheSetting<int>("client_launch_delay", 3, GetIntFromString);
+		s_nextLaunchTime = now + std::chrono::seconds(launchDelay.Read());
 	}
+
+	--progress.Queued;
+	s_pendingLogins.pop_front();
+	CheckGroupFinished(group);
 }
 
 void Import()
@@ -239,6 +526,7 @@ static void ReceivedMessageHandler(const ProtoMessagePtr& message)
 			// only set the hotkey if the instance reports successfully loaded
 			ProfileRecord profile = ParseProfileFromMessage(loaded);
 			const LoginInstance* login = UpdateInstance(loaded.pid(), profile, true);
+			OnClientLoaded(loaded.pid());
 
 			if (login != nullptr && login->Hotkey)
 			{
@@ -257,6 +545,7 @@ static void ReceivedMessageHandler(const ProtoMessagePtr& message)
 			stop.ParseFromString(login_message.payload());
 
 			RemoveInstance(stop.pid());
+			OnClientUnloaded(stop.pid());
 		}
 
 		break;
@@ -288,13 +577,28 @@ static void ReceivedMessageHandler(const ProtoMessagePtr& message)
 
 		break;
 
+	case proto::login::MessageId::LoginRetry:
+		if (login_message.has_payload())
+		{
+			proto::login::LoginRetryMissive retry;
+			retry.ParseFromString(login_message.payload());
+
+			OnLoginRetry(retry.pid(), retry.message());
+		}
+
+		break;
+
 	default: break;
 	}
+
+	// this is called from the post office thread, the UI won't know that anything changed
+	LauncherImGui::RequestRender();
 }
 
 void InitializeAutoLogin()
 {
-	s_dropbox = postoffice::GetPostOffice().RegisterAddress("autologin", ReceivedMessageHandler);
+	s_dropbox = postoffice::GetPostOffice().RegisterAddress("autologin", ReceivedMessageHandler,
+		postoffice::MailboxPriority::Control);
 
 	// Get path to mq2autologin.ini
 	internal_paths::s_autoLoginIni = (fs::path{ internal_paths::Config }  / "MQ2AutoLogin.ini").string();
@@ -16,13 +16,27 @@
 
 #include "login/Login.h"
 
+#include <map>
+#include <string>
+
 
 // AutoLogin
+struct LaunchProgress
+{
+	int Queued = 0;
+	int Launching = 0;
+	int Loaded = 0;
+	int Failed = 0;
+	int Stalled = 0;
+};
+
 void LoadCharacter(const ProfileRecord& profile, bool force);
 void LoadProfileGroup(std::string_view group, bool force);
 
 void LaunchCleanSession();
 void ProcessPendingLogins();
+const std::map<std::string, LaunchProgress>& GetLaunchProgress(); // by profile group, empty for single characters
+const std::string& GetLaunchStatus();                            // why the next launch is waiting, if it is
 void Import();
 std::string GetEQRoot();
 
@@ -1612,6 +1612,21 @@ void ShowProfilesWindow()
 		ImGui::SameLine();
 		ImGui::TextColored({ 1.0f, 1.0f, 1.0f, 0.5f }, "Right click list items to edit or remove");
 
+		for (const auto& [launchGroup, progress] : GetLaunchProgress())
+		{
+			ImGui::Text("Launching %s: %d loaded, %d launching, %d queued",
+				launchGroup.empty() ? "characters" : launchGroup.c_str(), progress.Loaded, progress.Launching, progress.Queued);
+
+			if (progress.Failed > 0 || progress.Stalled > 0)
+			{
+				ImGui::SameLine();
+				ImGui::TextColored({ 1.0f, 0.4f, 0.4f, 1.0f }, "(%d failed, %d stalled)", progress.Failed, progress.Stalled);
+			}
+		}
+
+		if (const std::string& status = GetLaunchStatus(); !status.empty())
+			ImGui::TextColored({ 1.0f, 1.0f, 1.0f, 0.5f }, "%s", status.c_str());
+
 		ProfileTable(group);
 	}
 
@@ -1691,6 +1706,9 @@ void ShowSettingsWindow()
 	static auto load_ini = login::db::CacheSetting<bool>("load_ini", false, GetBoolFromString);
 	static auto detect_info = login::db::CacheSetting<bool>("detect_info", defaultSettings.DetectInformation, GetBoolFromString);
 	static auto client_launch_delay = login::db::CacheSetting<int>("client_launch_delay", defaultSettings.ClientLaunchDelay, GetIntFromString);
+	static auto client_launch_concurrency = login::db::CacheSetting<int>("client_launch_concurrency", defaultSettings.ClientLaunchConcurrency, GetIntFromString);
+	static auto client_launch_timeout = login::db::CacheSetting<int>("client_launch_timeout", defaultSettings.ClientLaunchTimeout, GetIntFromString);
+	static auto client_launch_max_load = login::db::CacheSetting<int>("client_launch_max_load", defaultSettings.ClientLaunchMaxLoad, GetIntFromString);
 	static auto char_select_delay = login::db::CacheSetting<int>("char_select_delay", defaultSettings.CharSelectDelay, GetIntFromString);
 	static auto connect_retries = login::db::CacheSetting<int>("login_connect_retries", defaultSettings.ConnectRetries, GetIntFromString);
 
@@ -1735,6 +1753,24 @@ void ShowSettingsWindow()
 		login::db::WriteSetting("client_launch_delay", std::to_string(client_launch_delay.Updated()), "Seconds in between client launches");
 	ImGui::SameLine(); imgui::HelpMarker("Seconds in between client launches");
 
+	ImGui::Spacing();
+	ImGui::SetNextItemWidth(50.f);
+	if (ImGui::InputScalar("Concurrent Launches", ImGuiDataType_U32, &client_launch_concurrency.Read()))
+		login::db::WriteSetting("client_launch_concurrency", std::to_string(client_launch_concurrency.Updated()), "Number of clients that can be launching at once, 0 for no limit");
+	ImGui::SameLine(); imgui::HelpMarker("Number of clients that can be launching at once, 0 for no limit. A client is launching until it reports that it has loaded.");
+
+	ImGui::Spacing();
+	ImGui::SetNextItemWidth(50.f);
+	if (ImGui::InputScalar("Client Launch Timeout", ImGuiDataType_U32, &client_launch_timeout.Read()))
+		login::db::WriteSetting("client_launch_timeout", std::to_string(client_launch_timeout.Updated()), "Seconds to wait for a launched client to load before launching the next one anyway");
+	ImGui::SameLine(); imgui::HelpMarker("Seconds to wait for a launched client to load before launching the next one anyway");
+
+	ImGui::Spacing();
+	ImGui::SetNextItemWidth(50.f);
+	if (ImGui::InputScalar("Max Load For Launch", ImGuiDataType_U32, &client_launch_max_load.Read()))
+		login::db::WriteSetting("client_launch_max_load", std::to_string(client_launch_max_load.Updated()), "Percent of CPU, memory or disk use at which launches wait, 0 to never wait");
+	ImGui::SameLine(); imgui::HelpMarker("Percent of CPU, memory or disk use at which launches wait, 0 to never wait");
+
 	ImGui::Spacing();
 	ImGui::SetNextItemWidth(50.f);
 	if (ImGui::InputScalar("Character Select Delay", ImGuiDataType_U32, &char_select_delay.Read()))
@@ -1990,17 +1990,14 @@ int WINAPI CALLBACK WinMain(
 			ProcessPendingLogins();
 			CheckPruneLogging();
 
-			if (PeekMessageA(&msg, nullptr, 0, 0, PM_REMOVE) != 0)
+			// handle everything that is queued, the loop waits for more between frames
+			while (PeekMessageA(&msg, nullptr, 0, 0, PM_REMOVE) != 0)
 			{
-				switch (msg.message)
-				{
-				case WM_QUIT:
+				if (msg.message == WM_QUIT)
 					return false;
-				default:
-					TranslateMessage(&msg);
-					DispatchMessageA(&msg);
-					return true;
-				}
+
+				TranslateMessage(&msg);
+				DispatchMessageA(&msg);
 			}
 
 			return true;
@@ -16,6 +16,8 @@
 #include "loader/PostOffice.h"
 #include "loader/Crashpad.h"
 #include "loader/LoaderAutoLogin.h"
+#include "loader/RoutingBridge.h"
+#include "routing/PipeLoadTest.h"
 #include "routing/PostOffice.h"
 
 #include <date/date.h>
@@ -38,10 +40,25 @@ private:
 		std::string account;
 		std::string server;
 		std::string character;
+		std::string endpoint;
+		int link = 0;        // the routing bridge link of a client on another machine, 0 for our own
 	};
 
 	std::unordered_map<uint32_t, ClientIdentification> m_identities;
 	ci_unordered::map<std::string, uint32_t> m_names;
+
+	// pids of m_identities by each part of their address, so routing only has to check the
+	// identities that can match. Only changed through SetIdentity and RemoveIdentity.
+	using IdentityIndex = ci_unordered::map<std::string, std::vector<uint32_t>>;
+	IdentityIndex m_byCharacter;
+	IdentityIndex m_byAccount;
+	IdentityIndex m_byServer;
+
+	// the clients that subscribe to each topic, and the topics of each client. Only changed through
+	// SetSubscriptions.
+	std::unordered_map<std::string, std::vector<uint32_t>> m_topicSubscribers;
+	std::unordered_map<uint32_t, std::vector<std::string>> m_clientTopics;
+
 	bool m_running = false;
 	std::thread m_thread;
 	std::thread::id m_threadId;
@@ -50,6 +67,19 @@ private:
 	std::mutex m_processMutex;
 	std::condition_variable m_needsProcessing;
 
+	// copied from the post office thread for the routing panel
+	std::vector<MailboxStats> m_mailboxStats;
+	std::unordered_map<uint32_t, std::string> m_clientNames;
+	std::mutex m_statsMutex;
+
+	// the last frame limiter report of each client, guarded by m_statsMutex
+	struct FrameLimiterReport
+	{
+		proto::routing::FrameLimiterTelemetry telemetry;
+		std::chrono::steady_clock::time_point received;
+	};
+	std::unordered_map<uint32_t, FrameLimiterReport> m_frameLimiterReports;
+
 	class PipeEventsHandler : public NamedPipeEvents
 	{
 	public:
@@ -119,16 +149,21 @@ private:
 					}
 					else
 					{
-						auto result = m_postOffice->m_identities.insert_or_assign(id.pid(), ClientIdentification{
+						added = m_postOffice->SetIdentity(ClientIdentification{
 							id.pid(),
 							id.has_account() ? id.account() : "",
 							id.has_server() ? id.server() : "",
-							id.has_character() ? id.character() : ""
+							id.has_character() ? id.character() : "",
+							id.has_endpoint() ? id.endpoint() : ""
 						});
-						added = result.second;
 
 						// only include the PID here, otherwise it's pseudonym-identifiable information from the logs
 						SPDLOG_INFO("Got identification from {}", id.pid());
+
+						// the other launchers route to this client through us, so they don't get the endpoint
+						proto::routing::Identification forwarded = id;
+						forwarded.clear_endpoint();
+						m_postOffice->ForwardToLinks(MQMessageId::MSG_IDENTIFICATION, forwarded);
 					}
 
 					// we also need to update all the clients
@@ -156,6 +191,10 @@ private:
 
 						if (!client.character.empty())
 							id.set_character(client.character);
+
+						// the clients connect to each other directly with this
+						if (!client.endpoint.empty())
+							id.set_endpoint(client.endpoint);
 						
 						m_postOffice->m_pipeServer.SendProtoMessage(
 							message->GetConnectionId(),
@@ -177,6 +216,14 @@ private:
 				}
 				break;
 
+			case mq::MQMessageId::MSG_SUBSCRIPTIONS:
+			{
+				auto subscriptions = ProtoMessage::Parse<proto::routing::Subscriptions>(message);
+				m_postOffice->SetSubscriptions(subscriptions.pid(),
+					std::vector<std::string>(subscriptions.topics().begin(), subscriptions.topics().end()));
+				break;
+			}
+
 			case mq::MQMessageId::MSG_MAIN_PROCESS_UNLOADED:
 				break;
 
@@ -341,16 +388,102 @@ private:
 				// only include the PID here, otherwise it's pseudonym-identifiable information from the logs
 				SPDLOG_INFO("Disconnection detected, dropping ID from {}", id.pid());
 
+				m_postOffice->ForwardToLinks(MQMessageId::MSG_DROPPED, id);
 				broadcast(std::move(id));
 
-				m_postOffice->m_identities.erase(ident_it);
+				m_postOffice->RemoveIdentity(processId);
 			}
+
+			m_postOffice->SetSubscriptions(processId, {});
 		}
 
 		private:
 			LauncherPostOffice* m_postOffice;
 	};
 
+	// The post office thread gets these from RoutingBridge::Process
+	class BridgeEventsHandler : public mq::RoutingBridgeEvents
+	{
+	public:
+		BridgeEventsHandler(LauncherPostOffice* postOffice) : m_postOffice(postOffice) {}
+
+		virtual void OnLinkUp(int linkId, const std::string& name) override
+		{
+			// the launcher on the other end tells us about its clients in the same way
+			for (const auto& [_, client] : m_postOffice->m_identities)
+			{
+				if (client.link == 0)
+				{
+					std::string data = MakeIdentification(client).SerializeAsString();
+					m_postOffice->m_bridge->SendMessage(linkId, PipeMessage(MQMessageId::MSG_IDENTIFICATION, data.data(), data.size()));
+				}
+			}
+		}
+
+		virtual void OnLinkDown(int linkId) override
+		{
+			std::vector<uint32_t> dropped;
+			for (const auto& [pid, client] : m_postOffice->m_identities)
+			{
+				if (client.link == linkId)
+					dropped.push_back(pid);
+			}
+
+			for (uint32_t pid : dropped)
+			{
+				m_postOffice->m_pipeServer.BroadcastProtoMessage(MQMessageId::MSG_DROPPED,
+					MakeIdentification(m_postOffice->m_identities[pid]));
+				m_postOffice->RemoveIdentity(pid);
+			}
+
+			SPDLOG_INFO("Routing bridge link {} is down, dropped {} remote clients", linkId, dropped.size());
+		}
+
+		virtual void OnLinkMessage(int linkId, PipeMessagePtr&& message) override
+		{
+			switch (message->GetMessageId())
+			{
+			case MQMessageId::MSG_IDENTIFICATION:
+			{
+				auto id = ProtoMessage::Parse<proto::routing::Identification>(message);
+				m_postOffice->SetRemoteIdentity(linkId, id);
+				break;
+			}
+
+			case MQMessageId::MSG_DROPPED:
+			{
+				auto id = ProtoMessage::Parse<proto::routing::Identification>(message);
+				auto ident_it = m_postOffice->m_identities.find(id.pid());
+				if (ident_it != m_postOffice->m_identities.end() && ident_it->second.link == linkId)
+				{
+					m_postOffice->m_pipeServer.BroadcastProtoMessage(MQMessageId::MSG_DROPPED, id);
+					m_postOffice->RemoveIdentity(id.pid());
+				}
+				break;
+			}
+
+			case MQMessageId::MSG_ROUTE:
+				m_postOffice->RouteMessage(std::move(message), linkId);
+				break;
+
+			default: break;
+			}
+		}
+
+		virtual void OnRequestProcessEvents() override
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_postOffice->m_processMutex);
+				m_postOffice->m_hasMessages = true;
+			}
+
+			m_postOffice->m_needsProcessing.notify_one();
+		}
+
+	private:
+		LauncherPostOffice* m_postOffice;
+	};
+
 public:
 	LauncherPostOffice() : m_pipeServer{ mq::MQ2_PIPE_SERVER_PATH }
 	{
@@ -382,13 +515,253 @@ public:
 			(!address.has_character() || ci_equals(address.character(), id.character));
 	}
 
-	auto FindIdentity(
-		const proto::routing::Address& address,
-		const std::unordered_map<uint32_t, ClientIdentification>::iterator& from)
+	static void AddToIndex(IdentityIndex& index, const std::string& key, uint32_t pid)
+	{
+		if (!key.empty())
+			index[key].push_back(pid);
+	}
+
+	static void RemoveFromIndex(IdentityIndex& index, const std::string& key, uint32_t pid)
+	{
+		auto iter = index.find(key);
+		if (iter == index.end())
+			return;
+
+		std::vector<uint32_t>& pids = iter->second;
+		pids.erase(std::remove(pids.begin(), pids.end(), pid), pids.end());
+		if (pids.empty())
+			index.erase(iter);
+	}
+
+	// Returns true if this is a new identity
+	bool SetIdentity(ClientIdentification&& id)
+	{
+		const uint32_t pid = id.pid;
+		const bool added = !RemoveIdentity(pid);
+
+		AddToIndex(m_byCharacter, id.character, pid);
+		AddToIndex(m_byAccount, id.account, pid);
+		AddToIndex(m_byServer, id.server, pid);
+
+		m_identities.emplace(pid, std::move(id));
+		return added;
+	}
+
+	static proto::routing::Identification MakeIdentification(const ClientIdentification& client)
+	{
+		proto::routing::Identification id;
+		id.set_pid(client.pid);
+
+		if (!client.account.empty())
+			id.set_account(client.account);
+
+		if (!client.server.empty())
+			id.set_server(client.server);
+
+		if (!client.character.empty())
+			id.set_character(client.character);
+
+		return id;
+	}
+
+	// An identification from the launcher on the other end of a link. Its clients can't be reached
+	// directly, so our clients don't get an endpoint and send to them through us.
+	void SetRemoteIdentity(int linkId, proto::routing::Identification& id)
+	{
+		auto existing = m_identities.find(id.pid());
+		if (id.has_name() || id.pid() == GetCurrentProcessId()
+			|| (existing != m_identities.end() && existing->second.link != linkId))
+		{
+			SPDLOG_WARN("Ignoring identification of {} from routing bridge link {}, the pid is already in use", id.pid(), linkId);
+			return;
+		}
+
+		id.clear_endpoint();
+		SetIdentity(ClientIdentification{
+			id.pid(),
+			id.has_account() ? id.account() : "",
+			id.has_server() ? id.server() : "",
+			id.has_character() ? id.character() : "",
+			"",
+			linkId
+		});
+
+		m_pipeServer.BroadcastProtoMessage(MQMessageId::MSG_IDENTIFICATION, id);
+	}
+
+	// Tells the launchers on the other end of every link about a change to one of our clients
+	void ForwardToLinks(MQMessageId messageId, const proto::routing::Identification& id)
+	{
+		if (!m_bridge)
+			return;
+
+		std::string data = id.SerializeAsString();
+		PipeMessage message(messageId, data.data(), data.size());
+		for (int linkId : m_bridge->GetLinkIds())
+			m_bridge->SendMessage(linkId, message);
+	}
+
+	// The link of a client on another machine, 0 if this isn't one
+	int GetIdentityLink(uint32_t pid) const
 	{
-		return std::find_if(from, m_identities.end(),
-			[&address](const std::pair<uint32_t, ClientIdentification>& pair)
-			{ return IsRecipient(address, pair.second); });
+		auto iter = m_identities.find(pid);
+		return iter != m_identities.end() ? iter->second.link : 0;
+	}
+
+	bool RemoveIdentity(uint32_t pid)
+	{
+		auto iter = m_identities.find(pid);
+		if (iter == m_identities.end())
+			return false;
+
+		RemoveFromIndex(m_byCharacter, iter->second.character, pid);
+		RemoveFromIndex(m_byAccount, iter->second.account, pid);
+		RemoveFromIndex(m_byServer, iter->second.server, pid);
+
+		m_identities.erase(iter);
+		return true;
+	}
+
+	// Calls callback with the pid of every identity that the address matches, until it returns false.
+	// The most selective part of the address picks the identities that are checked, so a targeted
+	// send checks a single identity and only an address without any of the parts checks them all.
+	template <typename Callback>
+	void ForEachRecipient(const proto::routing::Address& address, Callback&& callback)
+	{
+		const IdentityIndex* index = nullptr;
+		const std::string* key = nullptr;
+
+		if (address.has_character())
+			index = &m_byCharacter, key = &address.character();
+		else if (address.has_account())
+			index = &m_byAccount, key = &address.account();
+		else if (address.has_server())
+			index = &m_byServer, key = &address.server();
+
+		if (index == nullptr)
+		{
+			for (const auto& [pid, identity] : m_identities)
+			{
+				if (!callback(pid))
+					return;
+			}
+			return;
+		}
+
+		auto candidates = index->find(*key);
+		if (candidates == index->end())
+			return;
+
+		for (uint32_t pid : candidates->second)
+		{
+			auto identity = m_identities.find(pid);
+			if (identity != m_identities.end() && IsRecipient(address, identity->second) && !callback(pid))
+				return;
+		}
+	}
+
+	// Returns the pid of the one identity (or topic subscriber) that the address matches. Fails with MsgError_RoutingFailed
+	// if there isn't one, and MsgError_AmbiguousRecipient if there is more than one.
+	int FindSingleRecipient(const proto::routing::Address& address, uint32_t& recipient)
+	{
+		int count = 0;
+		auto match = [&](uint32_t pid)
+			{
+				recipient = pid;
+				return ++count < 2;
+			};
+
+		if (address.has_topic())
+			ForEachSubscriber(address, match);
+		else
+			ForEachRecipient(address, match);
+
+		if (count == 0)
+			return MsgError_RoutingFailed;
+
+		return count > 1 ? MsgError_AmbiguousRecipient : 0;
+	}
+
+	void SetSubscriptions(uint32_t pid, std::vector<std::string>&& topics)
+	{
+		auto client = m_clientTopics.find(pid);
+		if (client != m_clientTopics.end())
+		{
+			for (const std::string& topic : client->second)
+			{
+				auto iter = m_topicSubscribers.find(topic);
+				if (iter == m_topicSubscribers.end())
+					continue;
+
+				std::vector<uint32_t>& pids = iter->second;
+				pids.erase(std::remove(pids.begin(), pids.end(), pid), pids.end());
+				if (pids.empty())
+					m_topicSubscribers.erase(iter);
+			}
+
+			m_clientTopics.erase(client);
+		}
+
+		if (topics.empty())
+			return;
+
+		for (const std::string& topic : topics)
+			m_topicSubscribers[topic].push_back(pid);
+
+		m_clientTopics.emplace(pid, std::move(topics));
+	}
+
+	// Calls callback with the pid of every client that subscribes to the topic of the address, and
+	// matches the rest of it, until it returns false.
+	template <typename Callback>
+	void ForEachSubscriber(const proto::routing::Address& address, Callback&& callback)
+	{
+		auto subscribers = m_topicSubscribers.find(address.topic());
+		if (subscribers == m_topicSubscribers.end())
+			return;
+
+		const bool filtered = address.has_account() || address.has_server() || address.has_character();
+		for (uint32_t pid : subscribers->second)
+		{
+			if (filtered)
+			{
+				auto identity = m_identities.find(pid);
+				if (identity == m_identities.end() || !IsRecipient(address, identity->second))
+					continue;
+			}
+
+			if (!callback(pid))
+				return;
+		}
+	}
+
+	// Sends a message to every subscriber of its topic. The subscribers share the one buffer that the
+	// message came in, and the launcher's own subscribers get it without going through a pipe. We only
+	// know about our own subscribers, so a topic that one of our clients sent goes to every link too.
+	void RouteToTopic(PipeMessagePtr&& message, proto::routing::Envelope& envelope, bool forward)
+	{
+		const std::shared_ptr<PipeMessage> shared(std::move(message));
+
+		if (forward && m_bridge)
+		{
+			for (int linkId : m_bridge->GetLinkIds())
+				m_bridge->SendMessage(linkId, *shared);
+		}
+
+		ForEachSubscriber(envelope.address(), [&](uint32_t pid)
+			{
+				if (auto connection = m_pipeServer.GetConnectionForProcessId(pid))
+					connection->SendMessage(std::make_unique<PipeMessage>(*shared, shared, shared->get(), shared->size()));
+
+				return true;
+			});
+
+		const auto& address = envelope.address();
+		if (!address.has_account() && !address.has_server() && !address.has_character())
+		{
+			auto local = std::make_unique<PipeMessage>(*shared, shared, shared->get(), shared->size());
+			DeliverToTopic(local, envelope);
+		}
 	}
 
 	void RouteMessage(PipeMessagePtr&& message, const PipeMessageResponseCb& callback) override
@@ -428,24 +801,26 @@ public:
 			}
 			else
 			{
-				auto identity = FindIdentity(envelope.address(), m_identities.begin());
-
-				if (identity == m_identities.end())
-					RoutingFailed(envelope, MsgError_RoutingFailed, std::move(message), callback);
-				else if (FindIdentity(envelope.address(), std::next(identity)) != m_identities.end())
-					RoutingFailed(envelope, MsgError_AmbiguousRecipient, std::move(message), callback);
+				uint32_t recipient = 0;
+				if (int status = FindSingleRecipient(envelope.address(), recipient); status != 0)
+					RoutingFailed(envelope, status, std::move(message), callback);
 				else
 				{
 					message->SetRequestMode(MQRequestMode::CallAndResponse);
-					SendMessageToPID(identity->first, std::move(message), single_send, routing_failed);
+					SendMessageToPID(recipient, std::move(message), single_send, routing_failed);
 				}
 			}
 		}
 	}
 
+	// A message that came in over a routing bridge link (fromLink) only goes to our own clients. The
+	// launcher that sent it already sent copies to the other links itself.
 	void RouteMessage(
-		PipeMessagePtr&& message)
+		PipeMessagePtr&& message,
+		int fromLink = 0)
 	{
+		const bool overLinks = fromLink == 0;
+
 		auto envelope = ProtoMessage::Parse<proto::routing::Envelope>(message);
 		const auto& address = envelope.address();
 		auto routing_failed = [&envelope](int status, PipeMessagePtr&& message)
@@ -461,7 +836,7 @@ public:
 		if (address.has_pid())
 		{
 			// a PID is necessarily a singular identifier, avoid the loop
-			SendMessageToPID(address.pid(), std::move(message), single_send, routing_failed);
+			SendMessageToPID(address.pid(), std::move(message), single_send, routing_failed, overLinks);
 		}
 		else if (address.has_name())
 		{
@@ -477,32 +852,49 @@ public:
 				SendMessageToPID(pid_it->second, std::move(message), single_send, routing_failed);
 			}
 		}
+		else if (address.has_topic() && message->GetRequestMode() != MQRequestMode::CallAndResponse)
+		{
+			// only the subscribers get a topic, instead of everyone that matches the address
+			RouteToTopic(std::move(message), envelope, overLinks);
+		}
 		else if (message->GetRequestMode() == MQRequestMode::CallAndResponse)
 		{
 			// ensure that we have a singular target for an RPC message
-			auto identity = FindIdentity(envelope.address(), m_identities.begin());
-
-			if (identity == m_identities.end())
-				RoutingFailed(envelope, MsgError_RoutingFailed, std::move(message), nullptr);
-			else if (FindIdentity(envelope.address(), std::next(identity)) != m_identities.end())
-				RoutingFailed(envelope, MsgError_AmbiguousRecipient, std::move(message), nullptr);
+			uint32_t recipient = 0;
+			if (int status = FindSingleRecipient(envelope.address(), recipient); status != 0)
+				RoutingFailed(envelope, status, std::move(message), nullptr);
 			else
-				SendMessageToPID(identity->first, std::move(message), single_send, routing_failed);
+				SendMessageToPID(recipient, std::move(message), single_send, routing_failed, overLinks);
 		}
 		else
 		{
 			// we don't have a PID or a name and this is not an RPC, so we will send this message to 
 			// all clients that match the address -- it's important to copy these messages
-			for (const auto& identity : m_identities)
-			{
-				if (IsRecipient(address, identity.second))
+			std::vector<int> links;
+			ForEachRecipient(address, [&](uint32_t pid)
 				{
+					// the launcher on the other end of a link sends it to all of its own clients that
+					// match, so each link only needs one copy
+					if (int linkId = GetIdentityLink(pid); linkId != 0)
+					{
+						if (overLinks && std::find(links.begin(), links.end(), linkId) == links.end())
+							links.push_back(linkId);
+
+						return true;
+					}
+
 					SendMessageToPID(
-						identity.first,
+						pid,
 						std::make_unique<PipeMessage>(*message->GetHeader(), message->get(), message->size()),
 						single_send,
 						routing_failed);
-				}
+					return true;
+				});
+
+			for (int linkId : links)
+			{
+				if (!m_bridge || !m_bridge->SendMessage(linkId, *message))
+					SPDLOG_WARN("Unable to send to routing bridge link {}, message route failed.", linkId);
 			}
 		}
 	}
@@ -551,6 +943,8 @@ public:
 	void Initialize()
 	{
 		m_pipeServer.SetHandler(std::make_shared<PipeEventsHandler>(this));
+		InitializeRoutingBridge();
+
 		m_thread = std::thread(
 			[this]
 			{
@@ -576,10 +970,13 @@ public:
 
 					m_pipeServer.Process();
 
-					// OnIncomingMessage is only called from this thread. If we ever have another source of messages
-					// (ie, network messages) then we will need to be careful about making sure Deliver and Process
-					// are always called from the same thread to avoid race conditions
+					// OnIncomingMessage is only called from this thread, and the routing bridge hands its
+					// messages over here too, so Deliver and Process are always called from the same thread
+					if (m_bridge)
+						m_bridge->Process();
+
 					Process(10);
+					UpdateStats();
 
 					{
 						std::unique_lock<std::mutex> lock(m_processMutex);
@@ -596,6 +993,15 @@ public:
 			{
 				// if we've gotten here, then something is delivering a message to this
 				// post office ("pipe_server"), so handle messages directly
+			}, MailboxPriority::Control);
+
+		m_frameLimiterDropbox = RegisterAddress("frame_limiter",
+			[this](ProtoMessagePtr&& message)
+			{
+				auto telemetry = message->Parse<proto::routing::FrameLimiterTelemetry>();
+
+				std::scoped_lock lock(m_statsMutex);
+				m_frameLimiterReports[telemetry.pid()] = { std::move(telemetry), std::chrono::steady_clock::now() };
 			});
 
 		// request ID from all pre-existing connections
@@ -608,23 +1014,351 @@ public:
 		// make sure all remaining messages get discarded by dropping the last reference so we stop
 		// processing
 		m_serverDropbox.Remove();
+		m_frameLimiterDropbox.Remove();
 
 		// we don't need to worry about sending messages after we stop because the pipe client will log
 		// and handle this situation.
 		m_running = false;
 		m_needsProcessing.notify_one();
 		m_thread.join();
+
+		if (m_bridge)
+		{
+			m_bridge->Stop();
+			m_bridge.reset();
+		}
+	}
+
+	void InitializeRoutingBridge()
+	{
+		if (!GetPrivateProfileBool("RoutingBridge", "Enabled", false, internal_paths::MQini))
+			return;
+
+		mq::RoutingBridgeConfig config;
+		config.ListenAddress = GetPrivateProfileString("RoutingBridge", "ListenAddress", config.ListenAddress, internal_paths::MQini);
+		config.Port = static_cast<uint16_t>(GetPrivateProfileInt("RoutingBridge", "Port", config.Port, internal_paths::MQini));
+		config.Secret = GetPrivateProfileString("RoutingBridge", "Secret", "", internal_paths::MQini);
+		config.Compression = GetPrivateProfileBool("RoutingBridge", "Compression", config.Compression, internal_paths::MQini);
+		config.MaxQueuedBytes = static_cast<size_t>(std::max(64, GetPrivateProfileInt("RoutingBridge", "MaxQueuedKB",
+			static_cast<int>(config.MaxQueuedBytes / 1024), internal_paths::MQini))) * 1024;
+
+		for (std::string& peer : mq::split(GetPrivateProfileString("RoutingBridge", "Peers", "", internal_paths::MQini), ','))
+		{
+			mq::trim(peer);
+			if (!peer.empty())
+				config.Peers.push_back(std::move(peer));
+		}
+
+		m_bridge = std::make_unique<mq::RoutingBridge>(std::move(config), std::make_shared<BridgeEventsHandler>(this));
+		if (!m_bridge->Start())
+			m_bridge.reset();
+	}
+
+	void ShowRoutingPanel()
+	{
+		std::vector<PipeConnectionStats> connections = m_pipeServer.GetConnectionStats();
+		std::sort(connections.begin(), connections.end(),
+			[](const PipeConnectionStats& a, const PipeConnectionStats& b) { return a.ProcessId < b.ProcessId; });
+
+		std::scoped_lock lock(m_statsMutex);
+
+		ImGui::Text("Connections: %d", static_cast<int>(connections.size()));
+
+		if (ImGui::BeginTable("##RoutingConnections", 11, ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+			ImVec2(0, ImGui::GetContentRegionAvail().y * 0.6f)))
+		{
+			ImGui::TableSetupColumn("PID", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Client", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("Transport", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Sent/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Sent KB/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Recv/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Recv KB/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Send Queue", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Pending RPC", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("RPC ms (avg/p99/max)", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("RPC Timeouts", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableHeadersRow();
+
+			for (const PipeConnectionStats& connection : connections)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%d", connection.ProcessId);
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", GetClientName(connection.ProcessId).c_str());
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(connection.SharedMemory ? "Shared memory" : "Pipe");
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", connection.SentMessageRate);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", connection.SentByteRate / 1024.0f);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", connection.ReceivedMessageRate);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", connection.ReceivedByteRate / 1024.0f);
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%d (max %d)", static_cast<int>(connection.SendQueueDepth), static_cast<int>(connection.MaxSendQueueDepth));
+				ImGui::TableNextColumn();
+				ImGui::Text("%d", static_cast<int>(connection.PendingRequests));
+				ImGui::TableNextColumn();
+				ImGui::Text("%.2f / %.2f / %.2f", connection.AverageRoundTrip.count() / 1000.0f,
+					connection.P99RoundTrip.count() / 1000.0f, connection.MaxRoundTrip.count() / 1000.0f);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", connection.TimedOutRequests);
+			}
+
+			ImGui::EndTable();
+		}
+
+		if (m_bridge)
+			ShowRoutingBridgeLinks();
+
+		ImGui::Spacing();
+
+		if (ImGui::BeginTable("##RoutingMailboxes", 5, ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+		{
+			ImGui::TableSetupColumn("Mailbox", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("Msgs/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("KB/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Delivered", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Queue", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableHeadersRow();
+
+			for (const MailboxStats& mailbox : m_mailboxStats)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", mailbox.Address.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", mailbox.MessageRate);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", mailbox.ByteRate / 1024.0f);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", mailbox.MessagesDelivered);
+				ImGui::TableNextColumn();
+				ImGui::Text("%d (max %d)", static_cast<int>(mailbox.QueueDepth), static_cast<int>(mailbox.MaxQueueDepth));
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	void ShowRoutingBridgeLinks()
+	{
+		std::vector<mq::RoutingLinkStats> links = m_bridge->GetLinkStats();
+
+		ImGui::Spacing();
+		ImGui::Text("Routing bridge links: %d", static_cast<int>(links.size()));
+
+		if (ImGui::BeginTable("##RoutingBridgeLinks", 10, ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Link", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Peer", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("State", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Sent/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Sent KB/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Recv/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Recv KB/s", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Compressed", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Send Queue KB", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Dropped", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableHeadersRow();
+
+			for (const mq::RoutingLinkStats& link : links)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%d", link.LinkId);
+
+				ImGui::TableNextColumn();
+				if (link.Name.empty())
+					ImGui::Text("%s", link.Peer.c_str());
+				else
+					ImGui::Text("%s (%s)", link.Name.c_str(), link.Peer.c_str());
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s%s%s", link.Connected ? "Up" : "Down", link.Inbound ? ", inbound" : "", link.ReadPaused ? ", paused" : "");
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", link.SentMessageRate);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", link.SentByteRate / 1024.0f);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", link.ReceivedMessageRate);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", link.ReceivedByteRate / 1024.0f);
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f%%", link.CompressionRatio * 100.0f);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f (max %.1f)", link.SendQueueBytes / 1024.0f, link.MaxSendQueueBytes / 1024.0f);
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", link.MessagesDropped);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	void ShowFrameLimiterPanel()
+	{
+		std::scoped_lock lock(m_statsMutex);
+
+		// Clients report every second, anything that has stopped reporting has exited or unloaded
+		auto now = std::chrono::steady_clock::now();
+		for (auto report_it = m_frameLimiterReports.begin(); report_it != m_frameLimiterReports.end();)
+		{
+			if (now - report_it->second.received > std::chrono::seconds(5))
+				report_it = m_frameLimiterReports.erase(report_it);
+			else
+				++report_it;
+		}
+
+		int limited = 0, foreground = 0;
+		float renderFPS = 0.f, simulationFPS = 0.f, throttle = 0.f, cpu = 0.f;
+		for (const auto& [_, report] : m_frameLimiterReports)
+		{
+			const auto& telemetry = report.telemetry;
+			limited += telemetry.enabled() ? 1 : 0;
+			foreground += telemetry.foreground() ? 1 : 0;
+			renderFPS += telemetry.render_fps();
+			simulationFPS += telemetry.simulation_fps();
+			throttle += telemetry.throttle_percent();
+			cpu += telemetry.cpu_usage();
+		}
+
+		const int count = static_cast<int>(m_frameLimiterReports.size());
+		ImGui::Text("Clients: %d (%d limited, %d in the foreground)", count, limited, foreground);
+		if (count > 0)
+		{
+			ImGui::Text("Total render FPS: %.1f, total simulation FPS: %.1f", renderFPS, simulationFPS);
+			ImGui::Text("Average throttle: %.1f%%, total CPU: %.1f%% (average %.1f%%)", throttle / count, cpu, cpu / count);
+		}
+
+		ImGui::Spacing();
+
+		if (ImGui::BeginTable("##FrameLimiterClients", 8, ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY
+			| ImGuiTableFlags_Sortable))
+		{
+			ImGui::TableSetupColumn("PID", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Client", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("State", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoSort);
+			ImGui::TableSetupColumn("Render FPS", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Target FPS", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Simulation FPS", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("Throttle", ImGuiTableColumnFlags_WidthFixed);
+			ImGui::TableSetupColumn("CPU", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableHeadersRow();
+
+			std::vector<const FrameLimiterReport*> reports;
+			reports.reserve(m_frameLimiterReports.size());
+			for (const auto& [_, report] : m_frameLimiterReports)
+				reports.push_back(&report);
+
+			if (const ImGuiTableSortSpecs* sortSpecs = ImGui::TableGetSortSpecs(); sortSpecs && sortSpecs->SpecsCount > 0)
+			{
+				const ImGuiTableColumnSortSpecs& spec = sortSpecs->Specs[0];
+				auto key = [column = spec.ColumnIndex](const FrameLimiterReport* report) -> float
+				{
+					const auto& telemetry = report->telemetry;
+					switch (column)
+					{
+					case 0: return static_cast<float>(telemetry.pid());
+					case 3: return telemetry.render_fps();
+					case 4: return telemetry.target_fps();
+					case 5: return telemetry.simulation_fps();
+					case 6: return telemetry.throttle_percent();
+					case 7: return telemetry.cpu_usage();
+					default: return 0.f;
+					}
+				};
+
+				if (spec.ColumnIndex == 1)
+				{
+					std::sort(reports.begin(), reports.end(), [this](const FrameLimiterReport* a, const FrameLimiterReport* b)
+						{ return GetClientName(a->telemetry.pid()) < GetClientName(b->telemetry.pid()); });
+				}
+				else
+				{
+					std::sort(reports.begin(), reports.end(), [&key](const FrameLimiterReport* a, const FrameLimiterReport* b)
+						{ return key(a) < key(b); });
+				}
+
+				if (spec.SortDirection == ImGuiSortDirection_Descending)
+					std::reverse(reports.begin(), reports.end());
+			}
+
+			for (const FrameLimiterReport* report : reports)
+			{
+				const auto& telemetry = report->telemetry;
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%d", telemetry.pid());
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s", GetClientName(telemetry.pid()).c_str());
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%s%s", telemetry.foreground() ? "Foreground" : "Background", telemetry.enabled() ? ", limited" : "");
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", telemetry.render_fps());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", telemetry.target_fps());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", telemetry.simulation_fps());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f%%", telemetry.throttle_percent());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f%%", telemetry.cpu_usage());
+			}
+
+			ImGui::EndTable();
+		}
 	}
 
 private:
 	mq::ProtoPipeServer m_pipeServer;
+	std::unique_ptr<mq::RoutingBridge> m_bridge;
 	Dropbox m_serverDropbox;
+	Dropbox m_frameLimiterDropbox;
 
+	// m_statsMutex must be held
+	std::string GetClientName(uint32_t pid) const
+	{
+		auto name_it = m_clientNames.find(pid);
+		return name_it != m_clientNames.end() ? name_it->second : "(unidentified)";
+	}
+
+	// Mailboxes and identities belong to the post office thread, so the panel shows a copy
+	void UpdateStats()
+	{
+		std::scoped_lock lock(m_statsMutex);
+		m_mailboxStats = GetMailboxStats();
+
+		m_clientNames.clear();
+		for (const auto& [pid, id] : m_identities)
+		{
+			m_clientNames.emplace(pid, id.character.empty() ? id.account : fmt::format("{} ({})", id.character, id.server));
+		}
+	}
+
+	// Clients on other machines are only sent to overLinks. Messages that came in over a link aren't
+	// sent on to another one, and RPCs from the launcher itself can't get their replies back over one.
 	bool SendMessageToPID(
 		uint32_t pid,
 		PipeMessagePtr&& message,
 		const std::function<void(const PipeConnectionPtr&, PipeMessagePtr&&)> send,
-		const std::function<void(int, PipeMessagePtr&&)>& failed)
+		const std::function<void(int, PipeMessagePtr&&)>& failed,
+		bool overLinks = false)
 	{
 		if (pid == GetCurrentProcessId())
 		{
@@ -638,6 +1372,16 @@ private:
 			send(connection, std::move(message));
 			return true;
 		}
+		else if (int linkId = GetIdentityLink(pid); linkId != 0 && overLinks)
+		{
+			// the launcher on the other end delivers it, the header goes along so replies find their way back
+			if (m_bridge && m_bridge->SendMessage(linkId, *message))
+				return true;
+
+			SPDLOG_WARN("Unable to send to PID {} over routing bridge link {}, message route failed.", pid, linkId);
+			failed(MsgError_NoConnection, std::move(message));
+			return false;
+		}
 
 		SPDLOG_WARN("Unable to get connection for PID {}, message route failed.", pid);
 		failed(MsgError_NoConnection, std::move(message));
@@ -670,13 +1414,120 @@ void SendForceUnloadAllCommand()
 	static_cast<LauncherPostOffice&>(GetPostOffice()).SendForceUnloadAllCommand();
 }
 
+static void ShowRoutingPanel()
+{
+	static_cast<LauncherPostOffice&>(GetPostOffice()).ShowRoutingPanel();
+}
+
+static void ShowFrameLimiterPanel()
+{
+	static_cast<LauncherPostOffice&>(GetPostOffice()).ShowFrameLimiterPanel();
+}
+
+// Synthetic clients on a pipe of their own, to measure the pipe layer without any game running.
+static mq::PipeLoadTest s_loadTest;
+static mq::PipeLoadTestOptions s_loadTestOptions;
+
+static void ShowRoutingLoadTestPanel()
+{
+	const bool running = s_loadTest.IsRunning();
+
+	ImGui::BeginDisabled(running);
+	ImGui::SetNextItemWidth(200);
+	ImGui::SliderInt("Clients", &s_loadTestOptions.Clients, 1, 128);
+
+	int pattern = static_cast<int>(s_loadTestOptions.Pattern);
+	ImGui::SetNextItemWidth(200);
+	if (ImGui::Combo("Pattern", &pattern, "Point to point\0Broadcast\0RPC\0"))
+		s_loadTestOptions.Pattern = static_cast<mq::PipeLoadPattern>(pattern);
+
+	int messages = static_cast<int>(s_loadTestOptions.MessagesPerClient);
+	ImGui::SetNextItemWidth(200);
+	if (ImGui::InputInt("Messages per client", &messages, 100, 1000))
+		s_loadTestOptions.MessagesPerClient = static_cast<uint32_t>(std::clamp(messages, 1, 1000000));
+
+	int payloadSize = static_cast<int>(s_loadTestOptions.PayloadSize);
+	ImGui::SetNextItemWidth(200);
+	if (ImGui::InputInt("Payload bytes", &payloadSize, 64, 1024))
+		s_loadTestOptions.PayloadSize = static_cast<uint32_t>(std::clamp(payloadSize, 16, 1024 * 1024));
+
+	int window = static_cast<int>(s_loadTestOptions.Window);
+	ImGui::SetNextItemWidth(200);
+	if (ImGui::SliderInt("Messages in flight", &window, 1, 256))
+		s_loadTestOptions.Window = static_cast<uint32_t>(window);
+
+	ImGui::Checkbox("Shared memory", &s_loadTestOptions.SharedMemory);
+	ImGui::EndDisabled();
+
+	if (running)
+	{
+		if (ImGui::Button("Cancel"))
+			s_loadTest.Cancel();
+	}
+	else if (ImGui::Button("Start"))
+	{
+		s_loadTest.Start(s_loadTestOptions);
+	}
+
+	const mq::PipeLoadTestResults results = s_loadTest.GetResults();
+	if (results.MessagesExpected == 0 && !results.Running)
+		return;
+
+	ImGui::Separator();
+
+	if (results.Running)
+		ImGui::Text("Running, %d clients connected", results.ConnectedClients);
+	else if (!results.Error.empty())
+		ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", results.Error.c_str());
+	else
+		ImGui::TextUnformatted(results.Completed ? "Completed" : "Finished with failed requests");
+
+	ImGui::Text("Delivered: %llu / %llu (%llu sent, %llu failed)", results.MessagesDelivered, results.MessagesExpected,
+		results.MessagesSent, results.FailedRequests);
+	ImGui::Text("Elapsed: %.2f s", results.Elapsed.count() / 1000000.0);
+	ImGui::Text("Throughput: %.0f msgs/s, %.1f KB/s", results.DeliveredPerSecond, results.BytesPerSecond / 1024.0);
+	ImGui::Text("Latency ms (avg/p50/p99/max): %.3f / %.3f / %.3f / %.3f", results.AverageLatency.count() / 1000.0,
+		results.MedianLatency.count() / 1000.0, results.P99Latency.count() / 1000.0, results.MaxLatency.count() / 1000.0);
+	ImGui::Text("Max queue depths: send %d, server main thread %d, client main thread %d",
+		static_cast<int>(results.MaxSendQueueDepth), static_cast<int>(results.MaxServerMainQueue),
+		static_cast<int>(results.MaxClientMainQueue));
+
+	// Only the buckets that have samples in them, bucket n is under 2^n microseconds
+	if (ImGui::BeginTable("##LoadTestLatency", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
+	{
+		ImGui::TableSetupColumn("Latency under", ImGuiTableColumnFlags_WidthFixed);
+		ImGui::TableSetupColumn("Messages", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableHeadersRow();
+
+		for (size_t bucket = 0; bucket < results.LatencyHistogram.size(); ++bucket)
+		{
+			if (results.LatencyHistogram[bucket] == 0)
+				continue;
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f ms", (1ull << bucket) / 1000.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", results.LatencyHistogram[bucket]);
+		}
+
+		ImGui::EndTable();
+	}
+}
+
 void InitializeNamedPipeServer()
 {
 	static_cast<LauncherPostOffice&>(GetPostOffice()).Initialize();
+
+	LauncherImGui::AddMainPanel("Routing", ShowRoutingPanel);
+	LauncherImGui::AddMainPanel("Frame Limiter", ShowFrameLimiterPanel);
+	LauncherImGui::AddMainPanel("Routing Load Test", ShowRoutingLoadTestPanel);
 }
 
 void ShutdownNamedPipeServer()
 {
+	s_loadTest.Cancel();
 	static_cast<LauncherPostOffice&>(GetPostOffice()).Shutdown();
 }
 
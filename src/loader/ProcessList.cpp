@@ -23,6 +23,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <filesystem>
+#include <future>
 #include <thread>
 #include <mutex>
 
@@ -40,6 +41,9 @@ static std::atomic_bool s_injectorRunning = false;
 // Delay before a process is injected.
 const std::chrono::milliseconds NEW_PROCESS_INJECTION_DELAY_MS = 1s;
 
+// Number of processes that are injected at the same time.
+constexpr size_t MAX_CONCURRENT_INJECTIONS = 8;
+
 const std::string s_mainDLL = "MQ2Main.dll";
 
 struct InjectRequest
@@ -908,6 +912,29 @@ std::string GetLocalPlayer(DWORD pid)
 	return {};
 }
 
+// Every client of a mass launch runs the same eqgame.exe, and finding its version maps and parses the
+// whole file. The mapping also has a fixed name, so two injections can't do it at the same time.
+static std::pair<std::string, std::string> GetCachedEQGameVersionStrings(const std::string& path)
+{
+	static std::mutex s_versionMutex;
+	static std::map<std::string, std::pair<fs::file_time_type, std::pair<std::string, std::string>>> s_versions;
+
+	std::scoped_lock lock(s_versionMutex);
+
+	std::error_code ec;
+	const fs::file_time_type writeTime = fs::last_write_time(path, ec);
+
+	auto iter = s_versions.find(path);
+	if (!ec && iter != s_versions.end() && iter->second.first == writeTime)
+		return iter->second.second;
+
+	auto versions = GetEQGameVersionStrings(path);
+	if (!ec && !versions.first.empty() && !versions.second.empty())
+		s_versions[path] = { writeTime, versions };
+
+	return versions;
+}
+
 static InjectResult DoInject(uint32_t PID)
 {
 	SPDLOG_DEBUG("Injecting MQ into eqgame.exe: pid={0}", PID);
@@ -960,7 +987,7 @@ static InjectResult DoInject(uint32_t PID)
 	char szOutPath[MAX_STRING] = { 0 };
 	::GetModuleFileNameExA(hEQGame.get(), hEqGameMod, szOutPath, MAX_STRING);
 
-	auto [clientDate, clientTime] = GetEQGameVersionStrings(szOutPath);
+	auto [clientDate, clientTime] = GetCachedEQGameVersionStrings(szOutPath);
 
 	if (clientDate.empty() || clientTime.empty())
 	{
@@ -1086,26 +1113,37 @@ void InjectorThread(bool injectOnce)
 		// unlock the mutex while we try to process the list
 		lock.unlock();
 
-		// Process entries and remove all the completions from the list.
-		requests.erase(std::remove_if(std::begin(requests), std::end(requests),
-			[&now, &wait_for](InjectRequest& request)
-			{
-				InjectResult result = DoInject(request.processId);
-				if (result == InjectResult::FailedRetry)
-				{
-					if (request.retries > 0)
-					{
-						SPDLOG_INFO("Scheduling injection for retry: pid={0} retriesLeft={1}", request.processId, request.retries - 1);
+		// Inject several processes at the same time. Most of an injection is spent waiting on the remote
+		// threads in the process, so a mass launch doesn't have to wait for each client in turn.
+		std::vector<InjectResult> results(requests.size(), InjectResult::FailedPermanent);
+		for (size_t first = 0; first < requests.size(); first += MAX_CONCURRENT_INJECTIONS)
+		{
+			const size_t last = std::min(first + MAX_CONCURRENT_INJECTIONS, requests.size());
 
-						--request.retries;
-						request.injectTime = now + 1s;
+			std::vector<std::future<InjectResult>> injections;
+			for (size_t i = first; i < last; ++i)
+				injections.push_back(std::async(std::launch::async, DoInject, requests[i].processId));
 
+			for (size_t i = first; i < last; ++i)
+				results[i] = injections[i - first].get();
+		}
 
-						return false;
-					}
-				}
-				return true;
-			}), std::end(requests));
+		// Keep the requests that should be retried, the rest are done.
+		std::vector<InjectRequest> retries;
+		for (size_t i = 0; i < requests.size(); ++i)
+		{
+			InjectRequest& request = requests[i];
+			if (results[i] == InjectResult::FailedRetry && request.retries > 0)
+			{
+				SPDLOG_INFO("Scheduling injection for retry: pid={0} retriesLeft={1}", request.processId, request.retries - 1);
+
+				--request.retries;
+				request.injectTime = now + 1s;
+				retries.push_back(request);
+			}
+		}
+
+		requests = std::move(retries);
 
 		// Re-lock and copy back to the list
 		lock.lock();
@@ -22,6 +22,8 @@
 #include <wil/resource.h>
 #include <spdlog/spdlog.h>
 #include <chrono>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std::chrono_literals;
 
@@ -40,6 +42,136 @@ public:
 
 std::unique_ptr<ProcessMonitor> pMonitor;
 
+#pragma region Process Tracker
+
+// Waits on the handles of every known eqgame process with the thread pool, so that exits are reported
+// as soon as they happen and without a limit on how many processes can be waited on. Processes that the
+// loader launches are added here directly, the monitors only need to find the ones launched elsewhere.
+class ProcessTracker
+{
+public:
+	~ProcessTracker();
+
+	// Returns true if the process wasn't tracked yet. Processes that can't be opened aren't tracked.
+	bool Track(uint32_t processId);
+	void Clear();
+
+private:
+	static void CALLBACK OnProcessExit(PVOID context, BOOLEAN timedOut);
+
+	struct TrackedProcess
+	{
+		wil::unique_process_handle hProcess;
+		HANDLE hWait = nullptr;
+	};
+
+	std::mutex m_mutex;
+	std::unordered_map<uint32_t, TrackedProcess> m_processes;
+};
+
+static ProcessTracker s_processTracker;
+
+ProcessTracker::~ProcessTracker()
+{
+	Clear();
+}
+
+bool ProcessTracker::Track(uint32_t processId)
+{
+	std::unique_lock lock(m_mutex);
+
+	if (m_processes.count(processId) != 0)
+		return false;
+
+	wil::unique_process_handle hProcess(OpenProcess(SYNCHRONIZE, FALSE, processId));
+	if (!hProcess)
+		return false;
+
+	TrackedProcess& tracked = m_processes[processId];
+	tracked.hProcess = std::move(hProcess);
+
+	if (!::RegisterWaitForSingleObject(&tracked.hWait, tracked.hProcess.get(), &ProcessTracker::OnProcessExit,
+		reinterpret_cast<PVOID>(static_cast<uintptr_t>(processId)), INFINITE, WT_EXECUTEONLYONCE))
+	{
+		SPDLOG_WARN("{}",
+			fmt::windows_error(GetLastError(), "ProcessTracker: failed to wait on process {}", processId).what());
+
+		m_processes.erase(processId);
+		return false;
+	}
+
+	return true;
+}
+
+void ProcessTracker::Clear()
+{
+	std::unordered_map<uint32_t, TrackedProcess> processes;
+
+	{
+		std::unique_lock lock(m_mutex);
+		processes.swap(m_processes);
+	}
+
+	// A callback that is already running may be sending its exit to the main window, so this doesn't
+	// wait for it (that would deadlock when called from the main thread). It won't find its process.
+	for (auto& [_, tracked] : processes)
+	{
+		::UnregisterWait(tracked.hWait);
+	}
+}
+
+void CALLBACK ProcessTracker::OnProcessExit(PVOID context, BOOLEAN /*timedOut*/)
+{
+	const uint32_t processId = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(context));
+
+	{
+		std::unique_lock lock(s_processTracker.m_mutex);
+
+		auto iter = s_processTracker.m_processes.find(processId);
+		if (iter == s_processTracker.m_processes.end())
+			return;
+
+		// The wait has already fired, this just releases it without waiting for this callback.
+		::UnregisterWait(iter->second.hWait);
+		s_processTracker.m_processes.erase(iter);
+	}
+
+	if (gpProcessMonitorEvents)
+		gpProcessMonitorEvents->HandleProcessDestruction(processId);
+}
+
+static void ReportProcessCreation(uint32_t processId)
+{
+	if (s_processTracker.Track(processId) && gpProcessMonitorEvents)
+		gpProcessMonitorEvents->HandleProcessCreation(processId);
+}
+
+static std::vector<DWORD> GetEQGameProcessIds()
+{
+	std::vector<DWORD> processList;
+
+	wil::unique_tool_help_snapshot hSnapshot(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0));
+	if (hSnapshot.is_valid())
+	{
+		PROCESSENTRY32 proc = { sizeof(PROCESSENTRY32) };
+
+		if (Process32First(hSnapshot.get(), &proc))
+		{
+			do
+			{
+				if (ci_equals(proc.szExeFile, "eqgame.exe"))
+				{
+					processList.push_back(proc.th32ProcessID);
+				}
+			} while (Process32Next(hSnapshot.get(), &proc));
+		}
+	}
+
+	return processList;
+}
+
+#pragma endregion
+
 #pragma region WMI Process Monitor
 
 // https://github.com/MvkZ/ServiceProcessWorks/tree/master/process_notify/process_notify
@@ -50,9 +182,8 @@ _COM_SMARTPTR_TYPEDEF(IUnsecuredApartment, __uuidof(IUnsecuredApartment));
 class WmiQueryEventSink : public IWbemObjectSink
 {
 public:
-	WmiQueryEventSink(bool bCreate)
+	WmiQueryEventSink()
 	{
-		m_bIsCreation = bCreate;
 		m_lRef = 0;
 	}
 	~WmiQueryEventSink()
@@ -115,14 +246,7 @@ public:
 				}
 				else
 				{
-					if (m_bIsCreation)
-					{
-						HandleProcessCreation(vPid.ulVal);
-					}
-					else
-					{
-						HandleProcessDestruction(vPid.ulVal);
-					}
+					ReportProcessCreation(vPid.ulVal);
 				}
 			}
 			catch (_com_error& err)
@@ -140,20 +264,9 @@ public:
 		return WBEM_S_NO_ERROR;
 	}
 
-	void HandleProcessCreation(DWORD processId)
-	{
-		gpProcessMonitorEvents->HandleProcessCreation(processId);
-	}
-
-	void HandleProcessDestruction(DWORD processId)
-	{
-		gpProcessMonitorEvents->HandleProcessDestruction(processId);
-	}
-
 private:
 	LONG m_lRef = 0;
 	bool m_bDone = false;
-	bool m_bIsCreation = false;
 };
 
 class WmiProcessMonitor : public ProcessMonitor
@@ -169,8 +282,6 @@ private:
 	wil::com_ptr<IWbemServices> m_wbemServices;
 	wil::com_ptr<WmiQueryEventSink> m_creationSink;
 	wil::com_ptr<IWbemObjectSink> m_creationSinkStub;
-	wil::com_ptr<WmiQueryEventSink> m_destructionSink;
-	wil::com_ptr<IWbemObjectSink> m_destructionSinkStub;
 };
 
 void WmiProcessMonitor::Start()
@@ -197,7 +308,7 @@ void WmiProcessMonitor::Start()
 
 	//----------------------------------------------------------------------------
 	// Create the creation sink
-	m_creationSink = new WmiQueryEventSink(true);
+	m_creationSink = new WmiQueryEventSink();
 
 	wil::com_ptr<IUnknown> pStubUnkCreation;
 	pUnsecApp->CreateObjectStub(m_creationSink.get(), &pStubUnkCreation);
@@ -208,23 +319,10 @@ void WmiProcessMonitor::Start()
 		bstr_t("SELECT * FROM __InstanceCreationEvent WITHIN 1 WHERE TargetInstance ISA 'Win32_Process' AND TargetInstance.Name = 'eqgame.exe'"),
 		WBEM_FLAG_SEND_STATUS, nullptr, creationSinkStub.get()));
 
-	//----------------------------------------------------------------------------
-	// Create the destruction sink
-
-	m_destructionSink = new WmiQueryEventSink(false);
-
-	wil::com_ptr<IUnknown> pStubUnkDeletion;
-	pUnsecApp->CreateObjectStub(m_destructionSink.get(), &pStubUnkDeletion);
-	auto destructionSinkStub = pStubUnkDeletion.query<IWbemObjectSink>();
-
-	THROW_IF_FAILED(wbemServices->ExecNotificationQueryAsync(
-		bstr_t("WQL"),
-		bstr_t("SELECT * FROM __InstanceDeletionEvent WITHIN 1 WHERE TargetInstance ISA 'Win32_Process' AND TargetInstance.Name = 'eqgame.exe'"),
-		WBEM_FLAG_SEND_STATUS, nullptr, destructionSinkStub.get()));
+	// Exits are reported by the process tracker, so there is no deletion query.
 
 	m_wbemServices = wbemServices;
 	m_creationSinkStub = creationSinkStub;
-	m_destructionSinkStub = destructionSinkStub;
 }
 
 void WmiProcessMonitor::Stop()
@@ -235,11 +333,6 @@ void WmiProcessMonitor::Stop()
 		{
 			m_wbemServices->CancelAsyncCall(m_creationSinkStub.get());
 		}
-
-		if (m_destructionSinkStub)
-		{
-			m_wbemServices->CancelAsyncCall(m_destructionSinkStub.get());
-		}
 	}
 }
 
@@ -266,6 +359,8 @@ bool StartWMIProcessMonitor()
 
 #pragma region ToolHelp Process Monitor
 
+// Polls for eqgame processes that weren't launched by the loader. The interval starts short and decays
+// while nothing new shows up, so a batch of clients started by something else is still picked up quickly.
 class ToolHelpProcessMonitor : public ProcessMonitor
 {
 public:
@@ -278,6 +373,9 @@ public:
 private:
 	void ThreadProc();
 
+	static constexpr std::chrono::milliseconds MinPollInterval = 250ms;
+	static constexpr std::chrono::milliseconds MaxPollInterval = 5s;
+
 	wil::unique_event m_event;
 	std::atomic_bool m_running{ false };
 	std::thread m_thread;
@@ -297,9 +395,9 @@ void ToolHelpProcessMonitor::Start()
 	if (m_running)
 		return;
 
-	m_thread = std::thread([this]() { ThreadProc(); });
-	m_running = true;
 	m_event.create(wil::EventOptions::ManualReset);
+	m_running = true;
+	m_thread = std::thread([this]() { ThreadProc(); });
 }
 
 void ToolHelpProcessMonitor::Stop()
@@ -315,111 +413,36 @@ void ToolHelpProcessMonitor::Stop()
 
 void ToolHelpProcessMonitor::ThreadProc()
 {
-	// vector of open processes. the unique_process_handle will keep the handle
-	// open while we wait on it.
-	std::vector<std::pair<DWORD, wil::unique_process_handle>> allProcesses;
-	std::vector<DWORD> processList;
-	std::vector<HANDLE> waitList;
-	waitList.push_back(m_event.get());
-	bool initial = true;
-	bool switchToWMI = false;
+	std::chrono::milliseconds pollInterval = MinPollInterval;
 
 	do
 	{
-		processList.clear();
-		processList.reserve(allProcesses.size()); // Assume that nothing changed
+		bool found = false;
 
-		// Retrieve process list
-		wil::unique_tool_help_snapshot hSnapshot(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0));
-
-		if (hSnapshot.is_valid())
+		// Known processes (including everything the loader launched) are already tracked.
+		for (DWORD processId : GetEQGameProcessIds())
 		{
-			PROCESSENTRY32 proc = { sizeof(PROCESSENTRY32) };
-
-			if (Process32First(hSnapshot.get(), &proc))
+			if (s_processTracker.Track(processId))
 			{
-				do
-				{
-					if (ci_equals(proc.szExeFile, "eqgame.exe"))
-					{
-						processList.push_back(proc.th32ProcessID);
-					}
-				} while (Process32Next(hSnapshot.get(), &proc));
+				found = true;
+				gpProcessMonitorEvents->HandleProcessCreation(processId);
 			}
 		}
 
-		// Compare with the currently known list.
-		for (DWORD processId : processList)
-		{
-			if (std::find_if(std::begin(allProcesses), std::end(allProcesses),
-				[processId](const auto& pi) { return pi.first == processId; })
-				== std::end(allProcesses))
-			{
-				// not found, this is a new process.
-				wil::unique_process_handle hProcess(OpenProcess(SYNCHRONIZE, FALSE, processId));
-				if (hProcess)
-				{
-					waitList.push_back(hProcess.get());
-					allProcesses.emplace_back(processId, std::move(hProcess));
-
-					if (!initial)
-						gpProcessMonitorEvents->HandleProcessCreation(processId);
-				}
-			}
-		}
-
-		// Now we wait. The first element is always the event.
-		DWORD result = ::WaitForMultipleObjects((DWORD)waitList.size(), &waitList[0], FALSE, 5000);
+		pollInterval = found ? MinPollInterval : std::min(pollInterval * 2, MaxPollInterval);
 
+		// The event is only signaled to stop.
+		DWORD result = ::WaitForSingleObject(m_event.get(), static_cast<DWORD>(pollInterval.count()));
 		if (result == WAIT_FAILED)
 		{
-			if (waitList.size() >= MAXIMUM_WAIT_OBJECTS)
-			{
-				// SPDLOG_ERROR("Encountered more than the maximum number of processes while waiting on ToolhelpThread: {}! "
-				// 	"Switching to WMI process monitor.", waitList.size());
-				// switchToWMI = true;
-				// m_running = false;
+			SPDLOG_WARN("{}",
+				fmt::windows_error(GetLastError(), "ToolHelpThread: failed in WaitForSingleObject").what());
 
-				Sleep(2500); // Well, we were going to sleep for 5 seconds as a timeout anyway.
-			}
-			else
-			{
-				SPDLOG_WARN("{}",
-					fmt::windows_error(GetLastError(), "ToolHelpThread: failed in WaitForMultipleObjects").what());
-			}
+			Sleep(static_cast<DWORD>(MaxPollInterval.count()));
 		}
-		else if (result != WAIT_TIMEOUT)
-		{
-			if (result >= WAIT_OBJECT_0 && result <= WAIT_OBJECT_0 + waitList.size())
-			{
-				int index = result - WAIT_OBJECT_0;
-				HANDLE hHandle = waitList[index];
-
-				// If its index 0, then the wake up event was signaled. Everything else is a process handle.
-				if (index > 0)
-				{
-					waitList.erase(waitList.begin() + index);
-
-					DWORD processId = allProcesses[index - 1].first;
-					allProcesses.erase(allProcesses.begin() + index - 1);
-
-					gpProcessMonitorEvents->HandleProcessDestruction(processId);
-				}
-			}
-		}
-
-		initial = false;
 	} while (m_running);
 
 	SPDLOG_DEBUG("Process Monitor Thread Exit");
-
-	if (switchToWMI)
-	{
-		// Detach this thread so we can destroy the process monitor.
-		m_thread.detach();
-
-		StartWMIProcessMonitor();
-	}
 }
 
 bool StartToolHelpProcessMonitor()
@@ -445,6 +468,12 @@ void StartProcessMonitor(ProcessMonitorEvents* pEvents)
 {
 	gpProcessMonitorEvents = pEvents;
 
+	// Processes that are already running are tracked, but they aren't new.
+	for (DWORD processId : GetEQGameProcessIds())
+	{
+		s_processTracker.Track(processId);
+	}
+
 	// Try to start the tooltip process monitor
 	bool success = StartToolHelpProcessMonitor();
 	if (!success)
@@ -466,5 +495,11 @@ void StopProcessMonitor()
 		pMonitor.reset();
 	}
 
+	s_processTracker.Clear();
 	gpProcessMonitorEvents = nullptr;
+}
+
+void TrackLaunchedProcess(uint32_t processId)
+{
+	ReportProcessCreation(processId);
 }
\ No newline at end of file
@@ -31,3 +31,7 @@ public:
 
 void StartProcessMonitor(ProcessMonitorEvents*);
 void StopProcessMonitor();
+
+// Reports a process that the loader launched itself right away, instead of waiting for the monitor
+// to find it. Its exit is reported when its handle is signaled.
+void TrackLaunchedProcess(uint32_t processId);
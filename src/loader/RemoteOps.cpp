@@ -14,476 +14,409 @@
 
 #include "MacroQuest.h"
 
-// https://www.codeproject.com/Tips/139349/Getting-the-address-of-a-function-in-a-DLL-loaded
-
-HMODULE WINAPI GetRemoteModuleHandle(HANDLE hProcess, LPCSTR lpModuleName)
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Based on https://www.codeproject.com/Tips/139349/Getting-the-address-of-a-function-in-a-DLL-loaded
+//
+// Reading the export table of a module in another process takes a lot of ReadProcessMemory calls,
+// and the same dlls are looked at in every client that is launched. The export tables are cached by
+// the identity of the image (its timestamp, checksum and size), which doesn't depend on where it was
+// loaded, so a table read from one client is used for all of them. System dlls are also loaded at
+// the same base in every process of a boot session, so where a module was last found is checked
+// first, before enumerating the modules of the process.
+//
+// The caches are shared by the threads that inject clients. The lock is only held to look up or
+// store an entry, never while reading another process.
+
+struct RemoteImageId
 {
-	HMODULE* ModuleArray = nullptr;
-	DWORD ModuleArraySize = 100;
-	DWORD NumModules = 0;
-	CHAR lpModuleNameCopy[MAX_PATH] = { 0 };
-	CHAR ModuleNameBuffer[MAX_PATH] = { 0 };
-
-	/* Make sure we didn't get a nullptr pointer for the module name */
-	if (lpModuleName == nullptr)
-		goto GRMH_FAIL_JMP;
+	DWORD TimeDateStamp = 0;
+	DWORD CheckSum = 0;
+	DWORD SizeOfImage = 0;
+	DWORD ExportRva = 0;
+	DWORD ExportSize = 0;
 
-	/* Convert lpModuleName to all lowercase so the comparison isn't case sensitive */
-	for (size_t i = 0; lpModuleName[i] != '\0'; ++i)
+	bool operator<(const RemoteImageId& other) const
 	{
-		if (lpModuleName[i] >= 'A' && lpModuleName[i] <= 'Z')
-			lpModuleNameCopy[i] = lpModuleName[i] + 0x20; // 0x20 is the difference between uppercase and lowercase
-		else
-			lpModuleNameCopy[i] = lpModuleName[i];
-
-		lpModuleNameCopy[i + 1] = '\0';
+		return std::tie(TimeDateStamp, CheckSum, SizeOfImage, ExportRva, ExportSize)
+			< std::tie(other.TimeDateStamp, other.CheckSum, other.SizeOfImage, other.ExportRva, other.ExportSize);
 	}
 
-	/* Allocate memory to hold the module handles */
-	ModuleArray = new HMODULE[ModuleArraySize];
-
-	/* Check if the allocation failed */
-	if (ModuleArray == nullptr)
-		goto GRMH_FAIL_JMP;
-
-	/* Get handles to all the modules in the target process */
-	if (!::EnumProcessModulesEx(hProcess, ModuleArray,
-		ModuleArraySize * sizeof(HMODULE), &NumModules, LIST_MODULES_ALL))
-		goto GRMH_FAIL_JMP;
-
-	/* We want the number of modules not the number of bytes */
-	NumModules /= sizeof(HMODULE);
-
-	/* Did we allocate enough memory for all the module handles? */
-	if (NumModules > ModuleArraySize)
+	bool operator==(const RemoteImageId& other) const
 	{
-		delete[] ModuleArray; // Deallocate so we can try again
-		ModuleArray = nullptr; // Set it to nullptr se we can be sure if the next try fails
-		ModuleArray = new HMODULE[NumModules]; // Allocate the right amount of memory
-
-		/* Check if the allocation failed */
-		if (ModuleArray == nullptr)
-			goto GRMH_FAIL_JMP;
+		return !(*this < other) && !(other < *this);
+	}
+};
 
-		ModuleArraySize = NumModules; // Update the size of the array
+struct RemoteExportTable
+{
+	DWORD OrdinalBase = 0;
+	std::vector<DWORD> Functions;                                 // rvas, indexed by ordinal - base
+	std::vector<std::pair<std::string, WORD>> Names;              // in the order of the name table
+	std::unordered_map<std::string, WORD> NameToFunction;
+	std::unordered_map<WORD, std::string> Forwarders;             // "module.function" or "module.#ordinal"
+};
+
+struct RemoteModuleLocation
+{
+	uintptr_t Base = 0;
+	RemoteImageId Id;
+};
 
-		/* Get handles to all the modules in the target process */
-		if (!::EnumProcessModulesEx(hProcess, ModuleArray,
-			ModuleArraySize * sizeof(HMODULE), &NumModules, LIST_MODULES_ALL))
-			goto GRMH_FAIL_JMP;
+static std::mutex s_remoteCacheMutex;
+static std::map<RemoteImageId, std::shared_ptr<const RemoteExportTable>> s_remoteExportTables;
+static std::unordered_map<std::string, RemoteModuleLocation> s_remoteModules;  // lower case names
 
-		/* We want the number of modules not the number of bytes */
-		NumModules /= sizeof(HMODULE);
-	}
+static std::string ReadRemoteString(HANDLE hProcess, uintptr_t address)
+{
+	std::string result;
+	char buffer[64];
 
-	/* Iterate through all the modules and see if the names match the one we are looking for */
-	for (DWORD i = 0; i <= NumModules; ++i)
+	for (;;)
 	{
-		/* Get the module's name */
-		::GetModuleBaseName(hProcess, ModuleArray[i],
-			ModuleNameBuffer, sizeof(ModuleNameBuffer));
-
-		/* Convert ModuleNameBuffer to all lowercase so the comparison isn't case sensitive */
-		for (size_t j = 0; ModuleNameBuffer[j] != '\0'; ++i)
+		SIZE_T read = 0;
+		if (!::ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(address), buffer, sizeof(buffer), &read))
 		{
-			if (ModuleNameBuffer[j] >= 'A' && ModuleNameBuffer[j] <= 'Z')
-				ModuleNameBuffer[j] += 0x20; // 0x20 is the difference between uppercase and lowercase
+			// The chunk could run past the end of a readable page, fall back to one character at a time.
+			if (!::ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(address), buffer, 1, &read))
+				return {};
+
+			read = 1;
 		}
 
-		/* Does the name match? */
-		if (strstr(ModuleNameBuffer, lpModuleNameCopy) != nullptr)
+		for (SIZE_T i = 0; i < read; ++i)
 		{
-			/* Make a temporary variable to hold return value*/
-			HMODULE TempReturn = ModuleArray[i];
+			if (buffer[i] == '\0')
+				return result;
 
-			/* Give back that memory */
-			delete[] ModuleArray;
-
-			/* Success */
-			return TempReturn;
+			result.push_back(buffer[i]);
 		}
 
-		/* Wrong module let's try the next... */
+		address += read;
 	}
-
-	/* Uh Oh... */
-GRMH_FAIL_JMP:
-
-	/* If we got to the point where we allocated memory we need to give it back */
-	if (ModuleArray != nullptr)
-		delete[] ModuleArray;
-
-	/* Failure... */
-	return nullptr;
 }
 
-FARPROC WINAPI GetRemoteProcAddress(HANDLE hProcess, HMODULE hModule, LPCSTR lpProcName, UINT Ordinal, BOOL UseOrdinal)
+// Reads the headers of the image that was loaded at base.
+static bool ReadRemoteImageId(HANDLE hProcess, uintptr_t base, RemoteImageId& id)
 {
-	BOOL Is64Bit = FALSE;
-	MODULEINFO RemoteModuleInfo = { 0 };
-	UINT_PTR RemoteModuleBaseVA = 0;
-	IMAGE_DOS_HEADER DosHeader = { 0 };
-	DWORD Signature = 0;
-	IMAGE_FILE_HEADER FileHeader = { 0 };
-	IMAGE_OPTIONAL_HEADER64 OptHeader64 = { 0 };
-	IMAGE_OPTIONAL_HEADER32 OptHeader32 = { 0 };
-	IMAGE_DATA_DIRECTORY ExportDirectory = { 0 };
-	IMAGE_EXPORT_DIRECTORY ExportTable = { 0 };
-	UINT_PTR ExportFunctionTableVA = 0;
-	UINT_PTR ExportNameTableVA = 0;
-	UINT_PTR ExportOrdinalTableVA = 0;
-	DWORD* ExportFunctionTable = nullptr;
-	DWORD* ExportNameTable = nullptr;
-	WORD* ExportOrdinalTable = nullptr;
-
-	/* Temporary variables not used until much later but easier
-	/* to define here than in all the the places they are used */
-	CHAR TempChar;
-	BOOL Done = FALSE;
-
-	/* Check to make sure we didn't get a nullptr pointer for the name unless we are searching by ordinal */
-	if (lpProcName == nullptr && !UseOrdinal)
-		goto GRPA_FAIL_JMP;
-
-	/* Get the base address of the remote module along with some other info we don't need */
-	if (!::GetModuleInformation(hProcess, hModule, &RemoteModuleInfo, sizeof(RemoteModuleInfo)))
-		goto GRPA_FAIL_JMP;
-	RemoteModuleBaseVA = (UINT_PTR)RemoteModuleInfo.lpBaseOfDll;
-
-	/* Read the DOS header and check it's magic number */
-	if (!::ReadProcessMemory(hProcess, (LPCVOID)RemoteModuleBaseVA, &DosHeader,
-		sizeof(DosHeader), nullptr) || DosHeader.e_magic != IMAGE_DOS_SIGNATURE)
-		goto GRPA_FAIL_JMP;
-
-	/* Read and check the NT signature */
-	if (!::ReadProcessMemory(hProcess, (LPCVOID)(RemoteModuleBaseVA + DosHeader.e_lfanew),
-		&Signature, sizeof(Signature), nullptr) || Signature != IMAGE_NT_SIGNATURE)
-		goto GRPA_FAIL_JMP;
-
-	/* Read the main header */
-	if (!::ReadProcessMemory(hProcess,
-		(LPCVOID)(RemoteModuleBaseVA + DosHeader.e_lfanew + sizeof(Signature)),
-		&FileHeader, sizeof(FileHeader), nullptr))
-		goto GRPA_FAIL_JMP;
-
-	/* Which type of optional header is the right size? */
-	if (FileHeader.SizeOfOptionalHeader == sizeof(OptHeader64))
-		Is64Bit = TRUE;
-	else if (FileHeader.SizeOfOptionalHeader == sizeof(OptHeader32))
-		Is64Bit = FALSE;
-	else
-		goto GRPA_FAIL_JMP;
-
-	if (Is64Bit)
+	IMAGE_DOS_HEADER dosHeader = { 0 };
+	if (!::ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(base), &dosHeader, sizeof(dosHeader), nullptr)
+		|| dosHeader.e_magic != IMAGE_DOS_SIGNATURE)
 	{
-		/* Read the optional header and check it's magic number */
-		if (!::ReadProcessMemory(hProcess,
-			(LPCVOID)(RemoteModuleBaseVA + DosHeader.e_lfanew + sizeof(Signature) + sizeof(FileHeader)),
-			&OptHeader64, FileHeader.SizeOfOptionalHeader, nullptr)
-			|| OptHeader64.Magic != IMAGE_NT_OPTIONAL_HDR64_MAGIC)
-			goto GRPA_FAIL_JMP;
+		return false;
 	}
-	else
+
+	// Big enough for either kind of optional header, which one it is follows from the magic number.
+	IMAGE_NT_HEADERS64 ntHeaders = { 0 };
+	if (!::ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(base + dosHeader.e_lfanew), &ntHeaders,
+		sizeof(ntHeaders), nullptr) || ntHeaders.Signature != IMAGE_NT_SIGNATURE)
 	{
-		/* Read the optional header and check it's magic number */
-		if (!::ReadProcessMemory(hProcess,
-			(LPCVOID)(RemoteModuleBaseVA + DosHeader.e_lfanew + sizeof(Signature) + sizeof(FileHeader)),
-			&OptHeader32, FileHeader.SizeOfOptionalHeader, nullptr)
-			|| OptHeader32.Magic != IMAGE_NT_OPTIONAL_HDR32_MAGIC)
-			goto GRPA_FAIL_JMP;
+		return false;
 	}
 
-	/* Make sure the remote module has an export directory and if it does save it's relative address and size */
-	if (Is64Bit && OptHeader64.NumberOfRvaAndSizes >= IMAGE_DIRECTORY_ENTRY_EXPORT + 1)
+	id.TimeDateStamp = ntHeaders.FileHeader.TimeDateStamp;
+
+	const IMAGE_DATA_DIRECTORY* exportDirectory = nullptr;
+	if (ntHeaders.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
 	{
-		ExportDirectory.VirtualAddress = (OptHeader64.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]).VirtualAddress;
-		ExportDirectory.Size = (OptHeader64.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]).Size;
+		const IMAGE_OPTIONAL_HEADER64& header = ntHeaders.OptionalHeader;
+		id.CheckSum = header.CheckSum;
+		id.SizeOfImage = header.SizeOfImage;
+		if (header.NumberOfRvaAndSizes > IMAGE_DIRECTORY_ENTRY_EXPORT)
+			exportDirectory = &header.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
 	}
-	else if (OptHeader32.NumberOfRvaAndSizes >= IMAGE_DIRECTORY_ENTRY_EXPORT + 1)
+	else if (ntHeaders.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
 	{
-		ExportDirectory.VirtualAddress = (OptHeader32.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]).VirtualAddress;
-		ExportDirectory.Size = (OptHeader32.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT]).Size;
+		const auto& header = reinterpret_cast<const IMAGE_OPTIONAL_HEADER32&>(ntHeaders.OptionalHeader);
+		id.CheckSum = header.CheckSum;
+		id.SizeOfImage = header.SizeOfImage;
+		if (header.NumberOfRvaAndSizes > IMAGE_DIRECTORY_ENTRY_EXPORT)
+			exportDirectory = &header.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
 	}
 	else
-		goto GRPA_FAIL_JMP;
-
-	/* Read the main export table */
-	if (!::ReadProcessMemory(hProcess, (LPCVOID)(RemoteModuleBaseVA + ExportDirectory.VirtualAddress),
-		&ExportTable, sizeof(ExportTable), nullptr))
-		goto GRPA_FAIL_JMP;
-
-	/* Save the absolute address of the tables so we don't need to keep adding the base address */
-	ExportFunctionTableVA = RemoteModuleBaseVA + ExportTable.AddressOfFunctions;
-	ExportNameTableVA = RemoteModuleBaseVA + ExportTable.AddressOfNames;
-	ExportOrdinalTableVA = RemoteModuleBaseVA + ExportTable.AddressOfNameOrdinals;
-
-	/* Allocate memory for our copy of the tables */
-	ExportFunctionTable = new DWORD[ExportTable.NumberOfFunctions];
-	ExportNameTable = new DWORD[ExportTable.NumberOfNames];
-	ExportOrdinalTable = new WORD[ExportTable.NumberOfNames];
-
-	/* Check if the allocation failed */
-	if (ExportFunctionTable == nullptr || ExportNameTable == nullptr || ExportOrdinalTable == nullptr)
-		goto GRPA_FAIL_JMP;
-
-	/* Get a copy of the function table */
-	if (!::ReadProcessMemory(hProcess, (LPCVOID)ExportFunctionTableVA,
-		ExportFunctionTable, ExportTable.NumberOfFunctions * sizeof(DWORD), nullptr))
-		goto GRPA_FAIL_JMP;
-
-	/* Get a copy of the name table */
-	if (!::ReadProcessMemory(hProcess, (LPCVOID)ExportNameTableVA,
-		ExportNameTable, ExportTable.NumberOfNames * sizeof(DWORD), nullptr))
-		goto GRPA_FAIL_JMP;
-
-	/* Get a copy of the ordinal table */
-	if (!::ReadProcessMemory(hProcess, (LPCVOID)ExportOrdinalTableVA,
-		ExportOrdinalTable, ExportTable.NumberOfNames * sizeof(WORD), nullptr))
-		goto GRPA_FAIL_JMP;
-
-	/* If we are searching for an ordinal we do that now */
-	if (UseOrdinal)
 	{
-		/* NOTE:
-		/* Microsoft's PE/COFF specification does NOT say we need to subtract the ordinal base
-		/* from our ordinal but it seems to always give the wrong function if we don't */
+		return false;
+	}
+
+	if (exportDirectory)
+	{
+		id.ExportRva = exportDirectory->VirtualAddress;
+		id.ExportSize = exportDirectory->Size;
+	}
 
-		/* Make sure the ordinal is valid */
-		if (Ordinal < ExportTable.Base || (Ordinal - ExportTable.Base) >= ExportTable.NumberOfFunctions)
-			goto GRPA_FAIL_JMP;
+	return true;
+}
 
-		UINT FunctionTableIndex = Ordinal - ExportTable.Base;
+static std::shared_ptr<const RemoteExportTable> ReadRemoteExportTable(HANDLE hProcess, uintptr_t base,
+	const RemoteImageId& id)
+{
+	if (id.ExportRva == 0 || id.ExportSize < sizeof(IMAGE_EXPORT_DIRECTORY))
+		return nullptr;
+
+	// The directory, the tables and (nearly always) the names and forwarder strings are all inside of
+	// the export data directory, so it is read in one go.
+	std::vector<char> directory(id.ExportSize);
+	if (!::ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(base + id.ExportRva), directory.data(),
+		directory.size(), nullptr))
+	{
+		return nullptr;
+	}
 
-		/* Check if the function is forwarded and if so get the real address*/
-		if (ExportFunctionTable[FunctionTableIndex] >= ExportDirectory.VirtualAddress &&
-			ExportFunctionTable[FunctionTableIndex] <= ExportDirectory.VirtualAddress + ExportDirectory.Size)
+	auto readTable = [&](DWORD rva, void* buffer, size_t size)
+	{
+		if (rva >= id.ExportRva && rva - id.ExportRva + size <= directory.size())
 		{
-			Done = FALSE;
-			std::string TempForwardString;
-			TempForwardString.clear(); // Empty the string so we can fill it with a new name
+			memcpy(buffer, directory.data() + (rva - id.ExportRva), size);
+			return true;
+		}
 
-			/* Get the forwarder string one character at a time because we don't know how long it is */
-			for (UINT_PTR i = 0; !Done; ++i)
-			{
-				/* Get next character */
-				if (!::ReadProcessMemory(hProcess,
-					(LPCVOID)(RemoteModuleBaseVA + ExportFunctionTable[FunctionTableIndex] + i),
-					&TempChar, sizeof(TempChar), nullptr))
-					goto GRPA_FAIL_JMP;
+		return ::ReadProcessMemory(hProcess, reinterpret_cast<LPCVOID>(base + rva), buffer, size, nullptr) != FALSE;
+	};
+
+	auto readString = [&](DWORD rva)
+	{
+		if (rva >= id.ExportRva && rva < id.ExportRva + directory.size())
+		{
+			const char* first = directory.data() + (rva - id.ExportRva);
+			const char* last = directory.data() + directory.size();
+			const char* end = std::find(first, last, '\0');
+			if (end != last)
+				return std::string(first, end);
+		}
 
-				TempForwardString.push_back(TempChar); // Add it to the string
+		return ReadRemoteString(hProcess, base + rva);
+	};
 
-				/* If it's NUL we are done */
-				if (TempChar == (CHAR)'\0')
-					Done = TRUE;
-			}
+	const auto& exportTable = *reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(directory.data());
 
-			/* Find the dot that seperates the module name and the function name/ordinal */
-			size_t Dot = TempForwardString.find('.');
-			if (Dot == std::string::npos)
-				goto GRPA_FAIL_JMP;
+	auto table = std::make_shared<RemoteExportTable>();
+	table->OrdinalBase = exportTable.Base;
+	table->Functions.resize(exportTable.NumberOfFunctions);
 
-			/* Temporary variables that hold parts of the forwarder string */
-			std::string RealModuleName, RealFunctionId;
-			RealModuleName = TempForwardString.substr(0, Dot - 1);
-			RealFunctionId = TempForwardString.substr(Dot + 1, std::string::npos);
+	std::vector<DWORD> nameTable(exportTable.NumberOfNames);
+	std::vector<WORD> ordinalTable(exportTable.NumberOfNames);
 
-			HMODULE RealModule = GetRemoteModuleHandle(hProcess, RealModuleName.c_str());
-			FARPROC TempReturn;// Make a temporary variable to hold return value
+	if (!readTable(exportTable.AddressOfFunctions, table->Functions.data(), table->Functions.size() * sizeof(DWORD))
+		|| !readTable(exportTable.AddressOfNames, nameTable.data(), nameTable.size() * sizeof(DWORD))
+		|| !readTable(exportTable.AddressOfNameOrdinals, ordinalTable.data(), ordinalTable.size() * sizeof(WORD)))
+	{
+		return nullptr;
+	}
 
+	// The ordinal table holds indices into the function table, the ordinal base isn't part of them.
+	table->Names.reserve(nameTable.size());
+	for (size_t i = 0; i < nameTable.size(); ++i)
+	{
+		if (ordinalTable[i] >= table->Functions.size())
+			continue;
 
-			/* Figure out if the function was exported by name or by ordinal */
-			if (RealFunctionId.at(0) == '#') // Exported by ordinal
-			{
-				UINT RealOrdinal = 0;
-				RealFunctionId.erase(0, 1); // Remove '#' from string
+		std::string name = readString(nameTable[i]);
+		table->NameToFunction.emplace(name, ordinalTable[i]);
+		table->Names.emplace_back(std::move(name), ordinalTable[i]);
+	}
 
-				/* My version of atoi() because I was too lazy to use the real one... */
-				for (char i : RealFunctionId)
-				{
-					if (i >= '0' && i <= '9')
-					{
-						RealOrdinal *= 10;
-						RealOrdinal += i - '0';
-					}
-					else
-						break;
-				}
+	// Functions that point back into the export directory are forwarded to another module.
+	for (size_t i = 0; i < table->Functions.size(); ++i)
+	{
+		const DWORD rva = table->Functions[i];
+		if (rva >= id.ExportRva && rva < id.ExportRva + id.ExportSize)
+			table->Forwarders.emplace(static_cast<WORD>(i), readString(rva));
+	}
 
-				/* Recursively call this function to get return value */
-				TempReturn = GetRemoteProcAddress(hProcess, RealModule, nullptr, RealOrdinal, TRUE);
-			}
-			else // Exported by name
-			{
-				/* Recursively call this function to get return value */
-				TempReturn = GetRemoteProcAddress(hProcess, RealModule, RealFunctionId.c_str(), 0, FALSE);
-			}
+	return table;
+}
 
-			/* Give back that memory */
-			delete[] ExportFunctionTable;
-			delete[] ExportNameTable;
-			delete[] ExportOrdinalTable;
+static std::shared_ptr<const RemoteExportTable> GetRemoteExportTable(HANDLE hProcess, uintptr_t base,
+	const RemoteImageId& id)
+{
+	{
+		std::scoped_lock lock(s_remoteCacheMutex);
 
-			/* Success!!! */
-			return TempReturn;
-		}
-		else // Not Forwarded
-		{
+		auto iter = s_remoteExportTables.find(id);
+		if (iter != s_remoteExportTables.end())
+			return iter->second;
+	}
 
-			/* Make a temporary variable to hold return value*/
-			FARPROC TempReturn = (FARPROC)(RemoteModuleBaseVA + ExportFunctionTable[FunctionTableIndex]);
+	auto table = ReadRemoteExportTable(hProcess, base, id);
+	if (!table)
+		return nullptr;
 
-			/* Give back that memory */
-			delete[] ExportFunctionTable;
-			delete[] ExportNameTable;
-			delete[] ExportOrdinalTable;
+	// Another thread might have read the same table in the meantime, they're the same either way.
+	std::scoped_lock lock(s_remoteCacheMutex);
+	return s_remoteExportTables.emplace(id, std::move(table)).first->second;
+}
 
-			/* Success!!! */
-			return TempReturn;
-		}
+static std::string ToLowerModuleName(std::string_view name)
+{
+	std::string result(name);
+	for (char& ch : result)
+	{
+		if (ch >= 'A' && ch <= 'Z')
+			ch += 'a' - 'A';
 	}
 
-	/* Iterate through all the names and see if they match the one we are looking for */
-	for (DWORD i = 0; i < ExportTable.NumberOfNames; ++i)
-	{
-		std::string TempFunctionName;
+	return result;
+}
+
+// Module names match when the name that is searched for is part of the module's name, so "kernel32"
+// finds "kernel32.dll".
+static bool RemoteModuleNameMatches(HANDLE hProcess, HMODULE hModule, const std::string& lowerName)
+{
+	char moduleName[MAX_PATH] = { 0 };
+	if (!::GetModuleBaseNameA(hProcess, hModule, moduleName, sizeof(moduleName)))
+		return false;
+
+	return ToLowerModuleName(moduleName).find(lowerName) != std::string::npos;
+}
+
+HMODULE WINAPI GetRemoteModuleHandle(HANDLE hProcess, LPCSTR lpModuleName)
+{
+	if (lpModuleName == nullptr)
+		return nullptr;
+
+	const std::string lowerName = ToLowerModuleName(lpModuleName);
 
-		Done = FALSE;// Reset for next name
-		TempFunctionName.clear(); // Empty the string so we can fill it with a new name
+	// Check where the module was found last, that's where it is in any other process of this session,
+	// as long as it is the same image.
+	RemoteModuleLocation cached;
+	bool haveCached = false;
+	{
+		std::scoped_lock lock(s_remoteCacheMutex);
 
-		/* Get the function name one character at a time because we don't know how long it is */
-		for (UINT_PTR j = 0; !Done; ++j)
+		auto iter = s_remoteModules.find(lowerName);
+		if (iter != s_remoteModules.end())
 		{
-			/* Get next character */
-			if (!::ReadProcessMemory(hProcess, (LPCVOID)(RemoteModuleBaseVA + ExportNameTable[i] + j),
-				&TempChar, sizeof(TempChar), nullptr))
-				goto GRPA_FAIL_JMP;
+			cached = iter->second;
+			haveCached = true;
+		}
+	}
 
-			TempFunctionName.push_back(TempChar); // Add it to the string
+	if (haveCached)
+	{
+		HMODULE hModule = reinterpret_cast<HMODULE>(cached.Base);
+		RemoteImageId id;
 
-			/* If it's NUL we are done */
-			if (TempChar == (CHAR)'\0')
-				Done = TRUE;
+		if (RemoteModuleNameMatches(hProcess, hModule, lowerName)
+			&& ReadRemoteImageId(hProcess, cached.Base, id) && id == cached.Id)
+		{
+			return hModule;
 		}
+	}
 
-		/* Does the name match? */
-		if (TempFunctionName.find(lpProcName) != std::string::npos)
+	std::vector<HMODULE> modules(256);
+	DWORD bytesNeeded = 0;
+
+	for (;;)
+	{
+		if (!::EnumProcessModulesEx(hProcess, modules.data(), static_cast<DWORD>(modules.size() * sizeof(HMODULE)),
+			&bytesNeeded, LIST_MODULES_ALL))
 		{
-			/* NOTE:
-			/* Microsoft's PE/COFF specification says we need to subtract the ordinal base
-			/*from the value in the ordinal table but that seems to always give the wrong function */
+			return nullptr;
+		}
 
-			/* Check if the function is forwarded and if so get the real address*/
-			if (ExportFunctionTable[ExportOrdinalTable[i]] >= ExportDirectory.VirtualAddress &&
-				ExportFunctionTable[ExportOrdinalTable[i]] <= ExportDirectory.VirtualAddress + ExportDirectory.Size)
-			{
-				Done = FALSE;
-				std::string TempForwardString;
-				TempForwardString.clear(); // Empty the string so we can fill it with a new name
+		if (bytesNeeded <= modules.size() * sizeof(HMODULE))
+			break;
 
-				/* Get the forwarder string one character at a time because we don't know how long it is */
-				for (UINT_PTR j = 0; !Done; ++j)
-				{
-					/* Get next character */
-					if (!::ReadProcessMemory(hProcess,
-						(LPCVOID)(RemoteModuleBaseVA + ExportFunctionTable[i] + j),
-						&TempChar, sizeof(TempChar), nullptr))
-						goto GRPA_FAIL_JMP;
+		modules.resize(bytesNeeded / sizeof(HMODULE));
+	}
 
-					TempForwardString.push_back(TempChar); // Add it to the string
+	modules.resize(bytesNeeded / sizeof(HMODULE));
 
-					/* If it's NUL we are done */
-					if (TempChar == (CHAR)'\0')
-						Done = TRUE;
-				}
+	for (HMODULE hModule : modules)
+	{
+		if (!RemoteModuleNameMatches(hProcess, hModule, lowerName))
+			continue;
+
+		RemoteModuleLocation location;
+		location.Base = reinterpret_cast<uintptr_t>(hModule);
+
+		if (ReadRemoteImageId(hProcess, location.Base, location.Id))
+		{
+			std::scoped_lock lock(s_remoteCacheMutex);
+			s_remoteModules[lowerName] = location;
+		}
 
-				/* Find the dot that seperates the module name and the function name/ordinal */
-				size_t Dot = TempForwardString.find('.');
-				if (Dot == std::string::npos)
-					goto GRPA_FAIL_JMP;
+		return hModule;
+	}
 
-				/* Temporary variables that hold parts of the forwarder string */
-				std::string RealModuleName, RealFunctionId;
-				RealModuleName = TempForwardString.substr(0, Dot);
-				RealFunctionId = TempForwardString.substr(Dot + 1, std::string::npos);
+	return nullptr;
+}
 
-				HMODULE RealModule = GetRemoteModuleHandle(hProcess, RealModuleName.c_str());
-				FARPROC TempReturn;// Make a temporary variable to hold return value
+static FARPROC ResolveRemoteForwarder(HANDLE hProcess, const std::string& forwarder)
+{
+	// Find the dot that separates the module name and the function name/ordinal
+	const size_t dot = forwarder.find('.');
+	if (dot == std::string::npos || dot + 1 >= forwarder.size())
+		return nullptr;
 
+	HMODULE realModule = GetRemoteModuleHandle(hProcess, forwarder.substr(0, dot).c_str());
+	if (!realModule)
+		return nullptr;
 
-				/* Figure out if the function was exported by name or by ordinal */
-				if (RealFunctionId.at(0) == '#') // Exported by ordinal
-				{
-					UINT RealOrdinal = 0;
-					RealFunctionId.erase(0, 1); // Remove '#' from string
-
-					/* My version of atoi() because I was to lazy to use the real one... */
-					for (char i : RealFunctionId)
-					{
-						if (i >= '0' && i <= '9')
-						{
-							RealOrdinal *= 10;
-							RealOrdinal += i - '0';
-						}
-						else
-							break;
-					}
-
-					/* Recursively call this function to get return value */
-					TempReturn = GetRemoteProcAddress(hProcess, RealModule, nullptr, RealOrdinal, TRUE);
-				}
-				else // Exported by name
-				{
-					/* Recursively call this function to get return value */
-					TempReturn = GetRemoteProcAddress(hProcess, RealModule, RealFunctionId.c_str(), 0, FALSE);
-				}
+	const std::string functionId = forwarder.substr(dot + 1);
+	if (functionId[0] == '#')
+	{
+		const UINT ordinal = static_cast<UINT>(strtoul(functionId.c_str() + 1, nullptr, 10));
+		return GetRemoteProcAddress(hProcess, realModule, nullptr, ordinal, TRUE);
+	}
 
-				/* Give back that memory */
-				delete[] ExportFunctionTable;
-				delete[] ExportNameTable;
-				delete[] ExportOrdinalTable;
+	return GetRemoteProcAddress(hProcess, realModule, functionId.c_str(), 0, FALSE);
+}
 
-				/* Success!!! */
-				return TempReturn;
-			}
-			else // Not Forwarded
-			{
+FARPROC WINAPI GetRemoteProcAddress(HANDLE hProcess, HMODULE hModule, LPCSTR lpProcName, UINT Ordinal, BOOL UseOrdinal)
+{
+	if (lpProcName == nullptr && !UseOrdinal)
+		return nullptr;
 
-				/* Make a temporary variable to hold return value*/
-				FARPROC TempReturn;
+	const uintptr_t base = reinterpret_cast<uintptr_t>(hModule);
 
-				/* NOTE:
-				/* Microsoft's PE/COFF specification says we need to subtract the ordinal base
-				/*from the value in the ordinal table but that seems to always give the wrong function */
-				//TempReturn = (FARPROC)(RemoteModuleBaseVA + ExportFunctionTable[ExportOrdinalTable[i] - ExportTable.Base]);
+	RemoteImageId id;
+	if (!ReadRemoteImageId(hProcess, base, id))
+		return nullptr;
 
-				/* So we do it this way instead */
-				TempReturn = (FARPROC)(RemoteModuleBaseVA + ExportFunctionTable[ExportOrdinalTable[i]]);
+	const auto table = GetRemoteExportTable(hProcess, base, id);
+	if (!table)
+		return nullptr;
 
-				/* Give back that memory */
-				delete[] ExportFunctionTable;
-				delete[] ExportNameTable;
-				delete[] ExportOrdinalTable;
+	int functionIndex = -1;
+	if (UseOrdinal)
+	{
+		if (Ordinal < table->OrdinalBase || Ordinal - table->OrdinalBase >= table->Functions.size())
+			return nullptr;
 
-				/* Success!!! */
-				return TempReturn;
+		functionIndex = static_cast<int>(Ordinal - table->OrdinalBase);
+	}
+	else
+	{
+		auto iter = table->NameToFunction.find(lpProcName);
+		if (iter != table->NameToFunction.end())
+		{
+			functionIndex = iter->second;
+		}
+		else
+		{
+			// Names used to be matched by searching for them in the exported names, keep finding those.
+			for (const auto& [name, index] : table->Names)
+			{
+				if (name.find(lpProcName) != std::string::npos)
+				{
+					functionIndex = index;
+					break;
+				}
 			}
 		}
 
-		/* Wrong function let's try the next... */
+		if (functionIndex < 0)
+			return nullptr;
 	}
 
-	/* Uh Oh... */
-GRPA_FAIL_JMP:
+	auto forwarder = table->Forwarders.find(static_cast<WORD>(functionIndex));
+	if (forwarder != table->Forwarders.end())
+		return ResolveRemoteForwarder(hProcess, forwarder->second);
 
-	/* If we got to the point where we allocated memory we need to give it back */
-	if (ExportFunctionTable != nullptr)
-		delete[] ExportFunctionTable;
-	if (ExportNameTable != nullptr)
-		delete[] ExportNameTable;
-	if (ExportOrdinalTable != nullptr)
-		delete[] ExportOrdinalTable;
-
-	/* Falure... */
-	return nullptr;
+	return reinterpret_cast<FARPROC>(base + table->Functions[functionIndex]);
 }
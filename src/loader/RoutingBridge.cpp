@@ -0,0 +1,1019 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// winsock2 has to come before anything that pulls in windows.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <bcrypt.h>
+#include <compressapi.h>
+
+#include "RoutingBridge.h"
+
+#include <fmt/os.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <unordered_map>
+
+#pragma comment(lib, "ws2_32")
+#pragma comment(lib, "bcrypt")
+#pragma comment(lib, "Cabinet")
+
+namespace mq {
+
+constexpr uint32_t BRIDGE_VERSION = 1;
+constexpr size_t NONCE_SIZE = 16;
+constexpr size_t MAC_SIZE = 32;                             // HMAC-SHA256
+constexpr size_t MAX_FRAME_SIZE = 16 * 1024 * 1024;
+constexpr size_t COMPRESS_THRESHOLD = 512;                  // smaller batches aren't worth it
+constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+constexpr size_t MAX_LINKS = MAXIMUM_WAIT_OBJECTS - 2;      // the wake and listen events take two
+constexpr auto RECONNECT_DELAY = std::chrono::seconds(5);
+constexpr auto DUPLICATE_RECONNECT_DELAY = std::chrono::seconds(60);
+
+enum FrameType : uint8_t
+{
+	FRAME_HELLO = 1,       // BridgeHello followed by the name of the computer
+	FRAME_AUTH = 2,        // HMAC of the nonce of the other end and our instance id
+	FRAME_MESSAGES = 3,    // a batch of messages, each an MQMessageHeader followed by its payload
+};
+
+enum FrameFlags : uint8_t
+{
+	FRAME_COMPRESSED = 0x01,
+};
+
+#pragma pack(push, 1)
+
+struct FrameHeader
+{
+	uint32_t length;       // of the body that follows, as it is on the wire
+	uint8_t  type;
+	uint8_t  flags;
+	uint16_t reserved;
+	uint32_t rawLength;    // of the body before it was compressed
+};
+
+struct BridgeHello
+{
+	uint32_t version;
+	uint64_t instanceId;
+	uint8_t  nonce[NONCE_SIZE];
+};
+
+#pragma pack(pop)
+
+struct RoutingBridge::Link
+{
+	enum class State { Closed, Connecting, Handshake, Up };
+
+	int id = 0;
+	SOCKET socket = INVALID_SOCKET;
+	WSAEVENT event = WSA_INVALID_EVENT;
+	std::string peer;
+	bool inbound = false;
+	State state = State::Closed;
+	std::chrono::steady_clock::time_point retryAt;              // outbound links only
+
+	uint8_t nonce[NONCE_SIZE] = {};
+	bool helloReceived = false;
+	uint64_t peerInstanceId = 0;
+	std::string name;
+
+	// guarded by m_linksMutex, this is the batch that is being collected
+	std::vector<uint8_t> pending;
+	uint32_t pendingMessages = 0;
+
+	// only used by the thread of the bridge
+	std::vector<uint8_t> writeBuffer;
+	size_t writeOffset = 0;
+	bool writable = false;
+	std::vector<uint8_t> readBuffer;
+	std::atomic<bool> readPaused{ false };
+
+	std::atomic<size_t> unsentBytes{ 0 };                      // of writeBuffer
+	std::atomic<size_t> maxQueuedBytes{ 0 };
+	std::atomic<size_t> undeliveredBytes{ 0 };                 // received, waiting for Process
+	std::atomic<uint64_t> dropped{ 0 };
+	std::atomic<uint64_t> rawBytes{ 0 };
+	std::atomic<uint64_t> wireBytes{ 0 };
+	TrafficCounter sent;
+	TrafficCounter received;
+};
+
+struct RoutingBridge::Event
+{
+	enum class Type { LinkUp, LinkDown, Message };
+
+	Type type;
+	int linkId;
+	std::string name;
+	PipeMessagePtr message;
+};
+
+static bool ComputeMac(const std::string& secret, const uint8_t* nonce, uint64_t instanceId, uint8_t* mac)
+{
+	BCRYPT_ALG_HANDLE hAlgorithm = nullptr;
+	if (!BCRYPT_SUCCESS(::BCryptOpenAlgorithmProvider(&hAlgorithm, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG)))
+		return false;
+
+	BCRYPT_HASH_HANDLE hHash = nullptr;
+	const bool success = BCRYPT_SUCCESS(::BCryptCreateHash(hAlgorithm, &hHash, nullptr, 0,
+			reinterpret_cast<PUCHAR>(const_cast<char*>(secret.data())), static_cast<ULONG>(secret.size()), 0))
+		&& BCRYPT_SUCCESS(::BCryptHashData(hHash, const_cast<PUCHAR>(nonce), NONCE_SIZE, 0))
+		&& BCRYPT_SUCCESS(::BCryptHashData(hHash, reinterpret_cast<PUCHAR>(&instanceId), sizeof(instanceId), 0))
+		&& BCRYPT_SUCCESS(::BCryptFinishHash(hHash, mac, MAC_SIZE, 0));
+
+	if (hHash)
+		::BCryptDestroyHash(hHash);
+	::BCryptCloseAlgorithmProvider(hAlgorithm, 0);
+
+	return success;
+}
+
+static std::string FormatAddress(const sockaddr_storage& address)
+{
+	char host[NI_MAXHOST] = {};
+	char port[NI_MAXSERV] = {};
+	if (::getnameinfo(reinterpret_cast<const sockaddr*>(&address), sizeof(address), host, sizeof(host),
+		port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+	{
+		return "(unknown)";
+	}
+
+	return fmt::format("{}:{}", host, port);
+}
+
+RoutingBridge::RoutingBridge(RoutingBridgeConfig config, std::shared_ptr<RoutingBridgeEvents> handler)
+	: m_config(std::move(config))
+	, m_handler(std::move(handler))
+	, m_listenSocket(INVALID_SOCKET)
+{
+}
+
+RoutingBridge::~RoutingBridge()
+{
+	Stop();
+}
+
+bool RoutingBridge::Start()
+{
+	if (m_config.Secret.empty())
+	{
+		SPDLOG_ERROR("Routing bridge is not started, it needs a Secret that is shared by every launcher");
+		return false;
+	}
+
+	WSADATA wsaData;
+	if (int error = ::WSAStartup(MAKEWORD(2, 2), &wsaData); error != 0)
+	{
+		SPDLOG_ERROR("{}", fmt::windows_error(error, "Failed to initialize winsock").what());
+		return false;
+	}
+
+	::BCryptGenRandom(nullptr, reinterpret_cast<PUCHAR>(&m_instanceId), sizeof(m_instanceId), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+
+	char name[MAX_COMPUTERNAME_LENGTH + 1] = {};
+	DWORD nameLength = static_cast<DWORD>(std::size(name));
+	m_name = ::GetComputerNameA(name, &nameLength) ? name : "(unknown)";
+
+	COMPRESSOR_HANDLE compressor = nullptr;
+	DECOMPRESSOR_HANDLE decompressor = nullptr;
+	if (m_config.Compression)
+	{
+		if (!::CreateCompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &compressor)
+			|| !::CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &decompressor))
+		{
+			SPDLOG_WARN("{}", fmt::windows_error(GetLastError(), "Failed to create compressor, routing bridge will send uncompressed").what());
+		}
+	}
+	m_compressor = compressor;
+	m_decompressor = decompressor;
+
+	// the other end might compress even if we don't
+	if (!m_decompressor)
+	{
+		::CreateDecompressor(COMPRESS_ALGORITHM_XPRESS_HUFF, nullptr, &decompressor);
+		m_decompressor = decompressor;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	addrinfo* result = nullptr;
+	if (::getaddrinfo(m_config.ListenAddress.c_str(), std::to_string(m_config.Port).c_str(), &hints, &result) == 0)
+	{
+		SOCKET listenSocket = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+		if (listenSocket != INVALID_SOCKET
+			&& ::bind(listenSocket, result->ai_addr, static_cast<int>(result->ai_addrlen)) == 0
+			&& ::listen(listenSocket, SOMAXCONN) == 0)
+		{
+			m_listenEvent = ::WSACreateEvent();
+			::WSAEventSelect(listenSocket, m_listenEvent, FD_ACCEPT);
+			m_listenSocket = listenSocket;
+
+			SPDLOG_INFO("Routing bridge listening on {}:{}", m_config.ListenAddress, m_config.Port);
+		}
+		else
+		{
+			// we can still connect to the peers that listen
+			SPDLOG_ERROR("{} address={}:{}", fmt::windows_error(::WSAGetLastError(), "Routing bridge failed to listen").what(),
+				m_config.ListenAddress, m_config.Port);
+
+			if (listenSocket != INVALID_SOCKET)
+				::closesocket(listenSocket);
+		}
+
+		::freeaddrinfo(result);
+	}
+
+	{
+		std::scoped_lock lock(m_linksMutex);
+		for (const std::string& peer : m_config.Peers)
+		{
+			if (m_links.size() < MAX_LINKS)
+				m_links.push_back(CreateLink(INVALID_SOCKET, peer, false));
+		}
+	}
+
+	m_wakeEvent = ::WSACreateEvent();
+	m_running = true;
+	m_thread = std::thread([this] { Run(); });
+
+	return true;
+}
+
+void RoutingBridge::Stop()
+{
+	if (!m_running)
+		return;
+
+	m_running = false;
+	::WSASetEvent(m_wakeEvent);
+	m_thread.join();
+
+	{
+		std::scoped_lock lock(m_linksMutex);
+		for (auto& link : m_links)
+		{
+			if (link->socket != INVALID_SOCKET)
+				::closesocket(link->socket);
+			if (link->event != WSA_INVALID_EVENT)
+				::WSACloseEvent(link->event);
+		}
+
+		m_links.clear();
+	}
+
+	if (m_listenSocket != INVALID_SOCKET)
+	{
+		::closesocket(m_listenSocket);
+		::WSACloseEvent(m_listenEvent);
+		m_listenSocket = INVALID_SOCKET;
+	}
+
+	::WSACloseEvent(m_wakeEvent);
+	m_wakeEvent = nullptr;
+
+	if (m_compressor)
+		::CloseCompressor(static_cast<COMPRESSOR_HANDLE>(m_compressor));
+	if (m_decompressor)
+		::CloseDecompressor(static_cast<DECOMPRESSOR_HANDLE>(m_decompressor));
+	m_compressor = m_decompressor = nullptr;
+
+	::WSACleanup();
+}
+
+std::unique_ptr<RoutingBridge::Link> RoutingBridge::CreateLink(uintptr_t socket, const std::string& peer, bool inbound)
+{
+	auto link = std::make_unique<Link>();
+	link->socket = static_cast<SOCKET>(socket);
+	link->peer = peer;
+	link->inbound = inbound;
+	link->retryAt = std::chrono::steady_clock::now();
+	return link;
+}
+
+void RoutingBridge::Run()
+{
+	using fSetThreadDescription = HRESULT(WINAPI*)(HANDLE, PCWSTR);
+	auto SetThreadDescription = (fSetThreadDescription)GetProcAddress(GetModuleHandle("kernel32.dll"), "SetThreadDescription");
+	if (SetThreadDescription)
+		SetThreadDescription(GetCurrentThread(), L"RoutingBridge");
+
+	std::vector<WSAEVENT> events;
+	while (m_running)
+	{
+		// Only this thread adds and removes links, so they can be walked without the lock here
+		events.clear();
+		events.push_back(m_wakeEvent);
+		if (m_listenSocket != INVALID_SOCKET)
+			events.push_back(m_listenEvent);
+
+		auto now = std::chrono::steady_clock::now();
+		auto nextRetry = now + std::chrono::seconds(1);
+		for (auto& link : m_links)
+		{
+			if (link->event != WSA_INVALID_EVENT)
+				events.push_back(link->event);
+			else if (!link->inbound)
+				nextRetry = std::min(nextRetry, link->retryAt);
+		}
+
+		const DWORD timeout = static_cast<DWORD>(std::max<int64_t>(0,
+			std::chrono::duration_cast<std::chrono::milliseconds>(nextRetry - now).count()));
+		::WSAWaitForMultipleEvents(static_cast<DWORD>(events.size()), events.data(), FALSE, timeout, FALSE);
+		::WSAResetEvent(m_wakeEvent);
+
+		if (!m_running)
+			break;
+
+		if (m_listenSocket != INVALID_SOCKET)
+		{
+			WSANETWORKEVENTS networkEvents;
+			if (::WSAEnumNetworkEvents(m_listenSocket, m_listenEvent, &networkEvents) == 0
+				&& (networkEvents.lNetworkEvents & FD_ACCEPT))
+			{
+				Accept();
+			}
+		}
+
+		// links are only appended while this walks them, so go by index
+		for (size_t i = 0; i < m_links.size(); ++i)
+		{
+			Link& link = *m_links[i];
+			if (link.socket == INVALID_SOCKET)
+				continue;
+
+			WSANETWORKEVENTS networkEvents;
+			if (::WSAEnumNetworkEvents(link.socket, link.event, &networkEvents) != 0)
+				continue;
+
+			if (networkEvents.lNetworkEvents & FD_CONNECT)
+			{
+				if (networkEvents.iErrorCode[FD_CONNECT_BIT] != 0)
+				{
+					Close(link, "connect failed");
+					continue;
+				}
+
+				OnConnected(link);
+			}
+
+			if (networkEvents.lNetworkEvents & FD_WRITE)
+				link.writable = true;
+
+			if (networkEvents.lNetworkEvents & (FD_READ | FD_CLOSE))
+				OnReadable(link);
+
+			if ((networkEvents.lNetworkEvents & FD_CLOSE) && link.state != Link::State::Closed)
+				Close(link, "closed by peer");
+		}
+
+		ResumeReading();
+
+		now = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < m_links.size(); ++i)
+		{
+			Link& link = *m_links[i];
+			if (link.state == Link::State::Closed && !link.inbound && link.retryAt <= now)
+				Connect(link);
+			else if (link.state != Link::State::Closed)
+				Flush(link);
+		}
+
+		// closed inbound links are gone for good, the other end will connect again
+		std::scoped_lock lock(m_linksMutex);
+		m_links.erase(std::remove_if(m_links.begin(), m_links.end(),
+			[](const std::unique_ptr<Link>& link) { return link->inbound && link->state == Link::State::Closed; }),
+			m_links.end());
+	}
+}
+
+void RoutingBridge::Connect(Link& link)
+{
+	link.retryAt = std::chrono::steady_clock::now() + RECONNECT_DELAY;
+
+	std::string host = link.peer;
+	std::string port = std::to_string(m_config.Port);
+	if (auto pos = host.rfind(':'); pos != std::string::npos)
+	{
+		port = host.substr(pos + 1);
+		host.resize(pos);
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* result = nullptr;
+	if (::getaddrinfo(host.c_str(), port.c_str(), &hints, &result) != 0)
+	{
+		SPDLOG_WARN("Routing bridge could not resolve peer {}", link.peer);
+		return;
+	}
+
+	SOCKET socket = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (socket == INVALID_SOCKET)
+	{
+		::freeaddrinfo(result);
+		return;
+	}
+
+	// selecting the events makes the socket non-blocking, so this returns before it is connected
+	WSAEVENT event = ::WSACreateEvent();
+	::WSAEventSelect(socket, event, FD_CONNECT | FD_READ | FD_WRITE | FD_CLOSE);
+
+	const int status = ::connect(socket, result->ai_addr, static_cast<int>(result->ai_addrlen));
+	::freeaddrinfo(result);
+
+	if (status != 0 && ::WSAGetLastError() != WSAEWOULDBLOCK)
+	{
+		SPDLOG_WARN("{} peer={}", fmt::windows_error(::WSAGetLastError(), "Routing bridge failed to connect").what(), link.peer);
+		::closesocket(socket);
+		::WSACloseEvent(event);
+		return;
+	}
+
+	std::scoped_lock lock(m_linksMutex);
+	link.id = m_nextLinkId++;
+	link.socket = socket;
+	link.event = event;
+	link.state = Link::State::Connecting;
+}
+
+void RoutingBridge::Accept()
+{
+	sockaddr_storage address = {};
+	int addressLength = sizeof(address);
+
+	SOCKET socket;
+	while ((socket = ::accept(m_listenSocket, reinterpret_cast<sockaddr*>(&address), &addressLength)) != INVALID_SOCKET)
+	{
+		const std::string peer = FormatAddress(address);
+		if (m_links.size() >= MAX_LINKS)
+		{
+			SPDLOG_WARN("Routing bridge refused {}, it already has {} links", peer, m_links.size());
+			::closesocket(socket);
+			continue;
+		}
+
+		auto link = CreateLink(socket, peer, true);
+		link->event = ::WSACreateEvent();
+		::WSAEventSelect(socket, link->event, FD_READ | FD_WRITE | FD_CLOSE);
+
+		Link& added = *link;
+		{
+			std::scoped_lock lock(m_linksMutex);
+			link->id = m_nextLinkId++;
+			m_links.push_back(std::move(link));
+		}
+
+		SPDLOG_INFO("Routing bridge accepted a connection from {}", peer);
+		OnConnected(added);
+
+		addressLength = sizeof(address);
+	}
+}
+
+void RoutingBridge::Close(Link& link, const char* reason)
+{
+	const bool wasUp = link.state == Link::State::Up;
+	SPDLOG_INFO("Routing bridge link {} to {} closed: {}", link.id, link.peer, reason);
+
+	if (link.socket != INVALID_SOCKET)
+		::closesocket(link.socket);
+	if (link.event != WSA_INVALID_EVENT)
+		::WSACloseEvent(link.event);
+
+	{
+		std::scoped_lock lock(m_linksMutex);
+		link.socket = INVALID_SOCKET;
+		link.event = WSA_INVALID_EVENT;
+		link.state = Link::State::Closed;
+		link.pending.clear();
+		link.pendingMessages = 0;
+	}
+
+	link.writeBuffer.clear();
+	link.writeOffset = 0;
+	link.writable = false;
+	link.readBuffer.clear();
+	link.readPaused = false;
+	link.helloReceived = false;
+	link.unsentBytes = 0;
+
+	if (wasUp)
+		PushEvent({ Event::Type::LinkDown, link.id });
+}
+
+void RoutingBridge::OnConnected(Link& link)
+{
+	BOOL noDelay = TRUE;
+	::setsockopt(link.socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+	{
+		std::scoped_lock lock(m_linksMutex);
+		link.state = Link::State::Handshake;
+	}
+
+	link.writable = true;
+	::BCryptGenRandom(nullptr, link.nonce, NONCE_SIZE, BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+
+	std::vector<uint8_t> hello(sizeof(BridgeHello) + m_name.size());
+	BridgeHello* header = reinterpret_cast<BridgeHello*>(hello.data());
+	header->version = BRIDGE_VERSION;
+	header->instanceId = m_instanceId;
+	memcpy(header->nonce, link.nonce, NONCE_SIZE);
+	memcpy(hello.data() + sizeof(BridgeHello), m_name.data(), m_name.size());
+
+	WriteFrame(link, FRAME_HELLO, hello.data(), hello.size());
+}
+
+void RoutingBridge::OnReadable(Link& link)
+{
+	while (link.state != Link::State::Closed)
+	{
+		// parse whatever complete frames we have first, there can be some left over from a pause
+		size_t offset = 0;
+		while (!link.readPaused && link.state != Link::State::Closed
+			&& link.readBuffer.size() - offset >= sizeof(FrameHeader))
+		{
+			FrameHeader header;
+			memcpy(&header, link.readBuffer.data() + offset, sizeof(header));
+			if (header.length > MAX_FRAME_SIZE || header.rawLength > MAX_FRAME_SIZE)
+			{
+				Close(link, "frame is too large");
+				return;
+			}
+
+			if (link.readBuffer.size() - offset - sizeof(FrameHeader) < header.length)
+				break;
+
+			OnFrame(link, header.type, header.flags, link.readBuffer.data() + offset + sizeof(FrameHeader), header.length, header.rawLength);
+			offset += sizeof(FrameHeader) + header.length;
+		}
+
+		if (link.state == Link::State::Closed)
+			return;
+
+		link.readBuffer.erase(link.readBuffer.begin(), link.readBuffer.begin() + offset);
+
+		// leave the rest in the socket until the post office catches up, which stops the other end
+		// once the buffers of tcp fill up
+		if (link.readPaused)
+			return;
+
+		const size_t size = link.readBuffer.size();
+		link.readBuffer.resize(size + READ_CHUNK_SIZE);
+
+		const int received = ::recv(link.socket, reinterpret_cast<char*>(link.readBuffer.data() + size), READ_CHUNK_SIZE, 0);
+		if (received <= 0)
+		{
+			link.readBuffer.resize(size);
+
+			if (received == 0)
+				Close(link, "closed by peer");
+			else if (::WSAGetLastError() != WSAEWOULDBLOCK)
+				Close(link, "read failed");
+
+			return;
+		}
+
+		link.readBuffer.resize(size + received);
+	}
+}
+
+void RoutingBridge::OnFrame(Link& link, uint8_t type, uint8_t flags, const uint8_t* data, size_t length, uint32_t rawLength)
+{
+	switch (type)
+	{
+	case FRAME_HELLO:
+	{
+		if (link.helloReceived || length < sizeof(BridgeHello))
+		{
+			Close(link, "unexpected hello");
+			return;
+		}
+
+		BridgeHello hello;
+		memcpy(&hello, data, sizeof(hello));
+		if (hello.version != BRIDGE_VERSION)
+		{
+			Close(link, "peer has a different version of the bridge");
+			return;
+		}
+
+		if (hello.instanceId == m_instanceId)
+		{
+			Close(link, "connected to itself");
+			link.retryAt = std::chrono::steady_clock::now() + DUPLICATE_RECONNECT_DELAY;
+			return;
+		}
+
+		{
+			std::scoped_lock lock(m_linksMutex);
+			link.name.assign(reinterpret_cast<const char*>(data) + sizeof(BridgeHello), length - sizeof(BridgeHello));
+		}
+
+		link.helloReceived = true;
+		link.peerInstanceId = hello.instanceId;
+
+		// Our instance id is part of the proof, so a proof can't be reflected back at the one that
+		// sent the nonce without claiming to be it, which fails the check above
+		uint8_t mac[MAC_SIZE];
+		if (!ComputeMac(m_config.Secret, hello.nonce, m_instanceId, mac))
+		{
+			Close(link, "failed to compute the proof of the secret");
+			return;
+		}
+
+		WriteFrame(link, FRAME_AUTH, mac, MAC_SIZE);
+		break;
+	}
+
+	case FRAME_AUTH:
+	{
+		uint8_t expected[MAC_SIZE];
+		if (!link.helloReceived || link.state != Link::State::Handshake || length != MAC_SIZE
+			|| !ComputeMac(m_config.Secret, link.nonce, link.peerInstanceId, expected))
+		{
+			Close(link, "unexpected authentication");
+			return;
+		}
+
+		uint8_t difference = 0;
+		for (size_t i = 0; i < MAC_SIZE; ++i)
+			difference |= expected[i] ^ data[i];
+
+		if (difference != 0)
+		{
+			SPDLOG_WARN("Routing bridge link from {} does not know the secret", link.peer);
+			Close(link, "authentication failed");
+			return;
+		}
+
+		// Both launchers might list each other as peers. Both ends keep the link that was started by
+		// the launcher with the lower instance id, so they close the same one.
+		const uint64_t initiator = link.inbound ? link.peerInstanceId : m_instanceId;
+		for (auto& other : m_links)
+		{
+			if (other.get() == &link || other->state != Link::State::Up || other->peerInstanceId != link.peerInstanceId)
+				continue;
+
+			const uint64_t otherInitiator = other->inbound ? other->peerInstanceId : m_instanceId;
+			if (otherInitiator <= initiator)
+			{
+				Close(link, "there is already a link to this launcher");
+				link.retryAt = std::chrono::steady_clock::now() + DUPLICATE_RECONNECT_DELAY;
+				return;
+			}
+
+			Close(*other, "replaced by a link to the same launcher");
+			other->retryAt = std::chrono::steady_clock::now() + DUPLICATE_RECONNECT_DELAY;
+		}
+
+		{
+			std::scoped_lock lock(m_linksMutex);
+			link.state = Link::State::Up;
+		}
+
+		SPDLOG_INFO("Routing bridge link {} to {} ({}) is up", link.id, link.name, link.peer);
+		PushEvent({ Event::Type::LinkUp, link.id, link.name });
+		break;
+	}
+
+	case FRAME_MESSAGES:
+	{
+		if (link.state != Link::State::Up)
+		{
+			Close(link, "messages before authentication");
+			return;
+		}
+
+		std::vector<uint8_t> decompressed;
+		if (flags & FRAME_COMPRESSED)
+		{
+			decompressed.resize(rawLength);
+
+			SIZE_T decompressedSize = 0;
+			if (!m_decompressor || !::Decompress(static_cast<DECOMPRESSOR_HANDLE>(m_decompressor), data, length,
+				decompressed.data(), decompressed.size(), &decompressedSize) || decompressedSize != rawLength)
+			{
+				Close(link, "failed to decompress a batch");
+				return;
+			}
+
+			data = decompressed.data();
+			length = decompressed.size();
+		}
+
+		size_t offset = 0;
+		uint32_t messages = 0;
+		while (length - offset >= sizeof(MQMessageHeader))
+		{
+			MQMessageHeader header;
+			memcpy(&header, data + offset, sizeof(header));
+			offset += sizeof(header);
+
+			if (length - offset < header.messageLength)
+			{
+				Close(link, "batch is truncated");
+				return;
+			}
+
+			link.undeliveredBytes += header.messageLength;
+			PushEvent({ Event::Type::Message, link.id, {},
+				std::make_unique<PipeMessage>(header, data + offset, header.messageLength) });
+
+			offset += header.messageLength;
+			++messages;
+		}
+
+		link.received.Add(length, messages);
+
+		if (link.undeliveredBytes > m_config.MaxQueuedBytes)
+			link.readPaused = true;
+		break;
+	}
+
+	default:
+		Close(link, "unknown frame");
+		break;
+	}
+}
+
+void RoutingBridge::WriteFrame(Link& link, uint8_t type, const void* data, size_t length)
+{
+	WriteFrame(link, type, 0, data, length, static_cast<uint32_t>(length));
+}
+
+void RoutingBridge::WriteFrame(Link& link, uint8_t type, uint8_t flags, const void* data, size_t length, uint32_t rawLength)
+{
+	FrameHeader header = {};
+	header.length = static_cast<uint32_t>(length);
+	header.type = type;
+	header.flags = flags;
+	header.rawLength = rawLength;
+
+	const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(&header);
+	link.writeBuffer.insert(link.writeBuffer.end(), headerBytes, headerBytes + sizeof(header));
+	link.writeBuffer.insert(link.writeBuffer.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + length);
+	link.unsentBytes = link.writeBuffer.size() - link.writeOffset;
+}
+
+void RoutingBridge::Flush(Link& link)
+{
+	while (link.writable && link.state != Link::State::Closed)
+	{
+		if (link.writeOffset == link.writeBuffer.size())
+		{
+			link.writeBuffer.clear();
+			link.writeOffset = 0;
+
+			if (link.state != Link::State::Up)
+				return;
+
+			// the next batch is everything that was queued while the last one was written
+			std::vector<uint8_t> batch;
+			uint32_t messages = 0;
+			{
+				std::scoped_lock lock(m_linksMutex);
+				batch.swap(link.pending);
+				std::swap(messages, link.pendingMessages);
+			}
+
+			if (batch.empty())
+				return;
+
+			link.sent.Add(batch.size(), messages);
+			link.rawBytes += batch.size();
+
+			bool compressed = false;
+			if (m_compressor && batch.size() >= COMPRESS_THRESHOLD)
+			{
+				// only worth sending compressed if it got smaller, so the output never has to be bigger
+				std::vector<uint8_t> output(batch.size());
+				SIZE_T compressedSize = 0;
+				if (::Compress(static_cast<COMPRESSOR_HANDLE>(m_compressor), batch.data(), batch.size(),
+					output.data(), output.size(), &compressedSize) && compressedSize < batch.size())
+				{
+					WriteFrame(link, FRAME_MESSAGES, FRAME_COMPRESSED, output.data(), compressedSize, static_cast<uint32_t>(batch.size()));
+					link.wireBytes += compressedSize;
+					compressed = true;
+				}
+			}
+
+			if (!compressed)
+			{
+				WriteFrame(link, FRAME_MESSAGES, batch.data(), batch.size());
+				link.wireBytes += batch.size();
+			}
+		}
+
+		const int sent = ::send(link.socket, reinterpret_cast<const char*>(link.writeBuffer.data() + link.writeOffset),
+			static_cast<int>(std::min<size_t>(link.writeBuffer.size() - link.writeOffset, INT_MAX)), 0);
+		if (sent == SOCKET_ERROR)
+		{
+			// FD_WRITE tells us when there is room again
+			if (::WSAGetLastError() == WSAEWOULDBLOCK)
+				link.writable = false;
+			else
+				Close(link, "write failed");
+
+			return;
+		}
+
+		link.writeOffset += sent;
+		link.unsentBytes = link.writeBuffer.size() - link.writeOffset;
+	}
+}
+
+void RoutingBridge::ResumeReading()
+{
+	for (size_t i = 0; i < m_links.size(); ++i)
+	{
+		Link& link = *m_links[i];
+		if (link.readPaused && link.undeliveredBytes <= m_config.MaxQueuedBytes / 2)
+		{
+			link.readPaused = false;
+
+			// the data that was left in the socket won't signal again until we read it
+			OnReadable(link);
+		}
+	}
+}
+
+void RoutingBridge::PushEvent(Event&& event)
+{
+	bool wasEmpty;
+	{
+		std::scoped_lock lock(m_eventsMutex);
+		wasEmpty = m_events.empty();
+		m_events.push_back(std::move(event));
+	}
+
+	if (wasEmpty)
+		m_handler->OnRequestProcessEvents();
+}
+
+void RoutingBridge::Process()
+{
+	std::vector<Event> events;
+	{
+		std::scoped_lock lock(m_eventsMutex);
+		events.swap(m_events);
+	}
+
+	if (events.empty())
+		return;
+
+	std::unordered_map<int, size_t> delivered;
+	for (Event& event : events)
+	{
+		switch (event.type)
+		{
+		case Event::Type::LinkUp:
+			m_handler->OnLinkUp(event.linkId, event.name);
+			break;
+
+		case Event::Type::LinkDown:
+			m_handler->OnLinkDown(event.linkId);
+			break;
+
+		case Event::Type::Message:
+			delivered[event.linkId] += event.message->size();
+			m_handler->OnLinkMessage(event.linkId, std::move(event.message));
+			break;
+		}
+	}
+
+	bool resume = false;
+	{
+		std::scoped_lock lock(m_linksMutex);
+		for (auto& link : m_links)
+		{
+			auto iter = delivered.find(link->id);
+			if (iter == delivered.end())
+				continue;
+
+			link->undeliveredBytes -= std::min<size_t>(iter->second, link->undeliveredBytes);
+			resume |= link->readPaused;
+		}
+	}
+
+	if (resume)
+		::WSASetEvent(m_wakeEvent);
+}
+
+bool RoutingBridge::SendMessage(int linkId, const PipeMessage& message)
+{
+	const MQMessageHeader* header = message.GetHeader();
+	if (header == nullptr || message.size() > MAX_FRAME_SIZE / 2)
+		return false;
+
+	bool wasEmpty = false;
+	{
+		std::scoped_lock lock(m_linksMutex);
+		auto iter = std::find_if(m_links.begin(), m_links.end(),
+			[linkId](const std::unique_ptr<Link>& link) { return link->id == linkId; });
+		if (iter == m_links.end() || (*iter)->state != Link::State::Up)
+			return false;
+
+		Link& link = **iter;
+		const size_t queued = link.pending.size() + link.unsentBytes;
+		if (queued + sizeof(MQMessageHeader) + message.size() > m_config.MaxQueuedBytes)
+		{
+			++link.dropped;
+			return false;
+		}
+
+		wasEmpty = link.pending.empty();
+
+		// the header goes as it is, so requests and replies keep their mode and sequence ids
+		MQMessageHeader copy = *header;
+		copy.messageLength = static_cast<uint32_t>(message.size());
+
+		const uint8_t* headerBytes = reinterpret_cast<const uint8_t*>(&copy);
+		const uint8_t* data = static_cast<const uint8_t*>(message.get());
+		link.pending.insert(link.pending.end(), headerBytes, headerBytes + sizeof(copy));
+		link.pending.insert(link.pending.end(), data, data + message.size());
+		++link.pendingMessages;
+
+		link.maxQueuedBytes = std::max<size_t>(link.maxQueuedBytes, queued + sizeof(copy) + message.size());
+	}
+
+	// a batch that already had messages is going to be flushed anyway
+	if (wasEmpty)
+		::WSASetEvent(m_wakeEvent);
+
+	return true;
+}
+
+std::vector<int> RoutingBridge::GetLinkIds() const
+{
+	std::vector<int> linkIds;
+
+	std::scoped_lock lock(m_linksMutex);
+	for (const auto& link : m_links)
+	{
+		if (link->state == Link::State::Up)
+			linkIds.push_back(link->id);
+	}
+
+	return linkIds;
+}
+
+std::vector<RoutingLinkStats> RoutingBridge::GetLinkStats() const
+{
+	std::vector<RoutingLinkStats> stats;
+
+	std::scoped_lock lock(m_linksMutex);
+	stats.reserve(m_links.size());
+	for (const auto& link : m_links)
+	{
+		RoutingLinkStats& link_stats = stats.emplace_back();
+		link_stats.LinkId = link->id;
+		link_stats.Peer = link->peer;
+		link_stats.Name = link->name;
+		link_stats.Inbound = link->inbound;
+		link_stats.Connected = link->state == Link::State::Up;
+
+		link_stats.MessagesSent = link->sent.GetMessages();
+		link_stats.BytesSent = link->sent.GetBytes();
+		link_stats.SentMessageRate = link->sent.GetMessageRate();
+		link_stats.SentByteRate = link->sent.GetByteRate();
+
+		link_stats.MessagesReceived = link->received.GetMessages();
+		link_stats.BytesReceived = link->received.GetBytes();
+		link_stats.ReceivedMessageRate = link->received.GetMessageRate();
+		link_stats.ReceivedByteRate = link->received.GetByteRate();
+
+		if (const uint64_t raw = link->rawBytes; raw > 0)
+			link_stats.CompressionRatio = static_cast<float>(link->wireBytes.load()) / raw;
+
+		link_stats.SendQueueBytes = link->pending.size() + link->unsentBytes;
+		link_stats.MaxSendQueueBytes = link->maxQueuedBytes;
+		link_stats.MessagesDropped = link->dropped;
+		link_stats.ReadPaused = link->readPaused;
+	}
+
+	return stats;
+}
+
+} // namespace mq
@@ -0,0 +1,165 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "routing/NamedPipes.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mq {
+
+//============================================================================
+// Links the post offices of launchers on other machines over TCP. Every launcher listens for
+// the others and connects to the peers in its ini, and both ends of a link prove that they know
+// the shared secret before anything is routed over it. Messages queued for a link are sent in
+// batches (whatever was queued while the last batch was being written), and batches over a
+// threshold are compressed.
+//
+// The sockets belong to a thread of the bridge. Everything that comes in is queued, and handed to
+// the events handler from Process, which has to be called by the thread of the post office.
+
+struct RoutingBridgeConfig
+{
+	std::string ListenAddress = "0.0.0.0";
+	uint16_t Port = 7788;
+	std::vector<std::string> Peers;              // host:port, or host for the default port
+	std::string Secret;
+	bool Compression = true;
+	size_t MaxQueuedBytes = 4 * 1024 * 1024;     // per link, in each direction
+};
+
+struct RoutingLinkStats
+{
+	int LinkId = 0;
+	std::string Peer;                            // the address of the other end
+	std::string Name;                            // the computer name it identified itself with
+	bool Inbound = false;
+	bool Connected = false;
+
+	uint64_t MessagesSent = 0;
+	uint64_t BytesSent = 0;                      // before compression
+	float SentMessageRate = 0;
+	float SentByteRate = 0;
+
+	uint64_t MessagesReceived = 0;
+	uint64_t BytesReceived = 0;
+	float ReceivedMessageRate = 0;
+	float ReceivedByteRate = 0;
+
+	// How much of the uncompressed batches was put on the wire, 1 without compression
+	float CompressionRatio = 1.0f;
+
+	size_t SendQueueBytes = 0;
+	size_t MaxSendQueueBytes = 0;
+	uint64_t MessagesDropped = 0;                // refused because the send queue was full
+	bool ReadPaused = false;                     // the post office hasn't kept up with what came in
+};
+
+class RoutingBridgeEvents
+{
+public:
+	virtual ~RoutingBridgeEvents() = default;
+
+	// The link was authenticated and can be sent to.
+	virtual void OnLinkUp(int linkId, const std::string& name) = 0;
+
+	// The link was closed. Only called for links that were up.
+	virtual void OnLinkDown(int linkId) = 0;
+
+	virtual void OnLinkMessage(int linkId, PipeMessagePtr&& message) = 0;
+
+	// Called from the thread of the bridge when there is something for Process.
+	virtual void OnRequestProcessEvents() = 0;
+};
+
+class RoutingBridge
+{
+public:
+	RoutingBridge(RoutingBridgeConfig config, std::shared_ptr<RoutingBridgeEvents> handler);
+	~RoutingBridge();
+
+	RoutingBridge(const RoutingBridge&) = delete;
+	RoutingBridge& operator=(const RoutingBridge&) = delete;
+
+	bool Start();
+	void Stop();
+
+	// Hands the events that came in since the last call to the handler.
+	void Process();
+
+	// Queues a copy of the message for the link. Returns false if the link isn't up, or if the
+	// other end has fallen so far behind that its send queue is full.
+	bool SendMessage(int linkId, const PipeMessage& message);
+
+	// The links that are up.
+	std::vector<int> GetLinkIds() const;
+
+	std::vector<RoutingLinkStats> GetLinkStats() const;
+
+private:
+	struct Link;
+	struct Event;
+
+	void Run();
+
+	std::unique_ptr<Link> CreateLink(uintptr_t socket, const std::string& peer, bool inbound);
+	void Connect(Link& link);
+	void Accept();
+	void Close(Link& link, const char* reason);
+
+	void OnConnected(Link& link);
+	void OnReadable(Link& link);
+	void OnFrame(Link& link, uint8_t type, uint8_t flags, const uint8_t* data, size_t length, uint32_t rawLength);
+	void Flush(Link& link);
+	void WriteFrame(Link& link, uint8_t type, const void* data, size_t length);
+	void WriteFrame(Link& link, uint8_t type, uint8_t flags, const void* data, size_t length, uint32_t rawLength);
+
+	void PushEvent(Event&& event);
+	void ResumeReading();
+
+	RoutingBridgeConfig m_config;
+	std::shared_ptr<RoutingBridgeEvents> m_handler;
+
+	std::thread m_thread;
+	std::atomic<bool> m_running = false;
+	void* m_wakeEvent = nullptr;
+	uintptr_t m_listenSocket;
+	void* m_listenEvent = nullptr;
+
+	// random, sent in the handshake so a launcher can tell that it connected to itself, and both
+	// ends of two links between the same launchers agree on which to keep
+	uint64_t m_instanceId = 0;
+	std::string m_name;
+
+	// the links are created and destroyed by the thread of the bridge, other threads only look at
+	// them while holding the mutex
+	mutable std::mutex m_linksMutex;
+	std::vector<std::unique_ptr<Link>> m_links;
+	int m_nextLinkId = 1;
+
+	std::mutex m_eventsMutex;
+	std::vector<Event> m_events;
+
+	void* m_compressor = nullptr;
+	void* m_decompressor = nullptr;
+};
+
+} // namespace mq
@@ -35,6 +35,9 @@ struct AutoLoginSettings
 	int CharSelectDelay = 3;
 	int ConnectRetries = 5;
 	int ClientLaunchDelay = 3;
+	int ClientLaunchConcurrency = 4;
+	int ClientLaunchTimeout = 90;
+	int ClientLaunchMaxLoad = 90;
 	bool ShowHiddenCharacters = true;
 	bool DetectInformation = true;
 };
@@ -25,9 +25,11 @@
 
 #include <wil/resource.h>
 #include <wil/registry.h>
+#include <chrono>
 #include <filesystem>
 #include <regex>
 #include <random>
+#include <unordered_map>
 
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
@@ -404,6 +406,10 @@ static std::string ReadText(sqlite3_stmt* stmt, int position)
 }
 
 static std::map<int, std::shared_ptr<WithDb>> s_connections;
+
+// Set after every write, so the next ReadDataVersion doesn't wait for its interval to see it
+static bool s_dataVersionStale = true;
+
 class WithDb
 {
 public:
@@ -431,6 +437,9 @@ public:
 
 	~WithDb()
 	{
+		for (const auto& [_, statement] : m_statements)
+			sqlite3_finalize(statement.stmt);
+
 		if (m_db != nullptr) sqlite3_close(m_db);
 	}
 
@@ -440,7 +449,58 @@ public:
 	static T Query(const int flags, const std::string& query, const DoQuery<T>& action)
 	{
 		const auto connection = Get(flags);
-		return WithStatement<T>(connection->m_db, query).Execute(action);
+		if ((flags & SQLITE_OPEN_READWRITE) != 0)
+			s_dataVersionStale = true;
+
+		return WithStatement<T>(connection.get(), query).Execute(action);
+	}
+
+	// The same handful of queries run over and over (every lookup, every setting read), so the
+	// prepared statements are kept per connection and reset between uses. A query that is already
+	// in use (a nested query over the same results) gets a statement of its own.
+	sqlite3_stmt* AcquireStatement(const std::string& query)
+	{
+		if (m_db == nullptr)
+			return nullptr;
+
+		auto iter = m_statements.find(query);
+		if (iter != m_statements.end() && !iter->second.inUse)
+		{
+			iter->second.inUse = true;
+			return iter->second.stmt;
+		}
+
+		sqlite3_stmt* stmt = nullptr;
+		if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			SPDLOG_ERROR("{}", sqlite3_errmsg(m_db));
+			sqlite3_finalize(stmt);
+			return nullptr;
+		}
+
+		if (iter == m_statements.end())
+			m_statements.emplace(query, CachedStatement{ stmt, true });
+
+		return stmt;
+	}
+
+	void ReleaseStatement(sqlite3_stmt* stmt)
+	{
+		if (stmt == nullptr)
+			return;
+
+		for (auto& [_, statement] : m_statements)
+		{
+			if (statement.stmt == stmt)
+			{
+				sqlite3_reset(stmt);
+				sqlite3_clear_bindings(stmt);
+				statement.inUse = false;
+				return;
+			}
+		}
+
+		sqlite3_finalize(stmt);
 	}
 
 	WithDb(const WithDb&) = delete;
@@ -463,19 +523,26 @@ public:
 	}
 
 private:
+	struct CachedStatement
+	{
+		sqlite3_stmt* stmt;
+		bool inUse;
+	};
+
 	template <typename T>
 	class WithStatement
 	{
 	public:
-		WithStatement(sqlite3* db, const std::string& query) : m_db(db), m_stmt(nullptr)
+		WithStatement(WithDb* connection, const std::string& query)
+			: m_connection(connection)
+			, m_db(connection->m_db)
+			, m_stmt(connection->AcquireStatement(query))
 		{
-			if (sqlite3_prepare_v2(m_db, query.c_str(), -1, &m_stmt, nullptr) != SQLITE_OK)
-				SPDLOG_ERROR("{}", sqlite3_errmsg(m_db));
 		}
 
 		~WithStatement()
 		{
-			sqlite3_finalize(m_stmt);
+			m_connection->ReleaseStatement(m_stmt);
 		}
 
 		T Execute(const DoQuery<T>& action) const
@@ -489,27 +556,29 @@ private:
 		WithStatement& operator=(WithStatement&&) = delete;
 
 	private:
+		WithDb* m_connection;
 		sqlite3* m_db;
 		sqlite3_stmt* m_stmt;
 	};
 
 	sqlite3* m_db = nullptr;
+	std::unordered_map<std::string, CachedStatement> m_statements;
 };
 
 login::db::StatementHelper::StatementHelper(
 	const std::shared_ptr<WithDb>& db,
 	const std::string& query,
 	const std::function<void(sqlite3_stmt*, sqlite3*)>& bind)
-	: m_db(db->GetDB())
-	, m_stmt(nullptr)
+	: m_connection(db)
+	, m_db(db->GetDB())
+	, m_stmt(db->AcquireStatement(query))
 {
-	sqlite3_prepare_v2(m_db, query.c_str(), -1, &m_stmt, nullptr);
 	bind(m_stmt, m_db);
 }
 
 login::db::StatementHelper::~StatementHelper()
 {
-	sqlite3_finalize(m_stmt);
+	m_connection->ReleaseStatement(m_stmt);
 }
 
 bool login::db::StatementHelper::Step() const
@@ -540,16 +609,33 @@ struct HashParams
 	uint32_t Parallelism = 1;
 };
 
+// Every Cache::Read checks the data version, which is a statement of its own. Writes from this
+// process mark it stale, so only changes made by other processes (the loader and every client share
+// the file) wait for the interval to be noticed.
+static constexpr auto DATA_VERSION_INTERVAL = std::chrono::milliseconds(250);
+
 int login::db::ReadDataVersion()
 {
-	return WithDb::Query<int>(SQLITE_OPEN_READONLY,
-		"PRAGMA data_version",
-		[](sqlite3_stmt* stmt, sqlite3*)
-		{
-			if (sqlite3_step(stmt) == SQLITE_ROW)
-				return sqlite3_column_int(stmt, 0);
-			return 0;
-		});
+	static int s_dataVersion = 0;
+	static std::chrono::steady_clock::time_point s_dataVersionTime;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (s_dataVersionStale || now - s_dataVersionTime >= DATA_VERSION_INTERVAL)
+	{
+		s_dataVersion = WithDb::Query<int>(SQLITE_OPEN_READONLY,
+			"PRAGMA data_version",
+			[](sqlite3_stmt* stmt, sqlite3*)
+			{
+				if (sqlite3_step(stmt) == SQLITE_ROW)
+					return sqlite3_column_int(stmt, 0);
+				return 0;
+			});
+
+		s_dataVersionStale = false;
+		s_dataVersionTime = now;
+	}
+
+	return s_dataVersion;
 }
 
 static std::string CreateCompany()
@@ -784,9 +870,23 @@ void login::db::WriteSetting(std::string_view key, std::string_view value, std::
 	}
 }
 
+// settings are read far more often than they change, so they are kept until the data version moves
+static std::unordered_map<std::string, std::optional<std::string>> s_settings;
+static int s_settingsVersion = -1;
+
 std::optional<std::string> login::db::ReadSetting(std::string_view key)
 {
-	return WithDb::Query<std::optional<std::string>>(SQLITE_OPEN_READONLY,
+	if (const int version = ReadDataVersion(); version != s_settingsVersion)
+	{
+		s_settings.clear();
+		s_settingsVersion = version;
+	}
+
+	std::string keyString(key);
+	if (auto iter = s_settings.find(keyString); iter != s_settings.end())
+		return iter->second;
+
+	auto value = WithDb::Query<std::optional<std::string>>(SQLITE_OPEN_READONLY,
 		R"(SELECT value FROM settings WHERE key = ?)",
 		[key](sqlite3_stmt* stmt, sqlite3* db) -> std::optional<std::string>
 		{
@@ -797,6 +897,9 @@ std::optional<std::string> login::db::ReadSetting(std::string_view key)
 
 			return {};
 		});
+
+	s_settings.emplace(std::move(keyString), value);
+	return value;
 }
 
 void login::db::DeleteSetting(std::string_view key)
@@ -2616,5 +2719,8 @@ bool login::db::InitDatabase(const std::string& path)
 void login::db::ShutdownDatabase()
 {
 	s_connections.clear();
+	s_settings.clear();
+	s_settingsVersion = -1;
+	s_dataVersionStale = true;
 }
 
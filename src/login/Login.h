@@ -175,6 +175,7 @@ public:
 	StatementHelper& operator=(StatementHelper&&) = delete;
 
 private:
+	std::shared_ptr<WithDb> m_connection;
 	sqlite3* m_db;
 	sqlite3_stmt* m_stmt;
 };
@@ -31,6 +31,7 @@
 
 #include <spdlog/spdlog.h>
 #include <wil/resource.h>
+#include <atomic>
 #include <filesystem>
 
 #include <dbghelp.h>
@@ -95,19 +96,146 @@ static crashpad::StringAnnotation<36> buildCrashIdAnnotation("crashId");
 
 static crashpad::StringAnnotation<MAX_STRING> s_currentCommandAnnotation("mq.command");
 static crashpad::StringAnnotation<MAX_STRING> s_currentMacroData("mq.macro_data");
+static crashpad::StringAnnotation<8192> s_breadcrumbsAnnotation("mq.breadcrumbs");
 
 static std::string s_sessionUuid;
 
 static LONG WINAPI OurCrashHandler(EXCEPTION_POINTERS* ex);
+static LONG WINAPI OurSilentCrashHandler(EXCEPTION_POINTERS* ex);
 static void ReplaceCrashpadUnhandledExceptionFilter()
 {
-	if (!gEnableSilentCrashpad)
+	// Crashpad handler will install its own unhandled exception filter. We want to go first
+	// and issue a prompt first (or just fill in the breadcrumbs if we're silent), so reinstall
+	// our handler and save the crashpad handler so we can invoke it after our own handler.
+	lpCrashpadTopLevelExceptionFilter = SetUnhandledExceptionFilter(
+		gEnableSilentCrashpad ? OurSilentCrashHandler : OurCrashHandler);
+}
+
+//============================================================================
+// Breadcrumbs
+//
+// Commands and macro data are recorded on every call, so recording one only stores a pointer, the
+// length and the time into a ring. The entries are written without locks, and the sequence of an
+// entry is only published once the rest of it has been written.
+
+static constexpr uint64_t NumCrashBreadcrumbs = 16;
+static constexpr size_t MaxBreadcrumbLineText = 256;
+
+struct CrashBreadcrumb
+{
+	std::atomic<uint64_t> sequence{ 0 };         // 0 while the entry is unused or being written
+	std::atomic<bool> active{ false };
+	const char* text = nullptr;
+	uint32_t length = 0;
+	CrashBreadcrumbKind kind = CrashBreadcrumbKind::Command;
+	uint64_t timestamp = 0;
+};
+
+static CrashBreadcrumb s_breadcrumbs[NumCrashBreadcrumbs];
+static std::atomic<uint64_t> s_nextBreadcrumb{ 1 };
+
+uint64_t CrashHandler_BeginBreadcrumb(CrashBreadcrumbKind kind, std::string_view text)
+{
+	const uint64_t sequence = s_nextBreadcrumb.fetch_add(1, std::memory_order_relaxed);
+	CrashBreadcrumb& crumb = s_breadcrumbs[sequence % NumCrashBreadcrumbs];
+
+	crumb.sequence.store(0, std::memory_order_relaxed);
+	crumb.text = text.data();
+	crumb.length = static_cast<uint32_t>(text.size());
+	crumb.kind = kind;
+	crumb.timestamp = ::GetTickCount64();
+	crumb.active.store(true, std::memory_order_relaxed);
+	crumb.sequence.store(sequence, std::memory_order_release);
+
+	return sequence;
+}
+
+void CrashHandler_EndBreadcrumb(uint64_t breadcrumb)
+{
+	// If the ring wrapped around since, the entry already belongs to a newer breadcrumb.
+	CrashBreadcrumb& crumb = s_breadcrumbs[breadcrumb % NumCrashBreadcrumbs];
+	if (crumb.sequence.load(std::memory_order_acquire) == breadcrumb)
+		crumb.active.store(false, std::memory_order_relaxed);
+}
+
+// The text of a breadcrumb that ended may already have been freed, and macro data is parsed in
+// place, so reading it can fault or find something else by now. Returns the number of bytes copied.
+static size_t CopyBreadcrumbText(char* dest, size_t destSize, const char* text, size_t length)
+{
+	__try
 	{
-		// Crashpad handler will install its own unhandled exception filter. We want to go first
-		// and issue a prompt first, so reinstall our handler and save the crashpad handler
-		// so we can invoke it after our own handler.
-		lpCrashpadTopLevelExceptionFilter = SetUnhandledExceptionFilter(OurCrashHandler);
+		const size_t copied = strnlen(text, std::min(length, destSize - 1));
+		memcpy(dest, text, copied);
+		dest[copied] = 0;
+		return copied;
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER)
+	{
+		dest[0] = 0;
+		return 0;
+	}
+}
+
+// Copies the most recent breadcrumbs into the annotations of the crash report. We may have crashed
+// from a stack overflow, so the buffers aren't on the stack.
+static void MaterializeCrashBreadcrumbs()
+{
+	if (!gEnableCrashSubmissions)
+		return;
+
+	static char s_text[MAX_STRING];
+	static char s_lines[8192];
+
+	const uint64_t next = s_nextBreadcrumb.load(std::memory_order_acquire);
+	const uint64_t now = ::GetTickCount64();
+	const uint64_t oldest = next > NumCrashBreadcrumbs ? next - NumCrashBreadcrumbs : 1;
+
+	bool foundCommand = false;
+	bool foundMacroData = false;
+	size_t linesLength = 0;
+	s_lines[0] = 0;
+
+	s_currentCommandAnnotation.Clear();
+	s_currentMacroData.Clear();
+
+	// Newest first. The innermost command and macro data that were still running are the ones that
+	// were going on when we crashed.
+	for (uint64_t sequence = next - 1; sequence >= oldest && sequence != 0; --sequence)
+	{
+		const CrashBreadcrumb& crumb = s_breadcrumbs[sequence % NumCrashBreadcrumbs];
+		if (crumb.sequence.load(std::memory_order_acquire) != sequence)
+			continue;
+
+		const bool active = crumb.active.load(std::memory_order_relaxed);
+		const bool isCommand = crumb.kind == CrashBreadcrumbKind::Command;
+		const size_t length = CopyBreadcrumbText(s_text, sizeof(s_text), crumb.text, crumb.length);
+
+		if (active && isCommand && !foundCommand)
+		{
+			s_currentCommandAnnotation.Set(base::StringPiece(s_text, length));
+			foundCommand = true;
+		}
+		else if (active && !isCommand && !foundMacroData)
+		{
+			s_currentMacroData.Set(base::StringPiece(s_text, length));
+			foundMacroData = true;
+		}
+
+		const int written = _snprintf_s(s_lines + linesLength, sizeof(s_lines) - linesLength, _TRUNCATE,
+			"%llums ago %s%s: %.*s
+",
+			now - crumb.timestamp, isCommand ? "command" : "macro data", active ? " (running)" : "",
+			static_cast<int>(std::min(length, MaxBreadcrumbLineText)), s_text);
+		if (written < 0)
+		{
+			linesLength = strlen(s_lines);
+			break;
+		}
+
+		linesLength += written;
 	}
+
+	s_breadcrumbsAnnotation.Set(base::StringPiece(s_lines, linesLength));
 }
 
 bool ShouldUploadCrash()
@@ -299,6 +427,8 @@ void SetCrashId()
 
 int MQ2CrashHandler(EXCEPTION_POINTERS* ex, const char* description)
 {
+	MaterializeCrashBreadcrumbs();
+
 	SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES);
 	HANDLE hProcess = GetCurrentProcess();
 	DWORD processID = GetCurrentProcessId();
@@ -440,6 +570,19 @@ LONG WINAPI OurCrashHandler(EXCEPTION_POINTERS* ex)
 	}
 }
 
+LONG WINAPI OurSilentCrashHandler(EXCEPTION_POINTERS* ex)
+{
+	__try
+	{
+		MaterializeCrashBreadcrumbs();
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER)
+	{
+	}
+
+	return lpCrashpadTopLevelExceptionFilter(ex);
+}
+
 // this is the effectively the first thing that we do when we attach to EQ.
 void InstallUnhandledExceptionFilter()
 {
@@ -500,28 +643,6 @@ void CrashHandler_Startup()
 	SetCrashId();
 }
 
-void CrashHandler_SetLastCommand(const char* command)
-{
-	if (gEnableCrashSubmissions)
-	{
-		if (!command || !command[0])
-			s_currentCommandAnnotation.Clear();
-		else
-			s_currentCommandAnnotation.Set(command);
-	}
-}
-
-void CrashHandler_SetLastMacroData(const char* macroData)
-{
-	if (gEnableCrashSubmissions)
-	{
-		if (!macroData || !macroData[0])
-			s_currentMacroData.Clear();
-		else
-			s_currentMacroData.Set(macroData);
-	}
-}
-
 //----------------------------------------------------------------------------
 
 static crashpad::StringAnnotation<32> s_synthesizedAnnotation("synthesized");
@@ -541,6 +662,8 @@ void DoCrash(PlayerClient*, const char* szLine)
 	}
 	else
 	{
+		MaterializeCrashBreadcrumbs();
+
 		CONTEXT context;
 		crashpad::CaptureContext(&context);
 		crashpad::CrashpadClient::DumpWithoutCrash(context);
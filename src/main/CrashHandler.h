@@ -14,6 +14,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string_view>
+
 namespace mq {
 
 #define DebugTryBegin()
@@ -34,8 +37,18 @@ bool InitializeCrashpad();
 void InitializeCrashpadPipe(const std::string& pipeName);
 
 void CrashHandler_Startup();
-void CrashHandler_SetLastCommand(const char* command);
-void CrashHandler_SetLastMacroData(const char* macroData);
+
+enum class CrashBreadcrumbKind : uint8_t
+{
+	Command,
+	MacroData,
+};
+
+// Records what we are doing in case something goes wrong. Only the pointer to the text is kept, so
+// it must remain valid until the breadcrumb is ended. The text of the most recent breadcrumbs is
+// only copied into the crash report once we crash.
+uint64_t CrashHandler_BeginBreadcrumb(CrashBreadcrumbKind kind, std::string_view text);
+void CrashHandler_EndBreadcrumb(uint64_t breadcrumb);
 
 } // namespace mq
 
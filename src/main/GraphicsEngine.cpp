@@ -489,13 +489,34 @@ void MQGraphicsEngine::PostUpdateScene()
 {
 	if (m_deviceAcquired && m_imguiReady && !m_needResetOverlay)
 	{
-		if (gGameState != GAMESTATE_LOGGINGIN && gbRenderImGui)
+		if (gGameState != GAMESTATE_LOGGINGIN && gbRenderImGui && !IsImGuiHeadless())
 		{
 			ImGui_DrawFrame();
 		}
 	}
 }
 
+void MQGraphicsEngine::ImGui_DrawHeadlessFrame()
+{
+	if (!m_deviceAcquired || !m_imguiReady || m_needResetOverlay
+		|| gGameState == GAMESTATE_LOGGINGIN || !gbRenderImGui)
+	{
+		return;
+	}
+
+	// Frequent enough that input and window state are processed, the callbacks of plugins are
+	// throttled further by their own interval.
+	const auto now = std::chrono::steady_clock::now();
+	if (now < m_nextHeadlessFrame)
+		return;
+
+	m_nextHeadlessFrame = now + std::chrono::milliseconds{ 100 };
+
+	m_headlessFrame = true;
+	ImGui_DrawFrame();
+	m_headlessFrame = false;
+}
+
 void MQGraphicsEngine::ImGui_DrawFrame()
 {
 	// we can't expect that the rounding mode is valid, and imgui respects the rounding mode so set it here and ensure that we reset it before the return
@@ -506,19 +527,29 @@ void MQGraphicsEngine::ImGui_DrawFrame()
 	{
 		ImGui::NewFrame();
 
-		ImGuiManager_DrawFrame();
+		ImGuiManager_DrawFrame(m_headlessFrame);
 
-		// Render the ui
-		ImGui::Render();
-		ImGui_RenderDrawData();
+		if (m_headlessFrame)
+		{
+			// End the frame without rendering it, nothing is presented while headless. The platform
+			// windows still need their update, even though they aren't rendered.
+			ImGui::EndFrame();
+			ImGui::UpdatePlatformWindows();
+		}
+		else
+		{
+			// Render the ui
+			ImGui::Render();
+			ImGui_RenderDrawData();
 
-		ImGui::UpdatePlatformWindows();
+			ImGui::UpdatePlatformWindows();
 
-		// Update and Render additional Platform Windows
-		ImGuiIO& io = ImGui::GetIO();
-		if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
-		{
-			ImGui::RenderPlatformWindowsDefault();
+			// Update and Render additional Platform Windows
+			ImGuiIO& io = ImGui::GetIO();
+			if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
+			{
+				ImGui::RenderPlatformWindowsDefault();
+			}
 		}
 	}
 	catch (const ImGuiException& ex)
@@ -541,6 +572,11 @@ void MQGraphicsEngine::OnUpdateFrame()
 {
 	OnUpdateFrame_Internal();
 
+	if (IsImGuiHeadless())
+	{
+		ImGui_DrawHeadlessFrame();
+	}
+
 	// Reset the device hooks between game states. Some of them may alter
 	// the device and we might need to start over.
 	if (gGameState != m_lastGameState)
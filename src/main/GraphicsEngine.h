@@ -132,6 +132,7 @@ protected:
 	void ImGui_Initialize();
 	void ImGui_Shutdown();
 	virtual void ImGui_DrawFrame();
+	void ImGui_DrawHeadlessFrame();
 	virtual void ImGui_RenderDrawData() {}
 
 private:
@@ -169,6 +170,11 @@ protected:
 	// Last known fullscreen state.
 	bool m_lastFullScreenState = false;
 
+	// Set while building an ImGui frame from the pulse because ImGui is headless. Those frames
+	// don't produce draw data.
+	bool m_headlessFrame = false;
+	std::chrono::steady_clock::time_point m_nextHeadlessFrame;
+
 private:
 	bool m_retryHooks = false;
 	bool m_initializationFailed = false;
@@ -17,6 +17,12 @@
 
 #include "MQ2Main.h"
 
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+
 namespace mq {
 
 //============================================================================
@@ -26,6 +32,94 @@ static bool s_shutdown = false;
 
 static int s_renderCallbacksId = -1;
 
+// Textures of the same file share one bitmap, so icons drawn from the same file bind the same
+// texture and ImGui can put them in one draw call.
+struct SharedBitmap
+{
+	BMI* bmi = nullptr;
+	int refs = 0;
+};
+static ci_unordered::map<std::string, SharedBitmap> s_bitmaps;
+
+// Textures handed out by GetSharedTexture. The entries don't keep the textures alive, they are
+// swept once the map has doubled in size since the last sweep.
+struct SharedTexture
+{
+	std::weak_ptr<MQTexture> texture;
+	std::chrono::steady_clock::time_point failedAt;
+};
+static ci_unordered::map<std::string, SharedTexture> s_sharedTextures[2];    // sync, async
+static size_t s_sharedTexturesSweepAt = 64;
+
+// How long a file that failed to load is left alone.
+static constexpr std::chrono::seconds SharedTextureRetryDelay{ 5 };
+
+// Deferred textures. The worker reads the file so it is in the file cache by the time the texture
+// is created on the main thread, which is where the time of a load goes.
+struct TexturePrefetch
+{
+	std::string filename;
+	bool done = false;                     // guarded by s_prefetchMutex
+};
+
+struct PendingTexture
+{
+	MQTexture* texture;
+	std::shared_ptr<TexturePrefetch> prefetch;
+};
+
+static std::vector<PendingTexture> s_pendingTextures;
+static std::mutex s_prefetchMutex;
+static std::condition_variable s_prefetchAvailable;
+static std::deque<std::shared_ptr<TexturePrefetch>> s_prefetchQueue;
+static std::thread s_prefetchThread;
+static bool s_prefetchStopping = false;
+
+// How long a pulse may spend creating deferred textures. At least one is created every pulse.
+static constexpr std::chrono::microseconds PendingTextureBudget{ 2000 };
+
+static void TexturePrefetchThread()
+{
+	std::vector<char> buffer(64 * 1024);
+
+	while (true)
+	{
+		std::shared_ptr<TexturePrefetch> prefetch;
+		{
+			std::unique_lock lock(s_prefetchMutex);
+			s_prefetchAvailable.wait(lock, [] { return s_prefetchStopping || !s_prefetchQueue.empty(); });
+
+			if (s_prefetchStopping)
+				return;
+
+			prefetch = std::move(s_prefetchQueue.front());
+			s_prefetchQueue.pop_front();
+		}
+
+		std::ifstream file(prefetch->filename, std::ios::binary);
+		while (file.read(buffer.data(), buffer.size()))
+		{
+		}
+
+		std::scoped_lock lock(s_prefetchMutex);
+		prefetch->done = true;
+	}
+}
+
+static void StopTexturePrefetch()
+{
+	{
+		std::scoped_lock lock(s_prefetchMutex);
+		s_prefetchStopping = true;
+		s_prefetchQueue.clear();
+	}
+
+	s_prefetchAvailable.notify_all();
+
+	if (s_prefetchThread.joinable())
+		s_prefetchThread.join();
+}
+
 //============================================================================
 
 MQTexture* CreateTexture(std::string_view filename)
@@ -63,19 +157,97 @@ MQTexturePtr CreateTexturePtr(std::string_view filename)
 	return std::shared_ptr<MQTexture>(CreateTexture(filename), [](MQTexture* tex) { DestroyTexture(tex); });
 }
 
-//============================================================================
+MQTexturePtr CreateTextureAsync(std::string_view filename)
+{
+	if (!pGraphicsEngine || !pGraphicsEngine->pResourceManager || s_shutdown)
+		return nullptr;
 
-MQTexture::MQTexture(std::string_view name)
-	: m_name(name)
+	MQTexture* newTexture = new MQTexture(filename, true);
+
+	auto prefetch = std::make_shared<TexturePrefetch>();
+	prefetch->filename = newTexture->GetFilename();
+	s_pendingTextures.push_back({ newTexture, prefetch });
+
+	{
+		std::scoped_lock lock(s_prefetchMutex);
+
+		if (!s_prefetchThread.joinable())
+		{
+			s_prefetchStopping = false;
+			s_prefetchThread = std::thread(&TexturePrefetchThread);
+		}
+
+		s_prefetchQueue.push_back(std::move(prefetch));
+	}
+
+	s_prefetchAvailable.notify_one();
+
+	return std::shared_ptr<MQTexture>(newTexture, [](MQTexture* tex) { DestroyTexture(tex); });
+}
+
+MQTexturePtr GetSharedTexture(std::string_view filename, bool async)
 {
-	AcquireTexture();
+	if (s_shutdown)
+		return nullptr;
 
-	if (m_bmi)
+	auto& sharedTextures = s_sharedTextures[async ? 1 : 0];
+	const auto now = std::chrono::steady_clock::now();
+
+	auto iter = sharedTextures.find(std::string(filename));
+	if (iter != sharedTextures.end())
 	{
-		m_bmi->Name = m_name.c_str();
-		m_bmi->pBmp->m_nTrackingType = 2; // EQG
+		if (MQTexturePtr texture = iter->second.texture.lock())
+		{
+			if (texture->IsValid() || texture->IsPending())
+				return texture;
 
-		s_textures.push_back(this);
+			// An async load that failed. Nothing holds on to that for long.
+			iter->second.failedAt = now;
+			iter->second.texture.reset();
+			return nullptr;
+		}
+
+		if (iter->second.failedAt != std::chrono::steady_clock::time_point{}
+			&& now - iter->second.failedAt < SharedTextureRetryDelay)
+		{
+			return nullptr;
+		}
+	}
+	else
+	{
+		if (sharedTextures.size() >= s_sharedTexturesSweepAt)
+		{
+			for (auto sweep = sharedTextures.begin(); sweep != sharedTextures.end();)
+			{
+				if (sweep->second.texture.expired() && now - sweep->second.failedAt >= SharedTextureRetryDelay)
+					sweep = sharedTextures.erase(sweep);
+				else
+					++sweep;
+			}
+
+			s_sharedTexturesSweepAt = std::max<size_t>(64, sharedTextures.size() * 2);
+		}
+
+		iter = sharedTextures.try_emplace(std::string(filename)).first;
+	}
+
+	MQTexturePtr texture = async ? CreateTextureAsync(filename) : CreateTexturePtr(filename);
+
+	iter->second.texture = texture;
+	iter->second.failedAt = texture ? std::chrono::steady_clock::time_point{} : now;
+
+	return texture;
+}
+
+//============================================================================
+
+MQTexture::MQTexture(std::string_view name, bool deferred)
+	: m_name(name)
+	, m_pending(deferred)
+{
+	if (!deferred)
+	{
+		FinishPending();
 	}
 }
 
@@ -89,6 +261,20 @@ MQTexture::~MQTexture()
 	if (!s_shutdown)
 	{
 		s_textures.erase(std::remove(begin(s_textures), end(s_textures), this), end(s_textures));
+		s_pendingTextures.erase(std::remove_if(begin(s_pendingTextures), end(s_pendingTextures),
+			[this](const PendingTexture& pending) { return pending.texture == this; }), end(s_pendingTextures));
+	}
+}
+
+void MQTexture::FinishPending()
+{
+	m_pending = false;
+
+	AcquireTexture();
+
+	if (m_bmi)
+	{
+		s_textures.push_back(this);
 	}
 }
 
@@ -96,24 +282,30 @@ void MQTexture::AcquireTexture()
 {
 	if (m_bmi == nullptr)
 	{
-		BMI* bmi = pGraphicsEngine->pResourceManager->CreateBMI(m_name.c_str(), m_name.c_str(),
-			nullptr, eMemoryPoolManagerTypePersistent);
+		auto iter = s_bitmaps.try_emplace(m_name).first;
+		SharedBitmap& shared = iter->second;
 
-		if (!bmi->pBmp)
-		{
-			pGraphicsEngine->pResourceManager->DestroyBMI(bmi);
-		}
-		else
+		if (shared.bmi == nullptr)
 		{
-			if (bmi->pBmp->GetD3DTexture() == nullptr)
+			BMI* bmi = pGraphicsEngine->pResourceManager->CreateBMI(m_name.c_str(), m_name.c_str(),
+				nullptr, eMemoryPoolManagerTypePersistent);
+
+			if (!bmi->pBmp || bmi->pBmp->GetD3DTexture() == nullptr)
 			{
 				pGraphicsEngine->pResourceManager->DestroyBMI(bmi);
+				s_bitmaps.erase(iter);
+				return;
 			}
-			else
-			{
-				m_bmi = bmi;
-			}
+
+			// The name is kept by the map, it outlives every texture sharing the bitmap.
+			bmi->Name = iter->first.c_str();
+			bmi->pBmp->m_nTrackingType = 2; // EQG
+
+			shared.bmi = bmi;
 		}
+
+		++shared.refs;
+		m_bmi = shared.bmi;
 	}
 }
 
@@ -121,7 +313,13 @@ void MQTexture::ReleaseTexture()
 {
 	if (m_bmi != nullptr)
 	{
-		pGraphicsEngine->pResourceManager->DestroyBMI(m_bmi);
+		auto iter = s_bitmaps.find(m_name);
+		if (iter != s_bitmaps.end() && --iter->second.refs <= 0)
+		{
+			pGraphicsEngine->pResourceManager->DestroyBMI(iter->second.bmi);
+			s_bitmaps.erase(iter);
+		}
+
 		m_bmi = nullptr;
 	}
 }
@@ -174,6 +372,36 @@ static void GraphicsResources_InvalidateDeviceObjects()
 	}
 }
 
+void GraphicsResources_OnPulse()
+{
+	if (s_pendingTextures.empty() || !pGraphicsEngine || !pGraphicsEngine->pResourceManager)
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	bool createdOne = false;
+
+	for (auto iter = s_pendingTextures.begin(); iter != s_pendingTextures.end();)
+	{
+		if (createdOne && std::chrono::steady_clock::now() - start >= PendingTextureBudget)
+			break;
+
+		{
+			std::scoped_lock lock(s_prefetchMutex);
+			if (!iter->prefetch->done)
+			{
+				++iter;
+				continue;
+			}
+		}
+
+		MQTexture* texture = iter->texture;
+		iter = s_pendingTextures.erase(iter);
+
+		texture->FinishPending();
+		createdOne = true;
+	}
+}
+
 void GraphicsResources_Initialize()
 {
 	MQRenderCallbacks callbacks;
@@ -185,7 +413,10 @@ void GraphicsResources_Initialize()
 
 void GraphicsResources_Shutdown()
 {
+	StopTexturePrefetch();
+
 	s_shutdown = true;
+	s_pendingTextures.clear();
 
 	if (pGraphicsEngine && pGraphicsEngine->pResourceManager)
 	{
@@ -196,6 +427,9 @@ void GraphicsResources_Shutdown()
 	}
 
 	s_textures.clear();
+	s_bitmaps.clear();
+	s_sharedTextures[0].clear();
+	s_sharedTextures[1].clear();
 
 	RemoveRenderCallbacks(s_renderCallbacksId);
 }
@@ -89,6 +89,8 @@ struct ImGui_ImplDX11_Data
 	ID3D11DepthStencilState*    pDepthStencilState;
 	int                         VertexBufferSize;
 	int                         IndexBufferSize;
+	int                         VertexBufferOffset;     // where the next frame's vertices go in the ring
+	int                         IndexBufferOffset;      // where the next frame's indices go in the ring
 
     ImGui_ImplDX11_Data()       { memset((void*)this, 0, sizeof(*this)); VertexBufferSize = 5000; IndexBufferSize = 10000; }
 };
@@ -157,11 +159,13 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 	ImGui_ImplDX11_Data* bd = ImGui_ImplDX11_GetBackendData();
 	ID3D11DeviceContext* device = bd->pd3dDeviceContext;
 
-	// Create and grow vertex/index buffers if needed
+	// Create and grow vertex/index buffers if needed. They grow geometrically, so that a UI that keeps
+	// getting bigger doesn't recreate them every few frames.
 	if (!bd->pVB || bd->VertexBufferSize < draw_data->TotalVtxCount)
 	{
 		if (bd->pVB) { bd->pVB->Release(); bd->pVB = nullptr; }
-		bd->VertexBufferSize = draw_data->TotalVtxCount + 5000;
+		bd->VertexBufferSize = std::max(bd->VertexBufferSize * 2, draw_data->TotalVtxCount + 5000);
+		bd->VertexBufferOffset = 0;
 		D3D11_BUFFER_DESC desc;
 		memset(&desc, 0, sizeof(D3D11_BUFFER_DESC));
 		desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -175,7 +179,8 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 	if (!bd->pIB || bd->IndexBufferSize < draw_data->TotalIdxCount)
 	{
 		if (bd->pIB) { bd->pIB->Release(); bd->pIB = nullptr; }
-		bd->IndexBufferSize = draw_data->TotalIdxCount + 10000;
+		bd->IndexBufferSize = std::max(bd->IndexBufferSize * 2, draw_data->TotalIdxCount + 10000);
+		bd->IndexBufferOffset = 0;
 		D3D11_BUFFER_DESC desc;
 		memset(&desc, 0, sizeof(D3D11_BUFFER_DESC));
 		desc.Usage = D3D11_USAGE_DYNAMIC;
@@ -186,14 +191,32 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 			return;
 	}
 
-	// Upload vertex/index data into a single contiguous GPU buffer
+	// Upload vertex/index data into a single contiguous GPU buffer. The buffers are used as rings: each
+	// frame (and each viewport) is appended after the previous one with NO_OVERWRITE, so the driver
+	// doesn't have to hand out a new buffer, and only a frame that doesn't fit discards and starts over.
+	D3D11_MAP vtx_map = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (bd->VertexBufferOffset + draw_data->TotalVtxCount > bd->VertexBufferSize)
+	{
+		vtx_map = D3D11_MAP_WRITE_DISCARD;
+		bd->VertexBufferOffset = 0;
+	}
+	D3D11_MAP idx_map = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (bd->IndexBufferOffset + draw_data->TotalIdxCount > bd->IndexBufferSize)
+	{
+		idx_map = D3D11_MAP_WRITE_DISCARD;
+		bd->IndexBufferOffset = 0;
+	}
+
 	D3D11_MAPPED_SUBRESOURCE vtx_resource, idx_resource;
-	if (device->Map(bd->pVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &vtx_resource) != S_OK)
+	if (device->Map(bd->pVB, 0, vtx_map, 0, &vtx_resource) != S_OK)
 		return;
-	if (device->Map(bd->pIB, 0, D3D11_MAP_WRITE_DISCARD, 0, &idx_resource) != S_OK)
+	if (device->Map(bd->pIB, 0, idx_map, 0, &idx_resource) != S_OK)
+	{
+		device->Unmap(bd->pVB, 0);
 		return;
-	ImDrawVert* vtx_dst = (ImDrawVert*)vtx_resource.pData;
-	ImDrawIdx* idx_dst = (ImDrawIdx*)idx_resource.pData;
+	}
+	ImDrawVert* vtx_dst = (ImDrawVert*)vtx_resource.pData + bd->VertexBufferOffset;
+	ImDrawIdx* idx_dst = (ImDrawIdx*)idx_resource.pData + bd->IndexBufferOffset;
 	for (int n = 0; n < draw_data->CmdListsCount; n++)
 	{
 		const ImDrawList* draw_list = draw_data->CmdLists[n];
@@ -286,9 +309,30 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 
 	// Render command lists
 	// (Because we merged all buffers into a single one, we maintain our own offset into them)
-	int global_idx_offset = 0;
-	int global_vtx_offset = 0;
+	int global_idx_offset = bd->IndexBufferOffset;
+	int global_vtx_offset = bd->VertexBufferOffset;
+	bd->IndexBufferOffset += draw_data->TotalIdxCount;
+	bd->VertexBufferOffset += draw_data->TotalVtxCount;
 	ImVec2 clip_off = draw_data->DisplayPos;
+
+	// Consecutive commands with the same texture and clip rect, whose indices follow each other, are
+	// drawn with one call. The texture and scissor rect are only set when they change.
+	struct PendingDraw
+	{
+		UINT IndexCount = 0;
+		UINT StartIndex = 0;
+		INT BaseVertex = 0;
+	} pending;
+	ID3D11ShaderResourceView* bound_srv = nullptr;
+	D3D11_RECT bound_rect = {};
+	bool state_bound = false;
+
+	auto flush_pending = [&]()
+	{
+		if (pending.IndexCount != 0)
+			device->DrawIndexed(pending.IndexCount, pending.StartIndex, pending.BaseVertex);
+		pending.IndexCount = 0;
+	};
 	for (int n = 0; n < draw_data->CmdListsCount; n++)
 	{
 		const ImDrawList* cmd_list = draw_data->CmdLists[n];
@@ -299,6 +343,9 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 			{
 				// User callback, registered via ImDrawList::AddCallback()
 				// (ImDrawCallback_ResetRenderState is a special callback value used by the user to request the renderer to reset render state.)
+				flush_pending();
+				state_bound = false;
+
 				if (pcmd->UserCallback == ImDrawCallback_ResetRenderState)
 					ImGui_ImplDX11_SetupRenderState(draw_data, device);
 				else
@@ -312,9 +359,7 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 				if (clip_max.x <= clip_min.x || clip_max.y <= clip_min.y)
 					continue;
 
-				// Apply scissor/clipping rectangle
 				const D3D11_RECT r = { (LONG)clip_min.x, (LONG)clip_min.y, (LONG)clip_max.x, (LONG)clip_max.y };
-				device->RSSetScissorRects(1, &r);
 
 				ID3D11ShaderResourceView* texture_srv = nullptr;
 				ImTextureID texID = pcmd->GetTexID();
@@ -350,14 +395,42 @@ void ImGui_ImplDX11_RenderDrawData(ImDrawData* draw_data)
 					texture_srv = texID;
 				}
 
-				// Bind texture, Draw
-				device->PSSetShaderResources(0, 1, &texture_srv);
-				device->DrawIndexed(pcmd->ElemCount, pcmd->IdxOffset + global_idx_offset, pcmd->VtxOffset + global_vtx_offset);
+				const UINT start_index = pcmd->IdxOffset + global_idx_offset;
+				const INT base_vertex = pcmd->VtxOffset + global_vtx_offset;
+				const bool same_state = state_bound && texture_srv == bound_srv
+					&& memcmp(&r, &bound_rect, sizeof(D3D11_RECT)) == 0;
+
+				if (same_state && pending.IndexCount != 0 && pending.BaseVertex == base_vertex
+					&& pending.StartIndex + pending.IndexCount == start_index)
+				{
+					pending.IndexCount += pcmd->ElemCount;
+					continue;
+				}
+
+				flush_pending();
+
+				// Apply scissor/clipping rectangle and bind texture
+				if (!same_state)
+				{
+					if (!state_bound || memcmp(&r, &bound_rect, sizeof(D3D11_RECT)) != 0)
+						device->RSSetScissorRects(1, &r);
+					if (!state_bound || texture_srv != bound_srv)
+						device->PSSetShaderResources(0, 1, &texture_srv);
+
+					bound_rect = r;
+					bound_srv = texture_srv;
+					state_bound = true;
+				}
+
+				pending.IndexCount = pcmd->ElemCount;
+				pending.StartIndex = start_index;
+				pending.BaseVertex = base_vertex;
 			}
 		}
 		global_idx_offset += cmd_list->IdxBuffer.Size;
 		global_vtx_offset += cmd_list->VtxBuffer.Size;
 	}
+	flush_pending();
 	platform_io.Renderer_RenderState = nullptr;
 
 	// Restore modified DX state
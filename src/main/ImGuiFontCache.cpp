@@ -0,0 +1,349 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "ImGuiFontCache.h"
+
+#include "MQ2Main.h"
+
+#include <imgui/imgui.h>
+#include <imgui/imgui_internal.h>
+#if defined(IMGUI_ENABLE_FREETYPE)
+#include <imgui/misc/freetype/imgui_freetype.h>
+#endif
+
+#include <filesystem>
+#include <fstream>
+
+namespace mq {
+
+static constexpr uint32_t FontCacheMagic = 0x41465143;     // "CQFA"
+static constexpr uint32_t FontCacheVersion = 1;
+
+struct FontCacheHeader
+{
+	uint32_t magic = FontCacheMagic;
+	uint32_t version = FontCacheVersion;
+	uint32_t imguiVersion = IMGUI_VERSION_NUM;
+	uint32_t glyphSize = sizeof(ImFontGlyph);
+	uint64_t key = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+	int32_t customRectCount = 0;
+	int32_t fontCount = 0;
+};
+
+// Followed by the glyphs of the font.
+struct FontCacheFont
+{
+	float fontSize = 0.0f;
+	float ascent = 0.0f;
+	float descent = 0.0f;
+	int32_t metricsTotalSurface = 0;
+	int32_t glyphCount = 0;
+	ImU8 used4kPagesMap[sizeof(ImFont::Used4kPagesMap)] = {};
+};
+
+static const ImFontBuilderIO* GetDefaultFontBuilder()
+{
+#if defined(IMGUI_ENABLE_FREETYPE)
+	return ImGuiFreeType::GetBuilderForFreeType();
+#else
+	return ImFontAtlasGetBuilderForStbTruetype();
+#endif
+}
+
+//============================================================================
+
+class FontCacheKey
+{
+public:
+	void Add(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+		// The font data is megabytes of it, so eight bytes at a time.
+		while (size >= sizeof(uint64_t))
+		{
+			uint64_t word;
+			memcpy(&word, bytes, sizeof(word));
+			m_hash = (m_hash ^ word) * 1099511628211ULL;
+
+			bytes += sizeof(word);
+			size -= sizeof(word);
+		}
+
+		while (size-- > 0)
+		{
+			m_hash = (m_hash ^ *bytes++) * 1099511628211ULL;
+		}
+	}
+
+	template <typename T>
+	void Add(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		Add(&value, sizeof(value));
+	}
+
+	uint64_t Get() const { return m_hash; }
+
+private:
+	uint64_t m_hash = 14695981039346656037ULL;
+};
+
+// Everything that goes into the build: the fonts and their settings, the settings of the atlas and
+// the rectangles packed next to the glyphs.
+static uint64_t GetFontCacheKey(const ImFontAtlas* atlas)
+{
+	FontCacheKey key;
+	key.Add(static_cast<uint32_t>(sizeof(ImWchar)));
+	key.Add(atlas->Flags);
+	key.Add(atlas->TexDesiredWidth);
+	key.Add(atlas->TexGlyphPadding);
+	key.Add(atlas->FontBuilderFlags);
+	key.Add(atlas->Fonts.Size);
+
+	for (const ImFontConfig& config : atlas->ConfigData)
+	{
+		key.Add(config.FontDataSize);
+		key.Add(config.FontData, config.FontDataSize);
+		key.Add(config.FontNo);
+		key.Add(config.SizePixels);
+		key.Add(config.OversampleH);
+		key.Add(config.OversampleV);
+		key.Add(config.PixelSnapH);
+		key.Add(config.GlyphExtraSpacing);
+		key.Add(config.GlyphOffset);
+		key.Add(config.GlyphMinAdvanceX);
+		key.Add(config.GlyphMaxAdvanceX);
+		key.Add(config.MergeMode);
+		key.Add(config.FontBuilderFlags);
+		key.Add(config.RasterizerMultiply);
+		key.Add(config.RasterizerDensity);
+		key.Add(config.EllipsisChar);
+
+		for (const ImWchar* range = config.GlyphRanges; range && range[0]; range += 2)
+		{
+			key.Add(range[0]);
+			key.Add(range[1]);
+		}
+
+		const int fontIndex = atlas->Fonts.index_from_ptr(std::find(atlas->Fonts.begin(), atlas->Fonts.end(), config.DstFont));
+		key.Add(fontIndex);
+	}
+
+	for (const ImFontAtlasCustomRect& rect : atlas->CustomRects)
+	{
+		key.Add(rect.Width);
+		key.Add(rect.Height);
+		key.Add(static_cast<uint32_t>(rect.GlyphID));
+		key.Add(rect.GlyphAdvanceX);
+		key.Add(rect.GlyphOffset);
+	}
+
+	return key.Get();
+}
+
+static std::filesystem::path GetFontCachePath(uint64_t key)
+{
+	return std::filesystem::path(internal_paths::Resources) / "FontCache" / fmt::format("{:016x}.atlas", key);
+}
+
+//============================================================================
+
+static bool LoadFontCache(ImFontAtlas* atlas, uint64_t key)
+{
+	std::ifstream file(GetFontCachePath(key), std::ios::binary);
+	if (!file)
+		return false;
+
+	FontCacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != FontCacheMagic
+		|| header.version != FontCacheVersion
+		|| header.imguiVersion != IMGUI_VERSION_NUM
+		|| header.glyphSize != sizeof(ImFontGlyph)
+		|| header.key != key
+		|| header.width <= 0 || header.height <= 0
+		|| header.customRectCount != atlas->CustomRects.Size
+		|| header.fontCount != atlas->Fonts.Size)
+	{
+		return false;
+	}
+
+	// Everything is read before anything is changed, so a bad entry leaves the atlas to be built.
+	ImVec2 uvWhitePixel;
+	ImVec4 uvLines[IM_ARRAYSIZE(atlas->TexUvLines)];
+	std::vector<std::pair<uint16_t, uint16_t>> rectPositions(header.customRectCount);
+	std::vector<FontCacheFont> fonts(header.fontCount);
+	std::vector<std::vector<ImFontGlyph>> glyphs(header.fontCount);
+
+	if (!file.read(reinterpret_cast<char*>(&uvWhitePixel), sizeof(uvWhitePixel))
+		|| !file.read(reinterpret_cast<char*>(uvLines), sizeof(uvLines))
+		|| !file.read(reinterpret_cast<char*>(rectPositions.data()), rectPositions.size() * sizeof(rectPositions[0])))
+	{
+		return false;
+	}
+
+	for (int i = 0; i < header.fontCount; ++i)
+	{
+		if (!file.read(reinterpret_cast<char*>(&fonts[i]), sizeof(FontCacheFont)) || fonts[i].glyphCount < 0)
+			return false;
+
+		glyphs[i].resize(fonts[i].glyphCount);
+		if (!file.read(reinterpret_cast<char*>(glyphs[i].data()), glyphs[i].size() * sizeof(ImFontGlyph)))
+			return false;
+	}
+
+	const size_t pixelCount = static_cast<size_t>(header.width) * header.height;
+	unsigned char* pixels = static_cast<unsigned char*>(IM_ALLOC(pixelCount));
+	if (!file.read(reinterpret_cast<char*>(pixels), pixelCount))
+	{
+		IM_FREE(pixels);
+		return false;
+	}
+
+	ImFontAtlasBuildInit(atlas);
+
+	atlas->TexID = 0;
+	atlas->ClearTexData();
+	atlas->TexPixelsAlpha8 = pixels;
+	atlas->TexWidth = header.width;
+	atlas->TexHeight = header.height;
+	atlas->TexUvScale = ImVec2(1.0f / header.width, 1.0f / header.height);
+	atlas->TexUvWhitePixel = uvWhitePixel;
+	memcpy(atlas->TexUvLines, uvLines, sizeof(uvLines));
+
+	for (int i = 0; i < header.customRectCount; ++i)
+	{
+		atlas->CustomRects[i].X = rectPositions[i].first;
+		atlas->CustomRects[i].Y = rectPositions[i].second;
+	}
+
+	for (int i = 0; i < header.fontCount; ++i)
+	{
+		ImFont* font = atlas->Fonts[i];
+		font->ClearOutputData();
+		font->ContainerAtlas = atlas;
+		font->FontSize = fonts[i].fontSize;
+		font->Ascent = fonts[i].ascent;
+		font->Descent = fonts[i].descent;
+		font->MetricsTotalSurface = fonts[i].metricsTotalSurface;
+		memcpy(font->Used4kPagesMap, fonts[i].used4kPagesMap, sizeof(font->Used4kPagesMap));
+
+		font->Glyphs.resize(fonts[i].glyphCount);
+		if (fonts[i].glyphCount > 0)
+			memcpy(font->Glyphs.Data, glyphs[i].data(), glyphs[i].size() * sizeof(ImFontGlyph));
+
+		font->BuildLookupTable();
+	}
+
+	atlas->TexReady = true;
+	return true;
+}
+
+static void SaveFontCache(const ImFontAtlas* atlas, uint64_t key)
+{
+	// Colored glyphs are in an RGBA texture, those atlases are just built every time.
+	if (!atlas->TexPixelsAlpha8 || atlas->TexPixelsUseColors)
+		return;
+
+	const std::filesystem::path path = GetFontCachePath(key);
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	// Other clients may be reading the entry, so it is written next to it and moved over it.
+	std::filesystem::path tempPath = path;
+	tempPath += fmt::format(".{}.tmp", GetCurrentProcessId());
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return;
+
+		FontCacheHeader header;
+		header.key = key;
+		header.width = atlas->TexWidth;
+		header.height = atlas->TexHeight;
+		header.customRectCount = atlas->CustomRects.Size;
+		header.fontCount = atlas->Fonts.Size;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		file.write(reinterpret_cast<const char*>(&atlas->TexUvWhitePixel), sizeof(atlas->TexUvWhitePixel));
+		file.write(reinterpret_cast<const char*>(atlas->TexUvLines), sizeof(atlas->TexUvLines));
+
+		for (const ImFontAtlasCustomRect& rect : atlas->CustomRects)
+		{
+			const std::pair<uint16_t, uint16_t> position = { rect.X, rect.Y };
+			file.write(reinterpret_cast<const char*>(&position), sizeof(position));
+		}
+
+		for (const ImFont* font : atlas->Fonts)
+		{
+			FontCacheFont cached;
+			cached.fontSize = font->FontSize;
+			cached.ascent = font->Ascent;
+			cached.descent = font->Descent;
+			cached.metricsTotalSurface = font->MetricsTotalSurface;
+			cached.glyphCount = font->Glyphs.Size;
+			memcpy(cached.used4kPagesMap, font->Used4kPagesMap, sizeof(cached.used4kPagesMap));
+
+			file.write(reinterpret_cast<const char*>(&cached), sizeof(cached));
+			file.write(reinterpret_cast<const char*>(font->Glyphs.Data), font->Glyphs.size_in_bytes());
+		}
+
+		file.write(reinterpret_cast<const char*>(atlas->TexPixelsAlpha8),
+			static_cast<size_t>(atlas->TexWidth) * atlas->TexHeight);
+
+		if (!file)
+		{
+			file.close();
+			std::filesystem::remove(tempPath, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec)
+		std::filesystem::remove(tempPath, ec);
+}
+
+//============================================================================
+
+static bool BuildFontAtlasCached(ImFontAtlas* atlas)
+{
+	// Registers the default rectangles, so they are part of the key.
+	ImFontAtlasBuildInit(atlas);
+
+	const uint64_t key = GetFontCacheKey(atlas);
+	if (LoadFontCache(atlas, key))
+		return true;
+
+	if (!GetDefaultFontBuilder()->FontBuilder_Build(atlas))
+		return false;
+
+	SaveFontCache(atlas, key);
+	return true;
+}
+
+static const ImFontBuilderIO s_cachedFontBuilder = { &BuildFontAtlasCached };
+
+void ImGuiFontCache_Install(ImFontAtlas* atlas)
+{
+	atlas->FontBuilderIO = &s_cachedFontBuilder;
+}
+
+} // namespace mq
@@ -0,0 +1,27 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+struct ImFontAtlas;
+
+namespace mq {
+
+// Keeps built font atlases on disk, so the fonts are only rasterized once for every client on the
+// machine. Installed as the font builder of the atlas: a build first looks for an entry that was
+// built from the same fonts, sizes and build settings, and only falls back to rasterizing when
+// there isn't one. Entries are in the FontCache folder of the resources.
+void ImGuiFontCache_Install(ImFontAtlas* atlas);
+
+} // namespace mq
@@ -16,6 +16,7 @@
 #include "ImGuiManager.h"
 
 #include "GraphicsEngine.h"
+#include "ImGuiFontCache.h"
 #include "imgui/ImGuiUtils.h"
 #include "MQ2ImGuiTools.h"
 #include "MQPluginHandler.h"
@@ -353,6 +354,10 @@ bool gbRenderImGui = true;
 bool gbHideCursorAttachment = false;
 int gDrawWindowFrameSkipCount = -1;
 
+// How often the console and the internal windows update while ImGui is headless.
+static constexpr std::chrono::milliseconds HeadlessInternalUpdateInterval{ 1000 };
+static std::chrono::steady_clock::time_point s_nextHeadlessInternalUpdate;
+
 enum class DebugTab {
 	MouseInput = 0,
 	Graphics = 1,
@@ -498,6 +503,7 @@ struct EQFontData
 
 static std::vector<EQFontData> s_eqFontData;
 static bool s_eqFontsLoaded = false;
+static bool s_cacheFontAtlas = true;
 
 ImFont* ImGuiManager_GetEQImFont(int fontID)
 {
@@ -622,6 +628,11 @@ void ImGuiManager_BuildFonts(ImFontAtlas* fontAtlas)
 {
 	LoadFonts();
 
+	if (s_cacheFontAtlas)
+	{
+		ImGuiFontCache_Install(fontAtlas);
+	}
+
 	mq::imgui::ConfigureFonts(fontAtlas);
 	s_eqFontsLoaded = LoadEQFonts(fontAtlas);
 }
@@ -852,10 +863,29 @@ static bool ImGuiManager_DetectCursorAttachment()
 	return s_showForFrames > 0;
 }
 
-void ImGuiManager_DrawFrame()
+void ImGuiManager_DrawFrame(bool headless)
 {
 	MQScopedBenchmark bm1(bmUpdateImGui);
 
+	if (headless)
+	{
+		// Nothing is going to be drawn, so only keep the state of the windows current.
+		const auto now = std::chrono::steady_clock::now();
+		if (now >= s_nextHeadlessInternalUpdate)
+		{
+			s_nextHeadlessInternalUpdate = now + HeadlessInternalUpdateInterval;
+			DoImGuiUpdateInternal();
+		}
+
+		if (!gbManualResetRequired)
+		{
+			MQScopedBenchmark bm2(bmPluginsUpdateImGui);
+			PluginsUpdateImGui(true);
+		}
+
+		return;
+	}
+
 	DoImGuiUpdateInternal();
 
 	// Plugins will get disabled if an error occurs.
@@ -1130,8 +1160,35 @@ void ImGuiManager_ReloadContext()
 	ImGuiManager_CreateContext();
 }
 
+static void* ImGuiManager_AccountedAlloc(size_t size, void* userData)
+{
+	void* ptr = malloc(size);
+	if (ptr)
+		static_cast<MQMemoryCounters*>(userData)->Allocate(_msize(ptr));
+
+	return ptr;
+}
+
+static void ImGuiManager_AccountedFree(void* ptr, void* userData)
+{
+	if (ptr)
+	{
+		static_cast<MQMemoryCounters*>(userData)->Free(_msize(ptr));
+		free(ptr);
+	}
+}
+
 void ImGuiManager_CreateContext()
 {
+	// Swapped before the first context is created, so next to nothing was allocated by the default
+	// allocators. They use malloc too, so whatever was can still be freed by ours.
+	static bool s_accountedAllocators = false;
+	if (gbMemoryAccounting && !s_accountedAllocators)
+	{
+		ImGui::SetAllocatorFunctions(ImGuiManager_AccountedAlloc, ImGuiManager_AccountedFree, GetMemoryCounters("ImGui"));
+		s_accountedAllocators = true;
+	}
+
 	bool buildFonts = false;
 	if (s_fontAtlas == nullptr)
 	{
@@ -1435,6 +1492,7 @@ void ImGuiManager_Initialize()
 	s_enableCursorAttachment = GetPrivateProfileBool("Overlay", "CursorAttachment", s_enableCursorAttachment, mq::internal_paths::MQini);
 	s_shiftToDock = GetPrivateProfileBool("Overlay", "DockingWithShift", false, mq::internal_paths::MQini);
 	s_keyboardNavImGui = GetPrivateProfileBool("Overlay", "EnableKeyboardNav", false, mq::internal_paths::MQini);
+	s_cacheFontAtlas = GetPrivateProfileBool("Overlay", "CacheFontAtlas", s_cacheFontAtlas, mq::internal_paths::MQini);
 
 	if (gbWriteAllConfig)
 	{
@@ -1445,6 +1503,7 @@ void ImGuiManager_Initialize()
 		WritePrivateProfileBool("Overlay", "CursorAttachment", s_enableCursorAttachment, mq::internal_paths::MQini);
 		WritePrivateProfileBool("Overlay", "DockingWithShift", s_shiftToDock, mq::internal_paths::MQini);
 		WritePrivateProfileBool("Overlay", "EnableKeyboardNav", s_keyboardNavImGui, mq::internal_paths::MQini);
+		WritePrivateProfileBool("Overlay", "CacheFontAtlas", s_cacheFontAtlas, mq::internal_paths::MQini);
 	}
 
 	// TODO: application-wide keybinds could use an encapsulated interface. For now I'm just dumping his here since we need it to
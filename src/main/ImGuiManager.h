@@ -22,7 +22,8 @@ void ImGuiManager_Initialize();
 void ImGuiManager_Shutdown();
 void ImGuiManager_Pulse();
 
-void ImGuiManager_DrawFrame();
+// A headless frame only runs the imgui callbacks that are due, see IsImGuiHeadless.
+void ImGuiManager_DrawFrame(bool headless = false);
 void ImGuiManager_DrawCursorAttachment();
 
 bool ImGuiManager_HandleWndProcEx(HWND hWnd, uint32_t msg, uintptr_t wparam, intptr_t lparam, ImGuiIO& io);
@@ -49,6 +50,9 @@ extern bool gbManualResetRequired;
 // global imgui toggle
 extern bool gbRenderImGui;
 
+// True while the frame limiter has ImGui skip drawing because the game isn't visible (MQ2FrameLimiter.cpp).
+bool IsImGuiHeadless();
+
 // When true, hides the cursor attachment
 extern bool gbHideCursorAttachment;
 
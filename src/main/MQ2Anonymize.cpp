@@ -20,6 +20,7 @@
 
 #include <regex>
 #include <memory>
+#include <optional>
 #include <Yaml.hpp>
 
 namespace mq {
@@ -115,6 +116,53 @@ static Anonymization anon_guild;
 static Anonymization anon_raid;
 static Anonymization anon_self;
 
+// bumped whenever a replacer (or the set of them) changes, so the matcher is rebuilt
+static uint32_t anon_generation = 1;
+
+static bool is_anon_word_char(char ch)
+{
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+// the matcher compares lower case, with every kind of whitespace as a single space
+static char normalize_anon_char(char ch)
+{
+	if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\f' || ch == '\v')
+		return ' ';
+	if (ch >= 'A' && ch <= 'Z')
+		return static_cast<char>(ch - 'A' + 'a');
+	return ch;
+}
+
+// Normalizes a name or alternate for the matcher. The only regex syntax names use is the \s between
+// a first and last name, anything else (returns false) still has to go through std::regex.
+static bool normalize_anon_pattern(std::string_view pattern, std::string& normalized)
+{
+	normalized.clear();
+	for (size_t i = 0; i < pattern.length(); ++i)
+	{
+		char ch = pattern[i];
+		if (ch == '\\')
+		{
+			if (i + 1 < pattern.length() && pattern[i + 1] == 's')
+			{
+				normalized.push_back(' ');
+				++i;
+				continue;
+			}
+
+			return false;
+		}
+
+		if (std::string_view(".^$|()[]{}*+?").find(ch) != std::string_view::npos)
+			return false;
+
+		normalized.push_back(normalize_anon_char(ch));
+	}
+
+	return true;
+}
+
 class anon_replacer {
 public:
 	const std::string name;
@@ -123,11 +171,34 @@ private:
 	Anonymization strategy;
 	std::string target;
 	std::set<std::string> alternates;
-	std::regex search_string;
+	std::vector<std::string> patterns;
+	std::optional<std::regex> search_string;
 
 private:
 	void build_regex()
 	{
+		++anon_generation;
+		patterns.clear();
+		search_string.reset();
+
+		bool literal = true;
+		auto add_pattern = [this, &literal](std::string_view pattern)
+		{
+			std::string normalized;
+			if (!normalize_anon_pattern(pattern, normalized))
+				literal = false;
+			else if (!normalized.empty())
+				patterns.push_back(std::move(normalized));
+		};
+
+		add_pattern(name);
+		for (const std::string& alternate : alternates)
+			add_pattern(alternate);
+
+		if (literal)
+			return;
+
+		patterns.clear();
 		search_string = std::regex(
 			fmt::format("\\b({}{})\\b", name, std::accumulate(alternates.cbegin(), alternates.cend(), std::string(),
 				[](const std::string& text, std::string_view alt) -> std::string {
@@ -183,6 +254,7 @@ public:
 	void update_strategy(Anonymization strategy)
 	{
 		this->strategy = strategy;
+		++anon_generation;
 	}
 
 	Anonymization get_strategy()
@@ -193,6 +265,7 @@ public:
 	void update_target(std::string_view target)
 	{
 		this->target = target;
+		++anon_generation;
 	}
 
 	std::string_view get_target()
@@ -264,10 +337,24 @@ public:
 		}
 	}
 
+	// the normalized names for the matcher, empty if the name needs the regex
+	const std::vector<std::string>& get_patterns() const
+	{
+		return patterns;
+	}
+
+	bool needs_regex() const
+	{
+		return search_string.has_value();
+	}
+
 	std::string replace_text(std::string_view text) const
 	{
+		if (!search_string)
+			return std::string(text);
+
 		std::string result;
-		std::regex_replace(std::back_inserter(result), std::cbegin(text), std::cend(text), search_string, anonymize());
+		std::regex_replace(std::back_inserter(result), std::cbegin(text), std::cend(text), *search_string, anonymize());
 		return result;
 	}
 
@@ -295,6 +382,156 @@ static ci_unordered::map<std::string_view, std::unique_ptr<anon_replacer>> guild
 static ci_unordered::map<std::string_view, std::unique_ptr<anon_replacer>> raid_memoization;
 static std::unique_ptr<anon_replacer> self_replacer;
 
+// All the names that get anonymized, in one trie, so text is scanned once no matter how many names
+// there are. At every word boundary the longest name that also ends on a word boundary is replaced
+// (the words the \b(name|alternates)\b regex of each replacer used to match). Replacers whose names use
+// other regex syntax are applied after the scan.
+class anon_matcher
+{
+	struct trie_node
+	{
+		std::vector<std::pair<char, int>> next;
+		int replacer = -1;
+	};
+
+	std::vector<trie_node> nodes = std::vector<trie_node>(1);
+	std::vector<const anon_replacer*> entries;
+	std::vector<const anon_replacer*> regex_entries;
+
+	int find_next(int node, char ch) const
+	{
+		for (const auto& [next_ch, next] : nodes[node].next)
+		{
+			if (next_ch == ch)
+				return next;
+		}
+
+		return -1;
+	}
+
+	static bool is_word_boundary(std::string_view text, size_t pos)
+	{
+		const bool before = pos > 0 && is_anon_word_char(text[pos - 1]);
+		const bool after = pos < text.length() && is_anon_word_char(text[pos]);
+		return before != after;
+	}
+
+public:
+	void clear()
+	{
+		nodes.assign(1, trie_node{});
+		entries.clear();
+		regex_entries.clear();
+	}
+
+	// replacers that are added first keep a name that more than one of them has
+	void add(const anon_replacer* replacer)
+	{
+		if (replacer->needs_regex())
+		{
+			regex_entries.push_back(replacer);
+			return;
+		}
+
+		const int index = static_cast<int>(entries.size());
+		entries.push_back(replacer);
+
+		for (const std::string& pattern : replacer->get_patterns())
+		{
+			int node = 0;
+			for (char ch : pattern)
+			{
+				int next = find_next(node, ch);
+				if (next == -1)
+				{
+					next = static_cast<int>(nodes.size());
+					nodes[node].next.emplace_back(ch, next);
+					nodes.emplace_back();
+				}
+
+				node = next;
+			}
+
+			if (nodes[node].replacer == -1)
+				nodes[node].replacer = index;
+		}
+	}
+
+	std::string replace_text(std::string_view text) const
+	{
+		std::string result;
+		std::vector<std::pair<int, std::string>> replacements;
+		size_t copied = 0;
+		size_t pos = 0;
+
+		while (pos < text.length())
+		{
+			int matched = -1;
+			size_t match_end = 0;
+
+			if (is_word_boundary(text, pos))
+			{
+				int node = 0;
+				for (size_t i = pos; i < text.length(); ++i)
+				{
+					node = find_next(node, normalize_anon_char(text[i]));
+					if (node == -1)
+						break;
+
+					if (nodes[node].replacer != -1 && is_word_boundary(text, i + 1))
+					{
+						matched = nodes[node].replacer;
+						match_end = i + 1;
+					}
+				}
+			}
+
+			if (matched == -1)
+			{
+				++pos;
+				continue;
+			}
+
+			// the replacement of a replacer is the same for every match in the text
+			auto replacement = std::find_if(replacements.begin(), replacements.end(),
+				[matched](const auto& r) { return r.first == matched; });
+			if (replacement == replacements.end())
+			{
+				replacements.emplace_back(matched, entries[matched]->anonymize());
+				replacement = std::prev(replacements.end());
+			}
+
+			result.append(text.substr(copied, pos - copied));
+			result.append(replacement->second);
+			pos = copied = match_end;
+		}
+
+		result.append(text.substr(copied));
+
+		for (const anon_replacer* replacer : regex_entries)
+			result = replacer->replace_text(result);
+
+		return result;
+	}
+};
+
+static anon_matcher matcher;
+static uint32_t matcher_generation = 0;
+static uint64_t members_checked_at = 0;
+static uint64_t members_signature = 0;
+
+// Text is redrawn every frame, so the anonymized text is kept until the names or anything the
+// replacements show (like levels) might have changed.
+struct anon_text_hasher
+{
+	using is_transparent = void;
+	size_t operator()(std::string_view str) const { return std::hash<std::string_view>()(str); }
+};
+
+static constexpr size_t MAX_ANONYMIZED_TEXT = 4096;
+static constexpr uint64_t MEMBERS_CHECK_INTERVAL_MS = 1000;
+static std::unordered_map<std::string, std::string, anon_text_hasher, std::equal_to<>> anonymized_text;
+
 // the source string_view here will be used to index
 // creating a regex that looks like `(source|all|the|alternates)`
 
@@ -357,6 +594,8 @@ static void SetAnonymization(AnonymizationClasses AnonClass, Anonymization Strat
 		return;
 	}
 
+	++anon_generation;
+
 	WriteChatf("Updated \ag%s\ax anonymization to \ao%s\ax.", GetStringFromAnonClass(AnonClass).data(), GetStringFromAnonymization(Strategy).data());
 }
 
@@ -392,6 +631,7 @@ static void DropAnonymization(std::string_view Name)
 	if (replacer_it != std::end(replacers))
 	{
 		replacers.erase(replacer_it);
+		++anon_generation;
 		WriteChatf("Un-Anonymized \at%s\ax.", Name.data());
 	}
 	else
@@ -540,6 +780,7 @@ static void Deserialize()
 	guild_memoization.clear();
 	raid_memoization.clear();
 	self_replacer.reset();
+	++anon_generation;
 	WriteChatf("Done.");
 }
 
@@ -558,132 +799,175 @@ CXStr& PluginAnonymize(CXStr& Text)
 	return Text;
 }
 
-CXStr Anonymize(const CXStr& Text)
+static anon_replacer* GetMemoizedReplacer(ci_unordered::map<std::string_view, std::unique_ptr<anon_replacer>>& memoization,
+	const char* name, Anonymization strategy)
 {
-	if (!MaybeAnonymize(Text))
-		return Text;
+	auto memoized = memoization.find(name);
+	if (memoized == memoization.end())
+	{
+		auto replacer = std::make_unique<anon_replacer>(name, strategy);
+		std::string_view key = replacer->name;
+		memoized = memoization.emplace(key, std::move(replacer)).first;
+	}
 
-	if (!pLocalPlayer || !pLocalPC)
-		return Text;
+	return memoized->second.get();
+}
 
-	EnterMQ2Benchmark(bmAnonymizer);
+// A hash of every name that is anonymized because of who the player is grouped, raided or guilded
+// with, to notice when the matcher needs them added without rebuilding it every time.
+static uint64_t GetMembersSignature()
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](const char* name)
+	{
+		for (const char* ch = name; *ch; ++ch)
+		{
+			hash ^= static_cast<uint8_t>(*ch);
+			hash *= 1099511628211ULL;
+		}
 
-	auto new_text = std::accumulate(std::cbegin(replacers), std::cend(replacers), std::string(Text),
-		[](std::string& text, const std::unique_ptr<anon_replacer>& r) -> std::string {
-			return r ? r->replace_text(text) : text;
-		});
+		hash ^= 0xff;
+		hash *= 1099511628211ULL;
+	};
+
+	add(pLocalPlayer->Name);
+	add(pLocalPlayer->Lastname);
+
+	if (anon_group != Anonymization::None && pLocalPC->Group)
+	{
+		for (const CGroupMember* pMember : *pLocalPC->Group)
+		{
+			if (pMember)
+				add(pMember->Name);
+		}
+	}
+
+	if (anon_fellowship != Anonymization::None)
+	{
+		for (const SFellowshipMember& f : pLocalPlayer->Fellowship.FellowshipMember)
+			add(f.Name);
+	}
+
+	if (anon_guild != Anonymization::None && pGuild)
+	{
+		add(pGuild->GetGuildName(pLocalPC->GuildID));
+
+		for (GuildMember* pMember = pGuild->pFirstGuildMember; pMember; pMember = pMember->pNext)
+			add(pMember->Name);
+	}
+
+	if (anon_raid != Anonymization::None && pRaid)
+	{
+		for (const RaidMember& pMember : pRaid->RaidMember)
+			add(pMember.Name);
+	}
+
+	return hash;
+}
+
+// Adds the replacers in the order they used to be applied, so the same one wins a name.
+static void RebuildMatcher()
+{
+	matcher.clear();
+	anonymized_text.clear();
+
+	for (const auto& r : replacers)
+	{
+		if (r)
+			matcher.add(r.get());
+	}
 
 	if (anon_self != Anonymization::None)
 	{
 		if (!self_replacer || ci_find_substr(self_replacer->name, pLocalPlayer->Name) != 0)
 			self_replacer = std::make_unique<anon_replacer>(pLocalPlayer, anon_self);
 
-		new_text = self_replacer->replace_text(new_text);
+		matcher.add(self_replacer.get());
 	}
 
 	if (anon_group != Anonymization::None && pLocalPC->Group)
 	{
-		new_text = std::accumulate(
-			std::cbegin(*pLocalPC->Group),
-			std::cend(*pLocalPC->Group),
-			new_text,
-			[](std::string& text, const CGroupMember* pMember) -> std::string
-			{
-				if (pMember && pMember->Name[0] != '\0' && ci_equals(text, pMember->Name, false))
-				{
-					auto memoized = group_memoization.find(pMember->Name);
-					if (memoized == group_memoization.end())
-						memoized = group_memoization.emplace(
-							pMember->Name,
-							std::make_unique<anon_replacer>(pMember->Name, anon_group)
-						).first;
-
-					return memoized->second->replace_text(text);
-				}
-
-				return text;
-			}
-		);
+		for (const CGroupMember* pMember : *pLocalPC->Group)
+		{
+			if (pMember && pMember->Name[0] != '\0')
+				matcher.add(GetMemoizedReplacer(group_memoization, pMember->Name, anon_group));
+		}
 	}
 
 	if (anon_fellowship != Anonymization::None)
 	{
-		auto& fellowship = pLocalPlayer->Fellowship;
-		new_text = std::accumulate(
-			std::cbegin(fellowship.FellowshipMember),
-			std::cend(fellowship.FellowshipMember),
-			new_text,
-			[](std::string& text, const SFellowshipMember& f) -> std::string
-			{
-				if (f.Name[0] != '\0' && ci_equals(text, f.Name, false))
-				{
-					auto memoized = fellowship_memoization.find(f.Name);
-					if (memoized == fellowship_memoization.end())
-						memoized = fellowship_memoization.emplace(
-							f.Name,
-							std::make_unique<anon_replacer>(f.Name, anon_fellowship)
-						).first;
-
-					return memoized->second->replace_text(text);
-				}
-
-				return text;
-			}
-		);
+		for (const SFellowshipMember& f : pLocalPlayer->Fellowship.FellowshipMember)
+		{
+			if (f.Name[0] != '\0')
+				matcher.add(GetMemoizedReplacer(fellowship_memoization, f.Name, anon_fellowship));
+		}
 	}
 
 	if (anon_guild != Anonymization::None && pGuild)
 	{
 		const char* guild_name = pGuild->GetGuildName(pLocalPC->GuildID);
-		if (guild_name[0] != '\0' && ci_equals(new_text, guild_name, false))
-		{
-			auto memoized = guild_memoization.find(guild_name);
-			if (memoized == guild_memoization.end())
-				memoized = guild_memoization.emplace(
-					guild_name,
-					std::make_unique<anon_replacer>(guild_name, Anonymization::Asterisk)
-				).first;
-
-			new_text = memoized->second->replace_text(new_text);
-		}
+		if (guild_name[0] != '\0')
+			matcher.add(GetMemoizedReplacer(guild_memoization, guild_name, Anonymization::Asterisk));
 
 		for (GuildMember* pMember = pGuild->pFirstGuildMember; pMember; pMember = pMember->pNext)
 		{
-			if (pMember->Name[0] != '\0' && ci_equals(new_text, pMember->Name, false))
-			{
-				auto memoized = guild_memoization.find(pMember->Name);
-				if (memoized == guild_memoization.end())
-					memoized = guild_memoization.emplace(
-						pMember->Name,
-						std::make_unique<anon_replacer>(pMember->Name, anon_guild)
-					).first;
-
-				new_text = memoized->second->replace_text(new_text);
-			}
+			if (pMember->Name[0] != '\0')
+				matcher.add(GetMemoizedReplacer(guild_memoization, pMember->Name, anon_guild));
 		}
 	}
 
-	if (anon_raid != Anonymization::None)
+	if (anon_raid != Anonymization::None && pRaid)
 	{
-		for (RaidMember& pMember : pRaid->RaidMember)
+		for (const RaidMember& pMember : pRaid->RaidMember)
 		{
-			if (pMember.Name[0] != '\0' && ci_equals(new_text, pMember.Name, false))
-			{
-				auto memoized = raid_memoization.find(pMember.Name);
-				if (memoized == raid_memoization.end())
-					memoized = raid_memoization.emplace(
-						pMember.Name,
-						std::make_unique<anon_replacer>(pMember.Name, anon_raid)
-					).first;
-
-				new_text = memoized->second->replace_text(new_text);
-			}
+			if (pMember.Name[0] != '\0')
+				matcher.add(GetMemoizedReplacer(raid_memoization, pMember.Name, anon_raid));
 		}
 	}
 
+	// creating replacers above bumps the generation too
+	matcher_generation = anon_generation;
+}
+
+CXStr Anonymize(const CXStr& Text)
+{
+	if (!MaybeAnonymize(Text))
+		return Text;
+
+	if (!pLocalPlayer || !pLocalPC)
+		return Text;
+
+	EnterMQ2Benchmark(bmAnonymizer);
+
+	const uint64_t now = MQGetTickCount64();
+	if (now - members_checked_at >= MEMBERS_CHECK_INTERVAL_MS)
+	{
+		members_checked_at = now;
+		if (test_and_set(members_signature, GetMembersSignature()))
+			++anon_generation;
+
+		// replacements show things like levels, so they don't stay cached for long
+		anonymized_text.clear();
+	}
+
+	if (matcher_generation != anon_generation)
+		RebuildMatcher();
+
+	std::string_view text{ Text.c_str(), Text.length() };
+	auto cached = anonymized_text.find(text);
+	if (cached == anonymized_text.end())
+	{
+		if (anonymized_text.size() >= MAX_ANONYMIZED_TEXT)
+			anonymized_text.clear();
+
+		cached = anonymized_text.emplace(std::string(text), matcher.replace_text(text)).first;
+	}
+
+	CXStr result(cached->second);
+
 	ExitMQ2Benchmark(bmAnonymizer);
 
-	return CXStr(new_text);
+	return result;
 }
 
 DETOUR_TRAMPOLINE_DEF(float, GetGaugeValueFromEQ_Trampoline, (int, CXStr*, bool*, unsigned long*))
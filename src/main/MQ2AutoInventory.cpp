@@ -19,6 +19,7 @@
 #include <list>
 #include <map>
 #include <string>
+#include <unordered_map>
 
 namespace mq {
 
@@ -68,11 +69,64 @@ namespace AutoInventory {
 	class CBarterSearchWnd_Hook;
 }
 
+// The values of the money strings in the value columns. A sort compares every row many times, so
+// each string is only parsed the first time it is seen (or not at all, when we formatted it
+// ourselves). The lists only ever show a few thousand distinct amounts.
+class MoneyStringValues
+{
+	struct Hasher
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view str) const { return std::hash<std::string_view>()(str); }
+	};
+
+	using ValueMap = std::unordered_map<std::string, int64_t, Hasher, std::equal_to<>>;
+
+public:
+	static constexpr size_t MaxEntries = 8192;
+
+	void Add(std::string_view str, GetMoneyFromStringFormat format, int64_t value)
+	{
+		ValueMap& values = GetValues(format);
+		if (values.size() >= MaxEntries)
+			values.clear();
+
+		values.insert_or_assign(std::string(str), value);
+	}
+
+	int64_t Get(const CXStr& str, GetMoneyFromStringFormat format)
+	{
+		if (str.empty())
+			return -1;
+
+		ValueMap& values = GetValues(format);
+
+		std::string_view key{ str.c_str(), str.length() };
+		auto iter = values.find(key);
+		if (iter != values.end())
+			return iter->second;
+
+		int64_t value = static_cast<int64_t>(GetMoneyFromString(str.c_str(), format));
+		Add(key, format, value);
+		return value;
+	}
+
+private:
+	ValueMap& GetValues(GetMoneyFromStringFormat format)
+	{
+		return format == GetMoneyFromStringFormat::Short ? m_short : m_long;
+	}
+
+	ValueMap m_long;
+	ValueMap m_short;
+};
+static MoneyStringValues s_moneyStringValues;
+
 static int CompareMoneyStrings(SListWndSortInfo* sInfo, GetMoneyFromStringFormat format)
 {
-	int64_t value1 = static_cast<int64_t>(!sInfo->StrLabel1.empty() ? GetMoneyFromString(sInfo->StrLabel1.c_str(), format) : -1);
-	int64_t value2 = static_cast<int64_t>(!sInfo->StrLabel2.empty() ? GetMoneyFromString(sInfo->StrLabel2.c_str(), format) : -1);
-	return static_cast<int>(value1 - value2);
+	int64_t value1 = s_moneyStringValues.Get(sInfo->StrLabel1, format);
+	int64_t value2 = s_moneyStringValues.Get(sInfo->StrLabel2, format);
+	return (value1 > value2) - (value1 < value2);
 }
 
 #if HAS_FIND_ITEM_WINDOW
@@ -131,6 +185,10 @@ public:
 
 					for (int i = 0; i < list->ItemsArray.Count && i < 900; i++)
 					{
+						// rows that are still there from the last update already have their checkbox and value
+						if (list->GetItemWnd(i, MarkCol))
+							continue;
+
 						sprintf_s(szTemp2, "FIW_CheckBox_%d", i);
 						pDisableConnectionTemplate->strName = szTemp2;
 						pDisableConnectionTemplate->strScreenId = szTemp2;
@@ -179,6 +237,9 @@ public:
 									{
 										int sellprice = ptr->ValueSellMerchant(1.05f, 1);
 										FormatMoneyString(szTemp3, lengthof(szTemp3), static_cast<uint64_t>(sellprice), GetMoneyFromStringFormat::Long);
+
+										// the sort doesn't have to parse it back
+										s_moneyStringValues.Add(szTemp3, GetMoneyFromStringFormat::Long, sellprice);
 									}
 
 									list->SetItemText(i, ValueCol, szTemp3);
@@ -760,6 +821,7 @@ public:
 				{
 					int sellPrice = pItem->ValueSellMerchant(1.05f, 1);
 					FormatMoneyString(szLabel, lengthof(szLabel), sellPrice, GetMoneyFromStringFormat::Short);
+					s_moneyStringValues.Add(szLabel, GetMoneyFromStringFormat::Short, sellPrice);
 				}
 
 				pThis->plistInventory->SetItemText(i, BarterValueCol, szLabel);
@@ -14,43 +14,382 @@
 
 #include "pch.h"
 #include "MQ2Main.h"
+#include "MQSamplingProfiler.h"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
 
 namespace mq {
 
-std::vector<std::unique_ptr<MQBenchmark>> gBenchmarks;
+// Samples are counted in log-linear buckets: values below 8us get a bucket each, and every power
+// of two above that is split into 8 buckets, so a bucket is never wider than 1/8th of its values.
+static constexpr uint32_t BenchmarkSubBuckets = 8;
+static constexpr uint32_t BenchmarkBuckets = 30 * BenchmarkSubBuckets;     // Up to 2^32us
+static constexpr uint32_t MaxBenchmarks = 1024;
 
-uint32_t AddMQ2Benchmark(const char* Name)
+struct BenchmarkRecord
 {
-	DebugSpew("AddMQ2Benchmark(%s)", Name);
+	std::string name;
+	uint32_t timelineName = 0;
 
-	// find an unused index from members.
-	int index = -1;
-	for (int i = 0; i < (int)gBenchmarks.size(); ++i)
+	std::atomic<uint64_t> lastTime = 0;
+	std::atomic<uint64_t> totalTime = 0;
+	std::atomic<uint64_t> count = 0;
+	std::atomic<uint64_t> maxTime = 0;
+	std::array<std::atomic<uint32_t>, BenchmarkBuckets> buckets = {};
+
+	explicit BenchmarkRecord(const char* name) : name(name) {}
+};
+
+// Benchmarks are entered from worker threads too, so the slots are atomic, and removed benchmarks
+// are kept until shutdown in case another thread is still on its way out of them.
+static std::array<std::atomic<BenchmarkRecord*>, MaxBenchmarks> s_benchmarks = {};
+static std::vector<std::unique_ptr<BenchmarkRecord>> s_retiredBenchmarks;
+static std::mutex s_benchmarksMutex;
+
+struct BenchmarkEntry
+{
+	uint32_t handle;
+	std::chrono::steady_clock::time_point entry;
+};
+static thread_local std::vector<BenchmarkEntry> t_benchmarkStack;
+
+//----------------------------------------------------------------------------
+// Frame timeline. Every benchmark sample, plugin callback and timeline zone is also written to a
+// ring buffer, along with a marker for each frame, so /benchmark capture can write out the last
+// frames as a trace for chrome://tracing or Perfetto. Writers claim the next slot in the ring
+// without taking a lock, and each slot carries the index it was written for, so the reader can
+// skip events that were overwritten while it was copying them.
+
+static constexpr uint32_t TimelineCapacity = 1 << 16;
+static constexpr int DefaultCaptureFrames = 300;
+
+struct TimelineEvent
+{
+	std::atomic<uint64_t> sequence = 0;            // index + 1 once written, 0 while being written
+	std::atomic<uint32_t> name = 0;
+	std::atomic<uint32_t> category = 0;
+	std::atomic<uint32_t> thread = 0;
+	std::atomic<int64_t> start = 0;                // ns since s_timelineEpoch
+	std::atomic<int64_t> duration = 0;
+};
+
+static std::array<TimelineEvent, TimelineCapacity> s_timeline;
+static std::atomic<uint64_t> s_timelineNext = 0;
+static const std::chrono::steady_clock::time_point s_timelineEpoch = std::chrono::steady_clock::now();
+
+// Names of events are interned, so that an event is small enough to write without allocating.
+static std::vector<std::string> s_timelineNames = { std::string() };
+static std::unordered_map<std::string, uint32_t> s_timelineNameIds;
+static std::mutex s_timelineNamesMutex;
+
+static const uint32_t s_timelineBenchmark = InternTimelineName("Benchmark");
+static const uint32_t s_timelineFrame = InternTimelineName("Frame");
+static const uint32_t s_timelineZone = InternTimelineName("Zone");
+
+static std::chrono::steady_clock::time_point s_lastTimelineFrame;
+
+uint32_t InternTimelineName(std::string_view name)
+{
+	std::scoped_lock lock(s_timelineNamesMutex);
+
+	std::string key{ name };
+	auto iter = s_timelineNameIds.find(key);
+	if (iter != s_timelineNameIds.end())
+		return iter->second;
+
+	const uint32_t id = static_cast<uint32_t>(s_timelineNames.size());
+	s_timelineNames.push_back(key);
+	s_timelineNameIds.emplace(std::move(key), id);
+	return id;
+}
+
+void AddTimelineEvent(uint32_t name, uint32_t category,
+	std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+	static thread_local const uint32_t t_threadId = ::GetCurrentThreadId();
+
+	const uint64_t index = s_timelineNext.fetch_add(1, std::memory_order_relaxed);
+	TimelineEvent& event = s_timeline[index & (TimelineCapacity - 1)];
+
+	event.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	event.name.store(name, std::memory_order_relaxed);
+	event.category.store(category, std::memory_order_relaxed);
+	event.thread.store(t_threadId, std::memory_order_relaxed);
+	event.start.store(std::chrono::duration_cast<std::chrono::nanoseconds>(start - s_timelineEpoch).count(), std::memory_order_relaxed);
+	event.duration.store(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), std::memory_order_relaxed);
+
+	event.sequence.store(index + 1, std::memory_order_release);
+}
+
+void AddTimelineZone(const char* Name, const char* Category,
+	std::chrono::steady_clock::time_point Start, std::chrono::steady_clock::time_point End)
+{
+	AddTimelineEvent(InternTimelineName(Name ? Name : ""),
+		Category && Category[0] ? InternTimelineName(Category) : s_timelineZone, Start, End);
+}
+
+void MarkTimelineFrame()
+{
+	const auto now = std::chrono::steady_clock::now();
+
+	if (s_lastTimelineFrame != std::chrono::steady_clock::time_point{})
+		AddTimelineEvent(s_timelineFrame, s_timelineFrame, s_lastTimelineFrame, now);
+
+	s_lastTimelineFrame = now;
+}
+
+static void AppendJsonString(fmt::memory_buffer& buffer, std::string_view text)
+{
+	buffer.push_back('"');
+
+	for (char ch : text)
 	{
-		if (gBenchmarks[i] == nullptr)
+		if (ch == '"' || ch == '\\')
 		{
-			index = i;
-			break;
+			buffer.push_back('\\');
+			buffer.push_back(ch);
 		}
+		else if (static_cast<unsigned char>(ch) < 0x20)
+		{
+			fmt::format_to(fmt::appender(buffer), "\\u{:04x}", static_cast<int>(ch));
+		}
+		else
+		{
+			buffer.push_back(ch);
+		}
+	}
+
+	buffer.push_back('"');
+}
+
+static void CaptureTimeline(int frames)
+{
+	struct CapturedEvent
+	{
+		uint32_t name;
+		uint32_t category;
+		uint32_t thread;
+		int64_t start;
+		int64_t duration;
+	};
+
+	const uint64_t end = s_timelineNext.load(std::memory_order_acquire);
+	const uint64_t begin = end > TimelineCapacity ? end - TimelineCapacity : 0;
+
+	std::vector<CapturedEvent> events;
+	events.reserve(static_cast<size_t>(end - begin));
+
+	for (uint64_t index = begin; index < end; ++index)
+	{
+		const TimelineEvent& event = s_timeline[index & (TimelineCapacity - 1)];
+		if (event.sequence.load(std::memory_order_acquire) != index + 1)
+			continue;
+
+		CapturedEvent captured;
+		captured.name = event.name.load(std::memory_order_relaxed);
+		captured.category = event.category.load(std::memory_order_relaxed);
+		captured.thread = event.thread.load(std::memory_order_relaxed);
+		captured.start = event.start.load(std::memory_order_relaxed);
+		captured.duration = event.duration.load(std::memory_order_relaxed);
+
+		// Written again while we were reading it.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (event.sequence.load(std::memory_order_relaxed) != index + 1)
+			continue;
+
+		events.push_back(captured);
+	}
+
+	// Keep everything that ends after the start of the oldest frame that was asked for.
+	std::vector<int64_t> frameStarts;
+	for (const CapturedEvent& event : events)
+	{
+		if (event.name == s_timelineFrame && event.category == s_timelineFrame)
+			frameStarts.push_back(event.start);
+	}
+
+	if (frameStarts.empty())
+	{
+		WriteChatColor("No frames have been recorded yet.", CONCOLOR_YELLOW);
+		return;
 	}
 
-	if (index == -1)
+	std::sort(frameStarts.begin(), frameStarts.end(), std::greater<>());
+	const size_t frameCount = std::min<size_t>(frameStarts.size(), frames);
+	const int64_t from = frameStarts[frameCount - 1];
+
+	events.erase(std::remove_if(events.begin(), events.end(),
+		[from](const CapturedEvent& event) { return event.start + event.duration < from; }), events.end());
+
+	std::vector<std::string> names;
 	{
-		gBenchmarks.emplace_back();
-		index = static_cast<int>(gBenchmarks.size()) - 1;
+		std::scoped_lock lock(s_timelineNamesMutex);
+		names = s_timelineNames;
 	}
 
-	gBenchmarks[index] = std::make_unique<MQBenchmark>(Name);
-	return index;
+	auto getName = [&names](uint32_t id) -> std::string_view { return id < names.size() ? names[id] : std::string_view(); };
+
+	fmt::memory_buffer buffer;
+	fmt::format_to(fmt::appender(buffer), "{{\"traceEvents\":[");
+
+	const DWORD processId = GetCurrentProcessId();
+	bool first = true;
+	for (const CapturedEvent& event : events)
+	{
+		if (!first)
+			buffer.push_back(',');
+		first = false;
+
+		fmt::format_to(fmt::appender(buffer), "\n{{\"name\":");
+		AppendJsonString(buffer, getName(event.name));
+		fmt::format_to(fmt::appender(buffer), ",\"cat\":");
+		AppendJsonString(buffer, getName(event.category));
+		fmt::format_to(fmt::appender(buffer), ",\"ph\":\"X\",\"ts\":{:.3f},\"dur\":{:.3f},\"pid\":{},\"tid\":{}}}",
+			(event.start - from) / 1000.0, event.duration / 1000.0, processId, event.thread);
+	}
+
+	fmt::format_to(fmt::appender(buffer), "\n],\"displayTimeUnit\":\"ms\"}}\n");
+
+	time_t curr_time;
+	time(&curr_time);
+
+	std::tm local_tm;
+	localtime_s(&local_tm, &curr_time);
+
+	const std::filesystem::path path = std::filesystem::path(mq::internal_paths::Logs)
+		/ fmt::format("Timeline_{:04d}{:02d}{:02d}_{:02d}{:02d}{:02d}.json",
+			local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday,
+			local_tm.tm_hour, local_tm.tm_min, local_tm.tm_sec);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		WriteChatf("\arCouldn't open %s for writing.", path.string().c_str());
+		return;
+	}
+
+	file.write(buffer.data(), buffer.size());
+
+	WriteChatf("Wrote \at%d\ax frames (\at%d\ax events) to \ay%s\ax", static_cast<int>(frameCount),
+		static_cast<int>(events.size()), path.string().c_str());
+}
+
+//----------------------------------------------------------------------------
+
+static uint32_t GetBenchmarkBucket(uint64_t value)
+{
+	if (value < BenchmarkSubBuckets)
+		return static_cast<uint32_t>(value);
+
+	value = std::min<uint64_t>(value, std::numeric_limits<uint32_t>::max());
+
+	uint32_t exponent = 0;
+	while ((value >> (exponent + 1)) != 0)
+		++exponent;
+
+	const uint32_t subBucket = static_cast<uint32_t>(value >> (exponent - 3)) & (BenchmarkSubBuckets - 1);
+	return (exponent - 2) * BenchmarkSubBuckets + subBucket;
+}
+
+// The largest value that is counted in a bucket.
+static uint64_t GetBenchmarkBucketLimit(uint32_t bucket)
+{
+	if (bucket < BenchmarkSubBuckets)
+		return bucket;
+
+	const uint32_t exponent = bucket / BenchmarkSubBuckets + 2;
+	const uint64_t subBucket = bucket % BenchmarkSubBuckets;
+	return ((BenchmarkSubBuckets + subBucket + 1) << (exponent - 3)) - 1;
+}
+
+static BenchmarkRecord* GetBenchmarkRecord(uint32_t BMHandle)
+{
+	if (BMHandle >= MaxBenchmarks)
+		return nullptr;
+
+	return s_benchmarks[BMHandle].load(std::memory_order_acquire);
+}
+
+static MQBenchmark GetBenchmarkSnapshot(const BenchmarkRecord& record)
+{
+	MQBenchmark benchmark(record.name);
+	benchmark.LastTime = std::chrono::microseconds(record.lastTime.load(std::memory_order_relaxed));
+	benchmark.TotalTime = std::chrono::microseconds(record.totalTime.load(std::memory_order_relaxed));
+	benchmark.Count = record.count.load(std::memory_order_relaxed);
+	benchmark.MaxTime = std::chrono::microseconds(record.maxTime.load(std::memory_order_relaxed));
+
+	std::array<uint32_t, BenchmarkBuckets> buckets;
+	uint64_t samples = 0;
+	for (uint32_t i = 0; i < BenchmarkBuckets; ++i)
+	{
+		buckets[i] = record.buckets[i].load(std::memory_order_relaxed);
+		samples += buckets[i];
+	}
+
+	if (samples == 0)
+		return benchmark;
+
+	auto percentile = [&](double fraction)
+	{
+		const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(samples * fraction)));
+
+		uint64_t seen = 0;
+		for (uint32_t i = 0; i < BenchmarkBuckets; ++i)
+		{
+			seen += buckets[i];
+			if (seen >= rank)
+				return std::chrono::microseconds(std::min(GetBenchmarkBucketLimit(i), static_cast<uint64_t>(benchmark.MaxTime.count())));
+		}
+
+		return benchmark.MaxTime;
+	};
+
+	benchmark.P50Time = percentile(0.50);
+	benchmark.P95Time = percentile(0.95);
+	benchmark.P99Time = percentile(0.99);
+	return benchmark;
+}
+
+uint32_t AddMQ2Benchmark(const char* Name)
+{
+	DebugSpew("AddMQ2Benchmark(%s)", Name);
+
+	std::scoped_lock lock(s_benchmarksMutex);
+
+	// find an unused index from members.
+	for (uint32_t i = 0; i < MaxBenchmarks; ++i)
+	{
+		if (s_benchmarks[i].load(std::memory_order_relaxed) == nullptr)
+		{
+			auto record = new BenchmarkRecord(Name);
+			record->timelineName = InternTimelineName(Name);
+
+			s_benchmarks[i].store(record, std::memory_order_release);
+			return i;
+		}
+	}
+
+	DebugSpewAlways("AddMQ2Benchmark(%s) failed: too many benchmarks", Name);
+	return UINT32_MAX;
 }
 
 void RemoveMQ2Benchmark(uint32_t BMHandle)
 {
 	DebugSpewAlways("RemoveMQ2Benchmark()");
 
-	if (BMHandle < gBenchmarks.size() && gBenchmarks[BMHandle])
+	std::scoped_lock lock(s_benchmarksMutex);
+
+	BenchmarkRecord* record = BMHandle < MaxBenchmarks ? s_benchmarks[BMHandle].exchange(nullptr) : nullptr;
+	if (record)
 	{
-		gBenchmarks[BMHandle].reset();
+		s_retiredBenchmarks.emplace_back(record);
 	}
 	else
 	{
@@ -60,46 +399,87 @@ void RemoveMQ2Benchmark(uint32_t BMHandle)
 
 void EnterMQ2Benchmark(uint32_t BMHandle)
 {
-	if (BMHandle < gBenchmarks.size() && gBenchmarks[BMHandle])
+	if (GetBenchmarkRecord(BMHandle))
 	{
-		gBenchmarks[BMHandle]->Entry = std::chrono::steady_clock::now();
+		t_benchmarkStack.push_back({ BMHandle, std::chrono::steady_clock::now() });
 	}
 }
 
 void ExitMQ2Benchmark(uint32_t BMHandle)
 {
-	if (BMHandle < gBenchmarks.size() && gBenchmarks[BMHandle])
-	{
-		MQBenchmark& benchmark = *gBenchmarks[BMHandle];
+	const auto now = std::chrono::steady_clock::now();
 
-		std::chrono::microseconds Time = std::chrono::duration_cast<std::chrono::microseconds>(
-			std::chrono::steady_clock::now() - benchmark.Entry);
+	// Usually the top of the stack, unless benchmarks were left out of order.
+	auto iter = std::find_if(t_benchmarkStack.rbegin(), t_benchmarkStack.rend(),
+		[BMHandle](const BenchmarkEntry& entry) { return entry.handle == BMHandle; });
+	if (iter == t_benchmarkStack.rend())
+		return;
 
-		benchmark.LastTime += Time;
-		if (benchmark.Count > 4000000000)
-		{
-			benchmark.Count = 1;
-			benchmark.TotalTime = Time;
-		}
-		else
-		{
-			benchmark.Count++;
-			benchmark.TotalTime += Time;
-		}
+	const auto entry = iter->entry;
+	t_benchmarkStack.erase(std::next(iter).base());
+
+	BenchmarkRecord* record = GetBenchmarkRecord(BMHandle);
+	if (!record)
+		return;
+
+	const uint64_t time = std::chrono::duration_cast<std::chrono::microseconds>(now - entry).count();
+
+	record->lastTime.fetch_add(time, std::memory_order_relaxed);
+	record->totalTime.fetch_add(time, std::memory_order_relaxed);
+	record->count.fetch_add(1, std::memory_order_relaxed);
+	record->buckets[GetBenchmarkBucket(time)].fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t maxTime = record->maxTime.load(std::memory_order_relaxed);
+	while (time > maxTime && !record->maxTime.compare_exchange_weak(maxTime, time, std::memory_order_relaxed))
+	{
 	}
+
+	AddTimelineEvent(record->timelineName, s_timelineBenchmark, entry, now);
 }
 
 bool GetMQ2Benchmark(uint32_t BMHandle, MQBenchmark& Dest)
 {
-	if (BMHandle < gBenchmarks.size() && gBenchmarks[BMHandle])
+	if (BenchmarkRecord* record = GetBenchmarkRecord(BMHandle))
 	{
-		Dest = *gBenchmarks[BMHandle]; // give them a copy of the data.
+		Dest = GetBenchmarkSnapshot(*record); // give them a copy of the data.
 		return true;
 	}
 
 	return false;
 }
 
+std::vector<MQBenchmark> GetMQ2Benchmarks()
+{
+	std::vector<MQBenchmark> benchmarks;
+
+	for (const auto& slot : s_benchmarks)
+	{
+		if (const BenchmarkRecord* record = slot.load(std::memory_order_acquire))
+			benchmarks.push_back(GetBenchmarkSnapshot(*record));
+	}
+
+	return benchmarks;
+}
+
+void ResetMQ2BenchmarkLastTimes()
+{
+	for (const auto& slot : s_benchmarks)
+	{
+		if (BenchmarkRecord* record = slot.load(std::memory_order_acquire))
+			record->lastTime.store(0, std::memory_order_relaxed);
+	}
+}
+
+static void WriteBenchmark(const MQBenchmark& bench)
+{
+	float avgMs = bench.Count ? bench.TotalTime.count() / static_cast<float>(bench.Count) / 1000.f : 0;
+	float totalMs = bench.TotalTime.count() / 1000.f;
+
+	WriteChatf("[\ay%s\ax] \at%I64u\ax runs, \at%.3f\axms total, \at%.3f\axms avg, \at%.3f\ax/\at%.3f\ax/\at%.3f\axms p50/p95/p99, \at%.3f\axms max",
+		bench.Name.c_str(), bench.Count, totalMs, avgMs, bench.P50Time.count() / 1000.f, bench.P95Time.count() / 1000.f,
+		bench.P99Time.count() / 1000.f, bench.MaxTime.count() / 1000.f);
+}
+
 void Cmd_DumpBenchmarks(SPAWNINFO* pChar, char* szLine)
 {
 	// Execute and time a command starting with '/'
@@ -112,22 +492,64 @@ void Cmd_DumpBenchmarks(SPAWNINFO* pChar, char* szLine)
 		return;
 	}
 
+	// "/benchmark capture [frames]" writes the most recent frames of the timeline to a trace file
+	if (szLine && ci_starts_with(szLine, "capture") && (szLine[7] == 0 || szLine[7] == ' '))
+	{
+		char szFrames[MAX_STRING] = { 0 };
+		GetArg(szFrames, szLine, 2);
+
+		int frames = GetIntFromString(szFrames, DefaultCaptureFrames);
+		if (frames <= 0)
+			frames = DefaultCaptureFrames;
+
+		CaptureTimeline(frames);
+		return;
+	}
+
+	// "/benchmark sample [seconds] [interval ms]" samples the main thread from a helper thread
+	if (szLine && ci_starts_with(szLine, "sample") && (szLine[6] == 0 || szLine[6] == ' '))
+	{
+		char szSeconds[MAX_STRING] = { 0 };
+		GetArg(szSeconds, szLine, 2);
+		char szInterval[MAX_STRING] = { 0 };
+		GetArg(szInterval, szLine, 3);
+
+		const float seconds = std::max(GetFloatFromString(szSeconds, 10.0f), 0.1f);
+		const float interval = std::max(GetFloatFromString(szInterval, 1.0f), 0.1f);
+
+		if (SamplingProfiler_Start(std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000)),
+			std::chrono::microseconds(static_cast<int64_t>(interval * 1000))))
+		{
+			WriteChatf("Sampling the main thread for \at%.1f\axs. The profile is shown in the Sampling Profiler inspector of the developer tools.", seconds);
+		}
+		else
+		{
+			WriteChatColor("The main thread is already being sampled.", CONCOLOR_YELLOW);
+		}
+		return;
+	}
+
+	// "/benchmark engines [save]" times the core engines, and compares them to the saved baseline
+	if (szLine && ci_starts_with(szLine, "engines") && (szLine[7] == 0 || szLine[7] == ' '))
+	{
+		char szArg[MAX_STRING] = { 0 };
+		GetArg(szArg, szLine, 2);
+
+		RunEngineBenchmarks(ci_equals(szArg, "save"));
+		return;
+	}
+
 	// Since it doesn't start with a slash, let's check there is a benchmark name to match
 	// "/benchmark mq2nav" for example
 	if (szLine && szLine[0])
 	{
-		for (const auto& bench : gBenchmarks)
+		for (const MQBenchmark& bench : GetMQ2Benchmarks())
 		{
-			if (bench && ci_equals(bench->Name, szLine))
+			if (ci_equals(bench.Name, szLine))
 			{
 				WriteChatf("Start %s Benchmark", szLine);
 				WriteChatColor("--------------");
-
-				float avgMs = bench->Count ? bench->TotalTime.count() / static_cast<float>(bench->Count) / 1000.f : 0;
-				float totalMs = bench->TotalTime.count() / 1000.f;
-
-				WriteChatf("[\ay%s\ax] \at%I64u\ax runs, \at%.3f\axms total, \at%.3f\axms avg",
-					bench->Name.c_str(), bench->Count, totalMs, avgMs);
+				WriteBenchmark(bench);
 				WriteChatf("End %s Benchmark", szLine);
 				WriteChatColor("--------------");
 				return;
@@ -141,16 +563,9 @@ void Cmd_DumpBenchmarks(SPAWNINFO* pChar, char* szLine)
 	{
 		WriteChatColor("MQ Benchmarks");
 		WriteChatColor("--------------");
-		for (const auto& bench : gBenchmarks)
+		for (const MQBenchmark& bench : GetMQ2Benchmarks())
 		{
-			if (bench)
-			{
-				float avgMs = bench->Count ? bench->TotalTime.count() / static_cast<float>(bench->Count) / 1000.f : 0;
-				float totalMs = bench->TotalTime.count() / 1000.f;
-
-				WriteChatf("[\ay%s\ax] \at%I64u\ax runs, \at%.3f\axms total, \at%.3f\axms avg",
-					bench->Name.c_str(), bench->Count, totalMs, avgMs);
-			}
+			WriteBenchmark(bench);
 		}
 		WriteChatColor("--------------");
 		WriteChatColor("End Benchmarks");
@@ -162,18 +577,16 @@ void DumpBenchmarks()
 	DebugSpewAlways("MQ2 Benchmarks");
 	DebugSpewAlways("--------------");
 
-	for (auto& pBenchmark : gBenchmarks)
+	for (const MQBenchmark& benchmark : GetMQ2Benchmarks())
 	{
-		if (pBenchmark)
-		{
-			float AvgMS = 0;
-			if (pBenchmark->Count)
-				AvgMS = static_cast<float>(pBenchmark->TotalTime.count()) / static_cast<float>(pBenchmark->Count) / 1000.f;
-			float TotalMS = static_cast<float>(pBenchmark->TotalTime.count()) / 1000.f;
+		float AvgMS = 0;
+		if (benchmark.Count)
+			AvgMS = static_cast<float>(benchmark.TotalTime.count()) / static_cast<float>(benchmark.Count) / 1000.f;
+		float TotalMS = static_cast<float>(benchmark.TotalTime.count()) / 1000.f;
 
-			DebugSpewAlways("%-40s  %d for %.3fms, %.3fms avg",
-				pBenchmark->Name.c_str(), pBenchmark->Count, TotalMS, AvgMS);
-		}
+		DebugSpewAlways("%-40s  %I64u for %.3fms, %.3fms avg, %.3fms p99, %.3fms max",
+			benchmark.Name.c_str(), benchmark.Count, TotalMS, AvgMS,
+			benchmark.P99Time.count() / 1000.f, benchmark.MaxTime.count() / 1000.f);
 	}
 
 	DebugSpewAlways("--------------");
@@ -191,10 +604,17 @@ void ShutdownMQ2Benchmarks()
 {
 	DebugSpew("Shutting down MQ2 Benchmarks");
 
+	SamplingProfiler_Shutdown();
+
 	DumpBenchmarks();
 	RemoveCommand("/benchmark");
 
-	gBenchmarks.clear();
+	std::scoped_lock lock(s_benchmarksMutex);
+
+	for (auto& slot : s_benchmarks)
+		delete slot.exchange(nullptr);
+
+	s_retiredBenchmarks.clear();
 }
 
 } // namespace mq
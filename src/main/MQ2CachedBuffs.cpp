@@ -16,49 +16,136 @@
 #include "MQ2Main.h"
 
 #include <optional>
+#include <unordered_map>
 
 namespace mq {
 
+// How long before a buff runs out that it is reported as expiring, in milliseconds.
+static DWORD s_buffExpiringThreshold = 30000;
+
+// Changes to the cached buffs, as they happen and as they are published for the pulse.
+static std::vector<CachedBuffChange> s_pendingBuffChanges;
+static std::vector<CachedBuffChange> s_buffChanges;
+
+static void AddBuffChange(int spawnID, const CachedBuff& buff, CachedBuffChangeType type)
+{
+	s_pendingBuffChanges.push_back({ static_cast<uint32_t>(spawnID), buff.spellId, buff.slot, type,
+		type == CachedBuffChangeType::Lost ? 0 : buff.Duration() });
+}
+
 class SpawnBuffs
 {
 public:
+	explicit SpawnBuffs(int spawnID) : spawnID(spawnID) {}
+
+	const int spawnID;
+
 	// timestamp of buff packet, target buff received in packet
 	std::vector<CachedBuff> cachedBuffs;
 
-	void Clear() noexcept { cachedBuffs.clear(); }
+	// Changes whenever the buffs do. Epochs are never reused, not even by other spawns.
+	uint32_t epoch = NextEpoch();
+
+	void Clear() noexcept
+	{
+		cachedBuffs.clear();
+		nextExpiry = NoExpiry;
+		nextWarning = NoExpiry;
+		epoch = NextEpoch();
+	}
+
+	// Replaces the buffs with the ones from a full buff packet, and reports what was gained and lost.
+	void Replace(std::vector<CachedBuff>&& buffs)
+	{
+		// Anything that ran out or started expiring before the packet is reported first.
+		Audit();
+
+		auto sameBuff = [](const CachedBuff& a, const CachedBuff& b) { return a.slot == b.slot && a.spellId == b.spellId; };
+
+		for (const CachedBuff& buff : cachedBuffs)
+		{
+			if (std::none_of(std::begin(buffs), std::end(buffs), [&](const CachedBuff& b) { return sameBuff(buff, b); }))
+				AddBuffChange(spawnID, buff, CachedBuffChangeType::Lost);
+		}
+
+		for (const CachedBuff& buff : buffs)
+		{
+			if (std::none_of(std::begin(cachedBuffs), std::end(cachedBuffs), [&](const CachedBuff& b) { return sameBuff(buff, b); }))
+				AddBuffChange(spawnID, buff, CachedBuffChangeType::Gained);
+		}
+
+		Clear();
+		for (CachedBuff& buff : buffs)
+			Emplace(buff);
+
+		// The durations start over from the packet, only report the buffs that cross the threshold after it.
+		lastAudit = EQGetTime();
+	}
 
 	void Audit()
 	{
-		if (!pZoneInfo || !pZoneInfo->bNoBuffExpiration)
+		// Nothing can have expired or started expiring before the buff that does so first, so most
+		// audits stop here.
+		const DWORD now = EQGetTime();
+		const DWORD lastAudited = std::exchange(lastAudit, now);
+		if (now < nextExpiry && now < nextWarning)
+			return;
+
+		const bool buffsExpire = !pZoneInfo || !pZoneInfo->bNoBuffExpiration;
+		if (buffsExpire)
 		{
-			cachedBuffs.erase(std::remove_if(std::begin(cachedBuffs), std::end(cachedBuffs),
-				[](const CachedBuff& buff) { return buff.duration >= 0 && buff.Duration() == 0U; }), std::end(cachedBuffs));
+			for (const CachedBuff& buff : cachedBuffs)
+			{
+				if (buff.duration < 0)
+					continue;
+
+				const DWORD warnAt = WarningTime(buff);
+				if (warnAt > lastAudited && warnAt <= now && buff.Duration() > 0U)
+					AddBuffChange(spawnID, buff, CachedBuffChangeType::Expiring);
+			}
+
+			auto expired = std::remove_if(std::begin(cachedBuffs), std::end(cachedBuffs),
+				[](const CachedBuff& buff) { return buff.duration >= 0 && buff.Duration() == 0U; });
+			if (expired != std::end(cachedBuffs))
+			{
+				for (auto iter = expired; iter != std::end(cachedBuffs); ++iter)
+					AddBuffChange(spawnID, *iter, CachedBuffChangeType::Lost);
+
+				cachedBuffs.erase(expired, std::end(cachedBuffs));
+				epoch = NextEpoch();
+			}
 		}
+
+		nextExpiry = NoExpiry;
+		nextWarning = NoExpiry;
+		for (const CachedBuff& buff : cachedBuffs)
+			UpdateNextExpiry(buff);
+
+		// Zones without buff expiration keep their buffs, check again in a second instead of every time.
+		if (nextExpiry <= now)
+			nextExpiry = now + 1000;
+		if (!buffsExpire)
+			nextWarning = NoExpiry;
 	}
 
 	template <typename ...Args>
 	void Emplace(Args&& ... args)
 	{
 		// by virtue of how we add to this vector, we won't have duplicates since we always clear before
-		cachedBuffs.emplace_back(std::forward<Args>(args)...);
-	}
-
-	auto Drop(std::function<bool(CachedBuff)> predicate)
-	{
-		return std::remove_if(std::begin(cachedBuffs), std::end(cachedBuffs),
-			[&predicate](CachedBuff buff) { return predicate(buff); });
+		UpdateNextExpiry(cachedBuffs.emplace_back(std::forward<Args>(args)...));
+		epoch = NextEpoch();
 	}
 
 	void Drop(int index)
 	{
 		cachedBuffs.erase(std::begin(cachedBuffs) + index);
+		epoch = NextEpoch();
 	}
 
-	std::optional<CachedBuff> Get(const std::function<bool(CachedBuff)>& predicate)
+	std::optional<CachedBuff> Get(const std::function<bool(const CachedBuff&)>& predicate)
 	{
 		Audit();
-		auto buff_it = std::find_if(std::begin(cachedBuffs), std::end(cachedBuffs),
-			[&predicate](CachedBuff buff) { return predicate(buff); });
+		auto buff_it = std::find_if(std::begin(cachedBuffs), std::end(cachedBuffs), std::cref(predicate));
 
 		if (buff_it != std::end(cachedBuffs))
 			return *buff_it;
@@ -75,11 +162,11 @@ public:
 		return std::nullopt;
 	}
 
-	std::vector<CachedBuff> Filter(const std::function<bool(CachedBuff)>& predicate)
+	std::vector<CachedBuff> Filter(const std::function<bool(const CachedBuff&)>& predicate)
 	{
 		Audit();
 		std::vector<CachedBuff> ret;
-		for (auto b : cachedBuffs)
+		for (const CachedBuff& b : cachedBuffs)
 		{
 			if (predicate(b))
 				ret.emplace_back(b);
@@ -87,10 +174,49 @@ public:
 
 		return ret;
 	}
+
+private:
+	static constexpr DWORD NoExpiry = 0xFFFFFFFF;
+
+	static uint32_t NextEpoch() noexcept
+	{
+		// 0 is left for spawns without cached buffs
+		static uint32_t s_lastEpoch = 0;
+		if (++s_lastEpoch == 0)
+			++s_lastEpoch;
+		return s_lastEpoch;
+	}
+
+	static DWORD WarningTime(const CachedBuff& buff)
+	{
+		const DWORD expiry = buff.timeStamp + buff.duration * 6000;
+		return expiry > s_buffExpiringThreshold ? expiry - s_buffExpiringThreshold : 0;
+	}
+
+	void UpdateNextExpiry(const CachedBuff& buff)
+	{
+		// Negative durations never expire.
+		if (buff.duration >= 0)
+		{
+			nextExpiry = std::min<DWORD>(nextExpiry, buff.timeStamp + buff.duration * 6000);
+
+			// Buffs that were already expiring when they arrived aren't reported.
+			const DWORD warnAt = WarningTime(buff);
+			if (warnAt > lastAudit)
+				nextWarning = std::min<DWORD>(nextWarning, warnAt);
+		}
+	}
+
+	// EQGetTime of the first buff to expire, and of the first buff to start expiring.
+	DWORD nextExpiry = NoExpiry;
+	DWORD nextWarning = NoExpiry;
+
+	// EQGetTime of the last audit, buffs that started expiring after it haven't been reported.
+	DWORD lastAudit = EQGetTime();
 };
 
 // spawnID -> spawn buffs
-static std::map<int, std::unique_ptr<SpawnBuffs>> gCachedBuffMap;
+static std::unordered_map<int, std::unique_ptr<SpawnBuffs>> gCachedBuffMap;
 
 class CEverQuestHook
 {
@@ -125,8 +251,10 @@ public:
 		// full buff messages.
 		if (header.m_bComplete)
 		{
-			auto [it, result] = gCachedBuffMap.try_emplace(header.m_id, std::make_unique<SpawnBuffs>());
-			it->second->Clear();
+			auto [it, result] = gCachedBuffMap.try_emplace(header.m_id, std::make_unique<SpawnBuffs>(header.m_id));
+
+			std::vector<CachedBuff> buffs;
+			buffs.reserve(header.m_count);
 
 			for (int i = 0; i < header.m_count; i++)
 			{
@@ -138,9 +266,11 @@ public:
 				buffer.ReadString(curBuff.casterName, lengthof(curBuff.casterName));
 				curBuff.timeStamp = EQGetTime();
 
-				it->second->Emplace(curBuff);
+				buffs.push_back(curBuff);
 			}
 
+			it->second->Replace(std::move(buffs));
+
 			gTargetbuffs = true;
 		}
 
@@ -249,6 +379,21 @@ DWORD GetCachedBuffCount(SPAWNINFO* pSpawn)
 	return 0U;
 }
 
+uint32_t GetCachedBuffsEpoch(SPAWNINFO* pSpawn)
+{
+	if (pSpawn)
+	{
+		auto buffs = gCachedBuffMap.find(pSpawn->SpawnID);
+		if (buffs != std::end(gCachedBuffMap))
+		{
+			buffs->second->Audit();
+			return buffs->second->epoch;
+		}
+	}
+
+	return 0;
+}
+
 void ClearCachedBuffsSpawn(SPAWNINFO* pSpawn)
 {
 	if (pSpawn)
@@ -264,6 +409,30 @@ void ClearCachedBuffs()
 	gCachedBuffMap.clear();
 }
 
+void SetCachedBuffs(int spawnID, std::vector<CachedBuff>&& buffs)
+{
+	auto [it, result] = gCachedBuffMap.try_emplace(spawnID, std::make_unique<SpawnBuffs>(spawnID));
+	it->second->Replace(std::move(buffs));
+}
+
+void CachedBuffs_Pulse()
+{
+	// Audits are cheap until something expires, so every spawn is checked rather than waiting for a query.
+	for (auto& [_, buffs] : gCachedBuffMap)
+		buffs->Audit();
+
+	s_buffChanges.clear();
+	std::swap(s_buffChanges, s_pendingBuffChanges);
+
+	for (const CachedBuffChange& change : s_buffChanges)
+		AddBuffChangeEvent(change);
+}
+
+const std::vector<CachedBuffChange>& CachedBuffs_GetChanges()
+{
+	return s_buffChanges;
+}
+
 void CachedBuffsCommand(PlayerClient* pChar, const char* szLine)
 {
 	if (!strcmp(szLine, "cleartarget"))
@@ -293,6 +462,8 @@ void CachedBuffsCommand(PlayerClient* pChar, const char* szLine)
 
 void InitializeCachedBuffs()
 {
+	s_buffExpiringThreshold = std::max(0, GetPrivateProfileInt("MacroQuest", "BuffExpiringSeconds", 30, mq::internal_paths::MQini)) * 1000;
+
 	EzDetour(CTargetWnd__RefreshTargetBuffs,
 		&CEverQuestHook::CTargetWnd__RefreshTargetBuffs_Detour,
 		&CEverQuestHook::CTargetWnd__RefreshTargetBuffs_Trampoline);
@@ -301,6 +472,9 @@ void InitializeCachedBuffs()
 void ShutdownCachedBuffs()
 {
 	RemoveDetour(CTargetWnd__RefreshTargetBuffs);
+
+	s_pendingBuffChanges.clear();
+	s_buffChanges.clear();
 }
 
 } // namespace mq
@@ -15,16 +15,134 @@
 #include "pch.h"
 #include "MQ2Main.h"
 
+#include "MQCastState.h"
 #include "MQPluginHandler.h"
 
 #include <fmt/chrono.h>
 
+#include <array>
+#include <string>
+#include <vector>
+
 namespace mq {
 
 #if HAS_CHAT_TIMESTAMPS
 bool gbTimeStampChat = false;
 #endif
 
+//============================================================================
+// Chat filters
+//
+// The filters are compiled into buckets by the character they start with, so a line is only
+// compared against the prefix filters that start like it does, and the substring filters are all
+// found in a single pass over the line. Whether a filter is enabled is checked while matching, the
+// filters are only compiled again when the list changes.
+
+struct CompiledChatFilter
+{
+	std::string text;
+	size_t length;
+	bool* pEnabled;
+
+	bool IsEnabled() const { return !pEnabled || *pEnabled; }
+};
+
+struct ChatFilterMatcher
+{
+	bool dirty = true;
+	MQFilter* pHead = nullptr;
+
+	std::array<std::vector<CompiledChatFilter>, 256> prefixFilters;      // by lowercase first character
+	std::array<std::vector<CompiledChatFilter>, 256> substringFilters;   // by first character
+	std::vector<CompiledChatFilter> alwaysFilters;                       // filters that match any line
+	bool hasSubstringFilters = false;
+};
+
+static ChatFilterMatcher s_chatFilters;
+
+void InvalidateChatFilters()
+{
+	s_chatFilters.dirty = true;
+}
+
+static void CompileChatFilters()
+{
+	ChatFilterMatcher& matcher = s_chatFilters;
+
+	for (auto& bucket : matcher.prefixFilters)
+		bucket.clear();
+	for (auto& bucket : matcher.substringFilters)
+		bucket.clear();
+	matcher.alwaysFilters.clear();
+	matcher.hasSubstringFilters = false;
+
+	for (MQFilter* pFilter = gpFilters; pFilter; pFilter = pFilter->pNext)
+	{
+		if (pFilter->FilterText[0] == '*')
+		{
+			const char* text = pFilter->FilterText + 1;
+			CompiledChatFilter filter{ text, strlen(text), pFilter->pEnabled };
+
+			if (filter.length == 0)
+			{
+				matcher.alwaysFilters.push_back(filter);
+			}
+			else
+			{
+				matcher.substringFilters[static_cast<unsigned char>(text[0])].push_back(std::move(filter));
+				matcher.hasSubstringFilters = true;
+			}
+		}
+		else
+		{
+			CompiledChatFilter filter{ pFilter->FilterText, pFilter->Length, pFilter->pEnabled };
+
+			if (filter.length == 0)
+				matcher.alwaysFilters.push_back(filter);
+			else
+				matcher.prefixFilters[::tolower(static_cast<unsigned char>(filter.text[0]))].push_back(std::move(filter));
+		}
+	}
+
+	matcher.pHead = gpFilters;
+	matcher.dirty = false;
+}
+
+static bool IsChatFiltered(const char* szMsg)
+{
+	ChatFilterMatcher& matcher = s_chatFilters;
+
+	// Plugins can link filters into the list themselves.
+	if (matcher.dirty || matcher.pHead != gpFilters)
+		CompileChatFilters();
+
+	for (const CompiledChatFilter& filter : matcher.alwaysFilters)
+	{
+		if (filter.IsEnabled())
+			return true;
+	}
+
+	for (const CompiledChatFilter& filter : matcher.prefixFilters[::tolower(static_cast<unsigned char>(szMsg[0]))])
+	{
+		if (filter.IsEnabled() && !_strnicmp(szMsg, filter.text.c_str(), filter.length))
+			return true;
+	}
+
+	if (matcher.hasSubstringFilters)
+	{
+		for (const char* pos = szMsg; *pos; ++pos)
+		{
+			for (const CompiledChatFilter& filter : matcher.substringFilters[static_cast<unsigned char>(*pos)])
+			{
+				if (filter.IsEnabled() && !strncmp(pos, filter.text.c_str(), filter.length))
+					return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 class CChatHook
 {
 public:
@@ -42,28 +160,9 @@ public:
 			CheckChatForEvent(szMsg);
 		}
 
-		bool Filtered = false;
-		MQFilter* Filter = gpFilters;
-
-		while (Filter && !Filtered)
-		{
-			if (!Filter->pEnabled || *Filter->pEnabled)
-			{
-				if (*Filter->FilterText == '*')
-				{
-					if (strstr(szMsg, Filter->FilterText + 1))
-						Filtered = true;
-				}
-				else
-				{
-					if (!_strnicmp(szMsg, Filter->FilterText, Filter->Length))
-						Filtered = true;
-				}
-			}
-			Filter = Filter->pNext;
-		}
+		CastState_OnChat(szMsg);
 
-		if (!Filtered)
+		if (!IsChatFiltered(szMsg))
 		{
 			bool SkipTrampoline = false;
 			Benchmark(bmPluginsIncomingChat, SkipTrampoline = PluginsIncomingChat(szMsg, dwColor));
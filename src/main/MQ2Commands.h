@@ -23,6 +23,7 @@ MQLIB_API void SetError                            (PlayerClient* pChar, const c
 MQLIB_API void SuperWho                            (PlayerClient* pChar, const char* szLine);
 MQLIB_API void MacroIfCmd                               (PlayerClient* pChar, const char* szLine);
 MQLIB_API void MacroWhileCmd                            (PlayerClient* pChar, const char* szLine);
+MQLIB_API void BackgroundMacro                     (PlayerClient* pChar, const char* szLine);
 MQLIB_API void Call                                (PlayerClient* pChar, const char* szLine);
 MQLIB_API void DeclareVar                          (PlayerClient* pChar, const char* szLine);
 MQLIB_API void DumpStack                           (PlayerClient* pChar, const char* szLine);
@@ -85,6 +86,7 @@ MQLIB_API void Filter                              (PlayerClient* pChar, const c
 MQLIB_API void Help                                (PlayerClient* pChar, const char* szLine);
 MQLIB_API void Identify                            (PlayerClient* pChar, const char* szLine);
 MQLIB_API void IniOutput                           (PlayerClient* pChar, const char* szLine);
+MQLIB_API void InputSequence                       (PlayerClient* pChar, const char* szLine);
 MQLIB_API void Items                               (PlayerClient* pChar, const char* szLine);
 MQLIB_API void ItemTarget                          (PlayerClient* pChar, const char* szLine);
 MQLIB_API void WindowState                         (PlayerClient* pChar, const char* szLine);
@@ -97,6 +99,7 @@ MQLIB_API void MouseTo                             (PlayerClient* pChar, const c
 MQLIB_API void MQMsgBox                            (PlayerClient* pChar, const char* szLine);
 MQLIB_API void SellItem                            (PlayerClient* pChar, const char* szLine);
 MQLIB_API void SetAutoRun                          (PlayerClient* pChar, const char* szLine);
+MQLIB_API void ReadinessCmd                        (PlayerClient* pChar, const char* szLine);
 MQLIB_API void Skills                              (PlayerClient* pChar, const char* szLine);
 MQLIB_API void SuperWhoTarget                      (PlayerClient* pChar, const char* szLine);
 MQLIB_API void SWhoFilter                          (PlayerClient* pChar, const char* szLine);
@@ -15,20 +15,129 @@
 #include "pch.h"
 #include "MQ2Main.h"
 #include "MQDataAPI.h"
+#include "MQCastState.h"
+#include "MQPetMercState.h"
+#include "MQSpawnTriggers.h"
+#include "MQTasks.h"
 
 #include <variant>
 
 using namespace mq::datatypes;
 namespace mq {
 
+// Variables are only added and removed on the main thread, which always takes this lock to do so.
+// Lookups on the main thread therefore can't race with a change and skip it. Lookups from other
+// threads still take the lock.
 static std::recursive_mutex s_dataVarMutex;
 
+// Returns the lookup table of the macro stack frame that owns the list, if any.
+static std::unordered_map<std::string_view, MQDataVar*>* GetFrameVariableIndex(MQDataVar** ppHead)
+{
+	for (MQMacroStack* pStack = gMacroStack; pStack; pStack = pStack->pNext)
+	{
+		if (ppHead == &pStack->Parameters)
+			return &pStack->ParameterIndex;
+		if (ppHead == &pStack->LocalVariables)
+			return &pStack->LocalIndex;
+	}
+
+	return nullptr;
+}
+
+static void IndexFrameVariable(MQDataVar* pVar)
+{
+	// The newest variable is at the head of the list, so it shadows older ones with the same name.
+	if (auto pIndex = GetFrameVariableIndex(pVar->ppHead))
+		pIndex->insert_or_assign(pVar->Name, pVar);
+}
+
+static void UnindexFrameVariable(MQDataVar* pVar)
+{
+	auto pIndex = GetFrameVariableIndex(pVar->ppHead);
+	if (!pIndex)
+		return;
+
+	auto iter = pIndex->find(pVar->Name);
+	if (iter == pIndex->end() || iter->second != pVar)
+		return;
+
+	pIndex->erase(iter);
+
+	// Fall back to the next variable in the list with the same name, if there is one.
+	for (MQDataVar* pOther = *pVar->ppHead; pOther; pOther = pOther->pNext)
+	{
+		if (pOther != pVar && pOther->Name == pVar->Name)
+		{
+			pIndex->emplace(pOther->Name, pOther);
+			break;
+		}
+	}
+}
+
+void IndexMacroStackVariables(MQMacroStack* pStack)
+{
+	pStack->ParameterIndex.clear();
+	pStack->LocalIndex.clear();
+
+	// Walk from the head so that the newest variable with a name wins.
+	for (MQDataVar* pVar = pStack->Parameters; pVar; pVar = pVar->pNext)
+		pStack->ParameterIndex.emplace(pVar->Name, pVar);
+
+	for (MQDataVar* pVar = pStack->LocalVariables; pVar; pVar = pVar->pNext)
+		pStack->LocalIndex.emplace(pVar->Name, pVar);
+}
+
+// Variables are recycled, so that the parameters of a flood of events don't turn into a flood of
+// allocations. Names keep their capacity while they sit in the pool.
+static constexpr size_t MaxPooledDataVars = 256;
+static std::vector<MQDataVar*> s_dataVarPool;
+
+// Variables are accounted while they are allocated, pooled ones included.
+static MQMemoryCounters* GetDataVarMemory()
+{
+	static MQMemoryCounters* s_dataVarMemory = GetMemoryCounters("Macro Variables");
+	return s_dataVarMemory;
+}
+
+static MQDataVar* AllocateDataVar()
+{
+	if (s_dataVarPool.empty())
+	{
+		GetDataVarMemory()->Allocate(sizeof(MQDataVar));
+		return new MQDataVar();
+	}
+
+	MQDataVar* pVar = s_dataVarPool.back();
+	s_dataVarPool.pop_back();
+	return pVar;
+}
+
+static void ReleaseDataVar(MQDataVar* pVar)
+{
+	if (s_dataVarPool.size() >= MaxPooledDataVars)
+	{
+		GetDataVarMemory()->Free(sizeof(MQDataVar));
+		delete pVar;
+		return;
+	}
+
+	pVar->Name.clear();
+	pVar->Var = MQTypeVar();
+	pVar->pNext = nullptr;
+	pVar->pPrev = nullptr;
+	pVar->ppHead = nullptr;
+	s_dataVarPool.push_back(pVar);
+}
+
 void DeleteMQ2DataVariable(MQDataVar* pVar)
 {
+	assert(IsMainThread());
 	std::scoped_lock lock(s_dataVarMutex);
 
+	UnindexFrameVariable(pVar);
+
 	if (pVar->ppHead == &pMacroVariables || pVar->ppHead == &pGlobalVariables)
-		VariableMap.erase(pVar->szName);
+		VariableMap.erase(pVar->Name);
 	if (pVar->pNext)
 		pVar->pNext->pPrev = pVar->pPrev;
 	if (pVar->pPrev)
@@ -36,13 +145,11 @@ void DeleteMQ2DataVariable(MQDataVar* pVar)
 	else
 		*pVar->ppHead = pVar->pNext;
 	pVar->Var.Type->FreeVariable(pVar->Var.VarPtr);
-	delete pVar;
+	ReleaseDataVar(pVar);
 }
 
-MQDataVar* FindMacroVariable(const char* Name)
+static MQDataVar* FindMacroVariableUnsynchronized(const char* Name)
 {
-	std::scoped_lock lock(s_dataVarMutex);
-
 	MQDataVar* pFind = nullptr;
 	auto it = VariableMap.find(Name);
 	if (it != VariableMap.end())
@@ -54,26 +161,27 @@ MQDataVar* FindMacroVariable(const char* Name)
 	// local?
 	if (gMacroStack)
 	{
-		MQDataVar* pVar = gMacroStack->Parameters;
-		while (pVar)
-		{
-			if (!strcmp(pVar->szName, Name))
-				return pVar;
-			pVar = pVar->pNext;
-		}
+		if (auto iter = gMacroStack->ParameterIndex.find(Name); iter != gMacroStack->ParameterIndex.end())
+			return iter->second;
 
-		pVar = gMacroStack->LocalVariables;
-		while (pVar)
-		{
-			if (!strcmp(pVar->szName, Name))
-				return pVar;
-			pVar = pVar->pNext;
-		}
+		if (auto iter = gMacroStack->LocalIndex.find(Name); iter != gMacroStack->LocalIndex.end())
+			return iter->second;
 	}
 
 	return nullptr;
 }
 
+MQDataVar* FindMacroVariable(const char* Name)
+{
+	if (IsMainThread())
+	{
+		return FindMacroVariableUnsynchronized(Name);
+	}
+
+	std::scoped_lock lock(s_dataVarMutex);
+	return FindMacroVariableUnsynchronized(Name);
+}
+
 bool IsMacroVariable(const char* variableName)
 {
 	return FindMacroVariable(variableName) != nullptr;
@@ -140,6 +248,7 @@ static bool InitArrayValue(const std::shared_ptr<CDataArray>& pArray, const Defa
 
 static bool AddMQ2DataEventVariable(const char* Name, const char* Index, MQ2Type* pType, MQDataVar** ppHead, const DefaultValueType& defaultValue)
 {
+	assert(IsMainThread());
 	std::scoped_lock lock(s_dataVarMutex);
 
 	if (!ppHead || !Name[0])
@@ -154,14 +263,15 @@ static bool AddMQ2DataEventVariable(const char* Name, const char* Index, MQ2Type
 		return false;
 
 	// create variable
-	MQDataVar* pVar = new MQDataVar;
+	MQDataVar* pVar = AllocateDataVar();
 	pVar->ppHead = ppHead;
 	pVar->pNext = *ppHead;
 	*ppHead = pVar;
 	pVar->pPrev = nullptr;
 	if (pVar->pNext)
 		pVar->pNext->pPrev = pVar;
-	strcpy_s(pVar->szName, Name);
+	pVar->Name = Name;
+	IndexFrameVariable(pVar);
 
 	if (Index[0])
 	{
@@ -189,6 +299,7 @@ static bool AddMQ2DataEventVariable(const char* Name, const char* Index, MQ2Type
 
 static bool AddMQ2DataVariableBy(const char* Name, const char* Index, MQ2Type* pType, MQDataVar** ppHead, const DefaultValueType& defaultValue)
 {
+	assert(IsMainThread());
 	std::scoped_lock lock(s_dataVarMutex);
 
 	if (!ppHead || !Name[0])
@@ -202,14 +313,15 @@ static bool AddMQ2DataVariableBy(const char* Name, const char* Index, MQ2Type* p
 		return false;
 
 	// create variable
-	MQDataVar* pVar = new MQDataVar;
+	MQDataVar* pVar = AllocateDataVar();
 	pVar->ppHead = ppHead;
 	pVar->pNext = *ppHead;
 	*ppHead = pVar;
 	pVar->pPrev = nullptr;
 	if (pVar->pNext)
 		pVar->pNext->pPrev = pVar;
-	strcpy_s(pVar->szName, Name);
+	pVar->Name = Name;
+	IndexFrameVariable(pVar);
 
 	if (Index[0])
 	{
@@ -357,6 +469,13 @@ void DeclareVar(PlayerClient* pChar, const char* szLine)
 		}
 	}
 
+	// Outer variables and their lookups are cleared when the foreground macro ends.
+	if (pScope == &pMacroVariables && gMacroBlock && gMacroBlock->Background)
+	{
+		MacroError("/declare '%s' failed.  Background macros can't declare outer variables, use local or global instead.", szName);
+		return;
+	}
+
 	if (!pType)
 		pType = pStringType;
 	if (pType == pArrayType)
@@ -464,7 +583,7 @@ void VarSetCmd(PlayerClient* pChar, const char* szLine)
 			return;
 		}
 
-		if (!pArray->GetType()->FromString(pArray->GetData(index), szRest))
+		if (!pArray->FromString(index, szRest))
 		{
 			MacroError("/varset '%s[%d]' failed, array element type rejected new value", szName, index);
 		}
@@ -495,17 +614,6 @@ void VarCalcCmd(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
-	char szRest[MAX_STRING] = { 0 };
-	strcpy_s(szRest, pRest);
-	double Result = 0.0;
-	if (!Calculate(szRest, Result))
-	{
-		MacroError("/varcalc '%s' failed.  Could not calculate '%s'", szName, szRest);
-		return;
-	}
-
-	sprintf_s(szRest, "%f", Result);
-
 	char szIndex[MAX_STRING] = { 0 };
 	if (char* pBracket = strchr(szName, '['))
 	{
@@ -520,6 +628,12 @@ void VarCalcCmd(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
+	MQ2Type* pType = pVar->Var.Type;
+	MQVarPtr* pVarPtr = &pVar->Var.VarPtr;
+	std::shared_ptr<CDataArray> pArray;
+	MQVarPtr element;
+	int index = -1;
+
 	if (szIndex[0])
 	{
 		if (pVar->Var.Type != pArrayType)
@@ -528,25 +642,60 @@ void VarCalcCmd(PlayerClient* pChar, const char* szLine)
 			return;
 		}
 
-		auto pArray = pVar->Var.Get<CDataArray>();
-		int index = pArray->GetElement(szIndex);
+		pArray = pVar->Var.Get<CDataArray>();
+		index = pArray->GetElement(szIndex);
 		if (index == -1)
 		{
 			MacroError("/varcalc '%s[%d]' failed, out of bounds on array", szName, index);
 			return;
 		}
 
-		if (!pArray->GetType()->FromString(pArray->GetData(index), szRest))
+		// Array elements are changed on a copy and written back.
+		pType = pArray->GetType();
+		element = pArray->GetData(index);
+		pVarPtr = &element;
+	}
+
+	char szRest[MAX_STRING] = { 0 };
+	strcpy_s(szRest, pRest);
+
+	// int64 variables get the exact result, which a double can't hold past 2^53.
+	if (pType == pInt64Type)
+	{
+		MQCalcValue Result;
+		if (!CalculateExact(szRest, Result))
 		{
-			MacroError("/varcalc '%s[%d]' failed, array element type rejected new value", szName, index);
+			MacroError("/varcalc '%s' failed.  Could not calculate '%s'", szName, szRest);
+			return;
 		}
+
+		if (Result.IsInteger)
+			sprintf_s(szRest, "%lld", Result.Integer);
+		else
+			sprintf_s(szRest, "%f", Result.Double);
 	}
 	else
 	{
-		if (!pVar->Var.Type->FromString(pVar->Var.VarPtr, szRest))
+		double Result = 0.0;
+		if (!Calculate(szRest, Result))
 		{
-			MacroError("/varcalc '%s' failed, variable type rejected new value", szName);
+			MacroError("/varcalc '%s' failed.  Could not calculate '%s'", szName, szRest);
+			return;
 		}
+
+		sprintf_s(szRest, "%f", Result);
+	}
+
+	if (!pType->FromString(*pVarPtr, szRest))
+	{
+		if (index != -1)
+			MacroError("/varcalc '%s[%d]' failed, array element type rejected new value", szName, index);
+		else
+			MacroError("/varcalc '%s' failed, variable type rejected new value", szName);
+	}
+	else if (pArray)
+	{
+		pArray->SetData(index, element);
 	}
 }
 
@@ -594,6 +743,8 @@ void VarDataCmd(PlayerClient* pChar, const char* szLine)
 
 	MQ2Type* destType;
 	MQVarPtr* destData;
+	std::shared_ptr<CDataArray> pArray;
+	MQVarPtr element;
 	int num = -1;
 
 	if (szIndex[0])
@@ -604,7 +755,7 @@ void VarDataCmd(PlayerClient* pChar, const char* szLine)
 			return;
 		}
 
-		auto pArray = destVar->Var.Get<CDataArray>();
+		pArray = destVar->Var.Get<CDataArray>();
 		num = pArray->GetElement(szIndex);
 		if (num == -1)
 		{
@@ -612,8 +763,10 @@ void VarDataCmd(PlayerClient* pChar, const char* szLine)
 			return;
 		}
 
+		// Array elements are changed on a copy and written back.
 		destType = pArray->GetType();
-		destData = &pArray->GetData(num);
+		element = pArray->GetData(num);
+		destData = &element;
 	}
 	else
 	{
@@ -628,10 +781,19 @@ void VarDataCmd(PlayerClient* pChar, const char* szLine)
 	if (sourceType != destType && sourceType->InheritsFrom(destType))
 	{
 		if (sourceType->Downcast(sourceVar, *destData, destType))
+		{
+			if (pArray)
+				pArray->SetData(num, element);
 			return;
+		}
 	}
 
-	if (!destType->FromData(*destData, sourceVar))
+	if (destType->FromData(*destData, sourceVar))
+	{
+		if (pArray)
+			pArray->SetData(num, element);
+	}
+	else
 	{
 		if (num != -1)
 		{
@@ -644,15 +806,141 @@ void VarDataCmd(PlayerClient* pChar, const char* szLine)
 	}
 }
 
+//----------------------------------------------------------------------------
+// Event queue
+//
+// gEventQueue is exported and walked elsewhere, so it stays a linked list, but the queue keeps a
+// tail pointer and per-event counts next to it. Anything that links or unlinks an event must go
+// through the functions below so that they stay in sync.
+
+static MQEventQueue* s_eventQueueTail = nullptr;
+static int s_queuedEventCount = 0;
+static int s_queuedEventTypeCount[NUM_EVENTS] = {};
+
+static constexpr size_t MaxPooledEvents = 64;
+static std::vector<MQEventQueue*> s_eventPool;
+
+static int& GetQueuedEventCount(const MQEventQueue* pEvent)
+{
+	if (pEvent->Type == EVENT_CUSTOM && pEvent->pEventList)
+		return pEvent->pEventList->QueuedCount;
+
+	return s_queuedEventTypeCount[pEvent->Type];
+}
+
+static bool IsSameEvent(const MQEventQueue* pEvent, const MQEventQueue* pOther)
+{
+	return pEvent->Type == pOther->Type && pEvent->pEventList == pOther->pEventList;
+}
+
+static MQEventQueue* AllocateEvent()
+{
+	if (s_eventPool.empty())
+		return new MQEventQueue();
+
+	MQEventQueue* pEvent = s_eventPool.back();
+	s_eventPool.pop_back();
+	return pEvent;
+}
+
+void UnlinkEvent(MQEventQueue* pEvent)
+{
+	if (pEvent->pPrev)
+		pEvent->pPrev->pNext = pEvent->pNext;
+	else
+		gEventQueue = pEvent->pNext;
+	if (pEvent->pNext)
+		pEvent->pNext->pPrev = pEvent->pPrev;
+	else
+		s_eventQueueTail = pEvent->pPrev;
+
+	pEvent->pPrev = nullptr;
+	pEvent->pNext = nullptr;
+
+	--GetQueuedEventCount(pEvent);
+	--s_queuedEventCount;
+}
+
+void ReleaseEvent(MQEventQueue* pEvent)
+{
+	ClearMQ2DataVariables(&pEvent->Parameters);
+
+	if (s_eventPool.size() >= MaxPooledEvents)
+	{
+		delete pEvent;
+		return;
+	}
+
+	pEvent->Type = EVENT_CHAT;
+	pEvent->Name.clear();
+	pEvent->pEventList = nullptr;
+	s_eventPool.push_back(pEvent);
+}
+
+static void DropEvent(MQEventQueue* pEvent, const char* reason)
+{
+	DebugSpewNoFile("Dropping event %d %s: %s", pEvent->Type,
+		pEvent->pEventList ? pEvent->pEventList->szName : pEvent->Name.c_str(), reason);
+
+	UnlinkEvent(pEvent);
+	ReleaseEvent(pEvent);
+}
+
+void ClearEventQueue()
+{
+	while (MQEventQueue* pEvent = gEventQueue)
+	{
+		UnlinkEvent(pEvent);
+		ReleaseEvent(pEvent);
+	}
+}
+
+static void QueueEvent(MQEventQueue* pEvent)
+{
+	if (!gEventQueue)
+		s_eventQueueTail = nullptr;
+
+	// Keep only the latest events of the same kind when MaxQueuedEventsPerEvent is set.
+	if (gMaxQueuedEventsPerEvent > 0)
+	{
+		MQEventQueue* pOld = gEventQueue;
+		while (pOld && GetQueuedEventCount(pEvent) >= gMaxQueuedEventsPerEvent)
+		{
+			MQEventQueue* pNext = pOld->pNext;
+			if (IsSameEvent(pOld, pEvent))
+				DropEvent(pOld, "too many of this event queued");
+			pOld = pNext;
+		}
+	}
+
+	// If /doevents isn't keeping up, drop the oldest events rather than growing without bound.
+	if (gMaxQueuedEvents > 0)
+	{
+		while (gEventQueue && s_queuedEventCount >= gMaxQueuedEvents)
+			DropEvent(gEventQueue, "event queue is full");
+	}
+
+	pEvent->pNext = nullptr;
+	pEvent->pPrev = s_eventQueueTail;
+	if (s_eventQueueTail)
+		s_eventQueueTail->pNext = pEvent;
+	else
+		gEventQueue = pEvent;
+	s_eventQueueTail = pEvent;
+
+	++GetQueuedEventCount(pEvent);
+	++s_queuedEventCount;
+}
+
 static void AddEvent(MQEventType Event, const char* FirstArg, ...)
 {
 	if (!gEventFunc[Event])
 		return;
 
-	// this is deleted in 2 locations DoEvents and EndMacro
+	// this is released in 2 locations DoEvents and EndMacro
 	DebugSpewNoFile("Adding Event %d %s", Event, FirstArg);
 
-	MQEventQueue* pEvent = new MQEventQueue();
+	MQEventQueue* pEvent = AllocateEvent();
 	pEvent->Name = FirstArg;
 	pEvent->Type = Event;
 
@@ -666,22 +954,16 @@ static void AddEvent(MQEventType Event, const char* FirstArg, ...)
 
 		while (CurrentArg)
 		{
-			char szParamName[MAX_STRING] = { 0 };
-			char szParamType[MAX_STRING] = { 0 };
 			int index = gEventFunc[Event];
 
-			auto iter = gMacroBlock->Line.find(index);
-			if (iter != gMacroBlock->Line.end())
+			if (gMacroBlock->HasLine(index))
 			{
-				MQMacroLine& line = iter->second;
+				MQMacroLine& line = gMacroBlock->GetLine(index);
 
-				GetFuncParam(&line.Command[0], i, szParamName, MAX_STRING, szParamType, MAX_STRING);
+				std::string paramName;
+				MQ2Type* pType = GetSubParameter(line, i, paramName);
 
-				MQ2Type* pType = pDataAPI->FindDataType(szParamType);
-				if (!pType)
-					pType = pStringType;
-
-				AddMQ2DataEventVariable(szParamName, "", pType, &pEvent->Parameters, CurrentArg);
+				AddMQ2DataEventVariable(paramName.c_str(), "", pType, &pEvent->Parameters, CurrentArg);
 				i++;
 				CurrentArg = va_arg(marker, const char*);
 			}
@@ -689,17 +971,7 @@ static void AddEvent(MQEventType Event, const char* FirstArg, ...)
 		va_end(marker);
 	}
 
-	if (!gEventQueue)
-	{
-		gEventQueue = pEvent;
-	}
-	else
-	{
-		MQEventQueue* pTemp;
-		for (pTemp = gEventQueue; pTemp->pNext; pTemp = pTemp->pNext) {}
-		pTemp->pNext = pEvent;
-		pEvent->pPrev = pTemp;
-	}
+	QueueEvent(pEvent);
 }
 
 void CALLBACK EventBlechCallback(unsigned int ID, void* pData, PBLECHVALUE pValues)
@@ -714,59 +986,29 @@ void CALLBACK EventBlechCallback(unsigned int ID, void* pData, PBLECHVALUE pValu
 		return;
 	}
 
-	MQEventQueue* pEvent = new MQEventQueue();
-	if (!pEvent)
-		return;
-
-	ZeroMemory(pEvent, sizeof(MQEventQueue));
+	MQEventQueue* pEvent = AllocateEvent();
 	pEvent->Type = EVENT_CUSTOM;
 	pEvent->pEventList = pEList;
-	char szParamName[MAX_STRING] = { 0 };
-	char szParamType[MAX_STRING] = { 0 };
+	MQMacroLine* pSubLine = gMacroBlock->HasLine(pEList->pEventFunc) ? &gMacroBlock->GetLine(pEList->pEventFunc) : nullptr;
+	std::string paramName;
 
-	auto eventIter = gMacroBlock->Line.find(pEList->pEventFunc);
-	if (eventIter != gMacroBlock->Line.end())
-	{
-		GetFuncParam(&eventIter->second.Command[0], 0, szParamName, MAX_STRING, szParamType, MAX_STRING);
-	}
-
-	MQ2Type* pType = pDataAPI->FindDataType(szParamType);
-	if (!pType)
-		pType = pStringType;
+	MQ2Type* pType = pSubLine ? GetSubParameter(*pSubLine, 0, paramName) : pStringType;
 
-	AddMQ2DataEventVariable(szParamName, "", pType, &pEvent->Parameters, EventMsg);
+	AddMQ2DataEventVariable(paramName.c_str(), "", pType, &pEvent->Parameters, EventMsg);
 
 	while (pValues)
 	{
 		if (pValues->Name[0] != '*')
 		{
-			auto eventIter2 = gMacroBlock->Line.find(pEList->pEventFunc);
-			if (eventIter2 != gMacroBlock->Line.end())
-			{
-				GetFuncParam(&eventIter2->second.Command[0], GetIntFromString(pValues->Name, 0), szParamName, MAX_STRING, szParamType, MAX_STRING);
-			}
+			MQ2Type* pType2 = pSubLine ? GetSubParameter(*pSubLine, GetIntFromString(pValues->Name, 0), paramName) : pStringType;
 
-			MQ2Type* pType2 = pDataAPI->FindDataType(szParamType);
-			if (!pType2)
-				pType2 = pStringType;
-
-			AddMQ2DataEventVariable(szParamName, "", pType2, &pEvent->Parameters, pValues->Value.c_str());
+			AddMQ2DataEventVariable(paramName.c_str(), "", pType2, &pEvent->Parameters, pValues->Value.c_str());
 		}
 
 		pValues = pValues->pNext;
 	}
 
-	if (!gEventQueue)
-	{
-		gEventQueue = pEvent;
-	}
-	else
-	{
-		MQEventQueue* pTemp;
-		for (pTemp = gEventQueue; pTemp->pNext; pTemp = pTemp->pNext) {}
-		pTemp->pNext = pEvent;
-		pEvent->pPrev = pTemp;
-	}
+	QueueEvent(pEvent);
 }
 
 static DWORD CALLBACK BeepOnTellThread(void* pData)
@@ -775,29 +1017,115 @@ static DWORD CALLBACK BeepOnTellThread(void* pData)
 	return 0;
 }
 
-static void TellCheck(const char* szClean)
+// Phrases that identify the channel of a chat line. Every phrase starts with a space, so a line is
+// scanned once by testing the phrases that can start at each space.
+enum ChatPhrase
 {
-	if (!gbFlashOnTells && !gbBeepOnTells)
-		return;
-
-	if (!pLocalPlayer) return;
+	ChatPhrase_Guild,
+	ChatPhrase_Group,
+	ChatPhrase_TellsYou,
+	ChatPhrase_ToldYou,
+	ChatPhrase_OOC,
+	ChatPhrase_Shout,
+	ChatPhrase_Auction,
+	ChatPhrase_SayQuote,
+	ChatPhrase_SayComma,
+	ChatPhrase_Raid,
+	ChatPhrase_Tells,
+
+	ChatPhrase_Count
+};
+
+static constexpr std::string_view s_chatPhrases[ChatPhrase_Count] = {
+	" tells the guild, ",
+	" tells the group, ",
+	" tells you, ",
+	" told you, ",
+	" says out of character, '",
+	" shouts, ",
+	" auctions, ",
+	" says '",
+	" says, ",
+	" tells the raid, ",
+	" tells ",
+};
+
+struct ChatPhraseScan
+{
+	// Position of the first occurrence of each phrase, or npos
+	size_t positions[ChatPhrase_Count];
 
-	char name[MAX_STRING] = { 0 };
-	bool isTell = false;
-	if (const char* pDest = strstr(szClean, " tells you, "))
+	explicit ChatPhraseScan(std::string_view text)
 	{
-		strncpy_s(name, szClean, static_cast<int>(pDest - szClean));
-		isTell = true;
+		std::fill(std::begin(positions), std::end(positions), std::string_view::npos);
+
+		for (size_t pos = text.find(' '); pos != std::string_view::npos; pos = text.find(' ', pos + 1))
+		{
+			if (pos + 1 >= text.size())
+				break;
+
+			std::string_view rest = text.substr(pos);
+			switch (rest[1])
+			{
+			case 't':
+				if (starts_with(rest, s_chatPhrases[ChatPhrase_Tells]))
+				{
+					Check(rest, pos, ChatPhrase_Tells);
+					Check(rest, pos, ChatPhrase_Guild);
+					Check(rest, pos, ChatPhrase_Group);
+					Check(rest, pos, ChatPhrase_TellsYou);
+					Check(rest, pos, ChatPhrase_Raid);
+				}
+				Check(rest, pos, ChatPhrase_ToldYou);
+				break;
+
+			case 's':
+				Check(rest, pos, ChatPhrase_OOC);
+				Check(rest, pos, ChatPhrase_SayQuote);
+				Check(rest, pos, ChatPhrase_SayComma);
+				Check(rest, pos, ChatPhrase_Shout);
+				break;
+
+			case 'a':
+				Check(rest, pos, ChatPhrase_Auction);
+				break;
+
+			default: break;
+			}
+		}
 	}
-	else if (pDest = strstr(szClean, " told you, "))
+
+	bool Has(ChatPhrase phrase) const { return positions[phrase] != std::string_view::npos; }
+
+private:
+	void Check(std::string_view rest, size_t pos, ChatPhrase phrase)
 	{
-		strncpy_s(name, szClean, static_cast<int>(pDest - szClean));
-		isTell = true;
+		if (positions[phrase] == std::string_view::npos && starts_with(rest, s_chatPhrases[phrase]))
+			positions[phrase] = pos;
 	}
+};
 
-	if (!isTell || strlen(name) >= EQ_MAX_NAME)
+static void TellCheck(std::string_view clean, const ChatPhraseScan& scan)
+{
+	if (!gbFlashOnTells && !gbBeepOnTells)
 		return;
 
+	if (!pLocalPlayer) return;
+
+	size_t namePos;
+	if (scan.Has(ChatPhrase_TellsYou))
+		namePos = scan.positions[ChatPhrase_TellsYou];
+	else if (scan.Has(ChatPhrase_ToldYou))
+		namePos = scan.positions[ChatPhrase_ToldYou];
+	else
+		return;
+
+	if (namePos >= EQ_MAX_NAME)
+		return;
+
+	char name[EQ_MAX_NAME] = { 0 };
+	memcpy(name, clean.data(), namePos);
+
 	// don't perform action if its us doing the tell
 	if (!_stricmp(pLocalPlayer->Name, name))
 		return;
@@ -863,85 +1191,111 @@ static void TellCheck(const char* szClean)
 	}
 }
 
-void CheckChatForEvent(const char* szMsg)
+// Copies the message into EventMsg, where the event callbacks read it from, and feeds it to a Blech.
+static void FeedEventMessage(Blech* pBlech, std::string_view message)
 {
-	size_t len = strlen(szMsg);
+	const size_t length = std::min(message.size(), static_cast<size_t>(MAX_STRING - 1));
+	memcpy(EventMsg, message.data(), length);
+	EventMsg[length] = 0;
 
-	auto pszCleanOrg = std::make_unique<char[]>(len + 64);
-	char* szClean = pszCleanOrg.get();
+	// The length that Blech takes is the size of the buffer that the print variables are copied into,
+	// not the length of the message.
+	pBlech->Feed(EventMsg, sizeof(EventMsg));
+	EventMsg[0] = 0;
+}
 
-	strcpy_s(szClean, len + 64, szMsg);
+void CheckChatForEvent(const char* szMsg)
+{
+	// Only lines with item links need a cleaned copy.
+	std::shared_ptr<const MQChatLinks> links;
+	std::string_view clean = szMsg;
 
-	if (strchr(szClean, '\x12'))
+	if (clean.find('\x12') != std::string_view::npos)
 	{
-		CXStr out = CleanItemTags(szClean, false);
-		strcpy_s(szClean, len + 64, out.c_str());
+		links = ParseChatLinks(clean);
+		clean = links->cleaned;
 	}
 
-	strncpy_s(EventMsg, szClean, MAX_STRING - 1);
-	EventMsg[MAX_STRING - 1] = 0;
+	const char* szClean = clean.data();
+
 	if (pMQ2Blech)
-		pMQ2Blech->Feed(EventMsg);
-	EventMsg[0] = 0;
-	TellCheck(szClean);
+		FeedEventMessage(pMQ2Blech, clean);
 
 	MQMacroBlockPtr pBlock = GetCurrentMacroBlock();
-	if ((pBlock && !pBlock->Line.empty()) && (!pBlock->Paused) && (!gbUnload) && (!gZoning))
+	const bool checkMacroEvents = (pBlock && !pBlock->Lines.empty()) && (!pBlock->Paused) && (!gbUnload) && (!gZoning);
+
+	if (!checkMacroEvents && !gbFlashOnTells && !gbBeepOnTells)
+		return;
+
+	const ChatPhraseScan scan(clean);
+	TellCheck(clean, scan);
+
+	if (checkMacroEvents)
 	{
 		char SpeakerName[MAX_STRING] = { 0 };
 		char Content[MAX_STRING] = { 0 };
 		char Channel[MAX_STRING] = { 0 };
-		char* pDest = nullptr;
+		const char* pDest = nullptr;
 
 		int StartCopyAt = 0;
 
-		if ((CHATEVENT(CHAT_GUILD)) && (pDest = strstr(szClean, " tells the guild, ")))
+		auto found = [&](ChatPhrase phrase)
+		{
+			if (!scan.Has(phrase))
+				return false;
+
+			pDest = szClean + scan.positions[phrase];
+			return true;
+		};
+
+		if ((CHATEVENT(CHAT_GUILD)) && found(ChatPhrase_Guild))
 		{
 			strcpy_s(Channel, "guild");
 		}
-		else if ((CHATEVENT(CHAT_GROUP)) && (pDest = strstr(szClean, " tells the group, ")))
+		else if ((CHATEVENT(CHAT_GROUP)) && found(ChatPhrase_Group))
 		{
 			strcpy_s(Channel, "group");
 		}
-		else if ((CHATEVENT(CHAT_TELL)) && (pDest = strstr(szClean, " tells you, ")))
+		else if ((CHATEVENT(CHAT_TELL)) && found(ChatPhrase_TellsYou))
 		{
 			strcpy_s(Channel, "tell");
 		}
-		else if ((CHATEVENT(CHAT_TELL)) && (pDest = strstr(szClean, " told you, ")))
+		else if ((CHATEVENT(CHAT_TELL)) && found(ChatPhrase_ToldYou))
 		{
 			strcpy_s(Channel, "tell");
 		}
 		// Cannot be said in another language, so we can match through the single quote here
-		else if ((CHATEVENT(CHAT_OOC)) && (pDest = strstr(szClean, " says out of character, '")))
+		else if ((CHATEVENT(CHAT_OOC)) && found(ChatPhrase_OOC))
 		{
 			strcpy_s(Channel, "ooc");
 		}
-		else if ((CHATEVENT(CHAT_SHOUT)) && (pDest = strstr(szClean, " shouts, ")))
+		else if ((CHATEVENT(CHAT_SHOUT)) && found(ChatPhrase_Shout))
 		{
 			strcpy_s(Channel, "shout");
 		}
-		else if ((CHATEVENT(CHAT_AUC)) && (pDest = strstr(szClean, " auctions, ")))
+		else if ((CHATEVENT(CHAT_AUC)) && found(ChatPhrase_Auction))
 		{
 			strcpy_s(Channel, "auc");
 		}
 		// What scenario misses the comma?  This is the only reason we require the StartCopyAt check
-		else if ((CHATEVENT(CHAT_SAY)) && (pDest = strstr(szClean, " says '")))
+		else if ((CHATEVENT(CHAT_SAY)) && found(ChatPhrase_SayQuote))
 		{
 			StartCopyAt = 7;
 			strcpy_s(Channel, "say");
 		}
-		else if ((CHATEVENT(CHAT_SAY)) && (pDest = strstr(szClean, " says, ")))
+		else if ((CHATEVENT(CHAT_SAY)) && found(ChatPhrase_SayComma))
 		{
 			strcpy_s(Channel, "say");
 		}
-		else if ((CHATEVENT(CHAT_RAID)) && (pDest = strstr(szClean, " tells the raid, ")))
+		else if ((CHATEVENT(CHAT_RAID)) && found(ChatPhrase_Raid))
 		{
 			strcpy_s(Channel, "raid");
 		}
-		else if ((CHATEVENT(CHAT_CHAT)) && (strstr(szClean, "You told ") == nullptr)
-			&& (pDest = strstr(szClean, " tells "))
-			&& (strstr(szClean, ":"))
-			&& (strstr(szClean, ", '")))
+		else if ((CHATEVENT(CHAT_CHAT)) && scan.Has(ChatPhrase_Tells)
+			&& (clean.find("You told ") == std::string_view::npos)
+			&& (clean.find(':') != std::string_view::npos)
+			&& (clean.find(", '") != std::string_view::npos)
+			&& found(ChatPhrase_Tells))
 		{
 			strcpy_s(Channel, pDest + 7);
 			Channel[strlen(Channel) - 1] = 0;
@@ -988,31 +1342,131 @@ void CheckChatForEvent(const char* szMsg)
 			AddEvent(EVENT_CHAT, Channel, SpeakerName, Content, NULL);
 		}
 
-		strncpy_s(EventMsg, szClean, MAX_STRING - 1);
-		EventMsg[MAX_STRING - 1] = 0;
-		pEventBlech->Feed(EventMsg);
-		EventMsg[0] = '\0';
+		FeedEventMessage(pEventBlech, clean);
 	}
 }
 
-void DropTimers()
+// Counts calls to DropTimers. Running timers are scheduled against this.
+static MQTimerWheel s_macroTimerWheel;
+
+MQTimer::~MQTimer()
 {
-	MQTimer* pTimer = gTimer;
+	s_macroTimerWheel.Cancel(this);
+}
+
+uint32_t MQTimer::GetCurrent() const
+{
+	if (!IsScheduled())
+		return 0;
+
+	return static_cast<uint32_t>(deadline - s_macroTimerWheel.GetCurrent());
+}
 
+void MQTimer::SetCurrent(uint32_t value)
+{
+	if (value == 0)
+		s_macroTimerWheel.Cancel(this);
+	else
+		s_macroTimerWheel.Schedule(this, s_macroTimerWheel.GetCurrent() + value);
+}
+
+void DropTimers()
+{
 	char szOrig[MAX_STRING] = { 0 };
 
-	while (pTimer)
-	{
-		if (pTimer->Current)
+	s_macroTimerWheel.Advance(s_macroTimerWheel.GetCurrent() + 1, [&](MQTimerWheelNode* node)
 		{
-			pTimer->Current--;
-			if (!pTimer->Current)
-			{
-				_itoa_s(pTimer->Original, szOrig, 10);
-				AddEvent(EVENT_TIMER, pTimer->Name.c_str(), szOrig, NULL);
-			}
-		}
-		pTimer = pTimer->pNext;
+			MQTimer* pTimer = static_cast<MQTimer*>(node);
+
+			_itoa_s(pTimer->Original, szOrig, 10);
+			AddEvent(EVENT_TIMER, pTimer->Name.c_str(), szOrig, NULL);
+		});
+}
+
+// Sub Event_TaskProgress(Task, Objective, CurrentCount, RequiredCount), the objective is 1 based.
+void AddTaskProgressEvent(const char* taskTitle, int objective, int currentCount, int requiredCount)
+{
+	char szObjective[16] = { 0 };
+	char szCurrent[16] = { 0 };
+	char szRequired[16] = { 0 };
+	_itoa_s(objective, szObjective, 10);
+	_itoa_s(currentCount, szCurrent, 10);
+	_itoa_s(requiredCount, szRequired, 10);
+
+	AddEvent(EVENT_TASKPROGRESS, taskTitle, szObjective, szCurrent, szRequired, NULL);
+}
+
+// Sub Event_SpawnTrigger(Name, Action, SpawnID), the action is "enter" or "leave".
+void AddSpawnTriggerEvent(const char* triggerName, bool entered, uint32_t spawnID)
+{
+	char szSpawnID[16] = { 0 };
+	_ultoa_s(spawnID, szSpawnID, 10);
+
+	AddEvent(EVENT_SPAWNTRIGGER, triggerName, entered ? "enter" : "leave", szSpawnID, NULL);
+}
+
+// Sub Event_BuffChange(SpawnID, Action, SpellID, Slot, Remaining), the action is "gained", "lost" or
+// "expiring" and the remaining duration is in seconds.
+void AddBuffChangeEvent(const CachedBuffChange& change)
+{
+	// Most macros don't have the sub, so don't bother formatting for them.
+	if (!gEventFunc[EVENT_BUFFCHANGE])
+		return;
+
+	const char* szAction = change.type == CachedBuffChangeType::Gained ? "gained"
+		: change.type == CachedBuffChangeType::Lost ? "lost" : "expiring";
+
+	char szSpawnID[16] = { 0 };
+	char szSpellID[16] = { 0 };
+	char szSlot[16] = { 0 };
+	char szRemaining[16] = { 0 };
+	_ultoa_s(change.spawnID, szSpawnID, 10);
+	_itoa_s(change.spellID, szSpellID, 10);
+	_itoa_s(change.slot, szSlot, 10);
+	_ultoa_s(change.remaining / 1000, szRemaining, 10);
+
+	AddEvent(EVENT_BUFFCHANGE, szSpawnID, szAction, szSpellID, szSlot, szRemaining, NULL);
+}
+
+// Sub Event_CastPhase(Phase, SpellID), the phase is one of the names from GetCastPhaseName.
+void AddCastPhaseEvent(MQCastPhase phase, int spellID)
+{
+	char szSpellID[16] = { 0 };
+	_itoa_s(spellID, szSpellID, 10);
+
+	AddEvent(EVENT_CASTPHASE, GetCastPhaseName(phase), szSpellID, NULL);
+}
+
+// Sub Event_PetMercChange(Who, Change, SpawnID), who is "pet" or "mercenary". Each change is its own
+// event: "spawn", "target", "stance" or "commands" for the pet, and "spawn", "state" or "stance" for
+// the mercenary. Health and buffs change too often to queue, buffs come through Event_BuffChange.
+void AddPetMercChangeEvent(bool mercenary, uint32_t changes, uint32_t spawnID)
+{
+	if (!gEventFunc[EVENT_PETMERCCHANGE])
+		return;
+
+	char szSpawnID[16] = { 0 };
+	_ultoa_s(spawnID, szSpawnID, 10);
+
+	const char* szWho = mercenary ? "mercenary" : "pet";
+	auto add = [&](uint32_t change, const char* szChange)
+	{
+		if (changes & change)
+			AddEvent(EVENT_PETMERCCHANGE, szWho, szChange, szSpawnID, NULL);
+	};
+
+	if (mercenary)
+	{
+		add(MQMercenaryChange_Spawn, "spawn");
+		add(MQMercenaryChange_State, "state");
+		add(MQMercenaryChange_Stance, "stance");
+	}
+	else
+	{
+		add(MQPetChange_Spawn, "spawn");
+		add(MQPetChange_Target, "target");
+		add(MQPetChange_Stance, "stance");
+		add(MQPetChange_Commands, "commands");
 	}
 }
 
@@ -1022,9 +1476,10 @@ namespace detail
 	{
 		WriteChatf("Tried to convert unlike types %s and %s", fromType, toType);
 
-		if (gMacroBlock != nullptr && gMacroBlock->Line.find(gMacroBlock->CurrIndex) != gMacroBlock->Line.end())
+		if (gMacroBlock != nullptr && gMacroBlock->HasLine(gMacroBlock->CurrIndex))
 		{
-			WriteChatf("%s: %d", gMacroBlock->Line.at(gMacroBlock->CurrIndex).SourceFile.c_str(), gMacroBlock->Line.at(gMacroBlock->CurrIndex).LineNumber);
+			const MQMacroLine& line = gMacroBlock->GetLine(gMacroBlock->CurrIndex);
+			WriteChatf("%s: %d", line.SourceFile.c_str(), line.LineNumber);
 		}
 
 		if (gMacroStack != nullptr)
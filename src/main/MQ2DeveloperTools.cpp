@@ -14,6 +14,11 @@
 
 #include "pch.h"
 #include "MQ2DeveloperTools.h"
+#include "MQMemoryAccounting.h"
+#include "MQSamplingProfiler.h"
+#include "MQSlowExpressions.h"
+#include "MQPluginHandler.h"
+#include "MQPostOffice.h"
 
 #include "imgui/ImGuiUtils.h"
 #include "imgui/fonts/IconsFontAwesome.h"
@@ -33,6 +38,7 @@
 #include <cfenv>
 #include <inttypes.h>
 #include <glm/glm.hpp>
+#include <psapi.h>
 
 using namespace std::chrono_literals;
 
@@ -54,7 +60,6 @@ static MQModule s_developerToolsModule = {
 };
 DECLARE_MODULE_INITIALIZER(s_developerToolsModule);
 
-extern std::vector<std::unique_ptr<MQBenchmark>> gBenchmarks;
 
 static inline void  TreeAdvanceToLabelPos() { ImGui::SetCursorPosX(ImGui::GetCursorPosX() + ImGui::GetTreeNodeToLabelSpacing()); }
 
@@ -143,6 +148,115 @@ void ImGuiWindowBase::SetWindowTitle(std::string_view windowTitle)
 	m_windowTitle = fmt::format("{}###{}", windowTitle, m_windowId);
 }
 
+#pragma region Inspector Table Model
+
+// The rows of an inspector table, kept from frame to frame. Candidates are only gathered when the
+// data key or the filter changes, or once per refresh interval for data that changes without
+// anything to compare. Matching them against the filter is spread over as many frames as it takes,
+// and the rows that are shown are only replaced once it is done. Only the rows that are on screen
+// are drawn.
+template <typename Row>
+class InspectorTableModel
+{
+public:
+	explicit InspectorTableModel(std::chrono::milliseconds refreshInterval = 0ms)
+		: m_refreshInterval(refreshInterval)
+	{
+	}
+
+	void Invalidate() { m_valid = false; }
+
+	void Clear()
+	{
+		m_valid = false;
+		m_candidates.clear();
+		m_pending.clear();
+		m_rows.clear();
+		m_nextCandidate = 0;
+		m_filtering = false;
+	}
+
+	// gather(std::vector<Row>&) adds all of the candidate rows, and match(const Row&, std::string_view)
+	// decides if a candidate passes the filter.
+	template <typename Gather, typename Match>
+	void Update(uint64_t dataKey, std::string_view filter, Gather&& gather, Match&& match)
+	{
+		const auto now = std::chrono::steady_clock::now();
+
+		if (!m_valid || dataKey != m_dataKey || filter != m_filter
+			|| (m_refreshInterval != 0ms && now - m_lastGather >= m_refreshInterval))
+		{
+			m_valid = true;
+			m_dataKey = dataKey;
+			m_filter = filter;
+			m_lastGather = now;
+
+			m_candidates.clear();
+			m_pending.clear();
+			m_nextCandidate = 0;
+			m_filtering = true;
+			gather(m_candidates);
+		}
+
+		if (!m_filtering)
+			return;
+
+		const auto deadline = now + MaxFilterTimePerFrame;
+		while (m_nextCandidate < m_candidates.size())
+		{
+			Row& candidate = m_candidates[m_nextCandidate++];
+			if (match(static_cast<const Row&>(candidate), std::string_view{ m_filter }))
+				m_pending.push_back(std::move(candidate));
+
+			// Checking the clock isn't free either.
+			if ((m_nextCandidate % 64) == 0 && std::chrono::steady_clock::now() >= deadline)
+				return;
+		}
+
+		m_rows.swap(m_pending);
+		m_pending.clear();
+		m_candidates.clear();
+		m_nextCandidate = 0;
+		m_filtering = false;
+	}
+
+	bool IsFiltering() const { return m_filtering; }
+
+	std::vector<Row>& GetRows() { return m_rows; }
+	const std::vector<Row>& GetRows() const { return m_rows; }
+
+	// Rows can be formatted the first time they are drawn, so drawRow gets a row it can change.
+	template <typename DrawRow>
+	void DrawRows(DrawRow&& drawRow)
+	{
+		ImGuiListClipper clipper;
+		clipper.Begin(static_cast<int>(m_rows.size()));
+
+		while (clipper.Step())
+		{
+			for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+				drawRow(m_rows[row]);
+		}
+	}
+
+private:
+	static constexpr auto MaxFilterTimePerFrame = 2ms;
+
+	std::chrono::milliseconds m_refreshInterval;
+	std::chrono::steady_clock::time_point m_lastGather;
+	bool m_valid = false;
+	uint64_t m_dataKey = 0;
+	std::string m_filter;
+
+	std::vector<Row> m_candidates;
+	size_t m_nextCandidate = 0;
+	bool m_filtering = false;
+	std::vector<Row> m_pending;
+	std::vector<Row> m_rows;
+};
+
+#pragma endregion
+
 #pragma region ImGui Demo Container
 
 class ImGuiDemoWindow : public ImGuiWindowBase
@@ -565,7 +679,7 @@ public:
 
 class AchievementsInspector : public ImGuiWindowBase
 {
-	std::vector<int> m_filteredAchievements;
+	InspectorTableModel<const Achievement*> m_filteredAchievements;
 	int m_selectedAchievementId = -1;
 	int m_selectedAchievementCategoryId = -1;
 
@@ -854,43 +968,42 @@ public:
 
 	void DrawFilteredAchievements(const AchievementManager& manager, std::string_view searchFilter, bool updateFilter)
 	{
-		if (updateFilter || m_filteredAchievements.empty())
-		{
-			m_filteredAchievements.clear();
+		if (updateFilter)
+			m_filteredAchievements.Invalidate();
 
-			std::vector<const Achievement*> achievements;
+		const uint64_t dataKey = static_cast<uint64_t>(manager.GetAchievementCount()) << 4
+			| (m_showCompleted ? 1 : 0) | (m_showLocked ? 2 : 0) | (m_showOpen ? 4 : 0) | (m_showHidden ? 8 : 0);
 
-			for (int index = 0; index < manager.GetAchievementCount(); ++index)
+		// Candidates are sorted by name, so the matches come out sorted as well.
+		m_filteredAchievements.Update(dataKey, searchFilter,
+			[&](std::vector<const Achievement*>& achievements)
 			{
-				const Achievement* achievement = manager.GetAchievementByIndex(index);
-				AchievementState state = manager.GetAchievementStateByIndex(index);
-				if (state == AchievementComplete && !m_showCompleted)
-					continue;
-				if (state == AchievementLocked && !m_showLocked)
-					continue;
-				if (state == AchievementOpen && !m_showOpen)
-					continue;
-				if (state == AchievementNotVisible && !m_showHidden)
-					continue;
-
-				if (searchFilter.empty() || ci_find_substr(achievement->name, searchFilter) != -1)
+				for (int index = 0; index < manager.GetAchievementCount(); ++index)
 				{
-					achievements.push_back(achievement);
+					AchievementState state = manager.GetAchievementStateByIndex(index);
+					if (state == AchievementComplete && !m_showCompleted)
+						continue;
+					if (state == AchievementLocked && !m_showLocked)
+						continue;
+					if (state == AchievementOpen && !m_showOpen)
+						continue;
+					if (state == AchievementNotVisible && !m_showHidden)
+						continue;
+
+					achievements.push_back(manager.GetAchievementByIndex(index));
 				}
-			}
 
-			std::sort(std::begin(achievements), std::end(achievements),
-				[&](const Achievement* idA, const Achievement* idB)
+				std::sort(std::begin(achievements), std::end(achievements),
+					[&](const Achievement* idA, const Achievement* idB)
+				{
+					return ci_less()(idA->name, idB->name);
+				});
+			},
+			[](const Achievement* achievement, std::string_view filter)
 			{
-				return ci_less()(idA->name, idB->name);
+				return filter.empty() || ci_find_substr(achievement->name, filter) != -1;
 			});
 
-			m_filteredAchievements.reserve(achievements.size());
-
-			for (const Achievement* ach : achievements)
-				m_filteredAchievements.push_back(ach->id);
-		}
-
 		if (ImGui::BeginTable("##AchievementsFilteredList", 2, ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY))
 		{
 			ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthFixed);
@@ -898,18 +1011,11 @@ public:
 			ImGui::TableSetupScrollFreeze(0, 1);
 			ImGui::TableHeadersRow();
 
-			ImGuiListClipper clipper;
-			clipper.Begin((int)m_filteredAchievements.size());
-
-			while (clipper.Step())
-			{
-				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+			m_filteredAchievements.DrawRows([&](const Achievement* achievement)
 				{
-					int achievementId = m_filteredAchievements[row];
+					DrawAchievementTableRow(achievement->id, manager);
+				});
 
-					DrawAchievementTableRow(achievementId, manager);
-				}
-			}
 			ImGui::EndTable();
 		}
 	}
@@ -1126,11 +1232,25 @@ static AchievementsInspector* s_achievementsInspector = nullptr;
 
 class AltAbilityInspector : public ImGuiWindowBase
 {
+	struct AltAbilityRow
+	{
+		CAltAbilityData* ability = nullptr;
+
+		// Looked up the first time the row is drawn.
+		bool formatted = false;
+		const char* name = nullptr;
+		std::string category;
+		const char* description = nullptr;
+	};
+
 	CAltAbilityData* m_selectedAbility = nullptr;
 	bool m_foundSelected = false;
 	bool m_showVisible = true;
 	char m_searchText[256] = { 0 };
 
+	// Which abilities can be seen changes as we level, so the rows are gathered again now and then.
+	InspectorTableModel<AltAbilityRow> m_abilities{ 2000ms };
+
 public:
 	AltAbilityInspector() : ImGuiWindowBase("Alt Abilities Inspector")
 	{
@@ -1152,27 +1272,52 @@ public:
 		{
 			// Clear cached data
 			m_selectedAbility = nullptr;
+			m_abilities.Clear();
 		}
 
 		ImGuiWindowBase::Update();
 	}
 
-	void DrawAltAbilityTableRow(CAltAbilityData* altAbility)
+	static void FormatAltAbilityRow(AltAbilityRow& row)
 	{
 		DatabaseStringTable* dbStr = pDBStr;
+		CAltAbilityData* altAbility = row.ability;
+
+		row.formatted = true;
+
+		row.name = dbStr->GetString(altAbility->nName, eAltAbilityName);
+		if (!row.name)
+			row.name = "Unknown";
+
+		if (altAbility->DisplayCategory > 0)
+		{
+			const char* CategoryName = dbStr->GetString(altAbility->DisplayCategory, eAltAbilityCategory);
+			row.category = fmt::format("{} ({})", CategoryName ? CategoryName : "UNKNOWN", altAbility->DisplayCategory);
+		}
+		else
+		{
+			const char* CategoryName = dbStr->GetString(altAbility->Expansion, eExpansionName);
+			row.category = fmt::format("{} ({})", CategoryName ? CategoryName : "UNKNOWN", altAbility->Expansion);
+		}
+
+		row.description = dbStr->GetString(altAbility->nDesc, eAltAbilityDescription);
+	}
+
+	void DrawAltAbilityTableRow(AltAbilityRow& row)
+	{
+		if (!row.formatted)
+			FormatAltAbilityRow(row);
+
+		CAltAbilityData* altAbility = row.ability;
 
 		ImGui::TableNextRow();
 		ImGui::TableNextColumn();
 
-		const char* AAName = dbStr->GetString(altAbility->nName, eAltAbilityName);
-		if (!AAName)
-			AAName = "Unknown";
-
 		ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_SpanFullWidth | ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
 		if (m_selectedAbility == altAbility)
 			flags |= ImGuiTreeNodeFlags_Selected;
 
-		ImGui::TreeNodeEx((void*)altAbility, flags, "%s", AAName);
+		ImGui::TreeNodeEx((void*)altAbility, flags, "%s", row.name);
 
 		if (ImGui::IsItemClicked())
 		{
@@ -1180,33 +1325,12 @@ public:
 		}
 
 		ImGui::TableNextColumn();
-		if (altAbility->DisplayCategory > 0)
-		{
-			if (const char* CategoryName = dbStr->GetString(altAbility->DisplayCategory, eAltAbilityCategory))
-			{
-				ImGui::Text("%s (%d)", CategoryName, altAbility->DisplayCategory);
-			}
-			else
-			{
-				ImGui::Text("UNKNOWN (%d)", altAbility->DisplayCategory);
-			}
-		}
-		else
-		{
-			if (const char* CategoryName = dbStr->GetString(altAbility->Expansion, eExpansionName))
-			{
-				ImGui::Text("%s (%d)", CategoryName, altAbility->Expansion);
-			}
-			else
-			{
-				ImGui::Text("UNKNOWN (%d)", altAbility->Expansion);
-			}
-		}
+		ImGui::TextUnformatted(row.category.c_str());
 
 		ImGui::TableNextColumn();
-		if (const char* AADescription = dbStr->GetString(altAbility->nDesc, eAltAbilityDescription))
+		if (row.description)
 		{
-			ImGui::Text("%s", AADescription);
+			ImGui::TextUnformatted(row.description);
 		}
 	}
 
@@ -1224,6 +1348,12 @@ public:
 	
 		ImGui::InputText("##AASearchText", m_searchText, 256);
 
+		if (m_abilities.IsFiltering())
+		{
+			ImGui::SameLine();
+			ImGui::TextDisabled("Searching...");
+		}
+
 		if (ImGui::BeginTable("##AltAbilityTable", 3, ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, size))
 		{
 			ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthStretch);
@@ -1232,36 +1362,46 @@ public:
 			ImGui::TableSetupScrollFreeze(0, 1);
 			ImGui::TableHeadersRow();
 
-			// Range-based For loop isn't working here for some reason. Need to figure it out.
-			const auto& abilities = *pAltAdvManager->abilities;
-			m_foundSelected = false;
+			const uint64_t dataKey = (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pAltAdvManager)) << 1) | (m_showVisible ? 1 : 0);
 
-			CAltAbilityData** ppAltAbility = abilities.WalkFirst();
-			while (ppAltAbility)
-			{
-				CAltAbilityData* altAbility = *ppAltAbility;
-				if (!m_showVisible || pAltAdvManager->CanSeeAbility(pLocalPC, altAbility))
+			m_abilities.Update(dataKey, m_searchText,
+				[this](std::vector<AltAbilityRow>& rows)
 				{
-					if (!m_searchText[0] ||
-							ci_find_substr(altAbility->GetNameString(), m_searchText) != -1 ||
-							ci_find_substr(altAbility->GetCategoryString(), m_searchText) != -1 ||
-							ci_find_substr(altAbility->GetDescriptionString(), m_searchText) != -1 ||
-							ci_find_substr(altAbility->GetExpansionString(), m_searchText) != -1)
+					// Range-based For loop isn't working here for some reason. Need to figure it out.
+					const auto& abilities = *pAltAdvManager->abilities;
+					m_foundSelected = false;
+
+					CAltAbilityData** ppAltAbility = abilities.WalkFirst();
+					while (ppAltAbility)
 					{
-						DrawAltAbilityTableRow(altAbility);
-					}
-				}
+						CAltAbilityData* altAbility = *ppAltAbility;
+						rows.push_back(AltAbilityRow{ altAbility });
 
-				if (altAbility == m_selectedAbility)
-					m_foundSelected = true;
+						if (altAbility == m_selectedAbility)
+							m_foundSelected = true;
 
-				ppAltAbility = abilities.WalkNext(ppAltAbility);
-			}
+						ppAltAbility = abilities.WalkNext(ppAltAbility);
+					}
 
-			if (!m_foundSelected)
-			{
-				m_selectedAbility = nullptr;
-			}
+					if (!m_foundSelected)
+					{
+						m_selectedAbility = nullptr;
+					}
+				},
+				[this](const AltAbilityRow& row, std::string_view searchText)
+				{
+					CAltAbilityData* altAbility = row.ability;
+					if (m_showVisible && !pAltAdvManager->CanSeeAbility(pLocalPC, altAbility))
+						return false;
+
+					return searchText.empty()
+						|| ci_find_substr(altAbility->GetNameString(), searchText) != -1
+						|| ci_find_substr(altAbility->GetCategoryString(), searchText) != -1
+						|| ci_find_substr(altAbility->GetDescriptionString(), searchText) != -1
+						|| ci_find_substr(altAbility->GetExpansionString(), searchText) != -1;
+				});
+
+			m_abilities.DrawRows([this](AltAbilityRow& row) { DrawAltAbilityTableRow(row); });
 
 			ImGui::EndTable();
 		}
@@ -4620,12 +4760,7 @@ public:
 
 	void ResetLastTimes()
 	{
-		// Reset last times
-		for (auto& bm : gBenchmarks)
-		{
-			if (bm != nullptr)
-				bm->LastTime = std::chrono::microseconds::zero();
-		}
+		ResetMQ2BenchmarkLastTimes();
 	}
 
 	virtual void Show() override
@@ -4642,6 +4777,8 @@ public:
 			m_resetNext = false;
 		}
 
+		m_benchmarks = GetMQ2Benchmarks();
+
 		DrawPlot();
 
 		if (ImGui::CollapsingHeader("Benchmark Table"))
@@ -4675,28 +4812,25 @@ public:
 			for (const auto& p : m_data)
 				p.second->Updated = false;
 
-			for (const auto& bm : gBenchmarks)
+			for (const MQBenchmark& bm : m_benchmarks)
 			{
-				if (bm == nullptr)
-					continue;
-
 				ScrollingData* data = nullptr;
 
-				auto iter = m_data.find(bm->Name);
+				auto iter = m_data.find(bm.Name);
 				if (iter == m_data.end())
 				{
 					auto pData = std::make_unique<ScrollingData>();
-					pData->Name = bm->Name;
+					pData->Name = bm.Name;
 					data = pData.get();
 
-					m_data.emplace(bm->Name, std::move(pData));
+					m_data.emplace(bm.Name, std::move(pData));
 				}
 				else
 				{
 					data = iter->second.get();
 				}
 
-				data->AddPoint(m_time, static_cast<float>(bm->LastTime.count()) / 1000.f);
+				data->AddPoint(m_time, static_cast<float>(bm.LastTime.count()) / 1000.f);
 				data->Updated = true;
 			}
 
@@ -4768,23 +4902,31 @@ public:
 
 	void DrawTable()
 	{
-		if (ImGui::BeginTable("##BenchmarksTable", 4))
+		if (ImGui::BeginTable("##BenchmarksTable", 8))
 		{
 			ImGui::TableSetupColumn("Name");
 			ImGui::TableSetupColumn("Count");
 			ImGui::TableSetupColumn("Total");
 			ImGui::TableSetupColumn("Last");
+			ImGui::TableSetupColumn("50th");
+			ImGui::TableSetupColumn("95th");
+			ImGui::TableSetupColumn("99th");
+			ImGui::TableSetupColumn("Max");
 			ImGui::TableHeadersRow();
 
-			for (const auto& bm : gBenchmarks)
+			for (const MQBenchmark& bm : m_benchmarks)
 			{
 				ImGui::TableNextRow();
 				ImGui::TableNextColumn();
 
-				ImGui::Text(bm->Name.c_str()); ImGui::TableNextColumn();
-				ImGui::Text("%d", bm->Count); ImGui::TableNextColumn();
-				ImGui::Text("%.3f ms", static_cast<float>(bm->TotalTime.count() / 1000.f)); ImGui::TableNextColumn();
-				ImGui::Text("%.3f ms", static_cast<float>(bm->LastTime.count() / 1000.f));
+				ImGui::TextUnformatted(bm.Name.c_str()); ImGui::TableNextColumn();
+				ImGui::Text("%I64u", bm.Count); ImGui::TableNextColumn();
+				ImGui::Text("%.3f ms", static_cast<float>(bm.TotalTime.count() / 1000.f)); ImGui::TableNextColumn();
+				ImGui::Text("%.3f ms", static_cast<float>(bm.LastTime.count() / 1000.f)); ImGui::TableNextColumn();
+				ImGui::Text("%.3f ms", static_cast<float>(bm.P50Time.count() / 1000.f)); ImGui::TableNextColumn();
+				ImGui::Text("%.3f ms", static_cast<float>(bm.P95Time.count() / 1000.f)); ImGui::TableNextColumn();
+				ImGui::Text("%.3f ms", static_cast<float>(bm.P99Time.count() / 1000.f)); ImGui::TableNextColumn();
+				ImGui::Text("%.3f ms", static_cast<float>(bm.MaxTime.count() / 1000.f));
 			}
 
 			ImGui::EndTable();
@@ -4793,6 +4935,7 @@ public:
 
 private:
 	std::map<std::string, std::unique_ptr<ScrollingData>> m_data;
+	std::vector<MQBenchmark> m_benchmarks;
 	float m_history = 30.0f; // 30 seconds
 	float m_time = 0.0f;
 	std::chrono::steady_clock::time_point m_lastUpdate;
@@ -4806,158 +4949,1047 @@ static BenchmarksInspector* s_benchmarksInspector = nullptr;
 
 #pragma endregion
 
-#pragma region String Inspector
+#pragma region Plugin Timings Inspector
 
-class StringInspector : public ImGuiWindowBase
+class PluginTimingsInspector : public ImGuiWindowBase
 {
 public:
-	StringInspector() : ImGuiWindowBase("String Inspector")
+	PluginTimingsInspector() : ImGuiWindowBase("Plugin Timings")
 	{
+		SetDefaultSize(ImVec2(800, 500));
 	}
 
-	~StringInspector()
+	virtual void Draw() override
 	{
-	}
+		if (ImGui::Button("Reset"))
+			ResetPluginTimings();
 
-protected:
-	void Draw() override
-	{
-		ImGui::LabelText("StrRep Allocations", "%d", eqlib::internal::gStrRepAllocations);
-		ImGui::LabelText("StrRep Live Objects", "%d", eqlib::internal::gStrRepLiveObjects);
+		ImGui::SameLine();
+		ImGui::Text("Pulse budget: %s  Callback budget: %s  Throttle: %s",
+			FormatBudget(gPluginPulseBudget).c_str(), FormatBudget(gPluginCallbackBudget).c_str(),
+			FormatThrottle(gPluginThrottleFrames).c_str());
 
-		ImGui::Text("CXStr FreeLists:");
+		ImGui::TextDisabled("Average and 99th percentile are taken over the last %d calls.",
+			PluginCallbackTiming::WindowSize);
 
-		eqlib::internal::LockCXStrMutex();
-		CXFreeList* freeList = eqlib::internal::GetCXFreeList();
-		if (freeList)
+		constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV
+			| ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+
+		if (ImGui::BeginTable("##PluginTimingsTable", 8, tableFlags))
 		{
-			if (ImGui::BeginTable("##CXFreeListTable", 2))
-			{
-				ImGui::TableSetupColumn("Block Size");
-				ImGui::TableSetupColumn("Count");
-				ImGui::TableHeadersRow();
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Plugin");
+			ImGui::TableSetupColumn("Callback");
+			ImGui::TableSetupColumn("Count");
+			ImGui::TableSetupColumn("Total");
+			ImGui::TableSetupColumn("Average");
+			ImGui::TableSetupColumn("Max");
+			ImGui::TableSetupColumn("99th");
+			ImGui::TableSetupColumn("Status");
+			ImGui::TableHeadersRow();
 
-				while (freeList->blockSize > 0)
+			ForEachPluginTimings([](const PluginTimings& timings)
 				{
-					ImGui::TableNextRow();
+					for (int i = 0; i < static_cast<int>(PluginCallback::Count); ++i)
+					{
+						const PluginCallback callback = static_cast<PluginCallback>(i);
+						const PluginCallbackTiming& timing = timings.Get(callback);
+						if (timing.count == 0)
+							continue;
 
-					ImGui::TableNextColumn();
-					ImGui::Text("%d", freeList->blockSize);
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
 
-					size_t count = 0;
-					CStrRep* rep = freeList->repList;
-					while (rep)
-					{
-						++count;
-						rep = rep->next;
+						ImGui::TextUnformatted(timings.name.c_str()); ImGui::TableNextColumn();
+						ImGui::TextUnformatted(GetPluginCallbackName(callback)); ImGui::TableNextColumn();
+						ImGui::Text("%" PRIu64, timing.count); ImGui::TableNextColumn();
+						ImGui::Text("%.3f ms", timing.total.count() / 1000000.0); ImGui::TableNextColumn();
+						ImGui::Text("%.3f ms", timing.GetAverage().count() / 1000000.0); ImGui::TableNextColumn();
+						ImGui::Text("%.3f ms", timing.max.count() / 1000000.0); ImGui::TableNextColumn();
+						ImGui::Text("%.3f ms", timing.GetPercentile(0.99f).count() / 1000000.0); ImGui::TableNextColumn();
+
+						if (callback == PluginCallback::Pulse && timings.throttleFrames > 1)
+							ImGui::TextColored(ImColor(255, 127, 0), "Throttled");
+						else if (timing.overBudget)
+							ImGui::TextColored(ImColor(255, 0, 0), "Over budget");
 					}
+				});
 
-					ImGui::TableNextColumn();
-					ImGui::Text("%d", count);
+			ImGui::EndTable();
+		}
+	}
 
-					++freeList;
-				}
+private:
+	static std::string FormatBudget(int budget)
+	{
+		if (budget <= 0)
+			return "none";
 
-				ImGui::EndTable();
-			}
-		}
-		else
-		{
-			ImGui::Text("<no freelist>");
-		}
+		return fmt::format("{:.3f} ms", budget / 1000.0);
+	}
 
-		eqlib::internal::UnlockCXStrMutex();
+	static std::string FormatThrottle(int frames)
+	{
+		if (frames <= 1)
+			return "off";
+
+		return fmt::format("every {} frames", frames);
 	}
 };
-static StringInspector* s_stringInspector = nullptr;
+static PluginTimingsInspector* s_pluginTimingsInspector = nullptr;
 
 #pragma endregion
 
-#pragma region Switch Inspector
+#pragma region Performance Dashboard
 
-// FIXME: Pull these helpers out
-inline bool IsSwitchStationary(EQSwitch* pSwitch)
+class PerformanceInspector : public ImGuiWindowBase
 {
-	int typeId = pSwitch->Type;
+	enum class Group
+	{
+		Frame,
+		PluginPulse,
+		Benchmarks,
+		Lua,
+		Routing,
+		Memory,
+
+		Count
+	};
 
-	return (typeId != 53 && typeId >= 50 && typeId < 59)
-		|| (typeId >= 153 && typeId <= 155);
-}
+	static const char* GetGroupName(Group group)
+	{
+		switch (group)
+		{
+		case Group::Frame: return "Frame Time";
+		case Group::PluginPulse: return "Plugin Pulse";
+		case Group::Benchmarks: return "Benchmarks";
+		case Group::Lua: return "Lua Threads";
+		case Group::Routing: return "Routing Queue";
+		case Group::Memory: return "Memory";
+		default: return "";
+		}
+	}
 
-inline bool IsSwitchTeleporter(EQSwitch* pSwitch)
-{
-	int typeId = pSwitch->Type;
-	DWORD TableSize = *(DWORD*)Teleport_Table_Size;
+	static const char* GetGroupUnits(Group group)
+	{
+		switch (group)
+		{
+		case Group::Routing: return "Messages";
+		case Group::Memory: return "MB";
+		default: return "Milliseconds";
+		}
+	}
 
-	return (typeId == 57 || typeId == 58) && pSwitch->SpellID > -1 && (pSwitch->SpellID < (int)TableSize);
-}
+	// Benchmark the Lua plugin keeps around running its threads.
+	static constexpr std::string_view LuaThreadsBenchmark = "Lua_Threads";
 
-class ImGuiSwitchViewer
-{
-	int m_instanceId = 0;
-	std::string m_windowDisplayName;
-	std::string m_viewerTitle;
-	bool m_needDock = true;
-	bool m_needFocus = false;
-	ImGuiID m_windowId = 0;
+	struct Series
+	{
+		Group group;
+		std::string name;
+		ScrollingData data;
+		double lastTotal = -1.0;          // for series that are sampled from a running total
+		bool updated = false;
+	};
 
-	int m_id = -1;
+	struct SeriesStats
+	{
+		const Series* series;
+		float current;
+		float average;
+		float max;
+	};
 
 public:
-	ImGuiSwitchViewer()
+	PerformanceInspector() : ImGuiWindowBase("Performance")
 	{
-		static int nextInstanceId = 1;
-		m_instanceId = nextInstanceId++;
+		SetDefaultSize(ImVec2(1200, 700));
 	}
 
-	void SetNeedDock(bool dock) { m_needDock = dock; }
-	bool GetNeedDock() const { return m_needDock; }
+	virtual void Draw() override
+	{
+		ImGui::SliderFloat("History", &m_history, 10.0f, 120.0f, "%.1f s");
 
-	void SetNeedFocus(bool needFocus) { m_needFocus = needFocus; }
-	const char* GetWindowIdStr() const { return m_viewerTitle.c_str(); }
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			m_series.clear();
 
-	int GetInstanceId() const { return m_instanceId; }
-	ImGuiID GetWindowId() const { return m_windowId; }
+		ImGui::SameLine();
+		if (ImGui::Button(m_paused ? "Resume" : "Pause"))
+			m_paused = !m_paused;
 
-	void SetSwitchId(int id)
-	{
-		if (!test_and_set(m_id, id))
-			return;
+		if (!m_paused)
+			Sample();
 
-		m_needFocus = true;
+		constexpr float tableWidth = 420.0f;
 
-		if (m_id >= 0)
-		{
-			const EQSwitch* pSwitch = pSwitchMgr->GetSwitchById(m_id);
-			if (pSwitch)
-			{
-				m_windowDisplayName = fmt::format("{} ({})", pSwitch->Name, pSwitch->ID);
-			}
-			else
-			{
-				m_windowDisplayName = fmt::format("Switch {}", m_id);
-			}
+		if (ImGui::BeginChild("##PerformancePlots", ImVec2(-tableWidth, 0)))
+			DrawPlots();
+		ImGui::EndChild();
 
-		}
+		ImGui::SameLine();
 
-		m_viewerTitle = fmt::format("{}###SwitchViewer{}", m_windowDisplayName, m_instanceId);
+		if (ImGui::BeginChild("##PerformanceTable", ImVec2(0, 0)))
+			DrawTable();
+		ImGui::EndChild();
 	}
-	int GetSwitchId() const { return m_id; }
 
-	bool Draw()
+private:
+	Series& GetSeries(Group group, const std::string& name)
 	{
-		if (m_needFocus)
+		auto& series = m_series[std::make_pair(group, name)];
+		if (!series)
 		{
-			ImGui::SetNextWindowFocus();
-			m_needFocus = false;
+			series = std::make_unique<Series>();
+			series->group = group;
+			series->name = name;
 		}
 
-		bool open = true;
-		ImGui::SetNextWindowSize(ImVec2(480, 640), ImGuiCond_FirstUseEver);
-		if (ImGui::Begin(m_viewerTitle.c_str(), &open))
-		{
-			if (m_windowId == 0)
-				m_windowId = ImGui::GetCurrentWindow()->ID;
+		series->updated = true;
+		return *series;
+	}
+
+	void AddPoint(Group group, const std::string& name, float value)
+	{
+		GetSeries(group, name).data.AddPoint(m_time, value);
+	}
+
+	// Plots how much a running total grew since the last frame.
+	void AddDelta(Group group, const std::string& name, double total)
+	{
+		Series& series = GetSeries(group, name);
+
+		// Nothing to compare the first total against, and totals restart when they are reset.
+		if (series.lastTotal >= 0.0 && total >= series.lastTotal)
+			series.data.AddPoint(m_time, static_cast<float>(total - series.lastTotal));
+
+		series.lastTotal = total;
+	}
+
+	void Sample()
+	{
+		m_time += ImGui::GetIO().DeltaTime;
+
+		for (const auto& p : m_series)
+			p.second->updated = false;
+
+		AddPoint(Group::Frame, "Frame Time", ImGui::GetIO().DeltaTime * 1000.0f);
+
+		ForEachPluginTimings([this](const PluginTimings& timings)
+			{
+				AddDelta(Group::PluginPulse, timings.name, timings.Get(PluginCallback::Pulse).total.count() / 1000000.0);
+			});
+
+		for (const MQBenchmark& bm : GetMQ2Benchmarks())
+		{
+			AddDelta(bm.Name == LuaThreadsBenchmark ? Group::Lua : Group::Benchmarks, bm.Name,
+				bm.TotalTime.count() / 1000.0);
+		}
+
+		AddPoint(Group::Routing, "Pipe Messages", static_cast<float>(pipeclient::GetQueuedMessageCount()));
+		if (std::optional<PipeConnectionStats> connection = pipeclient::GetConnectionStats())
+			AddPoint(Group::Routing, "Pipe Send Queue", static_cast<float>(connection->SendQueueDepth));
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - m_lastMemoryUpdate > 250ms)
+		{
+			PROCESS_MEMORY_COUNTERS_EX counters = { sizeof(counters) };
+			if (::GetProcessMemoryInfo(::GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters), sizeof(counters)))
+			{
+				m_workingSet = counters.WorkingSetSize / (1024.0f * 1024.0f);
+				m_privateBytes = counters.PrivateUsage / (1024.0f * 1024.0f);
+			}
+
+			m_lastMemoryUpdate = now;
+		}
+
+		AddPoint(Group::Memory, "Working Set", m_workingSet);
+		AddPoint(Group::Memory, "Private Bytes", m_privateBytes);
+
+		for (const MQMemoryStats& stats : MemoryAccounting_GetStats())
+			AddPoint(Group::Memory, stats.Name, stats.Current / (1024.0f * 1024.0f));
+
+		// Drop benchmarks and plugins that went away.
+		for (auto iter = m_series.begin(); iter != m_series.end();)
+		{
+			if (iter->second->updated)
+				++iter;
+			else
+				iter = m_series.erase(iter);
+		}
+	}
+
+	void DrawPlots()
+	{
+		constexpr int rows = 3;
+		constexpr int columns = 2;
+
+		if (ImPlot::BeginSubplots("##PerformanceSubplots", rows, columns, ImVec2(-1, -1), ImPlotSubplotFlags_LinkAllX))
+		{
+			for (int i = 0; i < static_cast<int>(Group::Count); ++i)
+			{
+				const Group group = static_cast<Group>(i);
+
+				if (ImPlot::BeginPlot(GetGroupName(group)))
+				{
+					ImPlot::SetupAxis(ImAxis_X1, nullptr, ImPlotAxisFlags_NoTickLabels);
+					ImPlot::SetupAxis(ImAxis_Y1, GetGroupUnits(group), ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_RangeFit);
+					ImPlot::SetupAxisLimits(ImAxis_X1, static_cast<double>(m_time) - m_history, m_time, ImGuiCond_Always);
+					ImPlot::SetupLegend(ImPlotLocation_NorthWest);
+
+					for (const auto& p : m_series)
+					{
+						const Series& series = *p.second;
+						if (series.group != group || series.data.Data.empty())
+							continue;
+
+						ImPlot::PlotLine(series.name.c_str(), &series.data.Data[0].x, &series.data.Data[0].y,
+							series.data.Data.size(), ImPlotLineFlags_None, series.data.Offset, sizeof(ImVec2));
+					}
+
+					ImPlot::EndPlot();
+				}
+			}
+
+			ImPlot::EndSubplots();
+		}
+	}
+
+	SeriesStats GetStats(const Series& series) const
+	{
+		SeriesStats stats = { &series, 0.0f, 0.0f, 0.0f };
+
+		const ImVector<ImVec2>& data = series.data.Data;
+		if (data.empty())
+			return stats;
+
+		const int newest = (series.data.Offset + data.size() - 1) % data.size();
+		stats.current = data[newest].y;
+
+		const float from = m_time - m_history;
+		int count = 0;
+		double total = 0.0;
+
+		for (const ImVec2& point : data)
+		{
+			if (point.x < from)
+				continue;
+
+			total += point.y;
+			stats.max = std::max(stats.max, point.y);
+			++count;
+		}
+
+		if (count > 0)
+			stats.average = static_cast<float>(total / count);
+
+		return stats;
+	}
+
+	void DrawTable()
+	{
+		enum ColumnID
+		{
+			ColumnID_Group,
+			ColumnID_Name,
+			ColumnID_Current,
+			ColumnID_Average,
+			ColumnID_Max,
+		};
+
+		constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV
+			| ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable | ImGuiTableFlags_Sortable | ImGuiTableFlags_SortMulti;
+
+		if (ImGui::BeginTable("##PerformanceTable", 5, tableFlags))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Group", ImGuiTableColumnFlags_WidthFixed, 90.0f, ColumnID_Group);
+			ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthStretch, 0.0f, ColumnID_Name);
+			ImGui::TableSetupColumn("Current", ImGuiTableColumnFlags_WidthFixed, 60.0f, ColumnID_Current);
+			ImGui::TableSetupColumn("Average", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultSort
+				| ImGuiTableColumnFlags_PreferSortDescending, 60.0f, ColumnID_Average);
+			ImGui::TableSetupColumn("Max", ImGuiTableColumnFlags_WidthFixed, 60.0f, ColumnID_Max);
+			ImGui::TableHeadersRow();
+
+			std::vector<SeriesStats> rows;
+			rows.reserve(m_series.size());
+			for (const auto& p : m_series)
+				rows.push_back(GetStats(*p.second));
+
+			// The values change every frame, so the rows are sorted every frame too.
+			ImGuiTableSortSpecs* sort_specs = ImGui::TableGetSortSpecs();
+			if (sort_specs && sort_specs->SpecsCount > 0)
+			{
+				std::sort(rows.begin(), rows.end(),
+					[sort_specs](const SeriesStats& a, const SeriesStats& b)
+					{
+						for (int n = 0; n < sort_specs->SpecsCount; ++n)
+						{
+							const ImGuiTableColumnSortSpecs* sort_spec = &sort_specs->Specs[n];
+							float delta = 0;
+
+							switch (sort_spec->ColumnUserID)
+							{
+							case ColumnID_Group: delta = static_cast<float>(static_cast<int>(a.series->group) - static_cast<int>(b.series->group)); break;
+							case ColumnID_Name: delta = static_cast<float>(ci_string_compare(a.series->name, b.series->name)); break;
+							case ColumnID_Current: delta = a.current - b.current; break;
+							case ColumnID_Average: delta = a.average - b.average; break;
+							case ColumnID_Max: delta = a.max - b.max; break;
+							default: break;
+							}
+
+							if (delta < 0)
+								return sort_spec->SortDirection == ImGuiSortDirection_Ascending;
+							if (delta > 0)
+								return sort_spec->SortDirection == ImGuiSortDirection_Descending;
+						}
+
+						return a.series->name < b.series->name;
+					});
+
+				sort_specs->SpecsDirty = false;
+			}
+
+			for (const SeriesStats& row : rows)
+			{
+				const char* format = row.series->group == Group::Routing ? "%.0f" : "%.3f";
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+
+				ImGui::TextUnformatted(GetGroupName(row.series->group)); ImGui::TableNextColumn();
+				ImGui::TextUnformatted(row.series->name.c_str()); ImGui::TableNextColumn();
+				ImGui::Text(format, row.current); ImGui::TableNextColumn();
+				ImGui::Text(format, row.average); ImGui::TableNextColumn();
+				ImGui::Text(format, row.max);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	std::map<std::pair<Group, std::string>, std::unique_ptr<Series>> m_series;
+	float m_history = 30.0f;
+	float m_time = 0.0f;
+	bool m_paused = false;
+
+	std::chrono::steady_clock::time_point m_lastMemoryUpdate;
+	float m_workingSet = 0.0f;
+	float m_privateBytes = 0.0f;
+};
+static PerformanceInspector* s_performanceInspector = nullptr;
+
+#pragma endregion
+
+#pragma region Memory Inspector
+
+class MemoryInspector : public ImGuiWindowBase
+{
+public:
+	MemoryInspector() : ImGuiWindowBase("Memory")
+	{
+		SetDefaultSize(ImVec2(700, 400));
+	}
+
+	virtual void Draw() override
+	{
+		if (!gbMemoryAccounting)
+		{
+			ImGui::TextDisabled("Lua and ImGui are only counted with MemoryAccounting=1 in the [MacroQuest] section of MacroQuest.ini.");
+		}
+
+		constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV
+			| ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+
+		if (ImGui::BeginTable("##MemoryTable", 6, tableFlags))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Name");
+			ImGui::TableSetupColumn("Current");
+			ImGui::TableSetupColumn("Peak");
+			ImGui::TableSetupColumn("Total Allocated");
+			ImGui::TableSetupColumn("Allocations");
+			ImGui::TableSetupColumn("Rate");
+			ImGui::TableHeadersRow();
+
+			for (const MQMemoryStats& stats : MemoryAccounting_GetStats())
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+
+				ImGui::TextUnformatted(stats.Name.c_str()); ImGui::TableNextColumn();
+				ImGui::TextUnformatted(FormatBytes(static_cast<double>(stats.Current)).c_str()); ImGui::TableNextColumn();
+				ImGui::TextUnformatted(FormatBytes(static_cast<double>(stats.Peak)).c_str()); ImGui::TableNextColumn();
+				ImGui::TextUnformatted(FormatBytes(static_cast<double>(stats.TotalAllocated)).c_str()); ImGui::TableNextColumn();
+				ImGui::Text("%" PRIu64, stats.Allocations); ImGui::TableNextColumn();
+				ImGui::Text("%s/s", FormatBytes(static_cast<double>(stats.AllocationRate)).c_str());
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+private:
+	static std::string FormatBytes(double bytes)
+	{
+		if (std::abs(bytes) >= 1024.0 * 1024.0)
+			return fmt::format("{:.2f} MB", bytes / (1024.0 * 1024.0));
+		if (std::abs(bytes) >= 1024.0)
+			return fmt::format("{:.2f} KB", bytes / 1024.0);
+
+		return fmt::format("{:.0f} B", bytes);
+	}
+};
+static MemoryInspector* s_memoryInspector = nullptr;
+
+#pragma endregion
+
+#pragma region Slow Expressions
+
+class SlowExpressionsInspector : public ImGuiWindowBase
+{
+public:
+	SlowExpressionsInspector() : ImGuiWindowBase("Slow Expressions")
+	{
+		SetDefaultSize(ImVec2(800, 400));
+	}
+
+	virtual void Draw() override
+	{
+		ImGui::Checkbox("Enabled", &gbSlowExpressions);
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(120);
+		if (ImGui::InputInt("Threshold (us)", &gSlowExpressionThreshold, 100, 1000))
+			gSlowExpressionThreshold = std::max(gSlowExpressionThreshold, 0);
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			SlowExpressions_Clear();
+
+		constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV
+			| ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+
+		if (ImGui::BeginTable("##SlowExpressionsTable", 5, tableFlags))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Time", ImGuiTableColumnFlags_WidthFixed, 70);
+			ImGui::TableSetupColumn("Kind", ImGuiTableColumnFlags_WidthFixed, 70);
+			ImGui::TableSetupColumn("Duration", ImGuiTableColumnFlags_WidthFixed, 80);
+			ImGui::TableSetupColumn("Source", ImGuiTableColumnFlags_WidthFixed, 200);
+			ImGui::TableSetupColumn("Expression", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableHeadersRow();
+
+			// Newest first
+			std::vector<MQSlowExpression> expressions = SlowExpressions_Get();
+			for (auto iter = expressions.rbegin(); iter != expressions.rend(); ++iter)
+			{
+				const MQSlowExpression& expression = *iter;
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+
+				tm timeInfo;
+				localtime_s(&timeInfo, &expression.Time);
+				ImGui::Text("%02d:%02d:%02d", timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec);
+				ImGui::TableNextColumn();
+
+				ImGui::TextUnformatted(GetKindName(expression.Kind)); ImGui::TableNextColumn();
+				ImGui::Text("%.2f ms", expression.Duration.count() / 1000.0); ImGui::TableNextColumn();
+				ImGui::TextUnformatted(expression.Source.c_str()); ImGui::TableNextColumn();
+
+				ImGui::PushID(static_cast<int>(iter - expressions.rbegin()));
+				ImGui::TextUnformatted(expression.Text.c_str());
+				if (ImGui::BeginPopupContextItem("##SlowExpressionContext"))
+				{
+					if (ImGui::Selectable("Copy"))
+						ImGui::SetClipboardText(expression.Text.c_str());
+					ImGui::EndPopup();
+				}
+				ImGui::PopID();
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+private:
+	static const char* GetKindName(MQSlowExpressionKind kind)
+	{
+		switch (kind)
+		{
+		case MQSlowExpressionKind::Parse: return "Parse";
+		case MQSlowExpressionKind::Command: return "Command";
+		case MQSlowExpressionKind::Member: return "Member";
+		default: return "Unknown";
+		}
+	}
+};
+static SlowExpressionsInspector* s_slowExpressionsInspector = nullptr;
+
+#pragma endregion
+
+#pragma region Routing
+
+class RoutingInspector : public ImGuiWindowBase
+{
+public:
+	RoutingInspector() : ImGuiWindowBase("Routing")
+	{
+		SetDefaultSize(ImVec2(600, 400));
+	}
+
+	virtual void Draw() override
+	{
+		if (std::optional<PipeConnectionStats> connection = pipeclient::GetConnectionStats())
+		{
+			if (ImGui::BeginTable("##RoutingConnection", 4, ImGuiTableFlags_BordersInnerV))
+			{
+				ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 120);
+				ImGui::TableSetupColumn("Messages/s", ImGuiTableColumnFlags_WidthFixed, 90);
+				ImGui::TableSetupColumn("KB/s", ImGuiTableColumnFlags_WidthFixed, 90);
+				ImGui::TableSetupColumn("Total", ImGuiTableColumnFlags_WidthStretch);
+				ImGui::TableHeadersRow();
+
+				auto row = [](const char* label, float messageRate, float byteRate, uint64_t messages, uint64_t bytes)
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::TextUnformatted(label);
+					ImGui::TableNextColumn(); ImGui::Text("%.1f", messageRate);
+					ImGui::TableNextColumn(); ImGui::Text("%.1f", byteRate / 1024.0f);
+					ImGui::TableNextColumn(); ImGui::Text("%llu (%.1f KB)", messages, bytes / 1024.0);
+				};
+
+				row("Sent to launcher", connection->SentMessageRate, connection->SentByteRate,
+					connection->MessagesSent, connection->BytesSent);
+				row("From launcher", connection->ReceivedMessageRate, connection->ReceivedByteRate,
+					connection->MessagesReceived, connection->BytesReceived);
+
+				ImGui::EndTable();
+			}
+
+			ImGui::Text("Transport: %s", connection->SharedMemory ? "Shared memory rings" : "Named pipe");
+			ImGui::Text("Send queue: %d (max %d)", static_cast<int>(connection->SendQueueDepth),
+				static_cast<int>(connection->MaxSendQueueDepth));
+			ImGui::Text("Waiting for the main thread: %d", static_cast<int>(pipeclient::GetQueuedMessageCount()));
+			ImGui::Text("RPC: %d pending, %llu completed, round trip %.2f ms last, %.2f ms avg, %.2f ms max",
+				static_cast<int>(connection->PendingRequests), connection->CompletedRequests,
+				connection->LastRoundTrip.count() / 1000.0, connection->AverageRoundTrip.count() / 1000.0,
+				connection->MaxRoundTrip.count() / 1000.0);
+			ImGui::Text("RPC round trip under: %.2f ms p50, %.2f ms p99. %llu timed out, %llu refused",
+				connection->MedianRoundTrip.count() / 1000.0, connection->P99RoundTrip.count() / 1000.0,
+				connection->TimedOutRequests, connection->RejectedRequests);
+		}
+		else
+		{
+			ImGui::TextColored(ImColor(255, 0, 0), "Not connected to the launcher");
+		}
+
+		ImGui::Separator();
+
+		constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV
+			| ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+
+		if (ImGui::BeginTable("##RoutingMailboxes", 6, tableFlags))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Mailbox", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("Messages/s", ImGuiTableColumnFlags_WidthFixed, 80);
+			ImGui::TableSetupColumn("KB/s", ImGuiTableColumnFlags_WidthFixed, 60);
+			ImGui::TableSetupColumn("Delivered", ImGuiTableColumnFlags_WidthFixed, 70);
+			ImGui::TableSetupColumn("Processed", ImGuiTableColumnFlags_WidthFixed, 70);
+			ImGui::TableSetupColumn("Queue", ImGuiTableColumnFlags_WidthFixed, 80);
+			ImGui::TableHeadersRow();
+
+			for (const postoffice::MailboxStats& mailbox : pipeclient::GetMailboxStats())
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::TextUnformatted(mailbox.Address.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", mailbox.MessageRate);
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", mailbox.ByteRate / 1024.0f);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", mailbox.MessagesDelivered);
+				ImGui::TableNextColumn(); ImGui::Text("%llu", mailbox.MessagesProcessed);
+				ImGui::TableNextColumn(); ImGui::Text("%d (max %d)", static_cast<int>(mailbox.QueueDepth),
+					static_cast<int>(mailbox.MaxQueueDepth));
+			}
+
+			ImGui::EndTable();
+		}
+	}
+};
+static RoutingInspector* s_routingInspector = nullptr;
+
+#pragma endregion
+
+#pragma region Sampling Profiler
+
+class SamplingProfilerInspector : public ImGuiWindowBase
+{
+public:
+	SamplingProfilerInspector() : ImGuiWindowBase("Sampling Profiler")
+	{
+		SetDefaultSize(ImVec2(900, 500));
+	}
+
+	virtual void Draw() override
+	{
+		const bool running = SamplingProfiler_IsRunning();
+
+		ImGui::BeginDisabled(running);
+		ImGui::SetNextItemWidth(100);
+		ImGui::InputFloat("Seconds", &m_seconds, 1.0f, 5.0f, "%.1f");
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(100);
+		ImGui::InputFloat("Interval (ms)", &m_interval, 0.5f, 1.0f, "%.1f");
+		ImGui::SameLine();
+		if (ImGui::Button("Start"))
+		{
+			m_seconds = std::max(m_seconds, 0.1f);
+			m_interval = std::max(m_interval, 0.1f);
+
+			SamplingProfiler_Start(std::chrono::milliseconds(static_cast<int64_t>(m_seconds * 1000)),
+				std::chrono::microseconds(static_cast<int64_t>(m_interval * 1000)));
+		}
+		ImGui::EndDisabled();
+
+		if (running)
+		{
+			ImGui::SameLine();
+			ImGui::TextColored(ImColor(255, 255, 0), "Sampling...");
+		}
+
+		std::shared_ptr<const MQSamplingProfile> profile = SamplingProfiler_GetProfile();
+		if (profile != m_profile)
+		{
+			m_profile = profile;
+			m_zoom = m_profile ? &m_profile->Root : nullptr;
+		}
+
+		if (!m_profile)
+		{
+			ImGui::TextDisabled("No profile has been captured yet. Profiles can also be captured with /benchmark sample [seconds] [interval ms].");
+			return;
+		}
+
+		ImGui::Text("%u samples over %.1fs", m_profile->Root.Samples, m_profile->Duration.count() / 1000.0f);
+		if (!m_profile->FoldedPath.empty())
+		{
+			ImGui::SameLine();
+			ImGui::TextDisabled("(%s)", m_profile->FoldedPath.c_str());
+		}
+
+		if (ImGui::BeginTabBar("##SamplingProfilerTabs"))
+		{
+			if (ImGui::BeginTabItem("Flame Graph"))
+			{
+				if (m_zoom != &m_profile->Root)
+				{
+					if (ImGui::Button("Reset Zoom"))
+						m_zoom = &m_profile->Root;
+				}
+				else
+				{
+					ImGui::TextDisabled("Click a function to zoom in on it.");
+				}
+
+				if (ImGui::BeginChild("##FlameGraph", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar))
+				{
+					DrawFlameGraph(*m_zoom);
+				}
+				ImGui::EndChild();
+
+				ImGui::EndTabItem();
+			}
+
+			if (ImGui::BeginTabItem("Functions"))
+			{
+				DrawFunctions();
+				ImGui::EndTabItem();
+			}
+
+			ImGui::EndTabBar();
+		}
+	}
+
+private:
+	static int GetDepth(const MQProfileNode& node)
+	{
+		int depth = 0;
+		for (const MQProfileNode& child : node.Children)
+			depth = std::max(depth, GetDepth(child));
+
+		return depth + 1;
+	}
+
+	void DrawFlameGraph(const MQProfileNode& root)
+	{
+		const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+		const float width = ImGui::GetContentRegionAvail().x;
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+
+		ImGui::Dummy(ImVec2(width, rowHeight * GetDepth(root)));
+
+		DrawFlameGraphNode(ImGui::GetWindowDrawList(), root, origin.x, width, origin.y, rowHeight);
+	}
+
+	void DrawFlameGraphNode(ImDrawList* drawList, const MQProfileNode& node, float x, float width, float y, float rowHeight)
+	{
+		if (width < 1.0f)
+			return;
+
+		const ImVec2 min(x, y);
+		const ImVec2 max(x + width - 1.0f, y + rowHeight - 1.0f);
+
+		// Give each module its own hue, so that the game and each plugin can be told apart.
+		const float hue = (std::hash<std::string>{}(node.Module) % 360) / 360.0f;
+		const bool hovered = ImGui::IsMouseHoveringRect(min, max);
+
+		drawList->AddRectFilled(min, max, ImColor::HSV(hue, 0.45f, hovered ? 0.95f : 0.75f));
+		drawList->PushClipRect(min, max, true);
+		drawList->AddText(ImVec2(x + 3.0f, y + 1.0f), IM_COL32(0, 0, 0, 255), node.Name.c_str());
+		drawList->PopClipRect();
+
+		if (hovered)
+		{
+			const float total = static_cast<float>(std::max(m_profile->Root.Samples, 1u));
+
+			ImGui::BeginTooltip();
+			ImGui::TextUnformatted(node.Name.c_str());
+			ImGui::TextDisabled("%s", node.Module.c_str());
+			ImGui::Text("Total: %.2f%% (%u samples)", node.Samples * 100.0f / total, node.Samples);
+			ImGui::Text("Self: %.2f%% (%u samples)", node.SelfSamples * 100.0f / total, node.SelfSamples);
+			ImGui::EndTooltip();
+
+			if (ImGui::IsMouseClicked(ImGuiMouseButton_Left))
+				m_zoom = &node;
+		}
+
+		float childX = x;
+		for (const MQProfileNode& child : node.Children)
+		{
+			const float childWidth = width * child.Samples / std::max(node.Samples, 1u);
+			DrawFlameGraphNode(drawList, child, childX, childWidth, y + rowHeight, rowHeight);
+			childX += childWidth;
+		}
+	}
+
+	void DrawFunctions()
+	{
+		constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV
+			| ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+
+		if (ImGui::BeginTable("##SamplingProfilerFunctions", 4, tableFlags))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Function", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("Module", ImGuiTableColumnFlags_WidthFixed, 150);
+			ImGui::TableSetupColumn("Self", ImGuiTableColumnFlags_WidthFixed, 70);
+			ImGui::TableSetupColumn("Total", ImGuiTableColumnFlags_WidthFixed, 70);
+			ImGui::TableHeadersRow();
+
+			const float total = static_cast<float>(std::max(m_profile->Root.Samples, 1u));
+
+			for (const MQProfileFunction& function : m_profile->Functions)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+
+				ImGui::TextUnformatted(function.Name.c_str()); ImGui::TableNextColumn();
+				ImGui::TextUnformatted(function.Module.c_str()); ImGui::TableNextColumn();
+				ImGui::Text("%.2f%%", function.SelfSamples * 100.0f / total); ImGui::TableNextColumn();
+				ImGui::Text("%.2f%%", function.Samples * 100.0f / total);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	float m_seconds = 10.0f;
+	float m_interval = 1.0f;
+	std::shared_ptr<const MQSamplingProfile> m_profile;
+	const MQProfileNode* m_zoom = nullptr;
+};
+static SamplingProfilerInspector* s_samplingProfilerInspector = nullptr;
+
+#pragma endregion
+
+#pragma region String Inspector
+
+class StringInspector : public ImGuiWindowBase
+{
+public:
+	StringInspector() : ImGuiWindowBase("String Inspector")
+	{
+	}
+
+	~StringInspector()
+	{
+	}
+
+protected:
+	void Draw() override
+	{
+		ImGui::LabelText("StrRep Allocations", "%d", eqlib::internal::gStrRepAllocations);
+		ImGui::LabelText("StrRep Live Objects", "%d", eqlib::internal::gStrRepLiveObjects);
+
+		ImGui::Text("CXStr FreeLists:");
+
+		// Walking the free lists holds the string lock, so they are only counted every so often.
+		const auto now = std::chrono::steady_clock::now();
+		if (now - m_lastCount >= 500ms)
+		{
+			m_lastCount = now;
+			CountFreeLists();
+		}
+
+		if (m_hasFreeList)
+		{
+			if (ImGui::BeginTable("##CXFreeListTable", 2))
+			{
+				ImGui::TableSetupColumn("Block Size");
+				ImGui::TableSetupColumn("Count");
+				ImGui::TableHeadersRow();
+
+				for (const auto& [blockSize, count] : m_freeListCounts)
+				{
+					ImGui::TableNextRow();
+
+					ImGui::TableNextColumn();
+					ImGui::Text("%d", blockSize);
+
+					ImGui::TableNextColumn();
+					ImGui::Text("%d", count);
+				}
+
+				ImGui::EndTable();
+			}
+		}
+		else
+		{
+			ImGui::Text("<no freelist>");
+		}
+	}
+
+private:
+	void CountFreeLists()
+	{
+		m_freeListCounts.clear();
+
+		eqlib::internal::LockCXStrMutex();
+		CXFreeList* freeList = eqlib::internal::GetCXFreeList();
+		m_hasFreeList = freeList != nullptr;
+
+		if (freeList)
+		{
+			while (freeList->blockSize > 0)
+			{
+				size_t count = 0;
+				CStrRep* rep = freeList->repList;
+				while (rep)
+				{
+					++count;
+					rep = rep->next;
+				}
+
+				m_freeListCounts.emplace_back(freeList->blockSize, count);
+				++freeList;
+			}
+		}
+
+		eqlib::internal::UnlockCXStrMutex();
+	}
+
+	std::chrono::steady_clock::time_point m_lastCount;
+	bool m_hasFreeList = false;
+	std::vector<std::pair<int, size_t>> m_freeListCounts;
+};
+static StringInspector* s_stringInspector = nullptr;
+
+#pragma endregion
+
+#pragma region Switch Inspector
+
+// FIXME: Pull these helpers out
+inline bool IsSwitchStationary(EQSwitch* pSwitch)
+{
+	int typeId = pSwitch->Type;
+
+	return (typeId != 53 && typeId >= 50 && typeId < 59)
+		|| (typeId >= 153 && typeId <= 155);
+}
+
+inline bool IsSwitchTeleporter(EQSwitch* pSwitch)
+{
+	int typeId = pSwitch->Type;
+	DWORD TableSize = *(DWORD*)Teleport_Table_Size;
+
+	return (typeId == 57 || typeId == 58) && pSwitch->SpellID > -1 && (pSwitch->SpellID < (int)TableSize);
+}
+
+class ImGuiSwitchViewer
+{
+	int m_instanceId = 0;
+	std::string m_windowDisplayName;
+	std::string m_viewerTitle;
+	bool m_needDock = true;
+	bool m_needFocus = false;
+	ImGuiID m_windowId = 0;
+
+	int m_id = -1;
+
+public:
+	ImGuiSwitchViewer()
+	{
+		static int nextInstanceId = 1;
+		m_instanceId = nextInstanceId++;
+	}
+
+	void SetNeedDock(bool dock) { m_needDock = dock; }
+	bool GetNeedDock() const { return m_needDock; }
+
+	void SetNeedFocus(bool needFocus) { m_needFocus = needFocus; }
+	const char* GetWindowIdStr() const { return m_viewerTitle.c_str(); }
+
+	int GetInstanceId() const { return m_instanceId; }
+	ImGuiID GetWindowId() const { return m_windowId; }
+
+	void SetSwitchId(int id)
+	{
+		if (!test_and_set(m_id, id))
+			return;
+
+		m_needFocus = true;
+
+		if (m_id >= 0)
+		{
+			const EQSwitch* pSwitch = pSwitchMgr->GetSwitchById(m_id);
+			if (pSwitch)
+			{
+				m_windowDisplayName = fmt::format("{} ({})", pSwitch->Name, pSwitch->ID);
+			}
+			else
+			{
+				m_windowDisplayName = fmt::format("Switch {}", m_id);
+			}
+
+		}
+
+		m_viewerTitle = fmt::format("{}###SwitchViewer{}", m_windowDisplayName, m_instanceId);
+	}
+	int GetSwitchId() const { return m_id; }
+
+	bool Draw()
+	{
+		if (m_needFocus)
+		{
+			ImGui::SetNextWindowFocus();
+			m_needFocus = false;
+		}
+
+		bool open = true;
+		ImGui::SetNextWindowSize(ImVec2(480, 640), ImGuiCond_FirstUseEver);
+		if (ImGui::Begin(m_viewerTitle.c_str(), &open))
+		{
+			if (m_windowId == 0)
+				m_windowId = ImGui::GetCurrentWindow()->ID;
 
 			ImGui::SetCursorPosY(ImGui::GetCursorPosY() + 9);
 
@@ -5235,98 +6267,106 @@ public:
 				m_positionChanged = false;
 			}
 
-			for (EQSwitch* pSwitch : m_switches)
+			ImGuiListClipper clipper;
+			clipper.Begin(static_cast<int>(m_switches.size()));
+
+			while (clipper.Step())
 			{
-				bool targetted = (m_lastDoorTargetId == pSwitch->ID);
-				bool selected = (m_selectedSwitchId == pSwitch->ID);
+				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+				{
+					EQSwitch* pSwitch = m_switches[row];
 
-				ImGui::PushID(pSwitch->ID);
-				ImGui::TableNextRow();
+					bool targetted = (m_lastDoorTargetId == pSwitch->ID);
+					bool selected = (m_selectedSwitchId == pSwitch->ID);
 
-				if (targetted)
-					ImGui::PushStyleColor(ImGuiCol_Text, MQColor(0, 255, 0).ToImU32());
+					ImGui::PushID(pSwitch->ID);
+					ImGui::TableNextRow();
 
-				ImGui::TableNextColumn();
+					if (targetted)
+						ImGui::PushStyleColor(ImGuiCol_Text, MQColor(0, 255, 0).ToImU32());
 
-				char label[32];
-				sprintf_s(label, "%d", pSwitch->ID);
+					ImGui::TableNextColumn();
 
-				if (ImGui::Selectable(label, selected, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap))
-				{
-					if (ImGui::GetIO().KeyCtrl)
-						ShowSwitchViewer(pSwitch->ID, true);
-					else
-						SetSelectedSwitchId(pSwitch->ID);
-				}
+					char label[32];
+					sprintf_s(label, "%d", pSwitch->ID);
 
-				ImGui::TableNextColumn();
-				ImGui::Text("%s", pSwitch->Name);
+					if (ImGui::Selectable(label, selected, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap))
+					{
+						if (ImGui::GetIO().KeyCtrl)
+							ShowSwitchViewer(pSwitch->ID, true);
+						else
+							SetSelectedSwitchId(pSwitch->ID);
+					}
 
-				if (ImGui::BeginPopupContextItem(""))
-				{
-					ImGui::TextColored(achGoldColor.ToImColor(), "%s", pSwitch->Name);
-					ImGui::Separator();
+					ImGui::TableNextColumn();
+					ImGui::Text("%s", pSwitch->Name);
 
-					if (ImGui::Selectable("Open in new viewer"))
-						ShowSwitchViewer(pSwitch->ID, true);
-					if (ImGui::Selectable("Copy ID"))
+					if (ImGui::BeginPopupContextItem(""))
 					{
-						char idText[32];
-						sprintf_s(idText, "%d", pSwitch->ID);
+						ImGui::TextColored(achGoldColor.ToImColor(), "%s", pSwitch->Name);
+						ImGui::Separator();
+
+						if (ImGui::Selectable("Open in new viewer"))
+							ShowSwitchViewer(pSwitch->ID, true);
+						if (ImGui::Selectable("Copy ID"))
+						{
+							char idText[32];
+							sprintf_s(idText, "%d", pSwitch->ID);
+
+							ImGui::SetClipboardText(idText);
+						}
+						if (ImGui::Selectable("Copy Name"))
+							ImGui::SetClipboardText(pSwitch->Name);
 
-						ImGui::SetClipboardText(idText);
+						ImGui::EndPopup();
 					}
-					if (ImGui::Selectable("Copy Name"))
-						ImGui::SetClipboardText(pSwitch->Name);
 
-					ImGui::EndPopup();
-				}
+					ImGui::TableNextColumn();
+					ImGui::Text("%d", pSwitch->Type);
 
-				ImGui::TableNextColumn();
-				ImGui::Text("%d", pSwitch->Type);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", GetDistance(pSwitch));
 
-				ImGui::TableNextColumn();
-				ImGui::Text("%.2f", GetDistance(pSwitch));
+					ImGui::TableNextColumn();
 
-				ImGui::TableNextColumn();
+					if (targetted)
+						ImGui::PopStyleColor();
 
-				if (targetted)
-					ImGui::PopStyleColor();
+					if (ImGui::SmallButton("Click"))
+					{
+						pSwitch->UseSwitch(pLocalPlayer->SpawnID, -1, 0, nullptr);
+					}
 
-				if (ImGui::SmallButton("Click"))
-				{
-					pSwitch->UseSwitch(pLocalPlayer->SpawnID, -1, 0, nullptr);
-				}
+					if (targetted)
+					{
+						ImGui::SameLine();
+						ImGui::Text("<target>");
+					}
+					else
+					{
+						ImGui::SameLine();
+						if (ImGui::SmallButton("Target"))
+						{
+							DoCommandf("/doortarget id %d", pSwitch->ID);
+						}
+					}
 
-				if (targetted)
-				{
-					ImGui::SameLine();
-					ImGui::Text("<target>");
-				}
-				else
-				{
-					ImGui::SameLine();
-					if (ImGui::SmallButton("Target"))
+					if (IsSwitchStationary(pSwitch))
 					{
-						DoCommandf("/doortarget id %d", pSwitch->ID);
+						ImGui::SameLine();
+						ImGui::Text("*stationary*");
 					}
-				}
 
-				if (IsSwitchStationary(pSwitch))
-				{
-					ImGui::SameLine();
-					ImGui::Text("*stationary*");
-				}
+					if (IsSwitchTeleporter(pSwitch))
+					{
+						ImGui::SameLine();
 
-				if (IsSwitchTeleporter(pSwitch))
-				{
-					ImGui::SameLine();
+						const char* dest = GetTeleportName(pSwitch->SpellID);
+						ImGui::Text("*teleporter: %s*", dest);
+					}
 
-					const char* dest = GetTeleportName(pSwitch->SpellID);
-					ImGui::Text("*teleporter: %s*", dest);
+					ImGui::PopID();
 				}
-
-				ImGui::PopID();
 			}
 
 			ImGui::EndTable();
@@ -5628,9 +6668,31 @@ static ZoneInspector* s_zoneInspector = nullptr;
 
 #pragma region Macro Expression Evaluator
 
+// Each expression is a watch that is evaluated again at the chosen rate. Evaluations are timed
+// with a benchmark of their own, and every member call they make is traced, so that the cost of
+// an expression can be broken down by the members it uses.
 class MacroExpressionEvaluator : public ImGuiWindowBase
 {
 	using CharBuffer = std::unique_ptr<char[]>;
+
+	struct MemberStats
+	{
+		uint64_t calls = 0;
+		std::chrono::microseconds totalTime{ 0 };
+		std::chrono::microseconds maxTime{ 0 };
+	};
+
+	struct ExpressionWatch
+	{
+		CharBuffer expression;
+		std::string evaluated;                            // the expression the timings belong to
+		uint32_t benchmark = 0;
+		std::string lastValue;
+		std::chrono::steady_clock::time_point lastEvaluated;
+		uint64_t evaluations = 0;
+		std::map<std::string, MemberStats> members;
+	};
+
 public:
 	MacroExpressionEvaluator() : ImGuiWindowBase("Macro Expression Evaluator")
 	{
@@ -5639,44 +6701,172 @@ public:
 
 	~MacroExpressionEvaluator()
 	{
+		for (ExpressionWatch& watch : m_watches)
+			ResetWatch(watch);
 	}
 
 protected:
 	void Draw() override
 	{
+		ImGui::SetNextItemWidth(150);
+		ImGui::SliderInt("Interval (ms)", &m_intervalMs, 0, 5000, m_intervalMs == 0 ? "Every frame" : "%d");
+		ImGui::SameLine();
+		if (ImGui::Button("Reset Timings"))
+		{
+			for (ExpressionWatch& watch : m_watches)
+				ResetWatch(watch);
+		}
+		ImGui::Separator();
+
+		const auto now = std::chrono::steady_clock::now();
+
 		int deleteRow = -1;
-		for (int i = 0; i < (int)m_expressions.size(); ++i)
+		for (int i = 0; i < (int)m_watches.size(); ++i)
 		{
+			ExpressionWatch& watch = m_watches[i];
+
 			ImGui::PushID(i);
 			ImGui::SetNextItemWidth(-20);
-			ImGui::InputText("##Expression", m_expressions[i].get(), MAX_STRING);
+			ImGui::InputText("##Expression", watch.expression.get(), MAX_STRING);
 			ImGui::SameLine();
 			if (ImGui::Button("X"))
 				deleteRow = i;
 
-			// Evaluate the row
-			static char szTemp[MAX_STRING];
-			strcpy_s(szTemp, m_expressions[i].get());
-			ParseMacroParameter(szTemp);
+			if (watch.evaluated != watch.expression.get())
+			{
+				ResetWatch(watch);
+				watch.evaluated = watch.expression.get();
+			}
+
+			if (!watch.evaluated.empty()
+				&& (watch.evaluations == 0 || now - watch.lastEvaluated >= std::chrono::milliseconds(m_intervalMs)))
+			{
+				Evaluate(watch);
+				watch.lastEvaluated = now;
+			}
+
+			ImGui::TextUnformatted(watch.lastValue.c_str());
+
+			MQBenchmark benchmark;
+			if (watch.benchmark != 0 && GetMQ2Benchmark(watch.benchmark, benchmark) && benchmark.Count > 0)
+			{
+				ImGui::TextDisabled("%" PRIu64 " evaluations, mean %.1f us, p99 %" PRId64 " us, max %" PRId64 " us",
+					benchmark.Count, static_cast<double>(benchmark.TotalTime.count()) / benchmark.Count,
+					static_cast<int64_t>(benchmark.P99Time.count()), static_cast<int64_t>(benchmark.MaxTime.count()));
+
+				if (!watch.members.empty() && ImGui::TreeNode("Members"))
+				{
+					DrawMemberBreakdown(watch);
+					ImGui::TreePop();
+				}
+			}
 
-			ImGui::Text("%s", szTemp);
 			ImGui::Separator();
 
 			ImGui::PopID();
 		}
 		if (deleteRow != -1)
-			m_expressions.erase(m_expressions.begin() + deleteRow);
+		{
+			ResetWatch(m_watches[deleteRow]);
+			m_watches.erase(m_watches.begin() + deleteRow);
+		}
 		if (ImGui::Button("Add"))
 		{
-			auto buf = std::make_unique<char[]>(MAX_STRING);
-			buf[0] = 0;
+			ExpressionWatch watch;
+			watch.expression = std::make_unique<char[]>(MAX_STRING);
+			watch.expression[0] = 0;
 
-			m_expressions.push_back(std::move(buf));
+			m_watches.push_back(std::move(watch));
 		}
 	}
 
 private:
-	std::vector<CharBuffer> m_expressions;
+	static void ResetWatch(ExpressionWatch& watch)
+	{
+		if (watch.benchmark != 0)
+		{
+			RemoveMQ2Benchmark(watch.benchmark);
+			watch.benchmark = 0;
+		}
+
+		watch.evaluated.clear();
+		watch.lastValue.clear();
+		watch.evaluations = 0;
+		watch.members.clear();
+	}
+
+	void Evaluate(ExpressionWatch& watch)
+	{
+		if (watch.benchmark == 0)
+			watch.benchmark = AddMQ2Benchmark(fmt::format("Expression: {}", watch.evaluated).c_str());
+
+		static char szTemp[MAX_STRING];
+		strcpy_s(szTemp, watch.evaluated.c_str());
+
+		m_memberTrace.clear();
+		SlowExpressions_BeginMemberTrace(m_memberTrace);
+
+		EnterMQ2Benchmark(watch.benchmark);
+		ParseMacroParameter(szTemp);
+		ExitMQ2Benchmark(watch.benchmark);
+
+		SlowExpressions_EndMemberTrace();
+
+		watch.lastValue = szTemp;
+		++watch.evaluations;
+
+		for (const MQMemberTiming& timing : m_memberTrace)
+		{
+			MemberStats& stats = watch.members[timing.Member];
+			++stats.calls;
+			stats.totalTime += timing.Duration;
+			stats.maxTime = std::max(stats.maxTime, timing.Duration);
+		}
+	}
+
+	static void DrawMemberBreakdown(const ExpressionWatch& watch)
+	{
+		if (ImGui::BeginTable("##MemberBreakdown", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingFixedFit))
+		{
+			ImGui::TableSetupColumn("Member", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("Calls / Eval");
+			ImGui::TableSetupColumn("Mean (us)");
+			ImGui::TableSetupColumn("Max (us)");
+			ImGui::TableHeadersRow();
+
+			// Most expensive first, per evaluation.
+			std::vector<std::pair<const std::string*, const MemberStats*>> members;
+			members.reserve(watch.members.size());
+			for (const auto& [name, stats] : watch.members)
+				members.emplace_back(&name, &stats);
+
+			std::sort(members.begin(), members.end(),
+				[](const auto& a, const auto& b) { return a.second->totalTime > b.second->totalTime; });
+
+			for (const auto& [name, stats] : members)
+			{
+				ImGui::TableNextRow();
+
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(name->c_str());
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", static_cast<double>(stats->calls) / watch.evaluations);
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", static_cast<double>(stats->totalTime.count()) / stats->calls);
+
+				ImGui::TableNextColumn();
+				ImGui::Text("%" PRId64, static_cast<int64_t>(stats->maxTime.count()));
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	int m_intervalMs = 250;
+	std::vector<ExpressionWatch> m_watches;
+	std::vector<MQMemberTiming> m_memberTrace;
 };
 
 static MacroExpressionEvaluator* s_macroEvaluator = nullptr;
@@ -5985,6 +7175,24 @@ static void DeveloperTools_Initialize()
 	s_benchmarksInspector = new BenchmarksInspector();
 	DeveloperTools_RegisterMenuItem(s_benchmarksInspector, "Benchmarks", s_menuNameInspectors);
 
+	s_pluginTimingsInspector = new PluginTimingsInspector();
+	DeveloperTools_RegisterMenuItem(s_pluginTimingsInspector, "Plugin Timings", s_menuNameInspectors);
+
+	s_performanceInspector = new PerformanceInspector();
+	DeveloperTools_RegisterMenuItem(s_performanceInspector, "Performance", s_menuNameInspectors);
+
+	s_memoryInspector = new MemoryInspector();
+	DeveloperTools_RegisterMenuItem(s_memoryInspector, "Memory", s_menuNameInspectors);
+
+	s_slowExpressionsInspector = new SlowExpressionsInspector();
+	DeveloperTools_RegisterMenuItem(s_slowExpressionsInspector, "Slow Expressions", s_menuNameInspectors);
+
+	s_samplingProfilerInspector = new SamplingProfilerInspector();
+	DeveloperTools_RegisterMenuItem(s_samplingProfilerInspector, "Sampling Profiler", s_menuNameInspectors);
+
+	s_routingInspector = new RoutingInspector();
+	DeveloperTools_RegisterMenuItem(s_routingInspector, "Routing", s_menuNameInspectors);
+
 	s_achievementsInspector = new AchievementsInspector();
 	DeveloperTools_RegisterMenuItem(s_achievementsInspector, "Achievements", s_menuNameInspectors);
 
@@ -6033,6 +7241,24 @@ static void DeveloperTools_Shutdown()
 	DeveloperTools_UnregisterMenuItem(s_benchmarksInspector);
 	delete s_benchmarksInspector; s_benchmarksInspector = nullptr;
 
+	DeveloperTools_UnregisterMenuItem(s_pluginTimingsInspector);
+	delete s_pluginTimingsInspector; s_pluginTimingsInspector = nullptr;
+
+	DeveloperTools_UnregisterMenuItem(s_performanceInspector);
+	delete s_performanceInspector; s_performanceInspector = nullptr;
+
+	DeveloperTools_UnregisterMenuItem(s_memoryInspector);
+	delete s_memoryInspector; s_memoryInspector = nullptr;
+
+	DeveloperTools_UnregisterMenuItem(s_slowExpressionsInspector);
+	delete s_slowExpressionsInspector; s_slowExpressionsInspector = nullptr;
+
+	DeveloperTools_UnregisterMenuItem(s_samplingProfilerInspector);
+	delete s_samplingProfilerInspector; s_samplingProfilerInspector = nullptr;
+
+	DeveloperTools_UnregisterMenuItem(s_routingInspector);
+	delete s_routingInspector; s_routingInspector = nullptr;
+
 	DeveloperTools_UnregisterMenuItem(s_achievementsInspector);
 	delete s_achievementsInspector; s_achievementsInspector = nullptr;
 
@@ -35,6 +35,7 @@ void DeveloperTools_UnregisterMenuItem(ImGuiWindowBase* window);
 
 // Developer Tools - Window Inspector panel
 void DeveloperTools_WindowInspector_Show(CXWnd* pWnd);
+void DeveloperTools_WindowInspector_AddWindow(CXWnd* pWnd);
 void DeveloperTools_WindowInspector_RemoveWindow(CXWnd* pWnd);
 void DeveloperTools_WindowInspector_SetSelectedWindow(CXWnd* pWnd);
 
@@ -19,6 +19,7 @@
 #include "ImGuiManager.h"
 #include "imgui/ImGuiUtils.h"
 #include "MQ2DeveloperTools.h"
+#include "MQPostOffice.h"
 
 #include "mq/api/RenderDoc.h"
 #include "mq/utils/Args.h"
@@ -86,6 +87,47 @@ public:
 	}
 };
 
+// How busy the machine as a whole is, not just this client.
+class HostCpuUsage
+{
+	ULARGE_INTEGER lastIdle, lastKernel, lastUser;
+
+public:
+	HostCpuUsage()
+	{
+		FILETIME idle, kernel, user;
+		GetSystemTimes(&idle, &kernel, &user);
+		memcpy(&lastIdle, &idle, sizeof(FILETIME));
+		memcpy(&lastKernel, &kernel, sizeof(FILETIME));
+		memcpy(&lastUser, &user, sizeof(FILETIME));
+	}
+
+	double GetCurrentValue()
+	{
+		FILETIME fidle, fkernel, fuser;
+		ULARGE_INTEGER idle, kernel, user;
+
+		if (!GetSystemTimes(&fidle, &fkernel, &fuser))
+			return 0.0;
+
+		memcpy(&idle, &fidle, sizeof(FILETIME));
+		memcpy(&kernel, &fkernel, sizeof(FILETIME));
+		memcpy(&user, &fuser, sizeof(FILETIME));
+
+		// kernel time includes the idle time
+		uint64_t total = (kernel.QuadPart - lastKernel.QuadPart) + (user.QuadPart - lastUser.QuadPart);
+		uint64_t idleDelta = idle.QuadPart - lastIdle.QuadPart;
+		lastIdle = idle;
+		lastKernel = kernel;
+		lastUser = user;
+
+		if (total == 0)
+			return 0.0;
+
+		return 100.0 * static_cast<double>(total - std::min(idleDelta, total)) / total;
+	}
+};
+
 class FrameCounter
 {
 public:
@@ -435,8 +477,41 @@ void Throttler_Detour()
 
 #pragma region limiter
 
+// True if the window is entirely behind the foreground window, like a client behind a full screen one.
+static bool IsCoveredByForegroundWindow(HWND hWnd)
+{
+	HWND hForeground = GetForegroundWindow();
+	if (!hForeground || hForeground == hWnd || IsIconic(hForeground))
+		return false;
+
+	RECT ours, theirs, both;
+	if (!GetWindowRect(hWnd, &ours) || !GetWindowRect(hForeground, &theirs))
+		return false;
+
+	UnionRect(&both, &ours, &theirs);
+	return EqualRect(&both, &theirs) != FALSE;
+}
+
 class FrameLimiter
 {
+public:
+	// Why the adaptive policy has stopped rendering the scene in the background.
+	enum class AdaptiveReason
+	{
+		None,
+		Minimized,
+		Occluded,
+		Away,                                // no input on the machine for a while
+		HostLoad,                            // the machine's cpu usage is over the threshold
+	};
+
+	static constexpr std::chrono::milliseconds DefaultFocusDuration = 30s;
+
+private:
+	static constexpr std::chrono::milliseconds AdaptiveCheckInterval = 1s;
+	static constexpr float HostLoadHysteresis = 10.0f;
+
+
 	bool m_lastInForeground = false;
 	bool m_resetOnNextPulse = false;
 	FrameCounter m_renderFPS;
@@ -447,8 +522,15 @@ class FrameLimiter
 	std::chrono::steady_clock::time_point m_startTime;
 	std::chrono::steady_clock::time_point m_prevFrame;
 	std::chrono::microseconds m_gameLoopDuration = 0us;
+	std::chrono::steady_clock::duration m_throttleTime{};
+	std::chrono::steady_clock::time_point m_lastTelemetry;
 	uint32_t m_lastGameState = 0;
 	uint32_t m_lastScreenMode = 0;
+	HostCpuUsage m_hostCpuUsageCalc;
+	float m_hostCpuUsage = 0.0f;
+	AdaptiveReason m_adaptiveReason = AdaptiveReason::None;
+	std::chrono::steady_clock::time_point m_nextAdaptiveCheck;
+	std::chrono::steady_clock::time_point m_focusedUntil;
 	bool m_needWaitRender = true;     // wait for RenderReal_World function to be called
 	bool m_didTryRender = false;      // real render function was called
 	bool m_doRender = false;          // if set to false, we won't render (per frame).
@@ -464,10 +546,15 @@ class FrameLimiter
 	bool m_renderInForeground = true;
 	bool m_tieImGuiToSimulation = false;
 	bool m_tieUiToSimulation = false;
+	bool m_headlessImGui = false;
+	bool m_simulationOnly = false;
+	bool m_adaptive = false;
 	bool m_clearScreen = false;
 	float m_backgroundFPS = 1.0f;
 	float m_foregroundFPS = 60.0f;
 	float m_minSimulationFPS = 30.0f;
+	float m_adaptiveAwaySeconds = 300.0f;
+	float m_adaptiveCPUThreshold = 90.0f;
 
 public:
 	FrameLimiter() :
@@ -485,10 +572,15 @@ public:
 		m_renderInBackground = GetSetting<bool, LimiterSetting::RenderInBackground>();
 		m_tieImGuiToSimulation = GetSetting<bool, LimiterSetting::TieImGuiToSimulation>();
 		m_tieUiToSimulation = GetSetting<bool, LimiterSetting::TieUiToSimulation>();
+		m_headlessImGui = GetSetting<bool, LimiterSetting::HeadlessImGui>();
+		m_simulationOnly = GetSetting<bool, LimiterSetting::SimulationOnly>();
+		m_adaptive = GetSetting<bool, LimiterSetting::Adaptive>();
 		m_clearScreen = GetSetting<bool, LimiterSetting::ClearScreen>();
 		m_backgroundFPS = GetSetting<float, LimiterSetting::BackgroundFPS>();
 		m_foregroundFPS = GetSetting<float, LimiterSetting::ForegroundFPS>();
 		m_minSimulationFPS = GetSetting<float, LimiterSetting::MinSimulationFPS>();
+		m_adaptiveAwaySeconds = GetSetting<float, LimiterSetting::AdaptiveAwaySeconds>();
+		m_adaptiveCPUThreshold = GetSetting<float, LimiterSetting::AdaptiveCPUThreshold>();
 
 		UpdateThrottler();
 	}
@@ -528,7 +620,7 @@ public:
 	float GetRecordedSimulationFPS() const { return 1000000 / static_cast<float>(m_gameFPS.Average()); }
 
 	float GetTargetForegroundFPS() const { return m_renderInForeground ? m_foregroundFPS : 0.f; }
-	float GetTargetBackgroundFPS() const { return m_renderInBackground ? m_backgroundFPS : 0.f; }
+	float GetTargetBackgroundFPS() const { return m_renderInBackground && !IsAdaptiveReduced() ? m_backgroundFPS : 0.f; }
 
 	inline bool IsEnabled() const {
 		return IsSupportedGameState() && (IsForeground() ? m_enabledInForeground : m_enabled);
@@ -536,16 +628,47 @@ public:
 	inline bool IsRenderingEnabled() const {
 		return IsForeground()
 			? (m_renderInForeground && m_foregroundFPS > 0.f)
-			: (m_renderInBackground && m_backgroundFPS > 0.f);
+			: (m_renderInBackground && m_backgroundFPS > 0.f && !IsAdaptiveReduced() && !m_simulationOnly);
+	}
+
+	// Nothing is drawn or presented at all, not the scene, the game UI or ImGui. The game loop and
+	// everything that runs from the pulse keep going at the minimum simulation rate.
+	bool IsSimulationOnly() const { return m_simulationOnly && IsBackground() && IsEnabled(); }
+
+	AdaptiveReason GetAdaptiveReason() const { return m_adaptive && IsBackground() ? m_adaptiveReason : AdaptiveReason::None; }
+	bool IsAdaptiveReduced() const { return GetAdaptiveReason() != AdaptiveReason::None; }
+
+	// Renders at the configured rate for a while, whatever the adaptive policy thinks.
+	void RequestFocus(std::chrono::milliseconds duration)
+	{
+		m_focusedUntil = std::chrono::steady_clock::now() + duration;
+		m_adaptiveReason = AdaptiveReason::None;
 	}
 
 	float GetMinimumSimulationFPS() const { return m_minSimulationFPS; }
 
-	bool GetTieImGuiToSimulation() const { return m_tieImGuiToSimulation && IsBackground(); }
+	bool GetTieImGuiToSimulation() const { return m_tieImGuiToSimulation && IsBackground() && !IsImGuiHeadless(); }
 	bool GetTieUiToSimulation() const { return m_tieUiToSimulation && GetTieImGuiToSimulation(); }
 
 	bool GetClearScreen() const { return m_clearScreen; }
 
+	// While headless, nothing of ImGui is drawn. ImGui frames are still built from the pulse, without
+	// draw data, so the imgui callbacks of plugins keep running at their headless rate.
+	bool IsImGuiHeadless() const
+	{
+		if (IsSimulationOnly())
+			return true;
+
+		if (!m_headlessImGui || !IsBackground())
+			return false;
+
+		if (IsEnabled())
+			return true;
+
+		HWND hEQWnd = GetEQWindowHandle();
+		return hEQWnd && IsIconic(hEQWnd);
+	}
+
 	bool DoRealRenderWorld()
 	{
 		if (!IsEnabled())
@@ -605,7 +728,9 @@ public:
 		//DebugSpewAlways("Sleep for: %d -- gameRemaining: %d -- frameRemaining: %d", (int)waitTime.count(),
 		//	(int)gameRemaining.count(), (int)frameRemaining.count());
 		//std::this_thread::sleep_for(waitTime);
+		auto sleepStart = std::chrono::steady_clock::now();
 		std::this_thread::sleep_until(m_prevFrame + m_gameLoopDuration);
+		m_throttleTime += std::chrono::steady_clock::now() - sleepStart;
 		m_prevFrame += m_gameLoopDuration;
 
 		return true;
@@ -657,6 +782,8 @@ public:
 		gCurrentFPS = static_cast<float>(1000000 / m_renderFPS.Average());
 		gCurrentCPU = static_cast<float>(m_cpuUsage.Average() / 1000.f);
 
+		UpdateAdaptivePolicy();
+
 #if HAS_DIRECTX_9
 		if (m_resetOnNextPulse)
 		{
@@ -691,6 +818,69 @@ public:
 		}
 	}
 
+	void UpdateAdaptivePolicy()
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (now < m_nextAdaptiveCheck)
+			return;
+
+		m_nextAdaptiveCheck = now + AdaptiveCheckInterval;
+
+		// sampled even while the policy is off, so that each sample covers a whole interval
+		m_hostCpuUsage = static_cast<float>(m_hostCpuUsageCalc.GetCurrentValue());
+
+		m_adaptiveReason = m_adaptive && IsBackground() && IsSupportedGameState()
+			? EvaluateAdaptivePolicy(now) : AdaptiveReason::None;
+	}
+
+	AdaptiveReason EvaluateAdaptivePolicy(std::chrono::steady_clock::time_point now) const
+	{
+		// anything that means someone wants to see this client brings it back up
+		if (now < m_focusedUntil || GetCombatState() == eCombatState_Combat)
+			return AdaptiveReason::None;
+
+		if (HWND hEQWnd = GetEQWindowHandle())
+		{
+			if (IsIconic(hEQWnd))
+				return AdaptiveReason::Minimized;
+
+			if (IsCoveredByForegroundWindow(hEQWnd))
+				return AdaptiveReason::Occluded;
+		}
+
+		LASTINPUTINFO lastInput = { sizeof(LASTINPUTINFO) };
+		if (m_adaptiveAwaySeconds > 0.f && GetLastInputInfo(&lastInput)
+			&& static_cast<float>(GetTickCount() - lastInput.dwTime) / 1000.f >= m_adaptiveAwaySeconds)
+		{
+			return AdaptiveReason::Away;
+		}
+
+		// once over the threshold, stay down until the load is well under it, so that rendering again
+		// doesn't put the machine straight back over
+		if (m_adaptiveCPUThreshold > 0.f && m_adaptiveCPUThreshold < 100.f)
+		{
+			float threshold = m_adaptiveReason == AdaptiveReason::HostLoad
+				? m_adaptiveCPUThreshold - HostLoadHysteresis : m_adaptiveCPUThreshold;
+
+			if (m_hostCpuUsage >= threshold)
+				return AdaptiveReason::HostLoad;
+		}
+
+		return AdaptiveReason::None;
+	}
+
+	static const char* GetAdaptiveReasonName(AdaptiveReason reason)
+	{
+		switch (reason)
+		{
+		case AdaptiveReason::Minimized: return "Minimized";
+		case AdaptiveReason::Occluded: return "Covered by another window";
+		case AdaptiveReason::Away: return "No input";
+		case AdaptiveReason::HostLoad: return "Machine is busy";
+		default: return "Rendering";
+		}
+	}
+
 	void UpdateForegroundState()
 	{
 		UpdateThrottler();
@@ -699,6 +889,31 @@ public:
 		m_prevFrame = std::chrono::steady_clock::now() - m_gameLoopDuration;
 	}
 
+	// Rates and the share of time spent throttling since the last call, for the launcher.
+	proto::routing::FrameLimiterTelemetry GetTelemetry()
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto elapsed = now - m_lastTelemetry;
+
+		proto::routing::FrameLimiterTelemetry telemetry;
+		telemetry.set_pid(GetCurrentProcessId());
+		telemetry.set_enabled(IsEnabled());
+		telemetry.set_foreground(IsForeground());
+		telemetry.set_render_fps(GetRecordedRenderFPS());
+		telemetry.set_simulation_fps(IsEnabled() ? GetRecordedSimulationFPS() : GetRecordedRenderFPS());
+		telemetry.set_target_fps(IsForeground() ? GetTargetForegroundFPS() : GetTargetBackgroundFPS());
+		telemetry.set_cpu_usage(GetCPUUsage());
+		telemetry.set_reduced(IsAdaptiveReduced());
+
+		if (m_lastTelemetry != std::chrono::steady_clock::time_point{} && elapsed.count() > 0)
+			telemetry.set_throttle_percent(100.0f * static_cast<float>(m_throttleTime.count()) / elapsed.count());
+
+		m_throttleTime = {};
+		m_lastTelemetry = now;
+
+		return telemetry;
+	}
+
 	void UpdateThrottler()
 	{
 		float desiredRenderRate = m_lastInForeground ? m_foregroundFPS : m_backgroundFPS;
@@ -815,6 +1030,68 @@ public:
 				ImGui::Unindent();
 			}
 
+			if (ImGui::Checkbox("Don't draw ImGui", &m_headlessImGui))
+			{
+				WriteSetting<LimiterSetting::HeadlessImGui>(m_headlessImGui);
+			}
+			ImGui::SameLine(); mq::imgui::HelpMarker(
+				"This setting applies when frame limiting is active and the game is in the background, or "
+				"when the game is minimized.\n"
+				"\n"
+				"When this setting is enabled, ImGui is not drawn at all, including windows that are outside "
+				"of the game window. Plugins keep updating their ImGui about once a second so their state "
+				"stays current, unless they ask for a different rate.\n"
+				"\n"
+				"This overrides \"Draw ImGui at simulation rate\".");
+
+			if (ImGui::Checkbox("Simulation only", &m_simulationOnly))
+			{
+				WriteSetting<LimiterSetting::SimulationOnly>(m_simulationOnly);
+			}
+			ImGui::SameLine(); mq::imgui::HelpMarker(
+				"This setting applies when frame limiting is active and the game is in the background.\n"
+				"\n"
+				"When this setting is enabled, nothing is drawn or presented: not the game scene, the game UI "
+				"or ImGui. The game keeps updating at the minimum simulation rate, and so do macros, lua "
+				"scripts and plugins. The window shows whatever was last drawn.\n"
+				"\n"
+				"This is meant for clients that nobody is looking at, and overrides the other drawing options.");
+
+			if (ImGui::Checkbox("Stop rendering when not needed", &m_adaptive))
+			{
+				WriteSetting<LimiterSetting::Adaptive>(m_adaptive);
+			}
+			ImGui::SameLine(); mq::imgui::HelpMarker(
+				"This setting applies when frame limiting is active and the game is in the background.\n"
+				"\n"
+				"When this setting is enabled, the game scene stops rendering while the game is minimized, "
+				"entirely covered by the foreground window, when nobody has used the mouse or keyboard for "
+				"a while, or when the machine's CPU usage is over the threshold. The simulation keeps running.\n"
+				"\n"
+				"Rendering continues at the target FPS while in combat, or for a while when another "
+				"program asks for it.");
+
+			if (m_adaptive)
+			{
+				ImGui::Indent();
+
+				ImGui::Text("Adaptive status: %s (machine CPU: %.0f%%)", GetAdaptiveReasonName(GetAdaptiveReason()), m_hostCpuUsage);
+
+				if (ImGui::SliderFloat("No input after (seconds)", &m_adaptiveAwaySeconds, 0.0f, 3600.0f, "%.0f"))
+				{
+					WriteSetting<LimiterSetting::AdaptiveAwaySeconds>(m_adaptiveAwaySeconds);
+				}
+				ImGui::SameLine(); mq::imgui::HelpMarker("Set to 0 to keep rendering when there is no input.");
+
+				if (ImGui::SliderFloat("Machine CPU threshold (%)", &m_adaptiveCPUThreshold, 0.0f, 100.0f, "%.0f"))
+				{
+					WriteSetting<LimiterSetting::AdaptiveCPUThreshold>(m_adaptiveCPUThreshold);
+				}
+				ImGui::SameLine(); mq::imgui::HelpMarker("Set to 0 or 100 to ignore the CPU usage of the machine.");
+
+				ImGui::Unindent();
+			}
+
 			ImGui::Unindent();
 		}
 		ImGui::PopID();
@@ -933,6 +1210,9 @@ private:
 		if (!gpD3D9Device)
 			return; // ???
 
+		if (IsSimulationOnly())
+			return;
+
 		HRESULT hResult = gpD3D9Device->TestCooperativeLevel();
 		if (FAILED(hResult))
 		{
@@ -966,10 +1246,15 @@ public:
 		RenderInForeground,
 		TieImGuiToSimulation,
 		TieUiToSimulation,
+		HeadlessImGui,
+		SimulationOnly,
+		Adaptive,
 		ClearScreen,
 		BackgroundFPS,
 		ForegroundFPS,
-		MinSimulationFPS
+		MinSimulationFPS,
+		AdaptiveAwaySeconds,
+		AdaptiveCPUThreshold
 	};
 
 	template <LimiterSetting Value>
@@ -982,10 +1267,15 @@ public:
 	template <> static constexpr const char* SettingName<LimiterSetting::RenderInForeground>() { return "RenderInForeground"; }
 	template <> static constexpr const char* SettingName<LimiterSetting::TieImGuiToSimulation>() { return "TieImGuiToSimulation"; }
 	template <> static constexpr const char* SettingName<LimiterSetting::TieUiToSimulation>() { return "TieUiToSimulation"; }
+	template <> static constexpr const char* SettingName<LimiterSetting::HeadlessImGui>() { return "HeadlessImGui"; }
+	template <> static constexpr const char* SettingName<LimiterSetting::SimulationOnly>() { return "SimulationOnly"; }
+	template <> static constexpr const char* SettingName<LimiterSetting::Adaptive>() { return "Adaptive"; }
 	template <> static constexpr const char* SettingName<LimiterSetting::ClearScreen>() { return "ClearScreen"; }
 	template <> static constexpr const char* SettingName<LimiterSetting::BackgroundFPS>() { return "BackgroundFPS"; }
 	template <> static constexpr const char* SettingName<LimiterSetting::ForegroundFPS>() { return "ForegroundFPS"; }
 	template <> static constexpr const char* SettingName<LimiterSetting::MinSimulationFPS>() { return "MinSimulationFPS"; }
+	template <> static constexpr const char* SettingName<LimiterSetting::AdaptiveAwaySeconds>() { return "AdaptiveAwaySeconds"; }
+	template <> static constexpr const char* SettingName<LimiterSetting::AdaptiveCPUThreshold>() { return "AdaptiveCPUThreshold"; }
 
 private:
 	template <typename T, LimiterSetting Value>
@@ -998,10 +1288,15 @@ private:
 	template <> static constexpr bool GetDefault<bool, LimiterSetting::RenderInForeground>() { return true; }
 	template <> static constexpr bool GetDefault<bool, LimiterSetting::TieImGuiToSimulation>() { return false; }
 	template <> static constexpr bool GetDefault<bool, LimiterSetting::TieUiToSimulation>() { return false; }
+	template <> static constexpr bool GetDefault<bool, LimiterSetting::HeadlessImGui>() { return false; }
+	template <> static constexpr bool GetDefault<bool, LimiterSetting::SimulationOnly>() { return false; }
+	template <> static constexpr bool GetDefault<bool, LimiterSetting::Adaptive>() { return false; }
 	template <> static constexpr bool GetDefault<bool, LimiterSetting::ClearScreen>() { return false; }
 	template <> static constexpr float GetDefault<float, LimiterSetting::BackgroundFPS>() { return 1.f; }
 	template <> static constexpr float GetDefault<float, LimiterSetting::ForegroundFPS>() { return 60.f; }
 	template <> static constexpr float GetDefault<float, LimiterSetting::MinSimulationFPS>() { return 30.f; }
+	template <> static constexpr float GetDefault<float, LimiterSetting::AdaptiveAwaySeconds>() { return 300.f; }
+	template <> static constexpr float GetDefault<float, LimiterSetting::AdaptiveCPUThreshold>() { return 90.f; }
 
 	std::string& GetINIFileName(LimiterSetting value)
 	{
@@ -1054,6 +1349,12 @@ private:
 		WriteSetting<LimiterSetting::TieImGuiToSimulation>(m_tieImGuiToSimulation);
 		m_tieUiToSimulation = GetDefault<bool, LimiterSetting::TieUiToSimulation>();
 		WriteSetting<LimiterSetting::TieUiToSimulation>(m_tieUiToSimulation);
+		m_headlessImGui = GetDefault<bool, LimiterSetting::HeadlessImGui>();
+		WriteSetting<LimiterSetting::HeadlessImGui>(m_headlessImGui);
+		m_simulationOnly = GetDefault<bool, LimiterSetting::SimulationOnly>();
+		WriteSetting<LimiterSetting::SimulationOnly>(m_simulationOnly);
+		m_adaptive = GetDefault<bool, LimiterSetting::Adaptive>();
+		WriteSetting<LimiterSetting::Adaptive>(m_adaptive);
 		m_clearScreen = GetDefault<bool, LimiterSetting::ClearScreen>();
 		WriteSetting<LimiterSetting::ClearScreen>(m_clearScreen);
 		m_backgroundFPS = GetDefault<float, LimiterSetting::BackgroundFPS>();
@@ -1062,6 +1363,10 @@ private:
 		WriteSetting<LimiterSetting::ForegroundFPS>(m_foregroundFPS);
 		m_minSimulationFPS = GetDefault<float, LimiterSetting::MinSimulationFPS>();
 		WriteSetting<LimiterSetting::MinSimulationFPS>(m_minSimulationFPS);
+		m_adaptiveAwaySeconds = GetDefault<float, LimiterSetting::AdaptiveAwaySeconds>();
+		WriteSetting<LimiterSetting::AdaptiveAwaySeconds>(m_adaptiveAwaySeconds);
+		m_adaptiveCPUThreshold = GetDefault<float, LimiterSetting::AdaptiveCPUThreshold>();
+		WriteSetting<LimiterSetting::AdaptiveCPUThreshold>(m_adaptiveCPUThreshold);
 	}
 
 	template <typename T, LimiterSetting Setting>
@@ -1103,6 +1408,9 @@ public:
 	template<> bool Set<LimiterSetting::RenderInForeground>(bool Value) { return InternalSet<bool, LimiterSetting::RenderInForeground>(m_renderInForeground, Value); }
 	template<> bool Set<LimiterSetting::TieImGuiToSimulation>(bool Value) { return InternalSet<bool, LimiterSetting::TieImGuiToSimulation>(m_tieImGuiToSimulation, Value); }
 	template<> bool Set<LimiterSetting::TieUiToSimulation>(bool Value) { return InternalSet<bool, LimiterSetting::TieUiToSimulation>(m_tieUiToSimulation, Value); }
+	template<> bool Set<LimiterSetting::HeadlessImGui>(bool Value) { return InternalSet<bool, LimiterSetting::HeadlessImGui>(m_headlessImGui, Value); }
+	template<> bool Set<LimiterSetting::SimulationOnly>(bool Value) { return InternalSet<bool, LimiterSetting::SimulationOnly>(m_simulationOnly, Value); }
+	template<> bool Set<LimiterSetting::Adaptive>(bool Value) { return InternalSet<bool, LimiterSetting::Adaptive>(m_adaptive, Value); }
 
 	template <LimiterSetting Setting>
 	bool Toggle() { return Set<Setting>(!GetSetting<bool, Setting>()); }
@@ -1112,6 +1420,8 @@ public:
 	template<> float Set<LimiterSetting::BackgroundFPS>(float Value) { return InternalSet<float, LimiterSetting::BackgroundFPS>(m_backgroundFPS, Value); }
 	template<> float Set<LimiterSetting::ForegroundFPS>(float Value) { return InternalSet<float, LimiterSetting::ForegroundFPS>(m_foregroundFPS, Value); }
 	template<> float Set<LimiterSetting::MinSimulationFPS>(float Value) { return InternalSet<float, LimiterSetting::MinSimulationFPS>(m_minSimulationFPS, Value); }
+	template<> float Set<LimiterSetting::AdaptiveAwaySeconds>(float Value) { return InternalSet<float, LimiterSetting::AdaptiveAwaySeconds>(m_adaptiveAwaySeconds, Value); }
+	template<> float Set<LimiterSetting::AdaptiveCPUThreshold>(float Value) { return InternalSet<float, LimiterSetting::AdaptiveCPUThreshold>(m_adaptiveCPUThreshold, Value); }
 };
 static FrameLimiter s_frameLimiter;
 
@@ -1155,6 +1465,11 @@ bool DoThrottleFrameRate()
 	return s_frameLimiter.DoThrottleFrameRate();
 }
 
+bool IsImGuiHeadless()
+{
+	return s_frameLimiter.IsImGuiHeadless();
+}
+
 static void FrameLimiterSettings()
 {
 	s_frameLimiter.UpdateSettingsPanel();
@@ -1248,6 +1563,16 @@ void FrameLimiterCommand(SPAWNINFO* pChar, char* szLine)
 
 	args::Command uirender(commands, "uirender", "set/toggle rendering the UI when rendering is otherwise disabled", SetFrameLimiterBool<FrameLimiter::LimiterSetting::TieUiToSimulation>);
 
+	args::Command headlessimgui(commands, "headlessimgui", "set/toggle skipping ImGui drawing when in the background", SetFrameLimiterBool<FrameLimiter::LimiterSetting::HeadlessImGui>);
+
+	args::Command simonly(commands, "simonly", "set/toggle running only the simulation, without drawing anything, when in the background", SetFrameLimiterBool<FrameLimiter::LimiterSetting::SimulationOnly>);
+
+	args::Command adaptive(commands, "adaptive", "set/toggle stopping rendering in the background when it isn't needed", SetFrameLimiterBool<FrameLimiter::LimiterSetting::Adaptive>);
+
+	args::Command awaytime(commands, "awaytime", "set the seconds without input before adaptive limiting stops rendering", SetFrameLimiterFloat<FrameLimiter::LimiterSetting::AdaptiveAwaySeconds>);
+
+	args::Command cputhreshold(commands, "cputhreshold", "set the machine CPU percent over which adaptive limiting stops rendering", SetFrameLimiterFloat<FrameLimiter::LimiterSetting::AdaptiveCPUThreshold>);
+
 	args::Command clearscreen(commands, "clearscreen", "set/toggle clearing (blanking) the screen when rendering is disabled", SetFrameLimiterBool<FrameLimiter::LimiterSetting::ClearScreen>);
 
 	args::Command bgfps(commands, "bgfps", "set the FPS rate for the background process", SetFrameLimiterFloat<FrameLimiter::LimiterSetting::BackgroundFPS>);
@@ -1286,6 +1611,27 @@ void FrameLimiterCommand(SPAWNINFO* pChar, char* szLine)
 
 #pragma region module
 
+static postoffice::Dropbox s_telemetryDropbox;
+static std::chrono::steady_clock::time_point s_lastTelemetrySent;
+
+static void PublishFrameLimiterTelemetry()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (now - s_lastTelemetrySent < 1s)
+		return;
+	s_lastTelemetrySent = now;
+
+	proto::routing::FrameLimiterTelemetry telemetry = s_frameLimiter.GetTelemetry();
+	if (!pipeclient::GetConnectionStats())
+		return;
+
+	proto::routing::Address address;
+	address.set_name("launcher");
+	address.set_mailbox("frame_limiter");
+
+	s_telemetryDropbox.Post(address, telemetry);
+}
+
 static void InitializeFrameLimiter()
 {
 	AddSettingsPanel("Frame Limiter", FrameLimiterSettings);
@@ -1319,10 +1665,21 @@ static void InitializeFrameLimiter()
 	s_frameLimiter.ReadSettings();
 
 	AddCommand("/framelimiter", FrameLimiterCommand, false, false, false);
+
+	s_telemetryDropbox = postoffice::GetPostOffice().RegisterAddress("frame_limiter",
+		[](ProtoMessagePtr&& message)
+		{
+			// the only thing sent to this mailbox is a request to render this client again
+			auto request = message->Parse<proto::routing::FrameLimiterFocusRequest>();
+			s_frameLimiter.RequestFocus(request.duration_ms() != 0
+				? std::chrono::milliseconds(request.duration_ms()) : FrameLimiter::DefaultFocusDuration);
+		});
 }
 
 static void ShutdownFrameLimiter()
 {
+	s_telemetryDropbox.Remove();
+
 	RemoveCommand("/framelimiter");
 
 	RemoveSettingsPanel("Frame Limiter");
@@ -1343,6 +1700,8 @@ static void ShutdownFrameLimiter()
 static void PulseFrameLimiter()
 {
 	s_frameLimiter.OnPulse();
+
+	PublishFrameLimiterTelemetry();
 }
 
 static void SetGameStateFrameLimiter(int GameState)
@@ -1381,7 +1740,9 @@ enum class FrameLimiterTypeMembers
 	BackgroundFPS,
 	ForegroundFPS,
 	MinSimulationFPS,
-	ClearScreen
+	ClearScreen,
+	Reduced,
+	SimulationOnly
 };
 
 MQ2FrameLimiterType::MQ2FrameLimiterType() : MQ2Type("framelimiter")
@@ -1396,6 +1757,8 @@ MQ2FrameLimiterType::MQ2FrameLimiterType() : MQ2Type("framelimiter")
 	ScopedTypeMember(FrameLimiterTypeMembers, ForegroundFPS);
 	ScopedTypeMember(FrameLimiterTypeMembers, MinSimulationFPS);
 	ScopedTypeMember(FrameLimiterTypeMembers, ClearScreen);
+	ScopedTypeMember(FrameLimiterTypeMembers, Reduced);
+	ScopedTypeMember(FrameLimiterTypeMembers, SimulationOnly);
 }
 
 bool MQ2FrameLimiterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
@@ -1457,6 +1820,16 @@ bool MQ2FrameLimiterType::GetMember(MQVarPtr VarPtr, const char* Member, char* I
 		Dest.Set(s_frameLimiter.GetClearScreen());
 		return true;
 
+	case FrameLimiterTypeMembers::Reduced:
+		Dest.Type = pBoolType;
+		Dest.Set(s_frameLimiter.IsAdaptiveReduced());
+		return true;
+
+	case FrameLimiterTypeMembers::SimulationOnly:
+		Dest.Type = pBoolType;
+		Dest.Set(s_frameLimiter.IsSimulationOnly());
+		return true;
+
 	default:
 		return false;
 	}
@@ -123,6 +123,17 @@ uint64_t gRunning = 0;
 bool gbMoving = false;
 int gMaxTurbo = 80;
 int gTurboLimit = 240;
+bool gbMacroCache = true;
+int gMaxQueuedEvents = 1000;
+int gMaxQueuedEventsPerEvent = 0;
+int gPluginPulseBudget = 0;
+int gPluginCallbackBudget = 0;
+int gPluginThrottleFrames = 0;
+bool gbMemoryAccounting = false;
+bool gbSlowExpressions = false;
+int gSlowExpressionThreshold = 2000;
+bool gbSharedMemoryRouting = false;
+bool gbPeerRouting = false;
 bool gReturn = true;
 bool gTargetbuffs = false;
 bool gItemsReceived = false;
@@ -748,6 +759,8 @@ bool gbHUDUnderUI = true;
 bool gbAlwaysDrawMQHUD = false;
 bool gbMQ2LoadingMsg = true;
 bool gbExactSearchCleanNames = false;
+bool gbLazySpawnSort = false;
+bool gbReadinessSnapshot = true;
 
 std::map<std::string, MQDataVar*> VariableMap;
 
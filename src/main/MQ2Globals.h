@@ -21,14 +21,6 @@
 #include <memory>
 #include <unordered_map>
 
-struct CaseInsensitiveLess
-{
-	bool operator()(const std::string& lhs, const std::string& rhs) const noexcept
-	{
-		return (::_stricmp(lhs.c_str(), rhs.c_str()) < 0);
-	}
-};
-
 // Probably move these to eqlib but for now these are all contained within MQ
 #if defined(EMULATOR)
 #define HAS_CHAT_TIMESTAMPS 1
@@ -152,6 +144,17 @@ MQLIB_VAR uint64_t gRunning;
 MQLIB_VAR bool gbMoving;
 MQLIB_VAR int gMaxTurbo;
 MQLIB_VAR int gTurboLimit;
+MQLIB_VAR bool gbMacroCache;
+MQLIB_VAR int gMaxQueuedEvents;
+MQLIB_VAR int gMaxQueuedEventsPerEvent;
+MQLIB_VAR int gPluginPulseBudget;      // microseconds, 0 = no budget
+MQLIB_VAR int gPluginCallbackBudget;   // microseconds, 0 = no budget
+MQLIB_VAR int gPluginThrottleFrames;   // 0 = only warn about plugins over their pulse budget
+MQLIB_VAR bool gbMemoryAccounting;     // count the allocations of Lua states and ImGui, read at startup
+MQLIB_VAR bool gbSlowExpressions;      // report parses, commands and members slower than the threshold
+MQLIB_VAR int gSlowExpressionThreshold; // microseconds
+MQLIB_VAR bool gbSharedMemoryRouting;  // offer the launcher shared memory rings for messages, read at startup
+MQLIB_VAR bool gbPeerRouting;          // send messages for a single other client directly to it, read at startup
 
 MQLIB_VAR bool gReturn;
 MQLIB_VAR bool gTargetbuffs;
@@ -240,6 +243,8 @@ MQLIB_VAR std::map<std::string, uint32_t> ItemSlotMap;
 MQLIB_VAR int gGameState;
 MQLIB_VAR bool gbMQ2LoadingMsg;
 MQLIB_VAR bool gbExactSearchCleanNames;
+MQLIB_VAR bool gbLazySpawnSort;
+MQLIB_VAR bool gbReadinessSnapshot;
 
 MQLIB_VAR bool gMouseClickInProgress[8];
 
@@ -13,7 +13,8 @@
  */
 
 #include "pch.h"
-#include "MQ2Main.h"
+#include "MQ2Main.h"
+#include "MQWarmUp.h"
 
 namespace mq {
 
@@ -29,15 +30,222 @@ static MQModule s_GroundSpawnsModule = {
 };
 MQModule* GetGroundSpawnsModule() { return &s_GroundSpawnsModule; }
 
+// Every item on the ground, by id and by display name. The index is built from the item list the
+// first time it is needed and then kept up to date by the ground item hooks, so searches don't have
+// to walk the list (and work out every display name) again.
+class GroundItemIndex
+{
+public:
+	static GroundItemIndex& Instance()
+	{
+		static GroundItemIndex instance;
+		return instance;
+	}
+
+	// The item isn't finished when it is added to the list, so it is only indexed on the next search.
+	void Add(EQGroundItem* pGroundItem)
+	{
+		if (m_built || m_building)
+			m_pending.push_back(pGroundItem);
+	}
+
+	void Remove(EQGroundItem* pGroundItem)
+	{
+		if (!m_built && !m_building)
+			return;
+
+		// The walk through the list can't continue from an item that is going away, start it over.
+		if (m_building && m_buildCursor == pGroundItem)
+		{
+			Reset();
+			return;
+		}
+
+		m_pending.erase(std::remove(m_pending.begin(), m_pending.end(), pGroundItem), m_pending.end());
+
+		auto iter = m_items.find(pGroundItem);
+		if (iter == m_items.end())
+			return;
+
+		auto idIter = m_byID.find(iter->second.dropID);
+		if (idIter != m_byID.end() && idIter->second == pGroundItem)
+			m_byID.erase(idIter);
+
+		auto nameIter = m_byName.find(iter->second.name);
+		if (nameIter != m_byName.end())
+		{
+			std::vector<EQGroundItem*>& items = nameIter->second;
+			items.erase(std::remove(items.begin(), items.end(), pGroundItem), items.end());
+			if (items.empty())
+				m_byName.erase(nameIter);
+		}
+
+		m_items.erase(iter);
+	}
+
+	void Reset()
+	{
+		m_items.clear();
+		m_byID.clear();
+		m_byName.clear();
+		m_pending.clear();
+		m_built = false;
+		m_building = false;
+		m_buildCursor = nullptr;
+	}
+
+	// Indexes up to count more items of the list, so that the warm-up can build the index over a few
+	// pulses instead of the first search building it all at once. Returns true once it is built.
+	bool Build(int count)
+	{
+		if (m_built)
+			return true;
+
+		if (!m_building)
+		{
+			Reset();
+			m_building = true;
+			m_buildCursor = pItemList ? pItemList->Top : nullptr;
+		}
+
+		for (; m_buildCursor && count > 0; --count)
+		{
+			Insert(m_buildCursor);
+			m_buildCursor = m_buildCursor->pNext;
+		}
+
+		if (m_buildCursor)
+			return false;
+
+		m_building = false;
+		m_built = true;
+		return true;
+	}
+
+	template <typename Func>
+	void ForEach(Func&& func)
+	{
+		Update();
+
+		for (const auto& [pGroundItem, _] : m_items)
+			func(pGroundItem);
+	}
+
+	template <typename Func>
+	void ForEachWithID(int ID, Func&& func)
+	{
+		Update();
+
+		auto iter = m_byID.find(ID);
+		if (iter != m_byID.end())
+			func(iter->second);
+	}
+
+	// Items with a display name that contains the name, ignoring case.
+	template <typename Func>
+	void ForEachWithName(std::string_view Name, Func&& func)
+	{
+		Update();
+
+		for (const auto& [name, items] : m_byName)
+		{
+			if (ci_find_substr(name, Name) >= 0)
+			{
+				for (EQGroundItem* pGroundItem : items)
+					func(pGroundItem);
+			}
+		}
+	}
+
+	bool Contains(EQGroundItem* pGroundItem)
+	{
+		Update();
+
+		return m_items.find(pGroundItem) != m_items.end();
+	}
+
+private:
+	struct Entry
+	{
+		int dropID = 0;
+		std::string name;
+	};
+
+	GroundItemIndex() = default;
+
+	void Update()
+	{
+		// Index whatever the warm-up hasn't gotten to yet. Items that were added while it was building
+		// are in the pending list, any that it has seen already are skipped by Insert.
+		if (!m_built)
+			Build(std::numeric_limits<int>::max());
+
+		for (EQGroundItem* pGroundItem : m_pending)
+			Insert(pGroundItem);
+		m_pending.clear();
+	}
+
+	void Insert(EQGroundItem* pGroundItem)
+	{
+		auto [iter, added] = m_items.try_emplace(pGroundItem);
+		if (!added)
+			return;
+
+		iter->second.dropID = pGroundItem->DropID;
+		iter->second.name = GetFriendlyNameForGroundItem(pGroundItem).c_str();
+
+		m_byID[pGroundItem->DropID] = pGroundItem;
+		m_byName[iter->second.name].push_back(pGroundItem);
+	}
+
+	std::unordered_map<EQGroundItem*, Entry> m_items;
+	std::unordered_map<int, EQGroundItem*> m_byID;
+	ci_unordered::map<std::string, std::vector<EQGroundItem*>> m_byName;
+	std::vector<EQGroundItem*> m_pending;
+	EQGroundItem* m_buildCursor = nullptr;
+	bool m_built = false;
+	bool m_building = false;
+};
+
+void IndexGroundItem(EQGroundItem* pGroundItem)
+{
+	GroundItemIndex::Instance().Add(pGroundItem);
+}
+
+void UnindexGroundItem(EQGroundItem* pGroundItem)
+{
+	GroundItemIndex::Instance().Remove(pGroundItem);
+}
+
+void ResetGroundItemIndex()
+{
+	GroundItemIndex::Instance().Reset();
+}
+
+bool WarmUpGroundItemIndex(int count)
+{
+	return GroundItemIndex::Instance().Build(count);
+}
+
 class GroundSpawnSearch
 {
 private:
+	struct Result
+	{
+		MQGroundSpawn spawn;
+		float distance;
+	};
+
 	// make this private because _all access_ to ground spawns should be through the list
-	std::vector<MQGroundSpawn> m_searchResults;
-	std::vector<MQGroundSpawn>::iterator m_currentResult;
-	bool m_valid;
+	std::vector<Result> m_searchResults;
+	size_t m_currentResult = 0;
 
-	GroundSpawnSearch() : m_searchResults(), m_currentResult(m_searchResults.end()), m_valid(false) {}
+	// the results are only put in order as far as they have been looked at, most searches only ever
+	// look at the nearest one.
+	size_t m_sortedResults = 0;
+	bool m_valid = false;
+
+	GroundSpawnSearch() = default;
 
 public:
 	GroundSpawnSearch(const GroundSpawnSearch&) = delete;
@@ -52,7 +260,8 @@ public:
 	static void Reset()
 	{
 		Instance().m_searchResults.clear();
-		Instance().m_currentResult = Instance().m_searchResults.end();
+		Instance().m_currentResult = 0;
+		Instance().m_sortedResults = 0;
 		Instance().m_valid = false;
 	}
 
@@ -105,23 +314,20 @@ public:
 		return Instance();
 	}
 
-	template <typename GroundPred, typename PlacedPred>
-	void Filter(SPAWNINFO* pSpawn, GroundPred GroundPredicate, PlacedPred PlacedPredicate)
+	// ForEachGround visits the candidate ground items, the predicate has the last word on them.
+	template <typename GroundVisit, typename PlacedPred>
+	void Filter(SPAWNINFO* pSpawn, GroundVisit ForEachGround, PlacedPred PlacedPredicate)
 	{
 		m_searchResults.clear();
 
-		if (pItemList)
-		{
-			for (auto pGround = pItemList->Top; pGround; pGround = pGround->pNext)
+		ForEachGround([&](EQGroundItem* pGround)
 			{
 				// z filters are universal
 				if (gZFilter < 10000.f && (pGround->Z > pSpawn->Z + gZFilter || pGround->Z < pSpawn->Z - gZFilter))
-					continue;
+					return;
 
-				if (GroundPredicate(pGround))
-					m_searchResults.emplace_back(pGround);
-			}
-		}
+				m_searchResults.push_back({ MQGroundSpawn(pGround), 0.f });
+			});
 
 		const auto& placed_item_mgr = EQPlacedItemManager::Instance();
 		for (auto pPlaced = placed_item_mgr.Top; pPlaced; pPlaced = pPlaced->pNext)
@@ -130,19 +336,20 @@ public:
 				continue;
 
 			if (PlacedPredicate(pPlaced))
-				m_searchResults.emplace_back(pPlaced);
+				m_searchResults.push_back({ MQGroundSpawn(pPlaced), 0.f });
 		}
 
-		m_currentResult = m_searchResults.begin();
+		m_currentResult = 0;
+		m_sortedResults = 0;
 		m_valid = true;
 	}
 
 	void Filter(SPAWNINFO* pSpawn, int ID)
 	{
 		Filter(pSpawn,
-			[&ID](EQGroundItem* ground)
+			[ID](auto&& visit)
 			{
-				return ground->DropID == ID;
+				GroundItemIndex::Instance().ForEachWithID(ID, visit);
 			},
 			[&ID](EQPlacedItem* placed)
 			{
@@ -159,9 +366,9 @@ public:
 		else
 		{
 			Filter(pSpawn,
-				[&Name](EQGroundItem* ground)
+				[&Name](auto&& visit)
 				{
-					return ci_find_substr(GetFriendlyNameForGroundItem(ground), Name) >= 0;
+					GroundItemIndex::Instance().ForEachWithName(Name, visit);
 				},
 				[&Name](EQPlacedItem* placed)
 				{
@@ -173,9 +380,14 @@ public:
 	void Filter(SPAWNINFO* pSpawn, const MQGroundSpawn& groundSpawn)
 	{
 		Filter(pSpawn,
-			[&groundSpawn](EQGroundItem* ground)
+			[&groundSpawn](auto&& visit)
 			{
-				return ground == groundSpawn;
+				if (groundSpawn.Type == MQGroundSpawnType::Ground)
+				{
+					EQGroundItem* pGround = groundSpawn.Get<EQGroundItem>();
+					if (pGround && GroundItemIndex::Instance().Contains(pGround))
+						visit(pGround);
+				}
 			},
 			[&groundSpawn](EQPlacedItem* placed)
 			{
@@ -185,51 +397,70 @@ public:
 
 	void Filter(SPAWNINFO* pSpawn)
 	{
-		Filter(pSpawn, [](EQGroundItem*) { return true; }, [](EQPlacedItem*) { return true; });
+		Filter(pSpawn,
+			[](auto&& visit)
+			{
+				GroundItemIndex::Instance().ForEach(visit);
+			},
+			[](EQPlacedItem*) { return true; });
 	}
 
 	void Sort(SPAWNINFO* pSpawn)
 	{
-		DistanceSort(pSpawn, m_searchResults,
-			[](SPAWNINFO* pSpawn, const MQGroundSpawn& ground)
+		for (Result& result : m_searchResults)
+		{
+			// if the object isn't valid or is nullptr, then stick them at the end of the list
+			result.distance = std::numeric_limits<float>::max();
+
+			const MQGroundSpawn& ground = result.spawn;
+			if (ground.Type == MQGroundSpawnType::Ground)
 			{
-				if (ground)
-				{
-					if (ground.Type == MQGroundSpawnType::Ground)
-					{
-						auto& pGround = *std::get<EQGroundItemPtr>(ground.Object);
-						if (pGround)
-							return Get3DDistanceSquared(pSpawn->X, pSpawn->Y, pSpawn->Z, pGround->X, pGround->Y, pGround->pActor->GetPosition().Z); // why pActor?
-					}
-					else if (ground.Type == MQGroundSpawnType::Placed)
-					{
-						auto& pPlaced = *std::get<EQPlacedItemPtr>(ground.Object);
-						if (pPlaced)
-							return Get3DDistanceSquared(pSpawn->X, pSpawn->Y, pSpawn->Z, pPlaced->X, pPlaced->Y, pPlaced->Z);
-					}
-				}
+				auto& pGround = *std::get<EQGroundItemPtr>(ground.Object);
+				if (pGround)
+					result.distance = Get3DDistanceSquared(pSpawn->X, pSpawn->Y, pSpawn->Z, pGround->X, pGround->Y, pGround->pActor->GetPosition().Z); // why pActor?
+			}
+			else if (ground.Type == MQGroundSpawnType::Placed)
+			{
+				auto& pPlaced = *std::get<EQPlacedItemPtr>(ground.Object);
+				if (pPlaced)
+					result.distance = Get3DDistanceSquared(pSpawn->X, pSpawn->Y, pSpawn->Z, pPlaced->X, pPlaced->Y, pPlaced->Z);
+			}
+		}
 
-				// if the object isn't valid or is nullptr, then stick them at the end of the list
-				return std::numeric_limits<float>::max();
-			});
+		m_currentResult = 0;
+		m_sortedResults = 0;
+	}
+
+	// Puts (at least) the first count results in order. The results after the sorted ones are all
+	// further away than them, so sorting more only has to look at those.
+	void EnsureSorted(size_t count)
+	{
+		if (count <= m_sortedResults)
+			return;
 
-		m_currentResult = m_searchResults.begin();
+		count = std::min(m_searchResults.size(), std::max({ count, m_sortedResults * 2, size_t(8) }));
+
+		std::partial_sort(m_searchResults.begin() + m_sortedResults, m_searchResults.begin() + count, m_searchResults.end(),
+			[](const Result& a, const Result& b) { return a.distance < b.distance; });
+		m_sortedResults = count;
 	}
 
 	bool Empty() const { return m_searchResults.empty(); }
 
 	MQGroundSpawn Current()
 	{
-		if (m_currentResult != m_searchResults.end())
-			return *m_currentResult;
+		if (m_currentResult < m_searchResults.size())
+		{
+			EnsureSorted(m_currentResult + 1);
+			return m_searchResults[m_currentResult].spawn;
+		}
 
 		return MQGroundSpawn();
 	}
 
 	MQGroundSpawn First()
 	{
-		// begin == end for an empty vector by definition
-		m_currentResult = m_searchResults.begin();
+		m_currentResult = 0;
 		return Current();
 	}
 
@@ -238,13 +469,13 @@ public:
 		if (m_searchResults.empty())
 			return MQGroundSpawn();
 
-		m_currentResult = std::prev(m_searchResults.end());
+		m_currentResult = m_searchResults.size() - 1;
 		return Current();
 	}
 
 	MQGroundSpawn Next()
 	{
-		if (m_searchResults.empty() || m_currentResult == std::prev(m_searchResults.end()))
+		if (m_searchResults.empty() || m_currentResult >= m_searchResults.size() - 1)
 			return MQGroundSpawn();
 
 		++m_currentResult;
@@ -253,8 +484,7 @@ public:
 
 	MQGroundSpawn Prev()
 	{
-		// begin == end for an empty vector by definition
-		if (m_currentResult == m_searchResults.begin())
+		if (m_currentResult == 0 || m_searchResults.empty())
 			return MQGroundSpawn();
 
 		--m_currentResult;
@@ -266,7 +496,8 @@ public:
 		if (Idx >= m_searchResults.size())
 			return MQGroundSpawn();
 
-		return m_searchResults.at(Idx);
+		EnsureSorted(Idx + 1);
+		return m_searchResults[Idx].spawn;
 	}
 
 	int Count()
@@ -278,6 +509,7 @@ public:
 static void SetGameStateGroundSpawns(int)
 {
 	GroundSpawnSearch::Reset();
+	GroundItemIndex::Instance().Reset();
 }
 
 MQGroundSpawn GetGroundSpawnByName(std::string_view Name)
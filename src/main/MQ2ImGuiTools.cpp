@@ -38,8 +38,6 @@ static void ShutdownMQ2ImGuiTools();
 static void PulseMQ2ImGuiTools();
 static void UpdateSettingsUI();
 
-static int WriteChatColorImGuiAPI(const char* line, uint32_t color, uint32_t filter);
-
 static MQModule gImGuiModule = {
 	"ImGuiAPI",                   // Name
 	false,                        // CanUnload
@@ -49,7 +47,7 @@ static MQModule gImGuiModule = {
 	nullptr,                      // SetGameState
 	UpdateSettingsUI,             // UpdateImGui
 	nullptr,                      // Zoned
-	WriteChatColorImGuiAPI,       // WriteChatColor
+	nullptr,                      // WriteChatColor, the console gets chat from FlushDeferredChat
 };
 MQModule* GetImGuiToolsModule() { return &gImGuiModule; }
 
@@ -378,9 +376,4 @@ static void PulseMQ2ImGuiTools()
 {
 }
 
-static int WriteChatColorImGuiAPI(const char* line, uint32_t color, uint32_t filter)
-{
-	return ImGuiConsoleAddText(line, color, filter);
-}
-
 } // namespace mq
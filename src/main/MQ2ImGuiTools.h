@@ -18,6 +18,8 @@
 
 #include <imgui.h>
 
+#include <vector>
+
 namespace mq {
 
 // Toggles the ImGui overlay
@@ -31,6 +33,7 @@ void InitializeImGuiConsole();
 void ShutdownImGuiConsole();
 void UpdateImGuiConsole();
 
-DWORD ImGuiConsoleAddText(const char* line, DWORD color, DWORD filter);
+struct MQChatLine;
+void ImGuiConsoleAddLines(const std::vector<MQChatLine>& lines);
 
 } // namespace mq
@@ -18,13 +18,28 @@
 #include "mq/api/Main.h"
 #include "mq/api/PluginAPI.h"
 #include "mq/base/PluginHandle.h"
+#include "MQTimerWheel.h"
 
+#include <array>
+#include <atomic>
+#include <initializer_list>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include <variant>
 
+struct CaseInsensitiveLess
+{
+	bool operator()(const std::string& lhs, const std::string& rhs) const noexcept
+	{
+		return (::_stricmp(lhs.c_str(), rhs.c_str()) < 0);
+	}
+};
+
 namespace mq {
 
 enum eAdventureTheme
@@ -147,6 +162,101 @@ struct MQSpawnSearch
 using SEARCHSPAWN DEPRECATE("Use MQSpawnSearch instead of SEARCHSPAWN") = MQSpawnSearch;
 using PSEARCHSPAWN DEPRECATE("Use MQSpawnSearch* instead of PSEARCHSPAWN") = MQSpawnSearch *;
 
+/**
+ * A spawn search compiled into the list of checks that it actually uses, ordered so that the
+ * cheapest checks run first. String comparisons against class, race and body type descriptions
+ * are remembered by ID, and the name is lowercased once, so matching many spawns against the same
+ * search avoids most of the per-spawn string work.
+ *
+ * The predicate refers to the search it was compiled from, which must outlive it.
+ */
+class MQSpawnSearchPredicate
+{
+public:
+	explicit MQSpawnSearchPredicate(const MQSpawnSearch& search);
+
+	MQSpawnSearchPredicate(const MQSpawnSearchPredicate&) = delete;
+	MQSpawnSearchPredicate& operator=(const MQSpawnSearchPredicate&) = delete;
+
+	bool Matches(SPAWNINFO* pChar, SPAWNINFO* pSpawn) const;
+
+	const MQSpawnSearch& GetSearch() const { return m_search; }
+
+private:
+	using CheckFunction = bool(*)(const MQSpawnSearchPredicate& predicate, SPAWNINFO* pChar, SPAWNINFO* pSpawn);
+	static constexpr size_t MaxChecks = 48;
+
+	void AddCheck(CheckFunction check) { m_checks[m_numChecks++] = check; }
+
+	bool MatchesClassDesc(int classID) const;
+	bool MatchesBodyTypeDesc(int bodyTypeID) const;
+	bool MatchesRaceDesc(int raceID) const;
+
+	const MQSpawnSearch& m_search;
+	std::array<CheckFunction, MaxChecks> m_checks;
+	size_t m_numChecks = 0;
+	std::string m_lowerName;
+
+	// Remembered results of description comparisons, by ID: 0 = unknown, 1 = match, 2 = no match.
+	static constexpr int MaxCachedDescID = 1024;
+	mutable std::vector<uint8_t> m_classMatches;
+	mutable std::vector<uint8_t> m_bodyTypeMatches;
+	mutable std::vector<uint8_t> m_raceMatches;
+
+	friend struct SpawnSearchChecks;
+};
+
+// Spawn searches made by the Spawn, NearestSpawn and SpawnCount TLOs are cached until the spawn
+// list is sorted again or a spawn is added or removed.
+enum class SpawnSearchQuery
+{
+	Search,
+	Nearest,
+	Count,
+};
+
+struct MQSpawnSearchResult
+{
+	SPAWNINFO* pSpawn = nullptr;
+	int Count = 0;
+};
+
+bool FindCachedSpawnSearch(SpawnSearchQuery query, MQSpawnSearch& search, SPAWNINFO* pOrigin, int nth,
+	MQSpawnSearchResult& result);
+void CacheSpawnSearch(SpawnSearchQuery query, const MQSpawnSearch& search, SPAWNINFO* pOrigin, int nth,
+	const MQSpawnSearchResult& result);
+void ClearSpawnSearchCache();
+
+// Drops the index FindItemByName and friends use to avoid searching the inventory. Called once per pulse.
+void ClearInventoryItemIndex();
+
+// Drops the slot counts GetFreeInventory and GetBankSlotCount keep for the pulse. Called once per pulse.
+void ClearInventorySlotStatistics();
+
+// Has the next alternate ability lookup check the bought abilities for changes. Called once per pulse.
+void InvalidateAltAbilityTables();
+
+// Has the chat hook compile the filters again. Called whenever gpFilters changes.
+void InvalidateChatFilters();
+
+// Writes out what is queued for DebugSpew.log and stops its writer thread.
+void ShutdownDebugSpewLog();
+
+// Calls the callback for every spawn within a 2D radius of a point, using the spawn grid. Spawns
+// slightly outside of the radius may also be visited. Returns false without visiting any spawns
+// if a linear scan of the spawn list would be faster.
+bool ForEachSpawnInRadius(float x, float y, float radius, const std::function<void(SPAWNINFO*)>& callback);
+
+// Makes sure that at least the first count entries of gSpawnsArray are the nearest spawns, in
+// order. With LazySpawnSort enabled, only a short prefix is sorted each pulse.
+void EnsureSpawnsArraySorted(size_t count = SIZE_MAX);
+
+// Keep the ground item index of the ground spawn searches in step with the item list. Called by the
+// ground item hooks.
+void IndexGroundItem(EQGroundItem* pGroundItem);
+void UnindexGroundItem(EQGroundItem* pGroundItem);
+void ResetGroundItemIndex();
+
 enum SearchItemFlag
 {
 	Lore = 1,
@@ -190,6 +300,28 @@ struct MQItemSearch
 using SEARCHITEM DEPRECATE("Use MQItemSearch instead of SEARCHITEM") = MQItemSearch;
 using PSEARCHITEM DEPRECATE("Use MQItemSearch instead of PSEARCHITEM") = MQItemSearch*;
 
+// An item found by SearchAllItems.
+struct MQItemSearchResult
+{
+	ItemGlobalIndex Index;
+	int ItemID = 0;
+	int Count = 0;                     // stack count of the item
+};
+
+// One step of SendWindowNotifications, with the same arguments as /notify takes after the window.
+struct MQWindowNotification
+{
+	std::string ScreenID;              // child of the window, empty or "0" for the window itself
+	std::string Notification;          // leftmouseup, listselect, newvalue, ...
+	std::string Data;                  // the notification data, if it takes any
+};
+
+struct MQWindowNotificationResult
+{
+	bool Success = false;
+	std::string Error;
+};
+
 struct MQWhoFilter
 {
 	bool Lastname = true;
@@ -230,10 +362,44 @@ struct MQWhoSort
 using WHOSORT DEPRECATE("Use MQWhoSort instead of WHOSORT") = MQWhoSort;
 using PWHOSORT DEPRECATE("Use MQWhoSort* instead PWHOSORT") = MQWhoSort*;
 
+struct MQCommand;
+struct MQCompiledCalculation;
+
+// A /for line split into its parts when the macro is loaded.
+struct MQMacroForLoop
+{
+	bool DownTo = false;
+	std::string End;                            // may contain ${} references
+	std::string Step;                           // empty if the line has no step
+};
+
+// The parameters declared by a Sub line, parsed the first time something calls the Sub.
+struct MQSubSignature
+{
+	struct Parameter
+	{
+		std::string Name;
+		std::string TypeName;
+	};
+
+	std::vector<Parameter> Parameters;
+};
+
 struct MQMacroLine
 {
 	std::string Command;
 
+	// Command split into its first word and the offset of its arguments, filled in when the
+	// line is added to the macro.
+	std::string CommandName;
+	size_t ArgumentOffset = 0;
+
+	// Handler for CommandName, resolved by MQCommandAPI::DoMacroLine the first time the line runs.
+	// Only valid while ResolvedGeneration matches the command generation of MQCommandAPI.
+	MQCommand* ResolvedCommand = nullptr;
+	uint32_t ResolvedGeneration = 0;
+	int ResolvedGameState = 0;
+
 	int LoopStart = 0;
 	// used for loops/while if its 0 no action is taken, otherwise it will jump to the line indicated.
 	int LoopEnd = 0;
@@ -241,10 +407,24 @@ struct MQMacroLine
 	std::string SourceFile;
 	int LineNumber = 0;
 
-#ifdef MQ2_PROFILING
-	int ExecutionCount = 0;
+	// Index of the Sub line this line belongs to, or 0 if it comes before the first Sub.
+	int SubIndex = 0;
+
+	// Condition of an /if or /while line compiled when the macro is loaded, and the offset of
+	// the command that follows it. Lines that couldn't be compiled go through the command handler.
+	std::shared_ptr<MQCompiledCalculation> Condition;
+	size_t ConditionEnd = 0;
+
+	std::shared_ptr<MQMacroForLoop> ForLoop;
+
+	// Parameters of a Sub line, see GetSubParameter.
+	std::shared_ptr<MQSubSignature> Signature;
+
+	// Filled in by the macro profiler while /profile lines is on. Times are in nanoseconds, and
+	// ParseTime is the part of ExecutionTime spent parsing the arguments of the line.
+	uint64_t ExecutionCount = 0;
 	uint64_t ExecutionTime = 0;
-#endif
+	uint64_t ParseTime = 0;
 
 	MQMacroLine(std::string Line, std::string sourceFile, int lineNumber)
 		: Command(std::move(Line))
@@ -254,22 +434,66 @@ struct MQMacroLine
 
 	MQMacroLine(const MQMacroLine&) = delete;
 	MQMacroLine& operator=(const MQMacroLine&) = delete;
+	MQMacroLine(MQMacroLine&&) = default;
+	MQMacroLine& operator=(MQMacroLine&&) = default;
 };
 using MACROLINE DEPRECATE("Use MQMacroLine instead MACROLINE") = MQMacroLine;
 using PMACROLINE DEPRECATE("Use MQMacroLine* instead of PMACROLINE") = MQMacroLine;
 
+struct MQMacroStack;
+
+// Execution state of a background macro while it isn't running. The globals (gMacroStack, gDelay,
+// gMacroSubLookupMap, ...) always hold the state of the macro that is running, and a background
+// macro's state is swapped into them for as long as it runs (see MQBackgroundMacroScope).
+struct MQMacroContext
+{
+	MQMacroStack* pStack = nullptr;
+	int Delay = 0;
+	std::string DelayCondition;
+	bool Turbo = true;
+	int MaxTurbo = 80;
+	std::map<std::string, int, CaseInsensitiveLess> SubLookupMap;
+	std::map<std::string, int> UndeclaredVars;
+	std::string MacroName;
+	uint64_t Running = 0;
+};
+
 struct MQMacroBlock
 {
 	std::string Name;                           // our macro Name
 	bool Paused = false;
+	bool Background = false;                    // started with /bgmacro, runs alongside the macro
+	MQMacroContext Context;                     // background macros only, see MQMacroContext
 	int CurrIndex = 0;                          // the current macro line we are on
 	int BindStackIndex = -1;                    // where we were at before calling the bind.
 	std::string BindCmd;                        // the actual command including parameters
-	std::map<int, MQMacroLine> Line;
 	bool Removed = false;
 
+	// Lines of the macro in the order they appear. Line indices start at 1 so that an index of 0
+	// can mean "no line", and the line at index N is stored in Lines[N - 1].
+	std::vector<MQMacroLine> Lines;
+
+	// Label lines, keyed by the index of the Sub they are in and the lowercase label (see
+	// GetLabelKey). Built when the macro is loaded. A label can appear more than once in a Sub.
+	std::unordered_map<std::string, std::vector<int>> Labels;
+
 	MQMacroBlock(std::string name) : Name(std::move(name)) {}
 
+	bool HasLine(int index) const { return index > 0 && index <= static_cast<int>(Lines.size()); }
+	MQMacroLine& GetLine(int index) { return Lines.at(index - 1); }
+	const MQMacroLine& GetLine(int index) const { return Lines.at(index - 1); }
+	int GetLastIndex() const { return static_cast<int>(Lines.size()); }
+
+	static std::string GetLabelKey(int subIndex, std::string_view label)
+	{
+		std::string key = std::to_string(subIndex);
+		key.push_back(':');
+		key.append(label);
+		for (char& ch : key)
+			ch = static_cast<char>(::tolower(static_cast<unsigned char>(ch)));
+		return key;
+	}
+
 	MQMacroBlock(const MQMacroBlock&) = delete;
 	MQMacroBlock& operator=(const MQMacroBlock&) = delete;
 };
@@ -278,13 +502,24 @@ using MQMacroBlockPtr = std::shared_ptr<MQMacroBlock>;
 using PMACROBLOCK DEPRECATE("Use MQMacroBlockPtr instead of PMACROBLOCK") = MQMacroBlockPtr;
 using MACROBLOCK DEPRECATE("Use MQMacroBlock instead MACROBLOCK") = MQMacroBlock;
 
-struct MQTimer
+// Macro timer variable. Timers count down in tenths of a second, driven by DropTimers. A running
+// timer is scheduled on the macro timer wheel, so only the timers that expire are touched per tick.
+struct MQTimer : MQTimerWheelNode
 {
 	std::string Name;
 	uint32_t Original = 0;
-	uint32_t Current = 0;
 	MQTimer* pNext = nullptr;
 	MQTimer* pPrev = nullptr;
+
+	MQTimer() = default;
+	~MQTimer();
+
+	MQTimer(const MQTimer&) = delete;
+	MQTimer& operator=(const MQTimer&) = delete;
+
+	// Remaining time in tenths of a second. 0 if the timer isn't running.
+	uint32_t GetCurrent() const;
+	void SetCurrent(uint32_t value);
 };
 using MQTIMER DEPRECATE("Use MQTimer instead of MQTIMER") = MQTimer;
 using PMQTIMER DEPRECATE("Use MQTimer* instead of PMQTIMER") = MQTimer*;
@@ -320,6 +555,7 @@ struct MQEventList
 	char szMatch[MAX_STRING];
 	int pEventFunc = 0;
 	DWORD BlechID = 0;
+	int QueuedCount = 0;                 // number of these events in gEventQueue
 
 	MQEventList* pNext = nullptr;
 };
@@ -392,16 +628,19 @@ void RemoveInternalModule(MQModule* module);
 struct ModuleInitializer;
 void AddStaticInitializationModule(ModuleInitializer* module);
 
+// dependsOn lists the names of modules that must be initialized first.
 struct ModuleInitializer
 {
-	ModuleInitializer(MQModule* thisModule)
+	ModuleInitializer(MQModule* thisModule, std::initializer_list<const char*> dependsOn = {})
 		: module(thisModule)
+		, dependencies(dependsOn)
 	{
 		AddStaticInitializationModule(this);
 	}
 
 	ModuleInitializer* next = nullptr;
 	MQModule* module = nullptr;
+	std::vector<const char*> dependencies;
 };
 
 #if _M_AMD64
@@ -410,14 +649,35 @@ struct ModuleInitializer
 #define FORCE_UNDEFINED_SYMBOL(x) __pragma(comment (linker, "/export:_" #x))
 #endif
 
-#define DECLARE_MODULE_INITIALIZER(moduleRecord) \
-	extern "C" ModuleInitializer s_moduleInitializer ## moduleRecord { &moduleRecord } \
+#define DECLARE_MODULE_INITIALIZER(moduleRecord, ...) \
+	extern "C" ModuleInitializer s_moduleInitializer ## moduleRecord { &moduleRecord, __VA_ARGS__ } \
 	FORCE_UNDEFINED_SYMBOL(s_moduleInitializer ## moduleRecord);
 
 
 
 //============================================================================
 
+/**
+ * The searches of an alert list, each compiled into a predicate. A compiled list never changes,
+ * changing the alert list compiles a new one, so it can be matched against without holding on to
+ * the alerts.
+ */
+struct MQCompiledAlertList
+{
+	struct Entry
+	{
+		explicit Entry(const MQSpawnSearch& search_);
+
+		MQSpawnSearch search;
+		uint32_t spawnID;                  // Only this spawn can match, if not 0
+		MQSpawnSearchPredicate predicate;
+	};
+
+	std::vector<std::unique_ptr<Entry>> entries;
+
+	bool Matches(SPAWNINFO* pChar, SPAWNINFO* pSpawn) const;
+};
+
 class CMQ2Alerts
 {
 public:
@@ -434,9 +694,29 @@ public:
 	MQLIB_OBJECT bool ListAlerts(char* szOut, size_t max);
 	MQLIB_OBJECT void FreeAlerts(uint32_t id);
 
+	// The alert list compiled for matching, or null if there is no such list.
+	MQLIB_OBJECT std::shared_ptr<const MQCompiledAlertList> GetCompiledAlert(uint32_t id) const;
+
+	// Incremented whenever an alert list changes.
+	uint32_t GetGeneration() const { return m_generation; }
+
+	// Whether the spawn matches any search of the alert list. Results are remembered on the main
+	// thread until the alerts change or the spawn search cache is cleared.
+	MQLIB_OBJECT bool SpawnMatchesAlert(SPAWNINFO* pChar, SPAWNINFO* pSpawn, uint32_t id);
+	void ClearMatchCache();
+
 private:
+	void UpdateCompiledAlert(uint32_t id);
+
 	mutable std::mutex m_mutex;
 	std::map<uint32_t, std::vector<MQSpawnSearch>> m_alertMap;
+	std::map<uint32_t, std::shared_ptr<const MQCompiledAlertList>> m_compiledMap;
+	std::atomic<uint32_t> m_generation = 0;
+
+	// Main thread only. Keyed by alert list id and spawn id.
+	std::unordered_map<uint64_t, bool> m_matchCache;
+	SPAWNINFO* m_matchCacheChar = nullptr;
+	uint32_t m_matchCacheGeneration = 0;
 };
 
 //============================================================================
@@ -670,6 +950,12 @@ struct MQMacroStack
 	int LocationIndex = 0;
 	MQDataVar* Parameters = nullptr;
 	MQDataVar* LocalVariables = nullptr;
+
+	// Lookup tables for Parameters and LocalVariables, keyed by views of the variable names. Kept
+	// in sync by the functions in MQ2DataVars.cpp that add and remove variables.
+	std::unordered_map<std::string_view, MQDataVar*> ParameterIndex;
+	std::unordered_map<std::string_view, MQDataVar*> LocalIndex;
+
 	std::vector<MQLoop> loopStack;
 	std::string Return;
 
@@ -683,6 +969,10 @@ struct MQMacroStack
 	MQMacroStack& operator=(const MQMacroStack&) = delete;
 };
 using PMACROSTACK DEPRECATE("Use MQMacroStack* instead of PMACROSTACK") = MQMacroStack *;
+
+// Returns the name and type of a parameter of the Sub on the given line. Parameters past the ones
+// that the Sub declares are strings named ParamN, like parameters with no name or type.
+MQ2Type* GetSubParameter(MQMacroLine& subLine, int index, std::string& name);
 using MACROSTACK DEPRECATE("Use MQMacroStack instead of MACROSTACK") = MQMacroStack;
 
 enum MQEventType {
@@ -694,6 +984,11 @@ enum MQEventType {
 	EVENT_PULSE,
 	EVENT_SHUTDOWN,
 	EVENT_BREAK,
+	EVENT_TASKPROGRESS,
+	EVENT_SPAWNTRIGGER,
+	EVENT_BUFFCHANGE,
+	EVENT_CASTPHASE,
+	EVENT_PETMERCCHANGE,
 
 	NUM_EVENTS
 };
@@ -863,6 +1158,12 @@ public:
 
 void RefreshKeyRingWindow();
 
+// The place of the key ring item in the key ring window's list, or -1.
+int GetKeyRingListIndex(KeyRingType keyRingType, int slot);
+
+// The slot of the first key ring item with the name, or -1.
+int FindKeyRingItemSlot(KeyRingType keyRingType, std::string_view name);
+
 //----------------------------------------------------------------------------
 bool GetFilteredModules(HANDLE hProcess, HMODULE* hModule, DWORD cb, DWORD* lpcbNeeded,
 	const std::function<bool(HMODULE)>& filter);
@@ -896,6 +1197,49 @@ public:
 
 	MQTopLevelObject* FindTopLevelObject(const char* name) override;
 
+	int AddMacroDataObserver(
+		std::vector<std::string> strings,
+		MQMacroDataObserverCallback callback,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool RemoveMacroDataObserver(
+		int observerId,
+		const MQPluginHandle& pluginHandle) override;
+
+	int AddGameEventObserver(
+		MQGameEvent event,
+		MQGameEventCallback callback,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool RemoveGameEventObserver(
+		int observerId,
+		const MQPluginHandle& pluginHandle) override;
+
+	int AddWarmUpTask(
+		const char* name,
+		MQWarmUpStep step,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool RemoveWarmUpTask(
+		int taskId,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool IsWarmUpTaskReady(
+		int taskId) const override;
+
+	bool IsWarmUpComplete() const override;
+
+	int AddSpawnTrigger(
+		const char* name,
+		const MQSpawnSearch& search,
+		float radius,
+		MQSpawnTriggerCallback callback,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool RemoveSpawnTrigger(
+		int triggerId,
+		const MQPluginHandle& pluginHandle) override;
+
 	void SendToActor(
 		postoffice::Dropbox* dropbox,
 		const postoffice::Address& address,
@@ -919,6 +1263,33 @@ public:
 		postoffice::Dropbox*& dropbox,
 		const MQPluginHandle& pluginHandle) override;
 
+	bool SubscribeActor(
+		postoffice::Dropbox* dropbox,
+		const std::string& topic,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool UnsubscribeActor(
+		postoffice::Dropbox* dropbox,
+		const std::string& topic,
+		const MQPluginHandle& pluginHandle) override;
+
+	void QueryRemoteData(
+		const postoffice::Address& address,
+		std::vector<std::string> expressions,
+		postoffice::RemoteQueryCallback callback,
+		const MQPluginHandle& pluginHandle) override;
+
+	int SubscribeRemoteData(
+		const postoffice::Address& address,
+		std::vector<std::string> expressions,
+		std::chrono::milliseconds interval,
+		postoffice::RemoteSubscriptionCallback callback,
+		const MQPluginHandle& pluginHandle) override;
+
+	bool UnsubscribeRemoteData(
+		int subscriptionId,
+		const MQPluginHandle& pluginHandle) override;
+
 	// Commands
 	bool AddCommand(
 		std::string_view command,
@@ -944,6 +1315,10 @@ public:
 		int msDelay,
 		const MQPluginHandle& pluginHandle) override;
 
+	void DoCompiledCommand(
+		MQCompiledCommand& command,
+		const MQPluginHandle& pluginHandle) override;
+
 	// Aliases
 	bool AddAlias(
 		const std::string& shortCommand,
@@ -20,6 +20,7 @@
 #include <mq/imgui/Widgets.h>
 
 #include <chrono>
+#include <unordered_map>
 
 using namespace std::chrono_literals;
 
@@ -93,16 +94,108 @@ int GetActivatedItemCount()
 #endif
 }
 
-static bool gbDidUpdateKeyRing = false;
-static uint64_t gLastKeyRingUpdate = 0;
+// The key rings only change when an item is added to or removed from them, which is seen by the
+// signature of each key ring changing. The key ring window's lists, which put the items in the order
+// that ${Mount[n]} and friends use, are only refreshed after that, and the items are indexed by name
+// and by their place in the lists, so lookups don't search the key rings.
 
-void RefreshKeyRingWindow()
+struct KeyRingCache
+{
+	uint64_t signature = 0;
+	bool listCurrent = false;                             // the window's list was refreshed since the change
+	std::unordered_map<int, int> slotToListIndex;
+	ci_unordered::map<std::string, int> nameToSlot;       // the first slot with the name
+};
+
+static KeyRingCache s_keyRings[eKeyRingTypeLast + 1];
+static bool s_keyRingsChecked = false;                    // the signatures were checked this pulse
+
+static void InvalidateKeyRings()
 {
-	if (gbDidUpdateKeyRing) // only need to update keyring every so often.
+	for (KeyRingCache& cache : s_keyRings)
+	{
+		cache.signature = 0;
+		cache.listCurrent = false;
+		cache.slotToListIndex.clear();
+		cache.nameToSlot.clear();
+	}
+
+	s_keyRingsChecked = false;
+}
+
+static void CheckKeyRings()
+{
+	if (s_keyRingsChecked || !pLocalPC)
 		return;
+
+	s_keyRingsChecked = true;
+
+	for (auto keyRingType = eKeyRingTypeFirst;
+		keyRingType <= eKeyRingTypeLast;
+		keyRingType = static_cast<KeyRingType>(keyRingType + 1))
+	{
+		ItemContainer& container = pLocalPC->GetKeyRingItems(keyRingType);
+
+		uint64_t hash = 14695981039346656037ULL;
+		auto add = [&hash](uint32_t value)
+		{
+			hash ^= value;
+			hash *= 1099511628211ULL;
+		};
+
+		add(static_cast<uint32_t>(container.GetCount()));
+		container.VisitItems(-1, -1, -1, [&add](const ItemPtr& pItem, const ItemIndex& index)
+			{
+				add(static_cast<uint32_t>(index.GetTopSlot()));
+				add(static_cast<uint32_t>(pItem->GetID()));
+			});
+
+		KeyRingCache& cache = s_keyRings[keyRingType];
+		if (cache.signature == hash)
+			continue;
+
+		cache.signature = hash;
+		cache.listCurrent = false;
+		cache.slotToListIndex.clear();
+		cache.nameToSlot.clear();
+
+		container.VisitItems(-1, -1, -1, [&cache](const ItemPtr& pItem, const ItemIndex& index)
+			{
+				cache.nameToSlot.emplace(pItem->GetName(), index.GetTopSlot());
+			});
+	}
+}
+
+static void IndexKeyRingList(KeyRingType keyRingType)
+{
+	KeyRingCache& cache = s_keyRings[keyRingType];
+	cache.slotToListIndex.clear();
+
+	if (CListWnd* pListWnd = pKeyRingWnd->GetKeyRingList(keyRingType))
+	{
+		for (int i = 0; i < pListWnd->ItemsArray.GetCount(); ++i)
+			cache.slotToListIndex.emplace((int)pListWnd->GetItemData(i), i);
+	}
+}
+
+void RefreshKeyRingWindow()
+{
 	if (!pKeyRingWnd)
 		return;
 
+	CheckKeyRings();
+
+	bool listsCurrent = true;
+	for (auto keyRingType = eKeyRingTypeFirst;
+		keyRingType <= eKeyRingTypeLast;
+		keyRingType = static_cast<KeyRingType>(keyRingType + 1))
+	{
+		listsCurrent = listsCurrent && s_keyRings[keyRingType].listCurrent;
+	}
+
+	if (listsCurrent) // only need to update keyring when it changed.
+		return;
+
 	bool isVisible = pKeyRingWnd->IsVisible();
 	auto currentPage = pKeyRingWnd->CurrentPage;
 	int lastUpdateTime = pKeyRingWnd->LastUpdateTime;
@@ -128,8 +221,66 @@ void RefreshKeyRingWindow()
 		pKeyRingWnd->CurrentPage = currentPage;
 	pKeyRingWnd->LastUpdateTime = lastUpdateTime;
 
-	gbDidUpdateKeyRing = true;
-	gLastKeyRingUpdate = MQGetTickCount64();
+	for (auto keyRingType = eKeyRingTypeFirst;
+		keyRingType <= eKeyRingTypeLast;
+		keyRingType = static_cast<KeyRingType>(keyRingType + 1))
+	{
+		IndexKeyRingList(keyRingType);
+		s_keyRings[keyRingType].listCurrent = true;
+	}
+}
+
+int GetKeyRingListIndex(KeyRingType keyRingType, int slot)
+{
+	if (keyRingType < eKeyRingTypeFirst || keyRingType > eKeyRingTypeLast || !pKeyRingWnd)
+		return -1;
+
+	RefreshKeyRingWindow();
+
+	CListWnd* pListWnd = pKeyRingWnd->GetKeyRingList(keyRingType);
+	if (!pListWnd)
+		return -1;
+
+	KeyRingCache& cache = s_keyRings[keyRingType];
+
+	// The list can also be sorted in the window, which doesn't change the key ring.
+	auto iter = cache.slotToListIndex.find(slot);
+	if (iter == cache.slotToListIndex.end()
+		|| iter->second >= pListWnd->ItemsArray.GetCount()
+		|| (int)pListWnd->GetItemData(iter->second) != slot)
+	{
+		IndexKeyRingList(keyRingType);
+		iter = cache.slotToListIndex.find(slot);
+	}
+
+	return iter != cache.slotToListIndex.end() ? iter->second : -1;
+}
+
+int FindKeyRingItemSlot(KeyRingType keyRingType, std::string_view name)
+{
+	if (keyRingType < eKeyRingTypeFirst || keyRingType > eKeyRingTypeLast || !pLocalPC)
+		return -1;
+
+	CheckKeyRings();
+
+	const KeyRingCache& cache = s_keyRings[keyRingType];
+
+	auto iter = cache.nameToSlot.find(name);
+	if (iter == cache.nameToSlot.end())
+		return -1;
+
+	// Items can be added or removed earlier in the pulse.
+	ItemPtr pItem = pLocalPC->GetKeyRingItems(keyRingType).GetItem(iter->second);
+	if (!pItem || !ci_equals(pItem->GetName(), name))
+	{
+		s_keyRingsChecked = false;
+		CheckKeyRings();
+
+		iter = cache.nameToSlot.find(name);
+		return iter != cache.nameToSlot.end() ? iter->second : -1;
+	}
+
+	return iter->second;
 }
 #endif // HAS_KEYRING_WINDOW
 
@@ -581,15 +732,8 @@ static void Items_Shutdown()
 static void Items_Pulse()
 {
 #if HAS_KEYRING_WINDOW
-	// This may not be necessary if the data cannot be manipulated without the UI.
-	// This resets the check for gbDidUpdateKeyRing 5 seconds after it is set.
-	if (gbDidUpdateKeyRing)
-	{
-		if (gLastKeyRingUpdate + 5000 < MQGetTickCount64())
-		{
-			gbDidUpdateKeyRing = false;
-		}
-	}
+	// The key rings are checked for changes again by the first lookup of the pulse.
+	s_keyRingsChecked = false;
 #endif // HAS_KEYRING_WINDOW
 }
 
@@ -597,7 +741,7 @@ static void Items_SetGameState(int gameState)
 {
 #if HAS_KEYRING_WINDOW
 	if (gameState == GAMESTATE_INGAME)
-		gbDidUpdateKeyRing = false;
+		InvalidateKeyRings();
 #endif // HAS_KEYRING_WINDOW
 }
 
@@ -18,6 +18,7 @@
 #include "MQ2KeyBinds.h"
 
 #include <fmt/format.h>
+#include <unordered_map>
 
 namespace mq {
 
@@ -29,6 +30,55 @@ using KeybindMap = std::map<std::string, int, ci_less>;
 KeybindMap gKeybindMap;
 std::vector<std::unique_ptr<MQKeyBind>> gKeyBinds;
 
+// gKeybindMap keeps the binds in order for listing them, lookups go through the hash.
+static ci_unordered::map<std::string, int> s_keyBindsByName;
+
+// The ids of the binds on each key (either combo), in id order. A keystroke only has to compare the
+// combos of the binds on its key.
+static std::unordered_map<uint8_t, std::vector<int>> s_keyBindsByKey;
+
+// szEQMappableCommands by name, built the first time a command is looked up.
+static ci_unordered::map<std::string_view, int> s_mappableCommandsByName;
+
+static void IndexKeyBind(const MQKeyBind& keyBind)
+{
+	for (const KeyCombo* combo : { &keyBind.Normal, &keyBind.Alt })
+	{
+		if (combo->Data[3] == 0)
+			continue;
+
+		std::vector<int>& ids = s_keyBindsByKey[combo->Data[3]];
+		auto iter = std::lower_bound(ids.begin(), ids.end(), keyBind.Id);
+		if (iter == ids.end() || *iter != keyBind.Id)
+			ids.insert(iter, keyBind.Id);
+	}
+}
+
+static void UnindexKeyBind(const MQKeyBind& keyBind)
+{
+	for (const KeyCombo* combo : { &keyBind.Normal, &keyBind.Alt })
+	{
+		auto iter = s_keyBindsByKey.find(combo->Data[3]);
+		if (iter == s_keyBindsByKey.end())
+			continue;
+
+		std::vector<int>& ids = iter->second;
+		ids.erase(std::remove(ids.begin(), ids.end(), keyBind.Id), ids.end());
+		if (ids.empty())
+			s_keyBindsByKey.erase(iter);
+	}
+}
+
+// The binds on the key of a combo. A copy, since the bind functions can change the binds.
+static std::vector<int> GetKeyBindsOnKey(const KeyCombo& combo)
+{
+	auto iter = s_keyBindsByKey.find(combo.Data[3]);
+	if (iter == s_keyBindsByKey.end())
+		return {};
+
+	return iter->second;
+}
+
 void EnumerateKeyBinds(const std::function<void(const MQKeyBind& keyBind)>& func)
 {
 	for (const auto& [name, id] : gKeybindMap)
@@ -48,8 +98,8 @@ int GetKeyBindsCount()
 
 static MQKeyBind* KeyBindByName(const char* name)
 {
-	auto iter = gKeybindMap.find(name);
-	if (iter == std::end(gKeybindMap))
+	auto iter = s_keyBindsByName.find(std::string_view{ name });
+	if (iter == std::end(s_keyBindsByName))
 		return nullptr;
 
 	return gKeyBinds[iter->second].get();
@@ -98,8 +148,9 @@ bool MQ2HandleKeyDown(const KeyCombo& combo)
 		}
 	}
 
-	for (auto& pKeybind : gKeyBinds)
+	for (int id : GetKeyBindsOnKey(combo))
 	{
+		auto& pKeybind = gKeyBinds[id];
 		if (pKeybind
 			&& pKeybind->State == 0
 			&& (pKeybind->Normal == combo || pKeybind->Alt == combo))
@@ -130,8 +181,9 @@ bool MQ2HandleKeyUp(const KeyCombo& combo)
 		}
 	}
 
-	for (auto& pKeybind : gKeyBinds)
+	for (int id : GetKeyBindsOnKey(combo))
 	{
+		auto& pKeybind = gKeyBinds[id];
 		if (pKeybind
 			&& pKeybind->State == 1
 			&& (pKeybind->Normal.Data[3] == combo.Data[3] || pKeybind->Alt.Data[3] == combo.Data[3]))
@@ -210,6 +262,9 @@ void ShutdownMQ2KeyBinds()
 {
 	gKeyBinds.clear();
 	gKeybindMap.clear();
+	s_keyBindsByName.clear();
+	s_keyBindsByKey.clear();
+	s_mappableCommandsByName.clear();
 
 	RemoveDetour(KeypressHandler__ClearCommandStateArray);
 	RemoveDetour(KeypressHandler__HandleKeyDown);
@@ -255,8 +310,10 @@ bool AddMQ2KeyBind(const char* name, fMQExecuteCmd function)
 	}
 
 	pKeybind->Id = index;
+	IndexKeyBind(*pKeybind);
 	gKeyBinds[index] = std::move(pKeybind);
 	gKeybindMap.insert_or_assign(name, index);
+	s_keyBindsByName.insert_or_assign(name, index);
 
 	return true;
 }
@@ -279,6 +336,8 @@ bool RemoveMQ2KeyBind(const char* name)
 	if (iter == std::end(gKeybindMap))
 		return false;
 
+	UnindexKeyBind(*gKeyBinds[iter->second]);
+	s_keyBindsByName.erase(gKeyBinds[iter->second]->Name);
 	gKeyBinds[iter->second].reset();
 	gKeybindMap.erase(iter);
 
@@ -309,6 +368,7 @@ bool SetMQ2KeyBind(const char* name, bool alternate, KeyCombo& combo)
 	{
 		std::string settingName;
 
+		UnindexKeyBind(*pKeybind);
 		if (!alternate)
 		{
 			settingName = fmt::format("{}_Nrm", pKeybind->Name);
@@ -319,6 +379,7 @@ bool SetMQ2KeyBind(const char* name, bool alternate, KeyCombo& combo)
 			settingName = fmt::format("{}_Alt", pKeybind->Name);
 			pKeybind->Alt = combo;
 		}
+		IndexKeyBind(*pKeybind);
 
 		char szBuffer[MAX_STRING] = { 0 };
 
@@ -332,16 +393,24 @@ bool SetMQ2KeyBind(const char* name, bool alternate, KeyCombo& combo)
 
 int FindMappableCommand(const char* name)
 {
-	for (int i = 0; i < nEQMappableCommands; i++)
+	// the names are in the game image, they don't change
+	if (s_mappableCommandsByName.empty())
 	{
-		if (szEQMappableCommands[i] == nullptr || szEQMappableCommands[i] > reinterpret_cast<const char*>(g_eqgameimagesize))
-			continue;
+		for (int i = 0; i < nEQMappableCommands; i++)
+		{
+			if (szEQMappableCommands[i] == nullptr || szEQMappableCommands[i] > reinterpret_cast<const char*>(g_eqgameimagesize))
+				continue;
 
-		if (!_stricmp(name, szEQMappableCommands[i]))
-			return i;
+			// the first command with a name wins, as the scan did
+			s_mappableCommandsByName.emplace(szEQMappableCommands[i], i);
+		}
 	}
 
-	return -1;
+	auto iter = s_mappableCommandsByName.find(std::string_view{ name });
+	if (iter == s_mappableCommandsByName.end())
+		return -1;
+
+	return iter->second;
 }
 
 void MQ2KeyBindCommand(PlayerClient* pChar, const char* szLine)
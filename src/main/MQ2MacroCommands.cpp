@@ -17,9 +17,13 @@
 
 #include "MQCommandAPI.h"
 #include "MQDataAPI.h"
+#include "MQMacroCache.h"
+#include "MQMacroProfiler.h"
 #include "MQPluginHandler.h"
 #include "MQ2KeyBinds.h"
 
+#include <mq/base/ScopeExit.h>
+
 #include <fstream>
 #include <regex>
 
@@ -31,6 +35,16 @@ void CALLBACK EventBlechCallback(unsigned int ID, void* pData, PBLECHVALUE pValu
 static std::map<std::string, MQMacroBlockPtr> MacroBlockMap;
 uint64_t s_commandCount = 0;
 
+// Collects the flattened source of the macro being loaded from its files, when caching is on.
+static MQMacroCache* s_macroCacheRecording = nullptr;
+
+// Macros started with /bgmacro, in the order they were started.
+static std::vector<MQMacroBlockPtr> s_backgroundMacros;
+
+// Set when a background macro ends every macro. The macro it interrupted can only be ended once
+// it's back in the foreground.
+static bool s_endAllMacrosPending = false;
+
 void format_args(fmt::appender& buffer, const std::vector<std::string>& args)
 {
 	if (args.empty())
@@ -234,6 +248,15 @@ static std::vector<std::string> ArgsToVector(const char* szLine)
 
 void ProfileCmd(PlayerClient* pChar, const char* szLine)
 {
+	char szArg[MAX_STRING] = { 0 };
+	GetArg(szArg, szLine, 1);
+
+	if (ci_equals(szArg, "lines"))
+	{
+		MacroProfiler_Command(GetNextArg(szLine));
+		return;
+	}
+
 	Macro(pChar, szLine);
 
 	if (g_pProfile)
@@ -278,24 +301,25 @@ void FailIf(SPAWNINFO* pChar, const char* szCommand, int StartLine, bool All = f
 			return;
 		}
 
-		auto lineIter = gMacroBlock->Line.find(StartLine);
-		if (lineIter == gMacroBlock->Line.end())
+		if (!gMacroBlock->HasLine(StartLine))
 		{
 			DebugSpewNoFile("FailIf - Macro was ended before we could handle the false if command");
 			return;
 		}
 
-		lineIter++; // move it forward once...
-		gMacroBlock->CurrIndex = lineIter->first;
+		int index = StartLine + 1; // move it forward once...
+		gMacroBlock->CurrIndex = index;
 
-		for (; lineIter != gMacroBlock->Line.end() && Scope > 0; lineIter++)
+		for (; index <= gMacroBlock->GetLastIndex() && Scope > 0; ++index)
 		{
-			if (lineIter->second.Command[0] == '}')
+			const std::string& command = gMacroBlock->GetLine(index).Command;
+
+			if (command[0] == '}')
 				Scope--;
 
 			if (All)
 			{
-				if (lineIter->second.Command[lineIter->second.Command.size() - 1] == '{')
+				if (command[command.size() - 1] == '{')
 				{
 					Scope++;
 				}
@@ -305,35 +329,31 @@ void FailIf(SPAWNINFO* pChar, const char* szCommand, int StartLine, bool All = f
 			{
 				if (!All)
 				{
-					if (lineIter->second.Command[lineIter->second.Command.size() - 1] == '{')
+					if (command[command.size() - 1] == '{')
 						Scope++;
 				}
 
-				if (!_strnicmp(lineIter->second.Command.c_str(), "sub ", 4))
+				if (!_strnicmp(command.c_str(), "sub ", 4))
 				{
 					gMacroBlock->CurrIndex = StartLine;
 					FatalError("{} pairing ran into anther subroutine");
 					return;
 				}
 
-				auto forward = lineIter;
-				++forward;
-
-				if (forward == gMacroBlock->Line.end())
+				if (index == gMacroBlock->GetLastIndex())
 				{
 					gMacroBlock->CurrIndex = StartLine;
 					FatalError("Bad {} block pairing");
 					return;
 				}
 
-				gMacroBlock->CurrIndex = forward->first;
+				gMacroBlock->CurrIndex = index + 1;
 			}
 		}
 
-		lineIter = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-		if (lineIter != gMacroBlock->Line.end())
+		if (gMacroBlock->HasLine(gMacroBlock->CurrIndex))
 		{
-			auto& currLine = lineIter->second;
+			auto& currLine = gMacroBlock->GetLine(gMacroBlock->CurrIndex);
 
 			if (!All && (!_strnicmp(currLine.Command.c_str(), "} else ", 7)))
 			{
@@ -576,6 +596,106 @@ bool Include(const char* szFile, int* LineNumber)
 	return true;
 }
 
+// Splits the arguments of a macro line into words, keeping ${} references whole.
+static std::vector<std::string_view> SplitMacroWords(std::string_view text)
+{
+	std::vector<std::string_view> words;
+
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		while (pos < text.size() && text[pos] == ' ')
+			++pos;
+		if (pos == text.size())
+			break;
+
+		const size_t start = pos;
+		int braces = 0;
+
+		while (pos < text.size() && (braces > 0 || text[pos] != ' '))
+		{
+			if (text[pos] == '{')
+				++braces;
+			else if (text[pos] == '}' && braces > 0)
+				--braces;
+			++pos;
+		}
+
+		words.push_back(text.substr(start, pos - start));
+	}
+
+	return words;
+}
+
+// ***************************************************************************
+// Function:    CompileMacroLine
+// Description: Compiles the conditions of /if and /while lines and splits /for lines
+//              into their parts, so that they aren't parsed again every time they run.
+//              Lines that can't be compiled are left to their command handlers.
+// ***************************************************************************
+static void CompileMacroLine(MQMacroLine& line)
+{
+	const std::string_view args = std::string_view{ line.Command }.substr(line.ArgumentOffset);
+
+	if (ci_equals(line.CommandName, "/if") || ci_equals(line.CommandName, "/while"))
+	{
+		if (args.empty() || args[0] != '(')
+			return;
+
+		// Pair the parentheses the same way the command handlers do, except that the ones inside
+		// of ${} references don't count.
+		size_t pos = 1;
+		int parens = 1;
+		int braces = 0;
+
+		for (; pos < args.size(); ++pos)
+		{
+			const char ch = args[pos];
+
+			if (ch == '{')
+				++braces;
+			else if (ch == '}')
+			{
+				if (braces > 0)
+					--braces;
+			}
+			else if (braces == 0)
+			{
+				if (ch == '(')
+					++parens;
+				else if (ch == ')' && --parens == 0)
+					break;
+			}
+		}
+
+		if (parens != 0 || pos + 1 >= args.size() || args[pos + 1] != ' ')
+			return;
+
+		line.Condition = CompileCalculation(args.substr(0, pos + 1));
+		if (line.Condition)
+			line.ConditionEnd = line.ArgumentOffset + pos + 2;
+	}
+	else if (ci_equals(line.CommandName, "/for"))
+	{
+		// <variable> <start> <to|downto> <end> [step <step>]
+		const std::vector<std::string_view> words = SplitMacroWords(args);
+		if (words.size() != 4 && !(words.size() == 6 && ci_equals(words[4], "step")))
+			return;
+
+		const bool downTo = ci_equals(words[2], "downto");
+		if (!downTo && !ci_equals(words[2], "to"))
+			return;
+
+		auto forLoop = std::make_shared<MQMacroForLoop>();
+		forLoop->DownTo = downTo;
+		forLoop->End = words[3];
+		if (words.size() == 6)
+			forLoop->Step = words[5];
+
+		line.ForLoop = std::move(forLoop);
+	}
+}
+
 // ***************************************************************************
 // Function:    AddMacroLine
 // Description: Add a line to the MacroBlock
@@ -602,10 +722,28 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 			}
 			pDef = pDef->pNext;
 		}
+
+		if (s_macroCacheRecording)
+			s_macroCacheRecording->AddLine(FileName, szLine, localLine);
 	}
 	else
 	{
-		if (!_strnicmp(szLine, "#include ", 9) || !_strnicmp(szLine, "#include_optional ", 18))
+		const bool isInclude = !_strnicmp(szLine, "#include ", 9) || !_strnicmp(szLine, "#include_optional ", 18);
+
+		// Includes are flattened and defines are already applied to the lines that follow them.
+		// Every other directive is replayed when the macro is loaded from the cache.
+		if (s_macroCacheRecording && !isInclude && _strnicmp(szLine, "#define ", 8) != 0)
+			s_macroCacheRecording->AddLine(FileName, szLine, localLine);
+
+		if (gMacroBlock->Background && (!_strnicmp(szLine, "#event ", 7) || !_strnicmp(szLine, "#bind", 5)
+			|| !_strnicmp(szLine, "#chat ", 6)))
+		{
+			// Events and binds are dispatched to the foreground macro.
+			MacroError("Background macros can't use %s", szLine);
+			return false;
+		}
+
+		if (isInclude)
 		{
 			bool optional = false;
 			szLine += 8;
@@ -620,6 +758,11 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 			{
 				szLine++;
 			}
+
+			// The file can differ from one load to the next, so the result can't be cached.
+			if (s_macroCacheRecording && strstr(szLine, "${"))
+				s_macroCacheRecording->Cacheable = false;
+
 			ParseMacroData(szLine, Linelen);
 
 			std::filesystem::path incFilePath = szLine;
@@ -641,6 +784,9 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 				}
 			}
 
+			if (s_macroCacheRecording)
+				s_macroCacheRecording->AddDependency(incFilePath);
+
 			if (!optional)
 			{
 				// Include() contains the error messages, so let it error if it doesn't exist
@@ -806,13 +952,40 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 		}
 	}
 
-	if ((!_stricmp(szLine, "Sub Event_Chat")) || (!_strnicmp(szLine, "Sub Event_Chat(", 15)))
+	const int index = gMacroBlock->GetLastIndex() + 1;
+
+	if (gMacroBlock->Background)
 	{
-		gEventFunc[EVENT_CHAT] = *LineNumber;
+		// Event subs of a background macro are never called, don't let them replace the ones of
+		// the foreground macro.
+	}
+	else if ((!_stricmp(szLine, "Sub Event_Chat")) || (!_strnicmp(szLine, "Sub Event_Chat(", 15)))
+	{
+		gEventFunc[EVENT_CHAT] = index;
 	}
 	else if ((!_stricmp(szLine, "Sub Event_Timer")) || (!_strnicmp(szLine, "Sub Event_Timer(", 16)))
 	{
-		gEventFunc[EVENT_TIMER] = *LineNumber;
+		gEventFunc[EVENT_TIMER] = index;
+	}
+	else if ((!_stricmp(szLine, "Sub Event_TaskProgress")) || (!_strnicmp(szLine, "Sub Event_TaskProgress(", 23)))
+	{
+		gEventFunc[EVENT_TASKPROGRESS] = index;
+	}
+	else if ((!_stricmp(szLine, "Sub Event_SpawnTrigger")) || (!_strnicmp(szLine, "Sub Event_SpawnTrigger(", 23)))
+	{
+		gEventFunc[EVENT_SPAWNTRIGGER] = index;
+	}
+	else if ((!_stricmp(szLine, "Sub Event_BuffChange")) || (!_strnicmp(szLine, "Sub Event_BuffChange(", 21)))
+	{
+		gEventFunc[EVENT_BUFFCHANGE] = index;
+	}
+	else if ((!_stricmp(szLine, "Sub Event_CastPhase")) || (!_strnicmp(szLine, "Sub Event_CastPhase(", 20)))
+	{
+		gEventFunc[EVENT_CASTPHASE] = index;
+	}
+	else if ((!_stricmp(szLine, "Sub Event_PetMercChange")) || (!_strnicmp(szLine, "Sub Event_PetMercChange(", 24)))
+	{
+		gEventFunc[EVENT_PETMERCCHANGE] = index;
 	}
 	else
 	{
@@ -821,7 +994,7 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 		{
 			if (!_stricmp(szLine, pEvent->szName))
 			{
-				pEvent->pEventFunc = *LineNumber;
+				pEvent->pEventFunc = index;
 			}
 			else
 			{
@@ -830,32 +1003,31 @@ bool AddMacroLine(const char* FileName, char* szLine, size_t Linelen, int* LineN
 
 				if (!_strnicmp(szLine, szNameP, strlen(szNameP)))
 				{
-					pEvent->pEventFunc = *LineNumber;
+					pEvent->pEventFunc = index;
 				}
 			}
 			pEvent = pEvent->pNext;
 		}
 	}
 
-	auto [iter, success] = gMacroBlock->Line.emplace(
-		std::piecewise_construct,
-		std::forward_as_tuple(*LineNumber),
-		std::forward_as_tuple(szLine, FileName, localLine));
-	if (!success)
-	{
-		MacroError("Duplicate line number detected! %s@%d", FileName, localLine);
-	}
+	MQMacroLine& line = gMacroBlock->Lines.emplace_back(szLine, FileName, localLine);
 
-#ifdef MQ2_PROFILING
-	iter->second.ExecutionCount = 0;
-	iter->second.ExecutionTime = 0;
-#endif
+	// Split the command word from its arguments the same way DoCommand does
+	char szCommandName[MAX_STRING] = { 0 };
+	GetArg(szCommandName, szLine, 1);
+	line.CommandName = szCommandName;
+	line.ArgumentOffset = GetNextArg(line.Command.c_str()) - line.Command.c_str();
+	CompileMacroLine(line);
 
-	static const std::regex subrx("^sub (\\w+)", std::regex_constants::icase);
-	std::cmatch submatch;
-	if (std::regex_search(szLine, submatch, subrx))
+	// Only Sub lines can match, so skip the regex for everything else.
+	if (!_strnicmp(szLine, "sub ", 4))
 	{
-		gMacroSubLookupMap[submatch.str(1)] = *LineNumber;
+		static const std::regex subrx("^sub (\\w+)", std::regex_constants::icase);
+		std::cmatch submatch;
+		if (std::regex_search(szLine, submatch, subrx))
+		{
+			gMacroSubLookupMap[submatch.str(1)] = index;
+		}
 	}
 
 	return true;
@@ -869,6 +1041,84 @@ static MQMacroBlockPtr AddMacroBlock(std::string Name)
 	return macroBlock;
 }
 
+// ***************************************************************************
+// Function:    BuildMacroJumpTable
+// Description: Resolves the targets of labels, /while blocks and /for loops once the
+//              macro has been loaded, so that /goto, /while, /continue and /break don't
+//              need to search for them while the macro is running.
+// ***************************************************************************
+static void BuildMacroJumpTable(MQMacroBlock& block)
+{
+	block.Labels.clear();
+
+	int subIndex = 0;
+	std::vector<int> openBlocks;                            // lines ending in { that are waiting for their }
+	std::unordered_map<std::string, std::vector<int>> openForLoops; // /for lines by variable, waiting for their /next
+
+	for (int index = 1; index <= block.GetLastIndex(); ++index)
+	{
+		MQMacroLine& line = block.GetLine(index);
+		const std::string& command = line.Command;
+
+		if (command.empty())
+			continue;
+
+		// Blocks and loops never continue into another sub
+		if (!_strnicmp(command.c_str(), "sub ", 4))
+		{
+			subIndex = index;
+			openBlocks.clear();
+			openForLoops.clear();
+		}
+
+		line.SubIndex = subIndex;
+
+		if (command[0] == ':')
+		{
+			block.Labels[MQMacroBlock::GetLabelKey(subIndex, command)].push_back(index);
+		}
+		else if (!_strnicmp(command.c_str(), "/for ", 5))
+		{
+			char forVariable[MAX_STRING] = { 0 };
+			GetArg(forVariable, command.c_str(), 2);
+
+			openForLoops[to_lower_copy(forVariable)].push_back(index);
+		}
+		else if (!_strnicmp(command.c_str(), "/next ", 6))
+		{
+			char forVariable[MAX_STRING] = { 0 };
+			GetArg(forVariable, command.c_str(), 2);
+
+			auto iter = openForLoops.find(to_lower_copy(forVariable));
+			if (iter != openForLoops.end())
+			{
+				for (int forIndex : iter->second)
+					block.GetLine(forIndex).LoopEnd = index;
+
+				openForLoops.erase(iter);
+			}
+		}
+
+		if (command[0] == '}' && !openBlocks.empty())
+		{
+			const int openIndex = openBlocks.back();
+			openBlocks.pop_back();
+
+			// Same as what MarkWhile records the first time the /while runs.
+			MQMacroLine& openLine = block.GetLine(openIndex);
+			if (!_strnicmp(openLine.Command.c_str(), "/while", 6) && openIndex > 1)
+			{
+				openLine.LoopStart = openIndex - 1;
+				openLine.LoopEnd = index;
+				line.LoopStart = openIndex - 1;
+			}
+		}
+
+		if (command[command.size() - 1] == '{')
+			openBlocks.push_back(index);
+	}
+}
+
 static void RemoveMacroBlock(std::string Name)
 {
 	auto iter = MacroBlockMap.find(Name);
@@ -879,8 +1129,181 @@ static void RemoveMacroBlock(std::string Name)
 	}
 }
 
+// Frames are recycled, so that their lookup tables and return value keep their capacity from one
+// /call to the next instead of being allocated for every call.
+static constexpr size_t MaxPooledMacroStacks = 32;
+static std::vector<MQMacroStack*> s_macroStackPool;
+
+static MQMacroStack* AllocateMacroStack(int locationIndex)
+{
+	if (s_macroStackPool.empty())
+		return new MQMacroStack(locationIndex);
+
+	MQMacroStack* pStack = s_macroStackPool.back();
+	s_macroStackPool.pop_back();
+
+	pStack->LocationIndex = locationIndex;
+	return pStack;
+}
+
+// The variables of the frame must have been cleared already.
+static void ReleaseMacroStack(MQMacroStack* pStack)
+{
+	if (s_macroStackPool.size() >= MaxPooledMacroStacks)
+	{
+		delete pStack;
+		return;
+	}
+
+	pStack->bIsBind = false;
+	pStack->LocationIndex = 0;
+	pStack->Parameters = nullptr;
+	pStack->LocalVariables = nullptr;
+	pStack->ParameterIndex.clear();
+	pStack->LocalIndex.clear();
+	pStack->loopStack.clear();
+	pStack->Return.clear();
+	pStack->pNext = nullptr;
+	s_macroStackPool.push_back(pStack);
+}
+
+// Frees the stack of the macro that is running.
+static void ClearMacroStack()
+{
+	while (gMacroStack)
+	{
+		MQMacroStack* pStack = gMacroStack->pNext;
+
+		if (gMacroStack->LocalVariables)
+			ClearMQ2DataVariables(&gMacroStack->LocalVariables);
+
+		if (gMacroStack->Parameters)
+			ClearMQ2DataVariables(&gMacroStack->Parameters);
+
+		ReleaseMacroStack(gMacroStack);
+		gMacroStack = pStack;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Background macros
+
+static void SwapMacroContext(MQMacroContext& context)
+{
+	std::swap(gMacroStack, context.pStack);
+	std::swap(gDelay, context.Delay);
+	std::swap(gTurbo, context.Turbo);
+	std::swap(gMaxTurbo, context.MaxTurbo);
+	std::swap(gRunning, context.Running);
+	gMacroSubLookupMap.swap(context.SubLookupMap);
+	gUndeclaredVars.swap(context.UndeclaredVars);
+
+	const std::string delayCondition = std::exchange(context.DelayCondition, gDelayCondition);
+	strcpy_s(gDelayCondition, delayCondition.c_str());
+
+	const std::string macroName = std::exchange(context.MacroName, gszMacroName);
+	strcpy_s(gszMacroName, macroName.c_str());
+}
+
+MQBackgroundMacroScope::MQBackgroundMacroScope(MQMacroBlockPtr pBlock)
+	: m_pBlock(std::move(pBlock))
+{
+	m_pSavedBlock = std::exchange(gMacroBlock, m_pBlock);
+	SwapMacroContext(m_pBlock->Context);
+}
+
+MQBackgroundMacroScope::~MQBackgroundMacroScope()
+{
+	SwapMacroContext(m_pBlock->Context);
+	gMacroBlock = std::move(m_pSavedBlock);
+
+	if (s_endAllMacrosPending && !(gMacroBlock && gMacroBlock->Background))
+	{
+		s_endAllMacrosPending = false;
+		EndAllMacros();
+	}
+}
+
+const std::vector<MQMacroBlockPtr>& GetBackgroundMacroBlocks()
+{
+	return s_backgroundMacros;
+}
+
+static MQMacroBlockPtr FindBackgroundMacro(const char* Name)
+{
+	for (const MQMacroBlockPtr& pBlock : s_backgroundMacros)
+	{
+		if (!_stricmp(pBlock->Name.c_str(), Name))
+			return pBlock;
+	}
+
+	return nullptr;
+}
+
+// Ends the background macro that is running. Its :OnExit isn't run, and its state is left in the
+// globals until the scope that is running it puts back the macro it interrupted.
+static void EndRunningBackgroundMacro()
+{
+	MQMacroBlockPtr pBlock = gMacroBlock;
+
+	MacroProfiler_MacroEnded(*pBlock);
+
+	pBlock->Removed = true;
+	s_backgroundMacros.erase(std::remove(s_backgroundMacros.begin(), s_backgroundMacros.end(), pBlock),
+		s_backgroundMacros.end());
+
+	ClearMacroStack();
+	gMacroSubLookupMap.clear();
+	gUndeclaredVars.clear();
+	gDelay = 0;
+	gDelayCondition[0] = 0;
+	gszMacroName[0] = 0;
+	gRunning = 0;
+
+	// Tells whoever is running the macro that it's done.
+	gMacroBlock = nullptr;
+
+	DebugSpewNoFile("EndMacro - Ended background macro %s", pBlock->Name.c_str());
+	if (gFilterMacro != FILTERMACRO_NONE && gFilterMacro != FILTERMACRO_MACROENDED)
+		WriteChatf("The background macro %s has ended.", pBlock->Name.c_str());
+}
+
+static void EndBackgroundMacro(const MQMacroBlockPtr& pBlock)
+{
+	if (pBlock == gMacroBlock)
+	{
+		EndRunningBackgroundMacro();
+		return;
+	}
+
+	MQBackgroundMacroScope scope(pBlock);
+	EndRunningBackgroundMacro();
+}
+
+static void EndBackgroundMacros()
+{
+	// Copied, ending a macro removes it from the list.
+	const std::vector<MQMacroBlockPtr> blocks = s_backgroundMacros;
+	for (const MQMacroBlockPtr& pBlock : blocks)
+	{
+		if (!pBlock->Removed)
+			EndBackgroundMacro(pBlock);
+	}
+}
+
+//----------------------------------------------------------------------------
+
 void EndAllMacros()
 {
+	if (gMacroBlock && gMacroBlock->Background)
+	{
+		s_endAllMacrosPending = true;
+		EndRunningBackgroundMacro();
+		return;
+	}
+
+	EndBackgroundMacros();
+
 	if (MacroBlockMap.empty())
 		return;
 
@@ -948,6 +1371,10 @@ MQMacroBlockPtr GetCurrentMacroBlock()
 	if (!gMacroBlock)
 		return nullptr;
 
+	// Background macros aren't in the block map, and are only current while they run.
+	if (gMacroBlock->Background)
+		return gMacroBlock;
+
 	if (!MacroBlockMap.empty())
 	{
 		if (BlockIndex == 0)
@@ -973,86 +1400,76 @@ int GetMacroBlockCount()
 	return static_cast<int>(MacroBlockMap.size());
 }
 
-// ***************************************************************************
-// Function:    Macro
-// Description: Our '/macro' command
-// Usage:       /macro <filename>
-// ***************************************************************************
-void Macro(PlayerClient* pChar, const char* szLine)
+static void ClearMacroDefines()
 {
-	gWarning = false;
-	bRunNextCommand = true;
-
-	char* szNext = nullptr;
-	bool InBlockComment = false;
-
-	if (szLine[0] == 0)
+	while (pDefines)
 	{
-		SyntaxError("Usage: /macro <filename> [param [param...]]");
-		return;
+		MQDefine* pDef = pDefines->pNext;
+		delete pDefines;
+
+		pDefines = pDef;
 	}
+}
 
-	MQMacroBlockPtr pBlock = GetMacroBlock(szLine);
+// ***************************************************************************
+// Function:    LoadMacroFile
+// Description: Adds the lines of a macro file to gMacroBlock, from the macro cache when it is
+//              up to date, and resolves its jump table.
+// ***************************************************************************
+static bool LoadMacroFile(const std::filesystem::path& macFilePath)
+{
+	MQMacroCache cache;
+	const bool fromCache = gbMacroCache && LoadMacroCache(macFilePath, cache);
 
-	if (gMacroBlock && !gMacroBlock->Line.empty())
+	FILE* fMacro = nullptr;
+	if (!fromCache)
 	{
-		gReturn = false;
-		EndMacro(pChar, szLine);
-		gReturn = true;
-	}
+		fMacro = _fsopen(macFilePath.string().c_str(), "rt", _SH_DENYNO);
 
-	if (CXWnd* pWnd = FindMQ2Window("RunningMacrosWindow"))
-	{
-		if (CListWnd * list = (CListWnd*)pWnd->GetChildItem("RMW_RunningMacrosList"))
+		if (fMacro == nullptr)
 		{
-			list->DeleteAll();
+			FatalError("Couldn't open macro file: %s", macFilePath.string().c_str());
+			return false;
 		}
 	}
 
-	gBindInProgress = true; // we dont want people to use binds until the macro is read.
-
-	// we get ourself a new block, this will be valid until the macro ends.
-	gMacroBlock = AddMacroBlock(szLine);
-
-	gMaxTurbo = 80;
-	gTurbo = true;
+	DebugSpew("Macro - Loading macro: %s", macFilePath.string().c_str());
 
 	char szTemp[MAX_STRING] = { 0 };
-	GetArg(szTemp, szLine, 1);
-	const char* Params = GetNextArg(szLine);
-
-	strcpy_s(gszMacroName, szTemp);
+	bool InBlockComment = false;
+	int LineIndex = 0;
+	int LocalLine = 0;
+	gMacroSubLookupMap.clear();
 
-	if (!strstr(szTemp, ".")) strcat_s(szTemp, ".mac");
+	// Defines only apply to the macro they are loaded with.
+	SCOPE_EXIT(ClearMacroDefines());
 
-	std::filesystem::path macFilePath = szTemp;
+	const std::string strMacroName = macFilePath.filename().string();
 
-	if (macFilePath.is_relative())
+	if (fromCache)
 	{
-		macFilePath = mq::internal_paths::Macros / macFilePath;
-	}
+		DebugSpew("Macro - Loading %d lines from the macro cache", static_cast<int>(cache.Lines.size()));
 
-	FILE* fMacro = _fsopen(macFilePath.string().c_str(), "rt", _SH_DENYNO);
+		for (const MQMacroCache::Line& line : cache.Lines)
+		{
+			strcpy_s(szTemp, line.Text.c_str());
+			LineIndex++;
 
-	if (fMacro == nullptr)
+			if (!AddMacroLine(cache.Files[line.FileIndex].c_str(), szTemp, MAX_STRING, &LineIndex, line.LineNumber))
+			{
+				MacroError("Unable to add macro line.");
+				return false;
+			}
+		}
+	}
+	else if (gbMacroCache)
 	{
-		FatalError("Couldn't open macro file: %s", macFilePath.string().c_str());
-		gszMacroName[0] = 0;
-		gRunning = 0;
-		return;
+		cache.AddDependency(macFilePath);
+		s_macroCacheRecording = &cache;
 	}
+	SCOPE_EXIT(s_macroCacheRecording = nullptr);
 
-	gEventChat = 0;
-	strcpy_s(gszMacroName, szTemp);
-	DebugSpew("Macro - Loading macro: %s", macFilePath.string().c_str());
-
-	int LineIndex = 0;
-	int LocalLine = 0;
-	gMacroSubLookupMap.clear();
-
-	const std::string strMacroName = macFilePath.filename().string();
-
-	while (!feof(fMacro))
+	while (fMacro && !feof(fMacro))
 	{
 		fgets(szTemp, MAX_STRING, fMacro);
 		CleanMacroLine(szTemp);
@@ -1071,31 +1488,116 @@ void Macro(PlayerClient* pChar, const char* szLine)
 			{
 				MacroError("Unable to add macro line.");
 				fclose(fMacro);
-
-				gszMacroName[0] = 0;
-				gRunning = 0;
-				return;
+				return false;
 			}
 		}
 		else
 		{
 			DebugSpew("Macro - BlockComment: %s", szTemp);
 
-			if (!strncmp(&szTemp[strlen(szTemp) - 3], "**|", 3))
-			{
-				InBlockComment = false;
-			}
-		}
-	}
+			if (!strncmp(&szTemp[strlen(szTemp) - 3], "**|", 3))
+			{
+				InBlockComment = false;
+			}
+		}
+	}
+
+	if (fMacro)
+		fclose(fMacro);
+
+	if (s_macroCacheRecording)
+	{
+		s_macroCacheRecording = nullptr;
+		SaveMacroCache(macFilePath, cache);
+	}
+
+	// An error can end the macro while it is loading.
+	if (!gMacroBlock)
+		return false;
+
+	BuildMacroJumpTable(*gMacroBlock);
+	return true;
+}
+
+static std::filesystem::path GetMacroFilePath(char* szFileName, size_t Length)
+{
+	if (!strstr(szFileName, ".")) strcat_s(szFileName, Length, ".mac");
+
+	std::filesystem::path macFilePath = szFileName;
+
+	if (macFilePath.is_relative())
+	{
+		macFilePath = mq::internal_paths::Macros / macFilePath;
+	}
+
+	return macFilePath;
+}
+
+// ***************************************************************************
+// Function:    Macro
+// Description: Our '/macro' command
+// Usage:       /macro <filename>
+// ***************************************************************************
+void Macro(PlayerClient* pChar, const char* szLine)
+{
+	if (szLine[0] == 0)
+	{
+		SyntaxError("Usage: /macro <filename> [param [param...]]");
+		return;
+	}
+
+	if (gMacroBlock && gMacroBlock->Background)
+	{
+		MacroError("/macro can't be used from a background macro.");
+		return;
+	}
+
+	gWarning = false;
+	bRunNextCommand = true;
+
+	MQMacroBlockPtr pBlock = GetMacroBlock(szLine);
+
+	if (gMacroBlock && !gMacroBlock->Lines.empty())
+	{
+		gReturn = false;
+		EndMacro(pChar, szLine);
+		gReturn = true;
+	}
+
+	if (CXWnd* pWnd = FindMQ2Window("RunningMacrosWindow"))
+	{
+		if (CListWnd * list = (CListWnd*)pWnd->GetChildItem("RMW_RunningMacrosList"))
+		{
+			list->DeleteAll();
+		}
+	}
+
+	gBindInProgress = true; // we dont want people to use binds until the macro is read.
+
+	// we get ourself a new block, this will be valid until the macro ends.
+	gMacroBlock = AddMacroBlock(szLine);
+
+	gMaxTurbo = 80;
+	gTurbo = true;
+
+	char szTemp[MAX_STRING] = { 0 };
+	GetArg(szTemp, szLine, 1);
+	const char* Params = GetNextArg(szLine);
+
+	strcpy_s(gszMacroName, szTemp);
+
+	const std::filesystem::path macFilePath = GetMacroFilePath(szTemp, MAX_STRING);
 
-	fclose(fMacro);
+	gEventChat = 0;
+	strcpy_s(gszMacroName, szTemp);
 
-	while (pDefines)
-	{
-		MQDefine* pDef = pDefines->pNext;
-		delete pDefines;
+	const std::string strMacroName = macFilePath.filename().string();
 
-		pDefines = pDef;
+	if (!LoadMacroFile(macFilePath))
+	{
+		gszMacroName[0] = 0;
+		gRunning = 0;
+		return;
 	}
 
 	strcpy_s(szTemp, "Main");
@@ -1118,11 +1620,9 @@ void Macro(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
-	auto iter = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-	if (iter != gMacroBlock->Line.end())
+	if (gMacroBlock->HasLine(gMacroBlock->CurrIndex))
 	{
-		std::advance(iter, 1);
-		gMacroBlock->CurrIndex = iter->first;
+		gMacroBlock->CurrIndex++;
 	}
 
 	if (!gMacroBlock || !gMacroStack)
@@ -1146,6 +1646,119 @@ void Macro(PlayerClient* pChar, const char* szLine)
 	}
 }
 
+// ***************************************************************************
+// Function:    BackgroundMacro
+// Description: Our '/bgmacro' command
+//              Runs a macro alongside the one started with /macro. Background macros have
+//              their own stack, /delay and #turbo budget, and take turns running after the
+//              foreground macro every frame. They share outer variables, events and binds
+//              with the foreground macro, so they can't declare outer variables or use
+//              #event, #bind or #chat.
+// Usage:       /bgmacro <filename> [param [param...]]
+//              /bgmacro end <filename|all>
+//              /bgmacro list
+// ***************************************************************************
+void BackgroundMacro(PlayerClient* pChar, const char* szLine)
+{
+	char szArg[MAX_STRING] = { 0 };
+	GetArg(szArg, szLine, 1);
+
+	if (szArg[0] == 0)
+	{
+		SyntaxError("Usage: /bgmacro <filename> [param [param...]], /bgmacro end <filename|all>, /bgmacro list");
+		return;
+	}
+
+	if (!_stricmp(szArg, "list"))
+	{
+		if (s_backgroundMacros.empty())
+		{
+			WriteChatColor("No background macros are running.", USERCOLOR_DEFAULT);
+			return;
+		}
+
+		for (const MQMacroBlockPtr& pBlock : s_backgroundMacros)
+		{
+			WriteChatf("Background macro: \ay%s\ax%s", pBlock->Name.c_str(), pBlock->Paused ? " (paused)" : "");
+		}
+		return;
+	}
+
+	if (!_stricmp(szArg, "end"))
+	{
+		GetArg(szArg, szLine, 2);
+
+		if (!_stricmp(szArg, "all"))
+		{
+			EndBackgroundMacros();
+		}
+		else if (MQMacroBlockPtr pBlock = FindBackgroundMacro(szArg))
+		{
+			EndBackgroundMacro(pBlock);
+		}
+		else
+		{
+			MacroError("No background macro named %s is running.", szArg);
+		}
+		return;
+	}
+
+	if (FindBackgroundMacro(szArg))
+	{
+		MacroError("Background macro %s is already running.", szArg);
+		return;
+	}
+
+	auto pBlock = std::make_shared<MQMacroBlock>(szArg);
+	pBlock->Background = true;
+	s_backgroundMacros.push_back(pBlock);
+
+	// Everything from here on works on the state of the new macro.
+	MQBackgroundMacroScope scope(pBlock);
+
+	bRunNextCommand = true;
+	const char* Params = GetNextArg(szLine);
+
+	char szTemp[MAX_STRING] = { 0 };
+	strcpy_s(szTemp, szArg);
+
+	const std::filesystem::path macFilePath = GetMacroFilePath(szTemp, MAX_STRING);
+	strcpy_s(gszMacroName, szTemp);
+
+	if (!LoadMacroFile(macFilePath))
+	{
+		if (gMacroBlock == pBlock)
+			EndRunningBackgroundMacro();
+		return;
+	}
+
+	strcpy_s(szTemp, "Main");
+	if (Params[0] != 0)
+	{
+		strcat_s(szTemp, " ");
+		strcat_s(szTemp, Params);
+	}
+
+	DebugSpew("BackgroundMacro - Starting macro with '/call %s'", szTemp);
+	Call(pChar, szTemp);
+
+	if (gMacroBlock != pBlock || !gMacroStack)
+	{
+		if (gMacroBlock == pBlock)
+			EndRunningBackgroundMacro();
+
+		MacroError("Not a valid macrofile %s no Sub Main found.", macFilePath.filename().string().c_str());
+		return;
+	}
+
+	if (pBlock->HasLine(pBlock->CurrIndex))
+	{
+		pBlock->CurrIndex++;
+	}
+
+	gRunning = MQGetTickCount64();
+}
+
 // ***************************************************************************
 // Function:    Cleanup
 // Description: Our '/cleanup' command
@@ -1209,48 +1822,45 @@ void Goto(PlayerClient* pChar, const char* szLine)
 	bRunNextCommand = true;
 	int FromIndex = gMacroBlock->CurrIndex;
 
-	const auto goto_line = gMacroBlock->Line.find(FromIndex);
-	if (goto_line->second.LoopEnd)
+	MQMacroLine& goto_line = gMacroBlock->GetLine(FromIndex);
+	if (goto_line.LoopEnd)
 	{
-		gMacroBlock->CurrIndex = goto_line->second.LoopEnd;
+		gMacroBlock->CurrIndex = goto_line.LoopEnd;
 		return;
 	}
 
-	std::map<int, MQMacroLine>::reverse_iterator ri(goto_line);
-
-	// search up first we only search until we find a "Sub "
-	for (; ri != gMacroBlock->Line.rend(); ri++)
+	// Labels were collected when the macro was loaded.
+	auto labelIter = gMacroBlock->Labels.find(MQMacroBlock::GetLabelKey(goto_line.SubIndex, szLine));
+	if (labelIter != gMacroBlock->Labels.end())
 	{
-		if (!_strnicmp(ri->second.Command.c_str(), "Sub ", 4))
-		{
-			ri--;
-			FromIndex = ri->first;
-			break;
-		}
+		// The nearest label above the /goto wins, otherwise the first one below it.
+		const std::vector<int>& labelLines = labelIter->second;
+		auto below = std::lower_bound(labelLines.begin(), labelLines.end(), FromIndex);
+		const int labelIndex = below != labelLines.begin() ? *(below - 1) : labelLines.front();
 
-		if (!_stricmp(szLine, ri->second.Command.c_str()))
-		{
-			// Label found....
-			gMacroBlock->CurrIndex = ri->first;
-			goto_line->second.LoopEnd = ri->first;
-			return;
-		}
+		gMacroBlock->CurrIndex = labelIndex;
+		goto_line.LoopEnd = labelIndex;
+		return;
 	}
 
-	// now that we found our start lets look forward for the goto label:
-	for (auto iter = gMacroBlock->Line.find(FromIndex); iter != gMacroBlock->Line.end(); iter++)
+	if (szLine[0] != ':')
 	{
-		if (!_strnicmp(iter->second.Command.c_str(), "Sub ", 4))
-		{
-			break;
-		}
+		// Not a label, so it wasn't collected. Look for a line that matches it in this sub.
+		int index = goto_line.SubIndex + 1;
 
-		if (!_stricmp(szLine, iter->second.Command.c_str()))
+		for (; index <= gMacroBlock->GetLastIndex(); ++index)
 		{
-			// Label found
-			gMacroBlock->CurrIndex = iter->first;
-			goto_line->second.LoopEnd = iter->first;
-			return;
+			const MQMacroLine& line = gMacroBlock->GetLine(index);
+
+			if (line.SubIndex != goto_line.SubIndex)
+				break;
+
+			if (!_stricmp(szLine, line.Command.c_str()))
+			{
+				gMacroBlock->CurrIndex = index;
+				goto_line.LoopEnd = index;
+				return;
+			}
 		}
 	}
 
@@ -1259,13 +1869,12 @@ void Goto(PlayerClient* pChar, const char* szLine)
 
 char* GetSubFromLine(int Line, char* szSub, size_t Sublen)
 {
-	std::map<int, MQMacroLine>::reverse_iterator ri(gMacroBlock->Line.find(Line));
-
-	for (; ri != gMacroBlock->Line.rend(); ri++)
+	if (gMacroBlock->HasLine(Line))
 	{
-		if (!_strnicmp(ri->second.Command.c_str(), "sub ", 4))
+		const int subIndex = gMacroBlock->GetLine(Line).SubIndex;
+		if (subIndex != 0)
 		{
-			strcpy_s(szSub, Sublen, ri->second.Command.c_str() + 4);
+			strcpy_s(szSub, Sublen, gMacroBlock->GetLine(subIndex).Command.c_str() + 4);
 			return szSub;
 		}
 	}
@@ -1283,11 +1892,9 @@ void DumpStack(PlayerClient* pChar, const char* szLine)
 	{
 		const MQMacroLine* ml = nullptr;
 
-		auto lineIter = gMacroBlock->Line.find(pMS->LocationIndex);
-
-		if (lineIter != gMacroBlock->Line.end())
+		if (gMacroBlock->HasLine(pMS->LocationIndex))
 		{
-			ml = &lineIter->second;
+			ml = &gMacroBlock->GetLine(pMS->LocationIndex);
 		}
 
 		char szTemp[MAX_STRING] = { 0 };
@@ -1332,9 +1939,20 @@ void EndMacro(PlayerClient* pChar, const char* szLine)
 		}
 	}
 
+	// A background macro ending from /endmacro, /return in Sub Main or an error. It can only end itself.
+	if (gMacroBlock && gMacroBlock->Background)
+	{
+		if (MacroName[0] && _stricmp(MacroName, gMacroBlock->Name.c_str()) != 0)
+		{
+			MacroError("A background macro can only end itself, use /bgmacro end to end other background macros.");
+			return;
+		}
+
+		EndRunningBackgroundMacro();
+		return;
+	}
+
 	gWarning = false;
-	MQMacroStack* pStack = nullptr;
-	MQEventQueue* pEvent = nullptr;
 	MQEventList* pEventL = nullptr;
 	MQBindList* pBindL = nullptr;
 
@@ -1350,11 +1968,11 @@ void EndMacro(PlayerClient* pChar, const char* szLine)
 	strcpy_s(MacroName, pBlock->Name.c_str());
 
 	// Code allowing for a routine for "OnExit"
-	for (auto i = pBlock->Line.begin(); i != pBlock->Line.end(); ++i)
+	for (int index = 1; index <= pBlock->GetLastIndex(); ++index)
 	{
-		if (!_strnicmp(i->second.Command.c_str(), ":OnExit", 7))
+		if (!_strnicmp(pBlock->GetLine(index).Command.c_str(), ":OnExit", 7))
 		{
-			pBlock->CurrIndex = i->first;
+			pBlock->CurrIndex = index;
 			// Force unpause to finish processing
 			pBlock->Paused = false;
 			// Return to the macro the first time around
@@ -1371,8 +1989,8 @@ void EndMacro(PlayerClient* pChar, const char* szLine)
 					// Save the next pointer before deleting the current stack item
 					MQMacroStack* pNext = gMacroStack->pNext;
 
-					// Delete the current stack item
-					delete gMacroStack;
+					// Release the current stack item
+					ReleaseMacroStack(gMacroStack);
 
 					// Move to the next item in the stack
 					gMacroStack = pNext;
@@ -1398,81 +2016,17 @@ void EndMacro(PlayerClient* pChar, const char* szLine)
 	// reset for next time
 	gReturn = true;
 
-#ifdef MQ2_PROFILING
-	// How many performance counters in 1 second?
-	LARGE_INTEGER PerformanceFrequency;
-	QueryPerformanceCounter(&PerformanceFrequency);
-
-	char Filename[MAX_STRING] = { 0 };
-	FILE* fMacro = NULL;
-	for (auto i = pBlock->Line.begin(); i != pBlock->Line.end(); i++) {
-		// Is this a different macro file?
-		if (strcmp(Filename, i->second.SourceFile.c_str())) {
-			// Close existing file
-			if (fMacro) {
-				fclose(fMacro);
-			}
-			// Open new profiling log file
-			strcpy_s(Filename, i->second.SourceFile.c_str());
-			sprintf_s(Buffer, "%s\\%s.mqp", gszMacroPath, Filename);
-			fMacro = _fsopen(Buffer, "w", _SH_DENYWR);
-			if (fMacro) {
-				fprintf(fMacro, " Execute |  Total   | Avg uSec | Line | Macro Source Code\n");
-				fprintf(fMacro, " Count   |   uSec   | Per 1000 |\n");
-				fprintf(fMacro, "------------------------------------------------------------------------------------------------------------- \n");
-			}
-		}
-
-		// Log execution/profiling information.  Output format is:
-		// Execution Count | Microseconds | Line # | Macro Source
-		if (fMacro) {
-			DWORD count = i->second.ExecutionCount;
-			DWORD total = (DWORD)(i->second.ExecutionTime * 1000000 / PerformanceFrequency.QuadPart);
-			DWORD avg = 0;
-			if (count > 0) {
-				avg = total * 1000 / count;
-			}
-			fprintf(fMacro, "%8lu | %8lu | %8lu | %4lu | %s\n",
-				count,
-				total,
-				avg,
-				i->second.LineNumber,
-				i->second.Command.c_str());
-		}
-	}
-	// Close existing file
-	if (fMacro) {
-		fclose(fMacro);
-	}
-#endif
+	MacroProfiler_MacroEnded(*pBlock);
 
 	RemoveMacroBlock(pBlock->Name);
 
 	gMacroBlock = nullptr;
-	while (gMacroStack)
-	{
-		pStack = gMacroStack->pNext;
-
-		if (gMacroStack->LocalVariables)
-			ClearMQ2DataVariables(&gMacroStack->LocalVariables);
-
-		if (gMacroStack->Parameters)
-			ClearMQ2DataVariables(&gMacroStack->Parameters);
-
-		delete gMacroStack;
-		gMacroStack = pStack;
-	}
+	ClearMacroStack();
 
 	gMacroSubLookupMap.clear();
 	gUndeclaredVars.clear();
 
-	while (gEventQueue)
-	{
-		pEvent = gEventQueue->pNext;
-		delete gEventQueue;
-
-		gEventQueue = pEvent;
-	}
+	ClearEventQueue();
 
 	while (pEventList)
 	{
@@ -1556,6 +2110,49 @@ static int GetNumArgsFromSub(const std::string& Sub)
 	return 0;
 }
 
+static const MQSubSignature& GetSubSignature(MQMacroLine& subLine)
+{
+	if (!subLine.Signature)
+	{
+		auto signature = std::make_shared<MQSubSignature>();
+
+		char szParamName[MAX_STRING] = { 0 };
+		char szParamType[MAX_STRING] = { 0 };
+		const int numArgs = GetNumArgsFromSub(subLine.Command);
+
+		for (int i = 0; i < numArgs; ++i)
+		{
+			GetFuncParam(subLine.Command.c_str(), i, szParamName, MAX_STRING, szParamType, MAX_STRING);
+			signature->Parameters.push_back({ szParamName, szParamType });
+		}
+
+		subLine.Signature = std::move(signature);
+	}
+
+	return *subLine.Signature;
+}
+
+MQ2Type* GetSubParameter(MQMacroLine& subLine, int index, std::string& name)
+{
+	const MQSubSignature& signature = GetSubSignature(subLine);
+
+	MQ2Type* pType = nullptr;
+	if (index >= 0 && index < static_cast<int>(signature.Parameters.size()))
+	{
+		const MQSubSignature::Parameter& param = signature.Parameters[index];
+		name = param.Name;
+
+		// Types are looked up every time, they can come and go with plugins.
+		pType = pDataAPI->FindDataType(param.TypeName.c_str());
+	}
+	else
+	{
+		name = fmt::format("Param{}", index);
+	}
+
+	return pType ? pType : datatypes::pStringType;
+}
+
 // ***************************************************************************
 // Function:    Call
 // Description: Our '/call' command
@@ -1569,7 +2166,7 @@ void Call(PlayerClient*, const char* szLine)
 		return;
 	}
 
-	if (!gMacroBlock || (gMacroBlock && gMacroBlock->Line.empty()))
+	if (!gMacroBlock || (gMacroBlock && gMacroBlock->Lines.empty()))
 	{
 		MacroError("Cannot call when a macro isn't running.");
 		return;
@@ -1592,7 +2189,7 @@ void Call(PlayerClient*, const char* szLine)
 	int MacroLine = iter->second;
 
 	// Prep to call the Sub
-	MQMacroStack* pStack = new MQMacroStack(MacroLine);
+	MQMacroStack* pStack = AllocateMacroStack(MacroLine);
 
 	gMacroBlock->CurrIndex = MacroLine;
 	if (gMacroStack && gMacroBlock->BindStackIndex != -1)
@@ -1621,28 +2218,21 @@ void Call(PlayerClient*, const char* szLine)
 	pStack->pNext = gMacroStack;
 	gMacroStack = pStack;
 
-	MQMacroLine& ml = gMacroBlock->Line.at(MacroLine);
-	int numsubargs = GetNumArgsFromSub(ml.Command);
+	MQMacroLine& ml = gMacroBlock->GetLine(MacroLine);
+	const int numsubargs = static_cast<int>(GetSubSignature(ml).Parameters.size());
 
 	if (SubParam[0] != 0 || numsubargs)
 	{
-		// FIXME: These don't need to all be 2k bytes long...
-		char szParamName[MAX_STRING] = { 0 };
-		char szParamType[MAX_STRING] = { 0 };
 		char szNewValue[MAX_STRING] = { 0 };
-		auto name = &ml.Command[0];
+		std::string paramName;
 
 		for (int StackNum = 0; StackNum < numsubargs || SubParam[0] != '\0'; StackNum++)
 		{
 			GetArg(szNewValue, SubParam, 1);
 
-			GetFuncParam(name, StackNum, szParamName, MAX_STRING, szParamType, MAX_STRING);
+			MQ2Type* pType = GetSubParameter(ml, StackNum, paramName);
 
-			MQ2Type* pType = pDataAPI->FindDataType(szParamType);
-			if (!pType)
-				pType = datatypes::pStringType;
-
-			AddMQ2DataVariable(szParamName, "", pType, &gMacroStack->Parameters, szNewValue);
+			AddMQ2DataVariable(paramName.c_str(), "", pType, &gMacroStack->Parameters, szNewValue);
 			SubParam = GetNextArg(SubParam);
 		}
 	}
@@ -1656,6 +2246,8 @@ void Call(PlayerClient*, const char* szLine)
 	}
 }
 
+static void RunIfCommand(PlayerClient* pChar, double Result, const char* pEnd);
+
 void MacroIfCmd(PlayerClient* pChar, const char* szLine)
 {
 	if (szLine[0] != '(')
@@ -1708,6 +2300,11 @@ void MacroIfCmd(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
+	RunIfCommand(pChar, Result, pEnd);
+}
+
+static void RunIfCommand(PlayerClient* pChar, double Result, const char* pEnd)
+{
 	if (Result != 0)
 	{
 		if (gParserVersion == 2)
@@ -1731,7 +2328,7 @@ void MacroIfCmd(PlayerClient* pChar, const char* szLine)
 	{
 		int index = 0;
 
-		if (gMacroBlock && !gMacroBlock->Line.empty())
+		if (gMacroBlock && !gMacroBlock->Lines.empty())
 			index = gMacroBlock->CurrIndex;
 
 		FailIf(pChar, pEnd, index);
@@ -1754,7 +2351,7 @@ static void PushMacroLoop(const MQLoop& loop)
 
 static void EndWhile()
 {
-	gMacroBlock->CurrIndex = gMacroBlock->Line.at(gMacroBlock->CurrIndex).LoopEnd;
+	gMacroBlock->CurrIndex = gMacroBlock->GetLine(gMacroBlock->CurrIndex).LoopEnd;
 	bRunNextCommand = true;
 }
 
@@ -1764,34 +2361,36 @@ static void MarkWhile(const char* szCommand, MQLoop& loop)
 	{
 		loop.type = MQLoop::Type::While;
 
-		auto lineIter = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-		if (lineIter->second.LoopStart && lineIter->second.LoopEnd)
+		// Normally resolved by BuildMacroJumpTable when the macro was loaded
+		const int currentIndex = gMacroBlock->CurrIndex;
+		MQMacroLine& currentLine = gMacroBlock->GetLine(currentIndex);
+		if (currentLine.LoopStart && currentLine.LoopEnd)
 		{
-			loop.firstLine = lineIter->second.LoopStart;
-			loop.lastLine = lineIter->second.LoopEnd;
+			loop.firstLine = currentLine.LoopStart;
+			loop.lastLine = currentLine.LoopEnd;
 			return;
 		}
 
-		const auto currentLine = lineIter;
-		--lineIter;
-		currentLine->second.LoopStart = lineIter->first;
-		loop.firstLine = lineIter->first;
-		++lineIter;
+		currentLine.LoopStart = currentIndex - 1;
+		loop.firstLine = currentIndex - 1;
 		int Scope = 1;
 
-		while (++lineIter != gMacroBlock->Line.end())
+		int index = currentIndex;
+		while (++index <= gMacroBlock->GetLastIndex())
 		{
-			if (lineIter->second.Command[0] == '}')
+			const std::string& command = gMacroBlock->GetLine(index).Command;
+
+			if (command[0] == '}')
 			{
 				--Scope;
 				if (Scope == 0) break;
 			}
 
-			if (lineIter->second.Command[lineIter->second.Command.size() - 1] == '{')
+			if (command[command.size() - 1] == '{')
 			{
 				++Scope;
 			}
-			else if (!_strnicmp(lineIter->second.Command.c_str(), "sub ", 4))
+			else if (!_strnicmp(command.c_str(), "sub ", 4))
 			{
 				FatalError("{} pairing ran into anther subroutine");
 				return;
@@ -1804,9 +2403,9 @@ static void MarkWhile(const char* szCommand, MQLoop& loop)
 			return;
 		}
 
-		lineIter->second.LoopStart = loop.firstLine;
-		loop.lastLine = lineIter->first;
-		currentLine->second.LoopEnd = lineIter->first;
+		gMacroBlock->GetLine(index).LoopStart = loop.firstLine;
+		loop.lastLine = index;
+		currentLine.LoopEnd = index;
 	}
 	else
 	{
@@ -1821,6 +2420,8 @@ static void MarkWhile(const char* szCommand, MQLoop& loop)
 //                   ....
 //              }
 // ***************************************************************************
+static void RunWhileCommand(double Result, const char* pEnd);
+
 void MacroWhileCmd(PlayerClient* pChar, const char* szLine)
 {
 	char szCond[MAX_STRING] = { 0 };
@@ -1874,6 +2475,11 @@ void MacroWhileCmd(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
+	RunWhileCommand(Result, pEnd);
+}
+
+static void RunWhileCommand(double Result, const char* pEnd)
+{
 	// lets check all the lines within it
 	// and mark the end so the interpreter knows when to exit it
 	MQLoop loop;
@@ -1888,6 +2494,54 @@ void MacroWhileCmd(PlayerClient* pChar, const char* szLine)
 		EndWhile();
 }
 
+// ***************************************************************************
+// Function:    RunCompiledCondition
+// Description: Runs an /if or /while line whose condition was compiled when the macro
+//              was loaded. Only the command of an /if that passes is parsed. Returns
+//              false if the line needs to go through its command handler instead.
+// ***************************************************************************
+bool RunCompiledCondition(MQMacroLine& line)
+{
+	double Result = 0;
+
+	switch (EvaluateCompiledCalculation(*line.Condition, Result))
+	{
+	case CalculateResult::NotNumeric:
+		return false;
+
+	case CalculateResult::Failure:
+	{
+		const std::string_view condition = std::string_view{ line.Command }.substr(
+			line.ArgumentOffset, line.ConditionEnd - line.ArgumentOffset - 1);
+
+		FatalError("Failed to parse %s condition '%.*s', non-numeric encountered", line.CommandName.c_str(),
+			static_cast<int>(condition.size()), condition.data());
+		return true;
+	}
+
+	case CalculateResult::Success:
+	default:
+		break;
+	}
+
+	char szCommand[MAX_STRING] = { 0 };
+	strcpy_s(szCommand, line.Command.c_str() + line.ConditionEnd);
+
+	if (ci_equals(line.CommandName, "/while"))
+	{
+		RunWhileCommand(Result, szCommand);
+	}
+	else
+	{
+		if (Result != 0)
+			ParseMacroParameter(szCommand);
+
+		RunIfCommand(pLocalPlayer, Result, szCommand);
+	}
+
+	return true;
+}
+
 // ***************************************************************************
 // Function:    DoEvents
 // Description: Our '/doevents' command
@@ -1895,7 +2549,8 @@ void MacroWhileCmd(PlayerClient* pChar, const char* szLine)
 // ***************************************************************************
 void DoEvents(PlayerClient* pChar, const char* szLine)
 {
-	if (!gEventQueue || !gMacroStack)
+	// Events belong to the foreground macro.
+	if (!gEventQueue || !gMacroStack || (gMacroBlock && gMacroBlock->Background))
 		return;
 
 	char Arg1[MAX_STRING] = { 0 };
@@ -1916,20 +2571,18 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 			{
 				if ((pEvent->Type == EVENT_CHAT && !_stricmp("Sub Event_Chat", szSub))
 					|| (pEvent->Type == EVENT_TIMER && !_stricmp("Sub Event_Timer", szSub))
+					|| (pEvent->Type == EVENT_TASKPROGRESS && !_stricmp("Sub Event_TaskProgress", szSub))
+					|| (pEvent->Type == EVENT_SPAWNTRIGGER && !_stricmp("Sub Event_SpawnTrigger", szSub))
+					|| (pEvent->Type == EVENT_BUFFCHANGE && !_stricmp("Sub Event_BuffChange", szSub))
+					|| (pEvent->Type == EVENT_CASTPHASE && !_stricmp("Sub Event_CastPhase", szSub))
+					|| (pEvent->Type == EVENT_PETMERCCHANGE && !_stricmp("Sub Event_PetMercChange", szSub))
 					|| (pEvent->Type == EVENT_CUSTOM && !_stricmp(pEvent->pEventList->szName, szSub)))
 				{
-					MQEventQueue* pEventNext;
-					if (pEventNext = pEvent->pNext)
-						pEventNext->pPrev = pEvent->pPrev;
-					if (pEvent->pPrev)
-						pEvent->pPrev->pNext = pEvent->pNext;
-					else
-						gEventQueue = pEvent->pNext;
-
-					ClearMQ2DataVariables(&pEvent->Parameters);
+					MQEventQueue* pEventNext = pEvent->pNext;
 					DebugSpewNoFile("Doevents: Deleting pEvent %d %s", pEvent->Type, pEvent->Name.c_str());
 
-					delete pEvent;
+					UnlinkEvent(pEvent);
+					ReleaseEvent(pEvent);
 					pEvent = pEventNext;
 
 					continue;
@@ -1940,16 +2593,8 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 		}
 		else
 		{
-			while (gEventQueue)
-			{
-				MQEventQueue* pEventNext = gEventQueue->pNext;
-
-				ClearMQ2DataVariables(&gEventQueue->Parameters);
-				DebugSpewNoFile("Doevents: Deleting gEventQueue %d %s", gEventQueue->Type, gEventQueue->Name.c_str());
-
-				delete gEventQueue;
-				gEventQueue = pEventNext;
-			}
+			DebugSpewNoFile("Doevents: Deleting gEventQueue");
+			ClearEventQueue();
 		}
 		return;
 	}
@@ -1971,6 +2616,11 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 		{
 			if ((pEvent->Type == EVENT_CHAT && !_stricmp("Sub Event_Chat", szSub))
 				|| (pEvent->Type == EVENT_TIMER && !_stricmp("Sub Event_Timer", szSub))
+				|| (pEvent->Type == EVENT_TASKPROGRESS && !_stricmp("Sub Event_TaskProgress", szSub))
+				|| (pEvent->Type == EVENT_SPAWNTRIGGER && !_stricmp("Sub Event_SpawnTrigger", szSub))
+				|| (pEvent->Type == EVENT_BUFFCHANGE && !_stricmp("Sub Event_BuffChange", szSub))
+				|| (pEvent->Type == EVENT_CASTPHASE && !_stricmp("Sub Event_CastPhase", szSub))
+				|| (pEvent->Type == EVENT_PETMERCCHANGE && !_stricmp("Sub Event_PetMercChange", szSub))
 				|| (pEvent->Type == EVENT_CUSTOM && !_stricmp(pEvent->pEventList->szName, szSub)))
 			{
 				break;
@@ -1983,12 +2633,7 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 			return;// no event found
 	}
 
-	if (pEvent->pPrev)
-		pEvent->pPrev->pNext = pEvent->pNext;
-	else
-		gEventQueue = pEvent->pNext;
-	if (pEvent->pNext)
-		pEvent->pNext->pPrev = pEvent->pPrev;
+	UnlinkEvent(pEvent);
 
 	DebugSpewNoFile("DoEvents: Running event type %d (%s) = 0x%p", pEvent->Type, (pEvent->pEventList) ? pEvent->pEventList->szName : "NONE", pEvent);
 
@@ -1996,15 +2641,14 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 	// /doevents again.
 
 	int locationIndex = 0;
-	auto lineIter = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-	if (lineIter != gMacroBlock->Line.end())
+	if (gMacroBlock->HasLine(gMacroBlock->CurrIndex))
 	{
-		lineIter--;
-		locationIndex = lineIter->first;
+		locationIndex = gMacroBlock->CurrIndex - 1;
 	}
 
-	MQMacroStack* pStack = new MQMacroStack(locationIndex);
+	MQMacroStack* pStack = AllocateMacroStack(locationIndex);
 	pStack->Parameters = pEvent->Parameters;
+	pEvent->Parameters = nullptr;
 
 	MQDataVar* pParam = pStack->Parameters;
 	while (pParam) // FIX THE HEAD ON EVERY VAR WE MOVED
@@ -2012,6 +2656,7 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 		pParam->ppHead = &pStack->Parameters;
 		pParam = pParam->pNext;
 	}
+	IndexMacroStackVariables(pStack);
 	pStack->pNext = gMacroStack;
 	gMacroStack = pStack;
 
@@ -2024,9 +2669,6 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 		gMacroBlock->CurrIndex = gEventFunc[pEvent->Type];
 	}
 
-	DebugSpewNoFile("DoEvents - Deleted event: %d %s", pEvent->Type, pEvent->Name.c_str());
-
-	delete pEvent;
 	bRunNextCommand = true;
 
 	if (g_pProfile)
@@ -2041,6 +2683,21 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 		case EVENT_TIMER:
 			eventName = "Event_Timer";
 			break;
+		case EVENT_TASKPROGRESS:
+			eventName = "Event_TaskProgress";
+			break;
+		case EVENT_SPAWNTRIGGER:
+			eventName = "Event_SpawnTrigger";
+			break;
+		case EVENT_BUFFCHANGE:
+			eventName = "Event_BuffChange";
+			break;
+		case EVENT_CASTPHASE:
+			eventName = "Event_CastPhase";
+			break;
+		case EVENT_PETMERCCHANGE:
+			eventName = "Event_PetMercChange";
+			break;
 		case EVENT_CUSTOM:
 			if (pEvent->pEventList)
 			{
@@ -2063,7 +2720,7 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 
 		while (parameters)
 		{
-			if (parameters->Var.Type->ToString(pParam->Var.VarPtr, szArg))
+			if (parameters->Var.Type->ToString(parameters->Var.VarPtr, szArg))
 				args.emplace_back(szArg);
 			else
 				args.emplace_back("NULL");
@@ -2073,6 +2730,10 @@ void DoEvents(PlayerClient* pChar, const char* szLine)
 
 		g_pProfile->Call(std::move(eventName), std::move(args));
 	}
+
+	DebugSpewNoFile("DoEvents - Deleted event: %d %s", pEvent->Type, pEvent->Name.c_str());
+
+	ReleaseEvent(pEvent);
 }
 
 // ***************************************************************************
@@ -2110,7 +2771,7 @@ void Return(PlayerClient* pChar, const char* szLine)
 	gMacroBlock->CurrIndex = pStack->pNext->LocationIndex;
 	gMacroStack = pStack->pNext;
 
-	delete pStack;
+	ReleaseMacroStack(pStack);
 
 	if (g_pProfile)
 	{
@@ -2176,6 +2837,19 @@ void For(PlayerClient* pChar, const char* szLine)
 	PushMacroLoop(loop);
 }
 
+// Reads the end or step of a /for loop, parsing it first if it has any ${} references.
+static int GetForLoopValue(const std::string& text, int defaultValue)
+{
+	if (text.find("${") == std::string::npos)
+		return GetIntFromString(text, defaultValue);
+
+	char szValue[MAX_STRING] = { 0 };
+	strcpy_s(szValue, text.c_str());
+	ParseMacroData(szValue, MAX_STRING);
+
+	return GetIntFromString(szValue, defaultValue);
+}
+
 // ***************************************************************************
 // Function:    Next
 // Description: Our '/next' command
@@ -2216,24 +2890,56 @@ void Next(PlayerClient* pChar, const char* szLine)
 
 	gMacroStack->loopStack[size - 1].lastLine = gMacroBlock->CurrIndex;
 	auto MacroLine = gMacroStack->loopStack[size - 1].firstLine;
-	auto iter = gMacroBlock->Line.find(MacroLine);
-
-	char ForLine[MAX_STRING];
-	strcpy_s(ForLine, iter->second.Command.c_str());
+	const MQMacroLine& forLine = gMacroBlock->GetLine(MacroLine);
 
-	ParseMacroData(ForLine, MAX_STRING);
-	int VarNum = GetIntFromString(&szLine[1], 0);
+	bool DownTo = false;
+	int Loop = 0;
 	int StepSize = 1;
 
-	int pos = ci_find_substr(ForLine, "step");
-	if (pos != -1)
+	if (forLine.ForLoop)
+	{
+		// Split up when the macro was loaded, only the references in the end and step are parsed.
+		DownTo = forLine.ForLoop->DownTo;
+		Loop = GetForLoopValue(forLine.ForLoop->End, 0);
+		if (!forLine.ForLoop->Step.empty())
+			StepSize = GetForLoopValue(forLine.ForLoop->Step, StepSize);
+	}
+	else
 	{
-		char* pTemp = ForLine + pos + 4;
+		char ForLine[MAX_STRING];
+		strcpy_s(ForLine, forLine.Command.c_str());
+
+		ParseMacroData(ForLine, MAX_STRING);
+
+		int pos = ci_find_substr(ForLine, "step");
+		if (pos != -1)
+		{
+			char* pTemp = ForLine + pos + 4;
+
+			while ((pTemp[0] != 0) && (pTemp[0] != ' ') && (pTemp[0] != '\t'))
+				pTemp++;
+			if (pTemp[0] != 0)
+				StepSize = GetIntFromString(pTemp, StepSize);
+		}
+
+		pos = ci_find_substr(ForLine, "downto");
+		if (pos != -1)
+		{
+			DownTo = true;
 
-		while ((pTemp[0] != 0) && (pTemp[0] != ' ') && (pTemp[0] != '\t'))
-			pTemp++;
-		if (pTemp[0] != 0)
-			StepSize = GetIntFromString(pTemp, StepSize);
+			char* pDest = ForLine + pos;
+			// TODO: This is easily broken, should search for the param rather than getting the specific point
+			Loop = GetIntFromString(&pDest[7], 0);
+		}
+		else
+		{
+			pos = ci_find_substr(ForLine, "to");
+			if (pos != -1)
+			{
+				char* pDest = ForLine + pos + 3;
+				Loop = GetIntFromString(pDest, 0);
+			}
+		}
 	}
 
 	pVar = FindMacroVariable(szNext);
@@ -2243,13 +2949,8 @@ void Next(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
-	pos = ci_find_substr(ForLine, "downto");
-	if (pos != -1)
+	if (DownTo)
 	{
-		char* pDest = ForLine + pos;
-		// TODO: This is easily broken, should search for the param rather than getting the specific point
-		auto Loop = GetIntFromString(&pDest[7], 0);
-
 		//DebugSpewNoFile("Next - End of loop %d downto %d", pVar->Var.Int, Loop);
 		pVar->Var.Int -= StepSize;
 		if (pVar->Var.Int >= Loop)
@@ -2263,15 +2964,6 @@ void Next(PlayerClient* pChar, const char* szLine)
 	}
 	else
 	{
-		auto Loop = 0;
-
-		pos = ci_find_substr(ForLine, "to");
-		if (pos != -1)
-		{
-			char* pDest = ForLine + pos + 3;
-			Loop = GetIntFromString(pDest, 0);
-		}
-
 		//DebugSpewNoFile("Next - End of loop %d to %d", pVar->Var.Int, Loop);
 		pVar->Var.Int += StepSize;
 
@@ -2314,16 +3006,22 @@ void Continue(PlayerClient* pChar, const char* szLine)
 	}
 	else if (loop.lastLine) // /for after 1st /next encountered
 	{
-		auto i = gMacroBlock->Line.find(loop.lastLine);
-		--i;
-		gMacroBlock->CurrIndex = i->first;
+		gMacroBlock->CurrIndex = loop.lastLine - 1;
+		return;
+	}
+
+	// The matching /next is usually known from when the macro was loaded
+	const int nextIndex = gMacroBlock->GetLine(loop.firstLine).LoopEnd;
+	if (nextIndex > gMacroBlock->CurrIndex)
+	{
+		loop.lastLine = nextIndex;
+		gMacroBlock->CurrIndex = nextIndex - 1;
 		return;
 	}
 
-	auto i = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-	while (++i != gMacroBlock->Line.end())
+	for (int index = gMacroBlock->CurrIndex + 1; index <= gMacroBlock->GetLastIndex(); ++index)
 	{
-		const char* line = i->second.Command.c_str();
+		const char* line = gMacroBlock->GetLine(index).Command.c_str();
 		if (!_strnicmp(line, "/next", 5))
 		{
 			char for_var[MAX_STRING];
@@ -2333,10 +3031,8 @@ void Continue(PlayerClient* pChar, const char* szLine)
 			if (_stricmp(for_var, loop.forVariable.c_str()))
 				continue;
 
-			loop.lastLine = i->first;
-			--i;
-
-			gMacroBlock->CurrIndex = i->first;
+			loop.lastLine = index;
+			gMacroBlock->CurrIndex = index - 1;
 			return;
 		}
 
@@ -2377,10 +3073,18 @@ void Break(PlayerClient* pChar, const char* szLine)
 		return;
 	}
 
-	auto i = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-	while (++i != gMacroBlock->Line.end())
+	// The matching /next is usually known from when the macro was loaded
+	const int nextIndex = gMacroBlock->GetLine(loop.firstLine).LoopEnd;
+	if (nextIndex > gMacroBlock->CurrIndex)
+	{
+		gMacroBlock->CurrIndex = nextIndex;
+		PopMacroLoop();
+		return;
+	}
+
+	for (int index = gMacroBlock->CurrIndex + 1; index <= gMacroBlock->GetLastIndex(); ++index)
 	{
-		const char* line = i->second.Command.c_str();
+		const char* line = gMacroBlock->GetLine(index).Command.c_str();
 		if (!_strnicmp(line, "/next", 5))
 		{
 			char for_var[MAX_STRING];
@@ -2390,8 +3094,8 @@ void Break(PlayerClient* pChar, const char* szLine)
 			if (_stricmp(for_var, loop.forVariable.c_str()))
 				continue;
 
-			gMacroBlock->CurrIndex = i->first;
-			loop.lastLine = i->first;;
+			gMacroBlock->CurrIndex = index;
+			loop.lastLine = index;
 			PopMacroLoop();
 
 			return;
@@ -19,6 +19,10 @@
 #include "MQCommandAPI.h"
 #include "MQDataAPI.h"
 #include "MQDetourAPI.h"
+#include "MQGameEvents.h"
+#include "MQRemoteQuery.h"
+#include "MQWarmUp.h"
+#include "MQSpawnTriggers.h"
 #include "MQRenderDoc.h"
 #include "MQ2KeyBinds.h"
 #include "MQPluginHandler.h"
@@ -166,6 +170,7 @@ void InitializeLogging()
 
 void ShutdownLogging()
 {
+	ShutdownDebugSpewLog();
 	eqlib::ShutdownLogging();
 	spdlog::shutdown();
 }
@@ -404,12 +409,25 @@ bool ParseINIFile(const std::string& iniFile)
 	bAllErrorsFatal          = GetPrivateProfileBool("MacroQuest", "AllErrorsFatal", bAllErrorsFatal, iniFile);
 	gbMQ2LoadingMsg          = GetPrivateProfileBool("MacroQuest", "MQ2LoadingMsg", gbMQ2LoadingMsg, iniFile);
 	gbExactSearchCleanNames  = GetPrivateProfileBool("MacroQuest", "ExactSearchCleanNames", gbExactSearchCleanNames, iniFile);
+	gbLazySpawnSort          = GetPrivateProfileBool("MacroQuest", "LazySpawnSort", gbLazySpawnSort, iniFile);
+	gbReadinessSnapshot      = GetPrivateProfileBool("MacroQuest", "ReadinessSnapshot", gbReadinessSnapshot, iniFile);
 	gUseTradeOnTarget        = GetPrivateProfileBool("MacroQuest", "UseTradeOnTarget", gUseTradeOnTarget, iniFile);
 	gbBeepOnTells            = GetPrivateProfileBool("MacroQuest", "BeepOnTells", gbBeepOnTells, iniFile);
 	gbFlashOnTells           = GetPrivateProfileBool("MacroQuest", "FlashOnTells", gbFlashOnTells, iniFile);
 	gbIgnoreAlertRecursion   = GetPrivateProfileBool("MacroQuest", "IgnoreAlertRecursion", gbIgnoreAlertRecursion, iniFile);
 	gbShowCurrentCamera      = GetPrivateProfileBool("MacroQuest", "ShowCurrentCamera", gbShowCurrentCamera, iniFile);
 	gTurboLimit              = GetPrivateProfileInt("MacroQuest", "TurboLimit", gTurboLimit, iniFile);
+	gbMacroCache             = GetPrivateProfileBool("MacroQuest", "MacroCache", gbMacroCache, iniFile);
+	gMaxQueuedEvents         = GetPrivateProfileInt("MacroQuest", "MaxQueuedEvents", gMaxQueuedEvents, iniFile); // 0 = unlimited
+	gMaxQueuedEventsPerEvent = GetPrivateProfileInt("MacroQuest", "MaxQueuedEventsPerEvent", gMaxQueuedEventsPerEvent, iniFile); // 0 = unlimited
+	gPluginPulseBudget       = GetPrivateProfileInt("MacroQuest", "PluginPulseBudget", gPluginPulseBudget, iniFile); // microseconds, 0 = none
+	gPluginCallbackBudget    = GetPrivateProfileInt("MacroQuest", "PluginCallbackBudget", gPluginCallbackBudget, iniFile); // microseconds, 0 = none
+	gPluginThrottleFrames    = GetPrivateProfileInt("MacroQuest", "PluginThrottleFrames", gPluginThrottleFrames, iniFile); // 0 = warn only
+	gbMemoryAccounting       = GetPrivateProfileBool("MacroQuest", "MemoryAccounting", gbMemoryAccounting, iniFile);
+	gbSlowExpressions        = GetPrivateProfileBool("MacroQuest", "SlowExpressions", gbSlowExpressions, iniFile);
+	gSlowExpressionThreshold = GetPrivateProfileInt("MacroQuest", "SlowExpressionThreshold", gSlowExpressionThreshold, iniFile); // microseconds
+	gbSharedMemoryRouting    = GetPrivateProfileBool("MacroQuest", "SharedMemoryRouting", gbSharedMemoryRouting, iniFile);
+	gbPeerRouting            = GetPrivateProfileBool("MacroQuest", "PeerRouting", gbPeerRouting, iniFile);
 	gCreateMQ2NewsWindow     = GetPrivateProfileBool("MacroQuest", "CreateMQ2NewsWindow", gCreateMQ2NewsWindow, iniFile);
 	gNetStatusXPos           = GetPrivateProfileInt("MacroQuest", "NetStatusXPos", gNetStatusXPos, iniFile);
 	gNetStatusYPos           = GetPrivateProfileInt("MacroQuest", "NetStatusYPos", gNetStatusYPos, iniFile);
@@ -439,12 +457,25 @@ bool ParseINIFile(const std::string& iniFile)
 		WritePrivateProfileBool("MacroQuest", "AllErrorsFatal", bAllErrorsFatal, iniFile);
 		WritePrivateProfileBool("MacroQuest", "MQ2LoadingMsg", gbMQ2LoadingMsg, iniFile);
 		WritePrivateProfileBool("MacroQuest", "ExactSearchCleanNames", gbExactSearchCleanNames, iniFile);
+		WritePrivateProfileBool("MacroQuest", "LazySpawnSort", gbLazySpawnSort, iniFile);
+		WritePrivateProfileBool("MacroQuest", "ReadinessSnapshot", gbReadinessSnapshot, iniFile);
 		WritePrivateProfileBool("MacroQuest", "UseTradeOnTarget", gUseTradeOnTarget, iniFile);
 		WritePrivateProfileBool("MacroQuest", "BeepOnTells", gbBeepOnTells, iniFile);
 		WritePrivateProfileBool("MacroQuest", "FlashOnTells", gbFlashOnTells, iniFile);
 		WritePrivateProfileBool("MacroQuest", "IgnoreAlertRecursion", gbIgnoreAlertRecursion, iniFile);
 		WritePrivateProfileBool("MacroQuest", "ShowCurrentCamera", gbShowCurrentCamera, iniFile);
 		WritePrivateProfileInt("MacroQuest", "TurboLimit", gTurboLimit, iniFile);
+		WritePrivateProfileBool("MacroQuest", "MacroCache", gbMacroCache, iniFile);
+		WritePrivateProfileInt("MacroQuest", "MaxQueuedEvents", gMaxQueuedEvents, iniFile);
+		WritePrivateProfileInt("MacroQuest", "MaxQueuedEventsPerEvent", gMaxQueuedEventsPerEvent, iniFile);
+		WritePrivateProfileInt("MacroQuest", "PluginPulseBudget", gPluginPulseBudget, iniFile);
+		WritePrivateProfileInt("MacroQuest", "PluginCallbackBudget", gPluginCallbackBudget, iniFile);
+		WritePrivateProfileInt("MacroQuest", "PluginThrottleFrames", gPluginThrottleFrames, iniFile);
+		WritePrivateProfileBool("MacroQuest", "MemoryAccounting", gbMemoryAccounting, iniFile);
+		WritePrivateProfileBool("MacroQuest", "SlowExpressions", gbSlowExpressions, iniFile);
+		WritePrivateProfileInt("MacroQuest", "SlowExpressionThreshold", gSlowExpressionThreshold, iniFile);
+		WritePrivateProfileBool("MacroQuest", "SharedMemoryRouting", gbSharedMemoryRouting, iniFile);
+		WritePrivateProfileBool("MacroQuest", "PeerRouting", gbPeerRouting, iniFile);
 		WritePrivateProfileBool("MacroQuest", "CreateMQ2NewsWindow", gCreateMQ2NewsWindow, iniFile);
 		WritePrivateProfileInt("MacroQuest", "NetStatusXPos", gNetStatusXPos, iniFile);
 		WritePrivateProfileInt("MacroQuest", "NetStatusYPos", gNetStatusYPos, iniFile);
@@ -1020,11 +1051,11 @@ void AddNewsLine(const char* Line, int inColor)
 
 	COLORREF color = pChatManager->GetRGBAFromIndex(inColor);
 
-	char szProcessed[MAX_STRING] = { 0 };
-	MQToSTML(szLine, szProcessed, MAX_STRING, color);
+	std::string processed;
+	MQToSTML(szLine, processed, color);
+	processed.append("<br>");
 
-	strcat_s(szProcessed, "<br>");
-	CXStr NewText(szProcessed);
+	CXStr NewText(processed);
 	ConvertItemTags(NewText, 0);
 
 	pNewsWindow->OutputBox->AppendSTML(NewText);
@@ -1215,6 +1246,79 @@ MQTopLevelObject* MainImpl::FindTopLevelObject(const char* name)
 	return pDataAPI->FindTopLevelObject(name);
 }
 
+int MainImpl::AddMacroDataObserver(
+	std::vector<std::string> strings,
+	MQMacroDataObserverCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	return pDataAPI->AddObserver(std::move(strings), std::move(callback), pluginHandle);
+}
+
+bool MainImpl::RemoveMacroDataObserver(
+	int observerId,
+	const MQPluginHandle& pluginHandle)
+{
+	return pDataAPI->RemoveObserver(observerId, pluginHandle);
+}
+
+int MainImpl::AddGameEventObserver(
+	MQGameEvent event,
+	MQGameEventCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	return GameEvents_AddObserver(event, std::move(callback), pluginHandle);
+}
+
+bool MainImpl::RemoveGameEventObserver(
+	int observerId,
+	const MQPluginHandle& pluginHandle)
+{
+	return GameEvents_RemoveObserver(observerId, pluginHandle);
+}
+
+int MainImpl::AddWarmUpTask(
+	const char* name,
+	MQWarmUpStep step,
+	const MQPluginHandle& pluginHandle)
+{
+	return WarmUp_AddTask(name, std::move(step), pluginHandle);
+}
+
+bool MainImpl::RemoveWarmUpTask(
+	int taskId,
+	const MQPluginHandle& pluginHandle)
+{
+	return WarmUp_RemoveTask(taskId, pluginHandle);
+}
+
+bool MainImpl::IsWarmUpTaskReady(
+	int taskId) const
+{
+	return WarmUp_IsTaskReady(taskId);
+}
+
+bool MainImpl::IsWarmUpComplete() const
+{
+	return WarmUp_IsComplete();
+}
+
+int MainImpl::AddSpawnTrigger(
+	const char* name,
+	const MQSpawnSearch& search,
+	float radius,
+	MQSpawnTriggerCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	return SpawnTriggers_Add(name, search, radius, std::move(callback), pluginHandle);
+}
+
+bool MainImpl::RemoveSpawnTrigger(
+	int triggerId,
+	const MQPluginHandle& pluginHandle)
+{
+	return SpawnTriggers_Remove(triggerId, pluginHandle);
+}
+
 void MainImpl::SendToActor(
 	postoffice::Dropbox* dropbox,
 	const postoffice::Address& address,
@@ -1250,6 +1354,48 @@ void MainImpl::RemoveActor(
 	pActorAPI->RemoveActor(dropbox, pluginHandle);
 }
 
+bool MainImpl::SubscribeActor(
+	postoffice::Dropbox* dropbox,
+	const std::string& topic,
+	const MQPluginHandle& pluginHandle)
+{
+	return pActorAPI->SubscribeActor(dropbox, topic, pluginHandle);
+}
+
+bool MainImpl::UnsubscribeActor(
+	postoffice::Dropbox* dropbox,
+	const std::string& topic,
+	const MQPluginHandle& pluginHandle)
+{
+	return pActorAPI->UnsubscribeActor(dropbox, topic, pluginHandle);
+}
+
+void MainImpl::QueryRemoteData(
+	const postoffice::Address& address,
+	std::vector<std::string> expressions,
+	postoffice::RemoteQueryCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	RemoteQuery_Query(address, std::move(expressions), std::move(callback), pluginHandle);
+}
+
+int MainImpl::SubscribeRemoteData(
+	const postoffice::Address& address,
+	std::vector<std::string> expressions,
+	std::chrono::milliseconds interval,
+	postoffice::RemoteSubscriptionCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	return RemoteQuery_Subscribe(address, std::move(expressions), interval, std::move(callback), pluginHandle);
+}
+
+bool MainImpl::UnsubscribeRemoteData(
+	int subscriptionId,
+	const MQPluginHandle& pluginHandle)
+{
+	return RemoteQuery_Unsubscribe(subscriptionId, pluginHandle);
+}
+
 bool MainImpl::AddCommand(
 	std::string_view command,
 	MQCommandHandler handler,
@@ -1279,6 +1425,11 @@ void MainImpl::TimedCommand(const char* command, int msDelay, const MQPluginHand
 	pCommandAPI->TimedCommand(command, msDelay, pluginHandle);
 }
 
+void MainImpl::DoCompiledCommand(MQCompiledCommand& command, const MQPluginHandle& pluginHandle)
+{
+	pCommandAPI->DoCompiledCommand(command, pluginHandle);
+}
+
 bool MainImpl::AddAlias(const std::string& shortCommand, const std::string& longCommand, bool persist, const MQPluginHandle& pluginHandle)
 {
 	return pCommandAPI->AddAlias(shortCommand, longCommand, persist, pluginHandle);
@@ -21,8 +21,6 @@
 #include "eqlib/EQLib.h"
 using namespace eqlib;
 
-//#define MQ2_PROFILING
-
 // uncomment this line to turn off the single-line benchmark macro
 // #define DISABLE_BENCHMARKS
 
@@ -69,6 +67,7 @@ using namespace eqlib;
 // only where they are needed.
 
 #include "mq/utils/Benchmarks.h"
+#include "mq/utils/MemoryAccounting.h"
 #include "mq/utils/Keybinds.h"
 
 #include "mq/api/Main.h"
@@ -82,6 +81,21 @@ namespace mq {
 void ShutdownMQ2Benchmarks();
 void InitializeMQ2Benchmarks();
 
+// Copies of every benchmark, for displaying them.
+std::vector<MQBenchmark> GetMQ2Benchmarks();
+void ResetMQ2BenchmarkLastTimes();
+
+// Frame timeline. Names are interned once and the id is passed with each event, so that adding an
+// event doesn't allocate. MarkTimelineFrame is called once per frame, on the main thread.
+uint32_t InternTimelineName(std::string_view name);
+void AddTimelineEvent(uint32_t name, uint32_t category,
+	std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+void MarkTimelineFrame();
+
+// Times the core engines against inputs that don't depend on the game. With save, the results
+// become the baseline that later runs are compared to.
+void RunEngineBenchmarks(bool save);
+
 void InitializeDisplayHook();
 void ShutdownDisplayHook();
 
@@ -142,6 +156,11 @@ MQLIB_API bool SendListSelect(const char* WindowName, const char* ScreenID, int
 MQLIB_API bool SendListSelect2(CXWnd* pList, int ListIndex);
 MQLIB_API bool SendWndClick2(CXWnd* pWnd, const char* ClickNotification);
 
+// Sends the notifications to the window one after the other, resolving the window only once. There is
+// a result for every step that was sent, steps after a failed one are only sent if StopOnFailure is false.
+MQLIB_API std::vector<MQWindowNotificationResult> SendWindowNotifications(const char* WindowName,
+	const std::vector<MQWindowNotification>& Steps, bool StopOnFailure = true);
+
 MQLIB_API void CreateMQ2NewsWindow();
 MQLIB_API void DeleteMQ2NewsWindow();
 
@@ -162,6 +181,41 @@ MQLIB_API bool ClickMouseItem(const MQGroundSpawn& pGroundSpawn, bool left);
 inline bool ClickMouseItem(SPAWNINFO* pChar, const MQGroundSpawn& pGroundSpawn, bool left) { return ClickMouseItem(pGroundSpawn, left); }
 void MouseConsume(int mouseButton, bool pressed);
 
+/* INPUT SEQUENCES */
+// Timed sequences of key and mouse actions. Every action starts once the one before it is done,
+// key and button events are injected as DirectInput data, and holds are kept in the device state
+// until they are released, so that each step lands on the frame it is meant for.
+enum class MQInputActionType
+{
+	KeyDown,                                     // Key, with its modifiers
+	KeyUp,
+	MouseDown,                                   // Button
+	MouseUp,
+	MouseMove,                                   // to X, Y. Moves along a straight line over Duration.
+	Wait,                                        // for Duration
+};
+
+struct MQInputAction
+{
+	MQInputActionType Type = MQInputActionType::Wait;
+	eqlib::KeyCombo Key;
+	int Button = 0;
+	int X = 0;
+	int Y = 0;
+	std::chrono::milliseconds Duration{ 0 };
+};
+
+// Called once the sequence is done, with completed = false if it was cancelled.
+using MQInputSequenceCallback = std::function<void(uint32_t id, bool completed)>;
+
+// Returns the id of the sequence, or 0 if it was empty.
+MQLIB_API uint32_t QueueInputSequence(std::vector<MQInputAction> actions, MQInputSequenceCallback callback = nullptr);
+MQLIB_API bool IsInputSequenceRunning(uint32_t id);
+// Releases anything the sequence is still holding.
+MQLIB_API void CancelInputSequence(uint32_t id);
+// Macros don't go on to their next line while a sequence they started with /inputsequence runs.
+bool IsMacroWaitingForInputSequence();
+
 /* UTILITIES */
 MQLIB_API void ConvertCR(char* Text, size_t LineLen);
 MQLIB_API void DrawHUDText(const char* Text, int X, int Y, unsigned int Argb, int Font);
@@ -186,8 +240,30 @@ MQLIB_API DEPRECATE("The EQ Path is the working directory.")
 char* GetEQPath(char* szBuffer, size_t len);
 
 MQLIB_API DWORD MQToSTML(const char* in, char* out, size_t maxlen = MAX_STRING, uint32_t ColorOverride = 0xFFFFFF);
+MQLIB_OBJECT void MQToSTML(std::string_view in, std::string& out, uint32_t ColorOverride = 0xFFFFFF); // appends to out
 MQLIB_API void StripMQChat(const char* in, char* out);
 MQLIB_OBJECT void StripMQChat(std::string_view in, char* out);
+
+// A chat line with its text links parsed out of it.
+struct MQChatLinks
+{
+	struct Link
+	{
+		TextTagInfo tag;                     // refers to the line
+		int itemID = 0;                      // for item links
+		std::string itemName;
+	};
+
+	std::string line;
+	std::string cleaned;                     // the line as CleanItemTags(line, false) returns it
+	std::vector<Link> links;
+
+	bool HasLinks() const { return !links.empty(); }
+};
+
+// Parses the links of a chat line. The last few lines are remembered, so the consumers of the same
+// line (events, filters, plugins) share the work instead of each of them cleaning it again.
+MQLIB_OBJECT std::shared_ptr<const MQChatLinks> ParseChatLinks(std::string_view line);
 MQLIB_API void STMLToPlainText(char* in, char* out);
 MQLIB_API char* GetSubFromLine(int Line, char* szSub, size_t Sublen);
 MQLIB_API const char* GetFilenameFromFullPath(const char* Filename);
@@ -246,6 +322,30 @@ MQLIB_API bool IsGuildMember(const char* SpawnName);
 MQLIB_API int GetGroupMercenaryCount(uint32_t ClassMASK);
 MQLIB_API SPAWNINFO* GetRaidMember(int index);
 MQLIB_API SPAWNINFO* GetGroupMember(int index);
+
+// Group lookups by the visual index that ${Group.Member[n]} uses: 0 is us, then the other members in
+// slot order. The lookups return -1 when there is no such member.
+MQLIB_API int GetGroupRosterCount();
+MQLIB_API CGroupMember* GetGroupRosterMember(int index);
+MQLIB_API int GetGroupRosterIndexByName(std::string_view name);
+MQLIB_API int GetGroupRosterIndexBySpawn(const PlayerClient* pSpawn);
+MQLIB_API int GetGroupRosterIndexByRole(int role);
+
+// Raid lookups return a raid member slot, or -1. Ordinals start at 1, as in ${Raid.Member[n]}.
+MQLIB_API int GetRaidRosterSlotByName(std::string_view name);
+MQLIB_API int GetRaidRosterSlotByOrdinal(int ordinal);
+
+// Merchant lookups return the index of an item on the merchant's regular page, or -1. A lookup that
+// isn't exact finds the first item whose name contains the name, both ignoring case.
+MQLIB_API int GetMerchantItemIndexByName(std::string_view name, bool exact);
+MQLIB_API int GetMerchantItemIndexByID(int itemID);
+
+// Corpse lookups return the loot slot of an item on the open corpse, or -1, and match names like the
+// merchant lookups do. FindCorpseItems returns the slots of every item the predicate accepts.
+MQLIB_API int GetCorpseItemSlotByName(std::string_view name, bool exact);
+MQLIB_API int GetCorpseItemSlotByID(int itemID);
+MQLIB_OBJECT std::vector<int> FindCorpseItems(const std::function<bool(const ItemPtr&)>& predicate);
+
 MQLIB_API uint32_t GetGroupMarkedTargetID(int index);
 MQLIB_API uint32_t GetRaidMarkedTargetID(int index);
 MQLIB_API bool IsAssistNPC(SPAWNINFO* pSpawn);
@@ -443,6 +543,8 @@ MQLIB_API EQSwitch* FindSwitchByName(const char* szName = nullptr);
 MQLIB_API void ClearSearchSpawn(MQSpawnSearch* pSearchSpawn);
 MQLIB_API SPAWNINFO* NthNearestSpawn(MQSpawnSearch* pSearchSpawn, int Nth, SPAWNINFO* pOrigin, bool IncludeOrigin = false);
 MQLIB_API int CountMatchingSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pOrigin, bool IncludeOrigin = false);
+MQLIB_API std::vector<SPAWNINFO*> SearchAllSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pOrigin,
+                                              size_t maxResults = SIZE_MAX, bool IncludeOrigin = false);
 MQLIB_API SPAWNINFO* SearchThroughSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar);
 MQLIB_API bool SpawnMatchesSearch(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar, SPAWNINFO* pSpawn);
 MQLIB_API bool SearchSpawnMatchesSearchSpawn(MQSpawnSearch* pSearchSpawn1, MQSpawnSearch* pSearchSpawn2);
@@ -471,6 +573,8 @@ MQLIB_API bool        PlayerHasAAAbility(int AAIndex);
 MQLIB_API const char* GetAANameByIndex(int AAIndex);
 MQLIB_API int         GetAAIndexByName(const char* AAName);
 MQLIB_API int         GetAAIndexByID(int ID);
+MQLIB_API CAltAbilityData* GetOwnedAAByName(const char* AAName);
+MQLIB_API CAltAbilityData* GetOwnedAAByID(int ID);
 MQLIB_API int         GetSkillIDFromName(const char* name);
 MQLIB_API bool        InHoverState();
 MQLIB_API int         GetGameState();
@@ -506,6 +610,8 @@ MQLIB_API CInvSlot*   GetInvSlot(const ItemGlobalIndex& idx);
    inline CInvSlot*   GetInvSlot2(const ItemGlobalIndex& idx) { return GetInvSlot(idx); }
 MQLIB_API bool        IsItemInsideContainer(ItemClient* pItem);
 MQLIB_API bool        ItemMatchesSearch(MQItemSearch& itemSearch, ItemClient* pItem);
+MQLIB_API std::vector<MQItemSearchResult> SearchAllItems(MQItemSearch& itemSearch,
+                                              const std::function<bool(ItemClient*)>& predicate = nullptr);
 MQLIB_API bool        PickupItem(const ItemGlobalIndex& index);
    inline bool        PickupItem(ItemContainerInstance type, ItemClient* pItem) { return PickupItem(pItem->GetItemLocation()); }
 MQLIB_API bool        DropItem(const ItemGlobalIndex& index);
@@ -553,12 +659,44 @@ public:
 void InitializeCachedBuffs();
 void ShutdownCachedBuffs();
 
+enum class CachedBuffChangeType
+{
+	Gained,
+	Lost,
+	Expiring,                // the buff is about to run out
+};
+
+// A change to the cached buffs of a spawn.
+struct CachedBuffChange
+{
+	uint32_t spawnID = 0;
+	int spellID = -1;
+	int slot = -1;
+	CachedBuffChangeType type = CachedBuffChangeType::Gained;
+	DWORD remaining = 0;     // in milliseconds, 0 for lost buffs
+};
+
+// Replaces the cached buffs of a spawn with a full set from somewhere other than a buff packet, like
+// the pet window. Changes are reported the same way.
+void SetCachedBuffs(int spawnID, std::vector<CachedBuff>&& buffs);
+
+// Audits the cached buffs of every spawn, and publishes the changes since the previous pulse.
+// Called once per pulse, before macros and game events are processed.
+void CachedBuffs_Pulse();
+
+// The changes that were published during this pulse.
+const std::vector<CachedBuffChange>& CachedBuffs_GetChanges();
+
+// Queues Event_BuffChange for the macro, if it has that sub. Lives with the other macro events.
+void AddBuffChangeEvent(const CachedBuffChange& change);
+
 MQLIB_API    int GetCachedBuff(SPAWNINFO* pSpawn, const std::function<bool(const CachedBuff&)>& predicate);
 MQLIB_API    int GetCachedBuffAt(SPAWNINFO* pSpawn, size_t index);
 MQLIB_OBJECT int GetCachedBuffAt(SPAWNINFO* pSpawn, size_t index, const std::function<bool(const CachedBuff&)>& predicate);
 MQLIB_OBJECT std::optional<CachedBuff> GetCachedBuffAtSlot(SPAWNINFO* pSpawn, int slot);
 MQLIB_OBJECT std::vector<CachedBuff> FilterCachedBuffs(SPAWNINFO* pSpawn, const std::function<bool(const CachedBuff&)>& predicate);
 MQLIB_API    DWORD GetCachedBuffCount(SPAWNINFO* pSpawn);
+MQLIB_OBJECT uint32_t GetCachedBuffsEpoch(SPAWNINFO* pSpawn);
 MQLIB_OBJECT DWORD GetCachedBuffCount(SPAWNINFO* pSpawn, const std::function<bool(const CachedBuff&)>& predicate);
 MQLIB_API    void ClearCachedBuffsSpawn(SPAWNINFO* pSpawn);
 MQLIB_API    void ClearCachedBuffs();
@@ -632,8 +770,50 @@ MQLIB_API void EndAllMacros();
 //                                                                                               //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Background macros started with /bgmacro. While one runs, its state is swapped into the globals
+// of the macro engine (gMacroBlock, gMacroStack, gDelay, ...) for the lifetime of this scope.
+class MQBackgroundMacroScope
+{
+public:
+	explicit MQBackgroundMacroScope(MQMacroBlockPtr pBlock);
+	~MQBackgroundMacroScope();
+
+	MQBackgroundMacroScope(const MQBackgroundMacroScope&) = delete;
+	MQBackgroundMacroScope& operator=(const MQBackgroundMacroScope&) = delete;
+
+private:
+	MQMacroBlockPtr m_pBlock;
+	MQMacroBlockPtr m_pSavedBlock;
+};
+
+const std::vector<MQMacroBlockPtr>& GetBackgroundMacroBlocks();
+
 MQLIB_API bool Calculate(const char* szFormula, double& Dest);
 
+// Result of CalculateExact. Integer results are exact across the whole 64-bit range.
+struct MQCalcValue
+{
+	bool IsInteger = false;
+	int64_t Integer = 0;
+	double Double = 0.0;                        // also set for integers
+};
+
+// Calculates a formula like Calculate does, but keeps numbers without a decimal point as 64-bit
+// integers. They only become doubles when a result isn't an exact integer, like 7/2, or overflows.
+MQLIB_OBJECT bool CalculateExact(const char* szFormula, MQCalcValue& Result);
+
+// Formulas compiled once and evaluated many times, like the conditions of macro loops.
+struct MQCompiledCalculation;
+enum class CalculateResult
+{
+	Success,
+	Failure,                                    // the error has already been reported
+	NotNumeric,                                 // a ${} reference didn't produce a number, use Calculate instead
+};
+
+std::shared_ptr<MQCompiledCalculation> CompileCalculation(std::string_view formula);
+CalculateResult EvaluateCompiledCalculation(const MQCompiledCalculation& compiled, double& Result);
+
 // Given a string that contains a number, make the number "pretty" by adding things like
 // comma separators, or decimals.
 MQLIB_API void PrettifyNumber(char* string, size_t bufferSize, int decimals = 0);
@@ -687,9 +867,28 @@ struct TokenTextParam
 	TokenTextParam(const char* Data, DWORD Length);
 };
 
+// The same message, read in place: the tokens are views into the stream, found when they are asked
+// for. Only valid for the duration of the callback.
+struct TokenTextView
+{
+	bool World = false;
+	int StringID = 0;
+	int Color = 0;
+
+	MQLIB_OBJECT TokenTextView(const char* Data, DWORD Length);
+
+	MQLIB_OBJECT int GetTokenCount() const;
+	MQLIB_OBJECT std::string_view GetToken(int Index) const;
+
+private:
+	const char* m_tokens = nullptr;
+	const char* m_end = nullptr;
+};
+
 void InitializeStringDB();
 void ShutdownStringDB();
 MQLIB_OBJECT int AddTokenMessageCmd(int StringID, fMQTokenMessageCmd Command);
+MQLIB_OBJECT int AddTokenMessageCmd(int StringID, fMQTokenMessageViewCmd Command);
 MQLIB_OBJECT void RemoveTokenMessageCmd(int StringID, int CallbackID);
 
 //----------------------------------------------------------------------------
@@ -25,6 +25,8 @@ using fMQCommand             = void   (*)(PlayerClient*, char* Buffer, size_t Bu
 using fCascadeItemFunction   = void   (*)();
 struct TokenTextParam;
 using fMQTokenMessageCmd     = void   (*)(const TokenTextParam&);
+struct TokenTextView;
+using fMQTokenMessageViewCmd = void   (*)(const TokenTextView&);
 
 
 // Misc Function types
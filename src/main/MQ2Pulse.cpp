@@ -18,11 +18,23 @@
 
 #include "MQ2Main.h"
 #include "CrashHandler.h"
+#include "GraphicsResources.h"
 #include "ImGuiManager.h"
 
 #include "MQCommandAPI.h"
+#include "MQDataAPI.h"
+#include "MQGameEvents.h"
+#include "MQMemoryAccounting.h"
+#include "MQMacroProfiler.h"
+#include "MQCorpseItems.h"
+#include "MQMerchantItems.h"
 #include "MQPluginHandler.h"
 #include "MQPostOffice.h"
+#include "MQAdvLoot.h"
+#include "MQCastState.h"
+#include "MQPetMercState.h"
+#include "MQTasks.h"
+#include "MQXTargets.h"
 
 #include <wil/resource.h>
 
@@ -56,6 +68,8 @@ void PostToMainThread(std::function<void()>&& callback)
 
 static void ProcessQueuedEvents()
 {
+	ProcessMacroDataRequests();
+
 	std::unique_lock lock(s_queuedEventMutex);
 
 	if (s_queuedEvents.empty())
@@ -94,6 +108,10 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 	if (IsMouseWaiting())
 		return false;
 
+	// ... or of an input sequence that the macro started.
+	if (IsMacroWaitingForInputSequence())
+		return false;
+
 	if (gDelay && gDelayCondition[0])
 	{
 		char szCond[MAX_STRING];
@@ -117,7 +135,7 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 
 	if (!gDelay && pBlock && !pBlock->Paused && (!gMQPauseOnChat || pEverQuestInfo->KeyboardMode) && gMacroStack)
 	{
-		const MQMacroLine& ml = pBlock->Line.at(pBlock->CurrIndex);
+		MQMacroLine& ml = pBlock->GetLine(pBlock->CurrIndex);
 
 		if (pBlock->BindStackIndex == pBlock->CurrIndex)
 		{
@@ -126,15 +144,18 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 		}
 
 		gMacroStack->LocationIndex = pBlock->CurrIndex;
-#ifdef MQ2_PROFILING
-		LARGE_INTEGER BeforeCommand;
-		QueryPerformanceCounter(&BeforeCommand);
-		int ThisMacroBlock = pBlock->CurrIndex;
-#endif
 
 		if (gbInZone && !gZoning)
 		{
-			DoCommand(ml.Command.c_str(), false);
+			const int lineIndex = pBlock->CurrIndex;
+			if (gMacroProfilerEnabled)
+				MacroProfiler_BeginLine(*pBlock);
+
+			pCommandAPI->DoMacroLine(ml);
+
+			if (gMacroProfilerEnabled)
+				MacroProfiler_EndLine(*pBlock, lineIndex);
+
 			MQMacroBlockPtr pCurrentBlock = GetCurrentMacroBlock();
 
 			if (!pCurrentBlock)
@@ -149,12 +170,11 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 					|| ci_find_substr(ml.Command, "/call") == 0
 					|| ci_find_substr(ml.Command, "/invoke") == 0)
 				{
-					auto iter = pCurrentBlock->Line.find(pCurrentBlock->CurrIndex);
-					if (iter != pCurrentBlock->Line.end())
+					if (pCurrentBlock->HasLine(pCurrentBlock->CurrIndex))
 					{
-						if (++iter != pCurrentBlock->Line.end())
+						if (pCurrentBlock->CurrIndex < pCurrentBlock->GetLastIndex())
 						{
-							pCurrentBlock->BindStackIndex = iter->first;
+							pCurrentBlock->BindStackIndex = pCurrentBlock->CurrIndex + 1;
 						}
 						else
 						{
@@ -167,33 +187,22 @@ static bool DoNextCommand(MQMacroBlockPtr pBlock)
 				}
 			}
 
-#ifdef MQ2_PROFILING
-			LARGE_INTEGER AfterCommand;
-			QueryPerformanceCounter(&AfterCommand);
-			pCurrentBlock->Line[ThisMacroBlock].ExecutionCount++;
-			pCurrentBlock->Line[ThisMacroBlock].ExecutionTime += AfterCommand.QuadPart - BeforeCommand.QuadPart;
-#endif
-
-			const int lastindex = pCurrentBlock->Line.rbegin()->first;
+			const int lastindex = pCurrentBlock->GetLastIndex();
 			if (pCurrentBlock->CurrIndex > lastindex)
 			{
 				FatalError("Reached end of macro.");
 			}
-			else
+			else if (pCurrentBlock->HasLine(pCurrentBlock->CurrIndex))
 			{
-				auto iter = pCurrentBlock->Line.find(pCurrentBlock->CurrIndex);
-				if (iter != pCurrentBlock->Line.end())
+				if (pCurrentBlock->CurrIndex < lastindex)
 				{
-					if (++iter != pCurrentBlock->Line.end())
-					{
-						pCurrentBlock->CurrIndex = iter->first;
-					}
-				}
-				else
-				{
-					FatalError("Reached end of macro.");
+					pCurrentBlock->CurrIndex++;
 				}
 			}
+			else
+			{
+				FatalError("Reached end of macro.");
+			}
 
 			s_commandCount++;
 			return true;
@@ -447,6 +456,13 @@ static void CheckGameState()
 
 static void Pulse()
 {
+	if (pDataAPI)
+		pDataAPI->AdvanceFrame();
+
+	ClearInventoryItemIndex();
+	ClearInventorySlotStatistics();
+	InvalidateAltAbilityTables();
+
 	static HWND EQhWnd = *(HWND*)EQADDR_HWND;
 	if (EQW_GetDisplayWindow)
 		EQhWnd = EQW_GetDisplayWindow();
@@ -459,6 +475,9 @@ static void Pulse()
 	// handle queued events.
 	ProcessQueuedEvents();
 
+	if (pDataAPI)
+		pDataAPI->UpdateObservers();
+
 	//CheckGameState();
 	CheckGameValidity();
 	if (!s_isValid && !s_hasNotified)
@@ -533,7 +552,17 @@ static void Pulse()
 	}
 
 	if (pMerchantWnd && !pMerchantWnd->IsVisible())
+	{
 		gItemsReceived = false;
+		InvalidateMerchantItems();
+	}
+
+	static PlayerClient* lastCorpse = nullptr;
+	PlayerClient* activeCorpse = pActiveCorpse;
+	if (test_and_set(lastCorpse, activeCorpse) || (pLootWnd && !pLootWnd->IsVisible()))
+	{
+		InvalidateCorpseItems();
+	}
 
 	if (gbDoAutoRun && pChar && pLocalPC)
 	{
@@ -671,6 +700,10 @@ static HeartbeatState Heartbeat()
 	{
 		TickDiff -= 100;
 		if (gDelay > 0) gDelay--;
+		for (const MQMacroBlockPtr& pBackground : GetBackgroundMacroBlocks())
+		{
+			if (pBackground->Context.Delay > 0) pBackground->Context.Delay--;
+		}
 		DropTimers();
 	}
 
@@ -682,6 +715,8 @@ static HeartbeatState Heartbeat()
 			DebugSpew("GetGameState()=%d vs %d", GameState, gGameState);
 			gGameState = GameState;
 			gbInZone = (gGameState == GAMESTATE_INGAME || gGameState == GAMESTATE_CHARSELECT || gGameState == GAMESTATE_CHARCREATE);
+			if (pDataAPI)
+				pDataAPI->AdvanceZone();
 			DebugTry(Benchmark(bmPluginsSetGameState, PluginsSetGameState(GameState)));
 		}
 
@@ -697,10 +732,19 @@ static HeartbeatState Heartbeat()
 
 	DebugTry(DrawHUD());
 	DebugTry(PulseMQ2AutoInventory());
+	DebugTry(XTargets_Pulse());
+	DebugTry(Tasks_Pulse());
+	DebugTry(PetMerc_Pulse());
+	DebugTry(CachedBuffs_Pulse());
+	DebugTry(CastState_Pulse());
+	DebugTry(AdvLoot_Pulse());
 
 	bRunNextCommand = true;
 	DebugTry(Pulse());
+	DebugTry(GameEvents_Pulse());
+	MemoryAccounting_Pulse();
 	DebugTry(Benchmark(bmPluginsPulse, DebugTry(PulsePlugins())));
+	FlushDeferredChat();
 
 	static bool ShownNews = false;
 	if (gGameState == GAMESTATE_CHARSELECT && !ShownNews)
@@ -711,6 +755,7 @@ static HeartbeatState Heartbeat()
 	}
 
 	ImGuiManager_Pulse();
+	GraphicsResources_OnPulse();
 
 	if (gGameState == -1)
 	{
@@ -739,6 +784,32 @@ static HeartbeatState Heartbeat()
 		pBlock = GetCurrentMacroBlock();
 	}
 
+	// Background macros take turns after the foreground macro, each with its own turbo budget.
+	// Copied, since they can start and end background macros.
+	const std::vector<MQMacroBlockPtr> backgroundMacros = GetBackgroundMacroBlocks();
+	for (const MQMacroBlockPtr& pBackground : backgroundMacros)
+	{
+		if (pBackground->Removed)
+			continue;
+
+		MQBackgroundMacroScope scope(pBackground);
+
+		bRunNextCommand = true;
+		CurTurbo = 0;
+
+		while (bRunNextCommand && gMacroBlock == pBackground)
+		{
+			if (!DoNextCommand(pBackground))
+				break;
+			if (gbUnload)
+				return HeartbeatUnload;
+			if (!gTurbo)
+				break;
+			if (++CurTurbo > gMaxTurbo)
+				break;
+		}
+	}
+
 	pCommandAPI->PulseCommands();
 
 	return HeartbeatNormal;
@@ -755,6 +826,7 @@ void DoMainThreadInitialization();
 bool DoGameEventsPulse(int (*pEventFunc)())
 {
 	SetMainThreadId();
+	MarkTimelineFrame();
 	HeartbeatState hbState;
 
 	{
@@ -827,6 +899,7 @@ public:
 
 		CMerchantWnd__PurchasePageHandler__UpdateList_Trampoline();
 
+		InvalidateMerchantItems();
 		gItemsReceived = true;
 	}
 };
@@ -854,6 +927,9 @@ void ShutdownMQ2Pulse()
 	RemoveDetour(reinterpret_cast<uintptr_t>(ProcessGameEvents));
 	RemoveDetour(CEverQuest__SetGameState);
 	RemoveDetour(CMerchantWnd__PurchasePageHandler__UpdateList);
+
+	ClearInventoryItemIndex();
+	ClearInventorySlotStatistics();
 }
 
 } // namespace mq
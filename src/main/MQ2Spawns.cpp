@@ -16,6 +16,9 @@
 #include "MQ2Main.h"
 #include "MQDataAPI.h"
 #include "MQPluginHandler.h"
+#include "MQWarmUp.h"
+
+#include <emmintrin.h>
 
 namespace mq {
 
@@ -50,6 +53,7 @@ static ECombatState s_combatState = eCombatState_Standing;
 
 static void UpdateNameSpriteTint(PlayerClient* pSpawn);
 static bool UpdateNameSpriteState(PlayerClient* pSpawn, bool apply);
+static void InvalidateCaptionStates();
 
 #pragma region Combat State Calculation
 //----------------------------------------------------------------------------
@@ -123,6 +127,7 @@ ECombatState GetCombatState()
 static PlayerClient* pNamingSpawn = nullptr;
 
 static int gMaxSpawnCaptions = 35;
+static int gMaxCaptionRefreshes = 10;
 static bool gMQCaptions = true;
 
 static constexpr int CAPTION_UPDATE_FRAMES = 20; // number of frames between caption updates
@@ -293,6 +298,7 @@ static void CaptionCmd(PlayerClient*, const char* szLine)
 	else if (!_stricmp(Arg1, "MQCaptions"))
 	{
 		gMQCaptions = (!_stricmp(GetNextArg(szLine), "On"));
+		InvalidateCaptionStates();
 		WritePrivateProfileBool("Captions", "MQCaptions", gMQCaptions, mq::internal_paths::MQini);
 		WriteChatf("MQCaptions are now \ay%s\ax.", (gMQCaptions ? "On" : "Off"));
 		return;
@@ -320,6 +326,7 @@ static void CaptionCmd(PlayerClient*, const char* szLine)
 		ConvertCR(gszSpawnCorpseName, MAX_STRING);
 		ConvertCR(gszSpawnPetName, MAX_STRING);
 		ConvertCR(gszSpawnMercName, MAX_STRING);
+		InvalidateCaptionStates();
 
 		WriteChatf("Updated Captions from INI.");
 		return;
@@ -338,6 +345,7 @@ static void CaptionCmd(PlayerClient*, const char* szLine)
 	strcpy_s(pCaption, MAX_STRING, GetNextArg(szLine));
 	WritePrivateProfileString("Captions", Arg1, pCaption, mq::internal_paths::MQini);
 	ConvertCR(pCaption, MAX_STRING);
+	InvalidateCaptionStates();
 	WriteChatf("\ay%s\ax caption set.", Arg1);
 }
 
@@ -506,12 +514,17 @@ public:
 #endif
 };
 
+static void UpdateIndexedSpawnName(PlayerClient* pSpawn);
+
 class PlayerClientHook
 {
 public:
 	DETOUR_TRAMPOLINE_DEF(int, SetNameSpriteState_Trampoline, (bool Show))
 	int SetNameSpriteState_Detour(bool Show)
 	{
+		// The game rebuilds the name sprite when a spawn is renamed.
+		UpdateIndexedSpawnName(reinterpret_cast<PlayerClient*>(this));
+
 		if (gGameState != GAMESTATE_INGAME || !Show || !gMQCaptions)
 			return SetNameSpriteState_Trampoline(Show);
 
@@ -628,6 +641,263 @@ static void UpdateNameSpriteTint(PlayerClient* pSpawn)
 		pSpawn->GetActor()->SetStringSpriteTint((RGB*)&NewColor);
 }
 
+//----------------------------------------------------------------------------
+// caption dependency tracking
+//----------------------------------------------------------------------------
+
+// Captions are only re-rendered when something they display has changed. The NamingSpawn
+// members a caption template uses are read from its text, and a hash of the values behind them
+// is stored for every spawn when its caption is rendered. Templates that use anything else are
+// volatile and are refreshed on the regular caption timer like before.
+
+enum CaptionDependency : uint32_t
+{
+	CaptionDep_Name          = 0x0001,
+	CaptionDep_HPs           = 0x0002,
+	CaptionDep_Mark          = 0x0004,
+	CaptionDep_Assist        = 0x0008,
+	CaptionDep_Surname       = 0x0010,
+	CaptionDep_Suffix        = 0x0020,
+	CaptionDep_Title         = 0x0040,
+	CaptionDep_Flags         = 0x0080,
+	CaptionDep_GroupLeader   = 0x0100,
+	CaptionDep_Guild         = 0x0200,
+	CaptionDep_Master        = 0x0400,
+	CaptionDep_Level         = 0x0800,
+	CaptionDep_Type          = 0x1000,
+};
+
+struct CaptionDependencies
+{
+	uint32_t members = 0;
+	bool isVolatile = false;
+};
+
+struct CaptionState
+{
+	const char* caption = nullptr;
+	uint64_t valueHash = 0;
+};
+
+static std::unordered_map<const char*, CaptionDependencies> s_captionDependencies;
+static std::unordered_map<PlayerClient*, CaptionState> s_captionStates;
+
+static uint32_t GetCaptionMemberDependency(std::string_view member)
+{
+	static const std::pair<const char*, uint32_t> s_memberDependencies[] = {
+		{ "Name",          CaptionDep_Name },
+		{ "CleanName",     CaptionDep_Name },
+		{ "DisplayName",   CaptionDep_Name },
+		{ "PctHPs",        CaptionDep_HPs },
+		{ "CurrentHPs",    CaptionDep_HPs },
+		{ "MaxHPs",        CaptionDep_HPs },
+		{ "Mark",          CaptionDep_Mark },
+		{ "Assist",        CaptionDep_Assist },
+		{ "Surname",       CaptionDep_Surname },
+		{ "Owner",         CaptionDep_Surname | CaptionDep_Type },
+		{ "Suffix",        CaptionDep_Suffix },
+		{ "Title",         CaptionDep_Title },
+		{ "AATitle",       CaptionDep_Title },
+		{ "AARank",        CaptionDep_Title },
+		{ "Trader",        CaptionDep_Flags },
+		{ "AFK",           CaptionDep_Flags },
+		{ "Linkdead",      CaptionDep_Flags },
+		{ "LFG",           CaptionDep_Flags },
+		{ "Invis",         CaptionDep_Flags },
+		{ "GroupLeader",   CaptionDep_GroupLeader },
+		{ "Guild",         CaptionDep_Guild },
+		{ "Master",        CaptionDep_Master },
+		{ "Level",         CaptionDep_Level },
+		{ "Type",          CaptionDep_Type },
+		{ "Class",         CaptionDep_Type },
+		{ "Race",          CaptionDep_Type },
+	};
+
+	for (const auto& [name, dependency] : s_memberDependencies)
+	{
+		if (ci_equals(member, name))
+			return dependency;
+	}
+
+	return 0;
+}
+
+static size_t SkipCaptionIdentifier(std::string_view caption, size_t pos)
+{
+	while (pos < caption.size() && (isalnum(static_cast<unsigned char>(caption[pos])) || caption[pos] == '_'))
+		++pos;
+
+	return pos;
+}
+
+static CaptionDependencies ParseCaptionDependencies(std::string_view caption)
+{
+	CaptionDependencies deps;
+
+	size_t pos = 0;
+	while ((pos = caption.find("${", pos)) != std::string_view::npos)
+	{
+		pos += 2;
+		size_t end = SkipCaptionIdentifier(caption, pos);
+		std::string_view name = caption.substr(pos, end - pos);
+		pos = end;
+
+		// The text inside an If is scanned like the rest of the caption.
+		if (ci_equals(name, "If"))
+			continue;
+
+		if (!ci_equals(name, "NamingSpawn"))
+		{
+			deps.isVolatile = true;
+			break;
+		}
+
+		if (end < caption.size() && caption[end] == '}')
+		{
+			deps.members |= CaptionDep_Name;
+			continue;
+		}
+
+		if (end >= caption.size() || caption[end] != '.')
+		{
+			deps.isVolatile = true;
+			break;
+		}
+
+		// Only the first member matters. Anything after it (.Length, .Type.Equal[PC]) is derived from it.
+		size_t memberEnd = SkipCaptionIdentifier(caption, end + 1);
+		uint32_t dependency = GetCaptionMemberDependency(caption.substr(end + 1, memberEnd - end - 1));
+
+		if (dependency == 0 || (memberEnd < caption.size() && caption[memberEnd] == '['))
+		{
+			deps.isVolatile = true;
+			break;
+		}
+
+		deps.members |= dependency;
+		pos = memberEnd;
+	}
+
+	return deps;
+}
+
+static const CaptionDependencies& GetCaptionDependencies(const char* caption)
+{
+	auto iter = s_captionDependencies.find(caption);
+	if (iter == s_captionDependencies.end())
+		iter = s_captionDependencies.emplace(caption, ParseCaptionDependencies(caption)).first;
+
+	return iter->second;
+}
+
+static void HashCaptionValue(uint64_t& hash, uint64_t value)
+{
+	hash = (hash ^ value) * 0x100000001b3ULL;
+}
+
+static void HashCaptionValue(uint64_t& hash, std::string_view value)
+{
+	HashCaptionValue(hash, static_cast<uint64_t>(std::hash<std::string_view>{}(value)));
+}
+
+static uint64_t GetCaptionValueHash(PlayerClient* pSpawn, uint32_t members)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	HashCaptionValue(hash, static_cast<uint64_t>(IsAnonymized()));
+
+	if (members & CaptionDep_Name)
+	{
+		HashCaptionValue(hash, pSpawn->Name);
+		HashCaptionValue(hash, pSpawn->DisplayedName);
+	}
+
+	if (members & CaptionDep_HPs)
+	{
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->HPCurrent));
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->HPMax));
+	}
+
+	if (members & CaptionDep_Mark)
+		HashCaptionValue(hash, gGameState == GAMESTATE_INGAME ? GetNPCMarkNumber(pSpawn) : 0);
+	if (members & CaptionDep_Assist)
+		HashCaptionValue(hash, gGameState == GAMESTATE_INGAME && IsAssistNPC(pSpawn));
+	if (members & CaptionDep_Surname)
+		HashCaptionValue(hash, pSpawn->Lastname);
+	if (members & CaptionDep_Suffix)
+		HashCaptionValue(hash, pSpawn->Suffix);
+
+	if (members & CaptionDep_Title)
+	{
+		HashCaptionValue(hash, pSpawn->Title);
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->AARank));
+	}
+
+	if (members & CaptionDep_Flags)
+	{
+		HashCaptionValue(hash, (pSpawn->Trader != 0) | (pSpawn->AFK != 0) << 1 | (pSpawn->Linkdead != 0) << 2
+			| (pSpawn->LFG != 0) << 3 | (pSpawn->HideMode != 0) << 4);
+	}
+
+	if (members & CaptionDep_GroupLeader)
+	{
+		bool groupLeader = false;
+		if (pLocalPC && pLocalPC->Group && pLocalPC->Group->GetGroupLeader())
+		{
+			groupLeader = pSpawn->Type == SPAWN_PLAYER
+				&& !_stricmp(pLocalPC->Group->GetGroupLeader()->GetName(), pSpawn->Name);
+		}
+
+		HashCaptionValue(hash, groupLeader);
+	}
+
+	if (members & CaptionDep_Guild)
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->GuildID));
+
+	if (members & CaptionDep_Master)
+	{
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->MasterID));
+		HashCaptionValue(hash, reinterpret_cast<uintptr_t>(GetSpawnByID(pSpawn->MasterID)));
+	}
+
+	if (members & CaptionDep_Level)
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->Level));
+
+	if (members & CaptionDep_Type)
+	{
+		HashCaptionValue(hash, static_cast<uint64_t>(GetSpawnType(pSpawn)));
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->GetClass()));
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->GetRace()));
+		HashCaptionValue(hash, static_cast<uint64_t>(pSpawn->Mercenary));
+	}
+
+	return hash;
+}
+
+// Parses the templates that captions are rendered from, so that the first captions after zoning don't
+// have to.
+bool WarmUpCaptionTemplates()
+{
+	if (!gMQCaptions)
+		return true;
+
+	for (const char* caption : gszSpawnPlayerName)
+		GetCaptionDependencies(caption);
+
+	GetCaptionDependencies(gszSpawnNPCName);
+	GetCaptionDependencies(gszSpawnPetName);
+	GetCaptionDependencies(gszSpawnMercName);
+	GetCaptionDependencies(gszSpawnCorpseName);
+	return true;
+}
+
+static void InvalidateCaptionStates()
+{
+	s_captionDependencies.clear();
+	s_captionStates.clear();
+}
+
+//----------------------------------------------------------------------------
+
 static bool SetCaption(PlayerClient* pSpawn, const char* CaptionString)
 {
 	if (CaptionString[0])
@@ -646,84 +916,133 @@ static bool SetCaption(PlayerClient* pSpawn, const char* CaptionString)
 		}
 
 		pNamingSpawn = nullptr;
+
+		CaptionState& state = s_captionStates[pSpawn];
+		state.caption = CaptionString;
+		state.valueHash = GetCaptionValueHash(pSpawn, GetCaptionDependencies(CaptionString).members);
 		return true;
 	}
 
 	return false;
 }
 
-static bool UpdateNameSpriteState(PlayerClient* pSpawn, bool apply)
+// Returns the caption template for a spawn, or nullptr if the spawn must not be named
+static const char* GetCaptionTemplate(PlayerClient* pSpawn)
 {
-	if (!apply || !gMQCaptions)
-	{
-		return PlayerClientHook::SetNameSpriteState(pSpawn, apply) != 0;
-	}
-
-	if (!pSpawn->GetActor() || !pSpawn->GetActor()->IsBoneSet(0))
-	{
-		return true;
-	}
-
 	switch (GetSpawnType(pSpawn))
 	{
 	case NPC:
-		if (SetCaption(pSpawn, gszSpawnNPCName))
-			return true;
-		break;
+		return gszSpawnNPCName;
 
 	case PC:
 		if (!pEverQuestInfo->gOpt.pcNames && pSpawn != pTarget)
-			return false;
-		if (SetCaption(pSpawn, gszSpawnPlayerName[IsAnonymized() ? 1 : pEverQuestInfo->iShowNamesLevel]))
-			return true;
-		break;
+			return nullptr;
+		return gszSpawnPlayerName[IsAnonymized() ? 1 : pEverQuestInfo->iShowNamesLevel];
 
 	case CORPSE:
-		if (SetCaption(pSpawn, gszSpawnCorpseName))
-			return true;
-		break;
+		return gszSpawnCorpseName;
 
 	case CHEST:
 	case UNTARGETABLE:
 	case TRAP:
 	case TIMER:
 	case TRIGGER: // trigger names make it crash!
-		return false;
+		return nullptr;
 
 	case MOUNT: //mount names make it crash!
-		return false;
+		return nullptr;
 
 	case PET:
-		if (SetCaption(pSpawn, gszSpawnPetName))
-			return true;
-		break;
+		return gszSpawnPetName;
 
 	case MERCENARY:
-		if (SetCaption(pSpawn, gszSpawnMercName))
-			return true;
-		break;
+		return gszSpawnMercName;
+
+	default:
+		return "";
+	}
+}
+
+// Returns true if the spawn's caption was rendered from this template and nothing it shows has
+// changed since. Volatile captions are considered current unless checkVolatile is set.
+static bool IsCaptionCurrent(PlayerClient* pSpawn, const char* caption, bool checkVolatile)
+{
+	auto iter = s_captionStates.find(pSpawn);
+	if (iter == s_captionStates.end() || caption != iter->second.caption)
+		return false;
+
+	const CaptionDependencies& deps = GetCaptionDependencies(caption);
+	if (deps.isVolatile)
+		return !checkVolatile;
+
+	return iter->second.valueHash == GetCaptionValueHash(pSpawn, deps.members);
+}
+
+static bool UpdateNameSpriteState(PlayerClient* pSpawn, bool apply)
+{
+	if (!apply || !gMQCaptions)
+	{
+		s_captionStates.erase(pSpawn);
+		return PlayerClientHook::SetNameSpriteState(pSpawn, apply) != 0;
 	}
 
+	if (!pSpawn->GetActor() || !pSpawn->GetActor()->IsBoneSet(0))
+	{
+		return true;
+	}
+
+	const char* caption = GetCaptionTemplate(pSpawn);
+	if (!caption)
+		return false;
+
+	if (SetCaption(pSpawn, caption))
+		return true;
+
+	s_captionStates.erase(pSpawn);
 	return PlayerClientHook::SetNameSpriteState(pSpawn, apply) != 0;
 }
 
-static void UpdateSpawnCaptions()
+// Refreshes the captions of the nearest spawns. Captions whose values haven't changed are skipped,
+// and no more than gMaxCaptionRefreshes of them are rendered per call. Volatile captions are only
+// refreshed when fullPass is set.
+static void UpdateSpawnCaptions(bool fullPass)
 {
 	if (!gMQCaptions)
 		return;
 
 	int count = 0;
-	for (const MQSpawnArrayItem& item : gSpawnsArray)
+	int refreshed = 0;
+
+	for (size_t i = 0; i < gSpawnsArray.size(); ++i)
 	{
-		PlayerClient* pSpawn = item.GetSpawn();
+		EnsureSpawnsArraySorted(i + 1);
+		PlayerClient* pSpawn = gSpawnsArray[i].GetSpawn();
 
 		if (!pSpawn || pSpawn == pTarget)
 			continue;
 
-		if (UpdateNameSpriteState(pSpawn, true))
+		const char* caption = GetCaptionTemplate(pSpawn);
+		bool isVolatile = caption && GetCaptionDependencies(caption).isVolatile;
+
+		if (IsCaptionCurrent(pSpawn, caption, fullPass))
+		{
+			if (fullPass)
+				UpdateNameSpriteTint(pSpawn);
+
+			++count;
+		}
+		else if (caption && caption[0] && !isVolatile && refreshed >= gMaxCaptionRefreshes)
+		{
+			// Over budget, a later frame will pick this one up.
+			++count;
+		}
+		else if (UpdateNameSpriteState(pSpawn, true))
 		{
 			UpdateNameSpriteTint(pSpawn);
 			++count;
+
+			if (!isVolatile)
+				++refreshed;
 		}
 
 		if (count >= gMaxSpawnCaptions)
@@ -747,6 +1066,7 @@ static void LoadCaptionSettings()
 	GetPrivateProfileString("Captions", "Merc", gszSpawnMercName, gszSpawnMercName, MAX_STRING, iniFile);
 
 	gMaxSpawnCaptions = GetPrivateProfileInt("Captions", "Update", gMaxSpawnCaptions, iniFile);
+	gMaxCaptionRefreshes = GetPrivateProfileInt("Captions", "RefreshBudget", gMaxCaptionRefreshes, iniFile);
 	gMQCaptions = GetPrivateProfileBool("Captions", "MQCaptions", gMQCaptions, iniFile);
 
 	if (gbWriteAllConfig)
@@ -763,6 +1083,7 @@ static void LoadCaptionSettings()
 		WritePrivateProfileString("Captions", "Merc", gszSpawnMercName, iniFile);
 
 		WritePrivateProfileInt("Captions", "Update", gMaxSpawnCaptions, iniFile);
+		WritePrivateProfileInt("Captions", "RefreshBudget", gMaxCaptionRefreshes, iniFile);
 		WritePrivateProfileBool("Captions", "MQCaptions", gMQCaptions, iniFile);
 	}
 
@@ -776,6 +1097,84 @@ static void LoadCaptionSettings()
 	ConvertCR(gszSpawnCorpseName, MAX_STRING);
 	ConvertCR(gszSpawnPetName, MAX_STRING);
 	ConvertCR(gszSpawnMercName, MAX_STRING);
+
+	InvalidateCaptionStates();
+}
+
+#pragma endregion
+
+#pragma region Spawn Search Cache
+//----------------------------------------------------------------------------
+// spawn search cache
+//----------------------------------------------------------------------------
+
+struct SpawnSearchCacheEntry
+{
+	SpawnSearchQuery query;
+	SPAWNINFO* pOrigin;
+	int nth;
+	MQSpawnSearch search;
+	MQSpawnSearchResult result;
+	uint32_t alertGeneration;
+};
+
+// Searches are compared linearly, so keep this small. A loop rarely uses more than a handful.
+static constexpr size_t MAX_CACHED_SPAWN_SEARCHES = 32;
+static std::vector<SpawnSearchCacheEntry> s_spawnSearchCache;
+
+static bool IsCacheableSpawnSearch(const MQSpawnSearch& search)
+{
+	// Searches that use alert lists are only found again while the alerts are unchanged.
+	return IsMainThread();
+}
+
+static bool IsSameSpawnSearch(MQSpawnSearch& search1, MQSpawnSearch& search2)
+{
+	// SearchSpawnMatchesSearchSpawn doesn't compare these.
+	return search1.zLoc == search2.zLoc
+		&& search1.bHealer == search2.bHealer
+		&& search1.PlayerState == search2.PlayerState
+		&& SearchSpawnMatchesSearchSpawn(&search1, &search2);
+}
+
+bool FindCachedSpawnSearch(SpawnSearchQuery query, MQSpawnSearch& search, SPAWNINFO* pOrigin, int nth,
+	MQSpawnSearchResult& result)
+{
+	if (!IsCacheableSpawnSearch(search))
+		return false;
+
+	for (SpawnSearchCacheEntry& entry : s_spawnSearchCache)
+	{
+		if (entry.query == query && entry.pOrigin == pOrigin && entry.nth == nth
+			&& entry.alertGeneration == CAlerts.GetGeneration()
+			&& IsSameSpawnSearch(entry.search, search))
+		{
+			result = entry.result;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CacheSpawnSearch(SpawnSearchQuery query, const MQSpawnSearch& search, SPAWNINFO* pOrigin, int nth,
+	const MQSpawnSearchResult& result)
+{
+	if (!IsCacheableSpawnSearch(search))
+		return;
+
+	if (s_spawnSearchCache.size() >= MAX_CACHED_SPAWN_SEARCHES)
+		s_spawnSearchCache.erase(s_spawnSearchCache.begin());
+
+	s_spawnSearchCache.push_back({ query, pOrigin, nth, search, result, CAlerts.GetGeneration() });
+}
+
+void ClearSpawnSearchCache()
+{
+	s_spawnSearchCache.clear();
+
+	// Alert list matches are remembered for as long as the searches are.
+	CAlerts.ClearMatchCache();
 }
 
 #pragma endregion
@@ -793,6 +1192,8 @@ static void AddGroundItem()
 {
 	if (EQGroundItem* pGroundItem = pItemList->Top)
 	{
+		IndexGroundItem(pGroundItem);
+
 		std::scoped_lock lock(s_groundsMutex);
 
 		MQGroundPending* pPending = new MQGroundPending;
@@ -808,6 +1209,7 @@ static void AddGroundItem()
 static void RemoveGroundItem(EQGroundItem* pGroundItem)
 {
 	InvalidateObservedEQObject(pGroundItem);
+	UnindexGroundItem(pGroundItem);
 
 	if (pPendingGrounds)
 	{
@@ -899,13 +1301,422 @@ static void ProcessPendingGroundItems()
 
 #pragma endregion
 
+#pragma region Spawn Grid
+//----------------------------------------------------------------------------
+// spawn grid
+//----------------------------------------------------------------------------
+
+// Spawns are bucketed into a uniform 2D grid so that searches limited to a radius only need to
+// visit the spawns in nearby cells. The grid is updated as spawns are added and removed, and
+// once per pulse for spawns that moved into a different cell.
+
+static constexpr float SPAWN_GRID_CELL_SIZE = 128.0f;
+
+// Radius searches that would cover more cells than this are faster as a linear scan.
+static constexpr int64_t SPAWN_GRID_MAX_QUERY_CELLS = 256;
+
+// Spawns can move between the grid update and a search, so searches are padded by this much.
+static constexpr float SPAWN_GRID_QUERY_PADDING = 32.0f;
+
+using SpawnGridCell = uint64_t;
+
+static std::unordered_map<SpawnGridCell, std::vector<PlayerClient*>> s_spawnGrid;
+static std::unordered_map<PlayerClient*, SpawnGridCell> s_spawnGridCells;
+
+static int GetSpawnGridCoord(float value)
+{
+	return static_cast<int>(std::floor(value / SPAWN_GRID_CELL_SIZE));
+}
+
+static SpawnGridCell MakeSpawnGridCell(int cellX, int cellY)
+{
+	return (static_cast<uint64_t>(static_cast<uint32_t>(cellX)) << 32) | static_cast<uint32_t>(cellY);
+}
+
+static SpawnGridCell GetSpawnGridCell(const PlayerClient* pSpawn)
+{
+	return MakeSpawnGridCell(GetSpawnGridCoord(pSpawn->X), GetSpawnGridCoord(pSpawn->Y));
+}
+
+static void RemoveFromSpawnGridCell(PlayerClient* pSpawn, SpawnGridCell cell)
+{
+	auto iter = s_spawnGrid.find(cell);
+	if (iter == s_spawnGrid.end())
+		return;
+
+	std::vector<PlayerClient*>& spawns = iter->second;
+
+	auto spawnIter = std::find(spawns.begin(), spawns.end(), pSpawn);
+	if (spawnIter != spawns.end())
+	{
+		*spawnIter = spawns.back();
+		spawns.pop_back();
+	}
+
+	if (spawns.empty())
+		s_spawnGrid.erase(iter);
+}
+
+static void UpdateSpawnGridCell(PlayerClient* pSpawn)
+{
+	SpawnGridCell cell = GetSpawnGridCell(pSpawn);
+
+	auto [iter, added] = s_spawnGridCells.try_emplace(pSpawn, cell);
+	if (!added)
+	{
+		if (iter->second == cell)
+			return;
+
+		RemoveFromSpawnGridCell(pSpawn, iter->second);
+		iter->second = cell;
+	}
+
+	s_spawnGrid[cell].push_back(pSpawn);
+}
+
+static void RemoveFromSpawnGrid(PlayerClient* pSpawn)
+{
+	auto iter = s_spawnGridCells.find(pSpawn);
+	if (iter == s_spawnGridCells.end())
+		return;
+
+	RemoveFromSpawnGridCell(pSpawn, iter->second);
+	s_spawnGridCells.erase(iter);
+}
+
+static void ClearSpawnGrid()
+{
+	s_spawnGrid.clear();
+	s_spawnGridCells.clear();
+}
+
+bool ForEachSpawnInRadius(float x, float y, float radius, const std::function<void(SPAWNINFO*)>& callback)
+{
+	// The grid is only maintained on the main thread.
+	if (!IsMainThread())
+		return false;
+
+	float paddedRadius = radius + SPAWN_GRID_QUERY_PADDING;
+	int minX = GetSpawnGridCoord(x - paddedRadius);
+	int maxX = GetSpawnGridCoord(x + paddedRadius);
+	int minY = GetSpawnGridCoord(y - paddedRadius);
+	int maxY = GetSpawnGridCoord(y + paddedRadius);
+
+	if (static_cast<int64_t>(maxX - minX + 1) * (maxY - minY + 1) > SPAWN_GRID_MAX_QUERY_CELLS)
+		return false;
+
+	for (int cellX = minX; cellX <= maxX; ++cellX)
+	{
+		for (int cellY = minY; cellY <= maxY; ++cellY)
+		{
+			auto iter = s_spawnGrid.find(MakeSpawnGridCell(cellX, cellY));
+			if (iter == s_spawnGrid.end())
+				continue;
+
+			for (PlayerClient* pSpawn : iter->second)
+				callback(pSpawn);
+		}
+	}
+
+	return true;
+}
+
+#pragma endregion
+
+#pragma region Spawn Index
+//----------------------------------------------------------------------------
+// spawn index
+//----------------------------------------------------------------------------
+
+// Spawns indexed by spawn ID and by lowercase name. Like the grid, these are updated as spawns
+// are added and removed, and are only used from the main thread. A spawn can be renamed while it
+// exists (for example, when it becomes a corpse). The game updates the name sprite when that
+// happens, which re-indexes the spawn, and names are also checked again once per pulse and by the
+// name lookups that find the spawn.
+//
+// Spawns that share a name are kept in the order they were indexed in, so a lookup finds the same
+// spawn the spawn manager would: the first one.
+
+static std::unordered_map<uint32_t, PlayerClient*> s_spawnsByID;
+static std::unordered_map<std::string, std::vector<PlayerClient*>> s_spawnsByName;
+
+// Indexed name of each spawn, so the old name can be removed after a rename.
+static std::unordered_map<PlayerClient*, std::string> s_spawnIndexNames;
+
+// False until the index has seen every spawn. Lookups that miss fall back to the spawn manager
+// until then.
+static bool s_spawnIndexSynced = false;
+
+static void RemoveFromSpawnNameIndex(PlayerClient* pSpawn)
+{
+	auto iter = s_spawnIndexNames.find(pSpawn);
+	if (iter == s_spawnIndexNames.end())
+		return;
+
+	auto nameIter = s_spawnsByName.find(iter->second);
+	if (nameIter != s_spawnsByName.end())
+	{
+		std::vector<PlayerClient*>& spawns = nameIter->second;
+		spawns.erase(std::remove(spawns.begin(), spawns.end(), pSpawn), spawns.end());
+
+		if (spawns.empty())
+			s_spawnsByName.erase(nameIter);
+	}
+
+	s_spawnIndexNames.erase(iter);
+}
+
+static void AddToSpawnNameIndex(PlayerClient* pSpawn)
+{
+	RemoveFromSpawnNameIndex(pSpawn);
+
+	if (!pSpawn->Name[0])
+		return;
+
+	std::string name = to_lower_copy(pSpawn->Name);
+	s_spawnsByName[name].push_back(pSpawn);
+	s_spawnIndexNames.emplace(pSpawn, std::move(name));
+}
+
+static void UpdateSpawnNameIndex(PlayerClient* pSpawn)
+{
+	auto iter = s_spawnIndexNames.find(pSpawn);
+	if (iter != s_spawnIndexNames.end() && ci_equals(iter->second, pSpawn->Name))
+		return;
+
+	AddToSpawnNameIndex(pSpawn);
+}
+
+// Like UpdateSpawnNameIndex, but only for spawns that are already indexed.
+static void UpdateIndexedSpawnName(PlayerClient* pSpawn)
+{
+	auto iter = s_spawnIndexNames.find(pSpawn);
+	if (iter != s_spawnIndexNames.end() && !ci_equals(iter->second, pSpawn->Name))
+		AddToSpawnNameIndex(pSpawn);
+}
+
+static void AddToSpawnIndex(PlayerClient* pSpawn)
+{
+	s_spawnsByID[pSpawn->SpawnID] = pSpawn;
+	AddToSpawnNameIndex(pSpawn);
+}
+
+static void RemoveFromSpawnIndex(PlayerClient* pSpawn)
+{
+	auto iter = s_spawnsByID.find(pSpawn->SpawnID);
+	if (iter != s_spawnsByID.end() && iter->second == pSpawn)
+		s_spawnsByID.erase(iter);
+
+	RemoveFromSpawnNameIndex(pSpawn);
+}
+
+static void ClearSpawnIndex()
+{
+	s_spawnsByID.clear();
+	s_spawnsByName.clear();
+	s_spawnIndexNames.clear();
+	s_spawnIndexSynced = false;
+}
+
+PlayerClient* FindSpawnByID(uint32_t spawnID)
+{
+	if (!pSpawnManager)
+		return nullptr;
+
+	if (IsMainThread())
+	{
+		auto iter = s_spawnsByID.find(spawnID);
+		if (iter != s_spawnsByID.end() && iter->second->SpawnID == spawnID)
+			return iter->second;
+
+		if (s_spawnIndexSynced)
+			return nullptr;
+	}
+
+	return pSpawnManager->GetSpawnByID(spawnID);
+}
+
+PlayerClient* FindSpawnByName(const char* spawnName)
+{
+	if (!pSpawnManager || !spawnName)
+		return nullptr;
+
+	if (!IsMainThread())
+		return pSpawnManager->GetSpawnByName(spawnName);
+
+	static std::string s_lookupName;
+	s_lookupName.assign(spawnName);
+	for (char& ch : s_lookupName)
+		ch = static_cast<char>(::tolower(static_cast<unsigned char>(ch)));
+
+	PlayerClient* pFound = nullptr;
+	bool renamed = false;
+
+	auto iter = s_spawnsByName.find(s_lookupName);
+	if (iter != s_spawnsByName.end())
+	{
+		for (PlayerClient* pSpawn : iter->second)
+		{
+			if (ci_equals(pSpawn->Name, spawnName))
+			{
+				pFound = pSpawn;
+				break;
+			}
+
+			renamed = true;
+		}
+	}
+
+	if (renamed)
+	{
+		// Spawns renamed since the last pulse, index them under their new names.
+		static std::vector<PlayerClient*> s_renamed;
+		s_renamed.clear();
+
+		for (PlayerClient* pSpawn : iter->second)
+		{
+			if (!ci_equals(pSpawn->Name, spawnName))
+				s_renamed.push_back(pSpawn);
+		}
+
+		for (PlayerClient* pSpawn : s_renamed)
+			AddToSpawnNameIndex(pSpawn);
+	}
+
+	if (pFound || (s_spawnIndexSynced && !renamed))
+		return pFound;
+
+	return pSpawnManager->GetSpawnByName(spawnName);
+}
+
+#pragma endregion
+
+#pragma region Spawn Sorting
+//----------------------------------------------------------------------------
+// spawn sorting
+//----------------------------------------------------------------------------
+
+// Number of nearest spawns that are sorted each pulse when LazySpawnSort is enabled.
+static constexpr size_t LAZY_SPAWN_SORT_COUNT = 32;
+
+// Number of leading entries of gSpawnsArray that are in order and nearer than every entry after them.
+static size_t s_sortedSpawnCount = 0;
+
+// Spawn positions and distances laid out for computing distances four at a time.
+static std::vector<float> s_spawnPosX;
+static std::vector<float> s_spawnPosY;
+static std::vector<float> s_spawnDistSq;
+
+static void ComputeDistancesSquared(float originX, float originY, const float* posX, const float* posY,
+	float* distSq, size_t count)
+{
+	const __m128 originX4 = _mm_set1_ps(originX);
+	const __m128 originY4 = _mm_set1_ps(originY);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 dX = _mm_sub_ps(originX4, _mm_loadu_ps(posX + i));
+		__m128 dY = _mm_sub_ps(originY4, _mm_loadu_ps(posY + i));
+		_mm_storeu_ps(distSq + i, _mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY)));
+	}
+
+	for (; i < count; ++i)
+	{
+		distSq[i] = GetDistanceSquared(originX, originY, posX[i], posY[i]);
+	}
+}
+
+static void UpdateSpawnsArrayDistances(float originX, float originY)
+{
+	const size_t count = gSpawnsArray.size();
+
+	s_spawnPosX.resize(count);
+	s_spawnPosY.resize(count);
+	s_spawnDistSq.resize(count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const PlayerClient* pSpawn = gSpawnsArray[i].GetSpawn();
+		s_spawnPosX[i] = pSpawn->X;
+		s_spawnPosY[i] = pSpawn->Y;
+	}
+
+	ComputeDistancesSquared(originX, originY, s_spawnPosX.data(), s_spawnPosY.data(), s_spawnDistSq.data(), count);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		gSpawnsArray[i] = MQSpawnArrayItem(gSpawnsArray[i].GetSpawn(), s_spawnDistSq[i]);
+	}
+
+	s_sortedSpawnCount = 0;
+}
+
+void EnsureSpawnsArraySorted(size_t count)
+{
+	const size_t size = gSpawnsArray.size();
+	if (count <= s_sortedSpawnCount || s_sortedSpawnCount >= size)
+		return;
+
+	// Callers typically walk the array one entry at a time, so grow the sorted range geometrically.
+	count = std::min(size, std::max(count, s_sortedSpawnCount * 2));
+
+	auto first = gSpawnsArray.begin() + s_sortedSpawnCount;
+	if (count == size)
+	{
+		std::sort(first, gSpawnsArray.end(), MQRankFloatCompare);
+	}
+	else
+	{
+		auto last = gSpawnsArray.begin() + count;
+		std::nth_element(first, last, gSpawnsArray.end(), MQRankFloatCompare);
+		std::sort(first, last, MQRankFloatCompare);
+	}
+
+	s_sortedSpawnCount = count;
+}
+
+// The order from the previous pulse is usually close to correct, so an insertion sort finishes in
+// near linear time. If too much has changed (for example after a teleport), use a full sort instead.
+static void SortSpawnsArray()
+{
+	const size_t maxShifts = gSpawnsArray.size() * 8;
+	size_t shifts = 0;
+
+	for (size_t i = 1; i < gSpawnsArray.size(); ++i)
+	{
+		if (!MQRankFloatCompare(gSpawnsArray[i], gSpawnsArray[i - 1]))
+			continue;
+
+		MQSpawnArrayItem item = gSpawnsArray[i];
+		size_t j = i;
+
+		do
+		{
+			gSpawnsArray[j] = gSpawnsArray[j - 1];
+			--j;
+			++shifts;
+		} while (j > 0 && MQRankFloatCompare(item, gSpawnsArray[j - 1]));
+
+		gSpawnsArray[j] = item;
+
+		if (shifts > maxShifts)
+		{
+			std::sort(std::begin(gSpawnsArray), std::end(gSpawnsArray), MQRankFloatCompare);
+			break;
+		}
+	}
+
+	s_sortedSpawnCount = gSpawnsArray.size();
+}
+
+#pragma endregion
+
 void UpdateMQ2SpawnSort()
 {
 	EnterMQ2Benchmark(bmUpdateSpawnSort);
 
-	EQP_DistArray = nullptr;
-	gSpawnCount = 0;
-	gSpawnsArray.clear();
+	ClearSpawnSearchCache();
 
 	float myX = 0, myY = 0;
 	if (pControlledPlayer)
@@ -915,19 +1726,47 @@ void UpdateMQ2SpawnSort()
 	}
 
 	// we need to make sure the spawn manager is valid here because this can get called from login pulse before the spawn manager is valid
+	size_t spawnCount = 0;
 	if (pSpawnManager)
 	{
-		PlayerClient* pSpawn = pSpawnManager->FirstSpawn;
-		while (pSpawn)
+		for (PlayerClient* pSpawn = pSpawnManager->FirstSpawn; pSpawn; pSpawn = pSpawn->pNext)
+			++spawnCount;
+	}
+
+	// Spawns are added and removed through Spawns_SpawnAdded and Spawns_SpawnRemoved, so the array
+	// only needs to be rebuilt if the list has changed without us seeing it.
+	if (spawnCount != gSpawnsArray.size())
+	{
+		gSpawnsArray.clear();
+		ClearSpawnGrid();
+		ClearSpawnIndex();
+
+		if (pSpawnManager)
 		{
-			float distSq = GetDistanceSquared(myX, myY, pSpawn->X, pSpawn->Y);
+			for (PlayerClient* pSpawn = pSpawnManager->FirstSpawn; pSpawn; pSpawn = pSpawn->pNext)
+			{
+				gSpawnsArray.emplace_back(pSpawn, 0.0f);
+				AddToSpawnIndex(pSpawn);
+			}
 
-			gSpawnsArray.emplace_back(pSpawn, distSq);
-			pSpawn = pSpawn->pNext;
+			s_spawnIndexSynced = true;
 		}
 	}
 
-	std::sort(std::begin(gSpawnsArray), std::end(gSpawnsArray), MQRankFloatCompare);
+	UpdateSpawnsArrayDistances(myX, myY);
+
+	// In lazy mode only the nearest few spawns are put in order. Anything that needs to walk further
+	// through the array sorts more of it on demand.
+	if (gbLazySpawnSort)
+		EnsureSpawnsArraySorted(LAZY_SPAWN_SORT_COUNT);
+	else
+		SortSpawnsArray();
+
+	for (const MQSpawnArrayItem& item : gSpawnsArray)
+	{
+		UpdateSpawnGridCell(item.GetSpawn());
+		UpdateSpawnNameIndex(item.GetSpawn());
+	}
 
 	gSpawnCount = static_cast<int>(gSpawnsArray.size());
 	EQP_DistArray = gSpawnCount > 0 ? &gSpawnsArray[0] : nullptr;
@@ -1037,6 +1876,9 @@ static void Spawns_Shutdown()
 	RemoveDetour(EQItemList__add_item);
 	RemoveDetour(EQItemList__delete_item);
 
+	// nothing keeps it up to date anymore
+	ResetGroundItemIndex();
+
 	ProcessPending = false;
 
 	{
@@ -1053,6 +1895,11 @@ static void Spawns_Shutdown()
 	EQP_DistArray = nullptr;
 	gSpawnCount = 0;
 	gSpawnsArray.clear();
+	s_sortedSpawnCount = 0;
+	ClearSpawnSearchCache();
+	ClearSpawnGrid();
+	ClearSpawnIndex();
+	InvalidateCaptionStates();
 
 	RemoveMQ2Benchmark(bmUpdateSpawnSort);
 	RemoveMQ2Benchmark(bmUpdateSpawnCaptions);
@@ -1083,19 +1930,24 @@ static void Spawns_Pulse()
 		LastTarget = 0;
 	}
 
-	if (nCaptions > CAPTION_UPDATE_FRAMES)
+	// Captions that track their values are checked every frame. Volatile captions are refreshed
+	// on the caption timer.
 	{
 		MQScopedBenchmark bm(bmUpdateSpawnCaptions);
-		nCaptions = 0;
-		
-		UpdateSpawnCaptions();
+		bool fullPass = nCaptions > CAPTION_UPDATE_FRAMES;
+		if (fullPass)
+			nCaptions = 0;
+
+		UpdateSpawnCaptions(fullPass);
 	}
 
 	if (pTarget)
 	{
 		LastTarget = pTarget->SpawnID;
 		pTarget.get_as<PlayerClientHook>()->SetNameSpriteTint_Trampoline();
-		UpdateNameSpriteState(pTarget, true);
+
+		if (!IsCaptionCurrent(pTarget, GetCaptionTemplate(pTarget), true))
+			UpdateNameSpriteState(pTarget, true);
 	}
 
 	ProcessPendingGroundItems();
@@ -1103,11 +1955,38 @@ static void Spawns_Pulse()
 
 static void Spawns_BeginZone()
 {
+	EQP_DistArray = nullptr;
+	gSpawnCount = 0;
 	gSpawnsArray.clear();
+	s_sortedSpawnCount = 0;
+	ClearSpawnSearchCache();
+	ClearSpawnGrid();
+	ClearSpawnIndex();
+	s_captionStates.clear();
+
+	// Spawns in the new zone are all seen by Spawns_SpawnAdded.
+	s_spawnIndexSynced = true;
 }
 
 void Spawns_SpawnAdded(PlayerClient* pNewSpawn)
 {
+	ClearSpawnSearchCache();
+
+	// The new spawn goes to the end of the array, so only the sorted entries that are nearer than it
+	// remain sorted. The next sort moves it into place.
+	const PlayerClient* pOrigin = pControlledPlayer;
+	MQSpawnArrayItem newItem(pNewSpawn, pOrigin ? GetDistanceSquared(pOrigin->X, pOrigin->Y, pNewSpawn->X, pNewSpawn->Y) : 0.0f);
+
+	s_sortedSpawnCount = std::upper_bound(gSpawnsArray.begin(), gSpawnsArray.begin() + s_sortedSpawnCount,
+		newItem, MQRankFloatCompare) - gSpawnsArray.begin();
+
+	gSpawnsArray.push_back(newItem);
+	gSpawnCount = static_cast<int>(gSpawnsArray.size());
+	EQP_DistArray = &gSpawnsArray[0];
+
+	UpdateSpawnGridCell(pNewSpawn);
+	AddToSpawnIndex(pNewSpawn);
+
 	if (!gMQCaptions)
 		return;
 
@@ -1116,13 +1995,24 @@ void Spawns_SpawnAdded(PlayerClient* pNewSpawn)
 
 static void Spawns_SpawnRemoved(PlayerClient* pSpawn)
 {
-	if (gSpawnsArray.empty())
+	ClearSpawnSearchCache();
+	RemoveFromSpawnGrid(pSpawn);
+	RemoveFromSpawnIndex(pSpawn);
+	s_captionStates.erase(pSpawn);
+
+	auto iter = std::find_if(std::begin(gSpawnsArray), std::end(gSpawnsArray),
+		[pSpawn](const MQSpawnArrayItem& item) { return item.GetSpawn() == pSpawn; });
+	if (iter == std::end(gSpawnsArray))
 		return;
 
-	gSpawnsArray.erase(
-		std::remove_if(std::begin(gSpawnsArray), std::end(gSpawnsArray),
-			[pSpawn](const MQSpawnArrayItem& item) { return item.GetSpawn() == pSpawn; }),
-		std::end(gSpawnsArray));
+	// Removing an entry keeps the rest in the same order.
+	if (static_cast<size_t>(iter - std::begin(gSpawnsArray)) < s_sortedSpawnCount)
+		--s_sortedSpawnCount;
+
+	gSpawnsArray.erase(iter);
+
+	gSpawnCount = static_cast<int>(gSpawnsArray.size());
+	EQP_DistArray = gSpawnCount > 0 ? &gSpawnsArray[0] : nullptr;
 }
 
 //----------------------------------------------------------------------------
@@ -1132,6 +2022,7 @@ static void Spawns_SpawnRemoved(PlayerClient* pSpawn)
 PlayerClient* GetClosestBanker(bool forInteraction)
 {
 	// gSpawnsArray is sorted by distance from the player, so the first banker we find will be the closest
+	EnsureSpawnsArraySorted();
 	for (const auto& spawn : gSpawnsArray)
 	{
 		if (forInteraction && spawn.GetDistanceSquared() > MAX_INTERACT_DISTANCE_SQUARED)
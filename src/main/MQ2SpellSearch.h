@@ -283,4 +283,8 @@ MQLIB_OBJECT SpellAttributePredicate<EQ_Affect> EvaluateBuffPredicate(std::strin
 MQLIB_OBJECT SpellAttributePredicate<EQ_Affect> EvaluatePetBuffPredicate(std::string_view dsl);
 MQLIB_OBJECT SpellAttributePredicate<CachedBuff> EvaluateCachedBuffPredicate(std::string_view dsl);
 
+// The slot of the first cached buff of the spawn matching the DSL, or -1. The result is kept until the
+// cached buffs of the spawn change.
+MQLIB_OBJECT int GetCachedBuffByQuery(PlayerClient* pSpawn, std::string_view dsl);
+
 } // namespace mq
@@ -15,14 +15,92 @@
 #include "pch.h"
 #include "MQ2Main.h"
 #include "MQ2SpellSearch.h"
+#include "MQSharedIndex.h"
 #include "mq/base/SimpleLexer.h"
 
+#include <filesystem>
+#include <tuple>
+
 namespace mq {
 
-ci_unordered::multimap<std::string_view, EQ_Spell*> s_spellNameMap;
-std::map<int, int> s_triggeredSpells;
+// The spell indices are built once the spells are loaded, in a layout that can be shared with the
+// other clients in the login session (see MQSharedIndex.h). They only hold spell ids, which are the
+// same in every client, and are turned into the spells of this client when they are looked up.
+struct SpellNameEntry
+{
+	uint32_t hash;                   // of the name, ignoring case
+	int32_t spellID;
+};
+
+struct SpellParentEntry
+{
+	int32_t spellID;                 // a spell that is triggered by the parent
+	int32_t parentID;
+};
+
+struct SpellIndexHeader
+{
+	uint32_t spellCount;             // spells with a name, checked against the spells that are loaded
+	uint32_t nameCount;              // name entries, sorted by hash and then in spell file order
+	uint32_t parentCount;            // parent entries, sorted by spell id
+	uint32_t spaCount;               // SPAs in the offset table, which has one more offset for the end
+	uint32_t spaSpellCount;          // ids of the spells that have each SPA, in spell file order
+};
+
+struct SpellIndex
+{
+	const SpellIndexHeader* header = nullptr;
+	const SpellNameEntry* names = nullptr;
+	const SpellParentEntry* parents = nullptr;
+	const uint32_t* spaOffsets = nullptr;
+	const int32_t* spaSpells = nullptr;
+};
+
+// Change this whenever the layout above, or what goes into it, changes.
+static constexpr uint32_t SpellIndexVersion = 1;
+static constexpr int MaxIndexedSPA = 1024;
+
 std::recursive_mutex s_initializeSpellsMutex;
 
+// Points into the shared index, or into the local one if it couldn't be shared. Guarded by
+// s_initializeSpellsMutex, as are the two copies.
+static SpellIndex s_spellIndex;
+static std::unique_ptr<SharedIndex> s_sharedSpellIndex;
+static std::vector<uint8_t> s_localSpellIndex;
+
+// Spells that GetSpellFromMap picked for a name, for the class and level they were picked for.
+// Keys are views into the name of the first spell with that name. Guarded by s_initializeSpellsMutex.
+static ci_unordered::map<std::string_view, EQ_Spell*> s_resolvedSpellNames;
+static int s_resolvedSpellsClass = -1;
+static int s_resolvedSpellsLevel = -1;
+
+// Results of FindSpellsWithSPA by SPA, class and level, so that walking ${SpellWithSPA[spa,n]}
+// doesn't filter the spells again for every n. Guarded by s_initializeSpellsMutex.
+static std::map<std::tuple<int, int, int>, std::shared_ptr<const std::vector<int>>> s_spellsWithSPA;
+static constexpr size_t MaxSpellsWithSPACache = 256;
+
+// The spells with the name that GetSpellFromMap is looking up. Guarded by s_initializeSpellsMutex.
+static std::vector<EQ_Spell*> s_spellNameMatches;
+
+static uint32_t HashSpellName(std::string_view name)
+{
+	uint32_t hash = 2166136261U;
+	for (char c : name)
+	{
+		hash ^= static_cast<uint32_t>(::tolower(static_cast<unsigned char>(c)));
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+struct SpellNameHashLess
+{
+	bool operator()(const SpellNameEntry& a, const SpellNameEntry& b) const { return a.hash < b.hash; }
+	bool operator()(const SpellNameEntry& entry, uint32_t hash) const { return entry.hash < hash; }
+	bool operator()(uint32_t hash, const SpellNameEntry& entry) const { return hash < entry.hash; }
+};
+
 static const ci_unordered::map<std::string_view, eEQSPELLCAT> s_spellCatLookup = {
 { "Aegolism"            , SPELLCAT_AEGOLISM },
 { "Agility"             , SPELLCAT_AGILITY },
@@ -822,7 +900,7 @@ static bool IsRecursiveEffect(int spa)
 	return false;
 }
 
-static void PopulateTriggeredMap(const EQ_Spell* pSpell)
+static void AddTriggeredSpells(const EQ_Spell* pSpell, std::map<int, int>& parents)
 {
 	if (!pSpell || pSpell->CannotBeScribed)
 		return;
@@ -834,36 +912,279 @@ static void PopulateTriggeredMap(const EQ_Spell* pSpell)
 
 		int triggeredSpellID = (int)GetSpellBase2(pSpell, i);
 		if (i > 0)
-			s_triggeredSpells[triggeredSpellID] = pSpell->ID;
+			parents[triggeredSpellID] = pSpell->ID;
 	}
 }
 
+static void AddToSPAIndex(const EQ_Spell* pSpell, std::vector<std::vector<int>>& spellsBySPA)
+{
+	for (int i = 0; i < pSpell->NumEffects; i++)
+	{
+		const int spa = GetSpellAttrib(pSpell, i);
+		if (spa < 0 || spa >= MaxIndexedSPA || spa == SPA_NOSPELL)
+			continue;
+
+		if (spa >= static_cast<int>(spellsBySPA.size()))
+			spellsBySPA.resize(spa + 1);
+
+		// A spell can have the same SPA in more than one slot.
+		std::vector<int>& spellIDs = spellsBySPA[spa];
+		if (spellIDs.empty() || spellIDs.back() != pSpell->ID)
+			spellIDs.push_back(pSpell->ID);
+	}
+}
+
+std::shared_ptr<const std::vector<int>> FindSpellsWithSPA(int spa, int classID, int maxLevel)
+{
+	static const auto s_noSpells = std::make_shared<const std::vector<int>>();
+
+	std::scoped_lock lock(s_initializeSpellsMutex);
+
+	if (!gbSpelldbLoaded || !s_spellIndex.header || spa < 0 || spa >= static_cast<int>(s_spellIndex.header->spaCount))
+		return s_noSpells;
+
+	if (classID != 0 && !IsPlayerClass(classID))
+		return s_noSpells;
+
+	if (classID == 0)
+		maxLevel = 0;
+
+	auto& cached = s_spellsWithSPA[std::make_tuple(spa, classID, maxLevel)];
+	if (cached)
+		return cached;
+
+	const int32_t* first = s_spellIndex.spaSpells + s_spellIndex.spaOffsets[spa];
+	const int32_t* last = s_spellIndex.spaSpells + s_spellIndex.spaOffsets[spa + 1];
+
+	auto result = std::make_shared<std::vector<int>>();
+	if (classID == 0)
+	{
+		result->assign(first, last);
+	}
+	else
+	{
+		for (const int32_t* iter = first; iter != last; ++iter)
+		{
+			const int spellID = *iter;
+			EQ_Spell* pSpell = GetSpellByID(spellID);
+			if (!pSpell)
+				continue;
+
+			const int level = pSpell->ClassLevel[classID];
+			if (level == 0 || level > MAX_PC_LEVEL || (maxLevel > 0 && level > maxLevel))
+				continue;
+
+			result->push_back(spellID);
+		}
+	}
+
+	// Levels and classes only change so often, but don't let a macro that walks all of them grow this forever.
+	if (s_spellsWithSPA.size() > MaxSpellsWithSPACache)
+	{
+		s_spellsWithSPA.clear();
+		return s_spellsWithSPA[std::make_tuple(spa, classID, maxLevel)] = std::move(result);
+	}
+
+	return cached = std::move(result);
+}
+
 EQ_Spell* GetSpellParent(int id)
 {
-	auto iter = s_triggeredSpells.find(id);
-	if (iter != s_triggeredSpells.end())
-		return GetSpellByID(iter->second);
+	if (!s_spellIndex.header)
+		return nullptr;
+
+	const SpellParentEntry* first = s_spellIndex.parents;
+	const SpellParentEntry* last = first + s_spellIndex.header->parentCount;
+
+	auto iter = std::lower_bound(first, last, id,
+		[](const SpellParentEntry& entry, int spellID) { return entry.spellID < spellID; });
+	if (iter != last && iter->spellID == id)
+		return GetSpellByID(iter->parentID);
 
 	return nullptr;
 }
 
-void PopulateSpellMap()
+template <typename T>
+static void AppendToSpellIndex(std::vector<uint8_t>& index, const T* values, size_t count)
 {
-	std::scoped_lock lock(s_initializeSpellsMutex);
+	const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+	index.insert(index.end(), bytes, bytes + count * sizeof(T));
+}
 
-	gbSpelldbLoaded = false;
+static std::vector<uint8_t> BuildSpellIndex()
+{
+	static_assert(sizeof(int) == sizeof(int32_t), "spell ids are copied into the index as they are");
 
-	s_triggeredSpells.clear();
-	s_spellNameMap.clear();
+	std::vector<SpellNameEntry> names;
+	std::map<int, int> parents;
+	std::vector<std::vector<int>> spellsBySPA;
+
+	names.reserve(std::size(pSpellMgr->Spells));
 
 	for (EQ_Spell* pSpell : pSpellMgr->Spells)
 	{
 		if (!pSpell || !pSpell->Name[0])
 			continue;
 
-		PopulateTriggeredMap(pSpell);
+		AddTriggeredSpells(pSpell, parents);
+		AddToSPAIndex(pSpell, spellsBySPA);
+
+		names.push_back({ HashSpellName(pSpell->Name), pSpell->ID });
+	}
+
+	// Spells with the same name stay in spell file order, which is the order that they are resolved in.
+	std::stable_sort(names.begin(), names.end(), SpellNameHashLess{});
+
+	SpellIndexHeader header;
+	header.spellCount = static_cast<uint32_t>(names.size());
+	header.nameCount = static_cast<uint32_t>(names.size());
+	header.parentCount = static_cast<uint32_t>(parents.size());
+	header.spaCount = static_cast<uint32_t>(spellsBySPA.size());
+	header.spaSpellCount = 0;
+
+	std::vector<uint32_t> spaOffsets;
+	spaOffsets.reserve(spellsBySPA.size() + 1);
+	for (const std::vector<int>& spellIDs : spellsBySPA)
+	{
+		spaOffsets.push_back(header.spaSpellCount);
+		header.spaSpellCount += static_cast<uint32_t>(spellIDs.size());
+	}
+	spaOffsets.push_back(header.spaSpellCount);
+
+	std::vector<uint8_t> index;
+	index.reserve(sizeof(SpellIndexHeader)
+		+ names.size() * sizeof(SpellNameEntry)
+		+ parents.size() * sizeof(SpellParentEntry)
+		+ spaOffsets.size() * sizeof(uint32_t)
+		+ header.spaSpellCount * sizeof(int32_t));
+
+	AppendToSpellIndex(index, &header, 1);
+	AppendToSpellIndex(index, names.data(), names.size());
 
-		s_spellNameMap.emplace(pSpell->Name, pSpell);
+	for (const auto& [spellID, parentID] : parents)
+	{
+		const SpellParentEntry entry{ spellID, parentID };
+		AppendToSpellIndex(index, &entry, 1);
+	}
+
+	AppendToSpellIndex(index, spaOffsets.data(), spaOffsets.size());
+	for (const std::vector<int>& spellIDs : spellsBySPA)
+		AppendToSpellIndex(index, spellIDs.data(), spellIDs.size());
+
+	return index;
+}
+
+// Points the spell index at an index that was built by BuildSpellIndex, here or in another client,
+// after checking that it is laid out the way its header says.
+static bool SetSpellIndex(const uint8_t* data, size_t size, uint32_t spellCount)
+{
+	s_spellIndex = SpellIndex{};
+
+	if (size < sizeof(SpellIndexHeader))
+		return false;
+
+	const SpellIndexHeader* header = reinterpret_cast<const SpellIndexHeader*>(data);
+	const uint64_t expectedSize = sizeof(SpellIndexHeader)
+		+ static_cast<uint64_t>(header->nameCount) * sizeof(SpellNameEntry)
+		+ static_cast<uint64_t>(header->parentCount) * sizeof(SpellParentEntry)
+		+ (static_cast<uint64_t>(header->spaCount) + 1) * sizeof(uint32_t)
+		+ static_cast<uint64_t>(header->spaSpellCount) * sizeof(int32_t);
+	if (expectedSize != size || header->spellCount != spellCount)
+		return false;
+
+	SpellIndex index;
+	index.header = header;
+	index.names = reinterpret_cast<const SpellNameEntry*>(data + sizeof(SpellIndexHeader));
+	index.parents = reinterpret_cast<const SpellParentEntry*>(index.names + header->nameCount);
+	index.spaOffsets = reinterpret_cast<const uint32_t*>(index.parents + header->parentCount);
+	index.spaSpells = reinterpret_cast<const int32_t*>(index.spaOffsets + header->spaCount + 1);
+
+	for (uint32_t spa = 0; spa < header->spaCount; ++spa)
+	{
+		if (index.spaOffsets[spa] > index.spaOffsets[spa + 1])
+			return false;
+	}
+
+	if (index.spaOffsets[header->spaCount] != header->spaSpellCount)
+		return false;
+
+	s_spellIndex = index;
+	return true;
+}
+
+// Identifies the spells that the index is built from. The names are covered directly, since they
+// are what the index is looked up by, and the effects by the spell file that they were loaded from.
+static uint64_t GetSpellDataHash(uint32_t& spellCount)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	};
+
+	spellCount = 0;
+	for (EQ_Spell* pSpell : pSpellMgr->Spells)
+	{
+		if (!pSpell || !pSpell->Name[0])
+			continue;
+
+		++spellCount;
+		add(&pSpell->ID, sizeof(pSpell->ID));
+		add(pSpell->Name, strlen(pSpell->Name));
+	}
+
+	std::error_code ec;
+	const std::filesystem::path spellFile = std::filesystem::path(internal_paths::EverQuest) / "spells_us.txt";
+	const uint64_t fileSize = std::filesystem::file_size(spellFile, ec);
+	const int64_t writeTime = std::filesystem::last_write_time(spellFile, ec).time_since_epoch().count();
+	add(&fileSize, sizeof(fileSize));
+	add(&writeTime, sizeof(writeTime));
+
+	return hash;
+}
+
+void PopulateSpellMap()
+{
+	std::scoped_lock lock(s_initializeSpellsMutex);
+
+	gbSpelldbLoaded = false;
+
+	s_spellIndex = SpellIndex{};
+	s_sharedSpellIndex.reset();
+	s_localSpellIndex.clear();
+	s_resolvedSpellNames.clear();
+	s_spellsWithSPA.clear();
+
+	uint32_t spellCount = 0;
+	const uint64_t dataHash = GetSpellDataHash(spellCount);
+
+	// Another client with the same build and spells may have already built the index.
+	s_sharedSpellIndex = SharedIndex::Open("spells", SpellIndexVersion, dataHash);
+	if (s_sharedSpellIndex && SetSpellIndex(s_sharedSpellIndex->GetData(), s_sharedSpellIndex->GetSize(), spellCount))
+	{
+		gbSpelldbLoaded = true;
+		return;
+	}
+
+	s_sharedSpellIndex.reset();
+	s_localSpellIndex = BuildSpellIndex();
+
+	// Once it is published, the clients after this one use the same copy, and so does this one.
+	s_sharedSpellIndex = SharedIndex::Publish("spells", SpellIndexVersion, dataHash, s_localSpellIndex);
+	if (s_sharedSpellIndex && SetSpellIndex(s_sharedSpellIndex->GetData(), s_sharedSpellIndex->GetSize(), spellCount))
+	{
+		s_localSpellIndex.clear();
+		s_localSpellIndex.shrink_to_fit();
+	}
+	else
+	{
+		s_sharedSpellIndex.reset();
+		SetSpellIndex(s_localSpellIndex.data(), s_localSpellIndex.size(), spellCount);
 	}
 
 	gbSpelldbLoaded = true;
@@ -906,30 +1227,16 @@ bool IsSpellClassUsable(EQ_Spell* pSpell)
 	return false;
 }
 
-static EQ_Spell* GetSpellFromMap(std::string_view name)
+// Picks the spell a name refers to when more than one spell has it.
+static EQ_Spell* ResolveSpellFromMap(const PcProfile* profile, const std::vector<EQ_Spell*>& spells)
 {
-	auto profile = GetPcProfile();
-	if (!profile)
-		return nullptr;
-
-	auto range = s_spellNameMap.equal_range(name);
-
-	// no hits
-	if (range.first == range.second)
-		return nullptr;
-
-	// If there is only a single hit by name, just return that spell.
-	if (std::distance(range.first, range.second) == 1)
-		return range.first->second;
-
 	// Find the preferred spell for this class.
 	if (IsPlayerClass(profile->Class))
 	{
 		EQ_Spell* classUsableSpell = nullptr;
 
-		for (auto iter = range.first; iter != range.second; ++iter)
+		for (EQ_Spell* testSpell : spells)
 		{
-			EQ_Spell* testSpell = iter->second;
 			if (profile->Level >= testSpell->ClassLevel[profile->Class])
 			{
 				if (!classUsableSpell)
@@ -956,9 +1263,8 @@ static EQ_Spell* GetSpellFromMap(std::string_view name)
 	// we will have to roll through it again and see if its usable by any other class
 
 	EQ_Spell* usableSpell = nullptr;
-	for (auto iter = range.first; iter != range.second; ++iter)
+	for (EQ_Spell* testSpell : spells)
 	{
-		EQ_Spell* testSpell = iter->second;
 		if (IsSpellClassUsable(testSpell))
 		{
 			if (!usableSpell)
@@ -975,7 +1281,51 @@ static EQ_Spell* GetSpellFromMap(std::string_view name)
 		return usableSpell;
 
 	// couldn't find a good match, return the first spell that came back.
-	return range.first->second;
+	return spells.front();
+}
+
+static EQ_Spell* GetSpellFromMap(std::string_view name)
+{
+	auto profile = GetPcProfile();
+	if (!profile)
+		return nullptr;
+
+	// Which spell is preferred depends on the class and level, so picks are only reused
+	// until either of them changes.
+	if (s_resolvedSpellsClass != profile->Class || s_resolvedSpellsLevel != profile->Level)
+	{
+		s_resolvedSpellNames.clear();
+		s_resolvedSpellsClass = profile->Class;
+		s_resolvedSpellsLevel = profile->Level;
+	}
+
+	auto resolved = s_resolvedSpellNames.find(name);
+	if (resolved != s_resolvedSpellNames.end())
+		return resolved->second;
+
+	// Names that hash the same are told apart by the names of the spells themselves.
+	s_spellNameMatches.clear();
+
+	const SpellNameEntry* names = s_spellIndex.names;
+	auto [first, last] = std::equal_range(names, names + s_spellIndex.header->nameCount, HashSpellName(name), SpellNameHashLess{});
+	for (auto entry = first; entry != last; ++entry)
+	{
+		EQ_Spell* pSpell = GetSpellByID(entry->spellID);
+		if (pSpell && ci_equals(pSpell->Name, name))
+			s_spellNameMatches.push_back(pSpell);
+	}
+
+	// no hits
+	if (s_spellNameMatches.empty())
+		return nullptr;
+
+	// If there is only a single hit by name, just return that spell.
+	if (s_spellNameMatches.size() == 1)
+		return s_spellNameMatches.front();
+
+	EQ_Spell* pSpell = ResolveSpellFromMap(profile, s_spellNameMatches);
+	s_resolvedSpellNames.emplace(s_spellNameMatches.front()->Name, pSpell);
+	return pSpell;
 }
 
 EQ_Spell* GetSpellByName(std::string_view name)
@@ -1003,7 +1353,7 @@ EQ_Spell* GetSpellByName(std::string_view name)
 	}
 
 	std::scoped_lock lock(s_initializeSpellsMutex);
-	if (s_spellNameMap.empty())
+	if (!s_spellIndex.header || s_spellIndex.header->nameCount == 0)
 		return nullptr;
 
 	EnterMQ2Benchmark(bmSpellAccess);
@@ -4227,99 +4577,181 @@ void RemovePetBuff(PlayerClient* pChar, const char* szLine)
 
 // --------------------------- Buff Find DSL --------------------------------
 
-template <typename Buff, typename Caster = SpellCasterAttribute>
-static SpellAttributePredicate<Buff> InternalBuffEvaluate(std::string_view dsl)
+// The DSL compiles to a flat program instead of a tree of std::function. Every expression leaves one
+// result, so the program only needs that result and not a stack: a term sets it, "not" flips it, and
+// "and"/"or" jump over their right hand side when the left hand side already decided the outcome.
+enum class BuffQueryOp : uint8_t
 {
-	using DSL = SimpleLexer<SpellAttributePredicate<Buff>>;
+	False,
+	SPA,              // value is the spa, flag is whether it has to be an increase
+	Category,
+	SubCategory,
+	Class,
+	ID,
+	Name,
+	Caster,
+	CasterID,         // value is a spawn id, resolved when the query runs
+	Not,
+	And,              // value is the number of instructions to skip when the result is false
+	Or,               // value is the number of instructions to skip when the result is true
+};
 
-	static auto spaDSL = DSL(
-		[]() -> SpellAttributePredicate<Buff>
-		{ return [](const Buff&) { return false; }; },
-		"spa", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
-			{
-				auto spa = GetIntFromString(arg, -1);
-				if (spa < 0)
-					spa = GetSPAFromName(arg);
-				return SpellAffect(static_cast<eEQSPA>(spa));
-			}),
-		"detspa", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
-			{
-				auto spa = GetIntFromString(arg, -1);
-				if (spa < 0)
-					spa = GetSPAFromName(arg);
-				return SpellAffect(static_cast<eEQSPA>(spa), false);
-			}),
-		"cat", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
+struct BuffQueryInstruction
+{
+	BuffQueryOp op = BuffQueryOp::False;
+	int value = 0;
+	bool flag = false;
+	std::string text;
+};
+
+struct BuffQueryProgram
+{
+	std::vector<BuffQueryInstruction> code;
+	bool resolvesSpawns = false;      // the outcome can change without the buffs changing
+
+	BuffQueryProgram() = default;
+	BuffQueryProgram(BuffQueryInstruction&& instruction)
+		: resolvesSpawns(instruction.op == BuffQueryOp::CasterID)
+	{
+		code.push_back(std::move(instruction));
+	}
+
+	static BuffQueryProgram Join(BuffQueryProgram&& a, BuffQueryOp op, BuffQueryProgram&& b)
+	{
+		BuffQueryProgram program = std::move(a);
+		program.code.push_back({ op, static_cast<int>(b.code.size()) });
+		program.code.insert(program.code.end(),
+			std::make_move_iterator(b.code.begin()), std::make_move_iterator(b.code.end()));
+		program.resolvesSpawns |= b.resolvesSpawns;
+		return program;
+	}
+
+	template <typename Buff, typename Caster>
+	bool Run(const Buff& buff) const
+	{
+		bool result = false;
+
+		for (size_t pc = 0; pc < code.size(); ++pc)
+		{
+			const BuffQueryInstruction& instruction = code[pc];
+
+			switch (instruction.op)
 			{
-				auto cat = GetIntFromString(arg, 0);
-				if (cat == 0)
-					cat = GetSpellCategoryFromName(arg);
-				return SpellCategory(static_cast<eEQSPELLCAT>(cat));
-			}),
-		"subcat", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
+			case BuffQueryOp::False: result = false; break;
+			case BuffQueryOp::SPA: result = SpellAffect(static_cast<eEQSPA>(instruction.value), instruction.flag)(buff); break;
+			case BuffQueryOp::Category: result = SpellCategory(static_cast<eEQSPELLCAT>(instruction.value))(buff); break;
+			case BuffQueryOp::SubCategory: result = SpellSubCat(static_cast<eEQSPELLCAT>(instruction.value))(buff); break;
+			case BuffQueryOp::Class: result = SpellClass(instruction.value)(buff); break;
+			case BuffQueryOp::ID: result = SpellIDAttribute(instruction.value)(buff); break;
+			case BuffQueryOp::Name: result = SpellNameAttribute(instruction.text)(buff); break;
+			case BuffQueryOp::Caster: result = Caster(instruction.text)(buff); break;
+			case BuffQueryOp::CasterID:
 			{
-				auto cat = GetIntFromString(arg, 0);
-				if (cat == 0)
-					cat = GetSpellCategoryFromName(arg);
-				return SpellSubCat(static_cast<eEQSPELLCAT>(cat));
-			}),
-		"class", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
+				SPAWNINFO* pSpawn = GetSpawnByID(instruction.value);
+				result = pSpawn != nullptr && Caster(pSpawn->Name)(buff);
+				break;
+			}
+			case BuffQueryOp::Not: result = !result; break;
+			case BuffQueryOp::And: if (!result) pc += instruction.value; break;
+			case BuffQueryOp::Or: if (result) pc += instruction.value; break;
+			}
+		}
+
+		return result;
+	}
+};
+
+static int GetSpellAffectFromArg(std::string_view arg)
+{
+	auto spa = GetIntFromString(arg, -1);
+	if (spa < 0)
+		spa = GetSPAFromName(arg);
+	return spa;
+}
+
+static int GetSpellCategoryFromArg(std::string_view arg)
+{
+	auto cat = GetIntFromString(arg, 0);
+	if (cat == 0)
+		cat = GetSpellCategoryFromName(arg);
+	return cat;
+}
+
+static std::shared_ptr<const BuffQueryProgram> CompileBuffQuery(std::string_view dsl)
+{
+	using DSL = SimpleLexer<BuffQueryProgram>;
+
+	static auto spaDSL = DSL(
+		[]() -> BuffQueryProgram
+		{ return BuffQueryInstruction{ BuffQueryOp::False }; },
+		"spa", DSL::Term([](std::string_view arg) -> BuffQueryProgram
+			{ return BuffQueryInstruction{ BuffQueryOp::SPA, GetSpellAffectFromArg(arg), true }; }),
+		"detspa", DSL::Term([](std::string_view arg) -> BuffQueryProgram
+			{ return BuffQueryInstruction{ BuffQueryOp::SPA, GetSpellAffectFromArg(arg), false }; }),
+		"cat", DSL::Term([](std::string_view arg) -> BuffQueryProgram
+			{ return BuffQueryInstruction{ BuffQueryOp::Category, GetSpellCategoryFromArg(arg) }; }),
+		"subcat", DSL::Term([](std::string_view arg) -> BuffQueryProgram
+			{ return BuffQueryInstruction{ BuffQueryOp::SubCategory, GetSpellCategoryFromArg(arg) }; }),
+		"class", DSL::Term([](std::string_view arg) -> BuffQueryProgram
 			{
 				auto player_class = GetIntFromString(arg, 0);
 				if (player_class == 0)
 					player_class = GetPlayerClass(arg);
-				return SpellClass(static_cast<PlayerClass>(player_class));
+				return BuffQueryInstruction{ BuffQueryOp::Class, player_class };
 			}),
-		"id", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
-			{ return SpellIDAttribute(GetIntFromString(arg, 0)); }),
-		"name", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
-			{ return SpellNameAttribute(arg); }),
-		"caster", DSL::Term([](std::string_view arg) -> SpellAttributePredicate<Buff>
+		"id", DSL::Term([](std::string_view arg) -> BuffQueryProgram
+			{ return BuffQueryInstruction{ BuffQueryOp::ID, GetIntFromString(arg, 0) }; }),
+		"name", DSL::Term([](std::string_view arg) -> BuffQueryProgram
+			{ return BuffQueryInstruction{ BuffQueryOp::Name, 0, false, std::string(arg) }; }),
+		"caster", DSL::Term([](std::string_view arg) -> BuffQueryProgram
 			{
 				auto id = GetIntFromString(arg, -1);
 				if (id >= 0)
-				{
-					auto name = GetSpawnByID(id);
-					if (name != nullptr)
-						return Caster(name->Name);
-
-					return [](const Buff&) { return false; };
-				}
+					return BuffQueryInstruction{ BuffQueryOp::CasterID, id };
 
-				return Caster(arg);
+				return BuffQueryInstruction{ BuffQueryOp::Caster, 0, false, std::string(arg) };
 			}),
-		"and", DSL::Reducer([](SpellAttributePredicate<Buff>&& a, SpellAttributePredicate<Buff>&& b) -> SpellAttributePredicate<Buff>
-			{ return BothSpellAttribute<Buff>(std::move(a), std::move(b)); }),
-		"or", DSL::Reducer([](SpellAttributePredicate<Buff>&& a, SpellAttributePredicate<Buff>&& b) -> SpellAttributePredicate<Buff>
-			{ return EitherSpellAttribute<Buff>(std::move(a), std::move(b)); }),
-		"not", DSL::Modifier([](SpellAttributePredicate<Buff>&& a) -> SpellAttributePredicate<Buff>
-			{ return NotSpellAttribute<Buff>(std::move(a)); })
+		"and", DSL::Reducer([](BuffQueryProgram&& a, BuffQueryProgram&& b) -> BuffQueryProgram
+			{ return BuffQueryProgram::Join(std::move(a), BuffQueryOp::And, std::move(b)); }),
+		"or", DSL::Reducer([](BuffQueryProgram&& a, BuffQueryProgram&& b) -> BuffQueryProgram
+			{ return BuffQueryProgram::Join(std::move(a), BuffQueryOp::Or, std::move(b)); }),
+		"not", DSL::Modifier([](BuffQueryProgram&& a) -> BuffQueryProgram
+			{
+				a.code.push_back({ BuffQueryOp::Not });
+				return std::move(a);
+			})
 	);
 
-	static ci_unordered::map<std::string_view, SpellAttributePredicate<Buff>> s_dslMap;
-	static ci_unordered::set<std::string> s_dsls; // storing like this prevents allocating a string every time
+	// The programs own their strings, so they are shared by every kind of buff, and queries that
+	// fail to parse are kept too, so that the error is only reported once.
+	static ci_unordered::map<std::string, std::shared_ptr<const BuffQueryProgram>> s_programs;
 
+	auto iter = s_programs.find(dsl);
+	if (iter != s_programs.end())
+		return iter->second;
+
+	std::shared_ptr<const BuffQueryProgram> program;
 	try
 	{
-		auto maybe_predicate = s_dslMap.find(dsl);
-		if (maybe_predicate == s_dslMap.end())
-		{
-			auto [dsl_iter, _] = s_dsls.emplace(dsl);
-
-			// this guarantees ownership of the DSL string is in the set, so we are free to use string_view's for everything in the DSL
-			auto predicate = spaDSL(*dsl_iter);
-			s_dslMap[*dsl_iter] = predicate;
-
-			return predicate;
-		}
-
-		return maybe_predicate->second;
+		program = std::make_shared<const BuffQueryProgram>(spaDSL(dsl));
 	}
 	catch (SimpleLexerParseError& e)
 	{
 		WriteChatf("%s", e.msg().c_str());
-		return [](const Buff&) { return false; };
+		program = std::make_shared<const BuffQueryProgram>(BuffQueryInstruction{ BuffQueryOp::False });
 	}
+
+	s_programs.emplace(dsl, program);
+	return program;
+}
+
+template <typename Buff, typename Caster = SpellCasterAttribute>
+static SpellAttributePredicate<Buff> InternalBuffEvaluate(std::string_view dsl)
+{
+	return [program = CompileBuffQuery(dsl)](const Buff& buff)
+	{
+		return program->Run<Buff, Caster>(buff);
+	};
 }
 
 SpellAttributePredicate<EQ_Affect> mq::EvaluateBuffPredicate(std::string_view dsl)
@@ -4337,6 +4769,61 @@ SpellAttributePredicate<CachedBuff> mq::EvaluateCachedBuffPredicate(std::string_
     return InternalBuffEvaluate<CachedBuff>(dsl);
 }
 
+// The same queries are checked against the same spawns over and over, by buff checking macros that
+// look at each member of the group every pulse. The cached buffs of a spawn only change when a buff
+// packet arrives or a buff expires, which gives them a new epoch, so the results are kept until then.
+int GetCachedBuffByQuery(SPAWNINFO* pSpawn, std::string_view dsl)
+{
+	if (!pSpawn)
+		return -1;
+
+	struct QueryResult
+	{
+		uint32_t epoch = 0;
+		int slot = -1;
+	};
+
+	struct CachedQuery
+	{
+		std::shared_ptr<const BuffQueryProgram> program;
+		std::unordered_map<uint32_t, QueryResult> results;    // spawn id -> result
+	};
+
+	static ci_unordered::map<std::string, CachedQuery> s_queries;
+
+	auto iter = s_queries.find(dsl);
+	if (iter == s_queries.end())
+	{
+		// Queries built from changing strings would otherwise collect forever.
+		if (s_queries.size() >= 256)
+			s_queries.clear();
+
+		iter = s_queries.emplace(dsl, CachedQuery{ CompileBuffQuery(dsl) }).first;
+	}
+
+	CachedQuery& query = iter->second;
+	const BuffQueryProgram& program = *query.program;
+
+	auto run = [&program](SPAWNINFO* pSpawn)
+	{
+		return GetCachedBuff(pSpawn, [&program](const CachedBuff& buff)
+			{ return program.Run<CachedBuff, SpellCasterAttribute>(buff); });
+	};
+
+	const uint32_t epoch = GetCachedBuffsEpoch(pSpawn);
+	if (epoch == 0 || program.resolvesSpawns)
+		return run(pSpawn);
+
+	QueryResult& result = query.results[pSpawn->SpawnID];
+	if (result.epoch != epoch)
+	{
+		result.epoch = epoch;
+		result.slot = run(pSpawn);
+	}
+
+	return result.slot;
+}
+
 //============================================================================
 
 static void InitializeSpells()
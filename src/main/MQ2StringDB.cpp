@@ -16,47 +16,114 @@
 #include "pch.h"
 #include "MQ2Main.h"
 
+#include <bitset>
+#include <optional>
+#include <unordered_map>
+
 namespace mq {
 
+// offsets into the serialized message
+constexpr DWORD TOKEN_STRINGID_OFFSET = 5;
+constexpr DWORD TOKEN_HEADER_LENGTH = 13;
+
 class TokenCallbackEntry
 {
 public:
 	int StringID;
 	int CallbackID;
 	fMQTokenMessageCmd Callback;
+	fMQTokenMessageViewCmd ViewCallback;
 
-	TokenCallbackEntry(int StringID, int CallbackID, fMQTokenMessageCmd Callback) :
-		StringID(StringID), CallbackID(CallbackID), Callback(Callback) {}
+	TokenCallbackEntry(int StringID, int CallbackID, fMQTokenMessageCmd Callback, fMQTokenMessageViewCmd ViewCallback) :
+		StringID(StringID), CallbackID(CallbackID), Callback(Callback), ViewCallback(ViewCallback) {}
 };
 
-static std::map<int, std::vector<std::unique_ptr<TokenCallbackEntry>>> callback_map;
+static std::unordered_map<int, std::vector<TokenCallbackEntry>> callback_map;
 
-int AddTokenMessageCmd(int StringID, fMQTokenMessageCmd Command)
+// One bit for every low 16 bits of a string id that has a callback. Most messages don't have one,
+// and this turns them away without a hash lookup.
+static std::bitset<65536> callback_filter;
+
+static size_t GetFilterBit(int StringID)
+{
+	return static_cast<uint32_t>(StringID) & 0xffff;
+}
+
+static int AddTokenCallback(int StringID, fMQTokenMessageCmd Command, fMQTokenMessageViewCmd ViewCommand)
 {
 	static int unique_id = 0;
 
-	callback_map[StringID].emplace_back(
-		std::make_unique<TokenCallbackEntry>(StringID, ++unique_id, Command));
+	callback_map[StringID].emplace_back(StringID, ++unique_id, Command, ViewCommand);
+
+	callback_filter.set(GetFilterBit(StringID));
 	return unique_id;
 }
 
+int AddTokenMessageCmd(int StringID, fMQTokenMessageCmd Command)
+{
+	return AddTokenCallback(StringID, Command, nullptr);
+}
+
+int AddTokenMessageCmd(int StringID, fMQTokenMessageViewCmd Command)
+{
+	return AddTokenCallback(StringID, nullptr, Command);
+}
+
 void RemoveTokenMessageCmd(int StringID, int CallbackID)
 {
 	auto entry = callback_map.find(StringID);
-	if (entry != std::end(callback_map))
+	if (entry == std::end(callback_map))
+		return;
+
+	std::vector<TokenCallbackEntry>& entries = entry->second;
+	entries.erase(std::remove_if(std::begin(entries), std::end(entries),
+		[CallbackID](const TokenCallbackEntry& cmd)
+		{
+			return cmd.CallbackID == CallbackID;
+		}),
+		std::end(entries));
+
+	if (entries.empty())
 	{
-		entry->second.erase(std::remove_if(std::begin(entry->second), std::end(entry->second),
-			[CallbackID](const std::unique_ptr<TokenCallbackEntry>& ptr)
+		callback_map.erase(entry);
+
+		// another string id may share the bit
+		const size_t bit = GetFilterBit(StringID);
+		callback_filter.reset(bit);
+		for (const auto& [id, _] : callback_map)
+		{
+			if (GetFilterBit(id) == bit)
 			{
-				return ptr && ptr->CallbackID == CallbackID;
-			}),
-			std::end(entry->second));
+				callback_filter.set(bit);
+				break;
+			}
+		}
 	}
 }
 
 // no need to copy the whole stream, just sweep a pointer over it and copy the individual elements.
 TokenTextParam::TokenTextParam(const char* Data, DWORD Length)
 {
+	TokenTextView view(Data, Length);
+
+	World = view.World;
+	StringID = view.StringID;
+	Color = view.Color;
+
+	// this could also currently be a loop of 9 elements since there are always currently 9 elements
+	// but doing it this way provides a guarantee that we always get all reported data without needing
+	// to adjust the code
+	const int count = view.GetTokenCount();
+	Tokens.reserve(count);
+	for (int i = 0; i < count; ++i)
+		Tokens.emplace_back(view.GetToken(i));
+}
+
+TokenTextView::TokenTextView(const char* Data, DWORD Length)
+{
+	if (!Data || Length < TOKEN_HEADER_LENGTH)
+		return;
+
 	char const* DataBuffer = Data;
 	DataBuffer += 4; // 4 bytes of padding
 
@@ -67,31 +134,75 @@ TokenTextParam::TokenTextParam(const char* Data, DWORD Length)
 	Color = *(int*)DataBuffer;
 	DataBuffer += 4;
 
-	// this could also currently be a loop of 9 elements since there are always currently 9 elements
-	// but doing it this way provides a guarantee that we always get all reported data without needing
-	// to adjust the code
-	while (DataBuffer < Data + Length)
+	m_tokens = DataBuffer;
+	m_end = Data + Length;
+}
+
+int TokenTextView::GetTokenCount() const
+{
+	int count = 0;
+	for (const char* DataBuffer = m_tokens; DataBuffer && m_end - DataBuffer >= 4; ++count)
 	{
 		int len = *(int*)DataBuffer;
-		DataBuffer += 4;
-		Tokens.emplace_back(DataBuffer, len);
-		DataBuffer += len;
+		if (len < 0 || len > m_end - DataBuffer - 4)
+			break;
+
+		DataBuffer += 4 + len;
 	}
+
+	return count;
+}
+
+std::string_view TokenTextView::GetToken(int Index) const
+{
+	for (const char* DataBuffer = m_tokens; DataBuffer && m_end - DataBuffer >= 4; --Index)
+	{
+		int len = *(int*)DataBuffer;
+		if (len < 0 || len > m_end - DataBuffer - 4)
+			break;
+
+		if (Index == 0)
+			return std::string_view(DataBuffer + 4, len);
+
+		DataBuffer += 4 + len;
+	}
+
+	return {};
 }
 
 DETOUR_TRAMPOLINE_DEF(void, msgTokenTextParam__Trampoline, (const char*, DWORD))
 void msgTokenTextParam__Detour(const char* Data, DWORD Length)
 {
-	if (Data)
+	if (Data && Length >= TOKEN_HEADER_LENGTH)
 	{
-		auto entry = callback_map.find(*(int*)(Data + 5));
-		if (entry != std::end(callback_map))
+		const int StringID = *(int*)(Data + TOKEN_STRINGID_OFFSET);
+
+		if (callback_filter.test(GetFilterBit(StringID)))
 		{
-			mq::TokenTextParam param(Data, Length);
-			for (const auto& cmd : entry->second)
+			TokenTextView view(Data, Length);
+
+			// the tokens are only copied out if a callback wants them that way
+			std::optional<TokenTextParam> param;
+
+			// callbacks may add or remove callbacks, so the list is looked up again for every one
+			for (size_t i = 0; ; ++i)
 			{
-				if (cmd)
-					cmd->Callback(param);
+				auto entry = callback_map.find(StringID);
+				if (entry == std::end(callback_map) || i >= entry->second.size())
+					break;
+
+				const TokenCallbackEntry cmd = entry->second[i];
+				if (cmd.ViewCallback)
+				{
+					cmd.ViewCallback(view);
+				}
+				else if (cmd.Callback)
+				{
+					if (!param)
+						param.emplace(Data, Length);
+
+					cmd.Callback(*param);
+				}
 			}
 		}
 	}
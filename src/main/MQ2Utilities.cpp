@@ -17,14 +17,23 @@
 
 #include "MQ2Mercenaries.h"
 #include "MQ2Utilities.h"
+#include "MQDataAPI.h"
+#include "MQWarmUp.h"
+#include "MQXTargets.h"
 
 #include <mq/api/Items.h>
+#include <mq/base/TransientArena.h>
 #include <mq/base/WString.h>
 
 #include <DbgHelp.h>
 #include <PathCch.h>
+#include <spdlog/async.h>
+#include <spdlog/sinks/base_sink.h>
 #include <wil/resource.h>
+#include <array>
+#include <optional>
 #include <random>
+#include <shared_mutex>
 
 #ifdef _DEBUG
 #define DBG_SPEW // enable DebugSpew messages in debug builds
@@ -39,27 +48,125 @@ namespace mq {
 // Description: Outputs text to debugger, usage is same as printf ;)
 //***************************************************************************
 
-static void LogToFile(const char* szOutput)
+// DebugSpew.log is written by a background thread. Messages are queued without waiting on the disk,
+// and if the queue ever fills up the oldest messages are dropped rather than stalling the thread
+// that is logging.
+static constexpr size_t DebugSpewQueueSize = 8192;
+static constexpr size_t DebugSpewMaxPending = 64 * 1024;
+static constexpr std::chrono::seconds DebugSpewFlushInterval{ 1 };
+
+// Every client on the machine appends to the same DebugSpew.log, so the file can't be held open.
+// The writer collects messages and opens the file only long enough to append them, the same way
+// each message used to be written. If another client has the file open the messages are kept
+// for the next flush.
+class DebugSpewFileSink : public spdlog::sinks::base_sink<std::mutex>
 {
-	FILE* fOut = nullptr;
+public:
+	explicit DebugSpewFileSink(std::string fileName)
+		: m_fileName(std::move(fileName))
+	{
+	}
 
-	const std::filesystem::path pathDebugSpew = std::filesystem::path(mq::internal_paths::Logs) / "DebugSpew.log";
-	fOut = _fsopen(pathDebugSpew.string().c_str(), "at", _SH_DENYWR);
+protected:
+	void sink_it_(const spdlog::details::log_msg& msg) override
+	{
+		spdlog::memory_buf_t formatted;
+		formatter_->format(msg, formatted);
+		m_pending.append(formatted.data(), formatted.size());
 
-	if (!fOut)
-		return;
+		if (m_pending.size() >= DebugSpewMaxPending)
+			flush_();
+	}
 
-#ifdef DBG_CHARNAME
-	char Name[256] = "Unknown";
-	if (pLocalPC)
+	void flush_() override
+	{
+		if (m_pending.empty())
+			return;
+
+		FILE* fOut = _fsopen(m_fileName.c_str(), "ab", _SH_DENYWR);
+		if (!fOut)
+		{
+			// Don't let the messages pile up if the file stays unavailable.
+			if (m_pending.size() >= DebugSpewMaxPending * 4)
+				m_pending.clear();
+			return;
+		}
+
+		fwrite(m_pending.data(), 1, m_pending.size(), fOut);
+		fclose(fOut);
+		m_pending.clear();
+	}
+
+private:
+	std::string m_fileName;
+	std::string m_pending;
+};
+
+static std::mutex s_debugSpewLogMutex;
+static std::shared_ptr<spdlog::details::thread_pool> s_debugSpewThreadPool;
+static std::shared_ptr<spdlog::logger> s_debugSpewLog;
+static std::atomic<int64_t> s_debugSpewLastFlush = 0;
+static bool s_debugSpewLogShutdown = false;
+
+static std::shared_ptr<spdlog::logger> GetDebugSpewLog()
+{
+	std::scoped_lock lock(s_debugSpewLogMutex);
+
+	if (!s_debugSpewLog && !s_debugSpewLogShutdown)
 	{
-		strcpy_s(Name, pLocalPC->Name);
+		try
+		{
+			const std::filesystem::path pathDebugSpew = std::filesystem::path(mq::internal_paths::Logs) / "DebugSpew.log";
+
+			auto sink = std::make_shared<DebugSpewFileSink>(pathDebugSpew.string());
+
+			s_debugSpewThreadPool = std::make_shared<spdlog::details::thread_pool>(DebugSpewQueueSize, 1);
+			s_debugSpewLog = std::make_shared<spdlog::async_logger>("DebugSpew", std::move(sink),
+				s_debugSpewThreadPool, spdlog::async_overflow_policy::overrun_oldest);
+			s_debugSpewLog->set_pattern("%v");
+		}
+		catch (const spdlog::spdlog_ex& ex)
+		{
+			SPDLOG_WARN("Failed to open DebugSpew.log: {}", ex.what());
+			s_debugSpewLogShutdown = true;
+		}
 	}
-	fprintf(fOut, "%s - ", Name);
+
+	return s_debugSpewLog;
+}
+
+void ShutdownDebugSpewLog()
+{
+	std::scoped_lock lock(s_debugSpewLogMutex);
+
+	// Destroying the thread pool waits for its queue to be written out.
+	s_debugSpewLogShutdown = true;
+	if (s_debugSpewLog)
+		s_debugSpewLog->flush();
+	s_debugSpewLog.reset();
+	s_debugSpewThreadPool.reset();
+}
+
+static void LogToFile(std::string_view output)
+{
+	std::shared_ptr<spdlog::logger> log = GetDebugSpewLog();
+	if (!log)
+		return;
+
+#ifdef DBG_CHARNAME
+	log->info("{} - {}", pLocalPC ? pLocalPC->Name : "Unknown", output);
+#else
+	log->info(output);
 #endif
 
-	fprintf(fOut, "%s\r\n", szOutput);
-	fclose(fOut);
+	// The writer collects messages, have it flush periodically so the file is never far behind.
+	const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+	int64_t lastFlush = s_debugSpewLastFlush;
+	if (now - lastFlush > std::chrono::steady_clock::duration(DebugSpewFlushInterval).count()
+		&& s_debugSpewLastFlush.compare_exchange_strong(lastFlush, now))
+	{
+		log->flush();
+	}
 }
 
 static void DebugSpewImpl(bool always, bool logToFile, const char* szFormat, va_list vaList)
@@ -67,21 +174,33 @@ static void DebugSpewImpl(bool always, bool logToFile, const char* szFormat, va_
 	if (!always && gFilterDebug)
 		return;
 
-	// _vscprintf doesn't count // terminating '\0'
-	int len = _vscprintf(szFormat, vaList) + 1;
-	size_t theLen = len + 32;
+	// Format on the stack, and only allocate for messages that don't fit.
+	char buffer[MAX_STRING];
+	std::unique_ptr<char[]> longBuffer;
+	char* szOutput = buffer;
 
-	auto out = std::make_unique<char[]>(theLen);
-	char* szOutput = out.get();
+	va_list args;
+	va_copy(args, vaList);
+	int len = vsnprintf(buffer, sizeof(buffer) - 1, szFormat, args);
+	va_end(args);
+
+	if (len < 0)
+		return;
 
-	vsprintf_s(szOutput, theLen, szFormat, vaList);
+	if (len >= static_cast<int>(sizeof(buffer)) - 1)
+	{
+		longBuffer = std::make_unique<char[]>(len + 2);
+		szOutput = longBuffer.get();
+		vsnprintf(szOutput, len + 1, szFormat, vaList);
+	}
 
-	strcat_s(szOutput, theLen, "\n");
+	szOutput[len] = '\n';
+	szOutput[len + 1] = '\0';
 	OutputDebugString(szOutput);
 
 	if (logToFile)
 	{
-		LogToFile(szOutput);
+		LogToFile(std::string_view(szOutput, len));
 	}
 }
 
@@ -544,292 +663,312 @@ void StripMQChat(const char* in, char* out)
 	StripMQChat(std::string_view{ in }, out);
 }
 
-static bool ReplaceSafely(char** out, size_t* pchar_out_string_position, char chr, size_t maxlen)
+static std::shared_ptr<MQChatLinks> ParseChatLinksUncached(std::string_view line)
 {
-	if ((*pchar_out_string_position) + 1 > maxlen)
-		return false;
-	(*out)[(*pchar_out_string_position)++] = chr;
-	return true;
+	auto result = std::make_shared<MQChatLinks>();
+	result->line = line;
+
+	if (line.find('\x12') == std::string_view::npos)
+	{
+		result->cleaned = result->line;
+		return result;
+	}
+
+	result->cleaned = std::string{ CleanItemTags(CXStr{ result->line }, false) };
+
+	TextTagInfo tags[MAX_EXTRACT_LINKS];
+	const size_t numTags = ExtractLinks(result->line, tags, MAX_EXTRACT_LINKS);
+
+	result->links.reserve(numTags);
+	for (size_t i = 0; i < numTags; ++i)
+	{
+		MQChatLinks::Link& link = result->links.emplace_back();
+		link.tag = tags[i];
+
+		ItemLinkInfo itemInfo;
+		if (link.tag.tagCode == ETAG_ITEM && ParseItemLink(link.tag.link, itemInfo))
+		{
+			link.itemID = itemInfo.itemID;
+			link.itemName = itemInfo.itemName;
+		}
+	}
+
+	return result;
 }
 
-DWORD MQToSTML(const char* in, char* out, size_t maxlen, uint32_t ColorOverride)
+std::shared_ptr<const MQChatLinks> ParseChatLinks(std::string_view line)
 {
-	//DebugSpew("MQToSTML(%s)",in);
-	// 1234567890123
-	// <c "#123456">
-	//char szCmd[MAX_STRING] = { 0 };
-	//strcpy_s(szCmd, out);
+	if (!IsMainThread())
+		return ParseChatLinksUncached(line);
 
-#define InsertColor(text, color) sprintf(text,"<c \"#%06X\">", color); TotalColors++;
-#define InsertColorSafe(text, len, color) sprintf_s(text, len, "<c \"#%06X\">", color); TotalColors++;
-#define InsertStopColor(text)   sprintf(text, "</c>"); TotalColors--;
-#define InsertStopColorSafe(text, len) sprintf_s(text, len, "</c>"); TotalColors--;
+	// A line goes through the whole chat pipeline before the next one arrives, so a few are plenty.
+	static constexpr size_t MaxCachedLines = 8;
+	static std::shared_ptr<const MQChatLinks> s_cachedLines[MaxCachedLines];
+	static size_t s_nextCachedLine = 0;
+
+	for (const auto& cached : s_cachedLines)
+	{
+		if (cached && cached->line == line)
+			return cached;
+	}
 
-	size_t outlen = maxlen;
-	if (maxlen > 14)
-		maxlen -= 14; // make room for this: <c "#123456">
+	std::shared_ptr<const MQChatLinks> result = ParseChatLinksUncached(line);
+	s_cachedLines[s_nextCachedLine] = result;
+	s_nextCachedLine = (s_nextCachedLine + 1) % MaxCachedLines;
 
-	size_t pchar_in_string_position = 0;
-	size_t pchar_out_string_position = 0;
-	bool bFirstColor = false;
-	bool bNBSpace = false;
-	ColorOverride &= 0xFFFFFF;
-	uint32_t CurrentColor = ColorOverride;
+	return result;
+}
+
+// MQ color codes, by the letter that follows \a. Dark colors are selected with a '-' first.
+struct MQColorCode
+{
+	char code;
+	uint32_t color;
+	uint32_t darkColor;
+};
+
+static constexpr MQColorCode s_mqColorCodes[] = {
+	{ 'y', 0xFFFF00, 0x999900 }, // yellow (green/red)
+	{ 'o', 0xFF9900, 0x996600 }, // orange (green/red)
+	{ 'g', 0x00FF00, 0x009900 }, // green   (green)
+	{ 'u', 0x0000FF, 0x000099 }, // blue   (blue)
+	{ 'r', 0xFF0000, 0x990000 }, // red     (red)
+	{ 't', 0x00FFFF, 0x009999 }, // teal (blue/green)
+	{ 'b', 0x000000, 0x000000 }, // black   (none)
+	{ 'm', 0xFF00FF, 0x990099 }, // magenta (blue/red)
+	{ 'p', 0x9900FF, 0x660099 }, // purple (blue/red)
+	{ 'w', 0xFFFFFF, 0x999999 }, // white   (all)
+};
+
+// Characters that can't be copied straight into STML. A space only needs replacing when it follows
+// another space, but it has to be looked at to know that.
+static constexpr auto s_stmlSpecialChars = []
+{
+	std::array<bool, 256> special = {};
+	for (unsigned char ch : std::string_view{ " \a&%<>\"\n" })
+		special[ch] = true;
+	return special;
+}();
 
-	int TotalColors = 0; // this MUST be signed.
+static constexpr size_t STMLColorTagLength = 13; // <c "#123456">
+static constexpr size_t STMLStopColorLength = 4; // </c>
 
-	pchar_out_string_position += InsertColorSafe(&out[pchar_out_string_position], outlen - pchar_out_string_position, CurrentColor);
+// Writes into a fixed size buffer and refuses anything that doesn't fit with room left to close the
+// colors that are still open.
+class STMLBufferWriter
+{
+public:
+	STMLBufferWriter(char* out, size_t size) : m_out(out), m_size(size) {}
 
-	while (in[pchar_in_string_position] != 0 && pchar_out_string_position < maxlen)
+	bool Append(const char* text, size_t length)
 	{
-		if (in[pchar_in_string_position] == ' ')
-		{
-			if (bNBSpace)
-			{
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '&', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'N', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'B', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'S', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'P', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ';', maxlen))
-					break;
-			}
-			else
-			{
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ' ', maxlen))
-					break;
-			}
+		if (m_pos + length + m_reservedLength + 1 > m_size)
+			return false;
 
-			bNBSpace = true;
-		}
-		else
+		memcpy(m_out + m_pos, text, length);
+		m_pos += length;
+		return true;
+	}
+
+	// Reserves room for the </c> of a color that was opened, or releases it when one was closed.
+	void ReserveStopColor(int count)
+	{
+		m_reservedLength = std::max(0, m_reservedColors += count) * STMLStopColorLength;
+	}
+
+	size_t Finish()
+	{
+		for (; m_reservedColors > 0; --m_reservedColors)
 		{
-			bNBSpace = false;
+			memcpy(m_out + m_pos, "</c>", STMLStopColorLength);
+			m_pos += STMLStopColorLength;
+		}
 
-			switch (in[pchar_in_string_position])
-			{
-			case '\a':
-				// HANDLE COLOR
-				bFirstColor = true;
-				pchar_in_string_position++;
+		m_out[m_pos++] = 0;
+		return m_pos;
+	}
 
-				if (in[pchar_in_string_position] == 'x')
-				{
-					CurrentColor = -1;
-					pchar_out_string_position += InsertStopColorSafe(&out[pchar_out_string_position], outlen - pchar_out_string_position);
+private:
+	char* m_out;
+	size_t m_size;
+	size_t m_pos = 0;
+	int m_reservedColors = 0; // this MUST be signed, \ax can close more colors than were opened.
+	size_t m_reservedLength = 0;
+};
 
-					if (pchar_out_string_position >= maxlen)
-						break;
-				}
-				else
-				{
-					if (in[pchar_in_string_position] == '#')
-					{
-						pchar_in_string_position++;
-						char temp[7];
-						for (int x = 0; x < 6; x++)
-						{
-							temp[x] = in[pchar_in_string_position++];
-						}
-						pchar_in_string_position--;
-						temp[6] = 0;
-						CurrentColor = -1;
-						//pchar_out_string_position += sprintf_s(&out[pchar_out_string_position],outlen-pchar_out_string_position, "<c \"#%s\">", &temp[0]);
-						pchar_out_string_position += sprintf_s(&out[pchar_out_string_position], outlen - pchar_out_string_position, "<c \"#%s\">", &temp[0]);
-						TotalColors++;
-						if (pchar_out_string_position >= maxlen)
-							break;
-					}
-					else
-					{
-						bool Dark = false;
+class STMLStringWriter
+{
+public:
+	explicit STMLStringWriter(std::string& out) : m_out(out) {}
 
-						if (in[pchar_in_string_position] == '-')
-						{
-							Dark = true;
-							pchar_in_string_position++;
-						}
+	bool Append(const char* text, size_t length)
+	{
+		m_out.append(text, length);
+		return true;
+	}
 
-						uint32_t LastColor = CurrentColor;
-						switch (in[pchar_in_string_position])
-						{
-						case 'y': // yellow (green/red)
-							if (Dark)
-								CurrentColor = 0x999900;
-							else
-								CurrentColor = 0xFFFF00;
-							break;
-						case 'o': // orange (green/red)
-							if (Dark)
-								CurrentColor = 0x996600;
-							else
-								CurrentColor = 0xFF9900;
-							break;
-						case 'g': // green   (green)
-							if (Dark)
-								CurrentColor = 0x009900;
-							else
-								CurrentColor = 0x00FF00;
-							break;
-						case 'u': // blue   (blue)
-							if (Dark)
-								CurrentColor = 0x000099;
-							else
-								CurrentColor = 0x0000FF;
-							break;
-						case 'r': // red     (red)
-							if (Dark)
-								CurrentColor = 0x990000;
-							else
-								CurrentColor = 0xFF0000;
-							break;
-						case 't': // teal (blue/green)
-							if (Dark)
-								CurrentColor = 0x009999;
-							else
-								CurrentColor = 0x00FFFF;
-							break;
-						case 'b': // black   (none)
-							CurrentColor = 0x000000;
-							break;
-						case 'm': // magenta (blue/red)
-							if (Dark)
-								CurrentColor = 0x990099;
-							else
-								CurrentColor = 0xFF00FF;
-							break;
-						case 'p': // purple (blue/red)
-							if (Dark)
-								CurrentColor = 0x660099;
-							else
-								CurrentColor = 0x9900FF;
-							break;
-						case 'w': // white   (all)
-							if (Dark)
-								CurrentColor = 0x999999;
-							else
-								CurrentColor = 0xFFFFFF;
-							break;
-						}
+	void ReserveStopColor(int count) { m_openColors += count; }
 
-						if (CurrentColor != LastColor)
-						{
-							//pchar_out_string_position += InsertColor(&out[pchar_out_string_position], CurrentColor);
-							pchar_out_string_position += InsertColorSafe(&out[pchar_out_string_position], outlen - pchar_out_string_position, CurrentColor);
-							if (pchar_out_string_position >= maxlen)
-								break;
-						}
-					}
-				}
-				break;
+	void Finish()
+	{
+		for (; m_openColors > 0; --m_openColors)
+			m_out.append("</c>", STMLStopColorLength);
+	}
 
-			case '&':
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '&', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'A', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'M', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'P', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ';', maxlen))
-					break;
-				break;
+private:
+	std::string& m_out;
+	int m_openColors = 0;
+};
 
-			case '%':
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '&', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'P', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'C', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'T', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ';', maxlen))
-					break;
-				break;
+template <typename Writer>
+static bool AppendSTMLColor(Writer& writer, uint32_t color)
+{
+	static constexpr char hexDigits[] = "0123456789ABCDEF";
 
-			case '<':
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '&', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'L', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'T', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ';', maxlen))
-					break;
-				break;
+	char tag[STMLColorTagLength] = { '<', 'c', ' ', '"', '#' };
+	for (int i = 0; i < 6; ++i)
+		tag[5 + i] = hexDigits[(color >> (20 - i * 4)) & 0xF];
+	tag[11] = '"';
+	tag[12] = '>';
 
-			case '>':
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '&', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'G', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'T', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ';', maxlen))
-					break;
+	if (!writer.Append(tag, STMLColorTagLength))
+		return false;
+
+	writer.ReserveStopColor(1);
+	return true;
+}
+
+template <typename Writer>
+static void WriteSTML(std::string_view in, uint32_t ColorOverride, Writer& writer)
+{
+	ColorOverride &= 0xFFFFFF;
+	uint32_t CurrentColor = ColorOverride;
+
+	if (!AppendSTMLColor(writer, CurrentColor))
+		return;
+
+	bool bNBSpace = false;
+	size_t pos = 0;
+
+	while (pos < in.size())
+	{
+		// Copy everything up to the next character that needs attention in one go. Most lines never
+		// get past this.
+		const size_t runStart = pos;
+		while (pos < in.size() && !s_stmlSpecialChars[static_cast<unsigned char>(in[pos])])
+			++pos;
+
+		if (pos != runStart)
+		{
+			bNBSpace = false;
+			if (!writer.Append(in.data() + runStart, pos - runStart))
+				return;
+
+			if (pos == in.size())
 				break;
+		}
 
-			case '"':
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '&', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'Q', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'U', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'O', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'T', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, ';', maxlen))
-					break;
+		const char ch = in[pos++];
+		if (ch == ' ')
+		{
+			const bool appended = bNBSpace ? writer.Append("&NBSP;", 6) : writer.Append(" ", 1);
+			if (!appended)
+				return;
+
+			bNBSpace = true;
+			continue;
+		}
+
+		bNBSpace = false;
+
+		bool appended = true;
+		switch (ch)
+		{
+		case '\a':
+			// HANDLE COLOR
+			if (pos == in.size())
 				break;
 
-			case '\n':
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '<', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'B', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, 'R', maxlen))
-					break;
-				if (!ReplaceSafely(&out, &pchar_out_string_position, '>', maxlen))
+			if (in[pos] == 'x')
+			{
+				++pos;
+				CurrentColor = -1;
+				appended = writer.Append("</c>", STMLStopColorLength);
+				if (appended)
+					writer.ReserveStopColor(-1);
+			}
+			else if (in[pos] == '#')
+			{
+				++pos;
+				const std::string_view hex = in.substr(pos, 6);
+				pos += hex.size();
+				CurrentColor = -1;
+
+				char tag[STMLColorTagLength] = { '<', 'c', ' ', '"', '#' };
+				memcpy(tag + 5, hex.data(), hex.size());
+				tag[5 + hex.size()] = '"';
+				tag[6 + hex.size()] = '>';
+
+				appended = writer.Append(tag, 7 + hex.size());
+				if (appended)
+					writer.ReserveStopColor(1);
+			}
+			else
+			{
+				const bool Dark = in[pos] == '-';
+				if (Dark && ++pos == in.size())
 					break;
-				break;
 
-			default:
-				out[pchar_out_string_position++] = in[pchar_in_string_position];
-				break;
+				const char code = in[pos++];
+				for (const MQColorCode& colorCode : s_mqColorCodes)
+				{
+					if (colorCode.code == code)
+					{
+						const uint32_t color = Dark ? colorCode.darkColor : colorCode.color;
+						if (color != CurrentColor)
+						{
+							CurrentColor = color;
+							appended = AppendSTMLColor(writer, color);
+						}
+						break;
+					}
+				}
 			}
+			break;
+
+		case '&': appended = writer.Append("&AMP;", 5); break;
+		case '%': appended = writer.Append("&PCT;", 5); break;
+		case '<': appended = writer.Append("&LT;", 4); break;
+		case '>': appended = writer.Append("&GT;", 4); break;
+		case '"': appended = writer.Append("&QUOT;", 6); break;
+		case '\n': appended = writer.Append("<BR>", 4); break;
+
+		default: break;
 		}
 
-		if (pchar_out_string_position >= maxlen)
-			break;
-		else
-			pchar_in_string_position++;
+		if (!appended)
+			return;
 	}
+}
 
-	if (pchar_out_string_position > maxlen)
-	{
-		pchar_out_string_position = maxlen;
-	}
-	for (TotalColors; TotalColors > 0;)
-	{
-		pchar_out_string_position += InsertStopColorSafe(&out[pchar_out_string_position], outlen - pchar_out_string_position);
-	}
+DWORD MQToSTML(const char* in, char* out, size_t maxlen, uint32_t ColorOverride)
+{
+	if (maxlen == 0)
+		return 0;
 
-	out[pchar_out_string_position++] = 0;
-	return static_cast<DWORD>(pchar_out_string_position);
+	STMLBufferWriter writer(out, maxlen);
+	WriteSTML(in, ColorOverride, writer);
+
+	return static_cast<DWORD>(writer.Finish());
+}
 
-#undef InsertColor
-#undef InsertColorSafe
-#undef InsertStopColor
-#undef InsertStopColorSafe
+void MQToSTML(std::string_view in, std::string& out, uint32_t ColorOverride)
+{
+	out.reserve(out.size() + in.size() + STMLColorTagLength + STMLStopColorLength);
+
+	STMLStringWriter writer(out);
+	WriteSTML(in, ColorOverride, writer);
+	writer.Finish();
 }
 
 static bool ItemFitsInSlot(ItemClient* pCont, std::string_view search)
@@ -1126,6 +1265,8 @@ void AddFilter(const char* szFilter, int Length, bool& pEnabled)
 
 	New->pNext = gpFilters;
 	gpFilters = New;
+
+	InvalidateChatFilters();
 }
 
 void DefaultFilters()
@@ -1208,6 +1349,44 @@ const char* GetShortZone(int ZoneID)
 	return "UNKNOWN_ZONE";
 }
 
+// Case insensitive table from names to ids, filled on first use and refilled whenever the game
+// data it was filled from changes. A name added more than once keeps its first id, so filling
+// the table in the order a linear search would check the names finds the same ids.
+class NameTable
+{
+public:
+	using AddFunction = std::function<void(const char* name, int id)>;
+
+	template <typename Fill>
+	int Find(std::string_view name, const void* source, int notFound, Fill&& fill)
+	{
+		std::scoped_lock lock(m_mutex);
+
+		if (!m_filled || m_source != source)
+		{
+			m_ids.clear();
+			fill(AddFunction([this](const char* name, int id)
+				{
+					if (name && name[0])
+						m_ids.emplace(name, id);
+				}));
+
+			// Keep trying while the data is still empty, it may not be loaded yet.
+			m_filled = !m_ids.empty();
+			m_source = source;
+		}
+
+		auto iter = m_ids.find(name);
+		return iter != m_ids.end() ? iter->second : notFound;
+	}
+
+private:
+	std::mutex m_mutex;
+	const void* m_source = nullptr;
+	bool m_filled = false;
+	ci_unordered::map<std::string, int> m_ids;
+};
+
 // ***************************************************************************
 // Function:    GetZoneID
 // Description: Returns a ZoneID from a short or long zone name
@@ -1217,23 +1396,18 @@ int GetZoneID(const char* ZoneShortName)
 	if (!pWorldData)
 		return -1;
 
-	for (int nIndex = 0; nIndex < MAX_ZONES; nIndex++)
-	{
-		EQZoneInfo* pZone = pWorldData->ZoneArray[nIndex];
-		if (pZone)
+	static NameTable s_zoneIDs;
+	return s_zoneIDs.Find(ZoneShortName, pWorldData, -1, [](const NameTable::AddFunction& add)
 		{
-			if (!_stricmp(pZone->ShortName, ZoneShortName))
+			for (int nIndex = 0; nIndex < MAX_ZONES; nIndex++)
 			{
-				return nIndex;
+				if (EQZoneInfo* pZone = pWorldData->ZoneArray[nIndex])
+				{
+					add(pZone->ShortName, nIndex);
+					add(pZone->LongName, nIndex);
+				}
 			}
-
-			if (!_stricmp(pZone->LongName, ZoneShortName))
-			{
-				return nIndex;
-			}
-		}
-	}
-	return -1;
+		});
 }
 
 // ***************************************************************************
@@ -1273,79 +1447,83 @@ void GetGameDate(int* Month, int* Day, int* Year)
 		*Year = pWorldData->Year;
 }
 
-// TOOD: Convert to data table
-int GetLanguageIDByName(const char* szName)
+struct LanguageName
 {
-	if (!_stricmp(szName, "Common")) return 1;
-	if (!_stricmp(szName, "Common Tongue")) return 1;
-	if (!_stricmp(szName, "Barbarian")) return 2;
-	if (!_stricmp(szName, "Erudian")) return 3;
-	if (!_stricmp(szName, "Elvish")) return 4;
-	if (!_stricmp(szName, "Dark Elvish")) return 5;
-	if (!_stricmp(szName, "Dwarvish")) return 6;
-	if (!_stricmp(szName, "Troll")) return 7;
-	if (!_stricmp(szName, "Ogre")) return 8;
-	if (!_stricmp(szName, "Gnomish")) return 9;
-	if (!_stricmp(szName, "Halfling")) return 10;
-	if (!_stricmp(szName, "Thieves Cant")) return 11;
-	if (!_stricmp(szName, "Old Erudian")) return 12;
-	if (!_stricmp(szName, "Elder Elvish")) return 13;
-	if (!_stricmp(szName, "Froglok")) return 14;
-	if (!_stricmp(szName, "Goblin")) return 15;
-	if (!_stricmp(szName, "Gnoll")) return 16;
-	if (!_stricmp(szName, "Combine Tongue")) return 17;
+	const char* name;
+	int id;
+};
+
+static const LanguageName s_languageNames[] = {
+	{ "Common",                 1 },
+	{ "Common Tongue",          1 },
+	{ "Barbarian",              2 },
+	{ "Erudian",                3 },
+	{ "Elvish",                 4 },
+	{ "Dark Elvish",            5 },
+	{ "Dwarvish",               6 },
+	{ "Troll",                  7 },
+	{ "Ogre",                   8 },
+	{ "Gnomish",                9 },
+	{ "Halfling",              10 },
+	{ "Thieves Cant",          11 },
+	{ "Old Erudian",           12 },
+	{ "Elder Elvish",          13 },
+	{ "Froglok",               14 },
+	{ "Goblin",                15 },
+	{ "Gnoll",                 16 },
+	{ "Combine Tongue",        17 },
 	// Incorrect spelling, but keeping for backwards compatibility
-	if (!_stricmp(szName, "Elder Tier'Dal")) return 18;
+	{ "Elder Tier'Dal",        18 },
 	// Correct Spelling
-	if (!_stricmp(szName, "Elder Teir'Dal")) return 18;
-	if (!_stricmp(szName, "Lizardman")) return 19;
-	if (!_stricmp(szName, "Orcish")) return 20;
-	if (!_stricmp(szName, "Faerie")) return 21;
-	if (!_stricmp(szName, "Dragon")) return 22;
-	if (!_stricmp(szName, "Elder Dragon")) return 23;
-	if (!_stricmp(szName, "Dark Speech")) return 24;
-	if (!_stricmp(szName, "Vah Shir")) return 25;
-	if (!_stricmp(szName, "Alaran")) return 26;
-	if (!_stricmp(szName, "Hadal")) return 27;
-	return -1;
+	{ "Elder Teir'Dal",        18 },
+	{ "Lizardman",             19 },
+	{ "Orcish",                20 },
+	{ "Faerie",                21 },
+	{ "Dragon",                22 },
+	{ "Elder Dragon",          23 },
+	{ "Dark Speech",           24 },
+	{ "Vah Shir",              25 },
+	{ "Alaran",                26 },
+	{ "Hadal",                 27 },
+};
+
+int GetLanguageIDByName(const char* szName)
+{
+	static NameTable s_languageIDs;
+	return s_languageIDs.Find(szName, s_languageNames, -1, [](const NameTable::AddFunction& add)
+		{
+			for (const LanguageName& language : s_languageNames)
+				add(language.name, language.id);
+		});
 }
 
-void UpdateCurrencyCache(std::unordered_map<std::string, int>& cache, int value, eDatabaseStringType type)
+static void AddCurrencyName(const NameTable::AddFunction& add, int value, eDatabaseStringType type)
 {
 	constexpr std::string_view chars_to_remove = "'`";
 	if (const char* ptr = pCDBStr->GetString(value, type))
 	{
-		const std::string currency = to_lower_copy(ptr);
-		if (currency.empty())
-			return;
-		cache[currency] = value;
-		cache[remove_chars(currency, chars_to_remove)] = value;
+		add(ptr, value);
+		add(remove_chars(ptr, chars_to_remove).c_str(), value);
 	}
 }
 
 int GetCurrencyIDByName(const char* szName)
 {
-	static std::unordered_map<std::string, int> cache;
+	if (!pCDBStr)
+		return -1;
 
-	if (cache.empty())
-	{
-		for (int i = ALTCURRENCY_FIRST; i <= ALTCURRENCY_LAST; ++i)
+	static NameTable s_currencyIDs;
+	return s_currencyIDs.Find(szName, pCDBStr, -1, [](const NameTable::AddFunction& add)
 		{
-			UpdateCurrencyCache(cache, i, eAltCurrencyNamePlural);
-			UpdateCurrencyCache(cache, i, eAltCurrencyName);
-		}
-		// Crowns are outside ALTCURRENCY_LAST
-		UpdateCurrencyCache(cache, ALTCURRENCY_CROWNS, eAltCurrencyNamePlural);
-		UpdateCurrencyCache(cache, ALTCURRENCY_CROWNS, eAltCurrencyName);
-	}
-
-	const auto it = cache.find(to_lower_copy(szName));
-	if (it != cache.end())
-	{
-		return it->second;
-	}
-
-	return -1;
+			for (int i = ALTCURRENCY_FIRST; i <= ALTCURRENCY_LAST; ++i)
+			{
+				AddCurrencyName(add, i, eAltCurrencyNamePlural);
+				AddCurrencyName(add, i, eAltCurrencyName);
+			}
+			// Crowns are outside ALTCURRENCY_LAST
+			AddCurrencyName(add, ALTCURRENCY_CROWNS, eAltCurrencyNamePlural);
+			AddCurrencyName(add, ALTCURRENCY_CROWNS, eAltCurrencyName);
+		});
 }
 
 // This wrapper is here to deal with older plugins and to preserve backwards compatibility with older clients (emu)
@@ -1645,7 +1823,7 @@ bool ItemMatchesSearch(MQItemSearch& SearchItem, ItemClient* pContents)
 	RequireFlag(Weapon, pItem->Damage && pItem->Delay);
 	RequireFlag(Normal, pItem->Type == ITEMTYPE_NORMAL);
 
-	if (SearchItem.szName[0] && ci_find_substr(pItem->Name, SearchItem.szName))
+	if (SearchItem.szName[0] && ci_find_substr(pItem->Name, SearchItem.szName) == -1)
 		return false;
 	if (SearchItem.szSlot[0] && !ItemFitsInSlot(pContents, SearchItem.szSlot))
 		return false;
@@ -1721,6 +1899,65 @@ bool SearchThroughItems(MQItemSearch& SearchItem, ItemClient** pResult, DWORD* n
 	return false;
 }
 #undef DoResult
+
+std::vector<MQItemSearchResult> SearchAllItems(MQItemSearch& SearchItem, const std::function<bool(ItemClient*)>& predicate)
+{
+	std::vector<MQItemSearchResult> results;
+
+	PcProfile* pProfile = GetPcProfile();
+	if (!pProfile) return results;
+
+	auto addIfMatches = [&](ItemClient* pContents)
+	{
+		if (ItemMatchesSearch(SearchItem, pContents) && (!predicate || predicate(pContents)))
+			results.push_back({ pContents->GetItemLocation(), pContents->GetID(), pContents->GetItemCount() });
+	};
+
+	// Same order as SearchThroughItems: worn items, inventory slots, then the contents of the packs.
+	if (MaskSet(Worn) && Flag(Worn))
+	{
+		for (int N = InvSlot_FirstWornItem; N <= InvSlot_LastWornItem; N++)
+		{
+			if (ItemClient* pContents = pProfile->GetInventorySlot(N))
+				addIfMatches(pContents);
+		}
+	}
+
+	if (MaskSet(Inventory) && Flag(Inventory))
+	{
+		for (int nPack = InvSlot_FirstBagSlot; nPack < GetHighestAvailableBagSlot(); nPack++)
+		{
+			if (ItemClient* pContents = pProfile->GetInventorySlot(nPack))
+				addIfMatches(pContents);
+		}
+
+		for (int nPack = InvSlot_FirstBagSlot; nPack < GetHighestAvailableBagSlot(); nPack++)
+		{
+			ItemClient* pContents = pProfile->GetInventorySlot(nPack);
+			if (pContents && pContents->IsContainer())
+			{
+				for (int nItem = 0; nItem < pContents->GetHeldItems().GetSize(); ++nItem)
+				{
+					if (ItemPtr pItem = pContents->GetHeldItems().GetItem(nItem))
+						addIfMatches(pItem.get());
+				}
+			}
+		}
+	}
+
+	if (pLocalPC)
+	{
+		auto visitor = [&](const ItemPtr& pItem, const ItemIndex&) { addIfMatches(pItem.get()); };
+
+		if (MaskSet(Bank) && Flag(Bank))
+			pLocalPC->BankItems.VisitItems(-1, -1, -1, visitor);
+
+		if (MaskSet(SharedBank) && Flag(SharedBank))
+			pLocalPC->SharedBankItems.VisitItems(-1, -1, -1, visitor);
+	}
+
+	return results;
+}
 #undef RequireFlag
 #undef Flag
 #undef MaskSet
@@ -2018,7 +2255,8 @@ enum eCalcOp
 	CO_SHL = 23,
 	CO_SHR = 24,
 	CO_NEGATE = 25,
-	CO_TOTAL = 26,
+	CO_SLOT = 26,
+	CO_TOTAL = 27,
 };
 
 int CalcOpPrecedence[CO_TOTAL] =
@@ -2049,22 +2287,49 @@ int CalcOpPrecedence[CO_TOTAL] =
 	8,    // shl
 	8,    // shr
 	12,   // negate
+	0,    // slot
 };
 
 struct CalcOp
 {
 	eCalcOp Op;
 	double Value;
+	int64_t IntValue;                  // exact value of numbers without a decimal point
+	bool IsInteger;
 };
 
-bool EvaluateRPN(CalcOp* pList, int Size, double& Result)
+// Numbers are read as doubles, and the ones that are integers also keep their exact value for
+// CalculateExact.
+static void SetCalcNumber(CalcOp& op, const char* szNumber)
+{
+	op.Value = GetDoubleFromString(szNumber, 0);
+
+	const char* pEnd = szNumber + strlen(szNumber);
+	int64_t value = 0;
+	auto result = std::from_chars(szNumber, pEnd, value);
+	op.IsInteger = result.ec == std::errc() && result.ptr == pEnd;
+	op.IntValue = op.IsInteger ? value : 0;
+}
+
+bool EvaluateRPN(const CalcOp* pList, int Size, double& Result, const double* pSlots = nullptr)
 {
 	if (!Size)
 		return false;
 
-	std::unique_ptr<double[]> stackPtr = std::make_unique<double[]>(Size / 2 + 2);
-	double* pStack = stackPtr.get();
+	// Every op pushes at most one value, and slot 0 is the bottom of the stack. Most formulas fit
+	// in the fixed buffer, longer ones borrow from the transient arena.
+	constexpr int FixedStackSize = 64;
+	double FixedStack[FixedStackSize];
+	double* pStack = FixedStack;
+
+	std::optional<MQTransientScope> scope;
+	if (Size + 1 > FixedStackSize)
+	{
+		scope.emplace();
+		pStack = scope->GetArena().AllocateArray<double>(Size + 1);
+	}
 
+	pStack[0] = 0.0;
 	int nStack = 0;
 
 #define StackEmpty()           (nStack==0)
@@ -2087,6 +2352,9 @@ bool EvaluateRPN(CalcOp* pList, int Size, double& Result)
 		case CO_NUMBER:
 			StackPush(pList[i].Value);
 			break;
+		case CO_SLOT:
+			StackPush(pSlots[static_cast<int>(pList[i].Value)]);
+			break;
 		case CO_ADD:
 			BinaryAssign(+);
 			break;
@@ -2215,35 +2483,29 @@ bool EvaluateRPN(CalcOp* pList, int Size, double& Result)
 	return true;
 }
 
-bool FastCalculate(char* szFormula, double& Result)
-{
-	//DebugSpew("FastCalculate(%s)",szFormula);
-	if (!szFormula || !szFormula[0])
-		return false;
+// Stands in for a ${} reference in a formula that is being compiled.
+constexpr char CalcSlotMarker = '\x01';
 
+// Converts a formula to RPN. pOpList and pStack must be zeroed and have room for one more entry
+// than the length of the formula. When compiling, slot markers are accepted and errors are not
+// reported, so that the caller can quietly fall back to evaluating the parsed formula instead.
+static bool ConvertToRPN(const char* szFormula, CalcOp* pOpList, eCalcOp* pStack, int& nOps, bool compiling)
+{
 	int Length = (int)strlen(szFormula);
-	int MaxOps = (Length + 1);
-
-	std::unique_ptr<CalcOp[]> OpsList = std::make_unique<CalcOp[]>(MaxOps);
-	CalcOp* pOpList = OpsList.get();
-	memset(pOpList, 0, sizeof(CalcOp) * MaxOps);
-
-	std::unique_ptr<eCalcOp[]> Stack = std::make_unique<eCalcOp[]>(MaxOps);
-	eCalcOp* pStack = Stack.get();
-	memset(pStack, 0, sizeof(eCalcOp) * MaxOps);
-
-	int nOps = 0;
 	int nStack = 0;
-	char* pEnd = szFormula + Length;
+	int nSlots = 0;
+	const char* pEnd = szFormula + Length;
 	char CurrentToken[MAX_STRING] = { 0 };
 	char* pToken = &CurrentToken[0];
 
+	nOps = 0;
+
+#define CalcError(...)       { if (!compiling) FatalError(__VA_ARGS__); return false; }
 #define OpToList(op)         { pOpList[nOps].Op = op; nOps++; }
-#define ValueToList(val)     { pOpList[nOps].Value = val; nOps++; }
 #define StackEmpty()         (nStack == 0)
 #define StackTop()           (pStack[nStack])
 #define StackPush(op)        { nStack++; pStack[nStack] = op; }
-#define StackPop()           { if (!nStack) { FatalError("Illegal arithmetic in calculation"); return 0; } nStack--;}
+#define StackPop()           { if (!nStack) CalcError("Illegal arithmetic in calculation"); nStack--; }
 #define HasPrecedence(a,b)   ( CalcOpPrecedence[a] >= CalcOpPrecedence[b])
 #define MoveStack(op) {                                                                        \
 	while (!StackEmpty() && StackTop() != CO_OPENPARENS && HasPrecedence(StackTop(), op)) {    \
@@ -2251,17 +2513,32 @@ bool FastCalculate(char* szFormula, double& Result)
 		StackPop();                                                                            \
 	}                                                                                          \
 }
-#define FinishString()       { if (pToken != &CurrentToken[0]) { *pToken = 0; ValueToList(GetDoubleFromString(CurrentToken, 0)); pToken = &CurrentToken[0]; *pToken=0; }}
+#define FinishString()       { if (pToken != &CurrentToken[0]) { *pToken = 0; SetCalcNumber(pOpList[nOps], CurrentToken); nOps++; pToken = &CurrentToken[0]; *pToken=0; }}
 #define NewOp(op)            { FinishString(); MoveStack(op); StackPush(op); }
 #define NextChar(ch)         { *pToken = ch; pToken++; }
 
 	bool WasParen = false;
-	for (char* pCur = szFormula; pCur < pEnd; pCur++)
+	bool WasSlot = false;
+	for (const char* pCur = szFormula; pCur < pEnd; pCur++)
 	{
 		switch (*pCur)
 		{
 		case ' ':
 			continue;
+		case CalcSlotMarker:
+			// The value of a slot is a number token of its own. Anything that would have merged
+			// with it if the value had been pasted into the formula can't be compiled.
+			if (!compiling)
+				CalcError("Unparsable in Calculation: '%c'", *pCur);
+			if (pToken != &CurrentToken[0] || WasSlot || WasParen)
+				return false;
+
+			pOpList[nOps].Op = CO_SLOT;
+			pOpList[nOps].Value = nSlots++;
+			nOps++;
+			WasParen = false;
+			WasSlot = true;
+			continue;
 		case '(':
 			FinishString();
 			StackPush(CO_OPENPARENS);
@@ -2275,6 +2552,7 @@ bool FastCalculate(char* szFormula, double& Result)
 			}
 			StackPop();
 			WasParen = true;
+			WasSlot = false;
 			continue;
 		case '+':
 			if (pCur[1] != '+')
@@ -2288,7 +2566,7 @@ bool FastCalculate(char* szFormula, double& Result)
 			}
 			else
 			{
-				if (CurrentToken[0] || WasParen)
+				if (CurrentToken[0] || WasParen || WasSlot)
 				{
 					NewOp(CO_SUBTRACT);
 				}
@@ -2417,17 +2695,18 @@ bool FastCalculate(char* szFormula, double& Result)
 		case '8':
 		case '9':
 		case '0':
+			if (WasSlot)
+				return false;
 			NextChar(*pCur);
 			break;
 		default:
 		{
 			//printf("Unparsable: '%c'\n",*pCur);
-			FatalError("Unparsable in Calculation: '%c'", *pCur);
-			// unparsable
-			return false;
+			CalcError("Unparsable in Calculation: '%c'", *pCur);
 		}
 		}
 		WasParen = false;
+		WasSlot = false;
 	}
 	FinishString();
 
@@ -2437,75 +2716,918 @@ bool FastCalculate(char* szFormula, double& Result)
 		StackPop();
 	}
 
+#undef CalcError
+#undef OpToList
+#undef StackEmpty
+#undef StackTop
+#undef StackPush
+#undef StackPop
+#undef HasPrecedence
+#undef MoveStack
+#undef FinishString
+#undef NewOp
+#undef NextChar
+
+	return true;
+}
+
+bool FastCalculate(char* szFormula, double& Result)
+{
+	//DebugSpew("FastCalculate(%s)",szFormula);
+	if (!szFormula || !szFormula[0])
+		return false;
+
+	int MaxOps = (int)strlen(szFormula) + 1;
+
+	// Scratch space comes from the transient arena instead of the heap
+	MQTransientScope scope;
+
+	CalcOp* pOpList = scope.GetArena().AllocateArray<CalcOp>(MaxOps);
+	memset(pOpList, 0, sizeof(CalcOp) * MaxOps);
+
+	eCalcOp* pStack = scope.GetArena().AllocateArray<eCalcOp>(MaxOps);
+	memset(pStack, 0, sizeof(eCalcOp) * MaxOps);
+
+	int nOps = 0;
+	if (!ConvertToRPN(szFormula, pOpList, pStack, nOps, false))
+		return false;
+
 	return EvaluateRPN(pOpList, nOps, Result);
 }
 
-bool Calculate(const char* szFormula, double& Result)
+// Rewrites NULL, TRUE and FALSE as numbers. Buffer must already be upper case. With integers set
+// they become integers padded with spaces, rather than doubles.
+static void ReplaceCalculationKeywords(char* Buffer, bool integers = false)
 {
-	char Buffer[MAX_STRING] = { 0 };
-	strcpy_s(Buffer, szFormula);
-	_strupr_s(Buffer);
+	const char point = integers ? ' ' : '.';
+	const char zero = integers ? ' ' : '0';
 
 	while (char* pNull = strstr(Buffer, "NULL"))
 	{
 		pNull[0] = '0';
-		pNull[1] = '.';
-		pNull[2] = '0';
-		pNull[3] = '0';
+		pNull[1] = point;
+		pNull[2] = zero;
+		pNull[3] = zero;
 	}
 
 	while (char* pTrue = strstr(Buffer, "TRUE"))
 	{
 		pTrue[0] = '1';
-		pTrue[1] = '.';
-		pTrue[2] = '0';
-		pTrue[3] = '0';
+		pTrue[1] = point;
+		pTrue[2] = zero;
+		pTrue[3] = zero;
 	}
 
 	while (char* pFalse = strstr(Buffer, "FALSE"))
 	{
 		pFalse[0] = '0';
-		pFalse[1] = '.';
-		pFalse[2] = '0';
-		pFalse[3] = '0';
-		pFalse[4] = '0';
+		pFalse[1] = point;
+		pFalse[2] = zero;
+		pFalse[3] = zero;
+		pFalse[4] = zero;
+	}
+}
+
+// Programs for the formulas that Calculate has seen recently, keyed by the shape of the formula:
+// its text once NULL, TRUE and FALSE are rewritten, with every number replaced by a slot. Macros
+// mostly calculate the same formulas over and over with different values parsed into them, and
+// those only need their numbers read before the program is run again.
+struct MQCalculationProgram
+{
+	std::string shape;
+	std::vector<CalcOp> ops;           // empty if the shape couldn't be compiled
+};
+
+static constexpr size_t MaxCalculationPrograms = 256;
+static constexpr int MaxCalculationLiterals = 64;
+
+// Most recently used first. Only used from the main thread.
+static std::list<MQCalculationProgram> s_calculationPrograms;
+static std::unordered_map<std::string_view, std::list<MQCalculationProgram>::iterator> s_calculationProgramIndex;
+
+static const MQCalculationProgram& GetCalculationProgram(std::string_view shape)
+{
+	auto iter = s_calculationProgramIndex.find(shape);
+	if (iter != s_calculationProgramIndex.end())
+	{
+		s_calculationPrograms.splice(s_calculationPrograms.begin(), s_calculationPrograms, iter->second);
+		return *iter->second;
+	}
+
+	if (s_calculationPrograms.size() >= MaxCalculationPrograms)
+	{
+		s_calculationProgramIndex.erase(s_calculationPrograms.back().shape);
+		s_calculationPrograms.pop_back();
+	}
+
+	MQCalculationProgram& program = s_calculationPrograms.emplace_front();
+	program.shape = shape;
+
+	const int MaxOps = static_cast<int>(shape.size()) + 1;
+
+	MQTransientScope scope;
+
+	CalcOp* pOpList = scope.GetArena().AllocateArray<CalcOp>(MaxOps);
+	memset(pOpList, 0, sizeof(CalcOp) * MaxOps);
+
+	eCalcOp* pStack = scope.GetArena().AllocateArray<eCalcOp>(MaxOps);
+	memset(pStack, 0, sizeof(eCalcOp) * MaxOps);
+
+	int nOps = 0;
+	if (ConvertToRPN(program.shape.c_str(), pOpList, pStack, nOps, true))
+		program.ops.assign(pOpList, pOpList + nOps);
+
+	s_calculationProgramIndex.emplace(program.shape, s_calculationPrograms.begin());
+	return program;
+}
+
+// Splits a formula into its shape and its numbers, and runs the program for the shape. Numbers
+// are read the way ConvertToRPN reads them, digits separated only by spaces being one number.
+// Anything that can't be handled this way goes through FastCalculate, which reports the errors.
+static bool CalculateWithProgram(char* szFormula, double& Result)
+{
+	if (!szFormula[0] || !IsMainThread())
+		return FastCalculate(szFormula, Result);
+
+	// Both buffers are only read up to what has been written to them.
+	char Shape[MAX_STRING];
+	size_t length = 0;
+
+	char Number[MAX_STRING];
+	double Literals[MaxCalculationLiterals];
+	int nLiterals = 0;
+
+	for (const char* pCur = szFormula; *pCur; )
+	{
+		if (*pCur == CalcSlotMarker)
+			return FastCalculate(szFormula, Result);
+
+		if (*pCur == '.' || (*pCur >= '0' && *pCur <= '9'))
+		{
+			if (nLiterals == MaxCalculationLiterals)
+				return FastCalculate(szFormula, Result);
+
+			size_t numberLength = 0;
+			for (; *pCur == ' ' || *pCur == '.' || (*pCur >= '0' && *pCur <= '9'); ++pCur)
+			{
+				if (*pCur != ' ')
+					Number[numberLength++] = *pCur;
+			}
+			Number[numberLength] = 0;
+
+			Literals[nLiterals++] = GetDoubleFromString(Number, 0);
+			Shape[length++] = CalcSlotMarker;
+		}
+		else
+		{
+			Shape[length++] = *pCur++;
+		}
 	}
 
+	const MQCalculationProgram& program = GetCalculationProgram(std::string_view(Shape, length));
+	if (program.ops.empty())
+		return FastCalculate(szFormula, Result);
+
+	return EvaluateRPN(program.ops.data(), static_cast<int>(program.ops.size()), Result, Literals);
+}
+
+bool Calculate(const char* szFormula, double& Result)
+{
+	char Buffer[MAX_STRING] = { 0 };
+	strcpy_s(Buffer, szFormula);
+	_strupr_s(Buffer);
+
+	ReplaceCalculationKeywords(Buffer);
+
 	bool Ret;
-	Benchmark(bmCalculate, Ret = FastCalculate(Buffer, Result));
+	Benchmark(bmCalculate, Ret = CalculateWithProgram(Buffer, Result));
 	return Ret;
 }
 
-bool PlayerHasAAAbility(int AAIndex)
+//----------------------------------------------------------------------------
+// Exact calculations
+//
+// The same formulas as Calculate, evaluated on values that are either 64-bit integers or
+// doubles. Integer operations stay exact unless their result can't be represented, like 7/2 or
+// an overflow, in which case the result becomes a double. The integer operators (\, %, bitwise
+// and shifts) work on 64 bits instead of truncating to 32.
+
+static MQCalcValue CalcInteger(int64_t value)
+{
+	MQCalcValue result;
+	result.IsInteger = true;
+	result.Integer = value;
+	result.Double = static_cast<double>(value);
+	return result;
+}
+
+static MQCalcValue CalcDouble(double value)
 {
-	for (int i = 0; i < AA_CHAR_MAX_REAL; i++)
+	MQCalcValue result;
+	result.Double = value;
+	return result;
+}
+
+static MQCalcValue CalcBool(bool value)
+{
+	return CalcInteger(value ? 1 : 0);
+}
+
+static bool CalcIsTrue(const MQCalcValue& value)
+{
+	return value.IsInteger ? value.Integer != 0 : value.Double != 0.0;
+}
+
+static int64_t CalcToInteger(const MQCalcValue& value)
+{
+	if (value.IsInteger)
+		return value.Integer;
+
+	// Out of range doubles are clamped instead of being undefined.
+	if (!(value.Double > -9223372036854775808.0))
+		return value.Double != value.Double ? 0 : INT64_MIN;
+	if (value.Double >= 9223372036854775808.0)
+		return INT64_MAX;
+	return static_cast<int64_t>(value.Double);
+}
+
+static bool CheckedAdd(int64_t a, int64_t b, int64_t& result)
+{
+	if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+		return false;
+	result = a + b;
+	return true;
+}
+
+static bool CheckedSubtract(int64_t a, int64_t b, int64_t& result)
+{
+	if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+		return false;
+	result = a - b;
+	return true;
+}
+
+static bool CheckedMultiply(int64_t a, int64_t b, int64_t& result)
+{
+	if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+		: (b > 0 ? a < INT64_MIN / b : (a != 0 && b < INT64_MAX / a)))
 	{
-		if (pLocalPC->GetAlternateAbilityId(i) == AAIndex)
-			return true;
+		return false;
 	}
-	return false;
+	result = a * b;
+	return true;
 }
 
-int GetAAIndexByName(const char* AAName)
+static bool CheckedPower(int64_t base, int64_t exponent, int64_t& result)
 {
-	int level = pLocalPlayer ? pLocalPlayer->Level : -1;
+	if (exponent < 0)
+		return false;
 
-	// check bought aa's first
-	for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+	int64_t value = 1;
+	while (exponent > 0)
 	{
-		if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility), level))
+		if (exponent & 1)
 		{
-			if (const char* pName = pCDBStr->GetString(pAbility->nName, eAltAbilityName))
-			{
-				if (!_stricmp(AAName, pName))
-				{
-					return pAbility->Index;
-				}
-			}
+			if (!CheckedMultiply(value, base, value))
+				return false;
+		}
+
+		exponent >>= 1;
+		if (exponent > 0 && !CheckedMultiply(base, base, base))
+			return false;
+	}
+
+	result = value;
+	return true;
+}
+
+// Applies a binary operator. Returns false if the error has been reported.
+static bool CalcBinaryOp(eCalcOp op, const MQCalcValue& left, const MQCalcValue& right, MQCalcValue& result)
+{
+	const bool integers = left.IsInteger && right.IsInteger;
+	int64_t value = 0;
+
+	switch (op)
+	{
+	case CO_ADD:
+		result = integers && CheckedAdd(left.Integer, right.Integer, value)
+			? CalcInteger(value) : CalcDouble(left.Double + right.Double);
+		return true;
+
+	case CO_SUBTRACT:
+		result = integers && CheckedSubtract(left.Integer, right.Integer, value)
+			? CalcInteger(value) : CalcDouble(left.Double - right.Double);
+		return true;
+
+	case CO_MULTIPLY:
+		result = integers && CheckedMultiply(left.Integer, right.Integer, value)
+			? CalcInteger(value) : CalcDouble(left.Double * right.Double);
+		return true;
+
+	case CO_DIVIDE:
+		if (!CalcIsTrue(right))
+		{
+			FatalError("Divide by zero in calculation");
+			return false;
+		}
+
+		if (integers && !(left.Integer == INT64_MIN && right.Integer == -1) && left.Integer % right.Integer == 0)
+			result = CalcInteger(left.Integer / right.Integer);
+		else
+			result = CalcDouble(left.Double / right.Double);
+		return true;
+
+	case CO_IDIVIDE:
+	case CO_MODULUS:
+	{
+		const int64_t divisor = CalcToInteger(right);
+		if (!divisor)
+		{
+			FatalError(op == CO_IDIVIDE ? "Divide by zero in calculation" : "Modulus by zero in calculation");
+			return false;
 		}
+
+		const int64_t dividend = CalcToInteger(left);
+		if (divisor == -1)
+			result = op == CO_IDIVIDE ? (dividend == INT64_MIN ? CalcDouble(-left.Double) : CalcInteger(-dividend)) : CalcInteger(0);
+		else
+			result = CalcInteger(op == CO_IDIVIDE ? dividend / divisor : dividend % divisor);
+		return true;
+	}
+
+	case CO_POWER:
+		result = integers && CheckedPower(left.Integer, right.Integer, value)
+			? CalcInteger(value) : CalcDouble(pow(left.Double, right.Double));
+		return true;
+
+	case CO_EQUAL:
+		result = CalcBool(integers ? left.Integer == right.Integer : left.Double == right.Double);
+		return true;
+	case CO_NOTEQUAL:
+		result = CalcBool(integers ? left.Integer != right.Integer : left.Double != right.Double);
+		return true;
+	case CO_GREATER:
+		result = CalcBool(integers ? left.Integer > right.Integer : left.Double > right.Double);
+		return true;
+	case CO_NOTGREATER:
+		result = CalcBool(integers ? left.Integer <= right.Integer : left.Double <= right.Double);
+		return true;
+	case CO_LESS:
+		result = CalcBool(integers ? left.Integer < right.Integer : left.Double < right.Double);
+		return true;
+	case CO_NOTLESS:
+		result = CalcBool(integers ? left.Integer >= right.Integer : left.Double >= right.Double);
+		return true;
+
+	case CO_LAND:
+		result = CalcBool(CalcIsTrue(left) && CalcIsTrue(right));
+		return true;
+	case CO_LOR:
+		result = CalcBool(CalcIsTrue(left) || CalcIsTrue(right));
+		return true;
+
+	case CO_AND:
+		result = CalcInteger(CalcToInteger(left) & CalcToInteger(right));
+		return true;
+	case CO_OR:
+		result = CalcInteger(CalcToInteger(left) | CalcToInteger(right));
+		return true;
+	case CO_XOR:
+		result = CalcInteger(CalcToInteger(left) ^ CalcToInteger(right));
+		return true;
+	case CO_SHL:
+		result = CalcInteger(static_cast<int64_t>(static_cast<uint64_t>(CalcToInteger(left)) << (CalcToInteger(right) & 63)));
+		return true;
+	case CO_SHR:
+		result = CalcInteger(CalcToInteger(left) >> (CalcToInteger(right) & 63));
+		return true;
+
+	default:
+		break;
+	}
+
+	FatalError("Illegal arithmetic in calculation");
+	return false;
+}
+
+static bool EvaluateRPNExact(const CalcOp* pList, int Size, MQCalcValue& Result)
+{
+	if (!Size)
+		return false;
+
+	// Same layout as the stack of EvaluateRPN
+	constexpr int FixedStackSize = 64;
+	MQCalcValue FixedStack[FixedStackSize];
+	MQCalcValue* pStack = FixedStack;
+
+	std::optional<MQTransientScope> scope;
+	if (Size + 1 > FixedStackSize)
+	{
+		scope.emplace();
+		pStack = scope->GetArena().AllocateArray<MQCalcValue>(Size + 1);
+	}
+
+	pStack[0] = CalcInteger(0);
+	int nStack = 0;
+
+	for (int i = 0; i < Size; i++)
+	{
+		const CalcOp& op = pList[i];
+
+		switch (op.Op)
+		{
+		case CO_NUMBER:
+			pStack[++nStack] = op.IsInteger ? CalcInteger(op.IntValue) : CalcDouble(op.Value);
+			break;
+
+		case CO_SLOT:
+			return false;
+
+		case CO_NEGATE:
+			if (pStack[nStack].IsInteger && pStack[nStack].Integer != INT64_MIN)
+				pStack[nStack] = CalcInteger(-pStack[nStack].Integer);
+			else
+				pStack[nStack] = CalcDouble(-pStack[nStack].Double);
+			break;
+
+		case CO_LNOT:
+			pStack[nStack] = CalcBool(!CalcIsTrue(pStack[nStack]));
+			break;
+
+		case CO_NOT:
+			pStack[nStack] = CalcInteger(~CalcToInteger(pStack[nStack]));
+			break;
+
+		default:
+		{
+			if (!nStack)
+			{
+				FatalError("Illegal arithmetic in calculation");
+				return false;
+			}
+
+			const MQCalcValue right = pStack[nStack--];
+			if (!CalcBinaryOp(op.Op, pStack[nStack], right, pStack[nStack]))
+				return false;
+			break;
+		}
+		}
+	}
+
+	Result = pStack[nStack];
+	return true;
+}
+
+bool CalculateExact(const char* szFormula, MQCalcValue& Result)
+{
+	char Buffer[MAX_STRING] = { 0 };
+	strcpy_s(Buffer, szFormula);
+	_strupr_s(Buffer);
+
+	ReplaceCalculationKeywords(Buffer, true);
+
+	if (!Buffer[0])
+		return false;
+
+	const int MaxOps = static_cast<int>(strlen(Buffer)) + 1;
+
+	MQTransientScope scope;
+
+	CalcOp* pOpList = scope.GetArena().AllocateArray<CalcOp>(MaxOps);
+	memset(pOpList, 0, sizeof(CalcOp) * MaxOps);
+
+	eCalcOp* pStack = scope.GetArena().AllocateArray<eCalcOp>(MaxOps);
+	memset(pStack, 0, sizeof(eCalcOp) * MaxOps);
+
+	int nOps = 0;
+	if (!ConvertToRPN(Buffer, pOpList, pStack, nOps, false))
+		return false;
+
+	bool Ret;
+	Benchmark(bmCalculate, Ret = EvaluateRPNExact(pOpList, nOps, Result));
+	return Ret;
+}
+
+//----------------------------------------------------------------------------
+// Compiled calculations
+//
+// A formula is compiled ahead of time with each of its ${} references replaced by a slot. Only
+// the references are evaluated when it runs, and each of them must produce a value that would
+// have been read back as a single number had it been pasted into the formula. Anything else is
+// reported back to the caller, who then evaluates the parsed formula with Calculate instead.
+
+struct MQCompiledCalculation
+{
+	struct Slot
+	{
+		std::string text;       // the reference, including ${ and }
+		std::string portion;    // the text between ${ and }
+		bool nested = false;    // portion contains references of its own
+		bool afterMinus = false; // a negative value would have formed -- with the text before it
+	};
+
+	std::vector<CalcOp> ops;
+	std::vector<Slot> slots;
+};
+
+// Mirrors the brace matching of ParseMacroData, including its handling of quoted parameters.
+// Returns the position of the } that closes the reference that starts at start.
+static size_t FindCalculationSlotEnd(std::string_view formula, size_t start)
+{
+	bool quote = false;
+	bool beginParam = false;
+	int braces = 1;
+
+	for (size_t pos = start + 2; pos < formula.size(); ++pos)
+	{
+		const char ch = formula[pos];
+
+		if (beginParam)
+		{
+			beginParam = false;
+			if (ch == '\"')
+				quote = true;
+			continue;
+		}
+
+		if (quote)
+		{
+			if (ch == '\"' && pos + 1 < formula.size() && (formula[pos + 1] == ']' || formula[pos + 1] == ','))
+				quote = false;
+		}
+		else if (ch == '}')
+		{
+			if (--braces == 0)
+				return pos;
+		}
+		else if (ch == '{')
+		{
+			++braces;
+		}
+		else if (ch == '[' || ch == ',')
+		{
+			beginParam = true;
+		}
+	}
+
+	return std::string_view::npos;
+}
+
+std::shared_ptr<MQCompiledCalculation> CompileCalculation(std::string_view formula)
+{
+	auto compiled = std::make_shared<MQCompiledCalculation>();
+
+	char Buffer[MAX_STRING] = { 0 };
+	size_t length = 0;
+
+	for (size_t pos = 0; pos < formula.size(); )
+	{
+		if (length + 1 >= MAX_STRING)
+			return nullptr;
+
+		if (formula[pos] == '$' && pos + 1 < formula.size() && formula[pos + 1] == '{')
+		{
+			const size_t end = FindCalculationSlotEnd(formula, pos);
+			if (end == std::string_view::npos || end == pos + 2)
+				return nullptr;
+
+			MQCompiledCalculation::Slot& slot = compiled->slots.emplace_back();
+			slot.text = formula.substr(pos, end + 1 - pos);
+			slot.portion = formula.substr(pos + 2, end - pos - 2);
+			slot.nested = slot.portion.find("${") != std::string::npos;
+			slot.afterMinus = length > 0 && Buffer[length - 1] == '-';
+
+			Buffer[length++] = CalcSlotMarker;
+			pos = end + 1;
+		}
+		else
+		{
+			if (formula[pos] == CalcSlotMarker)
+				return nullptr;
+
+			Buffer[length++] = static_cast<char>(toupper(static_cast<unsigned char>(formula[pos])));
+			++pos;
+		}
+	}
+
+	Buffer[length] = 0;
+	ReplaceCalculationKeywords(Buffer);
+
+	if (!Buffer[0])
+		return nullptr;
+
+	const int MaxOps = static_cast<int>(length) + 1;
+
+	MQTransientScope scope;
+
+	CalcOp* pOpList = scope.GetArena().AllocateArray<CalcOp>(MaxOps);
+	memset(pOpList, 0, sizeof(CalcOp) * MaxOps);
+
+	eCalcOp* pStack = scope.GetArena().AllocateArray<eCalcOp>(MaxOps);
+	memset(pStack, 0, sizeof(eCalcOp) * MaxOps);
+
+	int nOps = 0;
+	if (!ConvertToRPN(Buffer, pOpList, pStack, nOps, true) || nOps == 0)
+		return nullptr;
+
+	compiled->ops.assign(pOpList, pOpList + nOps);
+	return compiled;
+}
+
+// Reads the value of a slot the same way it would have been read had it been pasted into the
+// formula, or returns false if it would not have been a single number.
+static bool GetCalculationSlotValue(const char* szValue, double& Value)
+{
+	if (!_stricmp(szValue, "NULL") || !_stricmp(szValue, "FALSE"))
+	{
+		Value = 0.0;
+		return true;
+	}
+
+	if (!_stricmp(szValue, "TRUE"))
+	{
+		Value = 1.0;
+		return true;
+	}
+
+	const bool negative = szValue[0] == '-';
+	const char* pDigits = negative ? szValue + 1 : szValue;
+	if (!pDigits[0])
+		return false;
+
+	for (const char* pCur = pDigits; *pCur; ++pCur)
+	{
+		if (*pCur != '.' && (*pCur < '0' || *pCur > '9'))
+			return false;
+	}
+
+	Value = GetDoubleFromString(pDigits, 0.0);
+	if (negative)
+		Value = -Value;
+
+	return true;
+}
+
+static bool EvaluateCalculationSlot(const MQCompiledCalculation::Slot& slot, double& Value)
+{
+	char szValue[MAX_STRING] = { 0 };
+
+	if (gParserVersion != 2 && !slot.nested)
+	{
+		// Same as what ParseMacroData does for a reference without references inside of it.
+		strcpy_s(szValue, slot.portion.c_str());
+
+		MQTypeVar Result;
+		if (!pDataAPI->ParseMQ2DataPortion(szValue, Result) || !Result.Type || !Result.Type->ToString(Result.VarPtr, szValue))
+		{
+			strcpy_s(szValue, "NULL");
+		}
+
+		// An ini read that returned a reference asks for the rest of the line not to be parsed.
+		if (!bAllowCommandParse)
+		{
+			bAllowCommandParse = true;
+			return false;
+		}
+	}
+	else
+	{
+		strcpy_s(szValue, slot.text.c_str());
+		ParseMacroData(szValue, sizeof(szValue));
+	}
+
+	if (slot.afterMinus && szValue[0] == '-')
+		return false;
+
+	return GetCalculationSlotValue(szValue, Value);
+}
+
+CalculateResult EvaluateCompiledCalculation(const MQCompiledCalculation& compiled, double& Result)
+{
+	MQTransientScope scope;
+
+	const size_t slotCount = compiled.slots.size();
+	double* pSlots = scope.GetArena().AllocateArray<double>(slotCount + 1);
+
+	for (size_t i = 0; i < slotCount; ++i)
+	{
+		if (!EvaluateCalculationSlot(compiled.slots[i], pSlots[i]))
+			return CalculateResult::NotNumeric;
+	}
+
+	bool Ret;
+	Benchmark(bmCalculate, Ret = EvaluateRPN(compiled.ops.data(), static_cast<int>(compiled.ops.size()), Result, pSlots));
+	return Ret ? CalculateResult::Success : CalculateResult::Failure;
+}
+
+//----------------------------------------------------------------------------
+// Alternate ability lookup tables
+//
+// The abilities the character bought, and every ability, by name and by id. Names are looked up
+// with the abilities ranked for the character's level, like the searches these replace did.
+// Abilities are only bought between pulses, so the bought abilities are compared against the
+// character on the first lookup of each pulse and rebuilt if any of them changed. The table of
+// every ability only depends on the level.
+
+struct AltAbilityTables
+{
+	PcClient* pPC = nullptr;
+	int level = -1;
+	bool verified = false;
+
+	std::vector<int> ownedIndexes;                       // GetAlternateAbilityId of each slot
+	std::unordered_map<int, int> ownedSlots;             // ability index -> slot
+	ci_unordered::map<std::string, int> ownedByName;     // name -> ability index
+	std::unordered_map<int, int> ownedByID;              // ID -> ability index
+
+	bool allBuilt = false;
+	int allLevel = -1;
+	ci_unordered::map<std::string, int> allByName;
+	std::unordered_map<int, int> allByID;
+};
+
+static AltAbilityTables s_altAbilityTables;
+
+void InvalidateAltAbilityTables()
+{
+	s_altAbilityTables.verified = false;
+}
+
+static void BuildOwnedAltAbilityTables(AltAbilityTables& tables, int level)
+{
+	tables.pPC = pLocalPC;
+	tables.level = level;
+	tables.ownedIndexes.resize(AA_CHAR_MAX_REAL);
+	tables.ownedSlots.clear();
+	tables.ownedByName.clear();
+	tables.ownedByID.clear();
+
+	for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+	{
+		const int abilityIndex = pLocalPC->GetAlternateAbilityId(nAbility);
+		tables.ownedIndexes[nAbility] = abilityIndex;
+		tables.ownedSlots.emplace(abilityIndex, nAbility);
+
+		// emplace keeps the first match, same as searching the slots in order.
+		if (CAltAbilityData* pAbility = GetAAById(abilityIndex, level))
+		{
+			if (const char* pName = pCDBStr->GetString(pAbility->nName, eAltAbilityName))
+				tables.ownedByName.emplace(pName, abilityIndex);
+		}
+
+		if (CAltAbilityData* pAbility = GetAAById(abilityIndex))
+			tables.ownedByID.emplace(pAbility->ID, abilityIndex);
+	}
+}
+
+static bool AreOwnedAltAbilityTablesCurrent(const AltAbilityTables& tables, int level)
+{
+	if (tables.pPC != pLocalPC || tables.level != level
+		|| tables.ownedIndexes.size() != static_cast<size_t>(AA_CHAR_MAX_REAL))
+	{
+		return false;
+	}
+
+	for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+	{
+		if (pLocalPC->GetAlternateAbilityId(nAbility) != tables.ownedIndexes[nAbility])
+			return false;
+	}
+
+	return true;
+}
+
+// Returns the tables with the bought abilities up to date, or nullptr if the abilities have to
+// be searched instead.
+static AltAbilityTables* GetAltAbilityTables()
+{
+	if (!pLocalPC || !pAltAdvManager || !IsMainThread())
+		return nullptr;
+
+	AltAbilityTables& tables = s_altAbilityTables;
+	const int level = pLocalPlayer ? pLocalPlayer->Level : -1;
+
+	if (!tables.verified || tables.pPC != pLocalPC || tables.level != level)
+	{
+		if (!AreOwnedAltAbilityTablesCurrent(tables, level))
+			BuildOwnedAltAbilityTables(tables, level);
+
+		tables.verified = true;
+	}
+
+	return &tables;
+}
+
+static void BuildAllAltAbilityTables(AltAbilityTables& tables)
+{
+	if (tables.allBuilt && tables.allLevel == tables.level)
+		return;
+
+	tables.allByName.clear();
+	tables.allByID.clear();
+
+	for (int nAbility = 0; nAbility < NUM_ALT_ABILITIES; nAbility++)
+	{
+		if (CAltAbilityData* pAbility = GetAAById(nAbility, tables.level))
+		{
+			if (const char* pName = pCDBStr->GetString(pAbility->nName, eAltAbilityName))
+				tables.allByName.emplace(pName, nAbility);
+		}
+
+		if (CAltAbilityData* pAbility = GetAAById(nAbility))
+			tables.allByID.emplace(pAbility->ID, nAbility);
+	}
+
+	tables.allBuilt = true;
+	tables.allLevel = tables.level;
+}
+
+CAltAbilityData* GetOwnedAAByName(const char* AAName)
+{
+	if (AltAbilityTables* pTables = GetAltAbilityTables())
+	{
+		auto iter = pTables->ownedByName.find(std::string_view{ AAName });
+		return iter != pTables->ownedByName.end() ? GetAAById(iter->second, pTables->level) : nullptr;
+	}
+
+	if (!pLocalPC) return nullptr;
+	int level = pLocalPlayer ? pLocalPlayer->Level : -1;
+
+	for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+	{
+		if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility), level))
+		{
+			if (const char* pName = pCDBStr->GetString(pAbility->nName, eAltAbilityName))
+			{
+				if (!_stricmp(AAName, pName))
+				{
+					return pAbility;
+				}
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+CAltAbilityData* GetOwnedAAByID(int ID)
+{
+	if (AltAbilityTables* pTables = GetAltAbilityTables())
+	{
+		auto iter = pTables->ownedByID.find(ID);
+		return iter != pTables->ownedByID.end() ? GetAAById(iter->second) : nullptr;
+	}
+
+	if (!pLocalPC) return nullptr;
+
+	for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+	{
+		if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility)))
+		{
+			if (pAbility->ID == ID)
+			{
+				return pAbility;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+bool PlayerHasAAAbility(int AAIndex)
+{
+	if (AltAbilityTables* pTables = GetAltAbilityTables())
+		return pTables->ownedSlots.count(AAIndex) != 0;
+
+	for (int i = 0; i < AA_CHAR_MAX_REAL; i++)
+	{
+		if (pLocalPC->GetAlternateAbilityId(i) == AAIndex)
+			return true;
 	}
+	return false;
+}
+
+int GetAAIndexByName(const char* AAName)
+{
+	// check bought aa's first
+	if (CAltAbilityData* pAbility = GetOwnedAAByName(AAName))
+		return pAbility->Index;
+
+	int level = pLocalPlayer ? pLocalPlayer->Level : -1;
 
 	// not found? fine lets check them all then...
+	if (AltAbilityTables* pTables = GetAltAbilityTables())
+	{
+		BuildAllAltAbilityTables(*pTables);
+
+		auto iter = pTables->allByName.find(std::string_view{ AAName });
+		if (iter == pTables->allByName.end())
+			return 0;
+
+		CAltAbilityData* pAbility = GetAAById(iter->second, level);
+		return pAbility ? pAbility->Index : 0;
+	}
+
 	for (int nAbility = 0; nAbility < NUM_ALT_ABILITIES; nAbility++)
 	{
 		if (CAltAbilityData* pAbility = GetAAById(nAbility, level))
@@ -2526,18 +3648,22 @@ int GetAAIndexByName(const char* AAName)
 int GetAAIndexByID(int ID)
 {
 	// check our bought aa's first
-	for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+	if (CAltAbilityData* pAbility = GetOwnedAAByID(ID))
+		return pAbility->Index;
+
+	// didnt find it? fine we go through them all then...
+	if (AltAbilityTables* pTables = GetAltAbilityTables())
 	{
-		if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility)))
-		{
-			if (pAbility->ID == ID)
-			{
-				return pAbility->Index;
-			}
-		}
+		BuildAllAltAbilityTables(*pTables);
+
+		auto iter = pTables->allByID.find(ID);
+		if (iter == pTables->allByID.end())
+			return 0;
+
+		CAltAbilityData* pAbility = GetAAById(iter->second);
+		return pAbility ? pAbility->Index : 0;
 	}
 
-	// didnt find it? fine we go through them all then...
 	for (int nAbility = 0; nAbility < NUM_ALT_ABILITIES; nAbility++)
 	{
 		if (CAltAbilityData* pAbility = GetAAById(nAbility))
@@ -2953,22 +4079,34 @@ char* FormatSearchSpawn(char* Buffer, size_t BufferSize, MQSpawnSearch* pSearchS
 	return Buffer;
 }
 
+// Visits the spawns that could be within the search radius using the spawn grid. Returns false if
+// the search has no radius or the grid can't be used, in which case every spawn must be checked.
+static bool ForEachSpawnInSearchRadius(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pOrigin,
+	const std::function<void(SPAWNINFO*)>& callback)
+{
+	if (pSearchSpawn->FRadius >= 10000.0f)
+		return false;
+
+	float x = pSearchSpawn->bKnownLocation ? pSearchSpawn->xLoc : pOrigin->X;
+	float y = pSearchSpawn->bKnownLocation ? pSearchSpawn->yLoc : pOrigin->Y;
+
+	return ForEachSpawnInRadius(x, y, static_cast<float>(pSearchSpawn->FRadius), callback);
+}
+
 SPAWNINFO* NthNearestSpawn(MQSpawnSearch* pSearchSpawn, int Nth, SPAWNINFO* pOrigin, bool IncludeOrigin)
 {
 	if (!pSearchSpawn || Nth == 0 || !pOrigin)
 		return nullptr;
 
 	std::vector<MQSpawnArrayItem> spawnSet;
-	spawnSet.reserve(gSpawnsArray.size());
+	MQSpawnSearchPredicate predicate(*pSearchSpawn);
 
-	for (const MQSpawnArrayItem& item : gSpawnsArray)
+	auto addSpawn = [&](SPAWNINFO* pSpawn)
 	{
-		SPAWNINFO* pSpawn = item.GetSpawn();
-
 		if (!IncludeOrigin && pSpawn == pOrigin)
-			continue;
+			return;
 
-		if (SpawnMatchesSearch(pSearchSpawn, pOrigin, pSpawn))
+		if (predicate.Matches(pOrigin, pSpawn))
 		{
 			float distSq = Get3DDistanceSquared(pOrigin->X, pOrigin->Y, pOrigin->Z,
 				pSpawn->X, pSpawn->Y, pSpawn->Z);
@@ -2976,6 +4114,14 @@ SPAWNINFO* NthNearestSpawn(MQSpawnSearch* pSearchSpawn, int Nth, SPAWNINFO* pOri
 			// Spawn matches our search, add it to our set.
 			spawnSet.emplace_back(pSpawn, distSq);
 		}
+	};
+
+	if (!ForEachSpawnInSearchRadius(pSearchSpawn, pOrigin, addSpawn))
+	{
+		spawnSet.reserve(gSpawnsArray.size());
+
+		for (const MQSpawnArrayItem& item : gSpawnsArray)
+			addSpawn(item.GetSpawn());
 	}
 
 	if (Nth > static_cast<int>(spawnSet.size()))
@@ -2983,8 +4129,8 @@ SPAWNINFO* NthNearestSpawn(MQSpawnSearch* pSearchSpawn, int Nth, SPAWNINFO* pOri
 		return nullptr;
 	}
 
-	// sort our list
-	std::sort(std::begin(spawnSet), std::end(spawnSet), MQRankFloatCompare);
+	// only the Nth nearest needs to be in its sorted position
+	std::nth_element(std::begin(spawnSet), std::begin(spawnSet) + (Nth - 1), std::end(spawnSet), MQRankFloatCompare);
 
 	// get our Nth nearest
 	return spawnSet[Nth - 1].GetSpawn();
@@ -2996,32 +4142,68 @@ int CountMatchingSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pOrigin, bool In
 		return 0;
 
 	int TotalMatching = 0;
-	SPAWNINFO* pSpawn = pSpawnList;
+	MQSpawnSearchPredicate predicate(*pSearchSpawn);
 
-	if (IncludeOrigin)
+	auto countSpawn = [&](SPAWNINFO* pSpawn)
 	{
-		while (pSpawn)
+		if ((IncludeOrigin || pSpawn != pOrigin) && predicate.Matches(pOrigin, pSpawn))
 		{
-			if (SpawnMatchesSearch(pSearchSpawn, pOrigin, pSpawn))
-			{
-				TotalMatching++;
-			}
-			pSpawn = pSpawn->pNext;
+			// matches search, add to our set
+			TotalMatching++;
 		}
-	}
-	else
+	};
+
+	if (ForEachSpawnInSearchRadius(pSearchSpawn, pOrigin, countSpawn))
+		return TotalMatching;
+
+	for (SPAWNINFO* pSpawn = pSpawnList; pSpawn; pSpawn = pSpawn->pNext)
+		countSpawn(pSpawn);
+
+	return TotalMatching;
+}
+
+// Returns the spawns that match the search in a single pass, nearest to the origin first.
+std::vector<SPAWNINFO*> SearchAllSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pOrigin, size_t maxResults, bool IncludeOrigin)
+{
+	std::vector<SPAWNINFO*> results;
+
+	if (!pSearchSpawn || !pOrigin || maxResults == 0)
+		return results;
+
+	std::vector<MQSpawnArrayItem> spawnSet;
+	MQSpawnSearchPredicate predicate(*pSearchSpawn);
+
+	auto addSpawn = [&](SPAWNINFO* pSpawn)
 	{
-		while (pSpawn)
+		if ((IncludeOrigin || pSpawn != pOrigin) && predicate.Matches(pOrigin, pSpawn))
 		{
-			if (pSpawn != pOrigin && SpawnMatchesSearch(pSearchSpawn, pOrigin, pSpawn))
-			{
-				// matches search, add to our set
-				TotalMatching++;
-			}
-			pSpawn = pSpawn->pNext;
+			spawnSet.emplace_back(pSpawn, Get3DDistanceSquared(pOrigin->X, pOrigin->Y, pOrigin->Z,
+				pSpawn->X, pSpawn->Y, pSpawn->Z));
 		}
+	};
+
+	if (!ForEachSpawnInSearchRadius(pSearchSpawn, pOrigin, addSpawn))
+	{
+		for (SPAWNINFO* pSpawn = pSpawnList; pSpawn; pSpawn = pSpawn->pNext)
+			addSpawn(pSpawn);
 	}
-	return TotalMatching;
+
+	// only the results that are returned need to be in order
+	if (maxResults < spawnSet.size())
+	{
+		std::partial_sort(std::begin(spawnSet), std::begin(spawnSet) + maxResults, std::end(spawnSet), MQRankFloatCompare);
+		spawnSet.resize(maxResults);
+	}
+	else
+	{
+		std::sort(std::begin(spawnSet), std::end(spawnSet), MQRankFloatCompare);
+	}
+
+	results.reserve(spawnSet.size());
+	for (const MQSpawnArrayItem& item : spawnSet)
+		results.push_back(item.GetSpawn());
+
+	return results;
 }
 
 SPAWNINFO* SearchThroughSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar)
@@ -3032,6 +4214,10 @@ SPAWNINFO* SearchThroughSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar)
 	{
 		pFromSpawn = GetSpawnByID(pSearchSpawn->FromSpawnID);
 		if (!pFromSpawn) return nullptr;
+
+		EnsureSpawnsArraySorted();
+		MQSpawnSearchPredicate predicate(*pSearchSpawn);
+
 		for (int index = 0; index < (int)gSpawnsArray.size(); index++)
 		{
 			const MQSpawnArrayItem& item = gSpawnsArray[index];
@@ -3046,7 +4232,7 @@ SPAWNINFO* SearchThroughSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar)
 						SPAWNINFO* pPrevSpawn = gSpawnsArray[index].GetSpawn();
 
 						if (pPrevSpawn
-							&& SpawnMatchesSearch(pSearchSpawn, pFromSpawn, pPrevSpawn))
+							&& predicate.Matches(pFromSpawn, pPrevSpawn))
 						{
 							return pPrevSpawn;
 						}
@@ -3060,7 +4246,7 @@ SPAWNINFO* SearchThroughSpawns(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar)
 						SPAWNINFO* pNextSpawn = gSpawnsArray[index].GetSpawn();
 
 						if (pNextSpawn
-							&& SpawnMatchesSearch(pSearchSpawn, pFromSpawn, pNextSpawn))
+							&& predicate.Matches(pFromSpawn, pNextSpawn))
 						{
 							return pNextSpawn;
 						}
@@ -3190,289 +4376,415 @@ bool SearchSpawnMatchesSearchSpawn(MQSpawnSearch* pSearchSpawn1, MQSpawnSearch*
 	return true;
 }
 
-bool SpawnMatchesSearch(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar, SPAWNINFO* pSpawn)
-{
-	if (pSearchSpawn == nullptr || pChar == nullptr || pSpawn == nullptr || !pLocalPC)
-		return false;
+//----------------------------------------------------------------------------
+// Compiled spawn search predicates
 
-	eSpawnType SpawnType = GetSpawnType(pSpawn);
+struct SpawnSearchChecks
+{
+	using Predicate = MQSpawnSearchPredicate;
 
-	if (SpawnType == PET)
+	static bool SpawnType(const Predicate& p, SPAWNINFO* pChar, SPAWNINFO* pSpawn)
 	{
-		if (pSearchSpawn->bNoPet)
-			return false;
+		const MQSpawnSearch* pSearchSpawn = &p.m_search;
+		eSpawnType SpawnType = GetSpawnType(pSpawn);
 
-		if (pSearchSpawn->SpawnType == NPCPET || pSearchSpawn->SpawnType == PCPET || pSearchSpawn->SpawnType == NPC)
+		if (SpawnType == PET)
 		{
-			if (SPAWNINFO* pTheMaster = GetSpawnByID(pSpawn->MasterID))
+			if (pSearchSpawn->bNoPet)
+				return false;
+
+			if (pSearchSpawn->SpawnType == NPCPET || pSearchSpawn->SpawnType == PCPET || pSearchSpawn->SpawnType == NPC)
 			{
-				if (pTheMaster->Type != SPAWN_PLAYER)
+				if (SPAWNINFO* pTheMaster = GetSpawnByID(pSpawn->MasterID))
 				{
-					if (pSearchSpawn->SpawnType == PCPET)
+					if (pTheMaster->Type != SPAWN_PLAYER)
+					{
+						if (pSearchSpawn->SpawnType == PCPET)
+							return false;
+					}
+					else if (pSearchSpawn->SpawnType != PCPET)
+					{
 						return false;
+					}
 				}
-				else if (pSearchSpawn->SpawnType != PCPET)
+				else if (pSearchSpawn->SpawnType == PCPET)
 				{
 					return false;
 				}
-			}
-			else if (pSearchSpawn->SpawnType == PCPET)
-			{
-				return false;
-			}
 
-			SpawnType = pSearchSpawn->SpawnType;
+				SpawnType = pSearchSpawn->SpawnType;
+			}
 		}
-	}
 
-	if (pSearchSpawn->SpawnType != SpawnType && pSearchSpawn->SpawnType != NONE)
-	{
-		if (pSearchSpawn->SpawnType == NPCCORPSE)
+		if (pSearchSpawn->SpawnType != SpawnType && pSearchSpawn->SpawnType != NONE)
 		{
-			if (SpawnType != CORPSE || pSpawn->Deity)
+			if (pSearchSpawn->SpawnType == NPCCORPSE)
 			{
-				return false;
+				if (SpawnType != CORPSE || pSpawn->Deity)
+				{
+					return false;
+				}
 			}
-		}
-		else if (pSearchSpawn->SpawnType == PCCORPSE)
-		{
-			if (SpawnType != CORPSE || !pSpawn->Deity)
+			else if (pSearchSpawn->SpawnType == PCCORPSE)
+			{
+				if (SpawnType != CORPSE || !pSpawn->Deity)
+				{
+					return false;
+				}
+			}
+			else if (pSearchSpawn->SpawnType == NPC && SpawnType == UNTARGETABLE)
 			{
 				return false;
 			}
-		}
-		else if (pSearchSpawn->SpawnType == NPC && SpawnType == UNTARGETABLE)
-		{
-			return false;
-		}
 
-		// if the search type is not npc or the mob type is UNT, continue?
-		// stupid /who
+			// if the search type is not npc or the mob type is UNT, continue?
+			// stupid /who
 
-		else if (pSearchSpawn->SpawnType != NPC || SpawnType != UNTARGETABLE)
-		{
-			return false;
+			else if (pSearchSpawn->SpawnType != NPC || SpawnType != UNTARGETABLE)
+			{
+				return false;
+			}
 		}
+
+		return true;
 	}
 
-	if (pSearchSpawn->MinLevel && pSpawn->Level < pSearchSpawn->MinLevel)
-		return false;
-	if (pSearchSpawn->MaxLevel && pSpawn->Level > pSearchSpawn->MaxLevel)
-		return false;
-	if (pSearchSpawn->NotID == pSpawn->SpawnID)
-		return false;
-	if (pSearchSpawn->bSpawnID && pSearchSpawn->SpawnID != pSpawn->SpawnID)
-		return false;
-	if (pSearchSpawn->GuildID != -1 && pSearchSpawn->GuildID != pSpawn->GuildID)
-		return false;
+	static bool MinLevel(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->Level >= p.m_search.MinLevel; }
+	static bool MaxLevel(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->Level <= p.m_search.MaxLevel; }
+	static bool NotID(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return p.m_search.NotID != pSpawn->SpawnID; }
+	static bool SpawnID(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return p.m_search.SpawnID == pSpawn->SpawnID; }
+	static bool GuildID(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return p.m_search.GuildID == pSpawn->GuildID; }
+	static bool NoGuild(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->GuildID == -1 || pSpawn->GuildID == 0; }
+	static bool LFG(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->LFG; }
+	static bool Trader(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->Trader; }
 
-	if (pSearchSpawn->bGM && pSearchSpawn->SpawnType != NPC)
+	static bool PlayerState(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (!pSpawn->GM)
-			return false;
+		// if player state isn't 0 and we have that bit set
+		return (pSpawn->PlayerState & p.m_search.PlayerState) != 0;
 	}
 
-	if (pSearchSpawn->bGM && pSearchSpawn->SpawnType == NPC)
+	static bool GM(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->GM; }
+
+	static bool GMClass(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (pSpawn->GetClass() < 20 || pSpawn->GetClass() > 35)
-			return false;
+		return pSpawn->GetClass() >= 20 && pSpawn->GetClass() <= 35;
 	}
 
-	if (pSearchSpawn->bNamed && !IsNamed(pSpawn))
-		return false;
-	if (pSearchSpawn->bMerchant && pSpawn->GetClass() != 41)
-		return false;
-	if (pSearchSpawn->bBanker && pSpawn->GetClass() != 40)
-		return false;
-	if (pSearchSpawn->bTributeMaster && pSpawn->GetClass() != 63)
-		return false;
-	if (pSearchSpawn->bNoGuild && (pSpawn->GuildID != -1 && pSpawn->GuildID != 0))
-		return false;
+	static bool Merchant(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->GetClass() == 41; }
+	static bool Banker(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->GetClass() == 40; }
+	static bool TributeMaster(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pSpawn->GetClass() == 63; }
 
-	if (pSearchSpawn->bKnight && pSearchSpawn->SpawnType != NPC)
+	static bool Knight(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (pSpawn->GetClass() != Paladin
-			&& pSpawn->GetClass() != Shadowknight)
-		{
-			return false;
-		}
+		int classID = pSpawn->GetClass();
+		return classID == Paladin || classID == Shadowknight;
 	}
 
-	if (pSearchSpawn->bTank && pSearchSpawn->SpawnType != NPC)
+	static bool Tank(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (pSpawn->GetClass() != Paladin
-			&& pSpawn->GetClass() != Shadowknight
-			&& pSpawn->GetClass() != Warrior)
-		{
-			return false;
-		}
+		int classID = pSpawn->GetClass();
+		return classID == Paladin || classID == Shadowknight || classID == Warrior;
 	}
 
-	if (pSearchSpawn->bHealer && pSearchSpawn->SpawnType != NPC)
+	static bool Healer(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (pSpawn->GetClass() != Cleric
-			&& pSpawn->GetClass() != Druid
-			&& pSpawn->GetClass() != Shaman)
-		{
-			return false;
-		}
+		int classID = pSpawn->GetClass();
+		return classID == Cleric || classID == Druid || classID == Shaman;
 	}
 
-	if (pSearchSpawn->bDps && pSearchSpawn->SpawnType != NPC)
+	static bool Dps(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (pSpawn->GetClass() != Ranger
-			&& pSpawn->GetClass() != Rogue
-			&& pSpawn->GetClass() != Wizard
-			&& pSpawn->GetClass() != Berserker)
-		{
-			return false;
-		}
+		int classID = pSpawn->GetClass();
+		return classID == Ranger || classID == Rogue || classID == Wizard || classID == Berserker;
 	}
 
-	if (pSearchSpawn->bSlower && pSearchSpawn->SpawnType != NPC)
+	static bool Slower(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (pSpawn->GetClass() != Shaman
-			&& pSpawn->GetClass() != Enchanter
-			&& pSpawn->GetClass() != Beastlord
-			&& pSpawn->GetClass() != Bard)
-		{
-			return false;
-		}
+		int classID = pSpawn->GetClass();
+		return classID == Shaman || classID == Enchanter || classID == Beastlord || classID == Bard;
 	}
 
-	if (pSearchSpawn->bLFG && !pSpawn->LFG)
-		return false;
-	if (pSearchSpawn->bTrader && !pSpawn->Trader)
-		return false;
-
-	if (pSearchSpawn->bXTarHater)
+	static bool ZFilter(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		bool foundhater = false;
-
-		for (const ExtendedTargetSlot& xts : *pLocalPC->pExtendedTargetList)
-		{
-			if (xts.xTargetType == XTARGET_AUTO_HATER
-				&& xts.XTargetSlotStatus != eXTSlotEmpty
-				&& xts.SpawnID != 0)
-			{
-				SPAWNINFO* pXTargetSpawn = GetSpawnByID(xts.SpawnID);
-				if (pXTargetSpawn != nullptr
-					&& pXTargetSpawn->SpawnID == pSpawn->SpawnID)
-				{
-					foundhater = true;
-				}
-			}
-		}
+		// gZFilter can be changed at any time, so it is checked on every call.
+		return gZFilter >= 10000.0f
+			|| (pSpawn->Z <= p.m_search.zLoc + gZFilter && pSpawn->Z >= p.m_search.zLoc - gZFilter);
+	}
 
-		if (!foundhater)
-		{
-			return false;
-		}
+	static bool ZRadius(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
+	{
+		return pSpawn->Z <= p.m_search.zLoc + p.m_search.ZRadius && pSpawn->Z >= p.m_search.zLoc - p.m_search.ZRadius;
 	}
 
-	if (pSearchSpawn->bNoGroup && IsInGroup(pSpawn))
+	static bool LocationRadius(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		return false;
+		const MQSpawnSearch& search = p.m_search;
+		if (search.xLoc == pSpawn->X && search.yLoc == pSpawn->Y)
+			return true;
+
+		return Distance3DToPoint(pSpawn, search.xLoc, search.yLoc, search.zLoc) <= search.FRadius;
 	}
 
-	if (pSearchSpawn->bGroup && !IsInGroup(pSpawn, pSearchSpawn->SpawnType == PCCORPSE || pSpawn->Type == SPAWN_CORPSE))
+	static bool SpawnRadius(const Predicate& p, SPAWNINFO* pChar, SPAWNINFO* pSpawn)
 	{
-		return false;
+		return Distance3DToSpawn(pChar, pSpawn) <= p.m_search.FRadius;
 	}
 
-	if (pSearchSpawn->bFellowship && !IsInFellowship(pSpawn, pSearchSpawn->SpawnType == PCCORPSE || pSpawn->Type == SPAWN_CORPSE))
+	static bool ClassDesc(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return p.MatchesClassDesc(pSpawn->GetClass()); }
+	static bool BodyTypeDesc(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return p.MatchesBodyTypeDesc(GetBodyType(pSpawn)); }
+	static bool RaceDesc(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return p.MatchesRaceDesc(pSpawn->GetRace()); }
+
+	static bool Named(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return IsNamed(pSpawn); }
+
+	static bool Light(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		return false;
+		const char* pLight = GetLightForSpawn(pSpawn);
+		if (!_stricmp(pLight, "NONE"))
+			return false;
+		if (p.m_search.szLight[0] && _stricmp(pLight, p.m_search.szLight))
+			return false;
+		return true;
 	}
 
-	if (pSearchSpawn->bRaid && !IsInRaid(pSpawn, pSearchSpawn->SpawnType == PCCORPSE || pSpawn->Type == SPAWN_CORPSE))
+	static bool NoGroup(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return !IsInGroup(pSpawn); }
+
+	static bool Group(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		return false;
+		return IsInGroup(pSpawn, p.m_search.SpawnType == PCCORPSE || pSpawn->Type == SPAWN_CORPSE);
 	}
 
-	if (pSearchSpawn->bKnownLocation)
+	static bool Fellowship(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if ((pSearchSpawn->xLoc != pSpawn->X || pSearchSpawn->yLoc != pSpawn->Y))
-		{
-			if (pSearchSpawn->FRadius < 10000.0f
-				&& Distance3DToPoint(pSpawn, pSearchSpawn->xLoc, pSearchSpawn->yLoc, pSearchSpawn->zLoc)>pSearchSpawn->FRadius)
-			{
-				return false;
-			}
-		}
+		return IsInFellowship(pSpawn, p.m_search.SpawnType == PCCORPSE || pSpawn->Type == SPAWN_CORPSE);
 	}
-	else if (pSearchSpawn->FRadius < 10000.0f && Distance3DToSpawn(pChar, pSpawn)>pSearchSpawn->FRadius)
+
+	static bool Raid(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		return false;
+		return IsInRaid(pSpawn, p.m_search.SpawnType == PCCORPSE || pSpawn->Type == SPAWN_CORPSE);
 	}
 
-	if (pSearchSpawn->Radius > 0.0f && IsPCNear(pSpawn, pSearchSpawn->Radius))
-		return false;
-	if (gZFilter < 10000.0f && ((pSpawn->Z > pSearchSpawn->zLoc + gZFilter) || (pSpawn->Z < pSearchSpawn->zLoc - gZFilter)))
-		return false;
-	if (pSearchSpawn->ZRadius < 10000.0f && (pSpawn->Z > pSearchSpawn->zLoc + pSearchSpawn->ZRadius || pSpawn->Z < pSearchSpawn->zLoc - pSearchSpawn->ZRadius))
-		return false;
-	if (pSearchSpawn->bLight)
+	static bool Targetable(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return IsTargetable(pSpawn); }
+
+	static bool NotPCNear(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return !IsPCNear(pSpawn, p.m_search.Radius); }
+
+	static bool XTarHater(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return IsXTargetHater(pSpawn); }
+
+	static bool Alert(const Predicate& p, SPAWNINFO* pChar, SPAWNINFO* pSpawn)
 	{
-		const char* pLight = GetLightForSpawn(pSpawn);
-		if (!_stricmp(pLight, "NONE"))
-			return false;
-		if (pSearchSpawn->szLight[0] && _stricmp(pLight, pSearchSpawn->szLight))
-			return false;
+		return !CAlerts.AlertExist(p.m_search.AlertList) || IsAlert(pChar, pSpawn, p.m_search.AlertList);
 	}
-	if ((pSearchSpawn->bAlert) && CAlerts.AlertExist(pSearchSpawn->AlertList))
+
+	static bool NoAlert(const Predicate& p, SPAWNINFO* pChar, SPAWNINFO* pSpawn)
 	{
-		if (!IsAlert(pChar, pSpawn, pSearchSpawn->AlertList))
-			return false;
+		return !CAlerts.AlertExist(p.m_search.NoAlertList) || !IsAlert(pChar, pSpawn, p.m_search.NoAlertList);
 	}
-	if ((pSearchSpawn->bNoAlert) && CAlerts.AlertExist(pSearchSpawn->NoAlertList))
+
+	static bool NotNearAlert(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return !GetClosestAlert(pSpawn, p.m_search.NotNearAlertList); }
+	static bool NearAlert(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn) { return GetClosestAlert(pSpawn, p.m_search.NearAlertList); }
+
+	static bool LineOfSight(const Predicate&, SPAWNINFO*, SPAWNINFO* pSpawn) { return pControlledPlayer->CanSee(*pSpawn); }
+
+	// Case insensitive substring search against a needle that is already lowercase.
+	static bool ContainsLowercase(std::string_view haystack, std::string_view lowerNeedle)
 	{
-		if (IsAlert(pChar, pSpawn, pSearchSpawn->NoAlertList))
-			return false;
+		auto iter = std::search(std::begin(haystack), std::end(haystack), std::begin(lowerNeedle), std::end(lowerNeedle),
+			[](char a, char b) { return static_cast<char>(::tolower(static_cast<unsigned char>(a))) == b; });
+		return iter != std::end(haystack);
 	}
-	if (pSearchSpawn->bNotNearAlert && GetClosestAlert(pSpawn, pSearchSpawn->NotNearAlertList))
-		return false;
-	if (pSearchSpawn->bNearAlert && !GetClosestAlert(pSpawn, pSearchSpawn->NearAlertList))
-		return false;
-	if (pSearchSpawn->szClass[0] && _stricmp(pSearchSpawn->szClass, GetClassDesc(pSpawn->GetClass())))
-		return false;
-	if (pSearchSpawn->szBodyType[0] && _stricmp(pSearchSpawn->szBodyType, GetBodyTypeDesc(GetBodyType(pSpawn))))
-		return false;
-	if (pSearchSpawn->szRace[0] && _stricmp(pSearchSpawn->szRace, pEverQuest->GetRaceDesc(pSpawn->GetRace())))
-		return false;
-	if (pSearchSpawn->bLoS && !pControlledPlayer->CanSee(*pSpawn))
-		return false;
-	if (pSearchSpawn->bTargetable && !IsTargetable(pSpawn))
-		return false;
-	if (pSearchSpawn->PlayerState && !(pSpawn->PlayerState & pSearchSpawn->PlayerState)) // if player state isn't 0 and we have that bit set
-		return false;
 
-	if (pSearchSpawn->szName[0] && pSpawn->Name[0])
+	static bool Name(const Predicate& p, SPAWNINFO*, SPAWNINFO* pSpawn)
 	{
-		if (ci_find_substr(pSpawn->Name, pSearchSpawn->szName) == -1)
+		if (!pSpawn->Name[0])
+			return true;
+
+		if (!ContainsLowercase(pSpawn->Name, p.m_lowerName))
 		{
 			char szCleanName[EQ_MAX_NAME] = { 0 };
 			strcpy_s(szCleanName, pSpawn->Name);
 			CleanupName(szCleanName, sizeof(szCleanName), false);
 
-			if (ci_find_substr(szCleanName, pSearchSpawn->szName) == -1)
+			if (!ContainsLowercase(szCleanName, p.m_lowerName))
 				return false;
 		}
 
-		if (pSearchSpawn->bExactName)
+		if (p.m_search.bExactName)
 		{
 			char szCleanName[EQ_MAX_NAME] = { 0 };
 			strcpy_s(szCleanName, pSpawn->Name);
 			CleanupName(szCleanName, sizeof(szCleanName), false, !gbExactSearchCleanNames);
 
-			if (!ci_equals(szCleanName, pSearchSpawn->szName))
+			if (!ci_equals(szCleanName, p.m_search.szName))
 				return false;
 		}
+
+		return true;
+	}
+};
+
+MQSpawnSearchPredicate::MQSpawnSearchPredicate(const MQSpawnSearch& search)
+	: m_search(search)
+{
+	using Checks = SpawnSearchChecks;
+
+	// Simple field comparisons
+	if (search.MinLevel)
+		AddCheck(Checks::MinLevel);
+	if (search.MaxLevel)
+		AddCheck(Checks::MaxLevel);
+	AddCheck(Checks::NotID);
+	if (search.bSpawnID)
+		AddCheck(Checks::SpawnID);
+	if (search.GuildID != -1)
+		AddCheck(Checks::GuildID);
+	if (search.bNoGuild)
+		AddCheck(Checks::NoGuild);
+	if (search.bLFG)
+		AddCheck(Checks::LFG);
+	if (search.bTrader)
+		AddCheck(Checks::Trader);
+	if (search.PlayerState)
+		AddCheck(Checks::PlayerState);
+
+	// Class checks
+	if (search.bGM)
+		AddCheck(search.SpawnType == NPC ? Checks::GMClass : Checks::GM);
+	if (search.bMerchant)
+		AddCheck(Checks::Merchant);
+	if (search.bBanker)
+		AddCheck(Checks::Banker);
+	if (search.bTributeMaster)
+		AddCheck(Checks::TributeMaster);
+	if (search.SpawnType != NPC)
+	{
+		if (search.bKnight)
+			AddCheck(Checks::Knight);
+		if (search.bTank)
+			AddCheck(Checks::Tank);
+		if (search.bHealer)
+			AddCheck(Checks::Healer);
+		if (search.bDps)
+			AddCheck(Checks::Dps);
+		if (search.bSlower)
+			AddCheck(Checks::Slower);
+	}
+
+	// Spawn type (may look up the master of a pet)
+	AddCheck(Checks::SpawnType);
+
+	// Position
+	AddCheck(Checks::ZFilter);
+	if (search.ZRadius < 10000.0f)
+		AddCheck(Checks::ZRadius);
+	if (search.FRadius < 10000.0f)
+		AddCheck(search.bKnownLocation ? Checks::LocationRadius : Checks::SpawnRadius);
+
+	// Descriptions, remembered by ID
+	if (search.szClass[0])
+		AddCheck(Checks::ClassDesc);
+	if (search.szBodyType[0])
+		AddCheck(Checks::BodyTypeDesc);
+	if (search.szRace[0])
+		AddCheck(Checks::RaceDesc);
+
+	if (search.bNamed)
+		AddCheck(Checks::Named);
+	if (search.bLight)
+		AddCheck(Checks::Light);
+	if (search.bTargetable)
+		AddCheck(Checks::Targetable);
+
+	// Group, raid and other list membership
+	if (search.bNoGroup)
+		AddCheck(Checks::NoGroup);
+	if (search.bGroup)
+		AddCheck(Checks::Group);
+	if (search.bFellowship)
+		AddCheck(Checks::Fellowship);
+	if (search.bRaid)
+		AddCheck(Checks::Raid);
+	if (search.bXTarHater)
+		AddCheck(Checks::XTarHater);
+
+	if (search.szName[0])
+	{
+		m_lowerName = search.szName;
+		for (char& ch : m_lowerName)
+			ch = static_cast<char>(::tolower(static_cast<unsigned char>(ch)));
+
+		AddCheck(Checks::Name);
+	}
+
+	// Checks that search other spawns or the world
+	if (search.Radius > 0.0f)
+		AddCheck(Checks::NotPCNear);
+	if (search.bAlert)
+		AddCheck(Checks::Alert);
+	if (search.bNoAlert)
+		AddCheck(Checks::NoAlert);
+	if (search.bNotNearAlert)
+		AddCheck(Checks::NotNearAlert);
+	if (search.bNearAlert)
+		AddCheck(Checks::NearAlert);
+	if (search.bLoS)
+		AddCheck(Checks::LineOfSight);
+}
+
+bool MQSpawnSearchPredicate::Matches(SPAWNINFO* pChar, SPAWNINFO* pSpawn) const
+{
+	if (pChar == nullptr || pSpawn == nullptr || !pLocalPC)
+		return false;
+
+	for (size_t i = 0; i < m_numChecks; ++i)
+	{
+		if (!m_checks[i](*this, pChar, pSpawn))
+			return false;
 	}
 
 	return true;
 }
 
+static bool MatchesCachedDesc(std::vector<uint8_t>& cache, int id, int maxID, const char* searchDesc,
+	const char* (*getDesc)(int))
+{
+	if (id < 0 || id >= maxID)
+		return !_stricmp(searchDesc, getDesc(id));
+
+	if (static_cast<size_t>(id) >= cache.size())
+		cache.resize(id + 1, 0);
+
+	if (cache[id] == 0)
+		cache[id] = !_stricmp(searchDesc, getDesc(id)) ? 1 : 2;
+
+	return cache[id] == 1;
+}
+
+bool MQSpawnSearchPredicate::MatchesClassDesc(int classID) const
+{
+	return MatchesCachedDesc(m_classMatches, classID, MaxCachedDescID, m_search.szClass,
+		[](int id) -> const char* { return GetClassDesc(id); });
+}
+
+bool MQSpawnSearchPredicate::MatchesBodyTypeDesc(int bodyTypeID) const
+{
+	return MatchesCachedDesc(m_bodyTypeMatches, bodyTypeID, MaxCachedDescID, m_search.szBodyType,
+		[](int id) -> const char* { return GetBodyTypeDesc(id); });
+}
+
+bool MQSpawnSearchPredicate::MatchesRaceDesc(int raceID) const
+{
+	return MatchesCachedDesc(m_raceMatches, raceID, MaxCachedDescID, m_search.szRace,
+		[](int id) -> const char* { return pEverQuest->GetRaceDesc(id); });
+}
+
+bool SpawnMatchesSearch(MQSpawnSearch* pSearchSpawn, SPAWNINFO* pChar, SPAWNINFO* pSpawn)
+{
+	if (pSearchSpawn == nullptr)
+		return false;
+
+	return MQSpawnSearchPredicate(*pSearchSpawn).Matches(pChar, pSpawn);
+}
+
 const char* ParseSearchSpawnArgs(char* szArg, const char* szRest, MQSpawnSearch* pSearchSpawn)
 {
 	if (szArg && pSearchSpawn)
@@ -3905,27 +5217,7 @@ bool IsAlert(SPAWNINFO* pChar, SPAWNINFO* pSpawn, uint32_t id)
 	if (pSpawn == nullptr)
 		return false;
 
-	MQSpawnSearch SearchSpawn;
-
-	std::vector<MQSpawnSearch> alerts;
-	if (CAlerts.GetAlert(id, alerts))
-	{
-		for (auto& search : alerts)
-		{
-			if (search.SpawnID > 0 && search.SpawnID != pSpawn->SpawnID)
-				continue;
-
-			// FIXME
-			memcpy(&SearchSpawn, &search, sizeof(MQSpawnSearch));
-			SearchSpawn.SpawnID = pSpawn->SpawnID;
-
-			// if this spawn matches, it's true. This is an implied logical or
-			if (SpawnMatchesSearch(&SearchSpawn, pChar, pSpawn))
-				return true;
-		}
-	}
-
-	return false;
+	return CAlerts.SpawnMatchesAlert(pChar, pSpawn, id);
 }
 
 // FIXME: This function is broken, and doesn't actually check against the CAlerts list.
@@ -4373,9 +5665,11 @@ void SuperWhoDisplay(SPAWNINFO* pChar, MQSpawnSearch* pSearchSpawn, DWORD Color)
 	if (!pOrigin)
 		pOrigin = pChar;
 
+	MQSpawnSearchPredicate predicate(*pSearchSpawn);
+
 	while (pSpawn)
 	{
-		if (SpawnMatchesSearch(pSearchSpawn, pOrigin, pSpawn))
+		if (predicate.Matches(pOrigin, pSpawn))
 		{
 			// matches search, add to our set
 			SpawnSet.push_back(pSpawn);
@@ -4599,16 +5893,18 @@ bool LoH_HT_Ready()
 
 int GetSkillIDFromName(const char* name)
 {
-	for (int i = 0; i < NUM_SKILLS; i++)
-	{
-		if (EQ_Skill* pSkill = pSkillMgr->pSkill[i])
-		{
-			if (!_stricmp(name, pStringTable->getString(pSkill->nName)))
-				return i;
-		}
-	}
+	if (!pSkillMgr || !pStringTable)
+		return 0;
 
-	return 0;
+	static NameTable s_skillIDs;
+	return s_skillIDs.Find(name, pSkillMgr, 0, [](const NameTable::AddFunction& add)
+		{
+			for (int i = 0; i < NUM_SKILLS; i++)
+			{
+				if (EQ_Skill* pSkill = pSkillMgr->pSkill[i])
+					add(pStringTable->getString(pSkill->nName), i);
+			}
+		});
 }
 
 bool InHoverState()
@@ -4843,6 +6139,14 @@ bool BuffStackTest(SPELL* aSpell, SPELL* bSpell, bool bIgnoreTriggeringEffects,
 	return true;
 }
 
+// Results of WillStackWith, keyed by the ids of the two spells. The test only depends on the spells
+// and on the character casting them, and buff bots repeat it for every buff on every target, so
+// the results are kept until the character changes. Only used from the main thread.
+static std::unordered_map<uint64_t, bool> s_willStackWithCache;
+static uint32_t s_willStackWithSpawnID = 0;
+static int s_willStackWithLevel = -1;
+static constexpr size_t MaxWillStackWithCacheSize = 65536;
+
 /**
  * @fn WillStackWith
  *
@@ -4862,6 +6166,22 @@ bool WillStackWith(const EQ_Spell* testSpell, const EQ_Spell* existingSpell)
 	if (!pLocalPlayer || !pLocalPC)
 		return false;
 
+	// Spawn ids are handed out again on every zone, so this also drops the cache when zoning.
+	if (s_willStackWithSpawnID != pLocalPlayer->SpawnID || s_willStackWithLevel != pLocalPlayer->Level
+		|| s_willStackWithCache.size() >= MaxWillStackWithCacheSize)
+	{
+		s_willStackWithCache.clear();
+		s_willStackWithSpawnID = pLocalPlayer->SpawnID;
+		s_willStackWithLevel = pLocalPlayer->Level;
+	}
+
+	const uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(testSpell->ID)) << 32)
+		| static_cast<uint32_t>(existingSpell->ID);
+
+	auto iter = s_willStackWithCache.find(key);
+	if (iter != s_willStackWithCache.end())
+		return iter->second;
+
 	EQ_Affect buff;
 	buff.Level = pLocalPlayer->Level;
 	buff.CasterGuid = pLocalPC->Guid;
@@ -4871,7 +6191,9 @@ bool WillStackWith(const EQ_Spell* testSpell, const EQ_Spell* existingSpell)
 	int SlotIndex = -1;
 	EQ_Affect* ret = pLocalPC->FindAffectSlot(testSpell->ID, pLocalPlayer, &SlotIndex, true, pLocalPlayer->Level, &buff, 1);
 
-	return ret && SlotIndex != -1;
+	const bool result = ret && SlotIndex != -1;
+	s_willStackWithCache.emplace(key, result);
+	return result;
 }
 
 bool IsSpellTooPowerful(PlayerClient* caster, PlayerClient* target, EQ_Spell* spell)
@@ -5336,14 +6658,185 @@ static ItemClient* FindItem(T&& callback, bool checkKeyRings = true, int fromSlo
 	return foundItem.get();
 }
 
+//----------------------------------------------------------------------------
+// Inventory item index
+//
+// Every item in the inventory and the key rings, in the order FindItem visits them, indexed by
+// id and by name. Built on first use and dropped every pulse. Within a pulse items only change
+// places by way of the cursor, so the index is trusted while the cursor holds the item it did
+// when the index was built, and each entry is checked against its slot before it is used.
+
+struct InventoryIndexEntry
+{
+	ItemContainer* pContainer;
+	ItemIndex index;
+	ItemPtr pItem;
+};
+
+struct InventoryItemIndex
+{
+	PcProfile* pProfile = nullptr;
+	ItemPtr pCursorItem;
+	bool valid = false;
+
+	std::vector<InventoryIndexEntry> entries;
+	std::unordered_map<int, std::vector<uint32_t>> byID;
+	ci_unordered::map<std::string, std::vector<uint32_t>> byName;
+};
+
+static InventoryItemIndex s_inventoryIndex;
+static const std::vector<uint32_t> s_noIndexedItems;
+
+void ClearInventoryItemIndex()
+{
+	s_inventoryIndex.valid = false;
+	s_inventoryIndex.pProfile = nullptr;
+	s_inventoryIndex.pCursorItem = nullptr;
+	s_inventoryIndex.entries.clear();
+	s_inventoryIndex.byID.clear();
+	s_inventoryIndex.byName.clear();
+}
+
+static void BuildInventoryItemIndex(PcProfile* pProfile)
+{
+	ClearInventoryItemIndex();
+
+	auto addItems = [](ItemContainer& container, int fromSlot, int toSlot, int skipSlot = -1)
+	{
+		container.VisitItems(fromSlot, toSlot, -1, [&container, skipSlot](const ItemPtr& pItem, const ItemIndex& index)
+			{
+				if (skipSlot != -1 && index.GetSlot(0) == skipSlot)
+					return;
+
+				const uint32_t entry = static_cast<uint32_t>(s_inventoryIndex.entries.size());
+				s_inventoryIndex.entries.push_back({ &container, index, pItem });
+				s_inventoryIndex.byID[pItem->GetID()].push_back(entry);
+				s_inventoryIndex.byName[pItem->GetName()].push_back(entry);
+			});
+	};
+
+	// Same order as FindItem: the cursor, then every other slot.
+	addItems(pProfile->InventoryContainer, InvSlot_Cursor, InvSlot_Cursor);
+	addItems(pProfile->InventoryContainer, -1, -1, InvSlot_Cursor);
+
+#if HAS_KEYRING_WINDOW
+	for (auto keyRingType = eKeyRingTypeFirst;
+		keyRingType <= eKeyRingTypeLast;
+		keyRingType = static_cast<KeyRingType>(keyRingType + 1))
+	{
+		addItems(pLocalPC->GetKeyRingItems(keyRingType), -1, -1);
+	}
+#endif
+
+	s_inventoryIndex.pProfile = pProfile;
+	s_inventoryIndex.pCursorItem = pProfile->InventoryContainer.GetItem(InvSlot_Cursor);
+	s_inventoryIndex.valid = true;
+}
+
+static bool IsInventoryIndexEntryCurrent(const InventoryIndexEntry& entry)
+{
+	return entry.pContainer->GetItem(entry.index) == entry.pItem;
+}
+
+// Returns the inventory item index, or nullptr if the inventory has to be searched instead.
+static InventoryItemIndex* GetInventoryItemIndex()
+{
+	if (!IsMainThread() || !pLocalPC)
+		return nullptr;
+
+	PcProfile* pProfile = GetPcProfile();
+	if (!pProfile)
+		return nullptr;
+
+	if (!s_inventoryIndex.valid
+		|| s_inventoryIndex.pProfile != pProfile
+		|| s_inventoryIndex.pCursorItem != pProfile->InventoryContainer.GetItem(InvSlot_Cursor))
+	{
+		BuildInventoryItemIndex(pProfile);
+	}
+
+	return &s_inventoryIndex;
+}
+
+// Calls visit with the item of each entry, in order, until it returns true. If any of the items
+// moved since the index was built, the index is dropped and false is returned without visiting
+// anything, so that the caller searches the inventory instead.
+template <typename T>
+static bool VisitIndexedItems(const std::vector<uint32_t>& matches, T& visit)
+{
+	for (uint32_t entry : matches)
+	{
+		if (!IsInventoryIndexEntryCurrent(s_inventoryIndex.entries[entry]))
+		{
+			ClearInventoryItemIndex();
+			return false;
+		}
+	}
+
+	for (uint32_t entry : matches)
+	{
+		if (visit(s_inventoryIndex.entries[entry].pItem))
+			break;
+	}
+
+	return true;
+}
+
+// Visits the indexed items whose name matches, in the order FindItem would find them. Returns
+// false if the inventory has to be searched instead.
+template <typename T>
+static bool FindIndexedItems(std::string_view name, bool exact, T&& visit)
+{
+	InventoryItemIndex* pIndex = GetInventoryItemIndex();
+	if (!pIndex)
+		return false;
+
+	if (exact)
+	{
+		auto iter = pIndex->byName.find(name);
+		return VisitIndexedItems(iter != pIndex->byName.end() ? iter->second : s_noIndexedItems, visit);
+	}
+
+	std::vector<uint32_t> matches;
+	for (const auto& [itemName, nameEntries] : pIndex->byName)
+	{
+		if (ci_find_substr(itemName, name) != -1)
+			matches.insert(matches.end(), nameEntries.begin(), nameEntries.end());
+	}
+
+	std::sort(matches.begin(), matches.end());
+	return VisitIndexedItems(matches, visit);
+}
+
+// Visits the indexed items with the id, in the order FindItem would find them. Returns false if
+// the inventory has to be searched instead.
+template <typename T>
+static bool FindIndexedItems(int itemID, T&& visit)
+{
+	InventoryItemIndex* pIndex = GetInventoryItemIndex();
+	if (!pIndex)
+		return false;
+
+	auto iter = pIndex->byID.find(itemID);
+	return VisitIndexedItems(iter != pIndex->byID.end() ? iter->second : s_noIndexedItems, visit);
+}
+
 ItemClient* FindItemByName(const char* pName, bool bExact)
 {
+	ItemClient* pFound = nullptr;
+	if (FindIndexedItems(pName, bExact, [&pFound](const ItemPtr& pItem) { pFound = pItem.get(); return true; }))
+		return pFound;
+
 	return FindItem([pName, bExact](const ItemPtr& pItem, const ItemIndex&)
 		{ return ci_equals(pItem->GetName(), pName, bExact); });
 }
 
 ItemClient* FindItemByID(int ItemID)
 {
+	ItemClient* pFound = nullptr;
+	if (FindIndexedItems(ItemID, [&pFound](const ItemPtr& pItem) { pFound = pItem.get(); return true; }))
+		return pFound;
+
 	return FindItem([ItemID](const ItemPtr& pItem, const ItemIndex&)
 		{ return ItemID == pItem->GetID(); });
 }
@@ -5407,12 +6900,29 @@ int FindInventoryItemCountByID(int ItemID, int slotBegin, int slotEnd)
 
 int FindItemCountByName(const char* pName)
 {
+	// An empty name only matches items without a name, leave that to the search.
+	if (pName[0] != 0)
+	{
+		const bool exact = pName[0] == '=';
+		int count = 0;
+
+		if (FindIndexedItems(exact ? pName + 1 : pName, exact,
+			[&count](const ItemPtr& pItem) { count += pItem->GetItemCount(); return false; }))
+		{
+			return count;
+		}
+	}
+
 	return CountItems([pName](const ItemPtr& pItem)
 		{ return MaybeExactCompare(pItem->GetName(), pName); });
 }
 
 int FindItemCountByID(int ItemID)
 {
+	int count = 0;
+	if (FindIndexedItems(ItemID, [&count](const ItemPtr& pItem) { count += pItem->GetItemCount(); return false; }))
+		return count;
+
 	return CountItems([ItemID](const ItemPtr& pItem)
 		{ return pItem->GetID() == ItemID; });
 }
@@ -6318,32 +7828,6 @@ void WeDidStuff()
 	gMouseEventTime = GetFastTime();
 }
 
-int GetFreeInventory(int nSize)
-{
-	PcProfile* pProfile = GetPcProfile();
-	if (!pProfile)
-		return 0;
-
-	int freeSlots = 0;
-	for (int slot = InvSlot_FirstBagSlot; slot <= GetHighestAvailableBagSlot(); slot++)
-	{
-		if (ItemPtr pItem = pProfile->InventoryContainer.GetItem(slot))
-		{
-			if (pItem->IsContainer()
-				&& (nSize == 0 || pItem->GetItemDefinition()->SizeCapacity >= nSize))
-			{
-				freeSlots += pItem->GetHeldItems().GetSize() - pItem->GetHeldItems().GetCount();
-			}
-		}
-		else
-		{
-			freeSlots++;
-		}
-	}
-
-	return freeSlots;
-}
-
 int GetFreeStack(ItemClient* pContents)
 {
 	PcProfile* pProfile = GetPcProfile();
@@ -6810,56 +8294,26 @@ eSpawnType GetSpawnType(SPAWNINFO* pSpawn)
 
 bool IsRaidMember(const char* SpawnName)
 {
-	if (pRaid->Invited == RaidStateInRaid)
-	{
-		for (int index = 0; index < MAX_RAID_SIZE; index++)
-		{
-			if (pRaid->RaidMemberUsed[index] && !_stricmp(SpawnName, pRaid->RaidMember[index].Name))
-				return true;
-		}
-	}
-
-	return false;
+	return GetRaidMemberIndex(SpawnName) >= 0;
 }
 
 int GetRaidMemberIndex(const char* SpawnName)
 {
 	if (pRaid->Invited == RaidStateInRaid)
-	{
-		for (int index = 0; index < MAX_RAID_SIZE; index++)
-		{
-			if (pRaid->RaidMemberUsed[index] && !_stricmp(SpawnName, pRaid->RaidMember[index].Name))
-				return index;
-		}
-	}
+		return GetRaidRosterSlotByName(SpawnName);
 
 	return -1;
 }
 
 bool IsRaidMember(SPAWNINFO* pSpawn)
 {
-	if (pSpawn != nullptr)
-	{
-		for (int index = 0; index < MAX_RAID_SIZE; index++)
-		{
-			if (pRaid->RaidMemberUsed[index] && !_stricmp(pSpawn->Name, pRaid->RaidMember[index].Name))
-				return true;
-		}
-	}
-
-	return false;
+	return GetRaidMemberIndex(pSpawn) >= 0;
 }
 
 int GetRaidMemberIndex(SPAWNINFO* pSpawn)
 {
 	if (pSpawn != nullptr)
-	{
-		for (int index = 0; index < MAX_RAID_SIZE; index++)
-		{
-			if (pRaid->RaidMemberUsed[index] && !_stricmp(pSpawn->Name, pRaid->RaidMember[index].Name))
-				return index;
-		}
-	}
+		return GetRaidRosterSlotByName(pSpawn->Name);
 
 	return -1;
 }
@@ -6869,21 +8323,10 @@ bool IsGroupMember(const char* SpawnName)
 	if (!pLocalPC || !pLocalPC->Group)
 		return false;
 
-	for (int index = 1; index < MAX_GROUP_SIZE; index++)
-	{
-		if (CGroupMember* pMember = pLocalPC->Group->GetGroupMember(index))
-		{
-			char Name[MAX_STRING] = { 0 };
-			strcpy_s(Name, pMember->GetName());
-
-			CleanupName(Name, sizeof(Name), false, false);
-
-			if (!_stricmp(SpawnName, Name))
-				return true;
-		}
-	}
+	if (GetGroupRosterIndexByName(SpawnName) > 0)
+		return true;
 
-	return false;
+	return GetGroupRosterIndexBySpawn(GetSpawnByName(SpawnName)) > 0;
 }
 
 /*
@@ -6894,21 +8337,11 @@ bool IsGroupMember(SPAWNINFO* pSpawn)
 	if (!pLocalPC || !pLocalPC->Group)
 		return false;
 
-	for (int index = 1; index < MAX_GROUP_SIZE; index++)
-	{
-		if (CGroupMember* pMember = pLocalPC->Group->GetGroupMember(index))
-		{
-			char Name[MAX_STRING] = { 0 };
-			strcpy_s(Name, pMember->GetName());
-
-			//CleanupName(Name, sizeof(Name), false, false);
-
-			if (!_stricmp(pSpawn->Name, Name))
-				return true;
-		}
-	}
+	if (GetGroupRosterIndexBySpawn(pSpawn) > 0)
+		return true;
 
-	return false;
+	// A member whose spawn isn't linked up yet still matches by name.
+	return pSpawn && GetGroupRosterIndexByName(pSpawn->Name) > 0;
 }
 
 bool IsFellowshipMember(const char* SpawnName)
@@ -7293,10 +8726,11 @@ void FormatMoneyString(char* szBuffer, size_t bufferLength, uint64_t moneyAmount
 
 bool HasBuffCastByPlayer(SPAWNINFO* pBuffOwner, const char* szBuffName, const char* casterName)
 {
+	// The caster rules out most buffs, so check it before looking up the spell name.
 	auto predicate = [szBuffName, casterName](const CachedBuff& buff)
 	{
-		return MaybeExactCompare(GetSpellNameByID(buff.spellId), szBuffName)
-			&& _stricmp(buff.casterName, casterName) == 0;
+		return _stricmp(buff.casterName, casterName) == 0
+			&& MaybeExactCompare(GetSpellNameByID(buff.spellId), szBuffName);
 	};
 
 	int slot = GetCachedBuff(pBuffOwner, predicate);
@@ -7430,44 +8864,223 @@ void SetSwitchTarget(EQSwitch* pSwitch)
 	pSwitchTarget = pSwitch;
 }
 
+//----------------------------------------------------------------------------
+// Switch index
+//
+// The switches of a zone are indexed by id and by lower case name, and put into a grid by their
+// location, so that looking one up doesn't go through all of them. The switch manager only changes
+// when zoning, which is noticed by the entries changing, and the index is built again then.
+//
+// Switches that move (elevators, platforms) move up and down, and the grid only uses X and Y.
+
+struct SwitchIndex
+{
+	static constexpr float CellSize = 250.0f;
+
+	decltype(pSwitchMgr) pManager = nullptr;
+	int numEntries = -1;
+	EQSwitch* pFirst = nullptr;
+	EQSwitch* pLast = nullptr;
+
+	std::vector<std::pair<int, EQSwitch*>> byID;                  // sorted by id
+	std::vector<std::pair<std::string, EQSwitch*>> byName;        // sorted by lower case name
+
+	int minCellX = 0;
+	int minCellY = 0;
+	int cellsX = 0;
+	int cellsY = 0;
+	std::vector<std::vector<EQSwitch*>> cells;
+
+	static int GetCell(float value) { return static_cast<int>(std::floor(value / CellSize)); }
+};
+
+static SwitchIndex s_switchIndex;
+
+static const SwitchIndex& GetSwitchIndex()
+{
+	SwitchIndex& index = s_switchIndex;
+
+	const int numEntries = pSwitchMgr->NumEntries;
+	EQSwitch* pFirst = numEntries > 0 ? pSwitchMgr->Switches[0] : nullptr;
+	EQSwitch* pLast = numEntries > 0 ? pSwitchMgr->Switches[numEntries - 1] : nullptr;
+
+	if (index.pManager == pSwitchMgr && index.numEntries == numEntries && index.pFirst == pFirst && index.pLast == pLast)
+		return index;
+
+	index.pManager = pSwitchMgr;
+	index.numEntries = numEntries;
+	index.pFirst = pFirst;
+	index.pLast = pLast;
+	index.byID.clear();
+	index.byName.clear();
+	index.cells.clear();
+	index.cellsX = index.cellsY = 0;
+
+	if (numEntries <= 0)
+		return index;
+
+	int minX = INT_MAX, minY = INT_MAX, maxX = INT_MIN, maxY = INT_MIN;
+
+	for (int i = 0; i < numEntries; ++i)
+	{
+		EQSwitch* pSwitch = pSwitchMgr->Switches[i];
+
+		index.byID.emplace_back(pSwitch->ID, pSwitch);
+		index.byName.emplace_back(to_lower_copy(pSwitch->Name), pSwitch);
+
+		minX = std::min(minX, SwitchIndex::GetCell(pSwitch->X));
+		minY = std::min(minY, SwitchIndex::GetCell(pSwitch->Y));
+		maxX = std::max(maxX, SwitchIndex::GetCell(pSwitch->X));
+		maxY = std::max(maxY, SwitchIndex::GetCell(pSwitch->Y));
+	}
+
+	// Equal ids and names keep the order of the switch manager, like the search through it did.
+	std::stable_sort(index.byID.begin(), index.byID.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+	std::stable_sort(index.byName.begin(), index.byName.end(),
+		[](const auto& a, const auto& b) { return a.first < b.first; });
+
+	index.minCellX = minX;
+	index.minCellY = minY;
+	index.cellsX = maxX - minX + 1;
+	index.cellsY = maxY - minY + 1;
+	index.cells.resize(static_cast<size_t>(index.cellsX) * index.cellsY);
+
+	for (int i = 0; i < numEntries; ++i)
+	{
+		EQSwitch* pSwitch = pSwitchMgr->Switches[i];
+
+		const int x = SwitchIndex::GetCell(pSwitch->X) - minX;
+		const int y = SwitchIndex::GetCell(pSwitch->Y) - minY;
+		index.cells[static_cast<size_t>(y) * index.cellsX + x].push_back(pSwitch);
+	}
+
+	return index;
+}
+
+bool WarmUpSwitchIndex()
+{
+	if (pSwitchMgr)
+		GetSwitchIndex();
+
+	return true;
+}
+
 EQSwitch* GetSwitchByID(int ID)
 {
-	for (int Count = 0; Count < pSwitchMgr->NumEntries; Count++)
+	if (!pSwitchMgr)
+		return nullptr;
+
+	const SwitchIndex& index = GetSwitchIndex();
+
+	auto iter = std::lower_bound(index.byID.begin(), index.byID.end(), ID,
+		[](const auto& entry, int id) { return entry.first < id; });
+	if (iter != index.byID.end() && iter->first == ID)
+		return iter->second;
+
+	return nullptr;
+}
+
+// Whether the switch is within the z filter (or if the z filter is disabled)
+static bool IsSwitchInZFilter(const EQSwitch* pSwitch)
+{
+	return gZFilter >= 10000.0f || (pSwitch->Z <= pLocalPlayer->Z + gZFilter && pSwitch->Z >= pLocalPlayer->Z - gZFilter);
+}
+
+static EQSwitch* FindNearestSwitch(const SwitchIndex& index)
+{
+	if (index.cells.empty())
+		return nullptr;
+
+	const float X = pLocalPlayer->X;
+	const float Y = pLocalPlayer->Y;
+	const int cellX = SwitchIndex::GetCell(X) - index.minCellX;
+	const int cellY = SwitchIndex::GetCell(Y) - index.minCellY;
+
+	EQSwitch* closestSwitch = nullptr;
+	float cDistance = FLT_MAX;
+
+	// Visit the rings of cells around the player, until the ring is further away than the nearest
+	// switch found so far.
+	const int maxRing = std::max({ cellX + 1, index.cellsX - cellX, cellY + 1, index.cellsY - cellY });
+	for (int ring = 0; ring <= maxRing; ++ring)
 	{
-		EQSwitch* pSwitch = pSwitchMgr->Switches[Count];
+		const float ringDistance = std::max(0, ring - 1) * SwitchIndex::CellSize;
+		if (closestSwitch && ringDistance * ringDistance > cDistance)
+			break;
+
+		auto visit = [&](int x, int y)
+		{
+			if (x < 0 || x >= index.cellsX)
+				return;
+
+			for (EQSwitch* pSwitch : index.cells[static_cast<size_t>(y) * index.cellsX + x])
+			{
+				if (!IsSwitchInZFilter(pSwitch))
+					continue;
 
-		if (pSwitch->ID == ID)
+				const float Distance = Get3DDistanceSquared(X, Y, pLocalPlayer->Z, pSwitch->X, pSwitch->Y, pSwitch->Z);
+				if (Distance < cDistance)
+				{
+					closestSwitch = pSwitch;
+					cDistance = Distance;
+				}
+			}
+		};
+
+		// Only the edge of the square is new
+		const int firstY = std::max(cellY - ring, 0);
+		const int lastY = std::min(cellY + ring, index.cellsY - 1);
+		for (int y = firstY; y <= lastY; ++y)
 		{
-			return pSwitch;
+			if (y == cellY - ring || y == cellY + ring)
+			{
+				const int firstX = std::max(cellX - ring, 0);
+				const int lastX = std::min(cellX + ring, index.cellsX - 1);
+				for (int x = firstX; x <= lastX; ++x)
+					visit(x, y);
+			}
+			else
+			{
+				visit(cellX - ring, y);
+				visit(cellX + ring, y);
+			}
 		}
 	}
 
-	return nullptr;
+	return closestSwitch;
 }
 
 EQSwitch* FindSwitchByName(const char* szName)
 {
-	if (!pSwitchMgr)
+	if (!pSwitchMgr || !pLocalPlayer)
 		return nullptr;
 
+	const SwitchIndex& index = GetSwitchIndex();
+
+	if (!szName || szName[0] == 0)
+		return FindNearestSwitch(index);
+
+	// The names that start with szName are next to each other in the index.
+	const std::string prefix = to_lower_copy(szName);
+	auto iter = std::lower_bound(index.byName.begin(), index.byName.end(), prefix,
+		[](const auto& entry, const std::string& name) { return entry.first < name; });
+
 	EQSwitch* closestSwitch = nullptr;
 	float cDistance = FLT_MAX;
 
-	for (int Count = 0; Count < pSwitchMgr->NumEntries; Count++)
+	for (; iter != index.byName.end() && starts_with(iter->first, prefix); ++iter)
 	{
-		EQSwitch* pSwitch = pSwitchMgr->Switches[Count];
+		EQSwitch* pSwitch = iter->second;
+		if (!IsSwitchInZFilter(pSwitch))
+			continue;
 
-		// Match against the name if it is within the z filter (or if the z filter is disabled)
-		if ((!szName || szName[0] == 0 || ci_find_substr(pSwitch->Name, szName) == 0)
-			&& (gZFilter >= 10000.0f || (pSwitch->Z <= pLocalPlayer->Z + gZFilter && pSwitch->Z >= pLocalPlayer->Z - gZFilter)))
+		const float Distance = Get3DDistanceSquared(pLocalPlayer->X, pLocalPlayer->Y, pLocalPlayer->Z,
+			pSwitch->X, pSwitch->Y, pSwitch->Z);
+		if (Distance < cDistance)
 		{
-			float Distance = Get3DDistanceSquared(pLocalPlayer->X, pLocalPlayer->Y, pLocalPlayer->Z,
-				pSwitch->X, pSwitch->Y, pSwitch->Z);
-			if (Distance < cDistance)
-			{
-				closestSwitch = pSwitch;
-				cDistance = Distance;
-			}
+			closestSwitch = pSwitch;
+			cDistance = Distance;
 		}
 	}
 
@@ -7761,4 +9374,35 @@ void FormatBytes(char* szBuffer, size_t bufferLength, uint64_t bytes)
 	}
 }
 
+const std::string* InternString(std::string_view str, bool add)
+{
+	// Keys are views of the owned strings. The table is never destroyed, so atoms held by other
+	// static objects stay valid during shutdown.
+	static auto* s_strings = new std::unordered_map<std::string_view, std::unique_ptr<const std::string>>();
+	static std::shared_mutex s_stringsMutex;
+
+	{
+		std::shared_lock lock(s_stringsMutex);
+
+		auto iter = s_strings->find(str);
+		if (iter != s_strings->end())
+			return iter->second.get();
+	}
+
+	if (!add)
+		return nullptr;
+
+	std::unique_lock lock(s_stringsMutex);
+
+	auto iter = s_strings->find(str);
+	if (iter == s_strings->end())
+	{
+		auto entry = std::make_unique<const std::string>(str);
+		std::string_view key = *entry;
+		iter = s_strings->emplace(key, std::move(entry)).first;
+	}
+
+	return iter->second.get();
+}
+
 } // namespace mq
@@ -3459,6 +3459,8 @@ public:
 		m_pLastSelected = nullptr;
 		m_picking = false;
 		m_selectPicking = false;
+
+		ClearWindowTree();
 	}
 
 	void Update() override
@@ -3640,6 +3642,8 @@ public:
 			m_pHoveredWnd = nullptr;
 			m_pPickingWnd = nullptr;
 			m_pLastSelected = nullptr;
+
+			ClearWindowTree();
 		}
 
 		// update last selected to remember selection for next iteration
@@ -3782,8 +3786,211 @@ public:
 		}
 	}
 
+	// The tree is drawn from a cached model. The children of a node are only gathered once it is
+	// expanded, and are gathered again when a window is created or destroyed (or after a while, for
+	// windows that are created without going through the sidl). Runs of collapsed rows are clipped,
+	// so only the rows that are on screen are described.
+	static constexpr uint64_t TreeRefreshIntervalMS = 1000;
+	static constexpr int MinClippedRun = 16;
+
+	struct WindowTreeListRow
+	{
+		int rowIndex = 0;
+		std::vector<std::pair<int, CXWnd*>> cells;   // column number and the wrapper window
+	};
+
+	struct WindowTreeNode
+	{
+		uint32_t generation = 0;
+		uint64_t gatheredAt = 0;
+		std::vector<WindowTreeListRow> listRows;
+		std::vector<CXWnd*> children;
+	};
+
 	std::vector<std::pair<std::string_view, CXWnd*>> m_windows;
-	std::unordered_set<CXWnd*> m_traversedWindows;
+	std::unordered_map<CXWnd*, WindowTreeNode> m_treeNodes;
+	std::vector<CXWnd*> m_treePath;
+	uint32_t m_treeGeneration = 1;
+	uint32_t m_windowsGeneration = 0;
+	uint64_t m_windowsGatheredAt = 0;
+	int m_windowsSourceCount = -1;
+
+	void InvalidateWindowTree()
+	{
+		++m_treeGeneration;
+	}
+
+	void ClearWindowTree()
+	{
+		m_windows.clear();
+		m_treeNodes.clear();
+		m_windowsGeneration = 0;
+		m_windowsSourceCount = -1;
+		m_lastWindowCount = 0;
+	}
+
+	void GatherRootWindows()
+	{
+		m_windows.clear();
+
+		for (CXWnd* pWnd : pWndMgr->ParentAndContextMenuWindows)
+		{
+			if (pWnd->ParentWindow == nullptr
+				&& (pWnd->GetXMLData() != nullptr
+					|| pWnd->GetFirstChildWnd() != nullptr
+					|| !pWnd->GetWindowText().empty()
+					|| !pWnd->GetXMLName().empty()))
+			{
+				m_windows.emplace_back(std::string_view{ pWnd->GetXMLName() }, pWnd);
+			}
+		}
+
+		std::sort(std::begin(m_windows), std::end(m_windows),
+			[](const auto& l, const auto& r) { return ci_less()(l.first, r.first); });
+
+		m_windowsGeneration = m_treeGeneration;
+		m_windowsGatheredAt = MQGetTickCount64();
+		m_windowsSourceCount = pWndMgr->ParentAndContextMenuWindows.GetCount();
+		m_lastWindowCount = static_cast<int>(m_windows.size());
+	}
+
+	void GatherChildren(CXWnd* pWnd, WindowTreeNode& node)
+	{
+		node.listRows.clear();
+		node.children.clear();
+
+		// The wrapper windows of list cells are shown under their rows rather than as children.
+		std::unordered_set<CXWnd*> cellWindows;
+
+		// If this is a list box, then also traverse its child list windows.
+		if (pWnd->GetType() == UI_Listbox || pWnd->GetType() == UI_TreeView)
+		{
+			CListWnd* listWnd = static_cast<CListWnd*>(pWnd);
+
+			for (int rowIndex = 0; rowIndex < listWnd->ItemsArray.GetCount(); ++rowIndex)
+			{
+				const SListWndLine& line = listWnd->ItemsArray[rowIndex];
+				WindowTreeListRow row;
+				row.rowIndex = rowIndex;
+				bool hasWndCell = false;
+				int colNum = 1;
+
+				for (const SListWndCell& cell : line.Cells)
+				{
+					if (cell.pWnd)
+					{
+						hasWndCell = true;
+						cellWindows.insert(cell.pWnd);
+
+						// The children of the list are stored in wrapper windows. They show up
+						// as Unknown types. We just skip past them.
+						if (cell.pWnd->GetFirstChildWnd())
+							row.cells.emplace_back(colNum, cell.pWnd);
+					}
+					colNum++;
+				}
+
+				if (hasWndCell)
+					node.listRows.push_back(std::move(row));
+			}
+		}
+
+		CXWnd* pChild = pWnd->GetFirstChildWnd();
+		while (pChild)
+		{
+			if (cellWindows.count(pChild) == 0)
+				node.children.push_back(pChild);
+			pChild = pChild->GetNextSiblingWnd();
+		}
+
+		node.generation = m_treeGeneration;
+		node.gatheredAt = MQGetTickCount64();
+	}
+
+	WindowTreeNode& GetTreeNode(CXWnd* pWnd)
+	{
+		WindowTreeNode& node = m_treeNodes[pWnd];
+		if (node.generation != m_treeGeneration
+			|| MQGetTickCount64() - node.gatheredAt >= TreeRefreshIntervalMS)
+		{
+			GatherChildren(pWnd, node);
+		}
+
+		return node;
+	}
+
+	// The windows leading to the one that is being picked or was just selected. Their nodes are
+	// opened this frame, so they are never clipped.
+	void UpdateTreePath()
+	{
+		m_treePath.clear();
+
+		CXWnd* pWnd = nullptr;
+		if (m_pPickingWnd)
+			pWnd = m_pPickingWnd;
+		else if (m_pSelectedWnd && m_selectionChanged)
+			pWnd = m_pSelectedWnd;
+
+		while (pWnd)
+		{
+			m_treePath.push_back(pWnd);
+			pWnd = pWnd->GetParentWindow();
+		}
+	}
+
+	bool IsOnTreePath(CXWnd* pWnd) const
+	{
+		return std::find(m_treePath.begin(), m_treePath.end(), pWnd) != m_treePath.end();
+	}
+
+	static bool IsTreeNodeOpen(const void* id)
+	{
+		return ImGui::GetStateStorage()->GetInt(ImGui::GetID(id), 0) != 0;
+	}
+
+	// Draws count rows. Rows that isOpen claims are always drawn, and long runs of the others are clipped.
+	template <typename IsOpen, typename DrawRow>
+	static void DisplayClippedRows(int count, IsOpen&& isOpen, DrawRow&& drawRow)
+	{
+		int index = 0;
+		while (index < count)
+		{
+			if (isOpen(index))
+			{
+				drawRow(index++);
+				continue;
+			}
+
+			int runEnd = index + 1;
+			while (runEnd < count && !isOpen(runEnd))
+				++runEnd;
+
+			if (runEnd - index < MinClippedRun)
+			{
+				for (; index < runEnd; ++index)
+					drawRow(index);
+				continue;
+			}
+
+			const int runStart = index;
+			ImGuiListClipper clipper;
+			clipper.Begin(runEnd - runStart);
+			while (clipper.Step())
+			{
+				for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+					drawRow(runStart + i);
+			}
+
+			index = runEnd;
+		}
+	}
+
+	// Rows that are open or on the path can't be clipped (the picked window is scrolled to).
+	bool IsWindowRowUnclipped(CXWnd* pWnd) const
+	{
+		return IsOnTreePath(pWnd)
+			|| (pWnd->GetFirstChildWnd() != nullptr && IsTreeNodeOpen(pWnd));
+	}
 
 	void DisplayWindowTree()
 	{
@@ -3793,8 +4000,6 @@ public:
 			| ImGuiTableFlags_Resizable
 			| ImGuiTableFlags_RowBg;
 
-		m_traversedWindows.clear();
-
 		if (ImGui::BeginTable("##WindowTable", 2, tableFlags))
 		{
 			ImGui::TableSetupScrollFreeze(0, 1);
@@ -3802,49 +4007,32 @@ public:
 			ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed);
 			ImGui::TableHeadersRow();
 
-			m_windows.reserve(m_lastWindowCount);
-			m_lastWindowCount = 0;
-
 			if (pWndMgr)
 			{
-				m_windows.clear();
-
-				for (CXWnd* pWnd : pWndMgr->ParentAndContextMenuWindows)
+				if (m_windowsGeneration != m_treeGeneration
+					|| m_windowsSourceCount != pWndMgr->ParentAndContextMenuWindows.GetCount()
+					|| MQGetTickCount64() - m_windowsGatheredAt >= TreeRefreshIntervalMS)
 				{
-					if (pWnd->ParentWindow == nullptr
-						&& (pWnd->GetXMLData() != nullptr
-							|| pWnd->GetFirstChildWnd() != nullptr
-							|| !pWnd->GetWindowText().empty()
-							|| !pWnd->GetXMLName().empty()))
-					{
-						m_windows.emplace_back(std::string_view{ pWnd->GetXMLName() }, pWnd);
-					}
+					GatherRootWindows();
 				}
 
-				std::sort(std::begin(m_windows), std::end(m_windows),
-					[](const auto& l, const auto& r) { return ci_less()(l.first, r.first); });
-
-				for (const auto& [_, pWnd] : m_windows)
-				{
-					DisplayWindowTreeNode(pWnd, true);
-				}
+				UpdateTreePath();
 
-				m_lastWindowCount = static_cast<int>(m_windows.size());
+				DisplayClippedRows(static_cast<int>(m_windows.size()),
+					[&](int index) { return IsWindowRowUnclipped(m_windows[index].second); },
+					[&](int index) { DisplayWindowTreeNode(m_windows[index].second); });
+			}
+			else
+			{
+				ClearWindowTree();
 			}
 
 			ImGui::EndTable();
 		}
 	}
 
-	void DisplayWindowTreeNode(CXWnd* pWnd, bool isRoot = false, const char* nameOverride = nullptr)
+	void DisplayWindowTreeNode(CXWnd* pWnd, const char* nameOverride = nullptr)
 	{
-		if (!isRoot)
-		{
-			if (m_traversedWindows.count(pWnd) != 0)
-				return;
-			m_traversedWindows.insert(pWnd);
-		}
-
 		ImGui::TableNextRow();
 		ImGui::TableNextColumn();
 
@@ -3976,86 +4164,77 @@ public:
 
 		if (open)
 		{
-			// If this is a list box, then also traverse its child list windows.
-			if (pWnd->GetType() == UI_Listbox || pWnd->GetType() == UI_TreeView)
+			WindowTreeNode& node = GetTreeNode(pWnd);
+
+			if (!node.listRows.empty())
 			{
 				CListWnd* listWnd = static_cast<CListWnd*>(pWnd);
-				int rowNum = 0;
 
-				for (const SListWndLine& line : listWnd->ItemsArray)
+				// The rows can change without a window being created, so this is caught up next frame.
+				if (node.listRows.back().rowIndex >= listWnd->ItemsArray.GetCount())
 				{
-					bool hasWndCell = false;
-					int rowFlags = 0;
-					++rowNum;
-
-					for (const SListWndCell& cell : line.Cells)
+					node.generation = 0;
+				}
+				else
+				{
+					auto isOpen = [&](int index)
 					{
-						if (cell.pWnd)
-						{
-							CXWnd* pListChildWnd = cell.pWnd;
-
-							if (m_pPickingWnd)
-							{
-								if (m_pPickingWnd->IsDescendantOf(pListChildWnd))
-									rowFlags |= ImGuiTreeNodeFlags_DefaultOpen;
-							}
-							else if (m_pSelectedWnd && m_selectionChanged)
-							{
-								if (m_pSelectedWnd == pListChildWnd
-									|| m_pSelectedWnd->IsDescendantOf(pListChildWnd))
-								{
-									ImGui::SetNextItemOpen(true);
-								}
-							}
+						const WindowTreeListRow& row = node.listRows[index];
+						if (IsTreeNodeOpen(&listWnd->ItemsArray[row.rowIndex]))
+							return true;
 
-							hasWndCell = true;
-						}
-					}
+						return std::any_of(row.cells.begin(), row.cells.end(),
+							[&](const auto& cell) { return IsOnTreePath(cell.second); });
+					};
 
-					if (!hasWndCell)
-						continue;
+					DisplayClippedRows(static_cast<int>(node.listRows.size()), isOpen,
+						[&](int index) { DisplayListRow(listWnd, node.listRows[index]); });
+				}
+			}
 
-					ImGui::TableNextRow();
-					ImGui::TableNextColumn();
+			const std::vector<CXWnd*>& children = node.children;
+			DisplayClippedRows(static_cast<int>(children.size()),
+				[&](int index) { return IsWindowRowUnclipped(children[index]); },
+				[&](int index) { DisplayWindowTreeNode(children[index]); });
 
-					if (ImGui::TreeNodeEx(&line, rowFlags, "Row %d", rowNum))
-					{
-						int colNum = 1;
-						for (const SListWndCell& cell : line.Cells)
-						{
-							// The children of the list are stored in wrapper windows. They show up
-							// as Unknown types. We just skip past them.
-							if (cell.pWnd && cell.pWnd->GetFirstChildWnd())
-							{
-								CXWnd* pListChildWnd = cell.pWnd;
+			ImGui::TreePop();
+		}
+	}
 
-								char columnName[64];
-								sprintf_s(columnName, "Col %d", colNum);
+	void DisplayListRow(CListWnd* listWnd, const WindowTreeListRow& row)
+	{
+		const SListWndLine& line = listWnd->ItemsArray[row.rowIndex];
+		int rowFlags = 0;
 
-								DisplayWindowTreeNode(pListChildWnd, false, columnName);
-							}
-							colNum++;
-						}
-						ImGui::TreePop();
-					}
-					else
-					{
-						for (const SListWndCell& cell : line.Cells)
-						{
-							if (cell.pWnd)
-								m_traversedWindows.insert(cell.pWnd);
-						}
-					}
+		for (const auto& [_, pListChildWnd] : row.cells)
+		{
+			if (m_pPickingWnd)
+			{
+				if (m_pPickingWnd->IsDescendantOf(pListChildWnd))
+					rowFlags |= ImGuiTreeNodeFlags_DefaultOpen;
+			}
+			else if (m_pSelectedWnd && m_selectionChanged)
+			{
+				if (m_pSelectedWnd == pListChildWnd
+					|| m_pSelectedWnd->IsDescendantOf(pListChildWnd))
+				{
+					ImGui::SetNextItemOpen(true);
 				}
 			}
+		}
 
-			CXWnd* pChild = pWnd->GetFirstChildWnd();
-			while (pChild)
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+
+		if (ImGui::TreeNodeEx(&line, rowFlags, "Row %d", row.rowIndex + 1))
+		{
+			for (const auto& [colNum, pListChildWnd] : row.cells)
 			{
-				DisplayWindowTreeNode(pChild);
-				pChild = pChild->GetNextSiblingWnd();
-			}
+				char columnName[64];
+				sprintf_s(columnName, "Col %d", colNum);
 
+				DisplayWindowTreeNode(pListChildWnd, columnName);
+			}
 			ImGui::TreePop();
 		}
 	}
@@ -4079,6 +4258,14 @@ public:
 			m_pLastSelected = nullptr;
 
 		RemoveWindowInspector(pWnd);
+
+		m_treeNodes.erase(pWnd);
+		InvalidateWindowTree();
+	}
+
+	void OnWindowAdded(CXWnd* pWnd)
+	{
+		InvalidateWindowTree();
 	}
 
 	bool IsPicking() const { return m_picking; }
@@ -4739,6 +4926,12 @@ void DeveloperTools_WindowInspector_RemoveWindow(CXWnd* pWnd)
 		s_windowInspector->OnWindowRemoved(pWnd);
 }
 
+void DeveloperTools_WindowInspector_AddWindow(CXWnd* pWnd)
+{
+	if (s_windowInspector)
+		s_windowInspector->OnWindowAdded(pWnd);
+}
+
 void DeveloperTools_WindowInspector_Show(CXWnd* pWnd)
 {
 	if (s_windowInspector)
@@ -20,6 +20,7 @@
 #include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <spdlog/spdlog.h>
 
@@ -61,8 +62,73 @@ int WinCount = 0;
 static bool GenerateMQUI(const CXStr& strPath, const CXStr& strPathDefault);
 static void DestroyMQUI(const CXStr& strPath);
 
+//============================================================================
+// Window path cache
+//
+// Macros that poll ${Window[a/b/c]} or /notify the same controls resolve the same paths over and
+// over. The segments of every path are kept, and so are the children that were found under each
+// parent. Anything that adds, renames or removes a window starts a new generation, and children
+// are looked up again after that. A child that wasn't found isn't remembered, because its parent
+// can still create it later.
+
+static constexpr size_t MaxCachedWindowPaths = 1024;
+
+static uint32_t s_windowGeneration = 0;
+static uint32_t s_childWindowCacheGeneration = 0;
+static ci_unordered::map<std::string, std::vector<std::string>> s_windowPathSegments;
+static std::unordered_map<CXWnd*, ci_unordered::map<std::string, CXWnd*>> s_childWindowCache;
+
+static void InvalidateWindowCache()
+{
+	++s_windowGeneration;
+}
+
+static const std::vector<std::string>& GetWindowPathSegments(std::string_view path)
+{
+	auto iter = s_windowPathSegments.find(path);
+	if (iter != s_windowPathSegments.end())
+		return iter->second;
+
+	// Paths that are built on the fly could grow this forever.
+	if (s_windowPathSegments.size() >= MaxCachedWindowPaths)
+		s_windowPathSegments.clear();
+
+	std::vector<std::string> segments;
+	for (std::string_view segment : split_view(path, '/'))
+	{
+		// the same as strtok, which skipped empty segments
+		if (!segment.empty())
+			segments.emplace_back(segment);
+	}
+
+	return s_windowPathSegments.emplace(std::string(path), std::move(segments)).first->second;
+}
+
+static CXWnd* GetCachedChildItem(CXWnd* pParent, const std::string& name)
+{
+	if (s_childWindowCacheGeneration != s_windowGeneration)
+	{
+		s_childWindowCache.clear();
+		s_childWindowCacheGeneration = s_windowGeneration;
+	}
+
+	auto& children = s_childWindowCache[pParent];
+
+	auto iter = children.find(name);
+	if (iter != children.end())
+		return iter->second;
+
+	CXWnd* pChild = pParent->GetChildItem(name.c_str());
+	if (pChild)
+		children.emplace(name, pChild);
+
+	return pChild;
+}
+
 static void DropWindowFromMap(std::string_view Name, CXWnd* pWnd)
 {
+	InvalidateWindowCache();
+
 	auto range = WindowMap.equal_range(Name);
 	for (auto it = range.first; it != range.second;)
 	{
@@ -93,6 +159,7 @@ void AddWindowToList(const CXStr& WindowName, CXWnd* pWnd)
 	else
 	{
 		listIt = WindowList.emplace(std::make_pair(pWnd, WindowName)).first;
+		InvalidateWindowCache();
 	}
 
 	auto range = WindowMap.equal_range(WindowName);
@@ -119,6 +186,8 @@ public:
 		AddWindowToList(Name, reinterpret_cast<CXWnd*>(this));
 
 		Init_Trampoline(Name, A);
+
+		DeveloperTools_WindowInspector_AddWindow(reinterpret_cast<CXWnd*>(this));
 	}
 
 	// FIXME: Maybe this should go elsewhere? Isn't really related to what we're doing here...
@@ -153,6 +222,9 @@ public:
 	{
 		if (pWnd)
 		{
+			// Any window, a child could be in the window path cache.
+			InvalidateWindowCache();
+
 			auto windowListIter = WindowList.find(pWnd);
 			if (windowListIter != WindowList.end())
 			{
@@ -193,6 +265,7 @@ void ReinitializeWindowList()
 {
 	WindowList.clear();
 	WindowMap.clear();
+	InvalidateWindowCache();
 
 	InitializeWindowList();
 }
@@ -286,6 +359,7 @@ FILE* fopen_eqgraphics_detour(const char* filename, const char* mode)
 
 void ListWindows(PSPAWNINFO pChar, char* szLine);
 void WndNotify(PSPAWNINFO pChar, char* szLine);
+void WndNotifyBatch(PSPAWNINFO pChar, char* szLine);
 void ItemNotify(PSPAWNINFO pChar, char* szLine);
 void ListItemSlots(PSPAWNINFO pChar, char* szLine);
 
@@ -445,20 +519,18 @@ void RemoveXMLFile(const char* filename)
 
 CXWnd* FindMQ2WindowPath(const char* WindowName)
 {
-	char nameBuffer[256];
-	strcpy_s(nameBuffer, WindowName);
-
-	char* head = nameBuffer;
-	char* context = nullptr;
+	const std::vector<std::string>& segments = GetWindowPathSegments(WindowName);
+	if (segments.empty())
+		return nullptr;
 
-	head = strtok_s(head, "/", &context);
-
-	CXWnd* pWindow = FindMQ2Window(head);
+	// The top level window isn't cached, which of several windows of the same name is visible
+	// can change at any time.
+	CXWnd* pWindow = FindMQ2Window(segments[0].c_str());
 	if (!pWindow) return nullptr;
 
-	while (head = strtok_s(nullptr, "/", &context))
+	for (size_t i = 1; i < segments.size(); ++i)
 	{
-		pWindow = pWindow->GetChildItem(head);
+		pWindow = GetCachedChildItem(pWindow, segments[i]);
 		if (!pWindow) break;
 	}
 
@@ -616,150 +688,157 @@ CXWnd* GetChildByIndex(CXWnd* pWnd, const char* Name, int index)
 	return GetChildByIndex(pWnd->GetNextSiblingWnd(), Name, index);
 }
 
-bool SendWndClick(const char* WindowName, const char* ScreenID, const char* ClickNotification)
+// The controls of the reward selection window are on its pages, the one that is showing is used.
+static CXWnd* GetRewardSelectionPage(CXWnd* pWnd)
 {
-	CXWnd* pWnd = FindMQ2Window(WindowName);
-	if (!_stricmp(WindowName, "RewardSelectionWnd"))
-	{
-		//     Parent    TabWindow         PageTemplate
-		pWnd = pWnd->GetFirstChildWnd()->GetFirstChildWnd();
+	if (!pWnd)
+		return nullptr;
+
+	//     Parent    TabWindow         PageTemplate
+	pWnd = pWnd->GetFirstChildWnd()->GetFirstChildWnd();
 
-		while (pWnd)
+	while (pWnd)
+	{
+		if (pWnd->IsVisible())
 		{
-			if (pWnd->IsVisible())
-			{
-				break;
-			}
-			pWnd = pWnd->GetNextSiblingWnd();
+			break;
 		}
+		pWnd = pWnd->GetNextSiblingWnd();
 	}
 
-	if (!pWnd)
-	{
-		MacroError("Window '%s' not available.", WindowName);
-		return false;
-	}
+	return pWnd;
+}
 
-	if (ScreenID && ScreenID[0] && ScreenID[0] != '0')
-	{
-		CXWnd* pButton = nullptr;
+static CXWnd* FindNotificationWindow(const char* WindowName)
+{
+	CXWnd* pWnd = FindMQ2Window(WindowName);
+	if (!_stricmp(WindowName, "RewardSelectionWnd"))
+		pWnd = GetRewardSelectionPage(pWnd);
+
+	return pWnd;
+}
+
+// The buy buttons of the barter and bazaar search windows are on the rows of their lists, the
+// button of the selected row is clicked.
+static CXWnd* FindClickTarget(CXWnd* pWnd, const char* WindowName, const char* ScreenID, std::string& error)
+{
+	CXWnd* pButton = nullptr;
 
-		if (!_stricmp(WindowName, "bartersearchwnd") && !_stricmp(ScreenID, "sellbutton"))
+	if (!_stricmp(WindowName, "bartersearchwnd") && !_stricmp(ScreenID, "sellbutton"))
+	{
+		if (CListWnd* pList = (CListWnd*)GetCachedChildItem(pWnd, "BuyLineList"))
 		{
-			if (CListWnd* pList = (CListWnd*)pWnd->GetChildItem("BuyLineList"))
+			int selection = pList->GetCurSel();
+			if (selection == -1)
 			{
-				int selection = pList->GetCurSel();
-				if (selection == -1)
-				{
-					MacroError("Please select a Listitem in '%s' before issuing a '%s' Click", WindowName, ScreenID);
-					return false;
-				}
-
-				int buttonindex = (int)pList->GetItemData(selection);
-				WinCount = 0;
-				pButton = GetChildByIndex(pWnd, ScreenID, buttonindex + 1);
+				error = fmt::format("Please select a Listitem in '{}' before issuing a '{}' Click", WindowName, ScreenID);
+				return nullptr;
 			}
+
+			int buttonindex = (int)pList->GetItemData(selection);
+			WinCount = 0;
+			pButton = GetChildByIndex(pWnd, ScreenID, buttonindex + 1);
 		}
-		else if (!_stricmp(WindowName, "bazaarsearchwnd") && !_stricmp(ScreenID, "BZR_BuyButton"))
+	}
+	else if (!_stricmp(WindowName, "bazaarsearchwnd") && !_stricmp(ScreenID, "BZR_BuyButton"))
+	{
+		if (CListWnd* pList = (CListWnd*)GetCachedChildItem(pWnd, "BZR_ItemList"))
 		{
-			if (CListWnd* pList = (CListWnd*)pWnd->GetChildItem("BZR_ItemList"))
+			int selection = pList->GetCurSel();
+			if (selection == -1)
 			{
-				int selection = pList->GetCurSel();
-				if (selection == -1)
-				{
-					MacroError("Please select a Listitem in '%s' before issuing a '%s' Click", WindowName, ScreenID);
-					return false;
-				}
-
-				int buttonindex = (int)pList->GetItemData(selection);
-				WinCount = 0;
-				pButton = GetChildByIndex(pWnd, ScreenID, buttonindex + 1);
+				error = fmt::format("Please select a Listitem in '{}' before issuing a '{}' Click", WindowName, ScreenID);
+				return nullptr;
 			}
-		}
-		else
-		{
-			pButton = pWnd->GetChildItem(ScreenID);
-		}
 
-		if (!pButton)
-		{
-			MacroError("Window '%s' child '%s' not found.", WindowName, ScreenID);
-			return false;
+			int buttonindex = (int)pList->GetItemData(selection);
+			WinCount = 0;
+			pButton = GetChildByIndex(pWnd, ScreenID, buttonindex + 1);
 		}
-
-		pWnd = pButton;
+	}
+	else
+	{
+		pButton = GetCachedChildItem(pWnd, ScreenID);
 	}
 
-	for (int i = 0; i < 8; i++)
+	if (!pButton)
 	{
-		if (!_stricmp(szClickNotification[i], ClickNotification))
-		{
-			CXRect rect = pWnd->GetScreenRect();
-			CXPoint pt = rect.CenterPoint();
+		error = fmt::format("Window '{}' child '{}' not found.", WindowName, ScreenID);
+	}
 
-			switch (i)
-			{
-			case 0:
-				pWnd->HandleLButtonDown(pt, 0);
-				break;
-			case 1:
-				pWnd->HandleLButtonDown(pt, 0);
-				pWnd->HandleLButtonUp(pt, 0);
-				break;
-			case 2:
-				pWnd->HandleLButtonHeld(pt, 0);
-				break;
-			case 3:
-				pWnd->HandleLButtonDown(pt, 0);
-				pWnd->HandleLButtonHeld(pt, 0);
-				pWnd->HandleLButtonUpAfterHeld(pt, 0);
-				break;
-			case 4:
-				pWnd->HandleRButtonDown(pt, 0);
-				break;
-			case 5:
-				pWnd->HandleRButtonDown(pt, 0);
-				pWnd->HandleRButtonUp(pt, 0);
-				break;
-			case 6:
-				pWnd->HandleRButtonDown(pt, 0);
-				pWnd->HandleRButtonHeld(pt, 0);
-				break;
-			case 7:
-				pWnd->HandleRButtonDown(pt, 0);
-				pWnd->HandleRButtonHeld(pt, 0);
-				pWnd->HandleRButtonUpAfterHeld(pt, 0);
-				break;
-			default:
-				return false;
-			};
+	return pButton;
+}
 
-			WeDidStuff();
-			return true;
-		}
+// Selecting an item is a two step process:
+// 1. Change the current selection
+// 2. Emit a notification so that the parent can react.
+
+static void SelectListIndex(CListWnd* listWnd, int Value)
+{
+	listWnd->SetCurSel(Value);
+
+	int index = listWnd->GetCurSel();
+#pragma warning(suppress : 4312)
+	listWnd->ParentWndNotification(listWnd, XWM_LCLICK, (void*)index);
+
+	// Make the new selection visible for the user.
+	listWnd->EnsureVisible(index);
+
+	WeDidStuff();
+}
+
+static void SelectComboIndex(CComboWnd* comboWnd, int Value)
+{
+	comboWnd->SetChoice(Value);
+
+	CListWnd* listWnd = comboWnd->pListWnd;
+	int index = listWnd->GetCurSel();
+#pragma warning(suppress : 4312)
+	listWnd->ParentWndNotification(listWnd, XWM_LCLICK, (void*)index);
+
+	WeDidStuff();
+}
+
+static void NotifyWindow(CXWnd* pWnd, CXWnd* pChild, int Notification, void* Data)
+{
+	if (Notification == XWM_NEWVALUE && pChild)
+	{
+		CSliderWnd* sliderWnd = static_cast<CSliderWnd*>(pChild);
+#pragma warning(suppress : 4311 4302)
+		sliderWnd->SetValue(reinterpret_cast<int>(Data));
 	}
 
-	return false;
+	pWnd->WndNotification(pChild, Notification, Data);
+	WeDidStuff();
 }
 
-bool SendListSelect(const char* WindowName, const char* ScreenID, int Value)
+bool SendWndClick(const char* WindowName, const char* ScreenID, const char* ClickNotification)
 {
-	CXWnd* pWnd = FindMQ2Window(WindowName);
-	if (!_stricmp(WindowName, "RewardSelectionWnd"))
+	CXWnd* pWnd = FindNotificationWindow(WindowName);
+	if (!pWnd)
 	{
-		//           TabWindow           PageTemplate
-		pWnd = pWnd->GetFirstChildWnd()->GetFirstChildWnd();
-		while (pWnd)
-		{
-			if (pWnd->IsVisible())
-			{
-				break;
-			}
+		MacroError("Window '%s' not available.", WindowName);
+		return false;
+	}
+
+	if (ScreenID && ScreenID[0] && ScreenID[0] != '0')
+	{
+		std::string error;
+		pWnd = FindClickTarget(pWnd, WindowName, ScreenID, error);
 
-			pWnd = pWnd->GetNextSiblingWnd();
+		if (!pWnd)
+		{
+			MacroError("%s", error.c_str());
+			return false;
 		}
 	}
 
+	return SendWndClick2(pWnd, ClickNotification);
+}
+
+bool SendListSelect(const char* WindowName, const char* ScreenID, int Value)
+{
+	CXWnd* pWnd = FindNotificationWindow(WindowName);
 	if (!pWnd)
 	{
 		MacroError("Window '%s' not available.", WindowName);
@@ -768,44 +847,22 @@ bool SendListSelect(const char* WindowName, const char* ScreenID, int Value)
 
 	if (ScreenID && ScreenID[0] && ScreenID[0] != '0')
 	{
-		pWnd = pWnd->GetChildItem(ScreenID);
+		pWnd = GetCachedChildItem(pWnd, ScreenID);
 		if (!pWnd)
 		{
 			MacroError("Window '%s' child '%s' not found.", WindowName, ScreenID);
 			return false;
 		}
 
-		// Selecting an item is a two step process:
-		// 1. Change the current selection
-		// 2. Emit a notification so that the parent can react.
-
 		if (pWnd->GetType() == UI_Listbox || pWnd->GetType() == UI_TreeView)
 		{
-			CListWnd* listWnd = static_cast<CListWnd*>(pWnd);
-			listWnd->SetCurSel(Value);
-
-			int index = listWnd->GetCurSel();
-#pragma warning(suppress : 4312)
-			listWnd->ParentWndNotification(listWnd, XWM_LCLICK, (void*)index);
-
-			// Make the new selection visible for the user.
-			listWnd->EnsureVisible(index);
-
-			WeDidStuff();
+			SelectListIndex(static_cast<CListWnd*>(pWnd), Value);
 			return true;
 		}
 
 		if (pWnd->GetType() == UI_Combobox)
 		{
-			CComboWnd* comboWnd = static_cast<CComboWnd*>(pWnd);
-			comboWnd->SetChoice(Value);
-
-			CListWnd* listWnd = comboWnd->pListWnd;
-			int index = listWnd->GetCurSel();
-#pragma warning(suppress : 4312)
-			listWnd->ParentWndNotification(listWnd, XWM_LCLICK, (void*)index);
-
-			WeDidStuff();
+			SelectComboIndex(static_cast<CComboWnd*>(pWnd), Value);
 			return true;
 		}
 
@@ -882,22 +939,7 @@ bool SendListSelect2(CXWnd* pWnd, int ListIndex)
 
 bool SendComboSelect(const char* WindowName, const char* ScreenID, int Value)
 {
-	CXWnd* pWnd = FindMQ2Window(WindowName);
-	if (!_stricmp(WindowName, "RewardSelectionWnd"))
-	{
-		//     Parent    TabWindow          PageTemplate
-		pWnd = pWnd->GetFirstChildWnd()->GetFirstChildWnd();
-		while (pWnd)
-		{
-			if (pWnd->IsVisible())
-			{
-				break;
-			}
-
-			pWnd = pWnd->GetNextSiblingWnd();
-		}
-	}
-
+	CXWnd* pWnd = FindNotificationWindow(WindowName);
 	if (!pWnd)
 	{
 		MacroError("Window '%s' not available.", WindowName);
@@ -906,7 +948,7 @@ bool SendComboSelect(const char* WindowName, const char* ScreenID, int Value)
 
 	if (ScreenID && ScreenID[0] && ScreenID[0] != '0')
 	{
-		pWnd = pWnd->GetChildItem(ScreenID);
+		pWnd = GetCachedChildItem(pWnd, ScreenID);
 		if (!pWnd)
 		{
 			MacroError("Window '%s' child '%s' not found.", WindowName, ScreenID);
@@ -915,15 +957,7 @@ bool SendComboSelect(const char* WindowName, const char* ScreenID, int Value)
 
 		if (pWnd->GetType() == UI_Combobox)
 		{
-			CComboWnd* comboWnd = static_cast<CComboWnd*>(pWnd);
-			comboWnd->SetChoice(Value);
-
-			CListWnd* listWnd = comboWnd->pListWnd;
-			int index = listWnd->GetCurSel();
-#pragma warning(suppress : 4312)
-			listWnd->ParentWndNotification(listWnd, XWM_LCLICK, (void*)index);
-
-			WeDidStuff();
+			SelectComboIndex(static_cast<CComboWnd*>(pWnd), Value);
 			return true;
 		}
 
@@ -936,21 +970,7 @@ bool SendComboSelect(const char* WindowName, const char* ScreenID, int Value)
 
 bool SendTabSelect(const char* WindowName, const char* ScreenID, int Value)
 {
-	CXWnd* pWnd = FindMQ2Window(WindowName);
-	if (!_stricmp(WindowName, "RewardSelectionWnd"))
-	{
-		//          TabWindow           PageTemplate
-		pWnd = pWnd->GetFirstChildWnd()->GetFirstChildWnd();
-		while (pWnd)
-		{
-			if (pWnd->IsVisible())
-			{
-				break;
-			}
-			pWnd = pWnd->GetNextSiblingWnd();
-		}
-	}
-
+	CXWnd* pWnd = FindNotificationWindow(WindowName);
 	if (!pWnd)
 	{
 		MacroError("Window '%s' not available.", WindowName);
@@ -959,7 +979,7 @@ bool SendTabSelect(const char* WindowName, const char* ScreenID, int Value)
 
 	if (ScreenID && ScreenID[0] && ScreenID[0] != '0')
 	{
-		CTabWnd* pTab = (CTabWnd*)pWnd->GetChildItem(ScreenID);
+		CTabWnd* pTab = (CTabWnd*)GetCachedChildItem(pWnd, ScreenID);
 		if (!pTab)
 		{
 			MacroError("Window '%s' child '%s' not found.", WindowName, ScreenID);
@@ -994,7 +1014,7 @@ bool SendWndNotification(const char* WindowName, const char* ScreenID, int Notif
 	CXWnd* pChild = nullptr;
 	if (ScreenID && ScreenID[0])
 	{
-		pChild = pWnd->GetChildItem(ScreenID);
+		pChild = GetCachedChildItem(pWnd, ScreenID);
 		if (!pChild)
 		{
 			WriteChatf("Window '%s' child '%s' not found.", WindowName, ScreenID);
@@ -1002,15 +1022,7 @@ bool SendWndNotification(const char* WindowName, const char* ScreenID, int Notif
 		}
 	}
 
-	if (Notification == XWM_NEWVALUE && pChild)
-	{
-		CSliderWnd* sliderWnd = static_cast<CSliderWnd*>(pChild);
-#pragma warning(suppress : 4311 4302)
-		sliderWnd->SetValue(reinterpret_cast<int>(Data));
-	}
-
-	pWnd->WndNotification(pChild, Notification, Data);
-	WeDidStuff();
+	NotifyWindow(pWnd, pChild, Notification, Data);
 	return true;
 }
 
@@ -1339,6 +1351,212 @@ void WndNotify(PSPAWNINFO pChar, char* szLine)
 	MacroError("Invalid notification '%s'", szArg3);
 }
 
+//============================================================================
+// Notification batches
+//
+// UI automation sends long chains of notifications to the same window, each of which used to be a
+// /notify of its own. A batch resolves the window once and sends every step in the same frame. The
+// steps take the same arguments as /notify, and are sent the same way.
+
+static bool IsClickNotification(const char* Notification)
+{
+	for (const char* click : szClickNotification)
+	{
+		if (!_stricmp(click, Notification))
+			return true;
+	}
+
+	return false;
+}
+
+static bool SendWindowNotification(CXWnd* pWnd, CXWnd* pPage, const char* WindowName,
+	const MQWindowNotification& step, std::string& error)
+{
+	const char* ScreenID = step.ScreenID.c_str();
+	const char* Notification = step.Notification.c_str();
+	const bool toWindow = step.ScreenID.empty() || step.ScreenID[0] == '0';
+
+	int Data = GetIntFromString(step.Data, 0);
+	if (ci_equals(Notification, "link"))
+		Data = 1;
+
+	if (ci_equals(Notification, "listselect") || ci_equals(Notification, "comboselect") || ci_equals(Notification, "tabselect"))
+	{
+		if (Data <= 0)
+		{
+			error = fmt::format("{} index out of bounds: {}", Notification, step.Data);
+			return false;
+		}
+
+		CXWnd* pChild = pPage && !toWindow ? GetCachedChildItem(pPage, step.ScreenID) : nullptr;
+		if (!pChild)
+		{
+			error = fmt::format("Window '{}' child '{}' not found.", WindowName, ScreenID);
+			return false;
+		}
+
+		const int type = pChild->GetType();
+
+		if (ci_equals(Notification, "tabselect"))
+		{
+			if (type == UI_TabBox)
+			{
+				static_cast<CTabWnd*>(pChild)->SetPage(Data - 1, true);
+				WeDidStuff();
+				return true;
+			}
+		}
+		else if (type == UI_Combobox)
+		{
+			SelectComboIndex(static_cast<CComboWnd*>(pChild), Data - 1);
+			return true;
+		}
+		else if (ci_equals(Notification, "listselect") && (type == UI_Listbox || type == UI_TreeView))
+		{
+			SelectListIndex(static_cast<CListWnd*>(pChild), Data - 1);
+			return true;
+		}
+
+		error = fmt::format("Window '{}' child '{}' cannot accept this notification.", WindowName, ScreenID);
+		return false;
+	}
+
+	if (Data == 0 && IsClickNotification(Notification))
+	{
+		if (!pPage)
+		{
+			error = fmt::format("Window '{}' not available.", WindowName);
+			return false;
+		}
+
+		CXWnd* pTarget = toWindow ? pPage : FindClickTarget(pPage, WindowName, ScreenID, error);
+		return pTarget && SendWndClick2(pTarget, Notification);
+	}
+
+	for (int i = 0; i < static_cast<int>(lengthof(szWndNotification)); ++i)
+	{
+		if (szWndNotification[i] && ci_equals(szWndNotification[i], Notification))
+		{
+			CXWnd* pChild = nullptr;
+			if (!toWindow)
+			{
+				pChild = GetCachedChildItem(pWnd, step.ScreenID);
+				if (!pChild)
+				{
+					error = fmt::format("Window '{}' child '{}' not found.", WindowName, ScreenID);
+					return false;
+				}
+			}
+
+			if (i == XWM_LINK)
+			{
+				char szData[MAX_STRING] = { 0 };
+				strcpy_s(szData, step.Data.c_str());
+				NotifyWindow(pWnd, pChild, i, szData);
+			}
+			else
+			{
+#pragma warning(suppress : 4312)
+				NotifyWindow(pWnd, pChild, i, reinterpret_cast<void*>(Data));
+			}
+
+			return true;
+		}
+	}
+
+	error = fmt::format("Invalid notification '{}'", Notification);
+	return false;
+}
+
+std::vector<MQWindowNotificationResult> SendWindowNotifications(const char* WindowName,
+	const std::vector<MQWindowNotification>& Steps, bool StopOnFailure)
+{
+	std::vector<MQWindowNotificationResult> results;
+	results.reserve(Steps.size());
+
+	CXWnd* pWnd = nullptr;
+	CXWnd* pPage = nullptr;
+	uint32_t generation = 0;
+
+	auto resolve = [&]()
+	{
+		pWnd = FindMQ2Window(WindowName);
+		pPage = !_stricmp(WindowName, "RewardSelectionWnd") ? GetRewardSelectionPage(pWnd) : pWnd;
+		generation = s_windowGeneration;
+	};
+
+	resolve();
+
+	for (const MQWindowNotification& step : Steps)
+	{
+		// A step can close the window, or open another, so it is resolved again if any window was
+		// created or destroyed.
+		if (generation != s_windowGeneration)
+			resolve();
+
+		MQWindowNotificationResult& result = results.emplace_back();
+
+		if (!pWnd)
+			result.Error = fmt::format("Window '{}' not available.", WindowName);
+		else
+			result.Success = SendWindowNotification(pWnd, pPage, WindowName, step, result.Error);
+
+		if (!result.Success && StopOnFailure)
+			break;
+	}
+
+	return results;
+}
+
+// /notifybatch <window> <control> <notification> [data] [| <control> <notification> [data] ...]
+void WndNotifyBatch(PSPAWNINFO pChar, char* szLine)
+{
+	char szWindow[MAX_STRING] = { 0 };
+	GetArg(szWindow, szLine, 1);
+
+	std::vector<MQWindowNotification> steps;
+
+	for (std::string_view stepText : split_view(GetNextArg(szLine, 1), '|'))
+	{
+		std::string stepLine(stepText);
+
+		char szArg1[MAX_STRING] = { 0 };
+		char szArg2[MAX_STRING] = { 0 };
+		char szArg3[MAX_STRING] = { 0 };
+		GetArg(szArg1, stepLine.c_str(), 1);
+		GetArg(szArg2, stepLine.c_str(), 2);
+		GetArg(szArg3, stepLine.c_str(), 3);
+
+		if (!szArg1[0] && !szArg2[0])
+			continue;
+
+		if (!szArg2[0])
+		{
+			steps.clear();
+			break;
+		}
+
+		steps.push_back({ szArg1, szArg2, szArg3 });
+	}
+
+	if (!szWindow[0] || steps.empty())
+	{
+		SyntaxError("Syntax: /notifybatch <window> <control|0> <notification> [data] [| <control|0> <notification> [data] ...]");
+		return;
+	}
+
+	std::vector<MQWindowNotificationResult> results = SendWindowNotifications(szWindow, steps);
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		if (!results[i].Success)
+		{
+			MacroError("[/notifybatch] Step %d (%s %s) failed: %s", static_cast<int>(i + 1),
+				steps[i].ScreenID.c_str(), steps[i].Notification.c_str(), results[i].Error.c_str());
+		}
+	}
+}
+
 bool IsCtrlKey()
 {
 	return (pWndMgr->GetKeyboardFlags() & 0x00000002) != 0;
@@ -2002,6 +2220,7 @@ static void Windows_Initialize()
 
 	AddCommand("/windows", ListWindows);
 	AddCommand("/notify", WndNotify);
+	AddCommand("/notifybatch", WndNotifyBatch);
 	AddCommand("/itemnotify", ItemNotify, false, true, true);
 	AddCommand("/itemslots", ListItemSlots, false, true, true);
 
@@ -2021,6 +2240,7 @@ static void Windows_Shutdown()
 
 	RemoveCommand("/windows");
 	RemoveCommand("/notify");
+	RemoveCommand("/notifybatch");
 	RemoveCommand("/itemnotify");
 	RemoveCommand("/itemslots");
 
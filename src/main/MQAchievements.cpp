@@ -18,8 +18,6 @@
 
 namespace mq {
 
-static std::unordered_map<const eqlib::Achievement*, int> pointerToIndexMap;
-
 // These are ordered by most likely to least likely
 static eqlib::AchievementComponentType validComponentTypes[] = {
 	eqlib::AchievementComponentCompletion,
@@ -28,35 +26,116 @@ static eqlib::AchievementComponentType validComponentTypes[] = {
 	eqlib::AchievementComponentDisplay,
 };
 
+// Achievement array doesn't change over the duration of the session, so lookups are answered from
+// indices over it. Names are indexed when the indices are first used, categories and components the
+// first time they are searched. Everything is rebuilt if the manager ends up with a different array.
+struct AchievementIndices
+{
+	int achievementCount = -1;
+	const eqlib::Achievement* firstAchievement = nullptr;
+
+	// Names and descriptions are lower case. The first achievement or component with a name wins.
+	std::unordered_map<const eqlib::Achievement*, int> pointerToIndex;
+	std::unordered_map<std::string, int> nameToIndex;
+	std::unordered_map<int, std::unordered_map<std::string, int>> categoryNameToIndex;
+	std::unordered_map<const eqlib::Achievement*,
+		std::unordered_map<std::string, const eqlib::AchievementComponent*>> componentsByDescription;
+};
+
+static AchievementIndices s_indices;
+
+static AchievementIndices& GetAchievementIndices()
+{
+	eqlib::AchievementManager& mgr = eqlib::AchievementManager::Instance();
+
+	const int count = mgr.GetAchievementCount();
+	const eqlib::Achievement* first = count > 0 ? mgr.GetAchievementByIndex(0) : nullptr;
+
+	if (count != s_indices.achievementCount || first != s_indices.firstAchievement)
+	{
+		s_indices = AchievementIndices();
+		s_indices.achievementCount = count;
+		s_indices.firstAchievement = first;
+
+		s_indices.pointerToIndex.reserve(count);
+		s_indices.nameToIndex.reserve(count);
+
+		for (int index = 0; index < count; ++index)
+		{
+			if (const eqlib::Achievement* achievement = mgr.GetAchievementByIndex(index))
+			{
+				s_indices.pointerToIndex.emplace(achievement, index);
+				s_indices.nameToIndex.emplace(to_lower_copy(achievement->name.c_str()), index);
+			}
+		}
+	}
+
+	return s_indices;
+}
+
 static int GetAchievementIndexFromAchievement(const eqlib::Achievement* achievement)
 {
 	if (!achievement) return -1;
 
-	// Achievement array doesn't change over the duration of the session.
+	const AchievementIndices& indices = GetAchievementIndices();
 
-	auto iter = pointerToIndexMap.find(achievement);
-	if (iter != pointerToIndexMap.end())
+	auto iter = indices.pointerToIndex.find(achievement);
+	if (iter != indices.pointerToIndex.end())
 		return iter->second;
 
-	eqlib::AchievementManager& mgr = eqlib::AchievementManager::Instance();
-	auto [iter2, created] = pointerToIndexMap.emplace(achievement, mgr.GetAchievementIndexById(achievement->id));
+	return -1;
+}
 
-	return iter2->second;
+int GetAchievementIndexByName(std::string_view name)
+{
+	const AchievementIndices& indices = GetAchievementIndices();
+
+	auto iter = indices.nameToIndex.find(to_lower_copy(name));
+	if (iter != indices.nameToIndex.end())
+		return iter->second;
+
+	return -1;
 }
 
-const eqlib::Achievement* GetAchievementByName(std::string_view name)
+int GetAchievementIndexInCategoryByName(const eqlib::AchievementCategory* category, std::string_view name)
 {
-	eqlib::AchievementManager& mgr = eqlib::AchievementManager::Instance();
-	const eqlib::Achievement* achievement = nullptr;
+	if (!category) return -1;
+
+	AchievementIndices& indices = GetAchievementIndices();
+
+	auto [categoryIter, created] = indices.categoryNameToIndex.try_emplace(category->id);
+	if (created)
+	{
+		eqlib::AchievementManager& mgr = eqlib::AchievementManager::Instance();
+
+		for (const eqlib::AchievementInfo& info : category->achievements)
+		{
+			int achievementIndex = mgr.GetAchievementIndexById(info.achievementId);
+			if (achievementIndex >= 0)
+			{
+				if (const eqlib::Achievement* achievement = mgr.GetAchievementByIndex(achievementIndex))
+					categoryIter->second.emplace(to_lower_copy(achievement->name.c_str()), achievementIndex);
+			}
+		}
+	}
+
+	auto iter = categoryIter->second.find(to_lower_copy(name));
+	if (iter != categoryIter->second.end())
+		return iter->second;
+
+	return -1;
+}
 
-	int index = mgr.GetAchievementIndexByName(name);
+const eqlib::Achievement* GetAchievementByName(std::string_view name)
+{
+	int index = GetAchievementIndexByName(name);
 	if (index >= 0)
 	{
-		achievement = mgr.GetAchievementByIndex(index);
-		pointerToIndexMap.emplace(achievement, index);
+		eqlib::AchievementManager& mgr = eqlib::AchievementManager::Instance();
+		return mgr.GetAchievementByIndex(index);
 	}
 
-	return achievement;
+	return nullptr;
 }
 
 const eqlib::Achievement* GetAchievementById(int id)
@@ -68,7 +147,6 @@ const eqlib::Achievement* GetAchievementById(int id)
 	if (index >= 0)
 	{
 		achievement = mgr.GetAchievementByIndex(index);
-		pointerToIndexMap.emplace(achievement, index);
 	}
 
 	return achievement;
@@ -98,15 +176,24 @@ const eqlib::AchievementComponent* GetAchievementComponentByDescription(const eq
 {
 	if (!achievement) return nullptr;
 
-	for (eqlib::AchievementComponentType componentType : validComponentTypes)
+	AchievementIndices& indices = GetAchievementIndices();
+
+	auto [componentsIter, created] = indices.componentsByDescription.try_emplace(achievement);
+	if (created)
 	{
-		for (const eqlib::AchievementComponent& component : achievement->componentsByType[componentType])
+		for (eqlib::AchievementComponentType componentType : validComponentTypes)
 		{
-			if (ci_equals(component.description, description))
-				return &component;
+			for (const eqlib::AchievementComponent& component : achievement->componentsByType[componentType])
+			{
+				componentsIter->second.emplace(to_lower_copy(component.description.c_str()), &component);
+			}
 		}
 	}
 
+	auto iter = componentsIter->second.find(to_lower_copy(description));
+	if (iter != componentsIter->second.end())
+		return iter->second;
+
 	return nullptr;
 }
 
@@ -101,6 +101,9 @@ void MQActorAPI::SendToActor(
 	if (address.Character)
 		addr.set_character(*address.Character);
 
+	if (address.Topic)
+		addr.set_topic(*address.Topic);
+
 	PipeMessageResponseCb pipe_callback = nullptr;
 	if (callback != nullptr)
 	{
@@ -252,4 +255,26 @@ void MQActorAPI::RemoveActor(
 	}
 }
 
+bool MQActorAPI::SubscribeActor(
+	postoffice::Dropbox* dropbox,
+	const std::string& topic,
+	const MQPluginHandle& pluginHandle)
+{
+	if (dropbox == nullptr || !dropbox->IsValid())
+		return false;
+
+	return GetPostOffice().Subscribe(dropbox->GetAddress(), topic);
+}
+
+bool MQActorAPI::UnsubscribeActor(
+	postoffice::Dropbox* dropbox,
+	const std::string& topic,
+	const MQPluginHandle& pluginHandle)
+{
+	if (dropbox == nullptr || !dropbox->IsValid())
+		return false;
+
+	return GetPostOffice().Unsubscribe(dropbox->GetAddress(), topic);
+}
+
 } // namespace mq
@@ -48,6 +48,16 @@ public:
 	void RemoveActor(
 		postoffice::Dropbox*& dropbox,
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+
+	bool SubscribeActor(
+		postoffice::Dropbox* dropbox,
+		const std::string& topic,
+		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+
+	bool UnsubscribeActor(
+		postoffice::Dropbox* dropbox,
+		const std::string& topic,
+		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 };
 
 extern MQActorAPI* pActorAPI;
@@ -0,0 +1,221 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQAdvLoot.h"
+
+namespace mq {
+
+//============================================================================
+// Advanced loot lists
+//
+// The window keeps its items in an array and their order in a list window, so every lookup has to
+// find the list window by name and walk its rows. The model keeps the rows and the names, and is
+// only rebuilt when the rows change. Looting macros read the counts and the rows many times a
+// pulse, and that is only a few array reads now.
+
+static AdvLootListModel s_advLootLists[2];
+static CAdvancedLootWnd* s_advLootWnd = nullptr;
+static uint64_t s_lastAdvLootSignatures[2] = { 0, 0 };
+static uint32_t s_changedAdvLootLists = 0;
+
+#if HAS_ADVANCED_LOOT
+static const char* GetAdvLootListWndName(AdvLootList list)
+{
+	return list == AdvLootList::Personal ? "ADLW_PLLList" : "ADLW_CLLList";
+}
+
+static AdvancedLootItemList* GetAdvLootItemList(AdvLootList list)
+{
+	return list == AdvLootList::Personal ? pAdvancedLootWnd->pPLootList : pAdvancedLootWnd->pCLootList;
+}
+
+// The order of the rows and the items on them. The flags of the items aren't part of it, those are
+// read from the items every time.
+static uint64_t GetAdvLootListSignature(CListWnd* listWnd, AdvancedLootItemList* itemList)
+{
+	if (!listWnd || !itemList)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](uint64_t value)
+	{
+		hash ^= value;
+		hash *= 1099511628211ULL;
+	};
+
+	const int itemCount = itemList->Items.GetSize();
+	add(static_cast<uint64_t>(itemCount));
+
+	for (int row = 0; row < listWnd->ItemsArray.Count; ++row)
+	{
+		const int index = static_cast<int>(listWnd->GetItemData(row));
+		add(static_cast<uint64_t>(index));
+
+		if (index >= 0 && index < itemCount)
+			add(static_cast<uint64_t>(itemList->Items[index].ItemID));
+	}
+
+	return hash;
+}
+
+static void RebuildAdvLootList(AdvLootListModel& model, CListWnd* listWnd, AdvancedLootItemList* itemList)
+{
+	model.listWnd = listWnd;
+	model.itemList = itemList;
+	model.itemCount = itemList ? itemList->Items.GetSize() : 0;
+	model.signature = GetAdvLootListSignature(listWnd, itemList);
+	model.rows.clear();
+	model.rowByName.clear();
+
+	if (!listWnd || !itemList)
+		return;
+
+	model.rows.reserve(listWnd->ItemsArray.Count);
+	for (int row = 0; row < listWnd->ItemsArray.Count; ++row)
+	{
+		const int index = static_cast<int>(listWnd->GetItemData(row));
+		model.rows.push_back(index);
+
+		if (index >= 0 && index < model.itemCount)
+			model.rowByName.emplace(to_lower_copy(itemList->Items[index].Name), row);
+	}
+}
+
+static bool IsAdvLootListCurrent(const AdvLootListModel& model, AdvancedLootItemList* itemList)
+{
+	if (model.itemList != itemList || !model.listWnd)
+		return false;
+
+	return model.itemCount == (itemList ? itemList->Items.GetSize() : 0)
+		&& static_cast<int>(model.rows.size()) == model.listWnd->ItemsArray.Count;
+}
+#endif // HAS_ADVANCED_LOOT
+
+const AdvancedLootItem* AdvLootListModel::GetItem(int row) const
+{
+	const int index = GetItemIndex(row);
+	return index != -1 ? &itemList->Items[index] : nullptr;
+}
+
+int AdvLootListModel::GetItemIndex(int row) const
+{
+	if (row < 0 || row >= static_cast<int>(rows.size()) || !itemList)
+		return -1;
+
+	const int index = rows[row];
+	return index >= 0 && index < itemCount ? index : -1;
+}
+
+int AdvLootListModel::FindRowByName(std::string_view name) const
+{
+	auto iter = rowByName.find(to_lower_copy(name));
+	return iter != rowByName.end() ? iter->second : -1;
+}
+
+int AdvLootListModel::GetWantCount() const
+{
+	int count = 0;
+
+	for (int row = 0; row < static_cast<int>(rows.size()); ++row)
+	{
+		if (const AdvancedLootItem* item = GetItem(row))
+		{
+			if (item->AlwaysNeed || item->AlwaysGreed || item->Need || item->Greed)
+				++count;
+		}
+	}
+
+	return count;
+}
+
+bool AdvLootListModel::IsLootInProgress() const
+{
+	for (int row = 0; row < static_cast<int>(rows.size()); ++row)
+	{
+		if (const AdvancedLootItem* item = GetItem(row))
+		{
+			if (item->PLootInProgress || item->CLootInProgress)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+const AdvLootListModel* AdvLoot_GetList(AdvLootList list)
+{
+#if HAS_ADVANCED_LOOT
+	if (!pAdvancedLootWnd)
+		return nullptr;
+
+	AdvLootListModel& model = s_advLootLists[static_cast<int>(list)];
+	AdvancedLootItemList* itemList = GetAdvLootItemList(list);
+
+	// The list window is only looked up again when the window was recreated.
+	if (s_advLootWnd != pAdvancedLootWnd)
+	{
+		s_advLootWnd = pAdvancedLootWnd;
+		for (AdvLootListModel& other : s_advLootLists)
+			other.listWnd = nullptr;
+	}
+
+	if (!IsAdvLootListCurrent(model, itemList))
+	{
+		CListWnd* listWnd = model.listWnd;
+		if (!listWnd)
+			listWnd = static_cast<CListWnd*>(pAdvancedLootWnd->GetChildItem(GetAdvLootListWndName(list)));
+
+		RebuildAdvLootList(model, listWnd, itemList);
+	}
+
+	return model.listWnd ? &model : nullptr;
+#else
+	return nullptr;
+#endif
+}
+
+void AdvLoot_Pulse()
+{
+	s_changedAdvLootLists = 0;
+
+#if HAS_ADVANCED_LOOT
+	for (int list = 0; list < 2; ++list)
+	{
+		uint64_t signature = 0;
+
+		if (const AdvLootListModel* model = AdvLoot_GetList(static_cast<AdvLootList>(list)))
+		{
+			// Rows can be reordered or replaced without the size changing.
+			signature = GetAdvLootListSignature(model->listWnd, model->itemList);
+			if (signature != model->signature)
+				RebuildAdvLootList(s_advLootLists[list], model->listWnd, model->itemList);
+		}
+
+		if (signature != s_lastAdvLootSignatures[list])
+		{
+			s_lastAdvLootSignatures[list] = signature;
+			s_changedAdvLootLists |= 1 << list;
+		}
+	}
+#endif
+}
+
+uint32_t AdvLoot_GetChangedLists()
+{
+	return s_changedAdvLootLists;
+}
+
+} // namespace mq
@@ -0,0 +1,63 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mq {
+
+enum class AdvLootList
+{
+	Personal,
+	Shared,
+};
+
+// The rows of an advanced loot list, in the order that the window shows them.
+struct AdvLootListModel
+{
+	eqlib::CListWnd* listWnd = nullptr;
+	eqlib::AdvancedLootItemList* itemList = nullptr;
+	int itemCount = 0;
+	uint64_t signature = 0;
+	std::vector<int> rows;                                 // row -> index into the items, or -1
+	std::unordered_map<std::string, int> rowByName;        // lower case name -> first row with it
+
+	// The item shown on the row, or null if there is no such row.
+	const eqlib::AdvancedLootItem* GetItem(int row) const;
+	int GetItemIndex(int row) const;
+
+	// The first row of the item with this name, compared case insensitively, or -1.
+	int FindRowByName(std::string_view name) const;
+
+	// The flags change without the rows changing, so these look at the items every time.
+	int GetWantCount() const;
+	bool IsLootInProgress() const;
+};
+
+// Checks for changes to the rows of the lists. Called once per pulse, before macros and game
+// events are processed.
+void AdvLoot_Pulse();
+
+// The lists whose rows changed during this pulse: bit 0 for the personal list, bit 1 for the shared one.
+uint32_t AdvLoot_GetChangedLists();
+
+// The model of the list, rebuilt first if the size of the list changed. Null if there is no window.
+const AdvLootListModel* AdvLoot_GetList(AdvLootList list);
+
+} // namespace mq
@@ -0,0 +1,207 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQCastState.h"
+
+namespace mq {
+
+//============================================================================
+// Cast State
+//
+// The casting state of the player tells us when a cast begins and ends, but not how it ended. The
+// chat messages about the cast fill that in. They are only remembered when they arrive, and are
+// matched up with the casting state on the next pulse, so the order that they come in doesn't matter.
+
+// A resist is only blamed on the last spell that landed if it comes this soon after.
+static constexpr uint64_t ResistWindow = 3000;
+
+// A cast that ends this close to its ETA without a message finished, rather than being cut short.
+static constexpr int64_t LandedSlack = 250;
+
+enum class CastMessage
+{
+	None,
+	Fizzled,
+	Interrupted,
+	Resisted,
+};
+
+struct CastMessagePrefix
+{
+	std::string_view prefix;
+	CastMessage message;
+};
+
+static const CastMessagePrefix s_castMessages[] = {
+	{ "Your spell fizzles",                CastMessage::Fizzled },
+	{ "Your spell is interrupted",         CastMessage::Interrupted },
+	{ "Your casting has been interrupted", CastMessage::Interrupted },
+	{ "Your target resisted the ",         CastMessage::Resisted },
+	{ "Your spell did not take hold",      CastMessage::Resisted },
+};
+
+static MQCastState s_castState;
+static std::vector<CastPhaseTransition> s_castTransitions;
+
+// What was seen since the previous pulse.
+static CastMessage s_pendingFailure = CastMessage::None;
+static bool s_pendingResist = false;
+
+static int64_t s_castETA = 0;
+static int s_lastLandedSpellID = -1;
+static uint64_t s_lastLandedTime = 0;
+
+void CastState_OnChat(const char* szLine)
+{
+	if (!szLine || strncmp(szLine, "Your ", 5) != 0)
+		return;
+
+	std::string_view line{ szLine };
+	for (const CastMessagePrefix& entry : s_castMessages)
+	{
+		if (!starts_with(line, entry.prefix))
+			continue;
+
+		if (entry.message == CastMessage::Resisted)
+			s_pendingResist = true;
+		else
+			s_pendingFailure = entry.message;
+		return;
+	}
+}
+
+static void SetCastPhase(MQCastPhase phase, int spellID)
+{
+	s_castState.Phase = phase;
+	s_castState.SpellID = spellID;
+	s_castState.PhaseTime = GetTickCount64();
+
+	s_castTransitions.push_back({ phase, spellID });
+	AddCastPhaseEvent(phase, spellID);
+}
+
+void CastState_Pulse()
+{
+	s_castTransitions.clear();
+
+	if (gGameState != GAMESTATE_INGAME || gZoning || !pLocalPlayer || !pDisplay)
+	{
+		s_castState.Casting = false;
+		s_castState.Recovering = false;
+		s_pendingFailure = CastMessage::None;
+		s_pendingResist = false;
+		return;
+	}
+
+	const int spellID = pLocalPlayer->CastingData.SpellID;
+	const int64_t now = pDisplay->TimeStamp;
+
+	// A cast that ended, or was replaced by another one.
+	if (s_castState.Casting && spellID != s_castState.SpellID)
+	{
+		const int castSpellID = s_castState.SpellID;
+		s_castState.Casting = false;
+
+		if (s_pendingFailure == CastMessage::Fizzled)
+		{
+			SetCastPhase(MQCastPhase::Fizzled, castSpellID);
+		}
+		else if (s_pendingFailure == CastMessage::Interrupted || (s_castETA != 0 && now + LandedSlack < s_castETA))
+		{
+			SetCastPhase(MQCastPhase::Interrupted, castSpellID);
+		}
+		else
+		{
+			SetCastPhase(MQCastPhase::Landed, castSpellID);
+			s_lastLandedSpellID = castSpellID;
+			s_lastLandedTime = GetTickCount64();
+		}
+
+		s_pendingFailure = CastMessage::None;
+		s_castState.Recovering = true;
+	}
+
+	if (!s_castState.Casting && spellID != -1)
+	{
+		s_castState.Casting = true;
+		s_castState.TargetID = pTarget ? pTarget->SpawnID : 0;
+		++s_castState.CastCount;
+		s_castETA = 0;
+
+		SetCastPhase(MQCastPhase::Begin, spellID);
+	}
+
+	if (s_castState.Casting)
+	{
+		// The ETA isn't always known on the pulse that the cast begins.
+		if (pLocalPlayer->CastingData.SpellETA)
+			s_castETA = pLocalPlayer->CastingData.SpellETA;
+	}
+	else if (s_pendingFailure != CastMessage::None)
+	{
+		// Fizzles and some interruptions end the cast before a pulse ever sees it, so which spell it
+		// was isn't known.
+		SetCastPhase(s_pendingFailure == CastMessage::Fizzled ? MQCastPhase::Fizzled : MQCastPhase::Interrupted, -1);
+
+		s_pendingFailure = CastMessage::None;
+		s_castState.Recovering = true;
+	}
+
+	if (s_pendingResist)
+	{
+		s_pendingResist = false;
+
+		if (s_lastLandedSpellID != -1 && GetTickCount64() - s_lastLandedTime <= ResistWindow)
+		{
+			SetCastPhase(MQCastPhase::Resisted, s_lastLandedSpellID);
+			s_lastLandedSpellID = -1;
+		}
+	}
+
+	if (s_castState.Recovering && !s_castState.Casting && now > pLocalPlayer->GetSpellCooldownETA())
+	{
+		s_castState.Recovering = false;
+		SetCastPhase(MQCastPhase::Recovered, s_castState.SpellID);
+	}
+}
+
+const std::vector<CastPhaseTransition>& CastState_GetTransitions()
+{
+	return s_castTransitions;
+}
+
+const MQCastState& GetCastState()
+{
+	return s_castState;
+}
+
+const char* GetCastPhaseName(MQCastPhase phase)
+{
+	switch (phase)
+	{
+	case MQCastPhase::Begin: return "begin";
+	case MQCastPhase::Interrupted: return "interrupted";
+	case MQCastPhase::Fizzled: return "fizzled";
+	case MQCastPhase::Landed: return "landed";
+	case MQCastPhase::Resisted: return "resisted";
+	case MQCastPhase::Recovered: return "recovered";
+	case MQCastPhase::Idle:
+	default: return "idle";
+	}
+}
+
+} // namespace mq
@@ -0,0 +1,44 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+
+#pragma once
+
+#include "mq/api/Spells.h"
+
+#include <vector>
+
+namespace mq {
+
+// A step that a cast went through during this pulse.
+struct CastPhaseTransition
+{
+	MQCastPhase phase = MQCastPhase::Idle;
+	int spellID = -1;
+};
+
+// Looks for the chat messages that tell how a cast went. Called for every line of chat.
+void CastState_OnChat(const char* szLine);
+
+// Updates the cast state from the casting state of the player and the chat seen since the previous
+// pulse. Called once per pulse, before macros and game events are processed.
+void CastState_Pulse();
+
+// The steps that casts went through during this pulse, in order.
+const std::vector<CastPhaseTransition>& CastState_GetTransitions();
+
+// Queues Event_CastPhase for the macro, if it has that sub. Lives with the other macro events.
+void AddCastPhaseEvent(MQCastPhase phase, int spellID);
+
+} // namespace mq
@@ -17,18 +17,17 @@
 
 #include "CrashHandler.h"
 #include "MQCommandAPI.h"
+#include "MQDataAPI.h"
+#include "MQMacroProfiler.h"
+#include "MQSlowExpressions.h"
 #include "mq/base/ScopeExit.h"
 
 namespace mq {
 
-struct MQTimedCommand
+struct MQTimedCommand : MQTimerWheelNode
 {
-	uint64_t         time;
 	std::string      command;
 	MQPluginHandle   pluginHandle;
-
-	MQTimedCommand*  pLast;
-	MQTimedCommand*  pNext;
 };
 
 struct MQCommand
@@ -44,9 +43,30 @@ struct MQCommand
 	MQCommand*       pNext = nullptr;
 };
 
+// Commands that change what the per-frame snapshots report: Me.SpellReady after /cast, Me.Sitting
+// after /sit and so on. Running one of them expires the snapshots, so the rest of the frame reads
+// the new state instead of what it was at the start of the frame.
+static constexpr std::string_view s_frameStateCommands[] = {
+	"/alt", "/cast", "/disc", "/doability", "/duck", "/feign", "/interrupt", "/memspell",
+	"/sit", "/stand", "/stopcast", "/stopsong", "/target", "/useitem",
+};
+
+static void ExpireFrameStateAfter(const MQCommand* pCommand)
+{
+	if (!pDataAPI || !IsMainThread())
+		return;
+
+	if (std::any_of(std::begin(s_frameStateCommands), std::end(s_frameStateCommands),
+		[pCommand](std::string_view command) { return ci_equals(pCommand->command, command); }))
+	{
+		pDataAPI->AdvanceFrame();
+	}
+}
+
 void PopMacroLoop();
 // Defined in MQ2MacroCommands.cpp
 void FailIf(PlayerClient* pChar, const char* szCommand, int pStartLine, bool All);
+bool RunCompiledCondition(MQMacroLine& line);
 
 MQCommandAPI* pCommandAPI = nullptr;
 
@@ -72,6 +92,7 @@ public:
 //============================================================================
 
 MQCommandAPI::MQCommandAPI()
+	: m_timedCommands(MQGetTickCount64())
 {
 	DebugSpew("Initializing Commands");
 
@@ -142,6 +163,7 @@ MQCommandAPI::MQCommandAPI()
 		{ "/assist",            AssistCmd,                  true,  true  },
 		{ "/banklist",          BankList,                   true,  true  },
 		{ "/beep",              MacroBeep,                  true,  false },
+		{ "/bgmacro",           BackgroundMacro,            true,  false },
 		{ "/bind",              MQ2KeyBindCommand,          true,  false },
 		{ "/break",             Break,                      true,  false },
 		{ "/buyitem",           BuyItem,                    true,  true  },
@@ -189,6 +211,7 @@ MQCommandAPI::MQCommandAPI()
 		{ "/identify",          Identify,                   true,  true  },
 		{ "/if",                MacroIfCmd,                 true,  false },
 		{ "/ini",               IniOutput,                  true,  false },
+		{ "/inputsequence",     InputSequence,              true,  false },
 		{ "/insertaug",         InsertAugCmd,               true,  true  },
 		{ "/invoke",            InvokeCmd,                  true,  false },
 		{ "/items",             Items,                      true,  true  },
@@ -226,6 +249,7 @@ MQCommandAPI::MQCommandAPI()
 		{ "/profile",           ProfileCmd,                 true,  false },
 		{ "/quit",              QuitCmd,                    true,  false },
 		{ "/ranged",            RangedCmd,                  true,  true  },
+		{ "/readiness",         ReadinessCmd,               true,  false },
 		{ "/reloadui",          ReloadUICmd,                true,  true  },
 		{ "/removeaug",         RemoveAugCmd,               true,  true  },
 		{ "/removeaura",        RemoveAura,                 true,  true  },
@@ -287,13 +311,9 @@ MQCommandAPI::~MQCommandAPI()
 
 	m_delayedCommands.clear();
 
-	while (m_pTimedCommands)
-	{
-		MQTimedCommand* pNext = m_pTimedCommands->pNext;
-		delete m_pTimedCommands;
-		m_pTimedCommands = pNext;
-	}
+	m_timedCommands.Clear([](MQTimerWheelNode* node) { delete static_cast<MQTimedCommand*>(node); });
 
+	FlushAliases();
 	m_aliases.clear();
 }
 
@@ -319,6 +339,7 @@ void MQCommandAPI::OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& plug
 			pCommand = pCommand->pNext;
 
 			delete thisCmd;
+			++m_commandGeneration;
 		}
 		else
 		{
@@ -346,15 +367,19 @@ bool MQCommandAPI::InterpretCmd(const char* szFullLine, const MQCommandHandler&
 		}
 	}
 
-	if (auto findIter = m_aliases.find(szCommand); findIter != m_aliases.end())
+	const char* szExpandedCommand = nullptr;
+	if (const RegisteredAlias* alias = FindAlias(szCommand))
 	{
-		const RegisteredAlias& alias = findIter->second;
+		szExpandedCommand = alias->GetExpandedCommand(szFullCommand);
 
-		sprintf_s(szCommand, "%s%s",alias.replacement.c_str(), szFullCommand + alias.match.size());
+		sprintf_s(szCommand, "%s%s", alias->replacement.c_str(), szFullCommand + alias->match.size());
 		strcpy_s(szFullCommand, szCommand);
 	}
 
-	GetArg(szCommand, szFullCommand, 1);
+	if (szExpandedCommand)
+		strcpy_s(szCommand, szExpandedCommand);
+	else
+		GetArg(szCommand, szFullCommand, 1);
 
 	char szArgs[MAX_STRING] = { 0 };
 	strcpy_s(szArgs, GetNextArg(szFullCommand));
@@ -375,55 +400,59 @@ bool MQCommandAPI::InterpretCmd(const char* szFullLine, const MQCommandHandler&
 	return false;
 }
 
+MQCommand* MQCommandAPI::FindDispatchCommand(const char* szCommand) const
+{
+	// Commands can be abbreviated, the first command in the list that starts with the text wins.
+	const CommandTrieNode* node = FindTrieNode(szCommand);
+	if (!node)
+		return nullptr;
+
+	return gGameState == GAMESTATE_INGAME ? node->firstCommand : node->firstAnyStateCommand;
+}
+
 bool MQCommandAPI::DispatchCommand(char* szCommand, char* szArgs, const MQCommandHandler& eqHandler)
 {
 	std::unique_lock lock(m_commandMutex);
 
-	MQCommand* pCommand = m_pCommands;
-	while (pCommand)
-	{
-		if (pCommand->inGameOnly && gGameState != GAMESTATE_INGAME)
-		{
-			pCommand = pCommand->pNext;
-			continue;
-		}
-
-		// Substring search
-		int Pos = _strnicmp(szCommand, pCommand->command.c_str(), strlen(szCommand));
-		if (Pos < 0)
-		{
-			// command not found
-			break;
-		}
+	MQCommand* pCommand = FindDispatchCommand(szCommand);
+	if (!pCommand)
+		return false;
 
-		if (Pos == 0)
-		{
-			lock.unlock();
+	lock.unlock();
 
-			// the parser version is 2, or It's not version 2 and we're allowing command parses
-			if (pCommand->parse && (gParserVersion == 2 || (gParserVersion != 2 && bAllowCommandParse)))
-			{
-				ParseMacroParameter(szArgs, MAX_STRING);
-			}
+	// the parser version is 2, or It's not version 2 and we're allowing command parses
+	if (pCommand->parse && (gParserVersion == 2 || (gParserVersion != 2 && bAllowCommandParse)))
+	{
+		ParseMacroParameter(szArgs, MAX_STRING);
+	}
 
-			if (pCommand->eq && eqHandler != nullptr)
-			{
-				strcat_s(szCommand, MAX_STRING, " ");
-				strcat_s(szCommand, MAX_STRING, szArgs);
+	// Handlers can modify their arguments, so keep the command line for the report.
+	std::string slowCommand;
+	std::chrono::steady_clock::time_point slowStart;
+	if (gbSlowExpressions)
+	{
+		slowCommand = fmt::format("{} {}", szCommand, szArgs);
+		slowStart = std::chrono::steady_clock::now();
+	}
 
-				eqHandler(pLocalPlayer, szCommand);
-			}
-			else
-			{
-				pCommand->handler(pLocalPlayer, szArgs);
-			}
+	if (pCommand->eq && eqHandler != nullptr)
+	{
+		strcat_s(szCommand, MAX_STRING, " ");
+		strcat_s(szCommand, MAX_STRING, szArgs);
 
-			return true;
-		}
-		pCommand = pCommand->pNext;
+		eqHandler(pLocalPlayer, szCommand);
+	}
+	else
+	{
+		pCommand->handler(pLocalPlayer, szArgs);
 	}
 
-	return false;
+	ExpireFrameStateAfter(pCommand);
+
+	if (!slowCommand.empty())
+		SlowExpressions_Check(MQSlowExpressionKind::Command, slowCommand, slowStart);
+
+	return true;
 }
 
 bool MQCommandAPI::DispatchBind(char* szCommand, char* szArgs)
@@ -435,8 +464,9 @@ bool MQCommandAPI::DispatchBind(char* szCommand, char* szArgs)
 	if (!pLocalPlayer)
 		return false;
 
+	// Binds belong to the foreground macro.
 	MQMacroBlockPtr pBlock = GetCurrentMacroBlock();
-	if (!pBlock)
+	if (!pBlock || pBlock->Background)
 		return false;
 
 	MQBindList* pBind = pBindList;
@@ -491,8 +521,8 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 	WeDidStuff();
 
 	// Update crash state with last known command in case something goes wrong
-	CrashHandler_SetLastCommand(szLine);
-	SCOPE_EXIT(CrashHandler_SetLastCommand(nullptr));
+	const uint64_t breadcrumb = CrashHandler_BeginBreadcrumb(CrashBreadcrumbKind::Command, szLine);
+	SCOPE_EXIT(CrashHandler_EndBreadcrumb(breadcrumb));
 
 	char szTheCmd[MAX_STRING] = { 0 };
 	strcpy_s(szTheCmd, szLine);
@@ -503,15 +533,18 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 	char szArg1[MAX_STRING] = { 0 };
 	GetArg(szArg1, szTheCmd, 1);
 
-	auto findIter = m_aliases.find(szArg1);
-	if (findIter != m_aliases.end())
+	const char* szExpandedCommand = nullptr;
+	if (const RegisteredAlias* alias = FindAlias(szArg1))
 	{
-		const RegisteredAlias& alias = findIter->second;
+		szExpandedCommand = alias->GetExpandedCommand(szOriginalLine);
 
-		sprintf_s(szTheCmd, "%s%s", alias.replacement.c_str(), szOriginalLine + alias.match.size());
+		sprintf_s(szTheCmd, "%s%s", alias->replacement.c_str(), szOriginalLine + alias->match.size());
 	}
 
-	GetArg(szArg1, szTheCmd, 1);
+	if (szExpandedCommand)
+		strcpy_s(szArg1, szExpandedCommand);
+	else
+		GetArg(szArg1, szTheCmd, 1);
 	if (szArg1[0] == 0)
 		return;
 
@@ -529,7 +562,7 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 	{
 		if (pBlock)
 		{
-			const auto loopStart = pBlock->Line.at(pBlock->CurrIndex).LoopStart;
+			const auto loopStart = pBlock->GetLine(pBlock->CurrIndex).LoopStart;
 			if (loopStart != 0)
 			{
 				pBlock->CurrIndex = loopStart;
@@ -608,10 +641,196 @@ void MQCommandAPI::DoCommand(const char* szLine, bool delayed,
 	}
 }
 
+MQCommand* MQCommandAPI::ResolveMacroLine(const MQMacroLine& line) const
+{
+	const std::string& name = line.CommandName;
+
+	// Lines that DoCommand handles itself, or that are rewritten by an alias first, are not cached.
+	if (name.empty() || name.size() >= MAX_STRING
+		|| name[0] == ':' || name[0] == '{' || name[0] == '}' || name[0] == ';' || name[0] == '[')
+	{
+		return nullptr;
+	}
+
+	if (FindAlias(name))
+		return nullptr;
+
+	return FindDispatchCommand(name.c_str());
+}
+
+void MQCommandAPI::DoMacroLine(MQMacroLine& line)
+{
+	std::unique_lock lock(m_commandMutex);
+
+	if (line.ResolvedGeneration != m_commandGeneration || line.ResolvedGameState != gGameState)
+	{
+		line.ResolvedCommand = ResolveMacroLine(line);
+		line.ResolvedGeneration = m_commandGeneration;
+		line.ResolvedGameState = gGameState;
+	}
+
+	MQCommand* pCommand = line.ResolvedCommand;
+	if (!pCommand)
+	{
+		lock.unlock();
+
+		DoCommand(line.Command.c_str(), false);
+		return;
+	}
+
+	WeDidStuff();
+
+	// Update crash state with last known command in case something goes wrong
+	const uint64_t breadcrumb = CrashHandler_BeginBreadcrumb(CrashBreadcrumbKind::Command, line.Command);
+	SCOPE_EXIT(CrashHandler_EndBreadcrumb(breadcrumb));
+
+	// the parser version is 2, or It's not version 2 and we're allowing command parses
+	const bool parse = pCommand->parse && (gParserVersion == 2 || (gParserVersion != 2 && bAllowCommandParse));
+
+	// /if and /while lines with a compiled condition don't need the line to be parsed first.
+	if (line.Condition && parse && pCommand->pluginHandle == mqplugin::ThisPluginHandle
+		&& RunCompiledCondition(line))
+	{
+		strcpy_s(szLastCommand, line.Command.c_str());
+		return;
+	}
+
+	char szArgs[MAX_STRING] = { 0 };
+	strcpy_s(szArgs, line.Command.c_str() + line.ArgumentOffset);
+
+	if (parse)
+	{
+		if (gMacroProfilerEnabled)
+		{
+			const uint64_t parseStart = MacroProfiler_Now();
+			ParseMacroParameter(szArgs, MAX_STRING);
+			line.ParseTime += MacroProfiler_Now() - parseStart;
+		}
+		else
+		{
+			ParseMacroParameter(szArgs, MAX_STRING);
+		}
+	}
+
+	if (gbSlowExpressions)
+	{
+		const std::string slowCommand = fmt::format("{} {}", line.CommandName, szArgs);
+		const auto slowStart = std::chrono::steady_clock::now();
+
+		pCommand->handler(pLocalPlayer, szArgs);
+		SlowExpressions_Check(MQSlowExpressionKind::Command, slowCommand, slowStart);
+	}
+	else
+	{
+		pCommand->handler(pLocalPlayer, szArgs);
+	}
+
+	ExpireFrameStateAfter(pCommand);
+	strcpy_s(szLastCommand, line.Command.c_str());
+}
+
+void MQCommandAPI::ResolveCompiledCommand(MQCompiledCommand& command) const
+{
+	command.ResolvedLine = command.Line;
+	command.ResolvedGeneration = m_commandGeneration;
+	command.ResolvedGameState = gGameState;
+	command.ResolvedCommand = nullptr;
+	command.ExpandedLine.clear();
+	command.ArgumentOffset = 0;
+
+	if (command.Line.size() >= MAX_STRING)
+		return;
+
+	char szName[MAX_STRING] = { 0 };
+	GetArg(szName, command.Line.c_str(), 1);
+
+	// The same alias expansion that DoCommand does.
+	std::string expanded = command.Line;
+	if (const RegisteredAlias* alias = FindAlias(szName))
+	{
+		expanded = alias->replacement + command.Line.substr(std::min(alias->match.size(), command.Line.size()));
+		if (expanded.size() >= MAX_STRING)
+			return;
+
+		if (const char* szExpandedCommand = alias->GetExpandedCommand(command.Line.c_str()))
+			strcpy_s(szName, szExpandedCommand);
+		else
+			GetArg(szName, expanded.c_str(), 1);
+	}
+
+	// Lines that DoCommand handles itself, and binds, which depend on the running macro, aren't resolved.
+	if (szName[0] == 0 || szName[0] == ':' || szName[0] == '{' || szName[0] == '}' || szName[0] == ';' || szName[0] == '[')
+		return;
+
+	MQCommand* pCommand = FindDispatchCommand(szName);
+	if (!pCommand)
+		return;
+
+	command.ResolvedCommand = pCommand;
+	command.ArgumentOffset = GetNextArg(expanded.c_str()) - expanded.c_str();
+	command.ExpandedLine = std::move(expanded);
+}
+
+void MQCommandAPI::DoCompiledCommand(MQCompiledCommand& command,
+	const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
+{
+	std::unique_lock lock(m_commandMutex);
+
+	if (command.ResolvedGeneration != m_commandGeneration || command.ResolvedGameState != gGameState
+		|| command.ResolvedLine != command.Line)
+	{
+		ResolveCompiledCommand(command);
+	}
+
+	MQCommand* pCommand = command.ResolvedCommand;
+	if (!pCommand)
+	{
+		lock.unlock();
+
+		DoCommand(command.Line.c_str(), false, pluginHandle);
+		return;
+	}
+
+	lock.unlock();
+
+	WeDidStuff();
+
+	// Update crash state with last known command in case something goes wrong
+	const uint64_t breadcrumb = CrashHandler_BeginBreadcrumb(CrashBreadcrumbKind::Command, command.Line);
+	SCOPE_EXIT(CrashHandler_EndBreadcrumb(breadcrumb));
+
+	char szArgs[MAX_STRING] = { 0 };
+	strcpy_s(szArgs, command.ExpandedLine.c_str() + command.ArgumentOffset);
+
+	// the parser version is 2, or It's not version 2 and we're allowing command parses
+	if (pCommand->parse && (gParserVersion == 2 || (gParserVersion != 2 && bAllowCommandParse)))
+	{
+		ParseMacroParameter(szArgs, MAX_STRING);
+	}
+
+	if (gbSlowExpressions)
+	{
+		const std::string slowCommand = fmt::format("{} {}", pCommand->command, szArgs);
+		const auto slowStart = std::chrono::steady_clock::now();
+
+		pCommand->handler(pLocalPlayer, szArgs);
+		SlowExpressions_Check(MQSlowExpressionKind::Command, slowCommand, slowStart);
+	}
+	else
+	{
+		pCommand->handler(pLocalPlayer, szArgs);
+	}
+
+	ExpireFrameStateAfter(pCommand);
+	strcpy_s(szLastCommand, command.Line.c_str());
+}
+
 bool MQCommandAPI::AddCommand(std::string_view command, MQCommandHandler handler,
 	bool EQ /* = false */, bool Parse /* = true */, bool InGame /* = false */,
 	const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
 {
+	++m_commandGeneration;
+
 	DebugSpew("AddCommand(%.*s)", command.length(), command.data());
 
 	MQCommand* pCommand = new MQCommand;
@@ -703,6 +922,7 @@ bool MQCommandAPI::RemoveCommand(std::string_view command,
 				m_pCommands = pCommand->pNext;
 			delete pCommand;
 
+			++m_commandGeneration;
 			return true;
 		}
 
@@ -714,21 +934,159 @@ bool MQCommandAPI::RemoveCommand(std::string_view command,
 
 MQCommand* MQCommandAPI::FindCommand(std::string_view command) const
 {
-	MQCommand* pCommand = m_pCommands;
-	while (pCommand)
+	const CommandTrieNode* node = FindTrieNode(command);
+	return node ? node->command : nullptr;
+}
+
+bool MQCommandAPI::IsCommand(std::string_view command) const
+{
+	return FindCommand(command) != nullptr;
+}
+
+std::vector<std::string> MQCommandAPI::GetCompletions(std::string_view prefix) const
+{
+	std::vector<std::string> completions;
+
+	const CommandTrieNode* node = FindTrieNode(prefix);
+	if (!node)
+		return completions;
+
+	// Children are sorted, so a depth first walk visits the names in order.
+	auto collect = [&](auto& self, const CommandTrieNode& current) -> void
 	{
-		if (ci_equals(command, pCommand->command))
-			return pCommand;
+		if (current.command)
+			completions.push_back(current.command->command);
+		else if (current.alias)
+			completions.push_back(current.alias->match);
 
-		pCommand = pCommand->pNext;
+		for (uint32_t i = 0; i < current.childCount; ++i)
+			self(self, m_commandTrie[current.firstChild + i]);
+	};
+	collect(collect, *node);
+
+	return completions;
+}
+
+const MQCommandAPI::CommandTrieNode* MQCommandAPI::FindTrieNode(std::string_view name) const
+{
+	if (m_commandTrieGeneration != m_commandGeneration)
+	{
+		RebuildCommandTrie();
+		m_commandTrieGeneration = m_commandGeneration;
 	}
 
-	return nullptr;
+	const CommandTrieNode* node = &m_commandTrie[0];
+	for (char ch : name)
+	{
+		const char lower = static_cast<char>(::tolower(static_cast<unsigned char>(ch)));
+
+		const CommandTrieNode* child = nullptr;
+		for (uint32_t i = 0; i < node->childCount; ++i)
+		{
+			if (m_commandTrie[node->firstChild + i].ch == lower)
+			{
+				child = &m_commandTrie[node->firstChild + i];
+				break;
+			}
+		}
+
+		if (!child)
+			return nullptr;
+
+		node = child;
+	}
+
+	return node;
 }
 
-bool MQCommandAPI::IsCommand(std::string_view command) const
+void MQCommandAPI::RebuildCommandTrie() const
 {
-	return FindCommand(command) != nullptr;
+	struct Entry
+	{
+		std::string key;
+		uint32_t order;
+		MQCommand* command;
+		const RegisteredAlias* alias;
+	};
+
+	std::vector<Entry> entries;
+	uint32_t order = 0;
+
+	for (MQCommand* pCommand = m_pCommands; pCommand; pCommand = pCommand->pNext)
+		entries.push_back({ to_lower_copy(pCommand->command), order++, pCommand, nullptr });
+
+	for (const auto& [_, alias] : m_aliases)
+		entries.push_back({ to_lower_copy(alias.match), order++, nullptr, &alias });
+
+	// Equal names keep their list order, so the first entry of a name is the one the list finds first.
+	std::sort(entries.begin(), entries.end(),
+		[](const Entry& a, const Entry& b) { return a.key < b.key || (a.key == b.key && a.order < b.order); });
+
+	m_commandTrie.clear();
+	m_commandTrie.reserve(entries.size() * 4);
+	m_commandTrie.emplace_back();
+
+	// Fills in the node for entries [first, last), which share their first depth characters. Entries
+	// that end at this node sort before the ones that continue past it.
+	auto build = [&](auto& self, uint32_t nodeIndex, size_t first, size_t last, size_t depth) -> void
+	{
+		uint32_t firstOrder = UINT32_MAX;
+		uint32_t firstAnyStateOrder = UINT32_MAX;
+
+		for (size_t i = first; i < last; ++i)
+		{
+			const Entry& entry = entries[i];
+			if (!entry.command)
+				continue;
+
+			if (entry.order < firstOrder)
+			{
+				firstOrder = entry.order;
+				m_commandTrie[nodeIndex].firstCommand = entry.command;
+			}
+
+			if (!entry.command->inGameOnly && entry.order < firstAnyStateOrder)
+			{
+				firstAnyStateOrder = entry.order;
+				m_commandTrie[nodeIndex].firstAnyStateCommand = entry.command;
+			}
+		}
+
+		size_t start = first;
+		for (; start < last && entries[start].key.size() == depth; ++start)
+		{
+			if (entries[start].command && !m_commandTrie[nodeIndex].command)
+				m_commandTrie[nodeIndex].command = entries[start].command;
+			if (entries[start].alias)
+				m_commandTrie[nodeIndex].alias = entries[start].alias;
+		}
+
+		std::vector<std::pair<size_t, size_t>> children;
+		while (start < last)
+		{
+			size_t end = start + 1;
+			while (end < last && entries[end].key[depth] == entries[start].key[depth])
+				++end;
+
+			children.emplace_back(start, end);
+			start = end;
+		}
+
+		const uint32_t firstChild = static_cast<uint32_t>(m_commandTrie.size());
+		m_commandTrie[nodeIndex].firstChild = firstChild;
+		m_commandTrie[nodeIndex].childCount = static_cast<uint16_t>(children.size());
+		m_commandTrie.resize(m_commandTrie.size() + children.size());
+
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			const auto [childFirst, childLast] = children[i];
+			const uint32_t childIndex = firstChild + static_cast<uint32_t>(i);
+
+			m_commandTrie[childIndex].ch = entries[childFirst].key[depth];
+			self(self, childIndex, childFirst, childLast, depth + 1);
+		}
+	};
+	build(build, 0, 0, entries.size(), 0);
 }
 
 //============================================================================
@@ -765,6 +1123,7 @@ bool MQCommandAPI::AddAlias(const std::string& shortCommand, const std::string&
 	auto [iter2, added] = m_aliases.emplace(std::piecewise_construct,
 		std::forward_as_tuple(shortCommand),
 		std::forward_as_tuple(shortCommand, longCommand, pluginHandle));
+	++m_commandGeneration;
 
 	if (writeToIni)
 	{
@@ -788,32 +1147,94 @@ bool MQCommandAPI::RemoveAlias(const std::string& shortCommand,
 
 	const RegisteredAlias& alias = iter->second;
 
-	DeletePrivateProfileKey("Aliases", alias.match, mq::internal_paths::MQini);
-	
+	DeleteAliasFromIni(alias.match);
+
 	m_aliases.erase(iter);
+	++m_commandGeneration;
 	return true;
 }
 
 bool MQCommandAPI::IsAlias(const std::string& alias) const
 {
-	// TODO: Switch to std::string_view when we have c++20 support
-	return m_aliases.count(alias) != 0;
+	return FindAlias(alias) != nullptr;
+}
+
+const MQCommandAPI::RegisteredAlias* MQCommandAPI::FindAlias(std::string_view name) const
+{
+	const CommandTrieNode* node = FindTrieNode(name);
+	return node ? node->alias : nullptr;
+}
+
+MQCommandAPI::RegisteredAlias::RegisteredAlias(std::string match_, std::string replacement_,
+	const MQPluginHandle& pluginHandle_)
+	: match(std::move(match_))
+	, replacement(std::move(replacement_))
+	, pluginHandle(pluginHandle_)
+{
+	if (replacement.size() >= MAX_STRING || replacement.find('"') != std::string::npos)
+		return;
+
+	const char* szStart = GetNextArg(replacement.c_str(), 0);
+	char szCommand[MAX_STRING] = { 0 };
+	GetArg(szCommand, szStart, 1);
+
+	command = szCommand;
+	commandEndsInReplacement = szStart[command.size()] != 0;
+}
+
+const char* MQCommandAPI::RegisteredAlias::GetExpandedCommand(const char* szLine) const
+{
+	if (command.empty() || strlen(szLine) < match.size())
+		return nullptr;
+
+	// The rest of the line is appended to the replacement, so unless the command ends before that,
+	// it only ends there if the rest starts with a separator.
+	const char next = szLine[match.size()];
+	if (!commandEndsInReplacement && next != 0 && next != ' ' && next != '\t')
+		return nullptr;
+
+	return command.c_str();
 }
 
-// better single write them instead...
 void MQCommandAPI::WriteAliasToIni(const RegisteredAlias& alias)
 {
-	WritePrivateProfileString("Aliases", alias.match, alias.replacement, mq::internal_paths::MQini);
+	m_pendingAliasWrites[alias.match] = alias.replacement;
+}
+
+void MQCommandAPI::DeleteAliasFromIni(const std::string& match)
+{
+	m_pendingAliasWrites[match] = std::nullopt;
+}
+
+void MQCommandAPI::FlushAliases()
+{
+	if (m_pendingAliasWrites.empty())
+		return;
+
+	ScopedPrivateProfileBatch batch(mq::internal_paths::MQini);
+
+	for (const auto& [match, replacement] : m_pendingAliasWrites)
+	{
+		if (replacement)
+			WritePrivateProfileString("Aliases", match, *replacement, mq::internal_paths::MQini);
+		else
+			DeletePrivateProfileKey("Aliases", match, mq::internal_paths::MQini);
+	}
+
+	m_pendingAliasWrites.clear();
 }
 
 // this function is SUPER expensive, DO NOT use it unless you absolutely have to.
 void MQCommandAPI::RewriteAliases()
 {
+	m_pendingAliasWrites.clear();
+
+	ScopedPrivateProfileBatch batch(mq::internal_paths::MQini);
 	WritePrivateProfileSection("Aliases", "", mq::internal_paths::MQini);
 
 	for (const auto& [_, alias] : m_aliases)
 	{
-		WriteAliasToIni(alias);
+		WritePrivateProfileString("Aliases", alias.match, alias.replacement, mq::internal_paths::MQini);
 	}
 }
 
@@ -847,15 +1268,25 @@ void MQCommandAPI::LoadAliases()
 		AddAlias(match, replacement, false);
 	}
 
-	std::vector<std::string> aliases = GetPrivateProfileKeys<MAX_STRING * 10>("Aliases", mq::internal_paths::MQini);
+	// Changes that weren't written yet would be lost otherwise.
+	FlushAliases();
 
-	// Now, import the user's alias list, their modifications override existing.
-	for (const std::string& alias : aliases)
+	// Now, import the user's alias list, their modifications override existing. The section is read
+	// at once, and its lines parsed the way the ini functions parse them.
+	std::vector<std::pair<std::string, std::string>> aliases =
+		GetPrivateProfileKeyValues<MAX_STRING * 32>("Aliases", mq::internal_paths::MQini);
+
+	for (auto& [alias, value] : aliases)
 	{
-		std::string value = GetPrivateProfileString("Aliases", alias, std::string(), mq::internal_paths::MQini);
-		if (!value.empty())
+		trim(alias);
+		trim(value);
+
+		if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+			value = value.substr(1, value.size() - 2);
+
+		if (!alias.empty() && !value.empty())
 		{
-			AddAlias(alias.c_str(), value.c_str(), false);
+			AddAlias(alias, value, false);
 		}
 	}
 }
@@ -865,7 +1296,9 @@ void MQCommandAPI::LoadAliases()
 
 void MQCommandAPI::PulseCommands()
 {
-	if (m_delayedCommands.empty() && !m_pTimedCommands)
+	FlushAliases();
+
+	if (m_delayedCommands.empty() && m_timedCommands.IsEmpty())
 	{
 		return;
 	}
@@ -889,14 +1322,11 @@ void MQCommandAPI::PulseCommands()
 	// handle timed commands
 	uint64_t Now = MQGetTickCount64();
 
-	while (m_pTimedCommands && m_pTimedCommands->time <= Now)
-	{
-		MQTimedCommand* pNext = m_pTimedCommands->pNext;
-		DoCommand(m_pTimedCommands->command.c_str(), false, m_pTimedCommands->pluginHandle);
-
-		delete m_pTimedCommands;
-		m_pTimedCommands = pNext;
-	}
+	m_timedCommands.Advance(Now, [this](MQTimerWheelNode* node)
+		{
+			std::unique_ptr<MQTimedCommand> pTimedCommand(static_cast<MQTimedCommand*>(node));
+			DoCommand(pTimedCommand->command.c_str(), false, pTimedCommand->pluginHandle);
+		});
 }
 
 void MQCommandAPI::TimedCommand(const char* command, int msDelay, const MQPluginHandle& pluginHandle /* = mqplugin::ThisPluginHandle */)
@@ -904,36 +1334,16 @@ void MQCommandAPI::TimedCommand(const char* command, int msDelay, const MQPlugin
 	std::scoped_lock lock(m_commandMutex);
 
 	MQTimedCommand* pNew = new MQTimedCommand;
-	pNew->time = msDelay + MQGetTickCount64();
 	pNew->command = command;
 	pNew->pluginHandle = pluginHandle;
 
-	// insert into list
-	if (!m_pTimedCommands || m_pTimedCommands->time >= pNew->time)
-	{
-		pNew->pNext = m_pTimedCommands;
-		pNew->pLast = nullptr;
-		m_pTimedCommands = pNew;
-		return;
-	}
-
-	MQTimedCommand* pLast = m_pTimedCommands;
-	MQTimedCommand* pNode = m_pTimedCommands->pNext;
+	const uint64_t now = MQGetTickCount64();
 
-	while (pNode)
-	{
-		if (pNew->time <= pNode->time)
-		{
-			break;
-		}
-
-		pLast = pNode;
-		pNode = pNode->pNext;
-	}
+	// The wheel isn't advanced while it is empty. Catch it up first, which is free when it's empty.
+	if (m_timedCommands.IsEmpty())
+		m_timedCommands.Advance(now, [](MQTimerWheelNode*) {});
 
-	pLast->pNext = pNew;
-	pNew->pLast = pLast;
-	pNew->pNext = pNode;
+	m_timedCommands.Schedule(pNew, now + msDelay);
 }
 
 //============================================================================
@@ -1035,6 +1445,7 @@ void MQCommandAPI::Cmd_Alias(const char* szLine)
 	if (ci_equals(szName, "reload"))
 	{
 		m_aliases.clear();
+		++m_commandGeneration;
 
 		LoadAliases();
 		WriteChatf("%d aliases loaded.", m_aliases.size());
@@ -1090,6 +1501,11 @@ void DoCommand(const char* szLine, bool delayed)
 	pCommandAPI->DoCommand(szLine, delayed);
 }
 
+void DoCommand(MQCompiledCommand& command)
+{
+	pCommandAPI->DoCompiledCommand(command);
+}
+
 void DoCommandf(const char* szFormat, ...)
 {
 	va_list vaList;
@@ -21,8 +21,12 @@
 #include "mq/base/PluginHandle.h"
 #include "mq/base/String.h"
 #include "mq/api/CommandAPI.h"
+#include "MQTimerWheel.h"
 
 #include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace mq {
 
@@ -30,6 +34,7 @@ namespace mq {
 
 struct MQTimedCommand;
 struct MQCommand;
+struct MQMacroLine;
 struct MQPlugin;
 
 class MQCommandAPI
@@ -53,9 +58,20 @@ public:
 	void TimedCommand(const char* command, int msDelay,
 		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 
+	// Execute a line of the running macro immediately. The handler is resolved once and cached
+	// on the line, so that repeated executions skip the alias and command lookups.
+	void DoMacroLine(MQMacroLine& line);
+
+	// Execute a compiled command immediately, resolving it again first if it is out of date.
+	void DoCompiledCommand(MQCompiledCommand& command,
+		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+
 	bool IsCommand(std::string_view command) const;
 	MQCommand* FindCommand(std::string_view command) const;
 
+	// Names of the commands and aliases that start with prefix, in case-insensitive order.
+	std::vector<std::string> GetCompletions(std::string_view prefix) const;
+
 	// Aliases
 	bool AddAlias(const std::string& shortCommand, const std::string& longCommand,
 		bool writeToIni, const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
@@ -75,7 +91,13 @@ private:
 	void LoadAliases();
 	void RewriteAliases();
 
+	// Alias changes are written to the ini file once per pulse rather than one at a time.
+	void FlushAliases();
+
 	bool DispatchCommand(char* szCommand, char* szArgs, const MQCommandHandler& eqHandler);
+	MQCommand* FindDispatchCommand(const char* szCommand) const;
+	MQCommand* ResolveMacroLine(const MQMacroLine& line) const;
+	void ResolveCompiledCommand(MQCompiledCommand& command) const;
 	bool DispatchBind(char* szCommand, char* szArgs);
 
 	struct RegisteredAlias
@@ -83,16 +105,49 @@ private:
 		std::string match;
 		std::string replacement;
 
+		// The command that the replacement starts with, so that expanding the alias doesn't need to
+		// parse the line again. Empty if it has to be parsed, because the replacement has quotes.
+		std::string command;
+		bool commandEndsInReplacement = false;
+
 		const MQPluginHandle& pluginHandle;
 
-		RegisteredAlias(std::string match, std::string replacement, const MQPluginHandle& pluginHandle)
-			: match(std::move(match)), replacement(std::move(replacement)), pluginHandle(std::move(pluginHandle)) {}
+		RegisteredAlias(std::string match, std::string replacement, const MQPluginHandle& pluginHandle);
+
+		// The first argument of the line after expanding this alias on it, if it is known without
+		// parsing the expanded line.
+		const char* GetExpandedCommand(const char* szLine) const;
 	};
 
-	static void WriteAliasToIni(const RegisteredAlias& alias);
+	void WriteAliasToIni(const RegisteredAlias& alias);
+	void DeleteAliasFromIni(const std::string& match);
+
+	const RegisteredAlias* FindAlias(std::string_view name) const;
+
+	// Commands and aliases indexed by their lower case names, so that a lookup takes time in the
+	// length of the name rather than in the number of commands. The children of a node are
+	// stored next to each other, sorted by character.
+	struct CommandTrieNode
+	{
+		uint32_t firstChild = 0;
+		uint16_t childCount = 0;
+		char ch = 0;
+
+		MQCommand* command = nullptr;               // first command with exactly this name
+		MQCommand* firstCommand = nullptr;          // first command in list order starting with this name
+		MQCommand* firstAnyStateCommand = nullptr;  // same, skipping the commands that are in game only
+		const RegisteredAlias* alias = nullptr;
+	};
+
+	// Rebuilds the trie on the first lookup after a command or alias was added or removed.
+	const CommandTrieNode* FindTrieNode(std::string_view name) const;
+	void RebuildCommandTrie() const;
 
 	mq::ci_unordered::map<std::string, RegisteredAlias> m_aliases;
 
+	// Alias values waiting to be written by FlushAliases, none for the ones to delete.
+	mq::ci_unordered::map<std::string, std::optional<std::string>> m_pendingAliasWrites;
+
 	struct DelayedCommand
 	{
 		std::string command;
@@ -104,7 +159,14 @@ private:
 	std::vector<DelayedCommand> m_delayedCommands;
 
 	MQCommand* m_pCommands = nullptr;
-	MQTimedCommand* m_pTimedCommands = nullptr;
+	MQTimerWheel m_timedCommands;               // MQTimedCommand, in milliseconds
+
+	// Incremented whenever a command or alias is added or removed, so that macro lines know to
+	// resolve their handler again.
+	uint32_t m_commandGeneration = 1;
+
+	mutable std::vector<CommandTrieNode> m_commandTrie;
+	mutable uint32_t m_commandTrieGeneration = 0;
 
 	std::recursive_mutex m_commandMutex;
 };
@@ -15,6 +15,7 @@
 #include "pch.h"
 #include "MQ2Main.h"
 
+#include "MQAdvLoot.h"
 #include "MQCommandAPI.h"
 #include "MQDataAPI.h"
 #include "MQPostOffice.h"
@@ -437,6 +438,32 @@ void SquelchCommand(PlayerClient*, const char* szLine)
 	gFilterMQ = Temp;
 }
 
+// ***************************************************************************
+// Function:    ReadinessCmd
+// Description: Our '/readiness' command
+//              Chooses between reading spell gem and ability readiness once per
+//              frame, or every time it is asked for
+// Usage:       /readiness [snapshot|fresh]
+// ***************************************************************************
+void ReadinessCmd(PlayerClient*, const char* szLine)
+{
+	if (ci_equals(szLine, "snapshot"))
+	{
+		gbReadinessSnapshot = true;
+	}
+	else if (ci_equals(szLine, "fresh"))
+	{
+		gbReadinessSnapshot = false;
+	}
+	else if (szLine[0])
+	{
+		SyntaxError("Usage: /readiness [snapshot|fresh]");
+		return;
+	}
+
+	WriteChatf("Readiness is read %s.", gbReadinessSnapshot ? "once per frame" : "every time it is asked for");
+}
+
 // ***************************************************************************
 // Function:    Items
 // Description: Our '/items' command
@@ -1386,6 +1413,8 @@ void Filter(PlayerClient* pChar, const char* szLine)
 						}
 					}
 
+					InvalidateChatFilters();
+
 					WriteChatColor("Cleared all name filters.");
 					WriteFilterNames();
 					return;
@@ -1408,6 +1437,7 @@ void Filter(PlayerClient* pChar, const char* szLine)
 						}
 
 						delete pFilter;
+						InvalidateChatFilters();
 
 						WriteChatf("Stopped filtering on: %s", szRest);
 						WriteFilterNames();
@@ -1798,6 +1828,7 @@ bool CMQ2Alerts::RemoveAlertFromList(uint32_t Id, MQSpawnSearch* pSearchSpawn)
 			if (SearchSpawnMatchesSearchSpawn(pSearch, pSearchSpawn))
 			{
 				alertMap.erase(iter);
+				UpdateCompiledAlert(Id);
 				return true;
 			}
 		}
@@ -1825,6 +1856,7 @@ bool CMQ2Alerts::AddNewAlertList(uint32_t Id, MQSpawnSearch* pSearchSpawn)
 	}
 
 	m_alertMap[Id].push_back(*pSearchSpawn);
+	UpdateCompiledAlert(Id);
 	return true;
 }
 
@@ -1838,6 +1870,7 @@ void CMQ2Alerts::FreeAlerts(uint32_t id)
 	if (alertIter != m_alertMap.end())
 	{
 		m_alertMap.erase(alertIter);
+		UpdateCompiledAlert(id);
 		WriteChatf("Alert list %d cleared.", id);
 	}
 	else
@@ -1860,6 +1893,104 @@ bool CMQ2Alerts::GetAlert(uint32_t id, std::vector<MQSpawnSearch>& ss)
 	return false;
 }
 
+// The spawn id is checked before the predicate runs, so the predicate leaves it out.
+static MQSpawnSearch WithoutSpawnID(MQSpawnSearch search)
+{
+	search.bSpawnID = false;
+	return search;
+}
+
+MQCompiledAlertList::Entry::Entry(const MQSpawnSearch& search_)
+	: search(WithoutSpawnID(search_))
+	, spawnID(search_.SpawnID)
+	, predicate(search)
+{
+}
+
+bool MQCompiledAlertList::Matches(SPAWNINFO* pChar, SPAWNINFO* pSpawn) const
+{
+	// if any of the searches matches, it's true. This is an implied logical or
+	for (const auto& entry : entries)
+	{
+		if (entry->spawnID > 0 && entry->spawnID != pSpawn->SpawnID)
+			continue;
+
+		if (entry->predicate.Matches(pChar, pSpawn))
+			return true;
+	}
+
+	return false;
+}
+
+// Called with the lock held, after the alert list changed.
+void CMQ2Alerts::UpdateCompiledAlert(uint32_t id)
+{
+	++m_generation;
+
+	auto alertIter = m_alertMap.find(id);
+	if (alertIter == m_alertMap.end())
+	{
+		m_compiledMap.erase(id);
+		return;
+	}
+
+	auto compiled = std::make_shared<MQCompiledAlertList>();
+	compiled->entries.reserve(alertIter->second.size());
+
+	for (const MQSpawnSearch& search : alertIter->second)
+		compiled->entries.push_back(std::make_unique<MQCompiledAlertList::Entry>(search));
+
+	m_compiledMap[id] = std::move(compiled);
+}
+
+std::shared_ptr<const MQCompiledAlertList> CMQ2Alerts::GetCompiledAlert(uint32_t id) const
+{
+	std::scoped_lock lock(m_mutex);
+
+	auto compiledIter = m_compiledMap.find(id);
+	if (compiledIter != m_compiledMap.end())
+		return compiledIter->second;
+
+	return nullptr;
+}
+
+bool CMQ2Alerts::SpawnMatchesAlert(SPAWNINFO* pChar, SPAWNINFO* pSpawn, uint32_t id)
+{
+	if (pChar == nullptr || pSpawn == nullptr)
+		return false;
+
+	// The lock isn't held while matching: a search can refer to other alert lists.
+	std::shared_ptr<const MQCompiledAlertList> compiled = GetCompiledAlert(id);
+	if (!compiled)
+		return false;
+
+	if (!IsMainThread())
+		return compiled->Matches(pChar, pSpawn);
+
+	if (m_matchCacheGeneration != m_generation || m_matchCacheChar != pChar)
+	{
+		m_matchCache.clear();
+		m_matchCacheGeneration = m_generation;
+		m_matchCacheChar = pChar;
+	}
+
+	const uint64_t key = (static_cast<uint64_t>(id) << 32) | pSpawn->SpawnID;
+
+	auto matchIter = m_matchCache.find(key);
+	if (matchIter != m_matchCache.end())
+		return matchIter->second;
+
+	// Matching can add to the cache, so the iterator can't be reused.
+	const bool matches = compiled->Matches(pChar, pSpawn);
+	m_matchCache[key] = matches;
+	return matches;
+}
+
+void CMQ2Alerts::ClearMatchCache()
+{
+	m_matchCache.clear();
+}
+
 size_t CMQ2Alerts::GetCount(uint32_t id) const
 {
 	std::scoped_lock lock(m_mutex);
@@ -4287,23 +4418,10 @@ void AltAbility(PlayerClient* pChar, const char* szLine)
 	}
 	else if (!_stricmp(szCommand, "act"))
 	{
-		// we want to get the rank thats for our level here
-		int level = pLocalPlayer->Level;
-
-		// only search through the ones we have...
-		for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+		// only search through the ones we have, ranked for our level
+		if (CAltAbilityData* pAbility = GetOwnedAAByName(szName))
 		{
-			if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility), level))
-			{
-				if (const char* pName = pCDBStr->GetString(pAbility->nName, eAltAbilityName))
-				{
-					if (!_stricmp(szName, pName))
-					{
-						DoCommandf("/alt act %d", pAbility->ID);
-						break;
-					}
-				}
-			}
+			DoCommandf("/alt act %d", pAbility->ID);
 		}
 	}
 	else
@@ -4589,22 +4707,9 @@ void AdvLootCmd(PlayerClient* pChar, const char* szLine)
 					else
 					{
 						// if its not a number its a itemname
-						// need to roll through the list to get the index
-						if (pAdvancedLootWnd->pPLootList)
+						if (const AdvLootListModel* model = AdvLoot_GetList(AdvLootList::Personal))
 						{
-							for (int k = 0; k < pPersonalList->ItemsArray.Count; k++)
-							{
-								int listindex = (int)pPersonalList->GetItemData(k);
-								if (listindex != -1)
-								{
-									AdvancedLootItem& item = pAdvancedLootWnd->pPLootList->Items[listindex];
-									if (!_stricmp(item.Name, szID))
-									{
-										index = k;
-										break;
-									}
-								}
-							}
+							index = model->FindRowByName(szID);
 						}
 					}
 
@@ -4714,22 +4819,9 @@ void AdvLootCmd(PlayerClient* pChar, const char* szLine)
 				else
 				{
 					// if its not a number its a itemname
-					// need to roll through the list to get the index
-					if (pSharedList)
+					if (const AdvLootListModel* model = AdvLoot_GetList(AdvLootList::Shared))
 					{
-						for (int k = 0; k < pSharedList->ItemsArray.Count; k++)
-						{
-							int listindex = (int)pSharedList->GetItemData(k);
-							if (listindex != -1)
-							{
-								AdvancedLootItem& item = pAdvancedLootWnd->pCLootList->Items[listindex];
-								if (!_stricmp(item.Name, szID))
-								{
-									index = k;
-									break;
-								}
-							}
-						}
+						index = model->FindRowByName(szID);
 					}
 				}
 
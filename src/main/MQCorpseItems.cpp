@@ -0,0 +1,173 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQCorpseItems.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace mq {
+
+// A snapshot of the items on the open corpse. Looting macros ask for the same items by name over
+// and over while they loot, and every question used to search the loot window. The snapshot is
+// taken the first time it is needed for a corpse, and is taken again when the number of items
+// changed. Lookups check that the slot they found still holds the same item.
+struct CorpseItemSnapshot
+{
+	bool valid = false;
+	PlayerClient* corpse = nullptr;
+	int count = 0;
+	std::vector<ItemPtr> items;                            // by loot slot, empty slots are null
+	std::vector<std::string> lowerNames;
+	std::unordered_map<std::string, int> nameToSlot;       // the first slot with each lower case name
+	std::unordered_map<int, int> idToSlot;                 // the first slot with each id
+};
+
+static CorpseItemSnapshot s_corpseItems;
+
+void InvalidateCorpseItems()
+{
+	s_corpseItems.valid = false;
+	s_corpseItems.items.clear();
+}
+
+static CorpseItemSnapshot* GetCorpseItemSnapshot()
+{
+	if (!pLootWnd || !pActiveCorpse)
+		return nullptr;
+
+	CorpseItemSnapshot& snapshot = s_corpseItems;
+
+	ItemContainer& container = pLootWnd->GetLootItems();
+	const int count = container.GetCount();
+	if (snapshot.valid && snapshot.corpse == pActiveCorpse && snapshot.count == count)
+		return &snapshot;
+
+	snapshot.valid = true;
+	snapshot.corpse = pActiveCorpse;
+	snapshot.count = count;
+	snapshot.items.clear();
+	snapshot.lowerNames.clear();
+	snapshot.nameToSlot.clear();
+	snapshot.idToSlot.clear();
+
+	const int size = container.GetSize();
+	snapshot.items.reserve(size);
+	snapshot.lowerNames.reserve(size);
+
+	for (int slot = 0; slot < size; ++slot)
+	{
+		ItemPtr pItem = pLootWnd->GetLootItem(slot);
+
+		snapshot.lowerNames.push_back(pItem ? to_lower_copy(pItem->GetName()) : std::string());
+		if (pItem)
+		{
+			snapshot.nameToSlot.emplace(snapshot.lowerNames.back(), slot);
+			snapshot.idToSlot.emplace(pItem->GetID(), slot);
+		}
+
+		snapshot.items.push_back(std::move(pItem));
+	}
+
+	return &snapshot;
+}
+
+static bool IsCorpseItemCurrent(const CorpseItemSnapshot& snapshot, int slot)
+{
+	return pLootWnd->GetLootItem(slot).get() == snapshot.items[slot].get();
+}
+
+static int FindCorpseItem(const CorpseItemSnapshot& snapshot, const std::string& lowerName, bool exact)
+{
+	auto iter = snapshot.nameToSlot.find(lowerName);
+	const int match = iter != snapshot.nameToSlot.end() ? iter->second : -1;
+
+	if (exact || lowerName.empty())
+		return match;
+
+	// The first item that contains the name wins, and an item with the whole name contains it, so
+	// only the slots before that one need to be looked at.
+	const int end = match != -1 ? match : static_cast<int>(snapshot.lowerNames.size());
+	for (int slot = 0; slot < end; ++slot)
+	{
+		if (snapshot.items[slot] && snapshot.lowerNames[slot].find(lowerName) != std::string::npos)
+			return slot;
+	}
+
+	return match;
+}
+
+int GetCorpseItemSlotByName(std::string_view name, bool exact)
+{
+	const std::string lowerName = to_lower_copy(name);
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		const CorpseItemSnapshot* snapshot = GetCorpseItemSnapshot();
+		if (!snapshot)
+			return -1;
+
+		const int found = FindCorpseItem(*snapshot, lowerName, exact);
+		if (found == -1 || IsCorpseItemCurrent(*snapshot, found))
+			return found;
+
+		InvalidateCorpseItems();
+	}
+
+	return -1;
+}
+
+int GetCorpseItemSlotByID(int itemID)
+{
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		const CorpseItemSnapshot* snapshot = GetCorpseItemSnapshot();
+		if (!snapshot)
+			return -1;
+
+		auto iter = snapshot->idToSlot.find(itemID);
+		if (iter == snapshot->idToSlot.end())
+			return -1;
+
+		if (IsCorpseItemCurrent(*snapshot, iter->second))
+			return iter->second;
+
+		InvalidateCorpseItems();
+	}
+
+	return -1;
+}
+
+std::vector<int> FindCorpseItems(const std::function<bool(const ItemPtr&)>& predicate)
+{
+	std::vector<int> slots;
+
+	const CorpseItemSnapshot* snapshot = GetCorpseItemSnapshot();
+	if (!snapshot)
+		return slots;
+
+	// One pass over the snapshot answers the whole question, instead of a lookup for every item.
+	for (int slot = 0; slot < static_cast<int>(snapshot->items.size()); ++slot)
+	{
+		const ItemPtr& pItem = snapshot->items[slot];
+		if (pItem && predicate(pItem))
+			slots.push_back(slot);
+	}
+
+	return slots;
+}
+
+} // namespace mq
@@ -17,9 +17,12 @@
 
 #include "MQCommandAPI.h"
 #include "MQDataAPI.h"
+#include "MQMacroProfiler.h"
+#include "MQSlowExpressions.h"
 
 #include "CrashHandler.h"
 #include "mq/base/ScopeExit.h"
+#include "mq/base/TransientArena.h"
 
 namespace mq {
 
@@ -119,6 +122,10 @@ void UnloadPluginDataAPI(const char* Name)
 	// is unloaded, we get a crash. Force a pruning every time a plugin
 	// is unloaded to prevent that.
 	PruneObservedEQObjects();
+
+	// Compiled data portions may reference TLOs and types that were owned by the plugin.
+	if (pDataAPI)
+		pDataAPI->ClearCompiledDataCache();
 }
 
 //============================================================================
@@ -152,7 +159,11 @@ bool MQDataAPI::IsReservedName(const std::string& name) const
 {
 	std::scoped_lock lock(m_mutex);
 
-	return m_tloMap.find(name) != end(m_tloMap) || m_dataTypeMap.find(name) != end(m_dataTypeMap);
+	Atom atom = Atom::Find(name);
+	if (!atom)
+		return false;
+
+	return m_tloMap.find(atom) != end(m_tloMap) || m_dataTypeMap.find(atom) != end(m_dataTypeMap);
 }
 
 bool MQDataAPI::AddDataType(MQ2Type& Type, const MQPluginHandle& pluginHandle)
@@ -167,7 +178,10 @@ bool MQDataAPI::AddDataType(MQ2Type& Type, const MQPluginHandle& pluginHandle)
 	// this will not replace existing elements.
 	TypeRec rec = { &Type, pluginHandle };
 
-	auto result = m_dataTypeMap.emplace(Type.GetName(), rec);
+	auto result = m_dataTypeMap.emplace(Atom(Type.GetName()), rec);
+	if (result.second)
+		++m_dataGeneration;
+
 	return result.second;
 }
 
@@ -181,7 +195,7 @@ bool MQDataAPI::RemoveDataType(MQ2Type& Type, const MQPluginHandle& pluginHandle
 	if (!thetypename)
 		return false;
 
-	auto iter = m_dataTypeMap.find(thetypename);
+	auto iter = m_dataTypeMap.find(Atom::Find(thetypename));
 	if (iter == m_dataTypeMap.end())
 		return false;
 
@@ -189,6 +203,7 @@ bool MQDataAPI::RemoveDataType(MQ2Type& Type, const MQPluginHandle& pluginHandle
 
 	// The type existed. Erase it.
 	m_dataTypeMap.erase(iter);
+	++m_dataGeneration;
 	return true;
 }
 
@@ -196,7 +211,7 @@ MQ2Type* MQDataAPI::FindDataType(const char* Name) const
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = m_dataTypeMap.find(Name);
+	auto iter = m_dataTypeMap.find(Atom::Find(Name));
 	if (iter == m_dataTypeMap.end())
 		return nullptr;
 
@@ -210,7 +225,7 @@ bool MQDataAPI::AddTopLevelObject(const char* szName, MQTopLevelObjectFunction F
 
 	// check if the item exists first, so we don't construct
 	// something we don't actually need.
-	if (m_tloMap.find(szName) != m_tloMap.end())
+	if (m_tloMap.find(Atom::Find(szName)) != m_tloMap.end())
 	{
 		// TODO Logging: Report reason for failure
 		return false;
@@ -227,7 +242,8 @@ bool MQDataAPI::AddTopLevelObject(const char* szName, MQTopLevelObjectFunction F
 	TLORec rec = { std::move(newItem), pluginHandle };
 
 	// put the new item into the map
-	m_tloMap.emplace(szName, std::move(rec));
+	m_tloMap.emplace(Atom(szName), std::move(rec));
+	++m_dataGeneration;
 	return true;
 }
 
@@ -235,7 +251,7 @@ bool MQDataAPI::RemoveTopLevelObject(const char* szName, const MQPluginHandle& p
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = m_tloMap.find(szName);
+	auto iter = m_tloMap.find(Atom::Find(szName));
 	if (iter == m_tloMap.end())
 		return false;
 
@@ -250,6 +266,7 @@ bool MQDataAPI::RemoveTopLevelObject(const char* szName, const MQPluginHandle& p
 	}
 
 	m_tloMap.erase(iter);
+	++m_dataGeneration;
 	return true;
 }
 
@@ -257,16 +274,30 @@ MQTopLevelObject* MQDataAPI::FindTopLevelObject(const char* szName) const
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = m_tloMap.find(szName);
+	auto iter = m_tloMap.find(Atom::Find(szName));
 	if (iter == m_tloMap.end())
 		return nullptr;
 
 	return iter->second.tlo.get();
 }
 
+bool MQDataAPI::SetTopLevelObjectPurity(const char* szName, MQDataPurity purity)
+{
+	std::scoped_lock lock(m_mutex);
+
+	auto iter = m_tloMap.find(Atom::Find(szName));
+	if (iter == m_tloMap.end())
+		return false;
+
+	iter->second.tlo->Purity = purity;
+	++m_dataGeneration;
+	return true;
+}
 
 bool MQDataAPI::AddTypeExtension(const char* szName, MQ2Type* extension, const MQPluginHandle& pluginHandle)
 {
+	std::scoped_lock lock(m_mutex);
+
 	// get the extension record for this type name
 	auto& record = m_typeExtensions[szName];
 
@@ -281,11 +312,14 @@ bool MQDataAPI::AddTypeExtension(const char* szName, MQ2Type* extension, const M
 
 	// insert extension into the record
 	record.push_back(rec);
+	++m_dataGeneration;
 	return true;
 }
 
 bool MQDataAPI::RemoveTypeExtension(const char* szName, MQ2Type* extension, const MQPluginHandle& pluginHandle)
 {
+	std::scoped_lock lock(m_mutex);
+
 	// check if we have a record for this type name
 	auto iter = m_typeExtensions.find(szName);
 	if (iter == m_typeExtensions.end())
@@ -309,9 +343,117 @@ bool MQDataAPI::RemoveTypeExtension(const char* szName, MQ2Type* extension, cons
 	if (record.empty())
 		m_typeExtensions.erase(iter);
 
+	++m_dataGeneration;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+int MQDataAPI::AddObserver(std::vector<std::string> strings, MQMacroDataObserverCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	if (strings.empty() || !callback)
+		return 0;
+
+	const int observerId = m_nextObserverId++;
+
+	ObserverRec& rec = m_observers[observerId];
+	rec.strings = std::move(strings);
+	rec.callback = std::move(callback);
+	rec.owner = pluginHandle;
+
+	return observerId;
+}
+
+bool MQDataAPI::RemoveObserver(int observerId, const MQPluginHandle& pluginHandle)
+{
+	auto iter = m_observers.find(observerId);
+	if (iter == m_observers.end())
+		return false;
+
+	if (iter->second.owner != pluginHandle)
+		return false;
+
+	m_observers.erase(iter);
 	return true;
 }
 
+void MQDataAPI::OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle)
+{
+	// Remove any observers that were left behind by this plugin.
+	for (auto iter = m_observers.begin(); iter != m_observers.end();)
+	{
+		if (iter->second.owner == pluginHandle)
+		{
+			DebugSpew("Removing macro data observer left behind by %s", plugin->name.c_str());
+			iter = m_observers.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+void MQDataAPI::UpdateObservers()
+{
+	if (m_observers.empty())
+		return;
+
+	// Observers tend to watch the same things, so each distinct string is only parsed once.
+	std::unordered_map<std::string_view, std::string> parsed;
+	char szBuffer[MAX_STRING];
+
+	std::vector<std::pair<int, std::vector<MQMacroDataChange>>> pending;
+
+	for (auto& [observerId, rec] : m_observers)
+	{
+		const bool first = rec.values.empty();
+		if (first)
+			rec.values.resize(rec.strings.size());
+
+		std::vector<MQMacroDataChange> changes;
+
+		for (size_t index = 0; index < rec.strings.size(); ++index)
+		{
+			const std::string& str = rec.strings[index];
+
+			auto [iter, inserted] = parsed.try_emplace(str);
+			if (inserted)
+			{
+				const size_t length = std::min<size_t>(str.length(), MAX_STRING - 1);
+				memcpy(szBuffer, str.data(), length);
+				szBuffer[length] = 0;
+
+				ParseMacroData(szBuffer, MAX_STRING);
+				iter->second = szBuffer;
+			}
+
+			if (first || rec.values[index] != iter->second)
+			{
+				rec.values[index] = iter->second;
+				changes.push_back({ index, iter->second });
+			}
+		}
+
+		if (!changes.empty())
+			pending.emplace_back(observerId, std::move(changes));
+	}
+
+	// Callbacks run after the pass, and may add or remove observers.
+	for (auto& [observerId, changes] : pending)
+	{
+		auto iter = m_observers.find(observerId);
+		if (iter == m_observers.end())
+			continue;
+
+		MQMacroDataObserverCallback callback = iter->second.callback;
+		callback(changes);
+	}
+}
+
+//----------------------------------------------------------------------------
+
 bool MQDataAPI::FindMacroDataMember(MQ2Type* Type, const std::string& strMember) const
 {
 	// search for extensions on this type
@@ -347,6 +489,34 @@ bool MQDataAPI::FindMacroDataMember(MQ2Type* Type, const std::string& strMember)
 }
 
 // -1 = no exists, 0 = fail, 1 = success
+// Evaluates a member, and reports it if it was slow while slow expression detection is on, or adds
+// it to the member trace of the expression evaluator. The index is copied first, since some members
+// modify it.
+template <typename MemberT>
+static bool GetMemberChecked(MQ2Type* type, MQVarPtr&& VarPtr, const MemberT& Member, const char* name,
+	char* pIndex, MQTypeVar& Result)
+{
+	if (!gbSlowExpressions && !SlowExpressions_IsTracingMembers())
+		return type->GetMember(std::move(VarPtr), Member, pIndex, Result);
+
+	const std::string index = pIndex && gbSlowExpressions ? pIndex : "";
+	const auto start = std::chrono::steady_clock::now();
+
+	const bool result = type->GetMember(std::move(VarPtr), Member, pIndex, Result);
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	SlowExpressions_TraceMember(type->GetName(), name, elapsed);
+
+	if (gbSlowExpressions && elapsed >= std::chrono::microseconds(gSlowExpressionThreshold))
+	{
+		SlowExpressions_Check(MQSlowExpressionKind::Member, index.empty()
+			? fmt::format("{}.{}", type->GetName(), name)
+			: fmt::format("{}.{}[{}]", type->GetName(), name, index), start);
+	}
+
+	return result;
+}
+
 MQDataAPI::EvaluateResult MQDataAPI::EvaluateMacroDataMember(MQ2Type* type, MQVarPtr& VarPtr,
 	MQTypeVar& Result, const std::string& Member, char* pIndex, bool checkFirst) const
 {
@@ -377,11 +547,11 @@ MQDataAPI::EvaluateResult MQDataAPI::EvaluateMacroDataMember(MQ2Type* type, MQVa
 			return EvaluateResult::NotFound;
 		}
 
-		return type->GetMember(std::move(VarPtr), Member.c_str(), pIndex, Result)
+		return GetMemberChecked(type, std::move(VarPtr), Member.c_str(), Member.c_str(), pIndex, Result)
 			? EvaluateResult::Success : EvaluateResult::Failure;
 	}
 
-	if (type->GetMember(std::move(VarPtr), Member.c_str(), pIndex, Result))
+	if (GetMemberChecked(type, std::move(VarPtr), Member.c_str(), Member.c_str(), pIndex, Result))
 	{
 		return EvaluateResult::Success;
 	}
@@ -394,11 +564,34 @@ MQDataAPI::EvaluateResult MQDataAPI::EvaluateMacroDataMember(MQ2Type* type, MQVa
 	return EvaluateResult::Failure;
 }
 
+MQMemberHandle MQDataAPI::ResolveMemberHandle(MQ2Type* type, const char* Member) const
+{
+	{
+		std::scoped_lock lock(m_mutex);
+
+		if (m_typeExtensions.find(type->GetName()) != m_typeExtensions.end())
+			return MQMemberHandle();
+	}
+
+	return type->GetMemberHandle(Member);
+}
+
+MQDataAPI::EvaluateResult MQDataAPI::EvaluateMacroDataMember(MQ2Type* type, MQVarPtr& VarPtr,
+	MQTypeVar& Result, const MQMemberHandle& handle, char* pIndex) const
+{
+	if (!type->IsValidHandle(handle))
+		return EvaluateResult::NotFound;
+
+	// The handle guarantees that the member exists, so there is no need to look it up again on failure.
+	return GetMemberChecked(type, std::move(VarPtr), handle, handle.Member->Name, pIndex, Result)
+		? EvaluateResult::Success : EvaluateResult::Failure;
+}
+
 static void DumpWarning(const char* pStart, int index)
 {
 	if (MQMacroBlockPtr pBlock = GetCurrentMacroBlock())
 	{
-		MQMacroLine& ml = pBlock->Line.at(index);
+		MQMacroLine& ml = pBlock->GetLine(index);
 		bool oldbAllErrorsDumpStack = std::exchange(bAllErrorsDumpStack, false);
 		bool oldbAllErrorsFatal = std::exchange(bAllErrorsFatal, false);
 
@@ -468,27 +661,26 @@ static bool CallFunction(const char* name, const char* args)
 	// In case we're calling from an else, we need to adjust where we are expecting to return to.
 	gMacroStack->pNext->LocationIndex = saved_block_line;
 
-	auto subBlock = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-	++subBlock;
-
-	gMacroBlock->CurrIndex = subBlock->first;
-	while (gMacroBlock && subBlock != gMacroBlock->Line.end())
+	int subIndex = gMacroBlock->CurrIndex + 1;
+	while (gMacroBlock && gMacroBlock->HasLine(subIndex))
 	{
+		gMacroBlock->CurrIndex = subIndex;
 		gMacroStack->LocationIndex = gMacroBlock->CurrIndex;
+		const MQMacroLine& macroLine = gMacroBlock->GetLine(subIndex);
 
 		// TODO: This is where delays are ignored. I'm assuming it was coded that way initially because of the while loop,
 		// but a callback system might be better. For now, just dropping in a warning. This will throw
 		// false positives for /echo /timed and such, but better than the previous no output otherwise.
-		if (ci_starts_with(subBlock->second.Command, "/delay") || ci_find_substr(subBlock->second.Command, "/timed") != -1)
+		if (ci_starts_with(macroLine.Command, "/delay") || ci_find_substr(macroLine.Command, "/timed") != -1)
 		{
 			if (MQMacroBlockPtr pBlock = GetCurrentMacroBlock())
 			{
-				MQMacroLine& ml = pBlock->Line.at(gMacroBlock->CurrIndex);
-				MQMacroLine& ml_saved = saved_block->Line.at(saved_block_line);
+				MQMacroLine& ml = pBlock->GetLine(gMacroBlock->CurrIndex);
+				MQMacroLine& ml_saved = saved_block->GetLine(saved_block_line);
 				WriteChatf("\ayWARNING: Delays in subs called with variable syntax are ignored: (\ao%s\ay) Line \ao%i\ay called (\ao%s\ay) from (\a-o%s\ay) Line \a-o%i\ay (\a-o%s\ay) ", ml.SourceFile.c_str(), ml.LineNumber, ml.Command.c_str(), ml_saved.SourceFile.c_str(), ml_saved.LineNumber, ml_saved.Command.c_str());
 			}
 		}
-		DoCommand(&subBlock->second.Command[0], false);
+		DoCommand(macroLine.Command.c_str(), false);
 
 		if (!gMacroBlock)
 			break;
@@ -498,10 +690,7 @@ static bool CallFunction(const char* name, const char* args)
 			return true; // /return happened
 		}
 
-		subBlock = gMacroBlock->Line.find(gMacroBlock->CurrIndex);
-		++subBlock;
-
-		gMacroBlock->CurrIndex = subBlock->first;
+		subIndex = gMacroBlock->CurrIndex + 1;
 	}
 
 	FatalError("No /return in Subroutine %s", name);
@@ -645,6 +834,8 @@ void MQDataAPI::RegisterTopLevelObjects()
 	AddTopLevelObject("Spawn", datatypes::MQ2SpawnType::dataSpawn);
 	AddTopLevelObject("SpawnCount", datatypes::MQ2SpawnType::dataSpawnCount);
 	AddTopLevelObject("Spell", datatypes::MQ2SpellType::dataSpell);
+	AddTopLevelObject("SpellWithSPA", datatypes::MQ2SpellType::dataSpellWithSPA);
+	AddTopLevelObject("SpellWithSPACount", datatypes::MQ2SpellType::dataSpellWithSPACount);
 	AddTopLevelObject("Switch", datatypes::MQ2SwitchType::dataSwitch);
 	AddTopLevelObject("SwitchTarget", datatypes::MQ2SwitchType::dataSwitchTarget);
 	AddTopLevelObject("Target", datatypes::MQ2TargetType::dataTarget);
@@ -667,9 +858,15 @@ void MQDataAPI::RegisterTopLevelObjects()
 	AddTopLevelObject("ActivatedItem", datatypes::MQ2KeyRingType::dataActivatedItem);
 #endif
 #endif // HAS_KEYRING_WINDOW
+
+	// TLOs whose results can be reused by the parser
+	SetTopLevelObjectPurity("Group", MQDataPurity::PerFrame);
+	SetTopLevelObjectPurity("Me", MQDataPurity::PerFrame);
+	SetTopLevelObjectPurity("Spell", MQDataPurity::PerZone);
+	SetTopLevelObjectPurity("Zone", MQDataPurity::PerZone);
 }
 
-bool MQDataAPI::ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const
+bool MQDataAPI::ParseMQ2DataPortionUncached(char* szOriginal, MQTypeVar& Result) const
 {
 	Result.Type = nullptr;
 	Result.Int64 = 0;
@@ -873,6 +1070,407 @@ bool MQDataAPI::ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const
 	}
 }
 
+//============================================================================
+// Compiled data portions
+
+// Upper bound on the number of distinct data portions kept in the cache. Portions that embed
+// values from inner expansions (e.g. Spawn[1234].Name) are unique per value, so the cache is
+// simply flushed when it fills up.
+static constexpr size_t MAX_COMPILED_DATA_PORTIONS = 4096;
+
+/**
+ * Tokenizes a data portion into a list of steps. This mirrors the state machine in
+ * ParseMQ2DataPortionUncached exactly, but records each evaluation instead of performing it.
+ * Anything that would produce an error or an early exit in the original parser marks the
+ * result as invalid so that those paths keep their existing error reporting.
+ */
+static std::shared_ptr<MQDataAPI::CompiledDataPortion> CompileDataPortion(std::string_view portion)
+{
+	using CompiledDataPortion = MQDataAPI::CompiledDataPortion;
+
+	auto compiled = std::make_shared<CompiledDataPortion>();
+	compiled->source = portion;
+
+	if (portion.empty() || portion.length() >= MAX_STRING)
+		return compiled;
+
+	std::string buffer{ portion };
+	char Index[MAX_STRING] = { 0 };
+
+	char* pPos = &buffer[0];
+	char* pStart = pPos;
+	char* pIndex = &Index[0];
+	bool Quote = false;
+	bool functionAllowed = false;
+
+	auto addEvaluate = [&](bool allowFunction, bool requireType)
+	{
+		CompiledDataPortion::Step& step = compiled->steps.emplace_back();
+		step.kind = CompiledDataPortion::StepKind::Evaluate;
+		step.name = pStart;
+		step.index = pIndex;
+		step.allowFunction = allowFunction;
+		step.requireType = requireType;
+	};
+
+	while (true)
+	{
+		if (*pPos == 0)
+		{
+			if (pStart == pPos)
+				return compiled;
+
+			addEvaluate(functionAllowed, false);
+			compiled->valid = true;
+			return compiled;
+		}
+
+		if (*pPos == '(')
+		{
+			*pPos = 0;
+			if (pStart == pPos)
+				return compiled;
+
+			addEvaluate(false, true);
+
+			++pPos;
+			char* pType = pPos;
+
+			while (*pPos != ')')
+			{
+				if (!*pPos)
+					return compiled;
+				++pPos;
+			}
+
+			*pPos = 0;
+
+			CompiledDataPortion::Step& step = compiled->steps.emplace_back();
+			step.kind = CompiledDataPortion::StepKind::Cast;
+			step.name = pType;
+
+			if (pPos[1] == '.')
+			{
+				++pPos;
+				pStart = &pPos[1];
+			}
+			else if (!pPos[1])
+			{
+				compiled->valid = true;
+				return compiled;
+			}
+			else
+			{
+				return compiled;
+			}
+		}
+		else
+		{
+			if (*pPos == '[')
+			{
+				*pPos = 0;
+				++pPos;
+				functionAllowed = true;
+				Quote = false;
+				bool BeginParam = true;
+
+				while (true)
+				{
+					if (*pPos == 0)
+						return compiled;
+
+					if (BeginParam)
+					{
+						BeginParam = false;
+						if (*pPos == '\"')
+						{
+							Quote = true;
+							++pPos;
+							continue;
+						}
+					}
+
+					if (Quote)
+					{
+						if (*pPos == '\"')
+						{
+							if (pPos[1] == ']' || pPos[1] == ',')
+							{
+								Quote = false;
+								++pPos;
+								continue;
+							}
+						}
+					}
+					else
+					{
+						if (*pPos == ']')
+						{
+							if (pPos[1] == '.' || pPos[1] == '(' || pPos[1] == 0)
+								break;
+						}
+						else if (*pPos == ',')
+							BeginParam = true;
+					}
+
+					*pIndex = *pPos;
+					++pIndex;
+					++pPos;
+				}
+
+				*pIndex = 0;
+				pIndex = &Index[0];
+				*pPos = 0;
+			}
+			else if (*pPos == '.')
+			{
+				*pPos = 0;
+				if (pStart == pPos)
+					return compiled;
+
+				addEvaluate(false, false);
+
+				pStart = &pPos[1];
+				Index[0] = 0;
+			}
+		}
+		++pPos;
+	}
+}
+
+void MQDataAPI::ResolveCompiledDataPortion(const CompiledDataPortion& compiled) const
+{
+	// Must be called with m_mutex held.
+	for (size_t i = 0; i < compiled.steps.size(); ++i)
+	{
+		const CompiledDataPortion::Step& step = compiled.steps[i];
+
+		if (step.kind == CompiledDataPortion::StepKind::Cast)
+		{
+			step.castType = FindDataType(step.name.c_str());
+		}
+		else if (i == 0)
+		{
+			// Only the first step is guaranteed to be a top level lookup. TLOs take priority
+			// over macro variables, so a resolved TLO never needs to be re-checked until the
+			// set of TLOs changes.
+			step.tlo = FindTopLevelObject(step.name.c_str());
+		}
+	}
+
+	compiled.generation = m_dataGeneration;
+}
+
+std::shared_ptr<const MQDataAPI::CompiledDataPortion> MQDataAPI::GetCompiledDataPortion(std::string_view portion) const
+{
+	std::scoped_lock lock(m_mutex);
+
+	auto iter = m_compiledDataCache.find(portion);
+	if (iter == m_compiledDataCache.end())
+	{
+		if (m_compiledDataCache.size() >= MAX_COMPILED_DATA_PORTIONS)
+			m_compiledDataCache.clear();
+
+		std::shared_ptr<CompiledDataPortion> compiled = CompileDataPortion(portion);
+		iter = m_compiledDataCache.emplace(std::string_view{ compiled->source }, std::move(compiled)).first;
+	}
+
+	const std::shared_ptr<CompiledDataPortion>& compiled = iter->second;
+	if (!compiled->valid)
+		return nullptr;
+
+	if (compiled->generation != m_dataGeneration)
+		ResolveCompiledDataPortion(*compiled);
+
+	return compiled;
+}
+
+uint32_t MQDataAPI::GetPurityStamp(MQDataPurity purity) const
+{
+	switch (purity)
+	{
+	case MQDataPurity::PerFrame: return m_frameStamp;
+	case MQDataPurity::PerZone: return m_zoneStamp;
+	case MQDataPurity::Constant: return 1;
+	case MQDataPurity::Volatile:
+	default: return 0;
+	}
+}
+
+bool MQDataAPI::EvaluateCompiledDataPortion(const CompiledDataPortion& compiled, MQTypeVar& Result) const
+{
+	Result.Type = nullptr;
+	Result.Int64 = 0;
+
+	char szIndex[MAX_STRING];
+
+	const bool mainThread = IsMainThread();
+	size_t first = 0;
+
+	// The purity of the result so far is the least pure of all the steps evaluated to produce it.
+	MQDataPurity purity = MQDataPurity::Constant;
+
+	// Resume after the last step whose memoized result is still current. Purity can only
+	// decrease along the chain, so a current memo implies the ones before it are as well.
+	if (mainThread)
+	{
+		for (size_t i = compiled.steps.size(); i-- > 0;)
+		{
+			const CompiledDataPortion::Step& step = compiled.steps[i];
+
+			if (step.memoPurity != MQDataPurity::Volatile
+				&& step.memoGeneration == m_dataGeneration
+				&& step.memoStamp == GetPurityStamp(step.memoPurity))
+			{
+				Result = step.memoResult;
+				if (Result.Type == datatypes::pStringType && Result.Ptr)
+					Result.Ptr = step.memoString.data();
+
+				purity = step.memoPurity;
+				first = i + 1;
+				break;
+			}
+		}
+	}
+
+	auto memoize = [&](const CompiledDataPortion::Step& step, MQDataPurity stepPurity)
+	{
+		if (!mainThread)
+			return;
+
+		purity = std::min(purity, stepPurity);
+		step.memoPurity = purity;
+
+		if (purity != MQDataPurity::Volatile)
+		{
+			// Strings are usually returned in a shared temporary buffer, so keep a copy.
+			if (Result.Type == datatypes::pStringType)
+				step.memoString = Result.Ptr ? static_cast<const char*>(Result.Ptr) : "";
+
+			step.memoResult = Result;
+			step.memoStamp = GetPurityStamp(purity);
+			step.memoGeneration = m_dataGeneration;
+		}
+	};
+
+	for (size_t i = first; i < compiled.steps.size(); ++i)
+	{
+		const CompiledDataPortion::Step& step = compiled.steps[i];
+
+		if (step.kind == CompiledDataPortion::StepKind::Cast)
+		{
+			MQ2Type* pNewType = step.castType;
+			if (!pNewType)
+			{
+				MQ2DataError("Unknown type '%s'", step.name.c_str());
+				return false;
+			}
+
+			if (pNewType == datatypes::pTypeType)
+			{
+				Result.Ptr = Result.Type;
+				Result.Type = datatypes::pTypeType;
+			}
+			else
+			{
+				Result.Type = pNewType;
+			}
+
+			memoize(step, purity);
+			continue;
+		}
+
+		strcpy_s(szIndex, step.index.c_str());
+
+		// Member access through a handle cached at this step. The cache is only maintained on the
+		// main thread since compiled portions are shared between threads.
+		if (Result.Type && IsMainThread())
+		{
+			if (step.memberType != Result.Type
+				|| step.memberGeneration != m_dataGeneration
+				|| (step.memberHandle && !Result.Type->IsValidHandle(step.memberHandle)))
+			{
+				step.memberType = Result.Type;
+				step.memberHandle = ResolveMemberHandle(Result.Type, step.name.c_str());
+				step.memberGeneration = m_dataGeneration;
+			}
+
+			if (step.memberHandle)
+			{
+				MQVarPtr VarPtr = Result;
+				MQ2Type* pType = Result.Type;
+
+				if (EvaluateMacroDataMember(pType, VarPtr, Result, step.memberHandle, szIndex) != EvaluateResult::Success)
+					return false;
+
+				if (step.requireType && !Result.Type)
+					return false;
+
+				memoize(step, step.memberHandle.IsMethod() ? MQDataPurity::Volatile : step.memberHandle.Member->Purity);
+				continue;
+			}
+		}
+
+		// The undeclared variable check must still happen first to preserve the behavior of
+		// EvaluateDataExpression, but it is skipped entirely in the common case of an empty map.
+		MQDataPurity stepPurity = MQDataPurity::Volatile;
+
+		if (!Result.Type && step.tlo
+			&& (gWarning || gUndeclaredVars.empty() || gUndeclaredVars.find(step.name) == gUndeclaredVars.end()))
+		{
+			if (!step.tlo->Function(szIndex, Result))
+				return false;
+
+			stepPurity = step.tlo->Purity;
+		}
+		else if (!EvaluateDataExpression(Result, step.name.c_str(), szIndex, step.allowFunction))
+		{
+			return false;
+		}
+
+		if (step.requireType && !Result.Type)
+			return false;
+
+		memoize(step, stepPurity);
+	}
+
+	return true;
+}
+
+void MQDataAPI::ClearCompiledDataCache()
+{
+	std::scoped_lock lock(m_mutex);
+
+	m_compiledDataCache.clear();
+}
+
+bool MQDataAPI::ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const
+{
+	if (gMacroProfilerEnabled && IsMainThread())
+	{
+		// The portion may be modified while it is evaluated.
+		const std::string expression = szOriginal;
+		const uint64_t startTime = MacroProfiler_Now();
+
+		bool result = ParseMQ2DataPortionImpl(szOriginal, Result);
+
+		MacroProfiler_RecordExpression(expression, MacroProfiler_Now() - startTime);
+		return result;
+	}
+
+	return ParseMQ2DataPortionImpl(szOriginal, Result);
+}
+
+bool MQDataAPI::ParseMQ2DataPortionImpl(char* szOriginal, MQTypeVar& Result) const
+{
+	if (std::shared_ptr<const CompiledDataPortion> compiled = GetCompiledDataPortion(szOriginal))
+	{
+		return EvaluateCompiledDataPortion(*compiled, Result);
+	}
+
+	return ParseMQ2DataPortionUncached(szOriginal, Result);
+}
+
 /**
  * @fn FindMacroClosingBrace
  *
@@ -1001,20 +1599,22 @@ std::string GetMacroVarData(std::string_view strVarToParse)
 		// Strip the ${ and } off of the variable to pass it to ParseMQ2DataPortion
 		strVarToParse = strVarToParse.substr(2, strVarToParse.length() - 3);
 
-		// TODO:  Check to see if this exceeds MAX_STRING and error.
 		// Create a place to hold our "current" string and make sure its long enough to pass on (these
-		// functions expect a string buffer of MAX_STRING length).
-		std::string currentStr{ strVarToParse };
-		currentStr.resize(MAX_STRING);
+		// functions expect a string buffer of MAX_STRING length). This comes from the transient arena
+		// so that evaluating a variable doesn't need a heap allocation.
+		MQTransientScope scope;
+		char* currentStr = scope.GetArena().AllocateString(MAX_STRING);
+		const size_t length = std::min<size_t>(strVarToParse.length(), MAX_STRING - 1);
+		memcpy(currentStr, strVarToParse.data(), length);
+		currentStr[length] = 0;
 
 		MQTypeVar Result;
 
 		// If the parse was successful and there is a result type and we could convert that type to a string
-		if (pDataAPI->ParseMQ2DataPortion(&currentStr[0], Result) && Result.Type && Result.Type->ToString(Result.VarPtr, &currentStr[0]))
+		if (pDataAPI->ParseMQ2DataPortion(currentStr, Result) && Result.Type && Result.Type->ToString(Result.VarPtr, currentStr))
 		{
-			// Set our return whatever szCurrent was modified to be (removing the additional null terminators
-			// due to the above resize)
-			strReturn = currentStr.erase(currentStr.find('\0'));
+			// Set our return whatever szCurrent was modified to be
+			strReturn = currentStr;
 		}
 	}
 	return strReturn;
@@ -1067,6 +1667,11 @@ size_t GetParseDelimiterPos(std::string_view strOriginal, size_t iStartPos = 0)
 	return iFirstDelimiter;
 }
 
+static void AppendToBuffer(fmt::memory_buffer& out, std::string_view text)
+{
+	out.append(text.data(), text.data() + text.size());
+}
+
 /**
  * @fn HandleParseParam
  *
@@ -1122,7 +1727,10 @@ std::string HandleParseParam(std::string_view strOriginal, const bool bParseOnce
 			{
 				// We're going to need to start further in so that we can tokenize the internals
 				// This takes care of situations like ${SomeCustomTLO[${Parse[0,${Me.Name}]}, ${Me.Name}]}
-				strReturn = "${" + ModifyMacroString(strReturn.substr(2, strReturn.length()), bParseOnce);
+				fmt::memory_buffer buffer;
+				AppendToBuffer(buffer, "${");
+				AppendModifiedMacroString(buffer, std::string_view(strReturn).substr(2), bParseOnce);
+				strReturn.assign(buffer.data(), buffer.size());
 
 				// If we are supposed to parse until we're done we need to do a final evaluation of the variable we found.
 				if (!bParseOnce)
@@ -1154,6 +1762,9 @@ std::string HandleParseParam(std::string_view strOriginal, const bool bParseOnce
 				// Get between the bracket and the first delimiter and save that int as our number of iterations
 				int iParseIterations = GetIntFromString(strReturn.substr(iFirstBracket + 1, iFirstDelimiter - 1 - iFirstBracket), 0);
 
+				// Each iteration is built up in here before it replaces the return string.
+				fmt::memory_buffer buffer;
+
 				do {
 					// Find the first bracket in the return string
 					iFirstBracket = strReturn.find('[');
@@ -1168,14 +1779,15 @@ std::string HandleParseParam(std::string_view strOriginal, const bool bParseOnce
 					// and we checked them before we got to this loop.
 
 					// The Sub Parse (thing to be parsed) is the area after the first Delimiter.
-					std::string strSubParse = strReturn.substr(iFirstDelimiter + 1, strReturn.length() - iFirstDelimiter - 3);
+					std::string_view strSubParse = std::string_view(strReturn).substr(iFirstDelimiter + 1, strReturn.length() - iFirstDelimiter - 3);
+					buffer.clear();
 
 					// If this is a ${Parse[0, just remove the parse because we're done.  Also, if this is a negative
 					// number, treat it like a Parse 0.
 					if (iParseIterations <= 0)
 					{
 						// Remove the parse
-						strReturn = strSubParse;
+						AppendToBuffer(buffer, strSubParse);
 					}
 					else
 					{
@@ -1191,17 +1803,20 @@ std::string HandleParseParam(std::string_view strOriginal, const bool bParseOnce
 								iParseIterations = 1;
 							}
 
-							strReturn = PARSE_PARAM_BEG + "0" + strDelimiter + strSubParse + PARSE_PARAM_END;
+							fmt::format_to(fmt::appender(buffer), "{}0{}{}{}", PARSE_PARAM_BEG, strDelimiter, strSubParse, PARSE_PARAM_END);
 						}
 						else
 						{
 							// We have variables to parse. Decrement the iterations and Parse the variables only once
 							// (we'll go further if we need to in additional loops)
-							strReturn = PARSE_PARAM_BEG + std::to_string(iParseIterations - 1) + strDelimiter
-								+ ModifyMacroString(strSubParse, true) + PARSE_PARAM_END;
+							fmt::format_to(fmt::appender(buffer), "{}{}{}", PARSE_PARAM_BEG, iParseIterations - 1, strDelimiter);
+							AppendModifiedMacroString(buffer, strSubParse, true);
+							AppendToBuffer(buffer, PARSE_PARAM_END);
 						}
 					}
 
+					strReturn.assign(buffer.data(), buffer.size());
+
 					// Decrement our iteration counter
 					iParseIterations--;
 
@@ -1214,11 +1829,11 @@ std::string HandleParseParam(std::string_view strOriginal, const bool bParseOnce
 }
 
 /**
- * @fn ParseMacroVar
+ * @fn AppendParsedMacroVar
  *
  * @brief Parses a Macro Variable without tokenizing first, supports recursion
  *
- * ParseMacroVar parses a full variable.  In the case of a nested full variable like:
+ * AppendParsedMacroVar parses a full variable.  In the case of a nested full variable like:
  *         ${SomeOperation[${Me.Name}]}
  * the function will parse the rightmost variable first and work its way back to the
  * left side.  This should result in getting the innermost variables first.  The
@@ -1231,25 +1846,26 @@ std::string HandleParseParam(std::string_view strOriginal, const bool bParseOnce
  * HandleParseParam if it is found immediately, or during recursion if it is found buried.
  *
  * Where ModifyMacroString will tokenize the string and find the longest variables
- * before passing them in whole to ParseMacroVar, ParseMacroVar expects that it
- * is being passed an already tokenized variable.  While ParseMacroVar could be
+ * before passing them in whole to AppendParsedMacroVar, AppendParsedMacroVar expects that it
+ * is being passed an already tokenized variable.  While AppendParsedMacroVar could be
  * part of ModifyMacroString, it's easier for troubleshooting to keep it as a
  * separate operation (and also allows us to skip the first iteration of
  * tokenization if we know we have a full variable already).
  *
+ * The parsed string is appended to the output buffer.
+ *
+ * @param out The buffer to append the parsed string to
  * @param strOriginal The string to parse
  * @param bParseOnce Whether to parse just once or parse all iterations (default false - all iterations)
- *
- * @return std::string The parsed string
  */
-std::string ParseMacroVar(std::string_view strOriginal, const bool bParseOnce = false)
+static void AppendParsedMacroVar(fmt::memory_buffer& out, std::string_view strOriginal, const bool bParseOnce = false)
 {
-	// Setup a return string and initialize it to the original string
-	std::string strReturn{ strOriginal } ;
-
 	// If there is no parse parameter
 	if (strOriginal.find(PARSE_PARAM_BEG) == std::string::npos)
 	{
+		// Setup a working string and initialize it to the original string
+		std::string strReturn{ strOriginal };
+
 		// Track our position and we're starting from the right
 		size_t iCurrentPosition = strReturn.length();
 
@@ -1304,14 +1920,14 @@ std::string ParseMacroVar(std::string_view strOriginal, const bool bParseOnce =
 				iCurrentPosition = 0;
 			}
 		}
+
+		AppendToBuffer(out, strReturn);
 	}
 	else
 	{
 		// There is a parse parameter in this string
-		strReturn = HandleParseParam(strOriginal, bParseOnce);
+		AppendToBuffer(out, HandleParseParam(strOriginal, bParseOnce));
 	}
-
-	return strReturn;
 }
 
 /**
@@ -1338,22 +1954,47 @@ std::string ParseMacroVar(std::string_view strOriginal, const bool bParseOnce =
  * @param bParseOnce Whether to parse just once or parse all iterations (default false - all iterations)
  * @param iOperation What operation to perform, available operations are:
  *         -2 - Wrap Parse Zero, No Doubles - Wrap variables in a Parse Zero (unless they already have a Parse zero)
- *         -1 - Default - Parse variables using ParseMacroVar
+ *         -1 - Default - Parse variables using AppendParsedMacroVar
  *          0 - Wrap Parse Zero - Wrap variables in a Parse Zero (don't parse)
  *
  * @return std::string The parsed string
  */
 std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce, ModifyMacroMode iOperation)
 {
-	// Setup a return variable to track our string being built
-	std::string strReturn;
+	fmt::memory_buffer buffer;
+	AppendModifiedMacroString(buffer, strOriginal, bParseOnce, iOperation);
+
+	return std::string(buffer.data(), buffer.size());
+}
 
+/**
+ * @fn AppendModifiedMacroString
+ *
+ * @brief ModifyMacroString, appending its result to a buffer
+ *
+ * Nested calls append to the buffer of their caller rather than returning strings that the
+ * caller then copies, so the parsed text is only built once.
+ *
+ * Once the buffer holds at least limit characters, the variables that remain are copied without
+ * being modified. Callers that truncate the result at limit use this to skip the work of parsing
+ * text that would be thrown away.
+ */
+void AppendModifiedMacroString(fmt::memory_buffer& out, std::string_view strOriginal, bool bParseOnce,
+	ModifyMacroMode iOperation, size_t limit)
+{
 	// Start at the beginning
 	size_t iCurrentPosition = 0;
 
 	// While we have ${ sections
 	while (iCurrentPosition != std::string::npos)
 	{
+		// If the output is already going to be truncated, there's no point parsing the rest.
+		if (out.size() >= limit)
+		{
+			AppendToBuffer(out, strOriginal.substr(iCurrentPosition));
+			break;
+		}
+
 		// Find the next ${
 		const size_t iNewPosition = strOriginal.find("${", iCurrentPosition);
 
@@ -1361,7 +2002,7 @@ std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce, Mod
 		if (iNewPosition == std::string::npos)
 		{
 			// Add the rest of the line
-			strReturn += strOriginal.substr(iCurrentPosition);
+			AppendToBuffer(out, strOriginal.substr(iCurrentPosition));
 			iCurrentPosition = std::string::npos;
 		}
 		else
@@ -1370,7 +2011,7 @@ std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce, Mod
 			if (iNewPosition > iCurrentPosition)
 			{
 				// Catch the data we missed from the Current Position to the New Position
-				strReturn += strOriginal.substr(iCurrentPosition, (iNewPosition - iCurrentPosition));
+				AppendToBuffer(out, strOriginal.substr(iCurrentPosition, (iNewPosition - iCurrentPosition)));
 			}
 
 			// Advance the current pointer to where we are now.
@@ -1382,7 +2023,7 @@ std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce, Mod
 			// If we didn't find the matching brace, return the rest of the string
 			if (iBracePosition == std::string::npos)
 			{
-				strReturn += strOriginal.substr(iCurrentPosition);
+				AppendToBuffer(out, strOriginal.substr(iCurrentPosition));
 
 				// We reached the end of the string
 				iCurrentPosition = std::string::npos;
@@ -1398,31 +2039,31 @@ std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce, Mod
 					if (strOriginal.substr(iCurrentPosition, PARSE_PARAM_BEG.length() + 1) == PARSE_PARAM_BEG + "0")
 					{
 						// Just add the section as is
-						strReturn += strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition));
+						AppendToBuffer(out, strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)));
 					}
 					else
 					{
 						// Add a Parse Zero
-						strReturn.append(PARSE_PARAM_BEG);
-						strReturn.append("0,");
-						strReturn.append(strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)));
-						strReturn.append(PARSE_PARAM_END);
+						AppendToBuffer(out, PARSE_PARAM_BEG);
+						AppendToBuffer(out, "0,");
+						AppendToBuffer(out, strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)));
+						AppendToBuffer(out, PARSE_PARAM_END);
 					}
 					break;
 
 					// 0 - Wrap Parse Zero - Wrap variables in a Parse Zero (don't parse)
 				case ModifyMacroMode::Wrap:
-					strReturn.append(PARSE_PARAM_BEG);
-					strReturn.append("0,");
-					strReturn.append(strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)));
-					strReturn.append(PARSE_PARAM_END);
+					AppendToBuffer(out, PARSE_PARAM_BEG);
+					AppendToBuffer(out, "0,");
+					AppendToBuffer(out, strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)));
+					AppendToBuffer(out, PARSE_PARAM_END);
 					break;
 
 					// Default case is Parse
 				case ModifyMacroMode::Default:
 				default:
 					// Parse it and add the result to our current string
-					strReturn.append(ParseMacroVar(strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)), bParseOnce));
+					AppendParsedMacroVar(out, strOriginal.substr(iCurrentPosition, (iBracePosition - iCurrentPosition)), bParseOnce);
 				}
 
 				// Advance our position to where the brace is
@@ -1430,9 +2071,6 @@ std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce, Mod
 			}
 		}
 	}
-
-	// Return the parsed string
-	return strReturn;
 }
 
 static bool ParseMacroDataImpl(char* szOriginal, size_t BufferSize);
@@ -1466,8 +2104,21 @@ static bool ParseMacroDataImpl(char* szOriginal, size_t BufferSize);
 bool ParseMacroData(char* szOriginal, size_t BufferSize)
 {
 	// Update crash state with last known string in case something goes wrong
-	CrashHandler_SetLastMacroData(szOriginal);
-	SCOPE_EXIT(CrashHandler_SetLastMacroData(nullptr));
+	const uint64_t breadcrumb = CrashHandler_BeginBreadcrumb(CrashBreadcrumbKind::MacroData, szOriginal);
+	SCOPE_EXIT(CrashHandler_EndBreadcrumb(breadcrumb));
+
+	// Everything allocated from the transient arena while evaluating is released here.
+	MQTransientScope transientScope;
+
+	if (gbSlowExpressions)
+	{
+		const std::string original = szOriginal;
+		const auto start = std::chrono::steady_clock::now();
+
+		const bool result = ParseMacroDataImpl(szOriginal, BufferSize);
+		SlowExpressions_Check(MQSlowExpressionKind::Parse, original, start);
+		return result;
+	}
 
 	return ParseMacroDataImpl(szOriginal, BufferSize);
 }
@@ -1478,27 +2129,29 @@ static bool ParseMacroDataImpl(char* szOriginal, size_t BufferSize)
 
 	if (gParserVersion == 2)
 	{
-		// Pass it off to our String Parser
-		std::string strReturn = ModifyMacroString(szOriginal);
+		// Pass it off to our String Parser, which can stop parsing once the result is too long
+		fmt::memory_buffer buffer;
+		AppendModifiedMacroString(buffer, szOriginal, false, ModifyMacroMode::Default, BufferSize);
 
 		// If the result is larger than MAX_STRING
-		if (strReturn.length() >= BufferSize)
+		if (buffer.size() >= BufferSize)
 		{
 			// If we are currently in a macro block
 			if (MQMacroBlockPtr currblock = GetCurrentMacroBlock())
 			{
-				const MQMacroLine& line = currblock->Line.at(currblock->CurrIndex);
+				const MQMacroLine& line = currblock->GetLine(currblock->CurrIndex);
 
 				MacroError("Data Truncated in %s, Line: %d.  Expanded Length was greater than %d",
 					line.SourceFile.c_str(), line.LineNumber, BufferSize);
 			}
 
 			// Trim the result.
-			strReturn = strReturn.substr(0, BufferSize - 1);
+			buffer.resize(BufferSize - 1);
 		}
 
 		// Copy the parsed string into the original string
-		strcpy_s(szOriginal, BufferSize, strReturn.c_str());
+		memcpy(szOriginal, buffer.data(), buffer.size());
+		szOriginal[buffer.size()] = 0;
 		// TODO: Change the behavior of the return for this to be more informative (consider backwards compatibility, however)
 		return true;
 	}
@@ -1603,7 +2256,7 @@ static bool ParseMacroDataImpl(char* szOriginal, size_t BufferSize)
 		{
 			if (MQMacroBlockPtr currblock = GetCurrentMacroBlock())
 			{
-				const MQMacroLine& line = currblock->Line.at(currblock->CurrIndex);
+				const MQMacroLine& line = currblock->GetLine(currblock->CurrIndex);
 
 				SyntaxError(
 					"Syntax Error: %s Line:%d in %s\n"
@@ -1691,7 +2344,7 @@ bool MQ2Type::GetMemberID(const char* Name, int& result) const
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MemberMap.find(Name);
+	auto iter = MemberMap.find(Atom::Find(Name));
 	if (iter == MemberMap.end())
 		return false;
 
@@ -1700,35 +2353,50 @@ bool MQ2Type::GetMemberID(const char* Name, int& result) const
 	return true;
 }
 
+// The member handle currently being evaluated on this thread. GetMember(handle) passes the
+// member's own name pointer down to the string based GetMember, and FindMember/FindMethod
+// recognize that pointer and return the member without locking or hashing.
+static thread_local MQMemberHandle s_activeMemberHandle;
+
 mq::MQTypeMember* MQ2Type::FindMember(const char* Name)
 {
+	if (s_activeMemberHandle.Owner == this && s_activeMemberHandle.Member->Name == Name
+		&& !s_activeMemberHandle.IsMethod())
+	{
+		return s_activeMemberHandle.Member;
+	}
+
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MemberMap.find(Name);
+	auto iter = MemberMap.find(Atom::Find(Name));
 	if (iter == MemberMap.end())
 		return nullptr;
 
-	int index = MemberMap[Name];
-	return Members[index].get();
+	return Members[iter->second].get();
 }
 
 mq::MQTypeMember* MQ2Type::FindMember(const std::string& Name)
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MemberMap.find(Name);
+	auto iter = MemberMap.find(Atom::Find(Name));
 	if (iter == MemberMap.end())
 		return nullptr;
 
-	int index = MemberMap[Name];
-	return Members[index].get();
+	return Members[iter->second].get();
 }
 
 mq::MQTypeMember* MQ2Type::FindMethod(const char* Name)
 {
+	if (s_activeMemberHandle.Owner == this && s_activeMemberHandle.Member->Name == Name
+		&& s_activeMemberHandle.IsMethod())
+	{
+		return s_activeMemberHandle.Member;
+	}
+
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MethodMap.find(Name);
+	auto iter = MethodMap.find(Atom::Find(Name));
 	if (iter == MethodMap.end())
 		return nullptr;
 
@@ -1740,7 +2408,7 @@ mq::MQTypeMember* MQ2Type::FindMethod(const std::string& Name)
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MethodMap.find(Name);
+	auto iter = MethodMap.find(Atom::Find(Name));
 	if (iter == MethodMap.end())
 		return nullptr;
 
@@ -1753,14 +2421,83 @@ bool MQ2Type::CanEvaluateMethodOrMember(const std::string& Name)
 	std::scoped_lock lock(m_mutex);
 
 	// exists in method map?
-	return MemberMap.count(Name) != 0 || MethodMap.count(Name) != 0;
+	Atom atom = Atom::Find(Name);
+	return MemberMap.count(atom) != 0 || MethodMap.count(atom) != 0;
+}
+
+MQMemberHandle MQ2Type::GetMemberHandle(const char* Name)
+{
+	MQMemberHandle handle;
+
+	{
+		std::scoped_lock lock(m_mutex);
+
+		Atom atom = Atom::Find(Name);
+
+		auto iter = MemberMap.find(atom);
+		if (iter != MemberMap.end())
+		{
+			handle.Member = Members[iter->second].get();
+		}
+		else
+		{
+			auto methodIter = MethodMap.find(atom);
+			if (methodIter != MethodMap.end())
+				handle.Member = Methods[methodIter->second].get();
+		}
+
+		handle.TypeGeneration = handle.OwnerGeneration = m_memberGeneration;
+	}
+
+	if (handle.Member)
+	{
+		handle.Type = handle.Owner = this;
+		return handle;
+	}
+
+	// Inherited members are evaluated by the parent when the derived type doesn't recognize them.
+	if (m_parent != nullptr && m_parent != this)
+	{
+		MQMemberHandle parentHandle = m_parent->GetMemberHandle(Name);
+		if (parentHandle)
+		{
+			handle.Member = parentHandle.Member;
+			handle.Owner = parentHandle.Owner;
+			handle.OwnerGeneration = parentHandle.OwnerGeneration;
+			handle.Type = this;
+			return handle;
+		}
+	}
+
+	return MQMemberHandle();
+}
+
+bool MQ2Type::IsValidHandle(const MQMemberHandle& handle) const
+{
+	return handle.Member != nullptr
+		&& handle.Type == this
+		&& handle.TypeGeneration == m_memberGeneration
+		&& handle.OwnerGeneration == handle.Owner->m_memberGeneration;
+}
+
+bool MQ2Type::GetMember(MQVarPtr VarPtr, const MQMemberHandle& handle, char* Index, MQTypeVar& Dest)
+{
+	if (!IsValidHandle(handle))
+		return false;
+
+	// Nested evaluations (for example a member that parses another expression) install their
+	// own handle, so restore the previous one on the way out.
+	MQMemberHandle previous = std::exchange(s_activeMemberHandle, handle);
+	SCOPE_EXIT(s_activeMemberHandle = previous);
+
+	return GetMember(std::move(VarPtr), handle.Member->Name, Index, Dest);
 }
 
 bool MQ2Type::AddMember(int id, const char* Name)
 {
 	std::scoped_lock lock(m_mutex);
 
-	if (MemberMap.find(Name) != MemberMap.end())
+	if (MemberMap.find(Atom::Find(Name)) != MemberMap.end())
 		return false;
 
 	// find an unused index from members.
@@ -1781,7 +2518,8 @@ bool MQ2Type::AddMember(int id, const char* Name)
 	}
 
 	Members[index] = std::make_unique<MQTypeMember>(id, Name, 0);
-	MemberMap[Name] = index;
+	MemberMap[Atom(Name)] = index;
+	++m_memberGeneration;
 	return true;
 }
 
@@ -1789,7 +2527,7 @@ bool MQ2Type::RemoveMember(const char* Name)
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MemberMap.find(Name);
+	auto iter = MemberMap.find(Atom::Find(Name));
 	if (iter == MemberMap.end())
 		return false;
 
@@ -1799,6 +2537,7 @@ bool MQ2Type::RemoveMember(const char* Name)
 	if (index < 0)
 		return false;
 	Members[index].reset();
+	++m_memberGeneration;
 	return true;
 }
 
@@ -1806,7 +2545,7 @@ bool MQ2Type::AddMethod(int ID, const char* Name)
 {
 	std::scoped_lock lock(m_mutex);
 
-	if (MethodMap.find(Name) != MethodMap.end())
+	if (MethodMap.find(Atom::Find(Name)) != MethodMap.end())
 		return false;
 
 	// find an unused index from members.
@@ -1827,7 +2566,8 @@ bool MQ2Type::AddMethod(int ID, const char* Name)
 	}
 
 	Methods[index] = std::make_unique<MQTypeMember>(ID, Name, 1);
-	MethodMap[Name] = index;
+	MethodMap[Atom(Name)] = index;
+	++m_memberGeneration;
 	return true;
 }
 
@@ -1835,7 +2575,7 @@ bool MQ2Type::RemoveMethod(const char* Name)
 {
 	std::scoped_lock lock(m_mutex);
 
-	auto iter = MethodMap.find(Name);
+	auto iter = MethodMap.find(Atom::Find(Name));
 	if (iter == MethodMap.end())
 		return false;
 
@@ -1845,9 +2585,33 @@ bool MQ2Type::RemoveMethod(const char* Name)
 	if (index < 0)
 		return false;
 	Methods[index].reset();
+	++m_memberGeneration;
+	return true;
+}
+
+bool MQ2Type::SetMemberPurity(const char* Name, MQDataPurity purity)
+{
+	std::scoped_lock lock(m_mutex);
+
+	auto iter = MemberMap.find(Atom::Find(Name));
+	if (iter == MemberMap.end() || iter->second < 0)
+		return false;
+
+	Members[iter->second]->Purity = purity;
 	return true;
 }
 
+void MQ2Type::SetMemberPurity(MQDataPurity purity)
+{
+	std::scoped_lock lock(m_mutex);
+
+	for (const auto& pMember : Members)
+	{
+		if (pMember)
+			pMember->Purity = purity;
+	}
+}
+
 } // namespace datatypes
 
 //============================================================================
@@ -1885,12 +2649,107 @@ int EvaluateMacroDataMember(MQ2Type* pType, MQVarPtr VarPtr, MQTypeVar& Result,
 	return MQDataAPI::EvaluateResultToInt(result);
 }
 
+MQMemberHandle ResolveMacroDataMember(MQ2Type* pType, const char* Member)
+{
+	return pDataAPI->ResolveMemberHandle(pType, Member);
+}
+
+int EvaluateMacroDataMember(MQ2Type* pType, MQVarPtr VarPtr, MQTypeVar& Result, const MQMemberHandle& Member, char* pIndex)
+{
+	auto result = pDataAPI->EvaluateMacroDataMember(pType, VarPtr, Result, Member, pIndex);
+
+	return MQDataAPI::EvaluateResultToInt(result);
+}
+
 char* ParseMacroParameter(char* szOriginal, size_t BufferSize)
 {
 	ParseMacroData(szOriginal, BufferSize);
 	return szOriginal;
 }
 
+struct MQMacroDataRequest
+{
+	std::vector<std::string> strings;
+	std::function<void(std::vector<std::string>&&)> complete;
+};
+
+static std::mutex s_macroDataRequestMutex;
+static std::vector<MQMacroDataRequest> s_macroDataRequests;
+
+static void QueueMacroDataRequest(MQMacroDataRequest&& request)
+{
+	std::scoped_lock lock(s_macroDataRequestMutex);
+
+	s_macroDataRequests.push_back(std::move(request));
+}
+
+std::future<std::string> ParseMacroDataAsync(std::string strOriginal)
+{
+	auto promise = std::make_shared<std::promise<std::string>>();
+	std::future<std::string> result = promise->get_future();
+
+	MQMacroDataRequest request;
+	request.strings.push_back(std::move(strOriginal));
+	request.complete = [promise](std::vector<std::string>&& results) { promise->set_value(std::move(results[0])); };
+
+	QueueMacroDataRequest(std::move(request));
+	return result;
+}
+
+std::future<std::vector<std::string>> ParseMacroDataAsync(std::vector<std::string> strings)
+{
+	auto promise = std::make_shared<std::promise<std::vector<std::string>>>();
+	std::future<std::vector<std::string>> result = promise->get_future();
+
+	MQMacroDataRequest request;
+	request.strings = std::move(strings);
+	request.complete = [promise](std::vector<std::string>&& results) { promise->set_value(std::move(results)); };
+
+	QueueMacroDataRequest(std::move(request));
+	return result;
+}
+
+void ProcessMacroDataRequests()
+{
+	std::vector<MQMacroDataRequest> requests;
+	{
+		std::scoped_lock lock(s_macroDataRequestMutex);
+		if (s_macroDataRequests.empty())
+			return;
+
+		requests.swap(s_macroDataRequests);
+	}
+
+	// Remote clients polling many characters tend to ask for the same things, so each distinct
+	// string is only parsed once per batch.
+	std::unordered_map<std::string, std::string> parsed;
+	char szBuffer[MAX_STRING];
+
+	for (MQMacroDataRequest& request : requests)
+	{
+		std::vector<std::string> results;
+		results.reserve(request.strings.size());
+
+		for (const std::string& str : request.strings)
+		{
+			auto [iter, inserted] = parsed.try_emplace(str);
+			if (inserted)
+			{
+				const size_t length = std::min<size_t>(str.length(), MAX_STRING - 1);
+				memcpy(szBuffer, str.data(), length);
+				szBuffer[length] = 0;
+
+				ParseMacroData(szBuffer, MAX_STRING);
+				iter->second = szBuffer;
+			}
+
+			results.push_back(iter->second);
+		}
+
+		request.complete(std::move(results));
+	}
+}
+
 bool FindMacroDataMember(MQ2Type* Type, const std::string& Member)
 {
 	return pDataAPI->FindMacroDataMember(Type, Member);
@@ -1898,6 +2757,22 @@ bool FindMacroDataMember(MQ2Type* Type, const std::string& Member)
 
 //============================================================================
 
+MQTransientArena& GetTransientArena()
+{
+	static thread_local MQTransientArena s_transientArena;
+	return s_transientArena;
+}
+
+//============================================================================
+
+struct SGlobalBuffer::ThreadBuffer
+{
+	const SGlobalBuffer* owner = nullptr;
+	char buffer[bufferSize] = { 0 };
+	char* ptr = &buffer[0];
+	std::stack<char*> stack;
+};
+
 SGlobalBuffer::SGlobalBuffer()
 	: ptr(&buffer[0])
 {
@@ -1907,16 +2782,56 @@ SGlobalBuffer::~SGlobalBuffer()
 {
 }
 
+SGlobalBuffer::ThreadBuffer* SGlobalBuffer::GetThreadBuffer() const
+{
+	// There is only DataTypeTemp in practice, so this stays a list of one.
+	static thread_local std::vector<std::unique_ptr<ThreadBuffer>> s_threadBuffers;
+
+	for (const auto& threadBuffer : s_threadBuffers)
+	{
+		if (threadBuffer->owner == this)
+			return threadBuffer.get();
+	}
+
+	auto& threadBuffer = s_threadBuffers.emplace_back(std::make_unique<ThreadBuffer>());
+	threadBuffer->owner = this;
+	return threadBuffer.get();
+}
+
+char* SGlobalBuffer::data() const
+{
+	if (IsMainThread())
+		return ptr;
+
+	return GetThreadBuffer()->ptr;
+}
+
 void SGlobalBuffer::push_buffer(char* new_buffer)
 {
-	m_stack.push(ptr);
-	ptr = new_buffer;
+	if (IsMainThread())
+	{
+		m_stack.push(ptr);
+		ptr = new_buffer;
+		return;
+	}
+
+	ThreadBuffer* threadBuffer = GetThreadBuffer();
+	threadBuffer->stack.push(threadBuffer->ptr);
+	threadBuffer->ptr = new_buffer;
 }
 
 void SGlobalBuffer::pop_buffer()
 {
-	ptr = m_stack.top();
-	m_stack.pop();
+	if (IsMainThread())
+	{
+		ptr = m_stack.top();
+		m_stack.pop();
+		return;
+	}
+
+	ThreadBuffer* threadBuffer = GetThreadBuffer();
+	threadBuffer->ptr = threadBuffer->stack.top();
+	threadBuffer->stack.pop();
 }
 
 
@@ -22,11 +22,20 @@
 #include "mq/base/PluginHandle.h"
 #include "mq/api/MacroAPI.h"
 
+#include <fmt/format.h>
+
+#include <atomic>
+#include <map>
 #include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 namespace mq {
 
+struct MQEventQueue;
+struct MQMacroStack;
+
 //============================================================================
 
 class MQDataAPI
@@ -42,6 +51,7 @@ public:
 	bool RemoveTopLevelObject(const char* szName, const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
 
 	MQTopLevelObject* FindTopLevelObject(const char* szName) const;
+	bool SetTopLevelObjectPurity(const char* szName, MQDataPurity purity);
 
 	// DataTypes
 	bool AddDataType(MQ2Type& TypeInstance, const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
@@ -65,6 +75,12 @@ public:
 	EvaluateResult EvaluateMacroDataMember(MQ2Type* type, MQVarPtr& VarPtr, MQTypeVar& Result,
 		const std::string& Member, char* pIndex, bool checkFirst) const;
 
+	// Member handles bypass the extension lookup, so they are only handed out for members of
+	// types that have no extensions registered. Returns an empty handle otherwise.
+	MQMemberHandle ResolveMemberHandle(MQ2Type* type, const char* Member) const;
+	EvaluateResult EvaluateMacroDataMember(MQ2Type* type, MQVarPtr& VarPtr, MQTypeVar& Result,
+		const MQMemberHandle& handle, char* pIndex) const;
+
 	bool EvaluateDataExpression(MQTypeVar& Result, const char* pStart, char* pIndex, bool allowFunction = false) const;
 
 	static int EvaluateResultToInt(MQDataAPI::EvaluateResult result)
@@ -81,27 +97,96 @@ public:
 		}
 	}
 
+	// Macro data observers. Only used from the main thread.
+	int AddObserver(std::vector<std::string> strings, MQMacroDataObserverCallback callback,
+		const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+	bool RemoveObserver(int observerId, const MQPluginHandle& pluginHandle = mqplugin::ThisPluginHandle);
+
+	// Parse the strings of every observer and report the ones that changed. Called once per pulse.
+	void UpdateObservers();
+
+	void OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle);
+
 	// TODO: Change to string_view when we have c++20 support for transparent containers
 	bool IsReservedName(const std::string& name) const;
 
 	bool ParseMQ2DataPortion(char* szOriginal, MQTypeVar& Result) const;
 
+	// Compiled data portions. The text between ${ and } is tokenized once into a flat list of
+	// steps and cached by its source text, so repeated evaluations only perform the member calls.
+	struct CompiledDataPortion
+	{
+		enum class StepKind
+		{
+			Evaluate,                     // Evaluate a TLO, variable or member with an index
+			Cast,                         // Cast the current result to another type
+		};
+
+		struct Step
+		{
+			StepKind kind = StepKind::Evaluate;
+			std::string name;             // TLO/member name, or the type name of a cast
+			std::string index;
+			bool allowFunction = false;
+			bool requireType = false;     // result must have a type after this step
+
+			// Resolved on lookup, refreshed whenever TLOs or types are added or removed.
+			mutable MQTopLevelObject* tlo = nullptr;
+			mutable MQ2Type* castType = nullptr;
+
+			// Member handle for the type last seen at this step. Only used from the main thread.
+			mutable MQ2Type* memberType = nullptr;
+			mutable MQMemberHandle memberHandle;
+			mutable uint32_t memberGeneration = 0;
+
+			// Result after this step, reused while the purity of every step up to and including
+			// this one allows it. Only used from the main thread.
+			mutable MQTypeVar memoResult;
+			mutable std::string memoString;
+			mutable MQDataPurity memoPurity = MQDataPurity::Volatile;
+			mutable uint32_t memoStamp = 0;
+			mutable uint32_t memoGeneration = 0;
+		};
+
+		std::string source;
+		std::vector<Step> steps;
+		bool valid = false;               // false if the text must go through the uncached parser
+		mutable uint32_t generation = 0;
+	};
+
+	std::shared_ptr<const CompiledDataPortion> GetCompiledDataPortion(std::string_view portion) const;
+	bool EvaluateCompiledDataPortion(const CompiledDataPortion& compiled, MQTypeVar& Result) const;
+
+	void ClearCompiledDataCache();
+
+	// Expire memoized results of per-frame members and top level objects, and the per-frame
+	// readiness snapshot. Called once per pulse, and after commands that change what they report.
+	void AdvanceFrame() { ++m_frameStamp; }
+	uint32_t GetFrameStamp() const { return m_frameStamp; }
+
+	// Expire memoized results of per-zone and per-frame members and top level objects.
+	void AdvanceZone() { ++m_zoneStamp; ++m_frameStamp; }
+
 private:
 	void RegisterTopLevelObjects();
+	bool ParseMQ2DataPortionImpl(char* szOriginal, MQTypeVar& Result) const;
+	bool ParseMQ2DataPortionUncached(char* szOriginal, MQTypeVar& Result) const;
+	void ResolveCompiledDataPortion(const CompiledDataPortion& compiled) const;
+	uint32_t GetPurityStamp(MQDataPurity purity) const;
 
 	struct TLORec
 	{
 		std::unique_ptr<MQTopLevelObject> tlo;
 		MQPluginHandle owner;
 	};
-	std::unordered_map<std::string, TLORec> m_tloMap;
+	std::unordered_map<Atom, TLORec> m_tloMap;
 
 	struct TypeRec
 	{
 		MQ2Type* type;
 		MQPluginHandle owner;
 	};
-	std::unordered_map<std::string, TypeRec> m_dataTypeMap;
+	std::unordered_map<Atom, TypeRec> m_dataTypeMap;
 
 	struct ExtensionRec
 	{
@@ -110,6 +195,27 @@ private:
 	};
 	std::unordered_map<std::string, std::vector<ExtensionRec>> m_typeExtensions;
 
+	struct ObserverRec
+	{
+		std::vector<std::string> strings;
+		std::vector<std::string> values;  // empty until the first update
+		MQMacroDataObserverCallback callback;
+		MQPluginHandle owner;
+	};
+	std::map<int, ObserverRec> m_observers;
+	int m_nextObserverId = 1;
+
+	// Keys are views into CompiledDataPortion::source, which is owned by the mapped value.
+	mutable std::unordered_map<std::string_view, std::shared_ptr<CompiledDataPortion>> m_compiledDataCache;
+
+	// Incremented whenever a TLO, data type or type extension is added or removed, so that
+	// compiled data portions know to re-resolve their cached pointers.
+	std::atomic<uint32_t> m_dataGeneration = 1;
+
+	// Only modified and read on the main thread.
+	uint32_t m_frameStamp = 1;
+	uint32_t m_zoneStamp = 1;
+
 	mutable std::recursive_mutex m_mutex;
 };
 
@@ -122,6 +228,11 @@ enum class ModifyMacroMode { Default, Wrap, WrapNoDoubles };
 std::string ModifyMacroString(std::string_view strOriginal, bool bParseOnce = false,
 	ModifyMacroMode iOperation = ModifyMacroMode::Default);
 
+// Appends the result of ModifyMacroString to out. Variables that start once out holds limit
+// characters are copied as they are, since everything from there on is going to be truncated.
+void AppendModifiedMacroString(fmt::memory_buffer& out, std::string_view strOriginal, bool bParseOnce = false,
+	ModifyMacroMode iOperation = ModifyMacroMode::Default, size_t limit = std::string_view::npos);
+
 //============================================================================
 
 bool AddMQ2DataVariable(const char* Name, const char* Index, MQ2Type* pType, MQDataVar** ppHead, const char* Default);
@@ -130,5 +241,17 @@ MQDataVar** FindVariableScope(const char* Name);
 bool DeleteMQ2DataVariable(const char* Name);
 void ClearMQ2DataVariables(MQDataVar** ppHead);
 
+// Rebuilds the variable lookup tables of a stack frame after its lists were moved into it.
+void IndexMacroStackVariables(MQMacroStack* pStack);
+
+// Parses the requests made with ParseMacroDataAsync. Called once per pulse.
+void ProcessMacroDataRequests();
+
+// Event queue maintenance. Unlinking an event leaves its parameters alone, releasing it clears
+// them and returns the event to the pool.
+void UnlinkEvent(MQEventQueue* pEvent);
+void ReleaseEvent(MQEventQueue* pEvent);
+void ClearEventQueue();
+
 
 } // namespace mq
@@ -18,6 +18,10 @@
 #include "MQ2Main.h"
 #include "MQPluginHandler.h"
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 namespace mq {
 
 const char* g_customCaption = "MacroQuest: Even when you're loading.";
@@ -84,6 +88,89 @@ public:
 	}
 };
 
+//============================================================================
+// HUD text
+//
+// Text drawn with DrawHUDText during the DrawHUD pass of the plugins is collected and drawn in one
+// go afterwards. The fonts are looked up once per pass rather than once per string, and the strings
+// are kept as CXStr from one frame to the next, so a HUD that draws the same text every frame doesn't
+// convert it again every time.
+
+struct HUDTextItem
+{
+	const CXStr* text;
+	int x;
+	int y;
+	unsigned int argb;
+	int font;
+};
+
+struct CachedHUDString
+{
+	CXStr text;
+	uint32_t lastUsedFrame = 0;
+};
+
+static bool s_batchingHUDText = false;
+static std::vector<HUDTextItem> s_hudTextItems;
+static std::unordered_map<std::string, CachedHUDString> s_hudStrings;
+static uint32_t s_hudTextFrame = 0;
+
+static const CXStr* GetCachedHUDString(const char* text)
+{
+	auto [iter, added] = s_hudStrings.try_emplace(text);
+	if (added)
+		iter->second.text = text;
+
+	iter->second.lastUsedFrame = s_hudTextFrame;
+	return &iter->second.text;
+}
+
+static void FlushHUDText()
+{
+	if (!s_hudTextItems.empty() && pWndMgr)
+	{
+		const int sX = pWndMgr->ScreenExtentX;
+		const int sY = pWndMgr->ScreenExtentY;
+
+		// HUDs use a handful of fonts, so a linear search beats a map.
+		std::vector<std::pair<int, CTextureFont*>> fonts;
+
+		for (const HUDTextItem& item : s_hudTextItems)
+		{
+			auto fontIter = std::find_if(fonts.begin(), fonts.end(),
+				[&item](const auto& font) { return font.first == item.font; });
+			if (fontIter == fonts.end())
+				fontIter = fonts.insert(fonts.end(), { item.font, pWndMgr->GetFont(item.font) });
+
+			if (CTextureFont* pFont = fontIter->second)
+				pFont->DrawWrappedText(*item.text, item.x, item.y, sX - item.x, { item.x, item.y, sX, sY }, item.argb, 1, 0);
+		}
+	}
+
+	s_hudTextItems.clear();
+
+	// Strings that weren't drawn this frame are unlikely to come back.
+	for (auto iter = s_hudStrings.begin(); iter != s_hudStrings.end();)
+	{
+		if (iter->second.lastUsedFrame != s_hudTextFrame)
+			iter = s_hudStrings.erase(iter);
+		else
+			++iter;
+	}
+
+	++s_hudTextFrame;
+}
+
+static void PluginsDrawHUDText()
+{
+	s_batchingHUDText = true;
+	Benchmark(bmPluginsDrawHUD, PluginsDrawHUD());
+	s_batchingHUDText = false;
+
+	FlushHUDText();
+}
+
 DETOUR_TRAMPOLINE_DEF(void, DrawNetStatus_Trampoline, (uint16_t x, uint16_t y, void* udpConnection, uint32_t bps))
 void DrawNetStatus_Detour(uint16_t x, uint16_t y, void* udpConnection, uint32_t bps)
 {
@@ -96,7 +183,7 @@ void DrawNetStatus_Detour(uint16_t x, uint16_t y, void* udpConnection, uint32_t
 		return;
 
 	DrawNetStatus_Trampoline(x, y, udpConnection, bps);
-	Benchmark(bmPluginsDrawHUD, PluginsDrawHUD());
+	PluginsDrawHUDText();
 }
 
 void DrawHUD()
@@ -112,7 +199,7 @@ void DrawHUD()
 				DrawHUDParams[0] = 0;
 			}
 
-			Benchmark(bmPluginsDrawHUD, PluginsDrawHUD());
+			PluginsDrawHUDText();
 		}
 		else
 		{
@@ -123,6 +210,15 @@ void DrawHUD()
 
 void DrawHUDText(const char* Text, int X, int Y, unsigned int Argb, int Font)
 {
+	if (!Text)
+		return;
+
+	if (s_batchingHUDText)
+	{
+		s_hudTextItems.push_back({ GetCachedHUDString(Text), X, Y, Argb, Font });
+		return;
+	}
+
 	CTextureFont* pFont = pWndMgr->GetFont(Font);
 	if (!pFont)
 		return;
@@ -228,6 +324,9 @@ void ShutdownDisplayHook()
 
 	PluginsCleanUI();
 
+	s_hudTextItems.clear();
+	s_hudStrings.clear();
+
 	RemoveCommand("/netstatusxpos");
 	RemoveCommand("/netstatusypos");
 
@@ -0,0 +1,250 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Micro-benchmarks for the engines that everything else is built on: the calculator, both macro
+// parsers, Blech, macro line cleanup, chat color conversion and the routing of pipe messages.
+// They only use inputs they build themselves, so the results can be compared between builds on
+// the same machine. "/benchmark engines save" stores a baseline that later runs are compared to.
+
+#include "pch.h"
+#include "MQ2Main.h"
+
+#include "routing/PostOffice.h"
+
+#include <filesystem>
+
+namespace mq {
+
+bool FastCalculate(char* szFormula, double& Result);
+void CleanMacroLine(char* szLine);
+
+static constexpr const char* EngineBenchmarkSection = "EngineBenchmarks";
+static constexpr const char* EngineBenchmarkTLO = "EngineBenchmark";
+static constexpr double RegressionThreshold = 1.2;
+static constexpr auto MinimumDuration = std::chrono::milliseconds(50);
+
+struct EngineBenchmark
+{
+	const char* Name;
+	std::function<void()> Run;
+};
+
+static std::string GetEngineBenchmarkIni()
+{
+	return (std::filesystem::path(internal_paths::Config) / "EngineBenchmarks.ini").string();
+}
+
+// Runs the benchmark in batches until it has taken long enough to give a stable average.
+static double MeasureEngineBenchmark(const EngineBenchmark& benchmark)
+{
+	// Warm up caches (and the compiled data portions of the parser) before timing anything.
+	for (int i = 0; i < 100; ++i)
+		benchmark.Run();
+
+	uint64_t iterations = 0;
+	uint64_t batch = 100;
+	std::chrono::steady_clock::duration elapsed{};
+
+	while (elapsed < MinimumDuration)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < batch; ++i)
+			benchmark.Run();
+		elapsed += std::chrono::steady_clock::now() - start;
+
+		iterations += batch;
+		batch *= 2;
+	}
+
+	return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+// A top level object that doesn't depend on the game, so the parsers can be measured anywhere.
+static bool dataEngineBenchmark(const char* szIndex, MQTypeVar& Ret)
+{
+	Ret.Type = datatypes::pIntType;
+	Ret.Int = szIndex[0] ? GetIntFromString(szIndex, 0) : 42;
+	return true;
+}
+
+static void CALLBACK EngineBenchmarkEvent(unsigned int ID, void* pData, PBLECHVALUE pValues)
+{
+	++*static_cast<int*>(pData);
+}
+
+static std::vector<EngineBenchmark> CreateEngineBenchmarks(Blech& blech)
+{
+	std::vector<EngineBenchmark> benchmarks;
+
+	benchmarks.push_back({ "Calculate", []
+		{
+			double result = 0;
+			Calculate("(3+4)*5-(10/4)^2+17%5", result);
+		} });
+
+	benchmarks.push_back({ "FastCalculate", []
+		{
+			char szFormula[] = "(3+4)*5-(10/4)^2+17%5";
+			double result = 0;
+			FastCalculate(szFormula, result);
+		} });
+
+	auto parse = [](int parserVersion)
+	{
+		return [parserVersion]
+		{
+			int oldVersion = gParserVersion;
+			gParserVersion = parserVersion;
+
+			char szLine[MAX_STRING] = "${Math.Calc[${EngineBenchmark}*2+1]} ${EngineBenchmark[7].Float} ${If[${EngineBenchmark}>10,big,small]}";
+			ParseMacroData(szLine, MAX_STRING);
+
+			gParserVersion = oldVersion;
+		};
+	};
+	benchmarks.push_back({ "ParserV1", parse(1) });
+	benchmarks.push_back({ "ParserV2", parse(2) });
+
+	benchmarks.push_back({ "BlechFeed", [&blech]
+		{
+			blech.Feed("Soandso tells you, 'Hail, adventurer'");
+			blech.Feed("You have slain a gnoll pup!");
+			blech.Feed("Your spell is interrupted.");
+		} });
+
+	benchmarks.push_back({ "CleanMacroLine", []
+		{
+			char szLine[MAX_STRING] = "\t   /if (${Target.ID} && ${Me.PctHPs} < 50) /call Heal   // heal when we get low   ";
+			CleanMacroLine(szLine);
+		} });
+
+	static constexpr const char* ColoredText = "\ayYellow \arred and \a-gdark green\ax normal \a#ff8000orange\ax with a <link>";
+
+	benchmarks.push_back({ "StripMQChat", []
+		{
+			char szOut[MAX_STRING];
+			StripMQChat(ColoredText, szOut);
+		} });
+
+	benchmarks.push_back({ "MQToSTML", []
+		{
+			char szOut[MAX_STRING];
+			MQToSTML(ColoredText, szOut, MAX_STRING);
+		} });
+
+	benchmarks.push_back({ "MQToSTML (string)", []
+		{
+			static std::string out;
+			out.clear();
+			MQToSTML(ColoredText, out);
+		} });
+
+	benchmarks.push_back({ "PipeMessageParse", []
+		{
+			static const std::string payload(256, 'x');
+			static const PipeMessage message(MQMessageId::MSG_ECHO, payload.data(), payload.size());
+
+			size_t length = sizeof(MQMessageHeader) + message.size();
+			auto buffer = std::make_unique<uint8_t[]>(length);
+			memcpy(buffer.get(), message.GetHeader(), sizeof(MQMessageHeader));
+			memcpy(buffer.get() + sizeof(MQMessageHeader), message.get(), message.size());
+
+			PipeMessage parsed;
+			parsed.Parse(std::move(buffer), length);
+		} });
+
+	benchmarks.push_back({ "PostOfficeRoute", []
+		{
+			static const std::string envelope = []
+			{
+				proto::routing::Envelope envelope;
+				envelope.mutable_address()->set_mailbox("engine_benchmark");
+				envelope.set_payload(std::string(256, 'x'));
+				return envelope.SerializeAsString();
+			}();
+
+			// Processing takes at least one message from every mailbox, which keeps ours from growing.
+			postoffice::PostOffice& postOffice = postoffice::GetPostOffice();
+			postOffice.DeliverTo("engine_benchmark",
+				std::make_unique<PipeMessage>(MQMessageId::MSG_ROUTE, envelope.data(), envelope.size()));
+			postOffice.Process(1);
+		} });
+
+	return benchmarks;
+}
+
+void RunEngineBenchmarks(bool save)
+{
+	const std::string iniFile = GetEngineBenchmarkIni();
+
+	pDataAPI->AddTopLevelObject(EngineBenchmarkTLO, dataEngineBenchmark);
+
+	postoffice::GetPostOffice().RegisterAddress("engine_benchmark", [](ProtoMessagePtr&&) {});
+
+	int blechMatches = 0;
+	Blech blech('#');
+	std::vector<unsigned int> blechEvents = {
+		blech.AddEvent("#1# tells you, '#2#'", EngineBenchmarkEvent, &blechMatches),
+		blech.AddEvent("You have slain #1#!", EngineBenchmarkEvent, &blechMatches),
+		blech.AddEvent("#1# has been slain by #2#!", EngineBenchmarkEvent, &blechMatches),
+		blech.AddEvent("Your #1# spell has worn off of #2#.", EngineBenchmarkEvent, &blechMatches),
+	};
+
+	WriteChatColor("Engine Benchmarks");
+	WriteChatColor("--------------");
+
+	int regressions = 0;
+	for (const EngineBenchmark& benchmark : CreateEngineBenchmarks(blech))
+	{
+		double nsPerOp = MeasureEngineBenchmark(benchmark);
+		double baseline = GetPrivateProfileFloat(EngineBenchmarkSection, benchmark.Name, 0.0f, iniFile);
+
+		if (save)
+		{
+			WritePrivateProfileString(EngineBenchmarkSection, benchmark.Name, fmt::format("{:.1f}", nsPerOp), iniFile);
+			WriteChatf("\ay%s\ax: \at%.1f\ax ns/op", benchmark.Name, nsPerOp);
+		}
+		else if (baseline > 0)
+		{
+			double ratio = nsPerOp / baseline;
+			bool regressed = ratio > RegressionThreshold;
+			if (regressed)
+				++regressions;
+
+			WriteChatf("\ay%s\ax: \at%.1f\ax ns/op (baseline %.1f, %s%+.0f%%\ax)", benchmark.Name, nsPerOp, baseline,
+				regressed ? "\ar" : "\ag", (ratio - 1.0) * 100.0);
+		}
+		else
+		{
+			WriteChatf("\ay%s\ax: \at%.1f\ax ns/op", benchmark.Name, nsPerOp);
+		}
+	}
+
+	for (unsigned int id : blechEvents)
+		blech.RemoveEvent(id);
+
+	postoffice::GetPostOffice().RemoveMailbox("engine_benchmark");
+	pDataAPI->RemoveTopLevelObject(EngineBenchmarkTLO);
+
+	WriteChatColor("--------------");
+	if (save)
+		WriteChatf("Saved the engine benchmark baseline to %s", iniFile.c_str());
+	else if (regressions > 0)
+		WriteChatf("\ar%d engine benchmark(s) are more than %.0f%% slower than the baseline.", regressions,
+			(RegressionThreshold - 1.0) * 100.0);
+	else
+		WriteChatf("Matched %d Blech events.", blechMatches);
+}
+
+} // namespace mq
@@ -0,0 +1,295 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQAdvLoot.h"
+#include "MQCastState.h"
+#include "MQGameEvents.h"
+#include "MQGroupRoster.h"
+#include "MQPetMercState.h"
+#include "MQTasks.h"
+#include "MQXTargets.h"
+
+#include <map>
+
+namespace mq {
+
+struct GameEventObserver
+{
+	MQGameEvent event;
+	MQGameEventCallback callback;
+	MQPluginHandle owner;
+};
+
+static std::map<int, GameEventObserver> s_gameEventObservers;
+static int s_nextGameEventObserverId = 1;
+
+// What the last pulse saw. A zone of -1 means that we weren't in one.
+static int s_lastGameState = -1;
+static int s_lastZoneID = -1;
+static PlayerClient* s_lastTarget = nullptr;
+static uint64_t s_lastGroupHash = 0;
+static bool s_lastMoving = false;
+static int s_lastCastingSpellID = -1;
+static uint64_t s_lastBuffsHash = 0;
+static uint64_t s_lastRaidHash = 0;
+
+int GameEvents_AddObserver(MQGameEvent event, MQGameEventCallback callback, const MQPluginHandle& pluginHandle)
+{
+	if (!callback)
+		return 0;
+
+	const int observerId = s_nextGameEventObserverId++;
+
+	GameEventObserver& observer = s_gameEventObservers[observerId];
+	observer.event = event;
+	observer.callback = std::move(callback);
+	observer.owner = pluginHandle;
+
+	return observerId;
+}
+
+bool GameEvents_RemoveObserver(int observerId, const MQPluginHandle& pluginHandle)
+{
+	auto iter = s_gameEventObservers.find(observerId);
+	if (iter == s_gameEventObservers.end())
+		return false;
+
+	if (iter->second.owner != pluginHandle)
+		return false;
+
+	s_gameEventObservers.erase(iter);
+	return true;
+}
+
+void GameEvents_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle)
+{
+	// Remove any observers that were left behind by this plugin.
+	for (auto iter = s_gameEventObservers.begin(); iter != s_gameEventObservers.end();)
+	{
+		if (iter->second.owner == pluginHandle)
+		{
+			DebugSpew("Removing game event observer left behind by %s", plugin->name.c_str());
+			iter = s_gameEventObservers.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+static void PublishGameEvent(const MQGameEventInfo& info)
+{
+	// Callbacks may add or remove observers, so find the next one by id after every call.
+	for (auto iter = s_gameEventObservers.begin(); iter != s_gameEventObservers.end();)
+	{
+		const int observerId = iter->first;
+
+		if (iter->second.event == info.Event)
+		{
+			MQGameEventCallback callback = iter->second.callback;
+			callback(info);
+		}
+
+		iter = s_gameEventObservers.upper_bound(observerId);
+	}
+}
+
+static uint64_t GetGroupHash()
+{
+	if (!pLocalPC || !pLocalPC->Group)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](const char* name)
+	{
+		for (const char* ch = name; *ch; ++ch)
+		{
+			hash ^= static_cast<uint8_t>(*ch);
+			hash *= 1099511628211ULL;
+		}
+
+		hash ^= 0xff;
+		hash *= 1099511628211ULL;
+	};
+
+	CGroupMember* leader = pLocalPC->Group->GetGroupLeader();
+	add(leader ? leader->GetName() : "");
+
+	for (const CGroupMember* member : *pLocalPC->Group)
+		add(member ? member->GetName() : "");
+
+	return hash;
+}
+
+static uint64_t GetBuffsHash()
+{
+	PcProfile* pProfile = GetPcProfile();
+	if (!pProfile)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < MAX_TOTAL_BUFFS; ++i)
+	{
+		hash ^= static_cast<uint32_t>(pProfile->GetEffect(i).SpellID);
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+void GameEvents_Pulse()
+{
+	const int gameState = gGameState;
+	const int zoneID = (gameState == GAMESTATE_INGAME && !gZoning && pLocalPC && pLocalPlayer)
+		? static_cast<int>(pLocalPC->zoneId) : -1;
+	PlayerClient* target = pTarget;
+	const uint64_t groupHash = GetGroupHash();
+	const bool moving = zoneID != -1 && gbMoving;
+	const int castingSpellID = zoneID != -1 ? pLocalPlayer->CastingData.SpellID : -1;
+	const uint64_t buffsHash = zoneID != -1 ? GetBuffsHash() : 0;
+
+	// The raid roster is only rebuilt when this changes, whether or not anyone is observing.
+	const bool raidChanged = test_and_set(s_lastRaidHash, GetRaidRosterSignature());
+	if (raidChanged)
+		InvalidateRaidRoster();
+
+	if (s_gameEventObservers.empty())
+	{
+		// Keep up so that an observer added later isn't told about something that changed long ago.
+		s_lastGameState = gameState;
+		s_lastZoneID = zoneID;
+		s_lastTarget = target;
+		s_lastGroupHash = groupHash;
+		s_lastMoving = moving;
+		s_lastCastingSpellID = castingSpellID;
+		s_lastBuffsHash = buffsHash;
+		return;
+	}
+
+	if (test_and_set(s_lastGameState, gameState))
+	{
+		MQGameEventInfo info{ MQGameEvent::GameStateChanged };
+		info.GameState = gameState;
+		PublishGameEvent(info);
+	}
+
+	// Leaving a zone resets the last zone, so zoning back into the same one is still reported.
+	if (test_and_set(s_lastZoneID, zoneID) && zoneID != -1)
+	{
+		MQGameEventInfo info{ MQGameEvent::ZoneChanged };
+		info.ZoneID = zoneID;
+		PublishGameEvent(info);
+	}
+
+	if (test_and_set(s_lastGroupHash, groupHash))
+	{
+		PublishGameEvent(MQGameEventInfo{ MQGameEvent::GroupChanged });
+	}
+
+	if (test_and_set(s_lastTarget, target))
+	{
+		MQGameEventInfo info{ MQGameEvent::TargetChanged };
+		info.Target = target;
+		PublishGameEvent(info);
+	}
+
+	if (test_and_set(s_lastMoving, moving))
+	{
+		MQGameEventInfo info{ MQGameEvent::MovingChanged };
+		info.Moving = moving;
+		PublishGameEvent(info);
+	}
+
+	if (test_and_set(s_lastCastingSpellID, castingSpellID))
+	{
+		MQGameEventInfo info{ MQGameEvent::CastingChanged };
+		info.SpellID = castingSpellID;
+		PublishGameEvent(info);
+	}
+
+	if (test_and_set(s_lastBuffsHash, buffsHash))
+	{
+		PublishGameEvent(MQGameEventInfo{ MQGameEvent::BuffsChanged });
+	}
+
+	if (raidChanged)
+	{
+		PublishGameEvent(MQGameEventInfo{ MQGameEvent::RaidChanged });
+	}
+
+	// The snapshot was taken earlier in this pulse and already knows which slots changed.
+	if (const uint32_t xtargetSlots = XTargets_GetChangedSlots())
+	{
+		MQGameEventInfo info{ MQGameEvent::XTargetChanged };
+		info.XTargetSlots = xtargetSlots;
+		PublishGameEvent(info);
+	}
+
+	for (const TaskObjectiveProgress& progress : Tasks_GetProgressedObjectives())
+	{
+		MQGameEventInfo info{ MQGameEvent::TaskObjectiveProgress };
+		info.TaskID = progress.taskID;
+		info.ObjectiveIndex = progress.objectiveIndex;
+		info.ObjectiveCount = progress.currentCount;
+		info.ObjectiveRequiredCount = progress.requiredCount;
+		PublishGameEvent(info);
+	}
+
+	if (const uint32_t advLootLists = AdvLoot_GetChangedLists())
+	{
+		MQGameEventInfo info{ MQGameEvent::AdvLootChanged };
+		info.AdvLootLists = advLootLists;
+		PublishGameEvent(info);
+	}
+
+	for (const CachedBuffChange& change : CachedBuffs_GetChanges())
+	{
+		MQGameEventInfo info{ change.type == CachedBuffChangeType::Gained ? MQGameEvent::SpawnBuffGained
+			: change.type == CachedBuffChangeType::Lost ? MQGameEvent::SpawnBuffLost : MQGameEvent::SpawnBuffExpiring };
+		info.SpawnID = change.spawnID;
+		info.SpellID = change.spellID;
+		info.BuffSlot = change.slot;
+		info.BuffDuration = change.remaining;
+		PublishGameEvent(info);
+	}
+
+	for (const CastPhaseTransition& transition : CastState_GetTransitions())
+	{
+		MQGameEventInfo info{ MQGameEvent::CastPhaseChanged };
+		info.CastPhase = transition.phase;
+		info.SpellID = transition.spellID;
+		PublishGameEvent(info);
+	}
+
+	if (const uint32_t petChanges = PetMerc_GetPetChanges())
+	{
+		MQGameEventInfo info{ MQGameEvent::PetChanged };
+		info.SpawnID = GetPetSnapshot().spawnID;
+		info.PetChanges = petChanges;
+		PublishGameEvent(info);
+	}
+
+	if (const uint32_t mercenaryChanges = PetMerc_GetMercenaryChanges())
+	{
+		MQGameEventInfo info{ MQGameEvent::MercenaryChanged };
+		info.SpawnID = GetMercenarySnapshot().spawnID;
+		info.MercenaryChanges = mercenaryChanges;
+		PublishGameEvent(info);
+	}
+}
+
+} // namespace mq
@@ -0,0 +1,33 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "mq/api/GameEvents.h"
+#include "mq/base/PluginHandle.h"
+
+namespace mq {
+
+struct MQPlugin;
+
+// Game event observers. Everything here is only used from the main thread.
+int GameEvents_AddObserver(MQGameEvent event, MQGameEventCallback callback, const MQPluginHandle& pluginHandle);
+bool GameEvents_RemoveObserver(int observerId, const MQPluginHandle& pluginHandle);
+void GameEvents_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle);
+
+// Compares the game against the values seen last pulse and notifies the observers of what changed.
+// Called once per pulse, after the pulse has updated gbMoving and before plugins are pulsed.
+void GameEvents_Pulse();
+
+} // namespace mq
@@ -0,0 +1,324 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQGroupRoster.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace mq {
+
+//============================================================================
+// Group roster
+//
+// Indices over the group members by name, spawn and role. Checking whether the group changed only
+// reads the member pointers and their spawns and role flags, so it is done on every lookup and the
+// roster is never out of date. The name cleanup and hashing only happen when something changed.
+
+enum GroupRosterRole : uint8_t
+{
+	GroupRosterRole_Tank           = 1 << 0,
+	GroupRosterRole_Assist         = 1 << 1,
+	GroupRosterRole_Puller         = 1 << 2,
+	GroupRosterRole_MarkNPC        = 1 << 3,
+	GroupRosterRole_MasterLooter   = 1 << 4,
+};
+
+static uint8_t GetGroupRosterRoles(const CGroupMember* pMember)
+{
+	if (!pMember)
+		return 0;
+
+	return (pMember->IsMainTank() ? GroupRosterRole_Tank : 0)
+		| (pMember->IsMainAssist() ? GroupRosterRole_Assist : 0)
+		| (pMember->IsPuller() ? GroupRosterRole_Puller : 0)
+		| (pMember->IsMarkNPC() ? GroupRosterRole_MarkNPC : 0)
+		| (pMember->IsMasterLooter() ? GroupRosterRole_MasterLooter : 0);
+}
+
+struct GroupRoster
+{
+	// What the roster was built from.
+	CGroup* group = nullptr;
+	PlayerClient* self = nullptr;
+	CGroupMember* members[MAX_GROUP_SIZE] = {};
+	PlayerClient* players[MAX_GROUP_SIZE] = {};
+	uint8_t roles[MAX_GROUP_SIZE] = {};
+
+	// Visual indices are what ${Group.Member[n]} uses: 0 is us, then members in slot order.
+	int memberCount = 0;
+	int visualToSlot[MAX_GROUP_SIZE] = {};
+	std::unordered_map<std::string, int> nameToIndex;      // cleaned up, lower case names
+	std::unordered_map<const PlayerClient*, int> spawnToIndex;
+};
+
+static GroupRoster s_groupRoster;
+
+static const GroupRoster& GetGroupRoster()
+{
+	CGroup* group = pLocalPC ? pLocalPC->Group : nullptr;
+	PlayerClient* self = pLocalPlayer;
+
+	bool changed = group != s_groupRoster.group || self != s_groupRoster.self;
+
+	CGroupMember* members[MAX_GROUP_SIZE] = {};
+	PlayerClient* players[MAX_GROUP_SIZE] = {};
+	uint8_t roles[MAX_GROUP_SIZE] = {};
+
+	if (group)
+	{
+		for (int slot = 0; slot < MAX_GROUP_SIZE; ++slot)
+		{
+			if (CGroupMember* pMember = group->GetGroupMember(slot))
+			{
+				members[slot] = pMember;
+				players[slot] = pMember->GetPlayer();
+				roles[slot] = GetGroupRosterRoles(pMember);
+			}
+
+			changed = changed
+				|| members[slot] != s_groupRoster.members[slot]
+				|| players[slot] != s_groupRoster.players[slot]
+				|| roles[slot] != s_groupRoster.roles[slot];
+		}
+	}
+
+	if (!changed)
+		return s_groupRoster;
+
+	GroupRoster& roster = s_groupRoster;
+	roster.group = group;
+	roster.self = self;
+	std::copy(std::begin(members), std::end(members), std::begin(roster.members));
+	std::copy(std::begin(players), std::end(players), std::begin(roster.players));
+	std::copy(std::begin(roles), std::end(roles), std::begin(roster.roles));
+
+	roster.memberCount = 0;
+	std::fill(std::begin(roster.visualToSlot), std::end(roster.visualToSlot), -1);
+	roster.nameToIndex.clear();
+	roster.spawnToIndex.clear();
+
+	if (!group)
+		return roster;
+
+	roster.visualToSlot[0] = 0;
+	if (self)
+	{
+		roster.nameToIndex.emplace(to_lower_copy(self->Name), 0);
+		roster.spawnToIndex.emplace(self, 0);
+	}
+
+	for (int slot = 1; slot < MAX_GROUP_SIZE; ++slot)
+	{
+		if (!members[slot])
+			continue;
+
+		const int index = ++roster.memberCount;
+		roster.visualToSlot[index] = slot;
+
+		// Cleaned up to fix the mercenary name bug, the same as ${Group.Member[name]} always did.
+		char name[MAX_STRING] = { 0 };
+		strcpy_s(name, members[slot]->GetName());
+		CleanupName(name, sizeof(name), false, false);
+
+		roster.nameToIndex.emplace(to_lower_copy(name), index);
+
+		if (players[slot])
+			roster.spawnToIndex.emplace(players[slot], index);
+	}
+
+	return roster;
+}
+
+int GetGroupRosterCount()
+{
+	return GetGroupRoster().memberCount;
+}
+
+CGroupMember* GetGroupRosterMember(int index)
+{
+	if (index < 0 || index >= MAX_GROUP_SIZE)
+		return nullptr;
+
+	const GroupRoster& roster = GetGroupRoster();
+
+	const int slot = roster.visualToSlot[index];
+	return slot >= 0 ? roster.members[slot] : nullptr;
+}
+
+int GetGroupRosterIndexByName(std::string_view name)
+{
+	const GroupRoster& roster = GetGroupRoster();
+
+	auto iter = roster.nameToIndex.find(to_lower_copy(name));
+	return iter != roster.nameToIndex.end() ? iter->second : -1;
+}
+
+int GetGroupRosterIndexBySpawn(const PlayerClient* pSpawn)
+{
+	if (!pSpawn)
+		return -1;
+
+	const GroupRoster& roster = GetGroupRoster();
+
+	auto iter = roster.spawnToIndex.find(pSpawn);
+	return iter != roster.spawnToIndex.end() ? iter->second : -1;
+}
+
+int GetGroupRosterIndexByRole(int role)
+{
+	uint8_t flag = 0;
+	if (role == static_cast<int>(GroupRoleTank)) flag = GroupRosterRole_Tank;
+	else if (role == static_cast<int>(GroupRoleAssist)) flag = GroupRosterRole_Assist;
+	else if (role == static_cast<int>(GroupRolePuller)) flag = GroupRosterRole_Puller;
+	else if (role == static_cast<int>(GroupRoleMarkNPC)) flag = GroupRosterRole_MarkNPC;
+	else if (role == static_cast<int>(GroupRoleMasterLooter)) flag = GroupRosterRole_MasterLooter;
+
+	if (!flag)
+		return -1;
+
+	const GroupRoster& roster = GetGroupRoster();
+	if (!roster.group)
+		return -1;
+
+	for (int index = 0; index <= roster.memberCount; ++index)
+	{
+		const int slot = roster.visualToSlot[index];
+		if (slot >= 0 && (roster.roles[slot] & flag))
+			return index;
+	}
+
+	return -1;
+}
+
+//============================================================================
+// Raid roster
+//
+// The raid is too large to compare on every lookup, so the roster is rebuilt when the signature that
+// is checked every pulse changes. Lookups still check the slot they found, so a member that left
+// since the last pulse is never returned.
+
+struct RaidRoster
+{
+	bool valid = false;
+	std::vector<int> ordinalToSlot;                        // ${Raid.Member[n]} is ordinalToSlot[n - 1]
+	std::unordered_map<std::string, int> nameToSlot;       // lower case names
+};
+
+static RaidRoster s_raidRoster;
+
+uint64_t GetRaidRosterSignature()
+{
+	if (!pRaid || pRaid->Invited != RaidStateInRaid)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](uint8_t value)
+	{
+		hash ^= value;
+		hash *= 1099511628211ULL;
+	};
+
+	for (int slot = 0; slot < MAX_RAID_SIZE; ++slot)
+	{
+		if (!pRaid->RaidMemberUsed[slot])
+			continue;
+
+		add(static_cast<uint8_t>(slot));
+		for (const char* ch = pRaid->RaidMember[slot].Name; *ch; ++ch)
+			add(static_cast<uint8_t>(*ch));
+	}
+
+	return hash;
+}
+
+void InvalidateRaidRoster()
+{
+	s_raidRoster.valid = false;
+}
+
+static const RaidRoster& GetRaidRoster()
+{
+	RaidRoster& roster = s_raidRoster;
+
+	// A count that disagrees with the roster means that the raid changed since the last pulse.
+	if (roster.valid && pRaid && static_cast<int>(roster.ordinalToSlot.size()) == pRaid->RaidMemberCount)
+		return roster;
+
+	roster.valid = true;
+	roster.ordinalToSlot.clear();
+	roster.nameToSlot.clear();
+
+	if (!pRaid)
+		return roster;
+
+	for (int slot = 0; slot < MAX_RAID_SIZE; ++slot)
+	{
+		if (!pRaid->RaidMemberUsed[slot])
+			continue;
+
+		roster.ordinalToSlot.push_back(slot);
+		roster.nameToSlot.emplace(to_lower_copy(pRaid->RaidMember[slot].Name), slot);
+	}
+
+	return roster;
+}
+
+int GetRaidRosterSlotByName(std::string_view name)
+{
+	if (!pRaid)
+		return -1;
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		const RaidRoster& roster = GetRaidRoster();
+
+		auto iter = roster.nameToSlot.find(to_lower_copy(name));
+		if (iter == roster.nameToSlot.end())
+			return -1;
+
+		const int slot = iter->second;
+		if (pRaid->RaidMemberUsed[slot] && ci_equals(pRaid->RaidMember[slot].Name, name))
+			return slot;
+
+		InvalidateRaidRoster();
+	}
+
+	return -1;
+}
+
+int GetRaidRosterSlotByOrdinal(int ordinal)
+{
+	if (!pRaid || ordinal <= 0)
+		return -1;
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		const RaidRoster& roster = GetRaidRoster();
+		if (ordinal > static_cast<int>(roster.ordinalToSlot.size()))
+			return -1;
+
+		const int slot = roster.ordinalToSlot[ordinal - 1];
+		if (pRaid->RaidMemberUsed[slot])
+			return slot;
+
+		InvalidateRaidRoster();
+	}
+
+	return -1;
+}
+
+} // namespace mq
@@ -0,0 +1,27 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace mq {
+
+// A signature of the raid members, cheap enough to compute once per pulse.
+uint64_t GetRaidRosterSignature();
+
+// Called when the raid signature changed, so that lookups don't keep answering from the old raid.
+void InvalidateRaidRoster();
+
+} // namespace mq
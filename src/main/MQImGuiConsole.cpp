@@ -16,6 +16,8 @@
 
 #include "MQ2DeveloperTools.h"
 #include "MQ2ImGuiTools.h"
+#include "MQCommandAPI.h"
+#include "MQPluginHandler.h"
 #include "ImGuiManager.h"
 #include "mq/zep/ImGuiZepEditor.h"
 #include "mq/zep/ImGuiZepConsole.h"
@@ -27,7 +29,10 @@
 
 #include <imgui/imgui_internal.h>
 
+#include <condition_variable>
+#include <mutex>
 #include <optional>
+#include <thread>
 #include "sqlite3.h"
 
 namespace mq {
@@ -216,142 +221,288 @@ public:
 
 #pragma endregion
 
-std::vector<std::string> InitConsoleDatabase(sqlite3*& db, int process_id)
+// The command history that is kept between sessions. The database is shared by every client, so it
+// is only ever touched from a thread of its own: commands are queued and written there in batched
+// transactions, and the history is read from it a page at a time when the console wants more of it.
+// Waiting on another client's lock never holds up the game.
+class ConsoleHistoryDatabase
 {
-	std::vector<std::string> history;
-	if (s_consolePersistentCommandHistory)
+public:
+	static constexpr int PageSize = 20;
+
+	explicit ConsoleHistoryDatabase(int processId)
+		: m_processId(processId)
+		, m_sessionStart(GetTimestamp())
+	{
+		m_thread = std::thread([this]() { Run(); });
+	}
+
+	~ConsoleHistoryDatabase()
 	{
-		const std::string db_path = internal_paths::Logs + "\\ConsoleBuffer.db";
-		if (sqlite3_open_v2(db_path.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_WAL, nullptr) != SQLITE_OK)
 		{
-			WriteChatf("MQ Console Error opening console buffer database: %s", sqlite3_errmsg(db));
-			sqlite3_close(db);
-			db = nullptr;
+			std::scoped_lock lock(m_mutex);
+			m_stopping = true;
 		}
-		else
+
+		m_wake.notify_one();
+		m_thread.join();
+	}
+
+	void AddEntry(std::string_view command)
+	{
 		{
-			char* err_msg = nullptr;
-			if (sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS entries (entry_timestamp TEXT, pid INTEGER, command TEXT)", nullptr, nullptr, &err_msg) != SQLITE_OK)
-			{
-				WriteChatf("MQ Console Error creating console buffer table: %s", err_msg);
-				sqlite3_free(err_msg);
-				sqlite3_close(db);
-				db = nullptr;
-			}
-			else
-			{
-				if (sqlite3_exec(db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, &err_msg) != SQLITE_OK)
-				{
-					WriteChatf("MQ Console Error setting console buffer journal mode: %s", err_msg);
-					sqlite3_free(err_msg);
-					sqlite3_close(db);
-					db = nullptr;
-				}
-				else
-				{
-					// Fill the history buffer prioritizing this PID and limiting result sets from other PIDs.
-					const char* query = R"(
-						WITH PriorityEntries AS (
-							SELECT entry_timestamp,
-								pid,
-								command,
-								1 AS Priority,
-								MAX(entry_timestamp) OVER() AS LastTimestamp
-							FROM entries
-							WHERE pid = ? -- Prioritize the current PID
-						),
-
-						OtherPIDs AS (
-							SELECT pid,
-								MAX(entry_timestamp) AS LastTimestamp
-							FROM entries
-							WHERE pid != ? -- exclude the current PID
-							GROUP BY pid
-							ORDER BY LastTimeStamp DESC
-							LIMIT 3 -- only get the last 3 processes
-						),
-
-						OtherEntries AS (
-							SELECT oe.entry_timestamp,
-								oe.pid,
-								oe.command,
-								2 AS Priority,
-								op.LastTimeStamp
-							FROM entries oe
-							INNER JOIN OtherPIDs op ON oe.pid = op.pid
-						)
-
-						SELECT command
-						FROM (
-							SELECT *
-							FROM PriorityEntries
-
-							UNION ALL
-
-							SELECT *
-							FROM OtherEntries
-							ORDER BY LastTimestamp DESC -- get the latest entries first
-							LIMIT 50 -- we only want 50 commands since this isn't our original pid anyway
-						)
-						--ORDER BY Priority ASC, LastTimeStamp DESC, pid ASC, entry_timestamp DESC
-						ORDER BY
-							Priority DESC,       -- Sort by the current PID first
-							LastTimeStamp ASC,   -- Then sort by the last timestamp of the other PIDs
-							pid DESC,            -- Then sort by the PID in case there's a tie
-							entry_timestamp ASC  -- Then sort by the timestamp of the entry so they're in order
-					)";
-
-					sqlite3_stmt* stmt;
-			        if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
-			        {
-						WriteChatf("MQ Console Error preparing query for console buffer retrieval: %s", sqlite3_errmsg(db));
-					}
-					else
-					{
-						sqlite3_bind_int(stmt, 1, process_id);
-						sqlite3_bind_int(stmt, 2, process_id);
+			std::scoped_lock lock(m_mutex);
+			m_entries.push_back(Entry{ GetTimestamp(), std::string(command) });
+		}
 
-						while (sqlite3_step(stmt) == SQLITE_ROW)
-						{
-							if (const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)))
-							{
-								history.emplace_back(text);
-							}
-						}
+		m_wake.notify_one();
+	}
 
-						sqlite3_finalize(stmt);
-					}
-				}
-			}
+	// Asks for the page before the ones that have been read. Does nothing if one is on its way or
+	// there is nothing left to read.
+	void RequestPage()
+	{
+		{
+			std::scoped_lock lock(m_mutex);
+			if (m_pageRequested || m_page || m_exhausted)
+				return;
+
+			m_pageRequested = true;
 		}
+
+		m_wake.notify_one();
 	}
-	return history;
-}
 
-void AddEntryToDatabase(sqlite3* db, int process_id, const char* entry)
-{
-	if (db != nullptr)
+	// Takes the page that was read, if it is ready. Oldest entry first.
+	std::optional<std::vector<std::string>> TakePage()
 	{
-		const char* query = "INSERT INTO entries (entry_timestamp, pid, command) VALUES (strftime('%Y-%m-%d %H:%M:%f', 'now', 'localtime'), ?, ?);";
-		sqlite3_stmt* stmt;
-		if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK)
+		std::scoped_lock lock(m_mutex);
+		return std::exchange(m_page, std::nullopt);
+	}
+
+private:
+	struct Entry
+	{
+		std::string timestamp;
+		std::string command;
+	};
+
+	// In the format that strftime('%Y-%m-%d %H:%M:%f', 'now', 'localtime') would give.
+	static std::string GetTimestamp()
+	{
+		SYSTEMTIME time;
+		GetLocalTime(&time);
+
+		return fmt::format("{:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}", time.wYear, time.wMonth, time.wDay,
+			time.wHour, time.wMinute, time.wSecond, time.wMilliseconds);
+	}
+
+	void Run()
+	{
+		bool opened = Open();
+
+		std::unique_lock lock(m_mutex);
+		while (true)
 		{
-			WriteChatf("MQ Console Error preparing query for console buffer insertion: %s", sqlite3_errmsg(db));
+			m_wake.wait(lock, [this] { return m_stopping || !m_entries.empty() || m_pageRequested; });
+
+			std::vector<Entry> entries;
+			entries.swap(m_entries);
+			bool readPage = std::exchange(m_pageRequested, false);
+			bool stopping = m_stopping;
+
+			lock.unlock();
+
+			if (opened && !entries.empty())
+				WriteEntries(entries);
+
+			std::vector<std::string> page;
+			bool exhausted = !opened || (readPage && !ReadPage(page));
+
+			lock.lock();
+
+			if (readPage)
+				m_page = std::move(page);
+			m_exhausted = m_exhausted || exhausted;
+
+			if (stopping)
+				break;
 		}
-		else
+
+		lock.unlock();
+		Close();
+	}
+
+	bool Open()
+	{
+		const std::string dbPath = internal_paths::Logs + "\\ConsoleBuffer.db";
+		if (sqlite3_open_v2(dbPath.c_str(), &m_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_WAL, nullptr) != SQLITE_OK)
 		{
-			sqlite3_bind_int(stmt, 1, process_id);
-			sqlite3_bind_text(stmt, 2, entry, -1, SQLITE_STATIC);
+			SPDLOG_WARN("Console history: error opening database: {}", sqlite3_errmsg(m_db));
+			Close();
+			return false;
+		}
 
-			if (sqlite3_step(stmt) != SQLITE_DONE)
-			{
-				WriteChatf("MQ Console Error inserting into console buffer: %s", sqlite3_errmsg(db));
-			}
+		// other clients write to the same database, wait for their transactions here rather than failing
+		sqlite3_busy_timeout(m_db, 5000);
+
+		char* errMsg = nullptr;
+		if (sqlite3_exec(m_db, "CREATE TABLE IF NOT EXISTS entries (entry_timestamp TEXT, pid INTEGER, command TEXT)", nullptr, nullptr, &errMsg) != SQLITE_OK
+			|| sqlite3_exec(m_db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, &errMsg) != SQLITE_OK)
+		{
+			SPDLOG_WARN("Console history: error setting up database: {}", errMsg ? errMsg : "unknown error");
+			sqlite3_free(errMsg);
+			Close();
+			return false;
+		}
 
-			sqlite3_finalize(stmt);
+		const char* insert = "INSERT INTO entries (entry_timestamp, pid, command) VALUES (?, ?, ?);";
+		if (sqlite3_prepare_v2(m_db, insert, -1, &m_insert, nullptr) != SQLITE_OK)
+		{
+			SPDLOG_WARN("Console history: error preparing insert: {}", sqlite3_errmsg(m_db));
+			Close();
+			return false;
 		}
+
+		return true;
 	}
-}
+
+	void Close()
+	{
+		sqlite3_finalize(std::exchange(m_insert, nullptr));
+		sqlite3_close(std::exchange(m_db, nullptr));
+	}
+
+	void WriteEntries(const std::vector<Entry>& entries)
+	{
+		sqlite3_exec(m_db, "BEGIN;", nullptr, nullptr, nullptr);
+
+		for (const Entry& entry : entries)
+		{
+			sqlite3_bind_text(m_insert, 1, entry.timestamp.c_str(), -1, SQLITE_STATIC);
+			sqlite3_bind_int(m_insert, 2, m_processId);
+			sqlite3_bind_text(m_insert, 3, entry.command.c_str(), -1, SQLITE_STATIC);
+
+			if (sqlite3_step(m_insert) != SQLITE_DONE)
+				SPDLOG_WARN("Console history: error inserting entry: {}", sqlite3_errmsg(m_db));
+
+			sqlite3_reset(m_insert);
+			sqlite3_clear_bindings(m_insert);
+		}
+
+		if (sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK)
+		{
+			SPDLOG_WARN("Console history: error committing entries: {}", sqlite3_errmsg(m_db));
+			sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+		}
+	}
+
+	// Reads the next page, newest first in the query and oldest first in the page. Returns false once
+	// there is nothing left to read.
+	bool ReadPage(std::vector<std::string>& page)
+	{
+		// The history prioritizes this PID and limits the result sets from other PIDs. Entries of this
+		// session are left out, the console already has them.
+		const char* query = R"(
+			WITH PriorityEntries AS (
+				SELECT entry_timestamp,
+					pid,
+					command,
+					1 AS Priority,
+					MAX(entry_timestamp) OVER() AS LastTimestamp
+				FROM entries
+				WHERE pid = ? -- Prioritize the current PID
+					AND entry_timestamp < ? -- from before this session
+			),
+
+			OtherPIDs AS (
+				SELECT pid,
+					MAX(entry_timestamp) AS LastTimestamp
+				FROM entries
+				WHERE pid != ? -- exclude the current PID
+				GROUP BY pid
+				ORDER BY LastTimeStamp DESC
+				LIMIT 3 -- only get the last 3 processes
+			),
+
+			OtherEntries AS (
+				SELECT oe.entry_timestamp,
+					oe.pid,
+					oe.command,
+					2 AS Priority,
+					op.LastTimeStamp
+				FROM entries oe
+				INNER JOIN OtherPIDs op ON oe.pid = op.pid
+			)
+
+			SELECT command
+			FROM (
+				SELECT *
+				FROM PriorityEntries
+
+				UNION ALL
+
+				SELECT *
+				FROM OtherEntries
+				ORDER BY LastTimestamp DESC -- get the latest entries first
+				LIMIT 50 -- we only want 50 commands since this isn't our original pid anyway
+			)
+			ORDER BY
+				Priority ASC,        -- The current PID first
+				LastTimeStamp DESC,  -- Then the other PIDs, latest first
+				pid ASC,             -- Then by the PID in case there's a tie
+				entry_timestamp DESC -- Then the entries of each, latest first
+			LIMIT ? OFFSET ?
+		)";
+
+		sqlite3_stmt* stmt;
+		if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK)
+		{
+			SPDLOG_WARN("Console history: error preparing query: {}", sqlite3_errmsg(m_db));
+			return false;
+		}
+
+		sqlite3_bind_int(stmt, 1, m_processId);
+		sqlite3_bind_text(stmt, 2, m_sessionStart.c_str(), -1, SQLITE_STATIC);
+		sqlite3_bind_int(stmt, 3, m_processId);
+		sqlite3_bind_int(stmt, 4, PageSize);
+		sqlite3_bind_int(stmt, 5, m_rowsRead);
+
+		int rows = 0;
+		while (sqlite3_step(stmt) == SQLITE_ROW)
+		{
+			++rows;
+
+			if (const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)))
+				page.emplace_back(text);
+		}
+
+		sqlite3_finalize(stmt);
+
+		std::reverse(page.begin(), page.end());
+		m_rowsRead += rows;
+
+		return rows == PageSize;
+	}
+
+	const int m_processId;
+	const std::string m_sessionStart;
+
+	// only touched by the thread
+	sqlite3* m_db = nullptr;
+	sqlite3_stmt* m_insert = nullptr;
+	int m_rowsRead = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::vector<Entry> m_entries;
+	std::optional<std::vector<std::string>> m_page;
+	bool m_pageRequested = false;
+	bool m_exhausted = false;
+	bool m_stopping = false;
+
+	std::thread m_thread;
+};
 //============================================================================
 
 #pragma region ImGui Console
@@ -362,19 +513,27 @@ public:
 	char m_inputBuffer[2048];
 	ImVector<const char*> m_commands;
 	std::vector<std::string> m_history;
-	sqlite3* m_db = nullptr;
+	std::unique_ptr<ConsoleHistoryDatabase> m_historyDatabase;
+	bool m_historyRequested = false;
 	int current_pid = GetCurrentProcessId();
 	int m_historyPos = -1;    // -1: new line, 0..History.Size-1 browsing history.
 	bool m_scrollToBottom = true;
 	std::unique_ptr<ImGuiZepConsole> m_zepConsole;
 	bool m_localEcho = true;
 
+	// The text in the console buffer, for the memory accounting.
+	MQMemoryCounters* m_bufferMemory = GetMemoryCounters("Console");
+	size_t m_bufferSize = 0;
+
 	MQConsole()
 	{
 		ZeroMemory(m_inputBuffer, lengthof(m_inputBuffer));
 		m_zepConsole = std::make_unique<ImGuiZepConsole>("##ZepConsole");
 		m_zepConsole->SetDelegate(std::make_shared<MQMainConsoleDelegate>());
 
+		// Chat spam only costs the console anything when it is drawn.
+		m_zepConsole->SetDeferAppend(true);
+
 		m_localEcho = GetPrivateProfileBool("Console", "LocalEcho", m_localEcho, internal_paths::MQini);
 
 		bool autoScroll = GetPrivateProfileBool("Console", "AutoScroll", m_zepConsole->GetAutoScroll(), internal_paths::MQini);
@@ -382,16 +541,47 @@ public:
 
 		int maxBufferLines = GetPrivateProfileInt("Console", "MaxBufferLines", m_zepConsole->GetMaxBufferLines(), internal_paths::MQini);
 		m_zepConsole->SetMaxBufferLines(maxBufferLines);
-		m_history = InitConsoleDatabase(m_db, current_pid);
+
+		// Nothing of the saved history is read until the console is shown.
+		if (s_consolePersistentCommandHistory)
+		{
+			m_historyDatabase = std::make_unique<ConsoleHistoryDatabase>(current_pid);
+		}
 	}
 
 	~MQConsole()
 	{
 		ClearLog();
-		if (m_db != nullptr)
+		m_bufferMemory->Free(std::exchange(m_bufferSize, 0));
+
+		// writes whatever is still queued
+		m_historyDatabase.reset();
+	}
+
+	// Puts a page of saved history in front of what is in the history, once it has been read.
+	void CollectHistoryPage()
+	{
+		if (!m_historyDatabase)
+			return;
+
+		std::optional<std::vector<std::string>> page = m_historyDatabase->TakePage();
+		if (!page)
+			return;
+
+		// anything that was run again in this session is already in the history
+		std::vector<std::string> older;
+		for (std::string& entry : *page)
 		{
-			sqlite3_close(m_db);
+			if (std::none_of(m_history.begin(), m_history.end(),
+				[&](const std::string& existing) { return ci_equals(existing, entry); }))
+			{
+				older.push_back(std::move(entry));
+			}
 		}
+
+		m_history.insert(m_history.begin(), std::make_move_iterator(older.begin()), std::make_move_iterator(older.end()));
+		if (m_historyPos != -1)
+			m_historyPos += static_cast<int>(older.size());
 	}
 
 	void ClearLog()
@@ -421,6 +611,14 @@ public:
 
 	void Draw(bool* pOpen)
 	{
+		if (m_historyDatabase)
+		{
+			if (!std::exchange(m_historyRequested, true))
+				m_historyDatabase->RequestPage();
+
+			CollectHistoryPage();
+		}
+
 		ImGuiWindowFlags windowFlags = ImGuiWindowFlags_MenuBar;
 
 		ImGui::SetNextWindowSize(ImVec2(640, 240), ImGuiCond_FirstUseEver);
@@ -531,6 +729,10 @@ public:
 
 		m_zepConsole->Render(contentSize);
 
+		const size_t bufferSize = m_zepConsole->GetActiveBuffer()->GetWorkingBuffer().size();
+		m_bufferMemory->Resize(m_bufferSize, bufferSize);
+		m_bufferSize = bufferSize;
+
 		// Command-line
 		ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, ImVec2(2, 4));
 		ImGui::Separator();
@@ -593,7 +795,9 @@ public:
 			}
 		}
 		m_history.emplace_back(commandLine);
-		AddEntryToDatabase(m_db, current_pid, commandLine);
+
+		if (m_historyDatabase)
+			m_historyDatabase->AddEntry(commandLine);
 
 		// Process command
 		if (ci_equals(commandLine, "clear"))
@@ -652,16 +856,22 @@ public:
 			}
 
 			// Build a list of candidates
-			ImVector<const char*> candidates;
+			std::vector<std::string> candidates;
 			std::string_view word{ word_start, (size_t)(word_end - word_start) };
 
 			for (int i = 0; i < m_commands.Size; i++)
 			{
 				if (ci_starts_with(m_commands[i], word))
-					candidates.push_back(m_commands[i]);
+					candidates.emplace_back(m_commands[i]);
 			}
 
-			if (candidates.Size == 0)
+			if (!word.empty() && word[0] == '/')
+			{
+				std::vector<std::string> commands = pCommandAPI->GetCompletions(word);
+				candidates.insert(candidates.end(), commands.begin(), commands.end());
+			}
+
+			if (candidates.empty())
 			{
 				// No match
 				AddLog("No match for \"{0}\"!\n", word);
@@ -670,7 +880,7 @@ public:
 			{
 				// Single match. Delete the beginning of the word and replace it entirely so we've got nice casing
 				data->DeleteChars((int)(word_start - data->Buf), (int)(word_end - word_start));
-				data->InsertChars(data->CursorPos, candidates[0]);
+				data->InsertChars(data->CursorPos, candidates[0].c_str());
 				data->InsertChars(data->CursorPos, " ");
 			}
 			else
@@ -681,7 +891,7 @@ public:
 				{
 					int c = 0;
 					bool all_candidates_matches = true;
-					for (int i = 0; i < candidates.Size && all_candidates_matches; i++)
+					for (size_t i = 0; i < candidates.size() && all_candidates_matches; i++)
 						if (i == 0)
 							c = toupper(candidates[i][match_len]);
 						else if (c == 0 || c != toupper(candidates[i][match_len]))
@@ -694,13 +904,13 @@ public:
 				if (match_len > 0)
 				{
 					data->DeleteChars((int)(word_start - data->Buf), (int)(word_end - word_start));
-					data->InsertChars(data->CursorPos, candidates[0], candidates[0] + match_len);
+					data->InsertChars(data->CursorPos, candidates[0].c_str(), candidates[0].c_str() + match_len);
 				}
 
 				// List matches
 				AddLog("Possible matches:\n");
-				for (int i = 0; i < candidates.Size; i++)
-					AddLog("- {0}\n", candidates[i]);
+				for (const std::string& candidate : candidates)
+					AddLog("- {0}\n", candidate);
 			}
 
 			break;
@@ -709,6 +919,7 @@ public:
 		case ImGuiInputTextFlags_CallbackHistory:
 		{
 			// Example of HISTORY
+			CollectHistoryPage();
 			const int prev_history_pos = m_historyPos;
 			if (data->EventKey == ImGuiKey_UpArrow)
 			{
@@ -716,6 +927,10 @@ public:
 					m_historyPos = static_cast<int>(m_history.size()) - 1;
 				else if (m_historyPos > 0)
 					m_historyPos--;
+
+				// read the page before this one a little ahead of reaching the start
+				if (m_historyDatabase && m_historyPos < ConsoleHistoryDatabase::PageSize / 2)
+					m_historyDatabase->RequestPage();
 			}
 			else if (data->EventKey == ImGuiKey_DownArrow)
 			{
@@ -747,6 +962,7 @@ public:
 		static int hyperlinkNum = 1;
 		std::string text = fmt::format("This is hyperlink {}", hyperlinkNum++);
 
+		m_zepConsole->FlushPendingText();
 		m_zepConsole->InsertHyperlink(m_zepConsole->GetActiveBuffer()->End(), text,
 			ZepAttribute::HyperlinkAttributeData{ fmt::format("testlink:{}'s data", text) });
 		m_zepConsole->InsertText(m_zepConsole->GetActiveBuffer()->End(), "\n");
@@ -1097,14 +1313,21 @@ void ShutdownImGuiConsole()
 	RemoveCommand("/mqconsole");
 }
 
-DWORD ImGuiConsoleAddText(const char* line, DWORD color, DWORD filter)
+void ImGuiConsoleAddLines(const std::vector<MQChatLine>& lines)
 {
-	MQColor col = GetColorForChatColor(color);
+	if (!gMQConsole)
+		return;
 
-	if (gMQConsole)
-		gMQConsole->AddWriteChatColorLog(line, col, true);
+	// A burst of chat can be longer than the console keeps, skip the lines that would just be pruned.
+	size_t first = 0;
+	const int maxBufferLines = gMQConsole->m_zepConsole->GetMaxBufferLines();
+	if (maxBufferLines > 0 && lines.size() > static_cast<size_t>(maxBufferLines))
+		first = lines.size() - maxBufferLines;
 
-	return 0;
+	for (size_t i = first; i < lines.size(); ++i)
+	{
+		gMQConsole->AddWriteChatColorLog(lines[i].text.c_str(), GetColorForChatColor(lines[i].color), true);
+	}
 }
 
 } // namespace mq
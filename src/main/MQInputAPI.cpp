@@ -66,6 +66,15 @@ enum class ItemClickStatus
 
 static ItemClickStatus s_groundItemClickStatus = ItemClickStatus::None;
 
+// Device data from input sequences, waiting for the next GetDeviceData call of their device.
+static std::vector<DIDEVICEOBJECTDATA> s_pendingKeyboardData;
+static std::vector<DIDEVICEOBJECTDATA> s_pendingMouseData;
+
+// How many sequences hold each key and mouse button down. Held keys and buttons are added to the
+// device state, since EQ polls the state for some of them rather than reading the data.
+static uint8_t s_heldKeys[256] = {};
+static uint8_t s_heldMouseButtons[NUM_MOUSE_BUTTONS] = {};
+
 class CDisplay_Detour
 {
 public:
@@ -91,11 +100,54 @@ public:
 };
 
 DETOUR_TRAMPOLINE_DEF(HRESULT CALLBACK, DInput_GetDeviceData_Trampoline, (IDirectInputDevice8A* This, DWORD cbObjectData, LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags))
+
+// Copies as much of the pending data as fits, then fills the rest of the buffer from the device.
+static HRESULT GetDeviceDataWithPending(std::vector<DIDEVICEOBJECTDATA>& pending, IDirectInputDevice8A* This,
+	DWORD cbObjectData, LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags)
+{
+	if (pending.empty() || rgdod == nullptr || *pdwInOut == 0)
+		return DInput_GetDeviceData_Trampoline(This, cbObjectData, rgdod, pdwInOut, dwFlags);
+
+	// The caller's structure can be the smaller DirectX 3 one, without uAppData.
+	const size_t copySize = std::min<size_t>(cbObjectData, sizeof(DIDEVICEOBJECTDATA));
+	uint8_t* buffer = reinterpret_cast<uint8_t*>(rgdod);
+
+	const DWORD capacity = *pdwInOut;
+	const DWORD count = std::min<DWORD>(capacity, static_cast<DWORD>(pending.size()));
+
+	for (DWORD i = 0; i < count; ++i)
+		memcpy(buffer + i * cbObjectData, &pending[i], copySize);
+
+	if ((dwFlags & DIGDD_PEEK) == 0)
+		pending.erase(pending.begin(), pending.begin() + count);
+
+	DWORD remaining = capacity - count;
+	if (remaining > 0)
+	{
+		HRESULT hResult = DInput_GetDeviceData_Trampoline(This, cbObjectData,
+			reinterpret_cast<LPDIDEVICEOBJECTDATA>(buffer + count * cbObjectData), &remaining, dwFlags);
+
+		if (FAILED(hResult))
+			remaining = 0;
+	}
+
+	*pdwInOut = count + remaining;
+	return DI_OK;
+}
+
 HRESULT CALLBACK DInput_GetDeviceData_Detour(IDirectInputDevice8A* This, DWORD cbObjectData, LPDIDEVICEOBJECTDATA rgdod, LPDWORD pdwInOut, DWORD dwFlags)
 {
 	s_inGetDeviceData = true;
 	DWORD dwInOutSave = *pdwInOut;
 
+	if (!gbUnload && This == g_pDIKeyboard && !s_pendingKeyboardData.empty())
+	{
+		HRESULT hResult = GetDeviceDataWithPending(s_pendingKeyboardData, This, cbObjectData, rgdod, pdwInOut, dwFlags);
+
+		s_inGetDeviceData = false;
+		return hResult;
+	}
+
 	if (!gbUnload && This == g_pDIMouse)
 	{
 		// If we are waiting for a click-event to be confirmed by EQ, don't
@@ -148,6 +200,14 @@ HRESULT CALLBACK DInput_GetDeviceData_Detour(IDirectInputDevice8A* This, DWORD c
 			s_inGetDeviceData = false;
 			return DI_OK;
 		}
+
+		if (!s_pendingMouseData.empty())
+		{
+			HRESULT hResult = GetDeviceDataWithPending(s_pendingMouseData, This, cbObjectData, rgdod, pdwInOut, dwFlags);
+
+			s_inGetDeviceData = false;
+			return hResult;
+		}
 	}
 
 	// If we didn't add any keyboard data, and we aren't waiting for a click,
@@ -178,6 +238,23 @@ HRESULT CALLBACK DInput_GetDeviceState_Detour(IDirectInputDevice8A* This, DWORD
 			data->rgbButtons[0] = g_pDeviceInputProxy->mouse.CurrentClickState[0];
 			data->rgbButtons[1] = g_pDeviceInputProxy->mouse.CurrentClickState[1];
 		}
+
+		const int buttons = cbData == sizeof(DIMOUSESTATE2) ? 8 : 4;
+		for (int button = 0; button < buttons && button < NUM_MOUSE_BUTTONS; ++button)
+		{
+			if (s_heldMouseButtons[button])
+				static_cast<LPDIMOUSESTATE2>(lpvData)->rgbButtons[button] = 0x80;
+		}
+	}
+	else if (!gbUnload && This == g_pDIKeyboard && cbData == sizeof(s_heldKeys) && SUCCEEDED(hResult))
+	{
+		uint8_t* keys = static_cast<uint8_t*>(lpvData);
+
+		for (int key = 0; key < 256; ++key)
+		{
+			if (s_heldKeys[key])
+				keys[key] = 0x80;
+		}
 	}
 
 	s_inGetDeviceState = false;
@@ -685,6 +762,414 @@ void MouseTo(PlayerClient* pChar, const char* szLine)
 	DebugSpew("Help invoked or Bad MouseTo command: %s", szLine);
 }
 
+//============================================================================
+// Input sequences
+
+struct MQInputSequence
+{
+	uint32_t id = 0;
+	std::vector<MQInputAction> actions;
+	size_t next = 0;
+	MQInputSequenceCallback callback;
+	bool blocksMacro = false;
+
+	// When the current action started, and where the mouse was then for moves.
+	bool actionStarted = false;
+	std::chrono::steady_clock::time_point actionStart;
+	int moveFromX = 0;
+	int moveFromY = 0;
+
+	// What this sequence holds, so that it can be released when it is cancelled.
+	std::vector<uint8_t> heldKeys;
+	std::vector<int> heldButtons;
+};
+
+static std::vector<MQInputSequence> s_inputSequences;
+static uint32_t s_nextInputSequenceId = 0;
+
+static void QueueDeviceData(std::vector<DIDEVICEOBJECTDATA>& pending, DWORD offset, bool pressed)
+{
+	DIDEVICEOBJECTDATA data = {};
+	data.dwOfs = offset;
+	data.dwData = pressed ? 0x80 : 0;
+	data.dwTimeStamp = GetTickCount();
+
+	pending.push_back(data);
+}
+
+static void SetInputKey(MQInputSequence& sequence, uint8_t key, bool pressed)
+{
+	if (pressed)
+	{
+		if (s_heldKeys[key] < 0xff)
+			++s_heldKeys[key];
+		sequence.heldKeys.push_back(key);
+	}
+	else
+	{
+		auto iter = std::find(sequence.heldKeys.begin(), sequence.heldKeys.end(), key);
+		if (iter != sequence.heldKeys.end())
+		{
+			sequence.heldKeys.erase(iter);
+			if (s_heldKeys[key] > 0)
+				--s_heldKeys[key];
+		}
+	}
+
+	QueueDeviceData(s_pendingKeyboardData, key, pressed);
+}
+
+static void SetInputButton(MQInputSequence& sequence, int button, bool pressed)
+{
+	if (button < 0 || button >= NUM_MOUSE_BUTTONS)
+		return;
+
+	if (pressed)
+	{
+		if (s_heldMouseButtons[button] < 0xff)
+			++s_heldMouseButtons[button];
+		sequence.heldButtons.push_back(button);
+	}
+	else
+	{
+		auto iter = std::find(sequence.heldButtons.begin(), sequence.heldButtons.end(), button);
+		if (iter != sequence.heldButtons.end())
+		{
+			sequence.heldButtons.erase(iter);
+			if (s_heldMouseButtons[button] > 0)
+				--s_heldMouseButtons[button];
+		}
+	}
+
+	QueueDeviceData(s_pendingMouseData, DIMOFS_BUTTON0 + button, pressed);
+}
+
+static void ReleaseInputSequence(MQInputSequence& sequence)
+{
+	while (!sequence.heldKeys.empty())
+		SetInputKey(sequence, sequence.heldKeys.back(), false);
+
+	while (!sequence.heldButtons.empty())
+		SetInputButton(sequence, sequence.heldButtons.back(), false);
+}
+
+// Modifiers are pressed before the key and released after it, like they would be on a keyboard.
+static void SetInputKeyCombo(MQInputSequence& sequence, const KeyCombo& combo, bool pressed)
+{
+	const uint8_t modifiers[] = {
+		combo.Data[0] ? static_cast<uint8_t>(DIK_LMENU) : uint8_t{ 0 },
+		combo.Data[1] ? static_cast<uint8_t>(DIK_LCONTROL) : uint8_t{ 0 },
+		combo.Data[2] ? static_cast<uint8_t>(DIK_LSHIFT) : uint8_t{ 0 },
+	};
+
+	if (pressed)
+	{
+		for (uint8_t modifier : modifiers)
+		{
+			if (modifier)
+				SetInputKey(sequence, modifier, true);
+		}
+
+		SetInputKey(sequence, static_cast<uint8_t>(combo.Data[3]), true);
+	}
+	else
+	{
+		SetInputKey(sequence, static_cast<uint8_t>(combo.Data[3]), false);
+
+		for (uint8_t modifier : modifiers)
+		{
+			if (modifier)
+				SetInputKey(sequence, modifier, false);
+		}
+	}
+}
+
+// Runs the actions of the sequence that are due. Returns true once the last one is done.
+static bool RunInputSequence(MQInputSequence& sequence, std::chrono::steady_clock::time_point now)
+{
+	while (sequence.next < sequence.actions.size())
+	{
+		const MQInputAction& action = sequence.actions[sequence.next];
+
+		if (!sequence.actionStarted)
+		{
+			sequence.actionStarted = true;
+			sequence.actionStart = now;
+			sequence.moveFromX = EQADDR_MOUSE->X;
+			sequence.moveFromY = EQADDR_MOUSE->Y;
+		}
+
+		const auto elapsed = now - sequence.actionStart;
+		bool endFrame = false;
+
+		switch (action.Type)
+		{
+		case MQInputActionType::KeyDown:
+		case MQInputActionType::KeyUp:
+			SetInputKeyCombo(sequence, action.Key, action.Type == MQInputActionType::KeyDown);
+
+			// A press and its release have to be seen on different frames.
+			endFrame = action.Type == MQInputActionType::KeyDown;
+			break;
+
+		case MQInputActionType::MouseDown:
+		case MQInputActionType::MouseUp:
+			SetInputButton(sequence, action.Button, action.Type == MQInputActionType::MouseDown);
+			endFrame = action.Type == MQInputActionType::MouseDown;
+			break;
+
+		case MQInputActionType::MouseMove:
+			if (elapsed < action.Duration)
+			{
+				const float t = std::chrono::duration<float>(elapsed) / action.Duration;
+
+				MoveMouse(sequence.moveFromX + static_cast<int>((action.X - sequence.moveFromX) * t),
+					sequence.moveFromY + static_cast<int>((action.Y - sequence.moveFromY) * t));
+				return false;
+			}
+
+			MoveMouse(action.X, action.Y);
+			endFrame = true;
+			break;
+
+		case MQInputActionType::Wait:
+			if (elapsed < action.Duration)
+				return false;
+			break;
+		}
+
+		++sequence.next;
+		sequence.actionStarted = false;
+
+		if (endFrame)
+			break;
+	}
+
+	return sequence.next >= sequence.actions.size();
+}
+
+static void PulseInputSequences()
+{
+	if (s_inputSequences.empty())
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < s_inputSequences.size();)
+	{
+		MQInputSequence& sequence = s_inputSequences[i];
+
+		if (!RunInputSequence(sequence, now))
+		{
+			++i;
+			continue;
+		}
+
+		// Anything the sequence didn't release itself is released when it ends.
+		ReleaseInputSequence(sequence);
+
+		MQInputSequenceCallback callback = std::move(sequence.callback);
+		const uint32_t id = sequence.id;
+		s_inputSequences.erase(s_inputSequences.begin() + i);
+
+		if (callback)
+			callback(id, true);
+	}
+}
+
+uint32_t QueueInputSequence(std::vector<MQInputAction> actions, MQInputSequenceCallback callback)
+{
+	if (actions.empty())
+		return 0;
+
+	if (++s_nextInputSequenceId == 0)
+		++s_nextInputSequenceId;
+
+	MQInputSequence& sequence = s_inputSequences.emplace_back();
+	sequence.id = s_nextInputSequenceId;
+	sequence.actions = std::move(actions);
+	sequence.callback = std::move(callback);
+
+	WeDidStuff();
+	return sequence.id;
+}
+
+bool IsInputSequenceRunning(uint32_t id)
+{
+	return std::any_of(s_inputSequences.begin(), s_inputSequences.end(),
+		[id](const MQInputSequence& sequence) { return sequence.id == id; });
+}
+
+void CancelInputSequence(uint32_t id)
+{
+	auto iter = std::find_if(s_inputSequences.begin(), s_inputSequences.end(),
+		[id](const MQInputSequence& sequence) { return sequence.id == id; });
+	if (iter == s_inputSequences.end())
+		return;
+
+	ReleaseInputSequence(*iter);
+
+	MQInputSequenceCallback callback = std::move(iter->callback);
+	s_inputSequences.erase(iter);
+
+	if (callback)
+		callback(id, false);
+}
+
+bool IsMacroWaitingForInputSequence()
+{
+	return std::any_of(s_inputSequences.begin(), s_inputSequences.end(),
+		[](const MQInputSequence& sequence) { return sequence.blocksMacro; });
+}
+
+static bool ParseInputButton(const char* szButton, int& button)
+{
+	if (ci_equals(szButton, "left"))
+		button = 0;
+	else if (ci_equals(szButton, "right"))
+		button = 1;
+	else if (ci_equals(szButton, "middle"))
+		button = 2;
+	else
+	{
+		button = GetIntFromString(szButton, -1);
+		if (button < 0 || button >= NUM_MOUSE_BUTTONS)
+			return false;
+	}
+
+	return true;
+}
+
+// Parses one "action:argument[:milliseconds]" step of /inputsequence.
+static bool ParseInputStep(const char* szStep, std::vector<MQInputAction>& actions)
+{
+	char szAction[MAX_STRING] = { 0 };
+	strcpy_s(szAction, szStep);
+
+	char* szArgument = strchr(szAction, ':');
+	if (szArgument)
+		*szArgument++ = 0;
+	else
+		szArgument = szAction + strlen(szAction);
+
+	char* szTime = strchr(szArgument, ':');
+	if (szTime)
+		*szTime++ = 0;
+
+	const auto duration = std::chrono::milliseconds(szTime ? std::max(0, GetIntFromString(szTime, 0)) : 0);
+
+	MQInputAction action;
+
+	if (ci_equals(szAction, "wait"))
+	{
+		action.Type = MQInputActionType::Wait;
+		action.Duration = std::chrono::milliseconds(std::max(0, GetIntFromString(szArgument, 0)));
+		actions.push_back(action);
+		return true;
+	}
+
+	if (ci_equals(szAction, "down") || ci_equals(szAction, "up") || ci_equals(szAction, "press"))
+	{
+		if (!ParseKeyCombo(szArgument, action.Key))
+			return false;
+
+		if (!ci_equals(szAction, "up"))
+		{
+			action.Type = MQInputActionType::KeyDown;
+			actions.push_back(action);
+		}
+
+		if (ci_equals(szAction, "press"))
+			actions.push_back(MQInputAction{ MQInputActionType::Wait, {}, 0, 0, 0, duration });
+
+		if (!ci_equals(szAction, "down"))
+		{
+			action.Type = MQInputActionType::KeyUp;
+			actions.push_back(action);
+		}
+		return true;
+	}
+
+	if (ci_equals(szAction, "mousedown") || ci_equals(szAction, "mouseup") || ci_equals(szAction, "click"))
+	{
+		if (!ParseInputButton(szArgument, action.Button))
+			return false;
+
+		if (!ci_equals(szAction, "mouseup"))
+		{
+			action.Type = MQInputActionType::MouseDown;
+			actions.push_back(action);
+		}
+
+		if (ci_equals(szAction, "click"))
+			actions.push_back(MQInputAction{ MQInputActionType::Wait, {}, 0, 0, 0, duration });
+
+		if (!ci_equals(szAction, "mousedown"))
+		{
+			action.Type = MQInputActionType::MouseUp;
+			actions.push_back(action);
+		}
+		return true;
+	}
+
+	if (ci_equals(szAction, "move"))
+	{
+		char* szY = strchr(szArgument, ',');
+		if (!szY)
+			return false;
+		*szY++ = 0;
+
+		action.Type = MQInputActionType::MouseMove;
+		action.X = GetIntFromString(szArgument, 0);
+		action.Y = GetIntFromString(szY, 0);
+		action.Duration = duration;
+		actions.push_back(action);
+		return true;
+	}
+
+	return false;
+}
+
+// ***************************************************************************
+// Function: InputSequence
+// Description: Our '/inputsequence' command
+// Runs a sequence of timed key and mouse actions. A macro waits for it to finish.
+// Usage: /inputsequence <step> [<step> ...]
+//     down:<keycombo>  up:<keycombo>  press:<keycombo>[:holdms]
+//     mousedown:<button>  mouseup:<button>  click:<button>[:holdms]
+//     move:<x>,<y>[:ms]  wait:<ms>
+// ***************************************************************************
+void InputSequence(PlayerClient* pChar, const char* szLine)
+{
+	std::vector<MQInputAction> actions;
+
+	char szStep[MAX_STRING] = { 0 };
+	for (int index = 1; GetArg(szStep, szLine, index)[0] != 0; ++index)
+	{
+		if (!ParseInputStep(szStep, actions))
+		{
+			MacroError("/inputsequence: invalid step '%s'", szStep);
+			return;
+		}
+	}
+
+	if (actions.empty())
+	{
+		SyntaxError("Usage: /inputsequence <down|up|press:keycombo[:ms]|mousedown|mouseup|click:button[:ms]|move:x,y[:ms]|wait:ms> ...");
+		return;
+	}
+
+	const uint32_t id = QueueInputSequence(std::move(actions));
+
+	if (GetCurrentMacroBlock())
+	{
+		auto iter = std::find_if(s_inputSequences.begin(), s_inputSequences.end(),
+			[id](const MQInputSequence& sequence) { return sequence.id == id; });
+		if (iter != s_inputSequences.end())
+			iter->blocksMacro = true;
+	}
+}
+
 static void InstallDirectInputHooks()
 {
 	// hook ProcessDeviceEvents
@@ -762,6 +1247,12 @@ void InputAPI_Shutdown()
 	}
 
 	RemoveDetour(__ProcessDeviceEvents);
+
+	s_inputSequences.clear();
+	s_pendingKeyboardData.clear();
+	s_pendingMouseData.clear();
+	std::fill(std::begin(s_heldKeys), std::end(s_heldKeys), uint8_t{ 0 });
+	std::fill(std::begin(s_heldMouseButtons), std::end(s_heldMouseButtons), uint8_t{ 0 });
 }
 
 void InputAPI_Pulse()
@@ -769,13 +1260,9 @@ void InputAPI_Pulse()
 	if (!s_dinputInitialized)
 	{
 		InstallDirectInputHooks();
-
-		// If we're initialized we do not need to pulse anymore.
-		if (s_dinputInitialized)
-		{
-			s_inputAPIModule.Pulse = nullptr;
-		}
 	}
+
+	PulseInputSequences();
 }
 
 } // namespace mq
@@ -20,8 +20,128 @@
 #include <mq/api/Inventory.h>
 #include "eqlib/Items.h"
 
+#include <array>
+
 namespace mq {
 
+//----------------------------------------------------------------------------
+// Slot statistics
+//
+// Looting and selling loops ask for the free slots again and again, for different sizes. The slots
+// of the bags and of the bank are counted for every size at once, and the counts are kept until
+// the next pulse. Within a pulse items only change places by way of the cursor, so the counts are
+// also dropped when the cursor holds a different item than it did when they were made.
+
+// Indexed by the size of item the slots have to hold. The last one is for sizes that no container
+// holds, where only empty top level slots are left.
+static constexpr int SlotStatisticsSizes = ItemSize_Giant + 2;
+
+struct SlotStatistics
+{
+	bool valid = false;
+	eqlib::PcProfile* pProfile = nullptr;
+	eqlib::ItemPtr pCursorItem;
+	int topLevelSlots = 0;
+
+	std::array<int, SlotStatisticsSizes> slots{};       // every slot, occupied or not
+	std::array<int, SlotStatisticsSizes> freeSlots{};
+};
+
+static SlotStatistics s_bagStatistics;
+static SlotStatistics s_bankStatistics;
+
+void ClearInventorySlotStatistics()
+{
+	s_bagStatistics = SlotStatistics();
+	s_bankStatistics = SlotStatistics();
+}
+
+static int GetSlotStatisticsIndex(int nSize)
+{
+	return std::clamp(nSize, 0, SlotStatisticsSizes - 1);
+}
+
+static void CountSlots(eqlib::ItemContainer& container, int firstSlot, int lastSlot, SlotStatistics& stats)
+{
+	stats.slots.fill(0);
+	stats.freeSlots.fill(0);
+
+	for (int slot = firstSlot; slot <= lastSlot; ++slot)
+	{
+		const eqlib::ItemPtr pItem = container.GetItem(slot);
+
+		// No item in slot, it counts for every size
+		if (!pItem)
+		{
+			for (int size = 0; size < SlotStatisticsSizes; ++size)
+			{
+				stats.slots[size]++;
+				stats.freeSlots[size]++;
+			}
+			continue;
+		}
+
+		// Not a container, it is one occupied slot
+		if (!pItem->IsContainer())
+		{
+			for (int size = 0; size < SlotStatisticsSizes; ++size)
+				stats.slots[size]++;
+			continue;
+		}
+
+		const int capacity = pItem->GetItemDefinition()->SizeCapacity;
+		const int containerSize = pItem->GetHeldItems().GetSize();
+		const int containerFree = containerSize - static_cast<int>(pItem->GetHeldItems().GetCount());
+
+		for (int size = 0; size < SlotStatisticsSizes; ++size)
+		{
+			// A container too small for the size is one occupied slot
+			if (size == 0 || capacity >= size)
+			{
+				stats.slots[size] += containerSize;
+				stats.freeSlots[size] += containerFree;
+			}
+			else
+			{
+				stats.slots[size]++;
+			}
+		}
+	}
+}
+
+static const SlotStatistics* GetSlotStatistics(SlotStatistics& stats, eqlib::ItemContainer& container,
+	int firstSlot, int lastSlot, SlotStatistics& scratch)
+{
+	eqlib::PcProfile* pProfile = GetPcProfile();
+	if (!pProfile)
+		return nullptr;
+
+	const int topLevelSlots = lastSlot - firstSlot + 1;
+	eqlib::ItemPtr pCursorItem = pProfile->InventoryContainer.GetItem(InvSlot_Cursor);
+
+	// Only the main thread is in step with the pulse.
+	if (!IsMainThread())
+	{
+		CountSlots(container, firstSlot, lastSlot, scratch);
+		return &scratch;
+	}
+
+	if (!stats.valid
+		|| stats.pProfile != pProfile
+		|| stats.pCursorItem != pCursorItem
+		|| stats.topLevelSlots != topLevelSlots)
+	{
+		CountSlots(container, firstSlot, lastSlot, stats);
+
+		stats.valid = true;
+		stats.pProfile = pProfile;
+		stats.pCursorItem = std::move(pCursorItem);
+		stats.topLevelSlots = topLevelSlots;
+	}
+
+	return &stats;
+}
+
 /**
  * Get the number of bank slots based on the given size and whether it is empty (free).
  * @param nSize Minimum size capacity of a container item to be considered.
@@ -33,41 +153,37 @@ int GetBankSlotCount(int nSize, bool bEmptyOnly /* = false */)
 	if (!eqlib::pLocalPC || !eqlib::pLocalPlayer)
 		return 0;
 
-	int numSlots = 0;
-	const int availableSlots = GetAvailableBankSlots();
-
 	// Bind the size to a valid range.
 	nSize = std::clamp(nSize, static_cast<int>(ItemSize_Tiny), static_cast<int>(ItemSize_Giant));
 
-	for (int slot = 0; slot < availableSlots; ++slot)
-	{
-		if (const eqlib::ItemPtr pItem = pLocalPC->BankItems.GetItem(slot))
-		{
-			if (pItem->IsContainer()
-				&& (nSize == 0 || pItem->GetItemDefinition()->SizeCapacity >= nSize))
-			{
-				// Add the container size
-				numSlots += pItem->GetHeldItems().GetSize();
-				// If only empty slots are considered, deduct the occupied slots.
-				if (bEmptyOnly)
-				{
-					numSlots -= static_cast<int>(pItem->GetHeldItems().GetCount());
-				}
-			}
-			// Not a container, so only count it if we're not looking for empty slots.
-			else if (!bEmptyOnly)
-			{
-				numSlots++;
-			}
-		}
-		// No item in slot, increment
-		else
-		{
-			numSlots++;
-		}
-	}
+	SlotStatistics scratch;
+	const SlotStatistics* stats = GetSlotStatistics(s_bankStatistics, pLocalPC->BankItems,
+		0, GetAvailableBankSlots() - 1, scratch);
+	if (!stats)
+		return 0;
+
+	const int index = GetSlotStatisticsIndex(nSize);
+	return bEmptyOnly ? stats->freeSlots[index] : stats->slots[index];
+}
+
+/**
+ * Get the number of free slots in the bags and the empty bag slots.
+ * @param nSize Minimum size capacity of a container item to be considered.
+ * @return Number of free slots.
+ */
+int GetFreeInventory(int nSize)
+{
+	PcProfile* pProfile = GetPcProfile();
+	if (!pProfile)
+		return 0;
+
+	SlotStatistics scratch;
+	const SlotStatistics* stats = GetSlotStatistics(s_bagStatistics, pProfile->InventoryContainer,
+		InvSlot_FirstBagSlot, GetHighestAvailableBagSlot(), scratch);
+	if (!stats)
+		return 0;
 
-	return numSlots;
+	return stats->freeSlots[GetSlotStatisticsIndex(nSize)];
 }
 
-} // namespace mq
\ No newline at end of file
+} // namespace mq
@@ -0,0 +1,261 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQMacroCache.h"
+
+#include <fstream>
+
+namespace mq {
+
+// Bump whenever the layout of the file, or what AddMacroLine does with the lines, changes.
+static constexpr uint32_t MacroCacheMagic = 0x3143514d; // "MQC1"
+static constexpr uint32_t MacroCacheVersion = 1;
+
+void MQMacroCache::AddLine(std::string_view fileName, std::string_view text, int lineNumber)
+{
+	// Lines come in runs from the same file, so check the file of the previous line first.
+	uint32_t fileIndex = Lines.empty() ? 0 : Lines.back().FileIndex;
+	if (fileIndex >= Files.size() || Files[fileIndex] != fileName)
+	{
+		auto iter = std::find(Files.begin(), Files.end(), fileName);
+		if (iter == Files.end())
+			iter = Files.emplace(Files.end(), fileName);
+
+		fileIndex = static_cast<uint32_t>(iter - Files.begin());
+	}
+
+	Line& line = Lines.emplace_back();
+	line.FileIndex = fileIndex;
+	line.LineNumber = lineNumber;
+	line.Text = text;
+}
+
+static MQMacroCache::Dependency GetDependency(const std::filesystem::path& path)
+{
+	MQMacroCache::Dependency dependency;
+	dependency.Path = path.string();
+
+	std::error_code ec;
+	const auto size = std::filesystem::file_size(path, ec);
+	if (ec)
+		return dependency;
+
+	const auto writeTime = std::filesystem::last_write_time(path, ec);
+	if (ec)
+		return dependency;
+
+	dependency.Exists = true;
+	dependency.Size = size;
+	dependency.WriteTime = writeTime.time_since_epoch().count();
+	return dependency;
+}
+
+void MQMacroCache::AddDependency(const std::filesystem::path& path)
+{
+	Dependencies.push_back(GetDependency(path));
+}
+
+//----------------------------------------------------------------------------
+
+static std::filesystem::path GetMacroCachePath(const std::filesystem::path& macroPath)
+{
+	// Macros in different folders can share a name, so the file is named after a hash of the path.
+	uint64_t hash = 14695981039346656037ULL;
+	for (char ch : macroPath.string())
+	{
+		hash ^= static_cast<uint8_t>(::tolower(static_cast<unsigned char>(ch)));
+		hash *= 1099511628211ULL;
+	}
+
+	return std::filesystem::path(mq::internal_paths::Macros) / "cache"
+		/ fmt::format("{}_{:016x}.mqc", macroPath.stem().string(), hash);
+}
+
+class MacroCacheReader
+{
+public:
+	explicit MacroCacheReader(std::string_view data) : m_data(data) {}
+
+	bool IsValid() const { return m_valid; }
+
+	template <typename T>
+	T Read()
+	{
+		T value = T();
+		if (m_pos + sizeof(T) > m_data.size())
+		{
+			m_valid = false;
+			return value;
+		}
+
+		memcpy(&value, m_data.data() + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return value;
+	}
+
+	std::string ReadString()
+	{
+		const uint32_t length = Read<uint32_t>();
+		if (!m_valid || m_pos + length > m_data.size())
+		{
+			m_valid = false;
+			return std::string();
+		}
+
+		std::string value{ m_data.substr(m_pos, length) };
+		m_pos += length;
+		return value;
+	}
+
+private:
+	std::string_view m_data;
+	size_t m_pos = 0;
+	bool m_valid = true;
+};
+
+class MacroCacheWriter
+{
+public:
+	template <typename T>
+	void Write(T value)
+	{
+		m_data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void WriteString(std::string_view value)
+	{
+		Write(static_cast<uint32_t>(value.size()));
+		m_data.append(value);
+	}
+
+	const std::string& GetData() const { return m_data; }
+
+private:
+	std::string m_data;
+};
+
+bool LoadMacroCache(const std::filesystem::path& macroPath, MQMacroCache& cache)
+{
+	std::ifstream file(GetMacroCachePath(macroPath), std::ios::binary);
+	if (!file)
+		return false;
+
+	const std::string data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	MacroCacheReader reader(data);
+
+	if (reader.Read<uint32_t>() != MacroCacheMagic || reader.Read<uint32_t>() != MacroCacheVersion)
+		return false;
+
+	// Check the dependencies first, there's no point in reading the lines of a stale cache.
+	const uint32_t dependencyCount = reader.Read<uint32_t>();
+	for (uint32_t i = 0; i < dependencyCount && reader.IsValid(); ++i)
+	{
+		MQMacroCache::Dependency& dependency = cache.Dependencies.emplace_back();
+		dependency.Path = reader.ReadString();
+		dependency.Exists = reader.Read<uint8_t>() != 0;
+		dependency.Size = reader.Read<uint64_t>();
+		dependency.WriteTime = reader.Read<int64_t>();
+
+		const MQMacroCache::Dependency current = GetDependency(dependency.Path);
+		if (current.Exists != dependency.Exists || current.Size != dependency.Size
+			|| current.WriteTime != dependency.WriteTime)
+		{
+			DebugSpew("Macro cache for %s is out of date: %s changed", macroPath.string().c_str(), dependency.Path.c_str());
+			return false;
+		}
+	}
+
+	const uint32_t fileCount = reader.Read<uint32_t>();
+	for (uint32_t i = 0; i < fileCount && reader.IsValid(); ++i)
+		cache.Files.push_back(reader.ReadString());
+
+	const uint32_t lineCount = reader.Read<uint32_t>();
+	if (reader.IsValid())
+		cache.Lines.reserve(lineCount);
+
+	for (uint32_t i = 0; i < lineCount && reader.IsValid(); ++i)
+	{
+		MQMacroCache::Line& line = cache.Lines.emplace_back();
+		line.FileIndex = reader.Read<uint32_t>();
+		line.LineNumber = reader.Read<int32_t>();
+		line.Text = reader.ReadString();
+
+		if (line.FileIndex >= cache.Files.size() || line.Text.length() >= MAX_STRING)
+			return false;
+	}
+
+	return reader.IsValid();
+}
+
+void SaveMacroCache(const std::filesystem::path& macroPath, const MQMacroCache& cache)
+{
+	if (!cache.Cacheable)
+		return;
+
+	MacroCacheWriter writer;
+	writer.Write(MacroCacheMagic);
+	writer.Write(MacroCacheVersion);
+
+	writer.Write(static_cast<uint32_t>(cache.Dependencies.size()));
+	for (const MQMacroCache::Dependency& dependency : cache.Dependencies)
+	{
+		writer.WriteString(dependency.Path);
+		writer.Write(static_cast<uint8_t>(dependency.Exists));
+		writer.Write(dependency.Size);
+		writer.Write(dependency.WriteTime);
+	}
+
+	writer.Write(static_cast<uint32_t>(cache.Files.size()));
+	for (const std::string& fileName : cache.Files)
+		writer.WriteString(fileName);
+
+	writer.Write(static_cast<uint32_t>(cache.Lines.size()));
+	for (const MQMacroCache::Line& line : cache.Lines)
+	{
+		writer.Write(line.FileIndex);
+		writer.Write(line.LineNumber);
+		writer.WriteString(line.Text);
+	}
+
+	const std::filesystem::path cachePath = GetMacroCachePath(macroPath);
+	std::error_code ec;
+	std::filesystem::create_directories(cachePath.parent_path(), ec);
+
+	// Every client sharing the macro folder may write the same cache at once, so each writes its
+	// own temporary file and renames it over the cache, which readers see either whole or not at all.
+	std::filesystem::path tempPath = cachePath;
+	tempPath += fmt::format(".{}.tmp", GetCurrentProcessId());
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return;
+
+		file.write(writer.GetData().data(), writer.GetData().size());
+		if (!file)
+		{
+			file.close();
+			std::filesystem::remove(tempPath, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec)
+		std::filesystem::remove(tempPath, ec);
+}
+
+} // namespace mq
@@ -0,0 +1,65 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mq {
+
+// Flattened source of a macro: every line that reached the macro block while it was loaded, with
+// its includes expanded, comments dropped and #defines applied. Directives other than #include
+// and #define are kept, since loading them has side effects (#event, #bind, #turbo, ...).
+// Replaying the lines through AddMacroLine loads the same macro without touching its files.
+struct MQMacroCache
+{
+	struct Line
+	{
+		uint32_t FileIndex = 0;
+		int32_t LineNumber = 0;
+		std::string Text;
+	};
+
+	// A file the macro was built from. Files that didn't exist are recorded too, so that creating
+	// an #include_optional file invalidates the cache.
+	struct Dependency
+	{
+		std::string Path;
+		bool Exists = false;
+		uint64_t Size = 0;
+		int64_t WriteTime = 0;
+	};
+
+	std::vector<std::string> Files;
+	std::vector<Dependency> Dependencies;
+	std::vector<Line> Lines;
+
+	// Cleared when the macro can't be cached, for example when an #include path has ${} in it.
+	bool Cacheable = true;
+
+	void AddLine(std::string_view fileName, std::string_view text, int lineNumber);
+	void AddDependency(const std::filesystem::path& path);
+};
+
+// Loads the cache of a macro. Fails if there is none, or if any file it was built from changed.
+bool LoadMacroCache(const std::filesystem::path& macroPath, MQMacroCache& cache);
+
+// Writes the cache of a macro that was just loaded from its files.
+void SaveMacroCache(const std::filesystem::path& macroPath, const MQMacroCache& cache);
+
+} // namespace mq
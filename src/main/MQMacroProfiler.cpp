@@ -0,0 +1,577 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQ2DeveloperTools.h"
+#include "MQMacroProfiler.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+namespace mq {
+
+static void MacroProfiler_Initialize();
+static void MacroProfiler_Shutdown();
+
+static MQModule s_macroProfilerModule = {
+	"MacroProfiler",              // Name
+	false,                        // CanUnload
+	MacroProfiler_Initialize,     // Initialize
+	MacroProfiler_Shutdown,       // Shutdown
+};
+DECLARE_MODULE_INITIALIZER(s_macroProfilerModule, { "DeveloperTools" });
+
+bool gMacroProfilerEnabled = false;
+
+// Distinct expressions are capped, since portions with ${} inside of them are recorded after
+// the inner portions are replaced, and can take on any number of values.
+static constexpr size_t MaxProfiledExpressions = 4096;
+
+struct MQExpressionProfile
+{
+	uint64_t Count = 0;
+	uint64_t Time = 0;
+};
+
+// The block the folded stacks belong to. Line statistics live on the lines themselves.
+static const MQMacroBlock* s_profiledBlock = nullptr;
+
+// Sub index of every frame of the current line, outermost first.
+static std::vector<int> s_lineStack;
+static uint64_t s_lineStart = 0;
+static bool s_inLine = false;
+
+// Time spent in each distinct call stack, keyed by the sub indices of the stack followed by the
+// index of the line that ran.
+static std::map<std::vector<int>, uint64_t> s_foldedStacks;
+
+static std::unordered_map<std::string, MQExpressionProfile> s_expressions;
+static uint64_t s_droppedExpressions = 0;
+
+static void SetMacroProfilerEnabled(bool enabled)
+{
+	gMacroProfilerEnabled = enabled;
+	s_inLine = false;
+}
+
+static void ResetMacroProfiler()
+{
+	s_foldedStacks.clear();
+	s_expressions.clear();
+	s_droppedExpressions = 0;
+	s_inLine = false;
+
+	if (MQMacroBlockPtr pBlock = GetCurrentMacroBlock())
+	{
+		for (MQMacroLine& line : pBlock->Lines)
+		{
+			line.ExecutionCount = 0;
+			line.ExecutionTime = 0;
+			line.ParseTime = 0;
+		}
+	}
+}
+
+void MacroProfiler_BeginLine(MQMacroBlock& block)
+{
+	if (s_profiledBlock != &block)
+	{
+		s_foldedStacks.clear();
+		s_profiledBlock = &block;
+	}
+
+	s_lineStack.clear();
+	for (MQMacroStack* pStack = gMacroStack; pStack; pStack = pStack->pNext)
+	{
+		if (block.HasLine(pStack->LocationIndex))
+			s_lineStack.push_back(block.GetLine(pStack->LocationIndex).SubIndex);
+	}
+	std::reverse(s_lineStack.begin(), s_lineStack.end());
+
+	s_inLine = true;
+	s_lineStart = MacroProfiler_Now();
+}
+
+void MacroProfiler_EndLine(MQMacroBlock& block, int lineIndex)
+{
+	// Profiling was turned on while the line ran.
+	if (!s_inLine)
+		return;
+
+	const uint64_t elapsed = MacroProfiler_Now() - s_lineStart;
+	s_inLine = false;
+
+	if (&block != s_profiledBlock || !block.HasLine(lineIndex))
+		return;
+
+	MQMacroLine& line = block.GetLine(lineIndex);
+	++line.ExecutionCount;
+	line.ExecutionTime += elapsed;
+
+	s_lineStack.push_back(lineIndex);
+	s_foldedStacks[s_lineStack] += elapsed;
+}
+
+void MacroProfiler_RecordExpression(std::string_view expression, uint64_t elapsed)
+{
+	// Only expressions evaluated by macro lines are of interest here.
+	if (!s_inLine)
+		return;
+
+	auto iter = s_expressions.find(std::string(expression));
+	if (iter == s_expressions.end())
+	{
+		if (s_expressions.size() >= MaxProfiledExpressions)
+		{
+			++s_droppedExpressions;
+			return;
+		}
+
+		iter = s_expressions.emplace(expression, MQExpressionProfile{}).first;
+	}
+
+	++iter->second.Count;
+	iter->second.Time += elapsed;
+}
+
+//----------------------------------------------------------------------------
+
+static double ToMicroseconds(uint64_t nanoseconds)
+{
+	return static_cast<double>(nanoseconds) / 1000.0;
+}
+
+static std::string_view GetSubName(const MQMacroBlock& block, int subIndex)
+{
+	if (!block.HasLine(subIndex))
+		return "(none)";
+
+	// "Sub Name(params)"
+	std::string_view name = block.GetLine(subIndex).Command;
+	name = trim(name.substr(std::min<size_t>(name.size(), 3)));
+	return name.substr(0, name.find_first_of("( "));
+}
+
+static std::string GetLineName(const MQMacroLine& line)
+{
+	return fmt::format("{}:{}", std::filesystem::path(line.SourceFile).filename().string(), line.LineNumber);
+}
+
+static std::string EscapeCSV(std::string_view text)
+{
+	std::string result = "\"";
+	for (char ch : text)
+	{
+		if (ch == '"')
+			result.push_back('"');
+		result.push_back(ch);
+	}
+	result.push_back('"');
+	return result;
+}
+
+// Lines of a block that have run, hottest first.
+static std::vector<const MQMacroLine*> GetProfiledLines(const MQMacroBlock& block)
+{
+	std::vector<const MQMacroLine*> lines;
+	for (const MQMacroLine& line : block.Lines)
+	{
+		if (line.ExecutionCount > 0)
+			lines.push_back(&line);
+	}
+
+	std::sort(lines.begin(), lines.end(),
+		[](const MQMacroLine* a, const MQMacroLine* b) { return a->ExecutionTime > b->ExecutionTime; });
+	return lines;
+}
+
+struct MQTimeTotal
+{
+	std::string Name;
+	uint64_t Count = 0;
+	uint64_t Time = 0;
+};
+
+static std::vector<MQTimeTotal> SortTotals(std::map<std::string, MQTimeTotal>& totals)
+{
+	std::vector<MQTimeTotal> result;
+	result.reserve(totals.size());
+	for (auto& [_, total] : totals)
+		result.push_back(std::move(total));
+
+	std::sort(result.begin(), result.end(),
+		[](const MQTimeTotal& a, const MQTimeTotal& b) { return a.Time > b.Time; });
+	return result;
+}
+
+// Time spent on the lines of each sub, excluding the subs it calls.
+static std::vector<MQTimeTotal> GetSubTotals(const MQMacroBlock& block)
+{
+	std::map<std::string, MQTimeTotal> totals;
+	for (const MQMacroLine& line : block.Lines)
+	{
+		if (line.ExecutionCount == 0)
+			continue;
+
+		std::string_view name = GetSubName(block, line.SubIndex);
+		MQTimeTotal& total = totals[std::string(name)];
+		total.Name = name;
+		total.Count += line.ExecutionCount;
+		total.Time += line.ExecutionTime;
+	}
+
+	return SortTotals(totals);
+}
+
+// Time spent in each command handler, not counting the time spent parsing its arguments.
+static std::vector<MQTimeTotal> GetCommandTotals(const MQMacroBlock& block)
+{
+	std::map<std::string, MQTimeTotal> totals;
+	for (const MQMacroLine& line : block.Lines)
+	{
+		if (line.ExecutionCount == 0 || line.CommandName.empty())
+			continue;
+
+		MQTimeTotal& total = totals[line.CommandName];
+		total.Name = line.CommandName;
+		total.Count += line.ExecutionCount;
+		total.Time += line.ExecutionTime - std::min(line.ParseTime, line.ExecutionTime);
+	}
+
+	return SortTotals(totals);
+}
+
+static std::vector<std::pair<const std::string*, const MQExpressionProfile*>> GetExpressionTotals()
+{
+	std::vector<std::pair<const std::string*, const MQExpressionProfile*>> result;
+	result.reserve(s_expressions.size());
+	for (const auto& [expression, profile] : s_expressions)
+		result.emplace_back(&expression, &profile);
+
+	std::sort(result.begin(), result.end(),
+		[](const auto& a, const auto& b) { return a.second->Time > b.second->Time; });
+	return result;
+}
+
+//----------------------------------------------------------------------------
+
+static bool ExportMacroProfile(const MQMacroBlock& block)
+{
+	auto time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	std::tm now = {};
+	localtime_s(&now, &time);
+	char dateTime[32] = { 0 };
+	std::strftime(dateTime, 32, "%Y%m%d_%H%M%S", &now);
+
+	std::string profileDirectoryPath = fmt::format("{}\\profiles\\", gPathMacros);
+	std::error_code ec;
+
+	if (!std::filesystem::exists(profileDirectoryPath, ec))
+		std::filesystem::create_directory(profileDirectoryPath, ec);
+
+	const std::string baseName = fmt::format("{}{}_{}", profileDirectoryPath,
+		std::filesystem::path(block.Name).stem().string(), dateTime);
+
+	// Folded stacks, one "Main;Sub;file.mac:123 <microseconds>" entry per distinct stack, which
+	// can be fed straight to flamegraph tools.
+	std::ofstream foldedFile(baseName + ".folded");
+	if (!foldedFile)
+	{
+		WriteChatf("\ar[Profiler]\ax Could not write profile to: %s.folded", baseName.c_str());
+		return false;
+	}
+
+	if (&block == s_profiledBlock)
+	{
+		for (const auto& [stack, elapsed] : s_foldedStacks)
+		{
+			if (stack.empty() || !block.HasLine(stack.back()))
+				continue;
+
+			for (size_t i = 0; i + 1 < stack.size(); ++i)
+				foldedFile << GetSubName(block, stack[i]) << ';';
+
+			foldedFile << GetLineName(block.GetLine(stack.back())) << ' ' << elapsed / 1000 << '\n';
+		}
+	}
+
+	std::ofstream linesFile(baseName + "_lines.csv");
+	linesFile << "File,Line,Sub,Count,Total (us),Parse (us),Command (us),Source\n";
+	for (const MQMacroLine* line : GetProfiledLines(block))
+	{
+		linesFile << fmt::format("{},{},{},{},{:.1f},{:.1f},{:.1f},{}\n",
+			EscapeCSV(line->SourceFile), line->LineNumber, GetSubName(block, line->SubIndex), line->ExecutionCount,
+			ToMicroseconds(line->ExecutionTime), ToMicroseconds(line->ParseTime),
+			ToMicroseconds(line->ExecutionTime - std::min(line->ParseTime, line->ExecutionTime)),
+			EscapeCSV(line->Command));
+	}
+
+	std::ofstream expressionsFile(baseName + "_expressions.csv");
+	expressionsFile << "Count,Total (us),Expression\n";
+	for (const auto& [expression, profile] : GetExpressionTotals())
+	{
+		expressionsFile << fmt::format("{},{:.1f},{}\n", profile->Count, ToMicroseconds(profile->Time),
+			EscapeCSV(*expression));
+	}
+
+	WriteChatf("\ag[Profiler]\ax Saved line profile to: %s.folded", baseName.c_str());
+	return true;
+}
+
+void MacroProfiler_MacroEnded(MQMacroBlock& block)
+{
+	if (gMacroProfilerEnabled)
+		ExportMacroProfile(block);
+
+	s_profiledBlock = nullptr;
+	s_foldedStacks.clear();
+	s_inLine = false;
+}
+
+//----------------------------------------------------------------------------
+
+class MacroProfilerWindow : public ImGuiWindowBase
+{
+public:
+	MacroProfilerWindow()
+		: ImGuiWindowBase("Macro Profiler")
+	{
+		SetDefaultSize(ImVec2(800, 500));
+	}
+
+	void Draw() override
+	{
+		bool enabled = gMacroProfilerEnabled;
+		if (ImGui::Checkbox("Enabled", &enabled))
+			SetMacroProfilerEnabled(enabled);
+
+		MQMacroBlockPtr pBlock = GetCurrentMacroBlock();
+
+		ImGui::SameLine();
+		if (ImGui::Button("Reset"))
+			ResetMacroProfiler();
+
+		ImGui::SameLine();
+		ImGui::BeginDisabled(!pBlock);
+		if (ImGui::Button("Export"))
+			ExportMacroProfile(*pBlock);
+		ImGui::EndDisabled();
+
+		if (!pBlock)
+		{
+			ImGui::TextDisabled("No macro is running.");
+			return;
+		}
+
+		if (ImGui::BeginTabBar("##MacroProfiler_TabBar"))
+		{
+			if (ImGui::BeginTabItem("Lines"))
+			{
+				Draw_Lines(*pBlock);
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Subs"))
+			{
+				Draw_Totals("##MacroProfilerSubs", "Sub", "Lines Run", GetSubTotals(*pBlock));
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Commands"))
+			{
+				Draw_Totals("##MacroProfilerCommands", "Command", "Count", GetCommandTotals(*pBlock));
+				ImGui::EndTabItem();
+			}
+			if (ImGui::BeginTabItem("Expressions"))
+			{
+				Draw_Expressions();
+				ImGui::EndTabItem();
+			}
+
+			ImGui::EndTabBar();
+		}
+	}
+
+private:
+	static constexpr ImGuiTableFlags TableFlags = ImGuiTableFlags_SizingFixedFit
+		| ImGuiTableFlags_ScrollY
+		| ImGuiTableFlags_BordersV
+		| ImGuiTableFlags_BordersOuterH
+		| ImGuiTableFlags_Resizable
+		| ImGuiTableFlags_RowBg;
+
+	void Draw_Lines(const MQMacroBlock& block)
+	{
+		std::vector<const MQMacroLine*> lines = GetProfiledLines(block);
+
+		if (ImGui::BeginTable("##MacroProfilerLines", 7, TableFlags, ImGui::GetContentRegionAvail()))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Line");
+			ImGui::TableSetupColumn("Sub");
+			ImGui::TableSetupColumn("Count");
+			ImGui::TableSetupColumn("Total (ms)");
+			ImGui::TableSetupColumn("Parse (ms)");
+			ImGui::TableSetupColumn("Avg (us)");
+			ImGui::TableSetupColumn("Source", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableHeadersRow();
+
+			ImGuiListClipper clipper;
+			clipper.Begin(static_cast<int>(lines.size()));
+
+			while (clipper.Step())
+			{
+				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+				{
+					const MQMacroLine& line = *lines[row];
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::Text("%s", GetLineName(line).c_str());
+					ImGui::TableNextColumn(); ImGui::Text("%.*s", static_cast<int>(GetSubName(block, line.SubIndex).size()), GetSubName(block, line.SubIndex).data());
+					ImGui::TableNextColumn(); ImGui::Text("%llu", line.ExecutionCount);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", ToMicroseconds(line.ExecutionTime) / 1000.0);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", ToMicroseconds(line.ParseTime) / 1000.0);
+					ImGui::TableNextColumn(); ImGui::Text("%.1f", ToMicroseconds(line.ExecutionTime) / line.ExecutionCount);
+					ImGui::TableNextColumn(); ImGui::Text("%s", line.Command.c_str());
+				}
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	void Draw_Totals(const char* tableId, const char* nameLabel, const char* countLabel, const std::vector<MQTimeTotal>& totals)
+	{
+		if (ImGui::BeginTable(tableId, 3, TableFlags, ImGui::GetContentRegionAvail()))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn(nameLabel, ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn(countLabel);
+			ImGui::TableSetupColumn("Total (ms)");
+			ImGui::TableHeadersRow();
+
+			for (const MQTimeTotal& total : totals)
+			{
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::Text("%s", total.Name.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%llu", total.Count);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", ToMicroseconds(total.Time) / 1000.0);
+			}
+
+			ImGui::EndTable();
+		}
+	}
+
+	void Draw_Expressions()
+	{
+		if (s_droppedExpressions > 0)
+		{
+			ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "%llu evaluations of expressions past the first %d were not recorded.",
+				s_droppedExpressions, static_cast<int>(MaxProfiledExpressions));
+		}
+
+		auto expressions = GetExpressionTotals();
+
+		if (ImGui::BeginTable("##MacroProfilerExpressions", 4, TableFlags, ImGui::GetContentRegionAvail()))
+		{
+			ImGui::TableSetupScrollFreeze(0, 1);
+			ImGui::TableSetupColumn("Expression", ImGuiTableColumnFlags_WidthStretch);
+			ImGui::TableSetupColumn("Count");
+			ImGui::TableSetupColumn("Total (ms)");
+			ImGui::TableSetupColumn("Avg (us)");
+			ImGui::TableHeadersRow();
+
+			ImGuiListClipper clipper;
+			clipper.Begin(static_cast<int>(expressions.size()));
+
+			while (clipper.Step())
+			{
+				for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+				{
+					const auto& [expression, profile] = expressions[row];
+
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::Text("${%s}", expression->c_str());
+					ImGui::TableNextColumn(); ImGui::Text("%llu", profile->Count);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", ToMicroseconds(profile->Time) / 1000.0);
+					ImGui::TableNextColumn(); ImGui::Text("%.1f", ToMicroseconds(profile->Time) / profile->Count);
+				}
+			}
+
+			ImGui::EndTable();
+		}
+	}
+};
+
+static MacroProfilerWindow* s_macroProfilerWindow = nullptr;
+
+//----------------------------------------------------------------------------
+
+void MacroProfiler_Command(const char* szLine)
+{
+	char szArg[MAX_STRING] = { 0 };
+	GetArg(szArg, szLine, 1);
+
+	if (ci_equals(szArg, "on"))
+	{
+		SetMacroProfilerEnabled(true);
+		WriteChatf("\ag[Profiler]\ax Line profiling is now \agon\ax.");
+	}
+	else if (ci_equals(szArg, "off"))
+	{
+		SetMacroProfilerEnabled(false);
+		WriteChatf("\ag[Profiler]\ax Line profiling is now \aroff\ax.");
+	}
+	else if (ci_equals(szArg, "reset"))
+	{
+		ResetMacroProfiler();
+		WriteChatf("\ag[Profiler]\ax Line profile has been reset.");
+	}
+	else if (ci_equals(szArg, "show"))
+	{
+		if (s_macroProfilerWindow)
+			s_macroProfilerWindow->Show();
+	}
+	else if (ci_equals(szArg, "export"))
+	{
+		if (MQMacroBlockPtr pBlock = GetCurrentMacroBlock())
+			ExportMacroProfile(*pBlock);
+		else
+			WriteChatf("\ar[Profiler]\ax No macro is running.");
+	}
+	else
+	{
+		WriteChatf("Usage: /profile lines <on|off|reset|show|export>");
+	}
+}
+
+static void MacroProfiler_Initialize()
+{
+	s_macroProfilerWindow = new MacroProfilerWindow();
+	DeveloperTools_RegisterMenuItem(s_macroProfilerWindow, "Macro Profiler", s_menuNameTools);
+}
+
+static void MacroProfiler_Shutdown()
+{
+	DeveloperTools_UnregisterMenuItem(s_macroProfilerWindow);
+	delete s_macroProfilerWindow; s_macroProfilerWindow = nullptr;
+
+	SetMacroProfilerEnabled(false);
+	s_profiledBlock = nullptr;
+	s_foldedStacks.clear();
+	s_expressions.clear();
+}
+
+} // namespace mq
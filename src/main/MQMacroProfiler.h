@@ -0,0 +1,48 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace mq {
+
+struct MQMacroBlock;
+
+// Macro line profiler, toggled with /profile lines on|off. Everything here is only used from the
+// main thread, and costs a single check of gMacroProfilerEnabled per line while it is off.
+extern bool gMacroProfilerEnabled;
+
+inline uint64_t MacroProfiler_Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Called around every macro line executed by the pulse.
+void MacroProfiler_BeginLine(MQMacroBlock& block);
+void MacroProfiler_EndLine(MQMacroBlock& block, int lineIndex);
+
+// Called by the data api for every ${} portion it evaluates.
+void MacroProfiler_RecordExpression(std::string_view expression, uint64_t elapsed);
+
+// Writes out the profile of a macro that is about to end.
+void MacroProfiler_MacroEnded(MQMacroBlock& block);
+
+// Handles /profile lines <on|off|reset|show|export>.
+void MacroProfiler_Command(const char* szLine);
+
+} // namespace mq
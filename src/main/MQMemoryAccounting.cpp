@@ -0,0 +1,157 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQMemoryAccounting.h"
+
+#include <memory>
+#include <mutex>
+
+namespace mq {
+
+struct MemoryAccount
+{
+	std::string name;
+	MQMemoryCounters* counters = nullptr;
+	const MQPlugin* plugin = nullptr;            // set if the counters live in the plugin
+
+	uint64_t lastTotal = 0;
+	uint64_t rate = 0;
+};
+
+// Counters are handed out before MQ2Main is initialized, from the static initializers of other
+// files and from plugins, so the accounts are created on first use. Counters that we own are
+// never freed, since whoever asked for them may hold on to them until shutdown.
+struct MemoryAccounts
+{
+	std::mutex mutex;
+	std::vector<MemoryAccount> accounts;
+	std::vector<std::unique_ptr<MQMemoryCounters>> ownedCounters;
+	std::chrono::steady_clock::time_point lastSample;
+};
+
+static MemoryAccounts& GetMemoryAccounts()
+{
+	static MemoryAccounts s_accounts;
+	return s_accounts;
+}
+
+static MQMemoryStats GetMemoryStats(const MemoryAccount& account)
+{
+	MQMemoryStats stats;
+	stats.Name = account.name;
+	stats.Current = account.counters->Current.load(std::memory_order_relaxed);
+	stats.Peak = account.counters->Peak.load(std::memory_order_relaxed);
+	stats.TotalAllocated = account.counters->TotalAllocated.load(std::memory_order_relaxed);
+	stats.Allocations = account.counters->Allocations.load(std::memory_order_relaxed);
+	stats.AllocationRate = account.rate;
+	return stats;
+}
+
+MQMemoryCounters* GetMemoryCounters(const char* Name)
+{
+	MemoryAccounts& accounts = GetMemoryAccounts();
+	std::scoped_lock lock(accounts.mutex);
+
+	for (const MemoryAccount& account : accounts.accounts)
+	{
+		if (account.plugin == nullptr && ci_equals(account.name, Name))
+			return account.counters;
+	}
+
+	MQMemoryCounters* counters = accounts.ownedCounters.emplace_back(std::make_unique<MQMemoryCounters>()).get();
+
+	MemoryAccount& account = accounts.accounts.emplace_back();
+	account.name = Name;
+	account.counters = counters;
+	return counters;
+}
+
+void MemoryAccounting_AddPlugin(const MQPlugin* plugin, MQMemoryCounters* counters)
+{
+	MemoryAccounts& accounts = GetMemoryAccounts();
+	std::scoped_lock lock(accounts.mutex);
+
+	MemoryAccount& account = accounts.accounts.emplace_back();
+	account.name = plugin->name;
+	account.counters = counters;
+	account.plugin = plugin;
+	account.lastTotal = counters->TotalAllocated.load(std::memory_order_relaxed);
+}
+
+void MemoryAccounting_OnPluginUnloaded(const MQPlugin* plugin)
+{
+	MemoryAccounts& accounts = GetMemoryAccounts();
+	std::scoped_lock lock(accounts.mutex);
+
+	// The counters are freed along with the plugin.
+	accounts.accounts.erase(std::remove_if(accounts.accounts.begin(), accounts.accounts.end(),
+		[plugin](const MemoryAccount& account) { return account.plugin == plugin; }), accounts.accounts.end());
+}
+
+void MemoryAccounting_Pulse()
+{
+	MemoryAccounts& accounts = GetMemoryAccounts();
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now - accounts.lastSample < std::chrono::seconds(1))
+		return;
+
+	std::scoped_lock lock(accounts.mutex);
+
+	const double seconds = std::chrono::duration<double>(now - accounts.lastSample).count();
+	const bool firstSample = accounts.lastSample == std::chrono::steady_clock::time_point{};
+	accounts.lastSample = now;
+
+	for (MemoryAccount& account : accounts.accounts)
+	{
+		const uint64_t total = account.counters->TotalAllocated.load(std::memory_order_relaxed);
+		account.rate = firstSample ? 0 : static_cast<uint64_t>((total - account.lastTotal) / seconds);
+		account.lastTotal = total;
+	}
+}
+
+std::vector<MQMemoryStats> MemoryAccounting_GetStats()
+{
+	MemoryAccounts& accounts = GetMemoryAccounts();
+	std::scoped_lock lock(accounts.mutex);
+
+	std::vector<MQMemoryStats> stats;
+	stats.reserve(accounts.accounts.size());
+
+	for (const MemoryAccount& account : accounts.accounts)
+		stats.push_back(GetMemoryStats(account));
+
+	return stats;
+}
+
+bool MemoryAccounting_GetStats(std::string_view name, MQMemoryStats& stats)
+{
+	MemoryAccounts& accounts = GetMemoryAccounts();
+	std::scoped_lock lock(accounts.mutex);
+
+	for (const MemoryAccount& account : accounts.accounts)
+	{
+		if (ci_equals(account.name, name))
+		{
+			stats = GetMemoryStats(account);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // namespace mq
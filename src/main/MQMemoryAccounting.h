@@ -0,0 +1,38 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "mq/utils/MemoryAccounting.h"
+
+#include <string_view>
+#include <vector>
+
+namespace mq {
+
+struct MQPlugin;
+
+// Plugins that use PLUGIN_MEMORY_ACCOUNTING keep their counters in the plugin. They are accounted
+// under the name of the plugin until it is unloaded.
+void MemoryAccounting_AddPlugin(const MQPlugin* plugin, MQMemoryCounters* counters);
+void MemoryAccounting_OnPluginUnloaded(const MQPlugin* plugin);
+
+// Samples the allocation rates. Called once per pulse.
+void MemoryAccounting_Pulse();
+
+// Copies of the counters of every name that memory was accounted under.
+std::vector<MQMemoryStats> MemoryAccounting_GetStats();
+bool MemoryAccounting_GetStats(std::string_view name, MQMemoryStats& stats);
+
+} // namespace mq
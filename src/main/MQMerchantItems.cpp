@@ -0,0 +1,167 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQMerchantItems.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace mq {
+
+// Indices over the items on the merchant's regular page. The index is built the first time it is
+// needed after the list was updated, and lookups check the item they found, so an item that was
+// bought out since is never returned.
+struct MerchantItemIndex
+{
+	bool valid = false;
+	std::vector<const ItemClient*> items;
+	std::vector<std::string> lowerNames;
+	std::unordered_map<std::string, int> nameToIndex;      // the first item with each lower case name
+	std::unordered_map<int, int> idToIndex;                // the first item with each id
+
+	// Substring lookups that were already answered. Selling an inventory asks for the same names
+	// over and over.
+	std::unordered_map<std::string, int> substringToIndex;
+};
+
+static constexpr size_t MaxMerchantSubstringLookups = 1000;
+
+static MerchantItemIndex s_merchantItems;
+
+void InvalidateMerchantItems()
+{
+	s_merchantItems.valid = false;
+}
+
+static MerchantItemIndex& GetMerchantItemIndex(const CMerchantWnd::PageHandlerPtr& page)
+{
+	MerchantItemIndex& index = s_merchantItems;
+
+	// A count that disagrees means that the list changed without an update that we saw.
+	const int count = page->GetItemCount();
+	if (index.valid && static_cast<int>(index.items.size()) == count)
+		return index;
+
+	index.valid = true;
+	index.items.clear();
+	index.lowerNames.clear();
+	index.nameToIndex.clear();
+	index.idToIndex.clear();
+	index.substringToIndex.clear();
+
+	index.items.reserve(count);
+	index.lowerNames.reserve(count);
+
+	for (int i = 0; i < count; ++i)
+	{
+		ItemPtr pItem = page->GetItem(i);
+
+		index.items.push_back(pItem.get());
+		index.lowerNames.push_back(pItem ? to_lower_copy(pItem->GetName()) : std::string());
+
+		if (pItem)
+		{
+			index.nameToIndex.emplace(index.lowerNames.back(), i);
+			index.idToIndex.emplace(pItem->GetID(), i);
+		}
+	}
+
+	return index;
+}
+
+static int FindMerchantItem(MerchantItemIndex& index, const std::string& lowerName, bool exact)
+{
+	auto iter = index.nameToIndex.find(lowerName);
+	const int match = iter != index.nameToIndex.end() ? iter->second : -1;
+
+	if (exact || lowerName.empty())
+		return match;
+
+	auto substringIter = index.substringToIndex.find(lowerName);
+	if (substringIter != index.substringToIndex.end())
+		return substringIter->second;
+
+	// The first item that contains the name wins, and an item with the whole name contains it, so
+	// only the items before that one need to be looked at.
+	int found = match;
+	const int end = match != -1 ? match : static_cast<int>(index.lowerNames.size());
+	for (int i = 0; i < end; ++i)
+	{
+		if (index.items[i] && index.lowerNames[i].find(lowerName) != std::string::npos)
+		{
+			found = i;
+			break;
+		}
+	}
+
+	if (index.substringToIndex.size() >= MaxMerchantSubstringLookups)
+		index.substringToIndex.clear();
+	index.substringToIndex.emplace(lowerName, found);
+
+	return found;
+}
+
+int GetMerchantItemIndexByName(std::string_view name, bool exact)
+{
+	if (!pMerchantWnd || !pMerchantWnd->PageHandlers[RegularMerchantPage])
+		return -1;
+
+	const CMerchantWnd::PageHandlerPtr& page = pMerchantWnd->PageHandlers[RegularMerchantPage];
+	const std::string lowerName = to_lower_copy(name);
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		MerchantItemIndex& index = GetMerchantItemIndex(page);
+
+		const int found = FindMerchantItem(index, lowerName, exact);
+		if (found == -1)
+			return -1;
+
+		if (page->GetItem(found).get() == index.items[found])
+			return found;
+
+		InvalidateMerchantItems();
+	}
+
+	return -1;
+}
+
+int GetMerchantItemIndexByID(int itemID)
+{
+	if (!pMerchantWnd || !pMerchantWnd->PageHandlers[RegularMerchantPage])
+		return -1;
+
+	const CMerchantWnd::PageHandlerPtr& page = pMerchantWnd->PageHandlers[RegularMerchantPage];
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		const MerchantItemIndex& index = GetMerchantItemIndex(page);
+
+		auto iter = index.idToIndex.find(itemID);
+		if (iter == index.idToIndex.end())
+			return -1;
+
+		const int found = iter->second;
+		if (page->GetItem(found).get() == index.items[found])
+			return found;
+
+		InvalidateMerchantItems();
+	}
+
+	return -1;
+}
+
+} // namespace mq
@@ -0,0 +1,341 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQPetMercState.h"
+
+namespace mq {
+
+// What the datatypes read from. The last pulse only keeps what is compared to find the changes.
+static PetSnapshot s_pet;
+static PetSnapshot s_lastPet;
+static uint32_t s_petChanges = 0;
+
+static MercenarySnapshot s_mercenary;
+static MercenarySnapshot s_lastMercenary;
+static uint32_t s_mercenaryChanges = 0;
+
+// The parsed descriptions, and the list of mercenaries that they were parsed from.
+static std::vector<MercDesc> s_mercDescs;
+static std::vector<int> s_mercDescSubtypes;
+
+static int GetHPPct(const PlayerClient* pSpawn)
+{
+	// avoid dividing by zero!
+	return (!pSpawn || pSpawn->HPMax == 0) ? 0 : static_cast<int>(pSpawn->HPCurrent * 100 / pSpawn->HPMax);
+}
+
+static const char* GetMercenaryStateName()
+{
+	if (!pMercManager->HasMercenary())
+	{
+		if (pMercManager->currMercenaryIndex != -1)
+			return "SUSPENDED";
+
+		return "NONE";
+	}
+
+	switch (pMercManager->GetMercenaryState())
+	{
+	case MercenaryState_Dead:
+		return "DEAD";
+	case MercenaryState_Active:
+		return "ACTIVE";
+
+	default:
+		return "SUSPENDED";
+	}
+}
+
+static void UpdatePet(PetSnapshot& pet)
+{
+	pet = PetSnapshot{};
+	pet.timestamp = GetTickCount64();
+
+	if (!pLocalPlayer || pLocalPlayer->PetID == -1 || pLocalPlayer->PetID == 0)
+		return;
+
+	pet.spawnID = pLocalPlayer->PetID;
+	pet.spawn = GetSpawnByID(pet.spawnID);
+	if (!pet.spawn)
+		return;
+
+	pet.targetID = pet.spawn->WhoFollowing ? pet.spawn->WhoFollowing->SpawnID : 0;
+	pet.hpPct = GetHPPct(pet.spawn);
+
+	if (!pPetInfoWnd)
+		return;
+
+	pet.follow = pPetInfoWnd->Follow;
+	pet.hold = pPetInfoWnd->Hold;
+	pet.gHold = pPetInfoWnd->GHold;
+	pet.spellHold = pPetInfoWnd->SpellHold;
+#if IS_CLIENT_DATE(20250107)
+	pet.resume = pPetInfoWnd->Resume;
+	pet.procHold = pPetInfoWnd->ProcHold;
+#endif
+	pet.reGroup = pPetInfoWnd->ReGroup;
+	pet.stop = pPetInfoWnd->Stop;
+	pet.taunt = pPetInfoWnd->Taunt;
+	pet.focus = pPetInfoWnd->Focus;
+
+	pet.maxBuffs = pPetInfoWnd->GetMaxBuffs();
+	for (int slot = 0; slot < pet.maxBuffs; ++slot)
+	{
+		const int spellID = pPetInfoWnd->GetBuff(slot);
+		if (spellID == -1 || spellID == 0)
+			continue;
+
+		const int64_t timer = pPetInfoWnd->GetBuffTimer(slot);
+		pet.buffs.push_back({ slot, spellID, timer > 0 ? static_cast<uint32_t>(timer) : 0 });
+	}
+}
+
+static bool PetBuffsChanged(const PetSnapshot& current, const PetSnapshot& last)
+{
+	if (current.buffs.size() != last.buffs.size())
+		return true;
+
+	const uint64_t elapsed = current.timestamp - last.timestamp;
+	for (size_t i = 0; i < current.buffs.size(); ++i)
+	{
+		const PetBuffState& buff = current.buffs[i];
+		const PetBuffState& lastBuff = last.buffs[i];
+
+		if (buff.slot != lastBuff.slot || buff.spellID != lastBuff.spellID)
+			return true;
+
+		// Timers only count down, unless the buff was cast again. Allow a second for the window.
+		if (buff.timer > lastBuff.timer + elapsed + 1000)
+			return true;
+	}
+
+	return false;
+}
+
+// The pet window is the only place that has all of the buffs of the pet, so the cached buffs of the
+// pet are kept in step with it. They report the buffs that were gained and lost like any other spawn.
+static void UpdatePetCachedBuffs(const PetSnapshot& pet)
+{
+	std::vector<CachedBuff> buffs;
+	buffs.reserve(pet.buffs.size());
+
+	const DWORD now = EQGetTime();
+	for (const PetBuffState& buff : pet.buffs)
+	{
+		CachedBuff& cachedBuff = buffs.emplace_back();
+		cachedBuff.slot = buff.slot;
+		cachedBuff.spellId = buff.spellID;
+		cachedBuff.duration = buff.timer ? static_cast<int>((buff.timer + 5999) / 6000) : -1;
+		cachedBuff.count = 0;
+		cachedBuff.casterName[0] = 0;
+		cachedBuff.timeStamp = now;
+
+		if (auto buffInfo = pPetInfoWnd->GetBuffInfoBySpellID(buff.spellID))
+			strcpy_s(cachedBuff.casterName, buffInfo.GetCaster());
+	}
+
+	SetCachedBuffs(pet.spawnID, std::move(buffs));
+}
+
+static void UpdateMercenary(MercenarySnapshot& mercenary)
+{
+	mercenary = MercenarySnapshot{};
+
+	if (!pMercManager)
+		return;
+
+	mercenary.index = pMercManager->currMercenaryIndex;
+	mercenary.stateID = static_cast<int>(pMercManager->GetMercenaryState());
+	mercenary.stateName = GetMercenaryStateName();
+
+	if (const MercenaryStanceInfo* pStance = pMercManager->GetActiveMercenaryStance())
+	{
+		mercenary.stanceStringID = pStance->stanceStringId;
+		mercenary.stanceName = pCDBStr->GetString(pStance->stanceStringId, eMercenaryStanceName);
+	}
+
+	if (pMercManager->mercenarySpawnId)
+	{
+		mercenary.spawnID = pMercManager->mercenarySpawnId;
+		mercenary.spawn = GetSpawnByID(mercenary.spawnID);
+		mercenary.hpPct = GetHPPct(mercenary.spawn);
+	}
+}
+
+void PetMerc_Pulse()
+{
+	s_petChanges = 0;
+	s_mercenaryChanges = 0;
+
+	// The pet and mercenary are respawned after zoning, which is reported on the first pulse in the zone.
+	if (gGameState != GAMESTATE_INGAME || gZoning)
+		return;
+
+	UpdatePet(s_pet);
+
+	uint32_t petChanges = 0;
+	if (s_pet.spawnID != s_lastPet.spawnID)
+		petChanges |= MQPetChange_Spawn;
+	if (s_pet.targetID != s_lastPet.targetID)
+		petChanges |= MQPetChange_Target;
+	if (s_pet.hpPct != s_lastPet.hpPct)
+		petChanges |= MQPetChange_HP;
+	if (s_pet.follow != s_lastPet.follow)
+		petChanges |= MQPetChange_Stance;
+	if (s_pet.hold != s_lastPet.hold
+		|| s_pet.gHold != s_lastPet.gHold
+		|| s_pet.spellHold != s_lastPet.spellHold
+		|| s_pet.resume != s_lastPet.resume
+		|| s_pet.procHold != s_lastPet.procHold
+		|| s_pet.reGroup != s_lastPet.reGroup
+		|| s_pet.stop != s_lastPet.stop
+		|| s_pet.taunt != s_lastPet.taunt
+		|| s_pet.focus != s_lastPet.focus)
+	{
+		petChanges |= MQPetChange_Commands;
+	}
+
+	const bool buffsChanged = PetBuffsChanged(s_pet, s_lastPet);
+	if (buffsChanged)
+		petChanges |= MQPetChange_Buffs;
+
+	// A new pet gets its cached buffs from the window even if they look the same as the last pet's.
+	if ((buffsChanged || (petChanges & MQPetChange_Spawn)) && s_pet.spawn && pPetInfoWnd)
+		UpdatePetCachedBuffs(s_pet);
+
+	UpdateMercenary(s_mercenary);
+
+	uint32_t mercenaryChanges = 0;
+	if (s_mercenary.spawnID != s_lastMercenary.spawnID)
+		mercenaryChanges |= MQMercenaryChange_Spawn;
+	if (s_mercenary.stateID != s_lastMercenary.stateID || s_mercenary.index != s_lastMercenary.index)
+		mercenaryChanges |= MQMercenaryChange_State;
+	if (s_mercenary.stanceStringID != s_lastMercenary.stanceStringID)
+		mercenaryChanges |= MQMercenaryChange_Stance;
+	if (s_mercenary.hpPct != s_lastMercenary.hpPct)
+		mercenaryChanges |= MQMercenaryChange_HP;
+
+	s_petChanges = petChanges;
+	s_mercenaryChanges = mercenaryChanges;
+	s_lastPet = s_pet;
+	s_lastMercenary = s_mercenary;
+
+	if (petChanges)
+		AddPetMercChangeEvent(false, petChanges, s_pet.spawnID);
+	if (mercenaryChanges)
+		AddPetMercChangeEvent(true, mercenaryChanges, s_mercenary.spawnID);
+}
+
+void PetMerc_OnAddSpawn(PlayerClient* pSpawn)
+{
+	if (!s_pet.spawn && s_pet.spawnID != 0 && s_pet.spawnID == pSpawn->SpawnID)
+		s_pet.spawn = pSpawn;
+	if (!s_mercenary.spawn && s_mercenary.spawnID != 0 && s_mercenary.spawnID == pSpawn->SpawnID)
+		s_mercenary.spawn = pSpawn;
+}
+
+void PetMerc_OnRemoveSpawn(PlayerClient* pSpawn)
+{
+	if (s_pet.spawn == pSpawn)
+		s_pet.spawn = nullptr;
+	if (s_mercenary.spawn == pSpawn)
+		s_mercenary.spawn = nullptr;
+
+	// The last pulse only keeps the pointer because it is copied, but it could be reused by the next
+	// spawn that is added.
+	s_lastPet.spawn = nullptr;
+	s_lastMercenary.spawn = nullptr;
+}
+
+uint32_t PetMerc_GetPetChanges()
+{
+	return s_petChanges;
+}
+
+uint32_t PetMerc_GetMercenaryChanges()
+{
+	return s_mercenaryChanges;
+}
+
+const PetSnapshot& GetPetSnapshot()
+{
+	// A pet that was summoned or dismissed earlier in this pulse is looked up again rather than
+	// answering with the one from the start of the pulse.
+	const uint32_t petID = (!pLocalPlayer || pLocalPlayer->PetID == -1) ? 0 : static_cast<uint32_t>(pLocalPlayer->PetID);
+	if (petID != s_pet.spawnID)
+		UpdatePet(s_pet);
+
+	return s_pet;
+}
+
+const MercenarySnapshot& GetMercenarySnapshot()
+{
+	const uint32_t mercenaryID = pMercManager ? pMercManager->mercenarySpawnId : 0;
+	if (mercenaryID != s_mercenary.spawnID)
+		UpdateMercenary(s_mercenary);
+
+	return s_mercenary;
+}
+
+const PetBuffState* GetPetBuffState(int slot)
+{
+	const PetSnapshot& pet = GetPetSnapshot();
+	for (const PetBuffState& buff : pet.buffs)
+	{
+		if (buff.slot == slot)
+			return &buff;
+	}
+
+	return nullptr;
+}
+
+const std::vector<MercDesc>& GetMercenaryDescriptions()
+{
+	if (!pMercManager)
+	{
+		s_mercDescs.clear();
+		s_mercDescSubtypes.clear();
+		return s_mercDescs;
+	}
+
+	// Comparing the subtypes is much cheaper than looking up and parsing the descriptions.
+	bool changed = s_mercDescSubtypes.size() != static_cast<size_t>(pMercManager->mercenaries.GetCount());
+	if (!changed)
+	{
+		size_t index = 0;
+		for (const MercenaryInfo& mercInfo : pMercManager->mercenaries)
+		{
+			if (s_mercDescSubtypes[index++] != mercInfo.subtypeStringId)
+			{
+				changed = true;
+				break;
+			}
+		}
+	}
+
+	if (changed)
+	{
+		s_mercDescs = GetAllMercDesc();
+
+		s_mercDescSubtypes.clear();
+		for (const MercenaryInfo& mercInfo : pMercManager->mercenaries)
+			s_mercDescSubtypes.push_back(mercInfo.subtypeStringId);
+	}
+
+	return s_mercDescs;
+}
+
+} // namespace mq
@@ -0,0 +1,102 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "MQ2Mercenaries.h"
+#include "mq/api/GameEvents.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace eqlib {
+	class PlayerClient;
+}
+
+namespace mq {
+
+// A buff in the pet window as of this pulse.
+struct PetBuffState
+{
+	int slot = -1;
+	int spellID = -1;
+	uint32_t timer = 0;                        // remaining duration in milliseconds, 0 if it doesn't run out
+};
+
+// The player's pet as of this pulse, with its spawn already looked up. Empty if there is no pet.
+struct PetSnapshot
+{
+	uint32_t spawnID = 0;
+	eqlib::PlayerClient* spawn = nullptr;      // null if the spawn isn't in the spawn list
+	uint32_t targetID = 0;
+	int hpPct = 0;
+
+	// The toggles of the pet window
+	bool follow = false;
+	bool hold = false;
+	bool gHold = false;
+	bool spellHold = false;
+	bool resume = false;
+	bool procHold = false;
+	bool reGroup = false;
+	bool stop = false;
+	bool taunt = false;
+	bool focus = false;
+
+	int maxBuffs = 0;
+	std::vector<PetBuffState> buffs;           // only the slots that hold a buff, in slot order
+	uint64_t timestamp = 0;                    // GetTickCount64 when the snapshot was taken
+};
+
+// The mercenary as of this pulse. The state is filled in even when there is no mercenary.
+struct MercenarySnapshot
+{
+	int index = -1;                            // currMercenaryIndex, -1 if there is no mercenary
+	int stateID = 0;                           // MercenaryState
+	const char* stateName = "NONE";            // NONE, SUSPENDED, DEAD or ACTIVE
+	uint32_t spawnID = 0;
+	eqlib::PlayerClient* spawn = nullptr;      // null if the spawn isn't in the spawn list
+	int stanceStringID = -1;
+	std::string stanceName = "NULL";
+	int hpPct = 0;
+};
+
+// Takes the snapshot of the pet and mercenary that the rest of the pulse reads from, and gives the
+// buffs of the pet window to the cached buffs of the pet. Called once per pulse, before the cached
+// buffs, macros and game events are processed.
+void PetMerc_Pulse();
+
+// Keeps the spawns of the snapshot valid between pulses.
+void PetMerc_OnAddSpawn(eqlib::PlayerClient* pSpawn);
+void PetMerc_OnRemoveSpawn(eqlib::PlayerClient* pSpawn);
+
+// The MQPetChange and MQMercenaryChange bits for what changed since the previous pulse.
+uint32_t PetMerc_GetPetChanges();
+uint32_t PetMerc_GetMercenaryChanges();
+
+const PetSnapshot& GetPetSnapshot();
+const MercenarySnapshot& GetMercenarySnapshot();
+
+// The buff in the given 0 based slot of the pet window, or null if the slot is empty.
+const PetBuffState* GetPetBuffState(int slot);
+
+// The descriptions of the mercenaries from GetAllMercDesc. They are only parsed again when the
+// list of mercenaries changes.
+const std::vector<MercDesc>& GetMercenaryDescriptions();
+
+// Queues Event_PetMercChange for the macro, if it has that sub. Lives with the other macro events.
+void AddPetMercChangeEvent(bool mercenary, uint32_t changes, uint32_t spawnID);
+
+} // namespace mq
@@ -22,6 +22,16 @@
 #include <random>
 
 #include "MQCommandAPI.h"
+#include "MQDataAPI.h"
+#include "MQGameEvents.h"
+#include "MQRemoteQuery.h"
+#include "MQWarmUp.h"
+#include "MQSpawnTriggers.h"
+#include "MQMemoryAccounting.h"
+#include "MQPetMercState.h"
+#include "MQPluginHandler.h"
+#include "MQXTargets.h"
+#include "MQ2ImGuiTools.h"
 
 //#define DEBUG_PLUGINS
 
@@ -98,14 +108,446 @@ extern std::set<HMODULE> g_knownModules;
 std::vector<MQModule*> gInternalModules;
 static ModuleInitializer* s_moduleInitializerList = nullptr;
 
+//----------------------------------------------------------------------------
+// Callback lists
+//
+// For the callbacks that run every frame or for every spawn and chat line, a list of only the
+// modules and plugins that implement them, in the order ForEachModule and ForEachPlugin visit
+// them. The lists are rebuilt whenever a module or plugin is added or removed. Dispatching holds
+// on to the lists it started with, so a callback that loads or unloads a plugin doesn't change
+// the list being walked. Entries of anything removed since are skipped.
+//
+// Calls into plugins are timed, see PluginTimings. When a budget is configured, a plugin whose
+// callback goes over it is reported, and its OnPulse is throttled if gPluginThrottleFrames is set.
+
+template <typename Fn>
+struct CallbackTarget
+{
+	Fn callback;
+	const MQModule* module;            // one of module or plugin is set
+	const MQPlugin* plugin;
+	std::shared_ptr<PluginTimings> timings;
+
+	// Only used for the OnPulse of plugins with a pulse tier.
+	PluginPulseTier pulseTier = PluginPulseTier::EveryFrame;
+	mutable std::chrono::steady_clock::time_point nextPulse;
+
+	// Only used for OnUpdateImGui while ImGui is headless.
+	mutable std::chrono::steady_clock::time_point nextHeadlessUpdate;
+};
+
+struct CallbackLists
+{
+	uint32_t generation = 0;
+	std::vector<CallbackTarget<fMQWriteChatColor>> writeChatColor;
+	std::vector<CallbackTarget<fMQIncomingChat>>   incomingChat;
+	std::vector<CallbackTarget<fMQPulse>>          pulse;
+	std::vector<CallbackTarget<fMQDrawHUD>>        drawHUD;
+	std::vector<CallbackTarget<fMQSpawn>>          addSpawn;
+	std::vector<CallbackTarget<fMQSpawn>>          removeSpawn;
+	std::vector<CallbackTarget<fMQGroundItem>>     addGroundItem;
+	std::vector<CallbackTarget<fMQGroundItem>>     removeGroundItem;
+	std::vector<CallbackTarget<fMQUpdateImGui>>    updateImGui;
+};
+
+static std::shared_ptr<const CallbackLists> s_callbackLists = std::make_shared<CallbackLists>();
+static uint32_t s_callbackGeneration = 0;
+
+// Timings of the plugins in the plugin list, in the same order.
+static std::vector<std::pair<const MQPlugin*, std::shared_ptr<PluginTimings>>> s_pluginTimings;
+
+// Set at the start of every pulse, so idle pulses can tell whether the last frame was quiet.
+static bool s_tieredPulseThisFrame = false;
+static bool s_tieredPulseLastFrame = false;
+
+static constexpr std::chrono::milliseconds IdlePulseMaxDelay{ 5000 };
+static constexpr int PulseTierCount = 4;
+
+static std::chrono::milliseconds GetPulseTierPeriod(PluginPulseTier tier)
+{
+	switch (tier)
+	{
+	case PluginPulseTier::TenPerSecond: return std::chrono::milliseconds{ 100 };
+	case PluginPulseTier::OncePerSecond: return std::chrono::milliseconds{ 1000 };
+	case PluginPulseTier::Idle: return std::chrono::milliseconds{ 1000 };
+	default: return std::chrono::milliseconds::zero();
+	}
+}
+
+// Staggers the first pulse of the plugins in each tier over the period of the tier, so they
+// are spread over different frames instead of all running on the same one.
+static void SchedulePulseTiers(std::vector<CallbackTarget<fMQPulse>>& targets)
+{
+	int tierCounts[PulseTierCount] = {};
+	for (CallbackTarget<fMQPulse>& target : targets)
+	{
+		if (!target.plugin)
+			continue;
+
+		const int tier = static_cast<int>(target.plugin->PulseTier);
+		target.pulseTier = tier > 0 && tier < PulseTierCount ? target.plugin->PulseTier : PluginPulseTier::EveryFrame;
+		++tierCounts[static_cast<int>(target.pulseTier)];
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	int tierIndexes[PulseTierCount] = {};
+
+	for (CallbackTarget<fMQPulse>& target : targets)
+	{
+		if (target.pulseTier == PluginPulseTier::EveryFrame)
+			continue;
+
+		const int tier = static_cast<int>(target.pulseTier);
+		target.nextPulse = now + GetPulseTierPeriod(target.pulseTier) * tierIndexes[tier]++ / tierCounts[tier];
+	}
+}
+
+static bool IsTieredPulseDue(const CallbackTarget<fMQPulse>& target)
+{
+	const auto now = std::chrono::steady_clock::now();
+	if (now < target.nextPulse)
+		return false;
+
+	// Idle pulses wait for a frame after one without any tiered pulses, but not forever.
+	if (target.pulseTier == PluginPulseTier::Idle
+		&& (s_tieredPulseThisFrame || s_tieredPulseLastFrame)
+		&& now - target.nextPulse < IdlePulseMaxDelay)
+	{
+		return false;
+	}
+
+	// Keep the rate by scheduling from the time it was due, but don't try to catch up after a stall.
+	const std::chrono::milliseconds period = GetPulseTierPeriod(target.pulseTier);
+	target.nextPulse += period;
+	if (target.nextPulse <= now)
+		target.nextPulse = now + period;
+
+	s_tieredPulseThisFrame = true;
+	return true;
+}
+
+// While ImGui is headless, OnUpdateImGui is only called at the headless interval of the plugin.
+static bool s_imguiHeadless = false;
+
+static bool IsHeadlessImGuiUpdateDue(const CallbackTarget<fMQUpdateImGui>& target)
+{
+	const std::chrono::milliseconds interval{ target.plugin ? target.plugin->HeadlessImGuiInterval : 0 };
+	if (interval <= std::chrono::milliseconds::zero())
+		return false;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now < target.nextHeadlessUpdate)
+		return false;
+
+	target.nextHeadlessUpdate = now + interval;
+	return true;
+}
+
+template <typename Fn>
+static void AddCallbackTarget(std::vector<CallbackTarget<Fn>>& list, Fn callback,
+	const MQModule* module, const MQPlugin* plugin, const std::shared_ptr<PluginTimings>& timings = nullptr)
+{
+	if (callback)
+		list.push_back({ callback, module, plugin, timings });
+}
+
+static void RebuildCallbackLists()
+{
+	std::scoped_lock lock(s_pluginsMutex);
+
+	auto lists = std::make_shared<CallbackLists>();
+	lists->generation = ++s_callbackGeneration;
+
+	for (const MQModule* module : gInternalModules)
+	{
+		AddCallbackTarget(lists->writeChatColor, module->WriteChatColor, module, nullptr);
+		AddCallbackTarget(lists->pulse, module->Pulse, module, nullptr);
+		AddCallbackTarget(lists->addSpawn, module->SpawnAdded, module, nullptr);
+		AddCallbackTarget(lists->removeSpawn, module->SpawnRemoved, module, nullptr);
+	}
+
+	// Keep the timings of plugins that are still loaded.
+	auto previousTimings = std::move(s_pluginTimings);
+	s_pluginTimings.clear();
+
+	for (const MQPlugin* plugin = pPlugins; plugin; plugin = plugin->pNext)
+	{
+		auto iter = std::find_if(previousTimings.begin(), previousTimings.end(),
+			[plugin](const auto& entry) { return entry.first == plugin; });
+
+		std::shared_ptr<PluginTimings> timings;
+		if (iter != previousTimings.end())
+		{
+			timings = iter->second;
+		}
+		else
+		{
+			timings = std::make_shared<PluginTimings>();
+			timings->name = plugin->name;
+			timings->timelineName = InternTimelineName(plugin->name);
+		}
+
+		s_pluginTimings.emplace_back(plugin, timings);
+
+		AddCallbackTarget(lists->writeChatColor, plugin->WriteChatColor, nullptr, plugin, timings);
+		AddCallbackTarget(lists->incomingChat, plugin->IncomingChat, nullptr, plugin, timings);
+		AddCallbackTarget(lists->pulse, plugin->Pulse, nullptr, plugin, timings);
+		AddCallbackTarget(lists->drawHUD, plugin->DrawHUD, nullptr, plugin, timings);
+		AddCallbackTarget(lists->addSpawn, plugin->AddSpawn, nullptr, plugin, timings);
+		AddCallbackTarget(lists->removeSpawn, plugin->RemoveSpawn, nullptr, plugin, timings);
+		AddCallbackTarget(lists->addGroundItem, plugin->AddGroundItem, nullptr, plugin, timings);
+		AddCallbackTarget(lists->removeGroundItem, plugin->RemoveGroundItem, nullptr, plugin, timings);
+		AddCallbackTarget(lists->updateImGui, plugin->UpdateImGui, nullptr, plugin, timings);
+	}
+
+	SchedulePulseTiers(lists->pulse);
+	s_callbackLists = std::move(lists);
+}
+
+template <typename Fn>
+static bool IsCallbackTargetListed(const CallbackTarget<Fn>& target)
+{
+	if (target.module)
+		return std::find(gInternalModules.begin(), gInternalModules.end(), target.module) != gInternalModules.end();
+
+	for (const MQPlugin* plugin = pPlugins; plugin; plugin = plugin->pNext)
+	{
+		if (plugin == target.plugin)
+			return true;
+	}
+
+	return false;
+}
+
+static const char* s_pluginCallbackNames[] = {
+	"OnWriteChatColor",
+	"OnIncomingChat",
+	"OnPulse",
+	"OnDrawHUD",
+	"OnAddSpawn",
+	"OnRemoveSpawn",
+	"OnAddGroundItem",
+	"OnRemoveGroundItem",
+	"OnUpdateImGui",
+};
+static_assert(lengthof(s_pluginCallbackNames) == static_cast<size_t>(PluginCallback::Count));
+
+const char* GetPluginCallbackName(PluginCallback callback)
+{
+	return s_pluginCallbackNames[static_cast<size_t>(callback)];
+}
+
+void PluginCallbackTiming::Add(std::chrono::nanoseconds elapsed)
+{
+	++count;
+	total += elapsed;
+	max = std::max(max, elapsed);
+
+	window[windowPos] = elapsed;
+	windowPos = (windowPos + 1) % WindowSize;
+}
+
+std::chrono::nanoseconds PluginCallbackTiming::GetAverage() const
+{
+	const uint32_t windowCount = GetWindowCount();
+	if (windowCount == 0)
+		return std::chrono::nanoseconds::zero();
+
+	std::chrono::nanoseconds sum{ 0 };
+	for (uint32_t i = 0; i < windowCount; ++i)
+		sum += window[i];
+
+	return sum / windowCount;
+}
+
+std::chrono::nanoseconds PluginCallbackTiming::GetPercentile(float percentile) const
+{
+	const uint32_t windowCount = GetWindowCount();
+	if (windowCount == 0)
+		return std::chrono::nanoseconds::zero();
+
+	std::array<std::chrono::nanoseconds, WindowSize> sorted = window;
+	const uint32_t rank = std::min(windowCount - 1, static_cast<uint32_t>(percentile * windowCount));
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.begin() + windowCount);
+
+	return sorted[rank];
+}
+
+// Called every time the window of a callback fills up again.
+static void CheckCallbackBudget(PluginTimings& timings, PluginCallback callback)
+{
+	PluginCallbackTiming& timing = timings.Get(callback);
+	const int budget = callback == PluginCallback::Pulse ? gPluginPulseBudget : gPluginCallbackBudget;
+
+	if (budget <= 0)
+	{
+		timing.overBudget = false;
+		if (callback == PluginCallback::Pulse)
+			timings.throttleFrames = 0;
+		return;
+	}
+
+	// Only recover once well under the budget, so a plugin hovering around it doesn't flip back and forth.
+	const std::chrono::nanoseconds p99 = timing.GetPercentile(0.99f);
+	const std::chrono::microseconds budgetTime{ budget };
+	const bool wasOverBudget = timing.overBudget;
+
+	if (p99 > budgetTime)
+		timing.overBudget = true;
+	else if (p99 < budgetTime / 2)
+		timing.overBudget = false;
+
+	if (timing.overBudget == wasOverBudget)
+		return;
+
+	if (timing.overBudget)
+	{
+		WriteChatf("\ay%s\ax: \ar%s is over budget\ax (99th percentile %.3f ms, budget %.3f ms).",
+			timings.name.c_str(), GetPluginCallbackName(callback),
+			p99.count() / 1000000.0, budget / 1000.0);
+
+		if (callback == PluginCallback::Pulse && gPluginThrottleFrames > 1)
+		{
+			timings.throttleFrames = gPluginThrottleFrames;
+			timings.throttleCounter = 0;
+
+			WriteChatf("\ay%s\ax: OnPulse is now called every %d frames.", timings.name.c_str(), timings.throttleFrames);
+		}
+	}
+	else if (callback == PluginCallback::Pulse && timings.throttleFrames)
+	{
+		timings.throttleFrames = 0;
+
+		WriteChatf("\ay%s\ax: OnPulse is back under budget and called every frame again.", timings.name.c_str());
+	}
+}
+
+// Calls invoke with each callback in the list. Stops early if invoke returns false.
+template <PluginCallback Kind, typename Fn, typename Invoke>
+static void DispatchCallback(std::vector<CallbackTarget<Fn>> CallbackLists::* list, Invoke&& invoke)
+{
+	std::scoped_lock lock(s_pluginsMutex);
+	const std::shared_ptr<const CallbackLists> lists = s_callbackLists;
+
+	for (const CallbackTarget<Fn>& target : (*lists).*list)
+	{
+		if (lists->generation != s_callbackGeneration && !IsCallbackTargetListed(target))
+			continue;
+
+		PluginTimings* timings = target.timings.get();
+		if constexpr (Kind == PluginCallback::Pulse)
+		{
+			if (target.pulseTier != PluginPulseTier::EveryFrame && !IsTieredPulseDue(target))
+				continue;
+
+			if (timings && timings->throttleFrames > 1
+				&& ++timings->throttleCounter % timings->throttleFrames != 0)
+			{
+				continue;
+			}
+		}
+		else if constexpr (Kind == PluginCallback::UpdateImGui)
+		{
+			if (s_imguiHeadless && !IsHeadlessImGuiUpdateDue(target))
+				continue;
+		}
+
+		const auto start = timings ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+		bool keepGoing = true;
+
+		if constexpr (std::is_same_v<decltype(invoke(target.callback)), bool>)
+		{
+			keepGoing = invoke(target.callback);
+		}
+		else
+		{
+			invoke(target.callback);
+		}
+
+		if (timings)
+		{
+			static const uint32_t s_timelineCategory = InternTimelineName(GetPluginCallbackName(Kind));
+
+			const auto now = std::chrono::steady_clock::now();
+			AddTimelineEvent(timings->timelineName, s_timelineCategory, start, now);
+
+			PluginCallbackTiming& timing = timings->Get(Kind);
+			timing.Add(now - start);
+
+			if (timing.windowPos == 0)
+				CheckCallbackBudget(*timings, Kind);
+		}
+
+		if (!keepGoing)
+			break;
+	}
+}
+
+const PluginTimings* GetPluginTimings(const MQPlugin* plugin)
+{
+	std::scoped_lock lock(s_pluginsMutex);
+
+	for (const auto& [timingsPlugin, timings] : s_pluginTimings)
+	{
+		if (timingsPlugin == plugin)
+			return timings.get();
+	}
+
+	return nullptr;
+}
+
+void ForEachPluginTimings(const std::function<void(const PluginTimings&)>& callback)
+{
+	std::scoped_lock lock(s_pluginsMutex);
+
+	for (const auto& [plugin, timings] : s_pluginTimings)
+		callback(*timings);
+}
+
+void ResetPluginTimings()
+{
+	std::scoped_lock lock(s_pluginsMutex);
+
+	for (const auto& [plugin, timings] : s_pluginTimings)
+	{
+		timings->callbacks = {};
+		timings->throttleFrames = 0;
+		timings->throttleCounter = 0;
+	}
+}
+
 void InitializeInternalModules()
 {
-	ModuleInitializer* initializer = s_moduleInitializerList;
+	std::vector<ModuleInitializer*> pending;
+	for (ModuleInitializer* initializer = s_moduleInitializerList; initializer; initializer = initializer->next)
+		pending.push_back(initializer);
+
+	// Static modules register in whatever order the linker put their files in, so initialize them
+	// in the order of their dependencies. Names that aren't static modules are ignored, those are
+	// either added separately or don't exist.
+	auto isPending = [&pending](const char* name)
+	{
+		return std::any_of(pending.begin(), pending.end(),
+			[name](const ModuleInitializer* initializer) { return ci_equals(initializer->module->name, name); });
+	};
 
-	while (initializer)
+	while (!pending.empty())
 	{
+		auto iter = std::find_if(pending.begin(), pending.end(), [&](const ModuleInitializer* initializer)
+			{
+				return std::none_of(initializer->dependencies.begin(), initializer->dependencies.end(), isPending);
+			});
+
+		if (iter == pending.end())
+		{
+			SPDLOG_WARN("Internal modules have circular dependencies, initializing the rest in registration order");
+			iter = pending.begin();
+		}
+
+		ModuleInitializer* initializer = *iter;
+		pending.erase(iter);
+
 		AddInternalModule(initializer->module);
-		initializer = initializer->next;
 	}
 }
 
@@ -120,6 +562,7 @@ void AddInternalModule(MQModule* module, bool manualUnload /*=false*/)
 	SPDLOG_DEBUG("Initializing module: {0}", module->name);
 
 	gInternalModules.push_back(module);
+	RebuildCallbackLists();
 
 	if (module->Initialize)
 		module->Initialize();
@@ -138,6 +581,7 @@ void RemoveInternalModule(MQModule* module)
 		return;
 
 	gInternalModules.erase(iter);
+	RebuildCallbackLists();
 
 	if (module->loaded && module->Shutdown)
 	{
@@ -477,6 +921,154 @@ void AddPluginToList(MQPlugin* pPlugin)
 	if (pPlugins)
 		pPlugins->pLast = pPlugin;
 	pPlugins = pPlugin;
+
+	RebuildCallbackLists();
+}
+
+//----------------------------------------------------------------------------
+// Plugin replays
+//
+// A plugin that is loaded in game is told about the spawns and ground items that already exist.
+// In a crowded zone that can take long enough to freeze the client, so the existing objects are
+// handed over a few at a time each pulse instead, within PluginReplayBudget. Objects that appear
+// after the load reach the plugin the usual way. Objects that go away before being replayed are
+// dropped from the replay, and the plugin isn't told about their removal either.
+
+struct PluginReplay
+{
+	MQPlugin* plugin = nullptr;
+	std::vector<PlayerClient*> spawns;
+	std::vector<EQGroundItem*> groundItems;
+	size_t nextSpawn = 0;
+	size_t nextGroundItem = 0;
+};
+
+static std::vector<PluginReplay> s_pluginReplays;
+static constexpr std::chrono::microseconds PluginReplayBudget{ 2000 };
+
+// The replay that is being handed over. It is taken out of s_pluginReplays while its callbacks run,
+// since those can load and unload plugins. Cleared out (plugin set to null) if it is cancelled.
+static PluginReplay* s_activeReplay = nullptr;
+
+static void QueuePluginReplay(MQPlugin* pPlugin)
+{
+	PluginReplay replay;
+	replay.plugin = pPlugin;
+
+	if (pPlugin->AddSpawn)
+	{
+		for (PlayerClient* pSpawn = pSpawnList; pSpawn; pSpawn = pSpawn->pNext)
+			replay.spawns.push_back(pSpawn);
+	}
+
+	if (pPlugin->AddGroundItem)
+	{
+		for (EQGroundItem* pItem = pItemList->Top; pItem; pItem = pItem->pNext)
+			replay.groundItems.push_back(pItem);
+	}
+
+	if (!replay.spawns.empty() || !replay.groundItems.empty())
+		s_pluginReplays.push_back(std::move(replay));
+}
+
+static void RemovePluginReplay(MQPlugin* pPlugin)
+{
+	s_pluginReplays.erase(std::remove_if(s_pluginReplays.begin(), s_pluginReplays.end(),
+		[pPlugin](const PluginReplay& replay) { return replay.plugin == pPlugin; }), s_pluginReplays.end());
+
+	if (s_activeReplay && s_activeReplay->plugin == pPlugin)
+		s_activeReplay->plugin = nullptr;
+}
+
+static void ClearPluginReplays()
+{
+	s_pluginReplays.clear();
+
+	if (s_activeReplay)
+		s_activeReplay->plugin = nullptr;
+}
+
+// Drops the object from the replays that haven't reached it yet, and returns the plugins of those
+// replays. They were never told about the object, so they shouldn't be told that it went away.
+template <typename T>
+static std::vector<const MQPlugin*> RemoveFromPluginReplays(std::vector<T*> PluginReplay::* objects,
+	size_t PluginReplay::* next, T* pObject)
+{
+	std::vector<const MQPlugin*> notReplayed;
+
+	auto remove = [&](PluginReplay& replay)
+	{
+		std::vector<T*>& list = replay.*objects;
+		auto iter = std::find(list.begin() + std::min(replay.*next, list.size()), list.end(), pObject);
+		if (iter != list.end())
+		{
+			*iter = nullptr;
+			notReplayed.push_back(replay.plugin);
+		}
+	};
+
+	for (PluginReplay& replay : s_pluginReplays)
+		remove(replay);
+
+	if (s_activeReplay && s_activeReplay->plugin)
+		remove(*s_activeReplay);
+
+	return notReplayed;
+}
+
+static void ProcessPluginReplays()
+{
+	if (s_pluginReplays.empty())
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	int count = 0;
+
+	// Always make some progress, then check the clock every few objects.
+	auto overBudget = [&]()
+	{
+		return (++count % 16) == 0 && std::chrono::steady_clock::now() - start > PluginReplayBudget;
+	};
+
+	while (!s_pluginReplays.empty())
+	{
+		PluginReplay replay = std::move(s_pluginReplays.front());
+		s_pluginReplays.erase(s_pluginReplays.begin());
+
+		s_activeReplay = &replay;
+		bool finished = false;
+
+		while (replay.plugin)
+		{
+			if (replay.nextSpawn < replay.spawns.size())
+			{
+				if (PlayerClient* pSpawn = replay.spawns[replay.nextSpawn++])
+					replay.plugin->AddSpawn(pSpawn);
+			}
+			else if (replay.nextGroundItem < replay.groundItems.size())
+			{
+				if (EQGroundItem* pItem = replay.groundItems[replay.nextGroundItem++])
+					replay.plugin->AddGroundItem(pItem);
+			}
+			else
+			{
+				finished = true;
+				break;
+			}
+
+			if (overBudget())
+				break;
+		}
+
+		s_activeReplay = nullptr;
+
+		// The plugin may have been unloaded by one of the callbacks, otherwise pick up from here next pulse.
+		if (!finished && replay.plugin)
+		{
+			s_pluginReplays.insert(s_pluginReplays.begin(), std::move(replay));
+			return;
+		}
+	}
 }
 
 void RemovePluginFromList(MQPlugin* pPlugin)
@@ -490,6 +1082,9 @@ void RemovePluginFromList(MQPlugin* pPlugin)
 		pPlugins = pPlugin->pNext;
 	if (pPlugin->pNext)
 		pPlugin->pNext->pLast = pPlugin->pLast;
+
+	RemovePluginReplay(pPlugin);
+	RebuildCallbackLists();
 }
 
 // 0 - failed
@@ -573,6 +1168,15 @@ int LoadPlugin(std::string_view pluginName, bool save)
 	else
 		pPlugin->fpVersion = 1.0;
 
+	if (auto pulseTier = (PluginPulseTier*)GetProcAddress(pPlugin->hModule, "MQPulseTier"))
+		pPlugin->PulseTier = *pulseTier;
+
+	if (auto headlessInterval = (int*)GetProcAddress(pPlugin->hModule, "MQHeadlessImGuiInterval"))
+		pPlugin->HeadlessImGuiInterval = *headlessInterval;
+
+	if (auto memoryCounters = (MQMemoryCounters*)GetProcAddress(pPlugin->hModule, "MQPluginMemory"))
+		MemoryAccounting_AddPlugin(pPlugin, memoryCounters);
+
 	// initialize plugin
 	if (pPlugin->Initialize)
 		pPlugin->Initialize();
@@ -581,30 +1185,9 @@ int LoadPlugin(std::string_view pluginName, bool save)
 	if (pPlugin->SetGameState)
 		pPlugin->SetGameState(GetGameState());
 
+	// init spawns and ground items, spread over the next few pulses
 	if (GetGameState() == GAMESTATE_INGAME)
-	{
-		// init spawns
-		if (pPlugin->AddSpawn)
-		{
-			SPAWNINFO* pSpawn = pSpawnList;
-			while (pSpawn)
-			{
-				pPlugin->AddSpawn(pSpawn);
-				pSpawn = pSpawn->pNext;
-			}
-		}
-
-		// init ground items
-		if (pPlugin->AddGroundItem)
-		{
-			EQGroundItem* pItem = pItemList->Top;
-			while (pItem)
-			{
-				pPlugin->AddGroundItem(pItem);
-				pItem = pItem->pNext;
-			}
-		}
-	}
+		QueuePluginReplay(pPlugin);
 
 	AddPluginToList(pPlugin);
 	s_pluginMap.emplace(std::string_view(pPlugin->name), rec);
@@ -639,6 +1222,12 @@ static void ShutdownPlugin(const PluginInfoRec& rec)
 
 	// Perform any additional de-registration as required
 	pCommandAPI->OnPluginUnloaded(pPlugin, rec.handle);
+	pDataAPI->OnPluginUnloaded(pPlugin, rec.handle);
+	GameEvents_OnPluginUnloaded(pPlugin, rec.handle);
+	WarmUp_OnPluginUnloaded(pPlugin, rec.handle);
+	SpawnTriggers_OnPluginUnloaded(pPlugin, rec.handle);
+	RemoteQuery_OnPluginUnloaded(pPlugin, rec.handle);
+	MemoryAccounting_OnPluginUnloaded(pPlugin);
 }
 
 bool UnloadPlugin(std::string_view pluginName, bool save /* = false */)
@@ -801,6 +1390,39 @@ void ForEachPlugin(Callback&& callback)
 	}
 }
 
+// Lines written since the last FlushDeferredChat, and the batch being flushed.
+static std::vector<MQChatLine> s_deferredChat;
+static std::vector<MQChatLine> s_flushingChat;
+
+void FlushDeferredChat()
+{
+	if (s_deferredChat.empty())
+		return;
+
+	// Anything the sinks write goes into the next batch.
+	std::swap(s_deferredChat, s_flushingChat);
+
+	// One DebugSpew for the whole batch, so it goes wherever DebugSpew is configured to go
+	// without paying for it on every line.
+	if (!gFilterDebug)
+	{
+		fmt::memory_buffer spew;
+		for (const MQChatLine& line : s_flushingChat)
+		{
+			if (spew.size() > 0)
+				spew.push_back('\n');
+			fmt::format_to(fmt::appender(spew), "WriteChatColor({})", line.text);
+		}
+		spew.push_back('\0');
+
+		DebugSpew("%s", spew.data());
+	}
+
+	ImGuiConsoleAddLines(s_flushingChat);
+
+	s_flushingChat.clear();
+}
+
 void PluginsWriteChatColor(const char* Line, int Color, int Filter)
 {
 	if (!s_pluginsInitialized)
@@ -812,26 +1434,29 @@ void PluginsWriteChatColor(const char* Line, int Color, int Filter)
 
 	MQScopedBenchmark bm(bmWriteChatColor);
 
-	if (size_t len = strlen(Line))
+	const size_t len = strlen(Line);
+	if (len)
 	{
-		std::unique_ptr<char[]> plainText = std::make_unique<char[]>(len + 1);
+		// Lines almost always fit on the stack, only longer ones need an allocation.
+		char buffer[MAX_STRING];
+		std::unique_ptr<char[]> longBuffer;
+		char* plainText = buffer;
 
-		StripMQChat(Line, plainText.get());
-		CheckChatForEvent(plainText.get());
+		if (len >= MAX_STRING)
+		{
+			longBuffer = std::make_unique<char[]>(len + 1);
+			plainText = longBuffer.get();
+		}
 
-		DebugSpew("WriteChatColor(%s)", Line);
+		StripMQChat(Line, plainText);
+		CheckChatForEvent(plainText);
 	}
 
-	ForEachModule([&](const MQModule* module)
-		{
-			if (module->WriteChatColor)
-				module->WriteChatColor(Line, Color, Filter);
-		});
+	s_deferredChat.push_back({ std::string(Line, len), Color, Filter });
 
-	ForEachPlugin([&](const MQPlugin* plugin)
+	DispatchCallback<PluginCallback::WriteChatColor>(&CallbackLists::writeChatColor, [&](fMQWriteChatColor callback)
 		{
-			if (plugin->WriteChatColor)
-				plugin->WriteChatColor(Line, Color, Filter);
+			callback(Line, Color, Filter);
 		});
 }
 
@@ -846,10 +1471,11 @@ bool PluginsIncomingChat(const char* Line, uint32_t Color)
 
 	bool Ret = false;
 
-	ForEachPlugin([&](const MQPlugin* plugin) mutable
+	// Once a plugin handles the line, the rest don't see it.
+	DispatchCallback<PluginCallback::IncomingChat>(&CallbackLists::incomingChat, [&](fMQIncomingChat callback)
 		{
-			if (plugin->IncomingChat)
-				Ret = Ret || plugin->IncomingChat(Line, Color);
+			Ret = callback(Line, Color);
+			return !Ret;
 		});
 
 	return Ret;
@@ -862,16 +1488,14 @@ void PulsePlugins()
 
 	PluginDebug("PulsePlugins()");
 
-	ForEachModule([](const MQModule* module)
-		{
-			if (module->Pulse)
-				module->Pulse();
-		});
+	s_tieredPulseLastFrame = s_tieredPulseThisFrame;
+	s_tieredPulseThisFrame = false;
 
-	ForEachPlugin([](const MQPlugin* plugin)
+	ProcessPluginReplays();
+
+	DispatchCallback<PluginCallback::Pulse>(&CallbackLists::pulse, [](fMQPulse callback)
 		{
-			if (plugin->Pulse)
-				plugin->Pulse();
+			callback();
 		});
 }
 
@@ -966,6 +1590,9 @@ void PluginsSetGameState(int GameState)
 	DrawHUDParams[0] = 0;
 	gGameState = GameState;
 
+	if (GameState != GAMESTATE_INGAME)
+		ClearPluginReplays();
+
 	if (GameState != GAMESTATE_INGAME && GameState != GAMESTATE_LOGGINGIN)
 	{
 		gbSpelldbLoaded = false;
@@ -1048,36 +1675,33 @@ void PluginsDrawHUD()
 
 	PluginDebug("PluginsDrawHUD()");
 
-	ForEachPlugin([](const MQPlugin* plugin)
+	DispatchCallback<PluginCallback::DrawHUD>(&CallbackLists::drawHUD, [](fMQDrawHUD callback)
 		{
-			if (plugin->DrawHUD)
-				plugin->DrawHUD();
+			callback();
 		});
 }
 
 void PluginsAddSpawn(PlayerClient* pNewSpawn)
 {
+	XTargets_OnAddSpawn(pNewSpawn);
+	PetMerc_OnAddSpawn(pNewSpawn);
+
 	if (!s_pluginsInitialized)
 		return;
 
 	PluginDebug("PluginsAddSpawn(%s,%d,%d)", pNewSpawn->Name, pNewSpawn->GetRace());
 
-	ForEachModule([pNewSpawn](const MQModule* module)
+	DispatchCallback<PluginCallback::AddSpawn>(&CallbackLists::addSpawn, [pNewSpawn](fMQSpawn callback)
 		{
-			if (module->SpawnAdded)
-				module->SpawnAdded(pNewSpawn);
-		});
-
-	ForEachPlugin([pNewSpawn](const MQPlugin* plugin)
-		{
-			if (plugin->AddSpawn)
-				plugin->AddSpawn(pNewSpawn);
+			callback(pNewSpawn);
 		});
 }
 
 void PluginsRemoveSpawn(PlayerClient* pSpawn)
 {
 	InvalidateObservedEQObject(pSpawn);
+	XTargets_OnRemoveSpawn(pSpawn);
+	PetMerc_OnRemoveSpawn(pSpawn);
 
 	if (!s_pluginsInitialized)
 		return;
@@ -1085,17 +1709,16 @@ void PluginsRemoveSpawn(PlayerClient* pSpawn)
 	PluginDebug("PluginsRemoveSpawn(%s)", pSpawn->Name);
 
 	ClearCachedBuffsSpawn(pSpawn);
+	const std::vector<const MQPlugin*> notReplayed = RemoveFromPluginReplays(&PluginReplay::spawns,
+		&PluginReplay::nextSpawn, pSpawn);
 
-	ForEachModule([pSpawn](const MQModule* module)
-		{
-			if (module->SpawnRemoved)
-				module->SpawnRemoved(pSpawn);
-		});
-
-	ForEachPlugin([pSpawn](const MQPlugin* plugin)
+	DispatchCallback<PluginCallback::RemoveSpawn>(&CallbackLists::removeSpawn, [&](fMQSpawn callback)
 		{
-			if (plugin->RemoveSpawn)
-				plugin->RemoveSpawn(pSpawn);
+			if (std::none_of(notReplayed.begin(), notReplayed.end(),
+				[callback](const MQPlugin* plugin) { return plugin->RemoveSpawn == callback; }))
+			{
+				callback(pSpawn);
+			}
 		});
 }
 
@@ -1108,10 +1731,9 @@ void PluginsAddGroundItem(EQGroundItem* pNewGroundItem)
 
 	DebugSpew("PluginsAddGroundItem(%s) %.1f,%.1f,%.1f", pNewGroundItem->Name, pNewGroundItem->X, pNewGroundItem->Y, pNewGroundItem->Z);
 
-	ForEachPlugin([pNewGroundItem](const MQPlugin* plugin)
+	DispatchCallback<PluginCallback::AddGroundItem>(&CallbackLists::addGroundItem, [pNewGroundItem](fMQGroundItem callback)
 		{
-			if (plugin->AddGroundItem)
-				plugin->AddGroundItem(pNewGroundItem);
+			callback(pNewGroundItem);
 		});
 }
 
@@ -1122,10 +1744,16 @@ void PluginsRemoveGroundItem(EQGroundItem* pGroundItem)
 
 	PluginDebug("PluginsRemoveGroundItem()");
 
-	ForEachPlugin([pGroundItem](const MQPlugin* plugin)
+	const std::vector<const MQPlugin*> notReplayed = RemoveFromPluginReplays(&PluginReplay::groundItems,
+		&PluginReplay::nextGroundItem, pGroundItem);
+
+	DispatchCallback<PluginCallback::RemoveGroundItem>(&CallbackLists::removeGroundItem, [&](fMQGroundItem callback)
 		{
-			if (plugin->RemoveGroundItem)
-				plugin->RemoveGroundItem(pGroundItem);
+			if (std::none_of(notReplayed.begin(), notReplayed.end(),
+				[callback](const MQPlugin* plugin) { return plugin->RemoveGroundItem == callback; }))
+			{
+				callback(pGroundItem);
+			}
 		});
 }
 
@@ -1138,6 +1766,11 @@ void PluginsBeginZone()
 
 	gbInZone = false;
 	gZoning = true;
+	if (pDataAPI)
+		pDataAPI->AdvanceZone();
+
+	// The spawns of the old zone are about to go away.
+	ClearPluginReplays();
 
 	ForEachModule([](const MQModule* module)
 		{
@@ -1165,6 +1798,8 @@ void PluginsEndZone()
 	gbInZone = true;
 	WereWeZoning = true;
 	LastEnteredZone = MQGetTickCount64();
+	if (pDataAPI)
+		pDataAPI->AdvanceZone();
 
 	ForEachModule([](const MQModule* module)
 		{
@@ -1197,15 +1832,16 @@ void ModulesUpdateImGui()
 		});
 }
 
-void PluginsUpdateImGui()
+void PluginsUpdateImGui(bool headless)
 {
 	if (!s_pluginsInitialized)
 		return;
 
-	ForEachPlugin([](const MQPlugin* plugin)
+	s_imguiHeadless = headless;
+
+	DispatchCallback<PluginCallback::UpdateImGui>(&CallbackLists::updateImGui, [](fMQUpdateImGui callback)
 		{
-			if (plugin->UpdateImGui)
-				plugin->UpdateImGui();
+			callback();
 		});
 }
 
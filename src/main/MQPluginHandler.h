@@ -18,7 +18,11 @@
 #error This header should only be included from the MQ2Main project
 #endif
 
+#include <array>
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <string>
 
 namespace eqlib
 {
@@ -28,6 +32,8 @@ namespace eqlib
 
 namespace mq {
 
+struct MQPlugin;
+
 void InitializePlugins();
 void UnloadPlugins();
 void ShutdownPlugins();
@@ -49,9 +55,85 @@ void PluginsAddGroundItem(EQGroundItem* pNewGroundItem);
 void PluginsRemoveGroundItem(EQGroundItem* pGroundItem);
 void PluginsBeginZone();
 void PluginsEndZone();
-void PluginsUpdateImGui();
+void PluginsUpdateImGui(bool headless = false);
 void ModulesUpdateImGui();
 void PluginsMacroStart(const char* Name);
 void PluginsMacroStop(const char* Name);
 
+//----------------------------------------------------------------------------
+// Plugin callback timings
+
+enum class PluginCallback
+{
+	WriteChatColor,
+	IncomingChat,
+	Pulse,
+	DrawHUD,
+	AddSpawn,
+	RemoveSpawn,
+	AddGroundItem,
+	RemoveGroundItem,
+	UpdateImGui,
+
+	Count
+};
+
+const char* GetPluginCallbackName(PluginCallback callback);
+
+// How long one callback of a plugin takes. Averages and percentiles are taken over the most
+// recent calls.
+struct PluginCallbackTiming
+{
+	static constexpr uint32_t WindowSize = 128;
+
+	uint64_t count = 0;
+	std::chrono::nanoseconds total{ 0 };
+	std::chrono::nanoseconds max{ 0 };
+	std::array<std::chrono::nanoseconds, WindowSize> window{};
+	uint32_t windowPos = 0;
+	bool overBudget = false;
+
+	void Add(std::chrono::nanoseconds elapsed);
+	uint32_t GetWindowCount() const { return count < WindowSize ? static_cast<uint32_t>(count) : WindowSize; }
+	std::chrono::nanoseconds GetAverage() const;
+	std::chrono::nanoseconds GetPercentile(float percentile) const;
+};
+
+struct PluginTimings
+{
+	std::string name;
+	uint32_t timelineName = 0;
+	std::array<PluginCallbackTiming, static_cast<size_t>(PluginCallback::Count)> callbacks;
+
+	// While the pulse of the plugin is over budget and throttling is enabled, OnPulse is only
+	// called every throttleFrames frames.
+	int throttleFrames = 0;
+	int throttleCounter = 0;
+
+	const PluginCallbackTiming& Get(PluginCallback callback) const { return callbacks[static_cast<size_t>(callback)]; }
+	PluginCallbackTiming& Get(PluginCallback callback) { return callbacks[static_cast<size_t>(callback)]; }
+};
+
+//----------------------------------------------------------------------------
+// Deferred chat
+
+// A line written with WriteChatColor. Sinks that aren't latency critical, like the console and
+// the debug spew of chat, get all the lines of a frame in one batch at the end of the pulse.
+struct MQChatLine
+{
+	std::string text;
+	int color = 0;
+	int filter = 0;
+};
+
+// Hands the chat written since the last call to the deferred sinks. Called once per pulse.
+void FlushDeferredChat();
+
+//----------------------------------------------------------------------------
+
+// Only used from the main thread.
+const PluginTimings* GetPluginTimings(const MQPlugin* plugin);
+void ForEachPluginTimings(const std::function<void(const PluginTimings&)>& callback);
+void ResetPluginTimings();
+
 } // namespace mq
@@ -60,11 +60,29 @@ private:
 		std::string account;
 		std::string server;
 		std::string character;
+		std::string endpoint;
 	};
 
 	std::unordered_map<uint32_t, ClientIdentification> m_identities;
 	ci_unordered::map<std::string, uint32_t> m_names;
 
+	// Messages to other clients from these connections. The peers deliver them to their
+	// mailboxes, so they don't handle anything but MSG_ROUTE.
+	class PeerEventsHandler : public NamedPipeEvents
+	{
+	public:
+		PeerEventsHandler(MQPostOffice* postOffice) : m_postOffice(postOffice) {}
+
+		virtual void OnIncomingMessage(PipeMessagePtr&& message) override
+		{
+			if (message->GetMessageId() == MQMessageId::MSG_ROUTE)
+				m_postOffice->DeliverRoutedMessage(std::move(message));
+		}
+
+	private:
+		MQPostOffice* m_postOffice;
+	};
+
 	class PipeEventsHandler : public NamedPipeEvents
 	{
 	public:
@@ -75,45 +93,8 @@ private:
 			switch (message->GetMessageId())
 			{
 			case MQMessageId::MSG_ROUTE:
-			{
-				auto envelope = ProtoMessage::Parse<proto::routing::Envelope>(message);
-				auto address = envelope.has_address() ? std::make_optional(envelope.address()) : std::nullopt;
-				// either this message is coming off the pipe, so assume it was routed correctly by the server,
-				// or it was routed internally after checking to make sure that the destination of the message
-				// was within the client. In either case, we can safely assume that we should route it to an
-				// internal mailbox
-				if (address && address->has_mailbox())
-				{
-					// we need to loop all mailboxes and deliver to all of them that end with the address
-					// if this is an RPC message, then we need to ensure that we have only one
-					if (message->GetRequestMode() == MQRequestMode::CallAndResponse)
-					{
-						auto mailbox = m_postOffice->FindMailbox(*address, m_postOffice->m_mailboxes.begin());
-
-						if (mailbox == m_postOffice->m_mailboxes.end()) // no addresses
-							RoutingFailed(envelope, MsgError_RoutingFailed, std::move(message), nullptr);
-						else if (m_postOffice->FindMailbox(*address, std::next(mailbox)) != m_postOffice->m_mailboxes.end()) // multiple addresses
-							RoutingFailed(envelope, MsgError_AmbiguousRecipient, std::move(message), nullptr);
-						else // we have exactly one recipient, this is valid
-							m_postOffice->DeliverTo(address->mailbox(), std::move(message));
-					}
-					else
-					{
-						// in any other case, just route the message
-						m_postOffice->DeliverTo(address->mailbox(), std::move(message));
-					}
-				}
-				else
-				{
-					// This is a failsafe action, we shouldn't expect to be here often. For this code to
-					// be reached, we would have to have a client that packages a message in an envelope
-					// that is intended to be parsed directly by the server and not routed anywhere (so
-					// no mailbox routing information is included), rather than just send the message
-					m_postOffice->DeliverTo("pipe_client", std::move(message));
-				}
-
+				m_postOffice->DeliverRoutedMessage(std::move(message));
 				break;
-			}
 
 			case MQMessageId::MSG_IDENTIFICATION:
 				if (message->GetHeader()->messageLength > 0)
@@ -127,11 +108,18 @@ private:
 					}
 					else
 					{
+						const std::string endpoint = id.has_endpoint() ? id.endpoint() : "";
+
+						auto iter = m_postOffice->m_identities.find(id.pid());
+						if (iter != m_postOffice->m_identities.end() && iter->second.endpoint != endpoint)
+							m_postOffice->DropPeer(id.pid());
+
 						m_postOffice->m_identities.insert_or_assign(id.pid(), ClientIdentification{
 							id.pid(),
 							id.has_account() ? id.account() : "",
 							id.has_server() ? id.server() : "",
-							id.has_character() ? id.character() : ""
+							id.has_character() ? id.character() : "",
+							endpoint
 							});
 
 						// only include the PID here, otherwise it's pseudonym-identifiable information from the logs
@@ -158,6 +146,7 @@ private:
 				else
 				{
 					m_postOffice->m_identities.erase(id.pid());
+					m_postOffice->DropPeer(id.pid());
 				}
 
 				// TODO: forward the message to all mailboxes
@@ -226,6 +215,9 @@ private:
 
 			// and then ask for the list of all ID's
 			m_postOffice->m_pipeClient.SendMessage(MQMessageId::MSG_IDENTIFICATION, nullptr, 0);
+
+			// the launcher doesn't remember subscriptions across connections
+			m_postOffice->SendSubscriptions();
 		}
 
 	private:
@@ -247,7 +239,7 @@ public:
 				//       requiring that all plugins start linking the same proto compile, so let's
 				//       try to avoid that with some simple object casts, assuming this will always
 				//       be local.
-			});
+			}, postoffice::MailboxPriority::Control);
 	}
 
 	static void RoutingFailed(
@@ -280,6 +272,163 @@ public:
 			{ return ci_ends_with(pair.first, address.mailbox()); });
 	}
 
+	void DeliverRoutedMessage(PipeMessagePtr&& message)
+	{
+		auto envelope = ProtoMessage::Parse<proto::routing::Envelope>(message);
+
+		// the launcher only sends a topic to the clients that subscribe to it
+		if (envelope.has_address() && envelope.address().has_topic())
+		{
+			DeliverToTopic(message, envelope);
+			return;
+		}
+
+		auto address = envelope.has_address() ? std::make_optional(envelope.address()) : std::nullopt;
+		// either this message is coming off a pipe, so assume it was routed correctly by the server or
+		// the peer that sent it, or it was routed internally after checking to make sure that the
+		// destination of the message was within the client. In either case, we can safely assume that
+		// we should route it to an internal mailbox
+		if (address && address->has_mailbox())
+		{
+			// we need to loop all mailboxes and deliver to all of them that end with the address
+			// if this is an RPC message, then we need to ensure that we have only one
+			if (message->GetRequestMode() == MQRequestMode::CallAndResponse)
+			{
+				auto mailbox = FindMailbox(*address, m_mailboxes.begin());
+
+				if (mailbox == m_mailboxes.end()) // no addresses
+					RoutingFailed(envelope, MsgError_RoutingFailed, std::move(message), nullptr);
+				else if (FindMailbox(*address, std::next(mailbox)) != m_mailboxes.end()) // multiple addresses
+					RoutingFailed(envelope, MsgError_AmbiguousRecipient, std::move(message), nullptr);
+				else // we have exactly one recipient, this is valid
+					DeliverTo(address->mailbox(), std::move(message));
+			}
+			else
+			{
+				// in any other case, just route the message
+				DeliverTo(address->mailbox(), std::move(message));
+			}
+		}
+		else
+		{
+			// This is a failsafe action, we shouldn't expect to be here often. For this code to
+			// be reached, we would have to have a client that packages a message in an envelope
+			// that is intended to be parsed directly by the server and not routed anywhere (so
+			// no mailbox routing information is included), rather than just send the message
+			DeliverTo("pipe_client", std::move(message));
+		}
+	}
+
+	static bool IsRecipient(const proto::routing::Address& address, const ClientIdentification& id)
+	{
+		return (!address.has_account() || ci_equals(address.account(), id.account)) &&
+			(!address.has_server() || ci_equals(address.server(), id.server)) &&
+			(!address.has_character() || ci_equals(address.character(), id.character));
+	}
+
+	// Finds the connection to the single client that an address resolves to, if we can send to it
+	// directly. The launcher stays the directory: the addresses are resolved with the identities it
+	// broadcasts, and anything that isn't for exactly one other client goes through it. Until the
+	// connection to a peer is up, its messages go through the launcher too.
+	ProtoPipeClient* FindPeer(const proto::routing::Address& address, bool rpc)
+	{
+		// only the launcher knows who subscribes to a topic
+		if (!m_peerServer || address.has_topic())
+			return nullptr;
+
+		uint32_t pid = 0;
+		if (address.has_pid())
+		{
+			pid = address.pid();
+		}
+		else if (address.has_name())
+		{
+			auto pid_it = m_names.find(address.name());
+			if (pid_it == m_names.end())
+				return nullptr;
+
+			pid = pid_it->second;
+		}
+		else if (rpc)
+		{
+			// we have the same view of the identities as the launcher, so we can check that an RPC
+			// has a single recipient the same way it does
+			auto match = [&address](const std::pair<const uint32_t, ClientIdentification>& pair)
+				{ return IsRecipient(address, pair.second); };
+
+			auto identity = std::find_if(m_identities.begin(), m_identities.end(), match);
+			if (identity == m_identities.end() || std::find_if(std::next(identity), m_identities.end(), match) != m_identities.end())
+				return nullptr;
+
+			pid = identity->first;
+		}
+		else
+		{
+			// multicasts are fanned out by the launcher
+			return nullptr;
+		}
+
+		if (pid == GetCurrentProcessId() || pid == m_launcherProcessID)
+			return nullptr;
+
+		auto identity = m_identities.find(pid);
+		if (identity == m_identities.end() || !ci_starts_with(identity->second.endpoint, MQ2_PIPE_SERVER_PATH))
+			return nullptr;
+
+		auto& peer = m_peers[pid];
+		if (!peer)
+		{
+			SPDLOG_DEBUG("Connecting to peer {}", pid);
+
+			peer = std::make_unique<ProtoPipeClient>(identity->second.endpoint.c_str());
+			peer->SetHandler(std::make_shared<PeerEventsHandler>(this));
+			peer->EnableSharedMemory(gbSharedMemoryRouting);
+			peer->Start();
+			return nullptr;
+		}
+
+		return peer->IsConnected() ? peer.get() : nullptr;
+	}
+
+	void DropPeer(uint32_t pid)
+	{
+		auto iter = m_peers.find(pid);
+		if (iter != m_peers.end())
+		{
+			SPDLOG_DEBUG("Dropping peer {}", pid);
+
+			iter->second->Stop();
+			m_peers.erase(iter);
+		}
+	}
+
+	// Our own endpoint goes in every identification, the launcher replaces the whole identity.
+	void SetEndpoint(proto::routing::Identification& id)
+	{
+		if (m_peerServer)
+			id.set_endpoint(m_peerEndpoint);
+	}
+
+	// The launcher delivers topics by the client, so it gets the whole set whenever it changes
+	void SendSubscriptions()
+	{
+		if (!m_pipeClient.IsConnected())
+			return;
+
+		proto::routing::Subscriptions subscriptions;
+		subscriptions.set_pid(GetCurrentProcessId());
+
+		for (std::string& topic : GetTopics())
+			subscriptions.add_topics(std::move(topic));
+
+		m_pipeClient.SendProtoMessage(MQMessageId::MSG_SUBSCRIPTIONS, subscriptions);
+	}
+
+	void OnSubscriptionsChanged() override
+	{
+		SendSubscriptions();
+	}
+
 	void RouteMessage(PipeMessagePtr&& message, const PipeMessageResponseCb& callback) override
 	{
 		if (message->GetMessageId() == MQMessageId::MSG_ROUTE)
@@ -305,15 +454,19 @@ public:
 					address.has_account() ||
 					address.has_server() ||
 					address.has_character() ||
-					address.has_mailbox())
+					address.has_mailbox() ||
+					address.has_topic())
 				{
 					// we can't assume that even if we match the address (account/server/character) that this
 					// client is the only one that does. We need to route it through the server to ensure that
-					// it gets to all clients that match
+					// it gets to all clients that match, unless it resolves to a single peer
+					ProtoPipeClient* peer = FindPeer(address, callback != nullptr);
+					NamedPipeClient& pipe = peer ? *peer : m_pipeClient;
+
 					if (callback == nullptr) // no response
-						m_pipeClient.SendMessage(std::move(message));
+						pipe.SendMessage(std::move(message));
 					else
-						m_pipeClient.SendMessageWithResponse(std::move(message), callback);
+						pipe.SendMessageWithResponse(std::move(message), callback);
 				}
 				else if (address.has_pid() && address.pid() == GetCurrentProcessId() && callback != nullptr)
 				{
@@ -350,10 +503,31 @@ public:
 		}
 	}
 
+	size_t GetQueuedMessageCount()
+	{
+		return m_pipeClient.GetMainThreadQueueSize();
+	}
+
+	std::optional<PipeConnectionStats> GetConnectionStats() const
+	{
+		return m_pipeClient.GetConnectionStats();
+	}
+
 	void ProcessPipeClient()
 	{
 		m_pipeClient.Process();
-		Process(1000); // make this large just to prevent overflows
+
+		if (m_peerServer)
+		{
+			m_peerServer->Process();
+
+			for (const auto& [_, peer] : m_peers)
+				peer->Process();
+		}
+
+		// the count is large just to prevent overflows, the time budget keeps a flood of messages
+		// from stalling the frame. Whatever is left is processed next pulse.
+		Process(1000, std::chrono::milliseconds(2));
 	}
 
 	void NotifyIsForegroundWindow(bool isForeground)
@@ -421,6 +595,7 @@ public:
 				id.set_character(pLocalPC->Name);
 			}
 
+			SetEndpoint(id);
 			m_pipeClient.SendProtoMessage(MQMessageId::MSG_IDENTIFICATION, id);
 		}
 		else if (logged_in && GameState != GAMESTATE_LOGGINGIN && GameState != GAMESTATE_INGAME)
@@ -430,6 +605,7 @@ public:
 			proto::routing::Identification id;
 			id.set_pid(GetCurrentProcessId());
 
+			SetEndpoint(id);
 			m_pipeClient.SendProtoMessage(MQMessageId::MSG_IDENTIFICATION, id);
 		}
 		else if (!logged_in && (GameState == GAMESTATE_LOGGINGIN || GameState == GAMESTATE_INGAME))
@@ -442,6 +618,7 @@ public:
 			id.set_server(GetServerShortName());
 			id.set_character(pLocalPC->Name);
 
+			SetEndpoint(id);
 			m_pipeClient.SendProtoMessage(MQMessageId::MSG_IDENTIFICATION, id);
 		}
 	}
@@ -449,6 +626,17 @@ public:
 	void Initialize()
 	{
 		m_pipeClient.SetHandler(std::make_shared<PipeEventsHandler>(this));
+		m_pipeClient.EnableSharedMemory(gbSharedMemoryRouting);
+
+		if (gbPeerRouting)
+		{
+			// other clients connect here to send to us directly, after we announce it in our identification
+			m_peerEndpoint = fmt::format("{}_{}", MQ2_PIPE_SERVER_PATH, GetCurrentProcessId());
+			m_peerServer = std::make_unique<ProtoPipeServer>(m_peerEndpoint.c_str());
+			m_peerServer->SetHandler(std::make_shared<PeerEventsHandler>(this));
+			m_peerServer->Start();
+		}
+
 		m_pipeClient.Start();
 		::atexit(StopPipeClient);
 	}
@@ -463,6 +651,16 @@ public:
 		// we don't need to worry about sending messages after we stop because the pipe client will log
 		// and handle this situation.
 		m_pipeClient.Stop();
+
+		for (const auto& [_, peer] : m_peers)
+			peer->Stop();
+		m_peers.clear();
+
+		if (m_peerServer)
+		{
+			m_peerServer->Stop();
+			m_peerServer.reset();
+		}
 	}
 
 private:
@@ -470,6 +668,11 @@ private:
 	Dropbox m_clientDropbox;
 	DWORD m_launcherProcessID;
 
+	// direct connections to other clients
+	std::unique_ptr<ProtoPipeServer> m_peerServer;
+	std::string m_peerEndpoint;
+	std::unordered_map<uint32_t, std::unique_ptr<ProtoPipeClient>> m_peers;
+
 	static void StopPipeClient()
 	{
 		static_cast<MQPostOffice&>(GetPostOffice()).m_pipeClient.Stop();
@@ -499,6 +702,21 @@ void SendNotification(const std::string& message, const std::string& title)
 	static_cast<MQPostOffice&>(GetPostOffice()).SendNotification(message, title);
 }
 
+size_t GetQueuedMessageCount()
+{
+	return static_cast<MQPostOffice&>(GetPostOffice()).GetQueuedMessageCount();
+}
+
+std::optional<PipeConnectionStats> GetConnectionStats()
+{
+	return static_cast<MQPostOffice&>(GetPostOffice()).GetConnectionStats();
+}
+
+std::vector<postoffice::MailboxStats> GetMailboxStats()
+{
+	return GetPostOffice().GetMailboxStats();
+}
+
 void InitializePostOffice()
 {
 	static_cast<MQPostOffice&>(GetPostOffice()).Initialize();
@@ -20,6 +20,8 @@
 
 #include "MQ2MainBase.h"
 
+#include "routing/PostOffice.h"
+
 namespace mq {
 
 namespace pipeclient {
@@ -28,6 +30,15 @@ void NotifyIsForegroundWindow(bool isForeground);
 void RequestActivateWindow(HWND hWnd, bool sendMessage = true);
 void SendNotification(const std::string& message, const std::string& title);
 
+// Number of messages from the pipe that are waiting to be handled on the main thread.
+size_t GetQueuedMessageCount();
+
+// Traffic through the connection to the launcher, if we are connected.
+std::optional<PipeConnectionStats> GetConnectionStats();
+
+// Traffic through the mailboxes of this process. Must be called from the main thread.
+std::vector<postoffice::MailboxStats> GetMailboxStats();
+
 } // namespace pipeclient
 
 } // namespace mq
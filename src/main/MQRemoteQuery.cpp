@@ -0,0 +1,536 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQRemoteQuery.h"
+#include "MQDataAPI.h"
+#include "MQPostOffice.h"
+
+#include "routing/Routing.h"
+#include "routing/PostOffice.h"
+
+#include <map>
+#include <unordered_map>
+
+namespace mq {
+
+using namespace postoffice;
+
+//============================================================================
+// Remote macro data queries
+//
+// Other clients send ${} expressions to the "remote_query" mailbox, and get their values back with
+// the type they had here. A query is answered once. A subscription is evaluated here at the interval
+// it asked for, and only the values that changed are sent back, so a script that watches the health
+// of a group doesn't have to send a command to each client and parse the chat that comes back.
+//
+// Nothing tells us when the client of a subscription goes away, so subscriptions are leases that the
+// client renews while it is still interested. A subscription that isn't renewed is dropped.
+
+static const char* RemoteQueryMailbox = "remote_query";
+static const char* RemoteQueryUpdatesMailbox = "remote_query_updates";
+
+static constexpr std::chrono::seconds RemoteQueryLease{ 30 };
+static constexpr std::chrono::seconds RemoteQueryRenewal{ 10 };
+static constexpr std::chrono::milliseconds MinimumRemoteQueryInterval{ 100 };
+
+// Expressions come from any peer, and are evaluated in a buffer of MAX_STRING. Longer ones get an
+// empty value.
+static constexpr size_t MaxRemoteExpressionLength = MAX_STRING - 1;
+
+using RemoteQueryClock = std::chrono::steady_clock;
+
+static Dropbox s_serviceDropbox;
+static Dropbox s_clientDropbox;
+
+//----------------------------------------------------------------------------
+// Evaluation
+
+// A single ${} goes straight to the compiled expression, so the value keeps its type. Anything else
+// is parsed like a macro line would be, and is a string.
+static void EvaluateRemoteExpression(const std::string& expression, proto::routing::RemoteQueryValue& value)
+{
+	if (expression.empty() || expression.size() > MaxRemoteExpressionLength)
+		return;
+
+	char szBuffer[MAX_STRING] = { 0 };
+
+	const bool singleReference = gParserVersion != 2
+		&& expression.size() > 3
+		&& expression.compare(0, 2, "${") == 0
+		&& expression.back() == '}'
+		&& expression.find("${", 2) == std::string::npos;
+
+	if (singleReference)
+	{
+		strncpy_s(szBuffer, expression.c_str() + 2, _TRUNCATE);
+		szBuffer[expression.size() - 3] = 0;
+
+		MQTypeVar Result;
+		const bool parsed = pDataAPI->ParseMQ2DataPortion(szBuffer, Result) && Result.Type
+			&& Result.Type->ToString(Result.VarPtr, szBuffer);
+
+		// An ini read that returned a reference asks for the rest of the line not to be parsed.
+		bAllowCommandParse = true;
+
+		if (!parsed)
+			return;
+
+		if (Result.Type == pIntType)
+			value.set_integer(Result.Int);
+		else if (Result.Type == pInt64Type)
+			value.set_integer(Result.Int64);
+		else if (Result.Type == pFloatType)
+			value.set_number(Result.Float);
+		else if (Result.Type == pDoubleType)
+			value.set_number(Result.Double);
+		else if (Result.Type == pBoolType)
+			value.set_boolean(Result.VarPtr.Get<bool>());
+
+		value.set_text(szBuffer);
+		value.set_type(Result.Type->GetName());
+		return;
+	}
+
+	strncpy_s(szBuffer, expression.c_str(), _TRUNCATE);
+	if (!ParseMacroData(szBuffer, sizeof(szBuffer)))
+		return;
+
+	value.set_text(szBuffer);
+	value.set_type("string");
+}
+
+//----------------------------------------------------------------------------
+// Service
+
+struct ServedSubscription
+{
+	proto::routing::Address client;
+	std::vector<std::string> expressions;
+	std::vector<std::string> values;                       // serialized, to find the ones that changed
+	std::chrono::milliseconds interval{ 0 };
+	RemoteQueryClock::time_point nextUpdate;
+	RemoteQueryClock::time_point expires;
+};
+
+// keyed by the pid of the client and the id it gave the subscription
+static std::map<std::pair<uint32_t, uint32_t>, ServedSubscription> s_servedSubscriptions;
+
+static void OnRemoteQuery(ProtoMessagePtr&& message)
+{
+	auto query = message->Parse<proto::routing::RemoteQuery>();
+
+	// Over-long expressions are dropped here, so neither the query nor the subscription evaluates them.
+	for (std::string& expression : *query.mutable_expressions())
+	{
+		if (expression.size() > MaxRemoteExpressionLength)
+		{
+			SPDLOG_WARN("Ignoring remote query expression of {} characters", expression.size());
+			expression.clear();
+		}
+	}
+
+	if (query.id() == 0)
+	{
+		proto::routing::RemoteQueryResult result;
+		for (const std::string& expression : query.expressions())
+			EvaluateRemoteExpression(expression, *result.add_values());
+
+		s_serviceDropbox.PostReply(std::move(message), result);
+		return;
+	}
+
+	const auto& sender = message->GetSender();
+	if (!sender || !sender->has_pid())
+		return;
+
+	const auto key = std::make_pair(sender->pid(), query.id());
+	if (query.unsubscribe())
+	{
+		s_servedSubscriptions.erase(key);
+		return;
+	}
+
+	const auto now = RemoteQueryClock::now();
+
+	ServedSubscription& subscription = s_servedSubscriptions[key];
+	subscription.client.set_pid(sender->pid());
+	subscription.client.set_mailbox(sender->has_mailbox() ? sender->mailbox() : RemoteQueryUpdatesMailbox);
+
+	// A renewal sends the same expressions again, and only extends the lease.
+	if (!std::equal(subscription.expressions.begin(), subscription.expressions.end(),
+		query.expressions().begin(), query.expressions().end()))
+	{
+		subscription.expressions.assign(query.expressions().begin(), query.expressions().end());
+		subscription.values.clear();
+		subscription.nextUpdate = now;
+	}
+
+	subscription.interval = std::max(std::chrono::milliseconds(query.interval_ms()), MinimumRemoteQueryInterval);
+	subscription.expires = now + RemoteQueryLease;
+}
+
+static void PulseServedSubscriptions()
+{
+	if (s_servedSubscriptions.empty())
+		return;
+
+	const auto now = RemoteQueryClock::now();
+
+	// Subscriptions from several clients often watch the same things, so each is evaluated once.
+	std::unordered_map<std::string_view, std::string> evaluated;
+
+	for (auto iter = s_servedSubscriptions.begin(); iter != s_servedSubscriptions.end();)
+	{
+		ServedSubscription& subscription = iter->second;
+		if (now >= subscription.expires)
+		{
+			iter = s_servedSubscriptions.erase(iter);
+			continue;
+		}
+
+		if (now < subscription.nextUpdate)
+		{
+			++iter;
+			continue;
+		}
+
+		subscription.nextUpdate = now + subscription.interval;
+
+		const bool first = subscription.values.empty();
+		subscription.values.resize(subscription.expressions.size());
+
+		proto::routing::RemoteQueryResult result;
+		result.set_id(iter->first.second);
+
+		for (size_t i = 0; i < subscription.expressions.size(); ++i)
+		{
+			const std::string& expression = subscription.expressions[i];
+
+			auto evaluatedIter = evaluated.find(expression);
+			if (evaluatedIter == evaluated.end())
+			{
+				proto::routing::RemoteQueryValue value;
+				EvaluateRemoteExpression(expression, value);
+
+				evaluatedIter = evaluated.emplace(expression, value.SerializeAsString()).first;
+			}
+
+			if (!first && subscription.values[i] == evaluatedIter->second)
+				continue;
+
+			subscription.values[i] = evaluatedIter->second;
+			result.add_indices(static_cast<uint32_t>(i));
+			result.add_values()->ParseFromString(evaluatedIter->second);
+		}
+
+		// The first update has every value, so it doesn't need the indices.
+		if (first)
+			result.clear_indices();
+
+		if (result.values_size() > 0)
+			s_serviceDropbox.Post(subscription.client, result);
+
+		++iter;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Client
+
+struct PendingRemoteQuery
+{
+	RemoteQueryCallback callback;
+	MQPlugin* owner = nullptr;
+};
+
+struct RemoteSubscription
+{
+	proto::routing::Address address;
+	proto::routing::RemoteQuery query;
+	RemoteSubscriptionCallback callback;
+	MQPlugin* owner = nullptr;
+	RemoteQueryClock::time_point nextRenewal;
+};
+
+static uint32_t s_nextQueryId = 0;
+static std::unordered_map<uint32_t, PendingRemoteQuery> s_pendingQueries;
+static std::map<uint32_t, RemoteSubscription> s_subscriptions;
+
+static proto::routing::Address ToRemoteQueryAddress(const Address& address)
+{
+	proto::routing::Address addr;
+
+	if (address.PID)
+		addr.set_pid(*address.PID);
+	else if (address.Name)
+		addr.set_name(*address.Name);
+
+	if (address.Account)
+		addr.set_account(*address.Account);
+
+	if (address.Server)
+		addr.set_server(*address.Server);
+
+	if (address.Character)
+		addr.set_character(*address.Character);
+
+	// The service is always at the same mailbox, whatever the address asked for.
+	addr.set_mailbox(RemoteQueryMailbox);
+
+	return addr;
+}
+
+static RemoteValue ToRemoteValue(const proto::routing::RemoteQueryValue& value)
+{
+	RemoteValue result;
+	if (!value.has_text())
+		return result;
+
+	result.String = value.text();
+	result.TypeName = value.type();
+
+	switch (value.value_case())
+	{
+	case proto::routing::RemoteQueryValue::kInteger:
+		result.ValueKind = RemoteValue::Kind::Integer;
+		result.Integer = value.integer();
+		result.Number = static_cast<double>(value.integer());
+		break;
+
+	case proto::routing::RemoteQueryValue::kNumber:
+		result.ValueKind = RemoteValue::Kind::Number;
+		result.Number = value.number();
+		result.Integer = static_cast<int64_t>(value.number());
+		break;
+
+	case proto::routing::RemoteQueryValue::kBoolean:
+		result.ValueKind = RemoteValue::Kind::Boolean;
+		result.Boolean = value.boolean();
+		result.Integer = value.boolean() ? 1 : 0;
+		result.Number = static_cast<double>(result.Integer);
+		break;
+
+	default:
+		result.ValueKind = RemoteValue::Kind::String;
+		break;
+	}
+
+	return result;
+}
+
+static uint32_t GetNextQueryId()
+{
+	// 0 is a one time query to the service
+	if (++s_nextQueryId == 0)
+		++s_nextQueryId;
+
+	return s_nextQueryId;
+}
+
+void RemoteQuery_Query(const Address& address, std::vector<std::string> expressions,
+	RemoteQueryCallback callback, const MQPluginHandle& pluginHandle)
+{
+	if (!callback)
+		return;
+
+	const uint32_t queryId = GetNextQueryId();
+	s_pendingQueries[queryId] = { std::move(callback), GetPluginByHandle(pluginHandle, true) };
+
+	proto::routing::RemoteQuery query;
+	for (std::string& expression : expressions)
+		query.add_expressions(std::move(expression));
+
+	s_clientDropbox.Post(ToRemoteQueryAddress(address), query,
+		[queryId](int status, PipeMessagePtr&& message)
+		{
+			// Dropped if the plugin that asked was unloaded in the meantime.
+			auto iter = s_pendingQueries.find(queryId);
+			if (iter == s_pendingQueries.end())
+				return;
+
+			RemoteQueryCallback callback = std::move(iter->second.callback);
+			s_pendingQueries.erase(iter);
+
+			std::vector<RemoteValue> values;
+			if (status >= 0 && message->GetMessageId() == MQMessageId::MSG_ROUTE)
+			{
+				auto envelope = ProtoMessage::Parse<proto::routing::Envelope>(message);
+
+				proto::routing::RemoteQueryResult result;
+				if (result.ParseFromString(envelope.payload()))
+				{
+					values.reserve(result.values_size());
+					for (const auto& value : result.values())
+						values.push_back(ToRemoteValue(value));
+				}
+			}
+
+			callback(status < 0 ? status : 0, values);
+		});
+}
+
+int RemoteQuery_Subscribe(const Address& address, std::vector<std::string> expressions,
+	std::chrono::milliseconds interval, RemoteSubscriptionCallback callback, const MQPluginHandle& pluginHandle)
+{
+	if (!callback || expressions.empty())
+		return 0;
+
+	const uint32_t subscriptionId = GetNextQueryId();
+
+	RemoteSubscription& subscription = s_subscriptions[subscriptionId];
+	subscription.address = ToRemoteQueryAddress(address);
+	subscription.callback = std::move(callback);
+	subscription.owner = GetPluginByHandle(pluginHandle, true);
+	subscription.nextRenewal = RemoteQueryClock::now() + RemoteQueryRenewal;
+
+	subscription.query.set_id(subscriptionId);
+	subscription.query.set_interval_ms(static_cast<uint32_t>(std::max(interval, MinimumRemoteQueryInterval).count()));
+	for (std::string& expression : expressions)
+		subscription.query.add_expressions(std::move(expression));
+
+	s_clientDropbox.Post(subscription.address, subscription.query);
+
+	return static_cast<int>(subscriptionId);
+}
+
+static void SendUnsubscribe(const RemoteSubscription& subscription)
+{
+	proto::routing::RemoteQuery query;
+	query.set_id(subscription.query.id());
+	query.set_unsubscribe(true);
+
+	s_clientDropbox.Post(subscription.address, query);
+}
+
+bool RemoteQuery_Unsubscribe(int subscriptionId, const MQPluginHandle& pluginHandle)
+{
+	auto iter = s_subscriptions.find(static_cast<uint32_t>(subscriptionId));
+	if (iter == s_subscriptions.end() || iter->second.owner != GetPluginByHandle(pluginHandle, true))
+		return false;
+
+	SendUnsubscribe(iter->second);
+	s_subscriptions.erase(iter);
+	return true;
+}
+
+void RemoteQuery_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle&)
+{
+	for (auto iter = s_pendingQueries.begin(); iter != s_pendingQueries.end();)
+	{
+		if (iter->second.owner == plugin)
+			iter = s_pendingQueries.erase(iter);
+		else
+			++iter;
+	}
+
+	for (auto iter = s_subscriptions.begin(); iter != s_subscriptions.end();)
+	{
+		if (iter->second.owner == plugin)
+		{
+			SendUnsubscribe(iter->second);
+			iter = s_subscriptions.erase(iter);
+		}
+		else
+			++iter;
+	}
+}
+
+static void OnRemoteQueryUpdate(ProtoMessagePtr&& message)
+{
+	auto result = message->Parse<proto::routing::RemoteQueryResult>();
+
+	auto iter = s_subscriptions.find(result.id());
+	if (iter == s_subscriptions.end())
+		return;
+
+	std::vector<RemoteValueChange> changes;
+	changes.reserve(result.values_size());
+
+	for (int i = 0; i < result.values_size(); ++i)
+	{
+		const size_t index = i < result.indices_size() ? result.indices(i) : static_cast<size_t>(i);
+		if (index >= static_cast<size_t>(iter->second.query.expressions_size()))
+			continue;
+
+		changes.push_back({ index, ToRemoteValue(result.values(i)) });
+	}
+
+	if (!changes.empty())
+	{
+		// Copied, the callback is allowed to unsubscribe.
+		RemoteSubscriptionCallback callback = iter->second.callback;
+		callback(changes);
+	}
+}
+
+static void PulseSubscriptions()
+{
+	if (s_subscriptions.empty())
+		return;
+
+	const auto now = RemoteQueryClock::now();
+
+	for (auto& [_, subscription] : s_subscriptions)
+	{
+		if (now < subscription.nextRenewal)
+			continue;
+
+		subscription.nextRenewal = now + RemoteQueryRenewal;
+		s_clientDropbox.Post(subscription.address, subscription.query);
+	}
+}
+
+//----------------------------------------------------------------------------
+// Module
+
+static void InitializeRemoteQuery()
+{
+	s_serviceDropbox = GetPostOffice().RegisterAddress(RemoteQueryMailbox,
+		[](ProtoMessagePtr&& message) { OnRemoteQuery(std::move(message)); });
+
+	s_clientDropbox = GetPostOffice().RegisterAddress(RemoteQueryUpdatesMailbox,
+		[](ProtoMessagePtr&& message) { OnRemoteQueryUpdate(std::move(message)); });
+}
+
+static void ShutdownRemoteQuery()
+{
+	for (const auto& [_, subscription] : s_subscriptions)
+		SendUnsubscribe(subscription);
+
+	s_subscriptions.clear();
+	s_pendingQueries.clear();
+	s_servedSubscriptions.clear();
+
+	s_clientDropbox.Remove();
+	s_serviceDropbox.Remove();
+}
+
+static void PulseRemoteQuery()
+{
+	PulseServedSubscriptions();
+	PulseSubscriptions();
+}
+
+static MQModule s_RemoteQueryModule = {
+	"RemoteQuery",                 // Name
+	false,                         // CanUnload
+	InitializeRemoteQuery,         // Initialize
+	ShutdownRemoteQuery,           // Shutdown
+	PulseRemoteQuery,              // Pulse
+};
+DECLARE_MODULE_INITIALIZER(s_RemoteQueryModule);
+
+} // namespace mq
@@ -0,0 +1,34 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "mq/api/ActorAPI.h"
+#include "mq/base/PluginHandle.h"
+
+namespace mq {
+
+struct MQPlugin;
+
+// Queries and subscriptions of macro data on other clients. Everything here is only used from the
+// main thread.
+void RemoteQuery_Query(const postoffice::Address& address, std::vector<std::string> expressions,
+	postoffice::RemoteQueryCallback callback, const MQPluginHandle& pluginHandle);
+int RemoteQuery_Subscribe(const postoffice::Address& address, std::vector<std::string> expressions,
+	std::chrono::milliseconds interval, postoffice::RemoteSubscriptionCallback callback,
+	const MQPluginHandle& pluginHandle);
+bool RemoteQuery_Unsubscribe(int subscriptionId, const MQPluginHandle& pluginHandle);
+void RemoteQuery_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle);
+
+} // namespace mq
@@ -0,0 +1,434 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQSamplingProfiler.h"
+
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace mq {
+
+static constexpr uint32_t MaxStackFrames = 64;
+static constexpr size_t MaxSamples = 50000;
+
+static std::thread s_samplerThread;
+static std::atomic<bool> s_samplerRunning = false;
+static std::atomic<bool> s_samplerStop = false;
+
+static std::shared_ptr<const MQSamplingProfile> s_profile;
+static std::mutex s_profileMutex;
+
+static constexpr size_t MaxStackCopy = 32 * 1024;
+
+struct StackSnapshot
+{
+	CONTEXT Context;
+	uintptr_t StackPointer = 0;
+	size_t Size = 0;
+	uint8_t Stack[MaxStackCopy];
+};
+
+// Copies the registers and the top of the stack of a suspended thread. The thread may be holding
+// any lock, including the heap and loader locks, so this only reads memory and makes no calls
+// that could take a lock. The unwind happens afterwards on the copy, with the thread running.
+static bool CopyStack(HANDLE thread, StackSnapshot& snapshot)
+{
+	snapshot.Context = {};
+	snapshot.Context.ContextFlags = CONTEXT_FULL;
+	snapshot.Size = 0;
+	if (!GetThreadContext(thread, &snapshot.Context))
+		return false;
+
+#if defined(_M_AMD64)
+	snapshot.StackPointer = static_cast<uintptr_t>(snapshot.Context.Rsp);
+
+	// The committed stack above the stack pointer is one region, don't read past its end.
+	MEMORY_BASIC_INFORMATION mbi;
+	if (VirtualQuery(reinterpret_cast<LPCVOID>(snapshot.StackPointer), &mbi, sizeof(mbi)) == 0)
+		return false;
+
+	const uintptr_t regionEnd = reinterpret_cast<uintptr_t>(mbi.BaseAddress) + mbi.RegionSize;
+	const size_t size = std::min<size_t>(MaxStackCopy, regionEnd - snapshot.StackPointer);
+
+	__try
+	{
+		memcpy(snapshot.Stack, reinterpret_cast<const void*>(snapshot.StackPointer), size);
+		snapshot.Size = size;
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER)
+	{
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+// Walks a copied stack, leaf first.
+static uint32_t UnwindStack(StackSnapshot& snapshot, uint64_t* frames, uint32_t maxFrames)
+{
+	if (maxFrames == 0)
+		return 0;
+
+#if defined(_M_AMD64)
+	CONTEXT& context = snapshot.Context;
+	const uintptr_t copyBase = reinterpret_cast<uintptr_t>(snapshot.Stack);
+	const uintptr_t copyEnd = copyBase + snapshot.Size;
+
+	// Point every register that refers to the copied part of the stack at the copy instead, so
+	// that the unwinder reads the stack as it was when the thread was suspended.
+	auto relocate = [&](DWORD64& reg)
+	{
+		if (reg >= snapshot.StackPointer && reg < snapshot.StackPointer + snapshot.Size)
+			reg = reg - snapshot.StackPointer + copyBase;
+	};
+
+	for (DWORD64* reg = &context.Rax; reg <= &context.R15; ++reg)
+		relocate(*reg);
+
+	uint32_t count = 0;
+
+	// The stack is only as trustworthy as the code that was running, stop at the first bad frame
+	// or once the walk leaves the part of the stack that was copied.
+	__try
+	{
+		while (count < maxFrames && context.Rip != 0
+			&& context.Rsp >= copyBase && context.Rsp + sizeof(DWORD64) <= copyEnd)
+		{
+			frames[count++] = context.Rip;
+
+			DWORD64 imageBase = 0;
+			if (PRUNTIME_FUNCTION function = RtlLookupFunctionEntry(context.Rip, &imageBase, nullptr))
+			{
+				PVOID handlerData = nullptr;
+				DWORD64 establisherFrame = 0;
+				RtlVirtualUnwind(UNW_FLAG_NHANDLER, imageBase, context.Rip, function, &context,
+					&handlerData, &establisherFrame, nullptr);
+			}
+			else
+			{
+				// Leaf functions have no unwind data, their return address is on top of the stack.
+				context.Rip = *reinterpret_cast<DWORD64*>(context.Rsp);
+				context.Rsp += sizeof(DWORD64);
+			}
+		}
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER)
+	{
+	}
+
+	return count;
+#else
+	// Without unwind data only the function that was running can be trusted.
+	frames[0] = snapshot.Context.Eip;
+	return 1;
+#endif
+}
+
+//----------------------------------------------------------------------------
+
+class ProfileSymbolizer
+{
+public:
+	struct Symbol
+	{
+		std::string Name;
+		std::string Module;
+	};
+
+	ProfileSymbolizer()
+	{
+		SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+
+		char szSymSearchPath[MAX_STRING] = { 0 };
+		GetPrivateProfileString("Debug", "SymbolsPath", "", szSymSearchPath, MAX_STRING, mq::internal_paths::MQini);
+
+		m_initialized = SymInitialize(GetCurrentProcess(), szSymSearchPath[0] ? szSymSearchPath : nullptr, true) != FALSE;
+	}
+
+	~ProfileSymbolizer()
+	{
+		if (m_initialized)
+			SymCleanup(GetCurrentProcess());
+	}
+
+	const Symbol& Resolve(uint64_t address)
+	{
+		auto iter = m_symbols.find(address);
+		if (iter != m_symbols.end())
+			return iter->second;
+
+		Symbol& symbol = m_symbols[address];
+		symbol.Module = GetModuleName(address);
+
+		char buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(TCHAR)];
+		PSYMBOL_INFO pSymbol = reinterpret_cast<PSYMBOL_INFO>(buffer);
+		pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+		pSymbol->MaxNameLen = MAX_SYM_NAME;
+
+		DWORD64 displacement = 0;
+		if (m_initialized && SymFromAddr(GetCurrentProcess(), address, &displacement, pSymbol))
+			symbol.Name = pSymbol->Name;
+		else
+			symbol.Name = symbol.Module; // Everything without symbols is counted against its module
+
+		return symbol;
+	}
+
+private:
+	std::string GetModuleName(uint64_t address)
+	{
+		HMODULE hModule = nullptr;
+		if (!GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+			reinterpret_cast<LPCTSTR>(address), &hModule))
+		{
+			return "<unknown>";
+		}
+
+		auto iter = m_modules.find(hModule);
+		if (iter != m_modules.end())
+			return iter->second;
+
+		char szFileName[MAX_PATH] = { 0 };
+		GetModuleFileName(hModule, szFileName, MAX_PATH);
+
+		return m_modules[hModule] = std::filesystem::path(szFileName).filename().string();
+	}
+
+	bool m_initialized = false;
+	std::unordered_map<uint64_t, Symbol> m_symbols;
+	std::unordered_map<HMODULE, std::string> m_modules;
+};
+
+static void SortProfileNode(MQProfileNode& node)
+{
+	std::sort(node.Children.begin(), node.Children.end(),
+		[](const MQProfileNode& a, const MQProfileNode& b) { return a.Samples > b.Samples; });
+
+	for (MQProfileNode& child : node.Children)
+		SortProfileNode(child);
+}
+
+static std::string WriteFoldedStacks(const std::unordered_map<std::string, uint32_t>& folded)
+{
+	time_t curr_time;
+	time(&curr_time);
+
+	std::tm local_tm;
+	localtime_s(&local_tm, &curr_time);
+
+	const std::filesystem::path path = std::filesystem::path(mq::internal_paths::Logs)
+		/ fmt::format("Profile_{:04d}{:02d}{:02d}_{:02d}{:02d}{:02d}.folded",
+			local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday,
+			local_tm.tm_hour, local_tm.tm_min, local_tm.tm_sec);
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return {};
+
+	for (const auto& [stack, count] : folded)
+		file << stack << ' ' << count << '\n';
+
+	return path.string();
+}
+
+static std::shared_ptr<MQSamplingProfile> BuildProfile(const std::vector<uint64_t>& frames,
+	const std::vector<uint32_t>& depths)
+{
+	auto profile = std::make_shared<MQSamplingProfile>();
+	profile->Root.Name = "Main Thread";
+
+	ProfileSymbolizer symbolizer;
+
+	std::unordered_map<std::string, MQProfileFunction> functions;
+	std::unordered_map<std::string, uint32_t> folded;
+	std::vector<const ProfileSymbolizer::Symbol*> stack;
+	std::vector<MQProfileFunction*> seen;
+
+	for (size_t sample = 0; sample < depths.size(); ++sample)
+	{
+		const uint64_t* sampleFrames = &frames[sample * MaxStackFrames];
+
+		// Outermost frame first, with recursion through the same function (or module, for the
+		// frames that have no symbols) collapsed into one frame.
+		stack.clear();
+		for (uint32_t depth = depths[sample]; depth > 0; --depth)
+		{
+			const ProfileSymbolizer::Symbol& symbol = symbolizer.Resolve(sampleFrames[depth - 1]);
+			if (stack.empty() || stack.back()->Name != symbol.Name || stack.back()->Module != symbol.Module)
+				stack.push_back(&symbol);
+		}
+
+		MQProfileNode* node = &profile->Root;
+		++node->Samples;
+
+		std::string foldedStack;
+		seen.clear();
+
+		for (const ProfileSymbolizer::Symbol* symbol : stack)
+		{
+			auto iter = std::find_if(node->Children.begin(), node->Children.end(),
+				[symbol](const MQProfileNode& child) { return child.Name == symbol->Name && child.Module == symbol->Module; });
+			if (iter == node->Children.end())
+			{
+				MQProfileNode& child = node->Children.emplace_back();
+				child.Name = symbol->Name;
+				child.Module = symbol->Module;
+				iter = node->Children.end() - 1;
+			}
+
+			node = &*iter;
+			++node->Samples;
+
+			MQProfileFunction& function = functions[fmt::format("{}!{}", symbol->Module, symbol->Name)];
+			if (std::find(seen.begin(), seen.end(), &function) == seen.end())
+			{
+				function.Name = symbol->Name;
+				function.Module = symbol->Module;
+				++function.Samples;
+				seen.push_back(&function);
+			}
+
+			if (!foldedStack.empty())
+				foldedStack.push_back(';');
+			foldedStack.append(symbol->Module).push_back('!');
+			foldedStack.append(symbol->Name);
+		}
+
+		++node->SelfSamples;
+
+		if (!stack.empty())
+		{
+			++functions[fmt::format("{}!{}", stack.back()->Module, stack.back()->Name)].SelfSamples;
+
+			// Spaces separate the count from the stack in the folded format.
+			std::replace(foldedStack.begin(), foldedStack.end(), ' ', '_');
+			++folded[foldedStack];
+		}
+	}
+
+	SortProfileNode(profile->Root);
+
+	profile->Functions.reserve(functions.size());
+	for (auto& [_, function] : functions)
+		profile->Functions.push_back(std::move(function));
+
+	std::sort(profile->Functions.begin(), profile->Functions.end(),
+		[](const MQProfileFunction& a, const MQProfileFunction& b) { return a.SelfSamples > b.SelfSamples; });
+
+	profile->FoldedPath = WriteFoldedStacks(folded);
+
+	return profile;
+}
+
+static void SamplerThread(std::chrono::milliseconds duration, std::chrono::microseconds interval)
+{
+	HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_QUERY_INFORMATION,
+		FALSE, GetMainThreadId());
+	if (!thread)
+	{
+		s_samplerRunning = false;
+		return;
+	}
+
+	const size_t maxSamples = std::min<size_t>(MaxSamples,
+		static_cast<size_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration) / interval) + 1);
+
+	std::vector<uint64_t> frames(maxSamples * MaxStackFrames);
+	std::vector<uint32_t> depths;
+	depths.reserve(maxSamples);
+
+	auto snapshot = std::make_unique<StackSnapshot>();
+
+	// The default timer resolution is 15.6ms, which is what every sleep below would take.
+	timeBeginPeriod(1);
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto end = start + duration;
+
+	while (!s_samplerStop && depths.size() < maxSamples && std::chrono::steady_clock::now() < end)
+	{
+		if (SuspendThread(thread) != static_cast<DWORD>(-1))
+		{
+			const bool copied = CopyStack(thread, *snapshot);
+			ResumeThread(thread);
+
+			if (copied)
+			{
+				const uint32_t depth = UnwindStack(*snapshot, &frames[depths.size() * MaxStackFrames], MaxStackFrames);
+				if (depth > 0)
+					depths.push_back(depth);
+			}
+		}
+
+		std::this_thread::sleep_for(interval);
+	}
+
+	timeEndPeriod(1);
+	CloseHandle(thread);
+
+	std::shared_ptr<MQSamplingProfile> profile = BuildProfile(frames, depths);
+	profile->Duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	profile->Interval = interval;
+
+	{
+		std::scoped_lock lock(s_profileMutex);
+		s_profile = std::move(profile);
+	}
+
+	s_samplerRunning = false;
+}
+
+bool SamplingProfiler_Start(std::chrono::milliseconds duration, std::chrono::microseconds interval)
+{
+	if (s_samplerRunning)
+		return false;
+
+	if (s_samplerThread.joinable())
+		s_samplerThread.join();
+
+	s_samplerStop = false;
+	s_samplerRunning = true;
+	s_samplerThread = std::thread(SamplerThread, duration, std::max(interval, std::chrono::microseconds(100)));
+	return true;
+}
+
+bool SamplingProfiler_IsRunning()
+{
+	return s_samplerRunning;
+}
+
+std::shared_ptr<const MQSamplingProfile> SamplingProfiler_GetProfile()
+{
+	std::scoped_lock lock(s_profileMutex);
+	return s_profile;
+}
+
+void SamplingProfiler_Shutdown()
+{
+	s_samplerStop = true;
+
+	if (s_samplerThread.joinable())
+		s_samplerThread.join();
+}
+
+} // namespace mq
@@ -0,0 +1,64 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mq {
+
+// A function in the call tree of a profile. Samples counts every sample the function was on the
+// stack for, SelfSamples only the ones where it was the function that was running.
+struct MQProfileNode
+{
+	std::string Name;
+	std::string Module;
+	uint32_t Samples = 0;
+	uint32_t SelfSamples = 0;
+	std::vector<MQProfileNode> Children;
+};
+
+struct MQProfileFunction
+{
+	std::string Name;
+	std::string Module;
+	uint32_t Samples = 0;             // inclusive, counted once per sample even when recursive
+	uint32_t SelfSamples = 0;
+};
+
+struct MQSamplingProfile
+{
+	MQProfileNode Root;               // Root.Samples is the number of stacks that were captured
+	std::vector<MQProfileFunction> Functions;     // sorted by SelfSamples
+	std::chrono::milliseconds Duration{ 0 };
+	std::chrono::microseconds Interval{ 0 };
+	std::string FoldedPath;           // the stacks in the folded format used by flame graph tools
+};
+
+// Samples the stack of the main thread from a helper thread, every interval for the duration.
+// Returns false if a profile is already being captured.
+bool SamplingProfiler_Start(std::chrono::milliseconds duration, std::chrono::microseconds interval);
+bool SamplingProfiler_IsRunning();
+
+// The last profile that was completed, or null if there isn't one yet.
+std::shared_ptr<const MQSamplingProfile> SamplingProfiler_GetProfile();
+
+// Stops a capture that is in progress and waits for the helper thread to exit.
+void SamplingProfiler_Shutdown();
+
+} // namespace mq
@@ -0,0 +1,172 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQSharedIndex.h"
+
+#include <fmt/os.h>
+
+#include <atomic>
+
+namespace mq {
+
+constexpr uint32_t SHARED_INDEX_MAGIC = 0x58444e49;   // "INDX"
+
+struct SharedIndex::Header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t dataHash;
+	uint64_t size;                   // of the contents, which follow the header
+	uint64_t checksum;               // of the contents
+};
+
+static uint64_t HashBytes(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static std::string GetMappingName(std::string_view indexName, uint32_t version, uint64_t dataHash)
+{
+	// The build of MacroQuest goes with the build of eqgame that it was made for, and with the
+	// layout of the structs that an index could depend on.
+	static const uint64_t s_buildKey = []()
+	{
+		constexpr std::string_view build = __ExpectedVersionDate " " __ExpectedVersionTime;
+		const uint64_t pointerSize = sizeof(void*);
+
+		uint64_t hash = HashBytes(reinterpret_cast<const uint8_t*>(build.data()), build.size());
+		return HashBytes(reinterpret_cast<const uint8_t*>(&pointerSize), sizeof(pointerSize), hash);
+	}();
+
+	return fmt::format("Local\\MQSharedIndex-{}-v{}-{:016x}-{:016x}", indexName, version, s_buildKey, dataHash);
+}
+
+SharedIndex::SharedIndex(wil::unique_handle hMapping, const void* view, const uint8_t* data, size_t size)
+	: m_hMapping(std::move(hMapping))
+	, m_view(view)
+	, m_data(data)
+	, m_size(size)
+{
+}
+
+SharedIndex::~SharedIndex()
+{
+	if (m_view)
+		::UnmapViewOfFile(m_view);
+}
+
+std::unique_ptr<SharedIndex> SharedIndex::Open(std::string_view indexName, uint32_t version, uint64_t dataHash)
+{
+	const std::string name = GetMappingName(indexName, version, dataHash);
+
+	// Nobody publishing it yet is the usual case for the first client, so that isn't worth a warning.
+	wil::unique_handle hMapping(::OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str()));
+	if (!hMapping)
+		return nullptr;
+
+	const void* view = ::MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0);
+	if (!view)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to map shared index").what(), name);
+		return nullptr;
+	}
+
+	// Don't trust the header further than the size of the mapping
+	MEMORY_BASIC_INFORMATION mbi;
+	const Header* header = static_cast<const Header*>(view);
+	if (::VirtualQuery(view, &mbi, sizeof(mbi)) == 0
+		|| mbi.RegionSize < sizeof(Header)
+		|| header->magic != SHARED_INDEX_MAGIC)
+	{
+		// The client that is publishing it hasn't finished writing it.
+		::UnmapViewOfFile(view);
+		return nullptr;
+	}
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	const uint8_t* data = static_cast<const uint8_t*>(view) + sizeof(Header);
+	if (header->version != version
+		|| header->dataHash != dataHash
+		|| mbi.RegionSize - sizeof(Header) < header->size
+		|| HashBytes(data, static_cast<size_t>(header->size)) != header->checksum)
+	{
+		SPDLOG_ERROR("Shared index is not valid: name={}", name);
+		::UnmapViewOfFile(view);
+		return nullptr;
+	}
+
+	return std::unique_ptr<SharedIndex>(new SharedIndex(std::move(hMapping), view, data, static_cast<size_t>(header->size)));
+}
+
+std::unique_ptr<SharedIndex> SharedIndex::Publish(std::string_view indexName, uint32_t version, uint64_t dataHash,
+	const std::vector<uint8_t>& contents)
+{
+	const std::string name = GetMappingName(indexName, version, dataHash);
+	const uint64_t size = sizeof(Header) + contents.size();
+
+	wil::unique_handle hMapping(::CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+		static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name.c_str()));
+	if (!hMapping)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to create shared index").what(), name);
+		return nullptr;
+	}
+
+	// Another client is publishing the same index. Its copy is as good as ours, but might not be
+	// finished, so this client keeps its own.
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+		return nullptr;
+
+	void* view = ::MapViewOfFile(hMapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!view)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to map shared index").what(), name);
+		return nullptr;
+	}
+
+	// The magic goes in last, so a client that opens the index early doesn't see it half written.
+	Header* header = new (view) Header;
+	header->version = version;
+	header->dataHash = dataHash;
+	header->size = contents.size();
+	header->checksum = HashBytes(contents.data(), contents.size());
+	memcpy(static_cast<uint8_t*>(view) + sizeof(Header), contents.data(), contents.size());
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = SHARED_INDEX_MAGIC;
+	::UnmapViewOfFile(view);
+
+	// Map it back read only, so nothing in this client can change what the others see.
+	const void* readView = ::MapViewOfFile(hMapping.get(), FILE_MAP_READ, 0, 0, 0);
+	if (!readView)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to map shared index").what(), name);
+		return nullptr;
+	}
+
+	SPDLOG_INFO("Published shared index: name={} size={}", name, contents.size());
+
+	return std::unique_ptr<SharedIndex>(new SharedIndex(std::move(hMapping), readView,
+		static_cast<const uint8_t*>(readView) + sizeof(Header), contents.size()));
+}
+
+} // namespace mq
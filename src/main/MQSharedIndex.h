@@ -0,0 +1,64 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <wil/resource.h>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace mq {
+
+//============================================================================
+// Read-only indices over static game data, shared by every client in the login session. The first
+// client to build an index publishes it in named shared memory, and the clients after it map that
+// instead of building their own. The name of the mapping holds the version of the index layout, the
+// build of MacroQuest (and so of eqgame) and a hash of the data it was built from, so a client only
+// ever maps an index that it would have built the same way. The mapping goes away with the last
+// client that has it open.
+
+class SharedIndex
+{
+	struct Header;
+
+public:
+	~SharedIndex();
+
+	SharedIndex(const SharedIndex&) = delete;
+	SharedIndex& operator=(const SharedIndex&) = delete;
+
+	// Maps an index that another client published. Returns null if there is none, or if it is
+	// still being written or doesn't check out.
+	static std::unique_ptr<SharedIndex> Open(std::string_view indexName, uint32_t version, uint64_t dataHash);
+
+	// Publishes an index and maps it back read only. Returns null if another client published it
+	// first, or if it couldn't be created, in which case the caller keeps using its own copy.
+	static std::unique_ptr<SharedIndex> Publish(std::string_view indexName, uint32_t version, uint64_t dataHash,
+		const std::vector<uint8_t>& contents);
+
+	const uint8_t* GetData() const { return m_data; }
+	size_t GetSize() const { return m_size; }
+
+private:
+	SharedIndex(wil::unique_handle hMapping, const void* view, const uint8_t* data, size_t size);
+
+	wil::unique_handle m_hMapping;
+	const void* m_view = nullptr;
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+};
+
+} // namespace mq
@@ -0,0 +1,128 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQSlowExpressions.h"
+
+#include <deque>
+#include <mutex>
+
+namespace mq {
+
+static constexpr size_t MaxSlowExpressions = 500;
+
+static std::deque<MQSlowExpression> s_slowExpressions;
+static std::mutex s_slowExpressionsMutex;
+
+// Set by scripts (for instance lua) while they run, since they don't have a macro line.
+static thread_local std::string t_slowExpressionSource;
+
+void SetSlowExpressionSource(const char* Source)
+{
+	if (Source && gbSlowExpressions)
+		t_slowExpressionSource = Source;
+	else
+		t_slowExpressionSource.clear();
+}
+
+static std::string GetSlowExpressionSource()
+{
+	if (!t_slowExpressionSource.empty())
+		return t_slowExpressionSource;
+
+	// Macro state belongs to the main thread.
+	if (IsMainThread())
+	{
+		if (MQMacroBlockPtr pBlock = GetCurrentMacroBlock(); pBlock && pBlock->HasLine(pBlock->CurrIndex))
+		{
+			const MQMacroLine& ml = pBlock->GetLine(pBlock->CurrIndex);
+			return fmt::format("{}@{}", ml.LineNumber, ml.SourceFile);
+		}
+	}
+
+	return {};
+}
+
+void SlowExpressions_Check(MQSlowExpressionKind kind, std::string_view text,
+	std::chrono::steady_clock::time_point start)
+{
+	auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	if (duration.count() < gSlowExpressionThreshold)
+		return;
+
+	MQSlowExpression expression;
+	expression.Kind = kind;
+	expression.Text = text;
+	expression.Source = GetSlowExpressionSource();
+	expression.Duration = duration;
+	expression.Time = time(nullptr);
+
+	std::scoped_lock lock(s_slowExpressionsMutex);
+
+	if (s_slowExpressions.size() >= MaxSlowExpressions)
+		s_slowExpressions.pop_front();
+
+	s_slowExpressions.push_back(std::move(expression));
+}
+
+std::vector<MQSlowExpression> SlowExpressions_Get()
+{
+	std::scoped_lock lock(s_slowExpressionsMutex);
+
+	return { s_slowExpressions.begin(), s_slowExpressions.end() };
+}
+
+void SlowExpressions_Clear()
+{
+	std::scoped_lock lock(s_slowExpressionsMutex);
+
+	s_slowExpressions.clear();
+}
+
+// Only ever set and read on the main thread.
+static std::vector<MQMemberTiming>* s_memberTrace = nullptr;
+
+void SlowExpressions_BeginMemberTrace(std::vector<MQMemberTiming>& trace)
+{
+	if (IsMainThread())
+		s_memberTrace = &trace;
+}
+
+void SlowExpressions_EndMemberTrace()
+{
+	if (IsMainThread())
+		s_memberTrace = nullptr;
+}
+
+bool SlowExpressions_IsTracingMembers()
+{
+	return s_memberTrace != nullptr && IsMainThread();
+}
+
+void SlowExpressions_TraceMember(std::string_view type, std::string_view member,
+	std::chrono::steady_clock::duration duration)
+{
+	if (!SlowExpressions_IsTracingMembers())
+		return;
+
+	MQMemberTiming timing;
+	timing.Member.reserve(type.size() + member.size() + 1);
+	timing.Member.append(type).append(".").append(member);
+	timing.Duration = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+
+	s_memberTrace->push_back(std::move(timing));
+}
+
+} // namespace mq
@@ -0,0 +1,63 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mq {
+
+enum class MQSlowExpressionKind
+{
+	Parse,                            // A whole ParseMacroData call
+	Command,                          // A command handler, after its arguments were parsed
+	Member,                           // A single TLO member call
+};
+
+struct MQSlowExpression
+{
+	MQSlowExpressionKind Kind = MQSlowExpressionKind::Parse;
+	std::string Text;
+	std::string Source;               // "line@file" of the macro, or the script that was running
+	std::chrono::microseconds Duration{ 0 };
+	time_t Time = 0;
+};
+
+// Only used while gbSlowExpressions is set. Anything that took at least gSlowExpressionThreshold
+// microseconds since start is added to a ring buffer of the most recent reports.
+void SlowExpressions_Check(MQSlowExpressionKind kind, std::string_view text,
+	std::chrono::steady_clock::time_point start);
+
+std::vector<MQSlowExpression> SlowExpressions_Get();
+void SlowExpressions_Clear();
+
+// Every member call made on the main thread while a member trace is set is added to it, whether it
+// was slow or not. Used by the expression evaluator to show where the time of an expression goes.
+struct MQMemberTiming
+{
+	std::string Member;               // "Type.Member", without the index
+	std::chrono::microseconds Duration{ 0 };
+};
+
+void SlowExpressions_BeginMemberTrace(std::vector<MQMemberTiming>& trace);
+void SlowExpressions_EndMemberTrace();
+bool SlowExpressions_IsTracingMembers();
+void SlowExpressions_TraceMember(std::string_view type, std::string_view member,
+	std::chrono::steady_clock::duration duration);
+
+} // namespace mq
@@ -0,0 +1,369 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQSpawnTriggers.h"
+
+#include <map>
+#include <unordered_set>
+
+namespace mq {
+
+//============================================================================
+// Spawn Triggers
+//
+// Each trigger remembers the spawns that are inside its area. Every check only visits the spawn grid
+// cells that its area covers, plus the spawns that were inside last time, so the number of spawns in
+// the zone doesn't matter much. Despawns are handled as they happen, so no spawn is left behind.
+
+static constexpr std::chrono::milliseconds SpawnTriggerInterval{ 100 };
+
+struct SpawnTrigger
+{
+	explicit SpawnTrigger(const MQSpawnSearch& search_)
+		: search(search_)
+		, predicate(search)
+	{
+	}
+
+	std::string name;
+	MQSpawnSearch search;
+	MQSpawnSearchPredicate predicate;
+	float radius = 0.0f;
+	MQSpawnTriggerCallback callback;
+	MQPluginHandle owner;
+
+	std::unordered_set<PlayerClient*> inside;
+};
+
+static std::map<int, std::unique_ptr<SpawnTrigger>> s_spawnTriggers;
+static int s_nextSpawnTriggerId = 1;
+static std::chrono::steady_clock::time_point s_nextSpawnTriggerCheck;
+
+// Triggers added with /spawntrigger, by name.
+static std::map<std::string, int, ci_less> s_commandTriggers;
+
+int SpawnTriggers_Add(const char* name, const MQSpawnSearch& search, float radius, MQSpawnTriggerCallback callback,
+	const MQPluginHandle& pluginHandle)
+{
+	if (!callback || !(radius > 0.0f))
+		return 0;
+
+	const int triggerId = s_nextSpawnTriggerId++;
+
+	auto trigger = std::make_unique<SpawnTrigger>(search);
+	trigger->name = name ? name : "";
+	trigger->radius = radius;
+	trigger->callback = std::move(callback);
+	trigger->owner = pluginHandle;
+
+	s_spawnTriggers.emplace(triggerId, std::move(trigger));
+
+	// Check the new trigger with the next pulse.
+	s_nextSpawnTriggerCheck = {};
+	return triggerId;
+}
+
+bool SpawnTriggers_Remove(int triggerId, const MQPluginHandle& pluginHandle)
+{
+	auto iter = s_spawnTriggers.find(triggerId);
+	if (iter == s_spawnTriggers.end())
+		return false;
+
+	if (iter->second->owner != pluginHandle)
+		return false;
+
+	s_spawnTriggers.erase(iter);
+	return true;
+}
+
+void SpawnTriggers_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle)
+{
+	// Remove any triggers that were left behind by this plugin.
+	for (auto iter = s_spawnTriggers.begin(); iter != s_spawnTriggers.end();)
+	{
+		if (iter->second->owner == pluginHandle)
+		{
+			DebugSpew("Removing spawn trigger left behind by %s: %s", plugin->name.c_str(), iter->second->name.c_str());
+			iter = s_spawnTriggers.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+// Invokes the callback of a trigger. The callback could add or remove triggers, including its own,
+// so the trigger is looked up again by id for every event.
+static void RaiseSpawnTriggerEvent(int triggerId, PlayerClient* pSpawn, bool entered)
+{
+	auto iter = s_spawnTriggers.find(triggerId);
+	if (iter == s_spawnTriggers.end())
+		return;
+
+	MQSpawnTriggerEvent event;
+	event.TriggerID = triggerId;
+	event.Spawn = pSpawn;
+	event.SpawnID = pSpawn->SpawnID;
+	event.Entered = entered;
+
+	MQSpawnTriggerCallback callback = iter->second->callback;
+	callback(event);
+}
+
+static bool IsInsideSpawnTrigger(const SpawnTrigger& trigger, float x, float y, PlayerClient* pSpawn)
+{
+	if (pSpawn == pControlledPlayer)
+		return false;
+
+	if (GetDistanceSquared(x, y, pSpawn->X, pSpawn->Y) > trigger.radius * trigger.radius)
+		return false;
+
+	return trigger.predicate.Matches(pControlledPlayer, pSpawn);
+}
+
+static void CheckSpawnTrigger(int triggerId, SpawnTrigger& trigger)
+{
+	const float x = trigger.search.bKnownLocation ? trigger.search.xLoc : pControlledPlayer->X;
+	const float y = trigger.search.bKnownLocation ? trigger.search.yLoc : pControlledPlayer->Y;
+
+	std::vector<PlayerClient*> entered;
+	std::vector<PlayerClient*> left;
+
+	// Spawns that were inside are checked first, since the grid only has the ones near the center now.
+	for (PlayerClient* pSpawn : trigger.inside)
+	{
+		if (!IsInsideSpawnTrigger(trigger, x, y, pSpawn))
+			left.push_back(pSpawn);
+	}
+
+	auto checkSpawn = [&](PlayerClient* pSpawn)
+	{
+		if (!trigger.inside.count(pSpawn) && IsInsideSpawnTrigger(trigger, x, y, pSpawn))
+			entered.push_back(pSpawn);
+	};
+
+	if (!ForEachSpawnInRadius(x, y, trigger.radius, checkSpawn))
+	{
+		// The area covers too much of the grid, every spawn is quicker.
+		for (const MQSpawnArrayItem& item : gSpawnsArray)
+		{
+			if (PlayerClient* pSpawn = item.GetSpawn())
+				checkSpawn(pSpawn);
+		}
+	}
+
+	for (PlayerClient* pSpawn : left)
+		trigger.inside.erase(pSpawn);
+	for (PlayerClient* pSpawn : entered)
+		trigger.inside.insert(pSpawn);
+
+	// The trigger must not be used past this point, the callbacks could remove it.
+	for (PlayerClient* pSpawn : left)
+		RaiseSpawnTriggerEvent(triggerId, pSpawn, false);
+	for (PlayerClient* pSpawn : entered)
+		RaiseSpawnTriggerEvent(triggerId, pSpawn, true);
+}
+
+static void PulseSpawnTriggers()
+{
+	if (s_spawnTriggers.empty() || gGameState != GAMESTATE_INGAME || gZoning || !pControlledPlayer)
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now < s_nextSpawnTriggerCheck)
+		return;
+
+	s_nextSpawnTriggerCheck = now + SpawnTriggerInterval;
+
+	// Callbacks could add or remove triggers, so go by id.
+	std::vector<int> triggerIds;
+	triggerIds.reserve(s_spawnTriggers.size());
+	for (const auto& [triggerId, _] : s_spawnTriggers)
+		triggerIds.push_back(triggerId);
+
+	for (int triggerId : triggerIds)
+	{
+		auto iter = s_spawnTriggers.find(triggerId);
+		if (iter != s_spawnTriggers.end() && pControlledPlayer)
+			CheckSpawnTrigger(triggerId, *iter->second);
+	}
+}
+
+static void SpawnRemovedSpawnTriggers(PlayerClient* pSpawn)
+{
+	std::vector<int> triggerIds;
+	for (auto& [triggerId, trigger] : s_spawnTriggers)
+	{
+		if (trigger->inside.erase(pSpawn))
+			triggerIds.push_back(triggerId);
+	}
+
+	for (int triggerId : triggerIds)
+		RaiseSpawnTriggerEvent(triggerId, pSpawn, false);
+}
+
+static void BeginZoneSpawnTriggers()
+{
+	// Every spawn is about to go away, they are forgotten rather than leaving one by one.
+	for (auto& [_, trigger] : s_spawnTriggers)
+		trigger->inside.clear();
+}
+
+static void SetGameStateSpawnTriggers(int gameState)
+{
+	if (gameState != GAMESTATE_INGAME)
+		BeginZoneSpawnTriggers();
+}
+
+//----------------------------------------------------------------------------
+
+// Usage:       /spawntrigger add <name> <radius> <spawn search>
+//              /spawntrigger remove <name>
+//              /spawntrigger list
+//              /spawntrigger clear
+//
+// The macro is told about spawns entering and leaving through Sub Event_SpawnTrigger(Name, Action, SpawnID),
+// where action is "enter" or "leave".
+static void SpawnTriggerCommand(PlayerClient*, const char* szLine)
+{
+	char szArg[MAX_STRING] = { 0 };
+	GetArg(szArg, szLine, 1);
+	const char* szRest = GetNextArg(szLine, 1);
+
+	if (!_stricmp(szArg, "add"))
+	{
+		char szName[MAX_STRING] = { 0 };
+		char szRadius[MAX_STRING] = { 0 };
+		GetArg(szName, szRest, 1);
+		GetArg(szRadius, szRest, 2);
+		szRest = GetNextArg(szRest, 2);
+
+		const float radius = GetFloatFromString(szRadius, 0.0f);
+		if (szName[0] == 0 || radius <= 0.0f)
+		{
+			SyntaxError("Usage: /spawntrigger add <name> <radius> <spawn search>");
+			return;
+		}
+
+		MQSpawnSearch search;
+		ClearSearchSpawn(&search);
+		ParseSearchSpawn(szRest, &search);
+
+		std::string name = szName;
+		int triggerId = SpawnTriggers_Add(name.c_str(), search, radius,
+			[name](const MQSpawnTriggerEvent& event)
+			{
+				AddSpawnTriggerEvent(name.c_str(), event.Entered, event.SpawnID);
+			}, mqplugin::ThisPluginHandle);
+
+		// Adding a trigger with the name of an existing one replaces it.
+		auto [iter, added] = s_commandTriggers.emplace(name, triggerId);
+		if (!added)
+		{
+			SpawnTriggers_Remove(iter->second, mqplugin::ThisPluginHandle);
+			iter->second = triggerId;
+		}
+
+		char szSearch[MAX_STRING] = { 0 };
+		WriteChatf("Spawn trigger \ay%s\ax added: \ag%s\ax within \ag%.0f\ax", name.c_str(),
+			FormatSearchSpawn(szSearch, sizeof(szSearch), &search), radius);
+	}
+	else if (!_stricmp(szArg, "remove"))
+	{
+		GetArg(szArg, szRest, 1);
+
+		auto iter = s_commandTriggers.find(szArg);
+		if (iter == s_commandTriggers.end())
+		{
+			WriteChatf("No spawn trigger named \ay%s\ax.", szArg);
+			return;
+		}
+
+		SpawnTriggers_Remove(iter->second, mqplugin::ThisPluginHandle);
+		s_commandTriggers.erase(iter);
+
+		WriteChatf("Spawn trigger \ay%s\ax removed.", szArg);
+	}
+	else if (!_stricmp(szArg, "list"))
+	{
+		if (s_commandTriggers.empty())
+		{
+			WriteChatColor("No spawn triggers active.");
+			return;
+		}
+
+		for (const auto& [name, triggerId] : s_commandTriggers)
+		{
+			auto iter = s_spawnTriggers.find(triggerId);
+			if (iter == s_spawnTriggers.end())
+				continue;
+
+			SpawnTrigger& trigger = *iter->second;
+
+			char szSearch[MAX_STRING] = { 0 };
+			WriteChatf("\ay%s\ax: \ag%s\ax within \ag%.0f\ax, %d inside", name.c_str(),
+				FormatSearchSpawn(szSearch, sizeof(szSearch), &trigger.search), trigger.radius,
+				static_cast<int>(trigger.inside.size()));
+		}
+
+		WriteChatf("%d spawn triggers listed.", static_cast<int>(s_commandTriggers.size()));
+	}
+	else if (!_stricmp(szArg, "clear"))
+	{
+		for (const auto& [_, triggerId] : s_commandTriggers)
+			SpawnTriggers_Remove(triggerId, mqplugin::ThisPluginHandle);
+		s_commandTriggers.clear();
+
+		WriteChatColor("Spawn triggers cleared.");
+	}
+	else
+	{
+		SyntaxError("Usage: /spawntrigger <add <name> <radius> <spawn search>|remove <name>|list|clear>");
+	}
+}
+
+static void InitializeSpawnTriggers()
+{
+	AddCommand("/spawntrigger", SpawnTriggerCommand, false, true, false);
+}
+
+static void ShutdownSpawnTriggers()
+{
+	RemoveCommand("/spawntrigger");
+
+	s_commandTriggers.clear();
+	s_spawnTriggers.clear();
+}
+
+static MQModule s_SpawnTriggersModule = {
+	"SpawnTriggers",               // Name
+	false,                         // CanUnload
+	InitializeSpawnTriggers,       // Initialize
+	ShutdownSpawnTriggers,         // Shutdown
+	PulseSpawnTriggers,            // Pulse
+	SetGameStateSpawnTriggers,     // SetGameState
+	nullptr,                       // UpdateImGui
+	nullptr,                       // Zoned
+	nullptr,                       // WriteChatColor
+	nullptr,                       // SpawnAdded
+	SpawnRemovedSpawnTriggers,     // SpawnRemoved
+	BeginZoneSpawnTriggers,        // BeginZone
+};
+DECLARE_MODULE_INITIALIZER(s_SpawnTriggersModule);
+
+} // namespace mq
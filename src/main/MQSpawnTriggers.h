@@ -0,0 +1,34 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+
+#pragma once
+
+#include "mq/api/SpawnTriggers.h"
+#include "mq/base/PluginHandle.h"
+
+namespace mq {
+
+struct MQPlugin;
+
+// Spawn triggers. Everything here is only used from the main thread.
+int SpawnTriggers_Add(const char* name, const MQSpawnSearch& search, float radius, MQSpawnTriggerCallback callback,
+	const MQPluginHandle& pluginHandle);
+bool SpawnTriggers_Remove(int triggerId, const MQPluginHandle& pluginHandle);
+void SpawnTriggers_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle);
+
+// Queues Event_SpawnTrigger for the macro, if it has that sub. Lives with the other macro events.
+void AddSpawnTriggerEvent(const char* triggerName, bool entered, uint32_t spawnID);
+
+} // namespace mq
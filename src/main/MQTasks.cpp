@@ -0,0 +1,355 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQTasks.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace mq {
+
+//============================================================================
+// Task cache
+//
+// The task manager keeps the tasks in fixed arrays that have to be searched for every lookup, and an
+// objective's description is only available by formatting it. The cache keeps the titles and
+// descriptions, indexed by name, and is only rebuilt when the tasks or their objectives change. The
+// counts are compared on every pulse to find the objectives that progressed.
+
+struct CachedTaskObjective
+{
+	CTaskElement* element = nullptr;
+	std::string description;
+	int type = 0;
+	int requiredCount = 0;
+	int currentCount = 0;
+};
+
+struct CachedTask
+{
+	CTaskEntry* task = nullptr;
+	TaskSystemType system = cTaskSystemTypeTask;
+	int index = -1;
+	int taskID = 0;
+	std::string title;
+	std::vector<CachedTaskObjective> objectives;           // indexed like the elements of the task
+};
+
+struct TaskCache
+{
+	CTaskManager* taskManager = nullptr;
+	PcClient* pc = nullptr;
+	uint64_t signature = 0;
+	std::vector<CachedTask> tasks;
+	std::unordered_map<std::string, int> titleToTask;      // lower case titles
+};
+
+static TaskCache s_taskCache;
+static std::vector<TaskObjectiveProgress> s_progressedObjectives;
+
+template <typename Func>
+static void ForEachTaskEntry(Func&& func)
+{
+	for (int i = 0; i < MAX_SHARED_TASK_ENTRIES; ++i)
+		func(pTaskManager->SharedTaskEntries[i], i, cTaskSystemTypeSharedQuest);
+
+	for (int i = 0; i < MAX_QUEST_ENTRIES; ++i)
+		func(pTaskManager->QuestEntries[i], i, cTaskSystemTypeSoloQuest);
+}
+
+// The tasks and the shape of their objectives. The counts aren't part of it, they are compared on
+// every pulse anyway.
+static uint64_t GetTaskSignature()
+{
+	if (!pTaskManager)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ULL;
+	auto add = [&hash](uint32_t value)
+	{
+		hash ^= value;
+		hash *= 1099511628211ULL;
+	};
+
+	ForEachTaskEntry([&](CTaskEntry& entry, int index, TaskSystemType)
+	{
+		if (!entry.TaskID)
+			return;
+
+		add(static_cast<uint32_t>(index));
+		add(static_cast<uint32_t>(entry.TaskID));
+
+		for (const CTaskElement& element : entry.Elements)
+		{
+			add(static_cast<uint32_t>(element.Type));
+			add(static_cast<uint32_t>(element.RequiredCount));
+		}
+	});
+
+	return hash;
+}
+
+static void RebuildTaskCache(uint64_t signature)
+{
+	TaskCache& cache = s_taskCache;
+	cache.taskManager = pTaskManager;
+	cache.pc = pLocalPC;
+	cache.signature = signature;
+	cache.tasks.clear();
+	cache.titleToTask.clear();
+
+	if (!pTaskManager)
+		return;
+
+	char description[MAX_STRING] = { 0 };
+
+	ForEachTaskEntry([&](CTaskEntry& entry, int index, TaskSystemType system)
+	{
+		if (!entry.TaskID)
+			return;
+
+		CachedTask& task = cache.tasks.emplace_back();
+		task.task = &entry;
+		task.system = system;
+		task.index = index;
+		task.taskID = entry.TaskID;
+		task.title = entry.TaskTitle;
+
+		auto status = pLocalPC ? pTaskManager->GetTaskStatus(pLocalPC, index, system) : nullptr;
+
+		task.objectives.resize(MAX_TASK_ELEMENTS);
+		for (int i = 0; i < MAX_TASK_ELEMENTS; ++i)
+		{
+			CTaskElement& element = entry.Elements[i];
+			CachedTaskObjective& objective = task.objectives[i];
+
+			objective.element = &element;
+			objective.type = element.Type;
+			objective.requiredCount = element.RequiredCount;
+			objective.currentCount = status ? status->CurrentCounts[i] : 0;
+
+			description[0] = 0;
+			pTaskManager->GetElementDescription(&element, description);
+			objective.description = description;
+		}
+
+		cache.titleToTask.emplace(to_lower_copy(task.title), static_cast<int>(cache.tasks.size()) - 1);
+	});
+}
+
+void Tasks_Pulse()
+{
+	s_progressedObjectives.clear();
+
+	const uint64_t signature = GetTaskSignature();
+	if (signature != s_taskCache.signature || pTaskManager != s_taskCache.taskManager || pLocalPC != s_taskCache.pc)
+	{
+		// The counts of the new tasks are taken as they are, there is nothing to compare them to.
+		RebuildTaskCache(signature);
+		return;
+	}
+
+	if (!pTaskManager || !pLocalPC)
+		return;
+
+	for (CachedTask& task : s_taskCache.tasks)
+	{
+		auto status = pTaskManager->GetTaskStatus(pLocalPC, task.index, task.system);
+		if (!status)
+			continue;
+
+		for (int i = 0; i < static_cast<int>(task.objectives.size()); ++i)
+		{
+			CachedTaskObjective& objective = task.objectives[i];
+
+			const int currentCount = status->CurrentCounts[i];
+			if (currentCount == objective.currentCount)
+				continue;
+
+			const bool progressed = currentCount > objective.currentCount;
+			objective.currentCount = currentCount;
+
+			if (!progressed || objective.type <= 0)
+				continue;
+
+			s_progressedObjectives.push_back({ task.taskID, i, currentCount, objective.requiredCount });
+			AddTaskProgressEvent(task.title.c_str(), i + 1, currentCount, objective.requiredCount);
+		}
+	}
+}
+
+const std::vector<TaskObjectiveProgress>& Tasks_GetProgressedObjectives()
+{
+	return s_progressedObjectives;
+}
+
+static const TaskCache& GetTaskCache()
+{
+	TaskCache& cache = s_taskCache;
+	if (cache.taskManager != pTaskManager || cache.pc != pLocalPC)
+		RebuildTaskCache(GetTaskSignature());
+
+	return cache;
+}
+
+// A command earlier in this pulse could have changed the tasks. Lookups that didn't find what they
+// were looking for check whether that's the case, and look again if the cache had to be rebuilt.
+static bool RefreshTaskCache()
+{
+	const uint64_t signature = GetTaskSignature();
+	if (signature == s_taskCache.signature)
+		return false;
+
+	RebuildTaskCache(signature);
+	return true;
+}
+
+static bool IsCachedTaskValid(const CachedTask& task)
+{
+	return task.task->TaskID == task.taskID;
+}
+
+static CTaskEntry* FindCachedTaskByTitle(const TaskCache& cache, std::string_view title)
+{
+	if (title[0] == '=')
+	{
+		auto iter = cache.titleToTask.find(to_lower_copy(title.substr(1)));
+		if (iter == cache.titleToTask.end())
+			return nullptr;
+
+		const CachedTask& task = cache.tasks[iter->second];
+		return IsCachedTaskValid(task) ? task.task : nullptr;
+	}
+
+	for (const CachedTask& task : cache.tasks)
+	{
+		if (MaybeExactCompare(task.title, title))
+			return IsCachedTaskValid(task) ? task.task : nullptr;
+	}
+
+	return nullptr;
+}
+
+CTaskEntry* FindTaskByTitle(std::string_view title)
+{
+	if (!pTaskManager || title.empty())
+		return nullptr;
+
+	if (CTaskEntry* task = FindCachedTaskByTitle(GetTaskCache(), title))
+		return task;
+
+	return RefreshTaskCache() ? FindCachedTaskByTitle(s_taskCache, title) : nullptr;
+}
+
+static CTaskElement* FindCachedObjectiveByDescription(const TaskCache& cache, const CTaskEntry* task,
+	std::string_view description)
+{
+	auto iter = std::find_if(cache.tasks.begin(), cache.tasks.end(),
+		[task](const CachedTask& cached) { return cached.task == task; });
+	if (iter == cache.tasks.end() || !IsCachedTaskValid(*iter))
+		return nullptr;
+
+	for (const CachedTaskObjective& objective : iter->objectives)
+	{
+		if (MaybeExactCompare(objective.description, description))
+			return objective.element;
+	}
+
+	return nullptr;
+}
+
+CTaskElement* FindTaskObjectiveByDescription(CTaskEntry* task, std::string_view description)
+{
+	if (!pTaskManager || !task)
+		return nullptr;
+
+	if (CTaskElement* objective = FindCachedObjectiveByDescription(GetTaskCache(), task, description))
+		return objective;
+
+	return RefreshTaskCache() ? FindCachedObjectiveByDescription(s_taskCache, task, description) : nullptr;
+}
+
+// The entries are arrays of tasks that hold arrays of elements, so where an element is follows from
+// its address.
+static bool FindObjectiveInEntries(const CTaskEntry* entries, int count, const CTaskElement* objective,
+	TaskSystemType system, TaskObjectiveLocation& location)
+{
+	auto address = reinterpret_cast<uintptr_t>(objective);
+	auto first = reinterpret_cast<uintptr_t>(entries);
+	if (address < first || address >= first + count * sizeof(CTaskEntry))
+		return false;
+
+	const int taskIndex = static_cast<int>((address - first) / sizeof(CTaskEntry));
+	const CTaskEntry& entry = entries[taskIndex];
+	if (!entry.TaskID)
+		return false;
+
+	const CTaskElement* elements = &entry.Elements[0];
+	if (objective < elements || objective >= elements + MAX_TASK_ELEMENTS)
+		return false;
+
+	location = { taskIndex, static_cast<int>(objective - elements), static_cast<int>(system) };
+	return true;
+}
+
+TaskObjectiveLocation FindTaskObjectiveLocation(const CTaskElement* objective)
+{
+	TaskObjectiveLocation location;
+	if (!pTaskManager || !objective)
+		return location;
+
+	if (!FindObjectiveInEntries(&pTaskManager->SharedTaskEntries[0], MAX_SHARED_TASK_ENTRIES, objective,
+		cTaskSystemTypeSharedQuest, location))
+	{
+		FindObjectiveInEntries(&pTaskManager->QuestEntries[0], MAX_QUEST_ENTRIES, objective,
+			cTaskSystemTypeSoloQuest, location);
+	}
+
+	return location;
+}
+
+int FindTaskEntryIndex(const CTaskEntry* task)
+{
+	if (!task || !pTaskManager)
+		return -1;
+
+	// The entries are arrays, so the index follows from the address.
+	switch (task->TaskSystem)
+	{
+	case cTaskSystemTypeSharedQuest:
+	{
+		const CTaskEntry* first = &pTaskManager->SharedTaskEntries[0];
+		if (task >= first && task < first + MAX_SHARED_TASK_ENTRIES)
+			return static_cast<int>(task - first);
+		break;
+	}
+
+	case cTaskSystemTypeSoloQuest:
+	{
+		const CTaskEntry* first = &pTaskManager->QuestEntries[0];
+		if (task >= first && task < first + MAX_QUEST_ENTRIES)
+			return static_cast<int>(task - first);
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+} // namespace mq
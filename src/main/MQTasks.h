@@ -0,0 +1,61 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace mq {
+
+// Where an objective lives in the task manager.
+struct TaskObjectiveLocation
+{
+	int taskIndex = -1;                        // index into the shared task or quest entries
+	int objectiveIndex = -1;                   // index into the elements of the task
+	int systemType = 0;                        // TaskSystemType of the task
+};
+
+// An objective whose count went up since the previous pulse.
+struct TaskObjectiveProgress
+{
+	int taskID = 0;
+	int objectiveIndex = 0;                    // 0 based
+	int currentCount = 0;
+	int requiredCount = 0;
+};
+
+// Rebuilds the task cache when the tasks changed, and looks for objectives that progressed.
+// Called once per pulse, before macros and game events are processed.
+void Tasks_Pulse();
+
+// The objectives that progressed during this pulse.
+const std::vector<TaskObjectiveProgress>& Tasks_GetProgressedObjectives();
+
+// Queues Event_TaskProgress for the macro, if it has that sub. Lives with the other macro events.
+void AddTaskProgressEvent(const char* taskTitle, int objective, int currentCount, int requiredCount);
+
+// Finds a task by title, using the same rules as MaybeExactCompare.
+eqlib::CTaskEntry* FindTaskByTitle(std::string_view title);
+
+// Finds an objective of the task by its description, using the same rules as MaybeExactCompare.
+eqlib::CTaskElement* FindTaskObjectiveByDescription(eqlib::CTaskEntry* task, std::string_view description);
+
+// Finds the task and index of an objective, without searching every task.
+TaskObjectiveLocation FindTaskObjectiveLocation(const eqlib::CTaskElement* objective);
+
+// The index of the task in its task system entries, or -1 if it isn't one of them.
+int FindTaskEntryIndex(const eqlib::CTaskEntry* task);
+
+} // namespace mq
@@ -0,0 +1,227 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace mq {
+
+//============================================================================
+
+/**
+ * Intrusive link for objects that are scheduled on an MQTimerWheel.
+ */
+struct MQTimerWheelNode
+{
+	uint64_t deadline = 0;
+	MQTimerWheelNode* pWheelPrev = nullptr;
+	MQTimerWheelNode* pWheelNext = nullptr;
+	MQTimerWheelNode** ppWheelHead = nullptr;  // head of the slot the node is in, if scheduled
+
+	bool IsScheduled() const { return ppWheelHead != nullptr; }
+};
+
+/**
+ * Hierarchical timer wheel. Nodes are scheduled against an absolute deadline in whatever unit the
+ * owner advances the wheel in (milliseconds, pulses, ...). Scheduling and cancelling are constant
+ * time, and advancing the wheel only touches the slots that come due, so the cost of a pulse scales
+ * with the number of expirations rather than with the number of pending timers.
+ *
+ * Deadlines further away than the wheel can represent are parked in the last slot and cascaded
+ * back down when it comes due.
+ */
+class MQTimerWheel
+{
+public:
+	static constexpr int SlotBits = 6;
+	static constexpr int SlotCount = 1 << SlotBits;
+	static constexpr int LevelCount = 4;
+
+	explicit MQTimerWheel(uint64_t now = 0)
+		: m_current(now)
+	{
+	}
+
+	MQTimerWheel(const MQTimerWheel&) = delete;
+	MQTimerWheel& operator=(const MQTimerWheel&) = delete;
+
+	bool IsEmpty() const { return m_count == 0; }
+	size_t GetCount() const { return m_count; }
+	uint64_t GetCurrent() const { return m_current; }
+
+	// Schedule a node (or move it, if it is already scheduled). Deadlines that have already passed
+	// expire on the next call to Advance.
+	void Schedule(MQTimerWheelNode* node, uint64_t deadline)
+	{
+		Cancel(node);
+
+		node->deadline = deadline;
+		++m_count;
+
+		Insert(node, m_current + 1);
+	}
+
+	void Cancel(MQTimerWheelNode* node)
+	{
+		if (!node->IsScheduled())
+			return;
+
+		if (node->pWheelPrev)
+			node->pWheelPrev->pWheelNext = node->pWheelNext;
+		else
+			*node->ppWheelHead = node->pWheelNext;
+		if (node->pWheelNext)
+			node->pWheelNext->pWheelPrev = node->pWheelPrev;
+
+		node->pWheelPrev = nullptr;
+		node->pWheelNext = nullptr;
+		node->ppWheelHead = nullptr;
+		--m_count;
+	}
+
+	// Advance the wheel to now, calling onExpired for every node whose deadline is <= now. The node
+	// is no longer scheduled when the callback runs, so the callback may schedule it again or free it.
+	template <typename Callback>
+	void Advance(uint64_t now, Callback&& onExpired)
+	{
+		while (m_current < now)
+		{
+			if (m_count == 0)
+			{
+				m_current = now;
+				return;
+			}
+
+			const uint64_t tick = m_current + 1;
+
+			// Bring down the nodes of every level whose slot has come due on this tick.
+			for (int level = 1; level < LevelCount; ++level)
+			{
+				if (tick & ((uint64_t(1) << (SlotBits * level)) - 1))
+					break;
+
+				Cascade(level, tick);
+			}
+
+			m_current = tick;
+
+			// Detach the slot first. A callback may schedule a node that lands in this same slot for
+			// a full turn of the wheel later, and that node must not expire now.
+			MQTimerWheelNode*& slot = m_slots[0][tick & (SlotCount - 1)];
+			MQTimerWheelNode* pending = slot;
+			slot = nullptr;
+
+			for (MQTimerWheelNode* node = pending; node; node = node->pWheelNext)
+				node->ppWheelHead = &pending;
+
+			while (MQTimerWheelNode* node = pending)
+			{
+				pending = node->pWheelNext;
+				if (pending)
+					pending->pWheelPrev = nullptr;
+
+				node->pWheelNext = nullptr;
+				node->ppWheelHead = nullptr;
+				--m_count;
+
+				onExpired(node);
+			}
+		}
+	}
+
+	// Unschedule every node, calling onRemoved for each of them.
+	template <typename Callback>
+	void Clear(Callback&& onRemoved)
+	{
+		for (auto& level : m_slots)
+		{
+			for (MQTimerWheelNode*& head : level)
+			{
+				while (MQTimerWheelNode* node = head)
+				{
+					head = node->pWheelNext;
+
+					node->pWheelPrev = nullptr;
+					node->pWheelNext = nullptr;
+					node->ppWheelHead = nullptr;
+					--m_count;
+
+					onRemoved(node);
+				}
+			}
+		}
+	}
+
+private:
+	static constexpr uint64_t MaxDelta = (uint64_t(1) << (SlotBits * LevelCount)) - 1;
+
+	static int GetLevel(uint64_t delta)
+	{
+		int level = 0;
+		while (level < LevelCount - 1 && delta >= (uint64_t(1) << (SlotBits * (level + 1))))
+			++level;
+		return level;
+	}
+
+	static uint64_t GetSlotTime(const MQTimerWheelNode* node, uint64_t base)
+	{
+		uint64_t time = node->deadline < base ? base : node->deadline;
+		if (time - base > MaxDelta)
+			time = base + MaxDelta;
+		return time;
+	}
+
+	// Insert a scheduled node relative to base, the first tick that hasn't been processed yet.
+	void Insert(MQTimerWheelNode* node, uint64_t base)
+	{
+		const uint64_t time = GetSlotTime(node, base);
+		node->pWheelPrev = nullptr;
+
+		MQTimerWheelNode*& head = GetSlot(time, base);
+		node->pWheelNext = head;
+		node->ppWheelHead = &head;
+		if (head)
+			head->pWheelPrev = node;
+		head = node;
+	}
+
+	MQTimerWheelNode*& GetSlot(uint64_t time, uint64_t base)
+	{
+		const int level = GetLevel(time - base);
+		return m_slots[level][(time >> (SlotBits * level)) & (SlotCount - 1)];
+	}
+
+	void Cascade(int level, uint64_t tick)
+	{
+		MQTimerWheelNode*& head = m_slots[level][(tick >> (SlotBits * level)) & (SlotCount - 1)];
+		MQTimerWheelNode* node = head;
+		head = nullptr;
+
+		while (node)
+		{
+			MQTimerWheelNode* next = node->pWheelNext;
+			Insert(node, tick);
+			node = next;
+		}
+	}
+
+	uint64_t m_current;
+	size_t m_count = 0;
+	MQTimerWheelNode* m_slots[LevelCount][SlotCount] = {};
+};
+
+//============================================================================
+
+} // namespace mq
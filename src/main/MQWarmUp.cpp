@@ -0,0 +1,225 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQWarmUp.h"
+
+#include <map>
+
+namespace mq {
+
+//============================================================================
+// Warm-up
+//
+// A lot of indices are thrown away when we zone and rebuilt the first time something uses them,
+// which tends to be right after the zone has loaded, when the client is stalling already. The warm-up
+// rebuilds them after zoning instead, round robin, stopping for the pulse once it has used its time.
+
+static constexpr std::chrono::microseconds WarmUpBudget{ 1500 };
+
+// How many ground items are indexed per step.
+static constexpr int GroundItemsPerStep = 64;
+
+struct WarmUpTask
+{
+	std::string name;
+	MQWarmUpStep step;
+	MQPluginHandle owner;
+	bool ready = false;
+};
+
+static std::map<int, WarmUpTask> s_warmUpTasks;
+static int s_nextWarmUpTaskId = 1;
+static int s_lastWarmUpTaskId = 0;     // the task that ran last, the next pulse starts after it
+static bool s_warmingUp = false;
+static bool s_inZone = false;
+static std::chrono::steady_clock::time_point s_warmUpStarted;
+static int s_builtinTasks[3] = { 0 };
+
+int WarmUp_AddTask(const char* name, MQWarmUpStep step, const MQPluginHandle& pluginHandle)
+{
+	if (!step)
+		return 0;
+
+	const int taskId = s_nextWarmUpTaskId++;
+
+	WarmUpTask& task = s_warmUpTasks[taskId];
+	task.name = name ? name : "";
+	task.step = std::move(step);
+	task.owner = pluginHandle;
+
+	// It starts with the next pulse if we are in a zone, otherwise with the next zone.
+	if (s_inZone && !s_warmingUp)
+	{
+		s_warmingUp = true;
+		s_warmUpStarted = std::chrono::steady_clock::now();
+	}
+
+	return taskId;
+}
+
+bool WarmUp_RemoveTask(int taskId, const MQPluginHandle& pluginHandle)
+{
+	auto iter = s_warmUpTasks.find(taskId);
+	if (iter == s_warmUpTasks.end())
+		return false;
+
+	if (iter->second.owner != pluginHandle)
+		return false;
+
+	s_warmUpTasks.erase(iter);
+	return true;
+}
+
+bool WarmUp_IsTaskReady(int taskId)
+{
+	auto iter = s_warmUpTasks.find(taskId);
+	return iter != s_warmUpTasks.end() && iter->second.ready;
+}
+
+bool WarmUp_IsComplete()
+{
+	return s_inZone && !s_warmingUp;
+}
+
+void WarmUp_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle)
+{
+	// Remove any tasks that were left behind by this plugin.
+	for (auto iter = s_warmUpTasks.begin(); iter != s_warmUpTasks.end();)
+	{
+		if (iter->second.owner == pluginHandle)
+		{
+			DebugSpew("Removing warm-up task left behind by %s: %s", plugin->name.c_str(), iter->second.name.c_str());
+			iter = s_warmUpTasks.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+static void StartWarmUp()
+{
+	s_inZone = true;
+	s_warmingUp = true;
+	s_warmUpStarted = std::chrono::steady_clock::now();
+
+	for (auto& [_, task] : s_warmUpTasks)
+		task.ready = false;
+}
+
+static void StopWarmUp()
+{
+	s_inZone = false;
+	s_warmingUp = false;
+
+	for (auto& [_, task] : s_warmUpTasks)
+		task.ready = false;
+}
+
+// The first task after the given one that isn't ready, wrapping around to the start.
+static std::map<int, WarmUpTask>::iterator FindNextWarmUpTask(int afterTaskId)
+{
+	auto first = s_warmUpTasks.upper_bound(afterTaskId);
+
+	auto iter = std::find_if(first, s_warmUpTasks.end(), [](const auto& entry) { return !entry.second.ready; });
+	if (iter != s_warmUpTasks.end())
+		return iter;
+
+	iter = std::find_if(s_warmUpTasks.begin(), first, [](const auto& entry) { return !entry.second.ready; });
+	return iter != first ? iter : s_warmUpTasks.end();
+}
+
+static void PulseWarmUp()
+{
+	if (!s_warmingUp || gGameState != GAMESTATE_INGAME || gZoning)
+		return;
+
+	const auto deadline = std::chrono::steady_clock::now() + WarmUpBudget;
+
+	do
+	{
+		auto iter = FindNextWarmUpTask(s_lastWarmUpTaskId);
+		if (iter == s_warmUpTasks.end())
+		{
+			s_warmingUp = false;
+
+			DebugSpew("Warm-up finished after %d ms", static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - s_warmUpStarted).count()));
+			return;
+		}
+
+		const int taskId = iter->first;
+		s_lastWarmUpTaskId = taskId;
+
+		// The step could add or remove tasks, so find this one again afterwards.
+		MQWarmUpStep step = iter->second.step;
+		const bool done = step();
+
+		iter = s_warmUpTasks.find(taskId);
+		if (iter != s_warmUpTasks.end() && done)
+			iter->second.ready = true;
+	} while (std::chrono::steady_clock::now() < deadline);
+}
+
+static void SetGameStateWarmUp(int gameState)
+{
+	if (gameState == GAMESTATE_INGAME)
+		StartWarmUp();
+	else
+		StopWarmUp();
+}
+
+static void ZonedWarmUp()
+{
+	StartWarmUp();
+}
+
+static void InitializeWarmUp()
+{
+	s_builtinTasks[0] = WarmUp_AddTask("GroundItems",
+		[]() { return WarmUpGroundItemIndex(GroundItemsPerStep); }, mqplugin::ThisPluginHandle);
+	s_builtinTasks[1] = WarmUp_AddTask("Switches", WarmUpSwitchIndex, mqplugin::ThisPluginHandle);
+	s_builtinTasks[2] = WarmUp_AddTask("Captions", WarmUpCaptionTemplates, mqplugin::ThisPluginHandle);
+
+	if (gGameState == GAMESTATE_INGAME)
+		StartWarmUp();
+}
+
+static void ShutdownWarmUp()
+{
+	for (int& taskId : s_builtinTasks)
+	{
+		WarmUp_RemoveTask(taskId, mqplugin::ThisPluginHandle);
+		taskId = 0;
+	}
+
+	StopWarmUp();
+}
+
+static MQModule s_WarmUpModule = {
+	"WarmUp",                      // Name
+	false,                         // CanUnload
+	InitializeWarmUp,              // Initialize
+	ShutdownWarmUp,                // Shutdown
+	PulseWarmUp,                   // Pulse
+	SetGameStateWarmUp,            // SetGameState
+	nullptr,                       // UpdateImGui
+	ZonedWarmUp,                   // Zoned
+};
+DECLARE_MODULE_INITIALIZER(s_WarmUpModule);
+
+} // namespace mq
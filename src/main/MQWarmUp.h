@@ -0,0 +1,36 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "mq/api/WarmUp.h"
+#include "mq/base/PluginHandle.h"
+
+namespace mq {
+
+struct MQPlugin;
+
+// Warm-up tasks. Everything here is only used from the main thread.
+int WarmUp_AddTask(const char* name, MQWarmUpStep step, const MQPluginHandle& pluginHandle);
+bool WarmUp_RemoveTask(int taskId, const MQPluginHandle& pluginHandle);
+bool WarmUp_IsTaskReady(int taskId);
+bool WarmUp_IsComplete();
+void WarmUp_OnPluginUnloaded(MQPlugin* plugin, const MQPluginHandle& pluginHandle);
+
+// Steps of the built-in tasks, defined next to the index that they build.
+bool WarmUpGroundItemIndex(int count);
+bool WarmUpSwitchIndex();
+bool WarmUpCaptionTemplates();
+
+} // namespace mq
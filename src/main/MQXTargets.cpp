@@ -0,0 +1,183 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "MQ2Main.h"
+#include "MQXTargets.h"
+
+#include <array>
+
+namespace mq {
+
+// The changed slots are reported as a bit mask, so that is also as many slots as we look at.
+static constexpr int MaxXTargetSlots = 32;
+
+struct XTargetSnapshot
+{
+	int slotCount = 0;
+	int activeCount = 0;
+	std::array<XTargetSlotState, MaxXTargetSlots> slots;
+};
+
+// What the datatypes read from, and what the last pulse saw to find the changed slots.
+static XTargetSnapshot s_xtargets;
+static XTargetSnapshot s_lastXTargets;
+static uint32_t s_changedXTargetSlots = 0;
+
+static void UpdateSlotState(XTargetSlotState& state, const ExtendedTargetSlot& slot, int index)
+{
+	state.type = slot.xTargetType;
+	state.status = slot.XTargetSlotStatus;
+	state.spawnID = slot.SpawnID;
+	state.spawn = slot.SpawnID ? GetSpawnByID(slot.SpawnID) : nullptr;
+	state.aggroPct = -1;
+
+	if (pAggroInfo && AD_xTarget1 + index < MAX_AGGRO_METER_SIZE)
+		state.aggroPct = pAggroInfo->aggroData[AD_xTarget1 + index].AggroPct;
+}
+
+static bool IsActive(const XTargetSlotState& state)
+{
+	return state.type != 0 && state.status != eXTSlotEmpty;
+}
+
+void XTargets_Pulse()
+{
+	XTargetSnapshot& snapshot = s_xtargets;
+	snapshot.slotCount = 0;
+	snapshot.activeCount = 0;
+
+	if (pLocalPC && pLocalPC->pExtendedTargetList)
+	{
+		snapshot.slotCount = std::min(pLocalPC->pExtendedTargetList->GetNumSlots(), MaxXTargetSlots);
+
+		for (int index = 0; index < snapshot.slotCount; ++index)
+		{
+			XTargetSlotState& state = snapshot.slots[index];
+			state = XTargetSlotState{};
+
+			if (const ExtendedTargetSlot* slot = pLocalPC->pExtendedTargetList->GetSlot(index))
+				UpdateSlotState(state, *slot, index);
+
+			if (IsActive(state))
+				++snapshot.activeCount;
+		}
+	}
+
+	// Slots past the end of the list compare as empty.
+	for (int index = snapshot.slotCount; index < MaxXTargetSlots; ++index)
+		snapshot.slots[index] = XTargetSlotState{};
+
+	uint32_t changed = 0;
+	for (int index = 0; index < MaxXTargetSlots; ++index)
+	{
+		const XTargetSlotState& current = snapshot.slots[index];
+		const XTargetSlotState& last = s_lastXTargets.slots[index];
+
+		if (current.type != last.type
+			|| current.status != last.status
+			|| current.spawnID != last.spawnID
+			|| current.spawn != last.spawn
+			|| current.aggroPct != last.aggroPct)
+		{
+			changed |= 1u << index;
+		}
+	}
+
+	s_changedXTargetSlots = changed;
+	s_lastXTargets = snapshot;
+}
+
+void XTargets_OnAddSpawn(PlayerClient* pSpawn)
+{
+	for (int index = 0; index < s_xtargets.slotCount; ++index)
+	{
+		XTargetSlotState& state = s_xtargets.slots[index];
+		if (!state.spawn && state.spawnID != 0 && state.spawnID == pSpawn->SpawnID)
+			state.spawn = pSpawn;
+	}
+}
+
+void XTargets_OnRemoveSpawn(PlayerClient* pSpawn)
+{
+	for (int index = 0; index < MaxXTargetSlots; ++index)
+	{
+		if (s_xtargets.slots[index].spawn == pSpawn)
+			s_xtargets.slots[index].spawn = nullptr;
+
+		// The last pulse only keeps the pointer to compare against, but it could be reused by the
+		// next spawn that is added.
+		if (s_lastXTargets.slots[index].spawn == pSpawn)
+			s_lastXTargets.slots[index].spawn = nullptr;
+	}
+}
+
+uint32_t XTargets_GetChangedSlots()
+{
+	return s_changedXTargetSlots;
+}
+
+int GetXTargetSlotCount()
+{
+	return s_xtargets.slotCount;
+}
+
+const XTargetSlotState* GetXTargetSlotState(int index)
+{
+	if (index < 0 || index >= s_xtargets.slotCount || !pLocalPC || !pLocalPC->pExtendedTargetList)
+		return nullptr;
+
+	const ExtendedTargetSlot* slot = pLocalPC->pExtendedTargetList->GetSlot(index);
+	if (!slot)
+		return nullptr;
+
+	// A command earlier in this pulse could have changed the slot. Checking is much cheaper than the
+	// spawn lookup, so a changed slot is updated rather than answering from the snapshot.
+	XTargetSlotState& state = s_xtargets.slots[index];
+	if (state.spawnID != slot->SpawnID || state.type != slot->xTargetType || state.status != slot->XTargetSlotStatus)
+	{
+		const bool wasActive = IsActive(state);
+		UpdateSlotState(state, *slot, index);
+		s_xtargets.activeCount += static_cast<int>(IsActive(state)) - static_cast<int>(wasActive);
+	}
+
+	return &state;
+}
+
+int GetXTargetActiveCount()
+{
+	return s_xtargets.activeCount;
+}
+
+bool IsXTargetHater(const PlayerClient* pSpawn)
+{
+	if (!pSpawn)
+		return false;
+
+	for (int index = 0; index < s_xtargets.slotCount; ++index)
+	{
+		const XTargetSlotState& state = s_xtargets.slots[index];
+		if (state.type == XTARGET_AUTO_HATER
+			&& state.status != eXTSlotEmpty
+			&& state.spawn != nullptr
+			&& state.spawnID == pSpawn->SpawnID)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+} // namespace mq
@@ -0,0 +1,58 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace eqlib {
+	class PlayerClient;
+}
+
+namespace mq {
+
+// An extended target slot as of this pulse, with its spawn already looked up.
+struct XTargetSlotState
+{
+	int type = 0;                              // xTargetType, 0 if the slot isn't in use
+	int status = 0;                            // XTargetSlotStatus
+	uint32_t spawnID = 0;
+	eqlib::PlayerClient* spawn = nullptr;      // null if the spawn isn't in the spawn list
+	int aggroPct = -1;                         // -1 if there is no aggro information
+};
+
+// Takes the snapshot of the extended target slots that the rest of the pulse reads from.
+// Called once per pulse, before macros and game events are processed.
+void XTargets_Pulse();
+
+// Keeps the spawns of the snapshot valid between pulses.
+void XTargets_OnAddSpawn(eqlib::PlayerClient* pSpawn);
+void XTargets_OnRemoveSpawn(eqlib::PlayerClient* pSpawn);
+
+// A bit for every slot that changed type, status, spawn or aggro since the previous pulse.
+uint32_t XTargets_GetChangedSlots();
+
+// The number of slots in the snapshot.
+int GetXTargetSlotCount();
+
+// The state of a slot, or null if there is no such slot.
+const XTargetSlotState* GetXTargetSlotState(int index);
+
+// The number of slots that are in use and not empty.
+int GetXTargetActiveCount();
+
+// True if the spawn is an auto hater on the extended target list.
+bool IsXTargetHater(const eqlib::PlayerClient* pSpawn);
+
+} // namespace mq
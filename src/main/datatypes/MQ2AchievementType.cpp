@@ -73,7 +73,7 @@ bool MQ2AchievementManagerType::GetMember(MQVarPtr VarPtr, const char* Member, c
 			}
 			else
 			{
-				Dest.Int = mgr.GetAchievementIndexByName(Index);
+				Dest.Int = GetAchievementIndexByName(Index);
 			}
 		}
 		return true;
@@ -180,7 +180,7 @@ bool MQ2AchievementManagerType::dataAchievement(const char* szIndex, MQTypeVar&
 		}
 		else
 		{
-			Ret.Int = mgr.GetAchievementIndexByName(szIndex);
+			Ret.Int = GetAchievementIndexByName(szIndex);
 		}
 		return true;
 	}
@@ -316,16 +316,9 @@ bool MQ2AchievementType::GetMember(MQVarPtr VarPtr, const char* Member, char* In
 			}
 			else
 			{
-				for (int componentType = AchievementComponentUnlock; componentType < AchievementComponentCount; ++componentType)
+				if (const AchievementComponent* component = GetAchievementComponentByDescription(achievement, Index))
 				{
-					for (const AchievementComponent& component : achievement->componentsByType[componentType])
-					{
-						if (ci_equals(component.description, Index))
-						{
-							Dest.HighPart = (uint32_t)component.id;
-							break;
-						}
-					}
+					Dest.HighPart = (uint32_t)component->id;
 				}
 			}
 		}
@@ -495,7 +488,7 @@ bool MQ2AchievementType::FromString(MQVarPtr& VarPtr, const char* Source)
 	}
 	else
 	{
-		VarPtr.Int = mgr.GetAchievementIndexByName(Source);
+		VarPtr.Int = GetAchievementIndexByName(Source);
 	}
 
 	return VarPtr.Int != -1;
@@ -602,19 +595,7 @@ bool MQ2AchievementCategoryType::GetMember(MQVarPtr VarPtr, const char* Member,
 			}
 			else
 			{
-				for (const AchievementInfo& info : category->achievements)
-				{
-					int achievementIndex = mgr.GetAchievementIndexById(info.achievementId);
-					if (achievementIndex >= 0)
-					{
-						const Achievement* achievement = mgr.GetAchievementByIndex(achievementIndex);
-						if (achievement && ci_equals(achievement->name, Index))
-						{
-							Dest.Int = achievementIndex;
-							break;
-						}
-					}
-				}
+				Dest.Int = GetAchievementIndexInCategoryByName(category, Index);
 			}
 		}
 		return true;
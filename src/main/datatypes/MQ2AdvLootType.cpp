@@ -14,6 +14,7 @@
 
 #include "pch.h"
 #include "MQ2DataTypes.h"
+#include "MQAdvLoot.h"
 
 namespace mq::datatypes {
 
@@ -64,107 +65,70 @@ bool MQ2AdvLootType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 		return true;
 
 	case AdvLootTypeMembers::PList:
-		if (int index = GetIntFromString(Index, 0))
+	case AdvLootTypeMembers::SList:
+	{
+		const bool personal = static_cast<AdvLootTypeMembers>(pMember->ID) == AdvLootTypeMembers::PList;
+		const AdvLootListModel* model = AdvLoot_GetList(personal ? AdvLootList::Personal : AdvLootList::Shared);
+		if (!model || !Index[0])
+			return false;
+
+		// the rows can be found by their 1 based index, or by the name of the item
+		int row = -1;
+		if (IsNumber(Index))
 		{
-			index--;
-			if (index < 0)
-				index = 0;
-			if (CListWnd* clist = (CListWnd*)pAdvancedLootWnd->GetChildItem("ADLW_PLLList"))
-			{
-				int listindex = (int)clist->GetItemData(index);
-				if (pAdvancedLootWnd->pPLootList && listindex != -1)
-				{
-					Dest.Type = pAdvLootItemType;
-					Dest.DWord = listindex;
-					Dest.HighPart = static_cast<int>(ListType::PList);
-					return true;
-				}
-			}
+			int index = GetIntFromString(Index, 0);
+			if (index == 0)
+				return false;
+
+			row = std::max(index - 1, 0);
 		}
-		return false;
+		else
+		{
+			row = model->FindRowByName(Index);
+		}
+
+		int listindex = model->GetItemIndex(row);
+		if (listindex == -1)
+			return false;
+
+		Dest.Type = pAdvLootItemType;
+		Dest.DWord = listindex;
+		Dest.HighPart = static_cast<int>(personal ? ListType::PList : ListType::CList);
+		return true;
+	}
 
 	case AdvLootTypeMembers::SCount:
 		Dest.Int = pAdvancedLootWnd->pCLootList->Items.GetSize();
 		Dest.Type = pIntType;
 		return true;
 
-	case AdvLootTypeMembers::SList:
-		if (int index = GetIntFromString(Index, 0))
-		{
-			index--;
-			if (index < 0)
-				index = 0;
-
-			if (CListWnd* clist = (CListWnd*)pAdvancedLootWnd->GetChildItem("ADLW_CLLList"))
-			{
-				int listindex = (int)clist->GetItemData(index);
-				if (pAdvancedLootWnd->pCLootList && listindex != -1)
-				{
-					Dest.Type = pAdvLootItemType;
-					Dest.DWord = listindex;
-					Dest.HighPart = static_cast<int>(ListType::CList);
-					return true;
-				}
-			}
-		}
-		return false;
-
 	case AdvLootTypeMembers::PWantCount:
 		Dest.DWord = 0;
 		Dest.Type = pIntType;
 
-		if (CListWnd* clist = (CListWnd*)pAdvancedLootWnd->GetChildItem("ADLW_PLLList"))
-		{
-			// Access items in the order they appear in the list.
-			for (int i = 0; i < clist->ItemsArray.Count; i++)
-			{
-				int listindex = (int)clist->GetItemData(i);
-				if (pAdvancedLootWnd->pPLootList && listindex != -1)
-				{
-					const AdvancedLootItem& item = pAdvancedLootWnd->pPLootList->Items[listindex];
-					if (item.AlwaysNeed || item.AlwaysGreed || item.Need || item.Greed)
-					{
-						Dest.DWord++;
-					}
-				}
-			}
-		}
+		if (const AdvLootListModel* model = AdvLoot_GetList(AdvLootList::Personal))
+			Dest.DWord = model->GetWantCount();
 		return true;
 
 	case AdvLootTypeMembers::SWantCount:
 		Dest.DWord = 0;
 		Dest.Type = pIntType;
 
-		if (CListWnd* clist = (CListWnd*)pAdvancedLootWnd->GetChildItem("ADLW_CLLList"))
-		{
-			for (int i = 0; i < clist->ItemsArray.Count; i++)
-			{
-				int listindex = (int)clist->GetItemData(i);
-				if (pAdvancedLootWnd->pCLootList && listindex != -1)
-				{
-					const AdvancedLootItem& item = pAdvancedLootWnd->pCLootList->Items[listindex];
-					if (item.AlwaysNeed || item.AlwaysGreed || item.Need || item.Greed)
-					{
-						Dest.DWord++;
-					}
-				}
-			}
-		}
+		if (const AdvLootListModel* model = AdvLoot_GetList(AdvLootList::Shared))
+			Dest.DWord = model->GetWantCount();
 		return true;
 
 	case AdvLootTypeMembers::LootInProgress:
+	{
 		Dest.Set(false);
 		Dest.Type = pBoolType;
 
-		if (CListWnd* pPersonalList = (CListWnd*)pAdvancedLootWnd->GetChildItem("ADLW_PLLList"))
-		{
-			if (pAdvancedLootWnd->pCLootList)
-			{
-				CListWnd* pSharedList = (CListWnd*)pAdvancedLootWnd->pCLootList->SharedLootList;
-				Dest.Set(LootInProgress(pAdvancedLootWnd, pPersonalList, pSharedList));
-			}
-		}
+		const AdvLootListModel* personal = AdvLoot_GetList(AdvLootList::Personal);
+		const AdvLootListModel* shared = AdvLoot_GetList(AdvLootList::Shared);
+		if (personal && pAdvancedLootWnd->pCLootList)
+			Dest.Set(personal->IsLootInProgress() || (shared && shared->IsLootInProgress()));
 		return true;
+	}
 
 	case AdvLootTypeMembers::Filter:
 		Dest.Type = pItemFilterDataType;
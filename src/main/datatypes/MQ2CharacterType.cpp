@@ -17,6 +17,9 @@
 
 #include "MQ2Mercenaries.h"
 #include "MQ2SpellSearch.h"
+#include "MQDataAPI.h"
+#include "MQPetMercState.h"
+#include "MQXTargets.h"
 
 namespace mq::datatypes {
 
@@ -342,6 +345,7 @@ enum class CharacterMembers
 	CanMount,
 	SpellRankCap,
 	CastTimeLeft,
+	CastPhase,
 	MaxLevel,
 	AirSupply,
 	MaxAirSupply,
@@ -690,6 +694,7 @@ MQ2CharacterType::MQ2CharacterType() : MQ2Type("character")
 	ScopedTypeMember(CharacterMembers, CanMount);
 	ScopedTypeMember(CharacterMembers, SpellRankCap);
 	ScopedTypeMember(CharacterMembers, CastTimeLeft);
+	ScopedTypeMember(CharacterMembers, CastPhase);
 	ScopedTypeMember(CharacterMembers, MaxLevel);
 	ScopedTypeMember(CharacterMembers, AirSupply);
 	ScopedTypeMember(CharacterMembers, MaxAirSupply);
@@ -713,6 +718,107 @@ MQ2CharacterType::MQ2CharacterType() : MQ2Type("character")
 	ScopedTypeMethod(CharacterMethods, StopCast);
 }
 
+//----------------------------------------------------------------------------
+// Readiness snapshot
+//
+// Gem timers and the readiness of gems, abilities and alternate abilities come from the game,
+// and combat macros ask for them many times per frame. While gbReadinessSnapshot is set, each
+// answer is read from the game the first time it is asked for in a frame and reused for the rest
+// of it. Commands like /cast and /doability expire the snapshot (see MQCommandAPI), anything else
+// that changes readiness isn't seen until the next frame. Scripts that need to see it right away
+// can turn the snapshot off with /readiness fresh.
+
+struct ReadinessSnapshot
+{
+	uint32_t frame = 0;
+	std::array<std::optional<uint32_t>, NUM_SPELL_GEMS> gemTimers;
+	std::array<std::optional<bool>, NUM_SPELL_GEMS> gemsReady;
+	std::unordered_map<int, bool> abilitiesReady;
+	std::unordered_map<const CAltAbilityData*, bool> altAbilitiesReady;
+};
+
+static ReadinessSnapshot s_readiness;
+
+static ReadinessSnapshot* GetReadinessSnapshot()
+{
+	if (!gbReadinessSnapshot || !pDataAPI || !IsMainThread())
+		return nullptr;
+
+	const uint32_t frame = pDataAPI->GetFrameStamp();
+	if (s_readiness.frame != frame)
+	{
+		s_readiness.gemTimers.fill(std::nullopt);
+		s_readiness.gemsReady.fill(std::nullopt);
+		s_readiness.abilitiesReady.clear();
+		s_readiness.altAbilitiesReady.clear();
+		s_readiness.frame = frame;
+	}
+
+	return &s_readiness;
+}
+
+static uint32_t GetGemTimer(int nGem)
+{
+	if (ReadinessSnapshot* pSnapshot = GetReadinessSnapshot())
+	{
+		std::optional<uint32_t>& timer = pSnapshot->gemTimers[nGem];
+		if (!timer)
+			timer = GetSpellGemTimer(nGem);
+
+		return *timer;
+	}
+
+	return GetSpellGemTimer(nGem);
+}
+
+static bool IsGemReady(int nGem)
+{
+	auto readGem = [nGem]()
+	{
+		return pDisplay->TimeStamp > pLocalPlayer->SpellGemETA[nGem]
+			&& pDisplay->TimeStamp > pLocalPlayer->GetSpellCooldownETA();
+	};
+
+	if (ReadinessSnapshot* pSnapshot = GetReadinessSnapshot(); pSnapshot && nGem < NUM_SPELL_GEMS)
+	{
+		std::optional<bool>& ready = pSnapshot->gemsReady[nGem];
+		if (!ready)
+			ready = readGem();
+
+		return *ready;
+	}
+
+	return readGem();
+}
+
+static bool IsAbilityReady(int nSkill)
+{
+	if (ReadinessSnapshot* pSnapshot = GetReadinessSnapshot())
+	{
+		auto [iter, added] = pSnapshot->abilitiesReady.try_emplace(nSkill, false);
+		if (added)
+			iter->second = pSkillMgr->IsAvailable(nSkill);
+
+		return iter->second;
+	}
+
+	return pSkillMgr->IsAvailable(nSkill);
+}
+
+static bool IsAltAbilityReady(CAltAbilityData* pAbility)
+{
+	if (ReadinessSnapshot* pSnapshot = GetReadinessSnapshot())
+	{
+		auto [iter, added] = pSnapshot->altAbilitiesReady.try_emplace(pAbility, false);
+		if (added)
+			iter->second = pAltAdvManager->IsAbilityReady(pLocalPC, pAbility, nullptr);
+
+		return iter->second;
+	}
+
+	return pAltAdvManager->IsAbilityReady(pLocalPC, pAbility, nullptr);
+}
+
 bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
 {
 	if (!pLocalPC || !pLocalPlayer)
@@ -1773,28 +1879,17 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 			else
 			{
 				// by name so we ned to take level into account
-				int level = pLocalPlayer->Level;
-
-				for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+				if (CAltAbilityData* pAbility = GetOwnedAAByName(Index))
 				{
-					if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility), level))
+					int reusetimer = 0;
+					pAltAdvManager->IsAbilityReady(pLocalPC, pAbility, &reusetimer);
+					if (reusetimer < 0)
 					{
-						if (const char* pName = pDBStr->GetString(pAbility->nName, eAltAbilityName))
-						{
-							if (!_stricmp(Index, pName))
-							{
-								int reusetimer = 0;
-								pAltAdvManager->IsAbilityReady(pLocalPC, pAbility, &reusetimer);
-								if (reusetimer < 0)
-								{
-									reusetimer = 0;
-								}
-
-								Dest.UInt64 = static_cast<uint64_t>(reusetimer) * 1000;
-								return true;
-							}
-						}
+						reusetimer = 0;
 					}
+
+					Dest.UInt64 = static_cast<uint64_t>(reusetimer) * 1000;
+					return true;
 				}
 			}
 		}
@@ -1809,40 +1904,23 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 			if (IsNumber(Index))
 			{
 				// numeric
-				for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+				if (CAltAbilityData* pAbility = GetOwnedAAByID(GetIntFromString(Index, 0)))
 				{
-					if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility)))
-					{
-						if (pAbility->ID == GetIntFromString(Index, 0))
-						{
-							if (pAbility->SpellID != -1)
-								Dest.Set(pAltAdvManager->IsAbilityReady(pLocalPC, pAbility, nullptr));
+					if (pAbility->SpellID != -1)
+						Dest.Set(IsAltAbilityReady(pAbility));
 
-							return true;
-						}
-					}
+					return true;
 				}
 			}
 			else
 			{
 				// by name so we need to take their level into account
-				int level = pLocalPlayer->Level;
-
-				for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+				if (CAltAbilityData* pAbility = GetOwnedAAByName(Index))
 				{
-					if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility), level))
-					{
-						if (const char* pName = pDBStr->GetString(pAbility->nName, eAltAbilityName))
-						{
-							if (!_stricmp(Index, pName))
-							{
-								if (pAbility->SpellID != -1)
-									Dest.Set(pAltAdvManager->IsAbilityReady(pLocalPC, pAbility, nullptr));
+					if (pAbility->SpellID != -1)
+						Dest.Set(IsAltAbilityReady(pAbility));
 
-								return true;
-							}
-						}
-					}
+					return true;
 				}
 			}
 		}
@@ -1865,21 +1943,10 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 			else
 			{
 				// by name so we need to take their level into account
-				int level = pLocalPlayer->Level;
-
-				for (int nAbility = 0; nAbility < AA_CHAR_MAX_REAL; nAbility++)
+				if (CAltAbilityData* pAbility = GetOwnedAAByName(Index))
 				{
-					if (CAltAbilityData* pAbility = GetAAById(pLocalPC->GetAlternateAbilityId(nAbility), level))
-					{
-						if (const char* pName = pDBStr->GetString(pAbility->nName, eAltAbilityName))
-						{
-							if (!_stricmp(Index, pName))
-							{
-								Dest.Ptr = pAbility;
-								return true;
-							}
-						}
-					}
+					Dest.Ptr = pAbility;
+					return true;
 				}
 			}
 		}
@@ -2012,7 +2079,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 		int nSkill = GetAbilityIDFromString(Index, -1);
 		if (nSkill != -1 && HasSkillOrInnate(nSkill))
 		{
-			Dest.Set(pSkillMgr->IsAvailable(nSkill));
+			Dest.Set(IsAbilityReady(nSkill));
 		}
 		return true;
 	}
@@ -2240,11 +2307,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 
 				if (GetSpellByID(GetMemorizedSpell(nGem)))
 				{
-					if (pDisplay->TimeStamp > pLocalPlayer->SpellGemETA[nGem]
-						&& pDisplay->TimeStamp > pLocalPlayer->GetSpellCooldownETA())
-					{
-						Dest.Set(true);
-					}
+					Dest.Set(IsGemReady(nGem));
 					return true;
 				}
 			}
@@ -2256,11 +2319,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 					{
 						if (!_stricmp(Index, pSpell->Name))
 						{
-							if (pDisplay->TimeStamp > pLocalPlayer->SpellGemETA[nGem]
-								&& pDisplay->TimeStamp > pLocalPlayer->GetSpellCooldownETA())
-							{
-								Dest.Set(true);
-							}
+							Dest.Set(IsGemReady(nGem));
 							return true;
 						}
 					}
@@ -3112,15 +3171,15 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 
 		if (pAggroInfo)
 		{
-			int count = pLocalPC->pExtendedTargetList->GetNumSlots();
+			int count = GetXTargetSlotCount();
 			for (int i = 0; i < count; i++)
 			{
-				ExtendedTargetSlot* slot = pLocalPC->pExtendedTargetList->GetSlot(i);
+				const XTargetSlotState* slot = GetXTargetSlotState(i);
 				if (!slot) continue;
 
-				if (slot->SpawnID && slot->xTargetType == XTARGET_AUTO_HATER)
+				if (slot->spawnID && slot->type == XTARGET_AUTO_HATER)
 				{
-					SPAWNINFO* pSpawn = GetSpawnByID(slot->SpawnID);
+					SPAWNINFO* pSpawn = slot->spawn;
 					if (!pSpawn
 						|| (pTarget && pTarget->SpawnID == pSpawn->SpawnID)
 						|| (pSpawn->Type != SPAWN_NPC))
@@ -3128,8 +3187,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 						continue;
 					}
 
-					uint16_t aggropct = pAggroInfo->aggroData[AD_xTarget1 + i].AggroPct;
-					if (aggropct < AggroPct)
+					if (slot->aggroPct >= 0 && slot->aggroPct < AggroPct)
 					{
 						Dest.DWord++;
 					}
@@ -3145,12 +3203,16 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 
 		if (pAggroInfo)
 		{
-			for (ExtendedTargetSlot& slot : *pLocalPC->pExtendedTargetList)
+			int count = GetXTargetSlotCount();
+			for (int i = 0; i < count; i++)
 			{
-				if (slot.SpawnID != 0
-					&& slot.xTargetType == XTARGET_AUTO_HATER)
+				const XTargetSlotState* slot = GetXTargetSlotState(i);
+				if (!slot) continue;
+
+				if (slot->spawnID != 0
+					&& slot->type == XTARGET_AUTO_HATER)
 				{
-					SPAWNINFO* pSpawn = GetSpawnByID(slot.SpawnID);
+					SPAWNINFO* pSpawn = slot->spawn;
 					if (!pSpawn
 						|| (pTarget && pTarget->SpawnID == pSpawn->SpawnID)
 						|| (pSpawn->Type != SPAWN_NPC))
@@ -3204,16 +3266,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 		}
 
 		// No index was given, so we return the count.
-		int count = 0;
-		for (const ExtendedTargetSlot& slot : *pLocalPC->pExtendedTargetList)
-		{
-			if (slot.xTargetType != 0 && slot.XTargetSlotStatus != eXTSlotEmpty)
-			{
-				count++;
-			}
-		}
-
-		Dest.DWord = count;
+		Dest.DWord = GetXTargetActiveCount();
 		Dest.Type = pIntType;
 		return true;
 	}
@@ -3263,7 +3316,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 			{
 				if (GetMemorizedSpell(nGem) != 0xFFFFFFFF)
 				{
-					Dest.UInt64 = GetSpellGemTimer(nGem);
+					Dest.UInt64 = GetGemTimer(nGem);
 					return true;
 				}
 			}
@@ -3277,7 +3330,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 				{
 					if (!_stricmp(Index, pSpell->Name))
 					{
-						Dest.UInt64 = GetSpellGemTimer(nGem);
+						Dest.UInt64 = GetGemTimer(nGem);
 						return true;
 					}
 				}
@@ -3675,7 +3728,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 			if (nIndex >= pMercManager->mercenaries.GetLength() || nIndex < 0)
 				return false;
 
-			std::vector<MercDesc> descs = GetAllMercDesc();
+			const std::vector<MercDesc>& descs = GetMercenaryDescriptions();
 			if (nIndex < static_cast<int>(descs.size()))
 			{
 				strcpy_s(DataTypeTemp, descs[nIndex].Type.c_str());
@@ -3686,7 +3739,7 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 		}
 		else
 		{
-			std::vector<MercDesc> descs = GetAllMercDesc();
+			const std::vector<MercDesc>& descs = GetMercenaryDescriptions();
 
 			for (uint32_t index = 0; index < descs.size(); ++index)
 			{
@@ -3952,6 +4005,12 @@ bool MQ2CharacterType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 		}
 		return true;
 
+	case CharacterMembers::CastPhase:
+		Dest.Type = pStringType;
+		Dest.Ptr = &DataTypeTemp[0];
+		strcpy_s(DataTypeTemp, GetCastPhaseName(GetCastState().Phase));
+		return true;
+
 	case CharacterMembers::MaxLevel:
 		Dest.Type = pIntType;
 		Dest.Set(GetCharMaxLevel());
@@ -47,6 +47,8 @@ MQ2ClassType::MQ2ClassType() : MQ2Type("class")
 	ScopedTypeMember(ClassMembers, PetClass);
 	ScopedTypeMember(ClassMembers, HealerType);
 	ScopedTypeMember(ClassMembers, MercType);
+
+	SetMemberPurity(MQDataPurity::Constant);
 }
 
 bool MQ2ClassType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
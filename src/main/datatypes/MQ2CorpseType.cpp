@@ -70,10 +70,10 @@ bool MQ2CorpseType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 			char* pName1 = Index;
 			bool bExact = (*pName1 == '=') && ++pName1;
 
-			ItemIndex itemIndex = pLootWnd->GetLootItems().FindItem(0, FindItemByNamePred(pName1, bExact));
-			if (itemIndex.IsValid())
+			int slot = GetCorpseItemSlotByName(pName1, bExact);
+			if (slot != -1)
 			{
-				Dest = pItemType->MakeTypeVar(pLootWnd->GetLootItems().GetItem(itemIndex));
+				Dest = pItemType->MakeTypeVar(pLootWnd->GetLootItem(slot));
 				return true;
 			}
 		}
@@ -81,8 +81,18 @@ bool MQ2CorpseType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 		return true;
 
 	case CorpseMembers::Items:
-		Dest.DWord = pLootWnd->GetLootItems().GetCount();
 		Dest.Type = pIntType;
+
+		// with a name, the number of items that match it
+		if (Index[0])
+		{
+			const std::string_view name = Index;
+			Dest.DWord = static_cast<uint32_t>(FindCorpseItems(
+				[&name](const ItemPtr& pItem) { return MaybeExactCompare(pItem->GetName(), name); }).size());
+			return true;
+		}
+
+		Dest.DWord = pLootWnd->GetLootItems().GetCount();
 		return true;
 
 	default: break;
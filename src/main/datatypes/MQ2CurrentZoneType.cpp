@@ -45,6 +45,8 @@ MQ2CurrentZoneType::MQ2CurrentZoneType() : MQ2Type("currentzone")
 	ScopedTypeMember(CurrentZoneMembers, Indoor);
 	ScopedTypeMember(CurrentZoneMembers, Outdoor);
 	ScopedTypeMember(CurrentZoneMembers, NoBind);
+
+	SetMemberPurity(MQDataPurity::PerZone);
 }
 
 
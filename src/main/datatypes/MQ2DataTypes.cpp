@@ -93,104 +93,214 @@ CDataArray::CDataArray(MQ2Type* Type, const char* Index)
 	}
 
 	m_pType = Type;
-	m_pData = new MQVarPtr[m_totalElements];
+	m_storage = GetStorage(Type);
+
+	switch (m_storage)
+	{
+	case Storage::Int: m_pInts = new int32_t[m_totalElements](); break;
+	case Storage::Int64: m_pInt64s = new int64_t[m_totalElements](); break;
+	case Storage::Float: m_pFloats = new float[m_totalElements](); break;
+	case Storage::Double: m_pDoubles = new double[m_totalElements](); break;
+	case Storage::Bool: m_pBools = new bool[m_totalElements](); break;
+	default: m_pData = new MQVarPtr[m_totalElements]; break;
+	}
+}
+
+CDataArray::Storage CDataArray::GetStorage(MQ2Type* Type)
+{
+	if (Type == nullptr) return Storage::Variant;
+	if (Type == pIntType) return Storage::Int;
+	if (Type == pInt64Type) return Storage::Int64;
+	if (Type == pFloatType) return Storage::Float;
+	if (Type == pDoubleType) return Storage::Double;
+	if (Type == pBoolType) return Storage::Bool;
+
+	return Storage::Variant;
 }
 
 void CDataArray::Initialize(const char* defaultValue)
 {
-	if (m_pType != nullptr)
+	if (m_pType == nullptr)
+		return;
+
+	if (m_storage != Storage::Variant)
 	{
+		// Packed elements have nothing to allocate, so the default only needs to be converted once.
+		MQVarPtr data;
+		m_pType->InitVariable(data);
+		m_pType->FromString(data, defaultValue);
+
 		for (int index = 0; index < m_totalElements; index++)
-		{
-			m_pType->InitVariable(m_pData[index]);
-			m_pType->FromString(m_pData[index], defaultValue);
-		}
+			SetData(index, data);
+		return;
+	}
+
+	for (int index = 0; index < m_totalElements; index++)
+	{
+		m_pType->InitVariable(m_pData[index]);
+		m_pType->FromString(m_pData[index], defaultValue);
 	}
 }
 
 void CDataArray::Initialize(const MQTypeVar& defaultValue)
 {
-	if (m_pType != nullptr)
+	if (m_pType == nullptr)
+		return;
+
+	if (m_storage != Storage::Variant)
 	{
+		MQVarPtr data;
+		m_pType->InitVariable(data);
+		m_pType->FromData(data, defaultValue);
+
 		for (int index = 0; index < m_totalElements; index++)
-		{
-			m_pType->InitVariable(m_pData[index]);
-			m_pType->FromData(m_pData[index], defaultValue);
-		}
+			SetData(index, data);
+		return;
 	}
-}
-
 
-CDataArray::~CDataArray()
-{
-	if (m_pType && m_pData)
+	for (int index = 0; index < m_totalElements; index++)
 	{
-		for (int index = 0; index < m_totalElements; index++)
-		{
-			m_pType->FreeVariable(m_pData[index]);
-		}
+		m_pType->InitVariable(m_pData[index]);
+		m_pType->FromData(m_pData[index], defaultValue);
 	}
+}
 
-	delete[] m_pExtents;
-	delete[] m_pData;
+CDataArray::~CDataArray()
+{
+	Delete();
 }
 
 void CDataArray::Delete()
 {
-	if (m_pType && m_pData)
+	switch (m_storage)
 	{
-		for (int index = 0; index < m_totalElements; index++)
+	case Storage::Int: delete[] m_pInts; break;
+	case Storage::Int64: delete[] m_pInt64s; break;
+	case Storage::Float: delete[] m_pFloats; break;
+	case Storage::Double: delete[] m_pDoubles; break;
+	case Storage::Bool: delete[] m_pBools; break;
+
+	default:
+		if (m_pType && m_pData)
 		{
-			m_pType->FreeVariable(m_pData[index]);
+			for (int index = 0; index < m_totalElements; index++)
+			{
+				m_pType->FreeVariable(m_pData[index]);
+			}
 		}
+
+		delete[] m_pData;
+		break;
 	}
 
 	delete[] m_pExtents;
-	delete[] m_pData;
 
 	m_pExtents = nullptr;
 	m_pType = nullptr;
+	m_storage = Storage::Variant;
 	m_pData = nullptr;
 	m_nExtents = 0;
 	m_totalElements = 0;
 }
 
+MQVarPtr CDataArray::GetData(int index) const
+{
+	MQVarPtr data;
+
+	switch (m_storage)
+	{
+	case Storage::Int: data.Int = m_pInts[index]; break;
+	case Storage::Int64: data.Int64 = m_pInt64s[index]; break;
+	case Storage::Float: data.Float = m_pFloats[index]; break;
+	case Storage::Double: data.Double = m_pDoubles[index]; break;
+	case Storage::Bool: data.Set(m_pBools[index]); break;
+	default: data = m_pData[index]; break;
+	}
+
+	return data;
+}
+
+void CDataArray::SetData(int index, const MQVarPtr& data)
+{
+	switch (m_storage)
+	{
+	case Storage::Int: m_pInts[index] = data.Int; break;
+	case Storage::Int64: m_pInt64s[index] = data.Int64; break;
+	case Storage::Float: m_pFloats[index] = data.Float; break;
+	case Storage::Double: m_pDoubles[index] = data.Double; break;
+	case Storage::Bool: m_pBools[index] = data.Get<bool>(); break;
+	default: m_pData[index] = data; break;
+	}
+}
+
+bool CDataArray::FromString(int index, const char* Source)
+{
+	if (m_storage == Storage::Variant)
+		return m_pType->FromString(m_pData[index], Source);
+
+	MQVarPtr data = GetData(index);
+	if (!m_pType->FromString(data, Source))
+		return false;
+
+	SetData(index, data);
+	return true;
+}
+
+// Subscripts are almost always plain numbers by the time they get here, so those are read
+// directly and anything else goes through GetIntFromString.
+static int ReadArrayIndex(std::string_view token)
+{
+	int value = 0;
+	auto [ptr, ec] = std::from_chars(token.data(), token.data() + token.size(), value);
+	if (ec == std::errc() && ptr == token.data() + token.size())
+		return value;
+
+	return GetIntFromString(token, 0);
+}
+
 int CDataArray::GetElement(std::string_view Index) const
 {
-	if (m_nExtents == 1)
+	int location = 0;
+	int extent = 0;
+
+	while (true)
 	{
-		if (Index.find(',') != std::string_view::npos)
+		if (extent == m_nExtents)
 			return -1;
 
-		int location = GetIntFromString(Index, 0) - 1;
-		if (location >= m_totalElements)
+		const size_t comma = Index.find(',');
+		const int index = ReadArrayIndex(Index.substr(0, comma)) - 1;
+		if (index < 0 || index >= m_pExtents[extent])
 			return -1;
 
-		return location;
+		location = location * m_pExtents[extent] + index;
+		++extent;
+
+		if (comma == std::string_view::npos)
+			break;
+
+		Index.remove_prefix(comma + 1);
 	}
-	
-	int num_extents = static_cast<int>(std::count(Index.begin(), Index.end(), ',') + 1);
-	if (num_extents != m_nExtents)
-		return -1;
 
-	auto tokens = split_view(Index, ',');
-	int extent = 0;
-	return std::accumulate(tokens.begin(), tokens.end(), 0, [&extent, this](int location, std::string_view token) -> int
-		{
-			if (location < 0)
-				return -1;
+	return extent == m_nExtents ? location : -1;
+}
+
+int CDataArray::GetElement(const int* Indices, int Count) const
+{
+	if (Count != m_nExtents)
+		return -1;
 
-			int max_extent = m_pExtents[extent];
-			int next_location = GetIntFromString(token, 0) - 1;
-			if (next_location >= max_extent || next_location < 0)
-				return -1;
+	int location = 0;
+	for (int extent = 0; extent < m_nExtents; ++extent)
+	{
+		const int index = Indices[extent] - 1;
+		if (index < 0 || index >= m_pExtents[extent])
+			return -1;
 
-			for (int extent_marker = extent + 1; extent_marker < m_nExtents; ++extent_marker)
-				next_location *= m_pExtents[extent_marker];
+		location = location * m_pExtents[extent] + index;
+	}
 
-			++extent;
-			return location + next_location;
-		});
+	return location;
 }
 
 int CDataArray::GetElement(char* Index)
@@ -204,7 +314,7 @@ bool CDataArray::GetElement(std::string_view Index, MQTypeVar& Dest)
 	if (location >= 0)
 	{
 		Dest.Type = m_pType;
-		Dest.VarPtr = m_pData[location];
+		Dest.VarPtr = GetData(location);
 	}
 
 	return location >= 0;
@@ -43,18 +43,48 @@ public:
 	MQLIB_OBJECT bool GetElement(std::string_view Index, MQTypeVar& Dest);
 	MQLIB_OBJECT bool GetElement(char* Index, MQTypeVar& Dest);
 
+	// Same as GetElement, for indices that are already numbers. Indices are 1-based, as they are
+	// in a macro.
+	MQLIB_OBJECT int GetElement(const int* Indices, int Count) const;
+
 	MQ2Type* GetType() { return m_pType; }
-	MQVarPtr& GetData(int index) { return m_pData[index]; }
 	int GetExtents(int index) const { return m_pExtents[index]; }
 	int GetNumExtents() const { return m_nExtents; }
 	int GetTotalElements() const { return m_totalElements; }
 
+	// Elements of int, int64, float, double and bool arrays are packed, so they are returned by
+	// value. Changes to an element must be written back with SetData or FromString.
+	MQLIB_OBJECT MQVarPtr GetData(int index) const;
+	MQLIB_OBJECT void SetData(int index, const MQVarPtr& data);
+	MQLIB_OBJECT bool FromString(int index, const char* Source);
+
 	void Initialize(const char* defaultValue);
 	void Initialize(const MQTypeVar& defaultValue);
 
 private:
+	enum class Storage : uint8_t
+	{
+		Variant,
+		Int,
+		Int64,
+		Float,
+		Double,
+		Bool,
+	};
+
+	static Storage GetStorage(MQ2Type* Type);
+
 	MQ2Type* m_pType = nullptr;
-	MQVarPtr* m_pData = nullptr;
+	Storage m_storage = Storage::Variant;
+	union
+	{
+		MQVarPtr* m_pData = nullptr;
+		int32_t* m_pInts;
+		int64_t* m_pInt64s;
+		float* m_pFloats;
+		double* m_pDoubles;
+		bool* m_pBools;
+	};
 	int* m_pExtents = nullptr;
 	int m_nExtents = 0;
 	int m_totalElements = 0;
@@ -482,6 +512,8 @@ public:
 	MQLIB_OBJECT static EQ_Spell* GetSpell(const MQVarPtr& VarPtr);
 
 	static bool dataSpell(const char* szIndex, MQTypeVar& Ret);
+	static bool dataSpellWithSPA(const char* szIndex, MQTypeVar& Ret);
+	static bool dataSpellWithSPACount(const char* szIndex, MQTypeVar& Ret);
 };
 
 //============================================================================
@@ -65,6 +65,8 @@ MQ2GroupType::MQ2GroupType() : MQ2Type("group")
 	ScopedTypeMember(GroupMembers, Injured);
 	ScopedTypeMember(GroupMembers, LowMana);
 	ScopedTypeMember(GroupMembers, Cleric);
+
+	SetMemberPurity(MQDataPurity::PerFrame);
 }
 
 bool MQ2GroupType::ToString(MQVarPtr VarPtr, char* Destination)
@@ -112,29 +114,13 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		}
 
 		// by name
-		Dest.DWord = 0;
-		if (ci_equals(pLocalPlayer->Name, Index))
+		if (int index = GetGroupRosterIndexByName(Index); index >= 0)
 		{
-			Dest.DWord = 0;
+			Dest.DWord = index;
 			return true;
 		}
 
-		for (int i = 1; i < MAX_GROUP_SIZE; i++)
-		{
-			if (CGroupMember* pGroupMember = pLocalPC->Group->GetGroupMember(i))
-			{
-				Dest.DWord++;
-				char Name[MAX_STRING] = { 0 };
-				strcpy_s(Name, pGroupMember->GetName());
-
-				CleanupName(Name, sizeof(Name), false, false); // we do this to fix the mercenaryname bug
-
-				if (Index[0] != 0 && ci_equals(Name, Index))
-				{
-					return true;
-				}
-			}
-		}
+		Dest.DWord = GetGroupRosterCount();
 		return false;
 
 	case GroupMembers::Members:
@@ -154,15 +140,9 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 	}
 
 	case GroupMembers::GroupSize:
-		Dest.DWord = 0;
+		Dest.DWord = GetGroupRosterCount();
 		Dest.Type = pIntType;
 
-		for (int i = 1; i < MAX_GROUP_SIZE; i++)
-		{
-			if (pLocalPC->Group->GetGroupMember(i))
-				Dest.DWord++;
-		}
-
 		if (Dest.DWord)
 			Dest.DWord++;
 		return true;
@@ -171,9 +151,9 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.DWord = 0;
 		Dest.Type = pGroupMemberType;
 
-		if (CGroupMember* pGroupMember = pLocalPC->Group->GetGroupMemberByRole(GroupRoleTank))
+		if (int index = GetGroupRosterIndexByRole(GroupRoleTank); index >= 0)
 		{
-			Dest.DWord = pLocalPC->Group->GetGroupMemberVisualIndex(pGroupMember);
+			Dest.DWord = index;
 			return true;
 		}
 		return false;
@@ -182,9 +162,9 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.DWord = 0;
 		Dest.Type = pGroupMemberType;
 
-		if (CGroupMember* pGroupMember = pLocalPC->Group->GetGroupMemberByRole(GroupRoleAssist))
+		if (int index = GetGroupRosterIndexByRole(GroupRoleAssist); index >= 0)
 		{
-			Dest.DWord = pLocalPC->Group->GetGroupMemberVisualIndex(pGroupMember);
+			Dest.DWord = index;
 			return true;
 		}
 		return false;
@@ -193,9 +173,9 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.DWord = 0;
 		Dest.Type = pGroupMemberType;
 
-		if (CGroupMember* pGroupMember = pLocalPC->Group->GetGroupMemberByRole(GroupRolePuller))
+		if (int index = GetGroupRosterIndexByRole(GroupRolePuller); index >= 0)
 		{
-			Dest.DWord = pLocalPC->Group->GetGroupMemberVisualIndex(pGroupMember);
+			Dest.DWord = index;
 			return true;
 		}
 		return false;
@@ -204,9 +184,9 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.DWord = 0;
 		Dest.Type = pGroupMemberType;
 
-		if (CGroupMember* pGroupMember = pLocalPC->Group->GetGroupMemberByRole(GroupRoleMarkNPC))
+		if (int index = GetGroupRosterIndexByRole(GroupRoleMarkNPC); index >= 0)
 		{
-			Dest.DWord = pLocalPC->Group->GetGroupMemberVisualIndex(pGroupMember);
+			Dest.DWord = index;
 			return true;
 		}
 		return false;
@@ -215,9 +195,9 @@ bool MQ2GroupType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.DWord = 0;
 		Dest.Type = pGroupMemberType;
 
-		if (CGroupMember* pGroupMember = pLocalPC->Group->GetGroupMemberByRole(GroupRoleMasterLooter))
+		if (int index = GetGroupRosterIndexByRole(GroupRoleMasterLooter); index >= 0)
 		{
-			Dest.DWord = pLocalPC->Group->GetGroupMemberVisualIndex(pGroupMember);
+			Dest.DWord = index;
 			return true;
 		}
 		return false;
@@ -502,6 +482,8 @@ MQ2GroupMemberType::MQ2GroupMemberType() : MQ2Type("groupmember")
 	ScopedTypeMember(GroupMemberMembers, Offline);
 	ScopedTypeMember(GroupMemberMembers, OtherZone);
 	ScopedTypeMember(GroupMemberMembers, Present);
+
+	SetMemberPurity(MQDataPurity::PerFrame);
 }
 
 bool MQ2GroupMemberType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
@@ -522,25 +504,16 @@ bool MQ2GroupMemberType::GetMember(MQVarPtr VarPtr, const char* Member, char* In
 		if (index >= MAX_GROUP_SIZE)
 			return false;
 
-		for (int i = 1; i < MAX_GROUP_SIZE; i++)
+		if (CGroupMember* pMember = GetGroupRosterMember(index))
 		{
-			if (CGroupMember* pMember = pLocalPC->Group->GetGroupMember(i))
-			{
-				index--;
+			strcpy_s(MemberName, pMember->GetName());
 
-				if (index == 0)
-				{
-					strcpy_s(MemberName, pMember->GetName());
-
-					if (pMember->pSpawn)
-					{
-						pGroupMember = pMember->pSpawn;
-					}
-
-					pGroupMemberData = pMember;
-					break;
-				}
+			if (pMember->pSpawn)
+			{
+				pGroupMember = pMember->pSpawn;
 			}
+
+			pGroupMemberData = pMember;
 		}
 		if (MemberName[0] == '\0')
 			return false;
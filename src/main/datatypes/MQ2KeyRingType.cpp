@@ -105,6 +105,18 @@ static bool dataGetKeyRing(KeyRingType keyRingType, const char* szIndex, MQTypeV
 			const char* pName = szIndex;
 			bool exact = pName[0] == '=' && pName++;
 
+			if (exact)
+			{
+				int slot = FindKeyRingItemSlot(keyRingType, pName);
+				if (slot >= 0)
+				{
+					Ret = pKeyRingItemType->MakeTypeVar(keyRingType, slot);
+					return true;
+				}
+
+				return false;
+			}
+
 			ItemIndex index = pLocalPC->GetKeyRingItems(keyRingType).FindItem(0, FindItemByNamePred(pName, exact));
 			if (index.IsValid())
 			{
@@ -186,22 +198,10 @@ bool MQ2KeyRingItemType::GetMember(MQVarPtr VarPtr, const char* Member, char* In
 		// to the UI index.
 		Dest.Type = pIntType;
 
-		if (pKeyRingWnd)
+		if (int listIndex = GetKeyRingListIndex(type, n); listIndex >= 0)
 		{
-			RefreshKeyRingWindow();
-
-			if (CListWnd* pListWnd = pKeyRingWnd->GetKeyRingList(type))
-			{
-				for (int i = 0; i < pListWnd->ItemsArray.GetCount(); ++i)
-				{
-					int slotNum = (int)pListWnd->GetItemData(i);
-					if (slotNum == n)
-					{
-						Dest.DWord = i + 1;
-						return true;
-					}
-				}
-			}
+			Dest.DWord = listIndex + 1;
+			return true;
 		}
 		return false;
 
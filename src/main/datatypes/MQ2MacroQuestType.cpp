@@ -15,6 +15,8 @@
 #include "pch.h"
 #include "MQ2DataTypes.h"
 
+#include "MQMemoryAccounting.h"
+
 namespace mq::datatypes {
 
 enum class MacroQuestMembers
@@ -29,7 +31,10 @@ enum class MacroQuestMembers
 	Version,
 	InternalName,
 	Parser,
-	Anonymize
+	Anonymize,
+	Memory,
+	MemoryPeak,
+	MemoryRate,
 };
 
 MQ2MacroQuestType::MQ2MacroQuestType() : MQ2Type("macroquest")
@@ -45,6 +50,9 @@ MQ2MacroQuestType::MQ2MacroQuestType() : MQ2Type("macroquest")
 	ScopedTypeMember(MacroQuestMembers, InternalName);
 	ScopedTypeMember(MacroQuestMembers, Parser);
 	ScopedTypeMember(MacroQuestMembers, Anonymize);
+	ScopedTypeMember(MacroQuestMembers, Memory);
+	ScopedTypeMember(MacroQuestMembers, MemoryPeak);
+	ScopedTypeMember(MacroQuestMembers, MemoryRate);
 }
 
 bool MQ2MacroQuestType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
@@ -266,6 +274,25 @@ bool MQ2MacroQuestType::GetMember(MQVarPtr VarPtr, const char* Member, char* Ind
 		Dest.Type = pBoolType;
 		return true;
 
+	// Bytes accounted under a name in the memory accounting, for example ${MacroQuest.Memory[Lua]}
+	case MacroQuestMembers::Memory:
+	case MacroQuestMembers::MemoryPeak:
+	case MacroQuestMembers::MemoryRate: {
+		MQMemoryStats stats;
+		if (!Index[0] || !MemoryAccounting_GetStats(Index, stats))
+			return false;
+
+		switch (static_cast<MacroQuestMembers>(pMember->ID))
+		{
+		case MacroQuestMembers::Memory: Dest.Int64 = stats.Current; break;
+		case MacroQuestMembers::MemoryPeak: Dest.Int64 = stats.Peak; break;
+		default: Dest.Int64 = static_cast<int64_t>(stats.AllocationRate); break;
+		}
+
+		Dest.Type = pInt64Type;
+		return true;
+	}
+
 	default:
 		return false;
 	}
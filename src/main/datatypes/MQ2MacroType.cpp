@@ -82,7 +82,7 @@ bool MQ2MacroType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 
 				for (auto& [name, index] : gUndeclaredVars)
 				{
-					const MQMacroLine& ml = gMacroBlock->Line.at(index);
+					const MQMacroLine& ml = gMacroBlock->GetLine(index);
 
 					WriteChatf("[%d] %s see: %d@%s: %s", count++, name.c_str(),
 						ml.LineNumber, ml.SourceFile.c_str(), ml.Command.c_str());
@@ -186,7 +186,7 @@ bool MQ2MacroType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.Type = pIntType;
 		if (gMacroBlock)
 		{
-			Dest.DWord = gMacroBlock->Line.at(gMacroBlock->CurrIndex).LineNumber;
+			Dest.DWord = gMacroBlock->GetLine(gMacroBlock->CurrIndex).LineNumber;
 			return true;
 		}
 		break;
@@ -205,7 +205,7 @@ bool MQ2MacroType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, M
 		Dest.Type = pStringType;
 		if (gMacroBlock)
 		{
-			auto& line = gMacroBlock->Line.at(gMacroStack->LocationIndex);
+			auto& line = gMacroBlock->GetLine(gMacroStack->LocationIndex);
 
 			sprintf_s(DataTypeTemp, "%d@%s -> %s", line.LineNumber, line.SourceFile.c_str(), line.Command.c_str());
 			std::replace(std::begin(DataTypeTemp), std::begin(DataTypeTemp) + strlen(DataTypeTemp), '$', '#');
@@ -14,6 +14,7 @@
 
 #include "pch.h"
 #include "MQ2DataTypes.h"
+#include <numeric>
 #include <string_view>
 
 namespace mq::datatypes {
@@ -34,7 +35,13 @@ enum class MathMembers
 	Not,
 	Distance,
 	Sqrt,
-	Clamp
+	Clamp,
+	CalcExact,
+	Distances,
+	Sum,
+	Avg,
+	Min,
+	Max,
 };
 
 MQ2MathType::MQ2MathType() : MQ2Type("math")
@@ -54,6 +61,24 @@ MQ2MathType::MQ2MathType() : MQ2Type("math")
 	ScopedTypeMember(MathMembers, Distance);
 	ScopedTypeMember(MathMembers, Sqrt);
 	ScopedTypeMember(MathMembers, Clamp);
+	ScopedTypeMember(MathMembers, CalcExact);
+	ScopedTypeMember(MathMembers, Distances);
+	ScopedTypeMember(MathMembers, Sum);
+	ScopedTypeMember(MathMembers, Avg);
+	ScopedTypeMember(MathMembers, Min);
+	ScopedTypeMember(MathMembers, Max);
+}
+
+// Reads a list of numbers separated by commas or spaces, for the members that work on lists.
+static bool ReadMathList(const char* szList, std::vector<double>& values)
+{
+	auto cleaned_list = replace(szList, ",", " ");
+	for (std::string_view value : split_view(cleaned_list, ' ', true))
+	{
+		values.push_back(GetDoubleFromString(value, 0.0));
+	}
+
+	return !values.empty();
 }
 
 bool MQ2MathType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
@@ -129,6 +154,26 @@ bool MQ2MathType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQ
 		}
 		return false;
 
+	case MathMembers::CalcExact:
+	{
+		// int64 while the result is an exact integer, double otherwise
+		MQCalcValue Result;
+		if (!CalculateExact(Index, Result))
+			return false;
+
+		if (Result.IsInteger)
+		{
+			Dest.Int64 = Result.Integer;
+			Dest.Type = pInt64Type;
+		}
+		else
+		{
+			Dest.Double = Result.Double;
+			Dest.Type = pDoubleType;
+		}
+		return true;
+	}
+
 	case MathMembers::Sin:
 		Dest.Float = 0.0;
 		Dest.Type = pFloatType;
@@ -264,6 +309,99 @@ bool MQ2MathType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQ
 		}
 		return false;
 	}
+	case MathMembers::Distances:
+	{
+		// Distances from the first point to each of the ones after it, as a comma separated list.
+		// Points are given the same way as for Distance.
+		DataTypeTemp[0] = 0;
+		Dest.Ptr = &DataTypeTemp[0];
+		Dest.Type = pStringType;
+
+		if (!pControlledPlayer)
+			return false;
+
+		auto cleaned_index = replace(Index, ",", " ");
+		auto p_list = split_view(cleaned_index, ':', true);
+		if (p_list.size() < 2)
+			return false;
+
+		const size_t count = p_list.size();
+		std::vector<float> P(count * 3);                                // [Dimension][Loc]
+		float* Y = &P[0];
+		float* X = &P[count];
+		float* Z = &P[count * 2];
+
+		for (size_t i = 0; i < count; i++)
+		{
+			float point[3] = { pControlledPlayer->Y, pControlledPlayer->X, pControlledPlayer->Z };
+
+			auto pointList = split_view(p_list[i], ' ', true);
+			for (size_t j = 0; j < pointList.size() && j < 3; j++)
+			{
+				point[j] = GetFloatFromString(pointList[j], point[j]);
+			}
+
+			Y[i] = point[0];
+			X[i] = point[1];
+			Z[i] = point[2];
+		}
+
+		// Kept as a plain loop over the separate coordinate arrays so that it can be vectorized.
+		std::vector<float> distances(count - 1);
+		for (size_t i = 1; i < count; i++)
+		{
+			const float dY = Y[i] - Y[0];
+			const float dX = X[i] - X[0];
+			const float dZ = Z[i] - Z[0];
+			distances[i - 1] = sqrtf(dY * dY + dX * dX + dZ * dZ);
+		}
+
+		// Distances that don't fit in the buffer are left off the end.
+		size_t length = 0;
+		for (float distance : distances)
+		{
+			char szDistance[32];
+			const int written = sprintf_s(szDistance, "%s%.2f", length ? "," : "", distance);
+			if (written < 0 || length + written >= DataTypeTemp.size())
+				break;
+
+			memcpy(&DataTypeTemp[length], szDistance, written + 1);
+			length += written;
+		}
+		return true;
+	}
+
+	case MathMembers::Sum:
+	case MathMembers::Avg:
+	case MathMembers::Min:
+	case MathMembers::Max:
+	{
+		Dest.Double = 0.0;
+		Dest.Type = pDoubleType;
+
+		std::vector<double> values;
+		if (!ReadMathList(Index, values))
+			return false;
+
+		switch (static_cast<MathMembers>(pMember->ID))
+		{
+		case MathMembers::Sum:
+			Dest.Double = std::accumulate(values.begin(), values.end(), 0.0);
+			break;
+		case MathMembers::Avg:
+			Dest.Double = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+			break;
+		case MathMembers::Min:
+			Dest.Double = *std::min_element(values.begin(), values.end());
+			break;
+		case MathMembers::Max:
+			Dest.Double = *std::max_element(values.begin(), values.end());
+			break;
+		default: break;
+		}
+		return true;
+	}
+
 	default: break;
 	}
 
@@ -14,6 +14,7 @@
 
 #include "pch.h"
 #include "MQ2DataTypes.h"
+#include "MQPetMercState.h"
 
 namespace mq::datatypes {
 
@@ -27,28 +28,6 @@ enum class MercenaryMembers
 	Name,
 };
 
-static const char* GetMercenaryStateString()
-{
-	if (!pMercManager->HasMercenary())
-	{
-		if (pMercManager->currMercenaryIndex != -1)
-			return "SUSPENDED";
-
-		return "NONE";
-	}
-
-	switch (pMercManager->GetMercenaryState())
-	{
-	case MercenaryState_Dead:
-		return "DEAD";
-	case MercenaryState_Active:
-		return "ACTIVE";
-
-	default:
-		return "SUSPENDED";
-	}
-}
-
 MQ2MercenaryType::MQ2MercenaryType() : MQ2Type("mercenary")
 {
 	ScopedTypeMember(MercenaryMembers, AAPoints);
@@ -65,11 +44,9 @@ bool MQ2MercenaryType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 	if (!pMercManager)
 		return false;
 
-	SPAWNINFO* pMercenary = nullptr;
-	if (pMercManager->mercenarySpawnId)
-	{
-		pMercenary = GetSpawnByID(pMercManager->mercenarySpawnId);
-	}
+	// The state, stance and spawn of the mercenary come from the snapshot of this pulse.
+	const MercenarySnapshot& mercenary = GetMercenarySnapshot();
+	SPAWNINFO* pMercenary = mercenary.spawn;
 
 	MQTypeMember* pMember = MQ2MercenaryType::FindMember(Member);
 	if (!pMember)
@@ -91,38 +68,30 @@ bool MQ2MercenaryType::GetMember(MQVarPtr VarPtr, const char* Member, char* Inde
 		return true;
 
 	case MercenaryMembers::Stance:
-		if (const MercenaryStanceInfo* pStance = pMercManager->GetActiveMercenaryStance())
-		{
-			strcpy_s(DataTypeTemp, pCDBStr->GetString(pStance->stanceStringId, eMercenaryStanceName));
-		}
-		else
-		{
-			strcpy_s(DataTypeTemp, "NULL");
-		}
-
+		strcpy_s(DataTypeTemp, mercenary.stanceName.c_str());
 		Dest.Ptr = &DataTypeTemp[0];
 		Dest.Type = pStringType;
 		return true;
 
 	case MercenaryMembers::State:
-		strcpy_s(DataTypeTemp, GetMercenaryStateString());
+		strcpy_s(DataTypeTemp, mercenary.stateName);
 		Dest.Ptr = &DataTypeTemp[0];
 		Dest.Type = pStringType;
 		return true;
 
 	case MercenaryMembers::StateID:
-		Dest.DWord = static_cast<int>(pMercManager->GetMercenaryState());
+		Dest.DWord = mercenary.stateID;
 		Dest.Type = pIntType;
 		return true;
 
 	case MercenaryMembers::Index:
-		Dest.DWord = pMercManager->currMercenaryIndex + 1;
+		Dest.DWord = mercenary.index + 1;
 		Dest.Type = pIntType;
 		return true;
 
 	case MercenaryMembers::Name:
 		if (!pMercenary)
-			strcpy_s(DataTypeTemp, GetMercenaryStateString());
+			strcpy_s(DataTypeTemp, mercenary.stateName);
 		else
 			strcpy_s(DataTypeTemp, pMercenary->Name);
 		Dest.Type = pStringType;
@@ -140,7 +109,7 @@ bool MQ2MercenaryType::ToString(MQVarPtr VarPtr, char* Destination)
 	if (!pMercManager)
 		return false;
 
-	strcpy_s(Destination, MAX_STRING, GetMercenaryStateString());
+	strcpy_s(Destination, MAX_STRING, GetMercenarySnapshot().stateName);
 	return true;
 }
 
@@ -148,8 +117,7 @@ bool MQ2MercenaryType::Downcast(const MQVarPtr& fromVar, MQVarPtr& toVar, MQ2Typ
 {
 	if (toType == pSpawnType)
 	{
-		SPAWNINFO* pMercenary = pMercManager->mercenarySpawnId ? GetSpawnByID(pMercManager->mercenarySpawnId) : nullptr;
-		toVar = pSpawnType->MakeVarPtr(pMercenary);
+		toVar = pSpawnType->MakeVarPtr(GetMercenarySnapshot().spawn);
 		return true;
 	}
 
@@ -70,25 +70,17 @@ bool MQ2MerchantType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index
 		case MerchantMethods::SelectItem: {
 			if (pMerchantWnd->IsVisible())
 			{
-				bool bFound = false;
 				int listIndex = 0;
 				ItemPtr pItem;
 
 				auto& page = pMerchantWnd->PageHandlers[RegularMerchantPage];
 
-				for (int i = 0; i < page->GetItemCount(); i++)
+				const bool exact = Index[0] == '=';
+				int found = GetMerchantItemIndexByName(exact ? Index + 1 : Index, exact);
+				if (found != -1)
 				{
-					ItemPtr pItemItr = page->GetItem(i);
-
-					if (pItemItr)
-					{
-						if (MaybeExactCompare(pItemItr->GetName(), Index))
-						{
-							listIndex = i;
-							pItem = pItemItr;
-							break;
-						}
-					}
+					listIndex = found;
+					pItem = page->GetItem(found);
 				}
 
 				if (pItem)
@@ -221,15 +213,12 @@ bool MQ2MerchantType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index
 			}
 
 			// by name
-			for (int i = 0; i < page->GetItemCount(); ++i)
+			const bool exact = Index[0] == '=';
+			int found = GetMerchantItemIndexByName(exact ? Index + 1 : Index, exact);
+			if (found != -1)
 			{
-				ItemPtr pItem = page->GetItem(i);
-
-				if (pItem && MaybeExactCompare(pItem->GetName(), Index))
-				{
-					Dest = pItemType->MakeTypeVar(pItem);
-					return true;
-				}
+				Dest = pItemType->MakeTypeVar(page->GetItem(found));
+				return true;
 			}
 		}
 
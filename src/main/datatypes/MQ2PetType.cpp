@@ -14,9 +14,17 @@
 
 #include "pch.h"
 #include "MQ2DataTypes.h"
+#include "MQPetMercState.h"
 
 namespace mq::datatypes {
 
+// The pet window timers of the snapshot, counted down to now.
+static uint64_t GetRemainingTimer(const PetSnapshot& pet, const PetBuffState& buff)
+{
+	const uint64_t elapsed = GetTickCount64() - pet.timestamp;
+	return buff.timer > elapsed ? buff.timer - elapsed : 0;
+}
+
 enum class PetBuffMembers
 {
 	Caster = 1,
@@ -61,14 +69,20 @@ bool MQ2PetBuffType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 		return false;
 
 	case PetBuffMembers::Duration:
-		if (auto buffInfo = pPetInfoWnd->GetBuffInfoBySpellID(pSpell->ID))
+	{
+		const PetSnapshot& pet = GetPetSnapshot();
+		for (const PetBuffState& buff : pet.buffs)
 		{
-			Dest.UInt64 = buffInfo.GetBuffTimer();
-			Dest.Type = pTimeStampType;
-			return true;
+			if (buff.spellID == pSpell->ID)
+			{
+				Dest.UInt64 = GetRemainingTimer(pet, buff);
+				Dest.Type = pTimeStampType;
+				return true;
+			}
 		}
 
 		return false;
+	}
 
 	default: break;
 	}
@@ -162,6 +176,9 @@ bool MQ2PetType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQT
 	if (!pPetInfoWnd)
 		return false;
 
+	// The buffs come from the snapshot of the pet window, which only holds the slots that are in use.
+	const PetSnapshot& pet = GetPetSnapshot();
+
 	switch (static_cast<PetMembers>(pMember->ID))
 	{
 	case PetMembers::Buff:
@@ -172,13 +189,14 @@ bool MQ2PetType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQT
 		if (IsNumber(Index))
 		{
 			int nBuff = GetIntFromString(Index, 0) - 1;
-			if (nBuff < 0 || nBuff >= pPetInfoWnd->GetMaxBuffs())
+			if (nBuff < 0 || nBuff >= pet.maxBuffs)
 				return false;
 
-			if (pPetInfoWnd->GetBuff(nBuff) == -1 || pPetInfoWnd->GetBuff(nBuff) == 0)
+			const PetBuffState* buff = GetPetBuffState(nBuff);
+			if (!buff)
 				return false;
 
-			if (Dest.Ptr = GetSpellByID(pPetInfoWnd->GetBuff(nBuff)))
+			if (Dest.Ptr = GetSpellByID(buff->spellID))
 			{
 				Dest.Type = pPetBuffType;
 				return true;
@@ -186,13 +204,13 @@ bool MQ2PetType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQT
 		}
 		else
 		{
-			for (int nBuff = 0; nBuff < pPetInfoWnd->GetMaxBuffs(); nBuff++)
+			for (const PetBuffState& buff : pet.buffs)
 			{
-				if (SPELL* pSpell = GetSpellByID(pPetInfoWnd->GetBuff(nBuff)))
+				if (SPELL* pSpell = GetSpellByID(buff.spellID))
 				{
 					if (!_strnicmp(Index, pSpell->Name, strlen(Index)))
 					{
-						Dest.DWord = nBuff + 1;
+						Dest.DWord = buff.slot + 1;
 						Dest.Type = pIntType;
 						return true;
 					}
@@ -210,23 +228,24 @@ bool MQ2PetType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQT
 		if (IsNumber(Index))
 		{
 			int nBuff = GetIntFromString(Index, 0) - 1;
-			if (nBuff < 0 || nBuff >= pPetInfoWnd->GetMaxBuffs())
+			if (nBuff < 0 || nBuff >= pet.maxBuffs)
 				return false;
 
-			if (pPetInfoWnd->GetBuff(nBuff) == -1 || pPetInfoWnd->GetBuff(nBuff) == 0)
+			const PetBuffState* buff = GetPetBuffState(nBuff);
+			if (!buff)
 				return false;
 
-			Dest.UInt64 = pPetInfoWnd->GetBuffTimer(nBuff);
+			Dest.UInt64 = GetRemainingTimer(pet, *buff);
 			return true;
 		}
 
-		for (int nBuff = 0; nBuff < pPetInfoWnd->GetMaxBuffs(); nBuff++)
+		for (const PetBuffState& buff : pet.buffs)
 		{
-			if (SPELL* pSpell = GetSpellByID(pPetInfoWnd->GetBuff(nBuff)))
+			if (SPELL* pSpell = GetSpellByID(buff.spellID))
 			{
 				if (!_strnicmp(Index, pSpell->Name, strlen(Index)))
 				{
-					Dest.UInt64 = pPetInfoWnd->GetBuffTimer(nBuff);
+					Dest.UInt64 = GetRemainingTimer(pet, buff);
 					return true;
 				}
 			}
@@ -357,9 +376,8 @@ bool MQ2PetType::Downcast(const MQVarPtr& fromVar, MQVarPtr& toVar, MQ2Type* toT
 
 bool MQ2PetType::dataPet(const char* szIndex, MQTypeVar& Ret)
 {
-	SPAWNINFO* pPetSpawn = (pLocalPlayer && pLocalPlayer->PetID != -1) ? GetSpawnByID(pLocalPlayer->PetID) : nullptr;
-
-	Ret = pSpawnType->MakeTypeVar(pPetSpawn, pPetType);
+	// The snapshot already looked up the spawn of the pet.
+	Ret = pSpawnType->MakeTypeVar(GetPetSnapshot().spawn, pPetType);
 	return true;
 }
 
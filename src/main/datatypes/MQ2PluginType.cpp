@@ -15,6 +15,8 @@
 #include "pch.h"
 #include "MQ2DataTypes.h"
 
+#include "MQPluginHandler.h"
+
 namespace mq::datatypes {
 
 enum class PluginMembers
@@ -22,6 +24,9 @@ enum class PluginMembers
 	Name = 1,
 	Version,
 	IsLoaded,
+	PulseTime,
+	PulseMaxTime,
+	PulseThrottled,
 };
 
 MQ2PluginType::MQ2PluginType() : MQ2Type("plugin")
@@ -29,6 +34,9 @@ MQ2PluginType::MQ2PluginType() : MQ2Type("plugin")
 	ScopedTypeMember(PluginMembers, Name);
 	ScopedTypeMember(PluginMembers, Version);
 	ScopedTypeMember(PluginMembers, IsLoaded);
+	ScopedTypeMember(PluginMembers, PulseTime);
+	ScopedTypeMember(PluginMembers, PulseMaxTime);
+	ScopedTypeMember(PluginMembers, PulseThrottled);
 }
 
 bool MQ2PluginType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
@@ -58,6 +66,34 @@ bool MQ2PluginType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 		Dest.Set(pPlugin != nullptr);
 		return true;
 
+	case PluginMembers::PulseTime:
+		// Average of the recent calls to OnPulse, in milliseconds
+		if (const PluginTimings* timings = GetPluginTimings(pPlugin))
+		{
+			Dest.Type = pFloatType;
+			Dest.Set(timings->Get(PluginCallback::Pulse).GetAverage().count() / 1000000.0f);
+			return true;
+		}
+		return false;
+
+	case PluginMembers::PulseMaxTime:
+		if (const PluginTimings* timings = GetPluginTimings(pPlugin))
+		{
+			Dest.Type = pFloatType;
+			Dest.Set(timings->Get(PluginCallback::Pulse).max.count() / 1000000.0f);
+			return true;
+		}
+		return false;
+
+	case PluginMembers::PulseThrottled:
+		if (const PluginTimings* timings = GetPluginTimings(pPlugin))
+		{
+			Dest.Type = pBoolType;
+			Dest.Set(timings->throttleFrames > 1);
+			return true;
+		}
+		return false;
+
 	default: break;
 	}
 
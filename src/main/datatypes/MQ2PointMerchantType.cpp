@@ -61,15 +61,11 @@ bool MQ2PointMerchantType::GetMember(MQVarPtr VarPtr, const char* Member, char*
 			else
 			{
 				// by name
-				for (int i = 0; i < page->GetItemCount(); i++)
+				int found = GetMerchantItemIndexByName(Index, true);
+				if (found != -1)
 				{
-					ItemPtr pItem = page->GetItem(i);
-
-					if (pItem && !_stricmp(pItem->GetName(), Index))
-					{
-						Dest.Int = i;
-						return true;
-					}
+					Dest.Int = found;
+					return true;
 				}
 			}
 		}
@@ -91,29 +91,19 @@ bool MQ2RaidType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQ
 				if (!Count || Count > pRaid->RaidMemberCount)
 					return false;
 
-				for (int nMember = 0; nMember < MAX_RAID_SIZE; nMember++)
+				if (int slot = GetRaidRosterSlotByOrdinal(Count); slot >= 0)
 				{
-					if (pRaid->locations[nMember])
-					{
-						Count--;
-						if (!Count)
-						{
-							Dest.DWord = nMember + 1;
-							return true;
-						}
-					}
+					Dest.DWord = slot + 1;
+					return true;
 				}
 			}
 			else
 			{
 				// by name
-				for (int nMember = 0; nMember < MAX_RAID_SIZE; nMember++)
+				if (int slot = GetRaidRosterSlotByName(Index); slot >= 0)
 				{
-					if (pRaid->locations[nMember] && ci_equals(pRaid->raidMembers[nMember].Name, Index))
-					{
-						Dest.DWord = nMember + 1;
-						return true;
-					}
+					Dest.DWord = slot + 1;
+					return true;
 				}
 			}
 		}
@@ -132,13 +122,10 @@ bool MQ2RaidType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQ
 	case RaidMembers::Leader:
 		Dest.DWord = 0;
 		Dest.Type = pRaidMemberType;
-		for (int nMember = 0; nMember < MAX_RAID_SIZE; nMember++)
+		if (int slot = GetRaidRosterSlotByName(pRaid->RaidLeaderName); slot >= 0)
 		{
-			if (pRaid->locations[nMember] && ci_equals(pRaid->raidMembers[nMember].Name, pRaid->RaidLeaderName))
-			{
-				Dest.DWord = nMember + 1;
-				return true;
-			}
+			Dest.DWord = slot + 1;
+			return true;
 		}
 		return false;
 
@@ -317,6 +317,8 @@ MQ2SpawnType::MQ2SpawnType() : MQ2Type("spawn")
 	ScopedTypeMember(SpawnMembers, MyBuffCount);
 	ScopedTypeMember(SpawnMembers, MyBuffDuration);
 
+	SetMemberPurity(MQDataPurity::PerFrame);
+
 	ScopedTypeMethod(SpawnMethods, DoTarget);
 	ScopedTypeMethod(SpawnMethods, DoFace);
 	ScopedTypeMethod(SpawnMethods, DoAssist);
@@ -1469,12 +1471,7 @@ bool MQ2SpawnType::GetMember(SPAWNINFO* pSpawn, const char* Member, char* Index,
 		Dest.Type = pCachedBuffType;
 		Dest.Ptr = pSpawn;
 
-		auto attrib = EvaluateCachedBuffPredicate(Index);
-		Dest.HighPart = GetCachedBuff(pSpawn,
-			[&attrib](const CachedBuff& buff)
-			{
-				return attrib(buff);
-			});
+		Dest.HighPart = GetCachedBuffByQuery(pSpawn, Index);
 
 		return true;
 	}
@@ -1643,8 +1640,14 @@ bool MQ2SpawnType::dataSpawn(const char* szIndex, MQTypeVar& Ret)
 		ClearSearchSpawn(&ssSpawn);
 		ParseSearchSpawn(szIndex, &ssSpawn);
 
-		SPAWNINFO* pSearchSpawn = SearchThroughSpawns(&ssSpawn, pControlledPlayer);
-		Ret = pSpawnType->MakeTypeVar(pSearchSpawn);
+		MQSpawnSearchResult result;
+		if (!FindCachedSpawnSearch(SpawnSearchQuery::Search, ssSpawn, pControlledPlayer, 0, result))
+		{
+			result.pSpawn = SearchThroughSpawns(&ssSpawn, pControlledPlayer);
+			CacheSpawnSearch(SpawnSearchQuery::Search, ssSpawn, pControlledPlayer, 0, result);
+		}
+
+		Ret = pSpawnType->MakeTypeVar(result.pSpawn);
 		return true;
 	}
 
@@ -1660,7 +1663,15 @@ bool MQ2SpawnType::dataSpawnCount(const char* szIndex, MQTypeVar& Ret)
 		MQSpawnSearch ssSpawn;
 		ClearSearchSpawn(&ssSpawn);
 		ParseSearchSpawn(szIndex, &ssSpawn);
-		Ret.DWord = CountMatchingSpawns(&ssSpawn, pLocalPlayer, true);
+
+		MQSpawnSearchResult result;
+		if (!FindCachedSpawnSearch(SpawnSearchQuery::Count, ssSpawn, pLocalPlayer, 0, result))
+		{
+			result.Count = CountMatchingSpawns(&ssSpawn, pLocalPlayer, true);
+			CacheSpawnSearch(SpawnSearchQuery::Count, ssSpawn, pLocalPlayer, 0, result);
+		}
+
+		Ret.DWord = result.Count;
 		Ret.Type = pIntType;
 		return true;
 	}
@@ -1754,6 +1765,17 @@ bool MQ2SpawnType::dataNearestSpawn(const char* szIndex, MQTypeVar& Ret)
 			}
 		}
 
+		MQSpawnSearchResult result;
+		if (FindCachedSpawnSearch(SpawnSearchQuery::Nearest, ssSpawn, pControlledPlayer, nth, result))
+		{
+			if (!result.pSpawn)
+				return false;
+
+			Ret = pSpawnType->MakeTypeVar(result.pSpawn);
+			return true;
+		}
+
+		const int searchNth = nth;
 		float FRadiusSq = 0.0f;
 		bool checkDistance = ssSpawn.FRadius != MAX_SEARCH_RADIUS;
 		if (checkDistance)
@@ -1761,23 +1783,36 @@ bool MQ2SpawnType::dataNearestSpawn(const char* szIndex, MQTypeVar& Ret)
 			FRadiusSq = static_cast<float>(ssSpawn.FRadius * ssSpawn.FRadius);
 		}
 
-		for (const MQSpawnArrayItem& spawnItem : gSpawnsArray)
+		MQSpawnSearchPredicate predicate(ssSpawn);
+
+		for (size_t i = 0; i < gSpawnsArray.size(); ++i)
 		{
+			EnsureSpawnsArraySorted(i + 1);
+			const MQSpawnArrayItem& spawnItem = gSpawnsArray[i];
+
 			if (checkDistance && spawnItem.GetDistanceSquared() > FRadiusSq)
 			{
 				if (!ssSpawn.bKnownLocation)
-					return false;
+					break;
 			}
 
-			if (SpawnMatchesSearch(&ssSpawn, pControlledPlayer, spawnItem.GetSpawn()))
+			if (predicate.Matches(pControlledPlayer, spawnItem.GetSpawn()))
 			{
 				if (--nth == 0)
 				{
-					Ret = pSpawnType->MakeTypeVar(spawnItem.GetSpawn());
-					return true;
+					result.pSpawn = spawnItem.GetSpawn();
+					break;
 				}
 			}
 		}
+
+		CacheSpawnSearch(SpawnSearchQuery::Nearest, ssSpawn, pControlledPlayer, searchNth, result);
+
+		if (result.pSpawn)
+		{
+			Ret = pSpawnType->MakeTypeVar(result.pSpawn);
+			return true;
+		}
 	}
 
 	// No spawn
@@ -206,6 +206,10 @@ MQ2SpellType::MQ2SpellType() : MQ2Type("spell")
 	AddMember(static_cast<int>(SpellMembers::BaseEffectsFocusCap), "SongCap");
 	ScopedTypeMember(SpellMembers, MinCasterLevel);
 
+	// Spell data doesn't change, but many other members depend on the character.
+	SetMemberPurity("ID", MQDataPurity::Constant);
+	SetMemberPurity("Name", MQDataPurity::Constant);
+
 	ScopedTypeMethod(SpellMethods, Inspect);
 }
 
@@ -1410,6 +1414,64 @@ bool MQ2SpellType::dataSpell(const char* szIndex, MQTypeVar& Ret)
 	return true;
 }
 
+// Index of the SpellWithSPA TLOs: <spa>[,<n>][,mine]. The SPA is a number or a name, and mine
+// only counts the spells your class can use at your current level.
+static std::shared_ptr<const std::vector<int>> FindSpellsWithSPAIndex(const char* szIndex, int& n)
+{
+	std::vector<std::string_view> args = split_view(szIndex, ',');
+	if (args.empty())
+		return nullptr;
+
+	const std::string_view spaArg = trim(args[0]);
+	int spa = GetIntFromString(spaArg, -1);
+	if (spa < 0)
+		spa = GetSPAFromName(std::string(spaArg).c_str());
+
+	int classID = 0;
+	int maxLevel = 0;
+
+	for (size_t i = 1; i < args.size(); ++i)
+	{
+		const std::string_view arg = trim(args[i]);
+
+		if (ci_equals(arg, "mine"))
+		{
+			if (!pLocalPlayer)
+				return nullptr;
+
+			classID = pLocalPlayer->GetClass();
+			maxLevel = pLocalPlayer->Level;
+		}
+		else
+		{
+			n = GetIntFromString(arg, n);
+		}
+	}
+
+	return FindSpellsWithSPA(spa, classID, maxLevel);
+}
+
+bool MQ2SpellType::dataSpellWithSPA(const char* szIndex, MQTypeVar& Ret)
+{
+	int n = 1;
+	const std::shared_ptr<const std::vector<int>> spellIDs = FindSpellsWithSPAIndex(szIndex, n);
+	if (!spellIDs || n < 1 || n > static_cast<int>(spellIDs->size()))
+		return false;
+
+	Ret.Ptr = GetSpellByID((*spellIDs)[n - 1]);
+	Ret.Type = pSpellType;
+	return Ret.Ptr != nullptr;
+}
+
+bool MQ2SpellType::dataSpellWithSPACount(const char* szIndex, MQTypeVar& Ret)
+{
+	int n = 0;
+	const std::shared_ptr<const std::vector<int>> spellIDs = FindSpellsWithSPAIndex(szIndex, n);
+	Ret.Int = spellIDs ? static_cast<int>(spellIDs->size()) : 0;
+	Ret.Type = pIntType;
+	return true;
+}
+
 EQ_Spell* MQ2SpellType::GetSpell(const MQVarPtr& VarPtr)
 {
 	if (!VarPtr.IsType(MQVarPtr::VariantIdx::Ptr))
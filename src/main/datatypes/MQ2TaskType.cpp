@@ -14,6 +14,7 @@
 
 #include "pch.h"
 #include "MQ2DataTypes.h"
+#include "MQTasks.h"
 
 namespace mq::datatypes {
 
@@ -40,32 +41,7 @@ enum class TaskTypeMethods
 
 int FindTaskIndex(CTaskEntry* task)
 {
-	if (!task || !pTaskManager)
-		return -1;
-
-	switch (task->TaskSystem)
-	{
-	case TaskSystemType::cTaskSystemTypeSharedQuest:
-		for (int i = 0; i < MAX_SHARED_TASK_ENTRIES; ++i)
-		{
-			if (&pTaskManager->SharedTaskEntries[i] == task)
-				return i;
-		}
-		break;
-
-	case TaskSystemType::cTaskSystemTypeSoloQuest:
-		for (int i = 0; i < MAX_QUEST_ENTRIES; ++i)
-		{
-			if (&pTaskManager->QuestEntries[i] == task)
-				return i;
-		}
-		break;
-
-	default:
-		break;
-	}
-
-	return -1;
+	return FindTaskEntryIndex(task);
 }
 
 MQ2TaskType::MQ2TaskType() : MQ2Type("task")
@@ -298,18 +274,8 @@ bool MQ2TaskType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQ
 			return true;
 		}
 
-		char szOut[MAX_STRING] = { 0 };
-		for (auto& Element : pTask->Elements)
-		{
-			pTaskManager->GetElementDescription(&Element, szOut);
-			if (MaybeExactCompare(szOut, Index))
-			{
-				Dest.Ptr = &Element;
-				return true;
-			}
-		}
-
-		return false;
+		Dest.Ptr = FindTaskObjectiveByDescription(pTask, Index);
+		return Dest.Ptr != nullptr;
 	}
 
 	case TaskTypeMembers::Step: // gets the first step that's not Done in the task objective.
@@ -419,27 +385,9 @@ bool MQ2TaskType::dataTask(const char* szIndex, MQTypeVar& Ret)
 		return true;
 	}
 
-	// look up the task by name -- we loop by index here because it's the easiest way to
-	// loop by address of the task arrays
-	for (auto& sharedEntry : pTaskManager->SharedTaskEntries)
-	{
-		if (sharedEntry.TaskID && MaybeExactCompare(sharedEntry.TaskTitle, szIndex))
-		{
-			Ret.Ptr = &sharedEntry;
-			return true;
-		}
-	}
-
-	for (auto& questEntry : pTaskManager->QuestEntries)
-	{
-		if (questEntry.TaskID && MaybeExactCompare(questEntry.TaskTitle, szIndex))
-		{
-			Ret.Ptr = &questEntry;
-			return true;
-		}
-	}
-
-	return false;
+	// look up the task by name -- shared tasks are searched before quests, the same as by index
+	Ret.Ptr = FindTaskByTitle(szIndex);
+	return Ret.Ptr != nullptr;
 }
 
 enum class TaskMemberTypeMembers
@@ -537,36 +485,11 @@ struct ObjectiveIndex
 
 ObjectiveIndex FindObjectiveIndex(CTaskElement* objective)
 {
-	if (!pTaskManager || !objective)
+	TaskObjectiveLocation location = FindTaskObjectiveLocation(objective);
+	if (location.taskIndex < 0)
 		return { -1, -1, TaskSystemType::cTaskSystemTypeTask };
 
-	for (int i = 0; i < MAX_SHARED_TASK_ENTRIES; ++i)
-	{
-		auto sharedEntry = &pTaskManager->SharedTaskEntries[i];
-		if (!sharedEntry || !sharedEntry->TaskID)
-			continue;
-
-		for (int j = 0; j < MAX_TASK_ELEMENTS; ++j)
-		{
-			if (&sharedEntry->Elements[j] == objective)
-				return { i, j, TaskSystemType::cTaskSystemTypeSharedQuest };
-		}
-	}
-
-	for (int i = 0; i < MAX_QUEST_ENTRIES; ++i)
-	{
-		auto questEntry = &pTaskManager->QuestEntries[i];
-		if (!questEntry || !questEntry->TaskID)
-			continue;
-
-		for (int j = 0; j < MAX_TASK_ELEMENTS; ++j)
-		{
-			if (&questEntry->Elements[j] == objective)
-				return { i, j, TaskSystemType::cTaskSystemTypeSoloQuest };
-		}
-	}
-
-	return { -1, -1, TaskSystemType::cTaskSystemTypeTask };
+	return { location.taskIndex, location.objectiveIndex, static_cast<TaskSystemType>(location.systemType) };
 }
 
 MQ2TaskObjectiveType::MQ2TaskObjectiveType() : MQ2Type("taskobjective")
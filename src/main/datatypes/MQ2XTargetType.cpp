@@ -14,6 +14,7 @@
 
 #include "pch.h"
 #include "MQ2DataTypes.h"
+#include "MQXTargets.h"
 
 namespace mq::datatypes {
 
@@ -42,10 +43,12 @@ bool MQ2XTargetType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 	ExtendedTargetSlot* xts = pLocalPC->pExtendedTargetList->GetSlot(index);
 	if (!xts) return false;
 
+	const XTargetSlotState* state = GetXTargetSlotState(index);
+
 	MQTypeMember* pMember = MQ2XTargetType::FindMember(Member);
 	if (!pMember)
 	{
-		return pSpawnType->GetMember(GetSpawnByID(xts->SpawnID), Member, Index, Dest);
+		return pSpawnType->GetMember(state ? state->spawn : nullptr, Member, Index, Dest);
 	}
 
 	switch (static_cast<XTargetMembers>(pMember->ID))
@@ -76,13 +79,9 @@ bool MQ2XTargetType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index,
 	case XTargetMembers::PctAggro:
 		Dest.DWord = 0;
 		Dest.Type = pIntType;
-		if (pAggroInfo)
+		if (state && state->aggroPct >= 0)
 		{
-			uint32_t aggroIndex = AD_xTarget1 + index;
-			if (aggroIndex >= MAX_AGGRO_METER_SIZE)
-				return false;
-
-			Dest.DWord = pAggroInfo->aggroData[aggroIndex].AggroPct;
+			Dest.DWord = state->aggroPct;
 			return true;
 		}
 		return false;
@@ -119,10 +118,9 @@ bool MQ2XTargetType::Downcast(const MQVarPtr& fromVar, MQVarPtr& toVar, MQ2Type*
 
 		if (pLocalPC)
 		{
-			int index = fromVar.Int;
-			if (ExtendedTargetSlot* xts = pLocalPC->pExtendedTargetList->GetSlot(index))
+			if (const XTargetSlotState* state = GetXTargetSlotState(fromVar.Int))
 			{
-				pSpawn = GetSpawnByID(xts->SpawnID);
+				pSpawn = state->spawn;
 			}
 		}
 
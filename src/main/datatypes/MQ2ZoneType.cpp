@@ -31,6 +31,8 @@ MQ2ZoneType::MQ2ZoneType() : MQ2Type("zone")
 	ScopedTypeMember(ZoneMembers, ShortName);
 	ScopedTypeMember(ZoneMembers, ID);
 	ScopedTypeMember(ZoneMembers, ZoneFlags);
+
+	SetMemberPurity(MQDataPurity::PerZone);
 }
 
 bool MQ2ZoneType::GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest)
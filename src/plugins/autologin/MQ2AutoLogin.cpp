@@ -294,6 +294,16 @@ void NotifyCharacterUpdate(int Class, int Level, const char* Server, const char*
 	Post(proto::login::ProfileCharInfo, info);
 }
 
+void NotifyLoginRetry(int Retries, const char* Message)
+{
+	proto::login::LoginRetryMissive retry;
+	retry.set_pid(GetCurrentProcessId());
+	retry.set_retries(Retries);
+	retry.set_message(Message);
+
+	Post(proto::login::LoginRetry, retry);
+}
+
 void LoginServerSelect(const char* Login, const char* Pass)
 {
 	proto::login::StartInstanceMissive start;
@@ -41,6 +41,7 @@ void NotifyCharacterLoad(const char* Profile, const char* Account, const char* S
 void NotifyCharacterLoad(const std::shared_ptr<ProfileRecord>& ptr);
 void NotifyCharacterUnload();
 void NotifyCharacterUpdate(int Class, int Level, const char* Server, const char* Character);
+void NotifyLoginRetry(int Retries, const char* Message);
 void SendWndNotification(CXWnd* pWnd, CXWnd* sender, uint32_t msg, void* data = nullptr);
 CXStr GetWindowText(CXWnd* pWnd);
 CXStr GetEditWndText(CEditWnd* pWnd);
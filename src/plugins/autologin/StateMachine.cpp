@@ -366,6 +366,9 @@ public:
 
 				++m_retries;
 				m_delayTime = MQGetTickCount64() + 2000; // TODO: configure reconnect delay
+
+				// lets the launcher hold off on starting more clients while the login server is busy
+				NotifyLoginRetry(m_retries, str.c_str());
 			}
 		}
 
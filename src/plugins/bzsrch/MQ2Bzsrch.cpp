@@ -18,6 +18,10 @@
 
 #include <mq/Plugin.h>
 
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
 using namespace mq::datatypes;
 
 PLUGIN_VERSION(2.0);
@@ -126,6 +130,91 @@ struct BazaarSearchItem
 	}
 };
 std::vector<BazaarSearchItem> BazaarItemsArray;
+
+// The name of an item without the trailing "(...)" of the search result.
+static std::string_view GetBazaarItemBaseName(const char* itemName)
+{
+	std::string_view name = itemName;
+	if (size_t pos = name.rfind('('); pos != std::string_view::npos)
+		name = name.substr(0, pos);
+	while (!name.empty() && name.back() == ' ')
+		name.remove_suffix(1);
+	return name;
+}
+
+// Lookups into BazaarItemsArray. Every result is added as it is read, so the indices are complete
+// by the time the search is done and no lookup has to walk the results.
+class BazaarItemsIndex
+{
+	struct GuidHasher
+	{
+		size_t operator()(const EqItemGuid& guid) const
+		{
+			return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(&guid), sizeof(guid)));
+		}
+	};
+
+public:
+	void Clear()
+	{
+		m_byGuid.clear();
+		m_byName.clear();
+		m_byPrice.clear();
+		m_byQuantity.clear();
+	}
+
+	void Reserve(size_t count)
+	{
+		m_byGuid.reserve(count);
+		m_byName.reserve(count);
+		m_byPrice.reserve(count);
+		m_byQuantity.reserve(count);
+	}
+
+	void Add(int index)
+	{
+		const BazaarSearchItem& item = BazaarItemsArray[index];
+
+		m_byGuid.emplace(item.ItemGuid, index);
+		m_byName.emplace(std::string(GetBazaarItemBaseName(item.ItemName)), index);
+
+		// upper_bound keeps results of the same price (or quantity) in the order they arrived
+		m_byPrice.insert(std::upper_bound(m_byPrice.begin(), m_byPrice.end(), index,
+			[](int a, int b) { return BazaarItemsArray[a].Price < BazaarItemsArray[b].Price; }), index);
+		m_byQuantity.insert(std::upper_bound(m_byQuantity.begin(), m_byQuantity.end(), index,
+			[](int a, int b) { return BazaarItemsArray[a].Quantity < BazaarItemsArray[b].Quantity; }), index);
+	}
+
+	int FindByGuid(const EqItemGuid& guid) const
+	{
+		auto iter = m_byGuid.find(guid);
+		return iter != m_byGuid.end() ? iter->second : -1;
+	}
+
+	// The first result with this name, ignoring case.
+	int FindByName(std::string_view name) const
+	{
+		auto iter = m_byName.find(name);
+		return iter != m_byName.end() ? iter->second : -1;
+	}
+
+	const std::vector<int>& GetByPrice() const { return m_byPrice; }
+	const std::vector<int>& GetByQuantity() const { return m_byQuantity; }
+
+private:
+	std::unordered_map<EqItemGuid, int, GuidHasher> m_byGuid;
+	ci_unordered::map<std::string, int> m_byName;
+	std::vector<int> m_byPrice;                      // cheapest first
+	std::vector<int> m_byQuantity;                   // smallest first
+};
+BazaarItemsIndex BazaarItemsLookup;
+
+static void ClearBazaarItems()
+{
+	BazaarItemsArray.clear();
+	BazaarItemsLookup.Clear();
+}
+
 bool BazaarSearchDone = false;
 bool WaitingForSearch = false;
 uint64_t NextSearchCheck = 0;
@@ -159,8 +248,9 @@ public:
 		buffer.Read(unk2);
 		buffer.Read(count);
 
-		BazaarItemsArray.clear();
+		ClearBazaarItems();
 		BazaarItemsArray.resize(count);
+		BazaarItemsLookup.Reserve(count);
 
 		for (int i = 0; i < count; ++i)
 		{
@@ -171,6 +261,8 @@ public:
 			{
 				strcpy_s(item.TraderName, trader->Name);
 			}
+
+			BazaarItemsLookup.Add(i);
 		}
 
 		HandleSearchResults_Trampoline(bufferIn);
@@ -199,13 +291,7 @@ static void SelectBazaarSearchItem(const BazaarSearchItem* pSearchItem)
 
 static int FindBazaarItemsArrayIndex(const BazaarSearchResults* pResult)
 {
-	for (int i = 0; i < (int)BazaarItemsArray.size(); ++i)
-	{
-		if (BazaarItemsArray[i].ItemGuid == pResult->itemGuid)
-			return i;
-	}
-
-	return -1;
+	return BazaarItemsLookup.FindByGuid(pResult->itemGuid);
 }
 
 MQ2BazaarType* pBazaarType = nullptr;
@@ -346,6 +432,8 @@ public:
 		Done,
 		Item,
 		SortedItem,
+		ItemByPrice,
+		ItemByQuantity,
 	};
 
 	MQ2BazaarType() : MQ2Type("bazaar")
@@ -354,6 +442,8 @@ public:
 		ScopedTypeMember(BazaarMembers, Done);
 		ScopedTypeMember(BazaarMembers, Item);
 		ScopedTypeMember(BazaarMembers, SortedItem);
+		ScopedTypeMember(BazaarMembers, ItemByPrice);
+		ScopedTypeMember(BazaarMembers, ItemByQuantity);
 	}
 
 	bool GetMember(MQVarPtr VarPtr, const char* Member, char* Index, MQTypeVar& Dest) override
@@ -394,12 +484,21 @@ public:
 				}
 				else
 				{
+					int N = BazaarItemsLookup.FindByName(GetBazaarItemBaseName(Index));
+					if (N >= 0)
+					{
+						Dest.DWord = N;
+						Dest.Type = pBazaarItemType;
+						return true;
+					}
+
+					// names that only start with the index
 					for (uint32_t i = 0; i < BazaarItemsArray.size(); i++)
 					{
 						BazaarSearchItem& item = BazaarItemsArray[i];
 
-						size_t len = strrchr(&item.ItemName[0], '(') - &item.ItemName[0];
-						if (!strncmp(Index, &item.ItemName[0], len))
+						std::string_view name = GetBazaarItemBaseName(item.ItemName);
+						if (!name.empty() && !strncmp(Index, name.data(), name.length()))
 						{
 							Dest.DWord = i;
 							Dest.Type = pBazaarItemType;
@@ -460,6 +559,23 @@ public:
 			}
 			return false;
 
+		case BazaarMembers::ItemByPrice:
+		case BazaarMembers::ItemByQuantity:
+			if (Index[0])
+			{
+				const std::vector<int>& sorted = (BazaarMembers)pMember->ID == BazaarMembers::ItemByPrice
+					? BazaarItemsLookup.GetByPrice() : BazaarItemsLookup.GetByQuantity();
+
+				int N = GetIntFromString(Index, 0) - 1;
+				if (N < 0 || N >= (int)sorted.size())
+					return false;
+
+				Dest.DWord = sorted[N];
+				Dest.Type = pBazaarItemType;
+				return true;
+			}
+			return false;
+
 		default: break;
 		}
 
@@ -703,7 +819,7 @@ void BzReset(SPAWNINFO* pChar, char* szLine)
 {
 	BazaarSearchDone = false;
 	WaitingForSearch = false;
-	BazaarItemsArray.clear();
+	ClearBazaarItems();
 }
 
 void BzSrchMe(SPAWNINFO* pChar, char* szLine)
@@ -713,7 +829,7 @@ void BzSrchMe(SPAWNINFO* pChar, char* szLine)
 
 	BazaarSearchDone = false;
 	WaitingForSearch = false;
-	BazaarItemsArray.clear();
+	ClearBazaarItems();
 
 	// Reset to defaults
 	if (CButtonWnd* pDefaultButton = pBazaarSearchWnd->pDefaultButton)
@@ -971,7 +1087,7 @@ PLUGIN_API void SetGameState(DWORD gamestate)
 	// When game state changes, just clear things.
 	WaitingForSearch = false;
 	BazaarSearchDone = false;
-	BazaarItemsArray.clear();
+	ClearBazaarItems();
 	NextSearchCheck = 0;
 }
 
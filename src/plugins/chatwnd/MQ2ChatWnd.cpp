@@ -15,7 +15,7 @@
 #include <mq/Plugin.h>
 
 #include <vector>
-#include <list>
+#include <array>
 #include <string>
 #include <mq/imgui/ImGuiUtils.h>
 
@@ -23,11 +23,57 @@
 
 PreSetup("MQ2ChatWnd");
 
-static constexpr auto LINES_PER_FRAME = 3;
+static constexpr auto LINES_PER_FRAME = 64;
 static constexpr auto CMD_HIST_MAX = 50;
 static constexpr auto MAX_LINES_OUTBOX = 700;
 
-std::list<CXStr> sPendingChat;
+// Lines waiting to be added to the output box. It never holds more than the box keeps: once it is
+// full the oldest line is dropped (it would have been pruned from the box anyway) and counted, so a
+// burst of chat can't grow the queue or the time it takes to catch up without bound.
+class PendingChatQueue
+{
+public:
+	bool empty() const { return m_count == 0; }
+	size_t size() const { return m_count; }
+
+	void push_back(CXStr line)
+	{
+		if (m_count == m_lines.size())
+		{
+			pop_front();
+			++m_dropped;
+		}
+
+		m_lines[(m_head + m_count) % m_lines.size()] = std::move(line);
+		++m_count;
+	}
+
+	const CXStr& front() const { return m_lines[m_head]; }
+
+	void pop_front()
+	{
+		m_lines[m_head] = CXStr();
+		m_head = (m_head + 1) % m_lines.size();
+		--m_count;
+	}
+
+	void clear()
+	{
+		while (!empty())
+			pop_front();
+		m_dropped = 0;
+	}
+
+	uint32_t TakeDropped() { return std::exchange(m_dropped, 0); }
+
+private:
+	std::array<CXStr, MAX_LINES_OUTBOX> m_lines;
+	size_t m_head = 0;
+	size_t m_count = 0;
+	uint32_t m_dropped = 0;
+};
+
+PendingChatQueue sPendingChat;
 DWORD ulOldVScrollPos = 0;
 DWORD bmStripFirstStmlLines = 0;
 char szChatINISection[MAX_STRING] = { 0 };
@@ -287,6 +333,8 @@ void LoadChatFromINI(CSidlScreenWnd* pWindow)
 
 void SaveChatToINI(CSidlScreenWnd* pWindow)
 {
+	ScopedPrivateProfileBatch batch(INIFileName);
+
 	char szTemp[MAX_STRING] = { 0 };
 	WritePrivateProfileString("Settings", "AutoScroll", bAutoScroll ? "on" : "off", INIFileName);
 	WritePrivateProfileString("Settings", "NoCharSelect", bNoCharSelect ? "on" : "off", INIFileName);
@@ -666,17 +714,16 @@ PLUGIN_API DWORD OnWriteChatColor(char* Line, DWORD Color, DWORD Filter)
 	}
 
 	Color = pChatManager->GetRGBAFromIndex(Color);
-	char* szProcessed = new char[MAX_STRING];
 
-	int pos = MQToSTML(Line, szProcessed, MAX_STRING - 4, Color);
+	std::string processed;
+	MQToSTML(Line, processed, Color);
+	processed.append("<br>");
 
-	CXStr text = szProcessed;
-	text.append("<br>");
+	CXStr text{ processed };
 
 	ConvertItemTags(text);
-	sPendingChat.push_back(text);
+	sPendingChat.push_back(std::move(text));
 
-	delete[] szProcessed;
 	return 0;
 }
 
@@ -713,21 +760,24 @@ PLUGIN_API void OnPulse()
 			// scroll down if autoscroll enabled, or current position is the bottom of chatwnd
 			bool bScrollDown = bAutoScroll || (MQChatWnd->OutputBox->GetVScrollPos() == MQChatWnd->OutputBox->GetVScrollMax());
 
-			size_t ThisPulse = sPendingChat.size();
-			if (ThisPulse > LINES_PER_FRAME)
+			// the lines of the frame go in with a single append, so the box lays out and prunes once
+			CXStr batch;
+			if (uint32_t dropped = sPendingChat.TakeDropped())
 			{
-				ThisPulse = LINES_PER_FRAME;
+				std::string notice;
+				MQToSTML(fmt::format("\ay({} lines were dropped to keep up)", dropped), notice);
+				notice.append("<br>");
+				batch.append(notice.c_str());
 			}
 
-			for (size_t N = 0; N < ThisPulse; N++)
+			for (int N = 0; N < LINES_PER_FRAME && !sPendingChat.empty(); N++)
 			{
-				if (!sPendingChat.empty())
-				{
-					MQChatWnd->OutputBox->AppendSTML(*sPendingChat.begin());
-					sPendingChat.pop_front();
-				}
+				batch.append(sPendingChat.front());
+				sPendingChat.pop_front();
 			}
 
+			MQChatWnd->OutputBox->AppendSTML(batch);
+
 			if (bScrollDown)
 			{
 				// set current vscroll position to bottom
@@ -26,8 +26,20 @@ struct CustomBind
 	std::string name;
 	std::string commandDown;
 	std::string commandUp;
+
+	// Resolved the first time the bind is pressed, so that presses skip the command lookups.
+	MQCompiledCommand compiledDown;
+	MQCompiledCommand compiledUp;
 };
 
+static void RunCustomBindCommand(const std::string& command, MQCompiledCommand& compiled)
+{
+	if (compiled.Line != command)
+		compiled.Line = command;
+
+	DoCommand(compiled);
+}
+
 static std::vector<std::unique_ptr<CustomBind>> sCustomBinds;
 static bool gbBindsLoaded = false;
 
@@ -169,18 +181,19 @@ void ExecuteCustomBind(const char* Name, bool Down)
 	if (!pCharInfo)
 		return;
 
+	// Run right away rather than on the next pulse, a bind should act on the frame it is pressed.
 	if (CustomBind* pBind = sCustomBinds[N].get())
 	{
 		if (Down)
 		{
 			if (!pBind->commandDown.empty())
 			{
-				DoCommand(pCharInfo->pSpawn, pBind->commandDown.c_str());
+				RunCustomBindCommand(pBind->commandDown, pBind->compiledDown);
 			}
 		}
 		else if (!pBind->commandUp.empty())
 		{
-			DoCommand(pCharInfo->pSpawn, pBind->commandUp.c_str());
+			RunCustomBindCommand(pBind->commandUp, pBind->compiledUp);
 		}
 	}
 }
@@ -17,7 +17,10 @@
 
 #include <mq/Plugin.h>
 
+#include <filesystem>
 #include <mutex>
+#include <string>
+#include <vector>
 
 PreSetup("MQ2HUD");
 
@@ -40,11 +43,17 @@ struct HUDELEMENT
 	char        Text[MAX_STRING];
 	char        PreParsed[MAX_STRING];
 
+	// Text without any ${} is drawn as it is, without being parsed.
+	bool        HasVariables;
+	// The bare ${Name} references of the text, that have to exist before a macro element is parsed.
+	std::vector<std::string> Names;
+
 	HUDELEMENT* pNext;
 };
 HUDELEMENT* pHud = nullptr;
 
 struct _stat LastRead;
+HANDLE hINIChange = INVALID_HANDLE_VALUE;
 char HUDNames[MAX_STRING] = "Elements";
 char HUDSection[MAX_STRING] = "MQ2HUD";
 int SkipParse = 1;
@@ -67,6 +76,42 @@ bool Stat(const char* Filename, struct _stat& Dest)
 	return true;
 }
 
+// The ini is only looked at once something in its folder has changed. Without a change notification,
+// it is looked at every time.
+bool HasINIChanged()
+{
+	if (hINIChange != INVALID_HANDLE_VALUE)
+	{
+		if (WaitForSingleObject(hINIChange, 0) != WAIT_OBJECT_0)
+			return false;
+
+		FindNextChangeNotification(hINIChange);
+	}
+
+	struct _stat now;
+	return Stat(INIFileName, now) && now.st_mtime != LastRead.st_mtime;
+}
+
+std::vector<std::string> GetReferencedNames(std::string_view text)
+{
+	std::vector<std::string> names;
+
+	size_t pos = 0;
+	while ((pos = text.find("${", pos)) != std::string_view::npos)
+	{
+		pos += 2;
+
+		size_t end = pos;
+		while (end < text.length() && (isalnum(static_cast<unsigned char>(text[end])) || text[end] == '_'))
+			++end;
+
+		if (end > pos && end < text.length() && text[end] == '}')
+			names.emplace_back(text.substr(pos, end - pos));
+	}
+
+	return names;
+}
+
 void ClearElements()
 {
 	std::scoped_lock lock(s_mutex);
@@ -166,6 +211,11 @@ void AddElement(char* IniString)
 	strcpy_s(pElement->Text, IniString);
 	ZeroMemory(pElement->PreParsed, sizeof(pElement->PreParsed));
 	pElement->Size = Size;
+	pElement->HasVariables = strstr(pElement->Text, "${") != nullptr;
+	pElement->Names = GetReferencedNames(pElement->Text);
+
+	if (!pElement->HasVariables)
+		strcpy_s(pElement->PreParsed, pElement->Text);
 
 	DebugSpew("New element '%s' in color %X", pElement->Text, pElement->Color);
 }
@@ -422,6 +472,9 @@ PLUGIN_API void InitializePlugin()
 	GetPrivateProfileString(HUDSection, "Last", "Elements", HUDNames, MAX_STRING, INIFileName);
 	HandleINI();
 
+	std::filesystem::path iniFolder = std::filesystem::path(INIFileName).parent_path();
+	hINIChange = FindFirstChangeNotificationW(iniFolder.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+
 	AddCommand("/defaulthud", DefaultHUD);
 	AddCommand("/loadhud", LoadHUD);
 	AddCommand("/unloadhud", UnLoadHUD);
@@ -435,6 +488,12 @@ PLUGIN_API void ShutdownPlugin()
 {
 	ClearElements();
 
+	if (hINIChange != INVALID_HANDLE_VALUE)
+	{
+		FindCloseChangeNotification(hINIChange);
+		hINIChange = INVALID_HANDLE_VALUE;
+	}
+
 	RemoveCommand("/loadhud");
 	RemoveCommand("/unloadhud");
 	RemoveCommand("/defaulthud");
@@ -460,133 +519,18 @@ PLUGIN_API void OnZoned()
 	if (bZoneHUD) HandleINI();
 }
 
-bool ParseMacroLine(char* szOriginal, size_t BufferSize, std::list<std::string>& out)
-{
-	// find each {}
-	char* pBrace = strstr(szOriginal, "${");
-	if (!pBrace)
-		return false;
-
-	size_t NewLength = 0;
-	bool Changed = false;
-	char szCurrent[MAX_STRING] = { 0 };
-
-	do
-	{
-		// find this brace's end
-		char* pEnd = &pBrace[1];
-		bool Quote = false;
-		bool BeginParam = false;
-		int nBrace = 1;
-
-		while (nBrace)
-		{
-			++pEnd;
-			if (BeginParam)
-			{
-				BeginParam = false;
-				if (*pEnd == '\"')
-				{
-					Quote = true;
-				}
-				continue;
-			}
-
-			if (*pEnd == 0)
-			{
-				// unmatched brace or quote
-				continue;
-			}
-
-			if (Quote)
-			{
-				if (*pEnd == '\"')
-				{
-					if (pEnd[1] == ']' || pEnd[1] == ',')
-					{
-						Quote = false;
-					}
-				}
-			}
-			else
-			{
-				if (*pEnd == '}')
-				{
-					nBrace--;
-				}
-				else if (*pEnd == '{')
-				{
-					nBrace++;
-				}
-				else if (*pEnd == '[' || *pEnd == ',')
-					BeginParam = true;
-			}
-		}
-
-		*pEnd = 0;
-		strcpy_s(szCurrent, &pBrace[2]);
-		if (szCurrent[0] == 0)
-		{
-			continue;
-		}
-
-		if (ParseMacroLine(szCurrent, sizeof(szCurrent), out))
-		{
-			size_t NewLength = strlen(szCurrent);
-			memmove(&pBrace[NewLength + 1], &pEnd[1], strlen(&pEnd[1]) + 1);
-
-			int addrlen = (int)(pBrace - szOriginal);
-			memcpy_s(pBrace, BufferSize - addrlen, szCurrent, NewLength);
-
-			pEnd = &pBrace[NewLength];
-			*pEnd = 0;
-		}
-
-		if (!strchr(szCurrent, '[') && !strchr(szCurrent, '.'))
-			out.emplace_back(szCurrent);
-
-		NewLength = strlen(szCurrent);
-		memmove(&pBrace[NewLength], &pEnd[1], strlen(&pEnd[1]) + 1);
-
-		int addrlen = (int)(pBrace - szOriginal);
-		memcpy_s(pBrace, BufferSize - addrlen, szCurrent, NewLength);
-
-		if (!bAllowCommandParse)
-		{
-			bAllowCommandParse = true;
-			Changed = false;
-			break;
-		}
-		else
-		{
-			Changed = true;
-		}
-	} while (pBrace = strstr(&pBrace[1], "${"));
-
-	if (Changed)
-	{
-		while (ParseMacroLine(szOriginal, BufferSize, out))
-			;
-	}
-
-	return Changed;
-}
-
 // Called every frame that the "HUD" is drawn -- e.g. net status / packet loss bar
 PLUGIN_API void OnDrawHUD()
 {
 	std::scoped_lock lock(s_mutex);
 
-	static bool bOkToCheck = true;
 	static int FrameCount = 0;
-	char szBuffer[MAX_STRING] = { 0 };
 
 	if (++FrameCount > CheckINI)
 	{
 		FrameCount = 0;
 
-		struct _stat now;
-		if (Stat(INIFileName, now) && now.st_mtime != LastRead.st_mtime)
+		if (HasINIChanged())
 			LoadElements();
 
 		// check for EQ in foreground
@@ -627,54 +571,26 @@ PLUGIN_API void OnDrawHUD()
 				Y = SX + pElement->Y;
 			}
 
-			if (bCheckParse)
+			if (bCheckParse && pElement->HasVariables)
 			{
-				bOkToCheck = true;
-				strcpy_s(pElement->PreParsed, pElement->Text);
+				bool bOkToCheck = true;
 
-				if (pElement->Type & HUDTYPE_MACRO)
+				// only parse macro elements once everything they refer to exists
+				if (pElement->Type & HUDTYPE_MACRO && gRunning)
 				{
-					if (gRunning)
+					for (const std::string& name : pElement->Names)
 					{
-						char szTemp[MAX_STRING] = { 0 };
-						strcpy_s(szTemp, pElement->Text);
-
-						std::list<std::string> out;
-						ParseMacroLine(szTemp, MAX_STRING, out);
-
-						for (auto& line : out)
+						if (!FindTopLevelObject(name.c_str()) && !IsMacroVariable(name.c_str()))
 						{
 							bOkToCheck = false;
-							const char* pChar = line.c_str();
-
-							if (FindTopLevelObject(pChar))
-							{
-								bOkToCheck = true;
-								continue;
-							}
-
-							if (!bOkToCheck)
-							{
-								// ok fine we didn't find it in the tlo map...
-								// lets check variables
-								if (IsMacroVariable(pChar))
-								{
-									bOkToCheck = true;
-									continue;
-								}
-							}
-
-							if (!bOkToCheck)
-							{
-								// still not found...
-								break;
-							}
+							break;
 						}
 					}
 				}
 
 				if (bOkToCheck)
 				{
+					strcpy_s(pElement->PreParsed, pElement->Text);
 					ParseMacroParameter(pElement->PreParsed);
 				}
 				else
@@ -683,10 +599,9 @@ PLUGIN_API void OnDrawHUD()
 				}
 			}
 
-			strcpy_s(szBuffer, pElement->PreParsed);
-			if (szBuffer[0] && strcmp(szBuffer, "nullptr"))
+			if (pElement->PreParsed[0] && strcmp(pElement->PreParsed, "nullptr"))
 			{
-				DrawHUDText(szBuffer, X, Y, pElement->Color, pElement->Size);
+				DrawHUDText(pElement->PreParsed, X, Y, pElement->Color, pElement->Size);
 			}
 		}
 
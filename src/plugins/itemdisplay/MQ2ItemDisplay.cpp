@@ -859,7 +859,7 @@ struct fmt::formatter<class_name_level> : fmt::formatter<string_view> {
 	}
 };
 
-static void CreateSpellTextDetails(fmt::memory_buffer& out, EQ_Spell* pSpell)
+static void BuildSpellTextDetails(fmt::memory_buffer& out, EQ_Spell* pSpell)
 {
 	auto buffer = std::back_inserter(out);
 
@@ -985,6 +985,39 @@ static void CreateSpellTextDetails(fmt::memory_buffer& out, EQ_Spell* pSpell)
 	}
 }
 
+// The details of a spell only depend on the spell and the level of the character (for the
+// duration), so they are kept until the level changes or the UI is reloaded. Hovering over a
+// list of items would otherwise format the same spells over and over.
+static constexpr size_t MAX_CACHED_SPELL_DETAILS = 2048;
+static std::unordered_map<int, std::string> s_spellTextDetailsCache;
+static int s_spellTextDetailsLevel = -1;
+
+static void ClearSpellTextDetailsCache()
+{
+	s_spellTextDetailsCache.clear();
+	s_spellTextDetailsLevel = -1;
+}
+
+static void CreateSpellTextDetails(fmt::memory_buffer& out, EQ_Spell* pSpell)
+{
+	const int level = pLocalPlayer ? pLocalPlayer->Level : 0;
+	if (level != s_spellTextDetailsLevel || s_spellTextDetailsCache.size() >= MAX_CACHED_SPELL_DETAILS)
+	{
+		s_spellTextDetailsCache.clear();
+		s_spellTextDetailsLevel = level;
+	}
+
+	auto [iter, added] = s_spellTextDetailsCache.try_emplace(pSpell->ID);
+	if (added)
+	{
+		fmt::memory_buffer details;
+		BuildSpellTextDetails(details, pSpell);
+		iter->second = to_string(details);
+	}
+
+	out.append(iter->second.data(), iter->second.data() + iter->second.size());
+}
+
 // TODO: Find a way to remove origMsg by calculating the bonus dmg.
 static void CreateItemText(fmt::memory_buffer& buffer_, const ItemPtr& item, const CXStr& origMsg)
 {
@@ -1942,6 +1975,7 @@ PLUGIN_API void ShutdownPlugin()
 PLUGIN_API void OnCleanUI()
 {
 	s_itemDisplayExtraInfo.clear();
+	ClearSpellTextDetailsCache();
 
 	if (pItemDisplayManager && pItemDisplayManager->GetCount() > 0)
 	{
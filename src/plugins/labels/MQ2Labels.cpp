@@ -16,6 +16,9 @@
 
 #include <mq/Plugin.h>
 
+#include <string>
+#include <unordered_map>
+
 PLUGIN_VERSION(2.0);
 
 PreSetup("MQ2Labels");
@@ -78,6 +81,42 @@ struct {
 	{-1,     nullptr}
 };
 
+// What we keep for every custom (9999) label, so a text update that has nothing new to show doesn't
+// have to convert and parse the tooltip again.
+struct CustomLabel
+{
+	std::string tooltip;                             // the xml tooltip the expression was taken from
+	std::string expression;                          // the tooltip as plain text
+	bool hasVariables = false;
+	std::string text;                                // what the expression last parsed to
+	uint32_t refreshMs = 0;                          // from "Refresh=" in the controller, 0 is every update
+	uint64_t nextRefresh = 0;
+};
+static std::unordered_map<CLabel*, CustomLabel> s_customLabels;
+
+// The controller of a label is its EQType, optionally followed by a refresh interval:
+// "9999 Refresh=250ms" (or Refresh=2s, a plain number is milliseconds).
+static uint32_t GetRefreshFromController(std::string_view controller)
+{
+	constexpr std::string_view key = "refresh=";
+
+	int pos = ci_find_substr(controller, key);
+	if (pos == -1)
+		return 0;
+
+	std::string_view value = controller.substr(pos + key.length());
+	uint32_t refresh = 0;
+	auto [end, ec] = std::from_chars(value.data(), value.data() + value.length(), refresh);
+	if (ec != std::errc())
+		return 0;
+
+	std::string_view unit = value.substr(end - value.data());
+	if (!unit.empty() && (unit[0] == 's' || unit[0] == 'S'))
+		refresh *= 1000;
+
+	return refresh;
+}
+
 // the tool tip is already copied out of the in class CControlTemplate. Use this struct
 // to mock up the class, so we don't have to worry about class instatiation and crap
 
@@ -94,6 +133,12 @@ public:
 		{
 			CLabel* pLabel = static_cast<CLabel*>(newXWnd);
 			pLabel->EQType = GetIntFromString(pTemplate->strController, pLabel->EQType);
+
+			// a label can get the address of one that was destroyed, start over
+			if (pLabel->EQType == 9999)
+				s_customLabels[pLabel] = CustomLabel{ {}, {}, false, {}, GetRefreshFromController(pTemplate->strController) };
+			else
+				s_customLabels.erase(pLabel);
 		}
 
 		return newXWnd;
@@ -108,6 +153,12 @@ public:
 		{
 			CLabel* pLabel = static_cast<CLabel*>(newXWnd);
 			pLabel->EQType = GetIntFromString(pTemplate->strController, pLabel->EQType);
+
+			// a label can get the address of one that was destroyed, start over
+			if (pLabel->EQType == 9999)
+				s_customLabels[pLabel] = CustomLabel{ {}, {}, false, {}, GetRefreshFromController(pTemplate->strController) };
+			else
+				s_customLabels.erase(pLabel);
 		}
 
 		return newXWnd;
@@ -126,23 +177,47 @@ public:
 
 		if (pThis->EQType == 9999)
 		{
-			auto tooltip = pThis->GetXMLTooltip();
-			char buffer[MAX_STRING] = { 0 };
+			// nobody would see the text of a label on a hidden window
+			if (!pThis->IsReallyVisible())
+				return;
+
+			CustomLabel& label = s_customLabels[pThis];
+			const uint64_t now = MQGetTickCount64();
 
-			if (!tooltip.empty())
+			auto tooltip = pThis->GetXMLTooltip();
+			if (tooltip.empty())
+			{
+				label = CustomLabel{ {}, {}, false, "BadCustom", label.refreshMs };
+			}
+			else if (label.tooltip != tooltip.c_str())
 			{
+				char buffer[MAX_STRING] = { 0 };
 				STMLToPlainText(tooltip.mutable_data(), buffer);
 
+				label.tooltip = tooltip.c_str();
+				label.expression = buffer;
+				label.hasVariables = label.expression.find('$') != std::string::npos;
+				label.nextRefresh = 0;
+
+				if (!label.hasVariables)
+					label.text = label.expression;
+			}
+
+			if (label.hasVariables && now >= label.nextRefresh)
+			{
+				char buffer[MAX_STRING] = { 0 };
+				strcpy_s(buffer, label.expression.c_str());
+
 				ParseMacroParameter(buffer, MAX_STRING);
 				if (strcmp(buffer, "NULL") == 0)
 					buffer[0] = 0;
-			}
-			else
-			{
-				strcpy_s(buffer, "BadCustom");
+
+				label.text = buffer;
+				label.nextRefresh = now + label.refreshMs;
 			}
 
-			pThis->SetWindowText(buffer);
+			if (strcmp(pThis->GetWindowText().c_str(), label.text.c_str()) != 0)
+				pThis->SetWindowText(label.text.c_str());
 			return;
 		}
 
@@ -176,9 +251,17 @@ PLUGIN_API void InitializePlugin()
 	EzDetour(CSidlManager__CreateXWnd, &CSidlManagerHook::CreateXWnd_Detour, &CSidlManagerHook::CreateXWnd_Trampoline);
 }
 
+// The windows (and the labels in them) are all destroyed and remade
+PLUGIN_API void OnCleanUI()
+{
+	s_customLabels.clear();
+}
+
 // Called once, when the plugin is to shutdown
 PLUGIN_API void ShutdownPlugin()
 {
+	s_customLabels.clear();
+
 	// Remove commands, macro parameters, hooks, etc.
 	RemoveDetour(CSidlManager__CreateXWnd);
 	RemoveDetour(CLabel__UpdateText);
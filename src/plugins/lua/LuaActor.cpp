@@ -21,6 +21,7 @@
 #include "Actor.pb.h"
 
 #include "LuaActor.h"
+#include "LuaActorPayload.h"
 #include "LuaThread.h"
 #include "LuaCoroutine.h"
 
@@ -155,6 +156,20 @@ messaging::Variant SerializeProto(const sol::object& data)
 	return variant;
 }
 
+std::string SerializePayload(const sol::object& data, bool compact)
+{
+	if (compact)
+	{
+		lua_State* L = data.lua_state();
+		data.push();
+		std::string payload = EncodeCompactPayload(L, -1);
+		lua_pop(L, 1);
+
+		return payload;
+	}
+
+	return SerializeProto(data).SerializeAsString();
+}
 
 void Send(sol::object payload);
 void Send(sol::table header, sol::object payload);
@@ -168,16 +183,35 @@ struct LuaMessage
 	std::shared_ptr<Message> message;
 	messaging::Variant data;
 	bool has_data = false;
+	bool compact = false;
 
 	LuaMessage(const LuaDropbox* const dropbox_, const std::shared_ptr<Message>& message_)
 		: dropbox(dropbox_)
-		, message(message_)
 	{
-		has_data = message && message->Payload && data.ParseFromString(*message->Payload);
+		SetMessage(message_);
+	}
+
+	void SetMessage(const std::shared_ptr<Message>& message_)
+	{
+		message = message_;
+		compact = message && message->Payload && IsCompactPayload(*message->Payload);
+
+		// compact payloads are decoded straight onto the stack when they're asked for
+		has_data = message && message->Payload && (compact || data.ParseFromString(*message->Payload));
 	}
 
 	sol::object Get(sol::this_state s)
 	{
+		if (has_data && compact)
+		{
+			lua_State* L = s;
+			DecodeCompactPayload(L, *message->Payload);
+			sol::object content(L, -1);
+			lua_pop(L, 1);
+
+			return content;
+		}
+
 		if (has_data)
 			return DeserializeProto(data, s);
 
@@ -236,9 +270,13 @@ struct CallbackInstance
 
 	void Run()
 	{
+		std::shared_ptr<LuaThread> thread = LuaThread::get_from(m_thread.state());
+		if (thread)
+			thread->Wake(LuaWakeEvent_Actor);
+
 		try
 		{
-			ScopedYieldDisabler disableYield(LuaThread::get_from(m_thread.state()));
+			ScopedYieldDisabler disableYield(thread);
 
 			sol::function_result result = m_coroutine(m_status, m_message);
 			if (!result.valid())
@@ -279,8 +317,16 @@ public:
 	void Receive(const std::shared_ptr<Message>& message);
 	void Process();
 
+	bool Subscribe(const std::string& topic) const { return m_dropbox.Subscribe(topic); }
+	bool Unsubscribe(const std::string& topic) const { return m_dropbox.Unsubscribe(topic); }
+
 	const std::string& GetName() { return m_name; }
 
+	// Whether messages from this dropbox use the compact encoding. Only turn this on when every
+	// receiver understands it, replies always use the encoding the request came in.
+	bool IsCompact() const { return m_compact; }
+	void SetCompact(bool compact) { m_compact = compact; }
+
 	LuaDropbox(std::string_view name, const sol::function& callback, const sol::thread& parent_thread);
 	~LuaDropbox();
 
@@ -291,6 +337,7 @@ private:
 	sol::thread m_parentThread;
 	sol::coroutine m_coroutine;
 	std::vector<std::unique_ptr<CallbackInstance>> m_queue;
+	bool m_compact = false;
 
 	DropboxAPI m_dropbox;
 };
@@ -418,6 +465,9 @@ Address LuaDropbox::ParseHeader(sol::table header, const std::shared_ptr<LuaThre
 	addr.Server = header.get<std::optional<std::string>>("server");
 	addr.Character = header.get<std::optional<std::string>>("character");
 
+	// a topic goes to the mailboxes that subscribe to it, whatever their name
+	addr.Topic = header.get<std::optional<std::string>>("topic");
+
 	return addr;
 }
 
@@ -428,7 +478,7 @@ void LuaDropbox::Send(sol::object payload) const
 
 void LuaDropbox::Send(sol::table header, sol::object payload) const
 {
-	m_dropbox.Post(ParseHeader(header), SerializeProto(payload));
+	m_dropbox.Post(ParseHeader(header), SerializePayload(payload, m_compact));
 }
 
 void LuaDropbox::Send(sol::object payload, sol::function response_callback)
@@ -440,26 +490,31 @@ void LuaDropbox::Send(sol::table header, sol::object payload, sol::function resp
 {
 	// need to create the callback instance before response_callback goes out of scope in lua
 	auto callback = std::make_unique<CallbackInstance>(m_parentThread, response_callback, LuaMessage(this, nullptr));
-	m_dropbox.Post(ParseHeader(header), SerializeProto(payload),
+	m_dropbox.Post(ParseHeader(header), SerializePayload(payload, m_compact),
 		[callback = callback.release(), this](int status, const std::shared_ptr<Message>& message)
 		{
 			callback->m_status = status;
-			callback->m_message.message = message;
-			callback->m_message.has_data = message && message->Payload && callback->m_message.data.ParseFromString(*message->Payload);
+			callback->m_message.SetMessage(message);
 			m_queue.push_back(std::unique_ptr<CallbackInstance>(callback));
 		});
 }
 
 void LuaDropbox::Reply(const std::shared_ptr<Message>& message, const sol::object& reply, int status) const
 {
-	m_dropbox.PostReply(message, SerializeProto(reply), static_cast<uint8_t>(status));
+	// the sender of a compact request can read a compact reply
+	const bool compact = message && message->Payload ? IsCompactPayload(*message->Payload) : m_compact;
+	m_dropbox.PostReply(message, SerializePayload(reply, compact), static_cast<uint8_t>(status));
 }
 
 void LuaDropbox::Receive(const std::shared_ptr<Message>& message)
 {
+	std::shared_ptr<LuaThread> thread = LuaThread::get_from(m_thread.state());
+	if (thread)
+		thread->Wake(LuaWakeEvent_Actor);
+
 	try
 	{
-		ScopedYieldDisabler disableYield(LuaThread::get_from(m_thread.state()));
+		ScopedYieldDisabler disableYield(thread);
 
 		sol::function_result result = m_coroutine(LuaMessage(this, message));
 		if (!result.valid())
@@ -489,6 +544,262 @@ void LuaDropbox::Process()
 	m_queue.clear();
 }
 
+/**
+ * A named state table that every client running the script publishes, and a replica of the state of
+ * every other client. Publishing only sends the top level fields that changed since the last publish,
+ * each with the next sequence number. A subscriber that misses an update asks the publisher for the
+ * whole state, so replicas never drift.
+ */
+class LuaSharedState
+{
+public:
+	static std::shared_ptr<LuaSharedState> Register(const std::string& name, sol::this_state s);
+
+	LuaSharedState(std::string_view name, const sol::thread& parent_thread);
+	~LuaSharedState();
+
+	bool Publish(sol::table state);
+	sol::table GetReplicas() const { return m_replicas; }
+	void Unregister();
+
+private:
+	struct Replica
+	{
+		sol::object key;
+		uint32_t sequence = 0;
+		bool resyncRequested = false;
+	};
+
+	void Receive(const std::shared_ptr<Message>& message);
+	void Apply(Replica& replica, const messaging::StateUpdate& update);
+	void SendFull(uint32_t pid) const;
+	void SendTo(uint32_t pid, const messaging::StateUpdate& update) const;
+
+	std::string m_name;
+	sol::thread m_thread;
+	sol::table m_replicas;
+	std::unordered_map<uint32_t, Replica> m_replicaInfo;
+
+	// the published fields, in the compact encoding so they can be compared
+	std::unordered_map<std::string, std::string> m_fields;
+	uint32_t m_sequence = 0;
+
+	DropboxAPI m_dropbox;
+};
+
+std::shared_ptr<LuaSharedState> LuaSharedState::Register(const std::string& name, sol::this_state s)
+{
+	if (auto thread = LuaThread::get_from(s))
+		return std::make_shared<LuaSharedState>(fmt::format("{}:state:{}", thread->GetName(), name), thread->GetLuaThread());
+
+	return nullptr;
+}
+
+LuaSharedState::LuaSharedState(std::string_view name, const sol::thread& parent_thread)
+	: m_name(name)
+	, m_dropbox(AddActor(m_name.c_str(), [this](const std::shared_ptr<Message>& message) { Receive(message); }))
+{
+	m_thread = sol::thread::create(parent_thread.state());
+	m_replicas = sol::state_view(parent_thread.state()).create_table();
+}
+
+LuaSharedState::~LuaSharedState()
+{
+	Unregister();
+}
+
+void LuaSharedState::Unregister()
+{
+	if (!m_dropbox.Dropbox)
+		return;
+
+	// let everyone drop their replica of this client
+	if (m_sequence > 0)
+	{
+		messaging::StateUpdate update;
+		update.set_closed(true);
+
+		Address address;
+		address.Mailbox = m_name;
+		address.AbsoluteMailbox = true;
+		m_dropbox.Post(address, update);
+	}
+
+	m_dropbox.Remove();
+}
+
+bool LuaSharedState::Publish(sol::table state)
+{
+	if (!m_dropbox.Dropbox)
+		return false;
+
+	messaging::StateUpdate update;
+	std::unordered_map<std::string, std::string> fields;
+	fields.reserve(m_fields.size());
+
+	for (const auto& [k, v] : state)
+	{
+		// only named fields are diffed, anything nested is compared as a whole
+		if (k.get_type() != sol::type::string)
+			continue;
+
+		std::string key = k.as<std::string>();
+		std::string value = SerializePayload(v, true);
+
+		auto iter = m_fields.find(key);
+		if (iter == m_fields.end() || iter->second != value)
+			(*update.mutable_set())[key] = value;
+
+		fields.emplace(std::move(key), std::move(value));
+	}
+
+	for (const auto& [key, _] : m_fields)
+	{
+		if (fields.find(key) == fields.end())
+			update.add_removed(key);
+	}
+
+	// the first update is the whole state, after that nothing is sent if nothing changed
+	if (m_sequence > 0 && update.set().empty() && update.removed().empty())
+		return false;
+
+	m_fields = std::move(fields);
+	update.set_sequence(++m_sequence);
+	update.set_full(m_sequence == 1);
+
+	Address address;
+	address.Mailbox = m_name;
+	address.AbsoluteMailbox = true;
+	m_dropbox.Post(address, update);
+
+	return true;
+}
+
+void LuaSharedState::SendTo(uint32_t pid, const messaging::StateUpdate& update) const
+{
+	Address address;
+	address.PID = pid;
+	address.Mailbox = m_name;
+	address.AbsoluteMailbox = true;
+	m_dropbox.Post(address, update);
+}
+
+void LuaSharedState::SendFull(uint32_t pid) const
+{
+	messaging::StateUpdate update;
+	update.set_sequence(m_sequence);
+	update.set_full(true);
+
+	for (const auto& [key, value] : m_fields)
+		(*update.mutable_set())[key] = value;
+
+	SendTo(pid, update);
+}
+
+void LuaSharedState::Receive(const std::shared_ptr<Message>& message)
+{
+	if (!message || !message->Payload || !message->Sender || !message->Sender->PID)
+		return;
+
+	// our own state isn't replicated, the script already has it
+	const uint32_t pid = *message->Sender->PID;
+	if (pid == GetCurrentProcessId())
+		return;
+
+	messaging::StateUpdate update;
+	if (!update.ParseFromString(*message->Payload))
+		return;
+
+	if (update.resync())
+	{
+		if (m_sequence > 0)
+			SendFull(pid);
+		return;
+	}
+
+	if (update.closed())
+	{
+		auto iter = m_replicaInfo.find(pid);
+		if (iter != m_replicaInfo.end())
+		{
+			if (iter->second.key.valid())
+				m_replicas[iter->second.key] = sol::lua_nil;
+
+			m_replicaInfo.erase(iter);
+		}
+		return;
+	}
+
+	Replica& replica = m_replicaInfo[pid];
+	if (!update.full() && (replica.sequence == 0 || update.sequence() != replica.sequence + 1))
+	{
+		// we missed something (or joined late), everything until the full update is useless
+		if (!replica.resyncRequested)
+		{
+			messaging::StateUpdate request;
+			request.set_resync(true);
+			SendTo(pid, request);
+
+			replica.resyncRequested = true;
+		}
+		return;
+	}
+
+	if (!replica.key.valid())
+	{
+		const Address& sender = *message->Sender;
+		if (sender.Character)
+			replica.key = sol::make_object(m_thread.state(), *sender.Character);
+		else if (sender.Name)
+			replica.key = sol::make_object(m_thread.state(), *sender.Name);
+		else
+			replica.key = sol::make_object(m_thread.state(), pid);
+	}
+
+	Apply(replica, update);
+}
+
+void LuaSharedState::Apply(Replica& replica, const messaging::StateUpdate& update)
+{
+	lua_State* L = m_thread.state();
+
+	sol::table table = m_replicas[replica.key].get_or_create<sol::table>();
+	sol::stack::push(L, table);
+	const int index = lua_gettop(L);
+
+	// a full update replaces the replica in place, so scripts can keep a reference to it
+	if (update.full())
+	{
+		lua_pushnil(L);
+		while (lua_next(L, index) != 0)
+		{
+			lua_pop(L, 1);
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			lua_rawset(L, index);
+		}
+	}
+
+	for (const auto& [key, value] : update.set())
+	{
+		lua_pushlstring(L, key.data(), key.size());
+		DecodeCompactPayload(L, value);
+		lua_rawset(L, index);
+	}
+
+	for (const std::string& key : update.removed())
+	{
+		lua_pushlstring(L, key.data(), key.size());
+		lua_pushnil(L);
+		lua_rawset(L, index);
+	}
+
+	lua_settop(L, index - 1);
+
+	replica.sequence = update.sequence();
+	replica.resyncRequested = false;
+}
+
 void Send(sol::object payload)
 {
 	Send(sol::state_view(payload.lua_state()).create_table(), payload);
@@ -516,8 +827,7 @@ void Send(sol::table header, sol::object payload, sol::function response_callbac
 			[callback = callback.release()](int status, const std::shared_ptr<Message>& message)
 			{
 				callback->m_status = status;
-				callback->m_message.message = message;
-				callback->m_message.has_data = message && message->Payload && callback->m_message.data.ParseFromString(*message->Payload);
+				callback->m_message.SetMessage(message);
 				s_queue.push_back(std::unique_ptr<CallbackInstance>(callback));
 			});
 	}
@@ -580,7 +890,16 @@ sol::table LuaActors::RegisterLua(sol::state_view s)
 			sol::resolve<void(sol::object, sol::function)>(&LuaDropbox::Send),
 			sol::resolve<void(sol::table, sol::object) const>(&LuaDropbox::Send),
 			sol::resolve<void(sol::table, sol::object, sol::function)>(&LuaDropbox::Send)),
-		"unregister", &LuaDropbox::Unregister);
+		"unregister", &LuaDropbox::Unregister,
+		"subscribe", &LuaDropbox::Subscribe,
+		"unsubscribe", &LuaDropbox::Unsubscribe,
+		"compact", sol::property(&LuaDropbox::IsCompact, &LuaDropbox::SetCompact));
+
+	actors.new_usertype<LuaSharedState>(
+		"state", sol::no_constructor,
+		"publish", &LuaSharedState::Publish,
+		"replicas", sol::property(&LuaSharedState::GetReplicas),
+		"unregister", &LuaSharedState::Unregister);
 
 	actors.new_usertype<LuaMessage>(
 		"message", sol::no_constructor,
@@ -594,6 +913,7 @@ sol::table LuaActors::RegisterLua(sol::state_view s)
 
 	actors.set_function("register", sol::overload(&LuaDropbox::RegisterWithName, &LuaDropbox::Register));
 	actors.set_function("iter", &Iterator);
+	actors.set_function("state", &LuaSharedState::Register);
 	actors.set_function("send", sol::overload(
 		sol::resolve<void(sol::object)>(&Send),
 		sol::resolve<void(sol::object, sol::function)>(&Send),
@@ -604,7 +924,9 @@ sol::table LuaActors::RegisterLua(sol::state_view s)
 		"ConnectionClosed", postoffice::ResponseStatus::ConnectionClosed,
 		"NoConnection", postoffice::ResponseStatus::NoConnection,
 		"RoutingFailed", postoffice::ResponseStatus::RoutingFailed,
-		"AmbiguousRecipient", postoffice::ResponseStatus::AmbiguousRecipient);
+		"AmbiguousRecipient", postoffice::ResponseStatus::AmbiguousRecipient,
+		"Timeout", postoffice::ResponseStatus::Timeout,
+		"TooManyRequests", postoffice::ResponseStatus::TooManyRequests);
 
 	return actors;
 }
@@ -0,0 +1,632 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaActorPayload.h"
+
+#include "imgui.h"
+
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+namespace mq::lua {
+
+constexpr uint8_t PAYLOAD_MAGIC = 0x00;
+constexpr uint8_t PAYLOAD_VERSION = 1;
+
+// Deep enough for any real payload, shallow enough that a table that contains itself can't
+// take down the stack.
+constexpr int MAX_DEPTH = 32;
+
+// numbers, strings and key indices that fit in the tag
+constexpr uint8_t TAG_POSITIVE_FIXINT = 0x00;     // 0x00 - 0x7f: 0 to 127
+constexpr uint8_t TAG_FIXSTR = 0x80;              // 0x80 - 0x9f: strings shorter than 32 bytes
+constexpr uint8_t TAG_FIXKEY = 0xa0;              // 0xa0 - 0xbf: the first 32 interned keys
+constexpr uint8_t TAG_NEGATIVE_FIXINT = 0xe0;     // 0xe0 - 0xff: -32 to -1
+constexpr uint8_t TAG_FIX_MASK = 0xe0;
+
+constexpr uint8_t TAG_NIL = 0xc0;
+constexpr uint8_t TAG_FALSE = 0xc2;
+constexpr uint8_t TAG_TRUE = 0xc3;
+constexpr uint8_t TAG_INT32 = 0xc4;               // 4 bytes
+constexpr uint8_t TAG_DOUBLE = 0xc5;              // 8 bytes
+constexpr uint8_t TAG_STR = 0xc6;                 // varint length, then the bytes
+constexpr uint8_t TAG_KEY = 0xc7;                 // varint index of an interned key
+constexpr uint8_t TAG_ARRAY = 0xc8;               // varint count, then the values of 1 to count
+constexpr uint8_t TAG_MAP = 0xc9;                 // varint count, then key and value pairs
+constexpr uint8_t TAG_PACKED_INT32 = 0xca;        // varint count, then count * 4 bytes
+constexpr uint8_t TAG_PACKED_DOUBLE = 0xcb;       // varint count, then count * 8 bytes
+constexpr uint8_t TAG_IMVEC2 = 0xcc;              // 2 floats
+constexpr uint8_t TAG_IMVEC4 = 0xcd;              // 4 floats
+
+static bool IsInt32(lua_Number value)
+{
+	return value >= std::numeric_limits<int32_t>::min()
+		&& value <= std::numeric_limits<int32_t>::max()
+		&& static_cast<lua_Number>(static_cast<int32_t>(value)) == value;
+}
+
+// Tables are keyed by strings and array indices, same as the arr and entries of the proto Table.
+static bool IsSendableKey(lua_State* L, int index)
+{
+	switch (lua_type(L, index))
+	{
+	case LUA_TSTRING:
+		return true;
+
+	case LUA_TNUMBER:
+	{
+		const lua_Number key = lua_tonumber(L, index);
+		return key >= 0 && key <= std::numeric_limits<uint32_t>::max() && std::floor(key) == key;
+	}
+
+	default:
+		return false;
+	}
+}
+
+bool IsCompactPayload(std::string_view data)
+{
+	return data.size() >= 2
+		&& static_cast<uint8_t>(data[0]) == PAYLOAD_MAGIC
+		&& static_cast<uint8_t>(data[1]) == PAYLOAD_VERSION;
+}
+
+//----------------------------------------------------------------------------
+
+class PayloadWriter
+{
+public:
+	explicit PayloadWriter(lua_State* L)
+		: m_L(L)
+	{
+		WriteByte(PAYLOAD_MAGIC);
+		WriteByte(PAYLOAD_VERSION);
+	}
+
+	void WriteValue(int index, int depth)
+	{
+		switch (lua_type(m_L, index))
+		{
+		case LUA_TNUMBER:
+			WriteNumber(lua_tonumber(m_L, index));
+			break;
+
+		case LUA_TBOOLEAN:
+			WriteByte(lua_toboolean(m_L, index) ? TAG_TRUE : TAG_FALSE);
+			break;
+
+		case LUA_TSTRING:
+		{
+			size_t length = 0;
+			const char* str = lua_tolstring(m_L, index, &length);
+			WriteString(str, length);
+			break;
+		}
+
+		case LUA_TTABLE:
+			WriteTable(index, depth);
+			break;
+
+		case LUA_TUSERDATA:
+			WriteUserdata(index);
+			break;
+
+		default:
+			WriteByte(TAG_NIL);
+			break;
+		}
+	}
+
+	std::string Take() { return std::move(m_data); }
+
+private:
+	void WriteByte(uint8_t value) { m_data.push_back(static_cast<char>(value)); }
+	void WriteBytes(const void* data, size_t length) { m_data.append(static_cast<const char*>(data), length); }
+
+	void WriteVarint(uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			WriteByte(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+
+		WriteByte(static_cast<uint8_t>(value));
+	}
+
+	void WriteNumber(lua_Number value)
+	{
+		if (IsInt32(value))
+		{
+			const int32_t integer = static_cast<int32_t>(value);
+			if (integer >= 0 && integer <= 0x7f)
+			{
+				WriteByte(TAG_POSITIVE_FIXINT | static_cast<uint8_t>(integer));
+			}
+			else if (integer >= -32 && integer < 0)
+			{
+				WriteByte(static_cast<uint8_t>(integer));
+			}
+			else
+			{
+				WriteByte(TAG_INT32);
+				WriteBytes(&integer, sizeof(integer));
+			}
+		}
+		else
+		{
+			const double number = value;
+			WriteByte(TAG_DOUBLE);
+			WriteBytes(&number, sizeof(number));
+		}
+	}
+
+	void WriteString(const char* str, size_t length)
+	{
+		if (length < 32)
+		{
+			WriteByte(TAG_FIXSTR | static_cast<uint8_t>(length));
+		}
+		else
+		{
+			WriteByte(TAG_STR);
+			WriteVarint(length);
+		}
+
+		WriteBytes(str, length);
+	}
+
+	void WriteKey(int index)
+	{
+		if (lua_type(m_L, index) != LUA_TSTRING)
+		{
+			WriteNumber(lua_tonumber(m_L, index));
+			return;
+		}
+
+		// the key is owned by the table, which outlives the writer
+		size_t length = 0;
+		const char* str = lua_tolstring(m_L, index, &length);
+
+		auto [iter, added] = m_keys.emplace(std::string_view(str, length), static_cast<uint32_t>(m_keys.size()));
+		if (added)
+		{
+			WriteString(str, length);
+		}
+		else if (iter->second < 32)
+		{
+			WriteByte(TAG_FIXKEY | static_cast<uint8_t>(iter->second));
+		}
+		else
+		{
+			WriteByte(TAG_KEY);
+			WriteVarint(iter->second);
+		}
+	}
+
+	void WriteTable(int index, int depth)
+	{
+		if (depth >= MAX_DEPTH || !lua_checkstack(m_L, 3))
+		{
+			WriteByte(TAG_NIL);
+			return;
+		}
+
+		// Look the table over once to find out whether it is a sequence, and of what
+		const size_t length = lua_objlen(m_L, index);
+		size_t count = 0;
+		size_t keys = 0;
+		bool sequence = length > 0;
+		bool numbers = true;
+		bool integers = true;
+
+		lua_pushnil(m_L);
+		while (lua_next(m_L, index) != 0)
+		{
+			++count;
+
+			if (IsSendableKey(m_L, -2))
+				++keys;
+
+			if (sequence)
+			{
+				const lua_Number key = lua_type(m_L, -2) == LUA_TNUMBER ? lua_tonumber(m_L, -2) : 0;
+				sequence = key >= 1 && key <= length && std::floor(key) == key;
+			}
+
+			if (lua_type(m_L, -1) != LUA_TNUMBER)
+				numbers = integers = false;
+			else if (integers && !IsInt32(lua_tonumber(m_L, -1)))
+				integers = false;
+
+			lua_pop(m_L, 1);
+		}
+
+		// every key is one of 1 to length, and there are length of them, so none are missing
+		sequence = sequence && count == length;
+
+		if (sequence && numbers)
+		{
+			WriteByte(integers ? TAG_PACKED_INT32 : TAG_PACKED_DOUBLE);
+			WriteVarint(length);
+			m_data.reserve(m_data.size() + length * (integers ? sizeof(int32_t) : sizeof(double)));
+
+			for (size_t i = 1; i <= length; ++i)
+			{
+				lua_rawgeti(m_L, index, static_cast<int>(i));
+				const lua_Number value = lua_tonumber(m_L, -1);
+				lua_pop(m_L, 1);
+
+				if (integers)
+				{
+					const int32_t integer = static_cast<int32_t>(value);
+					WriteBytes(&integer, sizeof(integer));
+				}
+				else
+				{
+					const double number = value;
+					WriteBytes(&number, sizeof(number));
+				}
+			}
+		}
+		else if (sequence)
+		{
+			WriteByte(TAG_ARRAY);
+			WriteVarint(length);
+
+			for (size_t i = 1; i <= length; ++i)
+			{
+				lua_rawgeti(m_L, index, static_cast<int>(i));
+				WriteValue(lua_gettop(m_L), depth + 1);
+				lua_pop(m_L, 1);
+			}
+		}
+		else
+		{
+			WriteByte(TAG_MAP);
+			WriteVarint(keys);
+
+			lua_pushnil(m_L);
+			while (lua_next(m_L, index) != 0)
+			{
+				const int top = lua_gettop(m_L);
+				if (IsSendableKey(m_L, top - 1))
+				{
+					WriteKey(top - 1);
+					WriteValue(top, depth + 1);
+				}
+
+				lua_pop(m_L, 1);
+			}
+		}
+	}
+
+	void WriteUserdata(int index)
+	{
+		sol::stack_object object(m_L, index);
+
+		if (object.is<ImVec2>())
+		{
+			const ImVec2 vec = object.as<ImVec2>();
+			WriteByte(TAG_IMVEC2);
+			WriteBytes(&vec.x, sizeof(float));
+			WriteBytes(&vec.y, sizeof(float));
+		}
+		else if (object.is<ImVec4>())
+		{
+			const ImVec4 vec = object.as<ImVec4>();
+			WriteByte(TAG_IMVEC4);
+			WriteBytes(&vec.x, sizeof(float));
+			WriteBytes(&vec.y, sizeof(float));
+			WriteBytes(&vec.z, sizeof(float));
+			WriteBytes(&vec.w, sizeof(float));
+		}
+		else
+		{
+			WriteByte(TAG_NIL);
+		}
+	}
+
+	lua_State* m_L;
+	std::string m_data;
+	std::unordered_map<std::string_view, uint32_t> m_keys;
+};
+
+std::string EncodeCompactPayload(lua_State* L, int index)
+{
+	// the writer pushes while it walks tables, so it needs an index that doesn't move
+	if (index < 0 && index > LUA_REGISTRYINDEX)
+		index = lua_gettop(L) + index + 1;
+
+	PayloadWriter writer(L);
+	writer.WriteValue(index, 0);
+	return writer.Take();
+}
+
+//----------------------------------------------------------------------------
+
+// Everything read is checked against the end of the payload, since it came from another process.
+// Anything that doesn't add up fails the whole payload.
+class PayloadReader
+{
+public:
+	PayloadReader(lua_State* L, std::string_view data)
+		: m_L(L)
+		, m_pos(data.data())
+		, m_end(data.data() + data.size())
+	{
+	}
+
+	bool ReadValue(int depth, bool key = false)
+	{
+		uint8_t tag = 0;
+		if (!ReadBytes(&tag, sizeof(tag)))
+			return false;
+
+		if (tag < TAG_FIXSTR)
+		{
+			lua_pushnumber(m_L, tag);
+			return true;
+		}
+
+		if (tag >= TAG_NEGATIVE_FIXINT)
+		{
+			lua_pushnumber(m_L, static_cast<int8_t>(tag));
+			return true;
+		}
+
+		if ((tag & TAG_FIX_MASK) == TAG_FIXSTR)
+			return ReadString(tag & ~TAG_FIX_MASK, key);
+
+		if ((tag & TAG_FIX_MASK) == TAG_FIXKEY)
+			return PushKey(tag & ~TAG_FIX_MASK);
+
+		switch (tag)
+		{
+		case TAG_NIL:
+			lua_pushnil(m_L);
+			return true;
+
+		case TAG_FALSE:
+		case TAG_TRUE:
+			lua_pushboolean(m_L, tag == TAG_TRUE);
+			return true;
+
+		case TAG_INT32:
+		{
+			int32_t integer = 0;
+			if (!ReadBytes(&integer, sizeof(integer)))
+				return false;
+
+			lua_pushnumber(m_L, integer);
+			return true;
+		}
+
+		case TAG_DOUBLE:
+		{
+			double number = 0;
+			if (!ReadBytes(&number, sizeof(number)))
+				return false;
+
+			lua_pushnumber(m_L, number);
+			return true;
+		}
+
+		case TAG_STR:
+		{
+			size_t length = 0;
+			return ReadVarint(length) && ReadString(length, key);
+		}
+
+		case TAG_KEY:
+		{
+			size_t index = 0;
+			return ReadVarint(index) && PushKey(index);
+		}
+
+		case TAG_ARRAY:
+			return ReadArray(depth);
+
+		case TAG_MAP:
+			return ReadMap(depth);
+
+		case TAG_PACKED_INT32:
+			return ReadPacked<int32_t>(depth);
+
+		case TAG_PACKED_DOUBLE:
+			return ReadPacked<double>(depth);
+
+		case TAG_IMVEC2:
+		{
+			ImVec2 vec;
+			if (!ReadBytes(&vec.x, sizeof(float)) || !ReadBytes(&vec.y, sizeof(float)))
+				return false;
+
+			sol::stack::push(m_L, vec);
+			return true;
+		}
+
+		case TAG_IMVEC4:
+		{
+			ImVec4 vec;
+			if (!ReadBytes(&vec.x, sizeof(float)) || !ReadBytes(&vec.y, sizeof(float))
+				|| !ReadBytes(&vec.z, sizeof(float)) || !ReadBytes(&vec.w, sizeof(float)))
+			{
+				return false;
+			}
+
+			sol::stack::push(m_L, vec);
+			return true;
+		}
+
+		default:
+			return false;
+		}
+	}
+
+	bool AtEnd() const { return m_pos == m_end; }
+
+private:
+	size_t Remaining() const { return static_cast<size_t>(m_end - m_pos); }
+
+	bool ReadBytes(void* data, size_t length)
+	{
+		if (Remaining() < length)
+			return false;
+
+		memcpy(data, m_pos, length);
+		m_pos += length;
+		return true;
+	}
+
+	bool ReadVarint(size_t& value)
+	{
+		uint64_t result = 0;
+		for (int shift = 0; shift < 64 && m_pos != m_end; shift += 7)
+		{
+			const uint8_t byte = static_cast<uint8_t>(*m_pos++);
+			result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+
+			if ((byte & 0x80) == 0)
+			{
+				if (result > std::numeric_limits<size_t>::max())
+					return false;
+
+				value = static_cast<size_t>(result);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool ReadString(size_t length, bool key)
+	{
+		if (Remaining() < length)
+			return false;
+
+		// keys are interned in the order they are first written
+		if (key)
+			m_keys.emplace_back(m_pos, length);
+
+		lua_pushlstring(m_L, m_pos, length);
+		m_pos += length;
+		return true;
+	}
+
+	bool PushKey(size_t index)
+	{
+		if (index >= m_keys.size())
+			return false;
+
+		lua_pushlstring(m_L, m_keys[index].data(), m_keys[index].size());
+		return true;
+	}
+
+	// Reads a count of things that each take at least size bytes. A count that the rest of the
+	// payload can't hold is rejected before anything is allocated for it.
+	bool ReadCount(size_t& count, size_t size)
+	{
+		return ReadVarint(count)
+			&& count <= Remaining() / size
+			&& count <= static_cast<size_t>(std::numeric_limits<int>::max());
+	}
+
+	bool ReadArray(int depth)
+	{
+		size_t count = 0;
+		if (depth >= MAX_DEPTH || !lua_checkstack(m_L, 3) || !ReadCount(count, 1))
+			return false;
+
+		lua_createtable(m_L, static_cast<int>(count), 0);
+		for (size_t i = 1; i <= count; ++i)
+		{
+			if (!ReadValue(depth + 1))
+				return false;
+
+			lua_rawseti(m_L, -2, static_cast<int>(i));
+		}
+
+		return true;
+	}
+
+	template <typename T>
+	bool ReadPacked(int depth)
+	{
+		size_t count = 0;
+		if (depth >= MAX_DEPTH || !lua_checkstack(m_L, 2) || !ReadCount(count, sizeof(T)))
+			return false;
+
+		lua_createtable(m_L, static_cast<int>(count), 0);
+		for (size_t i = 1; i <= count; ++i)
+		{
+			T value;
+			memcpy(&value, m_pos, sizeof(T));
+			m_pos += sizeof(T);
+
+			lua_pushnumber(m_L, static_cast<lua_Number>(value));
+			lua_rawseti(m_L, -2, static_cast<int>(i));
+		}
+
+		return true;
+	}
+
+	bool ReadMap(int depth)
+	{
+		size_t count = 0;
+		if (depth >= MAX_DEPTH || !lua_checkstack(m_L, 4) || !ReadCount(count, 2))
+			return false;
+
+		lua_createtable(m_L, 0, static_cast<int>(count));
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!ReadValue(depth + 1, true) || !ReadValue(depth + 1))
+				return false;
+
+			// a nil or NaN key would raise an error, the writer never sends one
+			if (lua_isnil(m_L, -2) || (lua_type(m_L, -2) == LUA_TNUMBER && std::isnan(lua_tonumber(m_L, -2))))
+				return false;
+
+			lua_rawset(m_L, -3);
+		}
+
+		return true;
+	}
+
+	lua_State* m_L;
+	const char* m_pos;
+	const char* m_end;
+	std::vector<std::string_view> m_keys;
+};
+
+bool DecodeCompactPayload(lua_State* L, std::string_view data)
+{
+	const int top = lua_gettop(L);
+
+	if (IsCompactPayload(data) && lua_checkstack(L, 4))
+	{
+		PayloadReader reader(L, data.substr(2));
+		if (reader.ReadValue(0) && reader.AtEnd())
+			return true;
+	}
+
+	lua_settop(L, top);
+	lua_pushnil(L);
+	return false;
+}
+
+} // namespace mq::lua
@@ -0,0 +1,47 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+
+struct lua_State;
+
+namespace mq::lua {
+
+// A compact encoding of actor payloads, as an alternative to the Variant message of Actor.proto.
+// It is modelled on MessagePack: every value is a one byte tag, small numbers and short strings
+// fit in the tag, and tables are written straight from (and read straight onto) the Lua stack
+// without building any intermediate objects. On top of that:
+//
+//  * table keys are interned, a key that was already written in the payload is sent as its index
+//  * sequences of numbers are packed as contiguous int32s or doubles
+//
+// The payload starts with a zero byte, which can't start a serialized Variant, so receivers can
+// always tell the two encodings apart.
+
+// Returns true if the payload was written by EncodeCompactPayload.
+bool IsCompactPayload(std::string_view data);
+
+// Encodes the value at index of the stack of L. Values that can't be sent (functions, threads,
+// unknown userdata, tables nested too deep) are sent as nil. Like the proto encoding, entries
+// with keys that aren't strings or array indices are left out.
+std::string EncodeCompactPayload(lua_State* L, int index);
+
+// Pushes the value in the payload onto the stack of L. Returns false, with nil pushed instead, if
+// the payload is malformed.
+bool DecodeCompactPayload(lua_State* L, std::string_view data);
+
+} // namespace mq::lua
@@ -0,0 +1,164 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaBytecodeCache.h"
+
+#include <mq/Plugin.h>
+
+#include <luajit.h>
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+
+namespace mq::lua {
+
+constexpr uint32_t CACHE_MAGIC = 0x43424c4d;       // "MLBC"
+constexpr uint32_t CACHE_VERSION = 1;
+
+// Followed by the path of the file (so two paths with the same hash don't share an entry) and then
+// the bytecode.
+struct CacheHeader
+{
+	uint32_t magic = CACHE_MAGIC;
+	uint32_t version = CACHE_VERSION;
+	uint32_t luajitVersion = LUAJIT_VERSION_NUM;
+	uint32_t pointerSize = sizeof(void*);            // the bytecode of x86 and x64 differs
+	int64_t modifiedTime = 0;
+	uint64_t fileSize = 0;
+	uint32_t pathLength = 0;
+	uint32_t bytecodeLength = 0;
+};
+
+static uint64_t HashPath(std::string_view path)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (char ch : path)
+	{
+		hash ^= static_cast<uint8_t>(std::tolower(static_cast<unsigned char>(ch)));
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static bool ReadEntry(const std::filesystem::path& entryPath, const CacheHeader& expected,
+	const std::string& path, std::string& bytecode)
+{
+	std::ifstream file(entryPath, std::ios::binary);
+	if (!file)
+		return false;
+
+	CacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+		|| header.magic != expected.magic
+		|| header.version != expected.version
+		|| header.luajitVersion != expected.luajitVersion
+		|| header.pointerSize != expected.pointerSize
+		|| header.modifiedTime != expected.modifiedTime
+		|| header.fileSize != expected.fileSize
+		|| header.pathLength != path.length())
+	{
+		return false;
+	}
+
+	std::string entryFor(header.pathLength, '\0');
+	if (!file.read(entryFor.data(), entryFor.length()) || !ci_equals(entryFor, path))
+		return false;
+
+	bytecode.resize(header.bytecodeLength);
+	return static_cast<bool>(file.read(bytecode.data(), bytecode.length()));
+}
+
+static void WriteEntry(const std::filesystem::path& entryPath, CacheHeader header,
+	const std::string& path, const std::string& bytecode)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(entryPath.parent_path(), ec);
+
+	// Other clients may be reading the entry, so it is written next to it and moved over it.
+	std::filesystem::path tempPath = entryPath;
+	tempPath += fmt::format(".{}.tmp", GetCurrentProcessId());
+
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return;
+
+		header.pathLength = static_cast<uint32_t>(path.length());
+		header.bytecodeLength = static_cast<uint32_t>(bytecode.length());
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(path.data(), path.length());
+		file.write(bytecode.data(), bytecode.length());
+
+		if (!file)
+		{
+			file.close();
+			std::filesystem::remove(tempPath, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tempPath, entryPath, ec);
+	if (ec)
+		std::filesystem::remove(tempPath, ec);
+}
+
+static int lua_dumpWriter(lua_State*, const void* data, size_t size, void* userdata)
+{
+	static_cast<std::string*>(userdata)->append(static_cast<const char*>(data), size);
+	return 0;
+}
+
+sol::load_result LuaBytecodeCache::LoadFile(sol::state_view sv, const std::string& path, const std::string& cacheDir)
+{
+	std::error_code ec;
+	const auto modifiedTime = std::filesystem::last_write_time(path, ec);
+	const uintmax_t fileSize = ec ? 0 : std::filesystem::file_size(path, ec);
+	if (ec || cacheDir.empty())
+		return sv.load_file(path);
+
+	CacheHeader header;
+	header.modifiedTime = static_cast<int64_t>(modifiedTime.time_since_epoch().count());
+	header.fileSize = static_cast<uint64_t>(fileSize);
+
+	const std::filesystem::path entryPath = std::filesystem::path(cacheDir) / fmt::format("{:016x}.ljbc", HashPath(path));
+	const std::string chunkName = "@" + path;
+
+	std::string bytecode;
+	if (ReadEntry(entryPath, header, path, bytecode))
+	{
+		sol::load_result result = sv.load(std::string_view(bytecode), chunkName, sol::load_mode::binary);
+		if (result.valid())
+			return result;
+	}
+
+	sol::load_result result = sv.load_file(path);
+	if (result.valid())
+	{
+		bytecode.clear();
+
+		lua_State* L = sv.lua_state();
+		lua_pushvalue(L, result.stack_index());
+		if (lua_dump(L, &lua_dumpWriter, &bytecode) == 0)
+			WriteEntry(entryPath, header, path, bytecode);
+		lua_pop(L, 1);
+	}
+
+	return result;
+}
+
+} // namespace mq::lua
@@ -0,0 +1,34 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "LuaCommon.h"
+
+#include <string>
+
+namespace mq::lua {
+
+// Keeps the bytecode of the lua files that scripts run and require in a directory (.luacache in the
+// lua directory), so a file is only compiled once for every client on the machine until it changes.
+// An entry is used while the size and modification time of the file match what it was compiled
+// from, and it was compiled by the same LuaJIT for the same architecture.
+class LuaBytecodeCache
+{
+public:
+	// Like load_file, but through the cache. Files that fail to compile aren't cached.
+	static sol::load_result LoadFile(sol::state_view sv, const std::string& path, const std::string& cacheDir);
+};
+
+} // namespace mq::lua
@@ -79,6 +79,11 @@ public:
 	std::string moduleDir;
 	std::vector<std::string> luaRequirePaths;
 	std::vector<std::string> dllRequirePaths;
+	uint32_t scriptsPerSharedState = 16;
+	bool bytecodeCache = true;
+
+	// Where LuaBytecodeCache keeps its entries, empty when the cache is turned off.
+	std::string GetBytecodeCacheDir() const { return bytecodeCache ? luaDir + "\\.luacache" : std::string(); }
 
 private:
 	bool GetScriptLocationInfo(std::string_view script, const std::string& searchDir, ScriptLocationInfo& info) const;
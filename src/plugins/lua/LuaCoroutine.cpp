@@ -15,6 +15,7 @@
 #include "pch.h"
 #include "LuaCoroutine.h"
 #include "LuaThread.h"
+#include "LuaWorker.h"
 
 #include <mq/Plugin.h>
 
@@ -100,6 +101,52 @@ bool LuaCoroutine::CheckCondition(std::optional<sol::function>& func)
 	return false;
 }
 
+static uint32_t GetWakeEvent(std::string_view name)
+{
+	if (ci_equals(name, "target")) return LuaWakeEvent_Target;
+	if (ci_equals(name, "cast")) return LuaWakeEvent_Cast;
+	if (ci_equals(name, "buff")) return LuaWakeEvent_Buff;
+	if (ci_equals(name, "actor")) return LuaWakeEvent_Actor;
+	if (ci_equals(name, "chat")) return LuaWakeEvent_Chat;
+	if (ci_equals(name, "zone")) return LuaWakeEvent_Zone;
+	if (ci_equals(name, "roster")) return LuaWakeEvent_Roster;
+	if (ci_equals(name, "xtarget")) return LuaWakeEvent_XTarget;
+	if (ci_equals(name, "task")) return LuaWakeEvent_Task;
+	if (ci_equals(name, "advloot")) return LuaWakeEvent_AdvLoot;
+	if (ci_equals(name, "spawnbuff")) return LuaWakeEvent_SpawnBuff;
+	if (ci_equals(name, "pet")) return LuaWakeEvent_Pet;
+	if (ci_equals(name, "mercenary")) return LuaWakeEvent_Mercenary;
+
+	return LuaWakeEvent_None;
+}
+
+// The condition of a delay can be the name of an event to wait on, or a table of them.
+static uint32_t ParseWakeEvents(const sol::object& conditionObj, sol::state_view s)
+{
+	uint32_t events = LuaWakeEvent_None;
+	auto add = [&](const sol::object& nameObj)
+	{
+		auto name = nameObj.as<std::optional<std::string_view>>();
+		uint32_t event = name ? GetWakeEvent(*name) : LuaWakeEvent_None;
+		if (event == LuaWakeEvent_None)
+			luaL_error(s, "Invalid event passed to mq.delay, expected target, cast, buff, actor, chat, zone, roster, xtarget, task, advloot, spawnbuff, pet or mercenary");
+
+		events |= event;
+	};
+
+	if (conditionObj.get_type() == sol::type::table)
+	{
+		for (const auto& [_, nameObj] : conditionObj.as<sol::table>())
+			add(nameObj);
+	}
+	else
+	{
+		add(conditionObj);
+	}
+
+	return events;
+}
+
 void LuaCoroutine::Delay(sol::object delayObj, std::optional<sol::object> conditionObj, sol::state_view s)
 {
 	using namespace std::chrono_literals;
@@ -136,10 +183,22 @@ void LuaCoroutine::Delay(sol::object delayObj, std::optional<sol::object> condit
 	{
 		uint64_t delay_ms = std::max(0ms, std::chrono::milliseconds(*delay_int)).count();
 		std::optional<sol::function> condition;
-		if (conditionObj)
-			condition = conditionObj->as<std::optional<sol::function>>();
+		uint32_t wakeEvents = LuaWakeEvent_None;
+		std::function<bool()> nativeCondition;
+		if (conditionObj && conditionObj->get_type() == sol::type::function)
+		{
+			condition = conditionObj->as<sol::function>();
+		}
+		else if (conditionObj && conditionObj->is<LuaWorkerFuture>())
+		{
+			nativeCondition = [future = conditionObj->as<LuaWorkerFuture>()]() { return future.IsDone(); };
+		}
+		else if (conditionObj && conditionObj->valid() && conditionObj->get_type() != sol::type::lua_nil)
+		{
+			wakeEvents = ParseWakeEvents(*conditionObj, s);
+		}
 
-		SetDelay(delay_ms + MQGetTickCount64(), condition);
+		SetDelay(delay_ms + MQGetTickCount64(), condition, wakeEvents, std::move(nativeCondition));
 	}
 	else
 	{
@@ -147,17 +206,21 @@ void LuaCoroutine::Delay(sol::object delayObj, std::optional<sol::object> condit
 	}
 }
 
-void LuaCoroutine::SetDelay(uint64_t time, std::optional<sol::function> condition /* = std::nullopt */)
+void LuaCoroutine::SetDelay(uint64_t time, std::optional<sol::function> condition /* = std::nullopt */,
+	uint32_t wakeEvents /* = LuaWakeEvent_None */, std::function<bool()> nativeCondition /* = nullptr */)
 {
 	if (luaThread == nullptr)
 		return;
 
-	if (time > MQGetTickCount64() && !CheckCondition(condition))
+	if (time > MQGetTickCount64() && !(nativeCondition && nativeCondition()) && !CheckCondition(condition))
 	{
 		luaThread->DoYield();
 		//lua_yield(coroutine.lua_state(), 0); // only yield from the current coroutine
 		m_delayTime = time;
 		m_delayCondition = condition;
+		m_wakeEvents = wakeEvents;
+		m_woken = false;
+		m_nativeCondition = std::move(nativeCondition);
 	}
 }
 
@@ -165,6 +228,9 @@ void LuaCoroutine::ClearDelay()
 {
 	m_delayTime = 0L;
 	m_delayCondition = std::nullopt;
+	m_wakeEvents = LuaWakeEvent_None;
+	m_woken = false;
+	m_nativeCondition = nullptr;
 }
 
 bool LuaCoroutine::ShouldRun()
@@ -175,7 +241,8 @@ bool LuaCoroutine::ShouldRun()
 	}
 
 	// check delayed status
-	if (m_delayTime <= MQGetTickCount64() || CheckCondition(m_delayCondition))
+	if (m_woken || m_delayTime <= MQGetTickCount64() || (m_nativeCondition && m_nativeCondition())
+		|| CheckCondition(m_delayCondition))
 	{
 		ClearDelay();
 		return true;
@@ -18,10 +18,32 @@
 
 #include <sol/sol.hpp>
 
+#include <functional>
+
 namespace mq::lua {
 
 class LuaThread;
 
+// Things that happen natively which can end a delay early, instead of a condition that is checked
+// every frame. See mq.delay.
+enum LuaWakeEvent : uint32_t
+{
+	LuaWakeEvent_None      = 0,
+	LuaWakeEvent_Target    = 1 << 0,   // the target changed
+	LuaWakeEvent_Cast      = 1 << 1,   // we started or stopped casting
+	LuaWakeEvent_Buff      = 1 << 2,   // a buff landed on us or faded
+	LuaWakeEvent_Actor     = 1 << 3,   // an actor of the script got a message
+	LuaWakeEvent_Chat      = 1 << 4,   // an mq.event of the script matched a line
+	LuaWakeEvent_Zone      = 1 << 5,   // we finished zoning
+	LuaWakeEvent_Roster    = 1 << 6,   // the group or raid members changed
+	LuaWakeEvent_XTarget   = 1 << 7,   // an extended target slot or its aggro changed
+	LuaWakeEvent_Task      = 1 << 8,   // a task objective progressed
+	LuaWakeEvent_AdvLoot   = 1 << 9,   // items were added to or removed from the advanced loot lists
+	LuaWakeEvent_SpawnBuff = 1 << 10,  // a spawn gained or lost a cached buff, or one is about to run out
+	LuaWakeEvent_Pet       = 1 << 11,  // the pet, its target, health, stance, toggles or buffs changed
+	LuaWakeEvent_Mercenary = 1 << 12,  // the mercenary, its state, stance or health changed
+};
+
 struct LuaCoroutine
 {
 	LuaThread* luaThread;
@@ -30,13 +52,30 @@ struct LuaCoroutine
 	sol::thread thread;
 	uint64_t m_delayTime = 0L;
 	std::optional<sol::function> m_delayCondition = std::nullopt;
+	uint32_t m_wakeEvents = LuaWakeEvent_None;
+	bool m_woken = false;
+
+	// A check that doesn't call into lua and so is cheap enough to make every frame, like whether
+	// an mq.worker has finished.
+	std::function<bool()> m_nativeCondition;
 
 	bool CheckCondition(std::optional<sol::function>& func);
 	void Delay(sol::object delayObj, std::optional<sol::object> conditionObj, sol::state_view s);
-	void SetDelay(uint64_t time, std::optional<sol::function> condition = std::nullopt);
+	void SetDelay(uint64_t time, std::optional<sol::function> condition = std::nullopt,
+		uint32_t wakeEvents = LuaWakeEvent_None, std::function<bool()> nativeCondition = nullptr);
 	void ClearDelay();
 
+	// Ends the delay if it is waiting on any of the events.
+	void Wake(uint32_t events) { if (m_wakeEvents & events) m_woken = true; }
+
 	bool ShouldRun();
+
+	// Waiting on a delay that hasn't expired, and that has no condition that could end it early.
+	bool IsSleeping() const
+	{
+		return !m_delayCondition && !m_woken && m_delayTime > MQGetTickCount64()
+			&& !(m_nativeCondition && m_nativeCondition());
+	}
 	CoroutineResult RunCoroutine();
 	CoroutineResult RunCoroutine(const std::vector<std::string>& args);
 	CoroutineResult RunCoroutine(const std::vector<sol::object>& args);
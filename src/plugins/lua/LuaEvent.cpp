@@ -37,10 +37,100 @@ static unsigned int CALLBACK LuaVarProcess(char* VarName, char* Value, size_t Va
 
 //----------------------------------------------------------------------------
 
+LuaEventMatcher::LuaEventMatcher()
+	: m_blech(std::make_unique<Blech>('#', '|', LuaVarProcess))
+	, m_blechStripped(std::make_unique<Blech>('#', '|', LuaVarProcess))
+{
+}
+
+LuaEventMatcher& LuaEventMatcher::Get()
+{
+	static LuaEventMatcher s_matcher;
+	return s_matcher;
+}
+
+void LuaEventMatcher::Process(const char* szLine)
+{
+	if (szLine == nullptr || (m_blech->IsEmpty() && m_blechStripped->IsEmpty()))
+		return;
+
+	std::string_view line{ szLine };
+	if (line.size() >= MAX_STRING)
+		return;
+
+	// StripMQChat terminates what it writes, so these don't need to be cleared for every line
+	char line_char[MAX_STRING];
+	char line_char_stripped[MAX_STRING];
+
+	m_currentLineStripped = nullptr;
+	m_currentLine = nullptr;
+
+	// Split event handling by whether we have links in the string or not. If there are no links in
+	// the string then this is much simpler.
+	if (line.find_first_of("\x12\a\n") == std::string::npos)
+	{
+		// Nothing to strip, so the line can be fed as it is.
+		m_currentLineStripped = szLine;
+		m_currentLine = szLine;
+	}
+	else if (line.find_first_of('\x12') == std::string::npos)
+	{
+		StripMQChat(line, line_char);
+
+		m_currentLineStripped = line_char;
+		m_currentLine = line_char;
+	}
+	else
+	{
+		// We have links in the string. Do the minimal amount of work required based on what kinds of
+		// events have been registered.
+
+		// Check if we need to keep both the stripped and unstripped links.
+		if (!m_blech->IsEmpty() && !m_blechStripped->IsEmpty())
+		{
+			StripMQChat(line, line_char);
+			m_currentLine = line_char;
+
+			StripMQChat(ParseChatLinks(line)->cleaned, line_char_stripped);
+			m_currentLineStripped = line_char_stripped;
+		}
+		else if (!m_blech->IsEmpty())
+		{
+			StripMQChat(line, line_char);
+
+			m_currentLine = line_char;
+			m_currentLineStripped = line_char;
+		}
+		else if (!m_blechStripped->IsEmpty())
+		{
+			StripMQChat(ParseChatLinks(line)->cleaned, line_char_stripped);
+
+			m_currentLineStripped = line_char_stripped;
+			m_currentLine = line_char_stripped;
+		}
+	}
+
+	// just in case we get an overflow, re-set the last character to 0
+	line_char[MAX_STRING - 1] = 0;
+	line_char_stripped[MAX_STRING - 1] = 0;
+
+	if (!m_blech->IsEmpty() && m_currentLine != nullptr)
+	{
+		m_blech->Feed(m_currentLine, MAX_STRING);
+	}
+	if (!m_blechStripped->IsEmpty() && m_currentLineStripped != nullptr)
+	{
+		m_blechStripped->Feed(m_currentLineStripped, MAX_STRING);
+	}
+
+	m_currentLineStripped = nullptr;
+	m_currentLine = nullptr;
+}
+
+//----------------------------------------------------------------------------
+
 LuaEventProcessor::LuaEventProcessor(LuaThread* thread)
 	: m_thread(thread)
-	, m_blech(std::make_unique<Blech>('#', '|', LuaVarProcess))
-	, m_blechStripped(std::make_unique<Blech>('#', '|', LuaVarProcess))
 {
 }
 
@@ -117,87 +207,51 @@ bool LuaEventProcessor::RemoveBind(std::string_view name)
 	return false;
 }
 
-void LuaEventProcessor::Process(std::string_view line)
+bool LuaEventProcessor::AddSpawnTrigger(std::string_view name, float radius, std::string_view search,
+	const sol::function& function)
 {
-	if (!m_thread->IsValid())
-		return;
-	if (m_eventDefinitions.empty())
-		return;
-	if (line.size() >= MAX_STRING)
-		return;
-
-	char line_char[MAX_STRING] = { 0 };
-	char line_char_stripped[MAX_STRING] = { 0 };
-
-	m_currentLineStripped = nullptr;
-	m_currentLine = nullptr;
+	auto it = std::find_if(m_spawnTriggerDefinitions.begin(), m_spawnTriggerDefinitions.end(),
+		[&name](const std::unique_ptr<LuaSpawnTrigger>& trigger) { return trigger->GetName() == name; });
 
-	// Split event handling by whether we have links in the string or not. If there are no links in
-	// the string then this is much simpler.
-	if (line.find_first_of('\x12') == std::string::npos)
+	if (it != m_spawnTriggerDefinitions.end())
 	{
-		StripMQChat(line, line_char);
-
-		m_currentLineStripped = line_char;
-		m_currentLine = line_char;
+		LuaError("Cannot create spawn trigger %.*s, it is already defined.", name.length(), name.data());
+		return false;
 	}
-	else
-	{
-		// We have links in the string. Do the minimal amount of work required based on what kinds of
-		// events have been registered.
-
-		// Check if we need to keep both the stripped and unstripped links.
-		if (!m_blech->IsEmpty() && !m_blechStripped->IsEmpty())
-		{
-			StripMQChat(line, line_char);
-			m_currentLine = line_char;
 
-			CXStr line_str(line);
-			line_str = CleanItemTags(line_str, false);
-			StripMQChat(line_str, line_char_stripped);
-			m_currentLineStripped = line_char_stripped;
-		}
-		else if (!m_blech->IsEmpty())
-		{
-			StripMQChat(line, line_char);
-
-			m_currentLine = line_char;
-			m_currentLineStripped = line_char;
-		}
-		else if (!m_blechStripped->IsEmpty())
-		{
-			CXStr line_str(line);
-			line_str = CleanItemTags(line_str, false);
-			StripMQChat(line_str, line_char_stripped);
-
-			m_currentLineStripped = line_char_stripped;
-			m_currentLine = line_char_stripped;
-		}
+	auto trigger = std::make_unique<LuaSpawnTrigger>(name, radius, search, function, this);
+	if (!trigger->IsValid())
+	{
+		LuaError("Cannot create spawn trigger %.*s, the radius must be positive.", name.length(), name.data());
+		return false;
 	}
 
-	// since we initialized to 0, we know that any remaining members will be 0, so just in case we
-	// get an overflow, re-set the last character to 0
-	line_char[MAX_STRING - 1] = 0;
-	line_char_stripped[MAX_STRING - 1] = 0;
+	m_spawnTriggerDefinitions.push_back(std::move(trigger));
+	return true;
+}
 
-	if (!m_blech->IsEmpty() && m_currentLine != nullptr)
-	{
-		m_blech->Feed(m_currentLine, MAX_STRING);
-	}
-	if (!m_blechStripped->IsEmpty() && m_currentLineStripped != nullptr)
+bool LuaEventProcessor::RemoveSpawnTrigger(std::string_view name)
+{
+	m_spawnTriggersPending.erase(std::remove_if(m_spawnTriggersPending.begin(), m_spawnTriggersPending.end(),
+		[&name](LuaEventInstance<LuaSpawnTrigger>& t) { return t.definition->GetName() == name; }),
+		m_spawnTriggersPending.end());
+
+	auto it = std::find_if(m_spawnTriggerDefinitions.begin(), m_spawnTriggerDefinitions.end(),
+		[&name](const std::unique_ptr<LuaSpawnTrigger>& trigger) { return trigger->GetName() == name; });
+	if (it != m_spawnTriggerDefinitions.end())
 	{
-		m_blechStripped->Feed(m_currentLineStripped, MAX_STRING);
+		m_spawnTriggerDefinitions.erase(it);
+		return true;
 	}
 
-	m_currentLineStripped = nullptr;
-	m_currentLine = nullptr;
+	return false;
 }
 
 void LuaEventProcessor::HandleBlechEvent(LuaEvent* pEvent, BLECHVALUE* pValues)
 {
 	std::vector<std::pair<uint32_t, std::string>> args;
 
-	const char* line = pEvent->KeepLinks() ? m_currentLine : m_currentLineStripped;
+	const char* line = LuaEventMatcher::Get().GetCurrentLine(pEvent->KeepLinks());
 	args.emplace_back(0, line ? line : "");
 
 	auto value = pValues;
@@ -223,6 +277,17 @@ void LuaEventProcessor::HandleBlechEvent(LuaEvent* pEvent, BLECHVALUE* pValues)
 
 		m_eventsPending.emplace_back(pEvent, std::move(ordered_args));
 	}
+
+	m_thread->Wake(LuaWakeEvent_Chat);
+}
+
+void LuaEventProcessor::Wake(uint32_t events)
+{
+	for (const auto& running : m_eventsRunning)
+		running->coroutine->Wake(events);
+
+	for (const auto& running : m_bindsRunning)
+		running->coroutine->Wake(events);
 }
 
 static void loop_and_run(LuaThread& thread, std::vector<std::shared_ptr<LuaEventFunction>>& vec)
@@ -312,6 +377,13 @@ void LuaEventProcessor::PrepareBinds()
 	}
 
 	m_bindsPending.clear();
+
+	for (auto& t : m_spawnTriggersPending)
+	{
+		emplace_running(m_bindsRunning, t);
+	}
+
+	m_spawnTriggersPending.clear();
 }
 
 void LuaEventProcessor::RemoveBinds(const std::vector<std::string>& binds)
@@ -342,6 +414,16 @@ void LuaEventProcessor::HandleBindCallback(LuaBind* bind, const char* args)
 	}
 }
 
+void LuaEventProcessor::HandleSpawnTrigger(LuaSpawnTrigger* trigger, const MQSpawnTriggerEvent& event)
+{
+	if (!m_thread->IsValid() || m_thread->IsPaused())
+		return;
+
+	// The handler is called with ("enter" or "leave", spawn id, trigger name)
+	m_spawnTriggersPending.emplace_back(trigger, std::vector<std::string>{
+		event.Entered ? "enter" : "leave", std::to_string(event.SpawnID), std::string(trigger->GetName()) });
+}
+
 //============================================================================
 
 void CALLBACK LuaEventCallback(unsigned int ID, void* pData, BLECHVALUE* pValues)
@@ -351,7 +433,13 @@ void CALLBACK LuaEventCallback(unsigned int ID, void* pData, BLECHVALUE* pValues
 
 	auto def = static_cast<LuaEvent*>(pData);
 
-	def->GetEventProcessor()->HandleBlechEvent(def, pValues);
+	// Events of every script share the matcher, so skip the ones whose script isn't listening.
+	LuaEventProcessor* processor = def->GetEventProcessor();
+	LuaThread* thread = processor->GetThread();
+	if (!thread->IsValid() || thread->IsPaused())
+		return;
+
+	processor->HandleBlechEvent(def, pValues);
 }
 
 LuaEvent::LuaEvent(std::string_view name, std::string_view expression,
@@ -369,7 +457,8 @@ LuaEvent::LuaEvent(std::string_view name, std::string_view expression,
 		m_keepLinks = optionsTable.get_or("keepLinks", false);
 	}
 
-	m_blech = m_keepLinks ? &processor->GetBlech() : &processor->GetBlechStripped();
+	LuaEventMatcher& matcher = LuaEventMatcher::Get();
+	m_blech = m_keepLinks ? &matcher.GetBlech() : &matcher.GetBlechStripped();
 	m_id = m_blech->AddEvent(m_expression.c_str(), LuaEventCallback, this);
 }
 
@@ -396,6 +485,31 @@ LuaBind::~LuaBind()
 	RemoveCommand(m_name.c_str());
 }
 
+//============================================================================
+
+LuaSpawnTrigger::LuaSpawnTrigger(std::string_view name, float radius, std::string_view search,
+	const sol::function& func, LuaEventProcessor* processor)
+	: m_name(name)
+	, m_function(func)
+	, m_processor(processor)
+{
+	MQSpawnSearch spawnSearch;
+	ClearSearchSpawn(&spawnSearch);
+	ParseSearchSpawn(std::string(search).c_str(), &spawnSearch);
+
+	m_triggerId = mq::AddSpawnTrigger(m_name.c_str(), spawnSearch, radius,
+		[this](const MQSpawnTriggerEvent& event)
+		{
+			this->GetEventProcessor()->HandleSpawnTrigger(this, event);
+		});
+}
+
+LuaSpawnTrigger::~LuaSpawnTrigger()
+{
+	if (m_triggerId != 0)
+		mq::RemoveSpawnTrigger(m_triggerId);
+}
+
 //----------------------------------------------------------------------------
 
 template<> LuaEventFunction::LuaEventFunction(LuaEventInstance<LuaBind>& instance)
@@ -407,6 +521,15 @@ template<> LuaEventFunction::LuaEventFunction(LuaEventInstance<LuaBind>& instanc
 	coroutine->coroutine = sol::coroutine(solThreadInfo.second.state(), instance.definition->GetFunction());
 }
 
+template<> LuaEventFunction::LuaEventFunction(LuaEventInstance<LuaSpawnTrigger>& instance)
+	: luaThread(instance.definition->GetEventProcessor()->GetThread())
+	, solThreadInfo(luaThread->CreateThread())
+	, coroutine(LuaCoroutine::Create(solThreadInfo.second, luaThread))
+	, args(std::move(instance.args))
+{
+	coroutine->coroutine = sol::coroutine(solThreadInfo.second.state(), instance.definition->GetFunction());
+}
+
 template<> LuaEventFunction::LuaEventFunction(LuaEventInstance<LuaEvent>& instance)
 	: luaThread(instance.definition->GetEventProcessor()->GetThread())
 	, solThreadInfo(luaThread->CreateThread())
@@ -75,6 +75,29 @@ private:
 
 //----------------------------------------------------------------------------
 
+class LuaSpawnTrigger
+{
+public:
+	LuaSpawnTrigger(std::string_view name, float radius, std::string_view search, const sol::function& func,
+		LuaEventProcessor* processor);
+	~LuaSpawnTrigger();
+
+	LuaEventProcessor* GetEventProcessor() { return m_processor; }
+
+	std::string_view GetName() const { return m_name; }
+	const sol::function GetFunction() const { return m_function; }
+
+	bool IsValid() const { return m_triggerId != 0; }
+
+private:
+	const std::string m_name;
+	const sol::function m_function;
+	LuaEventProcessor* m_processor;
+	int m_triggerId = 0;
+};
+
+//----------------------------------------------------------------------------
+
 template <typename T>
 struct LuaEventInstance
 {
@@ -108,6 +131,32 @@ struct LuaEventFunction
 
 //----------------------------------------------------------------------------
 
+// Matches lines against the events of every running script. All events are registered with the
+// same pair of Blech instances, so each line is scanned once no matter how many scripts listen.
+class LuaEventMatcher
+{
+public:
+	static LuaEventMatcher& Get();
+
+	void Process(const char* line);
+
+	// The line being fed, with or without links, while events are dispatched. Otherwise nullptr.
+	const char* GetCurrentLine(bool keepLinks) const { return keepLinks ? m_currentLine : m_currentLineStripped; }
+
+	Blech& GetBlech() { return *m_blech; }
+	Blech& GetBlechStripped() { return *m_blechStripped; }
+
+private:
+	LuaEventMatcher();
+
+	std::unique_ptr<Blech> m_blech;
+	std::unique_ptr<Blech> m_blechStripped;
+	const char* m_currentLineStripped = nullptr;
+	const char* m_currentLine = nullptr;
+};
+
+//----------------------------------------------------------------------------
+
 class LuaEventProcessor
 {
 public:
@@ -121,7 +170,8 @@ public:
 	bool AddBind(std::string_view name, const sol::function& function);
 	bool RemoveBind(std::string_view name);
 
-	void Process(std::string_view line);
+	bool AddSpawnTrigger(std::string_view name, float radius, std::string_view search, const sol::function& function);
+	bool RemoveSpawnTrigger(std::string_view name);
 
 	// this is guaranteed to always run at the exact same time, so we can run binds and events in it
 	void RunEvents(LuaThread& thread);
@@ -130,22 +180,26 @@ public:
 	void PrepareEvents(const std::vector<std::string>& events);
 	void RemoveEvents(const std::vector<std::string>& events);
 	void PrepareBinds();
+
+	// There are binds or spawn triggers to prepare, or events or binds to run.
+	bool HasWork() const
+	{
+		return !m_bindsPending.empty() || !m_spawnTriggersPending.empty()
+			|| !m_bindsRunning.empty() || !m_eventsRunning.empty();
+	}
+
+	// Passes the events on to the coroutines of the running events and binds.
+	void Wake(uint32_t events);
 	void RemoveBinds(const std::vector<std::string>& binds);
 
 	LuaThread* GetThread() const { return m_thread; }
 
 	void HandleBlechEvent(LuaEvent* event, BLECHVALUE* pValues);
 	void HandleBindCallback(LuaBind* bind, const char* args);
-
-	Blech& GetBlech() { return *m_blech; }
-	Blech& GetBlechStripped() { return *m_blechStripped; }
+	void HandleSpawnTrigger(LuaSpawnTrigger* trigger, const MQSpawnTriggerEvent& event);
 
 private:
 	LuaThread* m_thread;
-	std::unique_ptr<Blech> m_blech;
-	std::unique_ptr<Blech> m_blechStripped;
-	const char* m_currentLineStripped = nullptr;
-	const char* m_currentLine = nullptr;
 
 	// Events
 	std::vector<std::unique_ptr<LuaEvent>> m_eventDefinitions;
@@ -156,6 +210,10 @@ private:
 	std::vector<std::unique_ptr<LuaBind>> m_bindDefinitions;
 	std::vector<LuaEventInstance<LuaBind>> m_bindsPending;
 	std::vector<std::shared_ptr<LuaEventFunction>> m_bindsRunning;
+
+	// Spawn triggers, these run with the binds
+	std::vector<std::unique_ptr<LuaSpawnTrigger>> m_spawnTriggerDefinitions;
+	std::vector<LuaEventInstance<LuaSpawnTrigger>> m_spawnTriggersPending;
 };
 
 } // namespace mq::lua
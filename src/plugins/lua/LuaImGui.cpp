@@ -18,10 +18,14 @@
 
 #include "bindings/lua_Bindings.h"
 #include "imgui/implot/implot.h"
+#include <imgui/imgui_internal.h>
 #include <mq/Plugin.h>
 
 namespace mq::lua {
 
+// Elements copied per PrimReserve when replaying, so a batch always fits in 16 bit indices.
+constexpr int MAX_REPLAY_ELEMENTS = 3 * 10000;
+
 //============================================================================
 
 LuaImGuiProcessor::LuaImGuiProcessor(const LuaThread* thread)
@@ -34,9 +38,18 @@ LuaImGuiProcessor::~LuaImGuiProcessor()
 {
 }
 
-void LuaImGuiProcessor::AddCallback(std::string_view name, sol::function callback)
+void LuaImGuiProcessor::AddCallback(std::string_view name, sol::function callback, const LuaImGuiRefresh& refresh)
 {
-	m_imguis.emplace_back(new LuaImGui(name, m_thread->GetLuaThread(), callback));
+	m_imguis.emplace_back(new LuaImGui(name, m_thread->GetLuaThread(), callback, refresh));
+}
+
+void LuaImGuiProcessor::Invalidate(std::string_view name)
+{
+	for (const std::unique_ptr<LuaImGui>& im : m_imguis)
+	{
+		if (im->GetName() == name)
+			im->Invalidate();
+	}
 }
 
 void LuaImGuiProcessor::RemoveCallback(std::string_view name)
@@ -76,9 +89,11 @@ void LuaImGuiProcessor::Pulse()
 
 //============================================================================
 
-LuaImGui::LuaImGui(std::string_view name, const sol::thread& parent_thread, const sol::function& callback)
+LuaImGui::LuaImGui(std::string_view name, const sol::thread& parent_thread, const sol::function& callback,
+	const LuaImGuiRefresh& refresh)
 	: m_name(name)
 	, m_parentThread(parent_thread), m_callback(callback)
+	, m_refresh(refresh)
 {
 	m_thread = sol::thread::create(m_parentThread.state());
 	m_coroutine = sol::coroutine(m_thread.state(), m_callback);
@@ -91,7 +106,113 @@ LuaImGui::~LuaImGui()
 {
 }
 
-bool LuaImGui::Pulse() const
+void LuaImGui::DrawListDeleter::operator()(ImDrawList* drawList) const
+{
+	IM_DELETE(drawList);
+}
+
+bool LuaImGui::Pulse()
+{
+	if (!m_refresh.IsRetained())
+		return Run();
+
+	if (!NeedsRun())
+	{
+		Replay();
+		return true;
+	}
+
+	// The windows that the callback draws are the ones that become active while it runs.
+	ImGuiContext& g = *GImGui;
+	std::vector<ImGuiWindow*> activeWindows;
+	for (ImGuiWindow* window : g.Windows)
+	{
+		if (window->LastFrameActive == g.FrameCount)
+			activeWindows.push_back(window);
+	}
+
+	m_cachedWindows.clear();
+	if (!Run())
+		return false;
+
+	m_invalidated = false;
+	m_hadFocus = false;
+	m_lastRun = std::chrono::steady_clock::now();
+
+	for (ImGuiWindow* window : g.Windows)
+	{
+		if (window->LastFrameActive != g.FrameCount || window->Hidden
+			|| std::find(activeWindows.begin(), activeWindows.end(), window) != activeWindows.end())
+		{
+			continue;
+		}
+
+		if (g.NavWindow && g.NavWindow->RootWindow == window->RootWindow)
+			m_hadFocus = true;
+
+		const ImRect rect = window->Rect();
+		m_cachedWindows.push_back({ rect.Min.x, rect.Min.y, rect.Max.x, rect.Max.y,
+			std::unique_ptr<ImDrawList, DrawListDeleter>(window->DrawList->CloneOutput()) });
+	}
+
+	return true;
+}
+
+bool LuaImGui::NeedsRun() const
+{
+	if (m_invalidated || m_hadFocus)
+		return true;
+
+	if (!m_refresh.isStatic && std::chrono::steady_clock::now() - m_lastRun >= m_refresh.interval)
+		return true;
+
+	for (const CachedWindow& window : m_cachedWindows)
+	{
+		if (ImGui::IsMouseHoveringRect(ImVec2(window.minX, window.minY), ImVec2(window.maxX, window.maxY), false))
+			return true;
+	}
+
+	return false;
+}
+
+// The windows aren't submitted while they are replayed, so what they drew goes in the background
+// draw list: above the game, below the windows that are live.
+void LuaImGui::Replay() const
+{
+	ImDrawList* target = ImGui::GetBackgroundDrawList();
+
+	for (const CachedWindow& window : m_cachedWindows)
+	{
+		const ImDrawList& source = *window.drawList;
+
+		for (const ImDrawCmd& cmd : source.CmdBuffer)
+		{
+			if (cmd.UserCallback != nullptr || cmd.ElemCount == 0)
+				continue;
+
+			target->PushClipRect(ImVec2(cmd.ClipRect.x, cmd.ClipRect.y), ImVec2(cmd.ClipRect.z, cmd.ClipRect.w));
+			target->PushTextureID(cmd.GetTexID());
+
+			for (unsigned int start = 0; start < cmd.ElemCount; start += MAX_REPLAY_ELEMENTS)
+			{
+				const int count = static_cast<int>(std::min<unsigned int>(cmd.ElemCount - start, MAX_REPLAY_ELEMENTS));
+				target->PrimReserve(count, count);
+
+				for (int i = 0; i < count; ++i)
+				{
+					const ImDrawIdx index = source.IdxBuffer[cmd.IdxOffset + start + i];
+					*target->_VtxWritePtr++ = source.VtxBuffer[cmd.VtxOffset + index];
+					*target->_IdxWritePtr++ = static_cast<ImDrawIdx>(target->_VtxCurrentIdx++);
+				}
+			}
+
+			target->PopTextureID();
+			target->PopClipRect();
+		}
+	}
+}
+
+bool LuaImGui::Run()
 {
 	bool success = true;
 	try
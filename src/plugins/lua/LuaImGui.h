@@ -16,27 +16,68 @@
 
 #include "LuaCommon.h"
 
+#include <chrono>
+#include <memory>
+#include <vector>
+
+struct ImDrawList;
 struct ImPlotContext;
 
 namespace mq::lua {
 
 class LuaThread;
 
+// How often an ImGui callback is run. Between runs, what the windows of its last run drew is drawn
+// again without calling into lua. The cached drawing can't be interacted with, so the callback
+// runs every frame while the mouse is over one of its windows or one of them has focus.
+struct LuaImGuiRefresh
+{
+	// Run at most this often, zero to run every frame.
+	std::chrono::milliseconds interval{ 0 };
+
+	// Only run again once invalidated (see LuaImGuiProcessor::Invalidate).
+	bool isStatic = false;
+
+	bool IsRetained() const { return isStatic || interval.count() > 0; }
+};
+
 class LuaImGui
 {
 public:
-	LuaImGui(std::string_view name, const sol::thread& parent_thread, const sol::function& callback);
+	LuaImGui(std::string_view name, const sol::thread& parent_thread, const sol::function& callback,
+		const LuaImGuiRefresh& refresh = {});
 	~LuaImGui();
 
-	bool Pulse() const;
+	bool Pulse();
 	std::string_view GetName() { return m_name; }
 
+	void Invalidate() { m_invalidated = true; }
+
 private:
+	bool Run();
+	bool NeedsRun() const;
+	void Replay() const;
+
 	std::string m_name;
 	sol::thread m_thread;
 	sol::function m_callback;
-	mutable sol::coroutine m_coroutine;
+	sol::coroutine m_coroutine;
 	sol::thread m_parentThread;
+
+	LuaImGuiRefresh m_refresh;
+	bool m_invalidated = true;
+	bool m_hadFocus = false;
+	std::chrono::steady_clock::time_point m_lastRun;
+
+	// the draw lists are allocated by ImGui, so they have to be freed by it
+	struct DrawListDeleter { void operator()(ImDrawList* drawList) const; };
+
+	struct CachedWindow
+	{
+		float minX, minY, maxX, maxY;
+		std::unique_ptr<ImDrawList, DrawListDeleter> drawList;
+	};
+	std::vector<CachedWindow> m_cachedWindows;
 };
 
 class LuaImGuiProcessor
@@ -45,9 +86,12 @@ public:
 	LuaImGuiProcessor(const LuaThread* thread);
 	~LuaImGuiProcessor();
 
-	void AddCallback(std::string_view name, sol::function callback);
+	void AddCallback(std::string_view name, sol::function callback, const LuaImGuiRefresh& refresh = {});
 	void RemoveCallback(std::string_view name);
 	bool HasCallback(std::string_view name);
+
+	// Makes a retained callback run on the next frame.
+	void Invalidate(std::string_view name);
 	void Pulse();
 
 private:
@@ -0,0 +1,214 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaProfiler.h"
+
+#include <sol/sol.hpp>
+#include <fmt/format.h>
+
+#include <fstream>
+
+namespace mq::lua {
+
+// Frames are joined with ';' and the count follows a space in the folded format.
+static std::string GetFrameName(std::string_view name)
+{
+	std::string frame(name);
+	std::replace(frame.begin(), frame.end(), ';', ':');
+	std::replace(frame.begin(), frame.end(), ' ', '_');
+	return frame;
+}
+
+LuaProfiler::LuaProfiler(std::string_view name)
+	: m_name(GetFrameName(name))
+{
+}
+
+LuaProfiler::~LuaProfiler()
+{
+	if (s_active == this)
+		s_active = nullptr;
+}
+
+void LuaProfiler::Resume()
+{
+	m_running = true;
+	m_last = m_resumed = std::chrono::steady_clock::now();
+	s_active = this;
+}
+
+void LuaProfiler::AddGarbageCollection(std::chrono::steady_clock::duration time)
+{
+	Stats& stats = m_stacks["(garbage collection)"];
+	stats.Time += std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+	++stats.Calls;
+
+	m_duration += time;
+}
+
+void LuaProfiler::Suspend()
+{
+	if (!m_running)
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+	Attribute(now);
+	m_duration += now - m_resumed;
+
+	m_running = false;
+	if (s_active == this)
+		s_active = nullptr;
+}
+
+const std::string& LuaProfiler::GetTopPath(lua_State* L)
+{
+	const std::vector<std::string>& callStack = m_callStacks[L];
+	return callStack.empty() ? m_name : callStack.back();
+}
+
+void LuaProfiler::Attribute(std::chrono::steady_clock::time_point now)
+{
+	if (m_running && m_current)
+	{
+		m_stacks[GetTopPath(m_current)].Time += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_last).count();
+	}
+
+	m_last = now;
+}
+
+void LuaProfiler::OnHook(lua_State* L, lua_Debug* D, int instructionCount)
+{
+	// Whatever ran since the last event ran in the coroutine that was current then.
+	Attribute(std::chrono::steady_clock::now());
+	m_current = L;
+
+	switch (D->event)
+	{
+	case LUA_HOOKCALL:
+	{
+		std::string name;
+		if (lua_getinfo(L, "Sn", D))
+		{
+			if (D->what && strcmp(D->what, "C") == 0)
+				name = fmt::format("[C] {}", D->name ? D->name : "?");
+			else
+				name = fmt::format("{} ({}:{})", D->name ? D->name : "?", D->short_src, D->linedefined);
+		}
+
+		std::vector<std::string>& callStack = m_callStacks[L];
+		std::string path = fmt::format("{};{}", callStack.empty() ? m_name : callStack.back(), GetFrameName(name));
+
+		++m_stacks[path].Calls;
+		callStack.push_back(std::move(path));
+		break;
+	}
+
+	case LUA_HOOKRET:
+	case LUA_HOOKTAILRET:
+	{
+		// Functions that were already running when profiling started return without a call.
+		std::vector<std::string>& callStack = m_callStacks[L];
+		if (!callStack.empty())
+			callStack.pop_back();
+		break;
+	}
+
+	case LUA_HOOKCOUNT:
+		m_stacks[GetTopPath(L)].Instructions += instructionCount;
+		break;
+
+	default:
+		break;
+	}
+}
+
+std::vector<LuaProfiler::FunctionStats> LuaProfiler::GetFunctions() const
+{
+	std::unordered_map<std::string_view, Stats> functions;
+	for (const auto& [path, stats] : m_stacks)
+	{
+		const size_t pos = path.rfind(';');
+		std::string_view name = pos == std::string::npos ? std::string_view(path) : std::string_view(path).substr(pos + 1);
+
+		Stats& function = functions[name];
+		function.Time += stats.Time;
+		function.Instructions += stats.Instructions;
+		function.Calls += stats.Calls;
+	}
+
+	std::vector<FunctionStats> result;
+	result.reserve(functions.size());
+	for (const auto& [name, stats] : functions)
+		result.push_back({ std::string(name), stats });
+
+	std::sort(result.begin(), result.end(),
+		[](const FunctionStats& a, const FunctionStats& b) { return a.Self.Time > b.Self.Time; });
+
+	return result;
+}
+
+bool LuaProfiler::WriteFolded(const std::string& path) const
+{
+	std::ofstream timeFile(path + ".time.folded", std::ios::binary | std::ios::trunc);
+	std::ofstream instructionsFile(path + ".instructions.folded", std::ios::binary | std::ios::trunc);
+	if (!timeFile || !instructionsFile)
+		return false;
+
+	for (const auto& [stack, stats] : m_stacks)
+	{
+		if (stats.Time >= 1000)
+			timeFile << stack << ' ' << stats.Time / 1000 << '\n';
+
+		if (stats.Instructions > 0)
+			instructionsFile << stack << ' ' << stats.Instructions << '\n';
+	}
+
+	return true;
+}
+
+//----------------------------------------------------------------------------
+
+LuaProfiler::ScopedAccess::ScopedAccess(std::string_view parent, std::string_view child)
+	: m_profiler(s_active)
+{
+	if (m_profiler && m_profiler->m_current)
+	{
+		m_path = fmt::format("{};{}.{}", m_profiler->GetTopPath(m_profiler->m_current), GetFrameName(parent), GetFrameName(child));
+		m_start = std::chrono::steady_clock::now();
+
+		// Time until now belongs to the frame that is making the access.
+		m_profiler->Attribute(m_start);
+	}
+	else
+	{
+		m_profiler = nullptr;
+	}
+}
+
+LuaProfiler::ScopedAccess::~ScopedAccess()
+{
+	if (m_profiler)
+	{
+		const auto now = std::chrono::steady_clock::now();
+
+		Stats& stats = m_profiler->m_stacks[m_path];
+		stats.Time += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_start).count();
+		++stats.Calls;
+
+		m_profiler->m_last = now;
+	}
+}
+
+} // namespace mq::lua
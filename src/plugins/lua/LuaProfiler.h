@@ -0,0 +1,111 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+struct lua_Debug;
+
+namespace mq::lua {
+
+// Profiles a single script with call/return hooks. Time is attributed to the stack that was
+// running between two hook events, and instruction counts to the stack that was running when the
+// count hook of the turbo fired. mq.TLO accesses are timed as leaf frames of the stack that
+// made them. Nothing is recorded while the script isn't running, or while no script is profiled.
+class LuaProfiler
+{
+public:
+	struct Stats
+	{
+		uint64_t Time = 0;            // nanoseconds, not counting the frames called from here
+		uint64_t Instructions = 0;
+		uint64_t Calls = 0;
+	};
+
+	struct FunctionStats
+	{
+		std::string Name;
+		Stats Self;
+	};
+
+	explicit LuaProfiler(std::string_view name);
+	~LuaProfiler();
+
+	LuaProfiler(const LuaProfiler&) = delete;
+	LuaProfiler& operator=(const LuaProfiler&) = delete;
+
+	// The script started or stopped running a slice (a frame, or an ImGui callback).
+	void Resume();
+	void Suspend();
+
+	void OnHook(lua_State* L, lua_Debug* D, int instructionCount);
+
+	// Time spent collecting the garbage of the script between its slices, as a frame of its own.
+	void AddGarbageCollection(std::chrono::steady_clock::duration time);
+
+	// Stats keyed by the stack in the folded format, outermost frame first and separated by ';'.
+	const std::unordered_map<std::string, Stats>& GetStacks() const { return m_stacks; }
+
+	// Stats of every function (or mq.TLO access), summed over every stack it was the last frame of.
+	std::vector<FunctionStats> GetFunctions() const;
+
+	// How long the script ran while it was profiled.
+	std::chrono::steady_clock::duration GetDuration() const { return m_duration; }
+
+	// Writes the time (microseconds) and instruction counts in the folded format used by flame
+	// graph tools, to <path>.time.folded and <path>.instructions.folded.
+	bool WriteFolded(const std::string& path) const;
+
+	// The profiler of the script that is running, if it is being profiled.
+	static LuaProfiler* GetActive() { return s_active; }
+
+	// Times an access to the macro data of the game as a leaf frame named "<parent>.<child>".
+	class ScopedAccess
+	{
+	public:
+		ScopedAccess(std::string_view parent, std::string_view child);
+		~ScopedAccess();
+
+		ScopedAccess(const ScopedAccess&) = delete;
+		ScopedAccess& operator=(const ScopedAccess&) = delete;
+
+	private:
+		LuaProfiler* m_profiler;
+		std::string m_path;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+private:
+	const std::string& GetTopPath(lua_State* L);
+	void Attribute(std::chrono::steady_clock::time_point now);
+
+	std::string m_name;
+	std::unordered_map<lua_State*, std::vector<std::string>> m_callStacks;   // per coroutine
+	std::unordered_map<std::string, Stats> m_stacks;
+	lua_State* m_current = nullptr;
+	std::chrono::steady_clock::time_point m_last;
+	std::chrono::steady_clock::time_point m_resumed;
+	std::chrono::steady_clock::duration m_duration{};
+	bool m_running = false;
+
+	static inline LuaProfiler* s_active = nullptr;
+};
+
+} // namespace mq::lua
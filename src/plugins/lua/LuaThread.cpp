@@ -14,10 +14,12 @@
 
 #include "pch.h"
 #include "LuaThread.h"
+#include "LuaBytecodeCache.h"
 #include "LuaCoroutine.h"
 #include "LuaEvent.h"
 #include "LuaImGui.h"
 #include "LuaActor.h"
+#include "LuaProfiler.h"
 #include "bindings/lua_Bindings.h"
 #include "bindings/lua_MQBindings.h"
 
@@ -63,6 +65,9 @@ void OnLuaTLORemoved(MQTopLevelObject* tlo, int pidOwner);
 // Mapping of TLOs to the pid of the script that created it
 std::unordered_map<const MQTopLevelObject*, int> s_allRegisteredTLOs;
 
+// The shared states that new scripts can be put in. The scripts own them, this only keeps track.
+static std::vector<std::weak_ptr<LuaVM>> s_sharedStates;
+
 //============================================================================
 
 void LuaThreadInfo::SetResult(const sol::protected_function_result& result, bool evaluate)
@@ -108,16 +113,71 @@ void LuaThreadInfo::EndRun()
 //============================================================================
 //============================================================================
 
-LuaThread::LuaThread(this_is_private&&, LuaEnvironmentSettings* environment)
+void LuaAccountedAllocator::Attach(lua_State* L)
+{
+	allocator = lua_getallocf(L, &userData);
+	counters = GetMemoryCounters("Lua");
+
+	// Whatever the state allocated so far is going to be freed through us.
+	counters->Allocate(static_cast<size_t>(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0));
+
+	lua_setallocf(L, &LuaAccountedAllocator::Allocate, this);
+}
+
+void* LuaAccountedAllocator::Allocate(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	LuaAccountedAllocator* self = static_cast<LuaAccountedAllocator*>(ud);
+	void* result = self->allocator(self->userData, ptr, osize, nsize);
+
+	// osize is only the size of the block when there is one.
+	const size_t oldSize = ptr ? osize : 0;
+
+	if (nsize == 0)
+		self->counters->Free(oldSize);
+	else if (result)
+		self->counters->Resize(oldSize, nsize);
+
+	return result;
+}
+
+//============================================================================
+//============================================================================
+
+LuaThread::LuaThread(this_is_private&&, LuaEnvironmentSettings* environment, LuaStateMode mode)
 	: m_luaEnvironmentSettings(environment)
+	, m_vm(mode == LuaStateMode::Shared ? AcquireSharedState(environment) : std::make_shared<LuaVM>())
+	, m_globalState(m_vm->state)
 	, m_name("(unnamed)")
 	, m_pid(NextID())
 	, m_coroutine(LuaCoroutine::Create(sol::thread::create(m_globalState), this))
 {
-	m_globalState.open_libraries();
-	m_luaEnvironmentSettings->ConfigureLuaState(m_globalState);
+	if (!m_vm->initialized)
+		InitializeState(*m_vm, m_luaEnvironmentSettings);
+
+	++m_vm->scripts;
 
 	m_environment = sol::environment(m_globalState, sol::create, m_globalState.globals());
+
+	if (m_vm->shared)
+	{
+		// package.loaded is swapped for this while the script is in require (see lua_Globals), so
+		// the modules it loads get its environment rather than that of whoever loaded them first.
+		m_loadedModules = m_globalState.create_table();
+		for (const auto& [name, module] : m_vm->baseModules)
+			m_loadedModules[name] = module;
+
+		sol::table package = m_globalState["package"];
+		sol::table packageProxy = m_globalState.create_table_with("loaded", m_loadedModules);
+		packageProxy[sol::metatable_key] = m_globalState.create_table_with(
+			sol::meta_function::index, package,
+			sol::meta_function::new_index, package);
+
+		m_loadedModules["package"] = packageProxy;
+		m_loadedModules["_G"] = m_environment;
+		m_environment["package"] = packageProxy;
+		m_environment["_G"] = m_environment;
+	}
+
 	m_environment.set_on(m_coroutine->thread);
 
 	m_threadTable = m_globalState.create_table();
@@ -129,22 +189,96 @@ LuaThread::~LuaThread()
 
 	m_imguiProcessor.reset();
 	m_eventProcessor.reset();
+
+	--m_vm->scripts;
 }
 
-/*static*/ std::shared_ptr<LuaThread> LuaThread::Create(LuaEnvironmentSettings* environment)
+/*static*/ std::shared_ptr<LuaThread> LuaThread::Create(LuaEnvironmentSettings* environment,
+	LuaStateMode mode /* = LuaStateMode::Separate */)
 {
-	std::shared_ptr<LuaThread> luaThread = std::make_shared<LuaThread>(this_is_private{}, environment);
+	std::shared_ptr<LuaThread> luaThread = std::make_shared<LuaThread>(this_is_private{}, environment, mode);
 	luaThread->Initialize();
 
 	return luaThread;
 }
 
+/*static*/ std::shared_ptr<LuaVM> LuaThread::AcquireSharedState(LuaEnvironmentSettings* environment)
+{
+	std::shared_ptr<LuaVM> result;
+
+	s_sharedStates.erase(std::remove_if(s_sharedStates.begin(), s_sharedStates.end(),
+		[&](const std::weak_ptr<LuaVM>& weak)
+		{
+			std::shared_ptr<LuaVM> vm = weak.lock();
+			if (!vm)
+				return true;
+
+			if (!result && vm->scripts < environment->scriptsPerSharedState)
+				result = std::move(vm);
+
+			return false;
+		}), s_sharedStates.end());
+
+	if (!result)
+	{
+		result = std::make_shared<LuaVM>();
+		result->shared = true;
+		s_sharedStates.push_back(result);
+	}
+
+	return result;
+}
+
+/*static*/ void LuaThread::ReleaseSharedStates()
+{
+	s_sharedStates.clear();
+}
+
+/*static*/ void LuaThread::InitializeState(LuaVM& vm, LuaEnvironmentSettings* environment)
+{
+	if (gbMemoryAccounting)
+		vm.allocator.Attach(vm.state.lua_state());
+
+	vm.state.open_libraries();
+	environment->ConfigureLuaState(vm.state);
+
+	bindings::RegisterBindings_Globals(vm.state);
+	bindings::RegisterBindings_Bit32(vm.state);
+
+	vm.state.add_package_loader(LuaThread::lua_PackageLoader);
+
+	// lua files are found through the bytecode cache before the standard searcher would compile them
+	sol::table loaders = vm.state["package"]["loaders"];
+	for (size_t i = loaders.size(); i >= 2; --i)
+		loaders[i + 1] = loaders[i];
+	loaders[2] = &LuaThread::lua_cachedFileSearcher;
+
+	if (vm.shared)
+	{
+		vm.baseModules = vm.state.create_table();
+		vm.bindingModules = vm.state.create_table();
+
+		sol::table loaded = vm.state.registry()["_LOADED"];
+		for (const auto& [name, module] : loaded)
+			vm.baseModules[name] = module;
+	}
+
+	vm.initialized = true;
+}
+
 void LuaThread::Initialize()
 {
-	bindings::RegisterBindings_Globals(this, m_globalState);
-	bindings::RegisterBindings_Bit32(m_globalState);
+	// get_from looks this up in the globals of the running coroutine, which are the environment of
+	// the script when the state is shared.
+	GetScriptGlobals()["mqthread"] = LuaThreadRef(shared_from_this());
+}
 
-	m_globalState.add_package_loader(LuaThread::lua_PackageLoader);
+sol::table LuaThread::GetScriptGlobals() const
+{
+	if (m_vm->shared)
+		return m_environment;
+
+	return m_globalState.globals();
 }
 
 void LuaThread::EnableImGui()
@@ -165,7 +299,7 @@ void LuaThread::EnableEvents()
 
 void LuaThread::InjectMQNamespace()
 {
-	m_globalState["mq"] = RegisterMQNamespace(m_globalState.lua_state());
+	GetScriptGlobals()["mq"] = RegisterMQNamespace(m_globalState.lua_state());
 }
 
 void LuaThread::Exit(LuaThreadExitReason reason)
@@ -199,9 +333,35 @@ sol::table LuaThread::RegisterMQNamespace(sol::this_state L)
 {
 	sol::state_view sv{ L };
 
+	if (!m_vm->shared)
+	{
+		auto mq = sv.create_table();
+		bindings::RegisterBindings_MQ(this, mq);
+		bindings::RegisterBindings_MQMacroData(mq);
+		bindings::RegisterBindings_MQScript(this, mq);
+
+		return mq;
+	}
+
+	// The scripts of a shared state share one copy of everything that doesn't belong to the script,
+	// including the usertypes, instead of registering them again for every script. Each script gets
+	// a table of its own on top of it, so what it sets doesn't show up in the other scripts.
+	sol::object shared = m_vm->bindingModules["mq"];
+	if (shared == sol::lua_nil)
+	{
+		sol::state_view vmState{ m_vm->state.lua_state() };
+
+		sol::table base = vmState.create_table();
+		bindings::RegisterBindings_MQ(this, base);
+		bindings::RegisterBindings_MQMacroData(base);
+
+		m_vm->bindingModules["mq"] = base;
+		shared = base;
+	}
+
 	auto mq = sv.create_table();
-	bindings::RegisterBindings_MQ(this, mq);
-	bindings::RegisterBindings_MQMacroData(mq);
+	bindings::RegisterBindings_MQScript(this, mq);
+	mq[sol::metatable_key] = sv.create_table_with(sol::meta_function::index, shared);
 
 	return mq;
 }
@@ -222,21 +382,46 @@ int LuaThread::PackageLoader(const std::string& pkg, lua_State* L)
 		return 1;
 	}
 
+	// These don't depend on the script, so the scripts of a shared state share them. They are
+	// built with the main state, which keeps any globals they set out of the script environment.
+	auto pushBindings = [&](sol::table(*registerBindings)(sol::this_state))
+	{
+		if (!m_vm->shared)
+		{
+			sol::stack::push(L, std::function([registerBindings](sol::this_state L) { return registerBindings(L); }));
+			return;
+		}
+
+		// the loader lives in the state, so it can't keep the state alive
+		LuaVM* vm = m_vm.get();
+		sol::stack::push(L, std::function([vm, pkg, registerBindings](sol::this_state)
+			{
+				sol::object module = vm->bindingModules[pkg];
+				if (module == sol::lua_nil)
+				{
+					module = registerBindings(sol::this_state{ vm->state.lua_state() });
+					vm->bindingModules[pkg] = module;
+				}
+
+				return module;
+			}));
+	};
+
 	if (pkg == "ImGui")
 	{
-		sol::stack::push(L, std::function([](sol::this_state L) { return bindings::RegisterBindings_ImGui(L); }));
+		pushBindings([](sol::this_state L) { return bindings::RegisterBindings_ImGui(L); });
 		return 1;
 	}
 
 	if (pkg == "ImPlot")
 	{
-		sol::stack::push(L, std::function([](sol::this_state L) { return bindings::RegisterBindings_ImPlot(L); }));
+		pushBindings(&bindings::RegisterBindings_ImPlot);
 		return 1;
 	}
 
 	if (pkg == "Zep")
 	{
-		sol::stack::push(L, std::function([](sol::this_state L) { return bindings::RegisterBindings_Zep(L); }));
+		pushBindings(&bindings::RegisterBindings_Zep);
 		return 1;
 	}
 
@@ -255,6 +440,39 @@ int LuaThread::PackageLoader(const std::string& pkg, lua_State* L)
 	return 0;
 }
 
+// Finds the module on package.path like the standard searcher, and loads it through the cache.
+/*static*/ int LuaThread::lua_cachedFileSearcher(lua_State* L)
+{
+	std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(L);
+	if (!thread_ptr)
+		return 0;
+
+	const std::string cacheDir = thread_ptr->m_luaEnvironmentSettings->GetBytecodeCacheDir();
+	if (cacheDir.empty())
+		return 0;
+
+	const std::string name = luaL_checkstring(L, 1);
+	sol::table package = thread_ptr->m_globalState["package"];
+	sol::protected_function searchPath = package["searchpath"];
+	if (!searchPath.valid())
+		return 0;
+
+	// leave the message for a module that isn't found to the standard searcher
+	std::optional<std::string> path = searchPath(name, package["path"]).get<std::optional<std::string>>();
+	if (!path)
+		return 0;
+
+	sol::load_result chunk = LuaBytecodeCache::LoadFile(L, *path, cacheDir);
+	if (!chunk.valid())
+	{
+		sol::error err = chunk;
+		return luaL_error(L, "error loading module '%s' from file '%s':\n\t%s", name.c_str(), path->c_str(), err.what());
+	}
+
+	lua_pushvalue(L, chunk.stack_index());
+	return 1;
+}
+
 //============================================================================
 //============================================================================
 
@@ -265,6 +483,10 @@ bool LuaThread::IsValid() const
 
 sol::state_view LuaThread::GetState() const
 {
+	// the globals of a view of the coroutine are its environment
+	if (m_vm->shared)
+		return m_coroutine->thread.state();
+
 	return m_globalState;
 }
 
@@ -295,10 +517,14 @@ std::optional<LuaThreadInfo> LuaThread::StartFile(
 	// the highest priority search path)
 	std::string runDir = fs::path{ locationInfo.fullPath }.parent_path().string();
 
-	if (!runDir.empty() && fs::path{ runDir }.compare(m_luaEnvironmentSettings->luaDir) != 0)
+	// The package paths of a shared state are shared by its scripts, so every directory is only added once.
+	const std::string runDirPath = fmt::format("{runDir}\\?\\init.lua;{runDir}\\?.lua;", fmt::arg("runDir", runDir));
+
+	if (!runDir.empty() && fs::path{ runDir }.compare(m_luaEnvironmentSettings->luaDir) != 0
+		&& (!m_vm->shared || m_globalState["package"]["path"].get<std::string_view>().find(runDirPath) == std::string_view::npos))
 	{
-		m_globalState["package"]["path"] = fmt::format("{runDir}\\?\\init.lua;{runDir}\\?.lua;{existingPath}",
-			fmt::arg("runDir", runDir),
+		m_globalState["package"]["path"] = fmt::format("{runDirPath}{existingPath}",
+			fmt::arg("runDirPath", runDirPath),
 			fmt::arg("existingPath", m_globalState["package"]["path"].get<std::string_view>()));
 
 		m_globalState["package"]["cpath"] = fmt::format("{runDir}\\?.dll;{existingPath}",
@@ -309,7 +535,8 @@ std::optional<LuaThreadInfo> LuaThread::StartFile(
 	m_name = locationInfo.canonicalName;
 	m_path = locationInfo.fullPath;
 
-	auto co = m_coroutine->thread.state().load_file(m_path);
+	auto co = LuaBytecodeCache::LoadFile(m_coroutine->thread.state(), m_path,
+		m_luaEnvironmentSettings->GetBytecodeCacheDir());
 	if (!co.valid())
 	{
 		sol::error err = co;
@@ -410,7 +637,17 @@ LuaThread::RunResult LuaThread::Run()
 {
 	if (m_coroutine->coroutine.status() == sol::call_status::yielded)
 	{
-		return RunOnce();
+		if (!m_profiling)
+			return RunOnce();
+
+		// keep a reference, the script can stop (or restart) its own profile while it runs
+		LuaProfiler* profiler = m_profiler.get();
+		profiler->Resume();
+		RunResult result = RunOnce();
+		if (profiler == m_profiler.get())
+			profiler->Suspend();
+
+		return result;
 	}
 
 	return { static_cast<sol::thread_status>(m_coroutine->coroutine.status()), std::nullopt };
@@ -429,6 +666,25 @@ void LuaThread::UpdateLuaDir(const std::filesystem::path& newLuaDir)
 	UNUSED(newLuaDir);
 }
 
+bool LuaThread::IsSleeping() const
+{
+	if (m_coroutine->coroutine.status() != sol::call_status::yielded)
+		return false;
+
+	if (m_eventProcessor && m_eventProcessor->HasWork())
+		return false;
+
+	return m_coroutine->IsSleeping();
+}
+
+void LuaThread::Wake(uint32_t events)
+{
+	m_coroutine->Wake(events);
+
+	if (m_eventProcessor)
+		m_eventProcessor->Wake(events);
+}
+
 LuaThread::RunResult LuaThread::RunOnce()
 {
 	if (!m_coroutine->thread.valid())
@@ -509,9 +765,18 @@ void LuaThread::SetAllowYield(bool allowYield, YieldDisabledReason reason)
 // this is the special sauce that lets us execute everything on the main thread without blocking
 /*static*/ void LuaThread::lua_forceYield(lua_State* L, lua_Debug* D)
 {
+	std::shared_ptr<LuaThread> thread_ptr = get_from(L);
+
+	// the script still has time left in its slice of the frame
+	if (D->event == LUA_HOOKCOUNT && thread_ptr
+		&& thread_ptr->m_sliceDeadline > std::chrono::steady_clock::now())
+	{
+		return;
+	}
+
 	if (lua_isyieldable(L))
 	{
-		if (std::shared_ptr<LuaThread> thread_ptr = get_from(L))
+		if (thread_ptr)
 		{
 			thread_ptr->m_yieldToFrame = true;
 		}
@@ -521,18 +786,77 @@ void LuaThread::SetAllowYield(bool allowYield, YieldDisabledReason reason)
 	else if (D->event != LUA_HOOKRET && D->event != LUA_HOOKTAILRET) // if we have either of these, we know we've already set the hook
 	{
 		// we can just keep retrying at every return (every chance we get to possibly change boundaries)
-		lua_sethook(L, LuaThread::lua_forceYield, LUA_MASKRET, 0);
+		if (thread_ptr)
+			thread_ptr->SetHook(L, LUA_MASKRET, 0);
+		else
+			lua_sethook(L, LuaThread::lua_forceYield, LUA_MASKRET, 0);
 	}
 }
 
+// The hook of a thread that is being profiled. Every call and return goes to the profiler, and only
+// the events that the thread asked to yield on are passed on to lua_forceYield.
+/*static*/ void LuaThread::lua_profileHook(lua_State* L, lua_Debug* D)
+{
+	std::shared_ptr<LuaThread> thread_ptr = get_from(L);
+	if (!thread_ptr)
+		return;
+
+	if (thread_ptr->m_profiling)
+		thread_ptr->m_profiler->OnHook(L, D, thread_ptr->m_hookCount);
+
+	int eventMask = 0;
+	switch (D->event)
+	{
+	case LUA_HOOKCALL: eventMask = LUA_MASKCALL; break;
+	case LUA_HOOKRET:
+	case LUA_HOOKTAILRET: eventMask = LUA_MASKRET; break;
+	case LUA_HOOKLINE: eventMask = LUA_MASKLINE; break;
+	case LUA_HOOKCOUNT: eventMask = LUA_MASKCOUNT; break;
+	default: break;
+	}
+
+	if (thread_ptr->m_yieldMask & eventMask)
+		lua_forceYield(L, D);
+}
+
+void LuaThread::SetHook(lua_State* L, int yieldMask, int count) const
+{
+	m_yieldMask = yieldMask;
+	m_hookCount = count;
+
+	if (m_profiling)
+		lua_sethook(L, &LuaThread::lua_profileHook, yieldMask | LUA_MASKCALL | LUA_MASKRET, count);
+	else
+		lua_sethook(L, &LuaThread::lua_forceYield, yieldMask, count);
+}
+
 void LuaThread::YieldAt(int count) const
 {
 	if (m_allowYield)
 	{
-		lua_sethook(m_coroutine->thread.state(), &LuaThread::lua_forceYield, count == 0 ? LUA_MASKLINE : LUA_MASKCOUNT, count);
+		SetHook(m_coroutine->thread.state(), count == 0 ? LUA_MASKLINE : LUA_MASKCOUNT, count);
 	}
 }
 
+void LuaThread::StartProfiling()
+{
+	m_profiler = std::make_unique<LuaProfiler>(m_name);
+	m_profiling = true;
+
+	SetHook(m_coroutine->thread.state(), m_yieldMask, m_hookCount);
+}
+
+void LuaThread::StopProfiling()
+{
+	if (!m_profiling)
+		return;
+
+	m_profiler->Suspend();
+	m_profiling = false;
+
+	SetHook(m_coroutine->thread.state(), m_yieldMask, m_hookCount);
+}
+
 //============================================================================
 
 bool LuaThread::AddTopLevelObject(const char* name, MQTopLevelObjectFunction func)
@@ -626,40 +950,86 @@ void LuaThread::AssociateTopLevelObject(const MQTopLevelObject* tlo)
 
 //============================================================================
 
-sol::table LuaThread::GetSpawnTable()
+// The entries of the spawn table are only made when they are looked up, and are kept so that a
+// spawn is always the same object until it despawns.
+static sol::object GetSpawnEntry(sol::table& spawns, eqlib::PlayerClient* spawn, lua_State* L)
 {
-	if (m_spawnTable == sol::nil)
+	sol::object entry = spawns.raw_get<sol::object>(spawn->SpawnID);
+	if (entry == sol::lua_nil)
+	{
+		entry = sol::make_object(L, bindings::lua_MQTypeVar(datatypes::pSpawnType->MakeTypeVar(spawn)));
+		spawns.raw_set(spawn->SpawnID, entry);
+	}
+
+	return entry;
+}
+
+static sol::object lua_spawnTableIndex(sol::table spawns, sol::stack_object key, sol::this_state L)
+{
+	if (key.get_type() == sol::type::number)
+	{
+		if (eqlib::PlayerClient* spawn = GetSpawnByID(key.as<uint32_t>()))
+			return GetSpawnEntry(spawns, spawn, L);
+	}
+
+	return sol::lua_nil;
+}
+
+// Iterates the spawns that exist when the loop starts, skipping the ones that are gone by the time
+// it gets to them (the loop can yield).
+static auto lua_spawnTablePairs(sol::table spawns)
+{
+	std::vector<uint32_t> spawnIDs;
+
+	if (pSpawnManager != nullptr)
 	{
-		m_spawnTable = m_globalState.create_named_table("__spawns");
+		for (auto spawn = pSpawnManager->FirstSpawn; spawn != nullptr; spawn = spawn->GetNext())
+			spawnIDs.push_back(spawn->SpawnID);
+	}
 
-		if (pSpawnManager != nullptr)
+	auto next = [spawnIDs = std::move(spawnIDs), index = size_t{ 0 }](sol::table spawns, sol::object, sol::this_state L) mutable
+		-> std::tuple<sol::object, sol::object>
+	{
+		while (index < spawnIDs.size())
 		{
-			auto spawn = pSpawnManager->FirstSpawn;
+			const uint32_t spawnID = spawnIDs[index++];
 
-			while (spawn != nullptr)
-			{
-				m_spawnTable[spawn->SpawnID] = bindings::lua_MQTypeVar(datatypes::pSpawnType->MakeTypeVar(spawn));
-				spawn = spawn->GetNext();
-			}
+			if (eqlib::PlayerClient* spawn = GetSpawnByID(spawnID))
+				return { sol::make_object(L, spawnID), GetSpawnEntry(spawns, spawn, L) };
 		}
-	}
 
-	return m_spawnTable;
+		return { sol::lua_nil, sol::lua_nil };
+	};
+
+	return std::make_tuple(std::function(std::move(next)), spawns, sol::lua_nil);
 }
 
-void LuaThread::AddSpawn(eqlib::PlayerClient* spawn)
+sol::table LuaThread::GetSpawnTable()
 {
-	if (m_coroutine->coroutine.status() == sol::call_status::yielded && m_spawnTable != sol::nil)
+	if (m_spawnTable == sol::nil)
 	{
-		m_spawnTable[spawn->SpawnID] = bindings::lua_MQTypeVar(datatypes::pSpawnType->MakeTypeVar(spawn));
+		m_spawnTable = m_globalState.create_table();
+		m_spawnTable[sol::metatable_key] = m_globalState.create_table_with(
+			sol::meta_function::index, &lua_spawnTableIndex,
+			sol::meta_function::pairs, &lua_spawnTablePairs);
+
+		GetScriptGlobals()["__spawns"] = m_spawnTable;
 	}
+
+	return m_spawnTable;
+}
+
+sol::object LuaThread::GetSpawn(eqlib::PlayerClient* spawn)
+{
+	sol::table spawns = GetSpawnTable();
+	return GetSpawnEntry(spawns, spawn, m_globalState.lua_state());
 }
 
 void LuaThread::RemoveSpawn(eqlib::PlayerClient* spawn)
 {
 	if (m_coroutine->coroutine.status() == sol::call_status::yielded && m_spawnTable != sol::nil)
 	{
-		m_spawnTable[spawn->SpawnID] = sol::nil;
+		m_spawnTable.raw_set(spawn->SpawnID, sol::lua_nil);
 	}
 }
 
@@ -667,7 +1037,8 @@ sol::table LuaThread::GetGroundItemTable()
 {
 	if (m_groundItemTable == sol::nil)
 	{
-		m_groundItemTable = m_globalState.create_named_table("__groundItems");
+		m_groundItemTable = m_globalState.create_table();
+		GetScriptGlobals()["__groundItems"] = m_groundItemTable;
 
 		if (pItemList != nullptr)
 		{
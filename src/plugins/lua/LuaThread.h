@@ -20,6 +20,7 @@
 #include "mq/base/GlobalBuffer.h"
 #include "mq/base/String.h"
 #include "mq/base/Vector.h"
+#include "mq/utils/MemoryAccounting.h"
 
 #include <sol/sol.hpp>
 
@@ -39,12 +40,86 @@ namespace mq::lua {
 
 class LuaEventProcessor;
 class LuaImGuiProcessor;
+class LuaProfiler;
 class LuaActors;
 class LuaThread;
 struct LuaCoroutine;
 
 struct ThreadState;
 
+// Counts the memory of a lua state under "Lua" in the memory accounting. The allocator of the state
+// is wrapped rather than replaced, since LuaJIT needs its own allocator on 64 bit.
+struct LuaAccountedAllocator
+{
+	lua_Alloc allocator = nullptr;
+	void* userData = nullptr;
+	MQMemoryCounters* counters = nullptr;
+
+	void Attach(lua_State* L);
+
+	static void* Allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+};
+
+enum class LuaStateMode
+{
+	// The script gets a lua state of its own.
+	Separate,
+
+	// The script runs in an environment of its own (its own globals and coroutines) inside a lua
+	// state that is shared with other scripts, so the libraries and bindings are only built once
+	// per state. The scripts of a state can see each other through the standard libraries and the
+	// metatables of the bindings, so this is for scripts that are trusted.
+	Shared,
+};
+
+// A lua state, and what is built in it once for all of the scripts that run in it.
+struct LuaVM
+{
+	// outlives the state, which keeps calling it until it is closed
+	LuaAccountedAllocator allocator;
+	sol::state state;
+
+	bool shared = false;
+	bool initialized = false;
+	uint32_t scripts = 0;
+
+	// The modules that were loaded once the state was initialized, every script in a shared state
+	// starts with a copy of these in its own package.loaded.
+	sol::table baseModules;
+
+	// Binding modules that don't depend on the script (ImGui, ImPlot...), built once per state.
+	sol::table bindingModules;
+
+	// Garbage collection, when MQ2Lua steps it instead of leaving it to the allocations (see
+	// CollectGarbage in MQ2Lua). The estimate is what was left after the last cycle, in KB.
+	bool gcStopped = false;
+	bool gcCollecting = false;
+	size_t gcEstimate = 0;
+};
+
+// How much of the frame budget a script gets, relative to the other scripts that want to run.
+enum class LuaThreadPriority
+{
+	Low,
+	Normal,
+	High,
+};
+
+// What the scheduler (OnPulse in MQ2Lua) keeps for a script from frame to frame.
+struct LuaThreadSchedule
+{
+	LuaThreadPriority priority = LuaThreadPriority::Normal;
+
+	// Budget that was left over in earlier frames, or negative if the script ran over.
+	std::chrono::microseconds credit{ 0 };
+
+	// Time spent running in the current window of the cpu share.
+	std::chrono::steady_clock::duration windowTime{ 0 };
+
+	// Fraction of the time of the main thread that the script ran for in the last window.
+	float cpuShare = 0.0f;
+};
+
 enum class LuaThreadStatus
 {
 	Starting,
@@ -108,8 +183,13 @@ private:
 	struct this_is_private {};
 
 public:
-	LuaThread(this_is_private&&, LuaEnvironmentSettings* environment);
-	static std::shared_ptr<LuaThread> Create(LuaEnvironmentSettings* environment);
+	LuaThread(this_is_private&&, LuaEnvironmentSettings* environment, LuaStateMode mode);
+	static std::shared_ptr<LuaThread> Create(LuaEnvironmentSettings* environment,
+		LuaStateMode mode = LuaStateMode::Separate);
+
+	// Stops handing out the shared states that exist, the scripts that are running in them keep
+	// them alive until they exit. Called when the settings that a state is configured with change.
+	static void ReleaseSharedStates();
 
 	~LuaThread();
 
@@ -125,6 +205,9 @@ public:
 	const std::string& GetName() const { return m_name; }
 	const std::string& GetScript() const { return m_path; }
 	sol::state_view GetState() const;
+	bool IsSharedState() const { return m_vm->shared; }
+	LuaVM* GetVM() const { return m_vm.get(); }
+	sol::table GetLoadedModules() const { return m_loadedModules; }
 	sol::thread GetLuaThread() const;
 	sol::thread_status GetThreadStatus() const;
 
@@ -133,6 +216,22 @@ public:
 
 	void InjectMQNamespace();
 	void SetTurbo(uint32_t turboVal) { m_turboNum = turboVal; }
+
+	// With a deadline, the count hook only yields once it has passed: the turbo is how often the
+	// clock is looked at instead of how much the script gets to run. A default deadline yields at
+	// every turbo.
+	void SetTimeSlice(std::chrono::steady_clock::time_point deadline) { m_sliceDeadline = deadline; }
+	LuaThreadSchedule& GetSchedule() { return m_schedule; }
+	const LuaThreadSchedule& GetSchedule() const { return m_schedule; }
+
+	// True if the script is waiting on a delay without a condition and has no events or binds to
+	// run, so there is nothing for Run to do.
+	bool IsSleeping() const;
+
+	// Ends the delays of the coroutines of the script that are waiting on any of the events (see
+	// LuaWakeEvent).
+	void Wake(uint32_t events);
+
 	void SetEvaluateResult(bool evaluate) { m_evaluateResult = evaluate; }
 	bool GetEvaluateResult() const { return m_evaluateResult; }
 
@@ -157,6 +256,13 @@ public:
 	bool GetAllowYield() const { return m_allowYield; }
 	YieldDisabledReason GetYieldDisabledReason() const { return m_yieldDisabledReason; }
 
+	// Profile the functions of the script with call/return hooks, see LuaProfiler. The profile of
+	// the last run is kept after profiling stops.
+	void StartProfiling();
+	void StopProfiling();
+	bool IsProfiling() const { return m_profiling; }
+	LuaProfiler* GetProfiler() const { return m_profiler.get(); }
+
 	bool ShouldYield() const { return m_yieldToFrame; }
 	void DoYield() { YieldAt(0); }
 	void Exit(LuaThreadExitReason reason = LuaThreadExitReason::Unspecified);
@@ -194,8 +300,10 @@ public:
 		m_namedDependencies.insert(name);
 	}
 
+	// A proxy for the spawn manager: indexing it by spawn id, or iterating it with pairs, gives the
+	// spawns as typevars.
 	sol::table GetSpawnTable();
-	void AddSpawn(eqlib::PlayerClient* spawn);
+	sol::object GetSpawn(eqlib::PlayerClient* spawn);
 	void RemoveSpawn(eqlib::PlayerClient* spawn);
 
 	sol::table GetGroundItemTable();
@@ -208,20 +316,32 @@ private:
 	sol::table RegisterMQNamespace(sol::this_state L);
 	void Initialize();
 
+	static std::shared_ptr<LuaVM> AcquireSharedState(LuaEnvironmentSettings* environment);
+	static void InitializeState(LuaVM& vm, LuaEnvironmentSettings* environment);
+
+	// The table that the globals of the script go in, its environment when the state is shared.
+	sol::table GetScriptGlobals() const;
+
 	void YieldAt(int count) const;
+	void SetHook(lua_State* L, int yieldMask, int count) const;
 
 	int PackageLoader(const std::string& pkg, lua_State* L);
 
 	static int lua_PackageLoader(lua_State* L);
+	static int lua_cachedFileSearcher(lua_State* L);
 	static void lua_forceYield(lua_State* L, lua_Debug* D);
+	static void lua_profileHook(lua_State* L, lua_Debug* D);
 
 private:
 	LuaEnvironmentSettings* m_luaEnvironmentSettings = nullptr;
 
-	// this needs to be first in initialization order because other things depend on it
-	sol::state m_globalState;
+	// this needs to be first in initialization order because other things depend on it, and
+	// everything that references the state has to be released before it is
+	std::shared_ptr<LuaVM> m_vm;
+	sol::state_view m_globalState;
 	std::shared_ptr<LuaCoroutine> m_coroutine;
 	sol::environment m_environment;
+	sol::table m_loadedModules = sol::nil;           // package.loaded of the script in a shared state
 	sol::table m_threadTable;
 	uint32_t m_threadIndex = 0;
 
@@ -230,6 +350,15 @@ private:
 	uint32_t m_pid = 0;
 	uint32_t m_turboNum = 500;
 	bool m_yieldToFrame = false;
+	std::chrono::steady_clock::time_point m_sliceDeadline;
+	LuaThreadSchedule m_schedule;
+
+	// What the hook has been set to yield on, so the profiler hook only yields on those events.
+	mutable int m_yieldMask = 0;
+	mutable int m_hookCount = 0;
+	std::unique_ptr<LuaProfiler> m_profiler;
+	bool m_profiling = false;
+
 	bool m_isString = false;
 	bool m_paused = false;
 	bool m_evaluateResult = false;
@@ -0,0 +1,278 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "pch.h"
+#include "LuaWorker.h"
+#include "LuaActorPayload.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mq::lua {
+
+constexpr int WORKER_THREADS = 2;
+
+// how many instructions a worker runs between looking at whether the pool is stopping
+constexpr int WORKER_STOP_CHECK_INTERVAL = 10000;
+
+struct LuaWorkerJob
+{
+	// written by the script, then only read by the worker
+	std::string chunk;                           // bytecode, or source
+	std::string args;                            // a table of the arguments
+	int argCount = 0;
+
+	// written by the worker, then only read on the main thread once the job is done
+	bool success = false;
+	std::string results;                         // a table of the results, or the error
+	int resultCount = 0;
+
+	// only touched on the main thread
+	bool done = false;
+};
+
+static std::mutex s_mutex;
+static std::condition_variable s_jobsAvailable;
+static std::deque<std::shared_ptr<LuaWorkerJob>> s_jobs;
+static std::vector<std::shared_ptr<LuaWorkerJob>> s_finishedJobs;
+static std::vector<std::thread> s_threads;
+static std::atomic<bool> s_stopping = false;
+
+static void lua_stopCheck(lua_State* L, lua_Debug*)
+{
+	if (s_stopping)
+		luaL_error(L, "The worker was stopped");
+}
+
+static void RunJob(lua_State* L, LuaWorkerJob& job)
+{
+	const int top = lua_gettop(L);
+
+	if (luaL_loadbuffer(L, job.chunk.data(), job.chunk.size(), "=worker") == 0)
+	{
+		// every job gets globals of its own, so jobs can't leave anything behind for the next one
+		lua_newtable(L);
+		lua_createtable(L, 0, 1);
+		lua_pushvalue(L, LUA_GLOBALSINDEX);
+		lua_setfield(L, -2, "__index");
+		lua_setmetatable(L, -2);
+		lua_setfenv(L, -2);
+
+		if (!DecodeCompactPayload(L, job.args))
+		{
+			lua_pop(L, 1);
+			lua_newtable(L);
+		}
+
+		const int argsIndex = lua_gettop(L);
+		for (int i = 1; i <= job.argCount; ++i)
+			lua_rawgeti(L, argsIndex, i);
+		lua_remove(L, argsIndex);
+
+		if (lua_pcall(L, job.argCount, LUA_MULTRET, 0) == 0)
+		{
+			job.resultCount = lua_gettop(L) - top;
+
+			lua_createtable(L, job.resultCount, 0);
+			for (int i = 1; i <= job.resultCount; ++i)
+			{
+				lua_pushvalue(L, top + i);
+				lua_rawseti(L, -2, i);
+			}
+
+			job.results = EncodeCompactPayload(L, -1);
+			job.success = true;
+			lua_settop(L, top);
+			return;
+		}
+	}
+
+	// the error of either the load or the call
+	size_t length = 0;
+	const char* message = lua_tolstring(L, -1, &length);
+	job.results = message ? std::string(message, length) : std::string("unknown error");
+	lua_settop(L, top);
+}
+
+static void WorkerThread()
+{
+	sol::state state;
+	state.open_libraries(sol::lib::base, sol::lib::string, sol::lib::table, sol::lib::math, sol::lib::bit32);
+
+	// nothing that reaches outside of the state
+	state["dofile"] = sol::lua_nil;
+	state["loadfile"] = sol::lua_nil;
+	state["print"] = sol::lua_nil;
+
+	lua_sethook(state.lua_state(), &lua_stopCheck, LUA_MASKCOUNT, WORKER_STOP_CHECK_INTERVAL);
+
+	while (true)
+	{
+		std::shared_ptr<LuaWorkerJob> job;
+		{
+			std::unique_lock lock(s_mutex);
+			s_jobsAvailable.wait(lock, [] { return s_stopping || !s_jobs.empty(); });
+
+			if (s_stopping)
+				return;
+
+			job = std::move(s_jobs.front());
+			s_jobs.pop_front();
+		}
+
+		RunJob(state.lua_state(), *job);
+
+		std::scoped_lock lock(s_mutex);
+		s_finishedJobs.push_back(std::move(job));
+	}
+}
+
+//============================================================================
+
+LuaWorkerFuture::LuaWorkerFuture(std::shared_ptr<LuaWorkerJob> job)
+	: m_job(std::move(job))
+{
+}
+
+bool LuaWorkerFuture::IsDone() const
+{
+	return m_job->done;
+}
+
+sol::variadic_results LuaWorkerFuture::Get(sol::this_state s) const
+{
+	if (!m_job->done)
+		luaL_error(s, "The worker hasn't finished, wait for it with mq.delay(timeout, future)");
+
+	if (!m_job->success)
+		luaL_error(s, "Error in mq.worker function: %s", m_job->results.c_str());
+
+	sol::variadic_results results;
+
+	DecodeCompactPayload(s, m_job->results);
+	sol::table table = sol::stack::pop<sol::table>(s);
+	for (int i = 1; i <= m_job->resultCount; ++i)
+		results.push_back(table.raw_get<sol::object>(i));
+
+	return results;
+}
+
+//============================================================================
+
+static int lua_dumpWriter(lua_State*, const void* data, size_t size, void* userdata)
+{
+	static_cast<std::string*>(userdata)->append(static_cast<const char*>(data), size);
+	return 0;
+}
+
+// mq.worker(function or source, ...) runs the function with the arguments on a worker thread.
+static LuaWorkerFuture lua_worker(sol::object function, sol::variadic_args args, sol::this_state s)
+{
+	lua_State* L = s;
+	auto job = std::make_shared<LuaWorkerJob>();
+
+	if (function.get_type() == sol::type::string)
+	{
+		job->chunk = function.as<std::string>();
+	}
+	else if (function.get_type() == sol::type::function)
+	{
+		function.push(L);
+
+		if (lua_iscfunction(L, -1))
+			luaL_error(L, "mq.worker can't run C functions");
+
+		if (const char* upvalue = lua_getupvalue(L, -1, 1))
+			luaL_error(L, "mq.worker functions can't have upvalues (%s), pass what they need as arguments", upvalue);
+
+		lua_dump(L, &lua_dumpWriter, &job->chunk);
+		lua_pop(L, 1);
+	}
+	else
+	{
+		luaL_error(L, "mq.worker expects a function or a string of source");
+	}
+
+	job->argCount = static_cast<int>(args.size());
+	lua_createtable(L, job->argCount, 0);
+	for (int i = 0; i < job->argCount; ++i)
+	{
+		lua_pushvalue(L, args.stack_index() + i);
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	job->args = EncodeCompactPayload(L, -1);
+	lua_pop(L, 1);
+
+	{
+		std::scoped_lock lock(s_mutex);
+
+		if (s_threads.empty())
+		{
+			s_stopping = false;
+			for (int i = 0; i < WORKER_THREADS; ++i)
+				s_threads.emplace_back(&WorkerThread);
+		}
+
+		s_jobs.push_back(job);
+	}
+
+	s_jobsAvailable.notify_one();
+	return LuaWorkerFuture(std::move(job));
+}
+
+void LuaWorkers::RegisterLua(sol::table& mq)
+{
+	mq.new_usertype<LuaWorkerFuture>(
+		"workerfuture"                               , sol::no_constructor,
+		"done"                                       , sol::property(&LuaWorkerFuture::IsDone),
+		"get"                                        , &LuaWorkerFuture::Get);
+
+	mq.set_function("worker",                        &lua_worker);
+}
+
+void LuaWorkers::Process()
+{
+	std::vector<std::shared_ptr<LuaWorkerJob>> finishedJobs;
+	{
+		std::scoped_lock lock(s_mutex);
+		finishedJobs.swap(s_finishedJobs);
+	}
+
+	for (const std::shared_ptr<LuaWorkerJob>& job : finishedJobs)
+		job->done = true;
+}
+
+void LuaWorkers::Stop()
+{
+	{
+		std::scoped_lock lock(s_mutex);
+		s_stopping = true;
+		s_jobs.clear();
+	}
+
+	s_jobsAvailable.notify_all();
+
+	for (std::thread& thread : s_threads)
+		thread.join();
+
+	s_threads.clear();
+	s_finishedJobs.clear();
+}
+
+} // namespace mq::lua
@@ -0,0 +1,56 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include "LuaCommon.h"
+
+#include <memory>
+
+namespace mq::lua {
+
+// Runs functions of scripts on a small pool of threads, for computation that doesn't need the
+// game. Every thread has a lua state of its own with only the base, string, table, math and bit
+// libraries, so a worker function can't reach the TLOs or anything else outside of its state.
+// The function is sent as bytecode and can't have upvalues, its arguments and results are copied
+// with the compact actor payload encoding.
+
+struct LuaWorkerJob;
+
+// What mq.worker returns. Wait for it with mq.delay(timeout, future).
+class LuaWorkerFuture
+{
+public:
+	explicit LuaWorkerFuture(std::shared_ptr<LuaWorkerJob> job);
+
+	bool IsDone() const;
+
+	// The values that the function returned. Raises the error of the function if it failed.
+	sol::variadic_results Get(sol::this_state s) const;
+
+private:
+	std::shared_ptr<LuaWorkerJob> m_job;
+};
+
+class LuaWorkers
+{
+public:
+	static void RegisterLua(sol::table& mq);
+	static void Stop();
+
+	// Hands the results of the jobs that finished to their futures, called on the main thread.
+	static void Process();
+};
+
+} // namespace mq::lua
@@ -16,10 +16,13 @@
 
 #include "LuaInterface.h"
 #include "LuaCommon.h"
+#include "LuaCoroutine.h"
 #include "LuaThread.h"
 #include "LuaEvent.h"
 #include "LuaActor.h"
 #include "LuaImGui.h"
+#include "LuaProfiler.h"
+#include "LuaWorker.h"
 #include "bindings/lua_Bindings.h"
 #include "imgui/ImGuiUtils.h"
 #include "imgui/ImGuiFileDialog.h"
@@ -52,6 +55,10 @@ namespace mq::lua {
 
 // provide option strings here
 static const std::string KEY_TURBO_NUM = "turboNum";
+static const std::string KEY_FRAME_BUDGET = "frameBudget";
+static const std::string KEY_GC_BUDGET = "gcBudget";
+static const std::string KEY_GC_PAUSE = "gcPause";
+static const std::string KEY_MEMORY_LIMIT = "memoryLimit";
 static const std::string KEY_LUA_DIR = "luaDir";
 static const std::string KEY_MODULE_DIR = "moduleDir";
 static const std::string KEY_LUA_REQUIRE_PATHS = "luaRequirePaths";
@@ -59,15 +66,26 @@ static const std::string KEY_DLL_REQUIRE_PATHS = "dllRequirePaths";
 static const std::string KEY_INFO_GC = "infoGC";
 static const std::string KEY_SQUELCH_STATUS = "squelchStatus";
 static const std::string KEY_SHOW_MENU = "showMenu";
+static const std::string KEY_SHARED_STATE_SCRIPTS = "sharedStateScripts";
+static const std::string KEY_SCRIPTS_PER_SHARED_STATE = "scriptsPerSharedState";
+static const std::string KEY_BYTECODE_CACHE = "bytecodeCache";
 
 // configurable options, defaults provided where needed
 static uint32_t s_turboNum = 500;
+static std::chrono::microseconds s_frameBudget{ 2000 }; // shared by all scripts, 0 to yield at every turbo
+static std::chrono::microseconds s_gcBudget{ 500 };     // garbage collection per frame, 0 to leave it to lua
+static uint32_t s_gcPause = 200;                        // percent of the memory left by a cycle to start the next at
+static uint32_t s_memoryLimit = 0;                      // MB, for scripts with a state of their own, 0 for none
 static std::string s_luaDirName = "lua";
 static std::string s_moduleDirName = "modules";
 static LuaEnvironmentSettings s_environment;
 static std::chrono::milliseconds s_infoGC = 3600s; // 1 hour
 static bool s_squelchStatus = false;
 static bool s_verboseErrors = true;
+static uint32_t s_luaThreadsBenchmark = 0;
+
+// scripts (by canonical name) that run in a shared lua state instead of one of their own
+static ci_unordered::set<std::string> s_sharedStateScripts;
 
 // this is static and will never change
 static std::string s_configPath = (std::filesystem::path(gPathConfig) / "MQ2Lua.yaml").string();
@@ -86,6 +104,35 @@ std::vector<std::shared_ptr<LuaThread>> s_pending;
 
 std::unordered_map<uint32_t, LuaThreadInfo> s_infoMap;
 
+// How many frames worth of budget a script can save up by yielding early, or owe after running over
+constexpr int MAX_CARRIED_FRAMES = 4;
+constexpr std::chrono::seconds CPU_SHARE_WINDOW{ 1 };
+
+// the game events that scripts can wait on with mq.delay
+static std::vector<int> s_gameEventObservers;
+
+static void WakeScripts(uint32_t events)
+{
+	for (const std::shared_ptr<LuaThread>& thread : s_running)
+		thread->Wake(events);
+}
+
+static void AddWakeObserver(MQGameEvent event, uint32_t wakeEvents)
+{
+	s_gameEventObservers.push_back(AddGameEventObserver(event,
+		[wakeEvents](const MQGameEventInfo&) { WakeScripts(wakeEvents); }));
+}
+
+static int GetPriorityWeight(LuaThreadPriority priority)
+{
+	switch (priority)
+	{
+	case LuaThreadPriority::Low: return 1;
+	case LuaThreadPriority::High: return 4;
+	default: return 2;
+	}
+}
+
 #pragma region Shared Function Definitions
 
 void DebugStackTrace(lua_State* L, const char* message)
@@ -581,7 +628,10 @@ static uint32_t LuaRunCommand(const std::string& script, const std::vector<std::
 		s_infoMap.erase(info_it);
 	}
 
-	std::shared_ptr<LuaThread> entry = LuaThread::Create(&s_environment);
+	const LuaStateMode mode = s_sharedStateScripts.count(locationInfo.canonicalName) != 0
+		? LuaStateMode::Shared : LuaStateMode::Separate;
+
+	std::shared_ptr<LuaThread> entry = LuaThread::Create(&s_environment, mode);
 	entry->SetTurbo(s_turboNum);
 	entry->EnableEvents();
 	entry->EnableImGui();
@@ -811,6 +861,73 @@ static void LuaPauseCommand(std::optional<std::string> script, bool on, bool off
 	}
 }
 
+static std::shared_ptr<LuaThread> FindRunningThread(uint32_t pid)
+{
+	auto thread_it = std::find_if(s_running.begin(), s_running.end(),
+		[&pid](const std::shared_ptr<LuaThread>& thread) { return thread->GetPID() == pid; });
+
+	return thread_it != s_running.end() ? *thread_it : nullptr;
+}
+
+static void LuaProfileCommand(const std::string& script)
+{
+	std::shared_ptr<LuaThread> thread;
+	uint32_t pid = GetIntFromString(script, 0UL);
+
+	if (pid > 0UL)
+	{
+		thread = FindRunningThread(pid);
+	}
+	else
+	{
+		auto thread_it = std::find_if(s_running.begin(), s_running.end(),
+			[&script](const std::shared_ptr<LuaThread>& thread) { return ci_equals(thread->GetName(), script); });
+		if (thread_it != s_running.end())
+			thread = *thread_it;
+	}
+
+	if (!thread)
+	{
+		WriteChatStatus("No lua script '%s' to profile", script.c_str());
+		return;
+	}
+
+	if (!thread->IsProfiling())
+	{
+		thread->StartProfiling();
+		WriteChatStatus("Profiling lua script '%s' with PID %d", thread->GetName().c_str(), thread->GetPID());
+		return;
+	}
+
+	thread->StopProfiling();
+
+	time_t curr_time;
+	time(&curr_time);
+
+	std::tm local_tm;
+	localtime_s(&local_tm, &curr_time);
+
+	std::string name = thread->GetName();
+	std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == ':'; }, '_');
+
+	const std::string path = (std::filesystem::path(gPathLogs)
+		/ fmt::format("LuaProfile_{}_{:04d}{:02d}{:02d}_{:02d}{:02d}{:02d}", name,
+			local_tm.tm_year + 1900, local_tm.tm_mon + 1, local_tm.tm_mday,
+			local_tm.tm_hour, local_tm.tm_min, local_tm.tm_sec)).string();
+
+	const LuaProfiler* profiler = thread->GetProfiler();
+	if (profiler->WriteFolded(path))
+	{
+		WriteChatStatus("Profiled '%s' for %.1f seconds, wrote %s.time.folded and %s.instructions.folded",
+			thread->GetName().c_str(), std::chrono::duration<double>(profiler->GetDuration()).count(),
+			path.c_str(), path.c_str());
+	}
+	else
+	{
+		WriteChatStatus("Failed to write the profile of '%s' to %s", thread->GetName().c_str(), path.c_str());
+	}
+}
+
 void SetLuaDirName(const std::string& luaDir)
 {
 	s_luaDirName = luaDir;
@@ -886,6 +1003,13 @@ static void ReadSettings()
 		}
 	}
 
+	s_frameBudget = std::chrono::microseconds(s_configNode[KEY_FRAME_BUDGET].as<uint32_t>(
+		static_cast<uint32_t>(s_frameBudget.count())));
+	s_gcBudget = std::chrono::microseconds(s_configNode[KEY_GC_BUDGET].as<uint32_t>(
+		static_cast<uint32_t>(s_gcBudget.count())));
+	s_gcPause = std::max(s_configNode[KEY_GC_PAUSE].as<uint32_t>(s_gcPause), 100U);
+	s_memoryLimit = s_configNode[KEY_MEMORY_LIMIT].as<uint32_t>(s_memoryLimit);
+
 	s_verboseErrors = s_configNode["verboseErrors"].as<bool>(false);
 
 	std::string tempDirName = s_luaDirName;
@@ -920,6 +1044,22 @@ static void ReadSettings()
 		}
 	}
 
+	s_sharedStateScripts.clear();
+	if (s_configNode[KEY_SHARED_STATE_SCRIPTS].IsSequence())
+	{
+		for (const auto& script : s_configNode[KEY_SHARED_STATE_SCRIPTS])
+		{
+			s_sharedStateScripts.emplace(script.as<std::string>());
+		}
+	}
+
+	s_environment.scriptsPerSharedState = std::max(1U, s_configNode[KEY_SCRIPTS_PER_SHARED_STATE].as<uint32_t>(16U));
+
+	// the shared states that exist were configured with the old settings
+	LuaThread::ReleaseSharedStates();
+
+	s_environment.bytecodeCache = s_configNode[KEY_BYTECODE_CACHE].as<bool>(true);
+
 	auto GC_interval = s_configNode[KEY_INFO_GC].as<std::string>(std::to_string(s_infoGC.count()));
 	trim(GC_interval);
 
@@ -962,7 +1102,8 @@ static void LuaConfCommand(const std::string& setting, const std::string& value)
 {
 	if (!value.empty())
 	{
-		if (ci_equals(setting, KEY_LUA_REQUIRE_PATHS) || ci_equals(setting, KEY_DLL_REQUIRE_PATHS))
+		if (ci_equals(setting, KEY_LUA_REQUIRE_PATHS) || ci_equals(setting, KEY_DLL_REQUIRE_PATHS)
+			|| ci_equals(setting, KEY_SHARED_STATE_SCRIPTS))
 		{
 			if (s_configNode[setting].IsNull())
 				s_configNode[setting] = YAML::Load("[]");
@@ -1022,19 +1163,23 @@ static void LuaPSCommand(const std::vector<std::string>& filters = {})
 		return std::find(filters.begin(), filters.end(), status) != filters.end();
 	};
 
-	WriteChatStatus("|  PID  |    NAME    |    START    |     END     |   STATUS   |");
+	WriteChatStatus("|  PID  |    NAME    |    START    |     END     |   STATUS   |  CPU  |");
 
 	for (const auto& [pid, info] : s_infoMap)
 	{
 		if (predicate(info))
 		{
+			auto thread_it = std::find_if(s_running.begin(), s_running.end(),
+				[pid = pid](const std::shared_ptr<LuaThread>& thread) { return thread->GetPID() == static_cast<int>(pid); });
+
 			fmt::memory_buffer line;
-			fmt::format_to(fmt::appender(line), "|{:^7}|{:^12}|{:%m/%d %I:%M%p}|{:^13}|{:^12}|",
+			fmt::format_to(fmt::appender(line), "|{:^7}|{:^12}|{:%m/%d %I:%M%p}|{:^13}|{:^12}|{:^7}|",
 				pid,
 				info.name.length() > 12 ? info.name.substr(0, 9) + "..." : info.name,
 				info.startTime,
 				info.status == LuaThreadStatus::Exited ? fmt::format("{:%m/%d %I:%M%p}", info.endTime) : "",
-				info.status_string());
+				info.status_string(),
+				thread_it != s_running.end() ? fmt::format("{:.1f}%", (*thread_it)->GetSchedule().cpuShare * 100.0f) : "");
 			WriteChatStatus("%.*s", line.size(), line.data());
 		}
 	}
@@ -1173,6 +1318,17 @@ void LuaCommand(SPAWNINFO* pChar, char* Buffer)
 		});
 	pause.RequireCommand(false);
 
+	args::Command profile(commands, "profile", "start or stop profiling a running lua script, the profile is written to the logs folder when it stops",
+		[](args::Subparser& parser)
+		{
+			args::Group arguments(parser, "", args::Group::Validators::All);
+			args::Positional<std::string> script(arguments, "process", "the PID or name of the script to profile");
+			auto h = HelpFlag(parser);
+			parser.Parse();
+
+			if (script) LuaProfileCommand(script.Get());
+		});
+
 	args::Command conf(commands, "conf", "set or view configuration variable",
 		[](args::Subparser& parser)
 		{
@@ -1577,6 +1733,61 @@ static void DrawLuaSettings()
 		s_configNode[KEY_TURBO_NUM] = s_turboNum;
 	}
 
+	ImGui::Text("Frame Budget:");
+	uint32_t budget_selected = static_cast<uint32_t>(s_frameBudget.count()), budget_min = 0U, budget_max = 10000U;
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::SliderScalar("##frameBudgetSlider", ImGuiDataType_U32, &budget_selected, &budget_min, &budget_max,
+		budget_selected == 0 ? "Off (yield at every turbo)" : "%u Microseconds per Frame", ImGuiSliderFlags_None))
+	{
+		s_frameBudget = std::chrono::microseconds(budget_selected);
+		s_configNode[KEY_FRAME_BUDGET] = budget_selected;
+	}
+	ImGui::SameLine();
+	mq::imgui::HelpMarker("The time that all of the scripts get to run for each frame, split between the scripts "
+		"that aren't waiting on a delay by their priority (mq.priority). Budget left over by yielding early "
+		"is saved up for a few frames. The turbo is how often a script looks at the clock.");
+
+	ImGui::Text("Garbage Collection Budget:");
+	uint32_t gc_selected = static_cast<uint32_t>(s_gcBudget.count()), gc_min = 0U, gc_max = 5000U;
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::SliderScalar("##gcBudgetSlider", ImGuiDataType_U32, &gc_selected, &gc_min, &gc_max,
+		gc_selected == 0 ? "Off (collect while the scripts allocate)" : "%u Microseconds per Frame", ImGuiSliderFlags_None))
+	{
+		s_gcBudget = std::chrono::microseconds(gc_selected);
+		s_configNode[KEY_GC_BUDGET] = gc_selected;
+	}
+	ImGui::SameLine();
+	mq::imgui::HelpMarker("The time spent collecting the garbage of all of the scripts each frame, after the "
+		"scripts have run, along with whatever is left of the frame budget. Scripts never stop to collect "
+		"garbage in the middle of running. A script that allocates faster than this can collect falls back "
+		"to collecting while it allocates, until it catches up.");
+
+	ImGui::Text("Garbage Collection Pause:");
+	uint32_t pause_selected = s_gcPause, pause_min = 100U, pause_max = 400U;
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::SliderScalar("##gcPauseSlider", ImGuiDataType_U32, &pause_selected, &pause_min, &pause_max,
+		"%u%%", ImGuiSliderFlags_None))
+	{
+		s_gcPause = pause_selected;
+		s_configNode[KEY_GC_PAUSE] = pause_selected;
+	}
+	ImGui::SameLine();
+	mq::imgui::HelpMarker("How much a script's memory grows, compared to what was left after the last "
+		"collection, before the next collection starts. Lower collects more often, higher uses more memory.");
+
+	ImGui::Text("Memory Limit:");
+	uint32_t limit_selected = s_memoryLimit, limit_min = 0U, limit_max = 2048U;
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::SliderScalar("##memoryLimitSlider", ImGuiDataType_U32, &limit_selected, &limit_min, &limit_max,
+		limit_selected == 0 ? "None" : "%u MB per Script", ImGuiSliderFlags_None))
+	{
+		s_memoryLimit = limit_selected;
+		s_configNode[KEY_MEMORY_LIMIT] = limit_selected;
+	}
+	ImGui::SameLine();
+	mq::imgui::HelpMarker("Scripts that still use more than this after a collection are ended. Scripts in a "
+		"shared state aren't limited, their memory can't be told apart.");
+
 
 	ImGui::Text("Lua Directory:");
 	auto dirDisplay = s_configNode[KEY_LUA_DIR].as<std::string>(s_luaDirName);
@@ -1848,6 +2059,24 @@ PLUGIN_API void InitializePlugin()
 
 	bindings::InitializeBindings_MQMacroData();
 
+	s_luaThreadsBenchmark = AddMQ2Benchmark("Lua_Threads");
+
+	AddWakeObserver(MQGameEvent::TargetChanged, LuaWakeEvent_Target);
+	AddWakeObserver(MQGameEvent::CastingChanged, LuaWakeEvent_Cast);
+	AddWakeObserver(MQGameEvent::CastPhaseChanged, LuaWakeEvent_Cast);
+	AddWakeObserver(MQGameEvent::BuffsChanged, LuaWakeEvent_Buff);
+	AddWakeObserver(MQGameEvent::ZoneChanged, LuaWakeEvent_Zone);
+	AddWakeObserver(MQGameEvent::GroupChanged, LuaWakeEvent_Roster);
+	AddWakeObserver(MQGameEvent::RaidChanged, LuaWakeEvent_Roster);
+	AddWakeObserver(MQGameEvent::XTargetChanged, LuaWakeEvent_XTarget);
+	AddWakeObserver(MQGameEvent::TaskObjectiveProgress, LuaWakeEvent_Task);
+	AddWakeObserver(MQGameEvent::AdvLootChanged, LuaWakeEvent_AdvLoot);
+	AddWakeObserver(MQGameEvent::SpawnBuffGained, LuaWakeEvent_SpawnBuff);
+	AddWakeObserver(MQGameEvent::SpawnBuffLost, LuaWakeEvent_SpawnBuff);
+	AddWakeObserver(MQGameEvent::SpawnBuffExpiring, LuaWakeEvent_SpawnBuff);
+	AddWakeObserver(MQGameEvent::PetChanged, LuaWakeEvent_Pet);
+	AddWakeObserver(MQGameEvent::MercenaryChanged, LuaWakeEvent_Mercenary);
+
 	LuaActors::Start();
 }
 
@@ -1856,6 +2085,13 @@ PLUGIN_API void ShutdownPlugin()
 	using namespace mq::lua;
 
 	LuaActors::Stop();
+	LuaWorkers::Stop();
+
+	for (int observerId : s_gameEventObservers)
+		RemoveGameEventObserver(observerId);
+	s_gameEventObservers.clear();
+
+	RemoveMQ2Benchmark(s_luaThreadsBenchmark);
 
 	bindings::ShutdownBindings_MQMacroData();
 
@@ -1876,6 +2112,118 @@ PLUGIN_API void ShutdownPlugin()
 	s_pluginInterface = nullptr;
 }
 
+// Steps the garbage collectors of the states of the running scripts, so their collection happens
+// here, within the slice, instead of in the middle of a script. Collection is stopped between the
+// slices. A cycle is started once a state has grown by the pause since the last one, like lua would,
+// and the states take turns at the slice. A state that grows to twice the size it should have started
+// at is given back to lua's own pacing until a cycle finishes.
+static void CollectGarbage(std::chrono::microseconds slice)
+{
+	using namespace mq::lua;
+
+	// a state is shared by the scripts that run in it
+	std::vector<std::pair<LuaVM*, LuaThread*>> states;
+	for (const std::shared_ptr<LuaThread>& thread : s_running)
+	{
+		LuaVM* vm = thread->GetVM();
+		if (std::find_if(states.begin(), states.end(), [vm](const auto& state) { return state.first == vm; }) == states.end())
+			states.emplace_back(vm, thread.get());
+	}
+
+	if (s_gcBudget.count() == 0)
+	{
+		for (auto& [vm, _] : states)
+		{
+			if (vm->gcStopped)
+			{
+				lua_gc(vm->state.lua_state(), LUA_GCRESTART, 0);
+				vm->gcStopped = false;
+			}
+		}
+
+		return;
+	}
+
+	static size_t nextState = 0;
+	if (states.empty())
+		return;
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto deadline = start + slice;
+
+	for (size_t i = 0; i < states.size(); ++i)
+	{
+		auto [vm, thread] = states[(nextState + i) % states.size()];
+		lua_State* L = vm->state.lua_state();
+
+		const size_t memory = static_cast<size_t>(lua_gc(L, LUA_GCCOUNT, 0));
+		if (!vm->gcStopped)
+		{
+			vm->gcEstimate = std::max(vm->gcEstimate, memory);
+			vm->gcStopped = true;
+		}
+
+		const size_t threshold = std::max<size_t>(vm->gcEstimate * s_gcPause / 100, 1024);
+		if (!vm->gcCollecting && memory >= threshold)
+			vm->gcCollecting = true;
+
+		const auto stateStart = std::chrono::steady_clock::now();
+		bool finished = false;
+
+		// stepping sets up lua's own pacing again, which is stopped again once the time is up
+		while (vm->gcCollecting && std::chrono::steady_clock::now() < deadline)
+		{
+			if (lua_gc(L, LUA_GCSTEP, 0))
+			{
+				finished = true;
+				break;
+			}
+		}
+
+		const auto stateEnd = std::chrono::steady_clock::now();
+
+		if (finished)
+		{
+			vm->gcCollecting = false;
+			vm->gcEstimate = static_cast<size_t>(lua_gc(L, LUA_GCCOUNT, 0));
+
+			if (s_memoryLimit > 0 && !vm->shared && vm->gcEstimate / 1024 > s_memoryLimit)
+			{
+				LuaError("Ending %s, it uses %u MB, which is over the memory limit of %u MB.", thread->GetName().c_str(),
+					static_cast<uint32_t>(vm->gcEstimate / 1024), s_memoryLimit);
+				thread->Exit();
+			}
+		}
+
+		if (vm->gcCollecting && memory >= threshold * 2)
+		{
+			// falling behind, the allocations drive the collection until this cycle is done
+			lua_gc(L, LUA_GCRESTART, 0);
+		}
+		else
+		{
+			lua_gc(L, LUA_GCSTOP, 0);
+		}
+
+		if (stateEnd > stateStart)
+		{
+			if (!vm->shared && thread->IsProfiling())
+				thread->GetProfiler()->AddGarbageCollection(stateEnd - stateStart);
+
+			AddTimelineZone("Garbage Collection", "Lua", stateStart, stateEnd);
+		}
+
+		if (stateEnd >= deadline)
+		{
+			// the next frame starts with the state that ran out of time
+			nextState = (nextState + i) % states.size();
+			return;
+		}
+	}
+
+	nextState = (nextState + 1) % states.size();
+}
+
 PLUGIN_API void OnPulse()
 {
 	using namespace mq::lua;
@@ -1886,19 +2234,96 @@ PLUGIN_API void OnPulse()
 		s_pending.clear();
 	}
 
-	s_running.erase(std::remove_if(s_running.begin(), s_running.end(),
-		[](const std::shared_ptr<LuaThread>& thread) -> bool
+	// Finished workers can end delays before the scripts run
+	LuaWorkers::Process();
+
+	const auto scriptsStart = std::chrono::steady_clock::now();
+
+	{
+		MQScopedBenchmark bm(s_luaThreadsBenchmark);
+
+		// Scripts that are waiting on a delay aren't resumed, and don't get a part of the budget
+		int totalWeight = 0;
+		if (s_frameBudget.count() > 0)
 		{
-			LuaThread::RunResult result = thread->Run();
+			for (const std::shared_ptr<LuaThread>& thread : s_running)
+			{
+				if (!thread->IsSleeping())
+					totalWeight += GetPriorityWeight(thread->GetSchedule().priority);
+			}
+		}
 
-			if (result.first != sol::thread_status::yielded)
+		s_running.erase(std::remove_if(s_running.begin(), s_running.end(),
+			[totalWeight](const std::shared_ptr<LuaThread>& thread) -> bool
 			{
-				EndScript(thread, result, true);
-				return true;
+				if (thread->IsSleeping())
+					return false;
+
+				LuaThreadSchedule& schedule = thread->GetSchedule();
+				std::chrono::microseconds share{ 0 };
+				if (totalWeight > 0)
+				{
+					share = std::max(s_frameBudget * GetPriorityWeight(schedule.priority) / totalWeight,
+						std::chrono::microseconds{ 1 });
+					schedule.credit = std::min(schedule.credit + share, share * MAX_CARRIED_FRAMES);
+
+					// paying back a frame it ran over in
+					if (schedule.credit.count() <= 0)
+						return false;
+				}
+
+				const auto start = std::chrono::steady_clock::now();
+				thread->SetTimeSlice(totalWeight > 0 ? start + schedule.credit : std::chrono::steady_clock::time_point{});
+				SetSlowExpressionSource(thread->GetName().c_str());
+				LuaThread::RunResult result = thread->Run();
+				SetSlowExpressionSource(nullptr);
+				thread->SetTimeSlice({});
+				const auto end = std::chrono::steady_clock::now();
+				AddTimelineZone(thread->GetName().c_str(), "Lua", start, end);
+
+				schedule.windowTime += end - start;
+				if (totalWeight > 0)
+				{
+					schedule.credit = std::max(schedule.credit - std::chrono::duration_cast<std::chrono::microseconds>(end - start),
+						-share * MAX_CARRIED_FRAMES);
+				}
+
+				if (result.first != sol::thread_status::yielded)
+				{
+					EndScript(thread, result, true);
+					return true;
+				}
+
+				return false;
+			}), s_running.end());
+	}
+
+	{
+		// whatever the scripts left of the frame budget goes to the collection as well
+		const auto scriptsTime = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - scriptsStart);
+		const auto leftover = std::max(s_frameBudget - scriptsTime, std::chrono::microseconds{ 0 });
+
+		CollectGarbage(s_gcBudget + leftover);
+	}
+
+	{
+		const auto now = std::chrono::steady_clock::now();
+		static auto windowStart = now;
+
+		if (now - windowStart >= CPU_SHARE_WINDOW)
+		{
+			const float window = std::chrono::duration<float>(now - windowStart).count();
+			for (const std::shared_ptr<LuaThread>& thread : s_running)
+			{
+				LuaThreadSchedule& schedule = thread->GetSchedule();
+				schedule.cpuShare = std::chrono::duration<float>(schedule.windowTime).count() / window;
+				schedule.windowTime = {};
 			}
 
-			return false;
-		}), s_running.end());
+			windowStart = now;
+		}
+	}
 
 	// Process messages after any threads have ended or started (the order likely won't matter since cleanup is checked)
 	LuaActors::Process();
@@ -1926,16 +2351,6 @@ PLUGIN_API void OnPulse()
 	}
 }
 
-PLUGIN_API void OnAddSpawn(PlayerClient* spawn)
-{
-	using namespace mq::lua;
-	for (const auto& thread : s_running)
-		thread->AddSpawn(spawn);
-
-	for (const auto& thread : s_pending)
-		thread->AddSpawn(spawn);
-}
-
 PLUGIN_API void OnRemoveSpawn(PlayerClient* spawn)
 {
 	using namespace mq::lua;
@@ -1974,7 +2389,17 @@ PLUGIN_API void OnUpdateImGui()
 	for (const std::shared_ptr<LuaThread>& thread : s_running)
 	{
 		if (LuaImGuiProcessor* imgui = thread->GetImGuiProcessor())
+		{
+			// ImGui callbacks run outside of the frame slices, so they are profiled separately
+			LuaProfiler* profiler = thread->IsProfiling() ? thread->GetProfiler() : nullptr;
+			if (profiler)
+				profiler->Resume();
+
 			imgui->Pulse();
+
+			if (profiler)
+				profiler->Suspend();
+		}
 	}
 
 	if (!s_showMenu)
@@ -2119,6 +2544,40 @@ PLUGIN_API void OnUpdateImGui()
 				ImGui::PopFont();
 			}
 
+			std::shared_ptr<LuaThread> thread = FindRunningThread(info.pid);
+			if (const LuaProfiler* profiler = thread ? thread->GetProfiler() : nullptr;
+				profiler && ImGui::CollapsingHeader("Profile", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				ImGui::Text("%s for %.1f seconds", thread->IsProfiling() ? "Profiling" : "Profiled",
+					std::chrono::duration<double>(profiler->GetDuration()).count());
+
+				if (ImGui::BeginTable("##LuaProfile", 4, ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg
+					| ImGuiTableFlags_BordersOuter | ImGuiTableFlags_Resizable, ImVec2(0, 200)))
+				{
+					ImGui::TableSetupScrollFreeze(0, 1);
+					ImGui::TableSetupColumn("Function", ImGuiTableColumnFlags_WidthStretch);
+					ImGui::TableSetupColumn("Time (ms)", ImGuiTableColumnFlags_WidthFixed, 70);
+					ImGui::TableSetupColumn("Instructions", ImGuiTableColumnFlags_WidthFixed, 80);
+					ImGui::TableSetupColumn("Calls", ImGuiTableColumnFlags_WidthFixed, 60);
+					ImGui::TableHeadersRow();
+
+					for (const LuaProfiler::FunctionStats& function : profiler->GetFunctions())
+					{
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::TextUnformatted(function.Name.c_str());
+						ImGui::TableNextColumn();
+						ImGui::Text("%.2f", function.Self.Time / 1000000.0);
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", function.Self.Instructions);
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", function.Self.Calls);
+					}
+
+					ImGui::EndTable();
+				}
+			}
+
 			ImGui::EndChild();
 
 			if (info.status != LuaThreadStatus::Exited)
@@ -2134,6 +2593,13 @@ PLUGIN_API void OnUpdateImGui()
 				{
 					LuaPauseCommand(fmt::format("{}", info.pid), false, false);
 				}
+
+				ImGui::SameLine();
+
+				if (ImGui::Button(thread && thread->IsProfiling() ? "Stop Profiling" : "Start Profiling"))
+				{
+					LuaProfileCommand(fmt::format("{}", info.pid));
+				}
 			}
 			else
 			{
@@ -2253,26 +2719,12 @@ PLUGIN_API void OnUpdateImGui()
 
 PLUGIN_API void OnWriteChatColor(const char* Line, int Color, int Filter)
 {
-	for (const std::shared_ptr<mq::lua::LuaThread>& thread : mq::lua::s_running)
-	{
-		if (thread && !thread->IsPaused())
-		{
-			if (lua::LuaEventProcessor* events = thread->GetEventProcessor())
-				events->Process(Line);
-		}
-	}
+	lua::LuaEventMatcher::Get().Process(Line);
 }
 
 PLUGIN_API bool OnIncomingChat(const char* Line, DWORD Color)
 {
-	for (const std::shared_ptr<mq::lua::LuaThread>& thread : mq::lua::s_running)
-	{
-		if (thread && !thread->IsPaused())
-		{
-			if (lua::LuaEventProcessor* events = thread->GetEventProcessor())
-				events->Process(Line);
-		}
-	}
+	lua::LuaEventMatcher::Get().Process(Line);
 
 	return false;
 }
@@ -2286,6 +2738,9 @@ PLUGIN_API void OnUnloadPlugin(const char* pluginName)
 {
 	using namespace mq::lua;
 
+	// the plugin is about to remove its types, and member handles can't tell
+	bindings::ClearMemberHandleCache();
+
 	// Visit all of our currently running scripts and terminate any that might be utilizing this plugin as a dependency.
 	MQPlugin* plugin = GetPlugin(pluginName);
 
@@ -19,8 +19,12 @@
 namespace mq::lua::bindings {
 
 void RegisterBindings_EQ(LuaThread* thread, sol::table& mq);
-void RegisterBindings_Globals(LuaThread* thread, sol::state_view sv);
+void RegisterBindings_Globals(sol::state_view sv);
 void RegisterBindings_MQ(LuaThread* thread, sol::table& mq);
+
+// The parts of the mq namespace that belong to the script. The rest can be shared by every script
+// of a shared state.
+void RegisterBindings_MQScript(LuaThread* thread, sol::table& mq);
 sol::table RegisterBindings_ImGui(sol::state_view sv);
 void RegisterBindings_Bit32(sol::state_view sv);
 
@@ -31,4 +35,8 @@ void RegisterBindings_MQMacroData(sol::table& lua);
 void InitializeBindings_MQMacroData();
 void ShutdownBindings_MQMacroData();
 
+// Forgets the member handles that lua_MQTypeVar has resolved. Has to be called before any types
+// that members were accessed on are destroyed.
+void ClearMemberHandleCache();
+
 } // namespace mq::lua::bindings
@@ -158,13 +158,11 @@ static sol::table lua_getAllSpawns(sol::this_state L)
 {
 	sol::table allSpawns = sol::state_view(L).create_table();
 
-	if (auto thisThread = LuaThread::get_from(L))
+	if (auto thisThread = LuaThread::get_from(L); thisThread && pSpawnManager != nullptr)
 	{
-		sol::table spawnTable = thisThread->GetSpawnTable();
-
-		for (const auto& [_, value] : spawnTable)
+		for (auto spawn = pSpawnManager->FirstSpawn; spawn != nullptr; spawn = spawn->GetNext())
 		{
-			allSpawns.add(value);
+			allSpawns.add(thisThread->GetSpawn(spawn));
 		}
 	}
 
@@ -176,12 +174,18 @@ static sol::table lua_getFilteredspawns(sol::this_state L, sol::optional<sol::un
 	sol::table filteredSpawns = sol::state_view(L).create_table();
 	auto thisThread = LuaThread::get_from(L);
 
-	if (thisThread && predicate_.has_value())
+	if (thisThread && predicate_.has_value() && pSpawnManager != nullptr)
 	{
-		sol::table spawnTable = thisThread->GetSpawnTable();
 		const sol::unsafe_function& predicate = predicate_.value();
 
-		for (const auto& [_, value] : spawnTable)
+		// the predicate is free to do anything, so don't walk the spawn list while calling it
+		std::vector<sol::object> spawns;
+		for (auto spawn = pSpawnManager->FirstSpawn; spawn != nullptr; spawn = spawn->GetNext())
+		{
+			spawns.push_back(thisThread->GetSpawn(spawn));
+		}
+
+		for (const sol::object& value : spawns)
 		{
 			if (predicate(value))
 			{
@@ -234,6 +238,375 @@ static sol::table lua_getFilteredGroundItems(sol::this_state L, sol::unsafe_func
 
 #pragma endregion
 
+#pragma region Spawn Search
+
+// A spawn found by mq.findspawns. It only holds the id, and looks the spawn up when a field is
+// read, so the fields are nil once the spawn is gone.
+struct lua_SpawnHandle
+{
+	uint32_t id = 0;
+
+	PlayerClient* Get() const { return GetSpawnByID(id); }
+
+	bool IsValid() const { return Get() != nullptr; }
+
+	sol::optional<std::string> GetName() const
+	{
+		if (PlayerClient* spawn = Get())
+			return std::string(spawn->Name);
+		return sol::nullopt;
+	}
+
+	sol::optional<std::string> GetCleanName() const
+	{
+		if (PlayerClient* spawn = Get())
+			return std::string(spawn->DisplayedName);
+		return sol::nullopt;
+	}
+
+	sol::optional<const char*> GetType() const
+	{
+		if (PlayerClient* spawn = Get())
+			return GetTypeDesc(GetSpawnType(spawn));
+		return sol::nullopt;
+	}
+
+	sol::optional<float> GetX() const { return Read([](PlayerClient* spawn) { return spawn->X; }); }
+	sol::optional<float> GetY() const { return Read([](PlayerClient* spawn) { return spawn->Y; }); }
+	sol::optional<float> GetZ() const { return Read([](PlayerClient* spawn) { return spawn->Z; }); }
+	sol::optional<float> GetHeading() const { return Read([](PlayerClient* spawn) { return spawn->Heading * 0.703125f; }); }
+	sol::optional<int> GetLevel() const { return Read([](PlayerClient* spawn) { return static_cast<int>(spawn->Level); }); }
+
+	sol::optional<int64_t> GetPctHPs() const
+	{
+		return Read([](PlayerClient* spawn) { return spawn->HPMax == 0 ? 0 : spawn->HPCurrent * 100 / spawn->HPMax; });
+	}
+
+	sol::optional<int> GetPctMana() const
+	{
+		return Read([](PlayerClient* spawn) { return spawn->GetMaxMana() == 0 ? 0 : spawn->GetCurrentMana() * 100 / spawn->GetMaxMana(); });
+	}
+
+	sol::optional<int> GetPctEndurance() const
+	{
+		return Read([](PlayerClient* spawn) { return spawn->GetMaxEndurance() == 0 ? 0 : spawn->GetCurrentEndurance() * 100 / spawn->GetMaxEndurance(); });
+	}
+
+	sol::optional<const char*> GetClass() const { return Read([](PlayerClient* spawn) { return GetClassDesc(spawn->GetClass()); }); }
+	sol::optional<const char*> GetRace() const { return Read([](PlayerClient* spawn) { return pEverQuest->GetRaceDesc(spawn->GetRace()); }); }
+	sol::optional<bool> IsDead() const { return Read([](PlayerClient* spawn) { return spawn->StandState == STANDSTATE_DEAD; }); }
+	sol::optional<bool> IsTargetable() const { return Read([](PlayerClient* spawn) { return spawn->Targetable; }); }
+	sol::optional<int> GetCastingID() const { return Read([](PlayerClient* spawn) { return static_cast<int>(spawn->CastingData.SpellID); }); }
+
+	sol::optional<float> GetDistance() const
+	{
+		if (!pLocalPlayer)
+			return sol::nullopt;
+
+		return Read([](PlayerClient* spawn) { return GetDistance3D(pLocalPlayer->X, pLocalPlayer->Y, pLocalPlayer->Z, spawn->X, spawn->Y, spawn->Z); });
+	}
+
+	// The spawn as the same typevar as mq.TLO.Spawn gives, for everything that doesn't have a field.
+	sol::object GetSpawn(sol::this_state L) const
+	{
+		if (PlayerClient* spawn = Get())
+			return sol::make_object(L, lua_MQTypeVar(datatypes::pSpawnType->MakeTypeVar(spawn)));
+		return sol::lua_nil;
+	}
+
+	template <typename Func>
+	auto Read(Func&& func) const -> sol::optional<decltype(func(nullptr))>
+	{
+		if (PlayerClient* spawn = Get())
+			return func(spawn);
+		return sol::nullopt;
+	}
+};
+
+static void lua_setSpawnSearchString(const sol::table& filters, const char* key, char* dest)
+{
+	if (sol::optional<std::string> value = filters.get<sol::optional<std::string>>(key))
+		strcpy_s(dest, MAX_STRING, value->c_str());
+}
+
+static void lua_setSpawnSearchFlag(const sol::table& filters, const char* key, bool& dest)
+{
+	if (sol::optional<bool> value = filters.get<sol::optional<bool>>(key))
+		dest = *value;
+}
+
+// Finds the spawns that match the filters, nearest to the character first, without going through a
+// search string. Searches with a radius only look at the spawns in the cells of the spawn grid that
+// the radius covers. The results are lua_SpawnHandles.
+static sol::table lua_findspawns(sol::optional<sol::table> filters, sol::this_state L)
+{
+	sol::state_view lua(L);
+	sol::table results = lua.create_table();
+
+	PlayerClient* pOrigin = pControlledPlayer ? pControlledPlayer : pLocalPlayer;
+	if (!pOrigin)
+		return results;
+
+	MQSpawnSearch search;
+	ClearSearchSpawn(&search);
+	size_t limit = SIZE_MAX;
+
+	if (filters.has_value())
+	{
+		const sol::table& filtersTable = filters.value();
+
+		// the spawn type keywords of a spawn search: npc, pc, pet, corpse, mercenary...
+		if (sol::optional<std::string> type = filtersTable.get<sol::optional<std::string>>("type"))
+		{
+			char szType[MAX_STRING] = { 0 };
+			strcpy_s(szType, type->c_str());
+			ParseSearchSpawnArgs(szType, "", &search);
+		}
+
+		lua_setSpawnSearchString(filtersTable, "name", search.szName);
+		lua_setSpawnSearchString(filtersTable, "race", search.szRace);
+		lua_setSpawnSearchString(filtersTable, "class", search.szClass);
+		lua_setSpawnSearchString(filtersTable, "body", search.szBodyType);
+
+		search.MinLevel = filtersTable.get_or("minlevel", search.MinLevel);
+		search.MaxLevel = filtersTable.get_or("maxlevel", search.MaxLevel);
+		search.FRadius = filtersTable.get_or("radius", search.FRadius);
+		search.ZRadius = filtersTable.get_or("zradius", search.ZRadius);
+		search.NotID = filtersTable.get_or("notid", search.NotID);
+
+		if (sol::optional<sol::table> loc = filtersTable.get<sol::optional<sol::table>>("loc"))
+		{
+			search.bKnownLocation = true;
+			search.xLoc = loc->get_or("x", loc->get_or(1, 0.0f));
+			search.yLoc = loc->get_or("y", loc->get_or(2, 0.0f));
+		}
+
+		lua_setSpawnSearchFlag(filtersTable, "exact", search.bExactName);
+		lua_setSpawnSearchFlag(filtersTable, "los", search.bLoS);
+		lua_setSpawnSearchFlag(filtersTable, "targetable", search.bTargetable);
+		lua_setSpawnSearchFlag(filtersTable, "nopet", search.bNoPet);
+		lua_setSpawnSearchFlag(filtersTable, "named", search.bNamed);
+		lua_setSpawnSearchFlag(filtersTable, "xtarhater", search.bXTarHater);
+		lua_setSpawnSearchFlag(filtersTable, "group", search.bGroup);
+		lua_setSpawnSearchFlag(filtersTable, "raid", search.bRaid);
+		lua_setSpawnSearchFlag(filtersTable, "merchant", search.bMerchant);
+		lua_setSpawnSearchFlag(filtersTable, "banker", search.bBanker);
+
+		limit = filtersTable.get_or("limit", limit);
+	}
+
+	for (PlayerClient* spawn : SearchAllSpawns(&search, pOrigin, limit))
+	{
+		results.add(lua_SpawnHandle{ spawn->SpawnID });
+	}
+
+	return results;
+}
+
+#pragma endregion
+
+#pragma region Native Data
+
+// The fields of the character, its buffs and its extended targets that scripts read all the time,
+// read straight from the game instead of going through mq.TLO one member at a time. Like the spawn
+// handles, they look the data up again on every read, and are nil when it isn't there.
+
+struct lua_BuffHandle
+{
+	int slot = 0;                                          // into the effects, songs come after the buffs
+
+	const EQ_Affect* Get() const
+	{
+		PcProfile* pProfile = GetPcProfile();
+		if (!pProfile || slot < 0 || slot >= MAX_TOTAL_BUFFS)
+			return nullptr;
+
+		const EQ_Affect& buff = pProfile->GetEffect(slot);
+		return buff.SpellID > 0 ? &buff : nullptr;
+	}
+
+	bool IsValid() const { return Get() != nullptr; }
+
+	sol::optional<int> GetSpellID() const { return Read([](const EQ_Affect* buff) { return buff->SpellID; }); }
+	sol::optional<int> GetLevel() const { return Read([](const EQ_Affect* buff) { return static_cast<int>(buff->Level); }); }
+
+	sol::optional<std::string> GetName() const
+	{
+		if (const EQ_Affect* buff = Get())
+		{
+			if (EQ_Spell* spell = GetSpellByID(buff->SpellID))
+				return std::string(spell->Name);
+		}
+		return sol::nullopt;
+	}
+
+	// in milliseconds
+	sol::optional<uint32_t> GetDuration() const { return Read([](const EQ_Affect* buff) { return GetSpellBuffTimer(buff->SpellID); }); }
+
+	template <typename Func>
+	auto Read(Func&& func) const -> sol::optional<decltype(func(nullptr))>
+	{
+		if (const EQ_Affect* buff = Get())
+			return func(buff);
+		return sol::nullopt;
+	}
+};
+
+struct lua_XTargetHandle
+{
+	int slot = 0;
+
+	const ExtendedTargetSlot* Get() const
+	{
+		if (!pLocalPC || !pLocalPC->pExtendedTargetList)
+			return nullptr;
+
+		return pLocalPC->pExtendedTargetList->GetSlot(slot);
+	}
+
+	bool IsValid() const { return Get() != nullptr; }
+
+	sol::optional<uint32_t> GetID() const { return Read([](const ExtendedTargetSlot* xts) { return xts->SpawnID; }); }
+	sol::optional<std::string> GetName() const { return Read([](const ExtendedTargetSlot* xts) { return std::string(xts->Name); }); }
+
+	sol::optional<const char*> GetTargetType() const
+	{
+		return Read([](const ExtendedTargetSlot* xts)
+		{
+			const char* name = pLocalPC->pExtendedTargetList->ExtendedTargetRoleName(xts->xTargetType);
+			return name ? name : "UNKNOWN";
+		});
+	}
+
+	sol::optional<lua_SpawnHandle> GetSpawn() const
+	{
+		const ExtendedTargetSlot* xts = Get();
+		if (!xts || !xts->SpawnID)
+			return sol::nullopt;
+
+		return lua_SpawnHandle{ xts->SpawnID };
+	}
+
+	template <typename Func>
+	auto Read(Func&& func) const -> sol::optional<decltype(func(nullptr))>
+	{
+		if (const ExtendedTargetSlot* xts = Get())
+			return func(xts);
+		return sol::nullopt;
+	}
+};
+
+// mq.me, the character. The percentages are the same as ${Me.PctHPs} and friends.
+struct lua_CharacterHandle
+{
+	bool IsValid() const { return pLocalPC && pLocalPlayer; }
+
+	sol::optional<std::string> GetName() const { return Read([] { return std::string(pLocalPlayer->Name); }); }
+	sol::optional<uint32_t> GetID() const { return Read([] { return pLocalPlayer->SpawnID; }); }
+	sol::optional<int> GetLevel() const { return Read([] { return static_cast<int>(pLocalPlayer->Level); }); }
+	sol::optional<float> GetX() const { return Read([] { return pLocalPlayer->X; }); }
+	sol::optional<float> GetY() const { return Read([] { return pLocalPlayer->Y; }); }
+	sol::optional<float> GetZ() const { return Read([] { return pLocalPlayer->Z; }); }
+	sol::optional<float> GetHeading() const { return Read([] { return pLocalPlayer->Heading * 0.703125f; }); }
+
+	sol::optional<int> GetPctHPs() const { return Read([] { return GetMaxHPS() == 0 ? 0 : GetCurHPS() * 100 / GetMaxHPS(); }); }
+	sol::optional<int> GetCurrentHPs() const { return Read([] { return GetCurHPS(); }); }
+	sol::optional<int> GetMaxHPs() const { return Read([] { return GetMaxHPS(); }); }
+
+	sol::optional<int> GetPctMana() const { return ReadProfile([](PcProfile* pProfile) { return GetMaxMana() == 0 ? 0 : pProfile->Mana * 100 / GetMaxMana(); }); }
+	sol::optional<int> GetCurrentMana() const { return ReadProfile([](PcProfile* pProfile) { return pProfile->Mana; }); }
+	sol::optional<int> GetMaxManaValue() const { return Read([] { return GetMaxMana(); }); }
+
+	sol::optional<int> GetPctEndurance() const { return ReadProfile([](PcProfile* pProfile) { return GetMaxEndurance() == 0 ? 0 : pProfile->Endurance * 100 / GetMaxEndurance(); }); }
+	sol::optional<int> GetCurrentEndurance() const { return ReadProfile([](PcProfile* pProfile) { return pProfile->Endurance; }); }
+	sol::optional<int> GetMaxEnduranceValue() const { return Read([] { return GetMaxEndurance(); }); }
+
+	sol::optional<bool> IsInCombat() const { return Read([] { return pEverQuestInfo->bAutoAttack; }); }
+	sol::optional<int> GetCastingID() const { return Read([] { return static_cast<int>(pLocalPlayer->CastingData.SpellID); }); }
+
+	sol::optional<lua_SpawnHandle> GetTarget() const
+	{
+		if (!IsValid() || !pTarget)
+			return sol::nullopt;
+
+		return lua_SpawnHandle{ pTarget->SpawnID };
+	}
+
+	sol::optional<lua_SpawnHandle> GetSpawn() const
+	{
+		return Read([] { return lua_SpawnHandle{ pLocalPlayer->SpawnID }; });
+	}
+
+	// 1-based, like ${Me.Buff[n]} and ${Me.Song[n]}
+	sol::optional<lua_BuffHandle> GetBuff(int index) const
+	{
+		if (index < 1 || index > NUM_LONG_BUFFS)
+			return sol::nullopt;
+
+		lua_BuffHandle buff{ index - 1 };
+		if (!buff.IsValid())
+			return sol::nullopt;
+
+		return buff;
+	}
+
+	sol::optional<lua_BuffHandle> GetSong(int index) const
+	{
+		if (index < 1 || index > NUM_SHORT_BUFFS)
+			return sol::nullopt;
+
+		lua_BuffHandle buff{ NUM_LONG_BUFFS + index - 1 };
+		if (!buff.IsValid())
+			return sol::nullopt;
+
+		return buff;
+	}
+
+	// 1-based, like ${Me.XTarget[n]}
+	sol::optional<lua_XTargetHandle> GetXTarget(int index) const
+	{
+		lua_XTargetHandle xtarget{ index - 1 };
+		if (!IsValid() || !xtarget.IsValid())
+			return sol::nullopt;
+
+		return xtarget;
+	}
+
+	sol::optional<int> GetXTargetSlots() const
+	{
+		if (!IsValid() || !pLocalPC->pExtendedTargetList)
+			return sol::nullopt;
+
+		return pLocalPC->pExtendedTargetList->GetNumSlots();
+	}
+
+	template <typename Func>
+	auto Read(Func&& func) const -> sol::optional<decltype(func())>
+	{
+		if (IsValid())
+			return func();
+		return sol::nullopt;
+	}
+
+	template <typename Func>
+	auto ReadProfile(Func&& func) const -> sol::optional<decltype(func(nullptr))>
+	{
+		if (PcProfile* pProfile = IsValid() ? GetPcProfile() : nullptr)
+			return func(pProfile);
+		return sol::nullopt;
+	}
+};
+
+static sol::optional<lua_SpawnHandle> lua_getSpawn(uint32_t spawnID)
+{
+	if (!GetSpawnByID(spawnID))
+		return sol::nullopt;
+
+	return lua_SpawnHandle{ spawnID };
+}
+
+#pragma endregion
+
 //============================================================================
 
 void RegisterBindings_EQ(LuaThread* thread, sol::table& mq)
@@ -324,6 +697,80 @@ void RegisterBindings_EQ(LuaThread* thread, sol::table& mq)
 	mq.set_function("getFilteredSpawns", lua_getFilteredspawns);
 	mq.set_function("getAllGroundItems", lua_getAllGroundItems);
 	mq.set_function("getFilteredGroundItems", lua_getFilteredGroundItems);
+
+	mq.new_usertype<lua_SpawnHandle>(
+		"spawnhandle"                     , sol::no_constructor,
+		"id"                              , sol::readonly(&lua_SpawnHandle::id),
+		"valid"                           , sol::property(&lua_SpawnHandle::IsValid),
+		"name"                            , sol::property(&lua_SpawnHandle::GetName),
+		"cleanName"                       , sol::property(&lua_SpawnHandle::GetCleanName),
+		"type"                            , sol::property(&lua_SpawnHandle::GetType),
+		"x"                               , sol::property(&lua_SpawnHandle::GetX),
+		"y"                               , sol::property(&lua_SpawnHandle::GetY),
+		"z"                               , sol::property(&lua_SpawnHandle::GetZ),
+		"heading"                         , sol::property(&lua_SpawnHandle::GetHeading),
+		"level"                           , sol::property(&lua_SpawnHandle::GetLevel),
+		"hp"                              , sol::property(&lua_SpawnHandle::GetPctHPs),
+		"mana"                            , sol::property(&lua_SpawnHandle::GetPctMana),
+		"endurance"                       , sol::property(&lua_SpawnHandle::GetPctEndurance),
+		"class"                           , sol::property(&lua_SpawnHandle::GetClass),
+		"race"                            , sol::property(&lua_SpawnHandle::GetRace),
+		"dead"                            , sol::property(&lua_SpawnHandle::IsDead),
+		"targetable"                      , sol::property(&lua_SpawnHandle::IsTargetable),
+		"casting"                         , sol::property(&lua_SpawnHandle::GetCastingID),
+		"distance"                        , sol::property(&lua_SpawnHandle::GetDistance),
+		"spawn"                           , &lua_SpawnHandle::GetSpawn);
+
+	mq.set_function("findspawns"          , &lua_findspawns);
+	mq.set_function("getspawn"            , &lua_getSpawn);
+
+	mq.new_usertype<lua_BuffHandle>(
+		"buffhandle"                      , sol::no_constructor,
+		"slot"                            , sol::readonly(&lua_BuffHandle::slot),
+		"valid"                           , sol::property(&lua_BuffHandle::IsValid),
+		"spellID"                         , sol::property(&lua_BuffHandle::GetSpellID),
+		"name"                            , sol::property(&lua_BuffHandle::GetName),
+		"level"                           , sol::property(&lua_BuffHandle::GetLevel),
+		"duration"                        , sol::property(&lua_BuffHandle::GetDuration));
+
+	mq.new_usertype<lua_XTargetHandle>(
+		"xtargethandle"                   , sol::no_constructor,
+		"slot"                            , sol::readonly(&lua_XTargetHandle::slot),
+		"valid"                           , sol::property(&lua_XTargetHandle::IsValid),
+		"id"                              , sol::property(&lua_XTargetHandle::GetID),
+		"name"                            , sol::property(&lua_XTargetHandle::GetName),
+		"targetType"                      , sol::property(&lua_XTargetHandle::GetTargetType),
+		"spawn"                           , sol::property(&lua_XTargetHandle::GetSpawn));
+
+	mq.new_usertype<lua_CharacterHandle>(
+		"characterhandle"                 , sol::no_constructor,
+		"valid"                           , sol::property(&lua_CharacterHandle::IsValid),
+		"name"                            , sol::property(&lua_CharacterHandle::GetName),
+		"id"                              , sol::property(&lua_CharacterHandle::GetID),
+		"level"                           , sol::property(&lua_CharacterHandle::GetLevel),
+		"x"                               , sol::property(&lua_CharacterHandle::GetX),
+		"y"                               , sol::property(&lua_CharacterHandle::GetY),
+		"z"                               , sol::property(&lua_CharacterHandle::GetZ),
+		"heading"                         , sol::property(&lua_CharacterHandle::GetHeading),
+		"hp"                              , sol::property(&lua_CharacterHandle::GetPctHPs),
+		"currentHPs"                      , sol::property(&lua_CharacterHandle::GetCurrentHPs),
+		"maxHPs"                          , sol::property(&lua_CharacterHandle::GetMaxHPs),
+		"mana"                            , sol::property(&lua_CharacterHandle::GetPctMana),
+		"currentMana"                     , sol::property(&lua_CharacterHandle::GetCurrentMana),
+		"maxMana"                         , sol::property(&lua_CharacterHandle::GetMaxManaValue),
+		"endurance"                       , sol::property(&lua_CharacterHandle::GetPctEndurance),
+		"currentEndurance"                , sol::property(&lua_CharacterHandle::GetCurrentEndurance),
+		"maxEndurance"                    , sol::property(&lua_CharacterHandle::GetMaxEnduranceValue),
+		"combat"                          , sol::property(&lua_CharacterHandle::IsInCombat),
+		"casting"                         , sol::property(&lua_CharacterHandle::GetCastingID),
+		"target"                          , sol::property(&lua_CharacterHandle::GetTarget),
+		"spawn"                           , sol::property(&lua_CharacterHandle::GetSpawn),
+		"xtargetSlots"                    , sol::property(&lua_CharacterHandle::GetXTargetSlots),
+		"buff"                            , &lua_CharacterHandle::GetBuff,
+		"song"                            , &lua_CharacterHandle::GetSong,
+		"xtarget"                         , &lua_CharacterHandle::GetXTarget);
+
+	mq.set("me"                           , lua_CharacterHandle{});
 }
 
 } // namespace mq::lua::bindings
@@ -26,12 +26,39 @@ namespace mq::lua::bindings {
 
 void lua_exit(sol::this_state s);
 
-void RegisterBindings_Globals(LuaThread* thread, sol::state_view state)
+// Swaps package.loaded for that of the script while it is in require, when the script runs in a
+// shared state.
+class ScopedLoadedModules
+{
+public:
+	ScopedLoadedModules(const std::shared_ptr<LuaThread>& thread, sol::state_view sv)
+	{
+		if (thread && thread->IsSharedState())
+		{
+			m_registry = sv.registry();
+			m_previous = m_registry["_LOADED"];
+			m_registry["_LOADED"] = thread->GetLoadedModules();
+		}
+	}
+
+	~ScopedLoadedModules()
+	{
+		if (m_registry.valid())
+			m_registry["_LOADED"] = m_previous;
+	}
+
+private:
+	sol::table m_registry;
+	sol::object m_previous;
+};
+
+void RegisterBindings_Globals(sol::state_view state)
 {
 	state["_old_dofile"] = state["dofile"];
-	state["dofile"] = [thread](std::string_view file, sol::variadic_args args, sol::this_state s)
+	state["dofile"] = [](std::string_view file, sol::variadic_args args, sol::this_state s)
 	{
-		std::filesystem::path file_path = std::filesystem::path(thread->GetLuaDir()) / file;
+		std::shared_ptr<LuaThread> thread = LuaThread::get_from(s);
+		std::filesystem::path file_path = thread ? std::filesystem::path(thread->GetLuaDir()) / file : std::filesystem::path(file);
 		sol::function dofile = sol::state_view(s)["_old_dofile"];
 
 		return dofile(file_path.string(), args);
@@ -40,8 +67,6 @@ void RegisterBindings_Globals(LuaThread* thread, sol::state_view state)
 	// Replace os.exit with mq.exit
 	state["os"]["exit"] = &lua_exit;
 
-	state["mqthread"] = LuaThreadRef(thread->shared_from_this());
-
 	state["print"] = [](sol::variadic_args va, sol::this_state s) {
 		WriteChatColorf("%s", USERCOLOR_CHAT_CHANNEL, lua_join(s, "", va).c_str());
 	};
@@ -56,7 +81,9 @@ void RegisterBindings_Globals(LuaThread* thread, sol::state_view state)
 	state["_old_require"] = state["require"];
 	state["require"] = [](sol::variadic_args args, sol::this_state s)
 	{
-		ScopedYieldDisabler disabler(s, YieldDisabledReason::Require);
+		std::shared_ptr<LuaThread> thread = LuaThread::get_from(s);
+		ScopedYieldDisabler disabler(thread, YieldDisabledReason::Require);
+		ScopedLoadedModules loadedModules(thread, s);
 
 		sol::unsafe_function require = sol::state_view(s)["_old_require"];
 		return require(args);
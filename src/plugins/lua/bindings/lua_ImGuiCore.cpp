@@ -687,8 +687,19 @@ sol::table RegisterBindings_ImGui(sol::state_view state)
 	ImGui.set_function("EndChildFrame", &ImGui::EndChildFrame);
 #pragma endregion
 
-	bindings::RegisterBindings_ImGuiWidgets(ImGui);
-	bindings::RegisterBindings_ImGuiCustom(ImGui);
+	// The widgets are most of the bindings, and a lot of scripts require ImGui without ever drawing
+	// anything. They are bound the first time the table is asked for something it doesn't have.
+	sol::table lazyWidgets = state.create_table();
+	lazyWidgets[sol::meta_function::index] = [](sol::table ImGui, sol::object key) -> sol::object
+		{
+			ImGui[sol::metatable_key] = sol::lua_nil;
+
+			bindings::RegisterBindings_ImGuiWidgets(ImGui);
+			bindings::RegisterBindings_ImGuiCustom(ImGui);
+
+			return ImGui.raw_get<sol::object>(key);
+		};
+	ImGui[sol::metatable_key] = lazyWidgets;
 
 	return ImGui;
 }
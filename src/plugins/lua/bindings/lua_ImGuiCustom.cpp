@@ -30,7 +30,7 @@ namespace mq::lua::bindings {
 
 //============================================================================
 
-void lua_addimgui(std::string_view name, sol::function function, sol::this_state s);
+void lua_addimgui(std::string_view name, sol::function function, sol::optional<sol::table> options, sol::this_state s);
 void lua_removeimgui(std::string_view name, sol::this_state s);
 
 void RegisterBindings_ImGuiCustom(sol::table& ImGui)
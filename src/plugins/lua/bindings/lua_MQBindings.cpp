@@ -20,6 +20,7 @@
 #include "LuaEvent.h"
 #include "LuaImGui.h"
 #include "LuaThread.h"
+#include "LuaWorker.h"
 
 #include <mq/Plugin.h>
 
@@ -121,6 +122,29 @@ void lua_exit(sol::this_state s)
 	}
 }
 
+// Returns the priority of the script ("low", "normal" or "high"), after changing it if one is given.
+static std::string_view lua_priority(std::optional<std::string_view> priority, sol::this_state s)
+{
+	static constexpr std::string_view names[] = { "low", "normal", "high" };
+
+	std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(s);
+	if (!thread_ptr)
+		return names[static_cast<int>(LuaThreadPriority::Normal)];
+
+	LuaThreadSchedule& schedule = thread_ptr->GetSchedule();
+	if (priority)
+	{
+		auto iter = std::find_if(std::begin(names), std::end(names),
+			[&](std::string_view name) { return ci_equals(name, *priority); });
+		if (iter == std::end(names))
+			luaL_error(s.lua_state(), "Unknown priority '%s', expected low, normal or high", std::string(*priority).c_str());
+
+		schedule.priority = static_cast<LuaThreadPriority>(iter - std::begin(names));
+	}
+
+	return names[static_cast<int>(schedule.priority)];
+}
+
 #pragma endregion
 
 //============================================================================
@@ -306,6 +330,35 @@ static bool lua_removebind(std::string_view name, sol::this_state s)
 	return false;
 }
 
+static bool lua_addspawntrigger(std::string_view name, float radius, std::string_view search, sol::function function,
+	sol::this_state s)
+{
+	if (function == sol::nil)
+	{
+		luaL_error(s, "nil function passed as spawn trigger callback");
+		return false;
+	}
+
+	if (std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(s))
+	{
+		if (LuaEventProcessor* events = thread_ptr->GetEventProcessor())
+			return events->AddSpawnTrigger(name, radius, search, function);
+	}
+
+	return false;
+}
+
+static bool lua_removespawntrigger(std::string_view name, sol::this_state s)
+{
+	if (std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(s))
+	{
+		if (LuaEventProcessor* events = thread_ptr->GetEventProcessor())
+			return events->RemoveSpawnTrigger(name);
+	}
+
+	return false;
+}
+
 #pragma endregion
 
 //============================================================================
@@ -313,12 +366,30 @@ static bool lua_removebind(std::string_view name, sol::this_state s)
 #pragma region ImGui Bindings
 
 // We also bind these inside ImGui namespace
-void lua_addimgui(std::string_view name, sol::function function, sol::this_state s)
+// options: { refresh = milliseconds } to run the callback at most that often, or { static = true } to
+// only run it again after mq.imgui.invalidate(name). The last frame it drew is shown in between.
+void lua_addimgui(std::string_view name, sol::function function, sol::optional<sol::table> options, sol::this_state s)
 {
 	if (std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(s))
 	{
+		LuaImGuiRefresh refresh;
+		if (options)
+		{
+			refresh.interval = std::chrono::milliseconds(std::max(0, options->get_or("refresh", 0)));
+			refresh.isStatic = options->get_or("static", false);
+		}
+
 		if (LuaImGuiProcessor* imgui = thread_ptr->GetImGuiProcessor())
-			imgui->AddCallback(name, function);
+			imgui->AddCallback(name, function, refresh);
+	}
+}
+
+static void lua_invalidateimgui(std::string_view name, sol::this_state s)
+{
+	if (std::shared_ptr<LuaThread> thread_ptr = LuaThread::get_from(s))
+	{
+		if (LuaImGuiProcessor* imgui = thread_ptr->GetImGuiProcessor())
+			imgui->Invalidate(name);
 	}
 }
 
@@ -510,14 +581,145 @@ static sol::object lua_unpickle(sol::this_state L, std::string_view file_path)
 
 #pragma endregion
 
+#pragma region Item Search
+
+static void lua_setSearchString(const sol::table& options, const char* key, char* dest)
+{
+	if (sol::optional<std::string> value = options.get<sol::optional<std::string>>(key))
+		strcpy_s(dest, MAX_STRING, value->c_str());
+}
+
+static void lua_setSearchFlag(MQItemSearch& search, const sol::table& options, const char* key, SearchItemFlag flag)
+{
+	if (sol::optional<bool> value = options.get<sol::optional<bool>>(key))
+	{
+		search.FlagMask[flag] = 1;
+		search.Flag[flag] = *value ? 1 : 0;
+	}
+}
+
+// Returns every item that matches the options in a single pass, as a list of
+// { location, slot, bag, id, count } tables. Worn and inventory items are searched unless any of
+// worn, inventory, bank or sharedbank is given.
+static sol::table lua_searchitems(sol::optional<sol::table> options, sol::this_state L)
+{
+	MQItemSearch search = MQItemSearch();
+
+	if (options.has_value())
+	{
+		const sol::table& optionsTable = options.value();
+
+		lua_setSearchString(optionsTable, "name", search.szName);
+		lua_setSearchString(optionsTable, "stat", search.szStat);
+		lua_setSearchString(optionsTable, "slot", search.szSlot);
+		lua_setSearchString(optionsTable, "race", search.szRace);
+		lua_setSearchString(optionsTable, "class", search.szClass);
+		search.ID = optionsTable.get_or("id", 0u);
+
+		lua_setSearchFlag(search, optionsTable, "lore", Lore);
+		lua_setSearchFlag(search, optionsTable, "nodrop", NoDrop);
+		lua_setSearchFlag(search, optionsTable, "norent", NoRent);
+		lua_setSearchFlag(search, optionsTable, "magic", Magic);
+		lua_setSearchFlag(search, optionsTable, "book", Book);
+		lua_setSearchFlag(search, optionsTable, "pack", Pack);
+		lua_setSearchFlag(search, optionsTable, "combinable", Combinable);
+		lua_setSearchFlag(search, optionsTable, "summoned", Summoned);
+		lua_setSearchFlag(search, optionsTable, "weapon", Weapon);
+		lua_setSearchFlag(search, optionsTable, "normal", Normal);
+		lua_setSearchFlag(search, optionsTable, "instrument", Instrument);
+
+		lua_setSearchFlag(search, optionsTable, "worn", Worn);
+		lua_setSearchFlag(search, optionsTable, "inventory", Inventory);
+		lua_setSearchFlag(search, optionsTable, "bank", Bank);
+		lua_setSearchFlag(search, optionsTable, "sharedbank", SharedBank);
+	}
+
+	if (!search.FlagMask[Worn] && !search.FlagMask[Inventory] && !search.FlagMask[Bank] && !search.FlagMask[SharedBank])
+	{
+		search.FlagMask[Worn] = search.Flag[Worn] = 1;
+		search.FlagMask[Inventory] = search.Flag[Inventory] = 1;
+	}
+
+	sol::state_view lua(L);
+	sol::table results = lua.create_table();
+
+	for (const MQItemSearchResult& result : SearchAllItems(search))
+	{
+		results.add(lua.create_table_with(
+			"location", static_cast<int>(result.Index.GetLocation()),
+			"slot", result.Index.GetTopSlot(),
+			"bag", result.Index.GetIndex().GetSlot(1),
+			"id", result.ItemID,
+			"count", result.Count));
+	}
+
+	return results;
+}
+
+#pragma endregion
+
+#pragma region Window Notifications
+
+static std::string lua_notificationField(const sol::table& step, const char* name, int index)
+{
+	sol::object value = step[name];
+	if (value.get_type() == sol::type::lua_nil)
+		value = step[index];
+
+	if (value.get_type() == sol::type::string)
+		return value.as<std::string>();
+
+	if (value.get_type() == sol::type::number)
+		return std::to_string(value.as<int>());
+
+	return {};
+}
+
+// Sends the steps to the window in this frame, the same as a /notify for each. A step is a
+// { control, notification, data } table, by position or by name. Returns a { success, error } table
+// for every step that was sent.
+static sol::table lua_notify(const std::string& windowName, const sol::table& stepsTable,
+	sol::optional<bool> continueOnFailure, sol::this_state L)
+{
+	std::vector<MQWindowNotification> steps;
+
+	// In order, which pairs() wouldn't be.
+	for (size_t i = 1; i <= stepsTable.size(); ++i)
+	{
+		sol::object value = stepsTable[i];
+		if (value.get_type() != sol::type::table)
+			continue;
+
+		sol::table stepTable = value.as<sol::table>();
+
+		MQWindowNotification& step = steps.emplace_back();
+		step.ScreenID = lua_notificationField(stepTable, "control", 1);
+		step.Notification = lua_notificationField(stepTable, "notification", 2);
+		step.Data = lua_notificationField(stepTable, "data", 3);
+	}
+
+	sol::state_view lua(L);
+	sol::table results = lua.create_table();
+
+	for (const MQWindowNotificationResult& result : SendWindowNotifications(windowName.c_str(), steps,
+		!continueOnFailure.value_or(false)))
+	{
+		results.add(lua.create_table_with(
+			"success", result.Success,
+			"error", result.Error));
+	}
+
+	return results;
+}
+
+#pragma endregion
+
 //============================================================================
 
 void RegisterBindings_MQ(LuaThread* thread, sol::table& mq)
 {
 	// values
 	mq.set("configDir",                          gPathConfig);
-	mq.set("luaDir",                             thread->GetLuaDir());
-	mq.set("moduleDir",                          thread->GetModuleDir());
 
 	// utility bindings
 	mq.set_function("join",                      &lua_join);
@@ -531,6 +733,7 @@ void RegisterBindings_MQ(LuaThread* thread, sol::table& mq)
 	// thread bindings
 	mq.set_function("delay",                     &lua_delay);
 	mq.set_function("exit",                      &lua_exit);
+	mq.set_function("priority",                  &lua_priority);
 
 	// event bindings
 	mq.set_function("doevents",                  &lua_doevents);
@@ -539,12 +742,24 @@ void RegisterBindings_MQ(LuaThread* thread, sol::table& mq)
 	mq.set_function("unevent",                   &lua_removeevent);
 	mq.set_function("bind",                      &lua_addbind);
 	mq.set_function("unbind",                    &lua_removebind);
+	mq.set_function("spawntrigger",              &lua_addspawntrigger);
+	mq.set_function("unspawntrigger",            &lua_removespawntrigger);
+
+	// items
+	mq.set_function("searchitems",               &lua_searchitems);
+
+	// windows
+	mq.set_function("notify",                    &lua_notify);
+
+	// computation off the main thread
+	LuaWorkers::RegisterLua(mq);
 
 	// imgui bindings (under mq.imgui.xxx)
 	mq["imgui"] = mq.create_with(
 		"init",                                  &lua_addimgui,
 		"destroy",                               &lua_removeimgui,
-		"exists",                                &lua_hasimgui
+		"exists",                                &lua_hasimgui,
+		"invalidate",                            &lua_invalidateimgui
 	);
 
 	//----------------------------------------------------------------------------
@@ -569,9 +784,42 @@ void RegisterBindings_MQ(LuaThread* thread, sol::table& mq)
 		"MQTexture"                  , sol::no_constructor,
 		"size"                       , sol::property([](const MQTexture& mThis) -> ImVec2 { return mThis.GetTextureSize(); }),
 		"fileName"                   , sol::property(&mq::MQTexture::GetFilename),
+		"valid"                      , sol::property(&mq::MQTexture::IsValid),
+		"pending"                    , sol::property(&mq::MQTexture::IsPending),
 		"GetTextureID"               , &mq::MQTexture::GetTextureID
 	);
 	mq.set_function("CreateTexture", [](const std::string& name) { return CreateTexturePtr(name); });
+	mq.set_function("CreateTextureAsync", [](const std::string& name) { return CreateTextureAsync(name); });
+}
+
+void RegisterBindings_MQScript(LuaThread* thread, sol::table& mq)
+{
+	// values
+	mq.set("luaDir",                             thread->GetLuaDir());
+	mq.set("moduleDir",                          thread->GetModuleDir());
+
+	// Textures shared with every other script that asks for the same file. The script holds on to
+	// them until it releases them or ends, so asking again every frame is only a lookup here.
+	auto textures = std::make_shared<ci_unordered::map<std::string, MQTexturePtr>>();
+
+	mq.set_function("GetTexture", [textures](const std::string& name, sol::optional<bool> async) -> MQTexturePtr
+		{
+			auto iter = textures->find(name);
+			if (iter != textures->end() && iter->second && (iter->second->IsValid() || iter->second->IsPending()))
+				return iter->second;
+
+			MQTexturePtr texture = GetSharedTexture(name, async.value_or(false));
+			if (texture)
+				(*textures)[name] = texture;
+			else if (iter != textures->end())
+				textures->erase(iter);
+
+			return texture;
+		});
+	mq.set_function("ReleaseTexture", [textures](const std::string& name)
+		{
+			return textures->erase(name) != 0;
+		});
 }
 
 } // namespace mq::lua::bindings
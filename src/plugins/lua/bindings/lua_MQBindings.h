@@ -76,8 +76,12 @@ public:
 private:
 	MQTypeVar m_self;
 	std::string m_member;
+
+	// m_member resolved against the type of m_self, when it could be
+	MQMemberHandle m_handle;
 };
 
+
 //----------------------------------------------------------------------------
 
 class lua_MQTopLevelObject
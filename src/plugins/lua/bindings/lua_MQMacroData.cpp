@@ -14,8 +14,10 @@
 
 #include "pch.h"
 #include "lua_MQBindings.h"
+#include "lua_Bindings.h"
 
 #include "LuaThread.h"
+#include "LuaProfiler.h"
 
 #include <mq/Plugin.h>
 
@@ -281,6 +283,37 @@ static bool CreateMacroTypeFromLua(sol::object object, MQTypeVar& Dest)
 
 #pragma region Macro Data Bindings
 
+// Member handles by type and member name, so a member that lua has accessed before is evaluated
+// without looking its name up again. No handles can be made for types with extensions, so their
+// members are always evaluated by name.
+static std::unordered_map<MQ2Type*, ci_unordered::map<std::string, MQMemberHandle>> s_memberHandles;
+
+static MQMemberHandle FindMemberHandle(MQ2Type* type, std::string_view member)
+{
+	auto& handles = s_memberHandles[type];
+
+	auto iter = handles.find(member);
+	if (iter != handles.end())
+	{
+		if (type->IsValidHandle(iter->second))
+			return iter->second;
+
+		handles.erase(iter);
+	}
+
+	std::string memberName{ member };
+	MQMemberHandle handle = ResolveMacroDataMember(type, memberName.c_str());
+	if (handle)
+		handles.emplace(std::move(memberName), handle);
+
+	return handle;
+}
+
+void ClearMemberHandleCache()
+{
+	s_memberHandles.clear();
+}
+
 lua_MQTypeVar::lua_MQTypeVar(const std::string& str)
 {
 	auto* const type = FindMQ2DataType(str.c_str());
@@ -313,9 +346,26 @@ MQTypeVar lua_MQTypeVar::EvaluateMember(const char* index) const
 	if (m_self.Type == nullptr || m_member.empty())
 		return m_self;
 
+	LuaProfiler::ScopedAccess access(m_self.Type->GetName(), m_member);
+
 	// the ternary in index is because datatypes are all over the place on whether or not they can
 	// accept null pointers. They all seem to agree that an empty string is the same thing, though.
 	MQTypeVar var;
+	if (m_handle)
+	{
+		switch (EvaluateMacroDataMember(m_self.Type, m_self.GetVarPtr(), var, m_handle, index ? index : ""))
+		{
+		case 1:
+			return std::move(var);
+		case 0:
+			return MQTypeVar();
+		default:
+			// the members of the type changed since the handle was made, fall back to the name
+			var = MQTypeVar();
+			break;
+		}
+	}
+
 	if (EvaluateMacroDataMember(m_self.Type, m_self.GetVarPtr(), var, m_member.c_str(), index ? index : "") == 1)
 		return std::move(var);
 
@@ -377,6 +427,7 @@ sol::object lua_MQTypeVar::Get(sol::stack_object key, sol::this_state L) const
 			// TODO: will need to keep track of extents to allow for access like this: arr[2][1]
 			// would rather return an array with a subset, but that would require slicing and copying the underlying array data
 			var.m_member = "";
+			var.m_handle = {};
 			var.m_self.Type = arr->GetType();
 			var.m_self.SetVarPtr(arr->GetData(*maybe_index));
 		}
@@ -389,6 +440,7 @@ sol::object lua_MQTypeVar::Get(sol::stack_object key, sol::this_state L) const
 			}
 
 			var.m_member = "";
+			var.m_handle = {};
 		}
 	}
 	else if (auto maybe_key = key.as<std::optional<std::string_view>>())
@@ -396,10 +448,15 @@ sol::object lua_MQTypeVar::Get(sol::stack_object key, sol::this_state L) const
 		// the nominal case is that the index is the key to the type member
 		var.m_member = *maybe_key;
 
-		// make sure that the macro data member even exists if we have the type info
-		if (var.m_self.Type && !FindMacroDataMember(var.m_self.Type, var.m_member))
+		if (var.m_self.Type)
 		{
-			return sol::object(L, sol::in_place, sol::lua_nil);
+			// a handle means that the member exists, otherwise make sure that it does by name
+			var.m_handle = FindMemberHandle(var.m_self.Type, var.m_member);
+
+			if (!var.m_handle && !FindMacroDataMember(var.m_self.Type, var.m_member))
+			{
+				return sol::object(L, sol::in_place, sol::lua_nil);
+			}
 		}
 	}
 
@@ -432,11 +489,20 @@ lua_MQTopLevelObject::lua_MQTopLevelObject(sol::this_state L, const MQTopLevelOb
 	}
 }
 
+// Evaluates the top level object, timed as an access of the script if it is being profiled.
+static bool EvaluateTopLevelObject(const MQTopLevelObject* self, const char* index, MQTypeVar& result)
+{
+	if (self == nullptr)
+		return false;
+
+	LuaProfiler::ScopedAccess access("mq.TLO", self->Name);
+	return self->Function(index, result);
+}
+
 lua_MQTypeVar lua_MQTopLevelObject::EvaluateSelf() const
 {
 	MQTypeVar result;
-	if (self != nullptr)
-		self->Function("", result);
+	EvaluateTopLevelObject(self, "", result);
 
 	return lua_MQTypeVar(result);
 }
@@ -469,7 +535,7 @@ MQ2Type* lua_MQTopLevelObject::GetType() const
 sol::object lua_MQTopLevelObject::Call(const std::string& index, sol::this_state L) const
 {
 	MQTypeVar result;
-	if (self != nullptr && self->Function(index.c_str(), result))
+	if (EvaluateTopLevelObject(self, index.c_str(), result))
 		return sol::object(L, sol::in_place, lua_MQTypeVar(result));
 
 	return sol::object(L, sol::in_place, lua_MQTypeVar(MQTypeVar()));
@@ -488,7 +554,7 @@ sol::object lua_MQTopLevelObject::CallVA(sol::this_state L, sol::variadic_args a
 sol::object lua_MQTopLevelObject::CallEmpty(sol::this_state L) const
 {
 	MQTypeVar result;
-	if (self != nullptr && self->Function("", result))
+	if (EvaluateTopLevelObject(self, "", result))
 		return lua_MQTypeVar(result).CallEmpty(L);
 
 	return sol::object(L, sol::in_place, sol::lua_nil);
@@ -497,7 +563,7 @@ sol::object lua_MQTopLevelObject::CallEmpty(sol::this_state L) const
 sol::object lua_MQTopLevelObject::Get(sol::stack_object key, sol::this_state L) const
 {
 	MQTypeVar result;
-	if (self != nullptr && self->Function("", result))
+	if (EvaluateTopLevelObject(self, "", result))
 		return lua_MQTypeVar(result).Get(key, L);
 
 	return sol::object(L, sol::in_place, lua_MQTypeVar(MQTypeVar()));
@@ -749,6 +815,7 @@ LuaProxyType::LuaProxyType(const std::string& typeName, LuaAbstractDataType* lua
 LuaProxyType::~LuaProxyType()
 {
 	remove_sorted(s_proxyTypes, this);
+	s_memberHandles.erase(this);
 }
 
 bool LuaProxyType::FromData(MQVarPtr& VarPtr, const MQTypeVar& Source)
@@ -1128,6 +1195,8 @@ void InitializeBindings_MQMacroData()
 
 void ShutdownBindings_MQMacroData()
 {
+	ClearMemberHandleCache();
+
 	delete s_luaTableType;
 	s_luaTableType = nullptr;
 }
@@ -89,6 +89,29 @@ public:
 		, m_state(L)
 	{
 		SetDelegate(std::make_shared<LuaZepConsoleDelegate>(this));
+
+		// Scripts tend to log from their main loop, many lines a frame. Same as the main console, the
+		// lines wait for the next render and only the ones that fit in the buffer are formatted.
+		SetDeferAppend(true);
+	}
+
+	// Appends several lines at once, each like AppendText would with a new line.
+	void AppendLines(const sol::table& lines, MQColor color)
+	{
+		const size_t count = lines.size();
+		for (size_t i = 1; i <= count; ++i)
+		{
+			if (sol::optional<std::string_view> line = lines.get<sol::optional<std::string_view>>(i))
+				AppendText(*line, color, true);
+		}
+	}
+
+	Zep::GlyphIterator AppendHyperlink(std::string_view text, std::string hyperlinkData)
+	{
+		// The link goes after anything that is still waiting to be appended.
+		FlushPendingText();
+
+		return InsertHyperlink(End(), text, std::move(hyperlinkData));
 	}
 
 	void SetEventCallback(sol::function func)
@@ -325,6 +348,7 @@ sol::table RegisterBindings_Zep(sol::this_state L)
 		"ScrollToBottom"           , &LuaZepConsole::ScrollToBottom,
 
 		"autoScroll"               , sol::property(&LuaZepConsole::GetAutoScroll, &LuaZepConsole::SetAutoScroll),
+		"deferAppend"              , sol::property(&LuaZepConsole::GetDeferAppend, &LuaZepConsole::SetDeferAppend),
 		"maxBufferLines"           , sol::property(&ImGuiZepConsole::GetMaxBufferLines, &LuaZepConsole::SetMaxBufferLines),
 		"opacity"                  , sol::property(&LuaZepConsole::GetOpacity, &LuaZepConsole::SetOpacity),
 		"eventCallback"            , sol::property(&LuaZepConsole::GetEventCallback, &LuaZepConsole::SetEventCallback),
@@ -358,6 +382,13 @@ sol::table RegisterBindings_Zep(sol::this_state L)
 				return pThis;
 			}),
 
+		"AppendLines", sol::overload(
+			[](LuaZepConsole* pThis, const sol::table& lines) { pThis->AppendLines(lines, MQColor(0, 0, 0, 0)); return pThis; },
+			[](LuaZepConsole* pThis, int col, const sol::table& lines) { pThis->AppendLines(lines, MQColor(MQColor::format_abgr, col)); return pThis; },
+			[](LuaZepConsole* pThis, const ImVec4& col, const sol::table& lines) { pThis->AppendLines(lines, MQColor(col)); return pThis; }),
+
+		"Flush"                    , &LuaZepConsole::FlushPendingText,
+
 		"AppendTextUnformatted", sol::overload(
 			[](LuaZepConsole* pThis, std::string_view text) { pThis->AppendText(text, MQColor(0, 0, 0, 0), false); return pThis; },
 			[](LuaZepConsole* pThis, int col, std::string_view text) { pThis->AppendText(text, MQColor(MQColor::format_abgr, col), false); return pThis; },
@@ -365,12 +396,12 @@ sol::table RegisterBindings_Zep(sol::this_state L)
 
 		"AppendHyperlink", sol::overload(
 			// AppendHyperlink(hyperlinkData, text, ...)
-			[](LuaZepConsole* pThis, std::string hyperlinkData, std::string_view text) { pThis->InsertHyperlink(pThis->End(), text, std::move(hyperlinkData)); return pThis; },
+			[](LuaZepConsole* pThis, std::string hyperlinkData, std::string_view text) { pThis->AppendHyperlink(text, std::move(hyperlinkData)); return pThis; },
 			[](LuaZepConsole* pThis, std::string hyperlinkData, std::string_view format, sol::variadic_args va, sol::this_state s) {
 				sol::function string_format = sol::state_view(s)["string"]["format"];
 				std::string text = string_format(format, va);
 
-				pThis->InsertHyperlink(pThis->End(), text, std::move(hyperlinkData));
+				pThis->AppendHyperlink(text, std::move(hyperlinkData));
 				return pThis;
 			}
 		),
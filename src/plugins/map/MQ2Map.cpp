@@ -18,6 +18,7 @@
 #include "MQ2Map.h"
 #include "MapObject.h"
 
+#include <cmath>
 #include <sstream>
 
 PreSetup("MQ2Map");
@@ -41,6 +42,8 @@ bool HighlightPulse = false;
 bool HighlightPulseIncreasing = true;
 int HighlightPulseIndex = 0;
 int HighlightPulseDiff = HighlightSIDELEN / 10;
+static int s_warmUpTask = 0;
+constexpr size_t MAP_SPAWNS_PER_WARMUP_STEP = 32;
 extern MapObject* gpActiveMapObjects;
 std::vector<MapFilterOption*> mapFilterObjectOptions;
 std::vector<MapFilterOption*> mapFilterGeneralOptions;
@@ -186,7 +189,7 @@ public:
 
 	virtual int PostDraw() override
 	{
-		MapUpdate();
+		MapUpdate(GetViewBounds());
 		MapAttach();
 		int result = Super::PostDraw();
 		MapDetach();
@@ -245,6 +248,37 @@ public:
 	//----------------------------------------------------------------------------
 private:
 
+	// How far past each edge of the view objects still count as in view, as a share of the view,
+	// so labels hanging over the edge are kept up to date.
+	static constexpr float ViewBoundsPadding = 0.25f;
+
+	MapViewBounds GetViewBounds()
+	{
+		CXRect rect = GetScreenRect();
+		CVector3 topLeft = { (float)rect.left, (float)rect.top, 0.f };
+		CVector3 bottomRight = { (float)rect.right, (float)rect.bottom, 0.f };
+		GetWorldCoordinates(topLeft);
+		GetWorldCoordinates(bottomRight);
+
+		MapViewBounds bounds;
+		bounds.MinX = std::min(topLeft.X, bottomRight.X);
+		bounds.MaxX = std::max(topLeft.X, bottomRight.X);
+		bounds.MinY = std::min(topLeft.Y, bottomRight.Y);
+		bounds.MaxY = std::max(topLeft.Y, bottomRight.Y);
+
+		const float padX = (bounds.MaxX - bounds.MinX) * ViewBoundsPadding;
+		const float padY = (bounds.MaxY - bounds.MinY) * ViewBoundsPadding;
+		bounds.MinX -= padX;
+		bounds.MaxX += padX;
+		bounds.MinY -= padY;
+		bounds.MaxY += padY;
+
+		bounds.Valid = std::isfinite(bounds.MinX) && std::isfinite(bounds.MaxX)
+			&& std::isfinite(bounds.MinY) && std::isfinite(bounds.MaxY)
+			&& bounds.MaxX > bounds.MinX && bounds.MaxY > bounds.MinY;
+		return bounds;
+	}
+
 	void OnHooked()
 	{
 	}
@@ -350,6 +384,8 @@ PLUGIN_API void InitializePlugin()
 	ParseSearchSpawn("#", &MapFilterNamed);
 
 	AddSettingsPanel("plugins/Map", DrawMapSettingsPanel);
+
+	s_warmUpTask = AddWarmUpTask("Map", []() { return AddQueuedSpawns(MAP_SPAWNS_PER_WARMUP_STEP); });
 }
 
 // Called once, when the plugin is to shutdown
@@ -372,6 +408,9 @@ PLUGIN_API void ShutdownPlugin()
 	RemoveCommand("/maploc");
 
 	RemoveSettingsPanel("plugins/Map");
+
+	RemoveWarmUpTask(s_warmUpTask);
+	s_warmUpTask = 0;
 }
 
 // This is called every time MQ pulses
@@ -449,7 +488,11 @@ PLUGIN_API void OnAddSpawn(SPAWNINFO* pNewSpawn)
 	// your toon's spawn id changes and it's no longer zero to start don't added it all
 	if (pLocalPlayer != pNewSpawn && pNewSpawn->SpawnID != 0)
 	{
-		AddSpawn(pNewSpawn);
+		// wait for the rest of the zone's spawns to be added by the warm-up, in order
+		if (gZoning || HasQueuedSpawns())
+			QueueSpawn(pNewSpawn);
+		else
+			AddSpawn(pNewSpawn);
 	}
 }
 
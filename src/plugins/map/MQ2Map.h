@@ -153,6 +153,22 @@ void MapSetLocationCmd(PlayerClient* pChar, const char* szLine);
 char* FormatMarker(const char* szLine, char* szDest, size_t BufferSize);
 bool IsFloat(const std::string& in);
 
+// The part of the zone that the map view shows, in world coordinates. Bounds that aren't valid
+// contain everything.
+struct MapViewBounds
+{
+	float MinX = 0.0f;
+	float MinY = 0.0f;
+	float MaxX = 0.0f;
+	float MaxY = 0.0f;
+	bool Valid = false;
+
+	bool Contains(const CVector3& pos) const
+	{
+		return !Valid || (pos.X >= MinX && pos.X <= MaxX && pos.Y >= MinY && pos.Y <= MaxY);
+	}
+};
+
 /* API */
 void MapInit();
 void MapClear();
@@ -160,7 +176,7 @@ void MapGenerate();
 int MapHighlight(MQSpawnSearch* pSearch);
 int MapHide(MQSpawnSearch& Search);
 int MapShow(MQSpawnSearch& Search);
-void MapUpdate();
+void MapUpdate(const MapViewBounds& bounds = {});
 void MapAttach();
 void MapDetach();
 
@@ -177,6 +193,9 @@ bool dataMapSpawn(const char* szIndex, MQTypeVar& Ret);
 
 MapObject* AddSpawn(SPAWNINFO* pNewSpawn, bool ExplicitAllow = false);
 bool RemoveSpawn(SPAWNINFO* pSpawn);
+void QueueSpawn(SPAWNINFO* pNewSpawn);
+bool HasQueuedSpawns();
+bool AddQueuedSpawns(size_t count);
 MapObject* AddGroundItem(GROUNDITEM* pGroundItem);
 void RemoveGroundItem(GROUNDITEM* pGroundItem);
 
@@ -100,8 +100,39 @@ void RemoveMapObject(MapObject* pMapSpawn)
 	delete pMapSpawn;
 }
 
+// Spawns that arrive while zoning are put on the map by a warm-up task once the zone has loaded, a
+// few each pulse, instead of all of them while the client is loading the zone.
+static std::vector<SPAWNINFO*> s_queuedSpawns;
+
+void QueueSpawn(SPAWNINFO* pNewSpawn)
+{
+	s_queuedSpawns.push_back(pNewSpawn);
+}
+
+bool HasQueuedSpawns()
+{
+	return !s_queuedSpawns.empty();
+}
+
+bool AddQueuedSpawns(size_t count)
+{
+	count = std::min(count, s_queuedSpawns.size());
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		// The target is put on the map as soon as it is targeted.
+		if (!FindMapObject(s_queuedSpawns[i]))
+			AddSpawn(s_queuedSpawns[i]);
+	}
+
+	s_queuedSpawns.erase(s_queuedSpawns.begin(), s_queuedSpawns.begin() + count);
+	return s_queuedSpawns.empty();
+}
+
 bool RemoveSpawn(SPAWNINFO* pSpawn)
 {
+	s_queuedSpawns.erase(std::remove(s_queuedSpawns.begin(), s_queuedSpawns.end(), pSpawn), s_queuedSpawns.end());
+
 	MapObject* pMapObject = FindMapObject(pSpawn);
 	if (pMapObject)
 	{
@@ -153,6 +184,7 @@ void MapGenerate()
 void MapClear()
 {
 	MapObjects_Clear();
+	s_queuedSpawns.clear();
 
 	pLastTarget = nullptr;
 
@@ -170,7 +202,7 @@ void MapClear()
 	PullCircle.Clear();
 }
 
-void MapUpdate()
+void MapUpdate(const MapViewBounds& bounds)
 {
 	if (!pLocalPC) return;
 	EnterMQ2Benchmark(bmMapRefresh);
@@ -208,11 +240,17 @@ void MapUpdate()
 		}
 	}
 
+	BeginMapObjectUpdates();
+
 	MapObject* mapObject = gpActiveMapObjects;
 	while (mapObject)
 	{
 		bool forced = (mapObject == pOldLastTarget) && bTargetChanged;
-		mapObject->Update(forced);
+
+		// Objects out of view wait until they come into view. Anything that was in view at its last
+		// update is still updated, so it doesn't leave a stale label behind at the edge of the view.
+		if (forced || mapObject == pLastTarget || mapObject->IsInView(bounds))
+			mapObject->Update(forced);
 
 		if (!mapObject->CanDisplayObject())
 		{
@@ -108,6 +108,27 @@ MapObject::~MapObject()
 		gpActiveMapObjects = m_pNext;
 }
 
+// Labels are formatted at most this many times in a refresh, unless forced. The rest wait for the next
+// refresh, so a zone full of changing spawns doesn't all get formatted in the same frame.
+static constexpr int LabelRefreshesPerUpdate = 64;
+static int s_labelRefreshBudget = LabelRefreshesPerUpdate;
+static bool s_labelsUseHealth = false;
+
+void BeginMapObjectUpdates()
+{
+	s_labelRefreshBudget = LabelRefreshesPerUpdate;
+	s_labelsUseHealth = strstr(MapNameString, "%h") || strstr(MapTargetNameString, "%h");
+}
+
+static bool TakeLabelRefresh()
+{
+	if (s_labelRefreshBudget <= 0)
+		return false;
+
+	--s_labelRefreshBudget;
+	return true;
+}
+
 void MapObject::Update(bool forced)
 {
 	if (m_label)
@@ -547,6 +568,25 @@ void MapObjectSpawn::Update(bool forced)
 	bool changed = false;
 
 	changed |= test_and_set(m_type, GetSpawnType(m_spawn));
+	changed |= test_and_set(m_labelLevel, static_cast<int>(m_spawn->Level));
+
+	if (s_labelsUseHealth)
+	{
+		int health = m_spawn->HPMax > 0 ? static_cast<int>(m_spawn->HPCurrent * 100 / m_spawn->HPMax) : 0;
+		changed |= test_and_set(m_labelHealth, health);
+	}
+
+	if (m_labelName != m_spawn->Name)
+	{
+		m_labelName = m_spawn->Name;
+		changed = true;
+	}
+
+	m_labelDirty |= changed;
+
+	// Becoming or no longer being the target switches the label format right away.
+	const bool isTarget = pLastTarget == this;
+	forced |= test_and_set(m_labelIsTarget, isTarget);
 
 	m_pos.X = m_spawn->X;
 	m_pos.Y = m_spawn->Y;
@@ -554,9 +594,11 @@ void MapObjectSpawn::Update(bool forced)
 	m_heading = m_spawn->Heading;
 
 	// If something changed update the label
-	if (changed || forced)
+	if (forced || (m_labelDirty && TakeLabelRefresh()))
 	{
-		SetText(FormatString(MapNameString));
+		m_labelDirty = false;
+
+		SetText(FormatString(isTarget ? MapTargetNameString : MapNameString));
 		SetColor(GetSpawnColor());
 	}
 	else if (!m_highlight)
@@ -566,10 +608,9 @@ void MapObjectSpawn::Update(bool forced)
 
 	MapObject::Update(forced);
 
-	if (pLastTarget == this)
+	if (isTarget)
 	{
 		SetColor(GetMapFilterOption(MapFilter::Target).Color);
-		SetText(FormatString(MapTargetNameString));
 	}
 }
 
@@ -20,6 +20,9 @@
 
 //============================================================================
 
+// Called at the start of every map refresh, before the objects are updated.
+void BeginMapObjectUpdates();
+
 class MapObject
 {
 public:
@@ -42,6 +45,10 @@ public:
 	void SetPosition(float x, float y, float z) { SetPosition(CVector3{ x, y, z }); }
 	void SetPosition(const CVector3& pos);
 	CVector3 GetPosition() const { return m_pos; }
+	virtual CVector3 GetCurrentPosition() const { return m_pos; }
+
+	// True if the object is in view now, or was at its last update.
+	bool IsInView(const MapViewBounds& bounds) const { return bounds.Contains(m_pos) || bounds.Contains(GetCurrentPosition()); }
 
 	MapObject* GetNext() const { return m_pNext; }
 	MapObject* GetPrev() const { return m_pLast; }
@@ -96,6 +103,7 @@ public:
 	virtual MapFilter GetMapFilter() const override;
 	virtual bool CanDisplayObject() const override;
 	virtual SPAWNINFO* GetSpawn() const { return m_spawn; }
+	virtual CVector3 GetCurrentPosition() const override { return { m_spawn->X, m_spawn->Y, m_spawn->Z }; }
 
 	MQColor GetSpawnColor() const;
 
@@ -112,6 +120,13 @@ private:
 	SPAWNINFO* m_spawn = nullptr;
 	eSpawnType m_type = NONE;
 	bool       m_explicit = false;
+
+	// What the label was last formatted from
+	std::string m_labelName;
+	int        m_labelLevel = -1;
+	int        m_labelHealth = -1;
+	bool       m_labelIsTarget = false;
+	bool       m_labelDirty = false;
 };
 
 //============================================================================
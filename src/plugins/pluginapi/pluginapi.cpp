@@ -78,6 +78,56 @@ mq::MQTopLevelObject* mq::FindTopLevelObject(const char* szName)
 	return mqplugin::MainInterface->FindTopLevelObject(szName);
 }
 
+int mq::AddMacroDataObserver(std::vector<std::string> strings, mq::MQMacroDataObserverCallback callback)
+{
+	return mqplugin::MainInterface->AddMacroDataObserver(std::move(strings), std::move(callback), mqplugin::ThisPluginHandle);
+}
+
+bool mq::RemoveMacroDataObserver(int observerId)
+{
+	return mqplugin::MainInterface->RemoveMacroDataObserver(observerId, mqplugin::ThisPluginHandle);
+}
+
+int mq::AddGameEventObserver(mq::MQGameEvent event, mq::MQGameEventCallback callback)
+{
+	return mqplugin::MainInterface->AddGameEventObserver(event, std::move(callback), mqplugin::ThisPluginHandle);
+}
+
+bool mq::RemoveGameEventObserver(int observerId)
+{
+	return mqplugin::MainInterface->RemoveGameEventObserver(observerId, mqplugin::ThisPluginHandle);
+}
+
+int mq::AddWarmUpTask(const char* name, mq::MQWarmUpStep step)
+{
+	return mqplugin::MainInterface->AddWarmUpTask(name, std::move(step), mqplugin::ThisPluginHandle);
+}
+
+bool mq::RemoveWarmUpTask(int taskId)
+{
+	return mqplugin::MainInterface->RemoveWarmUpTask(taskId, mqplugin::ThisPluginHandle);
+}
+
+bool mq::IsWarmUpTaskReady(int taskId)
+{
+	return mqplugin::MainInterface->IsWarmUpTaskReady(taskId);
+}
+
+bool mq::IsWarmUpComplete()
+{
+	return mqplugin::MainInterface->IsWarmUpComplete();
+}
+
+int mq::AddSpawnTrigger(const char* name, const mq::MQSpawnSearch& search, float radius, mq::MQSpawnTriggerCallback callback)
+{
+	return mqplugin::MainInterface->AddSpawnTrigger(name, search, radius, std::move(callback), mqplugin::ThisPluginHandle);
+}
+
+bool mq::RemoveSpawnTrigger(int triggerId)
+{
+	return mqplugin::MainInterface->RemoveSpawnTrigger(triggerId, mqplugin::ThisPluginHandle);
+}
+
 //============================================================================
 //============================================================================
 
@@ -91,6 +141,16 @@ void mq::postoffice::DropboxAPI::PostReply(const std::shared_ptr<mq::postoffice:
 	mqplugin::MainInterface->ReplyToActor(Dropbox, message, data, status, mqplugin::ThisPluginHandle);
 }
 
+bool mq::postoffice::DropboxAPI::Subscribe(const std::string& topic) const
+{
+	return mqplugin::MainInterface->SubscribeActor(Dropbox, topic, mqplugin::ThisPluginHandle);
+}
+
+bool mq::postoffice::DropboxAPI::Unsubscribe(const std::string& topic) const
+{
+	return mqplugin::MainInterface->UnsubscribeActor(Dropbox, topic, mqplugin::ThisPluginHandle);
+}
+
 void mq::postoffice::DropboxAPI::Remove()
 {
 	mqplugin::MainInterface->RemoveActor(Dropbox, mqplugin::ThisPluginHandle);
@@ -121,6 +181,23 @@ void mq::postoffice::SendToActor(const Address& address, const std::string& data
 	mqplugin::MainInterface->SendToActor(nullptr, address, data, callback, mqplugin::ThisPluginHandle);
 }
 
+void mq::postoffice::QueryRemoteData(const Address& address, std::vector<std::string> expressions, RemoteQueryCallback callback)
+{
+	mqplugin::MainInterface->QueryRemoteData(address, std::move(expressions), std::move(callback), mqplugin::ThisPluginHandle);
+}
+
+int mq::postoffice::SubscribeRemoteData(const Address& address, std::vector<std::string> expressions,
+	std::chrono::milliseconds interval, RemoteSubscriptionCallback callback)
+{
+	return mqplugin::MainInterface->SubscribeRemoteData(address, std::move(expressions), interval, std::move(callback),
+		mqplugin::ThisPluginHandle);
+}
+
+bool mq::postoffice::UnsubscribeRemoteData(int subscriptionId)
+{
+	return mqplugin::MainInterface->UnsubscribeRemoteData(subscriptionId, mqplugin::ThisPluginHandle);
+}
+
 //============================================================================
 //============================================================================
 
@@ -149,6 +226,11 @@ void mq::DoCommand(const char* command, bool delayed)
 	mqplugin::MainInterface->DoCommand(command, delayed, mqplugin::ThisPluginHandle);
 }
 
+void mq::DoCommand(MQCompiledCommand& command)
+{
+	mqplugin::MainInterface->DoCompiledCommand(command, mqplugin::ThisPluginHandle);
+}
+
 void mq::DoCommandf(const char* szFormat, ...)
 {
 	va_list vaList;
@@ -27,6 +27,7 @@
 
 PreSetup("MQ2TargetInfo");
 PLUGIN_VERSION(2.3);
+PLUGIN_PULSE_TIER(TenPerSecond);
 
 enum class eINIOptions
 {
@@ -780,123 +781,124 @@ PLUGIN_API void OnPulse()
 	if (GetGameState() != GAMESTATE_INGAME || !pLocalPlayer)
 		return;
 
+	// The tier only decides how often we are asked; the labels still refresh every 500ms.
 	static uint64_t lastPulseUpdate = MQGetTickCount64();
 	const uint64_t currentTime = MQGetTickCount64();
 
-	if (currentTime - lastPulseUpdate > 500) // 500ms
-	{
-		lastPulseUpdate = currentTime;
+	if (currentTime - lastPulseUpdate <= 500) // 500ms
+		return;
 
-		if (pTargetWnd && pTargetWnd->IsVisible())
+	lastPulseUpdate = currentTime;
+
+	if (pTargetWnd && pTargetWnd->IsVisible())
+	{
+		Initialize();
+		if (InfoLabel && DistanceLabel && CanSeeLabel && PHButton)
 		{
-			Initialize();
-			if (InfoLabel && DistanceLabel && CanSeeLabel && PHButton)
+			if (pTarget)
 			{
-				if (pTarget)
+				if (gbShowPlaceholder)
 				{
-					if (gbShowPlaceholder)
+					if (oldspawn != pTarget)
 					{
-						if (oldspawn != pTarget)
-						{
-							oldspawn = pTarget;
+						oldspawn = pTarget;
 
-							PHInfo pinf;
-							if (GetPhMap(pTarget, &pinf))
-							{
-								PHButton->SetTooltip(CXStr{ pinf.Named });
-								PHButton->SetVisible(true);
-							}
-							else
-							{
-								PHButton->SetVisible(false);
-							}
+						PHInfo pinf;
+						if (GetPhMap(pTarget, &pinf))
+						{
+							PHButton->SetTooltip(CXStr{ pinf.Named });
+							PHButton->SetVisible(true);
+						}
+						else
+						{
+							PHButton->SetVisible(false);
 						}
 					}
-					else
-					{
-						PHButton->SetVisible(false);
-					}
+				}
+				else
+				{
+					PHButton->SetVisible(false);
+				}
 
-					char szTargetDist[EQ_MAX_NAME] = { 0 };
+				char szTargetDist[EQ_MAX_NAME] = { 0 };
 
-					if (gbShowTargetInfo)
+				if (gbShowTargetInfo)
+				{
+					switch (pTarget->Anon)
 					{
-						switch (pTarget->Anon)
+						case 1:
+							if (gbShowAnon)
+							{
+								strcpy_s(szTargetDist, "Anonymous");
+								break;
+							}
+						case 2:
+							if (gbShowAnon)
+							{
+								strcpy_s(szTargetDist, "Roleplaying");
+								break;
+							}
+						default:
 						{
-							case 1:
-								if (gbShowAnon)
-								{
-									strcpy_s(szTargetDist, "Anonymous");
-									break;
-								}
-							case 2:
-								if (gbShowAnon)
-								{
-									strcpy_s(szTargetDist, "Roleplaying");
-									break;
-								}
-							default:
+							if (pTarget->Type == SPAWN_PLAYER)
 							{
-								if (pTarget->Type == SPAWN_PLAYER)
-								{
-									sprintf_s(szTargetDist, "%d %s %s", pTarget->Level, pTarget->GetRaceString(), pTarget->GetClassThreeLetterCode());
-								}
-								else
-								{
-									sprintf_s(szTargetDist, "%d %s %s", pTarget->Level, pTarget->GetRaceString(),pTarget->GetClassString());
-								}
+								sprintf_s(szTargetDist, "%d %s %s", pTarget->Level, pTarget->GetRaceString(), pTarget->GetClassThreeLetterCode());
+							}
+							else
+							{
+								sprintf_s(szTargetDist, "%d %s %s", pTarget->Level, pTarget->GetRaceString(),pTarget->GetClassString());
 							}
 						}
-
-						InfoLabel->SetWindowText(szTargetDist);
 					}
-					InfoLabel->SetVisible(gbShowTargetInfo);
 
-					// then distance
-					if(gBShowDistance)
-					{
-						float dist = Distance3DToSpawn(pLocalPlayer, pTarget);
-						sprintf_s(szTargetDist, "%.2f", dist);
+					InfoLabel->SetWindowText(szTargetDist);
+				}
+				InfoLabel->SetVisible(gbShowTargetInfo);
 
-						if (dist < 250)
-						{
-							DistanceLabel->SetCRNormal(MQColor(0, 255, 0)); // green
-						}
-						else
-						{
-							DistanceLabel->SetCRNormal(MQColor(255, 0, 0)); // red
-						}
+				// then distance
+				if(gBShowDistance)
+				{
+					float dist = Distance3DToSpawn(pLocalPlayer, pTarget);
+					sprintf_s(szTargetDist, "%.2f", dist);
 
-						DistanceLabel->SetWindowText(szTargetDist);
+					if (dist < 250)
+					{
+						DistanceLabel->SetCRNormal(MQColor(0, 255, 0)); // green
 					}
-					DistanceLabel->SetVisible(gBShowDistance);
-
-					// now do can see
-					if (gbShowSight)
+					else
 					{
-						if (pLocalPlayer->CanSee(*(PlayerClient*)pTarget))
-						{
-							strcpy_s(szTargetDist, "O");
-							CanSeeLabel->SetCRNormal(MQColor(0, 255, 0)); // green
-						}
-						else
-						{
-							strcpy_s(szTargetDist, "X");
-							CanSeeLabel->SetCRNormal(MQColor(255, 0, 0)); // red
-						}
-						CanSeeLabel->SetWindowText(szTargetDist);
+						DistanceLabel->SetCRNormal(MQColor(255, 0, 0)); // red
 					}
 
-					CanSeeLabel->SetVisible(gbShowSight);
-
+					DistanceLabel->SetWindowText(szTargetDist);
 				}
-				else
+				DistanceLabel->SetVisible(gBShowDistance);
+
+				// now do can see
+				if (gbShowSight)
 				{
-					InfoLabel->SetWindowText(CXStr());
-					DistanceLabel->SetWindowText(CXStr());
-					CanSeeLabel->SetWindowText(CXStr());
-					PHButton->SetVisible(false);
+					if (pLocalPlayer->CanSee(*(PlayerClient*)pTarget))
+					{
+						strcpy_s(szTargetDist, "O");
+						CanSeeLabel->SetCRNormal(MQColor(0, 255, 0)); // green
+					}
+					else
+					{
+						strcpy_s(szTargetDist, "X");
+						CanSeeLabel->SetCRNormal(MQColor(255, 0, 0)); // red
+					}
+					CanSeeLabel->SetWindowText(szTargetDist);
 				}
+
+				CanSeeLabel->SetVisible(gbShowSight);
+
+			}
+			else
+			{
+				InfoLabel->SetWindowText(CXStr());
+				DistanceLabel->SetWindowText(CXStr());
+				CanSeeLabel->SetWindowText(CXStr());
+				PHButton->SetVisible(false);
 			}
 		}
 	}
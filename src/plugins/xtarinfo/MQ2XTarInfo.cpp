@@ -10,6 +10,7 @@
 
 PreSetup("MQ2XTarInfo");
 PLUGIN_VERSION(0.1);
+PLUGIN_PULSE_TIER(TenPerSecond);
 
 bool gBShowExtDistance = true;
 bool gBUsePerCharSettings = false;
@@ -28,6 +29,30 @@ std::string DistanceLabelToolTip = "XTarget Distance";
 CGaugeWnd* ETW_Gauge[MAX_EXTENDED_TARGET_SIZE] = { nullptr };
 CLabelWnd* ETW_DistLabel[MAX_EXTENDED_TARGET_SIZE] = { nullptr };
 
+// What each distance label last showed, and the positions it was worked out from. A row is only
+// touched when its slot changes or either end moves, and the label only when its text or color does.
+struct DistLabelPos
+{
+	float X = 0.f;
+	float Y = 0.f;
+	float Z = 0.f;
+};
+
+struct DistLabelState
+{
+	uint32_t SpawnID = 0;
+	DistLabelPos MyPos;
+	DistLabelPos SpawnPos;
+	char Text[16] = { 0 };
+	bool Close = true;
+	bool Visible = false;
+	bool Valid = false;
+};
+DistLabelState ETW_DistState[MAX_EXTENDED_TARGET_SIZE];
+
+// How far (in either x, y or z) an end has to move before the distance is worked out again.
+constexpr float DistPositionEpsilon = 0.05f;
+
 DWORD orgExtTargetWindStyle = 0;
 
 enum class eINIOptions
@@ -248,45 +273,87 @@ void Initialize()
 	}
 }
 
+void ResetDistLabelState()
+{
+	for (DistLabelState& state : ETW_DistState)
+		state = DistLabelState();
+}
+
+static bool HasMoved(const DistLabelPos& a, const DistLabelPos& b)
+{
+	return std::abs(a.X - b.X) > DistPositionEpsilon
+		|| std::abs(a.Y - b.Y) > DistPositionEpsilon
+		|| std::abs(a.Z - b.Z) > DistPositionEpsilon;
+}
+
+static void SetDistLabelVisible(CLabelWnd* pWnd, DistLabelState& state, bool visible)
+{
+	if (state.Visible != visible || !state.Valid)
+	{
+		pWnd->SetVisible(visible);
+		state.Visible = visible;
+	}
+}
+
 void UpdatedExtDistance()
 {
-	if (!pLocalPC)
+	if (!pLocalPC || !pLocalPlayer)
 		return;
 
 	ExtendedTargetList* xtm = pLocalPC->pXTargetMgr;
+	const DistLabelPos myPos{ pLocalPlayer->X, pLocalPlayer->Y, pLocalPlayer->Z };
 
-	for (int i = 0; i < xtm->GetNumSlots(); i++)
+	for (int i = 0; i < xtm->GetNumSlots() && i < MAX_EXTENDED_TARGET_SIZE; i++)
 	{
-		if (CLabelWnd* pWnd = ETW_DistLabel[i])
+		CLabelWnd* pWnd = ETW_DistLabel[i];
+		if (!pWnd)
+			continue;
+
+		DistLabelState& state = ETW_DistState[i];
+		const ExtendedTargetSlot& xts = *xtm->GetSlot(i);
+
+		SPAWNINFO* pSpawn = xts.SpawnID ? GetSpawnByID(xts.SpawnID) : nullptr;
+
+		// empty slots, and rows the window isn't showing, only need to be hidden once
+		if (!pSpawn || (ETW_Gauge[i] && !ETW_Gauge[i]->IsVisible()))
 		{
-			const ExtendedTargetSlot& xts = *xtm->GetSlot(i);
-			uint32_t spID = xts.SpawnID;
+			SetDistLabelVisible(pWnd, state, false);
+			state.SpawnID = 0;
+			state.Valid = true;
+			continue;
+		}
 
-			if (spID)
-			{
-				if (SPAWNINFO* pSpawn = GetSpawnByID(spID))
-				{
-					char szTargetDist[EQ_MAX_NAME] = { 0 };
-					float dist = Distance3DToSpawn(pLocalPlayer, pSpawn);
-					sprintf_s(szTargetDist, "%.2f", dist);
+		const DistLabelPos spawnPos{ pSpawn->X, pSpawn->Y, pSpawn->Z };
+		if (state.Valid && state.SpawnID == xts.SpawnID && state.Visible
+			&& !HasMoved(state.MyPos, myPos) && !HasMoved(state.SpawnPos, spawnPos))
+		{
+			continue;
+		}
 
-					if (dist < 250)
-					{
-						pWnd->SetCRNormal(MQColor(0, 255, 0)); // green
-					}
-					else
-					{
-						pWnd->SetCRNormal(MQColor(255, 0, 0)); // red
-					}
+		const float dist = Distance3DToSpawn(pLocalPlayer, pSpawn);
+		const bool close = dist < 250;
 
-					pWnd->SetWindowText(szTargetDist);
-					pWnd->SetVisible(true);
-					continue;
-				}
-			}
+		char szTargetDist[sizeof(state.Text)] = { 0 };
+		sprintf_s(szTargetDist, "%.2f", dist);
 
-			pWnd->SetVisible(false);
+		if (!state.Valid || close != state.Close)
+		{
+			pWnd->SetCRNormal(close ? MQColor(0, 255, 0) : MQColor(255, 0, 0)); // green or red
+			state.Close = close;
 		}
+
+		if (!state.Valid || strcmp(szTargetDist, state.Text) != 0)
+		{
+			pWnd->SetWindowText(szTargetDist);
+			strcpy_s(state.Text, szTargetDist);
+		}
+
+		SetDistLabelVisible(pWnd, state, true);
+
+		state.SpawnID = xts.SpawnID;
+		state.MyPos = myPos;
+		state.SpawnPos = spawnPos;
+		state.Valid = true;
 	}
 }
 
@@ -312,6 +379,8 @@ void CleanUp()
 			label = nullptr;
 		}
 	}
+
+	ResetDistLabelState();
 }
 
 void ShowHelp()
@@ -347,6 +416,7 @@ void CMD_XTarInfo(SPAWNINFO* pPlayer, char* szLine)
 				label->SetVisible(gBShowExtDistance);
 			}
 		}
+		ResetDistLabelState();
 		WriteIni = true;
 	}
 	else if (ci_equals(szArg1, "reset"))
@@ -398,17 +468,10 @@ PLUGIN_API void OnPulse()
 	if (GetGameState() != GAMESTATE_INGAME || !pLocalPC)
 		return;
 
-	static uint64_t lastPulseUpdate = MQGetTickCount64();
-	uint64_t currentTime = MQGetTickCount64();
+	Initialize();
 
-	if (currentTime - lastPulseUpdate > 500) // 500ms
+	if (gBShowExtDistance && ETW_DistLabel[0] && pExtendedTargetWnd && pExtendedTargetWnd->IsVisible())
 	{
-		lastPulseUpdate = currentTime;
-		Initialize();
-
-		if (gBShowExtDistance && ETW_DistLabel[0] && pExtendedTargetWnd && pExtendedTargetWnd->IsVisible())
-		{
-			UpdatedExtDistance();
-		}
+		UpdatedExtDistance();
 	}
 }
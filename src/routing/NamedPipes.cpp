@@ -36,6 +36,84 @@ namespace mq {
 
 constexpr int BUFFER_SIZE = 4096;
 constexpr int PIPE_TIMEOUT = 5000;
+constexpr uint32_t RING_CAPACITY = 256 * 1024;
+constexpr size_t MAX_BATCH_SIZE = 64 * 1024;
+
+static std::atomic<uint32_t> s_nextRingNonce{ 1 };
+static std::atomic<uint32_t> s_nextRingEvent{ 1 };
+
+// Rings are named after the client process, so a server only ever opens rings of the
+// process that is on the other end of the pipe.
+static std::string GetRingName(uint32_t clientProcessId, uint32_t nonce, const char* direction)
+{
+	return fmt::format("Local\\mqring_{}_{}_{}", clientProcessId, nonce, direction);
+}
+
+//============================================================================
+// PipeBufferPool
+//============================================================================
+
+constexpr size_t POOL_MIN_BUFFER_SIZE = 64;
+constexpr size_t POOL_SIZE_CLASSES = 11;        // 64 bytes to 64 KB
+constexpr size_t POOL_MAX_FREE_BUFFERS = 64;    // per size class
+
+struct PipeBufferSizeClass
+{
+	std::mutex mutex;
+	std::vector<uint8_t*> free;
+
+	~PipeBufferSizeClass()
+	{
+		for (uint8_t* buffer : free)
+			delete[] buffer;
+	}
+};
+
+static PipeBufferSizeClass* GetPipeBufferSizeClasses()
+{
+	static PipeBufferSizeClass s_sizeClasses[POOL_SIZE_CLASSES];
+	return s_sizeClasses;
+}
+
+PipeBuffer PipeBufferPool::Allocate(size_t size)
+{
+	uint8_t sizeClass = 0;
+	while (sizeClass < POOL_SIZE_CLASSES && (POOL_MIN_BUFFER_SIZE << sizeClass) < size)
+		++sizeClass;
+
+	if (sizeClass == POOL_SIZE_CLASSES)
+		return PipeBuffer(new uint8_t[size]);
+
+	PipeBufferSizeClass& pool = GetPipeBufferSizeClasses()[sizeClass];
+	{
+		std::scoped_lock lock(pool.mutex);
+		if (!pool.free.empty())
+		{
+			uint8_t* buffer = pool.free.back();
+			pool.free.pop_back();
+			return PipeBuffer(buffer, Deleter(sizeClass));
+		}
+	}
+
+	return PipeBuffer(new uint8_t[POOL_MIN_BUFFER_SIZE << sizeClass], Deleter(sizeClass));
+}
+
+void PipeBufferPool::Deleter::operator()(uint8_t* buffer) const
+{
+	if (sizeClass != NotPooled)
+	{
+		PipeBufferSizeClass& pool = GetPipeBufferSizeClasses()[sizeClass];
+
+		std::scoped_lock lock(pool.mutex);
+		if (pool.free.size() < POOL_MAX_FREE_BUFFERS)
+		{
+			pool.free.push_back(buffer);
+			return;
+		}
+	}
+
+	delete[] buffer;
+}
 
 //============================================================================
 // PipeMessage
@@ -61,11 +139,19 @@ PipeMessage::PipeMessage(const PipeMessage& message, const void* data, size_t le
 	SetConnection(message.m_connection.lock());
 }
 
+PipeMessage::PipeMessage(const PipeMessage& message, std::shared_ptr<const void> owner, const void* data, size_t length)
+	: PipeMessage(message, nullptr, 0)
+{
+	m_header->messageLength = static_cast<uint32_t>(length);
+	m_owner = std::move(owner);
+	m_view = static_cast<const uint8_t*>(data);
+}
+
 PipeMessage::~PipeMessage()
 {
 }
 
-bool PipeMessage::Parse(std::unique_ptr<uint8_t[]> buffer, size_t length)
+bool PipeMessage::Parse(PipeBuffer buffer, size_t length)
 {
 	if (length == 0)
 		return false;
@@ -97,8 +183,11 @@ bool PipeMessage::Parse(std::unique_ptr<uint8_t[]> buffer, size_t length)
 	return false;
 }
 
-bool PipeMessage::Parse(const std::vector<std::pair<std::unique_ptr<uint8_t[]>, size_t>>& buffers)
+bool PipeMessage::Parse(std::vector<std::pair<PipeBuffer, size_t>>& buffers)
 {
+	if (buffers.size() == 1)
+		return Parse(std::move(buffers[0].first), buffers[0].second);
+
 	// calculate length
 	size_t length = std::accumulate(std::begin(buffers), std::end(buffers),
 		static_cast<size_t>(0), [](size_t v, const auto& p) { return v + p.second; });
@@ -106,7 +195,7 @@ bool PipeMessage::Parse(const std::vector<std::pair<std::unique_ptr<uint8_t[]>,
 		return false;
 
 	// allocate buffer and combine buffers into single.
-	auto buffer = std::make_unique<uint8_t[]>(length);
+	auto buffer = PipeBufferPool::Allocate(length);
 	uint8_t* pos = buffer.get();
 
 	for (auto& [buffer, size] : buffers)
@@ -124,7 +213,7 @@ void PipeMessage::Init(const void* data, size_t length)
 	m_bufferLength = length + m_dataOffset;
 
 	// initialize buffer and header
-	m_buffer = std::make_unique<uint8_t[]>(m_bufferLength);
+	m_buffer = PipeBufferPool::Allocate(m_bufferLength);
 	m_header = reinterpret_cast<MQMessageHeader*>(m_buffer.get());
 
 	if (data && length > 0)
@@ -155,6 +244,20 @@ void PipeMessage::Init(const MQMessageHeader& header, const void* data, size_t l
 	m_valid = true;
 }
 
+void PipeMessage::Flatten()
+{
+	if (!m_view)
+		return;
+
+	// Init replaces the buffer that the header is in
+	const MQMessageHeader header = *m_header;
+	const std::shared_ptr<const void> owner = std::move(m_owner);
+	const uint8_t* data = m_view;
+	m_view = nullptr;
+
+	Init(header, data, header.messageLength);
+}
+
 int PipeMessage::GetConnectionId() const
 {
 	if (auto connection = m_connection.lock())
@@ -217,6 +320,62 @@ mq::PipeMessagePtr MakeCallResponseReplyV0(MQMessageId messageId, const void* da
 
 //============================================================================
 // PipeConnection
+//============================================================================
+// TrafficCounter
+//============================================================================
+
+int64_t TrafficCounter::Now()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TrafficCounter::Add(size_t bytes, uint32_t messages)
+{
+	m_messages += messages;
+	m_bytes += bytes;
+	m_windowMessages += messages;
+	m_windowBytes += bytes;
+
+	const int64_t now = Now();
+	const int64_t windowStart = m_windowStart;
+
+	if (windowStart == 0)
+	{
+		m_windowStart = now;
+	}
+	else if (now - windowStart >= 1000)
+	{
+		const float seconds = (now - windowStart) / 1000.0f;
+		m_messageRate = m_windowMessages / seconds;
+		m_byteRate = m_windowBytes / seconds;
+
+		m_windowMessages = 0;
+		m_windowBytes = 0;
+		m_windowStart = now;
+	}
+}
+
+float TrafficCounter::GetMessageRate() const
+{
+	// The window only rolls over when there's traffic, so a window that has been open for longer
+	// than two seconds means traffic has slowed down since the last rate was computed.
+	const int64_t elapsed = Now() - m_windowStart;
+	if (m_windowStart != 0 && elapsed >= 2000)
+		return m_windowMessages * 1000.0f / elapsed;
+
+	return m_messageRate;
+}
+
+float TrafficCounter::GetByteRate() const
+{
+	const int64_t elapsed = Now() - m_windowStart;
+	if (m_windowStart != 0 && elapsed >= 2000)
+		return m_windowBytes * 1000.0f / elapsed;
+
+	return m_byteRate;
+}
+
 //============================================================================
 
 int PipeConnection::s_nextConnectionId = 1;
@@ -232,6 +391,8 @@ PipeConnection::PipeConnection(NamedPipeEndpointBase* parent, wil::unique_hfile
 
 	GetNamedPipeClientProcessId(m_hPipe.get(), (PULONG)&m_processId);
 
+	m_requestTimerTick = std::chrono::steady_clock::now().time_since_epoch() / REQUEST_TIMER_TICK;
+
 	SPDLOG_DEBUG("Created PipeConnection: connectionId={} pid={}", m_connectionId, m_processId);
 }
 
@@ -257,7 +418,7 @@ void PipeConnection::InternalBeginRead()
 
 	if (!m_readBuffer)
 	{
-		m_readBuffer = std::make_unique<uint8_t[]>(BUFFER_SIZE);
+		m_readBuffer = PipeBufferPool::Allocate(BUFFER_SIZE);
 		m_readBufferSize = BUFFER_SIZE;
 	}
 
@@ -298,7 +459,7 @@ void PipeConnection::ProcessBuffers()
 		auto message = std::make_unique<PipeMessage>();
 		if (message->Parse(m_readBuffers))
 		{
-			InternalReceiveMessage(std::move(message));
+			InternalReceiveFrame(std::move(message), size);
 		}
 		else
 		{
@@ -306,9 +467,12 @@ void PipeConnection::ProcessBuffers()
 				m_connectionId);
 		}
 
-		// Reclaim a buffer
-		m_readBuffer = std::move(m_readBuffers[0].first);
-		m_readBufferSize = m_readBuffers[0].second;
+		// Reclaim a buffer, unless the message took it
+		if (m_readBuffers[0].first)
+		{
+			m_readBuffer = std::move(m_readBuffers[0].first);
+			m_readBufferSize = m_readBuffers[0].second;
+		}
 
 		m_readBuffers.clear();
 	}
@@ -387,24 +551,24 @@ void PipeConnection::SendMessage(PipeMessagePtr&& message)
 }
 
 void PipeConnection::SendMessageWithResponse(MQMessageId messageId, const void* data, size_t dataLength,
-	const PipeMessageResponseCb& response)
+	const PipeMessageResponseCb& response, std::chrono::milliseconds timeout)
 {
-	SendMessageWithResponse(MakeCallResponseMessageV0(messageId, data, dataLength), response);
+	SendMessageWithResponse(MakeCallResponseMessageV0(messageId, data, dataLength), response, timeout);
 }
 
 void PipeConnection::SendMessageWithResponse(PipeMessagePtr&& message,
-	const PipeMessageResponseCb& callback)
+	const PipeMessageResponseCb& callback, std::chrono::milliseconds timeout)
 {
 	std::weak_ptr<PipeConnection> weakPtr = shared_from_this();
 	auto parent = m_parent;
 
-	m_parent->PostToPipeThread([message = message.release(), callback, weakPtr, parent]() mutable
+	m_parent->PostToPipeThread([message = message.release(), callback, timeout, weakPtr, parent]() mutable
 		{
 			if (auto ptr = weakPtr.lock())
 			{
 				auto msg = std::unique_ptr<PipeMessage>(message);
 				msg->SetRequestMode(MQRequestMode::CallAndResponse);
-				ptr->InternalSendMessage(std::move(msg), callback);
+				ptr->InternalSendMessage(std::move(msg), callback, timeout);
 			}
 			else
 			{
@@ -420,7 +584,8 @@ void PipeConnection::Close()
 }
 
 void PipeConnection::InternalSendMessage(PipeMessagePtr&& message,
-	const PipeMessageResponseCb& callback /* = nullptr */)
+	const PipeMessageResponseCb& callback /* = nullptr */,
+	std::chrono::milliseconds timeout /* = DEFAULT_REQUEST_TIMEOUT */)
 {
 	// this function *must* be called on the named pipe server thread
 	assert(std::this_thread::get_id() == m_parent->pipe_thread_id());
@@ -440,19 +605,57 @@ void PipeConnection::InternalSendMessage(PipeMessagePtr&& message,
 		return;
 	}
 
+	const bool tracked = message->GetHeader()->mode == MQRequestMode::CallAndResponse && callback != nullptr;
+	if (tracked && m_rpcRequests.size() >= MAX_PENDING_REQUESTS)
+	{
+		// The other end isn't keeping up with the requests we have, make the sender back off
+		// instead of piling more onto it
+		SPDLOG_WARN("Too many requests waiting for replies, refusing another. connectionId={} pending={}",
+			m_connectionId, m_rpcRequests.size());
+
+		++m_rejectedRequests;
+		m_parent->PostToMainThread(
+			[callback]() { callback(MsgError_TooManyRequests, nullptr); });
+		return;
+	}
+
+	message->Flatten();
+
 	if (message->GetSequenceId() == 0)
 		message->SetSequenceId(m_nextSequenceId++);
 	message->SetConnection(shared_from_this());
 
-	if (message->GetHeader()->mode == MQRequestMode::CallAndResponse
-		&& callback != nullptr)
+	if (tracked)
 	{
 		// If we have a callback, create a request object to track the response.
 		RpcRequest request;
 		request.callback = callback;
 		request.sequenceId = message->GetSequenceId();
 		request.sendTime = std::chrono::steady_clock::now();
+		request.deadline = request.sendTime + timeout;
+
+		// the request goes in the slot of the first tick at or after its deadline
+		const int64_t tick = (request.deadline.time_since_epoch() + REQUEST_TIMER_TICK - std::chrono::steady_clock::duration(1))
+			/ REQUEST_TIMER_TICK;
+		m_requestTimers[tick % REQUEST_TIMER_SLOTS].push_back(request.sequenceId);
+
 		m_rpcRequests.emplace(request.sequenceId, std::move(request));
+		m_pendingRequests = m_rpcRequests.size();
+	}
+
+	// Messages only take the ring when nothing is waiting on the pipe, so they can't overtake
+	// the messages that are queued there.
+	if (m_ringOut && m_writeQueue.empty())
+	{
+		bool wasEmpty = false;
+		if (m_ringOut->Write(message->buffer(), message->buffer_size(), wasEmpty))
+		{
+			m_sent.Add(message->buffer_size());
+
+			if (wasEmpty)
+				::SetEvent(m_peerRingEvent.get());
+			return;
+		}
 	}
 
 	auto queuedOp = std::make_unique<QueuedOp>();
@@ -464,12 +667,20 @@ void PipeConnection::InternalSendMessage(PipeMessagePtr&& message,
 
 void PipeConnection::InternalBeginSend()
 {
+	// Everything but the write in flight is waiting on it
+	m_sendQueueDepth = m_writeQueue.empty() ? 0 : m_writeQueue.size() - 1;
+	if (m_sendQueueDepth > m_maxSendQueueDepth)
+		m_maxSendQueueDepth = m_sendQueueDepth.load();
+
 	// Only allow one write to be processed at a time.
 	if (m_pendingWrite)
 		return;
 	if (m_writeQueue.empty())
 		return;
 
+	if (m_writeQueue.size() > 1)
+		CoalesceWrites();
+
 	QueuedOp* op = m_writeQueue[0].get();
 	op->ref = shared_from_this();
 	ZeroMemory(&op->overlapped, sizeof(OVERLAPPED));
@@ -496,6 +707,45 @@ void PipeConnection::InternalBeginSend()
 	}
 }
 
+void PipeConnection::CoalesceWrites()
+{
+	// Take as many whole messages from the front as fit. Anything big goes on its own.
+	size_t batchSize = 0;
+	size_t count = 0;
+	for (const auto& op : m_writeQueue)
+	{
+		const size_t size = op->message->buffer_size();
+		if (batchSize + size > MAX_BATCH_SIZE)
+			break;
+
+		batchSize += size;
+		++count;
+	}
+
+	if (count < 2)
+		return;
+
+	auto batch = std::make_unique<PipeMessage>();
+	batch->Init(MQMessageId::MSG_BATCH, nullptr, batchSize);
+
+	uint8_t* pos = batch->m_buffer.get() + batch->m_dataOffset;
+	uint32_t messageCount = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const PipeMessage& message = *m_writeQueue[i]->message;
+		memcpy(pos, message.buffer(), message.buffer_size());
+		pos += message.buffer_size();
+		messageCount += m_writeQueue[i]->messageCount;
+	}
+
+	m_writeQueue.erase(m_writeQueue.begin(), m_writeQueue.begin() + count);
+
+	auto queuedOp = std::make_unique<QueuedOp>();
+	queuedOp->message = std::move(batch);
+	queuedOp->messageCount = messageCount;
+	m_writeQueue.push_front(std::move(queuedOp));
+}
+
 void PipeConnection::HandleWriteComplete(QueuedOp* op, uint32_t dwErrorCode, uint32_t dwNumBytes)
 {
 	// this function *must* be called on the named pipe server thread
@@ -506,6 +756,7 @@ void PipeConnection::HandleWriteComplete(QueuedOp* op, uint32_t dwErrorCode, uin
 
 	const auto& reply = op->message;
 	size_t bytesWritten = reply->buffer_size();
+	uint32_t messagesWritten = op->messageCount;
 
 	// this will delete the op
 	m_writeQueue.pop_front();
@@ -522,6 +773,9 @@ void PipeConnection::HandleWriteComplete(QueuedOp* op, uint32_t dwErrorCode, uin
 	SPDLOG_TRACE("PipeConnection::HandleWriteComplete: dwErrorCode={} dwNumBytes={} connectionId={}",
 		dwErrorCode, dwNumBytes, m_connectionId);
 
+	if (dwErrorCode == ERROR_SUCCESS)
+		m_sent.Add(bytesWritten, messagesWritten);
+
 	InternalBeginSend();
 }
 
@@ -550,12 +804,293 @@ bool PipeConnection::InternalClose(bool disconnect)
 	}
 
 	m_rpcRequests.clear();
+	m_pendingRequests = 0;
+	for (auto& slot : m_requestTimers)
+		slot.clear();
+	m_expiredRequests.clear();
 	m_hPipe.reset();
+
+	m_ringIn.reset();
+	m_ringOut.reset();
+	m_offeredRingOut.reset();
+	m_peerRingEvent.reset();
+	m_usingSharedMemory = false;
 	return true;
 }
 
+void PipeConnection::ExpireRequests(std::chrono::steady_clock::time_point now)
+{
+	// this function *must* be called on the named pipe thread
+	assert(std::this_thread::get_id() == m_parent->pipe_thread_id());
+
+	const int64_t currentTick = now.time_since_epoch() / REQUEST_TIMER_TICK;
+	if (currentTick <= m_requestTimerTick)
+		return;
+
+	// after a long stall, one turn of the wheel covers every slot
+	const int64_t firstTick = std::max(m_requestTimerTick + 1, currentTick - static_cast<int64_t>(REQUEST_TIMER_SLOTS) + 1);
+	m_requestTimerTick = currentTick;
+
+	for (int64_t tick = firstTick; tick <= currentTick && !m_rpcRequests.empty(); ++tick)
+	{
+		std::vector<uint32_t>& slot = m_requestTimers[tick % REQUEST_TIMER_SLOTS];
+		for (size_t i = 0; i < slot.size();)
+		{
+			auto iter = m_rpcRequests.find(slot[i]);
+			if (iter != m_rpcRequests.end() && iter->second.deadline > now)
+			{
+				// this one is due on a later turn
+				++i;
+				continue;
+			}
+
+			if (iter != m_rpcRequests.end())
+			{
+				SPDLOG_DEBUG("Request timed out. connectionId={} sequenceId={}", m_connectionId, slot[i]);
+
+				m_parent->PostToMainThread(
+					[callback = std::move(iter->second.callback)]() { callback(MsgError_Timeout, nullptr); });
+
+				m_expiredRequests.emplace(slot[i], now);
+				m_rpcRequests.erase(iter);
+				++m_timedOutRequests;
+			}
+
+			slot[i] = slot.back();
+			slot.pop_back();
+		}
+	}
+
+	m_pendingRequests = m_rpcRequests.size();
+
+	// a reply that is this late isn't coming, and its sequence id may be in use again
+	for (auto iter = m_expiredRequests.begin(); iter != m_expiredRequests.end();)
+	{
+		if (now - iter->second > DEFAULT_REQUEST_TIMEOUT)
+			iter = m_expiredRequests.erase(iter);
+		else
+			++iter;
+	}
+}
+
+PipeConnectionStats PipeConnection::GetStats() const
+{
+	PipeConnectionStats stats;
+	stats.ConnectionId = m_connectionId;
+	stats.ProcessId = m_processId;
+
+	stats.MessagesSent = m_sent.GetMessages();
+	stats.BytesSent = m_sent.GetBytes();
+	stats.SentMessageRate = m_sent.GetMessageRate();
+	stats.SentByteRate = m_sent.GetByteRate();
+
+	stats.MessagesReceived = m_received.GetMessages();
+	stats.BytesReceived = m_received.GetBytes();
+	stats.ReceivedMessageRate = m_received.GetMessageRate();
+	stats.ReceivedByteRate = m_received.GetByteRate();
+
+	stats.SendQueueDepth = m_sendQueueDepth;
+	stats.MaxSendQueueDepth = m_maxSendQueueDepth;
+
+	stats.PendingRequests = m_pendingRequests;
+	stats.CompletedRequests = m_completedRequests;
+	stats.TimedOutRequests = m_timedOutRequests;
+	stats.RejectedRequests = m_rejectedRequests;
+	stats.LastRoundTrip = std::chrono::microseconds(m_lastRoundTrip);
+	stats.MaxRoundTrip = std::chrono::microseconds(m_maxRoundTrip);
+	if (stats.CompletedRequests > 0)
+		stats.AverageRoundTrip = std::chrono::microseconds(m_totalRoundTrip / stats.CompletedRequests);
+
+	uint64_t counted = 0;
+	for (const auto& bucket : m_roundTripHistogram)
+		counted += bucket;
+
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < m_roundTripHistogram.size() && counted > 0; ++bucket)
+	{
+		seen += m_roundTripHistogram[bucket];
+
+		const auto bound = std::chrono::microseconds(1ull << bucket);
+		if (stats.MedianRoundTrip.count() == 0 && seen * 2 >= counted)
+			stats.MedianRoundTrip = bound;
+		if (seen * 100 >= counted * 99)
+		{
+			stats.P99RoundTrip = bound;
+			break;
+		}
+	}
+
+	stats.SharedMemory = m_usingSharedMemory;
+
+	return stats;
+}
+
+void PipeConnection::InternalOfferSharedMemory()
+{
+	// this function *must* be called on the named pipe thread
+	assert(std::this_thread::get_id() == m_parent->pipe_thread_id());
+
+	if (!m_hPipe || !m_parent->m_ringEvent || m_ringIn || m_offeredRingOut)
+		return;
+
+	const uint32_t nonce = s_nextRingNonce++;
+	const uint32_t processId = ::GetCurrentProcessId();
+
+	auto ringIn = SharedMemoryRing::Create(GetRingName(processId, nonce, "down"), RING_CAPACITY);
+	auto ringOut = SharedMemoryRing::Create(GetRingName(processId, nonce, "up"), RING_CAPACITY);
+	if (!ringIn || !ringOut)
+		return;
+
+	// Nothing arrives on the incoming ring until the server has accepted, and nothing is sent
+	// on the outgoing ring until then either.
+	m_ringIn = std::move(ringIn);
+	m_offeredRingOut = std::move(ringOut);
+	m_ringNonce = nonce;
+
+	MQMessageSharedMemory offer = {};
+	offer.nonce = nonce;
+	strcpy_s(offer.eventName, m_parent->m_ringEventName.c_str());
+
+	InternalSendMessage(MakeSimpleMessageV0(MQMessageId::MSG_SHARED_MEMORY, &offer, sizeof(offer)));
+}
+
+void PipeConnection::HandleSharedMemoryMessage(const PipeMessagePtr& message)
+{
+	if (message->size() < sizeof(MQMessageSharedMemory))
+		return;
+
+	const MQMessageSharedMemory* data = message->get<MQMessageSharedMemory>();
+	const std::string eventName(data->eventName, strnlen(data->eventName, sizeof(data->eventName)));
+
+	wil::unique_event_nothrow peerEvent(::OpenEventA(EVENT_MODIFY_STATE, FALSE, eventName.c_str()));
+	if (!peerEvent)
+	{
+		SPDLOG_WARN("{} connectionId={} event={}",
+			fmt::windows_error(GetLastError(), "Failed to open shared memory ring event").what(), m_connectionId, eventName);
+		return;
+	}
+
+	if (m_offeredRingOut)
+	{
+		// The server accepted the rings that we offered.
+		if (data->nonce != m_ringNonce)
+			return;
+
+		m_peerRingEvent = std::move(peerEvent);
+		m_ringOut = std::move(m_offeredRingOut);
+	}
+	else
+	{
+		// The client is offering rings. If we can't use them, we don't reply and the pipe is
+		// used for everything.
+		if (m_ringIn || !m_parent->m_ringEvent)
+			return;
+
+		auto ringIn = SharedMemoryRing::Open(GetRingName(m_processId, data->nonce, "up"));
+		auto ringOut = SharedMemoryRing::Open(GetRingName(m_processId, data->nonce, "down"));
+		if (!ringIn || !ringOut)
+			return;
+
+		MQMessageSharedMemory reply = {};
+		reply.nonce = data->nonce;
+		strcpy_s(reply.eventName, m_parent->m_ringEventName.c_str());
+
+		// The reply goes over the pipe, because the outgoing ring isn't set yet.
+		InternalSendMessage(MakeSimpleMessageV0(MQMessageId::MSG_SHARED_MEMORY, &reply, sizeof(reply)));
+
+		m_ringIn = std::move(ringIn);
+		m_ringOut = std::move(ringOut);
+		m_peerRingEvent = std::move(peerEvent);
+	}
+
+	m_usingSharedMemory = true;
+
+	SPDLOG_DEBUG("Using shared memory rings: connectionId={} pid={} capacity={}",
+		m_connectionId, m_processId, m_ringOut->GetCapacity());
+}
+
+void PipeConnection::ProcessRing()
+{
+	// this function *must* be called on the named pipe thread
+	assert(std::this_thread::get_id() == m_parent->pipe_thread_id());
+
+	std::unique_ptr<uint8_t[]> buffer;
+	size_t length = 0;
+
+	// Receiving a message can close the connection, which drops the rings.
+	while (m_hPipe && m_ringIn && m_ringIn->Read(buffer, length))
+	{
+		auto message = std::make_unique<PipeMessage>();
+		if (message->Parse(std::move(buffer), length))
+		{
+			InternalReceiveFrame(std::move(message), length);
+		}
+		else
+		{
+			SPDLOG_WARN("PipeConnection::ProcessRing: Failed to parse incoming message: connectionId={}",
+				m_connectionId);
+		}
+	}
+}
+
+void PipeConnection::InternalReceiveFrame(PipeMessagePtr&& message, size_t bytes)
+{
+	if (message->GetMessageId() != MQMessageId::MSG_BATCH)
+	{
+		m_received.Add(bytes);
+		InternalReceiveMessage(std::move(message));
+		return;
+	}
+
+	// Each message in the batch is a header followed by its payload
+	const uint8_t* pos = message->get<uint8_t>();
+	size_t remaining = message->size();
+	std::vector<PipeMessagePtr> messages;
+
+	while (remaining > 0)
+	{
+		MQMessageHeader header;
+		if (remaining < sizeof(header))
+			break;
+
+		memcpy(&header, pos, sizeof(header));
+		if (header.protoVersion != MQProtoVersion::V0 || header.messageId == MQMessageId::MSG_BATCH
+			|| header.messageLength > remaining - sizeof(header))
+		{
+			break;
+		}
+
+		messages.push_back(std::make_unique<PipeMessage>(header, pos + sizeof(header), header.messageLength));
+		pos += sizeof(header) + header.messageLength;
+		remaining -= sizeof(header) + header.messageLength;
+	}
+
+	if (remaining > 0)
+	{
+		SPDLOG_WARN("PipeConnection::InternalReceiveFrame: Failed to parse batched message: connectionId={} remaining={}",
+			m_connectionId, remaining);
+	}
+
+	m_received.Add(bytes, static_cast<uint32_t>(messages.size()));
+
+	// Receiving a message can close the connection
+	for (PipeMessagePtr& batched : messages)
+	{
+		if (!m_hPipe)
+			break;
+
+		InternalReceiveMessage(std::move(batched));
+	}
+}
+
 void PipeConnection::InternalReceiveMessage(PipeMessagePtr&& message)
 {
+	if (message->GetMessageId() == MQMessageId::MSG_SHARED_MEMORY)
+	{
+		HandleSharedMemoryMessage(message);
+		return;
+	}
+
 	message->SetConnection(shared_from_this());
 
 	if (message->GetRequestMode() == MQRequestMode::MessageReply)
@@ -566,8 +1101,22 @@ void PipeConnection::InternalReceiveMessage(PipeMessagePtr&& message)
 		{
 			// We found a request handler.
 			auto callback = iter->second.callback;
+			const uint64_t roundTrip = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - iter->second.sendTime).count();
 			m_rpcRequests.erase(iter);
 
+			m_pendingRequests = m_rpcRequests.size();
+			++m_completedRequests;
+			m_totalRoundTrip += roundTrip;
+			m_lastRoundTrip = roundTrip;
+			if (roundTrip > m_maxRoundTrip)
+				m_maxRoundTrip = roundTrip;
+
+			size_t bucket = 0;
+			while (bucket + 1 < m_roundTripHistogram.size() && (1ull << bucket) <= roundTrip)
+				++bucket;
+			++m_roundTripHistogram[bucket];
+
 			m_parent->PostToMainThread([callback, message = message.release()]() mutable
 				{
 					callback(static_cast<int8_t>(message->GetHeader()->status), std::unique_ptr<PipeMessage>(message));
@@ -575,6 +1124,13 @@ void PipeConnection::InternalReceiveMessage(PipeMessagePtr&& message)
 
 			return;
 		}
+
+		if (m_expiredRequests.erase(message->GetHeader()->sequenceId) > 0)
+		{
+			SPDLOG_DEBUG("Dropping the reply to a request that timed out. connectionId={} sequenceId={}",
+				m_connectionId, message->GetHeader()->sequenceId);
+			return;
+		}
 	}
 
 	// if we get here with a reply, we didn't have a callback -- so it needs to be routed
@@ -590,6 +1146,15 @@ NamedPipeEndpointBase::NamedPipeEndpointBase(std::string threadName, std::string
 	, m_pipeName(std::move(pipeName))
 {
 	m_interruptEvent.create();
+
+	// Named, so the other end of a connection can open it when we start using shared memory rings.
+	m_ringEventName = fmt::format("Local\\mqring_{}_{}_{}", ::GetCurrentProcessId(), m_threadName, s_nextRingEvent++);
+	m_ringEvent.reset(::CreateEventA(nullptr, FALSE, FALSE, m_ringEventName.c_str()));
+	if (!m_ringEvent)
+	{
+		SPDLOG_WARN("{} name={}",
+			fmt::windows_error(GetLastError(), "Failed to create shared memory ring event").what(), m_ringEventName);
+	}
 }
 
 NamedPipeEndpointBase::~NamedPipeEndpointBase()
@@ -727,6 +1292,12 @@ void NamedPipeEndpointBase::PostToMainThread(std::function<void()>&& callback)
 	}
 }
 
+size_t NamedPipeEndpointBase::GetMainThreadQueueSize()
+{
+	std::scoped_lock lock(m_mainQueueMutex);
+	return m_mainQueue.size();
+}
+
 void NamedPipeEndpointBase::ProcessMainThreadQueue()
 {
 	assert(std::this_thread::get_id() == m_mainThreadId);
@@ -754,14 +1325,17 @@ NamedPipeServer::~NamedPipeServer()
 
 void NamedPipeServer::NamedPipeThread()
 {
-	HANDLE waitEvents[2] =
+	HANDLE waitEvents[3] =
 	{
 		m_connectEvent.get(),
 		m_interruptEvent.get(),
+		m_ringEvent.get(),
 	};
+	const DWORD waitCount = m_ringEvent ? 3 : 2;
 
 	// initiate by creating the pipe
 	bool bPending = CreateAndConnect();
+	DWORD timeout = INFINITE;
 
 	while (IsRunning())
 	{
@@ -769,7 +1343,9 @@ void NamedPipeServer::NamedPipeThread()
 		// 1. A connection event (a new incoming connection)
 		// 2. A stop event (server shutting down)
 		// 3. A background task being completed and executed while we wait.
-		DWORD dwWait = WaitForMultipleObjectsEx(2, waitEvents, FALSE, INFINITE, TRUE);
+		// 4. A shared memory ring of a connection has data
+		// 5. The next tick of the request timers, if there are requests waiting for replies
+		DWORD dwWait = WaitForMultipleObjectsEx(waitCount, waitEvents, FALSE, timeout, TRUE);
 
 		switch (dwWait)
 		{
@@ -817,6 +1393,10 @@ void NamedPipeServer::NamedPipeThread()
 			ProcessPipeThreadQueue();
 			break;
 
+		case 2: // ring event
+			ProcessRings();
+			break;
+
 		case WAIT_IO_COMPLETION:
 			//SPDLOG_TRACE("NamedPipeServer::server_thread: woke up on io completion");
 
@@ -824,9 +1404,14 @@ void NamedPipeServer::NamedPipeThread()
 			// This allows the system to execute the completion routine.
 			break;
 
+		case WAIT_TIMEOUT:
+			break;
+
 		default:
 			throw fmt::windows_error(GetLastError(), "Failed in WaitForMultipleObjectsEx");
 		}
+
+		timeout = ExpireRequests();
 	}
 
 	{
@@ -981,6 +1566,38 @@ std::shared_ptr<PipeConnection> NamedPipeServer::GetConnection(int connectionId)
 	return *iter;
 }
 
+void NamedPipeServer::ProcessRings()
+{
+	// Receiving can close connections, so don't hold the lock while we do it.
+	std::vector<std::shared_ptr<PipeConnection>> connections;
+	{
+		std::scoped_lock lock(m_mutex);
+		connections = m_connections;
+	}
+
+	for (const auto& connection : connections)
+		connection->ProcessRing();
+}
+
+DWORD NamedPipeServer::ExpireRequests()
+{
+	std::vector<std::shared_ptr<PipeConnection>> connections;
+	{
+		std::scoped_lock lock(m_mutex);
+		connections = m_connections;
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	bool pending = false;
+	for (const auto& connection : connections)
+	{
+		connection->ExpireRequests(now);
+		pending |= connection->HasPendingRequests();
+	}
+
+	return pending ? static_cast<DWORD>(PipeConnection::REQUEST_TIMER_TICK.count()) : INFINITE;
+}
+
 std::vector<int> NamedPipeServer::GetConnectionIds() const
 {
 	std::vector<int> connIds;
@@ -998,6 +1615,21 @@ std::vector<int> NamedPipeServer::GetConnectionIds() const
 	return connIds;
 }
 
+std::vector<PipeConnectionStats> NamedPipeServer::GetConnectionStats() const
+{
+	std::vector<PipeConnectionStats> stats;
+
+	std::scoped_lock<std::mutex> lock(m_mutex);
+	stats.reserve(m_connections.size());
+
+	for (const auto& conn : m_connections)
+	{
+		stats.push_back(conn->GetStats());
+	}
+
+	return stats;
+}
+
 std::shared_ptr<PipeConnection> NamedPipeServer::GetConnectionForProcessId(uint32_t processId) const
 {
 	std::scoped_lock<std::mutex> lock(m_mutex);
@@ -1080,9 +1712,11 @@ NamedPipeClient::~NamedPipeClient()
 
 void NamedPipeClient::NamedPipeThread()
 {
-	HANDLE waitEvents[1] = {
+	HANDLE waitEvents[2] = {
 		m_interruptEvent.get(),
+		m_ringEvent.get(),
 	};
+	const DWORD waitCount = m_ringEvent ? 2 : 1;
 
 	while (IsRunning())
 	{
@@ -1121,6 +1755,9 @@ void NamedPipeClient::NamedPipeThread()
 					m_connection = std::make_shared<PipeConnection>(this, std::move(hPipe));
 					m_connection->StartRead();
 
+					if (m_sharedMemory)
+						m_connection->InternalOfferSharedMemory();
+
 					if (m_handler)
 					{
 						m_handler->OnClientConnected();
@@ -1191,7 +1828,10 @@ void NamedPipeClient::NamedPipeThread()
 		// Second loop will try to process events on the connection
 		while (m_connection && IsRunning())
 		{
-			DWORD dwWait = WaitForMultipleObjectsEx(static_cast<DWORD>(lengthof(waitEvents)), waitEvents, FALSE, INFINITE, TRUE);
+			// wake up for the request timers while there are requests waiting for replies
+			const DWORD timeout = m_connection->HasPendingRequests()
+				? static_cast<DWORD>(PipeConnection::REQUEST_TIMER_TICK.count()) : INFINITE;
+			DWORD dwWait = WaitForMultipleObjectsEx(waitCount, waitEvents, FALSE, timeout, TRUE);
 
 			switch (dwWait)
 			{
@@ -1200,12 +1840,22 @@ void NamedPipeClient::NamedPipeThread()
 				ProcessPipeThreadQueue();
 				break;
 
+			case 1: // ring event
+				// Receiving can drop the connection, keep it alive until we're done.
+				if (auto connection = m_connection)
+					connection->ProcessRing();
+				break;
+
 			case WAIT_IO_COMPLETION:
+			case WAIT_TIMEOUT:
 				break;
 
 			default:
 				throw fmt::windows_error(GetLastError(), "Failed in WaitForMultipleObjectsEx");
 			}
+
+			if (auto connection = m_connection)
+				connection->ExpireRequests(std::chrono::steady_clock::now());
 		}
 	}
 
@@ -1221,6 +1871,14 @@ bool NamedPipeClient::IsConnected() const
 	return m_connection != nullptr;
 }
 
+std::optional<PipeConnectionStats> NamedPipeClient::GetConnectionStats() const
+{
+	if (PipeConnectionPtr connection = m_connection)
+		return connection->GetStats();
+
+	return std::nullopt;
+}
+
 void NamedPipeClient::CloseConnection(PipeConnection* connection)
 {
 	SPDLOG_DEBUG("Closing connection. connectionId={0}", connection->GetConnectionId());
@@ -15,13 +15,17 @@
 #pragma once
 
 #include "NamedPipesProtocol.h"
+#include "SharedMemoryRing.h"
 
 #include <wil/resource.h>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 
@@ -39,6 +43,33 @@ namespace mq {
 class NamedPipeEndpointBase;
 class PipeConnection;
 
+//============================================================================
+// Every message allocates at least one buffer, so freed buffers of the common sizes are
+// kept for reuse instead of going back to the heap. Safe to use from any thread.
+
+class PipeBufferPool
+{
+public:
+	static constexpr uint8_t NotPooled = 0xff;
+
+	struct Deleter
+	{
+		Deleter() = default;
+		Deleter(std::default_delete<uint8_t[]>) {}   // buffers that didn't come from the pool
+		explicit Deleter(uint8_t sizeClass) : sizeClass(sizeClass) {}
+
+		void operator()(uint8_t* buffer) const;
+
+		uint8_t sizeClass = NotPooled;
+	};
+
+	using Buffer = std::unique_ptr<uint8_t[], Deleter>;
+
+	// The buffer is at least size bytes. Its contents are not initialized.
+	static Buffer Allocate(size_t size);
+};
+using PipeBuffer = PipeBufferPool::Buffer;
+
 //============================================================================
 // message sent to/from the named pipe server
 
@@ -56,12 +87,18 @@ public:
 	PipeMessage(const MQMessageHeader& header, const void* data, size_t length);
 	PipeMessage(const PipeMessage& message, const void* data, size_t length);
 
+	// A message with the header of another message and a payload that it doesn't own. The
+	// payload has to stay valid for as long as owner does, and it is shared instead of copied.
+	PipeMessage(const PipeMessage& message, std::shared_ptr<const void> owner, const void* data, size_t length);
+
 	virtual ~PipeMessage();
 
 	// parse an existing message buffer into a message. Returns false if this is not a
 	// properly formatted message.
-	bool Parse(std::unique_ptr<uint8_t[]> buffer, size_t length);
-	bool Parse(const std::vector<std::pair<std::unique_ptr<uint8_t[]>, size_t>>& buffers);
+	bool Parse(PipeBuffer buffer, size_t length);
+
+	// A message that was read into a single buffer takes that buffer instead of copying it.
+	bool Parse(std::vector<std::pair<PipeBuffer, size_t>>& buffers);
 
 	void Init(const void* data, size_t length);
 	void Init(MQMessageId messageId, const void* data, size_t length);
@@ -97,7 +134,7 @@ public:
 	}
 
 	template <typename T = void>
-	const T* get() const { return reinterpret_cast<T*>(m_buffer.get() + m_dataOffset); }
+	const T* get() const { return reinterpret_cast<const T*>(m_view ? m_view : m_buffer.get() + m_dataOffset); }
 
 	size_t size() const { return m_header ? m_header->messageLength : 0; }
 
@@ -118,9 +155,14 @@ private:
 	const uint8_t* buffer() const { return m_buffer.get(); }
 	size_t buffer_size() const { return m_bufferLength; }
 
+	// Copies a shared payload in behind the header, so the message can be written.
+	void Flatten();
+
 private:
-	std::unique_ptr<uint8_t[]> m_buffer;
+	PipeBuffer m_buffer;
 	size_t m_bufferLength = 0;
+	std::shared_ptr<const void> m_owner;  // keeps a shared payload alive
+	const uint8_t* m_view = nullptr;      // the shared payload, if the payload isn't in m_buffer
 	MQMessageHeader* m_header = nullptr;
 	size_t m_dataOffset = 0;
 	bool m_valid = false;
@@ -142,6 +184,71 @@ PipeMessagePtr MakeCallResponseMessageV0(MQMessageId messageId, const void* data
 PipeMessagePtr MakeCallResponseReplyV0(MQMessageId messageId, const void* data, size_t dataLength,
 	uint32_t sequenceId, uint8_t status = 0);
 
+//============================================================================
+// Counts the messages going one way through a connection or mailbox. Only the thread that moves
+// the messages adds to it, any thread can read it.
+
+class TrafficCounter
+{
+public:
+	void Add(size_t bytes, uint32_t messages = 1);
+
+	uint64_t GetMessages() const { return m_messages; }
+	uint64_t GetBytes() const { return m_bytes; }
+
+	// Per second, over the last whole second (or longer, if it has been quiet since).
+	float GetMessageRate() const;
+	float GetByteRate() const;
+
+private:
+	static int64_t Now();
+
+	std::atomic<uint64_t> m_messages{ 0 };
+	std::atomic<uint64_t> m_bytes{ 0 };
+
+	std::atomic<int64_t> m_windowStart{ 0 };   // milliseconds
+	std::atomic<uint32_t> m_windowMessages{ 0 };
+	std::atomic<uint64_t> m_windowBytes{ 0 };
+	std::atomic<float> m_messageRate{ 0 };
+	std::atomic<float> m_byteRate{ 0 };
+};
+
+struct PipeConnectionStats
+{
+	int ConnectionId = -1;
+	uint32_t ProcessId = 0;
+
+	uint64_t MessagesSent = 0;
+	uint64_t BytesSent = 0;
+	float SentMessageRate = 0;
+	float SentByteRate = 0;
+
+	uint64_t MessagesReceived = 0;
+	uint64_t BytesReceived = 0;
+	float ReceivedMessageRate = 0;
+	float ReceivedByteRate = 0;
+
+	// Writes waiting behind the one in flight, only one write is in flight at a time.
+	size_t SendQueueDepth = 0;
+	size_t MaxSendQueueDepth = 0;
+
+	// Round trips of SendMessageWithResponse, from the message being queued to its reply arriving.
+	size_t PendingRequests = 0;
+	uint64_t CompletedRequests = 0;
+	uint64_t TimedOutRequests = 0;
+	uint64_t RejectedRequests = 0;        // refused because MAX_PENDING_REQUESTS were waiting
+	std::chrono::microseconds LastRoundTrip{ 0 };
+	std::chrono::microseconds AverageRoundTrip{ 0 };
+	std::chrono::microseconds MaxRoundTrip{ 0 };
+
+	// Upper bounds, from a histogram with a bucket for each power of two microseconds
+	std::chrono::microseconds MedianRoundTrip{ 0 };
+	std::chrono::microseconds P99RoundTrip{ 0 };
+
+	// Messages are sent over shared memory rings, with the pipe as the fallback
+	bool SharedMemory = false;
+};
+
 //============================================================================
 // Represents an established connetion to a named pipe.
 class PipeConnection
@@ -163,6 +270,7 @@ public:
 	const OVERLAPPED* GetOverlapped() const { return &m_overlapped; }
 
 	void StartRead() { InternalBeginRead(); }
+	bool IsUsingSharedMemory() const { return m_usingSharedMemory; }
 	HANDLE GetNamedPipe() { return m_hPipe.get(); }
 	bool IsNamedPipeOpen() const { return m_hPipe.is_valid(); }
 
@@ -173,13 +281,30 @@ public:
 	void SendMessage(MQMessageId messageId, const void* data, size_t dataLength);
 	void SendMessage(PipeMessagePtr&& message);
 
-	// Send a call-and-response message to the server
+	// Send a call-and-response message to the server. The response gets MsgError_Timeout if there
+	// is no reply by the timeout, and MsgError_TooManyRequests right away if MAX_PENDING_REQUESTS
+	// are already waiting for theirs.
 	void SendMessageWithResponse(MQMessageId messageId, const void* data, size_t dataLength,
-		const PipeMessageResponseCb& response);
+		const PipeMessageResponseCb& response, std::chrono::milliseconds timeout = DEFAULT_REQUEST_TIMEOUT);
 	void SendMessageWithResponse(PipeMessagePtr&& message,
-		const PipeMessageResponseCb& response);
+		const PipeMessageResponseCb& response, std::chrono::milliseconds timeout = DEFAULT_REQUEST_TIMEOUT);
 
 	void Close();
+
+	// Traffic, queue depths and round trip times of this connection. Safe to call from any thread.
+	PipeConnectionStats GetStats() const;
+
+	static constexpr std::chrono::milliseconds DEFAULT_REQUEST_TIMEOUT{ 30000 };
+	static constexpr size_t MAX_PENDING_REQUESTS = 4096;
+
+	// How often the pipe thread expires requests, while there are any
+	static constexpr std::chrono::milliseconds REQUEST_TIMER_TICK{ 100 };
+
+	bool HasPendingRequests() const { return m_pendingRequests > 0; }
+
+	// Fails the requests that are past their deadline. Called by the pipe thread every tick.
+	void ExpireRequests(std::chrono::steady_clock::time_point now);
+
 private:
 	// Queued outgoing writes
 	struct QueuedOp
@@ -187,6 +312,7 @@ private:
 		OVERLAPPED overlapped;
 		std::shared_ptr<PipeConnection> ref;
 		std::unique_ptr<PipeMessage> message;
+		uint32_t messageCount = 1;    // more than one if this is a batch
 	};
 
 	// After a read is completed, start a write.
@@ -197,10 +323,24 @@ private:
 
 	// This sends the message to the named pipe. It expects to be called from the named pipe thread.
 	void InternalSendMessage(PipeMessagePtr&& message,
-		const PipeMessageResponseCb& response = nullptr);
+		const PipeMessageResponseCb& response = nullptr,
+		std::chrono::milliseconds timeout = DEFAULT_REQUEST_TIMEOUT);
 
 	void InternalReceiveMessage(PipeMessagePtr&& message);
 
+	// Receives a message read from the pipe or a ring, unpacking it if it is a batch.
+	void InternalReceiveFrame(PipeMessagePtr&& message, size_t bytes);
+
+	// Replaces the messages at the front of the write queue with a single batch, so a burst of
+	// small messages takes one write instead of one per message.
+	void CoalesceWrites();
+
+	// Shared memory rings. The client creates both rings and offers them, the server opens
+	// them and replies. Until then, and for messages that don't fit, the pipe is used.
+	void InternalOfferSharedMemory();
+	void HandleSharedMemoryMessage(const PipeMessagePtr& message);
+	void ProcessRing();
+
 	void InternalBeginRead();
 	void ProcessBuffers();
 	void InternalBeginSend();
@@ -218,8 +358,8 @@ private:
 
 	// data used for reading
 	OVERLAPPED m_overlapped;              // used for reading only
-	std::unique_ptr<uint8_t[]> m_readBuffer;
-	std::vector<std::pair<std::unique_ptr<uint8_t[]>, size_t>> m_readBuffers;
+	PipeBuffer m_readBuffer;
+	std::vector<std::pair<PipeBuffer, size_t>> m_readBuffers;
 	size_t m_readBufferSize = 0;
 	std::shared_ptr<PipeConnection> m_self;
 
@@ -232,9 +372,43 @@ private:
 	{
 		PipeMessageResponseCb callback;
 		uint32_t sequenceId;
-		std::chrono::steady_clock::time_point sendTime; // for timeouts
+		std::chrono::steady_clock::time_point sendTime;
+		std::chrono::steady_clock::time_point deadline;
 	};
 	std::unordered_map<uint32_t, RpcRequest> m_rpcRequests;
+
+	// A timer wheel of the sequence ids in m_rpcRequests, by the tick of their deadline. Each tick
+	// that passes looks at one slot, and requests that are a whole turn (or more) away stay in it.
+	// Requests that get their reply are left in their slot until it comes around.
+	static constexpr size_t REQUEST_TIMER_SLOTS = 256;
+	std::array<std::vector<uint32_t>, REQUEST_TIMER_SLOTS> m_requestTimers;
+	int64_t m_requestTimerTick = 0;       // the last tick that was expired
+
+	// Requests that timed out, until their replies couldn't arrive any more. A late reply is dropped
+	// instead of being dispatched like a message that nobody asked for.
+	std::unordered_map<uint32_t, std::chrono::steady_clock::time_point> m_expiredRequests;
+
+	// metrics, written on the named pipe thread
+	TrafficCounter m_sent;
+	TrafficCounter m_received;
+	std::atomic<size_t> m_sendQueueDepth{ 0 };
+	std::atomic<size_t> m_maxSendQueueDepth{ 0 };
+	std::atomic<size_t> m_pendingRequests{ 0 };
+	std::atomic<uint64_t> m_completedRequests{ 0 };
+	std::atomic<uint64_t> m_timedOutRequests{ 0 };
+	std::atomic<uint64_t> m_rejectedRequests{ 0 };
+	std::atomic<uint64_t> m_totalRoundTrip{ 0 };    // microseconds
+	std::atomic<uint64_t> m_lastRoundTrip{ 0 };
+	std::atomic<uint64_t> m_maxRoundTrip{ 0 };
+	std::array<std::atomic<uint32_t>, 32> m_roundTripHistogram{};   // bucket n is under 2^n microseconds
+
+	// shared memory transport
+	std::unique_ptr<SharedMemoryRing> m_ringIn;
+	std::unique_ptr<SharedMemoryRing> m_ringOut;
+	std::unique_ptr<SharedMemoryRing> m_offeredRingOut;   // client, until the server accepts
+	uint32_t m_ringNonce = 0;
+	wil::unique_event_nothrow m_peerRingEvent;            // signaled when m_ringOut has data for the other side
+	std::atomic_bool m_usingSharedMemory{ false };
 };
 using PipeConnectionPtr = std::shared_ptr<PipeConnection>;
 
@@ -277,6 +451,9 @@ public:
 	virtual void Start();
 	virtual void Stop();
 
+	// Number of callbacks waiting to be run by the main thread
+	size_t GetMainThreadQueueSize();
+
 	// Handle sending work to the main thread
 	virtual void PostToMainThread(std::function<void()>&& callback);
 
@@ -299,6 +476,8 @@ protected:
 protected:
 	std::string m_pipeName;
 	wil::unique_event m_interruptEvent;
+	wil::unique_event m_ringEvent;       // signaled when a shared memory ring read by this endpoint has data
+	std::string m_ringEventName;
 	std::shared_ptr<NamedPipeEvents> m_handler;
 
 private:
@@ -344,6 +523,8 @@ public:
 	void BroadcastMessage(PipeMessagePtr&& message);
 	void BroadcastMessage(MQMessageId messageId, const void* data, size_t dataLength);
 
+	std::vector<PipeConnectionStats> GetConnectionStats() const;
+
 private:
 	void NamedPipeThread() override;
 
@@ -356,6 +537,12 @@ private:
 
 	int GetConnectionCount() const;
 
+	// Read everything waiting in the shared memory rings of every connection
+	void ProcessRings();
+
+	// Times out the requests of every connection, and returns how long to wait until the next tick
+	DWORD ExpireRequests();
+
 private:
 	wil::unique_event m_connectEvent;
 	OVERLAPPED m_oConnect;
@@ -384,14 +571,21 @@ public:
 	// Checks if we're connected
 	bool IsConnected() const;
 
+	// Offer the server shared memory rings for messages when connecting. Takes effect on the next connection.
+	void EnableSharedMemory(bool enable) { m_sharedMemory = enable; }
+
 	PipeConnectionPtr GetConnection() const { return m_connection; }
 
+	// Stats of the connection to the server, if there is one
+	std::optional<PipeConnectionStats> GetConnectionStats() const;
+
 private:
 	virtual void NamedPipeThread() override;
 	virtual void CloseConnection(PipeConnection* connection) override;
 
 private:
 	std::shared_ptr<PipeConnection> m_connection;
+	std::atomic_bool m_sharedMemory{ false };
 };
 
 } // namespace mq
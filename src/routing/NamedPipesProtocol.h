@@ -28,6 +28,10 @@ enum class MQMessageId : uint16_t
 	MSG_ROUTE                              = 2,     // Route a message to a mailbox in a client
 	MSG_IDENTIFICATION                     = 3,     // Update routing information in server/client or request ID list
 	MSG_DROPPED                            = 4,     // Notify clients that an address is no longer connected
+	MSG_SHARED_MEMORY                      = 5,     // Offer/accept shared memory rings for a connection. Handled by the connection.
+	MSG_BATCH                              = 6,     // Several complete messages (header and payload) written at once. Handled by the connection.
+	MSG_SUBSCRIPTIONS                      = 7,     // Update the topics that the mailboxes of a client subscribe to
+	MSG_LOAD_TEST                          = 8,     // Synthetic traffic of a PipeLoadTest. Only sent on its own pipe.
 
 	// FIXME: We really should have message ids separated by plugins or services. For now we will use a single enum
 	// and just change it later.
@@ -63,6 +67,8 @@ constexpr int MsgError_ConnectionClosed        = -1;                  // connect
 constexpr int MsgError_NoConnection            = -2;                  // no connection established
 constexpr int MsgError_RoutingFailed           = -3;                  // message routing failed
 constexpr int MsgError_AmbiguousRecipient      = -4;                  // RPC message couldn't determine single recipient
+constexpr int MsgError_Timeout                 = -5;                  // RPC message didn't get a reply in time
+constexpr int MsgError_TooManyRequests         = -6;                  // too many RPC messages are waiting for replies
 
 #pragma pack(push)
 #pragma pack(1)
@@ -83,6 +89,15 @@ struct MQMessageHeader
 
 #pragma pack(pop)
 
+// MSG_SHARED_MEMORY -> from client once it has created the rings. The server replies with the same
+// message once it has opened them. The rings are named after the client process and the nonce, and
+// each side sends the name of the event that wakes it up when its incoming ring has data.
+struct MQMessageSharedMemory
+{
+	uint32_t            nonce;         // makes the names of the rings unique to this connection
+	char                eventName[64];
+};
+
 // MSG_MAIN_PROCESS_LOADED
 struct MQMessageProcessLoadedFromMQ
 {
@@ -0,0 +1,456 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "PipeLoadTest.h"
+#include "NamedPipes.h"
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+#include <wil/resource.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace mq {
+
+#pragma pack(push)
+#pragma pack(1)
+
+// The start of the payload of every message of the test, the rest of it is filler.
+struct LoadTestHeader
+{
+	int64_t sentTime;             // steady_clock, in microseconds
+	int32_t source;               // the client that sent it
+	int32_t target;               // the client it goes to, or one of the targets below
+};
+
+#pragma pack(pop)
+
+constexpr int32_t LoadTestTarget_Hello = -1;       // tells the server which client the connection belongs to
+constexpr int32_t LoadTestTarget_Everyone = -2;
+
+constexpr int MAX_LOAD_TEST_CLIENTS = 256;
+constexpr auto LOAD_TEST_CONNECT_TIMEOUT = 10s;
+constexpr auto LOAD_TEST_SAMPLE_INTERVAL = 100ms;
+
+static int64_t GetLoadTestTime()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* GetPipeLoadPatternName(PipeLoadPattern pattern)
+{
+	switch (pattern)
+	{
+	case PipeLoadPattern::PointToPoint: return "Point to point";
+	case PipeLoadPattern::Broadcast: return "Broadcast";
+	case PipeLoadPattern::Rpc: return "RPC";
+	default: return "Unknown";
+	}
+}
+
+// Everything is handled on the thread of the test, which is the main thread of every endpoint.
+class LoadTestEvents : public NamedPipeEvents
+{
+public:
+	LoadTestEvents(std::function<void(PipeMessagePtr&&)> onMessage, HANDLE wakeEvent)
+		: m_onMessage(std::move(onMessage))
+		, m_wakeEvent(wakeEvent)
+	{
+	}
+
+	virtual void OnIncomingMessage(PipeMessagePtr&& message) override
+	{
+		m_onMessage(std::move(message));
+	}
+
+	virtual void OnRequestProcessEvents() override
+	{
+		SetEvent(m_wakeEvent);
+	}
+
+private:
+	std::function<void(PipeMessagePtr&&)> m_onMessage;
+	HANDLE m_wakeEvent;
+};
+
+// Counted on the thread of the test only, and copied into the results while it runs.
+struct LoadTestCounters
+{
+	uint64_t sent = 0;
+	uint64_t delivered = 0;
+	uint64_t failed = 0;
+	int connected = 0;
+
+	std::chrono::steady_clock::time_point firstSend;
+	std::chrono::steady_clock::time_point lastDelivery;
+
+	std::array<uint64_t, 32> histogram{};
+	uint64_t totalLatency = 0;
+	uint64_t maxLatency = 0;
+
+	size_t maxSendQueueDepth = 0;
+	size_t maxServerMainQueue = 0;
+	size_t maxClientMainQueue = 0;
+
+	void Record(const LoadTestHeader& header)
+	{
+		const auto now = std::chrono::steady_clock::now();
+		const uint64_t latency = static_cast<uint64_t>(std::max<int64_t>(0, GetLoadTestTime() - header.sentTime));
+
+		++delivered;
+		lastDelivery = now;
+		totalLatency += latency;
+		maxLatency = std::max(maxLatency, latency);
+
+		size_t bucket = 0;
+		while (bucket + 1 < histogram.size() && (1ull << bucket) <= latency)
+			++bucket;
+		++histogram[bucket];
+	}
+
+	std::chrono::microseconds GetPercentile(double percentile) const
+	{
+		if (delivered == 0)
+			return std::chrono::microseconds{ 0 };
+
+		const uint64_t rank = static_cast<uint64_t>(std::ceil(delivered * percentile));
+		uint64_t count = 0;
+		for (size_t bucket = 0; bucket < histogram.size(); ++bucket)
+		{
+			count += histogram[bucket];
+			if (count >= rank)
+				return std::chrono::microseconds{ 1ull << bucket };
+		}
+
+		return std::chrono::microseconds{ maxLatency };
+	}
+};
+
+PipeLoadTest::~PipeLoadTest()
+{
+	Cancel();
+}
+
+bool PipeLoadTest::Start(const PipeLoadTestOptions& options)
+{
+	if (m_running)
+		return false;
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	{
+		std::scoped_lock lock(m_resultsMutex);
+		m_results = PipeLoadTestResults{};
+		m_results.Running = true;
+	}
+
+	m_cancel = false;
+	m_running = true;
+	m_thread = std::thread([this, options]() { Run(options); });
+	return true;
+}
+
+void PipeLoadTest::Cancel()
+{
+	m_cancel = true;
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+PipeLoadTestResults PipeLoadTest::GetResults() const
+{
+	std::scoped_lock lock(m_resultsMutex);
+	return m_results;
+}
+
+void PipeLoadTest::Run(PipeLoadTestOptions options)
+{
+	options.Clients = std::clamp(options.Clients, 1, MAX_LOAD_TEST_CLIENTS);
+	options.PayloadSize = std::max<uint32_t>(options.PayloadSize, sizeof(LoadTestHeader));
+	options.Window = std::max<uint32_t>(options.Window, 1);
+
+	const int clientCount = options.Clients;
+	const PipeLoadPattern pattern = options.Pattern;
+	const uint64_t deliveriesPerMessage = pattern == PipeLoadPattern::Broadcast ? clientCount : 1;
+	const uint64_t expected = static_cast<uint64_t>(clientCount) * options.MessagesPerClient * deliveriesPerMessage;
+
+	SPDLOG_INFO("Starting pipe load test: {} clients, {}, {} messages of {} bytes each",
+		clientCount, GetPipeLoadPatternName(pattern), options.MessagesPerClient, options.PayloadSize);
+
+	// These outlive the endpoints, so nothing that the endpoints call back into goes away first.
+	LoadTestCounters counters;
+	std::string error;
+	bool completed = false;
+
+	struct ClientState
+	{
+		std::unique_ptr<NamedPipeClient> pipe;
+		uint32_t sent = 0;
+		uint32_t inFlight = 0;
+		bool hello = false;
+	};
+	std::vector<ClientState> clients(clientCount);
+	std::vector<int> connectionIds(clientCount, -1);     // the server's connection of each client
+
+	wil::unique_event wakeEvent(wil::EventOptions::None);
+
+	auto publish = [&](bool running)
+	{
+		const auto end = running || counters.delivered == 0 ? std::chrono::steady_clock::now() : counters.lastDelivery;
+		const auto elapsed = counters.sent > 0
+			? std::chrono::duration_cast<std::chrono::microseconds>(end - counters.firstSend)
+			: std::chrono::microseconds{ 0 };
+		const double seconds = elapsed.count() / 1000000.0;
+
+		std::scoped_lock lock(m_resultsMutex);
+		PipeLoadTestResults& results = m_results;
+		results.Running = running;
+		results.Completed = completed;
+		results.Error = error;
+		results.ConnectedClients = counters.connected;
+		results.MessagesSent = counters.sent;
+		results.MessagesDelivered = counters.delivered;
+		results.MessagesExpected = expected;
+		results.FailedRequests = counters.failed;
+		results.Elapsed = elapsed;
+		results.DeliveredPerSecond = seconds > 0 ? counters.delivered / seconds : 0;
+		results.BytesPerSecond = seconds > 0 ? counters.delivered * options.PayloadSize / seconds : 0;
+		results.LatencyHistogram = counters.histogram;
+		results.AverageLatency = std::chrono::microseconds{ counters.delivered ? counters.totalLatency / counters.delivered : 0 };
+		results.MedianLatency = counters.GetPercentile(0.5);
+		results.P99Latency = counters.GetPercentile(0.99);
+		results.MaxLatency = std::chrono::microseconds{ counters.maxLatency };
+		results.MaxSendQueueDepth = counters.maxSendQueueDepth;
+		results.MaxServerMainQueue = counters.maxServerMainQueue;
+		results.MaxClientMainQueue = counters.maxClientMainQueue;
+	};
+
+	{
+		// A pipe of our own, so nothing but the synthetic clients connects to it.
+		const std::string pipeName = fmt::format(R"(\\.\pipe\mqloadtest_{})", GetCurrentProcessId());
+		NamedPipeServer server(pipeName.c_str());
+
+		server.SetHandler(std::make_shared<LoadTestEvents>(
+			[&](PipeMessagePtr&& message)
+			{
+				if (message->size() < sizeof(LoadTestHeader))
+					return;
+
+				if (message->GetRequestMode() == MQRequestMode::CallAndResponse)
+				{
+					message->SendReply(MQMessageId::MSG_LOAD_TEST, const_cast<void*>(message->get()), message->size());
+					return;
+				}
+
+				const LoadTestHeader header = *message->get<LoadTestHeader>();
+				if (header.target == LoadTestTarget_Hello)
+				{
+					if (header.source >= 0 && header.source < clientCount && connectionIds[header.source] == -1)
+					{
+						connectionIds[header.source] = message->GetConnectionId();
+						++counters.connected;
+					}
+				}
+				else if (header.target == LoadTestTarget_Everyone)
+				{
+					server.BroadcastMessage(std::move(message));
+				}
+				else if (header.target >= 0 && header.target < clientCount && connectionIds[header.target] != -1)
+				{
+					server.SendMessage(connectionIds[header.target], std::move(message));
+				}
+			}, wakeEvent.get()));
+
+		// A message gives its sender's window back once it arrives. Broadcasts do once they come back
+		// around to the client that sent them, which is the last stop as good as any other.
+		auto release = [&](int index)
+		{
+			if (index >= 0 && index < clientCount && clients[index].inFlight > 0)
+				--clients[index].inFlight;
+		};
+
+		for (int index = 0; index < clientCount; ++index)
+		{
+			auto pipe = std::make_unique<NamedPipeClient>(pipeName.c_str());
+			pipe->SetHandler(std::make_shared<LoadTestEvents>(
+				[&, index](PipeMessagePtr&& message)
+				{
+					if (message->size() < sizeof(LoadTestHeader))
+						return;
+
+					const LoadTestHeader header = *message->get<LoadTestHeader>();
+					counters.Record(header);
+
+					if (pattern != PipeLoadPattern::Broadcast || header.source == index)
+						release(header.source);
+				}, wakeEvent.get()));
+			pipe->EnableSharedMemory(options.SharedMemory);
+
+			clients[index].pipe = std::move(pipe);
+		}
+
+		server.Start();
+		for (ClientState& client : clients)
+			client.pipe->Start();
+
+		std::vector<uint8_t> payload(options.PayloadSize, 0xcd);
+		auto* header = reinterpret_cast<LoadTestHeader*>(payload.data());
+
+		std::mt19937 random{ std::random_device{}() };
+		std::uniform_int_distribution<int> otherClient(1, std::max(1, clientCount - 1));
+
+		auto send = [&](int index)
+		{
+			ClientState& client = clients[index];
+
+			header->sentTime = GetLoadTestTime();
+			header->source = index;
+
+			switch (pattern)
+			{
+			case PipeLoadPattern::PointToPoint:
+				header->target = clientCount > 1 ? (index + otherClient(random)) % clientCount : index;
+				client.pipe->SendMessage(MQMessageId::MSG_LOAD_TEST, payload.data(), payload.size());
+				break;
+
+			case PipeLoadPattern::Broadcast:
+				header->target = LoadTestTarget_Everyone;
+				client.pipe->SendMessage(MQMessageId::MSG_LOAD_TEST, payload.data(), payload.size());
+				break;
+
+			case PipeLoadPattern::Rpc:
+				header->target = index;
+				client.pipe->SendMessageWithResponse(MQMessageId::MSG_LOAD_TEST, payload.data(), payload.size(),
+					[&, index](int status, PipeMessagePtr&& reply)
+					{
+						if (status < 0 || !reply || reply->size() < sizeof(LoadTestHeader))
+							++counters.failed;
+						else
+							counters.Record(*reply->get<LoadTestHeader>());
+
+						release(index);
+					});
+				break;
+			}
+
+			++client.sent;
+			++client.inFlight;
+			++counters.sent;
+		};
+
+		const auto start = std::chrono::steady_clock::now();
+		const auto deadline = start + LOAD_TEST_CONNECT_TIMEOUT + options.Timeout;
+		auto nextSample = start;
+
+		while (!m_cancel)
+		{
+			server.Process();
+			for (ClientState& client : clients)
+				client.pipe->Process();
+
+			const auto now = std::chrono::steady_clock::now();
+
+			if (counters.connected < clientCount)
+			{
+				for (int index = 0; index < clientCount; ++index)
+				{
+					ClientState& client = clients[index];
+					if (!client.hello && client.pipe->IsConnected())
+					{
+						LoadTestHeader hello{ GetLoadTestTime(), index, LoadTestTarget_Hello };
+						client.pipe->SendMessage(MQMessageId::MSG_LOAD_TEST, &hello, sizeof(hello));
+						client.hello = true;
+					}
+				}
+
+				if (now - start > LOAD_TEST_CONNECT_TIMEOUT)
+				{
+					error = fmt::format("Only {} of {} clients connected", counters.connected, clientCount);
+					break;
+				}
+			}
+			else
+			{
+				if (counters.sent == 0)
+					counters.firstSend = now;
+
+				for (int index = 0; index < clientCount; ++index)
+				{
+					ClientState& client = clients[index];
+					while (client.sent < options.MessagesPerClient && client.inFlight < options.Window)
+						send(index);
+				}
+
+				if (counters.delivered + counters.failed * deliveriesPerMessage >= expected)
+				{
+					completed = counters.failed == 0;
+					break;
+				}
+			}
+
+			if (now > deadline)
+			{
+				error = fmt::format("Timed out with {} of {} messages delivered", counters.delivered, expected);
+				break;
+			}
+
+			if (now >= nextSample)
+			{
+				for (const PipeConnectionStats& stats : server.GetConnectionStats())
+					counters.maxSendQueueDepth = std::max({ counters.maxSendQueueDepth, stats.SendQueueDepth, stats.MaxSendQueueDepth });
+
+				counters.maxServerMainQueue = std::max(counters.maxServerMainQueue, server.GetMainThreadQueueSize());
+				for (ClientState& client : clients)
+					counters.maxClientMainQueue = std::max(counters.maxClientMainQueue, client.pipe->GetMainThreadQueueSize());
+
+				publish(true);
+				nextSample = now + LOAD_TEST_SAMPLE_INTERVAL;
+			}
+
+			WaitForSingleObject(wakeEvent.get(), 1);
+		}
+
+		if (m_cancel && error.empty() && !completed)
+			error = "Cancelled";
+
+		// Clients first, so the server doesn't see them go one by one while it is still routing.
+		for (ClientState& client : clients)
+			client.pipe->Stop();
+		server.Stop();
+
+		// Their handlers refer to this scope.
+		clients.clear();
+	}
+
+	publish(false);
+	m_running = false;
+
+	const PipeLoadTestResults results = GetResults();
+	SPDLOG_INFO("Pipe load test finished{}: {} of {} delivered in {}ms, {:.0f}/s, latency p50 {}us p99 {}us max {}us",
+		error.empty() ? "" : fmt::format(" ({})", error), results.MessagesDelivered, results.MessagesExpected,
+		results.Elapsed.count() / 1000, results.DeliveredPerSecond, results.MedianLatency.count(),
+		results.P99Latency.count(), results.MaxLatency.count());
+}
+
+} // namespace mq
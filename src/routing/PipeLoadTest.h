@@ -0,0 +1,113 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace mq {
+
+//============================================================================
+// Load test of the named pipe layer. Starts a server on a pipe of its own and connects synthetic
+// clients to it, all in this process, then has the clients exchange messages as fast as their
+// windows allow. Nothing else is connected to the pipe, so it can run next to the real server.
+
+enum class PipeLoadPattern
+{
+	PointToPoint,       // each message goes through the server to one other client
+	Broadcast,          // each message goes through the server to every client
+	Rpc,                // each message is a request that the server replies to
+};
+
+const char* GetPipeLoadPatternName(PipeLoadPattern pattern);
+
+struct PipeLoadTestOptions
+{
+	int Clients = 50;
+	PipeLoadPattern Pattern = PipeLoadPattern::PointToPoint;
+	uint32_t MessagesPerClient = 1000;
+	uint32_t PayloadSize = 256;
+	uint32_t Window = 16;                 // messages each client may have in flight
+	bool SharedMemory = false;            // clients offer shared memory rings, like the game does
+	std::chrono::seconds Timeout{ 60 };
+};
+
+struct PipeLoadTestResults
+{
+	bool Running = false;
+	bool Completed = false;               // every message was delivered before the timeout
+	std::string Error;
+
+	int ConnectedClients = 0;
+	uint64_t MessagesSent = 0;
+	uint64_t MessagesDelivered = 0;       // broadcasts count once for every client that received them
+	uint64_t MessagesExpected = 0;
+	uint64_t FailedRequests = 0;          // replies with an error, including timeouts
+
+	// From the first message being sent, to the last one arriving (or now, while running)
+	std::chrono::microseconds Elapsed{ 0 };
+	double DeliveredPerSecond = 0;
+	double BytesPerSecond = 0;
+
+	// From a message being sent by a client, to it arriving at a client. Percentiles are upper
+	// bounds, from a histogram with a bucket for each power of two microseconds.
+	std::array<uint64_t, 32> LatencyHistogram{};  // bucket n is under 2^n microseconds
+	std::chrono::microseconds AverageLatency{ 0 };
+	std::chrono::microseconds MedianLatency{ 0 };
+	std::chrono::microseconds P99Latency{ 0 };
+	std::chrono::microseconds MaxLatency{ 0 };
+
+	// The deepest that the queues got, sampled while the test runs
+	size_t MaxSendQueueDepth = 0;         // of any connection of the server
+	size_t MaxServerMainQueue = 0;        // callbacks waiting for the server's main thread
+	size_t MaxClientMainQueue = 0;        // callbacks waiting for a client's main thread
+};
+
+class PipeLoadTest
+{
+public:
+	PipeLoadTest() = default;
+	~PipeLoadTest();
+
+	PipeLoadTest(const PipeLoadTest&) = delete;
+	PipeLoadTest& operator=(const PipeLoadTest&) = delete;
+
+	// Runs the test on a thread of its own. Returns false if a test is already running.
+	bool Start(const PipeLoadTestOptions& options);
+
+	// Stops a running test. It reports what was delivered until then.
+	void Cancel();
+
+	bool IsRunning() const { return m_running; }
+
+	// The results so far, safe to call from any thread.
+	PipeLoadTestResults GetResults() const;
+
+private:
+	void Run(PipeLoadTestOptions options);
+
+	std::thread m_thread;
+	std::atomic_bool m_running{ false };
+	std::atomic_bool m_cancel{ false };
+
+	mutable std::mutex m_resultsMutex;
+	PipeLoadTestResults m_results;
+};
+
+} // namespace mq
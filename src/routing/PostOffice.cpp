@@ -17,47 +17,86 @@
 
 namespace mq::postoffice {
 
+// What a bulk mailbox may process per turn, in bytes. Every message costs a little on top of
+// its size, so empty messages aren't free.
+constexpr size_t BULK_QUANTUM = 4096;
+constexpr size_t MESSAGE_COST = 64;
+
 void Mailbox::Deliver(PipeMessagePtr&& message) const
 {
 	// Don't do anything if this isn't wrapped in an envelope
 	if (message->GetMessageId() == MQMessageId::MSG_ROUTE)
 	{
-		m_receiveQueue.push(Open(ProtoMessage::Parse<proto::routing::Envelope>(message), message));
+		auto envelope = ProtoMessage::Parse<proto::routing::Envelope>(message);
+		Deliver(*message, envelope, TakePayload(envelope));
 	}
 }
 
-void Mailbox::Process(size_t howMany) const
+void Mailbox::Deliver(const PipeMessage& message, const proto::routing::Envelope& envelope,
+	const std::shared_ptr<const std::string>& payload) const
 {
-	if (howMany > 0 && !m_receiveQueue.empty())
-	{
-		m_receive(std::move(m_receiveQueue.front()));
-		m_receiveQueue.pop();
+	// this resets the m_replied member, but it couldn't have become true before this anyway
+	ProtoMessagePtr unwrapped = payload
+		? std::make_unique<ProtoMessage>(message, payload, payload->data(), payload->size())
+		: std::make_unique<ProtoMessage>(message, nullptr, 0);
 
-		Process(howMany - 1);
-	}
+	if (envelope.has_return_address())
+		unwrapped->SetSender(envelope.return_address());
+
+	m_delivered.Add(unwrapped->size());
+	m_receiveQueue.push(std::move(unwrapped));
+	m_maxQueueDepth = std::max(m_maxQueueDepth, m_receiveQueue.size());
 }
 
-ProtoMessagePtr Mailbox::Open(proto::routing::Envelope&& envelope, const PipeMessagePtr& message)
+std::shared_ptr<const std::string> Mailbox::TakePayload(proto::routing::Envelope& envelope)
 {
-	ProtoMessagePtr unwrapped;
+	if (!envelope.has_payload())
+		return nullptr;
+
+	return std::make_shared<const std::string>(std::move(*envelope.mutable_payload()));
+}
 
-	const void* data = nullptr;
-	size_t length = 0;
-	if (envelope.has_payload())
+void Mailbox::Process(size_t howMany) const
+{
+	while (howMany-- > 0 && ProcessOne())
 	{
-		data = &envelope.payload()[0];
-		length = envelope.payload().size();
 	}
+}
 
-	if (message != nullptr) // this resets the m_replied member, but it couldn't have become true before this anyway
-		unwrapped = std::make_unique<ProtoMessage>(*message, data, length);
-	else
-		unwrapped = std::make_unique<ProtoMessage>(MQMessageId::MSG_NULL, data, length);
+bool Mailbox::ProcessOne() const
+{
+	if (m_receiveQueue.empty())
+		return false;
 
-	if (envelope.has_return_address())
-		unwrapped->SetSender(envelope.return_address());
+	ProtoMessagePtr message = std::move(m_receiveQueue.front());
+	m_receiveQueue.pop();
+	++m_processed;
+
+	// the callback can remove this mailbox, don't touch it after
+	m_receive(std::move(message));
+	return true;
+}
+
+size_t Mailbox::GetNextCost() const
+{
+	if (m_receiveQueue.empty())
+		return 0;
+
+	return m_receiveQueue.front()->size() + MESSAGE_COST;
+}
 
-	return unwrapped;
+MailboxStats Mailbox::GetStats() const
+{
+	MailboxStats stats;
+	stats.Address = m_localAddress;
+	stats.MessagesDelivered = m_delivered.GetMessages();
+	stats.BytesDelivered = m_delivered.GetBytes();
+	stats.MessageRate = m_delivered.GetMessageRate();
+	stats.ByteRate = m_delivered.GetByteRate();
+	stats.MessagesProcessed = m_processed;
+	stats.QueueDepth = m_receiveQueue.size();
+	stats.MaxQueueDepth = m_maxQueueDepth;
+	return stats;
 }
 
 Dropbox::Dropbox(std::string localAddress, PostCallback&& post, DropboxDropper&& unregister)
@@ -108,11 +147,13 @@ void PostOffice::RouteMessage(const std::string& data, const PipeMessageResponse
 	RouteMessage(&data[0], data.size(), callback);
 }
 
-Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive)
+Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive, MailboxPriority priority)
 {
-	auto [mailbox, added] = m_mailboxes.emplace(localAddress, std::make_unique<Mailbox>(localAddress, std::move(receive)));
+	auto [mailbox, added] = m_mailboxes.emplace(localAddress, std::make_unique<Mailbox>(localAddress, std::move(receive), priority));
 	if (added)
 	{
+		++m_mailboxGeneration;
+
 		return Dropbox(
 			localAddress,
 			[this](const std::string& data, const PipeMessageResponseCb& callback) { RouteMessage(data, callback); },
@@ -124,7 +165,82 @@ Dropbox PostOffice::RegisterAddress(const std::string& localAddress, ReceiveCall
 
 bool PostOffice::RemoveMailbox(const std::string& localAddress)
 {
-	return m_mailboxes.erase(localAddress) == 1;
+	if (m_mailboxes.erase(localAddress) == 1)
+	{
+		++m_mailboxGeneration;
+
+		bool topicsChanged = false;
+		for (auto iter = m_subscriptions.begin(); iter != m_subscriptions.end();)
+		{
+			std::vector<std::string>& subscribers = iter->second;
+			subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), localAddress), subscribers.end());
+
+			if (subscribers.empty())
+			{
+				iter = m_subscriptions.erase(iter);
+				topicsChanged = true;
+			}
+			else
+			{
+				++iter;
+			}
+		}
+
+		if (topicsChanged)
+			OnSubscriptionsChanged();
+
+		return true;
+	}
+
+	return false;
+}
+
+bool PostOffice::Subscribe(const std::string& localAddress, const std::string& topic)
+{
+	if (topic.empty() || m_mailboxes.find(localAddress) == m_mailboxes.end())
+		return false;
+
+	std::vector<std::string>& subscribers = m_subscriptions[topic];
+	if (std::find(subscribers.begin(), subscribers.end(), localAddress) != subscribers.end())
+		return false;
+
+	subscribers.push_back(localAddress);
+	if (subscribers.size() == 1)
+		OnSubscriptionsChanged();
+
+	return true;
+}
+
+bool PostOffice::Unsubscribe(const std::string& localAddress, const std::string& topic)
+{
+	auto iter = m_subscriptions.find(topic);
+	if (iter == m_subscriptions.end())
+		return false;
+
+	std::vector<std::string>& subscribers = iter->second;
+	auto subscriber = std::find(subscribers.begin(), subscribers.end(), localAddress);
+	if (subscriber == subscribers.end())
+		return false;
+
+	subscribers.erase(subscriber);
+	if (subscribers.empty())
+	{
+		m_subscriptions.erase(iter);
+		OnSubscriptionsChanged();
+	}
+
+	return true;
+}
+
+std::vector<std::string> PostOffice::GetTopics() const
+{
+	std::vector<std::string> topics;
+	topics.reserve(m_subscriptions.size());
+
+	for (const auto& [topic, _] : m_subscriptions)
+		topics.push_back(topic);
+
+	return topics;
 }
 
 bool PostOffice::DeliverTo(const std::string& localAddress, PipeMessagePtr&& message, const std::function<void(int, PipeMessagePtr&&)>& failed)
@@ -143,24 +259,154 @@ bool PostOffice::DeliverTo(const std::string& localAddress, PipeMessagePtr&& mes
 
 void PostOffice::DeliverAll(PipeMessagePtr& message, std::optional<std::string_view> fromAddress)
 {
+	if (message->GetMessageId() != MQMessageId::MSG_ROUTE)
+		return;
+
+	// Open the envelope once, every mailbox gets the same payload. The copies don't get the
+	// connection, so a broadcast can't be answered once per mailbox.
+	auto envelope = ProtoMessage::Parse<proto::routing::Envelope>(message);
+	const auto payload = Mailbox::TakePayload(envelope);
+	const PipeMessage header(*message->GetHeader(), nullptr, 0);
+
 	for (const auto& [name, mailbox] : m_mailboxes)
 	{
 		if (fromAddress && name != *fromAddress)
 		{
 			OnDeliver(name, message);
-			mailbox->Deliver(
-				std::make_unique<PipeMessage>(*message->GetHeader(), message->get(), message->size())
-			);
+			mailbox->Deliver(header, envelope, payload);
+		}
+	}
+}
+
+bool PostOffice::DeliverToTopic(PipeMessagePtr& message, proto::routing::Envelope& envelope)
+{
+	auto iter = m_subscriptions.find(envelope.address().topic());
+	if (iter == m_subscriptions.end())
+		return false;
+
+	// same as DeliverAll, the subscribers share the payload and can't answer the copies
+	const auto payload = Mailbox::TakePayload(envelope);
+	const PipeMessage header(*message->GetHeader(), nullptr, 0);
+
+	for (const std::string& localAddress : iter->second)
+	{
+		auto mailbox = m_mailboxes.find(localAddress);
+		if (mailbox != m_mailboxes.end())
+		{
+			OnDeliver(localAddress, message);
+			mailbox->second->Deliver(header, envelope, payload);
 		}
 	}
+
+	return true;
 }
 
-void PostOffice::Process(size_t howMany)
+std::vector<MailboxStats> PostOffice::GetMailboxStats() const
 {
-	size_t messages_per_mailbox = std::max(1, (int)std::round(howMany / m_mailboxes.size()));
+	std::vector<MailboxStats> stats;
+	stats.reserve(m_mailboxes.size());
+
 	for (const auto& [_, mailbox] : m_mailboxes)
 	{
-		mailbox->Process(messages_per_mailbox);
+		stats.push_back(mailbox->GetStats());
+	}
+
+	std::sort(stats.begin(), stats.end(),
+		[](const MailboxStats& a, const MailboxStats& b) { return a.Address < b.Address; });
+
+	return stats;
+}
+
+void PostOffice::Process(size_t howMany, std::chrono::microseconds budget)
+{
+	const auto start = std::chrono::steady_clock::now();
+	size_t processed = 0;
+
+	auto done = [&]
+		{
+			return processed >= howMany
+				|| (budget.count() > 0 && std::chrono::steady_clock::now() - start >= budget);
+		};
+
+	// A callback can add or remove mailboxes, start over with the current ones when it does.
+	uint64_t generation = 0;
+	bool restart = true;
+
+	while (restart && !done())
+	{
+		restart = false;
+		generation = m_mailboxGeneration;
+
+		// The control lane goes first, and is emptied before anything else is processed
+		for (const auto& [_, mailbox] : m_mailboxes)
+		{
+			if (mailbox->GetPriority() != MailboxPriority::Control)
+				continue;
+
+			while (!done() && mailbox->ProcessOne())
+			{
+				++processed;
+				if (generation != m_mailboxGeneration)
+					break;
+			}
+
+			if (generation != m_mailboxGeneration)
+			{
+				restart = true;
+				break;
+			}
+		}
+
+		if (restart)
+			continue;
+
+		m_bulkMailboxes.clear();
+		for (const auto& [_, mailbox] : m_mailboxes)
+		{
+			if (mailbox->GetPriority() == MailboxPriority::Bulk)
+				m_bulkMailboxes.push_back(mailbox.get());
+		}
+
+		const size_t count = m_bulkMailboxes.size();
+		bool pending = count > 0;
+
+		while (pending && !restart && !done())
+		{
+			pending = false;
+
+			for (size_t turn = 0; turn < count && !restart && !done(); ++turn)
+			{
+				const size_t index = m_nextBulkMailbox++ % count;
+				const Mailbox* mailbox = m_bulkMailboxes[index];
+
+				size_t cost = mailbox->GetNextCost();
+				if (cost == 0)
+				{
+					// an empty mailbox doesn't get to save up its share
+					mailbox->m_deficit = 0;
+					continue;
+				}
+
+				mailbox->m_deficit += BULK_QUANTUM;
+				while (cost != 0 && cost <= mailbox->m_deficit && !done())
+				{
+					mailbox->m_deficit -= cost;
+					mailbox->ProcessOne();
+					++processed;
+
+					if (generation != m_mailboxGeneration)
+					{
+						restart = true;
+						break;
+					}
+
+					cost = mailbox->GetNextCost();
+				}
+
+				if (!restart && cost != 0)
+					pending = true;
+			}
+		}
 	}
 }
 
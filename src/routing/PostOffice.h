@@ -16,9 +16,11 @@
 
 #include "Routing.h"
 
+#include <chrono>
 #include <string>
 #include <unordered_map>
 #include <queue>
+#include <vector>
 #include <memory>
 
 namespace mq::postoffice {
@@ -27,12 +29,35 @@ using ReceiveCallback = std::function<void(ProtoMessagePtr&&)>;
 using PostCallback = std::function<void(const std::string&, const PipeMessageResponseCb&)>;
 using DropboxDropper = std::function<void(const std::string&)>;
 
+/**
+ * Control mailboxes are processed before any bulk mailbox, bulk mailboxes share
+ * what is left of a pulse fairly
+ */
+enum class MailboxPriority
+{
+	Control,
+	Bulk,
+};
+
+struct MailboxStats
+{
+	std::string Address;
+	uint64_t MessagesDelivered = 0;
+	uint64_t BytesDelivered = 0;     // payload bytes
+	float MessageRate = 0;
+	float ByteRate = 0;
+	uint64_t MessagesProcessed = 0;
+	size_t QueueDepth = 0;
+	size_t MaxQueueDepth = 0;
+};
+
 class Mailbox
 {
 public:
-	Mailbox(std::string localAddress, ReceiveCallback&& receive)
+	Mailbox(std::string localAddress, ReceiveCallback&& receive, MailboxPriority priority = MailboxPriority::Bulk)
 		: m_localAddress(localAddress)
 		, m_receive(std::move(receive))
+		, m_priority(priority)
 	{}
 
 	~Mailbox() {}
@@ -44,6 +69,13 @@ public:
 	 */
 	const std::string& GetAddress() const { return m_localAddress; }
 
+	/**
+	 * Gets the lane that this mailbox is processed in
+	 *
+	 * @return the priority of this mailbox
+	 */
+	MailboxPriority GetPriority() const { return m_priority; }
+
 	/**
 	 * Delivers a message to this mailbox to be handled by the receive callback
 	 *
@@ -51,6 +83,26 @@ public:
 	 */
 	void Deliver(PipeMessagePtr&& message) const;
 
+	/**
+	 * Delivers a message that has already been taken out of its envelope. The payload is shared
+	 * with the other mailboxes it is delivered to instead of being copied for each of them
+	 *
+	 * @param message the message the envelope came in, for its header and connection
+	 * @param envelope the envelope, for the return address
+	 * @param payload the payload of the envelope, see TakePayload
+	 */
+	void Deliver(const PipeMessage& message, const proto::routing::Envelope& envelope,
+		const std::shared_ptr<const std::string>& payload) const;
+
+	/**
+	 * Moves the payload out of an envelope so mailboxes can share it
+	 *
+	 * @param envelope the envelope to empty
+	 *
+	 * @return the payload, or nullptr if the envelope didn't have one
+	 */
+	static std::shared_ptr<const std::string> TakePayload(proto::routing::Envelope& envelope);
+
 	/**
 	 * Process some messages that have been delivered
 	 *
@@ -58,13 +110,40 @@ public:
 	 */
 	void Process(size_t howMany) const;
 
+	/**
+	 * Processes the oldest message that has been delivered, if there is one
+	 *
+	 * @return true if a message was processed
+	 */
+	bool ProcessOne() const;
+
+	/**
+	 * Gets what processing the oldest message costs against the fair share of this mailbox
+	 *
+	 * @return the cost of the next message, or 0 if there isn't one
+	 */
+	size_t GetNextCost() const;
+
+	/**
+	 * Gets the traffic through this mailbox and how many messages are waiting to be processed
+	 *
+	 * @return the stats of this mailbox
+	 */
+	MailboxStats GetStats() const;
+
 private:
-	static ProtoMessagePtr Open(proto::routing::Envelope&& envelope, const PipeMessagePtr& header);
+
+	friend class PostOffice;
 
 	const std::string m_localAddress;
 	const ReceiveCallback m_receive;
+	const MailboxPriority m_priority;
+	mutable size_t m_deficit = 0;          // used by the bulk scheduler of the post office
 
 	mutable std::queue<ProtoMessagePtr> m_receiveQueue;
+	mutable TrafficCounter m_delivered;
+	mutable uint64_t m_processed = 0;
+	mutable size_t m_maxQueueDepth = 0;
 };
 
 class Dropbox
@@ -163,6 +242,13 @@ public:
 	 */
 	bool IsValid() { return m_valid; }
 
+	/**
+	 * Gets the local address of the mailbox that this dropbox sends from
+	 *
+	 * @return the local address
+	 */
+	const std::string& GetAddress() const { return m_localAddress; }
+
 	/**
 	 * Removes the mailbox with the same name from the post office
 	 */
@@ -299,9 +385,11 @@ public:
 	 *
 	 * @param localAddress the string address to create the address at
 	 * @param receive a callback rvalue that will process messages as they are received in this mailbox
+	 * @param priority the lane the mailbox is processed in, control mailboxes should only get infrequent messages
 	 * @return an dropbox that the creator can use to send addressed messages. will be invalid if it failed to add
 	 */
-	Dropbox RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive);
+	Dropbox RegisterAddress(const std::string& localAddress, ReceiveCallback&& receive,
+		MailboxPriority priority = MailboxPriority::Bulk);
 
 	/**
 	 * Removes a mailbox from the post office
@@ -338,14 +426,73 @@ public:
 	void DeliverAll(PipeMessagePtr& message, std::optional<std::string_view> fromAddress = {});
 
 	/**
-	 * Processes messages waiting in the queue
+	 * Subscribes a local mailbox to a topic, so that messages addressed to the topic are delivered to it
+	 *
+	 * @param localAddress the local address of the mailbox
+	 * @param topic the topic to subscribe to
+	 * @return true if the mailbox exists and wasn't subscribed already
+	 */
+	bool Subscribe(const std::string& localAddress, const std::string& topic);
+
+	/**
+	 * Unsubscribes a local mailbox from a topic. Removing a mailbox removes all of its subscriptions
+	 *
+	 * @param localAddress the local address of the mailbox
+	 * @param topic the topic to unsubscribe from
+	 * @return true if the mailbox was subscribed
+	 */
+	bool Unsubscribe(const std::string& localAddress, const std::string& topic);
+
+	/**
+	 * Gets every topic that at least one local mailbox subscribes to
+	 *
+	 * @return the topics of this post office
+	 */
+	std::vector<std::string> GetTopics() const;
+
+	/**
+	 * Callback for when a topic gets its first subscriber or loses its last one
+	 */
+	virtual void OnSubscriptionsChanged() {}
+
+	/**
+	 * Delivers a message to every local mailbox that subscribes to the topic it is addressed to. Every
+	 * mailbox shares the payload, which is taken out of the envelope.
+	 *
+	 * @param message the message to send
+	 * @param envelope the envelope of the message, already opened by the caller
+	 * @return true if the topic had any subscribers
+	 */
+	bool DeliverToTopic(PipeMessagePtr& message, proto::routing::Envelope& envelope);
+
+	/**
+	 * Processes messages waiting in the queue. Control mailboxes are emptied first, then the bulk
+	 * mailboxes take turns with deficit round robin, so each gets the same share of bytes no matter
+	 * how chatty the others are. The next call picks up the turns where this one stopped.
 	 *
 	 * @param howMany how many messages to process (up to)
+	 * @param budget how long to spend processing (up to), zero for no limit
+	 */
+	void Process(size_t howMany, std::chrono::microseconds budget = std::chrono::microseconds::zero());
+
+	/**
+	 * Gets the stats of every mailbox, must be called from the thread that delivers and processes messages
+	 *
+	 * @return the stats of each mailbox
 	 */
-	void Process(size_t howMany);
+	std::vector<MailboxStats> GetMailboxStats() const;
 
 protected:
 	std::unordered_map<std::string, std::unique_ptr<Mailbox>> m_mailboxes;
+
+private:
+	// changes when a mailbox is added or removed, so processing knows its list is out of date
+	uint64_t m_mailboxGeneration = 0;
+	std::vector<const Mailbox*> m_bulkMailboxes;
+	size_t m_nextBulkMailbox = 0;
+
+	// the local addresses subscribed to each topic
+	std::unordered_map<std::string, std::vector<std::string>> m_subscriptions;
 };
 
 /**
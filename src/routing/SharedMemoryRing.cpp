@@ -0,0 +1,193 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "SharedMemoryRing.h"
+
+#include <fmt/os.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace mq {
+
+constexpr uint32_t RING_MAGIC = 0x474e4952;        // "RING"
+
+// The positions are on their own cache lines so the two processes don't fight over them.
+struct SharedMemoryRing::Header
+{
+	uint32_t magic;
+	uint32_t capacity;
+	alignas(64) std::atomic<uint64_t> writePosition;
+	alignas(64) std::atomic<uint64_t> readPosition;
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) && std::atomic<uint64_t>::is_always_lock_free,
+	"the ring positions must be usable across processes");
+
+static constexpr size_t GetRecordSize(size_t length)
+{
+	// a record is the length followed by the message, padded to keep the lengths aligned
+	return sizeof(uint32_t) + ((length + 3) & ~static_cast<size_t>(3));
+}
+
+SharedMemoryRing::SharedMemoryRing(wil::unique_handle hMapping, void* view, uint32_t capacity)
+	: m_hMapping(std::move(hMapping))
+	, m_view(view)
+	, m_header(static_cast<Header*>(view))
+	, m_data(static_cast<uint8_t*>(view) + sizeof(Header))
+	, m_capacity(capacity)
+{
+}
+
+SharedMemoryRing::~SharedMemoryRing()
+{
+	if (m_view)
+		::UnmapViewOfFile(m_view);
+}
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::Create(const std::string& name, uint32_t capacity)
+{
+	capacity = (capacity + 3) & ~3u;
+	const DWORD size = static_cast<DWORD>(sizeof(Header) + capacity);
+
+	wil::unique_handle hMapping(::CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, size, name.c_str()));
+	if (!hMapping)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to create shared memory ring").what(), name);
+		return nullptr;
+	}
+
+	void* view = ::MapViewOfFile(hMapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!view)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to map shared memory ring").what(), name);
+		return nullptr;
+	}
+
+	// The magic goes in last, so a reader that opens the ring early doesn't see it half initialized.
+	Header* header = new (view) Header;
+	header->capacity = capacity;
+	header->writePosition = 0;
+	header->readPosition = 0;
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = RING_MAGIC;
+
+	return std::unique_ptr<SharedMemoryRing>(new SharedMemoryRing(std::move(hMapping), view, capacity));
+}
+
+std::unique_ptr<SharedMemoryRing> SharedMemoryRing::Open(const std::string& name)
+{
+	wil::unique_handle hMapping(::OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str()));
+	if (!hMapping)
+	{
+		SPDLOG_WARN("{} name={}", fmt::windows_error(GetLastError(), "Failed to open shared memory ring").what(), name);
+		return nullptr;
+	}
+
+	void* view = ::MapViewOfFile(hMapping.get(), FILE_MAP_ALL_ACCESS, 0, 0, 0);
+	if (!view)
+	{
+		SPDLOG_ERROR("{} name={}", fmt::windows_error(GetLastError(), "Failed to map shared memory ring").what(), name);
+		return nullptr;
+	}
+
+	// Don't trust the header further than the size of the mapping
+	MEMORY_BASIC_INFORMATION mbi;
+	const Header* header = static_cast<const Header*>(view);
+	if (::VirtualQuery(view, &mbi, sizeof(mbi)) == 0
+		|| mbi.RegionSize < sizeof(Header)
+		|| header->magic != RING_MAGIC
+		|| header->capacity == 0
+		|| mbi.RegionSize < sizeof(Header) + header->capacity)
+	{
+		SPDLOG_ERROR("Shared memory ring is not valid: name={}", name);
+		::UnmapViewOfFile(view);
+		return nullptr;
+	}
+
+	return std::unique_ptr<SharedMemoryRing>(new SharedMemoryRing(std::move(hMapping), view, header->capacity));
+}
+
+void SharedMemoryRing::Copy(uint64_t position, const void* data, size_t length)
+{
+	const size_t offset = static_cast<size_t>(position % m_capacity);
+	const size_t first = std::min<size_t>(length, m_capacity - offset);
+
+	memcpy(m_data + offset, data, first);
+	memcpy(m_data, static_cast<const uint8_t*>(data) + first, length - first);
+}
+
+void SharedMemoryRing::CopyOut(uint64_t position, void* data, size_t length) const
+{
+	const size_t offset = static_cast<size_t>(position % m_capacity);
+	const size_t first = std::min<size_t>(length, m_capacity - offset);
+
+	memcpy(data, m_data + offset, first);
+	memcpy(static_cast<uint8_t*>(data) + first, m_data, length - first);
+}
+
+bool SharedMemoryRing::Write(const void* data, size_t length, bool& wasEmpty)
+{
+	const size_t recordSize = GetRecordSize(length);
+	const uint64_t write = m_header->writePosition.load(std::memory_order_relaxed);
+	const uint64_t read = m_header->readPosition.load();
+
+	if (length > GetMaxMessageSize() || recordSize > m_capacity - (write - read))
+		return false;
+
+	const uint32_t length32 = static_cast<uint32_t>(length);
+	Copy(write, &length32, sizeof(length32));
+	Copy(write + sizeof(length32), data, length);
+
+	m_header->writePosition.store(write + recordSize);
+
+	// This load has to come after the store above. A reader that found the ring empty stored its
+	// position before it looked at ours, so either it sees this record or we see that it caught up.
+	wasEmpty = m_header->readPosition.load() == write;
+	return true;
+}
+
+bool SharedMemoryRing::Read(std::unique_ptr<uint8_t[]>& buffer, size_t& length)
+{
+	const uint64_t read = m_header->readPosition.load(std::memory_order_relaxed);
+	const uint64_t write = m_header->writePosition.load();
+
+	if (read == write)
+		return false;
+
+	uint32_t length32 = 0;
+	CopyOut(read, &length32, sizeof(length32));
+
+	if (length32 > GetMaxMessageSize() || GetRecordSize(length32) > write - read)
+	{
+		// The other process wrote something that isn't a record, drop everything that is in the ring
+		SPDLOG_ERROR("Shared memory ring is corrupt, dropping {} bytes", write - read);
+		m_header->readPosition.store(write);
+		return false;
+	}
+
+	buffer = std::make_unique<uint8_t[]>(length32);
+	CopyOut(read + sizeof(length32), buffer.get(), length32);
+	length = length32;
+
+	m_header->readPosition.store(read + GetRecordSize(length32));
+	return true;
+}
+
+bool SharedMemoryRing::IsEmpty() const
+{
+	return m_header->readPosition.load() == m_header->writePosition.load();
+}
+
+} // namespace mq
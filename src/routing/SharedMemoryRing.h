@@ -0,0 +1,73 @@
+/*
+ * MacroQuest: The extension platform for EverQuest
+ * Copyright (C) 2002-present MacroQuest Authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#pragma once
+
+#include <wil/resource.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <windows.h>
+
+namespace mq {
+
+//============================================================================
+// A single producer, single consumer ring of messages in shared memory. One process
+// writes and the other reads, and each record is a length followed by the bytes of
+// a message. The positions only ever grow, so the ring is empty when they're equal.
+
+class SharedMemoryRing
+{
+	struct Header;
+
+public:
+	~SharedMemoryRing();
+
+	// Creates a new ring, replacing the contents of one with the same name.
+	static std::unique_ptr<SharedMemoryRing> Create(const std::string& name, uint32_t capacity);
+
+	// Opens a ring that the other process created.
+	static std::unique_ptr<SharedMemoryRing> Open(const std::string& name);
+
+	// Appends a message. Returns false if there isn't room for it, in which case nothing was
+	// written. wasEmpty is set if the reader had consumed everything before this write, and
+	// is the only case where the reader might be waiting to be woken up.
+	bool Write(const void* data, size_t length, bool& wasEmpty);
+
+	// Removes the oldest message. Returns false if the ring is empty.
+	bool Read(std::unique_ptr<uint8_t[]>& buffer, size_t& length);
+
+	bool IsEmpty() const;
+	uint32_t GetCapacity() const { return m_capacity; }
+
+	// The largest message that is sent over the ring. Anything bigger takes the pipe, so one
+	// message can't fill the ring on its own.
+	size_t GetMaxMessageSize() const { return m_capacity / 4; }
+
+private:
+	SharedMemoryRing(wil::unique_handle hMapping, void* view, uint32_t capacity);
+
+	void Copy(uint64_t position, const void* data, size_t length);
+	void CopyOut(uint64_t position, void* data, size_t length) const;
+
+	wil::unique_handle m_hMapping;
+	void* m_view = nullptr;
+	Header* m_header = nullptr;
+	uint8_t* m_data = nullptr;
+	uint32_t m_capacity = 0;
+};
+
+} // namespace mq
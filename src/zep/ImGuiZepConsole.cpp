@@ -32,6 +32,8 @@
 #include <imgui.h>
 #include <imgui_internal.h>
 
+#include <algorithm>
+
 using namespace Zep;
 
 namespace mq {
@@ -378,6 +380,8 @@ void ImGuiZepConsole::SetDelegate(std::shared_ptr<ImGuiZepConsoleDelegate> deleg
 
 void ImGuiZepConsole::Render(const char* id, const ImVec2& displaySize)
 {
+	FlushPendingText();
+
 	if (m_deferredCursorToEnd)
 	{
 		m_window->ScrollToBottom();
@@ -488,7 +492,70 @@ void ImGuiZepConsole::Notify(const std::shared_ptr<Zep::ZepMessage>& message)
 	}
 }
 
+void ImGuiZepConsole::SetDeferAppend(bool deferAppend)
+{
+	m_deferAppend = deferAppend;
+
+	if (!m_deferAppend)
+		FlushPendingText();
+}
+
+void ImGuiZepConsole::FlushPendingText()
+{
+	if (m_pendingText.empty())
+		return;
+
+	// Formatting can append more text (from the delegate), which then waits for the next render.
+	std::deque<PendingText> pendingText;
+	pendingText.swap(m_pendingText);
+	m_pendingLines = 0;
+
+	const ImGuiZepConsoleStyle style = m_style;
+	for (const PendingText& pending : pendingText)
+	{
+		m_style = pending.style;
+		InsertAppendedText(pending.text, pending.defaultColor, pending.appendNewLine);
+	}
+	m_style = style;
+
+	PruneBuffer();
+
+	if (m_lastCursorAtEnd && m_autoScroll)
+	{
+		m_deferredCursorToEnd = true;
+	}
+}
+
 void ImGuiZepConsole::AppendText(std::string_view text, MQColor defaultColor, bool appendNewLine)
+{
+	if (m_deferAppend)
+	{
+		const int lines = static_cast<int>(std::count(text.begin(), text.end(), '\n')) + (appendNewLine ? 1 : 0);
+
+		m_pendingText.push_back(PendingText{ std::string(text), m_style, defaultColor, appendNewLine, lines });
+		m_pendingLines += lines;
+
+		// Drop the oldest text once the rest is enough to fill the buffer on its own.
+		while (m_maxBufferLines > 0 && m_pendingText.size() > 1
+			&& m_pendingLines - m_pendingText.front().lines >= m_maxBufferLines)
+		{
+			m_pendingLines -= m_pendingText.front().lines;
+			m_pendingText.pop_front();
+		}
+
+		return;
+	}
+
+	InsertAppendedText(text, defaultColor, appendNewLine);
+	PruneBuffer();
+
+	if (m_lastCursorAtEnd && m_autoScroll)
+	{
+		m_deferredCursorToEnd = true;
+	}
+}
+
+void ImGuiZepConsole::InsertAppendedText(std::string_view text, MQColor defaultColor, bool appendNewLine)
 {
 	std::string_view lineView = text;
 	int pushed = 0;
@@ -536,16 +603,13 @@ void ImGuiZepConsole::AppendText(std::string_view text, MQColor defaultColor, bo
 		InsertText(m_buffer->End(), "\n");
 
 	PopStyleColor(pushed);
-	PruneBuffer();
-
-	if (m_lastCursorAtEnd && m_autoScroll)
-	{
-		m_deferredCursorToEnd = true;
-	}
 }
 
 void ImGuiZepConsole::Clear()
 {
+	m_pendingText.clear();
+	m_pendingLines = 0;
+
 	m_buffer->Clear();
 }
 
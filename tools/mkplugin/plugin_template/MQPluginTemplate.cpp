@@ -10,12 +10,65 @@
 PreSetup("MQPluginTemplate");
 PLUGIN_VERSION(0.1);
 
+/**
+ * If OnPulse doesn't need to run every frame, MacroQuest can call it less often
+ * instead. See PluginPulseTier for the choices.
+ */
+// PLUGIN_PULSE_TIER(TenPerSecond);
+
 /**
  * Avoid Globals if at all possible, since they persist throughout your program.
  * But if you must have them, here is the place to put them.
  */
 // bool ShowMQPluginTemplateWindow = true;
 
+/**
+ * Benchmarks for the callbacks that are called the most often. They show up in
+ * /benchmark and in the Benchmarks inspector of the developer tools, next to the time
+ * that MacroQuest measures for every callback of the plugin. Add one for any other
+ * work that you want to keep an eye on.
+ */
+static uint32_t bmOnPulse = 0;
+static uint32_t bmOnWriteChatColor = 0;
+static uint32_t bmOnDrawHUD = 0;
+static uint32_t bmOnUpdateImGui = 0;
+
+/**
+ * @class PulseThrottle
+ *
+ * Lets some work run at most once per interval, for code in callbacks that are
+ * called every frame.
+ *
+ * Usage:
+ *     static PulseThrottle throttle(std::chrono::milliseconds(500));
+ *     if (throttle.Ready())
+ *     {
+ *         // ... runs twice a second
+ *     }
+ */
+class PulseThrottle
+{
+public:
+	explicit PulseThrottle(std::chrono::steady_clock::duration interval) : m_interval(interval) {}
+
+	bool Ready()
+	{
+		const auto now = std::chrono::steady_clock::now();
+		if (now < m_next)
+			return false;
+
+		m_next = now + m_interval;
+		return true;
+	}
+
+	// Make the next call to Ready succeed, for when something changed that needs the work done now.
+	void Reset() { m_next = {}; }
+
+private:
+	std::chrono::steady_clock::duration m_interval;
+	std::chrono::steady_clock::time_point m_next;
+};
+
 /**
  * @fn InitializePlugin
  *
@@ -26,6 +79,11 @@ PLUGIN_API void InitializePlugin()
 {
 	DebugSpewAlways("MQPluginTemplate::Initializing version %f", MQ2Version);
 
+	bmOnPulse = AddMQ2Benchmark("MQPluginTemplate::OnPulse");
+	bmOnWriteChatColor = AddMQ2Benchmark("MQPluginTemplate::OnWriteChatColor");
+	bmOnDrawHUD = AddMQ2Benchmark("MQPluginTemplate::OnDrawHUD");
+	bmOnUpdateImGui = AddMQ2Benchmark("MQPluginTemplate::OnUpdateImGui");
+
 	// Examples:
 	// AddCommand("/mycommand", MyCommand);
 	// AddXMLFile("MQUI_MyXMLFile.xml");
@@ -42,6 +100,11 @@ PLUGIN_API void ShutdownPlugin()
 {
 	DebugSpewAlways("MQPluginTemplate::Shutting down");
 
+	RemoveMQ2Benchmark(bmOnPulse);
+	RemoveMQ2Benchmark(bmOnWriteChatColor);
+	RemoveMQ2Benchmark(bmOnDrawHUD);
+	RemoveMQ2Benchmark(bmOnUpdateImGui);
+
 	// Examples:
 	// RemoveCommand("/mycommand");
 	// RemoveXMLFile("MQUI_MyXMLFile.xml");
@@ -88,19 +151,18 @@ PLUGIN_API void OnReloadUI()
  * Note that this is not called at all if the HUD is not shown (default F11 to
  * toggle).
  *
- * Because the net status is updated frequently, it is recommended to have a
- * timer or counter at the start of this call to limit the amount of times the
- * code in this section is executed.
+ * Because the net status is updated frequently, it is recommended to use a
+ * PulseThrottle at the start of this call to limit the amount of times the code
+ * in this section is executed.
  */
 PLUGIN_API void OnDrawHUD()
 {
+	MQScopedBenchmark bm(bmOnDrawHUD);
 /*
-	static std::chrono::steady_clock::time_point DrawHUDTimer = std::chrono::steady_clock::now();
-	// Run only after timer is up
-	if (std::chrono::steady_clock::now() > DrawHUDTimer)
+	// Run at most twice a second
+	static PulseThrottle DrawHUDTimer(std::chrono::milliseconds(500));
+	if (DrawHUDTimer.Ready())
 	{
-		// Wait half a second before running again
-		DrawHUDTimer = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
 		DebugSpewAlways("MQPluginTemplate::OnDrawHUD()");
 	}
 */
@@ -133,19 +195,18 @@ PLUGIN_API void SetGameState(int GameState)
  *
  * This is called each time MQ2 goes through its heartbeat (pulse) function.
  *
- * Because this happens very frequently, it is recommended to have a timer or
- * counter at the start of this call to limit the amount of times the code in
- * this section is executed.
+ * Because this happens very frequently, it is recommended to use a PulseThrottle
+ * at the start of this call to limit the amount of times the code in this section
+ * is executed, or to set a PLUGIN_PULSE_TIER at the top of this file.
  */
 PLUGIN_API void OnPulse()
 {
+	MQScopedBenchmark bm(bmOnPulse);
 /*
-	static std::chrono::steady_clock::time_point PulseTimer = std::chrono::steady_clock::now();
-	// Run only after timer is up
-	if (std::chrono::steady_clock::now() > PulseTimer)
+	// Run at most once every 5 seconds
+	static PulseThrottle PulseTimer(std::chrono::seconds(5));
+	if (PulseTimer.Ready())
 	{
-		// Wait 5 seconds before running again
-		PulseTimer = std::chrono::steady_clock::now() + std::chrono::seconds(5);
 		DebugSpewAlways("MQPluginTemplate::OnPulse()");
 	}
 */
@@ -173,6 +234,7 @@ PLUGIN_API void OnPulse()
  */
 PLUGIN_API void OnWriteChatColor(const char* Line, int Color, int Filter)
 {
+	MQScopedBenchmark bm(bmOnWriteChatColor);
 	// DebugSpewAlways("MQPluginTemplate::OnWriteChatColor(%s, %d, %d)", Line, Color, Filter);
 }
 
@@ -309,6 +371,7 @@ PLUGIN_API void OnZoned()
  */
 PLUGIN_API void OnUpdateImGui()
 {
+	MQScopedBenchmark bm(bmOnUpdateImGui);
 /*
 	if (GetGameState() == GAMESTATE_INGAME)
 	{